@@ -29,7 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* Simple re-sizable vector that acts as a queue */
+/* Simple re-sizable vector */
 #define VEC(T) struct { T* data; size_t len, cap; }
 
 #define VEC_INIT(V)                             \
@@ -52,39 +52,63 @@
     V.data[V.len++] = X;                                \
   } while(0)                                            \
 
-#define VEC_POP(V)                                              \
-  do {                                                          \
-    if (V.len > 0)                                              \
-      memmove(V.data, V.data+1, (--V.len)*sizeof(*V.data));     \
-  } while(0)
+/* A ring of messages that doubles when full, so push and pop are O(1) */
+typedef struct ring_t {
+  pn_rwbytes_t *data;
+  size_t head, len, cap;
+} ring_t;
+
+static void ring_init(ring_t *r) {
+  r->head = r->len = 0;
+  r->cap = 16;
+  r->data = (pn_rwbytes_t*)malloc(r->cap * sizeof(*r->data));
+}
+
+static void ring_push(ring_t *r, pn_rwbytes_t m) {
+  if (r->len == r->cap) {       /* Grow, moving the wrapped part after the rest */
+    r->data = (pn_rwbytes_t*)realloc(r->data, 2 * r->cap * sizeof(*r->data));
+    memcpy(r->data + r->cap, r->data, r->head * sizeof(*r->data));
+    r->cap *= 2;
+  }
+  r->data[(r->head + r->len++) % r->cap] = m;
+}
+
+static pn_rwbytes_t ring_pop(ring_t *r) {
+  pn_rwbytes_t m = r->data[r->head];
+  r->head = (r->head + 1) % r->cap;
+  --r->len;
+  return m;
+}
 
-/* Simple thread-safe queue implementation */
+/* Simple thread-safe queue implementation.
+   The lock is only held to move messages and waiting connections in
+   and out, never while encoding, sending or waking. */
 typedef struct queue_t {
   pthread_mutex_t lock;
   char name[256];
-  VEC(pn_rwbytes_t) messages;   /* Messages on the queue_t */
+  ring_t messages;                 /* Messages on the queue_t */
   VEC(pn_connection_t*) waiting; /* Connections waiting to send messages from this queue */
   struct queue_t *next;            /* Next queue in chain */
   size_t sent;                     /* Count of messages sent, used as delivery tag */
+  size_t received;                 /* Count of messages received, for stats */
 } queue_t;
 
 static void queue_init(queue_t *q, const char* name, queue_t *next) {
   pthread_mutex_init(&q->lock, NULL);
-  strncpy(q->name, name, sizeof(q->name));
-  VEC_INIT(q->messages);
+  strncpy(q->name, name, sizeof(q->name) - 1);
+  q->name[sizeof(q->name) - 1] = '\0';
+  ring_init(&q->messages);
   VEC_INIT(q->waiting);
   q->next = next;
   q->sent = 0;
+  q->received = 0;
 }
 
 static void queue_destroy(queue_t *q) {
   pthread_mutex_destroy(&q->lock);
-  free(q->name);
-  for (size_t i = 0; i < q->messages.len; ++i)
-    free(q->messages.data[i].start);
-  VEC_FINAL(q->messages);
-  for (size_t i = 0; i < q->waiting.len; ++i)
-    pn_decref(q->waiting.data[i]);
+  while (q->messages.len)
+    free(ring_pop(&q->messages).start);
+  free(q->messages.data);
   VEC_FINAL(q->waiting);
 }
 
@@ -105,8 +129,7 @@ static void queue_send(queue_t *q, pn_link_t *s) {
       VEC_PUSH(q->waiting, c);
     }
   } else {
-    m = q->messages.data[0];
-    VEC_POP(q->messages);
+    m = ring_pop(&q->messages);
     tag = ++q->sent;
   }
   pthread_mutex_unlock(&q->lock);
@@ -137,60 +160,104 @@ bool pn_connection_get_check_queues(pn_connection_t *c) {
    If the queue was previously empty, notify waiting senders.
 */
 static void queue_receive(pn_proactor_t *d, queue_t *q, pn_rwbytes_t m) {
+  pn_connection_t **waiting = NULL;
+  size_t n = 0;
   pthread_mutex_lock(&q->lock);
-  VEC_PUSH(q->messages, m);
-  if (q->messages.len == 1) { /* Was empty, notify waiting connections */
-    for (size_t i = 0; i < q->waiting.len; ++i) {
-      pn_connection_t *c = q->waiting.data[i];
-      pn_connection_set_check_queues(c, true);
-      pn_connection_wake(c); /* Wake the connection */
-    }
-    q->waiting.len = 0;
+  ring_push(&q->messages, m);
+  ++q->received;
+  if (q->messages.len == 1 && q->waiting.len) { /* Was empty, take the waiting connections */
+    waiting = q->waiting.data;
+    n = q->waiting.len;
+    VEC_INIT(q->waiting);
   }
   pthread_mutex_unlock(&q->lock);
+  for (size_t i = 0; i < n; ++i) {
+    pn_connection_set_check_queues(waiting[i], true);
+    pn_connection_wake(waiting[i]); /* Wake the connection */
+  }
+  free(waiting);
 }
 
-/* Thread safe set of queues */
-typedef struct queues_t {
+/* Thread safe set of queues, split into shards by name so that
+   attaching links only contend with links to queues in their shard */
+#define QUEUE_SHARDS 16
+
+typedef struct queue_shard_t {
   pthread_mutex_t lock;
   queue_t *queues;
-  size_t sent;
+} queue_shard_t;
+
+typedef struct queues_t {
+  queue_shard_t shards[QUEUE_SHARDS];
 } queues_t;
 
 void queues_init(queues_t *qs) {
-  pthread_mutex_init(&qs->lock, NULL);
-  qs->queues = NULL;
+  for (size_t i = 0; i < QUEUE_SHARDS; ++i) {
+    pthread_mutex_init(&qs->shards[i].lock, NULL);
+    qs->shards[i].queues = NULL;
+  }
 }
 
 void queues_destroy(queues_t *qs) {
-  for (queue_t *q = qs->queues; q; q = q->next) {
-    queue_destroy(q);
-    free(q);
+  for (size_t i = 0; i < QUEUE_SHARDS; ++i) {
+    queue_t *q = qs->shards[i].queues;
+    while (q) {
+      queue_t *next = q->next;
+      queue_destroy(q);
+      free(q);
+      q = next;
+    }
+    pthread_mutex_destroy(&qs->shards[i].lock);
   }
-  pthread_mutex_destroy(&qs->lock);
 }
 
-/** Get or create the named queue. */
+/* FNV-1a */
+static size_t queue_hash(const char *name) {
+  size_t h = 2166136261u;
+  for (; *name; ++name) h = (h ^ (unsigned char)*name) * 16777619u;
+  return h;
+}
+
+/** Get or create the named queue. Queues live until the broker exits,
+    so links keep the queue they attach to in their context. */
 queue_t* queues_get(queues_t *qs, const char* name) {
-  pthread_mutex_lock(&qs->lock);
+  queue_shard_t *shard = &qs->shards[queue_hash(name) % QUEUE_SHARDS];
+  pthread_mutex_lock(&shard->lock);
   queue_t *q;
-  for (q = qs->queues; q && strcmp(q->name, name) != 0; q = q->next)
+  for (q = shard->queues; q && strcmp(q->name, name) != 0; q = q->next)
     ;
   if (!q) {
     q = (queue_t*)malloc(sizeof(queue_t));
-    queue_init(q, name, qs->queues);
-    qs->queues = q;
+    queue_init(q, name, shard->queues);
+    shard->queues = q;
   }
-  pthread_mutex_unlock(&qs->lock);
+  pthread_mutex_unlock(&shard->lock);
   return q;
 }
 
+/* Total messages received and sent by all queues */
+static void queues_count(queues_t *qs, size_t *received, size_t *sent) {
+  *received = *sent = 0;
+  for (size_t i = 0; i < QUEUE_SHARDS; ++i) {
+    pthread_mutex_lock(&qs->shards[i].lock);
+    for (queue_t *q = qs->shards[i].queues; q; q = q->next) {
+      pthread_mutex_lock(&q->lock);
+      *received += q->received;
+      *sent += q->sent;
+      pthread_mutex_unlock(&q->lock);
+    }
+    pthread_mutex_unlock(&qs->shards[i].lock);
+  }
+}
+
 /* The broker implementation */
 typedef struct broker_t {
   pn_proactor_t *proactor;
   size_t threads;
   const char *container_id;     /* AMQP container-id */
   queues_t queues;
+  pn_millis_t stats_interval;   /* Print throughput this often if not 0 */
+  size_t last_received, last_sent;
   bool finished;
 } broker_t;
 
@@ -199,11 +266,15 @@ void broker_stop(broker_t *b) {
   pn_proactor_interrupt(b->proactor);
 }
 
+/* The queue a link is attached to, looked up once when it opens */
+static queue_t *link_queue(pn_link_t *l) {
+  return (queue_t*)pn_link_get_context(l);
+}
+
 /* Try to send if link is sender and has credit */
 static void link_send(broker_t *b, pn_link_t *s) {
-  if (pn_link_is_sender(s) && pn_link_credit(s) > 0) {
-    const char *qname = pn_terminus_get_address(pn_link_source(s));
-    queue_t *q = queues_get(&b->queues, qname);
+  queue_t *q = link_queue(s);
+  if (q && pn_link_is_sender(s) && pn_link_credit(s) > 0) {
     queue_send(q, s);
   }
 }
@@ -212,8 +283,7 @@ static void queue_unsub(queue_t *q, pn_connection_t *c) {
   pthread_mutex_lock(&q->lock);
   for (size_t i = 0; i < q->waiting.len; ++i) {
     if (q->waiting.data[i] == c){
-      q->waiting.data[i] = q->waiting.data[0]; /* save old [0] */
-      VEC_POP(q->waiting);
+      q->waiting.data[i] = q->waiting.data[--q->waiting.len];
       break;
     }
   }
@@ -222,15 +292,24 @@ static void queue_unsub(queue_t *q, pn_connection_t *c) {
 
 /* Unsubscribe from the queue of interest to this link. */
 static void link_unsub(broker_t *b, pn_link_t *s) {
-  if (pn_link_is_sender(s)) {
-    const char *qname = pn_terminus_get_address(pn_link_source(s));
-    if (qname) {
-      queue_t *q = queues_get(&b->queues, qname);
-      queue_unsub(q, pn_session_connection(pn_link_session(s)));
-    }
+  queue_t *q = link_queue(s);
+  if (q && pn_link_is_sender(s)) {
+    queue_unsub(q, pn_session_connection(pn_link_session(s)));
   }
 }
 
+/* Print messages received and sent per second since the last time */
+static void print_stats(broker_t *b) {
+  size_t received, sent;
+  queues_count(&b->queues, &received, &sent);
+  double secs = b->stats_interval / 1000.0;
+  printf("received %.0f/s sent %.0f/s\n",
+         (received - b->last_received) / secs, (sent - b->last_sent) / secs);
+  fflush(stdout);
+  b->last_received = received;
+  b->last_sent = sent;
+}
+
 /* Called in connection's event loop when a connection is woken for messages.*/
 static void connection_unsub(broker_t *b, pn_connection_t *c) {
   for (pn_link_t *l = pn_link_head(c, 0); l != NULL; l = pn_link_next(l, 0))
@@ -301,14 +380,16 @@ static void handle(broker_t* b, pn_event_t* e) {
    }
    case PN_LINK_REMOTE_OPEN: {
      pn_link_t *l = pn_event_link(e);
+     const char *address;
      if (pn_link_is_sender(l)) {
-       const char *source = pn_terminus_get_address(pn_link_remote_source(l));
-       pn_terminus_set_address(pn_link_source(l), source);
+       address = pn_terminus_get_address(pn_link_remote_source(l));
+       pn_terminus_set_address(pn_link_source(l), address);
      } else {
-       const char* target = pn_terminus_get_address(pn_link_remote_target(l));
-       pn_terminus_set_address(pn_link_target(l), target);
+       address = pn_terminus_get_address(pn_link_remote_target(l));
+       pn_terminus_set_address(pn_link_target(l), address);
        pn_link_flow(l, WINDOW);
      }
+     if (address) pn_link_set_context(l, queues_get(&b->queues, address));
      pn_link_open(l);
      break;
    }
@@ -326,9 +407,14 @@ static void handle(broker_t* b, pn_event_t* e) {
        /* The broker does not decode the message, just forwards it. */
        pn_rwbytes_t m = { size, (char*)malloc(size) };
        pn_link_recv(r, m.start, m.size);
-       const char *qname = pn_terminus_get_address(pn_link_target(r));
-       queue_receive(b->proactor, queues_get(&b->queues, qname), m);
-       pn_delivery_update(d, PN_ACCEPTED);
+       queue_t *q = link_queue(r);
+       if (q) {
+         queue_receive(b->proactor, q, m);
+         pn_delivery_update(d, PN_ACCEPTED);
+       } else {                 /* No target address */
+         free(m.start);
+         pn_delivery_update(d, PN_REJECTED);
+       }
        pn_delivery_settle(d);
        pn_link_flow(r, WINDOW - pn_link_credit(r));
      }
@@ -370,6 +456,11 @@ static void handle(broker_t* b, pn_event_t* e) {
     broker_stop(b);
     break;
 
+   case PN_PROACTOR_TIMEOUT:
+    print_stats(b);
+    pn_proactor_set_timeout(b->proactor, b->stats_interval);
+    break;
+
    case PN_PROACTOR_INTERRUPT:
     b->finished = true;
     pn_proactor_interrupt(b->proactor); /* Pass along the interrupt to the other threads */
@@ -402,6 +493,9 @@ int main(int argc, char **argv) {
   int i = 1;
   const char *host = (argc > i) ? argv[i++] : "";
   const char *port = (argc > i) ? argv[i++] : "amqp";
+  /* Benchmark mode: print throughput every interval milliseconds */
+  b.stats_interval = (argc > i) ? (pn_millis_t)atoi(argv[i++]) : 0;
+  if (b.stats_interval) pn_proactor_set_timeout(b.proactor, b.stats_interval);
 
   /* Listen on addr */
   char addr[PN_MAX_ADDR];
@@ -419,6 +513,7 @@ int main(int argc, char **argv) {
     pthread_join(threads[i], NULL);
   }
   pn_proactor_free(b.proactor);
+  queues_destroy(&b.queues);
   free(threads);
   return exit_code;
 }
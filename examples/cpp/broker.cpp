@@ -19,6 +19,7 @@
 
 #include "options.hpp"
 
+#include <proton/binary.hpp>
 #include <proton/connection.hpp>
 #include <proton/connection_options.hpp>
 #include <proton/container.hpp>
@@ -28,7 +29,6 @@
 #include <proton/function.hpp>
 #include <proton/listen_handler.hpp>
 #include <proton/listener.hpp>
-#include <proton/message.hpp>
 #include <proton/messaging_handler.hpp>
 #include <proton/receiver_options.hpp>
 #include <proton/sender_options.hpp>
@@ -39,10 +39,12 @@
 #include <proton/tracker.hpp>
 #include <proton/transport.hpp>
 
+#include <algorithm>
 #include <deque>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #if PN_CPP_SUPPORTS_THREADS
 #include <thread>
@@ -59,23 +61,32 @@
 //
 // Queues are only created and never destroyed
 //
+// Messages are never decoded: receivers stream the encoded bytes of each
+// message, queues hold them as proton::binary and senders forward them as
+// they are with sender::send_encoded().
+//
+// Each entity below has its own work_queue, so with several threads they all run in
+// parallel and only interact by scheduling work on each other: there are no locks.
+// Queue names are spread over several QueueManagers by hash, so looking queues up
+// is not serialised either.
+//
 // Broker Entities (that need to be individually serialised)
-// QueueManager - Creates new queues, finds queues
+// QueueManager - Creates new queues, finds queues, for the names that hash to it
 // Queue        - Queues msgs, records subscribers, sends msgs to subscribers
 // Connection   - Receives Messages from network, sends messages to network.
 
 // Work
-// FindQueue(queueName, connection) - From a Connection to the QueueManager
+// FindQueue(queueName, connection) - From a Connection to the queueName's QueueManager
 //     This will create the queue if it doesn't already exist and send a BoundQueue
 //     message back to the connection.
 // BoundQueue(queue) - From the QueueManager to a Connection
 //
-// QueueMsg(msg)        - From a Connection (receiver) to a Queue
+// QueueMsg(bytes)      - From a Connection (receiver) to a Queue
 // Subscribe(sender)    - From a Connection (sender) to a Queue
 // Flow(sender, credit) - From a Connection (sender) to a Queue
 // Unsubscribe(sender)  - From a Connection (sender) to a Queue
 //
-// SendMsg(msg)   - From a Queue to a Connection (sender)
+// SendMsg(bytes) - From a Queue to a Connection (sender)
 // Unsubscribed() - From a Queue to a Connection (sender)
 
 
@@ -113,9 +124,9 @@ public:
 
 
     void boundQueue(Queue* q, std::string qn);
-    void sendMsg(proton::message m) {
+    void sendMsg(proton::binary m) {
         DOUT(std::cerr << "Sender:   " << this << " sending\n";);
-        sender_.send(m);
+        sender_.send_encoded(m);
     }
     void unsubscribed() {
         DOUT(std::cerr << "Sender:   " << this << " deleting\n";);
@@ -127,7 +138,7 @@ public:
 class Queue {
     proton::work_queue work_queue_;
     const std::string name_;
-    std::deque<proton::message> messages_;
+    std::deque<proton::binary> messages_;
     typedef std::map<Sender*, int> subscriptions; // With credit
     subscriptions subscriptions_;
     subscriptions::iterator current_;
@@ -147,7 +158,10 @@ class Queue {
             DOUT(std::cerr << "(" << current_->second << ") ";);
             if (current_->second>0) {
                 DOUT(std::cerr << current_->first << " ";);
-                proton::schedule_work(current_->first, &Sender::sendMsg, current_->first, messages_.front());
+                // Keep the message if the sender's connection can't take it,
+                // it is tried again on the next flow or message
+                if (!proton::schedule_work(current_->first, &Sender::sendMsg, current_->first, messages_.front()))
+                    break;
                 messages_.pop_front();
                 --current_->second;
                 ++current_;
@@ -167,7 +181,7 @@ public:
         return work_queue_.add(f);
     }
 
-    void queueMsg(proton::message m) {
+    void queueMsg(proton::binary m) {
         DOUT(std::cerr << "Queue:    " << this << "(" << name_ << ") queueMsg\n";);
         messages_.push_back(m);
         tryToSend();
@@ -231,11 +245,15 @@ class Receiver : public proton::messaging_handler {
     proton::receiver receiver_;
     proton::work_queue& work_queue_;
     Queue* queue_;
-    std::deque<proton::message> messages_;
+    proton::binary partial_;            // The message being received
+    std::deque<proton::binary> messages_;
 
-    // A message is received.
-    void on_message(proton::delivery &, proton::message &m) OVERRIDE {
-        messages_.push_back(m);
+    // Part of a message is received, accepted after the last part.
+    void on_message_chunk(proton::delivery &, const proton::binary &chunk, bool last) OVERRIDE {
+        partial_.insert(partial_.end(), chunk.begin(), chunk.end());
+        if (!last) return;
+        messages_.push_back(proton::binary());
+        messages_.back().swap(partial_);
 
         if (queue_) {
             queueMsgs();
@@ -245,7 +263,9 @@ class Receiver : public proton::messaging_handler {
     void queueMsgs() {
         DOUT(std::cerr << "Receiver: " << this << " queueing " << messages_.size() << " msgs to: " << queue_ << "\n";);
         while (!messages_.empty()) {
-            proton::schedule_work(queue_, &Queue::queueMsg, queue_, messages_.front());
+            // Keep the message if the queue can't take it, it is tried again with the next one
+            if (!proton::schedule_work(queue_, &Queue::queueMsg, queue_, messages_.front()))
+                break;
             messages_.pop_front();
         }
     }
@@ -264,6 +284,7 @@ public:
         queue_ = q;
         receiver_.open(proton::receiver_options()
             .source((proton::source_options().address(qn)))
+            .stream_messages(true)
             .handler(*this));
         std::cout << "receiving to " << qn << std::endl;
 
@@ -271,16 +292,25 @@ public:
     }
 };
 
+// The QueueManager of a name, out of n
+size_t queueShard(const std::string& name, size_t n) {
+    size_t h = 2166136261u;     // FNV-1a
+    for (std::string::const_iterator i = name.begin(); i != name.end(); ++i)
+        h = (h ^ static_cast<unsigned char>(*i)) * 16777619u;
+    return h % n;
+}
+
 class QueueManager {
     proton::container& container_;
     proton::work_queue work_queue_;
     typedef std::map<std::string, Queue*> queues;
     queues queues_;
+    size_t shard_, shards_;     // Which of how many QueueManagers this is
     int next_id_; // Use to generate unique queue IDs.
 
 public:
-    QueueManager(proton::container& c) :
-        container_(c), work_queue_(c), next_id_(0)
+    QueueManager(proton::container& c, size_t shard, size_t shards) :
+        container_(c), work_queue_(c), shard_(shard), shards_(shards), next_id_(0)
     {}
 
     bool add(proton::work f) {
@@ -289,11 +319,11 @@ public:
 
     template <class T>
     void findQueue(T& connection, std::string& qn) {
-        if (qn.empty()) {
-            // Dynamic queue creation
+        while (qn.empty()) {
+            // Dynamic queue creation, with a name that is found here later
             std::ostringstream os;
             os << "_dynamic_" << next_id_++;
-            qn = os.str();
+            if (queueShard(os.str(), shards_) == shard_) qn = os.str();
         }
         Queue* q = 0;
         queues::iterator i = queues_.find(qn);
@@ -315,13 +345,33 @@ public:
     }
 };
 
+// All the QueueManagers
+class QueueDirectory {
+    std::vector<QueueManager*> managers_;
+
+public:
+    QueueDirectory(proton::container& c, size_t n) {
+        for (size_t i = 0; i < n; ++i)
+            managers_.push_back(new QueueManager(c, i, n));
+    }
+
+    ~QueueDirectory() {
+        for (size_t i = 0; i < managers_.size(); ++i)
+            delete managers_[i];
+    }
+
+    QueueManager& manager(const std::string& name) {
+        return *managers_[queueShard(name, managers_.size())];
+    }
+};
+
 class connection_handler : public proton::messaging_handler {
-    QueueManager& queue_manager_;
+    QueueDirectory& directory_;
     senders senders_;
 
 public:
-    connection_handler(QueueManager& qm) :
-        queue_manager_(qm)
+    connection_handler(QueueDirectory& d) :
+        directory_(d)
     {}
 
     void on_connection_open(proton::connection& c) OVERRIDE {
@@ -333,7 +383,9 @@ public:
         std::string qn = sender.source().dynamic() ? "" : sender.source().address();
         Sender* s = new Sender(sender, senders_);
         senders_[sender] = s;
-        proton::schedule_work(&queue_manager_, &QueueManager::findQueueSender, &queue_manager_, s, qn);
+        // Dynamic queues are spread by link name
+        QueueManager* qm = &directory_.manager(qn.empty() ? sender.name() : qn);
+        proton::schedule_work(qm, &QueueManager::findQueueSender, qm, s, qn);
     }
 
     // A receiver receives messages from a publisher to a queue.
@@ -349,7 +401,8 @@ public:
                 DOUT(std::cerr << "ODD - trying to attach to a empty address\n";);
             }
             Receiver* r = new Receiver(receiver);
-            proton::schedule_work(&queue_manager_, &QueueManager::findQueueReceiver, &queue_manager_, r, qname);
+            QueueManager* qm = &directory_.manager(qname);
+            proton::schedule_work(qm, &QueueManager::findQueueReceiver, qm, r, qname);
         }
     }
 
@@ -387,8 +440,8 @@ public:
 
 class broker {
   public:
-    broker(const std::string addr) :
-        container_("broker"), queues_(container_), listener_(queues_)
+    broker(const std::string addr, int threads) :
+        container_("broker"), threads_(threads), queues_(container_, size_t(threads)), listener_(queues_)
     {
         container_.listen(addr, listener_);
         std::cout << "broker listening on " << addr << std::endl;
@@ -396,8 +449,8 @@ class broker {
 
     void run() {
 #if PN_CPP_SUPPORTS_THREADS
-        std::cout << "starting " << std::thread::hardware_concurrency() << " listening threads\n";
-        container_.run(std::thread::hardware_concurrency());
+        std::cout << "starting " << threads_ << " listening threads\n";
+        container_.run(threads_);
 #else
         container_.run();
 #endif
@@ -405,7 +458,7 @@ class broker {
 
   private:
     struct listener : public proton::listen_handler {
-        listener(QueueManager& c) : queues_(c) {}
+        listener(QueueDirectory& c) : queues_(c) {}
 
         proton::connection_options on_accept(proton::listener&) OVERRIDE{
             return proton::connection_options().handler(*(new connection_handler(queues_)));
@@ -415,11 +468,12 @@ class broker {
             std::cerr << "listen error: " << s << std::endl;
             throw std::runtime_error(s);
         }
-        QueueManager& queues_;
+        QueueDirectory& queues_;
     };
 
     proton::container container_;
-    QueueManager queues_;
+    int threads_;
+    QueueDirectory queues_;
     listener listener_;
 };
 
@@ -430,11 +484,18 @@ int main(int argc, char **argv) {
 
     opts.add_flag(verbose, 'v', "verbose", "verbose (debugging) output");
     opts.add_value(address, 'a', "address", "listen on URL", "URL");
+#if PN_CPP_SUPPORTS_THREADS
+    int threads = std::max(1, int(std::thread::hardware_concurrency()));
+    opts.add_value(threads, 't', "threads", "run N threads, each queue manager and queue on one at a time", "N");
+#else
+    int threads = 1;
+#endif
 
     try {
         verbose = false;
         opts.parse();
-        broker(address).run();
+        if (threads < 1) throw example::bad_option("threads must be at least 1");
+        broker(address, threads).run();
         return 0;
     } catch (const example::bad_option& e) {
         std::cout << opts << std::endl << e.what() << std::endl;
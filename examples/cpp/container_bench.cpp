@@ -0,0 +1,358 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "options.hpp"
+
+#include <proton/binary.hpp>
+#include <proton/connection.hpp>
+#include <proton/connection_options.hpp>
+#include <proton/container.hpp>
+#include <proton/delivery.hpp>
+#include <proton/error_condition.hpp>
+#include <proton/listen_handler.hpp>
+#include <proton/listener.hpp>
+#include <proton/message.hpp>
+#include <proton/message_id.hpp>
+#include <proton/messaging_handler.hpp>
+#include <proton/receiver_options.hpp>
+#include <proton/sender.hpp>
+#include <proton/thread_safe.hpp>
+#include <proton/tracker.hpp>
+#include <proton/transport.hpp>
+#include <proton/work_queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Container benchmark: one multi-threaded container listens and also makes
+// the client connections.  Each client connection opens a number of
+// senders and sends as fast as credit allows, the server side receives.
+// An optional injector thread calls work_queue::add() on the client
+// connections at a fixed rate.
+//
+// Reports send to on_message() latency and work_queue::add() to execution
+// latency as log-linear (HDR style) histograms.
+
+namespace {
+
+typedef std::chrono::steady_clock steady;
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady::now().time_since_epoch()).count();
+}
+
+// Log-linear histogram of nanosecond values: 32 buckets per power of 2,
+// so values are recorded to within about 3%.
+class histogram {
+    static const int SUB = 32;
+    std::vector<uint64_t> counts_;
+    uint64_t total_, max_;
+
+    static size_t index(uint64_t v) {
+        if (v < SUB) return size_t(v);
+        int e = 63;
+        while (!(v >> e)) --e;
+        return size_t(e - 4) * SUB + size_t((v >> (e - 5)) & (SUB - 1));
+    }
+
+    static uint64_t value(size_t i) {
+        if (i < SUB) return i;
+        int e = int(i / SUB) + 4;
+        return uint64_t(SUB + i % SUB) << (e - 5);
+    }
+
+  public:
+    histogram() : counts_(64 * SUB), total_(0), max_(0) {}
+
+    void add(uint64_t v) {
+        ++counts_[index(v)];
+        ++total_;
+        if (v > max_) max_ = v;
+    }
+
+    void merge(const histogram& h) {
+        for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += h.counts_[i];
+        total_ += h.total_;
+        if (h.max_ > max_) max_ = h.max_;
+    }
+
+    uint64_t total() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    uint64_t percentile(double p) const {
+        uint64_t want = uint64_t(p / 100.0 * total_ + 0.5), seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen && seen >= want) return value(i);
+        }
+        return max_;
+    }
+
+    void print(const char* what) const {
+        std::printf("%s latency us (%llu): p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+                    what, (unsigned long long)total_,
+                    percentile(50) / 1e3, percentile(90) / 1e3, percentile(99) / 1e3,
+                    percentile(99.9) / 1e3, max_ / 1e3);
+    }
+};
+
+struct settings {
+    int threads, connections, links, messages, credit, work_rate;
+    size_t size;
+};
+
+class bench;
+
+// Sending end of a client connection
+class client : public proton::messaging_handler {
+    bench& bench_;
+    std::map<proton::sender, int> sent_;
+    int acked_;
+    histogram work_;
+    std::mutex lock_;
+    proton::work_queue* work_queue_; // Cleared under lock_ before the connection closes
+
+  public:
+    client(bench& b) : bench_(b), acked_(0), work_queue_(0) {}
+
+    void on_connection_open(proton::connection& c) override;
+    void on_sendable(proton::sender& s) override;
+    void on_tracker_accept(proton::tracker& t) override;
+    void on_transport_close(proton::transport&) override;
+    void on_error(const proton::error_condition& e) override;
+
+    // Called by the injector thread: 1 if work was added, -1 if refused, 0 if not open
+    int add_work() {
+        std::lock_guard<std::mutex> l(lock_);
+        if (!work_queue_) return 0;
+        uint64_t added = now_ns();
+        return work_queue_->add([this, added]() { work_.add(now_ns() - added); }) ? 1 : -1;
+    }
+
+    void stop_work() {
+        std::lock_guard<std::mutex> l(lock_);
+        work_queue_ = 0;
+    }
+
+    const histogram& work_latency() const { return work_; }
+};
+
+// Receiving end, one per accepted connection
+class server : public proton::messaging_handler {
+    int credit_;
+    histogram latency_;
+
+  public:
+    explicit server(int credit) : credit_(credit) {}
+
+    void on_receiver_open(proton::receiver& r) override {
+        r.open(proton::receiver_options().credit_window(credit_));
+    }
+
+    void on_message(proton::delivery&, proton::message& m) override {
+        latency_.add(now_ns() - proton::get<uint64_t>(m.id()));
+    }
+
+    void on_error(const proton::error_condition& e) override {
+        std::cerr << "server error: " << e.what() << std::endl;
+    }
+
+    const histogram& latency() const { return latency_; }
+};
+
+class bench : public proton::listen_handler {
+  public:
+    const settings settings_;
+    const proton::binary payload;
+
+    bench(const settings& s) :
+        settings_(s), payload(s.size, 0), container_("container_bench"),
+        closed_(0), errors_(0), done_(false), adds_(0), add_failures_(0)
+    {}
+
+    int run(const std::string& address) {
+        listener_ = container_.listen(address, *this);
+        for (int i = 0; i < settings_.connections; ++i) {
+            clients_.push_back(std::unique_ptr<client>(new client(*this)));
+            container_.connect(address, proton::connection_options().handler(*clients_.back()));
+        }
+        std::thread injector;
+        if (settings_.work_rate > 0) injector = std::thread([this]() { inject(); });
+
+        uint64_t start = now_ns();
+        container_.run(settings_.threads);
+        double secs = (now_ns() - start) / 1e9;
+
+        done_ = true;
+        if (injector.joinable()) injector.join();
+        report(secs);
+        return errors_ ? 1 : 0;
+    }
+
+    // Called by client connections
+    void client_closed() {
+        if (++closed_ == settings_.connections) {
+            done_ = true;
+            listener_.stop();
+        }
+    }
+
+    void error(const std::string& what) {
+        std::cerr << what << std::endl;
+        ++errors_;
+    }
+
+  private:
+    proton::container container_;
+    proton::listener listener_;
+    std::vector<std::unique_ptr<client> > clients_;
+    std::mutex lock_;
+    std::vector<std::unique_ptr<server> > servers_; // Guarded by lock_
+    std::atomic<int> closed_;
+    std::atomic<int> errors_;
+    std::atomic<bool> done_;
+    uint64_t adds_, add_failures_; // Only used by the injector thread
+
+    proton::connection_options on_accept(proton::listener&) override {
+        std::lock_guard<std::mutex> l(lock_);
+        servers_.push_back(std::unique_ptr<server>(new server(settings_.credit)));
+        return proton::connection_options().handler(*servers_.back());
+    }
+
+    void on_error(proton::listener&, const std::string& s) override {
+        error("listen error: " + s);
+        throw std::runtime_error(s);
+    }
+
+    // Add work to the client connections round-robin at work_rate per second
+    void inject() {
+        const steady::duration interval = std::chrono::nanoseconds(1000000000 / settings_.work_rate);
+        steady::time_point next = steady::now();
+        size_t i = 0;
+        while (!done_) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+            switch (clients_[i++ % clients_.size()]->add_work()) {
+              case 1: ++adds_; break;
+              case -1: ++add_failures_; break;
+            }
+        }
+    }
+
+    void report(double secs) {
+        histogram latency, work;
+        for (size_t i = 0; i < servers_.size(); ++i) latency.merge(servers_[i]->latency());
+        for (size_t i = 0; i < clients_.size(); ++i) work.merge(clients_[i]->work_latency());
+        uint64_t want = uint64_t(settings_.connections) * settings_.links * settings_.messages;
+
+        std::printf("threads %d connections %d links %d messages %llu size %zu credit %d\n",
+                    settings_.threads, settings_.connections, settings_.links,
+                    (unsigned long long)want, settings_.size, settings_.credit);
+        std::printf("%.3f s %.0f msgs/s\n", secs, secs > 0 ? latency.total() / secs : 0.0);
+        latency.print("send to on_message");
+        if (settings_.work_rate > 0) {
+            std::printf("work_queue::add %llu added, %llu refused\n",
+                        (unsigned long long)adds_, (unsigned long long)add_failures_);
+            work.print("work_queue::add to run");
+        }
+        if (latency.total() != want) {
+            std::cerr << "received " << latency.total() << " of " << want << " messages" << std::endl;
+            ++errors_;
+        }
+    }
+};
+
+void client::on_connection_open(proton::connection& c) {
+    for (int i = 0; i < bench_.settings_.links; ++i) {
+        sent_[c.open_sender("bench")] = 0;
+    }
+    std::lock_guard<std::mutex> l(lock_);
+    work_queue_ = &c.work_queue();
+}
+
+void client::on_sendable(proton::sender& s) {
+    int& sent = sent_[s];
+    while (sent < bench_.settings_.messages && s.credit() > 0) {
+        proton::message m;
+        m.id(uint64_t(now_ns()));
+        m.body(bench_.payload);
+        s.send(m);
+        ++sent;
+    }
+}
+
+void client::on_tracker_accept(proton::tracker& t) {
+    if (++acked_ == bench_.settings_.links * bench_.settings_.messages) {
+        stop_work();
+        t.connection().close();
+    }
+}
+
+void client::on_transport_close(proton::transport&) {
+    stop_work();
+    bench_.client_closed();
+}
+
+void client::on_error(const proton::error_condition& e) {
+    bench_.error("client error: " + e.what());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string address("127.0.0.1:5672");
+    settings s;
+    s.threads = int(std::thread::hardware_concurrency());
+    s.connections = 10;
+    s.links = 1;
+    s.messages = 10000;
+    s.credit = 100;
+    s.work_rate = 0;
+    s.size = 100;
+    example::options opts(argc, argv);
+
+    opts.add_value(address, 'a', "address", "listen and connect on URL", "URL");
+    opts.add_value(s.threads, 't', "threads", "container threads", "N");
+    opts.add_value(s.connections, 'c', "connections", "client connections", "N");
+    opts.add_value(s.links, 'l', "links", "senders per connection", "N");
+    opts.add_value(s.messages, 'm', "messages", "messages per sender", "N");
+    opts.add_value(s.size, 's', "size", "message body size in bytes", "N");
+    opts.add_value(s.credit, 'w', "credit", "receiver credit window", "N");
+    opts.add_value(s.work_rate, 'r', "work-rate", "work_queue::add calls per second, 0 for none", "N");
+
+    try {
+        opts.parse();
+        if (s.threads < 1) s.threads = 1;
+        return bench(s).run(address);
+    } catch (const example::bad_option& e) {
+        std::cout << opts << std::endl << e.what() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return 1;
+}
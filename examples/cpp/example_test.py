@@ -224,6 +224,15 @@ map{string(k1):int(42), symbol(k2):boolean(0)}
         except ProcError:       # File not found, not a C++11 build.
             pass
 
+    def test_container_bench(self):
+        try:
+            with TestPort() as tp:
+                out = self.proc(["container_bench", "-a", tp.addr, "-t", "2", "-c", "4", "-l", "2",
+                                 "-m", "100", "-r", "1000"]).wait_exit()
+                self.assertTrue("send to on_message latency us (800)" in out, out)
+        except ProcError:       # File not found, not a C++11 build.
+            pass
+
     def test_message_properties(self):
         expect="""using put/get: short=123 string=foo symbol=sym
 using coerce: short(as long)=123
@@ -64,10 +64,14 @@ class selected_recv : public proton::messaging_handler {
     selected_recv(const std::string& u) : url(u) {}
 
     void on_container_start(proton::container &c) OVERRIDE {
+        const std::string selector("colour = 'green'");
         proton::source_options opts;
-        set_filter(opts, "colour = 'green'");
+        set_filter(opts, selector);
         proton::connection conn = c.connect(url);
-        conn.open_receiver(url.path(), proton::receiver_options().source(opts));
+        // The same selector is applied as messages arrive, in case the
+        // broker ignores the filter. Messages it does not match are
+        // given back to the broker without being decoded.
+        conn.open_receiver(url.path(), proton::receiver_options().source(opts).selector(selector));
     }
 
     void on_message(proton::delivery &, proton::message &m) OVERRIDE {
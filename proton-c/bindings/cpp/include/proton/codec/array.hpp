@@ -0,0 +1,79 @@
+#ifndef PROTON_CODEC_ARRAY_HPP
+#define PROTON_CODEC_ARRAY_HPP
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/// @file
+/// Enable conversions between proton::value and std::array
+
+#include "../error.hpp"
+#include "./encoder.hpp"
+#include "./decoder.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace proton {
+namespace codec {
+
+/// @cond INTERNAL
+namespace array_impl {
+template <class T, size_t N> encoder& encode(encoder& e, const std::array<T, N>& x, internal::false_type) {
+    return e << encoder::array(x, internal::type_id_of<T>::value);
+}
+
+// Fixed-width elements are contiguous, copy them all at once
+template <class T, size_t N> encoder& encode(encoder& e, const std::array<T, N>& x, internal::true_type) {
+    return e.insert_array(internal::type_id_of<T>::value, x.data(), N);
+}
+
+template <class T, size_t N> decoder& decode(decoder& d, std::array<T, N>& x, internal::false_type) {
+    start s;
+    d >> s;
+    if (s.size != N) throw conversion_error("sequence size does not match std::array size");
+    if (s.is_described) d.next();
+    for (size_t i = 0; i < N; ++i)
+        d >> x[i];
+    return d;
+}
+
+template <class T, size_t N> decoder& decode(decoder& d, std::array<T, N>& x, internal::true_type) {
+    long n = d.array_size(internal::type_id_of<T>::value);
+    if (n < 0) return decode(d, x, internal::false_type()); // A LIST or an array needing conversion
+    if (size_t(n) != N) throw conversion_error("array size does not match std::array size");
+    return d.extract_array(internal::type_id_of<T>::value, x.data(), N);
+}
+} // array_impl
+/// @endcond
+
+/// std::array<T, N> is encoded as an AMQP array.
+template <class T, size_t N> encoder& operator<<(encoder& e, const std::array<T, N>& x) {
+    return array_impl::encode(e, x, internal::is_fixed_width<T>());
+}
+
+/// Decode to std::array<T, N> from an amqp::LIST or amqp::ARRAY of exactly N elements.
+template <class T, size_t N> decoder& operator>>(decoder& d, std::array<T, N>& x) {
+    return array_impl::decode(d, x, internal::is_fixed_width<T>());
+}
+
+} // codec
+} // proton
+
+#endif // PROTON_CODEC_ARRAY_HPP
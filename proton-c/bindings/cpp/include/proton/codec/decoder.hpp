@@ -130,6 +130,24 @@ class decoder : public internal::data {
     template <class T> static sequence_ref<T> sequence(T& x) { return sequence_ref<T>(x); }
     template <class T> static associative_ref<T> associative(T& x) { return associative_ref<T>(x); }
     template <class T> static pair_sequence_ref<T> pair_sequence(T& x) { return pair_sequence_ref<T>(x); }
+
+    /// The number of elements if the next value is an undescribed
+    /// ARRAY of element, -1 otherwise. The decoder does not move.
+    PN_CPP_EXTERN long array_size(type_id element);
+
+    /// Extract the next value, an array checked with array_size(), to
+    /// values which has room for all its elements, without a call per
+    /// element.
+    PN_CPP_EXTERN decoder& extract_array(type_id element, void* values, size_t count);
+
+    /// Inside a MAP started with operator>>(start&), move to the
+    /// entry for a STRING or SYMBOL key so the next extract gets its
+    /// value. Return false if there is no such entry. Large maps are
+    /// indexed on the first lookup rather than scanned each time.
+    PN_CPP_EXTERN bool seek_key(const std::string& key);
+
+    /// As seek_key(const std::string&) for SYMBOL keys only.
+    PN_CPP_EXTERN bool seek_key(const symbol& key);
     /// @endcond
 
     /// Extract any AMQP sequence (ARRAY, LIST or MAP) to a C++
@@ -152,11 +170,17 @@ class decoder : public internal::data {
         *this >> s;
         assert_type_equal(MAP, s.type);
         r.ref.clear();
+        reserve(r.ref, s.size/2);
         for (size_t i = 0; i < s.size/2; ++i) {
             typename remove_const<typename T::key_type>::type k;
-            typename remove_const<typename T::mapped_type>::type v;
-            *this >> k >> v;
-            r.ref[k] = v;
+            *this >> k;
+            // Decode the value straight into its entry, a repeated key
+            // keeps the last value.
+#if PN_CPP_HAS_RVALUE_REFERENCES
+            *this >> r.ref[std::move(k)];
+#else
+            *this >> r.ref[k];
+#endif
         }
         return *this;
     }
@@ -169,12 +193,17 @@ class decoder : public internal::data {
         *this >> s;
         assert_type_equal(MAP, s.type);
         r.ref.clear();
+        reserve(r.ref, s.size/2);
         for (size_t i = 0; i < s.size/2; ++i) {
             typedef typename T::value_type value_type;
             typename remove_const<typename value_type::first_type>::type k;
             typename remove_const<typename value_type::second_type>::type v;
             *this >> k >> v;
+#if PN_CPP_HAS_RVALUE_REFERENCES
+            r.ref.push_back(value_type(std::move(k), std::move(v)));
+#else
             r.ref.push_back(value_type(k, v));
+#endif
         }
         return *this;
     }
@@ -0,0 +1,162 @@
+#ifndef PROTON_CODEC_DESCRIBED_HPP
+#define PROTON_CODEC_DESCRIBED_HPP
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/// @file
+/// **Experimental** - Encode C++ structs directly as AMQP described
+/// lists, see PN_CPP_DESCRIBED_TYPE.
+
+#include "../error.hpp"
+#include "../symbol.hpp"
+#include "./encoder.hpp"
+#include "./decoder.hpp"
+
+#include <cstddef>
+#include <tuple>
+
+namespace proton {
+namespace codec {
+
+/// **Experimental** - The descriptor of an AMQP described type, a
+/// numeric code or a symbolic name.
+struct descriptor {
+    uint64_t code;          ///< The numeric descriptor, if name is 0
+    const char* name;       ///< The symbolic descriptor or 0
+
+    /// A numeric descriptor.
+    descriptor(uint64_t c) : code(c), name(0) {}
+
+    /// A symbolic descriptor, name must outlive the descriptor.
+    descriptor(const char* n) : code(0), name(n) {}
+};
+
+/// **Experimental** - Metafunction true for types declared with
+/// PN_CPP_DESCRIBED_TYPE.
+template <class T> struct described_type : public internal::false_type {};
+
+/// @cond INTERNAL
+namespace described_impl {
+
+// Encode or decode the fields of T from member pointer I of the tuple M on
+template <class T, class M, size_t I = 0, size_t N = std::tuple_size<M>::value> struct fields {
+    static void encode(encoder& e, const T& x, const M& m) {
+        e << x.*std::get<I>(m);
+        fields<T, M, I+1, N>::encode(e, x, m);
+    }
+
+    // n is the number of fields in the encoded list. Fields omitted at the
+    // end, or encoded as null, keep their value.
+    static void decode(decoder& d, T& x, const M& m, size_t n) {
+        if (I >= n) return;
+        if (d.next_type() == NULL_TYPE) {
+            null z;
+            d >> z;
+        } else {
+            d >> x.*std::get<I>(m);
+        }
+        fields<T, M, I+1, N>::decode(d, x, m, n);
+    }
+};
+
+template <class T, class M, size_t N> struct fields<T, M, N, N> {
+    static void encode(encoder&, const T&, const M&) {}
+    static void decode(decoder&, T&, const M&, size_t) {}
+};
+
+} // described_impl
+/// @endcond
+
+/// Encode a PN_CPP_DESCRIBED_TYPE as a described list of its fields.
+template <class T> typename internal::enable_if<described_type<T>::value, encoder&>::type
+operator<<(encoder& e, const T& x) {
+    typedef described_type<T> dt;
+    typedef typename dt::members_type members;
+    internal::state_guard sg(e);
+    descriptor desc = dt::desc();
+    e << start::described();
+    if (desc.name) e << symbol(desc.name); else e << desc.code;
+    e << start::list();
+    described_impl::fields<T, members>::encode(e, x, dt::members());
+    e << finish() << finish();
+    sg.cancel();
+    return e;
+}
+
+/// Decode a PN_CPP_DESCRIBED_TYPE from a described list with the same
+/// descriptor.
+///
+/// @throw conversion_error if the descriptor or a field type does not
+/// match.
+template <class T> typename internal::enable_if<described_type<T>::value, decoder&>::type
+operator>>(decoder& d, T& x) {
+    typedef described_type<T> dt;
+    typedef typename dt::members_type members;
+    internal::state_guard sg(d);
+    start s;
+    d >> s;
+    assert_type_equal(DESCRIBED, s.type);
+    descriptor desc = dt::desc();
+    if (desc.name) {
+        symbol name;
+        d >> name;
+        if (name != desc.name) throw conversion_error("unexpected descriptor " + name);
+    } else {
+        uint64_t code;
+        d >> code;
+        if (code != desc.code) throw conversion_error("unexpected descriptor");
+    }
+    start l;
+    d >> l;
+    assert_type_equal(LIST, l.type);
+    described_impl::fields<T, members>::decode(d, x, dt::members(), l.size);
+    d >> finish() >> finish();
+    sg.cancel();
+    return d;
+}
+
+} // codec
+} // proton
+
+/// **Experimental** - Encode and decode struct T as an AMQP described
+/// list with DESCRIPTOR, a numeric code or a symbol name, and the
+/// members given as member pointers in the list order.
+///
+/// The fields are encoded straight into the encoder, with no
+/// intermediate proton::value or map. Fields may be any encodable type,
+/// including other described types. Decoding leaves the fields that are
+/// missing from the end of the list, or null, unchanged.
+///
+/// Use it at global scope, with T fully qualified:
+///
+///     struct point { double x, y; std::string label; };
+///     PN_CPP_DESCRIBED_TYPE(point, "example:point:list", &point::x, &point::y, &point::label)
+///
+///     message.body() = point{1, 2, "a"};
+///     point p = proton::get<point>(message.body());
+#define PN_CPP_DESCRIBED_TYPE(T, DESCRIPTOR, ...)                       \
+    namespace proton { namespace codec {                                \
+    template <> struct described_type<T> : public internal::true_type { \
+        static descriptor desc() { return descriptor(DESCRIPTOR); }     \
+        typedef decltype(std::make_tuple(__VA_ARGS__)) members_type;    \
+        static members_type members() { return std::make_tuple(__VA_ARGS__); } \
+    }; } }
+
+#endif // PROTON_CODEC_DESCRIBED_HPP
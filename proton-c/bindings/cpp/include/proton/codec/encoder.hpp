@@ -154,6 +154,10 @@ class encoder : public internal::data {
         *this << finish();
         return *this;
     }
+
+    /// Encode count contiguous values of a fixed-width element type
+    /// as an undescribed array, without a call per element.
+    PN_CPP_EXTERN encoder& insert_array(type_id element, const void* values, size_t count);
     /// @endcond
 
   private:
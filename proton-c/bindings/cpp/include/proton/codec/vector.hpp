@@ -34,9 +34,33 @@
 namespace proton {
 namespace codec {
 
+/// @cond INTERNAL
+namespace vector_impl {
+template <class T, class A> encoder& encode(encoder& e, const std::vector<T, A>& x, internal::false_type) {
+    return e << encoder::array(x, internal::type_id_of<T>::value);
+}
+
+// Fixed-width elements are contiguous, copy them all at once
+template <class T, class A> encoder& encode(encoder& e, const std::vector<T, A>& x, internal::true_type) {
+    return e.insert_array(internal::type_id_of<T>::value, x.empty() ? 0 : &x[0], x.size());
+}
+
+template <class T, class A> decoder& decode(decoder& d, std::vector<T, A>& x, internal::false_type) {
+    return d >> decoder::sequence(x);
+}
+
+template <class T, class A> decoder& decode(decoder& d, std::vector<T, A>& x, internal::true_type) {
+    long n = d.array_size(internal::type_id_of<T>::value);
+    if (n < 0) return d >> decoder::sequence(x); // A LIST or an array needing conversion
+    x.resize(size_t(n));
+    return d.extract_array(internal::type_id_of<T>::value, x.empty() ? 0 : &x[0], x.size());
+}
+} // vector_impl
+/// @endcond
+
 /// Encode std::vector<T> as amqp::ARRAY (same type elements)
 template <class T, class A> encoder& operator<<(encoder& e, const std::vector<T, A>& x) {
-    return e << encoder::array(x, internal::type_id_of<T>::value);
+    return vector_impl::encode(e, x, internal::is_fixed_width<T>());
 }
 
 /// Encode std::vector<value> encode as amqp::LIST (mixed type elements)
@@ -50,7 +74,9 @@ template <class A, class K, class T>
 encoder& operator<<(encoder& e, const std::vector<std::pair<K,T>, A>& x) { return e << encoder::map(x); }
 
 /// Decode to std::vector<T> from an amqp::LIST or amqp::ARRAY.
-template <class T, class A> decoder& operator>>(decoder& d, std::vector<T, A>& x) { return d >> decoder::sequence(x); }
+template <class T, class A> decoder& operator>>(decoder& d, std::vector<T, A>& x) {
+    return vector_impl::decode(d, x, internal::is_fixed_width<T>());
+}
 
 /// Decode to std::vector<std::pair<K, T> from an amqp::MAP.
 template <class A, class K, class T> decoder& operator>>(decoder& d, std::vector<std::pair<K, T> , A>& x) { return d >> decoder::pair_sequence(x); }
@@ -36,6 +36,35 @@ struct pn_connection_t;
 
 namespace proton {
 
+/// Performance counters of a connection, see @ref connection::stats.
+///
+/// The counters only ever increase: take the difference between two
+/// samples to get rates.
+struct connection_stats {
+    uint64_t frames_input;      ///< Frames decoded, including empty frames
+    uint64_t frames_output;     ///< Frames encoded, including empty frames
+    uint64_t bytes_input;       ///< Bytes read by the transport
+    uint64_t bytes_output;      ///< Bytes written by the transport
+    uint64_t transfers_input;   ///< Transfer frames decoded
+    uint64_t transfers_output;  ///< Transfer frames encoded
+    uint64_t flows_input;       ///< Flow frames decoded
+    uint64_t flows_output;      ///< Flow frames encoded
+
+    /// @name Totals over the connection's links
+    /// @{
+    uint64_t deliveries;        ///< Deliveries created
+    uint64_t settled;           ///< Deliveries settled locally
+    uint64_t settle_time;       ///< Milliseconds from creation to local settlement
+    uint64_t credit_blocked;    ///< Milliseconds senders waited for credit
+    uint64_t window_blocked;    ///< Milliseconds senders waited for the session window
+    /// @}
+
+    connection_stats() :
+        frames_input(0), frames_output(0), bytes_input(0), bytes_output(0),
+        transfers_input(0), transfers_output(0), flows_input(0), flows_output(0),
+        deliveries(0), settled(0), settle_time(0), credit_blocked(0), window_blocked(0) {}
+};
+
 /// A connection to a remote AMQP peer.
 class
 PN_CPP_CLASS_EXTERN connection : public internal::object<pn_connection_t>, public endpoint {
@@ -139,6 +168,21 @@ PN_CPP_CLASS_EXTERN connection : public internal::object<pn_connection_t>, publi
     /// @see @ref connection_options::idle_timeout
     PN_CPP_EXTERN uint32_t idle_timeout() const;
 
+    /// Get the memory held by the connection and its transport, in
+    /// bytes.
+    ///
+    /// @see @ref connection_options::memory_limit
+    PN_CPP_EXTERN size_t memory_usage() const;
+
+    /// Get the outgoing data not yet written to the peer, in bytes.
+    ///
+    /// @see @ref connection_options::output_high_water
+    PN_CPP_EXTERN size_t output_backlog() const;
+
+    /// Get the performance counters of the connection, its transport
+    /// and its links.
+    PN_CPP_EXTERN connection_stats stats() const;
+
     /// @cond INTERNAL
   friend class internal::factory<connection>;
   friend class container;
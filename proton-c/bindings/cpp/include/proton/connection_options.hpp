@@ -92,6 +92,26 @@ class connection_options {
     /// Set the idle timeout.
     PN_CPP_EXTERN connection_options& idle_timeout(duration);
 
+    /// Set a soft limit on the memory the connection may hold, in
+    /// bytes. Above it no more input is read from the peer.
+    ///
+    /// @see @ref connection::memory_usage
+    PN_CPP_EXTERN connection_options& memory_limit(size_t bytes);
+
+    /// Set a high-water mark on the output not yet written to the
+    /// peer, in bytes. Once it is reached senders get no
+    /// messaging_handler::on_sendable and report no credit until the
+    /// output drains to half the mark, however much credit the peer
+    /// grants.
+    ///
+    /// @see @ref connection::output_backlog
+    PN_CPP_EXTERN connection_options& output_high_water(size_t bytes);
+
+    /// Bound the connection's work_queue: work_queue::add() returns
+    /// false while it holds this many jobs waiting to run. The
+    /// default, 0, is no bound.
+    PN_CPP_EXTERN connection_options& work_queue_capacity(size_t jobs);
+
     /// Set the container ID.
     PN_CPP_EXTERN connection_options& container_id(const std::string &id);
 
@@ -119,6 +139,13 @@ class connection_options {
     // reconnect_options and making reconnect_timer internal
     /// **Experimental**
     PN_CPP_EXTERN connection_options& reconnect(const reconnect_timer &);
+
+    /// **Experimental** - URLs to reconnect to when the connection
+    /// is lost, as well as the one it was opened with. Each attempt
+    /// goes to the URL with the fewest failures since it last
+    /// connected, so a broker that is down is tried after the others.
+    /// Needs reconnect().
+    PN_CPP_EXTERN connection_options& failover_urls(const std::vector<std::string>&);
     /// @endcond
 
     /// Set SSL client options.
@@ -151,6 +178,9 @@ class connection_options {
     void apply_unbound(connection&) const;
     void apply_bound(connection&) const;
     messaging_handler* handler() const;
+    bool empty() const;
+    std::vector<std::string> failover_urls() const;
+    size_t work_queue_capacity() const;
 
     class impl;
     internal::pn_unique_ptr<impl> impl_;
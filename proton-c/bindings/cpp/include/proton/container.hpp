@@ -29,13 +29,57 @@
 #include "./internal/export.hpp"
 #include "./internal/pn_unique_ptr.hpp"
 
+#include <proton/type_compat.h>
+
 #include <string>
+#include <vector>
 
 /// If the library can support multithreaded containers then PN_CPP_SUPPORTS_THREADS will be set.
 #define PN_CPP_SUPPORTS_THREADS PN_CPP_HAS_STD_THREAD && PN_CPP_HAS_STD_MUTEX && PN_CPP_HAS_STD_ATOMIC
 
 namespace proton {
 
+/// Performance counters of a container, see @ref container::stats.
+///
+/// Totals over the connections the container runs, updated as each
+/// batch of a connection's events is handled.  Each counter is read
+/// atomically but the set is not one instant: a sample can be taken
+/// from any thread while the container runs.  Apart from the gauges
+/// marked "now" the counters only ever increase.
+struct container_stats {
+    uint64_t connections;         ///< Connections open now
+    uint64_t connections_opened;  ///< Transports bound, reconnects included
+    uint64_t links;               ///< Links opened and not yet closed by the peer, now
+    uint64_t deliveries_input;    ///< Messages received
+    uint64_t deliveries_output;   ///< Messages sent
+    uint64_t bytes_input;         ///< Bytes read
+    uint64_t bytes_output;        ///< Bytes written
+    uint64_t frames_input;        ///< Frames decoded
+    uint64_t frames_output;       ///< Frames encoded
+    uint64_t memory;              ///< Memory of open connections, see connection::memory_usage, now
+    uint64_t delivery_pool_hits;  ///< Deliveries that reused a pooled buffer
+    uint64_t delivery_pool_misses; ///< Deliveries that allocated one
+    uint64_t ready_work_queues;   ///< Container work queues waiting for a thread, now
+    uint64_t timers;              ///< Scheduled work not yet due, now
+
+    /// @name Proactor event batches
+    /// @{
+    uint64_t batches;             ///< Batches handled
+    uint64_t batch_time;          ///< Microseconds spent handling them
+    /// Batches by time taken: under 10us, 100us, 1ms, 10ms, 100ms, and longer
+    uint64_t batch_latency[6];
+    /// @}
+
+    container_stats() :
+        connections(0), connections_opened(0), links(0), deliveries_input(0), deliveries_output(0),
+        bytes_input(0), bytes_output(0), frames_input(0), frames_output(0), memory(0),
+        delivery_pool_hits(0), delivery_pool_misses(0), ready_work_queues(0), timers(0),
+        batches(0), batch_time(0)
+    {
+        for (int i = 0; i < 6; ++i) batch_latency[i] = 0;
+    }
+};
+
 /// A top-level container of connections, sessions, senders, and
 /// receivers.
 ///
@@ -110,6 +154,22 @@ class PN_CPP_CLASS_EXTERN container {
 #if PN_CPP_SUPPORTS_THREADS
     /// @copydoc run()
     PN_CPP_EXTERN void run(int threads);
+
+    /// **Experimental** - Run a thread for each of handlers.
+    ///
+    /// Each connection belongs to one of the handlers for its
+    /// lifetime: the handler of the thread that opened or accepted it,
+    /// or the next in turn for a connection opened outside the
+    /// container's threads. A connection's events go to its handler
+    /// unless connection, session or link options give another.
+    ///
+    /// Calls to a handler are never concurrent, so it can keep state
+    /// for its connections without locking. Connections mostly stay on
+    /// their handler's thread, see PN_PROACTOR_POLLERS.
+    ///
+    /// Each handler gets on_container_start() in its own thread before
+    /// any other event, and on_container_stop() once all threads are done.
+    PN_CPP_EXTERN void run(const std::vector<messaging_handler*>& handlers);
 #endif
 
     /// If true, stop the container when all active connections and listeners are closed.
@@ -118,6 +178,20 @@ class PN_CPP_CLASS_EXTERN container {
     /// auto_stop is set by default when a new container is created.
     PN_CPP_EXTERN void auto_stop(bool);
 
+    /// **Experimental** - If true, open_sender() and open_receiver()
+    /// open their links on an existing connection to the same URL
+    /// scheme, user, password, host and port instead of a new
+    /// connection each time.
+    ///
+    /// Only calls without connection options share connections. A
+    /// connection is shared by threads that cannot be handling it at
+    /// the same time: the thread handling its events, or any thread
+    /// while the container runs at most one thread. Other threads get
+    /// a connection of their own. Closed connections are not reused.
+    ///
+    /// Off by default.
+    PN_CPP_EXTERN void share_connections(bool);
+
     /// **Experimental** - Stop the container with an error_condition
     /// err.
     ///
@@ -187,6 +261,11 @@ class PN_CPP_CLASS_EXTERN container {
     /// A unique identifier for the container.
     PN_CPP_EXTERN std::string id() const;
 
+    /// Get the performance counters of the container.  Safe to call
+    /// from any thread, it does not stop the threads running the
+    /// container.
+    PN_CPP_EXTERN container_stats stats() const;
+
     /// Connection options that will be to outgoing connections. These
     /// are applied first and overriden by options provided in
     /// connect() and messaging_handler::on_connection_open().
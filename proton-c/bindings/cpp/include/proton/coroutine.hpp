@@ -0,0 +1,290 @@
+#ifndef PROTON_COROUTINE_HPP
+#define PROTON_COROUTINE_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "./internal/config.hpp"
+
+#if PN_CPP_HAS_COROUTINES
+
+#include "./connection.hpp"
+#include "./delivery.hpp"
+#include "./error.hpp"
+#include "./message.hpp"
+#include "./messaging_handler.hpp"
+#include "./receiver.hpp"
+#include "./sender.hpp"
+#include "./tracker.hpp"
+#include "./transport.hpp"
+#include "./work_queue.hpp"
+
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace proton {
+
+/// **Experimental** - A coroutine that starts at once and frees itself
+/// when it returns.
+///
+/// An exception that escapes the coroutine is thrown from the handler
+/// function that resumed it, as an exception from a handler would be.
+class task {
+  public:
+    struct promise_type {
+        task get_return_object() { return task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+};
+
+/// **Experimental** - Await `co_await resume_on(wq)` to continue the
+/// coroutine as work on `wq`, for example to move from an application
+/// thread onto the thread that runs a connection.
+///
+/// Throws proton::error from the co_await if the work cannot be added.
+class resume_on {
+  public:
+    explicit resume_on(class work_queue& wq) : wq_(wq), added_(false) {}
+
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        added_ = wq_.add([h]() { h.resume(); });
+        return added_;
+    }
+    void await_resume() const {
+        if (!added_) throw proton::error("resume_on: work queue is closed or full");
+    }
+
+  private:
+    class work_queue& wq_;
+    bool added_;
+};
+
+/// **Experimental** - A messaging_handler that coroutines await.
+///
+/// A coroutine started from a handler function, or moved onto a
+/// connection with resume_on(), can await credit, the settlement of the
+/// messages it sends and the messages a receiver gets.  It is resumed
+/// from the handler function for the event, on the thread running the
+/// connection, with nothing queued in between.
+///
+///     proton::task produce(coroutine_handler& h, proton::sender s) {
+///         for (int i = 0; i < 10; ++i) {
+///             proton::tracker t = co_await h.send(s, proton::message(i));
+///             ...
+///         }
+///     }
+///
+/// The handler keeps its waiting coroutines unlocked, so use one
+/// handler per connection when the container runs several threads.  A
+/// subclass that overrides on_sendable, on_message, on_tracker_settle,
+/// on_sender_close, on_receiver_close or on_transport_close must call
+/// this class's version.
+///
+/// If the link or the connection closes first, the co_await throws
+/// proton::error.
+class coroutine_handler : public messaging_handler {
+    // A suspended coroutine, or a send waiting for credit
+    struct waiter {
+        std::coroutine_handle<> handle;
+        std::string error;
+        virtual ~waiter() {}
+        virtual void ready() { handle.resume(); }
+        void fail(const std::string& e) { error = e; handle.resume(); }
+        void check() const { if (!error.empty()) throw proton::error(error); }
+    };
+
+  public:
+    /// Awaits credit on a sender
+    class credit_awaiter : private waiter {
+      public:
+        bool await_ready() const { return s_.credit() > 0 && !h_.waiting(s_); }
+        void await_suspend(std::coroutine_handle<> h) { handle = h; h_.credit_[s_].push_back(this); }
+        void await_resume() const { check(); }
+
+      private:
+        credit_awaiter(coroutine_handler& h, const sender& s) : h_(h), s_(s) {}
+        coroutine_handler& h_;
+        sender s_;
+      friend class coroutine_handler;
+    };
+
+    /// Awaits credit, sends and then awaits the receiver settling the
+    /// message.  The result is its tracker.
+    class send_awaiter : private waiter {
+      public:
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            if (s_.credit() > 0 && !h_.waiting(s_)) send();
+            else h_.credit_[s_].push_back(this);
+        }
+        tracker await_resume() const { check(); return t_; }
+
+      private:
+        send_awaiter(coroutine_handler& h, const sender& s, const message& m) : h_(h), s_(s), m_(m) {}
+        void send() {
+            t_ = s_.send(m_);
+            h_.settle_[t_] = this;
+        }
+        void ready() { if (!t_) send(); else handle.resume(); }
+        coroutine_handler& h_;
+        sender s_;
+        message m_;
+        tracker t_;
+      friend class coroutine_handler;
+    };
+
+    /// Awaits the next message of a receiver.  It is accepted when the
+    /// handler function that resumed the coroutine returns, unless the
+    /// receiver was opened without auto_accept.
+    class receive_awaiter : private waiter {
+      public:
+        bool await_ready() {
+            message_map::iterator i = h_.messages_.find(r_);
+            if (i == h_.messages_.end()) return false;
+            swap(m_, i->second.front());
+            i->second.pop_front();
+            if (i->second.empty()) h_.messages_.erase(i);
+            return true;
+        }
+        void await_suspend(std::coroutine_handle<> h) { handle = h; h_.receive_[r_].push_back(this); }
+        message await_resume() { check(); return std::move(m_); }
+
+      private:
+        receive_awaiter(coroutine_handler& h, const receiver& r) : h_(h), r_(r) {}
+        coroutine_handler& h_;
+        receiver r_;
+        message m_;
+      friend class coroutine_handler;
+    };
+
+    /// `co_await credit(s)` resumes when `s` can send a message.
+    credit_awaiter credit(const sender& s) { return credit_awaiter(*this, s); }
+
+    /// `co_await send(s, m)` sends `m` when `s` has credit and resumes
+    /// when the receiver settles it.  On a sender that settles before
+    /// sending there is no settlement to wait for, await credit() and
+    /// call sender::send() instead.
+    send_awaiter send(const sender& s, const message& m) { return send_awaiter(*this, s, m); }
+
+    /// `co_await receive(r)` resumes with the next message of `r`.
+    /// Messages that arrive with no coroutine waiting are kept, up to
+    /// the receiver's credit window.
+    receive_awaiter receive(const receiver& r) { return receive_awaiter(*this, r); }
+
+    void on_sendable(sender& s) PN_CPP_OVERRIDE {
+        waiter_map::iterator i = credit_.find(s);
+        while (i != credit_.end() && !i->second.empty() && s.credit() > 0) {
+            waiter* w = i->second.front();
+            i->second.pop_front();
+            if (i->second.empty()) credit_.erase(i);
+            w->ready();
+            i = credit_.find(s);
+        }
+    }
+
+    void on_message(delivery& d, message& m) PN_CPP_OVERRIDE {
+        receiver r = d.receiver();
+        waiter_map::iterator i = receive_.find(r);
+        if (i == receive_.end()) {
+            std::deque<message>& q = messages_[r];
+            q.push_back(message());
+            swap(q.back(), m);
+            return;
+        }
+        receive_awaiter* w = static_cast<receive_awaiter*>(i->second.front());
+        i->second.pop_front();
+        if (i->second.empty()) receive_.erase(i);
+        swap(w->m_, m);
+        w->ready();
+    }
+
+    void on_tracker_settle(tracker& t) PN_CPP_OVERRIDE {
+        settle_map::iterator i = settle_.find(t);
+        if (i == settle_.end()) return;
+        waiter* w = i->second;
+        settle_.erase(i);
+        w->ready();
+    }
+
+    void on_sender_close(sender& s) PN_CPP_OVERRIDE {
+        fail_link(s, "sender closed");
+    }
+
+    void on_receiver_close(receiver& r) PN_CPP_OVERRIDE {
+        messages_.erase(r);
+        fail_link(r, "receiver closed");
+    }
+
+    void on_transport_close(transport& t) PN_CPP_OVERRIDE {
+        connection c = t.connection();
+        std::deque<link> links;
+        for (waiter_map::iterator i = credit_.begin(); i != credit_.end(); ++i)
+            if (i->first.connection() == c) links.push_back(i->first);
+        for (waiter_map::iterator i = receive_.begin(); i != receive_.end(); ++i)
+            if (i->first.connection() == c) links.push_back(i->first);
+        for (settle_map::iterator i = settle_.begin(); i != settle_.end(); ++i)
+            if (i->first.connection() == c) links.push_back(i->first.sender());
+        for (message_map::iterator i = messages_.begin(); i != messages_.end();)
+            if (i->first.connection() == c) messages_.erase(i++); else ++i;
+        for (size_t i = 0; i < links.size(); ++i)
+            fail_link(links[i], "connection closed");
+    }
+
+  private:
+    typedef std::map<link, std::deque<waiter*> > waiter_map;
+    typedef std::map<tracker, waiter*> settle_map;
+    typedef std::map<link, std::deque<message> > message_map;
+
+    bool waiting(const sender& s) const { return credit_.find(s) != credit_.end(); }
+
+    // Waiters are taken out before they are resumed, a resumed coroutine
+    // may wait again
+    void fail_link(const link& l, const std::string& e) {
+        std::deque<waiter*> failed;
+        waiter_map::iterator c = credit_.find(l);
+        if (c != credit_.end()) { failed.insert(failed.end(), c->second.begin(), c->second.end()); credit_.erase(c); }
+        waiter_map::iterator r = receive_.find(l);
+        if (r != receive_.end()) { failed.insert(failed.end(), r->second.begin(), r->second.end()); receive_.erase(r); }
+        for (settle_map::iterator i = settle_.begin(); i != settle_.end();) {
+            if (link(i->first.sender()) == l) { failed.push_back(i->second); settle_.erase(i++); }
+            else ++i;
+        }
+        for (size_t i = 0; i < failed.size(); ++i) failed[i]->fail(e);
+    }
+
+    waiter_map credit_;         // Senders waiting for credit
+    waiter_map receive_;        // Coroutines waiting for a message
+    settle_map settle_;         // Sent, waiting for the receiver to settle
+    message_map messages_;      // Messages no coroutine is waiting for
+};
+
+} // proton
+
+#endif // PN_CPP_HAS_COROUTINES
+
+#endif // PROTON_COROUTINE_HPP
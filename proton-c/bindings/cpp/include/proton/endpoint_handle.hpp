@@ -0,0 +1,106 @@
+#ifndef PROTON_ENDPOINT_HANDLE_HPP
+#define PROTON_ENDPOINT_HANDLE_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "./container.hpp"
+#include "./fwd.hpp"
+#include "./internal/export.hpp"
+#include "./thread_safe.hpp"
+#include "./work_queue.hpp"
+
+#include <proton/type_compat.h>
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include <memory>
+
+namespace proton {
+
+class handle_table;
+
+namespace internal {
+
+/// @cond INTERNAL
+class endpoint_handle_base {
+  protected:
+    endpoint_handle_base() : token_(0) {}
+    PN_CPP_EXTERN explicit endpoint_handle_base(const connection&);
+    PN_CPP_EXTERN explicit endpoint_handle_base(const session&);
+    PN_CPP_EXTERN explicit endpoint_handle_base(const link&);
+
+    PN_CPP_EXTERN bool add(work f) const;
+    PN_CPP_EXTERN void get(connection&) const;
+    PN_CPP_EXTERN void get(session&) const;
+    PN_CPP_EXTERN void get(sender&) const;
+    PN_CPP_EXTERN void get(receiver&) const;
+    PN_CPP_EXTERN void get(link&) const;
+
+    std::shared_ptr<handle_table> table_;
+    uint64_t token_;
+};
+/// @endcond
+
+}
+
+/// **Experimental** - A handle to an endpoint for use from other threads.
+///
+/// A lighter alternative to thread_safe<>. An endpoint_handle does not
+/// hold a reference to its endpoint, so making, copying and destroying
+/// one allocates nothing and never schedules work on the connection.
+/// It names the endpoint by a slot in its connection's table with a
+/// generation: get() on a handle whose endpoint has since been freed
+/// returns an empty object, never another endpoint that reused the
+/// memory.
+///
+/// Make a handle in the connection's own thread, for example in
+/// messaging_handler::on_sender_open(). Copy it and call add() from
+/// any thread, call get() only in the connection's thread.
+///
+/// @see @ref mt_page
+template <class T>
+class endpoint_handle : private internal::endpoint_handle_base, private internal::endpoint_traits<T> {
+  public:
+    /// An empty handle.
+    endpoint_handle() {}
+
+    /// A handle to x, in x's connection thread.
+    explicit endpoint_handle(const T& x) : internal::endpoint_handle_base(x) {}
+
+    /// Add f to the work queue of the endpoint's connection, from any
+    /// thread. False if the connection is gone, has no work queue or
+    /// its queue is full.
+    bool add(work f) const { return internal::endpoint_handle_base::add(f); }
+
+    /// The endpoint, an empty T if it has been freed. Call only in the
+    /// connection's thread, such as in work passed to add().
+    T get() const { T x; internal::endpoint_handle_base::get(x); return x; }
+
+    /// True if the handle is empty.
+    bool operator!() const { return !table_; }
+};
+
+} // proton
+
+#endif // PN_CPP_SUPPORTS_THREADS
+
+#endif // PROTON_ENDPOINT_HANDLE_HPP
@@ -24,7 +24,12 @@
 
 namespace proton {
 
+namespace internal {
+template <class I> class iter_range;
+}
+
 class annotation_key;
+class binary;
 class connection;
 class connection_options;
 class container;
@@ -51,11 +56,14 @@ class source_options;
 class ssl;
 class target_options;
 class tracker;
+typedef internal::iter_range<tracker*> tracker_range;
+class transaction;
 class transport;
 class url;
 class void_function0;
 class work;
 class work_queue;
+class worker_queue;
 
 namespace io {
 
@@ -63,6 +71,7 @@ class connection_driver;
 
 }
 
+template <class T> class endpoint_handle;
 template <class T> class returned;
 template <class T> class thread_safe;
 
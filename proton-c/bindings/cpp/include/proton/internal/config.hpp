@@ -71,6 +71,16 @@
 #define PN_CPP_OVERRIDE
 #endif
 
+#ifndef PN_CPP_HAS_NOEXCEPT
+#define PN_CPP_HAS_NOEXCEPT PN_CPP_HAS_CPP11
+#endif
+
+#if PN_CPP_HAS_NOEXCEPT
+#define PN_CPP_NOEXCEPT noexcept
+#else
+#define PN_CPP_NOEXCEPT
+#endif
+
 #ifndef PN_CPP_HAS_EXPLICIT_CONVERSIONS
 #define PN_CPP_HAS_EXPLICIT_CONVERSIONS PN_CPP_HAS_CPP11
 #endif
@@ -107,6 +117,14 @@
 #define PN_CPP_HAS_STD_THREAD PN_CPP_HAS_CPP11
 #endif
 
+#ifndef PN_CPP_HAS_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define PN_CPP_HAS_COROUTINES 1
+#else
+#define PN_CPP_HAS_COROUTINES 0
+#endif
+#endif
+
 #endif // PROTON_INTERNAL_CONFIG_HPP
 
 /// @endcond
@@ -115,6 +115,20 @@ template<> struct type_id_of<symbol> : public type_id_constant<SYMBOL, symbol> {
 template<> struct type_id_of<binary> : public type_id_constant<BINARY, binary> {};
 /// @}
 
+/// Metafunction to test if T is stored as its own fixed-width C type in
+/// an AMQP array, so a contiguous run of them can be copied in one go.
+template <class T> struct is_fixed_width : public false_type {};
+template<> struct is_fixed_width<uint8_t> : public true_type {};
+template<> struct is_fixed_width<int8_t> : public true_type {};
+template<> struct is_fixed_width<uint16_t> : public true_type {};
+template<> struct is_fixed_width<int16_t> : public true_type {};
+template<> struct is_fixed_width<uint32_t> : public true_type {};
+template<> struct is_fixed_width<int32_t> : public true_type {};
+template<> struct is_fixed_width<uint64_t> : public true_type {};
+template<> struct is_fixed_width<int64_t> : public true_type {};
+template<> struct is_fixed_width<float> : public true_type {};
+template<> struct is_fixed_width<double> : public true_type {};
+
 /// Metafunction to test if a class has a type_id.
 template <class T, class Enable=void> struct has_type_id : public false_type {};
 template <class T> struct has_type_id<T, typename type_id_of<T>::type>  : public true_type {};
@@ -177,6 +191,18 @@ template <class From, class To> struct is_convertible : public sfinae {
 #endif
 };
 
+/// Metafunction to test if a container has reserve(size_type).
+template <class T> struct has_reserve : public sfinae {
+    template <class U, void (U::*)(typename U::size_type)> struct check {};
+    template <class U> static yes test(check<U, &U::reserve>*);
+    template <class U> static no test(...);
+    static const bool value = sizeof(test<T>(0)) == sizeof(yes);
+};
+
+/// Make room for n elements in containers that can, a no-op for others.
+template <class T> typename enable_if<has_reserve<T>::value>::type reserve(T& x, size_t n) { x.reserve(n); }
+template <class T> typename enable_if<!has_reserve<T>::value>::type reserve(T&, size_t) {}
+
 } // internal
 } // proton
 
@@ -128,6 +128,13 @@ PN_CPP_CLASS_EXTERN connection_driver {
     /// This changes the buffer, call read_buffer() to get the updated buffer.
     PN_CPP_EXTERN void read_done(size_t n);
 
+    /// Process input from your own buffer instead of copying it into read_buffer().
+    /// Only an incomplete frame at the end of the data is copied, the buffer can
+    /// be reused when this returns.
+    /// Returns the number of bytes taken, fewer than data.size if the engine
+    /// cannot take more now: call dispatch() and offer the rest again.
+    PN_CPP_EXTERN size_t read_external(const const_buffer& data);
+
     /// Indicate that the read side of the transport is closed and no more data will be read.
     /// Note that there may still be events to dispatch() or data to write.
     PN_CPP_EXTERN void read_close();
@@ -28,6 +28,7 @@
 #include "./timestamp.hpp"
 #include "./value.hpp"
 #include "./map.hpp"
+#include "./scalar.hpp"
 
 #include "./internal/pn_unique_ptr.hpp"
 
@@ -37,6 +38,7 @@
 #include <vector>
 
 struct pn_message_t;
+struct pn_link_t;
 
 namespace proton {
 
@@ -44,6 +46,13 @@ namespace proton {
 ///
 /// Value semantics: A message can be copied or assigned to make a new
 /// message.
+///
+/// To keep a message from on_message() without copying it, move or
+/// swap() it into place. The storage of destroyed messages is reused
+/// by the next messages created in the same thread, and is shared with
+/// other threads once a thread has more than it needs, so messages
+/// received on one thread and destroyed on another don't allocate each
+/// time either.
 class message {
   public:
     /// **Experimental** - A map of string keys and AMQP scalar
@@ -64,11 +73,12 @@ class message {
     PN_CPP_EXTERN message& operator=(const message&);
 
 #if PN_CPP_HAS_RVALUE_REFERENCES
-    /// Move a message.
-    PN_CPP_EXTERN message(message&&);
+    /// Move a message without copying its contents, m is left empty.
+    PN_CPP_EXTERN message(message&&) PN_CPP_NOEXCEPT;
 
-    /// Move a message.
-    PN_CPP_EXTERN message& operator=(message&&);
+    /// Move a message without copying its contents. m is left empty,
+    /// holding the storage this message had for reuse.
+    PN_CPP_EXTERN message& operator=(message&&) PN_CPP_NOEXCEPT;
 #endif
 
     /// Create a message with its body set from any value that can be
@@ -169,6 +179,21 @@ class message {
     /// Get the content encoding of the body.
     PN_CPP_EXTERN std::string content_encoding() const;
 
+    /// **Experimental** - Compress a binary body of at least
+    /// `min_size` bytes with deflate, setting the content encoding to
+    /// "deflate". A body that is not binary, already has a content
+    /// encoding or would not shrink is left alone, as is any body if
+    /// proton was built without zlib.
+    PN_CPP_EXTERN void compress(size_t min_size = 0);
+
+    /// **Experimental** - Inflate a body compressed with compress()
+    /// and clear the content encoding. Other bodies are left alone.
+    /// A body that would inflate to more than `max_size` bytes, 64 MiB
+    /// by default, is left compressed.
+    ///
+    /// @throw error if the body cannot be inflated or is too big
+    PN_CPP_EXTERN void decompress(size_t max_size = 64 * 1024 * 1024);
+
     /// Set the expiration time.
     PN_CPP_EXTERN void expiry_time(timestamp t);
 
@@ -297,6 +322,22 @@ class message {
     /// **Experimental** - examine the application properties map.
     PN_CPP_EXTERN const property_map& properties() const;
 
+    /// **Experimental** - Get application property `key` as a `T`, or
+    /// `T()` if there is none.  Only that entry is decoded, not the
+    /// whole properties map.
+    ///
+    /// @throw conversion_error if the property is not a `T`
+    template <class T> T property(const std::string& key) const {
+        scalar v = properties().get(key);
+        return v.empty() ? T() : proton::get<T>(v);
+    }
+
+    /// **Experimental** - Set application property `key`.  A new key is
+    /// added to the encoded properties without decoding them.
+    template <class T> void property(const std::string& key, const T& v) {
+        properties().put(key, scalar(v));
+    }
+
     /// @name **Experimental** - Annotations
     ///
     /// Normally used by messaging infrastructure, not applications.
@@ -316,13 +357,23 @@ class message {
     struct impl;
     pn_message_t *pn_msg() const;
     struct impl& impl() const;
+    void encode(pn_link_t *sender) const;
+    void encode_settled(pn_link_t *sender) const;
+    void decode(proton::delivery);
 
     mutable pn_message_t *pn_msg_;
 
-  PN_CPP_EXTERN friend void swap(message&, message&);
+  PN_CPP_EXTERN friend void swap(message&, message&) PN_CPP_NOEXCEPT;
+  friend class sender;
+  friend class transaction;
+  friend void message_decode(message&, proton::delivery);
+  friend bool message_unpack(message&, const char*&, const char*);
     /// @endcond
 };
 
+/// Swap the contents of two messages without copying.
+PN_CPP_EXTERN void swap(message&, message&) PN_CPP_NOEXCEPT;
+
 } // proton
 
 #endif // PROTON_MESSAGE_HPP
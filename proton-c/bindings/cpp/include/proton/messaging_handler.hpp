@@ -25,6 +25,10 @@
 #include "./fwd.hpp"
 #include "./internal/export.hpp"
 
+#include <proton/type_compat.h>
+
+#include <vector>
+
 namespace proton {
 
 
@@ -56,6 +60,9 @@ namespace proton {
 /// `on_X_error` event.  The error-handling logic doesn't have to
 /// manage resource clean up.  It can assume that the close event will
 /// be along to handle it.
+///
+/// See proton::typed_handler for a handler that only receives the
+/// events it declares functions for.
 class
 PN_CPP_CLASS_EXTERN messaging_handler {
   public:
@@ -73,6 +80,22 @@ PN_CPP_CLASS_EXTERN messaging_handler {
     /// A message is received.
     PN_CPP_EXTERN virtual void on_message(delivery &d, message &m);
 
+    /// Part of a message is received on a receiver that streams
+    /// messages, see receiver_options::stream_messages().  `chunk` is
+    /// the next piece of the encoded message and `last` is true for
+    /// the final piece.  The engine keeps no copy of the chunk.
+    PN_CPP_EXTERN virtual void on_message_chunk(delivery &d, const binary &chunk, bool last);
+
+    /// Messages are received together on a receiver that batches
+    /// messages, see receiver_options::batch_messages().  `messages[i]`
+    /// is the message of `deliveries[i]`, deliveries not settled on
+    /// return are accepted unless auto_accept is off.  A delivery
+    /// holding several messages, see sender::send_packed(), appears
+    /// once for each of them.  The default calls on_message() for
+    /// each message in turn.
+    PN_CPP_EXTERN virtual void on_messages(receiver &r, std::vector<delivery> &deliveries,
+                                           std::vector<message> &messages);
+
     /// A message can be sent.
     PN_CPP_EXTERN virtual void on_sendable(sender &s);
 
@@ -140,9 +163,31 @@ PN_CPP_CLASS_EXTERN messaging_handler {
     /// The receiving peer settled a transfer.
     PN_CPP_EXTERN virtual void on_tracker_settle(tracker &d);
 
+    /// The receiving peer settled transfers together on a sender that
+    /// batches settlements, see sender_options::batch_settlements().
+    /// The trackers are settled on return unless auto_settle is off.  The default calls on_tracker_accept(),
+    /// on_tracker_reject() or on_tracker_release() as the outcome of
+    /// each tracker is, then on_tracker_settle().
+    PN_CPP_EXTERN virtual void on_trackers_settled(sender &s, tracker_range trackers);
+
     /// The sending peer settled a transfer.
     PN_CPP_EXTERN virtual void on_delivery_settle(delivery &d);
 
+    /// **Experimental** - The peer declared a transaction, see
+    /// session::declare_transaction().
+    PN_CPP_EXTERN virtual void on_transaction_declare(transaction &t);
+
+    /// **Experimental** - The peer committed a transaction.
+    PN_CPP_EXTERN virtual void on_transaction_commit(transaction &t);
+
+    /// **Experimental** - The peer aborted a transaction.
+    PN_CPP_EXTERN virtual void on_transaction_abort(transaction &t);
+
+    /// **Experimental** - The peer refused to declare or discharge a
+    /// transaction, see transaction::error().  A failed commit has
+    /// rolled back.
+    PN_CPP_EXTERN virtual void on_transaction_error(transaction &t);
+
     /// **Experimental** - The receiving peer has requested a drain of
     /// remaining credit.
     PN_CPP_EXTERN virtual void on_sender_drain_start(sender &s);
@@ -153,6 +198,18 @@ PN_CPP_CLASS_EXTERN messaging_handler {
 
     /// Fallback error handling.
     PN_CPP_EXTERN virtual void on_error(const error_condition &c);
+
+  protected:
+    /// @cond INTERNAL
+    /// See typed_handler, `handled` has a bit from internal::handler_bit
+    /// for each function whose default does nothing that is overridden.
+    PN_CPP_EXTERN explicit messaging_handler(uint32_t handled);
+    /// @endcond
+
+  private:
+    uint32_t handled_;
+
+  friend class messaging_adapter;
 };
 
 } // proton
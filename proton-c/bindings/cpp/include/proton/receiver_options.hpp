@@ -27,6 +27,8 @@
 #include "./internal/pn_unique_ptr.hpp"
 #include "./delivery_mode.hpp"
 
+#include <string>
+
 namespace proton {
 
 /// Options for creating a receiver.
@@ -79,6 +81,21 @@ class receiver_options {
     /// Automatically settle messages (default is true).
     PN_CPP_EXTERN receiver_options& auto_settle(bool);
 
+    /// Pass message data to messaging_handler::on_message_chunk() as
+    /// each transfer arrives, instead of buffering whole messages for
+    /// messaging_handler::on_message() (default is false).  Session
+    /// window is released as the chunks are handed over, so a message
+    /// of any size needs no more than a few frames of memory.
+    PN_CPP_EXTERN receiver_options& stream_messages(bool);
+
+    /// Hand complete messages that arrive together to
+    /// messaging_handler::on_messages() in one call, instead of one
+    /// messaging_handler::on_message() call each (default is false).
+    /// A batch ends with any other event for the connection or at the
+    /// end of the input processed at once.  Ignored with
+    /// stream_messages().
+    PN_CPP_EXTERN receiver_options& batch_messages(bool);
+
     /// Options for the source node of the receiver.
     PN_CPP_EXTERN receiver_options& source(source_options &);
 
@@ -90,6 +107,45 @@ class receiver_options {
     /// replenishing.
     PN_CPP_EXTERN receiver_options& credit_window(int);
 
+    /// Replenish credit only once it has fallen to this many messages
+    /// or fewer, restoring the whole credit_window() in one flow
+    /// (default is one less than the window, so credit is replenished
+    /// after every message).  With half the window a receiver flows
+    /// once per half window of messages instead of once per message.
+    PN_CPP_EXTERN receiver_options& credit_low_water(int);
+
+    /// Size the credit window from the measured delivery rate times
+    /// the time credit takes to come back as deliveries, keeping the
+    /// pipeline full without buffering more than @p max_bytes of
+    /// messages of the average size (default is 0, a fixed window).
+    /// credit_window() is the window to start with, and 0 still
+    /// disables automatic credit.
+    PN_CPP_EXTERN receiver_options& adaptive_credit(size_t max_bytes);
+
+    /// **Experimental** - Push complete messages to a worker_queue for
+    /// other threads to process and settle, instead of calling
+    /// messaging_handler::on_message().  A message that finds the
+    /// queue full waits on the receiver, unsettled, and the receiver
+    /// grants no more credit until the workers make room.  A message
+    /// in a packed delivery goes to on_message() as usual.  The queue
+    /// must outlive the receiver.
+    /// Ignored with stream_messages() or without thread support.
+    PN_CPP_EXTERN receiver_options& worker_queue(class worker_queue&);
+
+    /// **Experimental** - Filter messages at the receiver with a JMS
+    /// style selector, for sources that do not support a selector
+    /// filter (see source_options::filters()).  The expression is
+    /// compiled once, and each message is matched against its header,
+    /// properties and application properties before it is decoded.
+    /// A message that does not match is settled as modified and
+    /// undeliverable here, so the sender can route it elsewhere, and
+    /// never reaches messaging_handler::on_message().  Ignored with
+    /// stream_messages() and for packed deliveries.  See
+    /// pn_message_selector() for the expression syntax.
+    ///
+    /// @throw proton::error if the expression is not valid
+    PN_CPP_EXTERN receiver_options& selector(const std::string& expression);
+
     /// @cond INTERNAL
   private:
     void apply(receiver &) const;
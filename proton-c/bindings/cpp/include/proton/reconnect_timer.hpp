@@ -52,11 +52,18 @@ class reconnect_timer {
     /// attempts should cease.
     PN_CPP_EXTERN int next_delay(timestamp now);
 
+    /// If true, each delay returned by next_delay() is picked at
+    /// random between half and all of the computed delay, so that
+    /// clients cut off together do not all retry together. Off by
+    /// default.
+    PN_CPP_EXTERN reconnect_timer& jitter(bool);
+
   private:
     duration first_delay_;
     duration max_delay_;
     duration increment_;
     bool doubling_;
+    bool jitter_;
     int32_t max_retries_;
     duration timeout_;
     int32_t retries_;
@@ -51,6 +51,7 @@ class encoder;
 
 namespace internal {
 template<class T> T get(const scalar_base& s);
+class value_base;
 }
 
 /// Base class for scalar types.
@@ -153,6 +154,7 @@ class scalar_base : private internal::comparable<scalar_base> {
 
     /// @cond INTERNAL
   friend class message;
+  friend class internal::value_base;
   friend class codec::encoder;
   friend class codec::decoder;
   template<class T> friend T internal::get(const scalar_base& s);
@@ -27,6 +27,8 @@
 #include "./link.hpp"
 #include "./tracker.hpp"
 
+#include <vector>
+
 struct pn_link_t;
 struct pn_session_t;
 
@@ -52,8 +54,47 @@ PN_CPP_CLASS_EXTERN sender : public link {
     PN_CPP_EXTERN void open(const sender_options &opts);
 
     /// Send a message on the sender.
+    ///
+    /// On a sender opened with sender_options::priority_ordering(),
+    /// a message that cannot go at once is held and the tracker is
+    /// empty: see messaging_handler::on_tracker_accept() and the
+    /// other tracker events for its outcome.
     PN_CPP_EXTERN tracker send(const message &m);
 
+    /// Send a message that is already encoded, such as one received
+    /// with receiver_options::stream_messages(). The bytes are sent
+    /// as they are, so forwarding needs no decode or encode.
+    PN_CPP_EXTERN tracker send_encoded(const binary &bytes);
+
+    /// Send a message pre-settled, for at-most-once delivery.
+    ///
+    /// With credit and nothing else waiting on the link the message is
+    /// framed at once with no delivery to track, so there is no
+    /// tracker and no tracker events. Meant for links opened with
+    /// delivery_mode::AT_MOST_ONCE.
+    PN_CPP_EXTERN void send_settled(const message &m);
+
+    /// Send messages in order, as many as there is credit for.
+    ///
+    /// The trackers of the messages sent are appended to `trackers`.
+    ///
+    /// @return the number of messages sent
+    PN_CPP_EXTERN size_t send_batch(const std::vector<message> &msgs, std::vector<tracker> &trackers);
+
+    /// **Experimental** - Send messages packed into a single delivery.
+    ///
+    /// Small messages cost mostly transfer framing, packing them takes
+    /// one credit and one transfer for all of them. The delivery has a
+    /// Proton specific message format, 0x00515001, that a Proton C++
+    /// receiver unpacks into one messaging_handler::on_message() per
+    /// message, in order. Other receivers see an opaque delivery.
+    ///
+    /// The tracker settles, and its outcome applies to, all of the
+    /// messages.
+    ///
+    /// @throw error if `msgs` is empty
+    PN_CPP_EXTERN tracker send_packed(const std::vector<message> &msgs);
+
     /// Get the source node.
     PN_CPP_EXTERN class source source() const;
 
@@ -27,6 +27,8 @@
 #include "./internal/pn_unique_ptr.hpp"
 #include "./delivery_mode.hpp"
 
+#include <proton/type_compat.h>
+
 namespace proton {
 
 /// Options for creating a sender.
@@ -79,6 +81,28 @@ class sender_options {
     /// Automatically settle messages (default is true).
     PN_CPP_EXTERN sender_options& auto_settle(bool);
 
+    /// Hand trackers the receiving peer settles together, as by one
+    /// ranged disposition, to messaging_handler::on_trackers_settled()
+    /// in one call (default is false).  A batch ends with any other
+    /// event for the connection or at the end of the input processed
+    /// at once.  Updates that do not settle are still handled one by
+    /// one.
+    PN_CPP_EXTERN sender_options& batch_settlements(bool);
+
+    /// Send messages in order of message::priority() rather than in
+    /// the order of sender::send() calls (default is false).  Messages
+    /// sent without credit, or while others wait, are held by the
+    /// sender and go highest priority first, in call order for equal
+    /// priority, as credit arrives and before
+    /// messaging_handler::on_sendable().  Held messages are dropped if
+    /// the sender closes.
+    PN_CPP_EXTERN sender_options& priority_ordering(bool);
+
+    /// Scheduling weight of the sender (default is 1).  When the
+    /// connection interleaves transfers a sender with weight N gets N
+    /// frames for each frame of a sender with weight 1.
+    PN_CPP_EXTERN sender_options& weight(uint32_t);
+
     /// Options for the source node of the sender.
     PN_CPP_EXTERN sender_options& source(const source_options &);
 
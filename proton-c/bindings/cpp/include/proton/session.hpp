@@ -27,6 +27,7 @@
 #include "./endpoint.hpp"
 #include "./receiver.hpp"
 #include "./sender.hpp"
+#include "./transaction.hpp"
 
 #include <string>
 
@@ -96,6 +97,14 @@ PN_CPP_CLASS_EXTERN session : public internal::object<pn_session_t>, public endp
     /// Return the receivers on this session.
     PN_CPP_EXTERN receiver_range receivers() const;
 
+    /// **Experimental** - Declare a transaction with the peer's
+    /// coordinator, see transaction.  The first declare opens the
+    /// coordinator link, which is not reported by on_sender_open() or
+    /// on_sendable().
+    ///
+    /// @throw proton::error if the session already has a transaction
+    PN_CPP_EXTERN transaction declare_transaction();
+
     /// @cond INTERNAL
   friend class internal::factory<session>;
   friend class session_iterator;
@@ -51,6 +51,13 @@ class session_options {
     /// Set a messaging_handler for the session.
     PN_CPP_EXTERN session_options& handler(class messaging_handler &);
 
+    /// Buffer at most this many bytes of incoming message data
+    /// (default is to limit only by the session window the peer is
+    /// granted, which is unlimited if the connection sets no
+    /// connection_options::max_frame_size()).  The peer is stopped
+    /// once the data is buffered, and let go on as it is read.
+    PN_CPP_EXTERN session_options& incoming_capacity(size_t bytes);
+
     /// @cond INTERNAL
     // Other useful session configuration TBD.
   private:
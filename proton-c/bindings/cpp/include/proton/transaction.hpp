@@ -0,0 +1,83 @@
+#ifndef PROTON_TRANSACTION_HPP
+#define PROTON_TRANSACTION_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "./fwd.hpp"
+#include "./internal/export.hpp"
+#include "./binary.hpp"
+#include "./error_condition.hpp"
+
+struct pn_session_t;
+
+namespace proton {
+
+/// **Experimental** - A local transaction on a session.
+///
+/// Declared with session::declare_transaction(), which opens a
+/// coordinator link to the peer. Once messaging_handler::on_transaction_declare()
+/// is called, messages accepted and sent with the transaction take
+/// effect together when it is committed, or not at all if it is
+/// aborted. Any number of deliveries are settled with one discharge
+/// round trip.
+///
+/// A session has at most one transaction at a time.
+class transaction {
+  public:
+    /// @cond INTERNAL
+    PN_CPP_EXTERN transaction(pn_session_t *s);
+    /// @endcond
+
+    /// Create an empty transaction.
+    transaction() : session_(0) {}
+
+    /// Get the session of the transaction.
+    PN_CPP_EXTERN class session session() const;
+
+    /// True once declared and until it is committed or aborted.
+    PN_CPP_EXTERN bool declared() const;
+
+    /// The identifier the peer gave the transaction, empty until declared.
+    PN_CPP_EXTERN binary id() const;
+
+    /// Why declaring or discharging the transaction failed.
+    PN_CPP_EXTERN error_condition error() const;
+
+    /// Accept and settle a received message as part of the transaction.
+    PN_CPP_EXTERN void accept(delivery &d);
+
+    /// Send a message as part of the transaction.
+    PN_CPP_EXTERN tracker send(sender &s, const message &m);
+
+    /// Commit the transaction, see messaging_handler::on_transaction_commit().
+    PN_CPP_EXTERN void commit();
+
+    /// Abort the transaction, see messaging_handler::on_transaction_abort().
+    PN_CPP_EXTERN void abort();
+
+  private:
+    pn_session_t *session_;
+};
+
+} // proton
+
+#endif // PROTON_TRANSACTION_HPP
@@ -0,0 +1,112 @@
+#ifndef PROTON_TYPED_HANDLER_HPP
+#define PROTON_TYPED_HANDLER_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "./messaging_handler.hpp"
+#include "./internal/type_traits.hpp"
+
+namespace proton {
+
+namespace internal {
+
+/// A bit for each messaging_handler function whose default does nothing
+/// or only calls others
+enum handler_bit {
+    ON_MESSAGE = 1 << 0,
+    ON_MESSAGE_CHUNK = 1 << 1,
+    ON_SENDABLE = 1 << 2,
+    ON_TRANSPORT_OPEN = 1 << 3,
+    ON_TRANSPORT_CLOSE = 1 << 4,
+    ON_CONNECTION_CLOSE = 1 << 5,
+    ON_SESSION_CLOSE = 1 << 6,
+    ON_RECEIVER_DETACH = 1 << 7,
+    ON_RECEIVER_CLOSE = 1 << 8,
+    ON_SENDER_DETACH = 1 << 9,
+    ON_SENDER_CLOSE = 1 << 10,
+    ON_TRACKER_ACCEPT = 1 << 11,
+    ON_TRACKER_REJECT = 1 << 12,
+    ON_TRACKER_RELEASE = 1 << 13,
+    ON_TRACKER_SETTLE = 1 << 14,
+    ON_DELIVERY_SETTLE = 1 << 15,
+    ON_SENDER_DRAIN_START = 1 << 16,
+    ON_RECEIVER_DRAIN_FINISH = 1 << 17,
+    ON_TRACKERS_SETTLED = 1 << 18
+};
+
+// The bit unless the member function is messaging_handler's own
+template <class C, class F> uint32_t if_overridden(F C::*, handler_bit bit) {
+    return is_same<C, messaging_handler>::value ? 0 : bit;
+}
+
+}
+
+/// **Experimental** - A messaging_handler that only receives the events
+/// it declares functions for.
+///
+/// Derive `H` from `typed_handler<H>` instead of messaging_handler.  The
+/// functions `H` declares are found when it is compiled, and the
+/// container skips the events of the others whose messaging_handler
+/// default does nothing: it makes no wrapper objects and no virtual
+/// call for them.  A receiver whose handler has no on_message() still
+/// accepts its messages but does not decode them, and a sender whose
+/// handler has no on_tracker_* functions does not look at the outcomes.
+///
+/// The functions must be public members of `H` or of a class between
+/// it and typed_handler.  A class derived from `H` is only called for
+/// the events `H` declares functions for.
+///
+///     struct sender_handler : public proton::typed_handler<sender_handler> {
+///         void on_sendable(proton::sender& s) { ... }
+///     };
+template <class H> class typed_handler : public messaging_handler {
+  protected:
+    typed_handler() : messaging_handler(handled()) {}
+
+  private:
+    static uint32_t handled() {
+        using namespace internal;
+        return if_overridden(&H::on_message, ON_MESSAGE) |
+            if_overridden(&H::on_message_chunk, ON_MESSAGE_CHUNK) |
+            if_overridden(&H::on_sendable, ON_SENDABLE) |
+            if_overridden(&H::on_transport_open, ON_TRANSPORT_OPEN) |
+            if_overridden(&H::on_transport_close, ON_TRANSPORT_CLOSE) |
+            if_overridden(&H::on_connection_close, ON_CONNECTION_CLOSE) |
+            if_overridden(&H::on_session_close, ON_SESSION_CLOSE) |
+            if_overridden(&H::on_receiver_detach, ON_RECEIVER_DETACH) |
+            if_overridden(&H::on_receiver_close, ON_RECEIVER_CLOSE) |
+            if_overridden(&H::on_sender_detach, ON_SENDER_DETACH) |
+            if_overridden(&H::on_sender_close, ON_SENDER_CLOSE) |
+            if_overridden(&H::on_tracker_accept, ON_TRACKER_ACCEPT) |
+            if_overridden(&H::on_tracker_reject, ON_TRACKER_REJECT) |
+            if_overridden(&H::on_tracker_release, ON_TRACKER_RELEASE) |
+            if_overridden(&H::on_tracker_settle, ON_TRACKER_SETTLE) |
+            if_overridden(&H::on_trackers_settled, ON_TRACKERS_SETTLED) |
+            if_overridden(&H::on_delivery_settle, ON_DELIVERY_SETTLE) |
+            if_overridden(&H::on_sender_drain_start, ON_SENDER_DRAIN_START) |
+            if_overridden(&H::on_receiver_drain_finish, ON_RECEIVER_DRAIN_FINISH);
+    }
+};
+
+} // proton
+
+#endif // PROTON_TYPED_HANDLER_HPP
@@ -86,8 +86,10 @@ See below           | proton::LIST         | Sequence of values of mixed types
 See below           | proton::MAP          | Map of key-value pairs
 
 A proton::value containing a proton::ARRAY can convert to and from C++ sequences
-of the corresponding C++ type: std::vector, std::deque, std::list, and
-std::forward_list.
+of the corresponding C++ type: std::vector, std::deque, std::list,
+std::forward_list and std::array. A std::vector or std::array of a
+fixed-width integer or floating point type is copied to and from the
+ARRAY in one go rather than element by element.
 
 proton::LIST converts to and from sequences of proton::value or
 proton::scalar, which can hold mixed types of data.
@@ -95,6 +97,9 @@ proton::scalar, which can hold mixed types of data.
 proton::MAP converts to and from std::map, std::unordered_map, and
 sequences of std::pair.
 
+Your own structs convert to and from an AMQP described list when they
+are declared with PN_CPP_DESCRIBED_TYPE.
+
 For example you can decode a message body with any AMQP MAP as follows:
 
     proton::message m = ...;
@@ -134,6 +139,8 @@ want, see @ref types.hpp.
 #include "./codec/map.hpp"
 #include "./codec/vector.hpp"
 #if PN_CPP_HAS_CPP11
+#include "./codec/array.hpp"
+#include "./codec/described.hpp"
 #include "./codec/forward_list.hpp"
 #include "./codec/unordered_map.hpp"
 #endif
@@ -43,6 +43,9 @@ class uuid : public byte_array<16> {
     /// Return a simple randomly-generated UUID.  This is used by the
     /// Proton library to generate default UUIDs.
     ///
+    /// Each thread has its own generator, so it can be called from
+    /// any thread without taking a lock.
+    ///
     /// For specific security, performance, or uniqueness
     /// requirements, you may want to use a better UUID generator or
     /// some other form of identifier entirely.
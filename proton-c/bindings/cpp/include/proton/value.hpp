@@ -37,15 +37,35 @@ namespace proton {
 namespace internal {
 
 // Separate value data from implicit conversion constructors to avoid template recursion.
+//
+// A scalar is kept in scalar_ with no pn_data_t until the value is used
+// as one, a pn_data_t costs several allocations. Once there is a data_
+// it holds the value and scalar_ is null.
 class value_base {
   protected:
-    internal::data& data();
+    internal::data& data();     // Moves a scalar into a new pn_data_t
+    internal::data& fresh_data(); // Discards a scalar, for a new value
     internal::data data_;
+    scalar_base scalar_;
+
+    template <class T> void put_scalar(const T& x) { scalar_.put(x); }
+    void copy_scalar(const scalar_base& x) { scalar_ = x; }
+    PN_CPP_EXTERN void clear_scalar();
+    PN_CPP_EXTERN void swap_scalar(value_base&);
 
   friend class codec::encoder;
   friend class codec::decoder;
 };
 
+// True for the types a value keeps as an inline scalar
+template <class T> struct is_inline_scalar : public sfinae {
+    template <class U> static yes test(typename type_id_of<U>::type*);
+    template <class U> static no test(...);
+    static const bool value = sizeof(test<T>(0)) == sizeof(yes) || is_unknown_integer<T>::value;
+};
+template <> struct is_inline_scalar<const char*> : public true_type {};
+template <size_t N> struct is_inline_scalar<char[N]> : public true_type {};
+
 } // internal
 
 /// A holder for any AMQP value, simple or complex.
@@ -58,6 +78,21 @@ class value : public internal::value_base, private internal::comparable<value> {
         public internal::enable_if<codec::is_encodable<T>::value, U> {};
     template<class U> struct assignable<value, U> {};
 
+    // Keep scalars inline unless the value refers to an existing pn_data_t
+    template <class T, class Enable=void> struct assigner {
+        static void assign(value& v, const T& x) { codec::encoder e(v); e << x; }
+    };
+    template <class T> struct assigner<T, typename internal::enable_if<internal::is_inline_scalar<T>::value>::type> {
+        static void assign(value& v, const T& x) {
+            if (!v.data_) {
+                v.put_scalar(x);
+            } else {
+                codec::encoder e(v);
+                e << x;
+            }
+        }
+    };
+
   public:
     /// Create a null value
     PN_CPP_EXTERN value();
@@ -77,8 +112,7 @@ class value : public internal::value_base, private internal::comparable<value> {
 
     /// Assign from any allowed type T.
     template <class T> typename assignable<T, value&>::type operator=(const T& x) {
-        codec::encoder e(*this);
-        e << x;
+        assigner<T>::assign(*this, x);
         return *this;
     }
 
@@ -119,9 +153,29 @@ class value : public internal::value_base, private internal::comparable<value> {
     /// Used to refer to existing pn_data_t* values as proton::value
     value(pn_data_t* d);          // Refer to existing pn_data_t
     void reset(pn_data_t* d = 0); // Refer to a new pn_data_t
+
+    // The scalar held without a pn_data_t, 0 if there is a pn_data_t
+    const scalar_base* inline_scalar() const { return !data_ ? &scalar_ : 0; }
     ///@endcond
 };
 
+/// @cond INTERNAL
+namespace internal {
+// Get a scalar type from an inline scalar without making a pn_data_t
+template <class T, class Enable=void> struct inline_getter {
+    static bool get(const value&, T&) { return false; }
+};
+template <class T> struct inline_getter<T, typename enable_if<is_inline_scalar<T>::value>::type> {
+    static bool get(const value& v, T& x) {
+        const scalar_base* s = v.inline_scalar();
+        if (!s) return false;
+        x = internal::get<T>(*s);
+        return true;
+    }
+};
+}
+/// @endcond
+
 /// @copydoc scalar::get
 /// @relatedalso proton::value
 template<class T> T get(const value& v) { T x; get(v, x); return x; }
@@ -131,7 +185,12 @@ template<class T> T get(const value& v) { T x; get(v, x); return x; }
 /// (arrays, maps, etc.)
 ///
 /// @relatedalso proton::value
-template<class T> void get(const value& v, T& x) { codec::decoder d(v, true); d >> x; }
+template<class T> void get(const value& v, T& x) {
+    if (!internal::inline_getter<T>::get(v, x)) {
+        codec::decoder d(v, true);
+        d >> x;
+    }
+}
 
 /// @relatedalso proton::value
 template<class T, class U> inline void get(const U& u, T& x) { const value v(u); get(v, x); }
@@ -146,6 +205,10 @@ template<class T> T coerce(const value& v) { T x; coerce(v, x); return x; }
 ///
 /// @relatedalso proton::value
 template<class T> void coerce(const value& v, T& x) {
+    if (const scalar_base* s = v.inline_scalar()) {
+        x = internal::coerce<T>(*s);
+        return;
+    }
     codec::decoder d(v, false);
     if (type_id_is_scalar(v.type())) {
         scalar s;
@@ -29,8 +29,17 @@
 #include "./internal/export.hpp"
 #include "./internal/pn_unique_ptr.hpp"
 
+#include <proton/type_compat.h>
+
 #include <functional>
 
+#if PN_CPP_HAS_STD_FUNCTION
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#endif
+
 struct pn_connection_t;
 struct pn_session_t;
 struct pn_link_t;
@@ -54,27 +63,99 @@ namespace proton {
 class work {
   public:
 #if PN_CPP_HAS_STD_FUNCTION
-    work(void_function0& f): item_( [&f]() { f(); }) {}
-    template <class T>
-    work(T f): item_(f) {}
+    work(void_function0& f): ops_(0) { init([&f]() { f(); }); }
+    template <class T, class = typename std::enable_if<
+                           !std::is_same<typename std::decay<T>::type, work>::value>::type>
+    work(T&& f): ops_(0) { init(std::forward<T>(f)); }
+
+    work(const work& x): ops_(x.ops_) { if (ops_) ops_->copy(x, *this); }
+    work(work&& x) PN_CPP_NOEXCEPT : ops_(x.ops_) { if (ops_) ops_->move(x, *this); x.ops_ = 0; }
+    work& operator=(const work& x) { if (this != &x) { work tmp(x); *this = std::move(tmp); } return *this; }
+    work& operator=(work&& x) PN_CPP_NOEXCEPT {
+        if (this != &x) {
+            reset();
+            ops_ = x.ops_;
+            if (ops_) ops_->move(x, *this);
+            x.ops_ = 0;
+        }
+        return *this;
+    }
+    ~work() { reset(); }
 
-    void operator()() { item_(); }
+    void operator()() { if (!ops_) throw std::bad_function_call(); ops_->call(*this); }
 #else
     work(void_function0& f): item_(&f) {}
 
     void operator()() { (*item_)(); }
-#endif
     ~work() {}
+#endif
 
 
   private:
 #if PN_CPP_HAS_STD_FUNCTION
-    std::function<void()> item_;
+    // Callables up to this size, such as lambdas or make_work() bindings
+    // of a few pointers, are kept in the work itself rather than allocated.
+    static const size_t inline_size = 6 * sizeof(void*);
+
+    struct ops {
+        void (*call)(work&);
+        void (*copy)(const work& from, work& to);
+        void (*move)(work& from, work& to);
+        void (*destroy)(work&);
+    };
+
+    template <class F> struct inline_ops {
+        static F* get(const work& w) { return const_cast<F*>(reinterpret_cast<const F*>(&w.storage_)); }
+        static void call(work& w) { (*get(w))(); }
+        static void copy(const work& from, work& to) { new (&to.storage_) F(*get(from)); }
+        static void move(work& from, work& to) { new (&to.storage_) F(std::move(*get(from))); get(from)->~F(); }
+        static void destroy(work& w) { get(w)->~F(); }
+        static const ops table;
+    };
+
+    template <class F> struct heap_ops {
+        static F* get(const work& w) { return static_cast<F*>(w.heap_); }
+        static void call(work& w) { (*get(w))(); }
+        static void copy(const work& from, work& to) { to.heap_ = new F(*get(from)); }
+        static void move(work& from, work& to) { to.heap_ = from.heap_; }
+        static void destroy(work& w) { delete get(w); }
+        static const ops table;
+    };
+
+    template <class T> void init(T&& f) {
+        typedef typename std::decay<T>::type F;
+        if (sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<F>::value) {
+            new (&storage_) F(std::forward<T>(f));
+            ops_ = &inline_ops<F>::table;
+        } else {
+            heap_ = new F(std::forward<T>(f));
+            ops_ = &heap_ops<F>::table;
+        }
+    }
+
+    void reset() { if (ops_) ops_->destroy(*this); ops_ = 0; }
+
+    const ops* ops_;
+    union {
+        typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type storage_;
+        void* heap_;
+    };
 #else
     void_function0* item_;
 #endif
 };
 
+#if PN_CPP_HAS_STD_FUNCTION
+template <class F> const work::ops work::inline_ops<F>::table = {
+    &work::inline_ops<F>::call, &work::inline_ops<F>::copy,
+    &work::inline_ops<F>::move, &work::inline_ops<F>::destroy };
+
+template <class F> const work::ops work::heap_ops<F>::table = {
+    &work::heap_ops<F>::call, &work::heap_ops<F>::copy,
+    &work::heap_ops<F>::move, &work::heap_ops<F>::destroy };
+#endif
+
 class PN_CPP_CLASS_EXTERN work_queue {
     /// @cond internal
     class impl;
@@ -83,16 +164,27 @@ class PN_CPP_CLASS_EXTERN work_queue {
 
   public:
     /// Create work_queue
+    /// Identifies work added by schedule(), see cancel().
+    typedef uint64_t timer_id;
+
     PN_CPP_EXTERN work_queue();
     PN_CPP_EXTERN work_queue(container&);
 
+    /// Create work_queue that holds at most capacity jobs waiting to run,
+    /// add() fails while it is full. A capacity of 0 is no bound, the
+    /// same as work_queue(container&).
+    ///
+    /// @see connection_options::work_queue_capacity for the queue of a connection With threads
+    /// capacity is rounded up to a power of 2, at least 2.
+    PN_CPP_EXTERN work_queue(container&, size_t capacity);
+
     PN_CPP_EXTERN ~work_queue();
 
     /// Add work to the work queue: f() will be called serialised with other work in the queue:
     /// deferred and possibly in another thread.
     ///
-    /// @return true if f() has or will be called, false if the event_loop is ended
-    /// or f() cannot be injected for any other reason.
+    /// @return true if f() has or will be called, false if the event_loop is ended,
+    /// a bounded queue is full or f() cannot be injected for any other reason.
     PN_CPP_EXTERN bool add(work f);
 
     /// Add work to the work queue after duration: f() will be called after the duration
@@ -101,7 +193,16 @@ class PN_CPP_CLASS_EXTERN work_queue {
     /// The scheduled execution is "best effort" and it is possible that after the elapsed duration
     /// the work will not be able to be injected into the serialised context - there will be no
     /// indication of this.
-    PN_CPP_EXTERN void schedule(duration, work);
+    ///
+    /// @return an id to pass to cancel(), 0 if the work will never be added.
+    PN_CPP_EXTERN timer_id schedule(duration, work);
+
+    /// Cancel work added by schedule() before its duration has elapsed.
+    /// The work is destroyed without being called.
+    ///
+    /// @return true if the work was cancelled, false if it has already been
+    /// added to the queue or was cancelled before.
+    PN_CPP_EXTERN bool cancel(timer_id);
 
   private:
     PN_CPP_EXTERN static work_queue& get(pn_connection_t*);
@@ -0,0 +1,120 @@
+#ifndef PROTON_WORKER_QUEUE_HPP
+#define PROTON_WORKER_QUEUE_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "./container.hpp"
+#include "./fwd.hpp"
+#include "./message.hpp"
+#include "./internal/export.hpp"
+#include "./internal/pn_unique_ptr.hpp"
+
+#include <proton/type_compat.h>
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include <cstddef>
+#include <memory>
+
+namespace proton {
+
+class settle_channel;
+
+/// **Experimental** - Messages handed from receivers to worker threads.
+///
+/// A receiver with receiver_options::worker_queue() decodes each
+/// message and pushes it here instead of calling
+/// messaging_handler::on_message(). Any number of threads may pop()
+/// messages and settle them with item::accept(), item::reject() or
+/// item::release() on their own thread. Outcomes go back to the
+/// connection without a lock, the connection is woken once for a burst
+/// of them and settles them all at the end of its next batch of events.
+///
+/// A message that finds the queue full waits, unsettled, on its
+/// receiver, which grants no more credit until it has been pushed.
+/// Waiting messages are pushed again when the connection next settles
+/// outcomes or handles events. An outcome for a connection that has
+/// since closed is dropped.
+class PN_CPP_CLASS_EXTERN worker_queue {
+  public:
+    /// A message taken from the queue and the means to settle its delivery.
+    class item {
+      public:
+        item() : token_(0) {}
+
+        /// The message, workers may keep or modify it.
+        proton::message message;
+
+        /// Settle the delivery as accepted, from any thread.
+        PN_CPP_EXTERN void accept();
+
+        /// Settle the delivery as rejected, from any thread.
+        PN_CPP_EXTERN void reject();
+
+        /// Settle the delivery as released, from any thread.
+        PN_CPP_EXTERN void release();
+
+      private:
+        void settle(uint64_t state);
+
+        std::shared_ptr<settle_channel> channel_;
+        uint64_t token_;
+
+      friend class worker_queue;
+    };
+
+    /// Create a queue holding at most @p capacity messages, rounded
+    /// up to a power of 2, at least 2.
+    PN_CPP_EXTERN explicit worker_queue(size_t capacity = 1024);
+
+    PN_CPP_EXTERN ~worker_queue();
+
+    /// Take the oldest message if there is one, without blocking.
+    PN_CPP_EXTERN bool try_pop(item&);
+
+    /// Take the oldest message, waiting for one if the queue is
+    /// empty. False once the queue is closed and empty.
+    PN_CPP_EXTERN bool pop(item&);
+
+    /// Wake the threads waiting in pop(), they return false once the
+    /// queue is empty.  Receivers still push messages to a closed queue.
+    PN_CPP_EXTERN void close();
+
+    /// @cond INTERNAL
+    /// Move m to the queue with the channel that settles it, false if
+    /// the queue is full and m is untouched.
+    PN_CPP_EXTERN bool offer(proton::message& m, const std::shared_ptr<settle_channel>& channel, uint64_t token);
+
+  private:
+    worker_queue(const worker_queue&);
+    worker_queue& operator=(const worker_queue&);
+
+    class impl;
+    internal::pn_unique_ptr<impl> impl_;
+    /// @endcond
+};
+
+} // proton
+
+#endif // PN_CPP_SUPPORTS_THREADS
+
+#endif // PROTON_WORKER_QUEUE_HPP
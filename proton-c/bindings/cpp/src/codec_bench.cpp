@@ -0,0 +1,266 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Codec microbenchmarks for the C++ binding: the same message shapes as
+// the C codec_bench, built as C++ values and encoded as proton::message.
+//
+// Usage: codec_bench [-t <ms per measurement>] [<shape>...]
+//
+// Prints ns/op and C++ allocations/op: calls to operator new, not counting
+// allocations made by the C library underneath.
+
+#include "proton/binary.hpp"
+#include "proton/message.hpp"
+#include "proton/value.hpp"
+#include "proton/codec/map.hpp"
+#include "proton/codec/vector.hpp"
+#include "test_bits.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+size_t news = 0;
+}
+
+// Count allocations made through operator new, by the binding as well
+#if defined(__GNUC__)
+#define BENCH_EXPORT __attribute__((visibility("default")))
+#else
+#define BENCH_EXPORT
+#endif
+#if PN_CPP_HAS_NOEXCEPT
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#endif
+
+BENCH_EXPORT void* operator new(size_t size) BENCH_THROW_BAD_ALLOC {
+    ++news;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+BENCH_EXPORT void operator delete(void* p) BENCH_NOTHROW { std::free(p); }
+#if __cpp_sized_deallocation
+BENCH_EXPORT void operator delete(void* p, size_t) BENCH_NOTHROW { std::free(p); }
+#endif
+
+namespace {
+
+using namespace std;
+using namespace proton;
+
+double now_ns() {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return double(c.QuadPart) * 1e9 / double(f.QuadPart);
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+#endif
+}
+
+// Shapes
+
+const int PROPERTIES = 32;
+const size_t BINARY_SIZE = 64*1024;
+const int NESTED_DEPTH = 4;
+const int NESTED_FANOUT = 4;
+const int ARRAY_SIZE = 1000;
+
+typedef std::map<std::string, value> value_map;
+
+vector<string> keys;
+binary blob;
+
+void fill_tiny(message& m) { m.body(std::string("hello")); }
+void get_tiny(const message& m) { ASSERT_EQUAL(5u, get<std::string>(m.body()).size()); }
+
+void fill_properties(message& m) {
+    message::property_map& props = m.properties();
+    for (int i = 0; i < PROPERTIES; ++i) {
+        switch (i % 4) {
+          case 0: props.put(keys[i], std::string("value")); break;
+          case 1: props.put(keys[i], int32_t(i)); break;
+          case 2: props.put(keys[i], int64_t(i) << 40); break;
+          case 3: props.put(keys[i], true); break;
+        }
+    }
+    m.body(std::string("hello"));
+}
+void get_properties(const message& m) { ASSERT_EQUAL(size_t(PROPERTIES), m.properties().size()); }
+
+void fill_binary(message& m) { m.body(blob); }
+void get_binary(const message& m) { ASSERT_EQUAL(BINARY_SIZE, get<binary>(m.body()).size()); }
+
+value nested(int depth) {
+    if (depth == 0) return int32_t(42);
+    value_map vm;
+    for (int i = 0; i < NESTED_FANOUT; ++i) {
+        vm[keys[i]] = nested(depth - 1);
+    }
+    return vm;
+}
+
+int count_leaves(const value& v) {
+    if (type_id_is_container(v.type())) {
+        value_map vm;
+        get(v, vm);
+        int n = 0;
+        for (value_map::const_iterator i = vm.begin(); i != vm.end(); ++i) {
+            n += count_leaves(i->second);
+        }
+        return n;
+    }
+    return 1;
+}
+
+void fill_nested(message& m) { m.body(nested(NESTED_DEPTH)); }
+void get_nested(const message& m) { ASSERT_EQUAL(256, count_leaves(m.body())); }
+
+void fill_array(message& m) {
+    std::vector<int32_t> v;
+    v.reserve(ARRAY_SIZE);
+    for (int i = 0; i < ARRAY_SIZE; ++i) v.push_back(i);
+    m.body(v);
+}
+void get_array(const message& m) { ASSERT_EQUAL(size_t(ARRAY_SIZE), get<std::vector<int32_t> >(m.body()).size()); }
+
+struct shape {
+    const char* name;
+    void (*fill)(message&);
+    void (*get)(const message&);
+};
+
+const shape shapes[] = {
+    { "tiny", fill_tiny, get_tiny },
+    { "properties", fill_properties, get_properties },
+    { "binary", fill_binary, get_binary },
+    { "nested", fill_nested, get_nested },
+    { "array", fill_array, get_array },
+};
+
+// Operations
+
+struct bench {
+    const shape* shape_;
+    std::vector<char> bytes;
+    message msg;
+};
+
+void op_build(bench& b) { message m; b.shape_->fill(m); }
+void op_encode(bench& b) { std::vector<char> bytes; b.msg.encode(bytes); }
+void op_decode(bench& b) { message m; m.decode(b.bytes); }
+void op_get(bench& b) { b.shape_->get(b.msg); }
+
+struct op {
+    const char* name;
+    void (*run)(bench&);
+};
+
+const op ops[] = {
+    { "build", op_build },
+    { "message::encode", op_encode },
+    { "message::decode", op_decode },
+    { "get", op_get },
+};
+
+// Double the iterations until a run takes at least target_ns
+void measure(bench& b, const op& o, double target_ns) {
+    o.run(b);                   // Warm up
+    size_t n = 1;
+    double elapsed;
+    size_t allocated;
+    for (;;) {
+        size_t a = news;
+        double start = now_ns();
+        for (size_t i = 0; i < n; ++i) {
+            o.run(b);
+        }
+        elapsed = now_ns() - start;
+        allocated = news - a;
+        if (elapsed >= target_ns || n >= (size_t(1) << 30)) break;
+        n *= 2;
+    }
+    std::printf("%-12s %-18s %12.1f ns/op %8.2f allocs/op %10lu iterations\n",
+                b.shape_->name, o.name, elapsed / n, double(allocated) / n, (unsigned long)n);
+}
+
+#define ARRAYLEN(A) (sizeof(A)/sizeof((A)[0]))
+
+}
+
+int main(int argc, char** argv) {
+    double target_ms = 200;
+    int first = 1;
+    if (argc > 2 && !std::strcmp(argv[1], "-t")) {
+        target_ms = std::atof(argv[2]);
+        first = 3;
+    }
+    for (int i = 0; i < PROPERTIES; ++i) {
+        keys.push_back(std::string("property-") + char('0' + i/10) + char('0' + i%10));
+    }
+    blob.resize(BINARY_SIZE);
+    for (size_t i = 0; i < BINARY_SIZE; ++i) {
+        blob[i] = uint8_t(i);
+    }
+
+    try {
+        for (size_t s = 0; s < ARRAYLEN(shapes); ++s) {
+            bool selected = first >= argc;
+            for (int i = first; i < argc; ++i) {
+                selected = selected || !std::strcmp(argv[i], shapes[s].name);
+            }
+            if (!selected) continue;
+            bench b;
+            b.shape_ = &shapes[s];
+            shapes[s].fill(b.msg);
+            b.msg.encode(b.bytes);
+            message m;
+            m.decode(b.bytes);
+            shapes[s].get(m);
+            std::printf("%-12s %lu bytes as a message\n", shapes[s].name, (unsigned long)b.bytes.size());
+            for (size_t o = 0; o < ARRAYLEN(ops); ++o) {
+                measure(b, ops[o], target_ms * 1e6);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "codec_bench: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
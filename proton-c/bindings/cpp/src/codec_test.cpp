@@ -23,10 +23,59 @@
 #include "proton/internal/config.hpp"
 #include "proton/types.hpp"
 
+#if PN_CPP_HAS_CPP11
+namespace {
+struct point { double x, y; std::string label; };
+struct segment { point from, to; uint32_t weight; };
+struct short_segment { point from; };
+}
+PN_CPP_DESCRIBED_TYPE(point, "example:point:list", &point::x, &point::y, &point::label)
+PN_CPP_DESCRIBED_TYPE(segment, 0x4242ULL, &segment::from, &segment::to, &segment::weight)
+PN_CPP_DESCRIBED_TYPE(short_segment, 0x4242ULL, &short_segment::from)
+#endif
+
 namespace {
 
 using namespace proton;
 
+#if PN_CPP_HAS_CPP11
+void described_type_test() {
+    ASSERT(codec::is_encodable<point>::value);
+    segment s = { {1, 2, "a"}, {3.5, -4, "b"}, 7 };
+    value v(s);
+    ASSERT_EQUAL(DESCRIBED, v.type());
+    ASSERT_EQUAL("@16962 [@:\"example:point:list\" [1, 2, \"a\"], @:\"example:point:list\" [3.5, -4, \"b\"], 7]",
+                 to_string(v));
+    segment s2 = get<segment>(v);
+    ASSERT_EQUAL(3.5, s2.to.x);
+    ASSERT_EQUAL("b", s2.to.label);
+    ASSERT_EQUAL(7U, s2.weight);
+
+    // Wire bytes round trip without a value
+    codec::encoder e(internal::data::create());
+    e << s;
+    std::string bytes = e.encode();
+    codec::decoder d(internal::data::create(), true);
+    d.decode(bytes);
+    d.rewind();
+    segment s3;
+    d >> s3;
+    ASSERT_EQUAL(-4, s3.to.y);
+
+    // Fields missing from the end keep their value
+    short_segment ss = { {5, 6, "c"} };
+    segment s4 = s;
+    get(value(ss), s4);
+    ASSERT_EQUAL("c", s4.from.label);
+    ASSERT_EQUAL("b", s4.to.label);
+    ASSERT_EQUAL(7U, s4.weight);
+
+    point p;
+    ASSERT_THROWS(conversion_error, get(v, p)); // Wrong descriptor type
+    ASSERT_THROWS(conversion_error, get(value(s.from), ss));
+}
+#endif
+
 template <class T> void  simple_type_test(const T& x) {
     ASSERT(codec::is_encodable<T>::value);
     value v;
@@ -103,6 +152,10 @@ int main(int, char**) {
     RUN_TEST(failed, simple_type_test(annotation_key(42)));
     RUN_TEST(failed, simple_type_test(message_id(42)));
 
+#if PN_CPP_HAS_CPP11
+    RUN_TEST(failed, described_type_test());
+#endif
+
     // Make sure we reject uncodable types
     RUN_TEST(failed, (uncodable_type_test<std::pair<int, float> >()));
     RUN_TEST(failed, (uncodable_type_test<std::pair<scalar, value> >()));
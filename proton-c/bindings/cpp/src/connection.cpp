@@ -37,6 +37,7 @@
 #include "proton_bits.hpp"
 
 #include <proton/connection.h>
+#include <proton/link.h>
 #include <proton/session.h>
 #include <proton/transport.h>
 #include <proton/object.h>
@@ -85,22 +86,16 @@ session_range connection::sessions() const {
 }
 
 receiver_range connection::receivers() const {
-  pn_link_t *lnk = pn_link_head(pn_object(), 0);
-  while (lnk) {
-    if (pn_link_is_receiver(lnk))
-      break;
-    lnk = pn_link_next(lnk, 0);
-  }
+  pn_link_t *lnk = 0;
+  for (pn_session_t *s = pn_session_head(pn_object(), 0); s && !lnk; s = pn_session_next(s, 0))
+    lnk = pn_session_receiver_head(s, 0);
   return receiver_range(receiver_iterator(make_wrapper<receiver>(lnk)));
 }
 
 sender_range connection::senders() const {
-  pn_link_t *lnk = pn_link_head(pn_object(), 0);
-  while (lnk) {
-    if (pn_link_is_sender(lnk))
-      break;
-    lnk = pn_link_next(lnk, 0);
-  }
+  pn_link_t *lnk = 0;
+  for (pn_session_t *s = pn_session_head(pn_object(), 0); s && !lnk; s = pn_session_next(s, 0))
+    lnk = pn_session_sender_head(s, 0);
   return sender_range(sender_iterator(make_wrapper<sender>(lnk)));
 }
 
@@ -174,4 +169,37 @@ uint32_t connection::idle_timeout() const {
     return pn_transport_get_remote_idle_timeout(pn_connection_transport(pn_object()));
 }
 
+size_t connection::memory_usage() const {
+    return pn_connection_memory_usage(pn_object());
+}
+
+size_t connection::output_backlog() const {
+    return pn_connection_output_backlog(pn_object());
+}
+
+connection_stats connection::stats() const {
+    connection_stats s;
+    pn_transport_stats_t ts;
+    pn_transport_stats(pn_connection_transport(pn_object()), &ts);
+    s.frames_input = ts.frames_input;
+    s.frames_output = ts.frames_output;
+    s.bytes_input = ts.bytes_input;
+    s.bytes_output = ts.bytes_output;
+    // Performatives are indexed by descriptor code from open (0x10)
+    s.transfers_input = ts.performative_frames_input[0x14 - 0x10];
+    s.transfers_output = ts.performative_frames_output[0x14 - 0x10];
+    s.flows_input = ts.performative_frames_input[0x13 - 0x10];
+    s.flows_output = ts.performative_frames_output[0x13 - 0x10];
+    for (pn_link_t *l = pn_link_head(pn_object(), 0); l; l = pn_link_next(l, 0)) {
+        pn_link_stats_t ls;
+        pn_link_stats(l, &ls);
+        s.deliveries += ls.deliveries;
+        s.settled += ls.settled;
+        s.settle_time += ls.settle_time;
+        s.credit_blocked += ls.credit_blocked;
+        s.window_blocked += ls.window_blocked;
+    }
+    return s;
+}
+
 }
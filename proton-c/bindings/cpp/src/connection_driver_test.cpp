@@ -30,12 +30,25 @@
 #include "proton/receiver_options.hpp"
 #include "proton/sender.hpp"
 #include "proton/sender_options.hpp"
+#include "proton/session_options.hpp"
 #include "proton/source_options.hpp"
 #include "proton/thread_safe.hpp"
+#include "proton/timestamp.hpp"
+#include "proton/tracker.hpp"
+#include "proton/transaction.hpp"
+#include "proton/typed_handler.hpp"
 #include "proton/types_fwd.hpp"
 #include "proton/uuid.hpp"
+#include "proton/worker_queue.hpp"
+
+#include <proton/delivery.h>
+#include <proton/disposition.h>
+#include <proton/session.h>
+#include <proton/terminus.h>
 
 #include <deque>
+#include <sstream>
+#include <vector>
 #include <algorithm>
 
 namespace {
@@ -74,7 +87,7 @@ struct in_memory_driver : public connection_driver {
     void do_write() {
         const_buffer wbuf = write_buffer();
         if (wbuf.size) {
-            writes.insert(writes.begin(),
+            writes.insert(writes.end(),
                           static_cast<const char*>(wbuf.data),
                           static_cast<const char*>(wbuf.data) + wbuf.size);
             write_done(wbuf.size);
@@ -340,6 +353,692 @@ void test_message() {
     ASSERT_EQUAL(value("b"), m2.message_annotations().get("a"));
 }
 
+void test_message_fanout() {
+    // One copy sent on several links arrives intact on each
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+
+    proton::sender s1 = d.a.connection().open_sender("x");
+    proton::sender s2 = d.a.connection().open_sender("y");
+    proton::message m("fan");
+    m.properties().put("x", "y");
+    proton::message c(m);
+    s1.send(c);
+    s2.send(c);
+    m.body() = "changed";
+
+    while (hb.messages.size() < 2)
+        d.process();
+
+    for (int i = 0; i < 2; ++i) {
+        proton::message r = quick_pop(hb.messages);
+        ASSERT_EQUAL(value("fan"), r.body());
+        ASSERT_EQUAL(value("y"), r.properties().get("x"));
+    }
+}
+
+/// Receives messages by chunk into a buffer, with a small session window
+struct stream_handler : public record_handler {
+    binary data;
+    size_t chunks, max_chunk;
+    bool last;
+
+    stream_handler() : chunks(0), max_chunk(0), last(false) {}
+
+    void on_session_open(session &s) PN_CPP_OVERRIDE {
+        pn_session_set_incoming_capacity(unwrap(s), 8*1024);
+        record_handler::on_session_open(s);
+    }
+
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(receiver_options().stream_messages(true));
+        receivers.push_back(l);
+    }
+
+    void on_message_chunk(delivery&, const binary& chunk, bool last_chunk) PN_CPP_OVERRIDE {
+        data.insert(data.end(), chunk.begin(), chunk.end());
+        max_chunk = std::max(max_chunk, chunk.size());
+        ++chunks;
+        last = last_chunk;
+    }
+};
+
+void test_message_stream() {
+    // A large message arrives in window-sized chunks and reassembles intact
+    record_handler ha;
+    stream_handler hb;
+    driver_pair d(ha, connection_options(hb).max_frame_size(1024));
+
+    proton::sender s = d.a.connection().open_sender("x");
+    proton::message m(std::string(100000, 'x'));
+    s.send(m);
+
+    while (!hb.last)
+        d.process();
+
+    ASSERT(hb.chunks > 1);
+    ASSERT(hb.max_chunk <= 8*1024U);
+    ASSERT(hb.messages.empty());
+    proton::message m2;
+    m2.decode(std::vector<char>(hb.data.begin(), hb.data.end()));
+    ASSERT_EQUAL(value(std::string(100000, 'x')), m2.body());
+}
+
+void test_send_encoded() {
+    // Streamed bytes are forwarded without decoding and arrive as the message
+    record_handler ha, hc;
+    stream_handler hb;
+    driver_pair d(ha, hb), e(ha, hc);
+    proton::sender s = d.a.connection().open_sender("x");
+    proton::message m("forwarded");
+    m.subject("s");
+    s.send(m);
+    while (!hb.last)
+        d.process();
+
+    proton::sender f = e.a.connection().open_sender("y");
+    while (!f.credit())
+        e.process();
+    f.send_encoded(hb.data);
+    while (hc.messages.empty())
+        e.process();
+    proton::message m2 = quick_pop(hc.messages);
+    ASSERT_EQUAL(value("forwarded"), m2.body());
+    ASSERT_EQUAL("s", m2.subject());
+}
+
+
+/// Receives messages in batches
+struct batch_handler : public record_handler {
+    std::vector<size_t> batches;
+
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(receiver_options().batch_messages(true).credit_window(100));
+        receivers.push_back(l);
+    }
+
+    void on_messages(receiver&, std::vector<delivery>& ds, std::vector<message>& ms) PN_CPP_OVERRIDE {
+        ASSERT_EQUAL(ds.size(), ms.size());
+        batches.push_back(ds.size());
+        for (size_t i = 0; i < ms.size(); ++i) messages.push_back(ms[i]);
+    }
+};
+
+/// Counts accepted messages
+struct accept_handler : public record_handler {
+    int accepted;
+    accept_handler() : accepted(0) {}
+    void on_tracker_accept(tracker&) PN_CPP_OVERRIDE { ++accepted; }
+};
+
+void test_message_batch() {
+    // Messages that arrive together are handed over together, in order, and accepted
+    accept_handler ha;
+    batch_handler hb;
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    while (s.credit() < 20)
+        d.process();
+    for (int i = 0; i < 20; ++i)
+        s.send(proton::message(i));
+
+    while (ha.accepted < 20)
+        d.process();
+
+    ASSERT(hb.batches.size() < 20U);
+    size_t total = 0;
+    for (size_t i = 0; i < hb.batches.size(); ++i) total += hb.batches[i];
+    ASSERT_EQUAL(20U, total);
+    for (int i = 0; i < 20; ++i)
+        ASSERT_EQUAL(value(i), quick_pop(hb.messages).body());
+}
+
+/// Receives only red messages
+struct selector_handler : public record_handler {
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(receiver_options().selector("colour = 'red' AND JMSPriority > 4"));
+        receivers.push_back(l);
+    }
+};
+
+/// Counts accepted and released messages
+struct outcome_handler : public accept_handler {
+    int released;
+    outcome_handler() : released(0) {}
+    void on_tracker_release(tracker&) PN_CPP_OVERRIDE { ++released; }
+};
+
+void test_message_selector() {
+    // Messages the selector does not match are given back to the sender unseen
+    outcome_handler ha;
+    selector_handler hb;
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    while (s.credit() < 6)
+        d.process();
+    for (int i = 0; i < 6; ++i) {
+        proton::message m(i);
+        m.properties().put("colour", i % 2 ? "blue" : "red");
+        m.priority(uint8_t(i < 4 ? 9 : 1));
+        s.send(m);
+    }
+    while (ha.accepted + ha.released < 6)
+        d.process();
+
+    ASSERT_EQUAL(2, ha.accepted);
+    ASSERT_EQUAL(4, ha.released);
+    ASSERT_EQUAL(2U, hb.messages.size());
+    ASSERT_EQUAL(value(0), quick_pop(hb.messages).body());
+    ASSERT_EQUAL(value(2), quick_pop(hb.messages).body());
+
+    // Errors in the expression are found when it is set
+    try {
+        receiver_options().selector("colour = ");
+        FAIL("no error for a bad selector");
+    } catch (const proton::error&) {}
+}
+}
+
+void test_send_packed() {
+    // Packed messages take one credit and one outcome, and arrive one by one
+    accept_handler ha;
+    record_handler hb;
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x");
+    while (!s.credit())
+        d.process();
+    int credit = s.credit();
+    std::vector<proton::message> msgs;
+    for (int i = 0; i < 3; ++i)
+        msgs.push_back(proton::message(i));
+    tracker t = s.send_packed(msgs);
+    ASSERT_EQUAL(credit - 1, s.credit());
+    ASSERT_THROWS(proton::error, s.send_packed(std::vector<proton::message>()));
+    while (!ha.accepted)
+        d.process();
+    ASSERT_EQUAL(tracker::ACCEPTED, t.state());
+    ASSERT_EQUAL(3U, hb.messages.size());
+    for (int i = 0; i < 3; ++i)
+        ASSERT_EQUAL(value(i), quick_pop(hb.messages).body());
+
+    // A batching receiver gets every message of the delivery in one batch
+    batch_handler hc;
+    driver_pair e(ha, hc);
+    s = e.a.connection().open_sender("y");
+    while (!s.credit())
+        e.process();
+    s.send(proton::message(-1));
+    s.send_packed(msgs);
+    s.send(proton::message(3));
+    while (ha.accepted < 4)
+        e.process();
+    ASSERT_EQUAL(5U, hc.messages.size());
+    for (int i = -1; i < 4; ++i)
+        ASSERT_EQUAL(value(i), quick_pop(hc.messages).body());
+}
+
+/// Opens receivers with a credit low-water mark
+struct low_water_handler : public record_handler {
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(receiver_options().credit_window(10).credit_low_water(5));
+        receivers.push_back(l);
+    }
+};
+
+void test_credit_low_water() {
+    // Credit is restored to the window only once it falls to the low-water mark
+    record_handler ha;
+    low_water_handler hb;
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    while (s.credit() < 10)
+        d.process();
+    for (int i = 1; i <= 5; ++i) {
+        s.send(proton::message(i));
+        while (hb.messages.size() < size_t(i))
+            d.process();
+        for (int j = 0; j < 5; ++j) d.process();
+        ASSERT_EQUAL(i < 5 ? 10 - i : 10, s.credit());
+    }
+}
+
+/// Opens receivers with adaptive credit
+struct adaptive_handler : public record_handler {
+    size_t max_bytes;
+    adaptive_handler(size_t n) : max_bytes(n) {}
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(receiver_options().credit_window(2).adaptive_credit(max_bytes));
+        receivers.push_back(l);
+    }
+};
+
+int adaptive_max_credit(size_t max_bytes, size_t body_size) {
+    record_handler ha;
+    adaptive_handler hb(max_bytes);
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x");
+    int max_credit = 0;
+    timestamp end = timestamp::now() + duration(200);
+    while (timestamp::now() < end) {
+        while (s.credit() > 0) s.send(proton::message(std::string(body_size, 'x')));
+        d.process();
+        hb.messages.clear();
+        max_credit = std::max(max_credit, s.credit());
+    }
+    return max_credit;
+}
+
+void test_adaptive_credit() {
+    // The window grows past its start while credit limits the rate, but
+    // never buffers more than max_bytes
+    ASSERT(adaptive_max_credit(1024*1024, 100) > 2);
+    ASSERT(adaptive_max_credit(4000, 1000) <= 4);
+}
+
+void test_session_incoming_capacity() {
+    // incoming_capacity() budgets the session even with no max frame size
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    session s = d.a.connection().open_session(session_options().incoming_capacity(4096));
+    ASSERT_EQUAL(4096U, pn_session_get_incoming_capacity(unwrap(s)));
+    ASSERT(pn_session_get_incoming_budget(unwrap(s)));
+    ASSERT(!pn_session_get_incoming_budget(unwrap(d.a.connection().open_session())));
+}
+
+void test_send_batch() {
+    // send_batch() sends what the credit allows and returns the trackers
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x");
+    while (s.credit() < 10)
+        d.process();
+    std::vector<proton::message> msgs;
+    for (int i = 0; i < 15; ++i)
+        msgs.push_back(proton::message(i));
+    std::vector<tracker> trackers;
+    ASSERT_EQUAL(10U, s.send_batch(msgs, trackers));
+    ASSERT_EQUAL(10U, trackers.size());
+    ASSERT_EQUAL(0, s.credit());
+    ASSERT(trackers[9].sender() == s);
+    ASSERT_EQUAL(0U, s.send_batch(msgs, trackers));
+
+    while (hb.messages.size() < 10)
+        d.process();
+    for (int i = 0; i < 10; ++i)
+        ASSERT_EQUAL(value(i), quick_pop(hb.messages).body());
+}
+
+/// Sends from on_sendable while there is credit, records the largest output backlog
+struct greedy_sender : public record_handler {
+    int sent;
+    size_t max_backlog;
+    greedy_sender() : sent(0), max_backlog(0) {}
+    void on_sendable(sender &s) PN_CPP_OVERRIDE {
+        while (s.credit() > 0 && sent < 100) {
+            s.send(proton::message(std::string(1000, 'x')));
+            ++sent;
+            max_backlog = std::max(max_backlog, s.connection().output_backlog());
+        }
+    }
+};
+
+void test_output_high_water() {
+    // Credit is withheld past the output high-water mark, on_sendable resumes when it drains
+    greedy_sender ha;
+    record_handler hb;
+    driver_pair d(connection_options().handler(ha).output_high_water(4096), hb);
+    proton::sender s = d.a.connection().open_sender("x");
+    while (ha.sent == 0)
+        d.process();
+    ASSERT(ha.sent < 10);
+    ASSERT_EQUAL(0, s.credit());
+    ASSERT(pn_link_credit(unwrap(s)) > 0);
+    while (hb.messages.size() < 100)
+        d.process();
+    ASSERT_EQUAL(100, ha.sent);
+    ASSERT(ha.max_backlog < 4096 + 1100);
+}
+
+/// Records the settlements batched by on_trackers_settled
+struct batch_settle_handler : public record_handler {
+    std::vector<size_t> batches;
+    int accepted;
+    batch_settle_handler() : accepted(0) {}
+    void on_trackers_settled(sender &s, tracker_range ts) PN_CPP_OVERRIDE {
+        size_t n = 0;
+        for (tracker* t = ts.begin(); t != ts.end(); ++t, ++n)
+            ASSERT(t->sender() == s);
+        batches.push_back(n);
+        messaging_handler::on_trackers_settled(s, ts);
+    }
+    void on_tracker_accept(tracker &) PN_CPP_OVERRIDE { ++accepted; }
+};
+
+void test_batch_settlements() {
+    // Trackers settled by one ranged disposition come in one call
+    batch_settle_handler ha;
+    record_handler hb;
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x", sender_options().batch_settlements(true));
+    while (s.credit() < 10)
+        d.process();
+    for (int i = 0; i < 10; ++i)
+        s.send(proton::message(i));
+    while (ha.accepted < 10)
+        d.process();
+    size_t total = 0;
+    for (size_t i = 0; i < ha.batches.size(); ++i) total += ha.batches[i];
+    ASSERT_EQUAL(10U, total);
+    ASSERT(ha.batches.size() < 10);
+    ASSERT_EQUAL(0, pn_link_unsettled(unwrap(s)));
+}
+
+void test_priority_ordering() {
+    // Messages held for credit go highest priority first, in call order within a priority
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x", sender_options().priority_ordering(true));
+    const int priority[] = { 1, 9, 4, 9, 1 };
+    for (int i = 0; i < 5; ++i) {
+        proton::message m(i);
+        m.priority(uint8_t(priority[i]));
+        ASSERT(!s.send(m));
+    }
+    while (hb.messages.size() < 5)
+        d.process();
+    const int order[] = { 1, 3, 2, 0, 4 };
+    for (int i = 0; i < 5; ++i)
+        ASSERT_EQUAL(value(order[i]), quick_pop(hb.messages).body());
+
+    // With credit and nothing held a message goes at once
+    ASSERT(!!s.send(proton::message(5)));
+}
+
+#if PN_CPP_SUPPORTS_THREADS
+void test_worker_queue() {
+    // Messages go to the worker queue and are settled from its items,
+    // those that find it full wait unsettled and hold back credit
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    proton::worker_queue q(4);
+    receiver r = d.a.connection().open_receiver("x", receiver_options().worker_queue(q));
+    while (hb.senders.empty() || hb.senders.front().credit() < 10)
+        d.process();
+    sender s = hb.senders.front();
+    std::vector<tracker> t;
+    for (int i = 0; i < 6; ++i)
+        t.push_back(s.send(proton::message(i)));
+    while (pn_link_unsettled(unwrap(r)) < 6)
+        d.process();
+    for (int i = 0; i < 4; ++i)
+        d.process();
+    // The last two are not seen by on_message or accepted, and their credit is not restored
+    ASSERT(ha.messages.empty());
+    ASSERT_EQUAL(6, pn_link_unsettled(unwrap(r)));
+    ASSERT_EQUAL(8, r.credit());
+    ASSERT_EQUAL(8, s.credit());
+    for (int i = 0; i < 6; ++i)
+        ASSERT_EQUAL(proton::transfer::NONE, t[i].state());
+
+    proton::worker_queue::item it;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT(q.try_pop(it));
+        ASSERT_EQUAL(value(i), it.message.body());
+        if (i == 1) it.reject(); else it.accept();
+        it.accept();            // Settling twice does nothing
+    }
+    ASSERT(!q.try_pop(it));
+    // Settling makes room, the waiting messages follow in order
+    while (t[3].state() != proton::transfer::ACCEPTED)
+        d.process();
+    ASSERT_EQUAL(proton::transfer::ACCEPTED, t[0].state());
+    ASSERT_EQUAL(proton::transfer::REJECTED, t[1].state());
+    ASSERT_EQUAL(proton::transfer::ACCEPTED, t[2].state());
+    ASSERT_EQUAL(proton::transfer::NONE, t[4].state());
+    ASSERT(q.try_pop(it));
+    ASSERT_EQUAL(value(4), it.message.body());
+    it.release();
+    ASSERT(q.try_pop(it));
+    ASSERT_EQUAL(value(5), it.message.body());
+    it.accept();
+    while (t[5].state() != proton::transfer::ACCEPTED || s.credit() < 10)
+        d.process();
+    ASSERT_EQUAL(proton::transfer::RELEASED, t[4].state());
+    ASSERT_EQUAL(0, pn_link_unsettled(unwrap(r)));
+    ASSERT(ha.messages.empty());
+
+    q.close();
+    ASSERT(!q.pop(it));
+}
+#endif
+
+void test_send_settled() {
+    // send_settled() goes without a delivery while there is credit, queued after
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    proton::sender s = d.a.connection().open_sender("x", sender_options().delivery_mode(delivery_mode::AT_MOST_ONCE));
+    while (s.credit() < 10)
+        d.process();
+    for (int i = 0; i < 12; ++i)
+        s.send_settled(proton::message(i));
+    ASSERT_EQUAL(0, pn_link_unsettled(unwrap(s)));
+    ASSERT_EQUAL(2, pn_link_queued(unwrap(s)));
+    while (hb.messages.size() < 12)
+        d.process();
+    for (int i = 0; i < 12; ++i)
+        ASSERT_EQUAL(value(i), quick_pop(hb.messages).body());
+}
+
+/// Declares only on_sendable and on_tracker_accept
+struct typed_sender : public typed_handler<typed_sender> {
+    int sendable, accepted;
+    typed_sender() : sendable(0), accepted(0) {}
+    void on_sendable(sender &) PN_CPP_OVERRIDE { ++sendable; }
+    void on_tracker_accept(tracker &) PN_CPP_OVERRIDE { ++accepted; }
+};
+
+struct typed_receiver : public typed_handler<typed_receiver> {
+    std::deque<proton::message> messages;
+    void on_message(delivery &, message &m) PN_CPP_OVERRIDE { messages.push_back(m); }
+};
+
+/// Declares no handler functions at all
+struct typed_sink : public typed_handler<typed_sink> {};
+
+void test_typed_handler() {
+    {
+        // Messages to a handler without on_message are accepted undecoded
+        typed_sender ha;
+        typed_sink hb;
+        driver_pair d(ha, hb);
+        proton::sender s = d.a.connection().open_sender("x");
+        while (!ha.sendable)
+            d.process();
+        for (int i = 0; i < 3; ++i)
+            s.send(proton::message(i));
+        while (ha.accepted < 3)
+            d.process();
+        ASSERT_EQUAL(0, pn_link_unsettled(unwrap(s)));
+    }
+    {
+        typed_sender ha;
+        typed_receiver hb;
+        driver_pair d(ha, hb);
+        proton::sender s = d.a.connection().open_sender("x");
+        while (!ha.sendable)
+            d.process();
+        for (int i = 0; i < 3; ++i)
+            s.send(proton::message(i));
+        while (hb.messages.size() < 3 || ha.accepted < 3)
+            d.process();
+        for (int i = 0; i < 3; ++i)
+            ASSERT_EQUAL(value(i), quick_pop(hb.messages).body());
+    }
+}
+
+// The transaction id of a transactional state
+binary txn_id_of(pn_disposition_t *disp) {
+    pn_data_t *data = pn_disposition_data(disp);
+    pn_data_rewind(data);
+    if (!(pn_data_next(data) && pn_data_enter(data) && pn_data_next(data)))
+        return binary();
+    pn_bytes_t b = pn_data_get_binary(data);
+    return binary(b.start, b.start + b.size);
+}
+
+/// Plays the transaction coordinator: declares "tx" followed by a count,
+/// accepts discharges and records transactional states. Requests
+/// alternate between declare and discharge.
+struct coordinator_handler : public record_handler {
+    int declares, discharges;
+    bool refuse, active;
+    std::vector<binary> states;     // transaction ids of settled and received transfers
+    coordinator_handler() : declares(0), discharges(0), refuse(false), active(false) {}
+
+    void on_receiver_open(receiver &r) PN_CPP_OVERRIDE {
+        r.open(receiver_options().auto_accept(false));
+        receivers.push_back(r);
+    }
+
+    void on_message(delivery &d, message &m) PN_CPP_OVERRIDE {
+        pn_delivery_t *dlv = unwrap(d);
+        if (pn_terminus_get_type(pn_link_remote_target(pn_delivery_link(dlv))) != PN_COORDINATOR) {
+            if (pn_delivery_remote_state(dlv) == 0x34)
+                states.push_back(txn_id_of(pn_delivery_remote(dlv)));
+            record_handler::on_message(d, m);
+            d.accept();
+        } else if (refuse) {
+            d.reject();
+        } else if (active) {
+            active = false;     // A discharge
+            ++discharges;
+            d.accept();
+        } else {
+            active = true;
+            ++declares;
+            std::ostringstream id;
+            id << "tx" << declares;
+            pn_data_t *data = pn_disposition_data(pn_delivery_local(dlv));
+            pn_data_put_list(data);
+            pn_data_enter(data);
+            pn_data_put_binary(data, pn_bytes(id.str().size(), id.str().data()));
+            pn_data_exit(data);
+            pn_delivery_update(dlv, 0x33);
+            d.settle();
+        }
+    }
+
+    void on_tracker_settle(tracker &t) PN_CPP_OVERRIDE {
+        if (pn_delivery_remote_state(unwrap(t)) == 0x34)
+            states.push_back(txn_id_of(pn_delivery_remote(unwrap(t))));
+    }
+};
+
+/// Records transaction events and the deliveries it is to accept
+struct transaction_handler : public record_handler {
+    int declared, committed, aborted, failed;
+    std::vector<delivery> deliveries;
+    transaction_handler() : declared(0), committed(0), aborted(0), failed(0) {}
+
+    void on_message(delivery &d, message &) PN_CPP_OVERRIDE { deliveries.push_back(d); }
+    void on_transaction_declare(transaction &) PN_CPP_OVERRIDE { ++declared; }
+    void on_transaction_commit(transaction &) PN_CPP_OVERRIDE { ++committed; }
+    void on_transaction_abort(transaction &) PN_CPP_OVERRIDE { ++aborted; }
+    void on_transaction_error(transaction &) PN_CPP_OVERRIDE { ++failed; }
+};
+
+void test_transaction() {
+    // Messages accepted and sent in a transaction are discharged together
+    transaction_handler ha;
+    coordinator_handler hb;
+    driver_pair d(ha, hb);
+    receiver r = d.a.connection().open_receiver("q", receiver_options().auto_accept(false));
+    session s = r.session();
+    sender out = s.open_sender("out");
+    while (hb.senders.empty() || !out.credit())
+        d.process();
+    for (int i = 0; i < 3; ++i)
+        hb.senders.front().send(proton::message(i));
+    while (ha.deliveries.size() < 3)
+        d.process();
+
+    transaction t = s.declare_transaction();
+    ASSERT(!t.declared());
+    ASSERT_THROWS(proton::error, s.declare_transaction());
+    ASSERT_THROWS(proton::error, t.commit());
+    while (!ha.declared)
+        d.process();
+    ASSERT(t.declared());
+    ASSERT_EQUAL(binary(std::string("tx1")), t.id());
+    ASSERT_EQUAL(1U, ha.senders.size()); // The coordinator link is not reported
+    ASSERT_EQUAL(out, ha.senders.front());
+
+    for (size_t i = 0; i < ha.deliveries.size(); ++i)
+        t.accept(ha.deliveries[i]);
+    t.send(out, proton::message("x"));
+    t.commit();
+    ASSERT(!t.declared());
+    while (!ha.committed)
+        d.process();
+    ASSERT_EQUAL(1, hb.discharges);
+    ASSERT_EQUAL(4U, hb.states.size());
+    for (size_t i = 0; i < hb.states.size(); ++i)
+        ASSERT_EQUAL(binary(std::string("tx1")), hb.states[i]);
+    ASSERT(t.id().empty());
+
+    // The coordinator link is kept for the next transaction
+    t = s.declare_transaction();
+    while (ha.declared < 2)
+        d.process();
+    ASSERT_EQUAL(binary(std::string("tx2")), t.id());
+    t.abort();
+    while (!ha.aborted)
+        d.process();
+    ASSERT_EQUAL(1, ha.committed);
+    ASSERT_EQUAL(2, hb.discharges);
+
+    hb.refuse = true;
+    t = s.declare_transaction();
+    while (!ha.failed)
+        d.process();
+    ASSERT(!t.declared());
+    ASSERT(!t.error().empty());
+}
+
+template <class R> std::vector<link> links(R range) {
+    std::vector<link> v;
+    for (typename R::iterator i = range.begin(); i != range.end(); ++i)
+        v.push_back(*i);
+    return v;
+}
+
+void test_link_ranges() {
+    // Each range visits only its own links, a connection's go session by session
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+    session s1 = d.a.connection().open_session();
+    session s2 = d.a.connection().open_session();
+    sender a = s1.open_sender("a");
+    receiver b = s2.open_receiver("b");
+    sender c = s2.open_sender("c");
+    sender e = s1.open_sender("e");
+    receiver f = s1.open_receiver("f");
+
+    std::vector<link> v = links(s1.senders());
+    ASSERT_EQUAL(2U, v.size());
+    ASSERT(v[0] == a && v[1] == e);
+    v = links(s1.receivers());
+    ASSERT(v.size() == 1 && v[0] == f);
+    v = links(s2.senders());
+    ASSERT(v.size() == 1 && v[0] == c);
+    v = links(d.a.connection().senders());
+    ASSERT_EQUAL(3U, v.size());
+    ASSERT(v[0] == a && v[1] == e && v[2] == c);
+    v = links(d.a.connection().receivers());
+    ASSERT(v.size() == 2 && v[0] == f && v[1] == b);
 }
 
 int main(int argc, char** argv) {
@@ -350,6 +1049,26 @@ int main(int argc, char** argv) {
     RUN_ARGV_TEST(failed, test_no_container());
     RUN_ARGV_TEST(failed, test_spin_interrupt());
     RUN_ARGV_TEST(failed, test_message());
+    RUN_ARGV_TEST(failed, test_message_fanout());
+    RUN_ARGV_TEST(failed, test_message_stream());
+    RUN_ARGV_TEST(failed, test_send_encoded());
+    RUN_ARGV_TEST(failed, test_message_batch());
+    RUN_ARGV_TEST(failed, test_message_selector());
+    RUN_ARGV_TEST(failed, test_send_packed());
+    RUN_ARGV_TEST(failed, test_credit_low_water());
+    RUN_ARGV_TEST(failed, test_adaptive_credit());
+    RUN_ARGV_TEST(failed, test_session_incoming_capacity());
     RUN_ARGV_TEST(failed, test_link_filters());
+    RUN_ARGV_TEST(failed, test_link_ranges());
+    RUN_ARGV_TEST(failed, test_send_batch());
+    RUN_ARGV_TEST(failed, test_output_high_water());
+    RUN_ARGV_TEST(failed, test_batch_settlements());
+    RUN_ARGV_TEST(failed, test_priority_ordering());
+#if PN_CPP_SUPPORTS_THREADS
+    RUN_ARGV_TEST(failed, test_worker_queue());
+#endif
+    RUN_ARGV_TEST(failed, test_send_settled());
+    RUN_ARGV_TEST(failed, test_typed_handler());
+    RUN_ARGV_TEST(failed, test_transaction());
     return failed;
 }
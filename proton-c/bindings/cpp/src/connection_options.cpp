@@ -53,11 +53,15 @@ class connection_options::impl {
     option<uint32_t> max_frame_size;
     option<uint16_t> max_sessions;
     option<duration> idle_timeout;
+    option<size_t> memory_limit;
+    option<size_t> output_high_water;
+    option<size_t> work_queue_capacity;
     option<std::string> container_id;
     option<std::string> virtual_host;
     option<std::string> user;
     option<std::string> password;
     option<reconnect_timer> reconnect;
+    option<std::vector<std::string> > failover_urls;
     option<class ssl_client_options> ssl_client_options;
     option<class ssl_server_options> ssl_server_options;
     option<bool> sasl_enabled;
@@ -136,6 +140,10 @@ class connection_options::impl {
             pn_transport_set_channel_max(pnt, max_sessions.value);
         if (idle_timeout.set)
             pn_transport_set_idle_timeout(pnt, idle_timeout.value.milliseconds());
+        if (memory_limit.set)
+            pn_connection_set_memory_limit(pnc, memory_limit.value);
+        if (output_high_water.set)
+            pn_connection_set_output_high_water(pnc, output_high_water.value);
     }
 
     void update(const impl& x) {
@@ -143,11 +151,15 @@ class connection_options::impl {
         max_frame_size.update(x.max_frame_size);
         max_sessions.update(x.max_sessions);
         idle_timeout.update(x.idle_timeout);
+        memory_limit.update(x.memory_limit);
+        output_high_water.update(x.output_high_water);
+        work_queue_capacity.update(x.work_queue_capacity);
         container_id.update(x.container_id);
         virtual_host.update(x.virtual_host);
         user.update(x.user);
         password.update(x.password);
         reconnect.update(x.reconnect);
+        failover_urls.update(x.failover_urls);
         ssl_client_options.update(x.ssl_client_options);
         ssl_server_options.update(x.ssl_server_options);
         sasl_enabled.update(x.sasl_enabled);
@@ -157,6 +169,17 @@ class connection_options::impl {
         sasl_config_path.update(x.sasl_config_path);
     }
 
+    bool empty() const {
+        return !(handler.set || max_frame_size.set || max_sessions.set ||
+                 idle_timeout.set || memory_limit.set || output_high_water.set ||
+                 work_queue_capacity.set || container_id.set ||
+                 virtual_host.set || user.set || password.set || reconnect.set || failover_urls.set ||
+                 ssl_client_options.set || ssl_server_options.set ||
+                 sasl_enabled.set || sasl_allow_insecure_mechs.set ||
+                 sasl_allowed_mechs.set || sasl_config_name.set ||
+                 sasl_config_path.set);
+    }
+
 };
 
 connection_options::connection_options() : impl_(new impl()) {}
@@ -183,11 +206,15 @@ connection_options& connection_options::handler(class messaging_handler &h) { im
 connection_options& connection_options::max_frame_size(uint32_t n) { impl_->max_frame_size = n; return *this; }
 connection_options& connection_options::max_sessions(uint16_t n) { impl_->max_sessions = n; return *this; }
 connection_options& connection_options::idle_timeout(duration t) { impl_->idle_timeout = t; return *this; }
+connection_options& connection_options::memory_limit(size_t n) { impl_->memory_limit = n; return *this; }
+connection_options& connection_options::output_high_water(size_t n) { impl_->output_high_water = n; return *this; }
+connection_options& connection_options::work_queue_capacity(size_t n) { impl_->work_queue_capacity = n; return *this; }
 connection_options& connection_options::container_id(const std::string &id) { impl_->container_id = id; return *this; }
 connection_options& connection_options::virtual_host(const std::string &id) { impl_->virtual_host = id; return *this; }
 connection_options& connection_options::user(const std::string &user) { impl_->user = user; return *this; }
 connection_options& connection_options::password(const std::string &password) { impl_->password = password; return *this; }
 connection_options& connection_options::reconnect(const reconnect_timer &rc) { impl_->reconnect = rc; return *this; }
+connection_options& connection_options::failover_urls(const std::vector<std::string>& urls) { impl_->failover_urls = urls; return *this; }
 connection_options& connection_options::ssl_client_options(const class ssl_client_options &c) { impl_->ssl_client_options = c; return *this; }
 connection_options& connection_options::ssl_server_options(const class ssl_server_options &c) { impl_->ssl_server_options = c; return *this; }
 connection_options& connection_options::sasl_enabled(bool b) { impl_->sasl_enabled = b; return *this; }
@@ -199,4 +226,7 @@ connection_options& connection_options::sasl_config_path(const std::string &p) {
 void connection_options::apply_unbound(connection& c) const { impl_->apply_unbound(c); }
 void connection_options::apply_bound(connection& c) const { impl_->apply_bound(c); }
 messaging_handler* connection_options::handler() const { return impl_->handler.value; }
+bool connection_options::empty() const { return impl_->empty(); }
+std::vector<std::string> connection_options::failover_urls() const { return impl_->failover_urls.value; }
+size_t connection_options::work_queue_capacity() const { return impl_->work_queue_capacity.value; }
 } // namespace proton
@@ -85,10 +85,13 @@ void container::run() { impl_->run(1); }
 
 #if PN_CPP_SUPPORTS_THREADS
 void container::run(int threads) { impl_->run(threads); }
+void container::run(const std::vector<messaging_handler*>& handlers) { impl_->run(handlers); }
 #endif
 
 void container::auto_stop(bool set) { impl_->auto_stop(set); }
 
+void container::share_connections(bool set) { impl_->share_connections(set); }
+
 void container::stop(const error_condition& err) { impl_->stop(err); }
 
 returned<sender> container::open_sender(
@@ -107,7 +110,9 @@ returned<receiver> container::open_receiver(
 
 std::string container::id() const { return impl_->id(); }
 
-void container::schedule(duration d, work f) { return impl_->schedule(d, f); }
+container_stats container::stats() const { return impl_->stats(); }
+
+void container::schedule(duration d, work f) { impl_->schedule(d, f); }
 
 void container::client_connection_options(const connection_options& c) { impl_->client_connection_options(c); }
 connection_options container::client_connection_options() const { return impl_->client_connection_options(); }
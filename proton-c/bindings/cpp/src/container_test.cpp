@@ -23,16 +23,33 @@
 #include "proton/connection_options.hpp"
 #include "proton/container.hpp"
 #include "proton/default_container.hpp"
+#include "proton/delivery.hpp"
+#include "proton/endpoint_handle.hpp"
+#include "proton/message.hpp"
 #include "proton/messaging_handler.hpp"
 #include "proton/listener.hpp"
 #include "proton/listen_handler.hpp"
+#include "proton/receiver.hpp"
+#include "proton/reconnect_timer.hpp"
+#include "proton/sender.hpp"
 #include "proton/thread_safe.hpp"
+#include "proton/tracker.hpp"
+#include "proton/work_queue.hpp"
 
 #include <cstdlib>
 #include <ctime>
 #include <string>
 #include <cstdio>
+#include <set>
 #include <sstream>
+#include <vector>
+
+#if PN_CPP_SUPPORTS_THREADS
+# include <atomic>
+# include <chrono>
+# include <memory>
+# include <thread>
+#endif
 
 namespace {
 
@@ -151,6 +168,99 @@ int test_container_bad_address() {
     return 0;
 }
 
+// Connect to a listener in the same container without a network address
+class inproc_tester : public proton::messaging_handler {
+    proton::listener listener;
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        listener = c.listen("inproc:container-test");
+        c.connect("inproc:container-test");
+    }
+
+    // Get here twice - once for listener, once for connector
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        if (++opened == 1) c.close();
+    }
+
+    void on_connection_close(proton::connection &) PN_CPP_OVERRIDE {
+        if (++closed == 1) listener.stop();
+    }
+
+  public:
+    inproc_tester(): opened(0), closed(0) {}
+
+    int opened, closed;
+};
+
+int test_container_inproc() {
+    inproc_tester t;
+    proton::default_container(t).run();
+    ASSERT_EQUAL(2, t.opened);
+    ASSERT_EQUAL(2, t.closed);
+    return 0;
+}
+
+// Send messages over an in-process connection, sampling the container's stats
+class stats_tester : public proton::messaging_handler {
+    proton::listener listener;
+    proton::container* container;
+    int sent, received, closed;
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        container = &c;
+        listener = c.listen("inproc:stats-test");
+        c.open_sender("inproc:stats-test");
+    }
+
+    void on_sendable(proton::sender& s) PN_CPP_OVERRIDE {
+        for (; s.credit() > 0 && sent < 10; ++sent)
+            s.send(proton::message(sent));
+    }
+
+    void on_message(proton::delivery&, proton::message&) PN_CPP_OVERRIDE { ++received; }
+
+    void on_tracker_accept(proton::tracker& t) PN_CPP_OVERRIDE {
+        if (++accepted == 10) {
+            running = container->stats();
+            t.connection().close();
+        }
+    }
+
+    void on_connection_close(proton::connection &) PN_CPP_OVERRIDE {
+        if (++closed == 1) listener.stop();
+    }
+
+  public:
+    stats_tester(): container(0), sent(0), received(0), closed(0), accepted(0) {}
+
+    int accepted;
+    proton::container_stats running;
+};
+
+int test_container_stats() {
+    stats_tester t;
+    proton::default_container c(t);
+    c.run();
+    ASSERT_EQUAL(10, t.accepted);
+    ASSERT_EQUAL(2U, t.running.connections);
+    ASSERT_EQUAL(2U, t.running.links);
+    ASSERT_EQUAL(10U, t.running.deliveries_output);
+    ASSERT_EQUAL(10U, t.running.deliveries_input);
+    ASSERT(t.running.bytes_output > 0 && t.running.memory > 0);
+
+    proton::container_stats s = c.stats();
+    ASSERT_EQUAL(0U, s.connections);
+    ASSERT_EQUAL(2U, s.connections_opened);
+    ASSERT_EQUAL(0U, s.links);
+    ASSERT_EQUAL(0U, s.memory);
+    ASSERT_EQUAL(s.bytes_output, s.bytes_input);
+    uint64_t batches = 0;
+    for (int i = 0; i < 6; ++i) batches += s.batch_latency[i];
+    ASSERT(s.batches > 0);
+    ASSERT_EQUAL(s.batches, batches);
+    return 0;
+}
+
 class stop_tester : public proton::messaging_handler {
     proton::listener listener;
 
@@ -197,6 +307,471 @@ int test_container_stop() {
     return 0;
 }
 
+// Client side of test_container_share_connections, counts the links on each connection
+class share_client : public proton::messaging_handler {
+  public:
+    std::vector<size_t> links;
+    proton::listener listener;
+
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        size_t n = 0;
+        proton::sender_range ss = c.senders();
+        for (proton::sender_iterator i = ss.begin(); i != ss.end(); ++i) ++n;
+        proton::receiver_range rs = c.receivers();
+        for (proton::receiver_iterator i = rs.begin(); i != rs.end(); ++i) ++n;
+        links.push_back(n);
+        c.close();
+    }
+
+    void on_connection_close(proton::connection &) PN_CPP_OVERRIDE {
+        if (links.size() == 2) listener.stop();
+    }
+};
+
+class share_tester : public proton::messaging_handler {
+  public:
+    share_client client;
+
+    void on_container_start(proton::container &c) PN_CPP_OVERRIDE {
+        std::string url = "127.0.0.1:" + int2string(listen_on_random_port(c, client.listener));
+        c.client_connection_options(proton::connection_options().handler(client));
+        c.share_connections(true);
+        c.open_sender(url + "/a");
+        c.open_sender(url + "/b");
+        c.open_receiver(url + "/c");
+        // Connection options of its own, so a connection of its own
+        c.open_sender(url + "/d", proton::connection_options().max_frame_size(8192));
+    }
+};
+
+int test_container_share_connections() {
+    share_tester t;
+    proton::default_container(t).run();
+    ASSERT_EQUAL(2U, t.client.links.size());
+    ASSERT_EQUAL(4U, t.client.links[0] + t.client.links[1]);
+    ASSERT(t.client.links[0] == 1 || t.client.links[1] == 1);
+    return 0;
+}
+
+// Client side of test_container_reconnect, opens its sender once
+class reconnect_client : public proton::messaging_handler {
+  public:
+    int opens;
+    reconnect_client() : opens(0) {}
+
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        if (opens++ == 0) c.open_sender("q");
+    }
+};
+
+class reconnect_tester : public proton::messaging_handler {
+  public:
+    reconnect_client client;
+    proton::listener listener;
+    int opens, receivers;
+    reconnect_tester() : opens(0), receivers(0) {}
+
+    // Nothing listens on port 1, the client fails over to the listener
+    // and back again when the first connection is forced closed.
+    void on_container_start(proton::container &c) PN_CPP_OVERRIDE {
+        std::string url = "127.0.0.1:" + int2string(listen_on_random_port(c, listener));
+        c.connect("127.0.0.1:1", proton::connection_options().handler(client)
+                  .reconnect(proton::reconnect_timer(0, -1, 10).jitter(true))
+                  .failover_urls(std::vector<std::string>(1, url)));
+    }
+
+    void on_connection_open(proton::connection &c) PN_CPP_OVERRIDE {
+        if (++opens == 1)
+            c.close(proton::error_condition("amqp:connection:forced", "failover"));
+    }
+
+    // The sender opened on the first connection comes back with the second
+    void on_receiver_open(proton::receiver &r) PN_CPP_OVERRIDE {
+        ++receivers;
+        if (opens == 2) {
+            r.connection().close();
+            listener.stop();
+        }
+    }
+
+    // The client drops the forced connection without a close of its own
+    void on_transport_error(proton::transport &) PN_CPP_OVERRIDE {}
+};
+
+int test_container_reconnect() {
+    reconnect_tester t;
+    proton::default_container(t).run();
+    ASSERT_EQUAL(2, t.client.opens);
+    ASSERT_EQUAL(2, t.opens);
+    ASSERT_EQUAL(1, t.receivers);
+    return 0;
+}
+
+#if PN_CPP_SUPPORTS_THREADS && PN_CPP_HAS_STD_FUNCTION
+
+class work_queue_tester : public proton::messaging_handler {
+  public:
+    std::unique_ptr<proton::work_queue> blocked, busy;
+    std::atomic<int> done, running;
+    bool overlap, waited;
+
+    work_queue_tester() : done(0), running(0), overlap(false), waited(false) {}
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        c.auto_stop(false);
+        blocked.reset(new proton::work_queue(c));
+        busy.reset(new proton::work_queue(c));
+        // Waits for all of the other queue's work, which must run on another thread
+        blocked->add([this, &c]() {
+            for (int i = 0; i < 5000 && done < 100; ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            waited = (done == 100);
+            c.stop();
+        });
+        for (int i = 0; i < 100; ++i) {
+            busy->add([this]() {
+                if (running++) overlap = true;
+                std::this_thread::yield();
+                --running;
+                ++done;
+            });
+        }
+    }
+};
+
+int test_container_work_queues_parallel() {
+    work_queue_tester t;
+    proton::default_container c(t);
+    c.run(4);
+    t.blocked.reset();
+    t.busy.reset();
+    ASSERT(t.waited);
+    ASSERT(!t.overlap);
+    return 0;
+}
+
+class work_queue_full_tester : public proton::messaging_handler {
+  public:
+    std::unique_ptr<proton::work_queue> queue;
+    size_t capacity;
+    int held;
+    std::atomic<int> ran;
+    bool refused, accepted;
+
+    work_queue_full_tester(size_t n, int h) : capacity(n), held(h), ran(0), refused(false), accepted(false) {}
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        c.auto_stop(false);
+        queue.reset(new proton::work_queue(c, capacity));
+        for (int i = 0; i < held; ++i)
+            queue->add([this]() { ++ran; });
+        refused = !queue->add([this]() { ++ran; });
+        proton::work_queue* q = queue.get();
+        // Room again once the queued work has run
+        c.schedule(proton::duration(10), [this, q, &c]() {
+            accepted = q->add([&c]() { c.stop(); });
+        });
+    }
+};
+
+int test_container_work_queue_full(size_t capacity, int held) {
+    work_queue_full_tester t(capacity, held);
+    proton::default_container c(t);
+    c.run();
+    t.queue.reset();
+    ASSERT(t.refused);
+    ASSERT(t.accepted);
+    ASSERT_EQUAL(held, t.ran);
+    return 0;
+}
+
+// Work queues are unbounded unless made with a capacity, and keep their order past the ring
+class work_queue_unbounded_tester : public proton::messaging_handler {
+  public:
+    std::unique_ptr<proton::work_queue> queue;
+    int added;
+    std::vector<int> order;
+
+    work_queue_unbounded_tester() : added(0) {}
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        c.auto_stop(false);
+        queue.reset(new proton::work_queue(c));
+        for (int i = 0; i < 5000; ++i)
+            if (queue->add([this, i]() { order.push_back(i); })) ++added;
+        queue->add([&c]() { c.stop(); });
+    }
+};
+
+int test_container_work_queue_unbounded() {
+    work_queue_unbounded_tester t;
+    proton::default_container c(t);
+    c.run();
+    t.queue.reset();
+    ASSERT_EQUAL(5000, t.added);
+    ASSERT_EQUAL(5000U, t.order.size());
+    for (size_t i = 0; i < t.order.size(); ++i)
+        ASSERT_EQUAL(int(i), t.order[i]);
+    return 0;
+}
+
+// connection_options::work_queue_capacity bounds the queue of one connection
+class connection_work_queue_tester : public proton::messaging_handler {
+  public:
+    proton::listener listener;
+    proton::connection client;
+    int client_added, client_ran, server_added, server_ran;
+    bool stopped;
+
+    connection_work_queue_tester() :
+        client_added(0), client_ran(0), server_added(0), server_ran(0), stopped(false) {}
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        int port = listen_on_random_port(c, listener);
+        client = c.connect("127.0.0.1:" + int2string(port),
+                           proton::connection_options().work_queue_capacity(4));
+    }
+
+    void on_connection_open(proton::connection& conn) PN_CPP_OVERRIDE {
+        proton::work_queue& q = conn.work_queue();
+        if (conn == client) {
+            // The last job to run closes the connection
+            while (client_added < 100 && q.add([this, conn]() mutable {
+                        if (++client_ran == client_added) conn.close();
+                    }))
+                ++client_added;
+        } else {
+            conn.open();
+            for (int i = 0; i < 5000; ++i)
+                if (q.add([this]() { ++server_ran; })) ++server_added;
+        }
+    }
+
+    void on_connection_close(proton::connection&) PN_CPP_OVERRIDE {
+        if (!stopped) listener.stop();
+        stopped = true;
+    }
+};
+
+int test_container_connection_work_queue_capacity() {
+    connection_work_queue_tester t;
+    proton::default_container c(t);
+    c.run();
+    ASSERT_EQUAL(4, t.client_added);
+    ASSERT_EQUAL(4, t.client_ran);
+    ASSERT_EQUAL(5000, t.server_added);
+    ASSERT_EQUAL(5000, t.server_ran);
+    return 0;
+}
+
+// Connections shared by the per-thread handlers of one container
+struct thread_handlers_shared {
+    proton::listener listener;
+    std::atomic<int> closed;
+    thread_handlers_shared() : closed(0) {}
+};
+
+class per_thread_handler : public proton::messaging_handler {
+  public:
+    thread_handlers_shared& shared;
+    bool opener;
+    int starts, stops;
+    std::atomic<int> active;
+    bool overlap;
+    std::set<proton::connection> connections;
+
+    per_thread_handler(thread_handlers_shared& s, bool o) :
+        shared(s), opener(o), starts(0), stops(0), active(0), overlap(false) {}
+
+    void enter() { if (++active > 1) overlap = true; }
+    void leave() { --active; }
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        enter();
+        ++starts;
+        if (opener) {
+            int port = listen_on_random_port(c, shared.listener);
+            for (int i = 0; i < 4; ++i)
+                c.connect("127.0.0.1:" + int2string(port));
+        }
+        leave();
+    }
+
+    void on_connection_open(proton::connection& c) PN_CPP_OVERRIDE {
+        enter();
+        connections.insert(c);
+        if (c.active()) c.close(); // Client side, the server has opened in reply
+        else proton::messaging_handler::on_connection_open(c);
+        leave();
+    }
+
+    void on_connection_close(proton::connection& c) PN_CPP_OVERRIDE {
+        enter();
+        connections.insert(c);
+        if (++shared.closed == 8) shared.listener.stop();
+        leave();
+    }
+
+    void on_container_stop(proton::container&) PN_CPP_OVERRIDE { ++stops; }
+};
+
+int test_container_thread_handlers() {
+    thread_handlers_shared shared;
+    per_thread_handler h0(shared, true), h1(shared, false), h2(shared, false);
+    std::vector<proton::messaging_handler*> handlers;
+    handlers.push_back(&h0);
+    handlers.push_back(&h1);
+    handlers.push_back(&h2);
+    proton::default_container c;
+    c.run(handlers);
+    per_thread_handler* hs[] = { &h0, &h1, &h2 };
+    size_t seen = 0;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQUAL(1, hs[i]->starts);
+        ASSERT_EQUAL(1, hs[i]->stops);
+        ASSERT(!hs[i]->overlap);
+        seen += hs[i]->connections.size();
+    }
+    // Connections opened on h0's thread stay with it, and no connection has two handlers
+    ASSERT(h0.connections.size() >= 4);
+    ASSERT_EQUAL(8U, seen);
+    return 0;
+}
+
+
+// Another thread sends on a sender through a handle to it
+class endpoint_handle_tester : public proton::messaging_handler {
+    proton::listener listener;
+    std::thread sender_thread;
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        listener = c.listen("inproc:handle-test");
+        c.open_sender("inproc:handle-test");
+    }
+
+    void on_sender_open(proton::sender& s) PN_CPP_OVERRIDE {
+        proton::endpoint_handle<proton::sender> h(s);
+        sender_thread = std::thread([h]() {
+            for (int i = 0; i < 3; ++i)
+                h.add([h, i]() {
+                    proton::sender s = h.get();
+                    if (!!s) s.send(proton::message(i)); // Held until there is credit
+                });
+        });
+    }
+
+    void on_message(proton::delivery& d, proton::message&) PN_CPP_OVERRIDE {
+        if (++received == 3) d.connection().close();
+    }
+
+    void on_connection_close(proton::connection &) PN_CPP_OVERRIDE {
+        if (++closed == 1) listener.stop();
+    }
+
+  public:
+    endpoint_handle_tester() : closed(0), received(0) {}
+    ~endpoint_handle_tester() { if (sender_thread.joinable()) sender_thread.join(); }
+
+    int closed, received;
+};
+
+int test_container_endpoint_handle() {
+    endpoint_handle_tester t;
+    proton::default_container c(t);
+    c.run();
+    ASSERT_EQUAL(3, t.received);
+    return 0;
+}
+
+#endif
+
+#if PN_CPP_HAS_STD_FUNCTION
+
+// Counts copies, so a test can tell a work was only ever moved
+struct copy_counter {
+    int* copies;
+    int* calls;
+    char pad[16];
+    copy_counter(int* c, int* n) : copies(c), calls(n) {}
+    copy_counter(const copy_counter& x) : copies(x.copies), calls(x.calls) { ++*copies; }
+    copy_counter(copy_counter&& x) noexcept : copies(x.copies), calls(x.calls) {}
+    void operator()() { ++*calls; }
+};
+
+struct big_callable {
+    int* calls;
+    char pad[256];
+    void operator()() { ++*calls; }
+};
+
+int test_work_move() {
+    int copies = 0, calls = 0;
+    proton::work w(copy_counter(&copies, &calls));
+    proton::work moved(std::move(w));
+    std::vector<proton::work> v;
+    v.push_back(std::move(moved));
+    v.back()();
+    ASSERT_EQUAL(0, copies);
+    ASSERT_EQUAL(1, calls);
+
+    proton::work copied(v.back());
+    copied();
+    ASSERT_EQUAL(1, copies);
+    ASSERT_EQUAL(2, calls);
+
+    // Too big to keep inline, still copies and moves
+    big_callable b = { &calls, {} };
+    proton::work h(b);
+    proton::work h2(h);
+    proton::work h3(std::move(h));
+    h2();
+    h3();
+    h = h2;
+    h();
+    ASSERT_EQUAL(5, calls);
+    return 0;
+}
+
+class schedule_cancel_tester : public proton::messaging_handler {
+  public:
+    proton::work_queue* queue;
+    std::vector<int> ran;
+    bool cancelled, cancel_again, cancel_ran;
+
+    schedule_cancel_tester() : queue(0), cancelled(false), cancel_again(true), cancel_ran(true) {}
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        c.auto_stop(false);
+        queue = new proton::work_queue(c);
+        queue->schedule(proton::duration(30), [this]() { ran.push_back(30); });
+        proton::work_queue::timer_id t = queue->schedule(proton::duration(20), [this]() { ran.push_back(20); });
+        proton::work_queue::timer_id first = queue->schedule(proton::duration(10), [this]() { ran.push_back(10); });
+        queue->schedule(proton::duration(5000), [this]() { ran.push_back(5000); });
+        cancelled = queue->cancel(t);
+        cancel_again = queue->cancel(t);
+        queue->schedule(proton::duration(50), [this, first, &c]() {
+            cancel_ran = queue->cancel(first);
+            c.stop();
+        });
+    }
+};
+
+int test_container_schedule_cancel() {
+    schedule_cancel_tester t;
+    proton::default_container c(t);
+    c.run();
+    delete t.queue;
+    ASSERT(t.cancelled);
+    ASSERT(!t.cancel_again);
+    ASSERT(!t.cancel_ran);
+    ASSERT_EQUAL(2U, t.ran.size());
+    ASSERT_EQUAL(10, t.ran[0]);
+    ASSERT_EQUAL(30, t.ran[1]);
+    return 0;
+}
+
+#endif
+
 }
 
 int main(int, char**) {
@@ -206,6 +781,23 @@ int main(int, char**) {
     RUN_TEST(failed, test_container_no_vhost());
     RUN_TEST(failed, test_container_bad_address());
     RUN_TEST(failed, test_container_stop());
+    RUN_TEST(failed, test_container_inproc());
+    RUN_TEST(failed, test_container_stats());
+    RUN_TEST(failed, test_container_share_connections());
+    RUN_TEST(failed, test_container_reconnect());
+#if PN_CPP_SUPPORTS_THREADS && PN_CPP_HAS_STD_FUNCTION
+    RUN_TEST(failed, test_container_work_queues_parallel());
+    RUN_TEST(failed, test_container_work_queue_full(4, 4));
+    RUN_TEST(failed, test_container_work_queue_full(1, 2)); // Rounded up to 2
+    RUN_TEST(failed, test_container_work_queue_unbounded());
+    RUN_TEST(failed, test_container_connection_work_queue_capacity());
+    RUN_TEST(failed, test_container_thread_handlers());
+    RUN_TEST(failed, test_container_endpoint_handle());
+#endif
+#if PN_CPP_HAS_STD_FUNCTION
+    RUN_TEST(failed, test_work_move());
+    RUN_TEST(failed, test_container_schedule_cancel());
+#endif
     return failed;
 }
 
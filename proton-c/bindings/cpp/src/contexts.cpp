@@ -20,8 +20,10 @@
  */
 
 #include "contexts.hpp"
+#include "handle_table.hpp"
 #include "msg.hpp"
 #include "proton_bits.hpp"
+#include "settle_channel.hpp"
 
 #include "proton/connection_options.hpp"
 #include "proton/error.hpp"
@@ -47,11 +49,11 @@ void cpp_context_finalize(void* v) { reinterpret_cast<context*>(v)->~context();
 #define cpp_context_inspect NULL
 pn_class_t cpp_context_class = PN_CLASS(cpp_context);
 
-// Handles
-PN_HANDLE(CONNECTION_CONTEXT)
-PN_HANDLE(LISTENER_CONTEXT)
-PN_HANDLE(SESSION_CONTEXT)
-PN_HANDLE(LINK_CONTEXT)
+// Handles: fixed record slots, looked up on nearly every event
+const pn_handle_t CONNECTION_CONTEXT = PN_RECORD_SLOT(2);
+const pn_handle_t LISTENER_CONTEXT = PN_RECORD_SLOT(3);
+const pn_handle_t SESSION_CONTEXT = PN_RECORD_SLOT(4);
+const pn_handle_t LINK_CONTEXT = PN_RECORD_SLOT(5);
 
 template <class T>
 T* get_context(pn_record_t* record, pn_handle_t handle) {
@@ -67,9 +69,16 @@ void *context::alloc(size_t n) { return pn_object_new(&cpp_context_class, n); }
 pn_class_t* context::pn_class() { return &cpp_context_class; }
 
 connection_context::connection_context() :
-    container(0), default_session(0), link_gen(0), handler(0), listener_context_(0)
+    container(0), default_session(0), link_gen(0), handler(0), reconnect_url(0), listener_context_(0), home(-1), counted(false), batch_link(0)
 {}
 
+// Out of line where worker_handoff is complete, it detaches its channel from the connection
+connection_context::~connection_context() {
+#if PN_CPP_SUPPORTS_THREADS
+    if (handle.table) handle.table->detach();
+#endif
+}
+
 listener_context::listener_context() : listen_handler_(0) {}
 
 connection_context& connection_context::get(pn_connection_t *c) {
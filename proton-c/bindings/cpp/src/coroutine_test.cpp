@@ -0,0 +1,115 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "test_bits.hpp"
+
+#include "proton/connection.hpp"
+#include "proton/container.hpp"
+#include "proton/coroutine.hpp"
+#include "proton/default_container.hpp"
+#include "proton/listener.hpp"
+#include "proton/message.hpp"
+#include "proton/receiver.hpp"
+#include "proton/sender.hpp"
+#include "proton/tracker.hpp"
+#include "proton/thread_safe.hpp"
+#include "proton/work_queue.hpp"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int COUNT = 100;
+
+// A producer and a consumer coroutine on the two ends of a connection
+class pipeline : public proton::coroutine_handler {
+    proton::listener listener;
+
+    void on_container_start(proton::container& c) PN_CPP_OVERRIDE {
+        std::string addr;
+        for (int port = 20000 + std::rand() % 30000;; ++port) {
+            std::ostringstream o;
+            o << "127.0.0.1:" << port;
+            addr = o.str();
+            try { listener = c.listen(addr); break; } catch (...) {}
+        }
+        proton::connection conn = c.connect(addr);
+        produce(conn.open_sender("x"));
+    }
+
+    void on_receiver_open(proton::receiver& r) PN_CPP_OVERRIDE {
+        coroutine_handler::on_receiver_open(r);
+        consume(r);
+    }
+
+    proton::task produce(proton::sender s) {
+        co_await proton::resume_on(s.work_queue());
+        for (int i = 0; i < COUNT; ++i) {
+            proton::tracker t = co_await send(s, proton::message(i));
+            if (t.state() == proton::transfer::ACCEPTED) ++accepted;
+            if (i == COUNT / 2) {
+                // Let messages arrive with no coroutine waiting
+                co_await credit(s);
+            }
+        }
+        s.connection().close();
+    }
+
+    proton::task consume(proton::receiver r) {
+        for (int i = 0; i < COUNT; ++i) {
+            proton::message m = co_await receive(r);
+            received.push_back(proton::get<int>(m.body()));
+        }
+        try {
+            co_await receive(r);
+        } catch (const proton::error& e) {
+            error = e.what();
+        }
+        listener.stop();
+    }
+
+  public:
+    pipeline() : accepted(0) {}
+
+    int accepted;
+    std::vector<int> received;
+    std::string error;
+};
+
+int test_coroutine_pipeline() {
+    pipeline p;
+    proton::default_container(p).run();
+    ASSERT_EQUAL(COUNT, p.accepted);
+    ASSERT_EQUAL(size_t(COUNT), p.received.size());
+    for (int i = 0; i < COUNT; ++i)
+        ASSERT_EQUAL(i, p.received[i]);
+    ASSERT(p.error.find("connection closed") != std::string::npos);
+    return 0;
+}
+
+}
+
+int main(int, char**) {
+    int failed = 0;
+    RUN_TEST(failed, test_coroutine_pipeline());
+    return failed;
+}
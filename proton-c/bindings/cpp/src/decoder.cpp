@@ -130,6 +130,40 @@ decoder& decoder::operator>>(start& s) {
     return *this;
 }
 
+namespace {
+bool seek(pn_data_t* d, pn_type_t type, const std::string& key) {
+    // From the start of the enclosing map
+    if (!pn_data_exit(d)) return false;
+    pn_data_enter(d);
+    if (!pn_data_lookup_key(d, type, pn_bytes(key))) return false;
+    pn_data_prev(d);            // Back to the key, the next extract gets the value
+    return true;
+}
+}
+
+bool decoder::seek_key(const std::string& key) { return seek(pn_object(), PN_INVALID, key); }
+
+bool decoder::seek_key(const symbol& key) { return seek(pn_object(), PN_SYMBOL, key); }
+
+long decoder::array_size(type_id element) {
+    internal::state_guard sg(*this);
+    if (!next()) return -1;
+    pn_data_t* d = pn_object();
+    if (pn_data_type(d) != PN_ARRAY || pn_data_is_array_described(d) ||
+        pn_data_get_array_type(d) != pn_type_t(element))
+        return -1;
+    return long(pn_data_get_array(d));
+}
+
+decoder& decoder::extract_array(type_id element, void* values, size_t count) {
+    internal::state_guard sg(*this);
+    assert_type_equal(ARRAY, pre_get());
+    if (pn_data_get_array_values(pn_object(), pn_type_t(element), values, count) != count)
+        throw conversion_error(MSG("expected " << count << " " << element << " array elements"));
+    sg.cancel();
+    return *this;
+}
+
 decoder& decoder::operator>>(const finish&) {
     pn_data_exit(pn_object());
     return *this;
@@ -142,6 +176,14 @@ decoder& decoder::operator>>(null&) {
 }
 
 decoder& decoder::operator>>(internal::value_base& x) {
+    if (!x.data_) {             // Keep a scalar inline
+        internal::state_guard sg(*this);
+        if (type_id_is_scalar(pre_get())) {
+            x.scalar_.set(pn_data_get_atom(pn_object()));
+            sg.cancel();
+            return *this;
+        }
+    }
     if (*this == x.data_)
         throw conversion_error("extract into self");
     data d = x.data();
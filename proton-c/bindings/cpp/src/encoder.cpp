@@ -46,7 +46,7 @@ void encoder::check(long result) {
 }
 
 
-encoder::encoder(internal::value_base& v) : data(v.data()) {
+encoder::encoder(internal::value_base& v) : data(v.fresh_data()) {
     clear();
 }
 
@@ -145,9 +145,18 @@ encoder& encoder::operator<<(const symbol& x) { return insert(x, pn_data_put_amq
 encoder& encoder::operator<<(const binary& x) { return insert(x, pn_data_put_amqp_binary); }
 encoder& encoder::operator<<(const null&) { pn_data_put_null(pn_object()); return *this; }
 
+encoder& encoder::insert_array(type_id element, const void* values, size_t count) {
+    internal::state_guard sg(*this);
+    check(pn_data_put_array_values(pn_object(), pn_type_t(element), values, count));
+    sg.cancel();
+    return *this;
+}
+
 encoder& encoder::operator<<(const scalar_base& x) { return insert(x.atom_, pn_data_put_atom); }
 
 encoder& encoder::operator<<(const internal::value_base& x) {
+    if (!x.data_)
+        return *this << x.scalar_;
     data d = x.data_;
     if (*this == d)
         throw conversion_error("cannot insert into self");
@@ -0,0 +1,155 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/endpoint_handle.hpp"
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include "proton/connection.hpp"
+#include "proton/link.hpp"
+#include "proton/receiver.hpp"
+#include "proton/sender.hpp"
+#include "proton/session.hpp"
+
+#include "contexts.hpp"
+#include "handle_table.hpp"
+#include "proton_bits.hpp"
+
+#include <proton/connection.h>
+#include <proton/link.h>
+#include <proton/session.h>
+
+namespace proton {
+
+handle_table::handle_table(work_queue& q) : queue_(&q) {}
+
+bool handle_table::add(work f) {
+    std::lock_guard<std::mutex> g(lock_);
+    return queue_ && queue_->add(f);
+}
+
+void handle_table::detach() {
+    std::lock_guard<std::mutex> g(lock_);
+    queue_ = 0;
+}
+
+uint64_t handle_table::put(void* endpoint) {
+    uint32_t i;
+    if (free_.empty()) {
+        i = uint32_t(slots_.size());
+        slots_.push_back(slot());
+    } else {
+        i = free_.back();
+        free_.pop_back();
+    }
+    slots_[i].endpoint = endpoint;
+    return (uint64_t(slots_[i].generation) << 32) | i;
+}
+
+void* handle_table::get(uint64_t token) const {
+    uint32_t i = uint32_t(token);
+    if (i >= slots_.size() || slots_[i].generation != uint32_t(token >> 32)) return 0;
+    return slots_[i].endpoint;
+}
+
+void handle_table::forget(uint64_t token) {
+    uint32_t i = uint32_t(token);
+    if (i >= slots_.size() || slots_[i].generation != uint32_t(token >> 32)) return;
+    slots_[i].endpoint = 0;
+    ++slots_[i].generation;
+    free_.push_back(i);
+}
+
+endpoint_slot::~endpoint_slot() {
+    if (table) table->forget(token);
+}
+
+namespace {
+
+// Put the endpoint in its connection's table the first time it gets a handle
+void put(endpoint_slot& s, pn_connection_t* c, void* endpoint) {
+    if (s.table) return;
+    connection_context& cc = connection_context::get(c);
+    if (!cc.handle.table) {
+        cc.handle.table.reset(new handle_table(cc.work_queue_));
+        cc.handle.token = cc.handle.table->put(c);
+    }
+    s.table = cc.handle.table;
+    if (&s != &cc.handle) s.token = s.table->put(endpoint);
+}
+
+}
+
+namespace internal {
+
+endpoint_handle_base::endpoint_handle_base(const connection& x) : token_(0) {
+    pn_connection_t* c = unwrap(x);
+    endpoint_slot& s = connection_context::get(c).handle;
+    put(s, c, c);
+    table_ = s.table;
+    token_ = s.token;
+}
+
+endpoint_handle_base::endpoint_handle_base(const session& x) : token_(0) {
+    pn_session_t* ssn = unwrap(x);
+    endpoint_slot& s = session_context::get(ssn).handle;
+    put(s, pn_session_connection(ssn), ssn);
+    table_ = s.table;
+    token_ = s.token;
+}
+
+endpoint_handle_base::endpoint_handle_base(const link& x) : token_(0) {
+    pn_link_t* l = unwrap(x);
+    endpoint_slot& s = link_context::get(l).handle;
+    put(s, pn_session_connection(pn_link_session(l)), l);
+    table_ = s.table;
+    token_ = s.token;
+}
+
+bool endpoint_handle_base::add(work f) const {
+    return table_ && table_->add(f);
+}
+
+void endpoint_handle_base::get(connection& x) const {
+    x = make_wrapper(table_ ? static_cast<pn_connection_t*>(table_->get(token_)) : 0);
+}
+
+void endpoint_handle_base::get(session& x) const {
+    x = make_wrapper(table_ ? static_cast<pn_session_t*>(table_->get(token_)) : 0);
+}
+
+void endpoint_handle_base::get(link& x) const {
+    x = make_wrapper(table_ ? static_cast<pn_link_t*>(table_->get(token_)) : 0);
+}
+
+void endpoint_handle_base::get(sender& x) const {
+    x = make_wrapper<sender>(table_ ? static_cast<pn_link_t*>(table_->get(token_)) : 0);
+}
+
+void endpoint_handle_base::get(receiver& x) const {
+    x = make_wrapper<receiver>(table_ ? static_cast<pn_link_t*>(table_->get(token_)) : 0);
+}
+
+}
+
+}
+
+#endif // PN_CPP_SUPPORTS_THREADS
@@ -22,12 +22,15 @@
 
 #include "proton/connection.hpp"
 #include "proton/container.hpp"
+#include "proton/delivery.hpp"
 #include "proton/error_condition.hpp"
+#include "proton/message.hpp"
 #include "proton/receiver.hpp"
 #include "proton/receiver_options.hpp"
 #include "proton/sender.hpp"
 #include "proton/sender_options.hpp"
 #include "proton/session.hpp"
+#include "proton/transaction.hpp"
 #include "proton/transport.hpp"
 
 #include "proton_bits.hpp"
@@ -37,13 +40,19 @@
 
 namespace proton {
 
-messaging_handler::messaging_handler(){}
+messaging_handler::messaging_handler() : handled_(~uint32_t(0)) {}
+
+messaging_handler::messaging_handler(uint32_t handled) : handled_(handled) {}
 
 messaging_handler::~messaging_handler(){}
 
 void messaging_handler::on_container_start(container &) {}
 void messaging_handler::on_container_stop(container &) {}
 void messaging_handler::on_message(delivery &, message &) {}
+void messaging_handler::on_message_chunk(delivery &, const binary &, bool) {}
+void messaging_handler::on_messages(receiver &, std::vector<delivery> &ds, std::vector<message> &ms) {
+    for (size_t i = 0; i < ds.size(); ++i) on_message(ds[i], ms[i]);
+}
 void messaging_handler::on_sendable(sender &) {}
 void messaging_handler::on_transport_close(transport &) {}
 void messaging_handler::on_transport_error(transport &t) { on_error(t.error()); }
@@ -82,7 +91,23 @@ void messaging_handler::on_tracker_accept(tracker &) {}
 void messaging_handler::on_tracker_reject(tracker &) {}
 void messaging_handler::on_tracker_release(tracker &) {}
 void messaging_handler::on_tracker_settle(tracker &) {}
+void messaging_handler::on_trackers_settled(sender &, tracker_range ts) {
+    for (tracker* t = ts.begin(); t != ts.end(); ++t) {
+        switch (t->state()) {
+          case transfer::ACCEPTED: on_tracker_accept(*t); break;
+          case transfer::REJECTED: on_tracker_reject(*t); break;
+          case transfer::RELEASED:
+          case transfer::MODIFIED: on_tracker_release(*t); break;
+          default: break;
+        }
+        on_tracker_settle(*t);
+    }
+}
 void messaging_handler::on_delivery_settle(delivery &) {}
+void messaging_handler::on_transaction_declare(transaction &) {}
+void messaging_handler::on_transaction_commit(transaction &) {}
+void messaging_handler::on_transaction_abort(transaction &) {}
+void messaging_handler::on_transaction_error(transaction &t) { on_error(t.error()); }
 void messaging_handler::on_sender_drain_start(sender &) {}
 void messaging_handler::on_receiver_drain_finish(receiver &) {}
 
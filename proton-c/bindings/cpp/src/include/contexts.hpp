@@ -22,20 +22,36 @@
  *
  */
 
+#include "proton/container.hpp"
 #include "proton/work_queue.hpp"
+#include "proton/binary.hpp"
+#include "proton/delivery.hpp"
+#include "proton/error_condition.hpp"
 #include "proton/message.hpp"
+#include "proton/tracker.hpp"
+#include "proton/internal/object.hpp"
 #include "proton/internal/pn_unique_ptr.hpp"
 
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 struct pn_record_t;
 struct pn_link_t;
 struct pn_session_t;
 struct pn_connection_t;
 struct pn_listener_t;
+struct pn_message_selector_t;
 
 namespace proton {
 
 class proton_handler;
 class reconnect_timer;
+class worker_handoff;
+class handle_table;
 
 namespace io {class link_namer;}
 
@@ -78,10 +94,34 @@ class context {
 
 class listener_context;
 
+#if PN_CPP_SUPPORTS_THREADS
+// Where endpoint_handle<> finds an endpoint, see handle_table
+struct endpoint_slot {
+    endpoint_slot() : token(0) {}
+    ~endpoint_slot();           // Forgets the endpoint
+
+    std::shared_ptr<handle_table> table; // Empty until the first handle
+    uint64_t token;
+};
+#endif
+
+// What a connection last added to its container's stats, see
+// container::impl::account()
+struct reported_stats {
+    reported_stats() : deliveries_input(0), deliveries_output(0), bytes_input(0), bytes_output(0),
+                       frames_input(0), frames_output(0), pool_hits(0), pool_misses(0), memory(0), links(0) {}
+    // Counters of the bound transport, they start again with a new one
+    uint64_t deliveries_input, deliveries_output, bytes_input, bytes_output, frames_input, frames_output;
+    uint64_t pool_hits, pool_misses;
+    uint64_t memory;
+    uint64_t links;             // Links opened and not yet closed by the peer
+};
+
 // Connection context used by all connections.
 class connection_context : public context {
   public:
     connection_context();
+    ~connection_context();
     static connection_context& get(pn_connection_t *c);
 
     class container* container;
@@ -91,8 +131,21 @@ class connection_context : public context {
 
     messaging_handler* handler;
     internal::pn_unique_ptr<reconnect_timer> reconnect;
+    std::vector<std::string> reconnect_urls; // Connect URL then failover URLs
+    std::vector<std::string> reconnect_addrs; // Proactor address of each URL
+    size_t reconnect_url;                    // Index of the URL connected to
     listener_context* listener_context_;
     work_queue work_queue_;
+    int home;                   // Per-thread handler of the container, or -1
+    bool counted;               // Counted in the container's stats, from bound to finally closed
+    reported_stats reported;
+    pn_link_t* batch_link;      // Receiver with messages waiting for on_messages(), or
+                                // sender with trackers waiting for on_trackers_settled()
+#if PN_CPP_SUPPORTS_THREADS
+    // Deliveries handed to worker queues, see receiver_options::worker_queue()
+    internal::pn_unique_ptr<worker_handoff> handoff;
+    endpoint_slot handle;       // Its table is the connection's
+#endif
 };
 
 class listener_context : public context {
@@ -104,25 +157,77 @@ class listener_context : public context {
     internal::pn_unique_ptr<const connection_options> connection_options_;
 };
 
+// What adaptive credit has measured of a receiver, see
+// receiver_options::adaptive_credit()
+struct adaptive_credit {
+    adaptive_credit() : max_bytes(0), rate(0), rtt(0), size(0), sample_start(0), sample_count(0), flow_at(0), credit(0) {}
+
+    size_t max_bytes;           // 0 if the window is fixed
+    double rate;                // deliveries per millisecond
+    double rtt;                 // milliseconds from credit granted from none to its first delivery
+    double size;                // average bytes per delivery
+    int64_t sample_start;
+    int sample_count;           // deliveries since sample_start
+    int64_t flow_at;            // when credit was granted from none, 0 once a delivery arrives
+    int credit;                 // left by the last topup
+};
+
 class link_context : public context {
   public:
-    link_context() : handler(0), credit_window(10), pending_credit(0), auto_accept(true), auto_settle(true), draining(false) {}
+    link_context() : handler(0), credit_window(10), credit_low_water(-1), pending_credit(0), auto_accept(true), auto_settle(true), stream_messages(false), batch_messages(false), batch_settlements(false), priority_ordering(false), draining(false), workers(0), batch_handler(0) {}
     static link_context& get(pn_link_t* l);
 
     messaging_handler* handler;
     int credit_window;
+    int credit_low_water;       // -1 for one less than credit_window
+    struct adaptive_credit adaptive;
     uint32_t pending_credit;
     bool auto_accept;
     bool auto_settle;
+    bool stream_messages;
+    bool batch_messages;
+    bool batch_settlements;
+    bool priority_ordering;
     bool draining;
+    class worker_queue* workers; // Takes complete messages, see receiver_options::worker_queue()
+    internal::pn_ptr<pn_message_selector_t> selector; // See receiver_options::selector()
+
+    // Encoded messages a sender holds for sender_options::priority_ordering(),
+    // highest priority first and in call order within a priority
+    typedef std::multimap<int, std::vector<char>, std::greater<int> > held_map;
+    held_map held;
+
+    // Messages batched for on_messages(), the message objects are kept
+    // for reuse between batches
+    messaging_handler* batch_handler;
+    std::vector<delivery> batch;
+    std::vector<message> batch_message;
+    std::vector<tracker> batch_settled; // Trackers batched for on_trackers_settled()
+#if PN_CPP_SUPPORTS_THREADS
+    // Unsettled messages that found the worker queue full, in arrival
+    // order. The link gets no more credit until they are all handed off.
+    std::deque<std::pair<pn_delivery_t*, message> > waiting;
+    endpoint_slot handle;
+#endif
 };
 
 class session_context : public context {
   public:
-    session_context() : handler(0) {}
+    session_context() : handler(0), coordinator(0), txn_request(0), txn_discharge(false), txn_fail(false) {}
     static session_context& get(pn_session_t* s);
 
     messaging_handler* handler;
+
+    // The session's transaction, see transaction.hpp
+    pn_link_t* coordinator;     // Sender to the peer's coordinator, made by the first declare
+    pn_delivery_t* txn_request; // Declare or discharge waiting for its outcome
+    binary txn_id;              // Empty until declared
+    bool txn_discharge;         // txn_request is a discharge
+    bool txn_fail;              // The discharge aborts
+    error_condition txn_error;
+#if PN_CPP_SUPPORTS_THREADS
+    endpoint_slot handle;
+#endif
 };
 
 }
@@ -0,0 +1,79 @@
+#ifndef PROTON_CPP_HANDLE_TABLE_HPP
+#define PROTON_CPP_HANDLE_TABLE_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/container.hpp"
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include "proton/work_queue.hpp"
+
+#include <proton/type_compat.h>
+
+#include <mutex>
+#include <vector>
+
+namespace proton {
+
+/// The endpoints of a connection that endpoint_handle<> refers to. A
+/// token names a slot and the slot's generation, so a handle to an
+/// endpoint that has been forgotten finds nothing.  Handles share the
+/// table, it outlives the connection.
+class handle_table {
+  public:
+    explicit handle_table(work_queue& q);
+
+    /// Add f to the connection's work queue, from any thread.
+    bool add(work f);
+
+    /// The connection is going away, add() fails from now on.
+    void detach();
+
+    /// Remember endpoint, returns its token.
+    uint64_t put(void* endpoint);
+
+    /// The endpoint for token, 0 if it was forgotten.
+    void* get(uint64_t token) const;
+
+    /// Forget the endpoint for token.
+    void forget(uint64_t token);
+
+  private:
+    struct slot {
+        slot() : endpoint(0), generation(0) {}
+        void* endpoint;
+        uint32_t generation;
+    };
+
+    std::mutex lock_;           // Guards queue_ against detach()
+    work_queue* queue_;
+    // Only used in the connection's thread
+    std::vector<slot> slots_;
+    std::vector<uint32_t> free_;
+};
+
+}
+
+#endif // PN_CPP_SUPPORTS_THREADS
+
+#endif // PROTON_CPP_HANDLE_TABLE_HPP
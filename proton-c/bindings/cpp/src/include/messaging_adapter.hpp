@@ -22,9 +22,15 @@
  *
  */
 
+#include <proton/type_compat.h>
+
 ///@cond INTERNAL
 
 struct pn_event_t;
+struct pn_collector_t;
+struct pn_connection_t;
+struct pn_delivery_t;
+struct pn_link_t;
 
 namespace proton {
 
@@ -35,8 +41,30 @@ class messaging_adapter
 {
   public:
     static void dispatch(messaging_handler& delegate, pn_event_t* e);
+
+    /// Deliver messages still batched on the connection, see
+    /// receiver_options::batch_messages(), and settle deliveries that
+    /// worker threads have settled, see receiver_options::worker_queue().
+    /// Call after the last event of a batch of events.
+    static void flush(pn_connection_t* c);
+
+    /// Restrict the collector to the event types dispatch() handles,
+    /// plus those the connection driver and container act on themselves.
+    static void want_events(pn_collector_t* collector);
+
+    /// True if the handler overrides a function of internal::handler_bit
+    /// or is not a typed_handler.
+    static bool handles(const messaging_handler& handler, uint32_t bit);
 };
 
+/// Handle an update to a transaction's declare or discharge, see
+/// transaction.cpp.  False if dlv is not one.
+bool transaction_outcome(messaging_handler& handler, pn_delivery_t* dlv);
+
+/// Send the messages a sender holds for priority order, as far as its
+/// credit goes, see sender.cpp
+void send_held(pn_link_t* lnk);
+
 }
 ///@endcond INTERNAL
 #endif  /*!PROTON_CPP_MESSAGING_ADAPTER_H*/
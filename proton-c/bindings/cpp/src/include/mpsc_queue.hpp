@@ -0,0 +1,264 @@
+#ifndef PROTON_CPP_MPSC_QUEUE_HPP
+#define PROTON_CPP_MPSC_QUEUE_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/container.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#if PN_CPP_SUPPORTS_THREADS
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#else
+#include <deque>
+#endif
+
+namespace proton {
+
+/// A queue for many producer threads and one consumer.
+///
+/// With threads this is a ring of sequence-numbered cells: producers
+/// claim a cell with a compare-and-swap on the enqueue position, and a
+/// cell's sequence tells the consumer when it is filled and producers
+/// when it is free again, so neither side takes a lock. The ring is
+/// only allocated by the first push, a queue that is never used costs
+/// nothing.
+///
+/// A queue made with capacity 0 is unbounded: once its ring is full,
+/// items wait in an overflow list under a lock, and later items follow
+/// them there until the consumer has taken the list.
+///
+/// Only one thread at a time may call empty() or drain().
+template <class T> class mpsc_queue {
+  public:
+    /// Hold at most capacity items, 0 for no limit.
+    explicit mpsc_queue(size_t capacity);
+    ~mpsc_queue();
+
+    /// Add x, false if the queue is bounded and full.
+    bool push(const T& x);
+#if PN_CPP_HAS_RVALUE_REFERENCES
+    bool push(T&& x);
+#endif
+
+    /// Move up to max items to the end of out, returns how many.
+    size_t drain(std::vector<T>& out, size_t max);
+
+    /// True if there is nothing to drain, checked without locking.
+    bool empty() const;
+
+    /// The most items held at once, capacity rounded up to a power of 2,
+    /// at least 2, with threads. 0 if unbounded.
+    size_t capacity() const { return capacity_; }
+
+    /// The ring size of an unbounded queue.
+    static const size_t unbounded_ring = 1024;
+
+  private:
+    mpsc_queue(const mpsc_queue&);
+    mpsc_queue& operator=(const mpsc_queue&);
+
+    size_t capacity_;
+
+#if PN_CPP_SUPPORTS_THREADS
+    struct cell {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        T* item() { return reinterpret_cast<T*>(&storage); }
+    };
+
+    static size_t ring_size(size_t);
+    cell* ring();
+    cell* claim();
+    bool overflow(const T& x);
+
+    std::atomic<cell*> ring_;
+    size_t size_;               // Cells in the ring
+    size_t mask_;
+    std::atomic<size_t> enqueue_;
+    size_t dequeue_;            // Consumer only
+    std::atomic<bool> overflowed_; // The overflow list has items, unbounded only
+    std::mutex overflow_lock_;
+    std::vector<T> overflow_;
+#else
+    std::deque<T> items_;
+#endif
+};
+
+#if PN_CPP_SUPPORTS_THREADS
+
+// One cell would have the same sequence free and filled, so at least 2
+template <class T> size_t mpsc_queue<T>::ring_size(size_t n) {
+    size_t size = 2;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+template <class T> mpsc_queue<T>::mpsc_queue(size_t capacity) :
+    capacity_(capacity ? ring_size(capacity) : 0), ring_(0),
+    size_(ring_size(capacity ? capacity : unbounded_ring)), mask_(size_ - 1),
+    enqueue_(0), dequeue_(0), overflowed_(false)
+{}
+
+template <class T> mpsc_queue<T>::~mpsc_queue() {
+    cell* r = ring_.load(std::memory_order_acquire);
+    if (!r) return;
+    // Destroy items never drained: filled cells have the sequence one past their position
+    for (size_t pos = dequeue_; r[pos & mask_].seq.load(std::memory_order_acquire) == pos + 1; ++pos)
+        r[pos & mask_].item()->~T();
+    delete[] r;
+}
+
+template <class T> typename mpsc_queue<T>::cell* mpsc_queue<T>::ring() {
+    cell* r = ring_.load(std::memory_order_acquire);
+    if (r) return r;
+    cell* fresh = new cell[size_];
+    for (size_t i = 0; i < size_; ++i)
+        fresh[i].seq.store(i, std::memory_order_relaxed);
+    if (ring_.compare_exchange_strong(r, fresh, std::memory_order_acq_rel))
+        return fresh;
+    delete[] fresh;             // Another producer got there first
+    return r;
+}
+
+// Claim the next free cell, 0 if the queue is full.
+template <class T> typename mpsc_queue<T>::cell* mpsc_queue<T>::claim() {
+    cell* r = ring();
+    size_t pos = enqueue_.load(std::memory_order_relaxed);
+    for (;;) {
+        cell* c = &r[pos & mask_];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        ptrdiff_t dif = ptrdiff_t(seq) - ptrdiff_t(pos);
+        if (dif == 0) {
+            if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                return c;
+        } else if (dif < 0) {
+            return 0;           // Full: the cell still holds an item a lap behind
+        } else {
+            pos = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Once an item has overflowed the ring, later ones follow it to keep their order
+template <class T> bool mpsc_queue<T>::overflow(const T& x) {
+    std::lock_guard<std::mutex> g(overflow_lock_);
+    overflow_.push_back(x);
+    overflowed_.store(true, std::memory_order_release);
+    return true;
+}
+
+// The claimed cell's sequence is its position, so filling publishes position + 1
+template <class T> bool mpsc_queue<T>::push(const T& x) {
+    if (!capacity_ && overflowed_.load(std::memory_order_acquire)) return overflow(x);
+    cell* c = claim();
+    if (!c) return !capacity_ && overflow(x);
+    size_t pos = c->seq.load(std::memory_order_relaxed);
+    new (c->item()) T(x);
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T> bool mpsc_queue<T>::push(T&& x) {
+    if (!capacity_ && overflowed_.load(std::memory_order_acquire)) return overflow(x);
+    cell* c = claim();
+    if (!c) return !capacity_ && overflow(x);
+    size_t pos = c->seq.load(std::memory_order_relaxed);
+    new (c->item()) T(std::move(x));
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T> size_t mpsc_queue<T>::drain(std::vector<T>& out, size_t max) {
+    cell* r = ring_.load(std::memory_order_acquire);
+    if (!r) return 0;
+    size_t n = 0;
+    while (n < max) {
+        cell* c = &r[dequeue_ & mask_];
+        if (c->seq.load(std::memory_order_acquire) != dequeue_ + 1) break;
+        out.push_back(std::move(*c->item()));
+        c->item()->~T();
+        c->seq.store(dequeue_ + size_, std::memory_order_release);
+        ++dequeue_;
+        ++n;
+    }
+    // Overflowed items are newer than those left in the ring
+    if (n < max && overflowed_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> g(overflow_lock_);
+        size_t k = std::min(max - n, overflow_.size());
+        for (size_t i = 0; i < k; ++i)
+            out.push_back(std::move(overflow_[i]));
+        overflow_.erase(overflow_.begin(), overflow_.begin() + k);
+        overflowed_.store(!overflow_.empty(), std::memory_order_release);
+        n += k;
+    }
+    return n;
+}
+
+template <class T> bool mpsc_queue<T>::empty() const {
+    if (overflowed_.load(std::memory_order_acquire)) return false;
+    cell* r = ring_.load(std::memory_order_acquire);
+    return !r || r[dequeue_ & mask_].seq.load(std::memory_order_acquire) != dequeue_ + 1;
+}
+
+#else
+
+template <class T> mpsc_queue<T>::mpsc_queue(size_t capacity) : capacity_(capacity) {}
+
+template <class T> mpsc_queue<T>::~mpsc_queue() {}
+
+template <class T> bool mpsc_queue<T>::push(const T& x) {
+    if (capacity_ && items_.size() >= capacity_) return false;
+    items_.push_back(x);
+    return true;
+}
+
+#if PN_CPP_HAS_RVALUE_REFERENCES
+template <class T> bool mpsc_queue<T>::push(T&& x) {
+    if (capacity_ && items_.size() >= capacity_) return false;
+    items_.push_back(std::move(x));
+    return true;
+}
+#endif
+
+template <class T> size_t mpsc_queue<T>::drain(std::vector<T>& out, size_t max) {
+    size_t n = 0;
+    for (; n < max && !items_.empty(); ++n) {
+        out.push_back(items_.front());
+        items_.pop_front();
+    }
+    return n;
+}
+
+template <class T> bool mpsc_queue<T>::empty() const { return items_.empty(); }
+
+#endif
+
+}
+
+#endif // PROTON_CPP_MPSC_QUEUE_HPP
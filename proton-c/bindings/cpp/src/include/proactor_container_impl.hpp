@@ -36,6 +36,7 @@
 #include "proton/work_queue.hpp"
 
 #include "proton_bits.hpp"
+#include "timer_wheel.hpp"
 
 #include <list>
 #include <map>
@@ -51,12 +52,23 @@
 # define ONCE_FLAG(x) std::once_flag x;
 # define CALL_ONCE(x, ...) std::call_once(x, __VA_ARGS__)
 # define ATOMIC_INT(x) std::atomic<int> x;
+# define ATOMIC_BOOL(x) std::atomic<bool> x;
+# define ATOMIC_UINT64(x) std::atomic<uint64_t> x;
 #else
 # define MUTEX(x)
 # define GUARD(x)
 # define ONCE_FLAG(x)
 # define CALL_ONCE(x, f, o) ((o)->*(f))()
 # define ATOMIC_INT(x) int x;
+# define ATOMIC_BOOL(x) bool x;
+# define ATOMIC_UINT64(x) uint64_t x;
+#endif
+
+#if PN_CPP_HAS_RVALUE_REFERENCES
+#include <utility>
+# define MOVE(x) std::move(x)
+#else
+# define MOVE(x) (x)
 #endif
 struct pn_proactor_t;
 struct pn_listener_t;
@@ -69,6 +81,7 @@ class container::impl {
     impl(container& c, const std::string& id, messaging_handler* = 0);
     ~impl();
     std::string id() const { return id_; }
+    container_stats stats();
     returned<connection> connect(const std::string&, const connection_options&);
     returned<sender> open_sender(
         const std::string&, const proton::sender_options &, const connection_options &);
@@ -86,24 +99,42 @@ class container::impl {
     void receiver_options(const proton::receiver_options&);
     class receiver_options receiver_options() const { return receiver_options_; }
     void run(int threads);
+    void run(const std::vector<messaging_handler*>& handlers);
     void stop(const error_condition& err);
     void auto_stop(bool set);
-    void schedule(duration, work);
+    void share_connections(bool set);
+    timer_wheel::id schedule(duration, work);
+    bool cancel(timer_wheel::id);
     template <class T> static void set_handler(T s, messaging_handler* h);
     template <class T> static messaging_handler* get_handler(T s);
-    static work_queue::impl* make_work_queue(container&);
+    static work_queue::impl* make_work_queue(container&, size_t capacity);
 
   private:
     class common_work_queue;
     class connection_work_queue;
     class container_work_queue;
     pn_listener_t* listen_common_lh(const std::string&);
-    connection connect_common(const std::string&, const connection_options&);
-
-    // Event loop to run in each container thread
-    void thread();
+    connection connect_common(const std::string&, const url&, const connection_options&);
+    connection shared_connection(const std::string&, const url&, const connection_options&);
+    bool can_share(pn_connection_t*);
+    void unshare(pn_connection_t*);
+    void connect_to(pn_connection_t*, const std::string& proactor_addr);
+    bool start_reconnect(pn_connection_t*);
+    void reconnect(pn_connection_t*);
+
+    // Event loop to run in each container thread, home is the index of
+    // its per-thread handler or -1
+    void thread(int home);
     bool handle(pn_event_t*);
+    void flush(pn_connection_t*);
+    bool dispatch(pn_event_t*, messaging_handler*);
     void run_timer_jobs();
+    void account(pn_connection_t*);
+    void account_bound(pn_connection_t*);
+    void account_closed(pn_connection_t*);
+    void account_batch(int64_t micros);
+    void arm_timeout_lh();
+    void wake_timeout();
 
     ATOMIC_INT(threads_)
     MUTEX(lock_)
@@ -111,21 +142,40 @@ class container::impl {
     ONCE_FLAG(stop_once_)
     container& container_;
 
+    // Container work queues, and those with jobs waiting to run.
+    // A queue is handed to one thread at a time so queues run in
+    // parallel but each stays serialised.
+    MUTEX(work_queues_lock_)
     typedef std::set<container_work_queue*> work_queues;
     work_queues work_queues_;
-    container_work_queue* add_work_queue();
+    std::list<container_work_queue*> ready_work_queues_;
+    container_work_queue* add_work_queue(size_t capacity);
     void remove_work_queue(container_work_queue*);
+    void work_queue_ready(container_work_queue*);
+    container_work_queue* take_ready_work_queue(std::vector<work>&);
+    void ready_work_queue_done(container_work_queue*);
     void start_event();
     void stop_event();
 
-    struct scheduled {
-        timestamp time; // duration from epoch for task
-        work task;
-
-        // We want to get to get the *earliest* first so test is "reversed"
-        bool operator < (const scheduled& r) const { return  r.time < time; }
+    // Scheduled work, under its own lock so timers are not held up by
+    // the rest of the container. armed_at_ is the proactor timeout last
+    // set, so a later deadline doesn't have to reset it.
+    MUTEX(timers_lock_)
+    timer_wheel timers_;
+    bool armed_;
+    timestamp armed_at_;
+
+    // Per-thread handlers from run(handlers). Each connection has a home
+    // handler for its lifetime, its lock keeps the handler's events serial
+    // when an idle thread picks up a connection from another.
+    struct thread_handler {
+        messaging_handler* handler;
+        MUTEX(lock)
     };
-    std::vector<scheduled> deferred_; // This vector is kept as a heap
+    thread_handler* thread_handlers_;
+    int nthread_handlers_;
+    ATOMIC_INT(next_home_)
+    int home_for_new_connection();
 
     pn_proactor_t* proactor_;
     messaging_handler* handler_;
@@ -136,8 +186,42 @@ class container::impl {
     proton::receiver_options receiver_options_;
     error_condition disconnect_error_;
 
-    bool auto_stop_;
+    ATOMIC_BOOL(auto_stop_)     // Read by dispatch() without lock_
     bool stopping_;
+
+    // Connections open_sender() and open_receiver() share, by URL
+    // without the path, see container::share_connections(). Removed
+    // when their transport closes, guarded by lock_.
+    bool share_connections_;
+    typedef std::map<std::string, pn_connection_t*> connection_map;
+    connection_map shared_connections_;
+
+    // Reconnect failures of each URL since it last connected, and the
+    // connections waiting to reconnect, guarded by lock_
+    std::map<std::string, int> url_failures_;
+    std::set<pn_connection_t*> reconnecting_;
+
+    // Totals for stats(), each thread adds what its connections did in
+    // an event batch
+    struct counters {
+        counters();
+        ATOMIC_UINT64(connections)
+        ATOMIC_UINT64(connections_opened)
+        ATOMIC_UINT64(links)
+        ATOMIC_UINT64(deliveries_input)
+        ATOMIC_UINT64(deliveries_output)
+        ATOMIC_UINT64(bytes_input)
+        ATOMIC_UINT64(bytes_output)
+        ATOMIC_UINT64(frames_input)
+        ATOMIC_UINT64(frames_output)
+        ATOMIC_UINT64(memory)
+        ATOMIC_UINT64(pool_hits)
+        ATOMIC_UINT64(pool_misses)
+        ATOMIC_UINT64(batches)
+        ATOMIC_UINT64(batch_time)
+        ATOMIC_UINT64(batch_latency[6])
+    };
+    counters counters_;
 };
 
 template <class T>
@@ -30,7 +30,8 @@ class work_queue::impl {
   public:
     virtual ~impl() {};
     virtual bool add(work f) = 0;
-    virtual void schedule(duration, work) = 0;
+    virtual timer_id schedule(duration, work) = 0;
+    virtual bool cancel(timer_id) = 0;
     virtual void run_all_jobs() = 0;
     virtual void finished() = 0;
 };
@@ -68,6 +68,7 @@ class source;
 class target;
 class reactor;
 class messaging_handler;
+class message;
 
 std::string error_str(long code);
 
@@ -82,6 +83,17 @@ std::ostream& operator<<(std::ostream& o, const inspectable& object);
 
 void set_error_condition(const error_condition&, pn_condition_t*);
 
+/// A name for a new link on c, from its link_namer if it has one.
+std::string next_link_name(const connection& c);
+
+/// The message format of deliveries holding several messages, see
+/// sender::send_packed(). Each message is encoded as an AMQP vbin32.
+const uint32_t PACKED_MESSAGE_FORMAT = 0x00515001;
+
+/// Decode the next message packed in [pos, end) and move pos past it,
+/// false if there are no more.
+bool message_unpack(message& msg, const char*& pos, const char* end);
+
 /// Convert a const char* to std::string, convert NULL to the empty string.
 inline std::string str(const char* s) { return s ? s : std::string(); }
 
@@ -0,0 +1,108 @@
+#ifndef PROTON_CPP_SETTLE_CHANNEL_HPP
+#define PROTON_CPP_SETTLE_CHANNEL_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/container.hpp"
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include "mpsc_queue.hpp"
+
+#include <proton/type_compat.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct pn_connection_t;
+struct pn_delivery_t;
+
+namespace proton {
+
+/// Outcomes of deliveries a connection handed to a worker_queue, on
+/// their way back from the worker threads.  Any thread may send(),
+/// only the connection's own thread drains.
+class settle_channel {
+  public:
+    struct outcome {
+        uint64_t token;
+        uint64_t state;
+    };
+
+    explicit settle_channel(pn_connection_t* c);
+
+    /// Queue an outcome and wake the connection unless a wake is
+    /// already on its way.  Waits for room if the channel is full.
+    void send(uint64_t token, uint64_t state);
+
+    /// Move the outcomes sent so far to the end of out.
+    size_t drain(std::vector<outcome>& out);
+
+    /// The connection is going away, outcomes sent from now on are dropped.
+    void detach();
+
+  private:
+    mpsc_queue<outcome> queue_;
+    std::mutex lock_;           // Guards connection_ against detach()
+    pn_connection_t* connection_;
+    std::atomic<bool> detached_;
+    std::atomic<bool> wake_pending_;
+};
+
+/// The deliveries a connection's receivers have handed out and not yet
+/// had settled. A token names a slot and the slot's generation, so an
+/// outcome that arrives after its slot was cleared finds nothing.
+class worker_handoff {
+  public:
+    explicit worker_handoff(pn_connection_t* c);
+    ~worker_handoff();
+
+    /// Remember d until its outcome comes back, returns its token.
+    uint64_t add(pn_delivery_t* d);
+
+    /// Forget the delivery for token, 0 if it was already forgotten.
+    pn_delivery_t* take(uint64_t token);
+
+    /// Forget all deliveries, their transport is gone.
+    void clear();
+
+    std::shared_ptr<settle_channel> channel;
+    std::vector<settle_channel::outcome> outcomes; // Reused by each drain
+    size_t waiting;             // Messages on the connection's receivers waiting for room
+
+  private:
+    struct slot {
+        slot() : delivery(0), generation(0) {}
+        pn_delivery_t* delivery;
+        uint32_t generation;
+    };
+    std::vector<slot> slots_;
+    std::vector<uint32_t> free_;
+};
+
+}
+
+#endif // PN_CPP_SUPPORTS_THREADS
+
+#endif // PROTON_CPP_SETTLE_CHANNEL_HPP
@@ -0,0 +1,108 @@
+#ifndef PROTON_CPP_TIMER_WHEEL_HPP
+#define PROTON_CPP_TIMER_WHEEL_HPP
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/timestamp.hpp"
+#include "proton/work_queue.hpp"
+
+#include <proton/type_compat.h>
+
+#include <utility>
+#include <vector>
+
+namespace proton {
+
+/// Timers for work to run at a deadline, in a hierarchical timing wheel.
+///
+/// Each level has 64 slots, a slot on level n spans 64^n milliseconds.
+/// A timer goes in the lowest level where its deadline shares the
+/// current time's higher digits, and moves down a level each time the
+/// current time reaches the start of its slot. Adding and cancelling
+/// are constant time, and a cancelled timer is freed at once.
+///
+/// Entries are kept in a vector and reused, an id pairs an entry's
+/// index with a generation so an old id never cancels a reused entry.
+///
+/// Not thread safe.
+class timer_wheel {
+  public:
+    /// Identifies a timer, 0 is never a valid id.
+    typedef uint64_t id;
+
+    explicit timer_wheel(timestamp start);
+
+    /// Add f to run at deadline.
+    id add(timestamp deadline, work f);
+
+    /// Remove a timer, false if it has already expired or was cancelled.
+    bool cancel(id);
+
+    /// Advance to now, moving the work of every expired timer to the end of out.
+    void expire(timestamp now, std::vector<work>& out);
+
+    /// Set t to the earliest time expire() will have anything to do, false if there are no timers.
+    bool next(timestamp& t) const;
+
+    /// Number of timers not yet expired or cancelled.
+    size_t size() const { return size_; }
+
+  private:
+    static const int bits = 6;
+    static const int slots = 1 << bits;
+    static const int levels = 7;
+    static const int due = levels * slots; // List of timers that have expired
+    static const int none = -1;
+
+    struct entry {
+#if PN_CPP_HAS_RVALUE_REFERENCES
+        explicit entry(work& f) : when(0), gen(0), slot(none), prev(none), next(none), task(std::move(f)) {}
+#else
+        explicit entry(work& f) : when(0), gen(0), slot(none), prev(none), next(none), task(f) {}
+#endif
+        uint64_t when;          // Milliseconds after start_
+        uint32_t gen;
+        int slot;               // Slot number, due, or none if free
+        int prev, next;
+        work task;
+    };
+
+    static uint64_t horizon();
+    int alloc(uint64_t when, work& f);
+    void free_entry(int i);
+    void insert(int i);
+    void link(int i, int slot);
+    void unlink(int i);
+    bool next_tick(uint64_t& t) const;
+
+    timestamp::numeric_type start_;
+    uint64_t now_;              // Milliseconds after start_
+    std::vector<entry> entries_;
+    int free_;
+    int heads_[due + 1];
+    uint64_t occupied_[levels]; // Bit per non-empty slot
+    size_t size_;
+};
+
+}
+
+#endif // PROTON_CPP_TIMER_WHEEL_HPP
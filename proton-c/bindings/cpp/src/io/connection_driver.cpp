@@ -45,6 +45,7 @@ void connection_driver::init() {
         this->~connection_driver(); // Dtor won't be called on throw from ctor.
         throw proton::error(std::string("connection_driver allocation failed"));
     }
+    messaging_adapter::want_events(driver_.collector);
 }
 
 connection_driver::connection_driver() : handler_(0) { init(); }
@@ -99,6 +100,14 @@ bool connection_driver::dispatch() {
             }
         }
     }
+    try {
+        messaging_adapter::flush(driver_.connection);
+    } catch (const std::exception& e) {
+        pn_condition_t *cond = pn_transport_condition(driver_.transport);
+        if (!pn_condition_is_set(cond)) {
+            pn_condition_format(cond, "exception", "%s", e.what());
+        }
+    }
     return !pn_connection_driver_finished(&driver_);
 }
 
@@ -111,6 +120,10 @@ void connection_driver::read_done(size_t n) {
     return pn_connection_driver_read_done(&driver_, n);
 }
 
+size_t connection_driver::read_external(const const_buffer& data) {
+    return pn_connection_driver_read_external(&driver_, data.data, data.size);
+}
+
 void connection_driver::read_close() {
     pn_connection_driver_read_close(&driver_);
 }
@@ -50,7 +50,7 @@ void link::detach() {
 int link::credit() const {
     pn_link_t *lnk = pn_object();
     if (pn_link_is_sender(lnk))
-        return pn_link_credit(lnk);
+        return pn_connection_output_blocked(pn_session_connection(pn_link_session(lnk))) ? 0 : pn_link_credit(lnk);
     link_context& lctx = link_context::get(lnk);
     return pn_link_credit(lnk) + lctx.pending_credit;
 }
@@ -132,16 +132,67 @@ proton::value& map<K,T>::value() { return flush(); }
 template <class K, class T>
 const proton::value& map<K,T>::value() const { return flush(); }
 
+namespace {
+// Look string and symbol keys up in the encoded map, rather than decode all
+// of it.  Return false to decode instead, otherwise set found and leave d at
+// the entry for k.
+template <class K> bool seek(codec::decoder&, const K&, bool&) { return false; }
+bool seek(codec::decoder& d, const std::string& k, bool& found) { found = d.seek_key(k); return true; }
+bool seek(codec::decoder& d, const symbol& k, bool& found) { found = d.seek_key(k); return true; }
+
+template <class K> bool seek_encoded(codec::decoder& d, const K& k, bool& found) {
+    if (d.next_type() != MAP) return false;
+    codec::start s;
+    d >> s;
+    return seek(d, k, found);
+}
+}
+
 template <class K, class T>
 T map<K,T>::get(const K& k) const {
+    if (!map_ && !value_.empty()) {
+        codec::decoder d(value_);
+        bool found;
+        if (seek_encoded(d, k, found)) {
+            T v = T();
+            if (found) d >> v;
+            return v;
+        }
+    }
     if (this->empty()) return T();
     typename map_type::const_iterator i = cache().find(k);
     if (i == map_->end()) return T();
     return i->second;
 }
 
+namespace {
+// Add an entry for a string or symbol key the encoded map does not have
+// yet, rather than decode all of it.  Return false to decode instead.
+template <class K, class T> bool append_encoded(value& m, const K& k, const T& v) {
+    if (m.empty()) {
+        codec::encoder e(m);
+        e << codec::start::map() << k << v << codec::finish();
+        return true;
+    }
+    codec::decoder d(m);
+    bool found;
+    // Replacing an entry in place is not possible in the encoded form
+    if (!seek_encoded(d, k, found) || found) return false;
+    while (d.next())
+        ;
+    codec::encoder e(d);
+    e << k << v;
+    return true;
+}
+
+template <class K, class T> bool put_encoded(value&, const K&, const T&) { return false; }
+template <class T> bool put_encoded(value& m, const std::string& k, const T& v) { return append_encoded(m, k, v); }
+template <class T> bool put_encoded(value& m, const symbol& k, const T& v) { return append_encoded(m, k, v); }
+}
+
 template <class K, class T>
 void map<K,T>::put(const K& k, const T& v) {
+    if (!map_ && put_encoded(value_, k, v)) return;
     cache()[k] = v;
 }
 
@@ -156,6 +207,11 @@ size_t map<K,T>::erase(const K& k) {
 
 template <class K, class T>
 bool map<K,T>::exists(const K& k) const {
+    if (!map_ && !value_.empty()) {
+        codec::decoder d(value_);
+        bool found;
+        if (seek_encoded(d, k, found)) return found;
+    }
     return this->empty() ? 0 : cache().find(k) != cache().end();
 }
 
@@ -178,7 +234,13 @@ bool map<K,T>::empty() const {
     if (value_.empty()) {
         return true;
     }
-    // We must decode the non-empty value to see if it is an empty map.
+    codec::decoder d(value_);
+    if (d.next_type() == MAP) {
+        codec::start s;
+        d >> s;
+        return s.size == 0;
+    }
+    // Not a map, decoding it reports the error
     return cache().empty();
 }
 
@@ -19,8 +19,10 @@
 
 
 #include "proton/map.hpp"
+#include "proton/message.hpp"
 #include "test_bits.hpp"
 
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -114,6 +116,29 @@ void test_value() {
     ASSERT_THROWS(conversion_error, m.value(bad));
 }
 
+// A decoded message's properties are looked up without decoding the map
+void test_encoded() {
+    message m;
+    for (int i = 0; i < 100; ++i) {
+        std::ostringstream k;
+        k << "key" << i;
+        m.properties().put(k.str(), i);
+    }
+    std::vector<char> bytes;
+    m.encode(bytes);
+    message m2;
+    m2.decode(bytes);
+    ASSERT_EQUAL(scalar(42), m2.properties().get("key42"));
+    ASSERT_EQUAL(scalar(0), m2.properties().get("key0"));
+    ASSERT_EQUAL(scalar(), m2.properties().get("missing"));
+    ASSERT(m2.properties().exists("key99"));
+    ASSERT(!m2.properties().exists("key100"));
+    ASSERT_EQUAL(100U, m2.properties().size());
+
+    m2.properties().put("key42", "changed");
+    ASSERT_EQUAL(scalar("changed"), m2.properties().get("key42"));
+}
+
 }
 
 int main(int, char**) {
@@ -122,5 +147,6 @@ int main(int, char**) {
     RUN_TEST(failed, test_use());
     RUN_TEST(failed, test_cppmap());
     RUN_TEST(failed, test_value());
+    RUN_TEST(failed, test_encoded());
     return failed;
 }
@@ -33,21 +33,78 @@
 #include "types_internal.hpp"
 
 #include <proton/delivery.h>
+#include <proton/link.h>
 #include <proton/message.h>
+#include <proton/object.h>
 
+#include <cstdlib>
 #include <string>
 #include <algorithm>
 #include <assert.h>
 
+#if PN_CPP_HAS_SHARED_PTR
+#include <memory>
+#endif
+
+#if PN_CPP_HAS_STD_MUTEX
+#include <mutex>
+#include <vector>
+#endif
+
+#ifndef PN_CPP_MESSAGE_CACHE_SIZE
+# define PN_CPP_MESSAGE_CACHE_SIZE 16 /* destroyed messages kept for reuse by each thread */
+#endif
+
+#ifndef PN_CPP_MESSAGE_POOL_SIZE
+# define PN_CPP_MESSAGE_POOL_SIZE 256 /* messages passed between thread caches */
+#endif
+
+#define MESSAGE_CACHE (PN_CPP_MESSAGE_CACHE_SIZE > 0 && PN_CPP_HAS_CPP11)
+#define MESSAGE_POOL (MESSAGE_CACHE && PN_CPP_MESSAGE_POOL_SIZE > 0 && PN_CPP_HAS_STD_MUTEX)
+
 namespace proton {
 
+namespace {
+void check(int err) {
+    if (err) throw error(error_str(err));
+}
+
+#if PN_CPP_HAS_SHARED_PTR
+typedef std::shared_ptr<const std::vector<char> > shared_encoding;
+
+// Proton object keeping a shared encoding alive for pn_link_send_shared()
+struct encoding_ref {
+    shared_encoding encoded;
+    encoding_ref(const shared_encoding& e) : encoded(e) {}
+};
+
+void encoding_ref_finalize(void* v) { reinterpret_cast<encoding_ref*>(v)->~encoding_ref(); }
+#define CID_encoding_ref CID_pn_object
+#define encoding_ref_initialize NULL
+#define encoding_ref_hashcode NULL
+#define encoding_ref_compare NULL
+#define encoding_ref_inspect NULL
+pn_class_t encoding_ref_class = PN_CLASS(encoding_ref);
+#endif
+} // namespace
+
 struct message::impl {
     value body;
     property_map properties;
     annotation_map annotations;
     annotation_map instructions;
+#if PN_CPP_HAS_SHARED_PTR
+    // A copy holds the encoding of the message it was copied from and
+    // only decodes it when first looked at. Untouched copies share one
+    // encoding and are sent by reference.
+    shared_encoding encoded;
+    bool decode_pending;
+#endif
 
     impl(pn_message_t *msg) {
+#if PN_CPP_HAS_SHARED_PTR
+        decode_pending = false;
+#endif
         body.reset(pn_message_body(msg));
         properties.reset(pn_message_properties(msg));
         annotations.reset(pn_message_annotations(msg));
@@ -66,38 +123,153 @@ struct message::impl {
         if (!annotations.empty()) annotations.value();
         if (!instructions.empty()) instructions.value();
     }
+
+    static struct impl* get(pn_message_t *msg) {
+        return msg ? (struct impl*)pn_message_get_extra(msg) : 0;
+    }
+
+    // Free a pn_message_t made by message::pn_msg()
+    static void free(pn_message_t *msg) {
+        get(msg)->~impl();  // destroy in-place, a pending copy is never decoded
+        pn_message_free(msg);
+    }
+
+#if MESSAGE_CACHE
+    // Cleared pn_message_t objects of destroyed messages, reused by the
+    // next messages the thread makes.
+    struct cache {
+        pn_message_t* msgs[PN_CPP_MESSAGE_CACHE_SIZE];
+        int count;
+        cache() : count(0) {}
+        // Messages destroyed after the thread's cache are freed at once
+        ~cache() { while (count > 0) free(msgs[--count]); count = -1; }
+    };
+    static thread_local cache cached;
+
+#if MESSAGE_POOL
+    // Messages moving between threads: a thread with a full cache gives
+    // half of it here and a thread with an empty cache takes some back,
+    // so messages received on one thread and destroyed on another are
+    // still reused by the receiving thread.
+    struct pool {
+        std::mutex lock;
+        std::vector<pn_message_t*> msgs;
+        pool() { msgs.reserve(PN_CPP_MESSAGE_POOL_SIZE); }
+        ~pool() { for (size_t i = 0; i < msgs.size(); ++i) free(msgs[i]); }
+    };
+    static pool& shared() { static pool p; return p; }
+#endif
+
+    // A cleared pn_message_t to reuse, 0 if there is none
+    static pn_message_t* reuse() {
+        cache& c = cached;
+#if MESSAGE_POOL
+        if (c.count == 0) {
+            pool& p = shared();
+            std::lock_guard<std::mutex> g(p.lock);
+            while (c.count < (PN_CPP_MESSAGE_CACHE_SIZE + 1) / 2 && !p.msgs.empty()) {
+                c.msgs[c.count++] = p.msgs.back();
+                p.msgs.pop_back();
+            }
+        }
+#endif
+        return c.count > 0 ? c.msgs[--c.count] : 0;
+    }
+
+    // Keep cleared msg for reuse, false if there is no room for it.
+    // Never called once the thread's cache is destroyed.
+    static bool recycle(pn_message_t* msg) {
+        cache& c = cached;
+#if MESSAGE_POOL
+        if (c.count == PN_CPP_MESSAGE_CACHE_SIZE) {
+            pool& p = shared();
+            std::lock_guard<std::mutex> g(p.lock);
+            while (c.count > PN_CPP_MESSAGE_CACHE_SIZE / 2 && p.msgs.size() < PN_CPP_MESSAGE_POOL_SIZE)
+                p.msgs.push_back(c.msgs[--c.count]);
+        }
+#endif
+        if (c.count >= PN_CPP_MESSAGE_CACHE_SIZE) return false;
+        c.msgs[c.count++] = msg;
+        return true;
+    }
+#endif
+
+#if PN_CPP_HAS_SHARED_PTR
+    // Stop sharing before msg is used, decoding the copied contents
+    void unshare(pn_message_t *msg) {
+        shared_encoding e;
+        e.swap(encoded);
+        if (decode_pending) {
+            decode_pending = false;
+            clear();
+            if (!e->empty()) check(pn_message_decode(msg, &(*e)[0], e->size()));
+        }
+    }
+
+    // The encoding of m for copies to share: a pending copy passes on
+    // the one it holds, anything else is encoded afresh.
+    static shared_encoding share(const message& m) {
+        struct impl* i = get(m.pn_msg_);
+        if (i && i->encoded) return i->encoded;
+        std::vector<char>* data = new std::vector<char>;
+        shared_encoding e(data);
+        m.encode(*data);
+        return e;
+    }
+#endif
 };
 
 message::message() : pn_msg_(0) {}
 message::message(const message &m) : pn_msg_(0) { *this = m; }
 
 #if PN_CPP_HAS_RVALUE_REFERENCES
-message::message(message &&m) : pn_msg_(0) { swap(*this, m); }
-message& message::operator=(message&& m) {
-  swap(*this, m);
+message::message(message &&m) PN_CPP_NOEXCEPT : pn_msg_(0) { swap(*this, m); }
+message& message::operator=(message&& m) PN_CPP_NOEXCEPT {
+  if (&m != this) {
+      swap(*this, m);
+      m.clear();
+  }
   return *this;
 }
 #endif
 
 message::message(const value& x) : pn_msg_(0) { body() = x; }
 
+#if MESSAGE_CACHE
+thread_local message::impl::cache message::impl::cached;
+#endif
+
 message::~message() {
     if (pn_msg_) {
-        impl().~impl();               // destroy in-place
-        pn_message_free(pn_msg_);
+#if MESSAGE_CACHE
+        if (impl::cached.count >= 0) {
+            clear();
+            if (impl::recycle(pn_msg_)) return;
+        }
+#endif
+        impl::free(pn_msg_);
     }
 }
 
-void swap(message& x, message& y) {
+void swap(message& x, message& y) PN_CPP_NOEXCEPT {
     std::swap(x.pn_msg_, y.pn_msg_);
 }
 
 pn_message_t *message::pn_msg() const {
     if (!pn_msg_) {
+#if MESSAGE_CACHE
+        if ((pn_msg_ = impl::reuse())) return pn_msg_;
+#endif
         pn_msg_ = pn_message_with_extra(sizeof(struct message::impl));
         // Construct impl in extra storage allocated with pn_msg_
         new (pn_message_get_extra(pn_msg_)) struct message::impl(pn_msg_);
     }
+#if PN_CPP_HAS_SHARED_PTR
+    else {
+        struct impl* i = impl::get(pn_msg_);
+        if (i->encoded) i->unshare(pn_msg_);
+    }
+#endif
     return pn_msg_;
 }
 
@@ -107,27 +279,34 @@ struct message::impl& message::impl() const {
 
 message& message::operator=(const message& m) {
     if (&m != this) {
+#if PN_CPP_HAS_SHARED_PTR
+        shared_encoding e = impl::share(m);
+        clear();
+        struct impl* i = impl::get(pn_msg());
+        i->encoded = e;
+        i->decode_pending = true;
+#else
         // TODO aconway 2015-08-10: more efficient pn_message_copy function
         std::vector<char> data;
         m.encode(data);
         decode(data);
+#endif
     }
     return *this;
 }
 
 void message::clear() {
     if (pn_msg_) {
+#if PN_CPP_HAS_SHARED_PTR
+        struct impl* i = impl::get(pn_msg_);
+        i->encoded.reset();
+        i->decode_pending = false;
+#endif
         impl().clear();
         pn_message_clear(pn_msg_);
     }
 }
 
-namespace {
-void check(int err) {
-    if (err) throw error(error_str(err));
-}
-} // namespace
-
 void message::id(const message_id& id) { pn_message_set_id(pn_msg(), id.atom_); }
 
 message_id message::id() const {
@@ -204,6 +383,15 @@ std::string message::content_encoding() const {
     return s ? std::string(s) : std::string();
 }
 
+void message::compress(size_t min_size) {
+    check(pn_message_compress(pn_msg(), min_size));
+}
+
+void message::decompress(size_t max_size) {
+    int err = pn_message_decompress(pn_msg(), max_size);
+    if (err) throw error(error_str(pn_message_error(pn_msg()), err));
+}
+
 void message::expiry_time(timestamp t) {
     pn_message_set_expiry_time(pn_msg(), t.milliseconds());
 }
@@ -242,49 +430,92 @@ void message::inferred(bool b) { pn_message_set_inferred(pn_msg(), b); }
 
 void message::body(const value& x) { body() = x; }
 
-const value& message::body() const { return impl().body; }
-value& message::body() { return impl().body; }
+// Calling the pn_message_t accessor first decodes any section that
+// pn_message_decode() left in its encoded form.
+const value& message::body() const { pn_message_body(pn_msg()); return impl().body; }
+value& message::body() { pn_message_body(pn_msg()); return impl().body; }
 
 message::property_map& message::properties() {
+    pn_message_properties(pn_msg());
     return impl().properties;
 }
 
 const message::property_map& message::properties() const {
+    pn_message_properties(pn_msg());
     return impl().properties;
 }
 
 message::annotation_map& message::message_annotations() {
+    pn_message_annotations(pn_msg());
     return impl().annotations;
 }
 
 const message::annotation_map& message::message_annotations() const {
+    pn_message_annotations(pn_msg());
     return impl().annotations;
 }
 
 message::annotation_map& message::delivery_annotations() {
+    pn_message_instructions(pn_msg());
     return impl().instructions;
 }
 
 const message::annotation_map& message::delivery_annotations() const {
+    pn_message_instructions(pn_msg());
     return impl().instructions;
 }
 
 void message::encode(std::vector<char> &s) const {
+#if PN_CPP_HAS_SHARED_PTR
+    struct impl* i = impl::get(pn_msg_);
+    if (i && i->encoded) {
+        s = *i->encoded;
+        return;
+    }
+#endif
     impl().flush();
-    size_t sz = std::max(s.capacity(), size_t(512));
-    while (true) {
-        s.resize(sz);
-        assert(!s.empty());
-        int err = pn_message_encode(pn_msg(), const_cast<char*>(&s[0]), &sz);
-        if (err) {
-            if (err != PN_OVERFLOW)
-                check(err);
-        } else {
-            s.resize(sz);
-            return;
-        }
-        sz *= 2;
+    // Encoded in one pass, growing the buffer as it goes
+    pn_rwbytes_t buf = pn_rwbytes(0, NULL);
+    ssize_t encoded = pn_message_encode2(pn_msg(), &buf);
+    if (encoded >= 0) s.assign(buf.start, buf.start + encoded);
+    std::free(buf.start);
+    if (encoded < 0) check(int(encoded));
+}
+
+// Encode onto the current delivery of sender without an intermediate buffer
+void message::encode(pn_link_t *sender) const {
+#if PN_CPP_HAS_SHARED_PTR
+    struct impl* i = impl::get(pn_msg_);
+    if (i && i->encoded && !i->encoded->empty()) {
+        void *ref = pn_object_new(&encoding_ref_class, sizeof(encoding_ref));
+        new (ref) encoding_ref(i->encoded);
+        ssize_t sent = pn_link_send_shared(sender, &(*i->encoded)[0], i->encoded->size(), ref);
+        pn_decref(ref);
+        if (sent < 0) check(int(sent));
+        return;
     }
+#endif
+    impl().flush();
+    ssize_t sent = pn_message_send(pn_msg(), sender);
+    if (sent < 0) check(int(sent));
+}
+
+// Send pre-settled with no delivery where it can, see pn_link_send_settled
+void message::encode_settled(pn_link_t *sender) const {
+#if PN_CPP_HAS_SHARED_PTR
+    struct impl* i = impl::get(pn_msg_);
+    if (i && i->encoded && !i->encoded->empty()) {
+        ssize_t sent = pn_link_send_settled(sender, &(*i->encoded)[0], i->encoded->size());
+        if (sent < 0) check(int(sent));
+        return;
+    }
+#endif
+    impl().flush();
+    pn_rwbytes_t buf = pn_rwbytes(0, NULL);
+    ssize_t sent = pn_message_encode2(pn_msg(), &buf);
+    if (sent >= 0) sent = pn_link_send_settled(sender, buf.start, size_t(sent));
+    std::free(buf.start);
+    if (sent < 0) check(int(sent));
 }
 
 std::vector<char> message::encode() const {
@@ -300,6 +531,31 @@ void message::decode(const std::vector<char> &s) {
     check(pn_message_decode(pn_msg(), &s[0], s.size()));
 }
 
+// Decode in place from the delivery buffer, then discard the bytes
+void message::decode(proton::delivery delivery) {
+    pn_delivery_t *dlv = unwrap(delivery);
+    pn_bytes_t bytes = pn_delivery_bytes(dlv);
+    if (!bytes.size)
+        throw error("message decode: no delivery pending on link");
+    impl().clear();
+    check(pn_message_decode(pn_msg(), bytes.start, bytes.size));
+    pn_link_recv(pn_delivery_link(dlv), NULL, bytes.size);
+}
+
+bool message_unpack(message& msg, const char*& pos, const char* end) {
+    if (pos == end) return false;
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(pos);
+    if (end - pos < 5 || p[0] != 0xb0)
+        throw error("message unpack: bad packed message");
+    size_t size = (size_t(p[1]) << 24) | (size_t(p[2]) << 16) | (size_t(p[3]) << 8) | size_t(p[4]);
+    if (size_t(end - pos) - 5 < size)
+        throw error("message unpack: packed message truncated");
+    msg.impl().clear();
+    check(pn_message_decode(msg.pn_msg(), pos + 5, size));
+    pos += 5 + size;
+    return true;
+}
+
 bool message::durable() const { return pn_message_is_durable(pn_msg()); }
 void message::durable(bool b) { pn_message_set_durable(pn_msg(), b); }
 
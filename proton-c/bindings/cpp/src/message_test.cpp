@@ -17,13 +17,26 @@
  * under the License.
  */
 
+#include "proton/binary.hpp"
+#include "proton/error.hpp"
 #include "proton/message.hpp"
 #include "proton/scalar.hpp"
 #include "test_bits.hpp"
+#include <proton/message.h>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <streambuf>
 #include <iosfwd>
+#include <vector>
+
+#if PN_CPP_HAS_STD_THREAD
+#include <thread>
+#endif
+
+#if PN_CPP_HAS_NOEXCEPT
+#include <type_traits>
+#endif
 
 namespace {
 
@@ -130,6 +143,33 @@ void test_message_body() {
     ASSERT_EQUAL(3.1, coerce<double>(message(3.1).body()));
 }
 
+void test_message_compress() {
+    std::string json;
+    while (json.size() < 4000) json += "{\"reading\": 42, \"unit\": \"C\"},";
+    binary original(json);
+    message m(original);
+    m.compress(json.size() + 1);
+    ASSERT(m.content_encoding().empty());
+    if (!pn_message_compress_present()) return;
+
+    message copy(m);            // Shares the encoding until compressed
+    copy.compress();
+    ASSERT_EQUAL("deflate", copy.content_encoding());
+    ASSERT(get<binary>(copy.body()).size() < json.size() / 4);
+    ASSERT_EQUAL(original, get<binary>(m.body()));
+
+    message received;
+    received.decode(copy.encode());
+    ASSERT_THROWS(proton::error, received.decompress(json.size() - 1));
+    ASSERT_EQUAL("deflate", received.content_encoding());
+    received.decompress();
+    ASSERT(received.content_encoding().empty());
+    ASSERT_EQUAL(original, get<binary>(received.body()));
+
+    received.content_encoding("deflate");
+    ASSERT_THROWS(proton::error, received.decompress());
+}
+
 void test_message_maps() {
     message m;
 
@@ -182,6 +222,45 @@ void test_message_maps() {
     ASSERT_EQUAL(1, t);
 }
 
+void test_message_property() {
+    message m;
+    ASSERT_EQUAL(0, m.property<int>("missing"));
+    m.property("a", 1);
+    m.property("b", std::string("two"));
+    m.property("c", 3.0);
+    ASSERT_EQUAL(1, m.property<int>("a"));
+    ASSERT_EQUAL("two", m.property<std::string>("b"));
+    ASSERT_EQUAL(3.0, m.property<double>("c"));
+    ASSERT_EQUAL(3u, m.properties().size());
+    ASSERT_THROWS(conversion_error, m.property<std::string>("a"));
+
+    // A replaced key and a new one after a round trip
+    message r;
+    r.decode(m.encode());
+    r.property("b", std::string("second"));
+    r.property("d", int64_t(4));
+    message r2;
+    r2.decode(r.encode());
+    ASSERT_EQUAL(4u, r2.properties().size());
+    ASSERT_EQUAL(1, r2.property<int>("a"));
+    ASSERT_EQUAL("second", r2.property<std::string>("b"));
+    ASSERT_EQUAL(int64_t(4), r2.property<int64_t>("d"));
+    ASSERT(!r2.properties().empty());
+
+    // Many keys added in the encoded form
+    message big;
+    for (int i = 0; i < 100; ++i) {
+        std::ostringstream k;
+        k << "key" << i;
+        big.property(k.str(), i);
+    }
+    message big2;
+    big2.decode(big.encode());
+    ASSERT_EQUAL(100u, big2.properties().size());
+    ASSERT_EQUAL(42, big2.property<int>("key42"));
+    ASSERT_EQUAL(99, big2.property<int>("key99"));
+}
+
 void test_message_reuse() {
     message m1("one");
     m1.properties().put("x", "y");
@@ -194,6 +273,110 @@ void test_message_reuse() {
     ASSERT_EQUAL(value("b"), m1.properties().get("a"));
 }
 
+void test_message_copy_shared() {
+    message m("fan");
+    m.properties().put("x", "y");
+
+    message c1(m), c2(c1), c3;
+    c3 = c2;
+    ASSERT_EQUAL(m.encode(), c3.encode()); // Untouched copies encode alike
+
+    c1.body() = "one";          // Changing a copy leaves the rest alone
+    c2.properties().put("x", "z");
+    m.body() = "changed";
+    ASSERT_EQUAL(value("one"), c1.body());
+    ASSERT_EQUAL(value("y"), c1.properties().get("x"));
+    ASSERT_EQUAL(value("fan"), c2.body());
+    ASSERT_EQUAL(value("z"), c2.properties().get("x"));
+    ASSERT_EQUAL(value("fan"), c3.body());
+    ASSERT_EQUAL(value("y"), c3.properties().get("x"));
+
+    c3.clear();                 // A cleared copy is empty, not the original
+    ASSERT(c3.body().empty());
+    ASSERT(c3.properties().empty());
+}
+
+
+// Messages reuse the storage of destroyed ones, which must not show through
+void test_message_recycle() {
+    {
+        message m("recycled");
+        m.id("id");
+        m.durable(true);
+        m.ttl(duration(10));
+        m.priority(1);
+        m.delivery_count(3);
+        m.properties().put("x", "y");
+        m.message_annotations().put("a", "b");
+        m.delivery_annotations().put("c", "d");
+        message c(m);           // Destroyed with a pending copy
+    }
+    test_message_defaults();
+    message m;
+    ASSERT(m.properties().empty());
+    ASSERT(m.message_annotations().empty());
+    ASSERT(m.delivery_annotations().empty());
+}
+
+#if PN_CPP_HAS_RVALUE_REFERENCES
+void test_message_move() {
+    message m("move");
+    m.properties().put("x", "y");
+    message m2(std::move(m));
+    ASSERT_EQUAL(value("move"), m2.body());
+    ASSERT_EQUAL(value("y"), m2.properties().get("x"));
+    ASSERT(m.body().empty());
+    m.body() = "reused";        // A moved-from message can be used again
+    ASSERT_EQUAL(value("reused"), m.body());
+
+    message m3("old");
+    m3.properties().put("old", "z");
+    m3 = std::move(m2);         // m2 is left empty
+    ASSERT_EQUAL(value("move"), m3.body());
+    ASSERT_EQUAL(value("y"), m3.properties().get("x"));
+    ASSERT(m3.properties().get("old").empty());
+    ASSERT(m2.body().empty());
+    ASSERT(m2.properties().empty());
+
+    swap(m, m3);
+    ASSERT_EQUAL(value("move"), m.body());
+    ASSERT_EQUAL(value("reused"), m3.body());
+
+#if PN_CPP_HAS_NOEXCEPT
+    ASSERT(std::is_nothrow_move_constructible<message>::value);
+#endif
+    std::vector<message> v;
+    v.push_back(std::move(m));
+    for (int i = 0; i < 10; ++i) v.push_back(message(i));
+    ASSERT_EQUAL(value("move"), v[0].body());
+    ASSERT_EQUAL(value(9), v[10].body());
+}
+#endif
+
+#if PN_CPP_HAS_STD_THREAD && PN_CPP_HAS_RVALUE_REFERENCES
+// Messages destroyed on another thread come back cleared to this one
+void test_message_pool() {
+    std::vector<message> v;
+    for (int i = 0; i < 100; ++i) {
+        message m(i);
+        m.subject("pooled");
+        m.reply_to("somewhere");
+        m.properties().put("x", i);
+        v.push_back(std::move(m));
+    }
+    std::thread t([&v]() { v.clear(); });
+    t.join();
+    for (int i = 0; i < 100; ++i) {
+        message m;
+        ASSERT_EQUAL("", m.subject());
+        ASSERT_EQUAL("", m.reply_to());
+        ASSERT(m.properties().empty());
+        ASSERT(m.body().empty());
+        v.push_back(std::move(m));
+    }
+}
+#endif
+
 }
 
 int main(int, char**) {
@@ -201,7 +384,17 @@ int main(int, char**) {
     RUN_TEST(failed, test_message_properties());
     RUN_TEST(failed, test_message_defaults());
     RUN_TEST(failed, test_message_body());
+    RUN_TEST(failed, test_message_compress());
     RUN_TEST(failed, test_message_maps());
+    RUN_TEST(failed, test_message_property());
     RUN_TEST(failed, test_message_reuse());
+    RUN_TEST(failed, test_message_copy_shared());
+    RUN_TEST(failed, test_message_recycle());
+#if PN_CPP_HAS_RVALUE_REFERENCES
+    RUN_TEST(failed, test_message_move());
+#endif
+#if PN_CPP_HAS_STD_THREAD && PN_CPP_HAS_RVALUE_REFERENCES
+    RUN_TEST(failed, test_message_pool());
+#endif
     return failed;
 }
@@ -21,6 +21,7 @@
 
 #include "messaging_adapter.hpp"
 
+#include "proton/binary.hpp"
 #include "proton/connection.hpp"
 #include "proton/container.hpp"
 #include "proton/delivery.hpp"
@@ -31,42 +32,135 @@
 #include "proton/sender.hpp"
 #include "proton/sender_options.hpp"
 #include "proton/session.hpp"
+#include "proton/timestamp.hpp"
 #include "proton/tracker.hpp"
+#include "proton/transaction.hpp"
 #include "proton/transport.hpp"
+#include "proton/typed_handler.hpp"
+#include "proton/worker_queue.hpp"
 
 #include "contexts.hpp"
 #include "msg.hpp"
 #include "proton_bits.hpp"
+#include "settle_channel.hpp"
 
 #include <proton/connection.h>
 #include <proton/delivery.h>
+#include <proton/disposition.h>
 #include <proton/handlers.h>
 #include <proton/link.h>
 #include <proton/message.h>
+#include <proton/message_selector.h>
 #include <proton/session.h>
 #include <proton/transport.h>
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 
 namespace proton {
 
+// Decode the message corresponding to a delivery from a link.
+void message_decode(message& msg, proton::delivery delivery) {
+    msg.clear();
+    msg.decode(delivery);
+    pn_link_advance(unwrap(delivery.receiver()));
+}
+
+inline bool messaging_adapter::handles(const messaging_handler& handler, uint32_t bit) {
+    return handler.handled_ & bit;
+}
+
 namespace {
+using namespace internal;
+
+inline bool handles(const messaging_handler& handler, uint32_t bit) {
+    return messaging_adapter::handles(handler, bit);
+}
+
 // This must only be called for receiver links
+double ewma(double average, double sample) {
+    return average ? average + (sample - average) / 4 : sample;
+}
+
+// Size the window to twice the deliveries expected in a round trip, so the
+// pipeline stays full while credit is on its way.  While credit is what
+// limits the rate the window doubles each sample, once the consumer is
+// what limits it the window follows its rate, never buffering more than
+// max_bytes of messages of the average size.
+void adapt_window(link_context& lctx, pn_link_t *link, int64_t now) {
+    adaptive_credit& a = lctx.adaptive;
+    int arrived = a.credit - pn_link_credit(link);
+    if (arrived > 0) {
+        a.credit -= arrived;
+        a.sample_count += arrived;
+        if (a.flow_at) {
+            a.rtt = ewma(a.rtt, now > a.flow_at ? double(now - a.flow_at) : 1);
+            a.flow_at = 0;
+        }
+    }
+    int64_t period = a.rtt > 10 ? int64_t(a.rtt) : 10;
+    if (!a.sample_start) {
+        a.sample_start = now;
+        a.sample_count = 0;
+    } else if (now - a.sample_start >= period) {
+        if (a.sample_count)
+            a.rate = ewma(a.rate, double(a.sample_count) / double(now - a.sample_start));
+        a.sample_start = now;
+        a.sample_count = 0;
+    }
+    if (a.rate && a.rtt) {
+        double window = 2 * a.rate * a.rtt + 1;
+        double cap = a.size >= 1 ? double(a.max_bytes) / a.size : double(INT_MAX);
+        if (window > cap) window = cap;
+        if (window > INT_MAX / 2) window = INT_MAX / 2;
+        lctx.credit_window = window < 2 ? 2 : int(window);
+    }
+}
+
 void credit_topup(pn_link_t *link) {
     assert(pn_link_is_receiver(link));
-    int window = link_context::get(link).credit_window;
+    link_context& lctx = link_context::get(link);
+#if PN_CPP_SUPPORTS_THREADS
+    if (!lctx.waiting.empty()) return; // The workers are not keeping up
+#endif
+    int64_t now = 0;
+    if (lctx.credit_window && lctx.adaptive.max_bytes) {
+        now = timestamp::now().milliseconds();
+        adapt_window(lctx, link, now);
+    }
+    int window = lctx.credit_window;
     if (window) {
-        int delta = window - pn_link_credit(link);
-        pn_link_flow(link, delta);
+        // Wait for credit to fall to the low-water mark and then restore
+        // the whole window in one flow
+        int low_water = window - 1;
+        if (lctx.credit_low_water >= 0 && lctx.credit_low_water < low_water)
+            low_water = lctx.credit_low_water;
+        int credit = pn_link_credit(link);
+        if (credit <= low_water || credit > window)
+            pn_link_flow(link, window - credit);
+        if (now) {
+            lctx.adaptive.credit = pn_link_credit(link);
+            if (!credit && lctx.adaptive.credit) lctx.adaptive.flow_at = now;
+        }
     }
 }
 
 
+// A sender to a transaction coordinator, see session::declare_transaction()
+bool is_coordinator(pn_link_t *lnk) {
+    return pn_link_is_sender(lnk) && pn_terminus_get_type(pn_link_target(lnk)) == PN_COORDINATOR;
+}
+
+// Output is over the connection's high-water mark, a PN_LINK_FLOW follows once it drains
+bool output_blocked(pn_link_t *lnk) {
+    return pn_connection_output_blocked(pn_session_connection(pn_link_session(lnk)));
+}
+
 void on_link_flow(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
     // TODO: process session flow data, if no link-specific data, just return.
-    if (!lnk) return;
+    if (!lnk || is_coordinator(lnk)) return;
     int state = pn_link_state(lnk);
     if ((state&PN_LOCAL_ACTIVE) && (state&PN_REMOTE_ACTIVE)) {
         link_context& lctx = link_context::get(lnk);
@@ -74,40 +168,209 @@ void on_link_flow(messaging_handler& handler, pn_event_t* event) {
             if (pn_link_credit(lnk) > 0) {
                 sender s(make_wrapper<sender>(lnk));
                 bool draining = pn_link_get_drain(lnk);
-                if ( draining && !lctx.draining) {
+                if ( draining && !lctx.draining && handles(handler, ON_SENDER_DRAIN_START)) {
                     handler.on_sender_drain_start(s);
                 }
                 lctx.draining = draining;
-                // create on_message extended event
-                handler.on_sendable(s);
+                // Held messages go before the application sends more
+                if (!lctx.held.empty()) send_held(lnk);
+                // create on_message extended event, unless the peer is not keeping up
+                if (handles(handler, ON_SENDABLE) && pn_link_credit(lnk) > 0 && !output_blocked(lnk))
+                    handler.on_sendable(s);
             }
         } else {
             // receiver
             if (!pn_link_credit(lnk) && lctx.draining) {
                 lctx.draining = false;
-                receiver r(make_wrapper<receiver>(lnk));
-                handler.on_receiver_drain_finish(r);
+                if (handles(handler, ON_RECEIVER_DRAIN_FINISH)) {
+                    receiver r(make_wrapper<receiver>(lnk));
+                    handler.on_receiver_drain_finish(r);
+                }
             }
             credit_topup(lnk);
         }
     }
 }
 
-// Decode the message corresponding to a delivery from a link.
-void message_decode(message& msg, proton::delivery delivery) {
-    std::vector<char> buf;
-    buf.resize(pn_delivery_pending(unwrap(delivery)));
-    if (buf.empty())
-        throw error("message decode: no delivery pending on link");
-    proton::receiver link = delivery.receiver();
-    assert(!buf.empty());
-    ssize_t n = pn_link_recv(unwrap(link), const_cast<char *>(&buf[0]), buf.size());
-    if (n != ssize_t(buf.size())) throw error(MSG("receiver read failure"));
-    msg.clear();
-    msg.decode(buf);
-    pn_link_advance(unwrap(link));
+// Hand the trackers batched on a sender to on_trackers_settled()
+void flush_settled(pn_link_t *lnk, link_context& lctx) {
+    std::vector<tracker> batch;
+    batch.swap(lctx.batch_settled);     // Nothing is handled twice if the handler throws
+    if (batch.empty()) return;
+    sender s(make_wrapper<sender>(lnk));
+    lctx.batch_handler->on_trackers_settled(s, tracker_range(&batch[0], &batch[0] + batch.size()));
+    if (lctx.auto_settle) {
+        for (size_t i = 0; i < batch.size(); ++i) batch[i].settle();
+    }
+    batch.clear();
+    batch.swap(lctx.batch_settled);     // Keep the capacity
+}
+
+// Hand the messages or trackers batched on the connection to on_messages()
+// or on_trackers_settled()
+void flush_batch(connection_context& ctx) {
+    pn_link_t *lnk = ctx.batch_link;
+    if (!lnk) return;
+    ctx.batch_link = 0;
+    link_context& lctx = link_context::get(lnk);
+    if (pn_link_is_sender(lnk)) {
+        flush_settled(lnk, lctx);
+        return;
+    }
+    std::vector<delivery> batch;
+    batch.swap(lctx.batch);     // Nothing is delivered twice if the handler throws
+    if (batch.empty()) return;
+    if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
+        if (lctx.auto_accept) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!i || !(batch[i] == batch[i-1])) batch[i].release();
+            }
+        }
+    } else {
+        // Shrinking only drops message objects a bigger batch left over
+        lctx.batch_message.resize(batch.size());
+        receiver r(make_wrapper<receiver>(lnk));
+        lctx.batch_handler->on_messages(r, batch, lctx.batch_message);
+        if (lctx.auto_accept) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                // The messages of a packed delivery are adjacent
+                if ((!i || !(batch[i] == batch[i-1])) && !batch[i].settled()) batch[i].accept();
+            }
+        }
+    }
+    batch.clear();
+    batch.swap(lctx.batch);     // Keep the capacity
+}
+
+// Discard the data of a complete delivery and advance past it
+void skip_delivery(pn_link_t *lnk, pn_delivery_t *dlv) {
+    pn_link_recv(lnk, NULL, pn_delivery_pending(dlv));
+    pn_link_advance(lnk);
+}
+
+// True if the receiver's selector does not match the complete delivery
+// dlv, see receiver_options::selector(). Only the sections the selector
+// reads are looked at, the message is not decoded.
+bool unselected(link_context& lctx, pn_delivery_t *dlv) {
+    if (!lctx.selector || pn_delivery_partial(dlv) || !pn_delivery_readable(dlv) ||
+        pn_delivery_message_format(dlv) == PACKED_MESSAGE_FORMAT)
+        return false;
+    pn_bytes_t bytes = pn_delivery_bytes(dlv);
+    // A malformed message is left for message_decode to report
+    return pn_message_selector_match(lctx.selector.get(), bytes.start, bytes.size) == 0;
+}
+
+// Generate on_message for each message of a packed delivery, see
+// sender::send_packed. False if the link was closed before the last.
+bool packed_messages(messaging_handler& handler, pn_link_t *lnk, delivery& d, message& msg) {
+    pn_delivery_t *dlv = unwrap(d);
+    // The delivery is complete, so the view holds until it is read
+    pn_bytes_t bytes = pn_delivery_bytes(dlv);
+    const char *pos = bytes.start, *end = bytes.start + bytes.size;
+    bool more = true;
+    while (!(pn_link_state(lnk) & PN_LOCAL_CLOSED) && (more = message_unpack(msg, pos, end)))
+        handler.on_message(d, msg);
+    skip_delivery(lnk, dlv);
+    return !more;
+}
+
+// Decode and advance past a complete delivery, keeping it for on_messages()
+void batch_delivery(messaging_handler& handler, pn_link_t *lnk, link_context& lctx, delivery& d) {
+    connection_context& ctx = connection_context::get(pn_session_connection(pn_link_session(lnk)));
+    if (ctx.batch_link != lnk) {
+        flush_batch(ctx);
+        ctx.batch_link = lnk;
+        lctx.batch_handler = &handler;
+    }
+    if (pn_delivery_message_format(unwrap(d)) == PACKED_MESSAGE_FORMAT) {
+        // The delivery is repeated for each of its messages
+        pn_bytes_t bytes = pn_delivery_bytes(unwrap(d));
+        const char *pos = bytes.start, *end = bytes.start + bytes.size;
+        for (size_t n = lctx.batch.size();; ++n) {
+            if (lctx.batch_message.size() <= n) lctx.batch_message.resize(n + 1);
+            if (!message_unpack(lctx.batch_message[n], pos, end)) break;
+            lctx.batch.push_back(d);
+        }
+        skip_delivery(lnk, unwrap(d));
+        return;
+    }
+    size_t n = lctx.batch.size();
+    if (lctx.batch_message.size() <= n) lctx.batch_message.resize(n + 1);
+    message_decode(lctx.batch_message[n], d);
+    lctx.batch.push_back(d);
+}
+
+#if PN_CPP_SUPPORTS_THREADS
+// Push msg for dlv to the receiver's worker queue, false if it is full
+bool offer(worker_handoff& h, link_context& lctx, pn_delivery_t *dlv, message& msg) {
+    uint64_t token = h.add(dlv);
+    if (lctx.workers->offer(msg, h.channel, token)) return true;
+    h.take(token);
+    return false;
 }
 
+// Decode and advance past a complete delivery and push it to the
+// receiver's worker queue. If the queue is full the message waits on
+// the link, unsettled, until workers make room.
+void hand_off(pn_link_t *lnk, link_context& lctx, delivery& d) {
+    pn_connection_t *pnc = pn_session_connection(pn_link_session(lnk));
+    connection_context& ctx = connection_context::get(pnc);
+    if (!ctx.handoff) ctx.handoff.reset(new worker_handoff(pnc));
+    message msg;                // The worker keeps it, so it can't be the reused one
+    message_decode(msg, d);
+    // Messages already waiting go first
+    if (lctx.waiting.empty() && offer(*ctx.handoff, lctx, unwrap(d), msg)) return;
+    lctx.waiting.push_back(std::make_pair(unwrap(d), message()));
+    swap(lctx.waiting.back().second, msg);
+    ++ctx.handoff->waiting;
+}
+
+// Offer the waiting messages again now that workers may have made room,
+// and restore the credit of receivers that have none left waiting
+void retry_waiting(connection_context& ctx, pn_connection_t *c) {
+    worker_handoff& h = *ctx.handoff;
+    if (!h.waiting) return;
+    size_t waiting = 0;
+    for (pn_link_t *lnk = pn_link_head(c, 0); lnk; lnk = pn_link_next(lnk, 0)) {
+        if (!pn_link_is_receiver(lnk)) continue;
+        link_context& lctx = link_context::get(lnk);
+        if (lctx.waiting.empty()) continue;
+        if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
+            lctx.waiting.clear();       // Their deliveries can't be settled any more
+            continue;
+        }
+        while (!lctx.waiting.empty() &&
+               offer(h, lctx, lctx.waiting.front().first, lctx.waiting.front().second))
+            lctx.waiting.pop_front();
+        waiting += lctx.waiting.size();
+        if (lctx.waiting.empty()) credit_topup(lnk);
+    }
+    h.waiting = waiting;
+}
+
+// The transport is gone, so are the deliveries of waiting messages
+void drop_waiting(connection_context& ctx, pn_connection_t *c) {
+    if (!ctx.handoff->waiting) return;
+    for (pn_link_t *lnk = pn_link_head(c, 0); lnk; lnk = pn_link_next(lnk, 0))
+        if (pn_link_is_receiver(lnk)) link_context::get(lnk).waiting.clear();
+    ctx.handoff->waiting = 0;
+}
+
+// Settle the deliveries whose outcomes came back from worker threads
+void settle_handed(connection_context& ctx) {
+    if (!ctx.handoff) return;
+    worker_handoff& h = *ctx.handoff;
+    h.outcomes.clear();
+    if (!h.channel->drain(h.outcomes)) return;
+    for (size_t i = 0; i < h.outcomes.size(); ++i) {
+        pn_delivery_t *dlv = h.take(h.outcomes[i].token);
+        if (!dlv) continue;     // Its transport closed meanwhile
+        pn_delivery_update(dlv, h.outcomes[i].state);
+        pn_delivery_settle(dlv);
+    }
+}
+#endif
+
 void on_delivery(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
     pn_delivery_t *dlv = pn_event_delivery(event);
@@ -115,7 +378,49 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
 
     if (pn_link_is_receiver(lnk)) {
         delivery d(make_wrapper<delivery>(dlv));
-        if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
+        if (lctx.adaptive.max_bytes && pn_delivery_readable(dlv) && !pn_delivery_partial(dlv))
+            lctx.adaptive.size = ewma(lctx.adaptive.size, double(pn_delivery_pending(dlv)));
+        if (lctx.stream_messages && pn_delivery_readable(dlv) &&
+            (pn_delivery_pending(dlv) || !pn_delivery_partial(dlv))) {
+            // generate on_message_chunk, reading releases the session window
+            pn_bytes_t bytes = pn_delivery_bytes(dlv);
+            bool wanted = handles(handler, ON_MESSAGE_CHUNK);
+            binary chunk;
+            if (wanted) chunk.assign(bytes.start, bytes.start + bytes.size);
+            pn_link_recv(lnk, NULL, bytes.size);
+            bool last = !pn_delivery_partial(dlv);
+            if (last) pn_link_advance(lnk);
+            if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
+                if (last && lctx.auto_accept)
+                    d.release();
+            } else {
+                if (wanted)
+                    handler.on_message_chunk(d, chunk, last);
+                if (last && lctx.auto_accept && !d.settled())
+                    d.accept();
+            }
+        }
+        else if (unselected(lctx, dlv)) {
+            // not for this receiver, the sender may deliver it elsewhere
+            skip_delivery(lnk, dlv);
+            pn_disposition_set_undeliverable(pn_delivery_local(dlv), true);
+            pn_delivery_update(dlv, PN_MODIFIED);
+            pn_delivery_settle(dlv);
+        }
+#if PN_CPP_SUPPORTS_THREADS
+        else if (lctx.workers && !pn_delivery_partial(dlv) && pn_delivery_readable(dlv) &&
+                 pn_delivery_message_format(dlv) != PACKED_MESSAGE_FORMAT &&
+                 !(pn_link_state(lnk) & PN_LOCAL_CLOSED)) {
+            // a worker settles it, see worker_queue
+            hand_off(lnk, lctx, d);
+        }
+#endif
+        else if (lctx.batch_messages && !pn_delivery_partial(dlv) && pn_delivery_readable(dlv) &&
+                 !(pn_link_state(lnk) & PN_LOCAL_CLOSED)) {
+            // on_messages is generated when the batch ends
+            batch_delivery(handler, lnk, lctx, d);
+        }
+        else if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
             // generate on_message
             pn_connection_t *pnc = pn_session_connection(pn_link_session(lnk));
             connection_context& ctx = connection_context::get(pnc);
@@ -123,55 +428,85 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
             // Avoid expensive heap malloc/free overhead.
             // See PROTON-998
             class message &msg(ctx.event_message);
-            message_decode(msg, d);
+            bool packed = pn_delivery_message_format(dlv) == PACKED_MESSAGE_FORMAT;
+            // Without on_message there is no need to decode
+            bool wanted = handles(handler, ON_MESSAGE);
+            if (!wanted) skip_delivery(lnk, dlv);
+            else if (!packed) message_decode(msg, d);
             if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
+                if (packed && wanted) skip_delivery(lnk, dlv);
                 if (lctx.auto_accept)
                     d.release();
             } else {
-                handler.on_message(d, msg);
+                if (wanted && !packed)
+                    handler.on_message(d, msg);
+                else if (wanted && !packed_messages(handler, lnk, d, msg) && lctx.auto_accept)
+                    d.release();        // Closed before the last message
                 if (lctx.auto_accept && !d.settled())
                     d.accept();
                 if (lctx.draining && !pn_link_credit(lnk)) {
                     lctx.draining = false;
-                    receiver r(make_wrapper<receiver>(lnk));
-                    handler.on_receiver_drain_finish(r);
+                    if (handles(handler, ON_RECEIVER_DRAIN_FINISH)) {
+                        receiver r(make_wrapper<receiver>(lnk));
+                        handler.on_receiver_drain_finish(r);
+                    }
                 }
             }
         }
-        else if (pn_delivery_updated(dlv) && d.settled()) {
+        else if (pn_delivery_updated(dlv) && d.settled() && handles(handler, ON_DELIVERY_SETTLE)) {
             handler.on_delivery_settle(d);
         }
         if (lctx.draining && pn_link_credit(lnk) == 0) {
+            // Batched messages come before the end of the drain
+            flush_batch(connection_context::get(pn_session_connection(pn_link_session(lnk))));
             lctx.draining = false;
             pn_link_set_drain(lnk, false);
-            receiver r(make_wrapper<receiver>(lnk));
-            handler.on_receiver_drain_finish(r);
+            if (handles(handler, ON_RECEIVER_DRAIN_FINISH)) {
+                receiver r(make_wrapper<receiver>(lnk));
+                handler.on_receiver_drain_finish(r);
+            }
             if (lctx.pending_credit) {
                 pn_link_flow(lnk, lctx.pending_credit);
                 lctx.pending_credit = 0;
             }
         }
         credit_topup(lnk);
-    } else {
-        tracker t(make_wrapper<tracker>(dlv));
+    } else if (!transaction_outcome(handler, dlv)) {
         // sender
         if (pn_delivery_updated(dlv)) {
-            uint64_t rstate = pn_delivery_remote_state(dlv);
-            if (rstate == PN_ACCEPTED) {
-                handler.on_tracker_accept(t);
-            }
-            else if (rstate == PN_REJECTED) {
-                handler.on_tracker_reject(t);
-            }
-            else if (rstate == PN_RELEASED || rstate == PN_MODIFIED) {
-                handler.on_tracker_release(t);
+            connection_context& ctx = connection_context::get(pn_session_connection(pn_link_session(lnk)));
+            if (lctx.batch_settlements && pn_delivery_settled(dlv) &&
+                handles(handler, ON_TRACKER_ACCEPT | ON_TRACKER_REJECT | ON_TRACKER_RELEASE | ON_TRACKER_SETTLE | ON_TRACKERS_SETTLED)) {
+                // on_trackers_settled is generated when the batch ends
+                if (ctx.batch_link != lnk) {
+                    flush_batch(ctx);
+                    ctx.batch_link = lnk;
+                    lctx.batch_handler = &handler;
+                }
+                lctx.batch_settled.push_back(make_wrapper<tracker>(dlv));
+                return;
             }
+            // Trackers settled before this update come first
+            if (ctx.batch_link == lnk) flush_batch(ctx);
+            if (handles(handler, ON_TRACKER_ACCEPT | ON_TRACKER_REJECT | ON_TRACKER_RELEASE | ON_TRACKER_SETTLE)) {
+                tracker t(make_wrapper<tracker>(dlv));
+                uint64_t rstate = pn_delivery_remote_state(dlv);
+                if (rstate == PN_ACCEPTED) {
+                    if (handles(handler, ON_TRACKER_ACCEPT)) handler.on_tracker_accept(t);
+                }
+                else if (rstate == PN_REJECTED) {
+                    if (handles(handler, ON_TRACKER_REJECT)) handler.on_tracker_reject(t);
+                }
+                else if (rstate == PN_RELEASED || rstate == PN_MODIFIED) {
+                    if (handles(handler, ON_TRACKER_RELEASE)) handler.on_tracker_release(t);
+                }
 
-            if (t.settled()) {
-                handler.on_tracker_settle(t);
+                if (t.settled() && handles(handler, ON_TRACKER_SETTLE)) {
+                    handler.on_tracker_settle(t);
+                }
             }
             if (lctx.auto_settle)
-                t.settle();
+                pn_delivery_settle(dlv);
         }
     }
 }
@@ -180,12 +515,33 @@ bool is_remote_unititialised(pn_state_t state) {
     return state & PN_REMOTE_UNINIT;
 }
 
+// The transaction in progress, if any, fails with the coordinator
+void on_coordinator_close(messaging_handler& handler, pn_link_t *lnk) {
+    pn_session_t *s = pn_link_session(lnk);
+    session_context& ctx = session_context::get(s);
+    if (ctx.coordinator == lnk) ctx.coordinator = 0;
+    if (ctx.txn_request || !ctx.txn_id.empty()) {
+        ctx.txn_request = 0;
+        ctx.txn_discharge = false;
+        ctx.txn_id.clear();
+        ctx.txn_error = make_wrapper(pn_link_remote_condition(lnk));
+        if (ctx.txn_error.empty())
+            ctx.txn_error = error_condition("amqp:transaction:rollback", "transaction coordinator closed");
+        transaction t(s);
+        handler.on_transaction_error(t);
+    }
+}
+
 void on_link_remote_detach(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
-    if (pn_link_is_receiver(lnk)) {
-        receiver r(make_wrapper<receiver>(lnk));
-        handler.on_receiver_detach(r);
-    } else {
+    if (is_coordinator(lnk)) {
+        on_coordinator_close(handler, lnk);
+    } else if (pn_link_is_receiver(lnk)) {
+        if (handles(handler, ON_RECEIVER_DETACH)) {
+            receiver r(make_wrapper<receiver>(lnk));
+            handler.on_receiver_detach(r);
+        }
+    } else if (handles(handler, ON_SENDER_DETACH)) {
         sender s(make_wrapper<sender>(lnk));
         handler.on_sender_detach(s);
     }
@@ -194,18 +550,22 @@ void on_link_remote_detach(messaging_handler& handler, pn_event_t* event) {
 
 void on_link_remote_close(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
-    if (pn_link_is_receiver(lnk)) {
+    if (is_coordinator(lnk)) {
+        on_coordinator_close(handler, lnk);
+    } else if (pn_link_is_receiver(lnk)) {
         receiver r(make_wrapper<receiver>(lnk));
         if (pn_condition_is_set(pn_link_remote_condition(lnk))) {
             handler.on_receiver_error(r);
         }
-        handler.on_receiver_close(r);
+        if (handles(handler, ON_RECEIVER_CLOSE))
+            handler.on_receiver_close(r);
     } else {
         sender s(make_wrapper<sender>(lnk));
         if (pn_condition_is_set(pn_link_remote_condition(lnk))) {
             handler.on_sender_error(s);
         }
-        handler.on_sender_close(s);
+        if (handles(handler, ON_SENDER_CLOSE))
+            handler.on_sender_close(s);
     }
     pn_link_close(lnk);
 }
@@ -216,7 +576,8 @@ void on_session_remote_close(messaging_handler& handler, pn_event_t* event) {
     if (pn_condition_is_set(pn_session_remote_condition(session))) {
         handler.on_session_error(s);
     }
-    handler.on_session_close(s);
+    if (handles(handler, ON_SESSION_CLOSE))
+        handler.on_session_close(s);
     pn_session_close(session);
 }
 
@@ -236,14 +597,17 @@ void on_connection_remote_close(messaging_handler& handler, pn_event_t* event) {
     if (pn_condition_is_set(cond)) {
         handler.on_connection_error(c);
     }
-    handler.on_connection_close(c);
+    if (handles(handler, ON_CONNECTION_CLOSE))
+        handler.on_connection_close(c);
     pn_connection_close(conn);
 }
 
 void on_connection_remote_open(messaging_handler& handler, pn_event_t* event) {
     // Generate on_transport_open event here until we find a better place
-    transport t(make_wrapper(pn_event_transport(event)));
-    handler.on_transport_open(t);
+    if (handles(handler, ON_TRANSPORT_OPEN)) {
+        transport t(make_wrapper(pn_event_transport(event)));
+        handler.on_transport_open(t);
+    }
 
     pn_connection_t *conn = pn_event_connection(event);
     connection c(make_wrapper(conn));
@@ -261,7 +625,8 @@ void on_link_local_open(messaging_handler& handler, pn_event_t* event) {
     if ( pn_link_is_receiver(lnk) ) {
         credit_topup(lnk);
     // We know local is active so don't check for it
-    } else if ( pn_link_state(lnk)&PN_REMOTE_ACTIVE && pn_link_credit(lnk) > 0) {
+    } else if ( pn_link_state(lnk)&PN_REMOTE_ACTIVE && pn_link_credit(lnk) > 0 && !is_coordinator(lnk) &&
+                !output_blocked(lnk) && handles(handler, ON_SENDABLE)) {
         sender s(make_wrapper<sender>(lnk));
         handler.on_sendable(s);
     }
@@ -273,7 +638,7 @@ void on_link_remote_open(messaging_handler& handler, pn_event_t* event) {
       receiver r(make_wrapper<receiver>(lnk));
       handler.on_receiver_open(r);
       credit_topup(lnk);
-    } else {
+    } else if (!is_coordinator(lnk)) {
       sender s(make_wrapper<sender>(lnk));
       handler.on_sender_open(s);
     }
@@ -286,14 +651,15 @@ void on_transport_closed(messaging_handler& handler, pn_event_t* event) {
     // If the connection isn't open generate on_transport_open event
     // because we didn't generate it yet and the events won't match.
     pn_connection_t *conn = pn_event_connection(event);
-    if (!conn || is_remote_unititialised(pn_connection_state(conn))) {
+    if ((!conn || is_remote_unititialised(pn_connection_state(conn))) && handles(handler, ON_TRANSPORT_OPEN)) {
         handler.on_transport_open(t);
     }
 
     if (pn_condition_is_set(pn_transport_condition(tspt))) {
         handler.on_transport_error(t);
     }
-    handler.on_transport_close(t);
+    if (handles(handler, ON_TRANSPORT_CLOSE))
+        handler.on_transport_close(t);
 }
 
 }
@@ -302,6 +668,14 @@ void messaging_adapter::dispatch(messaging_handler& handler, pn_event_t* event)
 {
     pn_event_type_t type = pn_event_type(event);
 
+    // Any other event ends a batch of messages
+    pn_connection_t *c = pn_event_connection(event);
+    if (c) {
+        connection_context& ctx = connection_context::get(c);
+        if (ctx.batch_link && !(type == PN_DELIVERY && pn_event_link(event) == ctx.batch_link))
+            flush_batch(ctx);
+    }
+
     // Only handle events we are interested in
     switch(type) {
 
@@ -319,11 +693,50 @@ void messaging_adapter::dispatch(messaging_handler& handler, pn_event_t* event)
 
       case PN_DELIVERY: on_delivery(handler, event); break;
 
-      case PN_TRANSPORT_CLOSED: on_transport_closed(handler, event); break;
+      case PN_TRANSPORT_CLOSED:
+#if PN_CPP_SUPPORTS_THREADS
+        // Outcomes of handed deliveries can't reach the peer any more
+        if (c && connection_context::get(c).handoff) {
+            connection_context::get(c).handoff->clear();
+            drop_waiting(connection_context::get(c), c);
+        }
+#endif
+        on_transport_closed(handler, event);
+        break;
 
       // Ignore everything else
       default: break;
     }
 }
 
+namespace {
+const pn_event_type_t wanted_events[] = {
+    PN_CONNECTION_INIT, PN_CONNECTION_BOUND, PN_CONNECTION_WAKE,
+    PN_CONNECTION_REMOTE_OPEN, PN_CONNECTION_REMOTE_CLOSE,
+    PN_SESSION_REMOTE_OPEN, PN_SESSION_REMOTE_CLOSE,
+    PN_LINK_LOCAL_OPEN, PN_LINK_REMOTE_OPEN, PN_LINK_REMOTE_CLOSE, PN_LINK_REMOTE_DETACH,
+    PN_LINK_FLOW, PN_DELIVERY, PN_TRANSPORT_CLOSED
+};
+}
+
+void messaging_adapter::flush(pn_connection_t* c)
+{
+    if (!c) return;
+    connection_context& ctx = connection_context::get(c);
+    flush_batch(ctx);
+#if PN_CPP_SUPPORTS_THREADS
+    settle_handed(ctx);
+    if (ctx.handoff) retry_waiting(ctx, c);
+#endif
+}
+
+void messaging_adapter::want_events(pn_collector_t* collector)
+{
+    if (!collector) return;
+    pn_collector_set_wanted(collector, PN_EVENT_NONE, false);
+    for (size_t i = 0; i < sizeof(wanted_events)/sizeof(wanted_events[0]); ++i) {
+        pn_collector_set_wanted(collector, wanted_events[i], true);
+    }
+}
+
 }
@@ -19,15 +19,18 @@
 
 #include "proactor_container_impl.hpp"
 #include "proactor_work_queue_impl.hpp"
+#include "mpsc_queue.hpp"
 
 #include "proton/error_condition.hpp"
 #include "proton/function.hpp"
 #include "proton/listener.hpp"
 #include "proton/listen_handler.hpp"
+#include "proton/reconnect_timer.hpp"
 #include "proton/thread_safe.hpp"
 #include "proton/url.hpp"
 
 #include "proton/connection.h"
+#include "proton/link.h"
 #include "proton/listener.h"
 #include "proton/proactor.h"
 #include "proton/transport.h"
@@ -37,10 +40,16 @@
 #include "proton_bits.hpp"
 
 #include <assert.h>
+#include <string.h>
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
+#if PN_CPP_HAS_CHRONO
+# include <chrono>
+#endif
+
 #if PN_CPP_SUPPORTS_THREADS
 # include <thread>
 #endif
@@ -49,53 +58,49 @@ namespace proton {
 
 class container::impl::common_work_queue : public work_queue::impl {
   public:
-    common_work_queue(container::impl& c): container_(c), finished_(false), running_(false) {}
+    common_work_queue(container::impl& c, size_t capacity):
+        container_(c), jobs_(capacity), finished_(false), running_(false) {}
 
     typedef std::vector<work> jobs;
 
     void run_all_jobs();
-    void finished() { GUARD(lock_); finished_ = true; }
-    void schedule(duration, work);
+    void finished() { finished_ = true; }
+    work_queue::timer_id schedule(duration, work);
+    bool cancel(work_queue::timer_id t) { return container_.cancel(t); }
+    // Move all queued work to j, only from the one thread running this queue
+    void take_jobs(jobs& j) { jobs_.drain(j, std::numeric_limits<size_t>::max()); }
+    bool has_jobs() const { return !jobs_.empty(); }
 
-    MUTEX(lock_)
     container::impl& container_;
-    jobs jobs_;
-    bool finished_;
-    bool running_;
+    mpsc_queue<work> jobs_;
+    ATOMIC_BOOL(finished_)
+    bool running_;              // Only touched by the thread running this queue
 };
 
-void container::impl::common_work_queue::schedule(duration d, work f) {
-    // Note this is an unbounded work queue.
-    // A resource-safe implementation should be bounded.
-    if (finished_) return;
-    container_.schedule(d, make_work(&work_queue::impl::add, (work_queue::impl*)this, f));
+work_queue::timer_id container::impl::common_work_queue::schedule(duration d, work f) {
+    if (finished_) return 0;
+    return container_.schedule(d, make_work(&work_queue::impl::add, (work_queue::impl*)this, f));
 }
 
 void container::impl::common_work_queue::run_all_jobs() {
+    // Checked on every event of a connection, usually with nothing to do
+    if (running_ || !has_jobs()) return;
+    // Never run work from this queue re-entrantly
+    running_ = true;
+    // Jobs added while these run wait for the next turn
     jobs j;
-    // Lock this operation for mt
-    {
-        GUARD(lock_);
-        // Ensure that we never run work from this queue concurrently
-        if (running_) return;
-        running_ = true;
-        // But allow adding to the queue concurrently to running
-        std::swap(j, jobs_);
-    }
+    take_jobs(j);
     // Run queued work, but ignore any exceptions
     for (jobs::iterator f = j.begin(); f != j.end(); ++f) try {
         (*f)();
     } catch (...) {};
-    {
-        GUARD(lock_);
-        running_ = false;
-    }
-    return;
+    running_ = false;
 }
 
 class container::impl::connection_work_queue : public common_work_queue {
   public:
-    connection_work_queue(container::impl& ct, pn_connection_t* c): common_work_queue(ct), connection_(c) {}
+    connection_work_queue(container::impl& ct, pn_connection_t* c, size_t capacity):
+        common_work_queue(ct, capacity), connection_(c) {}
 
     bool add(work f);
 
@@ -103,58 +108,108 @@ class container::impl::connection_work_queue : public common_work_queue {
 };
 
 bool container::impl::connection_work_queue::add(work f) {
-    // Note this is an unbounded work queue.
-    // A resource-safe implementation should be bounded.
-    GUARD(lock_);
-    if (finished_) return false;
-    jobs_.push_back(f);
+    if (finished_ || !jobs_.push(MOVE(f))) return false;
     pn_connection_wake(connection_);
     return true;
 }
 
 class container::impl::container_work_queue : public common_work_queue {
   public:
-    container_work_queue(container::impl& c): common_work_queue(c) {}
+    container_work_queue(container::impl& c, size_t capacity): common_work_queue(c, capacity), scheduled_(false) {}
     ~container_work_queue() { container_.remove_work_queue(this); }
 
     bool add(work f);
+
+    // Ready or running on some thread, guarded by work_queues_lock_
+    bool scheduled_;
 };
 
 bool container::impl::container_work_queue::add(work f) {
-    // Note this is an unbounded work queue.
-    // A resource-safe implementation should be bounded.
-    GUARD(lock_);
-    if (finished_) return false;
-    jobs_.push_back(f);
-    pn_proactor_set_timeout(container_.proactor_, 0);
+    if (finished_ || !jobs_.push(MOVE(f))) return false;
+    container_.work_queue_ready(this);
     return true;
 }
 
-class work_queue::impl* container::impl::make_work_queue(container& c) {
-    return c.impl_->add_work_queue();
+class work_queue::impl* container::impl::make_work_queue(container& c, size_t capacity) {
+    return c.impl_->add_work_queue(capacity);
 }
 
 container::impl::impl(container& c, const std::string& id, messaging_handler* mh)
-    : threads_(0), container_(c), proactor_(pn_proactor()), handler_(mh), id_(id),
-      auto_stop_(true), stopping_(false)
+    : threads_(0), container_(c), timers_(timestamp::now()), armed_(false),
+      thread_handlers_(0), nthread_handlers_(0), next_home_(0),
+      proactor_(pn_proactor()), handler_(mh), id_(id),
+      auto_stop_(true), stopping_(false), share_connections_(false)
 {}
 
 container::impl::~impl() {
+    // Connections released to reconnect belong to no proactor
+    for (std::set<pn_connection_t*>::iterator i = reconnecting_.begin(); i != reconnecting_.end(); ++i)
+        pn_connection_free(*i);
     pn_proactor_free(proactor_);
+    delete[] thread_handlers_;
 }
 
-container::impl::container_work_queue* container::impl::add_work_queue() {
-    container_work_queue* c = new container_work_queue(*this);
+container::impl::container_work_queue* container::impl::add_work_queue(size_t capacity) {
+    container_work_queue* c = new container_work_queue(*this, capacity);
+    GUARD(work_queues_lock_);
     work_queues_.insert(c);
     return c;
 }
 
 void container::impl::remove_work_queue(container::impl::container_work_queue* l) {
+    GUARD(work_queues_lock_);
     work_queues_.erase(l);
+    ready_work_queues_.remove(l);
+}
+
+// Each PN_PROACTOR_TIMEOUT hands one ready queue to the thread that got
+// it, and re-arms the timeout so another thread picks up the next.
+void container::impl::work_queue_ready(container::impl::container_work_queue* q) {
+    GUARD(work_queues_lock_);
+    if (q->scheduled_) return; // Already waiting, or its jobs are running
+    q->scheduled_ = true;
+    ready_work_queues_.push_back(q);
+    wake_timeout();
+}
+
+container::impl::container_work_queue* container::impl::take_ready_work_queue(std::vector<work>& jobs) {
+    GUARD(work_queues_lock_);
+    if (ready_work_queues_.empty()) return 0;
+    container_work_queue* q = ready_work_queues_.front();
+    ready_work_queues_.pop_front();
+    q->take_jobs(jobs);
+    if (!ready_work_queues_.empty()) wake_timeout();
+    return q;
+}
+
+void container::impl::ready_work_queue_done(container::impl::container_work_queue* q) {
+    GUARD(work_queues_lock_);
+    if (!work_queues_.count(q)) return; // Deleted while its jobs ran
+    if (q->has_jobs()) {
+        ready_work_queues_.push_back(q);
+        wake_timeout();
+    } else {
+        q->scheduled_ = false;
+    }
+}
+
+namespace {
+// The pn_proactor_connect()/listen() address of a URL
+std::string proactor_addr(const proton::url& url) {
+    std::string host = url.host(), port = url.port();
+    // Figure out correct string len then create connection address
+    int len = pn_proactor_addr(0, 0, host.c_str(), port.c_str());
+    std::vector<char> caddr(len+1);
+    pn_proactor_addr(&caddr[0], len+1, host.c_str(), port.c_str());
+    return std::string(&caddr[0], len);
+}
 }
 
+// The URL is parsed once by the caller, reconnect only needs the
+// proactor addresses which are kept on the connection context.
 proton::connection container::impl::connect_common(
     const std::string& addr,
+    const proton::url& url,
     const proton::connection_options& user_opts)
 {
     if (stopping_)
@@ -164,71 +219,162 @@ proton::connection container::impl::connect_common(
     opts.update(user_opts);
     messaging_handler* mh = opts.handler();
 
-    proton::url url(addr);
     pn_connection_t *pnc = pn_connection();
     connection_context& cc(connection_context::get(pnc));
     cc.container = &container_;
     cc.handler = mh;
-    cc.work_queue_ = new container::impl::connection_work_queue(*container_.impl_, pnc);
+    cc.work_queue_ = new container::impl::connection_work_queue(*container_.impl_, pnc, opts.work_queue_capacity());
+    cc.home = home_for_new_connection();
 
     pn_connection_set_container(pnc, id_.c_str());
     pn_connection_set_hostname(pnc, url.host().c_str());
-    if (!url.user().empty())
-        pn_connection_set_user(pnc, url.user().c_str());
-    if (!url.password().empty())
-        pn_connection_set_password(pnc, url.password().c_str());
+    std::string user = url.user();
+    if (!user.empty())
+        pn_connection_set_user(pnc, user.c_str());
+    std::string password = url.password();
+    if (!password.empty())
+        pn_connection_set_password(pnc, password.c_str());
 
     connection conn = make_wrapper(pnc);
     conn.open(opts);
-    // Figure out correct string len then create connection address
-    int len = pn_proactor_addr(0, 0, url.host().c_str(), url.port().c_str());
-    std::vector<char> caddr(len+1);
-    pn_proactor_addr(&caddr[0], len+1, url.host().c_str(), url.port().c_str());
-    pn_proactor_connect(proactor_, pnc, &caddr[0]);
+    std::string caddr = proactor_addr(url);
+    if (cc.reconnect) {
+        cc.reconnect_urls.push_back(addr);
+        cc.reconnect_addrs.push_back(caddr);
+        std::vector<std::string> failover = opts.failover_urls();
+        for (std::vector<std::string>::const_iterator i = failover.begin(); i != failover.end(); ++i) {
+            cc.reconnect_urls.push_back(*i);
+            cc.reconnect_addrs.push_back(proactor_addr(proton::url(*i)));
+        }
+    }
+    connect_to(pnc, caddr);
     return conn;
 }
 
+void container::impl::connect_to(pn_connection_t* pnc, const std::string& caddr) {
+    pn_proactor_connect(proactor_, pnc, caddr.c_str());
+}
+
+// Called for PN_TRANSPORT_CLOSED. If the connection is still open and may
+// reconnect, take it back from the proactor and schedule the next attempt
+// on the healthiest URL. Its sessions, links and credit are kept, and sent
+// together once the new transport is bound.
+bool container::impl::start_reconnect(pn_connection_t* c) {
+    connection_context& cc = connection_context::get(c);
+    if (!cc.reconnect || cc.listener_context_ || cc.reconnect_urls.empty() ||
+        !(pn_connection_state(c) & PN_LOCAL_ACTIVE))
+        return false;
+    GUARD(lock_);
+    if (stopping_) return false;
+    int delay = cc.reconnect->next_delay(timestamp::now());
+    if (delay < 0) return false;
+
+    ++url_failures_[cc.reconnect_urls[cc.reconnect_url]];
+    size_t n = cc.reconnect_urls.size();
+    size_t best = (cc.reconnect_url + 1) % n;
+    int best_failures = url_failures_[cc.reconnect_urls[best]];
+    for (size_t i = 2; i <= n; ++i) { // In order after the URL that failed
+        size_t j = (cc.reconnect_url + i) % n;
+        int failures = url_failures_[cc.reconnect_urls[j]];
+        if (failures < best_failures) {
+            best = j;
+            best_failures = failures;
+        }
+    }
+    cc.reconnect_url = best;
+    pn_proactor_release_connection(c);
+    reconnecting_.insert(c);
+    schedule(duration(delay), make_work(&container::impl::reconnect, this, c));
+    return true;
+}
+
+void container::impl::reconnect(pn_connection_t* c) {
+    {
+        GUARD(lock_);
+        reconnecting_.erase(c);
+        if (stopping_) {
+            pn_connection_free(c);
+            return;
+        }
+    }
+    connection_context& cc = connection_context::get(c);
+    connect_to(c, cc.reconnect_addrs[cc.reconnect_url]);
+}
+
 proton::returned<proton::connection> container::impl::connect(
     const std::string& addr,
     const proton::connection_options& user_opts)
 {
-    connection conn = connect_common(addr, user_opts);
+    connection conn = connect_common(addr, proton::url(addr), user_opts);
     GUARD(lock_);
     return make_thread_safe(conn);
 }
 
+// A connection to the URL this thread can share, or a new one
+connection container::impl::shared_connection(const std::string& addr, const proton::url& u, const connection_options& opts) {
+    if (!share_connections_ || !opts.empty())
+        return connect_common(addr, u, opts);
+    std::string key = u.scheme() + "://" + u.user() + ":" + u.password() + "@" + u.host() + ":" + u.port();
+    bool recorded = false;
+    {
+        GUARD(lock_);
+        connection_map::iterator i = shared_connections_.find(key);
+        if (i != shared_connections_.end()) {
+            pn_connection_t* c = i->second;
+            if (pn_connection_state(c) & (PN_LOCAL_CLOSED | PN_REMOTE_CLOSED))
+                shared_connections_.erase(i);
+            else if (can_share(c))
+                return make_wrapper(c);
+            else
+                recorded = true;
+        }
+    }
+    connection conn = connect_common(addr, u, opts);
+    if (!recorded) {
+        GUARD(lock_);
+        shared_connections_.insert(std::make_pair(key, unwrap(conn)));
+    }
+    return conn;
+}
+
+void container::impl::unshare(pn_connection_t* c) {
+    GUARD(lock_);
+    for (connection_map::iterator i = shared_connections_.begin(); i != shared_connections_.end(); ++i) {
+        if (i->second == c) {
+            shared_connections_.erase(i);
+            return;
+        }
+    }
+}
+
 returned<sender> container::impl::open_sender(const std::string &url, const proton::sender_options &o1, const connection_options &o2) {
     proton::sender_options lopts(sender_options_);
     lopts.update(o1);
-    connection conn = connect_common(url, o2);
+    proton::url u(url);
+    connection conn = shared_connection(url, u, o2);
 
     GUARD(lock_);
-    return make_thread_safe(conn.default_session().open_sender(proton::url(url).path(), lopts));
+    return make_thread_safe(conn.default_session().open_sender(u.path(), lopts));
 }
 
 returned<receiver> container::impl::open_receiver(const std::string &url, const proton::receiver_options &o1, const connection_options &o2) {
     proton::receiver_options lopts(receiver_options_);
     lopts.update(o1);
-    connection conn = connect_common(url, o2);
+    proton::url u(url);
+    connection conn = shared_connection(url, u, o2);
 
     GUARD(lock_);
     return make_thread_safe(
-        conn.default_session().open_receiver(proton::url(url).path(), lopts));
+        conn.default_session().open_receiver(u.path(), lopts));
 }
 
 pn_listener_t* container::impl::listen_common_lh(const std::string& addr) {
     if (stopping_)
         throw proton::error("container is stopping");
 
-    proton::url url(addr);
-
-    // Figure out correct string len then create connection address
-    int len = pn_proactor_addr(0, 0, url.host().c_str(), url.port().c_str());
-    std::vector<char> caddr(len+1);
-    pn_proactor_addr(&caddr[0], len+1, url.host().c_str(), url.port().c_str());
-
+    std::string caddr = proactor_addr(proton::url(addr));
     pn_listener_t* listener = pn_listener();
-    pn_proactor_listen(proactor_, listener, &caddr[0], 16);
+    pn_proactor_listen(proactor_, listener, caddr.c_str(), 16);
     return listener;
 }
 
@@ -254,18 +400,36 @@ proton::listener container::impl::listen(const std::string& addr, proton::listen
     return proton::listener(listener);
 }
 
-void container::impl::schedule(duration delay, work f) {
-    GUARD(lock_);
-    timestamp now = timestamp::now();
+timer_wheel::id container::impl::schedule(duration delay, work f) {
+    GUARD(timers_lock_);
+    timer_wheel::id t = timers_.add(timestamp::now()+delay, MOVE(f));
+    arm_timeout_lh();
+    return t;
+}
 
-    // Record timeout; Add callback to timeout sorted list
-    scheduled s = {now+delay, f};
-    deferred_.push_back(s);
-    std::push_heap(deferred_.begin(), deferred_.end());
+bool container::impl::cancel(timer_wheel::id t) {
+    // The proactor timeout is left alone, waking early does no harm
+    GUARD(timers_lock_);
+    return timers_.cancel(t);
+}
+
+// Only move the proactor timeout earlier, unless it has fired
+void container::impl::arm_timeout_lh() {
+    timestamp next;
+    if (!timers_.next(next)) return;
+    if (armed_ && !(next < armed_at_)) return;
+    armed_ = true;
+    armed_at_ = next;
+    duration::numeric_type ms = (next - timestamp::now()).milliseconds();
+    pn_proactor_set_timeout(proactor_, ms > 0 ? ms : 0);
+}
 
-    // Set timeout for current head of timeout queue
-    scheduled* next = &deferred_.front();
-    pn_proactor_set_timeout(proactor_, (next->time-now).milliseconds());
+// Get a PN_PROACTOR_TIMEOUT as soon as possible
+void container::impl::wake_timeout() {
+    GUARD(timers_lock_);
+    armed_ = true;
+    armed_at_ = timestamp::now();
+    pn_proactor_set_timeout(proactor_, 0);
 }
 
 void container::impl::client_connection_options(const connection_options &opts) {
@@ -289,25 +453,177 @@ void container::impl::receiver_options(const proton::receiver_options &opts) {
 }
 
 void container::impl::run_timer_jobs() {
-    // Check head of timer queue
-    timestamp now = timestamp::now();
-    scheduled* next = &deferred_.front();
-
-    // So every scheduled element that has past run and remove head
-    while ( next->time<=now ) {
-        next->task();
-        std::pop_heap(deferred_.begin(), deferred_.end());
-        deferred_.pop_back();
-        // If there are no more scheduled items finish now
-        if  ( deferred_.size()==0 ) return;
-        next = &deferred_.front();
-    };
+    std::vector<work> due;
+    {
+        GUARD(timers_lock_);
+        // The timeout has fired, the next deadline must be set again
+        armed_ = false;
+        timers_.expire(timestamp::now(), due);
+        arm_timeout_lh();
+    }
+    // Run expired work without holding the lock, it may schedule more
+    for (std::vector<work>::iterator f = due.begin(); f != due.end(); ++f)
+        (*f)();
+}
 
-    // To get here we know we must have at least one more thing scheduled
-    pn_proactor_set_timeout(proactor_, (next->time-now).milliseconds());
+namespace {
+int64_t now_micros() {
+#if PN_CPP_HAS_CHRONO
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return timestamp::now().milliseconds() * 1000;
+#endif
+}
+
+// Add the change from old to now to a counter that may go down
+template <class T> void add_change(T& counter, uint64_t& old, uint64_t now) {
+    if (now >= old) counter += now - old;
+    else counter -= old - now;
+    old = now;
+}
+}
+
+container::impl::counters::counters() {
+    connections = 0; connections_opened = 0; links = 0;
+    deliveries_input = 0; deliveries_output = 0;
+    bytes_input = 0; bytes_output = 0; frames_input = 0; frames_output = 0;
+    memory = 0; pool_hits = 0; pool_misses = 0;
+    batches = 0; batch_time = 0;
+    for (int i = 0; i < 6; ++i) batch_latency[i] = 0;
+}
+
+container_stats container::impl::stats() {
+    container_stats s;
+    s.connections = counters_.connections;
+    s.connections_opened = counters_.connections_opened;
+    s.links = counters_.links;
+    s.deliveries_input = counters_.deliveries_input;
+    s.deliveries_output = counters_.deliveries_output;
+    s.bytes_input = counters_.bytes_input;
+    s.bytes_output = counters_.bytes_output;
+    s.frames_input = counters_.frames_input;
+    s.frames_output = counters_.frames_output;
+    s.memory = counters_.memory;
+    s.delivery_pool_hits = counters_.pool_hits;
+    s.delivery_pool_misses = counters_.pool_misses;
+    s.batches = counters_.batches;
+    s.batch_time = counters_.batch_time;
+    for (int i = 0; i < 6; ++i) s.batch_latency[i] = counters_.batch_latency[i];
+    {
+        GUARD(work_queues_lock_);
+        s.ready_work_queues = ready_work_queues_.size();
+    }
+    {
+        GUARD(timers_lock_);
+        s.timers = timers_.size();
+    }
+    return s;
+}
+
+// Add what a connection did since it was last accounted for, on the
+// thread handling its events
+void container::impl::account(pn_connection_t* c) {
+    connection_context& cc = connection_context::get(c);
+    if (!cc.counted) return;
+    reported_stats& r = cc.reported;
+    pn_transport_t* t = pn_connection_transport(c);
+    if (t) {
+        pn_transport_stats_t ts;
+        pn_transport_stats(t, &ts);
+        add_change(counters_.deliveries_input, r.deliveries_input, ts.deliveries_input);
+        add_change(counters_.deliveries_output, r.deliveries_output, ts.deliveries_output);
+        add_change(counters_.bytes_input, r.bytes_input, ts.bytes_input);
+        add_change(counters_.bytes_output, r.bytes_output, ts.bytes_output);
+        add_change(counters_.frames_input, r.frames_input, ts.frames_input);
+        add_change(counters_.frames_output, r.frames_output, ts.frames_output);
+    }
+    add_change(counters_.pool_hits, r.pool_hits, pn_connection_get_delivery_pool_hits(c));
+    add_change(counters_.pool_misses, r.pool_misses, pn_connection_get_delivery_pool_misses(c));
+    add_change(counters_.memory, r.memory, pn_connection_memory_usage(c));
+}
+
+// A new transport counts from 0 again
+void container::impl::account_bound(pn_connection_t* c) {
+    connection_context& cc = connection_context::get(c);
+    reported_stats& r = cc.reported;
+    r.deliveries_input = r.deliveries_output = r.bytes_input = r.bytes_output = 0;
+    r.frames_input = r.frames_output = 0;
+    ++counters_.connections_opened;
+    if (!cc.counted) {
+        cc.counted = true;
+        ++counters_.connections;
+    }
+}
+
+// The connection is finished, what it holds is no longer counted
+void container::impl::account_closed(pn_connection_t* c) {
+    connection_context& cc = connection_context::get(c);
+    if (!cc.counted) return;
+    uint64_t none = 0;
+    add_change(counters_.memory, cc.reported.memory, none);
+    add_change(counters_.links, cc.reported.links, none);
+    --counters_.connections;
+    cc.counted = false;
+}
+
+void container::impl::account_batch(int64_t micros) {
+    ++counters_.batches;
+    counters_.batch_time += uint64_t(micros);
+    int bucket = 0;
+    for (int64_t limit = 10; bucket < 5 && micros >= limit; limit *= 10) ++bucket;
+    ++counters_.batch_latency[bucket];
+}
+
+#if PN_CPP_SUPPORTS_THREADS
+namespace {
+// The container and per-thread handler of a container thread, and the
+// connection whose events it is handling
+thread_local struct { const void* container; int home; pn_connection_t* connection; } thread_home = { 0, -1, 0 };
+}
+#endif
+
+// True if no other thread can be using c while this one does
+bool container::impl::can_share(pn_connection_t* c) {
+#if PN_CPP_SUPPORTS_THREADS
+    if (thread_home.container == this && thread_home.connection == c) return true;
+    return threads_ == 0 || (threads_ == 1 && thread_home.container == this);
+#else
+    (void)c;
+    return true;
+#endif
+}
+
+// The thread's own handler if the connection is opened on a container
+// thread, which is also where the proactor polls it. Otherwise take turns.
+int container::impl::home_for_new_connection() {
+    if (!nthread_handlers_) return -1;
+#if PN_CPP_SUPPORTS_THREADS
+    if (thread_home.container == this && thread_home.home >= 0) return thread_home.home;
+#endif
+    return int(unsigned(next_home_++) % unsigned(nthread_handlers_));
 }
 
 bool container::impl::handle(pn_event_t* event) {
+    pn_connection_t* c = pn_event_connection(event);
+    int home = c ? connection_context::get(c).home : -1;
+    if (home < 0) return dispatch(event, handler_);
+    thread_handler& th = thread_handlers_[home];
+    GUARD(th.lock);
+    return dispatch(event, th.handler);
+}
+
+// Deliver batched messages at the end of a connection's event batch
+void container::impl::flush(pn_connection_t* c) {
+    int home = connection_context::get(c).home;
+    if (home < 0) return messaging_adapter::flush(c);
+    thread_handler& th = thread_handlers_[home];
+    GUARD(th.lock);
+    messaging_adapter::flush(c);
+}
+
+// Handle event, default_handler gets anything without a more specific handler
+bool container::impl::dispatch(pn_event_t* event, messaging_handler* default_handler) {
 
     // If we have any pending connection work, do it now
     pn_connection_t* c = pn_event_connection(event);
@@ -331,18 +647,10 @@ bool container::impl::handle(pn_event_t* event) {
         return true;
 
     case PN_PROACTOR_TIMEOUT: {
-        GUARD(lock_);
         // Can get an immediate timeout, if we have a container event loop inject
-        if  ( deferred_.size()>0 ) {
-            run_timer_jobs();
-        }
-
-        // Run every container event loop job
-        // This is not at all efficient and single threads all these jobs, but it does correctly
-        // serialise them
-        for (work_queues::iterator loop = work_queues_.begin(); loop!=work_queues_.end(); ++loop) {
-            (*loop)->run_all_jobs();
-        }
+        run_timer_jobs();
+        // Container work queue jobs are run by thread() once the
+        // proactor is free to hand the next timeout to another thread
         return false;
     }
     case PN_LISTENER_OPEN:
@@ -365,7 +673,8 @@ bool container::impl::handle(pn_event_t* event) {
         cc.container = &container_;
         cc.listener_context_ = &lc;
         cc.handler = opts.handler();
-        cc.work_queue_ = new container::impl::connection_work_queue(*container_.impl_, c);
+        cc.work_queue_ = new container::impl::connection_work_queue(*container_.impl_, c, opts.work_queue_capacity());
+        cc.home = home_for_new_connection();
         pn_listener_accept(l, c);
         return false;
     }
@@ -386,13 +695,67 @@ bool container::impl::handle(pn_event_t* event) {
     case PN_CONNECTION_WAKE:
         return false;
 
+    // The connection is finished unless it reconnects, either way a
+    // new one will be made for its URL
+    case PN_TRANSPORT_CLOSED: {
+        pn_connection_t* c = pn_event_connection(event);
+        unshare(c);
+        account(c);
+        if (start_reconnect(c)) return false;
+        account_closed(c);
+        break;
+    }
+
+    case PN_LINK_LOCAL_OPEN: {
+        ++counters_.links;
+        ++connection_context::get(pn_event_connection(event)).reported.links;
+        break;
+    }
+
+    case PN_LINK_REMOTE_CLOSE:
+    case PN_LINK_REMOTE_DETACH: {
+        reported_stats& r = connection_context::get(pn_event_connection(event)).reported;
+        if (!(pn_link_state(pn_event_link(event)) & PN_LOCAL_UNINIT) && r.links) {
+            --counters_.links;
+            --r.links;
+        }
+        break;
+    }
+
+    // The peer wants the connection moved: the messaging_adapter hides
+    // the close, ending the transport here starts the reconnect
+    case PN_CONNECTION_REMOTE_CLOSE: {
+        pn_connection_t* c = pn_event_connection(event);
+        pn_condition_t* cond = pn_connection_remote_condition(c);
+        if (connection_context::get(c).reconnect && pn_condition_is_set(cond) &&
+            !strcmp(pn_condition_get_name(cond), "amqp:connection:forced")) {
+            pn_transport_t* t = pn_event_transport(event);
+            pn_transport_close_tail(t);
+            pn_transport_close_head(t);
+        }
+        break;
+    }
+
+    case PN_CONNECTION_REMOTE_OPEN: {
+        connection_context& cc = connection_context::get(pn_event_connection(event));
+        if (cc.reconnect && !cc.reconnect_urls.empty()) {
+            cc.reconnect->reset();
+            GUARD(lock_);
+            url_failures_.erase(cc.reconnect_urls[cc.reconnect_url]);
+        }
+        break;
+    }
+
     // Connection driver will bind a new transport to the connection at this point
     case PN_CONNECTION_INIT:
+        // Stop the engine generating events nothing here will handle
+        messaging_adapter::want_events(pn_connection_collector(pn_event_connection(event)));
         return false;
 
     case PN_CONNECTION_BOUND: {
         // Need to apply post bind connection options
         pn_connection_t* c = pn_event_connection(event);
+        account_bound(c);
         connection conn = make_wrapper(c);
         connection_context& cc = connection_context::get(c);
         if (cc.listener_context_) {
@@ -422,8 +785,8 @@ bool container::impl::handle(pn_event_t* event) {
     pn_connection_t *connection = pn_event_connection(event);
     if (connection && !mh) mh = get_handler(connection);
 
-    // Use container handler if nothing more specific (must be a container handler)
-    if (!mh) mh = handler_;
+    // Use container or per-thread handler if nothing more specific
+    if (!mh) mh = default_handler;
 
     // If we still have no handler don't do anything!
     // This is pretty unusual, but possible if we use the default constructor for container
@@ -433,16 +796,42 @@ bool container::impl::handle(pn_event_t* event) {
     return false;
 }
 
-void container::impl::thread() {
-    ++threads_;
+// threads_ is counted by run(), a thread that has yet to start must
+// still be passed the interrupt that stops the container
+void container::impl::thread(int home) {
+#if PN_CPP_SUPPORTS_THREADS
+    thread_home.container = this;
+    thread_home.home = home;
+#endif
     bool finished = false;
+    if (home >= 0) {
+        thread_handler& th = thread_handlers_[home];
+        GUARD(th.lock);
+        th.handler->on_container_start(container_);
+    }
     do {
       pn_event_batch_t *events = pn_proactor_wait(proactor_);
+      int64_t start = now_micros();
       pn_event_t *e;
+      pn_connection_t *c = 0;
+      container_work_queue* ready = 0;
+      common_work_queue::jobs jobs;
       try {
         while ((e = pn_event_batch_next(events))) {
+          c = pn_event_connection(e);
+#if PN_CPP_SUPPORTS_THREADS
+          thread_home.connection = c;
+#endif
           finished = handle(e);
           if (finished) break;
+          // Leave the rest of the batch, including the next timeout,
+          // to other threads while this one runs the queue
+          if (pn_event_type(e) == PN_PROACTOR_TIMEOUT && (ready = take_ready_work_queue(jobs)))
+              break;
+        }
+        if (c) {
+          flush(c);
+          account(c);
         }
       } catch (proton::error& e) {
         // If we caught an exception then shutdown the (other threads of the) container
@@ -455,8 +844,23 @@ void container::impl::thread() {
         if (!stopping_) stop(disconnect_error_);
         finished = true;
       }
+#if PN_CPP_SUPPORTS_THREADS
+      thread_home.connection = 0;
+#endif
+      account_batch(now_micros() - start);
       pn_proactor_done(proactor_, events);
+      if (ready) {
+          // Run queued work, but ignore any exceptions
+          for (common_work_queue::jobs::iterator f = jobs.begin(); f != jobs.end(); ++f) try {
+              (*f)();
+          } catch (...) {};
+          ready_work_queue_done(ready);
+      }
     } while(!finished);
+#if PN_CPP_SUPPORTS_THREADS
+    thread_home.container = 0;
+    thread_home.home = -1;
+#endif
     --threads_;
 }
 
@@ -466,6 +870,8 @@ void container::impl::start_event() {
 
 void container::impl::stop_event() {
     if (handler_) handler_->on_container_stop(container_);
+    for (int i = 0; i < nthread_handlers_; ++i)
+        thread_handlers_[i].handler->on_container_stop(container_);
 }
 
 void container::impl::run(int threads) {
@@ -473,13 +879,16 @@ void container::impl::run(int threads) {
     CALL_ONCE(start_once_, &impl::start_event, this);
 
 #if PN_CPP_SUPPORTS_THREADS
+    threads_ += threads;
     // Run handler threads
+    // Per-thread handlers are taken in order, this thread has the first
     std::vector<std::thread> ts(threads-1);
     if (threads>1) {
-      for (auto& t : ts) t = std::thread(&impl::thread, this);
+      for (int i = 1; i < threads; ++i)
+          ts[i-1] = std::thread(&impl::thread, this, i < nthread_handlers_ ? i : -1);
     }
 
-    thread();      // Use this thread too.
+    thread(nthread_handlers_ ? 0 : -1); // Use this thread too.
 
     // Wait for the other threads to stop
     if (threads>1) {
@@ -487,7 +896,8 @@ void container::impl::run(int threads) {
     }
 #else
     // Run a single handler thread (As we have no threading API)
-    thread();
+    ++threads_;
+    thread(-1);
 #endif
 
     if (threads_==0) CALL_ONCE(stop_once_, &impl::stop_event, this);
@@ -498,11 +908,33 @@ void container::impl::run(int threads) {
     };
 }
 
+#if PN_CPP_SUPPORTS_THREADS
+void container::impl::run(const std::vector<messaging_handler*>& handlers) {
+    if (handlers.empty())
+        throw proton::error("no handlers to run");
+    {
+        GUARD(lock_);
+        if (thread_handlers_)
+            throw proton::error("container is already running with per-thread handlers");
+        thread_handlers_ = new thread_handler[handlers.size()];
+        for (size_t i = 0; i < handlers.size(); ++i)
+            thread_handlers_[i].handler = handlers[i];
+        nthread_handlers_ = int(handlers.size());
+    }
+    run(nthread_handlers_);
+}
+#endif
+
 void container::impl::auto_stop(bool set) {
     GUARD(lock_);
     auto_stop_ = set;
 }
 
+void container::impl::share_connections(bool set) {
+    GUARD(lock_);
+    share_connections_ = set;
+}
+
 void container::impl::stop(const proton::error_condition& err) {
     GUARD(lock_);
     auto_stop_ = true;
@@ -511,6 +943,9 @@ void container::impl::stop(const proton::error_condition& err) {
     set_error_condition(err, error_condition);
     pn_proactor_disconnect(proactor_, error_condition);
     pn_condition_free(error_condition);
+    // With nothing left to disconnect there is no PN_PROACTOR_INACTIVE
+    // to end run(), a timeout is followed by one.
+    wake_timeout();
 }
 
 }
@@ -83,12 +83,11 @@ void receiver::drain() {
 
 receiver_iterator receiver_iterator::operator++() {
     if (!!obj_) {
-        pn_link_t *lnk = pn_link_next(obj_.pn_object(), 0);
-        while (lnk) {
-            if (pn_link_is_receiver(lnk) && pn_link_session(lnk) == session_)
-                break;
-            lnk = pn_link_next(lnk, 0);
-        }
+        pn_link_t *lnk = pn_link_session_next(obj_.pn_object(), 0);
+        // A connection's receivers go on with those of its next session
+        pn_session_t *s = pn_link_session(obj_.pn_object());
+        while (!lnk && !session_ && (s = pn_session_next(s, 0)))
+            lnk = pn_session_receiver_head(s, 0);
         obj_ = lnk;
     }
     return *this;
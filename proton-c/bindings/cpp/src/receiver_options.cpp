@@ -20,15 +20,18 @@
  */
 
 #include "proton/receiver_options.hpp"
+#include "proton/error.hpp"
 #include "proton/messaging_handler.hpp"
 #include "proton/source_options.hpp"
 #include "proton/target_options.hpp"
 
 #include <proton/link.h>
+#include <proton/message_selector.h>
 
 #include "contexts.hpp"
 #include "proactor_container_impl.hpp"
 #include "messaging_adapter.hpp"
+#include "msg.hpp"
 #include "proton_bits.hpp"
 
 namespace proton {
@@ -66,7 +69,13 @@ class receiver_options::impl {
     option<proton::delivery_mode> delivery_mode;
     option<bool> auto_accept;
     option<bool> auto_settle;
+    option<bool> stream_messages;
+    option<bool> batch_messages;
     option<int> credit_window;
+    option<int> credit_low_water;
+    option<size_t> adaptive_credit;
+    option<class worker_queue*> worker_queue;
+    option<internal::pn_ptr<pn_message_selector_t> > selector;
     option<bool> dynamic_address;
     option<source_options> source;
     option<target_options> target;
@@ -78,7 +87,13 @@ class receiver_options::impl {
             if (handler.set && handler.value) container::impl::set_handler(r, handler.value);
             if (auto_settle.set) get_context(r).auto_settle = auto_settle.value;
             if (auto_accept.set) get_context(r).auto_accept = auto_accept.value;
+            if (stream_messages.set) get_context(r).stream_messages = stream_messages.value;
+            if (batch_messages.set) get_context(r).batch_messages = batch_messages.value;
             if (credit_window.set) get_context(r).credit_window = credit_window.value;
+            if (credit_low_water.set) get_context(r).credit_low_water = credit_low_water.value;
+            if (adaptive_credit.set) get_context(r).adaptive.max_bytes = adaptive_credit.value;
+            if (worker_queue.set) get_context(r).workers = worker_queue.value;
+            if (selector.set) get_context(r).selector = selector.value;
 
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(r))));
@@ -96,7 +111,13 @@ class receiver_options::impl {
         delivery_mode.update(x.delivery_mode);
         auto_accept.update(x.auto_accept);
         auto_settle.update(x.auto_settle);
+        stream_messages.update(x.stream_messages);
+        batch_messages.update(x.batch_messages);
         credit_window.update(x.credit_window);
+        credit_low_water.update(x.credit_low_water);
+        adaptive_credit.update(x.adaptive_credit);
+        worker_queue.update(x.worker_queue);
+        selector.update(x.selector);
         dynamic_address.update(x.dynamic_address);
         source.update(x.source);
         target.update(x.target);
@@ -121,7 +142,22 @@ receiver_options& receiver_options::handler(class messaging_handler &h) { impl_-
 receiver_options& receiver_options::delivery_mode(proton::delivery_mode m) {impl_->delivery_mode = m; return *this; }
 receiver_options& receiver_options::auto_accept(bool b) {impl_->auto_accept = b; return *this; }
 receiver_options& receiver_options::auto_settle(bool b) {impl_->auto_settle = b; return *this; }
+receiver_options& receiver_options::stream_messages(bool b) {impl_->stream_messages = b; return *this; }
+receiver_options& receiver_options::batch_messages(bool b) {impl_->batch_messages = b; return *this; }
 receiver_options& receiver_options::credit_window(int w) {impl_->credit_window = w; return *this; }
+receiver_options& receiver_options::credit_low_water(int n) {impl_->credit_low_water = n; return *this; }
+receiver_options& receiver_options::adaptive_credit(size_t max_bytes) {impl_->adaptive_credit = max_bytes; return *this; }
+receiver_options& receiver_options::worker_queue(class worker_queue& q) {impl_->worker_queue = &q; return *this; }
+receiver_options& receiver_options::selector(const std::string& expression) {
+    // Compiled once here, receivers made with these options share it
+    internal::pn_ptr<pn_message_selector_t> s =
+        internal::pn_ptr<pn_message_selector_t>::take_ownership(pn_message_selector(expression.c_str()));
+    if (!s.get()) throw error(MSG("selector: out of memory"));
+    pn_error_t* err = pn_message_selector_error(s.get());
+    if (pn_error_code(err)) throw error(MSG(pn_error_text(err)));
+    impl_->selector = s;
+    return *this;
+}
 receiver_options& receiver_options::source(source_options &s) {impl_->source = s; return *this; }
 receiver_options& receiver_options::target(target_options &s) {impl_->target = s; return *this; }
 
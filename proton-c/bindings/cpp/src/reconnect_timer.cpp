@@ -21,6 +21,7 @@
 
 #include "proton/reconnect_timer.hpp"
 #include "proton/error.hpp"
+#include "proton/uuid.hpp"
 #include "msg.hpp"
 #include <proton/types.h>
 
@@ -28,7 +29,7 @@ namespace proton {
 
 reconnect_timer::reconnect_timer(uint32_t first, int32_t max, uint32_t increment,
                                  bool doubling, int32_t max_retries, int32_t timeout) :
-    first_delay_(first), max_delay_(max), increment_(increment), doubling_(doubling),
+    first_delay_(first), max_delay_(max), increment_(increment), doubling_(doubling), jitter_(false),
     max_retries_(max_retries), timeout_(timeout), retries_(0), next_delay_(-1), timeout_deadline_(0)
     {}
 
@@ -58,7 +59,19 @@ int reconnect_timer::next_delay(timestamp now) {
         next_delay_ = max_delay_;
     if (timeout_deadline_ != timestamp(0) && (now + next_delay_ > timeout_deadline_))
         next_delay_ = timeout_deadline_ - now;
-    return next_delay_.milliseconds();
+    int delay = int(next_delay_.milliseconds());
+    if (jitter_ && delay > 1) {
+        // uuid::random() has a generator per thread, no need for one here
+        uuid r = uuid::random();
+        uint32_t n = uint32_t(uint8_t(r[0])) | uint32_t(uint8_t(r[1])) << 8 | uint32_t(uint8_t(r[2])) << 16;
+        delay -= int(n % uint32_t(delay / 2 + 1));
+    }
+    return delay;
+}
+
+reconnect_timer& reconnect_timer::jitter(bool set) {
+    jitter_ = set;
+    return *this;
 }
 
 }
@@ -21,6 +21,7 @@
 
 #include "proton/sender.hpp"
 
+#include "proton/error.hpp"
 #include "proton/link.hpp"
 #include "proton/sender_options.hpp"
 #include "proton/source.hpp"
@@ -29,11 +30,14 @@
 
 #include <proton/delivery.h>
 #include <proton/link.h>
+#include <proton/session.h>
 #include <proton/types.h>
 
 #include "proton_bits.hpp"
 #include "contexts.hpp"
+#include "messaging_adapter.hpp"
 
+#include <algorithm>
 #include <assert.h>
 
 namespace proton {
@@ -58,18 +62,44 @@ class target sender::target() const {
 }
 
 namespace {
-// TODO: revisit if thread safety required
-uint64_t tag_counter = 0;
+// Send bytes already encoded as a message
+pn_delivery_t* send_bytes(pn_link_t *lnk, const char* bytes, size_t size) {
+    pn_delivery_t *dlv = pn_delivery_auto(lnk);
+    if (size) {
+        ssize_t sent = pn_link_send(lnk, bytes, size);
+        if (sent < 0) throw proton::error(error_str(sent));
+    }
+    pn_link_advance(lnk);
+    if (pn_link_snd_settle_mode(lnk) == PN_SND_SETTLED)
+        pn_delivery_settle(dlv);
+    return dlv;
+}
+}
+
+void send_held(pn_link_t *lnk) {
+    link_context &lctx = link_context::get(lnk);
+    sender s(make_wrapper<sender>(lnk));
+    while (!lctx.held.empty() && s.credit() > 0) {
+        link_context::held_map::iterator i = lctx.held.begin();
+        std::vector<char> bytes;
+        bytes.swap(i->second);
+        lctx.held.erase(i);
+        send_bytes(lnk, bytes.empty() ? 0 : &bytes[0], bytes.size());
+    }
+    if (!pn_link_credit(lnk))
+        lctx.draining = false;
 }
 
 tracker sender::send(const message &message) {
-    uint64_t id = ++tag_counter;
-    pn_delivery_t *dlv =
-        pn_delivery(pn_object(), pn_dtag(reinterpret_cast<const char*>(&id), sizeof(id)));
-    std::vector<char> buf;
-    message.encode(buf);
-    assert(!buf.empty());
-    pn_link_send(pn_object(), &buf[0], buf.size());
+    link_context &lctx = link_context::get(pn_object());
+    if (lctx.priority_ordering && (!lctx.held.empty() || credit() <= 0)) {
+        link_context::held_map::iterator i =
+            lctx.held.insert(std::make_pair(int(message.priority()), std::vector<char>()));
+        message.encode(i->second);
+        return tracker();
+    }
+    pn_delivery_t *dlv = pn_delivery_auto(pn_object());
+    message.encode(pn_object());
     pn_link_advance(pn_object());
     if (pn_link_snd_settle_mode(pn_object()) == PN_SND_SETTLED)
         pn_delivery_settle(dlv);
@@ -78,6 +108,63 @@ tracker sender::send(const message &message) {
     return make_wrapper<tracker>(dlv);
 }
 
+tracker sender::send_encoded(const binary &bytes) {
+    pn_delivery_t *dlv = send_bytes(pn_object(), bytes.empty() ? 0 : reinterpret_cast<const char*>(&bytes[0]), bytes.size());
+    if (!pn_link_credit(pn_object()))
+        link_context::get(pn_object()).draining = false;
+    return make_wrapper<tracker>(dlv);
+}
+
+void sender::send_settled(const message &message) {
+    message.encode_settled(pn_object());
+    if (!pn_link_credit(pn_object()))
+        link_context::get(pn_object()).draining = false;
+}
+
+size_t sender::send_batch(const std::vector<message> &msgs, std::vector<tracker> &trackers) {
+    pn_link_t *lnk = pn_object();
+    size_t n = std::min(msgs.size(), size_t(std::max(pn_link_credit(lnk), 0)));
+    if (!n) return 0;
+    link_context &lctx = link_context::get(lnk);
+    bool settled = pn_link_snd_settle_mode(lnk) == PN_SND_SETTLED;
+    trackers.reserve(trackers.size() + n);
+    for (size_t i = 0; i < n; ++i) {
+        pn_delivery_t *dlv = pn_delivery_auto(lnk);
+        msgs[i].encode(lnk);
+        pn_link_advance(lnk);
+        if (settled)
+            pn_delivery_settle(dlv);
+        trackers.push_back(make_wrapper<tracker>(dlv));
+    }
+    if (!pn_link_credit(lnk))
+        lctx.draining = false;
+    return n;
+}
+
+tracker sender::send_packed(const std::vector<message> &msgs) {
+    if (msgs.empty())
+        throw proton::error("send_packed: no messages");
+    std::vector<char> packed, encoded;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        msgs[i].encode(encoded);
+        uint32_t size = uint32_t(encoded.size());
+        char head[5] = { char(0xb0), char(size >> 24), char(size >> 16), char(size >> 8), char(size) };
+        packed.insert(packed.end(), head, head + sizeof(head));
+        packed.insert(packed.end(), encoded.begin(), encoded.end());
+    }
+    pn_link_t *lnk = pn_object();
+    pn_delivery_t *dlv = pn_delivery_auto(lnk);
+    pn_delivery_set_message_format(dlv, PACKED_MESSAGE_FORMAT);
+    ssize_t sent = pn_link_send(lnk, &packed[0], packed.size());
+    if (sent < 0) throw proton::error(error_str(sent));
+    pn_link_advance(lnk);
+    if (pn_link_snd_settle_mode(lnk) == PN_SND_SETTLED)
+        pn_delivery_settle(dlv);
+    if (!pn_link_credit(lnk))
+        link_context::get(lnk).draining = false;
+    return make_wrapper<tracker>(dlv);
+}
+
 void sender::return_credit() {
     link_context &lctx = link_context::get(pn_object());
     lctx.draining = false;
@@ -86,12 +173,11 @@ void sender::return_credit() {
 
 sender_iterator sender_iterator::operator++() {
     if (!!obj_) {
-        pn_link_t *lnk = pn_link_next(obj_.pn_object(), 0);
-        while (lnk) {
-            if (pn_link_is_sender(lnk) && pn_link_session(lnk) == session_)
-                break;
-            lnk = pn_link_next(lnk, 0);
-        }
+        pn_link_t *lnk = pn_link_session_next(obj_.pn_object(), 0);
+        // A connection's senders go on with those of its next session
+        pn_session_t *s = pn_link_session(obj_.pn_object());
+        while (!lnk && !session_ && (s = pn_session_next(s, 0)))
+            lnk = pn_session_sender_head(s, 0);
         obj_ = lnk;
     }
     return *this;
@@ -63,6 +63,9 @@ class sender_options::impl {
     option<messaging_handler*> handler;
     option<proton::delivery_mode> delivery_mode;
     option<bool> auto_settle;
+    option<bool> batch_settlements;
+    option<bool> priority_ordering;
+    option<uint32_t> weight;
     option<source_options> source;
     option<target_options> target;
 
@@ -71,6 +74,9 @@ class sender_options::impl {
             if (delivery_mode.set) set_delivery_mode(s, delivery_mode.value);
             if (handler.set && handler.value) container::impl::set_handler(s, handler.value);
             if (auto_settle.set) get_context(s).auto_settle = auto_settle.value;
+            if (batch_settlements.set) get_context(s).batch_settlements = batch_settlements.value;
+            if (priority_ordering.set) get_context(s).priority_ordering = priority_ordering.value;
+            if (weight.set) pn_link_set_weight(unwrap(s), weight.value);
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(s))));
                 source.value.apply(local_s);
@@ -86,6 +92,9 @@ class sender_options::impl {
         handler.update(x.handler);
         delivery_mode.update(x.delivery_mode);
         auto_settle.update(x.auto_settle);
+        batch_settlements.update(x.batch_settlements);
+        priority_ordering.update(x.priority_ordering);
+        weight.update(x.weight);
         source.update(x.source);
         target.update(x.target);
     }
@@ -108,6 +117,9 @@ void sender_options::update(const sender_options& x) { impl_->update(*x.impl_);
 sender_options& sender_options::handler(class messaging_handler &h) { impl_->handler = &h; return *this; }
 sender_options& sender_options::delivery_mode(proton::delivery_mode m) {impl_->delivery_mode = m; return *this; }
 sender_options& sender_options::auto_settle(bool b) {impl_->auto_settle = b; return *this; }
+sender_options& sender_options::batch_settlements(bool b) {impl_->batch_settlements = b; return *this; }
+sender_options& sender_options::priority_ordering(bool b) {impl_->priority_ordering = b; return *this; }
+sender_options& sender_options::weight(uint32_t w) {impl_->weight = w; return *this; }
 sender_options& sender_options::source(const source_options &s) {impl_->source = s; return *this; }
 sender_options& sender_options::target(const target_options &s) {impl_->target = s; return *this; }
 
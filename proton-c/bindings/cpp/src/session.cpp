@@ -62,13 +62,11 @@ connection session::connection() const {
     return make_wrapper(pn_session_connection(pn_object()));
 }
 
-namespace {
 std::string next_link_name(const connection& c) {
     io::link_namer* ln = connection_context::get(unwrap(c)).link_gen;
 
     return ln ? ln->link_name() : uuid::random().str();
 }
-}
 
 sender session::open_sender(const std::string &addr) {
     return open_sender(addr, sender_options());
@@ -108,22 +106,12 @@ size_t session::outgoing_bytes() const {
 }
 
 sender_range session::senders() const {
-    pn_link_t *lnk = pn_link_head(pn_session_connection(pn_object()), 0);
-    while (lnk) {
-        if (pn_link_is_sender(lnk) && pn_link_session(lnk) == pn_object())
-            break;
-        lnk = pn_link_next(lnk, 0);
-    }
+    pn_link_t *lnk = pn_session_sender_head(pn_object(), 0);
     return sender_range(sender_iterator(make_wrapper<sender>(lnk), pn_object()));
 }
 
 receiver_range session::receivers() const {
-    pn_link_t *lnk = pn_link_head(pn_session_connection(pn_object()), 0);
-    while (lnk) {
-        if (pn_link_is_receiver(lnk) && pn_link_session(lnk) == pn_object())
-            break;
-        lnk = pn_link_next(lnk, 0);
-    }
+    pn_link_t *lnk = pn_session_receiver_head(pn_object(), 0);
     return receiver_range(receiver_iterator(make_wrapper<receiver>(lnk), pn_object()));
 }
 
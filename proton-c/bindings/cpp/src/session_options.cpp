@@ -44,10 +44,15 @@ template <class T> struct option {
 class session_options::impl {
   public:
     option<messaging_handler *> handler;
+    option<size_t> incoming_capacity;
 
     void apply(session& s) {
         if (s.uninitialized()) {
             if (handler.set && handler.value) container::impl::set_handler(s, handler.value);
+            if (incoming_capacity.set) {
+                pn_session_set_incoming_capacity(unwrap(s), incoming_capacity.value);
+                pn_session_set_incoming_budget(unwrap(s), true);
+            }
         }
     }
 
@@ -65,6 +70,7 @@ session_options& session_options::operator=(const session_options& x) {
 }
 
 session_options& session_options::handler(class messaging_handler &h) { impl_->handler = &h; return *this; }
+session_options& session_options::incoming_capacity(size_t bytes) { impl_->incoming_capacity = bytes; return *this; }
 
 void session_options::apply(session& s) const { impl_->apply(s); }
 
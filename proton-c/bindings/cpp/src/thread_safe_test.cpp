@@ -23,8 +23,11 @@
 #include "test_bits.hpp"
 #include "proton_bits.hpp"
 
+#include "proton/endpoint_handle.hpp"
 #include "proton/thread_safe.hpp"
 #include "proton/io/connection_driver.hpp"
+#include "proton/sender.hpp"
+#include "proton/session.hpp"
 
 #include <proton/connection.h>
 
@@ -98,11 +101,47 @@ void test_convert() {
     ASSERT_EQUAL(1, pn_refcount(pc)); // only c is left
 }
 
+
+#if PN_CPP_SUPPORTS_THREADS
+void test_endpoint_handle() {
+    // Handles hold no reference to their endpoint
+    endpoint_handle<connection> hc;
+    endpoint_handle<sender> hs;
+    ASSERT(!hc);
+    ASSERT(!hc.get());
+    ASSERT(!hc.add([]() {}));
+    {
+        io::connection_driver e;
+        connection c = e.connection();
+        pn_connection_t* pc = unwrap(c);
+        sender s = c.open_sender("x");
+        int r = pn_refcount(pc);
+        hc = endpoint_handle<connection>(c);
+        hs = endpoint_handle<sender>(s);
+        endpoint_handle<sender> hs2(hs);
+        ASSERT_EQUAL(r, pn_refcount(pc));
+        ASSERT(!!hc);
+        ASSERT(hc.get() == c);
+        ASSERT(hs2.get() == s);
+        ASSERT(endpoint_handle<sender>(s).get() == s);
+        ASSERT(endpoint_handle<session>(s.session()).get() == s.session());
+        ASSERT(!hc.add([]() {})); // A driver's connection has no work queue
+    }
+    // The endpoints are gone, the handles find nothing
+    ASSERT(!!hc);
+    ASSERT(!hc.get());
+    ASSERT(!hs.get());
+    ASSERT(!hc.add([]() {}));
+}
+#endif
 }
 
 int main(int, char**) {
     int failed = 0;
     RUN_TEST(failed, test_new());
     RUN_TEST(failed, test_convert());
+#if PN_CPP_SUPPORTS_THREADS
+    RUN_TEST(failed, test_endpoint_handle());
+#endif
     return failed;
 }
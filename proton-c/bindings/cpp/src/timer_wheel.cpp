@@ -0,0 +1,194 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "timer_wheel.hpp"
+
+#include <utility>
+
+namespace proton {
+
+namespace {
+
+const uint64_t all = ~uint64_t(0);
+
+#if PN_CPP_HAS_RVALUE_REFERENCES
+inline void take(work& f, std::vector<work>& out) { out.push_back(std::move(f)); }
+inline void assign(work& to, work& from) { to = std::move(from); }
+#else
+inline void take(work& f, std::vector<work>& out) { out.push_back(f); }
+inline void assign(work& to, work& from) { to = from; }
+#endif
+
+// Destroy a timer's work now, rather than keep its captures alive until the entry is reused
+inline void discard(work& f) {
+#if PN_CPP_HAS_RVALUE_REFERENCES
+    work dead(std::move(f));
+#else
+    (void)f;
+#endif
+}
+
+inline int lowest_bit(uint64_t x) {
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; ++n; }
+    return n;
+}
+
+}
+
+// Furthest tick the wheel holds, over a century
+uint64_t timer_wheel::horizon() { return ~(all << (bits * levels)); }
+
+timer_wheel::timer_wheel(timestamp start) :
+    start_(start.milliseconds()), now_(0), free_(none), size_(0)
+{
+    for (int i = 0; i <= due; ++i) heads_[i] = none;
+    for (int l = 0; l < levels; ++l) occupied_[l] = 0;
+}
+
+timer_wheel::id timer_wheel::add(timestamp deadline, work f) {
+    timestamp::numeric_type ms = deadline.milliseconds() - start_;
+    int i = alloc(ms > 0 ? uint64_t(ms) : 0, f);
+    insert(i);
+    ++size_;
+    return (uint64_t(entries_[i].gen) << 32) | uint64_t(i + 1);
+}
+
+bool timer_wheel::cancel(id t) {
+    uint64_t n = t & 0xffffffff;
+    if (n == 0 || n > entries_.size()) return false;
+    int i = int(n - 1);
+    entry& e = entries_[i];
+    if (e.slot == none || e.gen != uint32_t(t >> 32)) return false;
+    unlink(i);
+    free_entry(i);
+    --size_;
+    return true;
+}
+
+void timer_wheel::expire(timestamp now, std::vector<work>& out) {
+    timestamp::numeric_type ms = now.milliseconds() - start_;
+    uint64_t target = ms > 0 ? uint64_t(ms) : 0;
+    if (target > horizon()) target = horizon();
+    for (;;) {
+        while (heads_[due] != none) {
+            int i = heads_[due];
+            unlink(i);
+            take(entries_[i].task, out);
+            free_entry(i);
+            --size_;
+        }
+        uint64_t t;
+        if (!next_tick(t) || t > target) break;
+        now_ = t;
+        // Move timers down from every level whose slot starts now, the
+        // level 0 slot for now holds only timers due now.
+        for (int l = levels - 1; l >= 0; --l) {
+            if (now_ & ~(all << (bits * l))) continue;
+            int s = l * slots + int((now_ >> (bits * l)) & (slots - 1));
+            while (heads_[s] != none) {
+                int i = heads_[s];
+                unlink(i);
+                insert(i);
+            }
+        }
+    }
+    if (target > now_) now_ = target;
+}
+
+bool timer_wheel::next(timestamp& t) const {
+    uint64_t tick;
+    if (heads_[due] != none) tick = now_;
+    else if (!next_tick(tick)) return false;
+    t = timestamp(start_ + timestamp::numeric_type(tick));
+    return true;
+}
+
+// Start of the first occupied slot after now_. Every slot at or before
+// the current digit of its level has already been emptied, and a
+// lower level always comes due before a higher one.
+bool timer_wheel::next_tick(uint64_t& t) const {
+    for (int l = 0; l < levels; ++l) {
+        int digit = int((now_ >> (bits * l)) & (slots - 1));
+        uint64_t later = digit == slots - 1 ? 0 : occupied_[l] & (all << (digit + 1));
+        if (later) {
+            t = (now_ & (all << (bits * (l + 1)))) | (uint64_t(lowest_bit(later)) << (bits * l));
+            return true;
+        }
+    }
+    return false;
+}
+
+int timer_wheel::alloc(uint64_t when, work& f) {
+    int i;
+    if (free_ != none) {
+        i = free_;
+        free_ = entries_[i].next;
+        assign(entries_[i].task, f);
+    } else {
+        i = int(entries_.size());
+        entries_.push_back(entry(f));
+    }
+    entries_[i].when = when < horizon() ? when : horizon();
+    return i;
+}
+
+void timer_wheel::free_entry(int i) {
+    entry& e = entries_[i];
+    discard(e.task);
+    ++e.gen;
+    e.slot = none;
+    e.prev = none;
+    e.next = free_;
+    free_ = i;
+}
+
+void timer_wheel::insert(int i) {
+    uint64_t when = entries_[i].when;
+    if (when <= now_) {
+        link(i, due);
+        return;
+    }
+    int l = 0;
+    while (l < levels - 1 && (when >> (bits * (l + 1))) != (now_ >> (bits * (l + 1))))
+        ++l;
+    link(i, l * slots + int((when >> (bits * l)) & (slots - 1)));
+}
+
+void timer_wheel::link(int i, int s) {
+    entry& e = entries_[i];
+    e.slot = s;
+    e.prev = none;
+    e.next = heads_[s];
+    if (e.next != none) entries_[e.next].prev = i;
+    heads_[s] = i;
+    if (s < due) occupied_[s / slots] |= uint64_t(1) << (s % slots);
+}
+
+void timer_wheel::unlink(int i) {
+    entry& e = entries_[i];
+    if (e.prev != none) entries_[e.prev].next = e.next;
+    else heads_[e.slot] = e.next;
+    if (e.next != none) entries_[e.next].prev = e.prev;
+    if (e.slot < due && heads_[e.slot] == none)
+        occupied_[e.slot / slots] &= ~(uint64_t(1) << (e.slot % slots));
+}
+
+}
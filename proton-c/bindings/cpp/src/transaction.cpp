@@ -0,0 +1,214 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/transaction.hpp"
+
+#include "proton/connection.hpp"
+#include "proton/delivery.hpp"
+#include "proton/error.hpp"
+#include "proton/message.hpp"
+#include "proton/messaging_handler.hpp"
+#include "proton/sender.hpp"
+#include "proton/session.hpp"
+#include "proton/tracker.hpp"
+
+#include "contexts.hpp"
+#include "messaging_adapter.hpp"
+#include "msg.hpp"
+#include "proton_bits.hpp"
+
+#include <proton/codec.h>
+#include <proton/delivery.h>
+#include <proton/disposition.h>
+#include <proton/link.h>
+#include <proton/message.h>
+#include <proton/session.h>
+#include <proton/terminus.h>
+
+namespace proton {
+
+namespace {
+// Descriptors from the AMQP transactions section
+const uint64_t DECLARE = 0x31;
+const uint64_t DISCHARGE = 0x32;
+const uint64_t DECLARED = 0x33;
+const uint64_t TRANSACTIONAL_STATE = 0x34;
+
+session_context& declared_context(pn_session_t *s) {
+    session_context& ctx = session_context::get(s);
+    if (ctx.txn_id.empty() || ctx.txn_request)
+        throw error(MSG("transaction is not declared"));
+    return ctx;
+}
+
+pn_data_t *put_described(pn_data_t *data, uint64_t descriptor) {
+    pn_data_put_described(data);
+    pn_data_enter(data);
+    pn_data_put_ulong(data, descriptor);
+    return data;
+}
+
+pn_bytes_t txn_bytes(const binary &id) {
+    return pn_bytes(id.size(), reinterpret_cast<const char*>(&id[0]));
+}
+
+// Send a declare or discharge to the session's coordinator
+void request(session_context& ctx, uint64_t descriptor) {
+    pn_message_t *m = pn_message();
+    pn_data_t *body = put_described(pn_message_body(m), descriptor);
+    pn_data_put_list(body);
+    if (descriptor == DISCHARGE) {
+        pn_data_enter(body);
+        pn_data_put_binary(body, txn_bytes(ctx.txn_id));
+        pn_data_put_bool(body, ctx.txn_fail);
+        pn_data_exit(body);
+    }
+    pn_data_exit(body);
+
+    pn_delivery_t *dlv = pn_delivery_auto(ctx.coordinator);
+    ssize_t sent = pn_message_send(m, ctx.coordinator);
+    pn_message_free(m);
+    if (sent < 0) throw error(error_str(sent));
+    pn_link_advance(ctx.coordinator);
+    ctx.txn_request = dlv;
+    ctx.txn_discharge = descriptor == DISCHARGE;
+}
+
+void discharge(pn_session_t *s, bool fail) {
+    session_context& ctx = declared_context(s);
+    ctx.txn_fail = fail;
+    request(ctx, DISCHARGE);
+}
+}
+
+transaction::transaction(pn_session_t *s) : session_(s) {}
+
+session transaction::session() const { return make_wrapper(session_); }
+
+bool transaction::declared() const {
+    if (!session_) return false;
+    session_context& ctx = session_context::get(session_);
+    return !ctx.txn_id.empty() && !ctx.txn_discharge;
+}
+
+binary transaction::id() const {
+    return session_ ? session_context::get(session_).txn_id : binary();
+}
+
+error_condition transaction::error() const {
+    return session_ ? session_context::get(session_).txn_error : error_condition();
+}
+
+void transaction::accept(delivery &d) {
+    session_context& ctx = declared_context(session_);
+    pn_delivery_t *dlv = unwrap(d);
+    pn_data_t *data = pn_disposition_data(pn_delivery_local(dlv));
+    pn_data_clear(data);
+    pn_data_put_list(data);
+    pn_data_enter(data);
+    pn_data_put_binary(data, txn_bytes(ctx.txn_id));
+    put_described(data, PN_ACCEPTED);
+    pn_data_put_list(data);
+    pn_data_exit(data);
+    pn_data_exit(data);
+    pn_delivery_update(dlv, TRANSACTIONAL_STATE);
+    d.settle();
+}
+
+tracker transaction::send(sender &s, const message &m) {
+    session_context& ctx = declared_context(session_);
+    pn_link_t *lnk = unwrap(s);
+    pn_delivery_t *dlv = pn_delivery_auto(lnk);
+    // The state goes out on the transfer
+    pn_data_t *data = pn_disposition_data(pn_delivery_local(dlv));
+    pn_data_put_list(data);
+    pn_data_enter(data);
+    pn_data_put_binary(data, txn_bytes(ctx.txn_id));
+    pn_data_exit(data);
+    pn_delivery_update(dlv, TRANSACTIONAL_STATE);
+    m.encode(lnk);
+    pn_link_advance(lnk);
+    return make_wrapper<tracker>(dlv);
+}
+
+void transaction::commit() { discharge(session_, false); }
+
+void transaction::abort() { discharge(session_, true); }
+
+transaction session::declare_transaction() {
+    session_context& ctx = session_context::get(pn_object());
+    if (!ctx.txn_id.empty() || ctx.txn_request)
+        throw proton::error(MSG("session already has a transaction"));
+    if (!ctx.coordinator) {
+        pn_link_t *lnk = pn_sender(pn_object(), next_link_name(connection()).c_str());
+        pn_terminus_t *target = pn_link_target(lnk);
+        pn_terminus_set_type(target, PN_COORDINATOR);
+        pn_data_put_symbol(pn_terminus_capabilities(target), pn_bytes(sizeof("amqp:local-transactions") - 1, "amqp:local-transactions"));
+        pn_link_open(lnk);
+        ctx.coordinator = lnk;
+    }
+    ctx.txn_error = error_condition();
+    request(ctx, DECLARE);
+    return transaction(pn_object());
+}
+
+bool transaction_outcome(messaging_handler& handler, pn_delivery_t *dlv) {
+    pn_session_t *s = pn_link_session(pn_delivery_link(dlv));
+    session_context& ctx = session_context::get(s);
+    if (dlv != ctx.txn_request) return false;
+    if (!pn_delivery_updated(dlv) || !pn_delivery_remote_state(dlv)) return true;
+
+    uint64_t state = pn_delivery_remote_state(dlv);
+    bool discharged = ctx.txn_discharge;
+    ctx.txn_request = 0;
+    ctx.txn_discharge = false;
+    binary id;
+    if (!discharged && state == DECLARED) {
+        pn_data_t *data = pn_disposition_data(pn_delivery_remote(dlv));
+        pn_data_rewind(data);
+        if (pn_data_next(data) && pn_data_enter(data) && pn_data_next(data) &&
+            pn_data_type(data) == PN_BINARY) {
+            pn_bytes_t b = pn_data_get_binary(data);
+            id = binary(b.start, b.start + b.size);
+        }
+        if (id.empty())
+            ctx.txn_error = error_condition("amqp:decode-error", "declared outcome has no transaction id");
+    } else if (!(discharged && state == PN_ACCEPTED)) {
+        ctx.txn_error = make_wrapper(pn_disposition_condition(pn_delivery_remote(dlv)));
+        if (ctx.txn_error.empty())
+            ctx.txn_error = error_condition("amqp:transaction:rollback", "transaction request was not accepted");
+    }
+    pn_delivery_settle(dlv);
+
+    ctx.txn_id = id;
+    transaction t(s);
+    if (!ctx.txn_error.empty())
+        handler.on_transaction_error(t);
+    else if (!discharged)
+        handler.on_transaction_declare(t);
+    else if (ctx.txn_fail)
+        handler.on_transaction_abort(t);
+    else
+        handler.on_transaction_commit(t);
+    return true;
+}
+
+}
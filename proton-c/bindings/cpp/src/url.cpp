@@ -168,6 +168,22 @@ struct url::impl {
         parse_url(&cstr[0], &scheme, &username, &password, &host, &port, &path);
     }
 
+    // Copy the parsed fields without parsing again
+    impl(const impl& x) : cstr(x.cstr), str(x.str) {
+        scheme = x.rebase(x.scheme, *this);
+        username = x.rebase(x.username, *this);
+        password = x.rebase(x.password, *this);
+        host = x.rebase(x.host, *this);
+        port = x.rebase(x.port, *this);
+        path = x.rebase(x.path, *this);
+    }
+
+    // Fields point into cstr, or at defaults that are not
+    const char* rebase(const char* p, const impl& to) const {
+        const char* begin = &cstr[0];
+        return (p >= begin && p < begin + cstr.size()) ? &to.cstr[0] + (p - begin) : p;
+    }
+
     void defaults() {
         if (!scheme || *scheme=='\0' ) scheme = proton::url::AMQP.c_str();
         if (!host || *host=='\0' ) host = default_host;
@@ -222,7 +238,7 @@ url::url(const std::string &s) : impl_(new impl(s)) { impl_->defaults(); }
 
 url::url(const std::string &s, bool d) : impl_(new impl(s)) { if (d) impl_->defaults(); }
 
-url::url(const url& u) : impl_(new impl(u)) {}
+url::url(const url& u) : impl_(new impl(*u.impl_)) {}
 
 url::~url() {}
 
@@ -22,11 +22,21 @@
 #include "proton/uuid.hpp"
 #include "proton/types_fwd.hpp"
 
-#include <cstdlib>
+#include "proton/internal/config.hpp"
+
 #include <ctime>
+#include <stdint.h>
 #include <sstream>
 #include <iomanip>
 
+#if PN_CPP_HAS_CPP11
+#include <chrono>
+#include <random>
+#endif
+#if PN_CPP_HAS_STD_ATOMIC
+#include <atomic>
+#endif
+
 #ifdef WIN32
 #include <process.h>
 #define GETPID _getpid
@@ -39,17 +49,49 @@ namespace proton {
 
 namespace {
 
+// splitmix64 finaliser, spreads every input bit over the result
+uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Generators started in the same process, so no two threads share a seed
+#if PN_CPP_HAS_STD_ATOMIC
+std::atomic<uint64_t> generators(0);
+#else
+uint64_t generators = 0;
+#endif
 
-// Seed the random number generated once at startup.
-struct seed {
-    seed() {
-        // A hash of time and PID, time alone is a bad seed as programs started
-        // within the same second will get the same seed.
-        long secs = time(0);
-        long pid = GETPID();
-        std::srand(((secs*181)*((pid-83)*359))%104729);
+// A splitmix64 sequence per thread: random() takes no lock, unlike
+// std::rand(), so threads making link names do not serialise on it.
+struct generator {
+    uint64_t state;
+
+    generator() {
+        // Time alone is a bad seed: processes started together must differ
+        // by PID, and threads by the generator count and address.
+        uint64_t seed = mix(uint64_t(time(0)) ^ (uint64_t(GETPID()) << 32));
+        seed = mix(seed ^ ++generators);
+        seed = mix(seed ^ uint64_t(reinterpret_cast<uintptr_t>(this)));
+#if PN_CPP_HAS_CPP11
+        seed = mix(seed ^ uint64_t(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
+        try {
+            std::random_device rd;
+            seed = mix(seed ^ (uint64_t(rd()) << 32 | rd()));
+        } catch (...) {}        // No entropy source, the hash above will do
+#endif
+        state = seed;
     }
-} seed_;
+
+    uint64_t next() { return mix(state += 0x9E3779B97F4A7C15ULL); }
+};
+
+#if PN_CPP_HAS_CPP11
+thread_local generator generator_;
+#else
+generator generator_;
+#endif
 
 }
 
@@ -70,12 +112,9 @@ uuid uuid::copy(const char* bytes) {
 
 uuid uuid::random() {
     uuid bytes;
-    int r = std::rand();
-    for (size_t i = 0; i < bytes.size(); ++i ) {
-        bytes[i] = r & 0xFF;
-        r >>= 8;
-        if (!r) r = std::rand();
-    }
+    uint64_t r[2] = { generator_.next(), generator_.next() };
+    for (size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = char(r[i / 8] >> (8 * (i % 8)));
 
     // From RFC4122, the version bits are set to 0100
     bytes[6] = (bytes[6] & 0x0F) | 0x40;
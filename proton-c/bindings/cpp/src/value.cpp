@@ -43,31 +43,66 @@ value& value::operator=(value&& x) { swap(*this, x); return *this; }
 
 value& value::operator=(const value& x) {
     if (this != &x) {
-        if (x.empty())
+        if (x.empty()) {
             clear();
-        else
+        } else if (!x.data_) {
+            if (!data_) {
+                copy_scalar(x.scalar_);
+            } else {
+                codec::encoder e(*this);
+                e << x;
+            }
+        } else {
             data().copy(x.data_);
+        }
     }
     return *this;
 }
 
-void swap(value& x, value& y) { std::swap(x.data_, y.data_); }
+void swap(value& x, value& y) {
+    std::swap(x.data_, y.data_);
+    x.swap_scalar(y);
+}
 
-void value::clear() { if (!!data_) data_.clear(); }
+void value::clear() {
+    clear_scalar();
+    if (!!data_) data_.clear();
+}
 
 namespace internal {
 
 // On demand
 internal::data& value_base::data() {
+    if (!data_) {
+        data_ = internal::data::create();
+        if (!scalar_.empty()) {
+            codec::encoder(data_) << scalar_;
+            clear_scalar();
+        }
+    }
+    return data_;
+}
+
+internal::data& value_base::fresh_data() {
+    clear_scalar();
     if (!data_)
         data_ = internal::data::create();
     return data_;
 }
 
+void value_base::clear_scalar() { scalar_.put_(null()); }
+
+// Swapping the byte storage keeps string atoms pointing at their bytes
+void value_base::swap_scalar(value_base& x) {
+    std::swap(scalar_.atom_, x.scalar_.atom_);
+    scalar_.bytes_.swap(x.scalar_.bytes_);
+}
+
 }
 
 type_id value::type() const {
-    return (!data_ || data_.empty()) ? NULL_TYPE : codec::decoder(*this).next_type();
+    if (!data_) return scalar_.type();
+    return data_.empty() ? NULL_TYPE : codec::decoder(*this).next_type();
 }
 
 bool value::empty() const { return type() == NULL_TYPE; }
@@ -171,12 +206,16 @@ int compare(const value& x, const value& y) {
 } // namespace
 
 bool operator==(const value& x, const value& y) {
+    const scalar_base *sx = x.inline_scalar(), *sy = y.inline_scalar();
+    if (sx && sy) return *sx == *sy;
     if (x.empty() && y.empty()) return true;
     if (x.empty() || y.empty()) return false;
     return compare(x, y) == 0;
 }
 
 bool operator<(const value& x, const value& y) {
+    const scalar_base *sx = x.inline_scalar(), *sy = y.inline_scalar();
+    if (sx && sy) return *sx < *sy;
     if (x.empty() && y.empty()) return false;
     if (x.empty()) return true; // empty is < !empty
     return compare(x, y) < 0;
@@ -186,6 +225,8 @@ std::ostream& operator<<(std::ostream& o, const value& x) {
     if (x.empty()) {
         return o << "<empty-value>";
     }
+    if (const scalar_base* s = x.inline_scalar())
+        return o << *s;
     if (type_id_is_scalar(x.type()) || x.empty())
         return o << proton::get<scalar>(x); // Print as a scalar
     // Use pn_inspect for complex types.
@@ -199,6 +240,9 @@ std::string to_string(const value& x) {
     return os.str();
 }
 
-void value::reset(pn_data_t *d) { data_ = make_wrapper(d); }
+void value::reset(pn_data_t *d) {
+    clear_scalar();
+    data_ = make_wrapper(d);
+}
 
 } // namespace proton
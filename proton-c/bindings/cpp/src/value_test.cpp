@@ -65,6 +65,87 @@ template <class T> void sequence_test(
     ASSERT_EQUAL(s, to_string(vx));
 }
 
+// Fixed-width sequences are copied in one go, check they still convert
+void fixed_width_test() {
+    vector<double> d;
+    for (int i = 0; i < 1000; ++i) d.push_back(i / 4.0);
+    value v(d);
+    ASSERT_EQUAL(ARRAY, v.type());
+    ASSERT_EQUAL(d, get<vector<double> >(v));
+    ASSERT_EQUAL(value(vector<double>()), value(vector<double>()));
+    ASSERT(get<vector<double> >(value(vector<double>())).empty());
+
+    // Other AMQP types still convert element by element
+    vector<int32_t> i32;
+    i32.push_back(-1);
+    i32.push_back(2);
+    vector<int64_t> i64(i32.begin(), i32.end());
+    ASSERT_EQUAL(i64, coerce<vector<int64_t> >(value(i32)));
+    vector<value> list(i32.begin(), i32.end());
+    ASSERT_EQUAL(i32, get<vector<int32_t> >(value(list)));
+    ASSERT_THROWS(conversion_error, get<vector<int64_t> >(value(i32)));
+
+#if PN_CPP_HAS_CPP11
+    std::array<float, 3> a = {{0.5f, -1.0f, 2.25f}};
+    value va(a);
+    ASSERT_EQUAL("@PN_FLOAT[0.5, -1, 2.25]", to_string(va));
+    ASSERT(a == (get<std::array<float, 3> >(va)));
+    std::array<float, 2> wrong;
+    ASSERT_THROWS(conversion_error, get(va, wrong));
+    std::array<string, 2> s = {{"a", "b"}};
+    ASSERT(s == (get<std::array<string, 2> >(value(s))));
+#endif
+}
+
+// Scalars are held without a pn_data_t and convert like any other value
+void inline_scalar_test() {
+    value i(42);
+    ASSERT(i.inline_scalar());
+    ASSERT_EQUAL(INT, i.type());
+    ASSERT_EQUAL(42, get<int32_t>(i));
+    ASSERT_EQUAL(42, coerce<int64_t>(i));
+    ASSERT_THROWS(conversion_error, get<int64_t>(i));
+    ASSERT_EQUAL("42", to_string(i));
+
+    value s("abc"), t(std::string("xyz"));
+    ASSERT(s.inline_scalar() && t.inline_scalar());
+    ASSERT(s < t);
+    swap(s, t);
+    ASSERT_EQUAL("xyz", get<std::string>(s));
+    ASSERT_EQUAL("abc", get<std::string>(t));
+    value u(t);
+    t = 1.5;
+    ASSERT_EQUAL("abc", get<std::string>(u));
+
+    // A value that holds a pn_data_t keeps it
+    value l(std::vector<int>(2, 1));
+    ASSERT(!l.inline_scalar());
+    l = u;
+    ASSERT(!l.inline_scalar());
+    ASSERT_EQUAL(u, l);
+    ASSERT(i < l && i < u);     // Ordered by type first, the same either way
+    l = 42;
+    ASSERT_EQUAL(i, l);
+
+    // Scalars in containers stay inline through encoding and decoding
+    std::map<std::string, value> m;
+    m["a"] = 1;
+    m["b"] = "two";
+    m["c"] = std::vector<int>(1, 3);
+    value vm(m);
+    std::map<std::string, value> m2 = get<std::map<std::string, value> >(vm);
+    ASSERT_EQUAL(m, m2);
+    ASSERT(m2["a"].inline_scalar() && m2["b"].inline_scalar());
+    ASSERT(!m2["c"].inline_scalar());
+
+    value n;
+    ASSERT(n.empty());
+    n = i;
+    n.clear();
+    ASSERT(n.empty());
+    ASSERT_EQUAL(value(), n);
+}
+
 template <class T, class U> void map_test(const U& values, const string& s) {
     T m(values.begin(), values.end());
     value v(m);
@@ -76,6 +157,33 @@ template <class T, class U> void map_test(const U& values, const string& s) {
         ASSERT_EQUAL(s, to_string(v));
 }
 
+
+// Decoding sizes containers from the encoded count and keeps the last
+// value of a repeated key
+void map_decode_test() {
+    ASSERT((internal::has_reserve<vector<int> >::value));
+    ASSERT(!(internal::has_reserve<map<string, int> >::value));
+    ASSERT(!(internal::has_reserve<deque<int> >::value));
+
+    typedef pair<string, uint64_t> si_pair;
+    vector<si_pair> pairs;
+    for (uint64_t i = 0; i < 1000; ++i)
+        pairs.push_back(si_pair(to_string(scalar(i)), i));
+    pairs.push_back(si_pair("0", 42));
+    value v(pairs);
+    vector<si_pair> pairs2(get<vector<si_pair> >(v));
+    ASSERT_EQUAL(pairs, pairs2);
+    map<string, uint64_t> m(get<map<string, uint64_t> >(v));
+    ASSERT_EQUAL(1000U, m.size());
+    ASSERT_EQUAL(42U, m["0"]);
+    ASSERT_EQUAL(999U, m["999"]);
+#if PN_CPP_HAS_CPP11
+    ASSERT((internal::has_reserve<unordered_map<string, int> >::value));
+    unordered_map<string, uint64_t> u(get<unordered_map<string, uint64_t> >(v));
+    ASSERT_EQUAL(1000U, u.size());
+    ASSERT_EQUAL(42U, u["0"]);
+#endif
+}
 }
 
 int main(int, char**) {
@@ -95,6 +203,10 @@ int main(int, char**) {
                  LIST, many<value>() + value(0) + value("a"), "[0, \"a\"]"));
     RUN_TEST(failed, sequence_test<vector<scalar> >(
                  LIST, many<scalar>() + scalar(0) + scalar("a"), "[0, \"a\"]"));
+    RUN_TEST(failed, sequence_test<vector<double> >(
+                 ARRAY, many<double>() + 1.5 + 2.5, "@PN_DOUBLE[1.5, 2.5]"));
+    RUN_TEST(failed, fixed_width_test());
+    RUN_TEST(failed, inline_scalar_test());
 
     // // Map tests
     typedef pair<string, uint64_t> si_pair;
@@ -119,6 +231,7 @@ int main(int, char**) {
     many<pair<annotation_key, message_id> > restricted_pairs(si_pairs);
     RUN_TEST(failed, (map_test<map<annotation_key, message_id> >(
                           restricted_pairs, "{:a=0, :b=1, :c=2}")));
+    RUN_TEST(failed, map_decode_test());
 
 #if PN_CPP_HAS_CPP11
     RUN_TEST(failed, sequence_test<forward_list<binary> >(
@@ -31,7 +31,8 @@
 namespace proton {
 
 work_queue::work_queue() {}
-work_queue::work_queue(container& c) { *this = container::impl::make_work_queue(c); }
+work_queue::work_queue(container& c) { *this = container::impl::make_work_queue(c, 0); }
+work_queue::work_queue(container& c, size_t capacity) { *this = container::impl::make_work_queue(c, capacity); }
 
 work_queue::~work_queue() {}
 
@@ -40,13 +41,17 @@ work_queue& work_queue::operator=(impl* i) { impl_.reset(i); return *this; }
 bool work_queue::add(work f) {
     // If we have no actual work queue, then can't defer
     if (!impl_) return false;
-    return impl_->add(f);
+    return impl_->add(MOVE(f));
 }
 
-void work_queue::schedule(duration d, work f) {
+work_queue::timer_id work_queue::schedule(duration d, work f) {
     // If we have no actual work queue, then can't defer
-    if (!impl_) return;
-    return impl_->schedule(d, f);
+    if (!impl_) return 0;
+    return impl_->schedule(d, MOVE(f));
+}
+
+bool work_queue::cancel(timer_id t) {
+    return impl_ && t && impl_->cancel(t);
 }
 
 work_queue& work_queue::get(pn_connection_t* c) {
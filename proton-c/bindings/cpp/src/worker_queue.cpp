@@ -0,0 +1,261 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "proton/worker_queue.hpp"
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include "settle_channel.hpp"
+
+#include <proton/connection.h>
+#include <proton/delivery.h>
+#include <proton/disposition.h>
+#include <proton/proactor.h>
+
+#include <condition_variable>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+namespace proton {
+
+// Enough outcomes for a burst from a busy pool between two batches
+#define PN_CPP_SETTLE_CHANNEL_CAPACITY 4096
+
+settle_channel::settle_channel(pn_connection_t* c) :
+    queue_(PN_CPP_SETTLE_CHANNEL_CAPACITY), connection_(c), detached_(false), wake_pending_(false)
+{}
+
+void settle_channel::send(uint64_t token, uint64_t state) {
+    outcome o = { token, state };
+    while (!queue_.push(o)) {
+        if (detached_.load(std::memory_order_acquire)) return;
+        std::this_thread::yield(); // The connection drains the channel at the end of its batch
+    }
+    if (!wake_pending_.exchange(true)) {
+        std::lock_guard<std::mutex> g(lock_);
+        if (connection_) pn_connection_wake(connection_);
+    }
+}
+
+size_t settle_channel::drain(std::vector<outcome>& out) {
+    // Clear the flag first, an outcome sent after the drain wakes the connection again
+    wake_pending_.exchange(false);
+    return queue_.drain(out, std::numeric_limits<size_t>::max());
+}
+
+void settle_channel::detach() {
+    detached_.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> g(lock_);
+    connection_ = 0;
+}
+
+worker_handoff::worker_handoff(pn_connection_t* c) : channel(new settle_channel(c)), waiting(0) {}
+
+worker_handoff::~worker_handoff() { channel->detach(); }
+
+uint64_t worker_handoff::add(pn_delivery_t* d) {
+    uint32_t i;
+    if (free_.empty()) {
+        i = uint32_t(slots_.size());
+        slots_.push_back(slot());
+    } else {
+        i = free_.back();
+        free_.pop_back();
+    }
+    slots_[i].delivery = d;
+    return (uint64_t(slots_[i].generation) << 32) | i;
+}
+
+pn_delivery_t* worker_handoff::take(uint64_t token) {
+    uint32_t i = uint32_t(token);
+    if (i >= slots_.size() || slots_[i].generation != uint32_t(token >> 32) || !slots_[i].delivery)
+        return 0;
+    pn_delivery_t* d = slots_[i].delivery;
+    slots_[i].delivery = 0;
+    ++slots_[i].generation;
+    free_.push_back(i);
+    return d;
+}
+
+void worker_handoff::clear() {
+    free_.clear();
+    for (uint32_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].delivery) {
+            slots_[i].delivery = 0;
+            ++slots_[i].generation;
+        }
+        free_.push_back(i);
+    }
+}
+
+void worker_queue::item::settle(uint64_t state) {
+    if (!channel_) return;
+    channel_->send(token_, state);
+    channel_.reset();
+}
+
+void worker_queue::item::accept() { settle(PN_ACCEPTED); }
+void worker_queue::item::reject() { settle(PN_REJECTED); }
+void worker_queue::item::release() { settle(PN_RELEASED); }
+
+// A ring of sequence-numbered cells like mpsc_queue, but consumers also
+// claim their cell with a compare-and-swap so any number may pop.
+// Consumers only take the lock to sleep when the queue is empty.
+class worker_queue::impl {
+  public:
+    explicit impl(size_t capacity);
+    ~impl();
+
+    bool push(item& x);
+    bool try_pop(item& x);
+    bool pop(item& x);
+    void close();
+
+  private:
+    struct cell {
+        std::atomic<size_t> seq;
+        std::aligned_storage<sizeof(item), alignof(item)>::type storage;
+        item* get() { return reinterpret_cast<item*>(&storage); }
+    };
+
+    static size_t ring_size(size_t);
+
+    size_t capacity_;
+    size_t mask_;
+    cell* ring_;
+    std::atomic<size_t> enqueue_;
+    std::atomic<size_t> dequeue_;
+    std::atomic<int> sleepers_;
+    std::atomic<bool> closed_;
+    std::mutex lock_;
+    std::condition_variable ready_;
+};
+
+// One cell would have the same sequence free and filled, so at least 2
+size_t worker_queue::impl::ring_size(size_t n) {
+    size_t size = 2;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+worker_queue::impl::impl(size_t capacity) :
+    capacity_(ring_size(capacity)), mask_(capacity_ - 1), ring_(new cell[capacity_]),
+    enqueue_(0), dequeue_(0), sleepers_(0), closed_(false)
+{
+    for (size_t i = 0; i < capacity_; ++i)
+        ring_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+worker_queue::impl::~impl() {
+    // Items never popped are dropped, their deliveries are not settled
+    for (size_t pos = dequeue_.load(); ring_[pos & mask_].seq.load() == pos + 1; ++pos)
+        ring_[pos & mask_].get()->~item();
+    delete[] ring_;
+}
+
+bool worker_queue::impl::push(item& x) {
+    size_t pos = enqueue_.load(std::memory_order_relaxed);
+    cell* c;
+    for (;;) {
+        c = &ring_[pos & mask_];
+        ptrdiff_t dif = ptrdiff_t(c->seq.load(std::memory_order_acquire)) - ptrdiff_t(pos);
+        if (dif == 0) {
+            if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;       // Full
+        } else {
+            pos = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+    new (c->get()) item(std::move(x));
+    c->seq.store(pos + 1, std::memory_order_release);
+    // Pairs with the increment in pop(): either a sleeper sees the item or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> g(lock_);
+        ready_.notify_one();
+    }
+    return true;
+}
+
+bool worker_queue::impl::try_pop(item& x) {
+    size_t pos = dequeue_.load(std::memory_order_relaxed);
+    cell* c;
+    for (;;) {
+        c = &ring_[pos & mask_];
+        ptrdiff_t dif = ptrdiff_t(c->seq.load(std::memory_order_acquire)) - ptrdiff_t(pos + 1);
+        if (dif == 0) {
+            if (dequeue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;       // Empty
+        } else {
+            pos = dequeue_.load(std::memory_order_relaxed);
+        }
+    }
+    x = std::move(*c->get());
+    c->get()->~item();
+    c->seq.store(pos + capacity_, std::memory_order_release);
+    return true;
+}
+
+bool worker_queue::impl::pop(item& x) {
+    if (try_pop(x)) return true;
+    std::unique_lock<std::mutex> l(lock_);
+    for (;;) {
+        sleepers_.fetch_add(1);
+        bool got = try_pop(x);
+        if (!got && !closed_.load()) ready_.wait(l);
+        sleepers_.fetch_sub(1);
+        if (got || try_pop(x)) return true;
+        if (closed_.load()) return false;
+    }
+}
+
+void worker_queue::impl::close() {
+    closed_.store(true);
+    std::lock_guard<std::mutex> g(lock_);
+    ready_.notify_all();
+}
+
+worker_queue::worker_queue(size_t capacity) : impl_(new impl(capacity)) {}
+
+worker_queue::~worker_queue() {}
+
+bool worker_queue::try_pop(item& x) { return impl_->try_pop(x); }
+
+bool worker_queue::pop(item& x) { return impl_->pop(x); }
+
+void worker_queue::close() { impl_->close(); }
+
+bool worker_queue::offer(proton::message& m, const std::shared_ptr<settle_channel>& channel, uint64_t token) {
+    item x;
+    swap(x.message, m);
+    x.channel_ = channel;
+    x.token_ = token;
+    if (impl_->push(x)) return true;
+    swap(x.message, m);
+    return false;
+}
+
+}
+
+#endif // PN_CPP_SUPPORTS_THREADS
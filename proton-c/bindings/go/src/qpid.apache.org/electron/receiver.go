@@ -158,20 +158,22 @@ func (r *receiver) message(delivery proton.Delivery) {
 		localClose(r.pLink, r.pLink.RemoteCondition().Error())
 		return
 	}
-	if delivery.HasMessage() {
-		m, err := delivery.Message()
-		if err != nil {
-			localClose(r.pLink, err)
-			return
-		}
-		assert(m != nil)
-		r.pLink.Advance()
-		if r.pLink.Credit() < 0 {
-			localClose(r.pLink, fmt.Errorf("received message in excess of credit limit"))
-		} else {
-			// We never issue more credit than cap(buffer) so this will not block.
-			r.buffer <- ReceivedMessage{m, delivery, r}
-		}
+	if !delivery.HasMessage() {
+		return
+	}
+	// Take every complete message on the link in one call, we never issue
+	// more credit than the buffer has room for so sending to it will not block.
+	room := cap(r.buffer) - len(r.buffer)
+	if r.pLink.Credit() < 0 || room == 0 {
+		localClose(r.pLink, fmt.Errorf("received message in excess of credit limit"))
+		return
+	}
+	ms, ds, err := r.pLink.RecvBatch(room)
+	for i, m := range ms {
+		r.buffer <- ReceivedMessage{m, ds[i], r}
+	}
+	if err != nil {
+		localClose(r.pLink, err)
 	}
 }
 
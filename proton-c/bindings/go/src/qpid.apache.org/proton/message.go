@@ -22,15 +22,106 @@ package proton
 // #include <proton/types.h>
 // #include <proton/message.h>
 // #include <proton/codec.h>
+// #include <proton/delivery.h>
+// #include <proton/link.h>
+//
+// /* Each helper does the per-delivery work of a send or receive in a single
+//    cgo call. Message bytes are copied once, between a Go buffer and the link. */
+//
+// /* Receive the message of delivery d into buf. Returns the message size,
+//    which is more than size if buf is too small and nothing was received,
+//    or an error code if d has no complete message. */
+// static ssize_t pn_go_delivery_recv(pn_delivery_t *d, char *buf, size_t size) {
+//   if (!pn_delivery_readable(d)) return PN_STATE_ERR;
+//   if (pn_delivery_partial(d)) return PN_INPROGRESS;
+//   size_t pending = pn_delivery_pending(d);
+//   if (pending == 0 || pending > size) return pending;
+//   return pn_link_recv(pn_delivery_link(d), buf, pending);
+// }
+//
+// /* Receive up to max complete messages from the head of link l into buf,
+//    one after the other, advancing past each. Message i is sizes[i] bytes
+//    and came from ds[i]. Returns the number of messages; *need is the size
+//    of the next complete message if it did not fit in what was left of buf. */
+// static size_t pn_go_link_recv_batch(pn_link_t *l, char *buf, size_t size,
+//                                     size_t *sizes, pn_delivery_t **ds, size_t max, size_t *need) {
+//   size_t n = 0, used = 0;
+//   *need = 0;
+//   for (pn_delivery_t *d = pn_link_current(l); d && n < max; d = pn_link_current(l)) {
+//     if (!pn_delivery_readable(d) || pn_delivery_partial(d)) break;
+//     size_t pending = pn_delivery_pending(d);
+//     if (pending > size - used) {
+//       *need = pending;
+//       break;
+//     }
+//     ssize_t got = pending ? pn_link_recv(l, buf + used, pending) : 0;
+//     if (got < 0) break;
+//     sizes[n] = got;
+//     ds[n++] = d;
+//     used += got;
+//     pn_link_advance(l);
+//   }
+//   return n;
+// }
+//
+// /* Send one message on link l as a new delivery, settled if the peer asked
+//    for settled sends. *result is the pn_link_send() result. */
+// static pn_delivery_t *pn_go_link_send(pn_link_t *l, const char *tag, size_t tag_size,
+//                                       const char *bytes, size_t size, ssize_t *result) {
+//   pn_delivery_t *d = pn_delivery(l, pn_dtag(tag, tag_size));
+//   *result = pn_link_send(l, bytes, size);
+//   pn_link_advance(l);
+//   if (*result >= 0 && (size_t)*result == size && pn_link_remote_snd_settle_mode(l) == PN_SND_SETTLED) {
+//     pn_delivery_settle(d);
+//   }
+//   return d;
+// }
+//
+// /* Send n messages on link l. buf holds the tag then the message of each in
+//    turn, sizes holds their sizes in the same order. Stops at the first send
+//    that fails. Returns the number of messages sent, ds[i] is the delivery
+//    of message i. */
+// static size_t pn_go_link_send_batch(pn_link_t *l, const char *buf, const size_t *sizes,
+//                                     size_t n, pn_delivery_t **ds) {
+//   for (size_t i = 0; i < n; ++i) {
+//     ssize_t result;
+//     size_t tag_size = sizes[2*i], size = sizes[2*i+1];
+//     ds[i] = pn_go_link_send(l, buf, tag_size, buf + tag_size, size, &result);
+//     if (result < 0 || (size_t)result != size) return i;
+//     buf += tag_size + size;
+//   }
+//   return n;
+// }
 import "C"
 
 import (
 	"fmt"
 	"qpid.apache.org/amqp"
 	"strconv"
+	"sync"
 	"sync/atomic"
 )
 
+// Buffers for encoding and receiving messages. The C library copies message
+// bytes in both directions, so a buffer is free again as soon as the call returns.
+const (
+	minBuffer = 1024
+	maxBuffer = 1024 * 1024 // Larger buffers are not kept for reuse
+)
+
+var buffers = sync.Pool{New: func() interface{} { b := make([]byte, minBuffer); return &b }}
+
+func getBuffer() *[]byte { return buffers.Get().(*[]byte) }
+
+// putBuffer returns b to the pool, keeping data instead if it is a larger
+// buffer that replaced b.
+func putBuffer(b *[]byte, data []byte) {
+	if cap(data) > cap(*b) && cap(data) <= maxBuffer {
+		*b = data[:cap(data)]
+	}
+	buffers.Put(b)
+}
+
 // HasMessage is true if all message data is available.
 // Equivalent to !d.isNil && d.Readable() && !d.Partial()
 func (d Delivery) HasMessage() bool { return !d.IsNil() && d.Readable() && !d.Partial() }
@@ -42,19 +133,62 @@ func (d Delivery) HasMessage() bool { return !d.IsNil() && d.Readable() && !d.Pa
 //
 // Will return an error if message is incomplete or not current.
 func (delivery Delivery) Message() (m amqp.Message, err error) {
-	if !delivery.Readable() {
-		return nil, fmt.Errorf("delivery is not readable")
+	buf := getBuffer()
+	data := *buf
+	defer func() { putBuffer(buf, data) }()
+	result := C.pn_go_delivery_recv(delivery.pn, cPtr(data), cLen(data))
+	if result > C.ssize_t(len(data)) {
+		data = make([]byte, result)
+		result = C.pn_go_delivery_recv(delivery.pn, cPtr(data), cLen(data))
 	}
-	if delivery.Partial() {
+	switch {
+	case result == C.PN_STATE_ERR:
+		return nil, fmt.Errorf("delivery is not readable")
+	case result == C.PN_INPROGRESS:
 		return nil, fmt.Errorf("delivery has partial message")
-	}
-	data := make([]byte, delivery.Pending())
-	result := delivery.Link().Recv(data)
-	if result != len(data) {
+	case result < 0:
 		return nil, fmt.Errorf("cannot receive message: %s", PnErrorCode(result))
 	}
 	m = amqp.NewMessage()
-	err = m.Decode(data)
+	err = m.Decode(data[:result])
+	return
+}
+
+// RecvBatch receives up to max complete messages from the head of a receiving
+// link in a single call to the C library, advancing the link past each one.
+// It stops early at a message that is not complete yet.
+//
+// Returns the messages and their deliveries, and an error if a message
+// cannot be decoded, in which case the results stop before that message.
+func (link Link) RecvBatch(max int) (ms []amqp.Message, ds []Delivery, err error) {
+	if max <= 0 {
+		return nil, nil, nil
+	}
+	buf := getBuffer()
+	data := *buf
+	defer func() { putBuffer(buf, data) }()
+	sizes := make([]C.size_t, max)
+	pds := make([]*C.pn_delivery_t, max)
+	for len(ds) < max {
+		var need C.size_t
+		n := int(C.pn_go_link_recv_batch(link.pn, cPtr(data), cLen(data), &sizes[0], &pds[0], C.size_t(max-len(ds)), &need))
+		offset := 0
+		for i := 0; i < n; i++ {
+			m := amqp.NewMessage()
+			if err = m.Decode(data[offset : offset+int(sizes[i])]); err != nil {
+				return
+			}
+			offset += int(sizes[i])
+			ms = append(ms, m)
+			ds = append(ds, Delivery{pds[i]})
+		}
+		if need == 0 {
+			break
+		}
+		if int(need) > len(data) { // The next message is bigger than the whole buffer
+			data = make([]byte, need)
+		}
+	}
 	return
 }
 
@@ -72,22 +206,67 @@ func (link Link) Send(m amqp.Message) (Delivery, error) {
 		return Delivery{}, fmt.Errorf("attempt to send message on receiving link")
 	}
 
-	delivery := link.Delivery(nextTag())
-	bytes, err := m.Encode(nil)
+	buf := getBuffer()
+	bytes, err := m.Encode(*buf)
+	defer func() { putBuffer(buf, bytes) }()
 	if err != nil {
 		return Delivery{}, fmt.Errorf("cannot send mesage %s", err)
 	}
-	result := link.SendBytes(bytes)
-	link.Advance()
-	if result != len(bytes) {
+	tag := []byte(nextTag())
+	var result C.ssize_t
+	delivery := Delivery{C.pn_go_link_send(link.pn, cPtr(tag), cLen(tag), cPtr(bytes), cLen(bytes), &result)}
+	if int(result) != len(bytes) {
 		if result < 0 {
 			return delivery, fmt.Errorf("send failed %v", PnErrorCode(result))
 		} else {
 			return delivery, fmt.Errorf("send incomplete %v of %v", result, len(bytes))
 		}
 	}
-	if link.RemoteSndSettleMode() == SndSettled {
-		delivery.Settle()
-	}
 	return delivery, nil
 }
+
+// SendBatch sends several amqp.Messages over a Link in a single call to the C
+// library, encoding them one after the other into a shared buffer.
+// Returns the deliveries sent, which stop before the first message that
+// could not be encoded or sent.
+func (link Link) SendBatch(ms []amqp.Message) ([]Delivery, error) {
+	if !link.IsSender() {
+		return nil, fmt.Errorf("attempt to send message on receiving link")
+	}
+	if len(ms) == 0 {
+		return nil, nil
+	}
+	buf := getBuffer()
+	data := (*buf)[:0]
+	defer func() { putBuffer(buf, data) }()
+	sizes := make([]C.size_t, 0, 2*len(ms))
+	var err error
+	for _, m := range ms {
+		tag := nextTag()
+		data = append(data, tag...)
+		start := len(data)
+		var bytes []byte
+		// Encode in place, Encode allocates if the rest of data is too small
+		if bytes, err = m.Encode(data[start:cap(data)]); err != nil {
+			err = fmt.Errorf("cannot send mesage %s", err)
+			data = data[:start-len(tag)]
+			break
+		}
+		data = append(data[:start], bytes...)
+		sizes = append(sizes, C.size_t(len(tag)), C.size_t(len(bytes)))
+	}
+	n := len(sizes) / 2
+	if n == 0 {
+		return nil, err
+	}
+	pds := make([]*C.pn_delivery_t, n)
+	sent := int(C.pn_go_link_send_batch(link.pn, cPtr(data), &sizes[0], C.size_t(n), &pds[0]))
+	if sent < n {
+		err = fmt.Errorf("send failed on message %v of %v", sent+1, len(ms))
+	}
+	ds := make([]Delivery, sent)
+	for i := range ds {
+		ds[i] = Delivery{pds[i]}
+	}
+	return ds, err
+}
@@ -151,18 +151,37 @@ int pn_message_decode(pn_message_t *msg, const char *BIN_IN, size_t BIN_LEN);
 ssize_t pn_link_send(pn_link_t *transport, const char *BIN_IN, size_t BIN_LEN);
 %ignore pn_link_send;
 
+// Receive straight into a new bytes object rather than a scratch buffer
+%typemap(in,numinputs=0) PyObject **BYTES_OUT (PyObject *temp = NULL) {
+  $1 = &temp;
+}
+%typemap(argout) PyObject **BYTES_OUT {
+  if (!*$1) SWIG_fail;
+  %append_output(*$1);
+}
+
 %rename(pn_link_recv) wrap_pn_link_recv;
 %inline %{
-  int wrap_pn_link_recv(pn_link_t *link, char *BIN_OUT, size_t *BIN_SIZE) {
-    ssize_t sz = pn_link_recv(link, BIN_OUT, *BIN_SIZE);
-    if (sz >= 0) {
-      *BIN_SIZE = sz;
-    } else {
-      *BIN_SIZE = 0;
+  int wrap_pn_link_recv(pn_link_t *link, size_t limit, PyObject **BYTES_OUT) {
+    PyObject *bytes = PyBytes_FromStringAndSize(NULL, limit);
+    if (!bytes) return PN_OUT_OF_MEMORY;
+    ssize_t sz = pn_link_recv(link, PyBytes_AS_STRING(bytes), limit);
+    if ((size_t)sz != limit) {
+      _PyBytes_Resize(&bytes, sz >= 0 ? sz : 0);
     }
+    *BYTES_OUT = bytes;
     return sz;
   }
 %}
+
+// Receive into a caller's writable buffer, e.g. a bytearray or memoryview
+%pybuffer_mutable_binary(char *BIN_INTO, size_t BIN_INTO_LEN)
+%rename(pn_link_recv_into) wrap_pn_link_recv_into;
+%inline %{
+  ssize_t wrap_pn_link_recv_into(pn_link_t *link, char *BIN_INTO, size_t BIN_INTO_LEN) {
+    return pn_link_recv(link, BIN_INTO, BIN_INTO_LEN);
+  }
+%}
 %ignore pn_link_recv;
 
 ssize_t pn_transport_push(pn_transport_t *transport, const char *BIN_IN, size_t BIN_LEN);
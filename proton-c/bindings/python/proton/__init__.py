@@ -448,6 +448,19 @@ A L{Message} enters this window when you call the put() method with the
 message.  If your outgoing window size is I{n}, and you call L{put} I{n}+1
 times, status information will no longer be available for the
 first message.
+""")
+
+  def _get_outgoing_spill(self):
+    return pn_messenger_get_outgoing_spill(self._mng)
+
+  def _set_outgoing_spill(self, threshold):
+    self._check(pn_messenger_set_outgoing_spill(self._mng, threshold))
+
+  outgoing_spill = property(_get_outgoing_spill, _set_outgoing_spill,
+                            doc="""
+The number of encoded bytes of outgoing messages the messenger keeps
+in memory. Messages put beyond it wait in a temporary file until they
+can be sent. Defaults to zero, which keeps every message in memory.
 """)
 
   def start(self):
@@ -3051,6 +3064,21 @@ class Receiver(Link):
       self._check(n)
       return binary
 
+  def recv_into(self, buffer):
+    """
+    Receive data for the current delivery directly into a writable
+    buffer such as a bytearray or memoryview, without the copy into a
+    new bytes object that recv() makes.
+
+    @param buffer: a writable object supporting the buffer protocol
+    @return: the number of bytes received, or None at the end of the delivery
+    """
+    n = pn_link_recv_into(self._impl, buffer)
+    if n == PN_EOS:
+      return None
+    else:
+      return self._check(n)
+
   def drain(self, n):
     pn_link_drain(self._impl, n)
 
@@ -3553,6 +3581,18 @@ class SASL(Wrapper):
   allow_insecure_mechs = property(_get_allow_insecure_mechs, _set_allow_insecure_mechs,
                                   doc="""
 Allow unencrypted cleartext passwords (PLAIN mech)
+""")
+
+  def _get_pipelined(self):
+    return pn_sasl_get_pipelined(self._sasl)
+
+  def _set_pipelined(self, pipelined):
+    pn_sasl_set_pipelined(self._sasl, pipelined)
+
+  pipelined = property(_get_pipelined, _set_pipelined,
+                       doc="""
+Send SASL-INIT and the AMQP frames without waiting for the server's
+mechanisms (client only, needs exactly one allowed mech)
 """)
 
   def done(self, outcome):
@@ -3564,6 +3604,13 @@ Allow unencrypted cleartext passwords (PLAIN mech)
   def config_path(self, path):
     pn_sasl_config_path(self._sasl, path)
 
+  def config_credential_cache(self, size, ttl):
+    """
+    Remember up to size successful server authentications for ttl seconds,
+    size 0 disables the cache (process wide, extended SASL only)
+    """
+    pn_sasl_config_credential_cache(self._sasl, size, secs2millis(ttl))
+
 class SSLException(TransportException):
   pass
 
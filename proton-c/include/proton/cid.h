@@ -66,7 +66,9 @@ typedef enum {
   CID_pn_listener,
   CID_pn_proactor,
 
-  CID_pn_listener_socket
+  CID_pn_listener_socket,
+
+  CID_pn_message_selector
 } pn_cid_t;
 
 /**
@@ -488,6 +488,11 @@ PN_EXTERN bool pn_data_exit(pn_data_t *data);
  * @cond INTERNAL
  */
 PN_EXTERN bool pn_data_lookup(pn_data_t *data, const char *name);
+
+/* Inside a map, move past the next key equal to key, which has the given
+   type, PN_STRING or PN_SYMBOL, or either for PN_INVALID. Lookups from the
+   start of a large map build an index of its keys, kept until the next put. */
+PN_EXTERN bool pn_data_lookup_key(pn_data_t *data, pn_type_t type, pn_bytes_t key);
 /**
  * @endcond
  */
@@ -563,6 +568,54 @@ PN_EXTERN ssize_t pn_data_encoded_size(pn_data_t *data);
  */
 PN_EXTERN ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size);
 
+/**
+ * Decode like ::pn_data_decode(), but keep a list, map or described
+ * value as its encoding until it is entered. Its elements are decoded
+ * the same way then. Encoding a value that was never entered copies the
+ * original bytes, so it is never rebuilt as nodes.
+ *
+ * Getting the size of a list or map does not decode it. Any other
+ * pn_data_t operation behaves as it would after ::pn_data_decode().
+ * Malformed contents are found only when the value is entered, and
+ * then ::pn_data_enter() fails with the error set on the data.
+ *
+ * @param data a pn_data_t object
+ * @param bytes a pointer to an encoded AMQP data stream
+ * @param size the size of the encoded AMQP data stream
+ * @return the number of bytes consumed from the AMQP data stream or an error code
+ */
+PN_EXTERN ssize_t pn_data_decode_lazy(pn_data_t *data, const char *bytes, size_t size);
+
+/**
+ * Decode like ::pn_data_decode(), but keep some values as their
+ * encoding, as ::pn_data_decode_lazy() would, so they cost no nodes
+ * unless they are entered. A described value whose descriptor is one of
+ * the ulongs in skip stays encoded, as does any list, map or described
+ * value that is depth levels below the decoded value. A depth of zero
+ * keeps the decoded value itself encoded, a negative depth sets no limit.
+ *
+ * @param data a pn_data_t object
+ * @param bytes a pointer to an encoded AMQP data stream
+ * @param size the size of the encoded AMQP data stream
+ * @param skip the descriptors of values to keep encoded, may be NULL if count is 0
+ * @param count the number of descriptors in skip
+ * @param depth the number of levels to decode
+ * @return the number of bytes consumed from the AMQP data stream or an error code
+ */
+PN_EXTERN ssize_t pn_data_decode_partial(pn_data_t *data, const char *bytes, size_t size,
+                                         const uint64_t *skip, size_t count, int depth);
+
+/**
+ * Put a single value that is already encoded, as ::pn_data_decode_lazy()
+ * would decode it. This splices bytes from another encoding in without
+ * decoding them, for example message annotations to be forwarded.
+ *
+ * @param data a pn_data_t object
+ * @param bytes exactly one encoded AMQP value, it is copied
+ * @return zero on success, or PN_ARG_ERR if bytes is not a single value
+ */
+PN_EXTERN int pn_data_put_encoded(pn_data_t *data, pn_bytes_t bytes);
+
 /**
  * Puts an empty list value into a pn_data_t. Elements may be filled
  * by entering the list node using ::pn_data_enter() and using
@@ -642,6 +695,28 @@ PN_EXTERN int pn_data_put_map(pn_data_t *data);
  */
 PN_EXTERN int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type);
 
+/**
+ * Puts an undescribed array of count fixed width numbers in a single
+ * call. This is the same as pn_data_put_array() followed by entering
+ * the array, putting each value and exiting, without a call per
+ * element.
+ *
+ * The values are stored as the C type the matching pn_data_put_*
+ * function takes, e.g. double for ::PN_DOUBLE or int32_t for
+ * ::PN_INT. Only ::PN_UBYTE, ::PN_BYTE, ::PN_USHORT, ::PN_SHORT,
+ * ::PN_UINT, ::PN_INT, ::PN_CHAR, ::PN_ULONG, ::PN_LONG,
+ * ::PN_TIMESTAMP, ::PN_FLOAT and ::PN_DOUBLE are supported.
+ *
+ * @param data a pn_data_t object
+ * @param type the type of the array elements
+ * @param values the element values
+ * @param count the number of elements
+ *
+ * @return zero on success, PN_ARG_ERR if type is not supported or
+ * PN_OUT_OF_MEMORY if there is no room for the elements
+ */
+PN_EXTERN int pn_data_put_array_values(pn_data_t *data, pn_type_t type, const void *values, size_t count);
+
 /**
  * Puts a described value into a pn_data_t object. A described node
  * has two children, the descriptor and the value. These are specified
@@ -984,6 +1059,22 @@ PN_EXTERN bool pn_data_is_array_described(pn_data_t *data);
  */
 PN_EXTERN pn_type_t pn_data_get_array_type(pn_data_t *data);
 
+/**
+ * Copies the elements of the current node, if it is an undescribed
+ * array of type, to values in a single call. The values are stored as
+ * for pn_data_put_array_values(), which lists the supported types.
+ * The current node is not changed.
+ *
+ * @param data a pn_data_t object
+ * @param type the type of the array elements
+ * @param values where to store the element values
+ * @param count the most elements to store
+ *
+ * @return the number of elements stored, zero if the current node is
+ * not an undescribed array of type
+ */
+PN_EXTERN size_t pn_data_get_array_values(pn_data_t *data, pn_type_t type, void *values, size_t count);
+
 /**
  * Checks if the current node is a described value. The descriptor and
  * value may be accessed by entering the described value node.
@@ -1284,6 +1375,109 @@ PN_EXTERN bool pn_data_restore(pn_data_t *data, pn_handle_t point);
  */
 PN_EXTERN void pn_data_dump(pn_data_t *data);
 
+/**
+ * **Experimental** - Callbacks for a streaming decoder.
+ *
+ * Any callback may be NULL. A non-zero return from a callback stops
+ * decoding and is returned by ::pn_decoder_stream_feed().
+ */
+typedef struct pn_decoder_handler_t {
+  /**
+   * A list, map, array or described value starts. count is the
+   * number of values it contains: elements of a list or array, keys
+   * and values of a map, or 2 for the descriptor and value of a
+   * described value. For arrays element_type is the type of the
+   * elements, and if described is true the array descriptor is
+   * reported as a scalar before the elements.
+   */
+  int (*enter)(void *context, pn_type_t type, size_t count, pn_type_t element_type, bool described);
+  /** The compound value most recently entered ends. */
+  int (*leave)(void *context, pn_type_t type);
+  /**
+   * A scalar value. Binary, string and symbol contents only remain
+   * valid for the duration of the call.
+   */
+  int (*scalar)(void *context, const pn_atom_t *atom);
+} pn_decoder_handler_t;
+
+/**
+ * **Experimental** - A streaming AMQP decoder.
+ *
+ * Unlike ::pn_data_decode() no tree is built: values are reported to
+ * a ::pn_decoder_handler_t as they are decoded. Input may be fed in
+ * arbitrary pieces; only the compound nesting and the single value
+ * split across two pieces are retained between calls, so memory stays
+ * proportional to the nesting depth rather than the data size.
+ */
+typedef struct pn_decoder_stream_t pn_decoder_stream_t;
+
+/**
+ * Construct a streaming decoder.
+ *
+ * @param handler the callbacks, copied into the decoder
+ * @param context passed to every callback
+ * @return a new decoder, free with ::pn_decoder_stream_free()
+ */
+PN_EXTERN pn_decoder_stream_t *pn_decoder_stream(const pn_decoder_handler_t *handler, void *context);
+
+/**
+ * Free a streaming decoder.
+ */
+PN_EXTERN void pn_decoder_stream_free(pn_decoder_stream_t *stream);
+
+/**
+ * Decode the next piece of input, invoking callbacks for every value
+ * it completes. A value cut off at the end of the input is held until
+ * the next call.
+ *
+ * @return zero on success, or an error code for malformed input or
+ * the first non-zero callback result. Once an error is returned the
+ * decoder returns it for every later call.
+ */
+PN_EXTERN int pn_decoder_stream_feed(pn_decoder_stream_t *stream, const char *bytes, size_t size);
+
+/**
+ * True if every value fed so far has been completely decoded.
+ */
+PN_EXTERN bool pn_decoder_stream_complete(pn_decoder_stream_t *stream);
+
+/**
+ * **Experimental** - Text styles for ::pn_encoded_format().
+ */
+typedef enum {
+  /**
+   * The text of ::pn_data_format() and ::pn_inspect(), with the
+   * field names of performatives and other known described types.
+   */
+  PN_TEXT_INSPECT,
+  /**
+   * JSON, one line per top level value. Binary is base64, symbols,
+   * chars, decimals and UUIDs are strings, described values are
+   * objects with "descriptor" and "value" members, and map keys that
+   * are not strings are written as strings of their JSON text.
+   */
+  PN_TEXT_JSON
+} pn_text_style_t;
+
+/**
+ * **Experimental** - Format AMQP encoded values as text in one pass
+ * over the encoding, without decoding them into a ::pn_data_t. The
+ * size pointer must hold the amount of free space following the text
+ * pointer, and upon success will be updated to indicate how much
+ * space has been used, not counting the terminating nul.
+ *
+ * @param bytes the encoded values
+ * @param size the size of the encoded values
+ * @param style the text to write
+ * @param text a buffer to write the text to
+ * @param text_size a pointer to the size of the buffer
+ * @return zero on success, PN_OVERFLOW if the text does not fit,
+ * PN_UNDERFLOW if the last value is incomplete, or an error for
+ * malformed input
+ */
+PN_EXTERN int pn_encoded_format(const char *bytes, size_t size, pn_text_style_t style,
+                                char *text, size_t *text_size);
+
 /**
  * @}
  */
@@ -494,6 +494,129 @@ PN_EXTERN pn_data_t *pn_connection_remote_properties(pn_connection_t *connection
  */
 PN_EXTERN pn_transport_t *pn_connection_transport(pn_connection_t *connection);
 
+/**
+ * Limit the memory kept by a connection for reuse by new deliveries.
+ *
+ * Settled deliveries are recycled for new ones along with their data
+ * buffers, so a connection that keeps sending or receiving messages
+ * of similar size does not reallocate them. Buffers are kept only
+ * while the total held stays within this limit, beyond it they are
+ * cut back to a small default size first.
+ *
+ * @param[in] connection the connection object
+ * @param[in] bytes the most data buffer memory to keep, in bytes
+ */
+PN_EXTERN void pn_connection_set_delivery_pool_max(pn_connection_t *connection, size_t bytes);
+
+/**
+ * Get the number of deliveries created by reusing a recycled one.
+ *
+ * @param[in] connection the connection object
+ * @return the number of pool hits
+ */
+PN_EXTERN uint64_t pn_connection_get_delivery_pool_hits(const pn_connection_t *connection);
+
+/**
+ * Get the number of deliveries that had to be allocated afresh.
+ *
+ * @param[in] connection the connection object
+ * @return the number of pool misses
+ */
+PN_EXTERN uint64_t pn_connection_get_delivery_pool_misses(const pn_connection_t *connection);
+
+/**
+ * Allocate deliveries ahead of use, so the first count deliveries
+ * created on the connection's links are pool hits.
+ *
+ * Reserved deliveries have data buffers of the small default size,
+ * which are kept whatever the pn_connection_set_delivery_pool_max()
+ * limit.
+ *
+ * @param[in] connection the connection object
+ * @param[in] count the number of unused deliveries to keep ready
+ * @return 0 on success, PN_OUT_OF_MEMORY if not all could be allocated
+ */
+PN_EXTERN int pn_connection_reserve_deliveries(pn_connection_t *connection, size_t count);
+
+/**
+ * Get the memory held by a connection and its bound transport.
+ *
+ * This counts the data buffers of deliveries, including recycled ones,
+ * the memory sessions, links and deliveries are allocated from, and
+ * the transport's input and output buffers. It does not count
+ * application data attached to the connection.
+ *
+ * @param[in] connection the connection object
+ * @return the memory used in bytes
+ */
+PN_EXTERN size_t pn_connection_memory_usage(pn_connection_t *connection);
+
+/**
+ * Set a soft limit on the memory used by a connection.
+ *
+ * While ::pn_connection_memory_usage() is at or above the limit the
+ * bound transport reports no input capacity, so no more data is read
+ * from the peer until the application settles deliveries, reads their
+ * data or the output drains. The limit can be exceeded by up to one
+ * read of input and by data the application sends. 0, the default,
+ * means no limit.
+ *
+ * @param[in] connection the connection object
+ * @param[in] bytes the memory limit in bytes, 0 for none
+ */
+PN_EXTERN void pn_connection_set_memory_limit(pn_connection_t *connection, size_t bytes);
+
+/**
+ * Get the memory limit set by ::pn_connection_set_memory_limit().
+ *
+ * @param[in] connection the connection object
+ * @return the memory limit in bytes, 0 for none
+ */
+PN_EXTERN size_t pn_connection_get_memory_limit(pn_connection_t *connection);
+
+/**
+ * Get the outgoing data a connection has not yet written.
+ *
+ * This counts the data of deliveries not yet framed, on all sessions,
+ * and the framed output the bound transport holds.
+ *
+ * @param[in] connection the connection object
+ * @return the pending output in bytes
+ */
+PN_EXTERN size_t pn_connection_output_backlog(pn_connection_t *connection);
+
+/**
+ * Set a high-water mark on the output backlog of a connection.
+ *
+ * Once ::pn_connection_output_backlog() reaches the mark,
+ * ::pn_connection_output_blocked() is true until the backlog drains
+ * to half the mark, when a ::PN_LINK_FLOW event is issued for each
+ * open sender that has credit. Applications that check it before
+ * sending keep at most about the mark of unwritten data for a slow
+ * peer, however much credit it grants. 0, the default, means no mark.
+ *
+ * @param[in] connection the connection object
+ * @param[in] bytes the high-water mark in bytes, 0 for none
+ */
+PN_EXTERN void pn_connection_set_output_high_water(pn_connection_t *connection, size_t bytes);
+
+/**
+ * Get the high-water mark set by ::pn_connection_set_output_high_water().
+ *
+ * @param[in] connection the connection object
+ * @return the high-water mark in bytes, 0 for none
+ */
+PN_EXTERN size_t pn_connection_get_output_high_water(pn_connection_t *connection);
+
+/**
+ * Check whether senders on a connection should hold off sending.
+ *
+ * @param[in] connection the connection object
+ * @return true if the output backlog reached the high-water mark and
+ * has not yet drained to half of it
+ */
+PN_EXTERN bool pn_connection_output_blocked(pn_connection_t *connection);
+
 /**
  * @}
  */
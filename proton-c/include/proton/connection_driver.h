@@ -153,6 +153,23 @@ PN_EXTERN pn_rwbytes_t pn_connection_driver_read_buffer(pn_connection_driver_t *
  */
 PN_EXTERN void pn_connection_driver_read_done(pn_connection_driver_t *, size_t n);
 
+/**
+ * Process input from your own memory instead of copying it into
+ * pn_connection_driver_read_buffer().
+ *
+ * Complete frames are parsed directly from @p bytes, only an incomplete
+ * frame at the end is copied into the driver, so @p bytes can be reused as
+ * soon as this returns. Do not mix with an unfinished
+ * pn_connection_driver_read_buffer(): call pn_connection_driver_read_done()
+ * first.
+ *
+ * @return the number of bytes taken. This can be less than @p n if the
+ * driver cannot take more input now, as when
+ * pn_connection_driver_read_buffer() would be empty: handle events and
+ * offer the rest again later. Returns 0 if the read side is closed.
+ */
+PN_EXTERN size_t pn_connection_driver_read_external(pn_connection_driver_t *, const char *bytes, size_t n);
+
 /**
  * Close the read side. Call when the IO can no longer be read.
  */
@@ -179,6 +196,31 @@ PN_EXTERN bool pn_connection_driver_read_closed(pn_connection_driver_t *);
  */
 PN_EXTERN void pn_connection_driver_write_done(pn_connection_driver_t *, size_t n);
 
+/**
+ * Get the pending output as a list of segments, for gather writes such as
+ * writev() or sendmsg() without first copying the output into one buffer.
+ *
+ * Fills @p segments with up to @p n segments to be written in order. Where
+ * frames are written as they are (no SSL or SASL security layer) the
+ * segments refer directly to the encoded frames. Call
+ * pn_connection_driver_write_iovec_done() when writing is complete.
+ *
+ * The segments are valid until the next call to a driver function other
+ * than pn_connection_driver_write_iovec_done(). Do not mix with an
+ * unfinished pn_connection_driver_write_buffer().
+ *
+ * @return the number of segments filled, 0 means there is nothing to write.
+ * There may be more output than fits in @p n segments.
+ */
+PN_EXTERN size_t pn_connection_driver_write_iovec(pn_connection_driver_t *, pn_bytes_t *segments, size_t n);
+
+/**
+ * Call when the first n bytes of the segments from
+ * pn_connection_driver_write_iovec() have been written to IO, n may end part
+ * way through a segment. Invalidates the segments.
+ */
+PN_EXTERN void pn_connection_driver_write_iovec_done(pn_connection_driver_t *, size_t n);
+
 /**
  * Close the write side. Call when IO can no longer be written to.
  */
@@ -198,8 +240,8 @@ PN_EXTERN void pn_connection_driver_close(pn_connection_driver_t * c);
  * Get the next event to handle.
  *
  * @return pointer is valid till the next call of
- * pn_connection_driver_next(). NULL if there are no more events available now,
- * reading/writing may produce more.
+ * pn_connection_driver_next(), it must not be kept with pn_incref(). NULL if
+ * there are no more events available now, reading/writing may produce more.
  */
 PN_EXTERN pn_event_t* pn_connection_driver_next_event(pn_connection_driver_t *);
 
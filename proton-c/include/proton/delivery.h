@@ -61,12 +61,32 @@ PN_EXTERN pn_delivery_tag_t pn_dtag(const char *bytes, size_t size);
  * tag. Links maintain a sequence of delivery object in the order that
  * they are created.
  *
+ * If the connection is bound to a new transport, a link attaching again
+ * resumes the unsettled deliveries it had on the wire, using the peer's
+ * unsettled map. An outgoing delivery the peer has an outcome for gets it
+ * as its remote state and is not sent again; one it has no outcome for
+ * is sent again with the resume flag. A delivery whose data was sent by
+ * ::pn_link_send_shared() or while still partial is no longer held, and
+ * gets a remote state of PN_RELEASED instead.
+ *
  * @param[in] link a link object
  * @param[in] tag the delivery tag
  * @return a newly created delivery, or NULL if there was an error
  */
 PN_EXTERN pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag);
 
+/**
+ * Create a delivery on a link with a tag from the link's own sequence.
+ *
+ * The tags are the link's delivery serial numbers, unique within the
+ * link and no longer than their significant bytes. A sender that
+ * creates all its deliveries this way need not manage tags itself.
+ *
+ * @param[in] link a link object
+ * @return a newly created delivery, or NULL if there was an error
+ */
+PN_EXTERN pn_delivery_t *pn_delivery_auto(pn_link_t *link);
+
 /**
  * @deprecated
  *
@@ -163,6 +183,30 @@ PN_EXTERN uint64_t pn_delivery_remote_state(pn_delivery_t *delivery);
  */
 PN_EXTERN bool pn_delivery_settled(pn_delivery_t *delivery);
 
+/**
+ * Get the message format of a delivery.
+ *
+ * The AMQP message-format of the transfers of a delivery says how its
+ * data is encoded. Zero, the default, is a standard AMQP message. The
+ * upper three bytes of any other format identify the vendor that
+ * defined it.
+ *
+ * @param[in] delivery a delivery object
+ * @return the message format
+ */
+PN_EXTERN uint32_t pn_delivery_message_format(pn_delivery_t *delivery);
+
+/**
+ * Set the message format of an outgoing delivery.
+ *
+ * The format is sent with the first transfer of the delivery, so it
+ * has no effect once data has been sent.
+ *
+ * @param[in] delivery a delivery object
+ * @param[in] format the message format
+ */
+PN_EXTERN void pn_delivery_set_message_format(pn_delivery_t *delivery, uint32_t format);
+
 /**
  * Get the amount of pending message data for a delivery.
  *
@@ -171,6 +215,19 @@ PN_EXTERN bool pn_delivery_settled(pn_delivery_t *delivery);
  */
 PN_EXTERN size_t pn_delivery_pending(pn_delivery_t *delivery);
 
+/**
+ * Get a read-only view of the pending message data of a delivery.
+ *
+ * This lets a receiver decode the data in place instead of copying
+ * it out with ::pn_link_recv. The view is only valid until the
+ * delivery's data is next read or more data arrives. Pass NULL to
+ * ::pn_link_recv to consume the data once it has been used.
+ *
+ * @param[in] delivery a delivery object
+ * @return the pending message data
+ */
+PN_EXTERN pn_bytes_t pn_delivery_bytes(pn_delivery_t *delivery);
+
 /**
  * Check if a delivery only has partial message data.
  *
@@ -386,6 +386,88 @@ PN_EXTERN void pn_collector_free(pn_collector_t *collector);
  */
 PN_EXTERN void pn_collector_release(pn_collector_t *collector);
 
+/**
+ * Give a collector a ring of reusable events.
+ *
+ * Up to capacity queued events are then taken from the ring and
+ * recycled in place, without allocating or reference counting the
+ * events themselves.  Each event in the ring is allocated the first
+ * time it is needed.  Further events come from the usual pool.  An
+ * event from the ring is only valid until it is popped or replaced by
+ * ::pn_collector_next(), so it must not be kept with pn_incref().
+ * Call this before any events are put on the collector.
+ *
+ * @param[in] collector a collector object
+ * @param[in] capacity the number of events in the ring
+ */
+PN_EXTERN void pn_collector_set_ring(pn_collector_t *collector, size_t capacity);
+
+/**
+ * Allocate events ahead of use, so that count events can be queued at
+ * once without allocating.  Events go into the collector's ring first,
+ * see ::pn_collector_set_ring(), then into its pool.
+ *
+ * @param[in] collector a collector object
+ * @param[in] count the number of events to have ready
+ * @return 0 on success, PN_OUT_OF_MEMORY if not all could be allocated
+ */
+PN_EXTERN int pn_collector_reserve(pn_collector_t *collector, size_t count);
+
+/**
+ * Choose whether a collector records events of a given type.
+ *
+ * Events of an unwanted type are discarded as they are put, so the
+ * application never sees them and no event is queued.  All types are
+ * wanted by default.  Passing ::PN_EVENT_NONE as the type applies the
+ * setting to every type at once.
+ *
+ * Only a handler that ignores a type entirely should turn it off;
+ * the engine itself does not depend on any event being delivered.
+ *
+ * @param[in] collector a collector object
+ * @param[in] type the event type, or ::PN_EVENT_NONE for all types
+ * @param[in] wanted true to record events of this type
+ */
+PN_EXTERN void pn_collector_set_wanted(pn_collector_t *collector, pn_event_type_t type, bool wanted);
+
+/**
+ * Check whether a collector records events of a given type.
+ *
+ * @param[in] collector a collector object
+ * @param[in] type the event type
+ * @return false if events of this type are discarded
+ */
+PN_EXTERN bool pn_collector_wanted(pn_collector_t *collector, pn_event_type_t type);
+
+/**
+ * Choose whether a collector queues at most one event of a given type
+ * for the same object.
+ *
+ * While an event of a unique type is queued and not yet consumed,
+ * putting another event of that type for the same context object is
+ * a no-op, wherever the first event is in the queue.  Once the event
+ * is returned by pn_collector_next() or popped, the next one is
+ * queued again.  ::PN_DELIVERY and ::PN_LINK_FLOW are unique by
+ * default: a handler reads the current state of the delivery or link,
+ * so a second event would report nothing new.  Passing
+ * ::PN_EVENT_NONE as the type applies the setting to every type.
+ *
+ * @param[in] collector a collector object
+ * @param[in] type the event type, or ::PN_EVENT_NONE for all types
+ * @param[in] unique true to queue one pending event per object
+ */
+PN_EXTERN void pn_collector_set_unique(pn_collector_t *collector, pn_event_type_t type, bool unique);
+
+/**
+ * Check whether a collector queues at most one event of a given type
+ * for the same object.
+ *
+ * @param[in] collector a collector object
+ * @param[in] type the event type
+ * @return true if events of this type are de-duplicated per object
+ */
+PN_EXTERN bool pn_collector_unique(pn_collector_t *collector, pn_event_type_t type);
+
 /**
  * Drain a collector: remove and discard all events.
  *
@@ -41,6 +41,12 @@ typedef pn_handler_t pn_flowcontroller_t;
 PNX_EXTERN pn_handshaker_t *pn_handshaker(void);
 PNX_EXTERN pn_iohandler_t *pn_iohandler(void);
 PNX_EXTERN pn_flowcontroller_t *pn_flowcontroller(int window);
+/* Start each receiver with window credit, then size it from the measured
+   delivery rate times the time credit takes to come back as deliveries,
+   never buffering more than max_bytes of deliveries of the average size */
+PNX_EXTERN pn_flowcontroller_t *pn_flowcontroller_adaptive(int window, size_t max_bytes);
+/* Replenish credit only once it falls to low_water, by default window - 1 */
+PNX_EXTERN void pn_flowcontroller_set_low_water(pn_flowcontroller_t *handler, int low_water);
 
 /**
  * @endcond
@@ -243,6 +243,22 @@ PN_EXTERN pn_link_t *pn_link_head(pn_connection_t *connection, pn_state_t state)
  */
 PN_EXTERN pn_link_t *pn_link_next(pn_link_t *link, pn_state_t state);
 
+/**
+ * Retrieve the next link of the same session and role that matches the
+ * given state mask.
+ *
+ * Used with ::pn_session_sender_head or ::pn_session_receiver_head to
+ * visit a session's senders or receivers without passing over the rest
+ * of the connection's links.
+ *
+ * @param[in] link the previous link obtained from
+ *                 ::pn_session_sender_head, ::pn_session_receiver_head
+ *                 or pn_link_session_next
+ * @param[in] state mask to match
+ * @return the next matching link, else NULL
+ */
+PN_EXTERN pn_link_t *pn_link_session_next(pn_link_t *link, pn_state_t state);
+
 /**
  * Open a link.
  *
@@ -551,6 +567,30 @@ PN_EXTERN pn_rcv_settle_mode_t pn_link_remote_rcv_settle_mode(pn_link_t *link);
  */
 PN_EXTERN int pn_link_unsettled(pn_link_t *link);
 
+/**
+ * Performance counters for a link, see pn_link_stats().
+ */
+typedef struct pn_link_stats_t {
+  uint64_t deliveries;          /**< Deliveries created on the link, sent or received */
+  uint64_t settled;             /**< Deliveries settled locally */
+  uint64_t settle_time;         /**< Total milliseconds from creation to local settlement of the settled deliveries */
+  size_t unsettled_max;         /**< Most deliveries unsettled at once */
+  uint64_t credit_blocked;      /**< Sender only: milliseconds a delivery was ready to send but the link had no credit */
+  uint64_t window_blocked;      /**< Sender only: milliseconds a delivery was ready to send but the session window was closed */
+} pn_link_stats_t;
+
+/**
+ * Get the performance counters of a link.
+ *
+ * The counters are always kept and only ever increase. The average settle
+ * latency is settle_time / settled. A period of blocking is counted once
+ * it ends, when the delivery is next sent.
+ *
+ * @param[in] link a link object
+ * @param[out] stats filled in with the link's counters
+ */
+PN_EXTERN void pn_link_stats(pn_link_t *link, pn_link_stats_t *stats);
+
 /**
  * Get the first unsettled delivery for a link.
  *
@@ -586,6 +626,85 @@ PN_EXTERN void pn_link_offered(pn_link_t *sender, int credit);
  */
 PN_EXTERN ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n);
 
+/**
+ * Send message data for the current delivery on a link by reference.
+ *
+ * Like ::pn_link_send(), but the bytes are not copied. The delivery
+ * holds a reference to owner, a proton object, until the bytes have
+ * been written into transfer frames, and owner must keep them valid
+ * and unchanged until then. One encoded message can so be sent on many
+ * links, for example to fan out to subscribers, without a copy per delivery.
+ *
+ * If the delivery already has data pending the bytes are copied as by
+ * ::pn_link_send(). Sending more data on the same delivery later copies
+ * any shared bytes not yet framed before appending.
+ *
+ * @param[in] sender a sender link object
+ * @param[in] bytes the start of the message data
+ * @param[in] n the number of bytes of message data
+ * @param[in] owner an object keeping the bytes valid, incref'd by the delivery
+ * @return the number of bytes sent, or an error code
+ */
+PN_EXTERN ssize_t pn_link_send_shared(pn_link_t *sender, const char *bytes, size_t n, void *owner);
+
+/**
+ * Send a caller owned buffer for the current delivery on a link
+ * without copying it.
+ *
+ * Like ::pn_link_send_shared(), but for bytes that are not held by a
+ * proton object. release(context) is called exactly once when the
+ * delivery no longer refers to the bytes, which may be before this
+ * returns if they were copied or could not be sent. The bytes must
+ * stay valid and unchanged until then. With a NULL release the bytes
+ * are copied as by ::pn_link_send().
+ *
+ * @param[in] sender a sender link object
+ * @param[in] bytes the start of the message data
+ * @param[in] n the number of bytes of message data
+ * @param[in] release called with context once the bytes are no longer needed
+ * @param[in] context passed to release
+ * @return the number of bytes sent, or an error code
+ */
+PN_EXTERN ssize_t pn_link_send_buffer(pn_link_t *sender, const char *bytes, size_t n,
+                                      void (*release)(void *context), void *context);
+
+/**
+ * Send a whole message pre-settled, for at-most-once senders.
+ *
+ * When the link is attached, has credit, has no current or queued
+ * delivery and the message fits one transfer frame, the transfer is
+ * framed straight into the transport's output: no ::pn_delivery_t is
+ * made and nothing is left to settle. Otherwise the message goes as a
+ * new delivery that is advanced and settled at once, so it is sent in
+ * order after those before it.
+ *
+ * No events are generated for the transfer, ::pn_link_credit shows the
+ * credit used.
+ *
+ * @param[in] sender a sender link object
+ * @param[in] bytes the encoded message
+ * @param[in] n the number of bytes in the message
+ * @return n, or an error code
+ */
+PN_EXTERN ssize_t pn_link_send_settled(pn_link_t *sender, const char *bytes, size_t n);
+
+/**
+ * Get how many more bytes the current delivery on a link should be
+ * given to keep message framing busy.
+ *
+ * A large message can be streamed with bounded memory by sending it
+ * in pieces: whenever this is non-zero (for example on each
+ * PN_LINK_FLOW event) pass up to this many bytes to ::pn_link_send().
+ * The transport frames buffered data as credit and the session window
+ * allow, and raises PN_LINK_FLOW each time it does, so the amount
+ * held for the delivery stays within a few frames.
+ *
+ * @param[in] sender a sender link object
+ * @return the number of bytes wanted, 0 if there is no current delivery
+ * or enough data is already buffered
+ */
+PN_EXTERN size_t pn_link_send_wanted(pn_link_t *sender);
+
 //PN_EXTERN void pn_link_abort(pn_sender_t *sender);
 
 /**
@@ -628,8 +747,11 @@ PN_EXTERN void pn_link_set_drain(pn_link_t *receiver, bool drain);
  * PN_EOS is returned, or verify that ::pn_delivery_partial is false,
  * and ::pn_delivery_pending is 0.
  *
+ * If bytes is NULL up to n bytes are discarded without being copied,
+ * which is useful after reading them in place with ::pn_delivery_bytes.
+ *
  * @param[in] receiver a receiving link object
- * @param[in] bytes a pointer to an empty buffer
+ * @param[in] bytes a pointer to an empty buffer, or NULL
  * @param[in] n the buffer capacity
  * @return the number of bytes received, PN_EOS, or an error code
  */
@@ -646,6 +768,29 @@ PN_EXTERN ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n);
  */
 PN_EXTERN bool pn_link_draining(pn_link_t *receiver);
 
+/**
+ * Get the scheduling weight of a sender link.
+ *
+ * @param[in] sender a sender link object
+ * @return the scheduling weight of the link
+ */
+PN_EXTERN uint32_t pn_link_weight(pn_link_t *sender);
+
+/**
+ * Set the scheduling weight of a sender link.
+ *
+ * When the transport interleaves transfers (see
+ * ::pn_transport_set_interleave()) each pending delivery may send up
+ * to its link's weight in frames per turn, so a link with weight 4
+ * gets four times the share of the connection of a link with the
+ * default weight of 1.  Give latency sensitive links a higher weight
+ * than bulk links sharing the same connection.
+ *
+ * @param[in] sender a sender link object
+ * @param[in] weight the weight, 0 is treated as 1
+ */
+PN_EXTERN void pn_link_set_weight(pn_link_t *sender, uint32_t weight);
+
 /**
  * **Experimental** - Get the maximum message size for a link.
  *
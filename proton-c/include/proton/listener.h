@@ -58,6 +58,20 @@ PNP_EXTERN pn_listener_t *pn_listener(void);
  */
 PNP_EXTERN void pn_listener_free(pn_listener_t *l);
 
+/**
+ * **Experimental** - Let other listeners bind the same address and port.
+ *
+ * Call before pn_proactor_listen().  Every listener sharing the port must
+ * enable this, they may belong to different proactors in the same process
+ * or to other processes of the same user.  The operating system spreads
+ * incoming connections over the listeners, so an application can run one
+ * proactor per group of cores on a single port without sharing locks.
+ *
+ * @return 0 on success, PN_STATE_ERR if the proactor or platform cannot
+ * share a port between listeners.
+ */
+PNP_EXTERN int pn_listener_set_reuseport(pn_listener_t *l, bool reuseport);
+
 /**
  * Bind @p connection to a new transport accepted from @p listener.
  * Errors are returned as @ref PN_TRANSPORT_CLOSED events by pn_proactor_wait().
@@ -111,6 +125,39 @@ PNP_EXTERN void pn_listener_close(pn_listener_t *l);
  */
 PNP_EXTERN pn_proactor_t *pn_listener_proactor(pn_listener_t *c);
 
+/**
+ * The number of incoming connections the listener has taken from the
+ * operating system that are still waiting for pn_listener_accept().
+ *
+ * A listener takes several connections per wakeup when many arrive at
+ * once, so this is a measure of how far the application is behind.
+ */
+PNP_EXTERN size_t pn_listener_backlog(pn_listener_t *l);
+
+/**
+ * **Experimental** - Counts of the listener running out of file descriptors,
+ * see pn_listener_overflow().
+ */
+typedef struct pn_listener_overflow_t {
+  uint64_t overflows;           /**< Times accepting stopped because the process had no free file descriptors */
+  uint64_t shed;                /**< Incoming connections refused with a TCP reset while out of file descriptors */
+} pn_listener_overflow_t;
+
+/**
+ * **Experimental** - Copy the listener's file descriptor overflow counters.
+ *
+ * When the process runs out of file descriptors a listener stops
+ * accepting and retries a little later, or sooner when the proactor
+ * closes a connection.  A proactor that keeps a spare descriptor uses
+ * it to reset the connections waiting to be accepted, so that clients
+ * fail at once rather than time out.
+ *
+ * @note Thread safe.
+ *
+ * @return 0 on success, PN_STATE_ERR if the proactor does not count overflows.
+ */
+PNP_EXTERN int pn_listener_overflow(pn_listener_t *l, pn_listener_overflow_t *overflow);
+
 /**
  * Return the listener associated with an event.
  *
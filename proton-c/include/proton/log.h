@@ -42,6 +42,28 @@ extern "C" {
  */
 typedef void (*pn_logger_t)(const char *message);
 
+/**
+ * The parts of the library that log, each with its own level.
+ */
+typedef enum {
+  PN_SUBSYSTEM_ENGINE,      /**< Codec, engine and transport messages */
+  PN_SUBSYSTEM_EVENT,       /**< Events dispatched by a proactor */
+  PN_SUBSYSTEM_MESSENGER,   /**< The messenger */
+  PN_SUBSYSTEM_ALL          /**< Every subsystem, for pn_log_set_level() */
+} pn_log_subsystem_t;
+
+/**
+ * How much a subsystem logs, each level includes the ones before it.
+ */
+typedef enum {
+  PN_LEVEL_NONE,
+  PN_LEVEL_ERROR,
+  PN_LEVEL_WARNING,
+  PN_LEVEL_INFO,
+  PN_LEVEL_DEBUG,
+  PN_LEVEL_TRACE
+} pn_log_level_t;
+
 /**
  * Enable/disable global logging.
  *
@@ -60,6 +82,41 @@ PN_EXTERN void pn_log_enable(bool enabled);
  */
 PN_EXTERN void pn_log_logger(pn_logger_t logger);
 
+/**
+ * Set the level of one subsystem, or of all of them.
+ *
+ * A subsystem without a level logs everything while logging is enabled
+ * by pn_log_enable() or PN_TRACE_LOG, and nothing otherwise.  The
+ * PN_LOG_LEVEL environment variable sets levels at start up, either one
+ * level for all subsystems or a list such as "event=trace,engine=error".
+ */
+PN_EXTERN void pn_log_set_level(pn_log_subsystem_t subsystem, pn_log_level_t level);
+
+/**
+ * Check whether a subsystem logs messages of a level.
+ */
+PN_EXTERN bool pn_log_level_enabled(pn_log_subsystem_t subsystem, pn_log_level_t level);
+
+/**
+ * Write log messages from a background thread.
+ *
+ * Once on, a message is formatted on the thread that logs it and queued
+ * in a fixed ring, and a background thread calls the logger, so a slow
+ * logger does not stall I/O threads.  Queued messages are cut at 511
+ * bytes and if the ring is full a message is dropped and counted, the
+ * count is logged when there is room again.  Turning it off writes what
+ * is queued first, as does exiting the process.  The default transport
+ * tracer writes through the logger, so its traces are queued too.  Setting the
+ * PN_LOG_ASYNC environment variable turns it on at start up.  Where
+ * there are no POSIX threads messages are always written at once.
+ */
+PN_EXTERN void pn_log_set_async(bool async);
+
+/**
+ * Wait until the background thread has written every queued message.
+ */
+PN_EXTERN void pn_log_flush(void);
+
 /**
  * @endcond
  */
@@ -660,6 +660,10 @@ PN_EXTERN int            pn_message_set_reply_to_group_id (pn_message_t *msg, co
  * The ::pn_data_t must either be empty or consist of a symbol keyed
  * map in order to be considered valid delivery instructions.
  *
+ * A section received by pn_message_decode() is decoded on first
+ * access: if it is malformed the returned data is empty and the error
+ * is set on pn_message_error().
+ *
  * @param[in] msg a message object
  * @return a pointer to the delivery instructions
  */
@@ -676,6 +680,10 @@ PN_EXTERN pn_data_t *pn_message_instructions(pn_message_t *msg);
  * The ::pn_data_t must either be empty or consist of a symbol keyed
  * map in order to be considered valid message annotations.
  *
+ * A section received by pn_message_decode() is decoded on first
+ * access: if it is malformed the returned data is empty and the error
+ * is set on pn_message_error().
+ *
  * @param[in] msg a message object
  * @return a pointer to the message annotations
  */
@@ -692,6 +700,10 @@ PN_EXTERN pn_data_t *pn_message_annotations(pn_message_t *msg);
  * The ::pn_data_t must either be empty or consist of a string keyed
  * map in order to be considered valid message properties.
  *
+ * A section received by pn_message_decode() is decoded on first
+ * access: if it is malformed the returned data is empty and the error
+ * is set on pn_message_error().
+ *
  * @param[in] msg a message object
  * @return a pointer to the message properties
  */
@@ -705,6 +717,10 @@ PN_EXTERN pn_data_t *pn_message_properties(pn_message_t *msg);
  * and may be used to both access and modify the content of the
  * message body.
  *
+ * A section received by pn_message_decode() is decoded on first
+ * access: if it is malformed the returned data is empty and the error
+ * is set on pn_message_error().
+ *
  * @param[in] msg a message object
  * @return a pointer to the message body
  */
@@ -717,6 +733,10 @@ PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
  * cleared and replaced with the content from the provided binary
  * data.
  *
+ * Annotations, application properties and the body are decoded when
+ * first accessed, so an encoding error inside one of them is reported
+ * through pn_message_error() at that point rather than by this call.
+ *
  * @param[in] msg a message object
  * @param[in] bytes the start of the encoded AMQP data
  * @param[in] size the size of the encoded AMQP data
@@ -724,6 +744,28 @@ PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
  */
 PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size);
 
+/**
+ * Decode message content like pn_message_decode(), but leave out the
+ * sections whose descriptor is one of the ulongs in skip. A skipped
+ * section is neither copied nor decoded, and the message reads and
+ * encodes as though it was never sent. Values nested in the other
+ * sections with one of these descriptors are kept in their encoding,
+ * see pn_data_decode_partial().
+ *
+ * For example skipping 0x75, 0x76 and 0x77, the body sections, gives
+ * the header and properties of a message without the cost of a large
+ * body.
+ *
+ * @param[in] msg a message object
+ * @param[in] bytes the start of the encoded AMQP data
+ * @param[in] size the size of the encoded AMQP data
+ * @param[in] skip the descriptors of the sections to leave out
+ * @param[in] count the number of descriptors in skip
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_message_decode_partial(pn_message_t *msg, const char *bytes, size_t size,
+                                        const uint64_t *skip, size_t count);
+
 /**
  * Encode/save message content as AMQP formatted binary data.
  *
@@ -739,11 +781,102 @@ PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t siz
  */
 PN_EXTERN int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size);
 
+/**
+ * Encode/save message content as AMQP formatted binary data, growing
+ * the buffer to fit as it is written.
+ *
+ * The content is encoded in a single pass, so unlike
+ * pn_message_encode() there is no need to size it first or to retry
+ * with a larger buffer on PN_OVERFLOW.
+ *
+ * @param[in] msg a message object
+ * @param[in,out] buf the buffer to encode into from its start. If
+ * buf->start is NULL or buf->size is too small, buf->start is grown
+ * with realloc() and buf is updated. The caller must free() buf->start.
+ * @return the size of the encoded message or an error code on failure
+ */
+PN_EXTERN ssize_t pn_message_encode2(pn_message_t *msg, pn_rwbytes_t *buf);
+
+/**
+ * Get the number of bytes pn_message_encode() needs for the current
+ * message content.
+ *
+ * Sizing a message does not copy the content, so a buffer can be
+ * allocated once and the message encoded into it in a single pass.
+ *
+ * @param[in] msg a message object
+ * @return the encoded size or an error code on failure
+ */
+PN_EXTERN ssize_t pn_message_encoded_size(pn_message_t *msg);
+
+/**
+ * Encode a message straight into the current delivery of a sender.
+ *
+ * This has the same effect as encoding the message into a buffer and
+ * passing that to pn_link_send(), without the intermediate buffer.
+ * The delivery is not advanced; call pn_link_advance() once the
+ * message is complete.
+ *
+ * @param[in] msg a message object
+ * @param[in] sender a sending link with a current delivery
+ * @return the number of bytes sent, PN_EOS if the link has no current
+ * delivery or another error code on failure
+ */
+PN_EXTERN ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender);
+
 /**
  * Save message content into a pn_data_t object data. The data object will first be cleared.
  */
 PN_EXTERN int pn_message_data(pn_message_t *msg, pn_data_t *data);
 
+/**
+ * Check if proton was built with message body compression.
+ *
+ * Without it ::pn_message_compress() leaves bodies as they are and
+ * ::pn_message_decompress() fails on compressed ones.
+ *
+ * @return true if bodies can be compressed
+ */
+PN_EXTERN bool pn_message_compress_present(void);
+
+/**
+ * Compress the body of a message.
+ *
+ * A body that is a single binary of at least min_size bytes and has no
+ * content-encoding is replaced by its zlib deflate encoding and the
+ * content-encoding is set to "deflate". Anything else, or a body that
+ * would not shrink, is left alone. Text such as JSON sent as binary
+ * typically shrinks several times over.
+ *
+ * @param[in] msg a message object
+ * @param[in] min_size the smallest body worth compressing
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_message_compress(pn_message_t *msg, size_t min_size);
+
+/**
+ * The default largest body ::pn_message_decompress() inflates to.
+ */
+#define PN_DEFAULT_DECOMPRESS_MAX (64 * 1024 * 1024)
+
+/**
+ * Undo ::pn_message_compress().
+ *
+ * A binary body with content-encoding "deflate" is inflated and the
+ * content-encoding is cleared. Any other message is left alone.
+ *
+ * The body comes from the peer, and a small one can inflate to a
+ * huge one: a body that would inflate to more than max_size bytes
+ * is left compressed and ::PN_OVERFLOW is returned.
+ *
+ * @param[in] msg a message object
+ * @param[in] max_size the largest inflated body accepted, for example
+ * ::PN_DEFAULT_DECOMPRESS_MAX
+ * @return zero on success or an error code on failure, see
+ * ::pn_message_error()
+ */
+PN_EXTERN int pn_message_decompress(pn_message_t *msg, size_t max_size);
+
 /** @cond INTERNAL */
 
 /** Construct a message with extra storage */
@@ -0,0 +1,131 @@
+#ifndef PROTON_MESSAGE_SELECTOR_H
+#define PROTON_MESSAGE_SELECTOR_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/import_export.h>
+#include <proton/error.h>
+#include <proton/type_compat.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ *
+ * @copybrief message_selector
+ *
+ * @addtogroup message_selector
+ * @{
+ */
+
+/**
+ * **Experimental** - A compiled message selector.
+ *
+ * A selector is a JMS style filter expression, for example
+ * `"colour = 'red' AND JMSPriority > 4"`. It is compiled once and
+ * can then be matched against any number of encoded messages. Only
+ * the message sections the expression refers to are examined, and
+ * only the values it names are decoded: the body is never read.
+ *
+ * The expression language is the SQL92 subset of JMS message
+ * selectors: string, integer, floating point and boolean literals;
+ * `+ - * /`; `= <> < > <= >=`; `AND`, `OR`, `NOT` with three-valued
+ * logic; `[NOT] BETWEEN`, `[NOT] IN`, `[NOT] LIKE ... [ESCAPE ...]`
+ * and `IS [NOT] NULL`. Keywords are not case sensitive.
+ *
+ * Identifiers name application properties, except for these which
+ * name header and properties fields:
+ *
+ * - `JMSDeliveryMode`: `'PERSISTENT'` if the message is durable,
+ *   otherwise `'NON_PERSISTENT'`
+ * - `JMSPriority`: the priority, ::PN_DEFAULT_PRIORITY if not set
+ * - `JMSMessageID`, `JMSCorrelationID`: the message and correlation id
+ * - `JMSType`: the subject
+ * - `JMSTimestamp`, `JMSExpiration`: the creation and absolute
+ *   expiry times in milliseconds
+ * - `JMSXGroupID`, `JMSXGroupSeq`: the group id and sequence
+ *
+ * A property or field that is absent, or has a type a selector
+ * cannot compare, is NULL.
+ */
+typedef struct pn_message_selector_t pn_message_selector_t;
+
+/**
+ * Compile a selector from expression.
+ *
+ * An empty or NULL expression selects every message. If expression
+ * is not valid the error is available from
+ * ::pn_message_selector_error() and the selector matches nothing.
+ * Free the selector with ::pn_message_selector_free().
+ *
+ * @param[in] expression the selector text
+ * @return a new selector, NULL if out of memory
+ */
+PN_EXTERN pn_message_selector_t *pn_message_selector(const char *expression);
+
+/**
+ * Free a selector.
+ *
+ * @param[in] selector a selector or NULL
+ */
+PN_EXTERN void pn_message_selector_free(pn_message_selector_t *selector);
+
+/**
+ * The compile error for a selector.
+ *
+ * The error code is zero if the expression compiled, otherwise
+ * ::PN_ARG_ERR with text naming the offending position.
+ *
+ * @param[in] selector a selector
+ * @return the selector's error, owned by the selector
+ */
+PN_EXTERN pn_error_t *pn_message_selector_error(pn_message_selector_t *selector);
+
+/**
+ * Match a selector against an encoded message.
+ *
+ * A compiled selector is not modified by matching, so several
+ * threads may match with the same selector at once.
+ *
+ * @param[in] selector a selector
+ * @param[in] bytes the encoded message, as from ::pn_message_encode()
+ * or a complete delivery
+ * @param[in] size the size of the encoded message
+ * @return 1 if the expression is true for the message, 0 if it is
+ * false or unknown, ::PN_ARG_ERR if the selector did not compile or
+ * another error code if a section it reads is malformed
+ */
+PN_EXTERN int pn_message_selector_match(pn_message_selector_t *selector, const char *bytes, size_t size);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* message_selector.h */
@@ -415,6 +415,36 @@ PNX_EXTERN int pn_messenger_get_outgoing_window(pn_messenger_t *messenger);
  */
 PNX_EXTERN int pn_messenger_set_outgoing_window(pn_messenger_t *messenger, int window);
 
+/**
+ * Get the outgoing spill threshold of a messenger.
+ *
+ * Messages waiting on the outgoing queue are kept in memory, encoded,
+ * until their size reaches this threshold.  Messages put beyond it are
+ * appended to a temporary file and read back when credit lets them be
+ * sent, so a producer can keep putting while its consumers are away
+ * without holding every message in memory.  A message the file cannot
+ * take stays in memory.
+ *
+ * The default threshold is 0, which keeps every message in memory.
+ *
+ * @param[in] messenger a messenger object
+ * @return the outgoing spill threshold in bytes
+ */
+PNX_EXTERN size_t pn_messenger_get_outgoing_spill(pn_messenger_t *messenger);
+
+/**
+ * Set the outgoing spill threshold of a messenger.
+ *
+ * See ::pn_messenger_get_outgoing_spill() for details.  A new threshold
+ * applies to messages put after it is set.
+ *
+ * @param[in] messenger a messenger object
+ * @param[in] threshold encoded bytes to keep in memory, or 0 for no limit
+ * @return an error or zero on success
+ * @see error.h
+ */
+PNX_EXTERN int pn_messenger_set_outgoing_spill(pn_messenger_t *messenger, size_t threshold);
+
 /**
  * Get the size of a messenger's incoming window.
  *
@@ -556,6 +586,23 @@ PNX_EXTERN const char *pn_subscription_address(pn_subscription_t *sub);
  */
 PNX_EXTERN int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg);
 
+/**
+ * Puts an array of messages onto the messenger's outgoing queue.
+ *
+ * This is equivalent to calling ::pn_messenger_put() for each message
+ * in turn, but looks up the outgoing link once for each run of
+ * consecutive messages with the same address.  If a message cannot be
+ * put, the messages before it remain on the outgoing queue and
+ * ::pn_messenger_outgoing_tracker() refers to the last of them.
+ *
+ * @param[in] messenger a messenger object
+ * @param[in] msgs the messages to put on the outgoing queue
+ * @param[in] count the number of messages in msgs
+ * @return an error code or zero on success
+ * @see error.h
+ */
+PNX_EXTERN int pn_messenger_put_batch(pn_messenger_t *messenger, pn_message_t **msgs, size_t count);
+
 /**
  * Track the status of a delivery.
  *
@@ -739,6 +786,23 @@ PNX_EXTERN int pn_messenger_receiving(pn_messenger_t *messenger);
  */
 PNX_EXTERN int pn_messenger_get(pn_messenger_t *messenger, pn_message_t *message);
 
+/**
+ * Get up to count messages from the head of a messenger's incoming queue.
+ *
+ * Each message is retrieved as by ::pn_messenger_get(), so a NULL
+ * entry in msgs discards its message, and
+ * ::pn_messenger_incoming_tracker() refers to the last message
+ * retrieved.
+ *
+ * @param[in] messenger a messenger object
+ * @param[out] msgs upon return the first entries contain the messages retrieved
+ * @param[in] count the number of entries in msgs
+ * @return the number of messages retrieved, ::PN_EOS if the incoming
+ * queue was empty or an error code
+ * @see error.h
+ */
+PNX_EXTERN int pn_messenger_get_batch(pn_messenger_t *messenger, pn_message_t **msgs, size_t count);
+
 /**
  * Get a tracker for the message most recently retrieved by
  * ::pn_messenger_get().
@@ -306,6 +306,20 @@ PN_EXTERN void *pn_iterator_next(pn_iterator_t *iterator);
 
 #define PN_LEGCTX ((pn_handle_t) 0)
 
+/**
+   Handles below PN_RECORD_SLOTS index a fixed slot of the record directly
+   instead of being searched for, so they are cheap to look up on every
+   event. They are reserved for proton itself:
+
+   - 0 is PN_LEGCTX
+   - 1 is the proactor's connection and listener context
+   - 2 to 5 are the C++ binding's connection, listener, session and link contexts
+
+   Other handles, including all PN_HANDLE() handles, work as before.
+ */
+#define PN_RECORD_SLOTS 6
+#define PN_RECORD_SLOT(n) ((pn_handle_t) (uintptr_t) (n))
+
 /**
    PN_HANDLE is a trick to define a unique identifier by using the address of a static variable.
    You MUST NOT use it in a .h file, since it must be defined uniquely in one compilation unit.
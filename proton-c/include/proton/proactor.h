@@ -92,6 +92,55 @@ PNP_EXTERN pn_proactor_t *pn_proactor(void);
  */
 PNP_EXTERN void pn_proactor_free(pn_proactor_t *proactor);
 
+/**
+ * **Experimental** - Tuning options, see pn_proactor_set_option().
+ *
+ * The defaults suit most applications.  Counts and sizes of 0 mean no
+ * limit, or the system default for socket options; flags are on when
+ * greater than 0.
+ */
+typedef enum {
+  PN_PROACTOR_HOG_MAX,          /**< Times a connection's batch is topped up for a thread before it yields, default 1 */
+  PN_PROACTOR_BATCH_EVENTS,     /**< Most events in one connection batch */
+  PN_PROACTOR_TURN_BYTES,       /**< Most bytes read, and most written, by a connection in one turn */
+  PN_PROACTOR_HANDSHAKE_MAX,    /**< Most threads doing I/O at once for connections the peer has not opened yet */
+  PN_PROACTOR_SO_RCVBUF,        /**< SO_RCVBUF of each socket */
+  PN_PROACTOR_SO_SNDBUF,        /**< SO_SNDBUF of each socket */
+  PN_PROACTOR_TCP_NOTSENT_LOWAT, /**< TCP_NOTSENT_LOWAT of each socket */
+  PN_PROACTOR_BUSY_POLL,        /**< SO_BUSY_POLL microseconds of each connection socket */
+  PN_PROACTOR_EDGE,             /**< Flag: poll connected sockets edge-triggered */
+  PN_PROACTOR_WRITE_MORE,       /**< Flag: send output flushed in the middle of a batch with MSG_MORE */
+  PN_PROACTOR_DISPOSITION_DELAY, /**< pn_transport_set_disposition_delay() of each transport */
+  PN_PROACTOR_DISPOSITION_LIMIT, /**< pn_transport_set_disposition_limit() of each transport, -1 (the default) leaves it */
+  PN_PROACTOR_INTERLEAVE,       /**< Flag: pn_transport_set_interleave() of each transport */
+  PN_PROACTOR_HIBERNATE,        /**< Milliseconds without events before a connection hibernates, 0 (the default) never */
+  PN_PROACTOR_LOCAL_WAKE,       /**< Flag: a thread handling a batch runs the connections it wakes itself */
+  PN_PROACTOR_SPIN,             /**< Microseconds pn_proactor_wait() polls for work before it sleeps */
+  PN_PROACTOR_RESOLVERS,        /**< Address resolver threads, 0 resolves on the calling thread, default 2 */
+  PN_PROACTOR_DNS_TTL,          /**< Milliseconds a resolved address is cached, default 10000 */
+  PN_PROACTOR_DNS_NEGATIVE_TTL, /**< Milliseconds a resolver error is cached, default 1000 */
+  PN_PROACTOR_SHM_SIZE,         /**< Bytes in each direction of a "shm:" connection's rings, default 256KiB */
+  PN_PROACTOR_OVERFLOW_RETRY    /**< Milliseconds between accept retries when out of file descriptors, default 100 */
+} pn_proactor_option_t;
+
+/**
+ * **Experimental** - Set a tuning option.
+ *
+ * Set options before the proactor connects or listens, connections
+ * and listeners that already exist may keep the old value.
+ *
+ * Each option is also read from the environment variable of the same
+ * name, for example PN_PROACTOR_HANDSHAKE_MAX=4, when the proactor is
+ * made.  A variable that is set overrides the application, so a
+ * deployment can be tuned without changing it: the option keeps the
+ * variable's value.
+ *
+ * @return 0 on success or if the environment overrides the option,
+ * PN_ARG_ERR if value is out of range, PN_STATE_ERR if this proactor
+ * does not have the option.
+ */
+PNP_EXTERN int pn_proactor_set_option(pn_proactor_t *proactor, pn_proactor_option_t option, int value);
+
 /**
  * Bind @p connection to a new @ref transport connected to @p addr.
  * Errors are returned as  @ref PN_TRANSPORT_CLOSED events by pn_proactor_wait().
@@ -109,6 +158,13 @@ PNP_EXTERN void pn_proactor_free(pn_proactor_t *proactor);
  * @param[in] addr the "host:port" network address, constructed by pn_proactor_addr()
  * An empty host will connect to the local host via the default protocol (IPV6 or IPV4).
  * An empty port will connect to the standard AMQP port (5672).
+ * On POSIX "unix:<path>" connects to a local socket at <path>, which must start
+ * with '/' or '.'; on Linux "unix:@<name>" uses the abstract socket namespace.
+ * "inproc:<name>" connects to a listener on "inproc:<name>" in the same
+ * process, with no network address.  Only the epoll proactor supports it.
+ * "shm:<path>" connects over a local socket like "unix:<path>", then moves
+ * the data through rings in memory shared with the peer, so both ends must be
+ * on the same host.  Only the epoll proactor on Linux supports it.
  *
  * @param[in] connection @ref connection to be connected to @p addr.
  *
@@ -130,6 +186,13 @@ PNP_EXTERN void pn_proactor_connect(pn_proactor_t *proactor, pn_connection_t *co
  * @param[in] addr the "host:port" network address, constructed by pn_proactor_addr()
  * An empty host will listen for all protocols (IPV6 and IPV4) on all local interfaces.
  * An empty port will listen on the standard AMQP port (5672).
+ * A "unix:<path>" or "unix:@<name>" address listens on a local socket, as for
+ * pn_proactor_connect(). The socket file is removed by pn_listener_close(), but
+ * a file left behind by a process that stopped without closing is not.
+ * An "inproc:<name>" address listens for pn_proactor_connect() to the same
+ * name from this process, see pn_proactor_connect().  Listening on a name
+ * another open listener has fails with an "in use" error.
+ * A "shm:<path>" address listens on a local socket for "shm:" connections.
 
  * @param[in] backlog of un-handled connection requests to allow before refusing
  * connections. If @p addr resolves to multiple interface/protocol combinations,
@@ -160,6 +223,27 @@ PNP_EXTERN void pn_proactor_listen(pn_proactor_t *proactor, pn_listener_t *liste
  */
 PNP_EXTERN void pn_proactor_disconnect(pn_proactor_t *proactor, pn_condition_t *condition);
 
+/**
+ * **Experimental** - Disconnect all connections and listeners belonging to the
+ * proactor without waiting for them, as pn_proactor_disconnect() does.
+ *
+ * Only notes which connections and listeners exist at the time of the call,
+ * the threads in pn_proactor_wait() then close them in parallel, a share
+ * each.  Progress is reported by the usual @ref PN_TRANSPORT_CLOSED and @ref
+ * PN_LISTENER_CLOSE events, and @ref PN_PROACTOR_INACTIVE when all are closed
+ * as for pn_proactor_disconnect().
+ *
+ * Proactors other than epoll treat it as pn_proactor_disconnect().
+ *
+ * @note Thread safe.
+ *
+ * @param proactor the proactor
+ *
+ * @param condition if not NULL the condition data is copied to each
+ * disconnected transports and listener and is available in the close event.
+ */
+PNP_EXTERN void pn_proactor_disconnect_async(pn_proactor_t *proactor, pn_condition_t *condition);
+
 /**
  * Wait until there are @ref proactor_events to handle.
  *
@@ -186,6 +270,21 @@ PNP_EXTERN pn_event_batch_t *pn_proactor_wait(pn_proactor_t *proactor);
  */
 PNP_EXTERN pn_event_batch_t *pn_proactor_get(pn_proactor_t *proactor);
 
+/**
+ * Wait until there are @ref proactor_events to handle, then return up to @p n
+ * batches that are ready without blocking again.
+ *
+ * Each batch is independent, as if returned by a separate call to
+ * pn_proactor_wait(), and must be passed to pn_proactor_done() when finished.
+ *
+ * @note Thread Safe.
+ *
+ * @param[out] batches array of at least @p n batch pointers
+ * @param[in] n maximum number of batches to return, must be at least 1
+ * @return the number of batches stored in @p batches, at least 1
+ */
+PNP_EXTERN size_t pn_proactor_wait_batches(pn_proactor_t *proactor, pn_event_batch_t **batches, size_t n);
+
 /**
  * Call when finished handling a batch of events.
  *
@@ -293,6 +392,73 @@ PNP_EXTERN pn_proactor_t *pn_event_proactor(pn_event_t *event);
  */
 PNP_EXTERN pn_millis_t pn_proactor_now(void);
 
+/**
+ * Number of buckets in a ::pn_proactor_histogram_t.
+ */
+#define PN_PROACTOR_HISTOGRAM_BUCKETS 40
+
+/**
+ * **Experimental** - A histogram of durations in nanoseconds.
+ *
+ * Bucket 0 counts durations up to 1ns, bucket i counts durations d with
+ * 2^(i-1) < d <= 2^i. The last bucket also counts anything longer.
+ */
+typedef struct pn_proactor_histogram_t {
+  uint64_t count;               /**< Number of durations recorded */
+  uint64_t total;               /**< Sum of the durations */
+  uint64_t max;                 /**< Longest duration */
+  uint64_t buckets[PN_PROACTOR_HISTOGRAM_BUCKETS];
+} pn_proactor_histogram_t;
+
+/**
+ * **Experimental** - Latency statistics kept by the proactor, see pn_proactor_stats().
+ */
+typedef struct pn_proactor_stats_t {
+  pn_proactor_histogram_t dispatch; /**< From socket readiness to the connection's batch being returned */
+  pn_proactor_histogram_t batch;    /**< From a connection batch being returned to pn_proactor_done() */
+  pn_proactor_histogram_t wake;     /**< Time a connection waited for a thread after being scheduled */
+  pn_proactor_histogram_t flush;    /**< From output being ready to send to the socket taking all of it */
+} pn_proactor_stats_t;
+
+/**
+ * **Experimental** - Copy the latency statistics for all connections of the proactor.
+ *
+ * Statistics are only kept if the PN_PROACTOR_STATS environment variable
+ * is set to a positive number when the proactor is created, they add a
+ * clock read and a few atomic updates to each step measured.
+ *
+ * The copy is taken while other threads may be recording, so the histograms
+ * can differ slightly from each other and from their count.
+ *
+ * Not every proactor implementation can measure every step, histograms it
+ * cannot measure stay empty.
+ *
+ * @note Thread safe.
+ *
+ * @return 0 on success, PN_STATE_ERR if statistics are not enabled.
+ */
+PNP_EXTERN int pn_proactor_stats(pn_proactor_t *proactor, pn_proactor_stats_t *stats);
+
+/**
+ * **Experimental** - Copy the latency statistics for a single connection, see pn_proactor_stats().
+ *
+ * @note Not thread safe. Call only while handling events for @p connection.
+ *
+ * @return 0 on success, PN_STATE_ERR if statistics are not enabled or the
+ * connection does not belong to a proactor.
+ */
+PNP_EXTERN int pn_connection_proactor_stats(pn_connection_t *connection, pn_proactor_stats_t *stats);
+
+/**
+ * **Experimental** - Estimate a percentile of a histogram.
+ *
+ * @param histogram the histogram
+ * @param percent between 0 and 100
+ * @return the upper bound in nanoseconds of the bucket holding the
+ * percentile, limited to the histogram max. 0 if the histogram is empty.
+ */
+PNP_EXTERN uint64_t pn_proactor_histogram_percentile(const pn_proactor_histogram_t *histogram, double percent);
+
 /**
  * @defgroup proactor_events Events
  *
@@ -151,6 +151,29 @@ PNX_EXTERN void pn_reactor_stop(pn_reactor_t *reactor);
 PNX_EXTERN void pn_reactor_run(pn_reactor_t *reactor);
 PNX_EXTERN pn_task_t *pn_reactor_schedule(pn_reactor_t *reactor, int delay, pn_handler_t *handler);
 
+/**
+ * Hand connections accepted by reactor's acceptors to worker, so they
+ * are served on the thread that runs worker.
+ *
+ * Accepted connections are spread round robin over the workers added
+ * to a reactor.  A worker's connections dispatch their events to the
+ * worker's own handler, not the acceptor's, and
+ * ::pn_connection_acceptor() returns NULL for them.  Connections from
+ * an acceptor with an SSL domain only go to workers given their own
+ * ssl_domain, as domains are not thread safe; others are served by
+ * reactor itself.
+ *
+ * Call this before worker is run.  Each worker keeps running until
+ * reactor is freed and its connections have closed.  Free reactor
+ * before its workers.
+ *
+ * @param[in] reactor the reactor that runs the acceptors
+ * @param[in] worker a reactor run by another thread
+ * @param[in] ssl_domain domain for connections from SSL acceptors, or NULL
+ * @return 0 on success or an error code
+ */
+PNX_EXTERN int pn_reactor_add_worker(pn_reactor_t *reactor, pn_reactor_t *worker, pn_ssl_domain_t *ssl_domain);
+
 
 PNX_EXTERN void pn_acceptor_set_ssl_domain(pn_acceptor_t *acceptor, pn_ssl_domain_t *domain);
 PNX_EXTERN void pn_acceptor_close(pn_acceptor_t *acceptor);
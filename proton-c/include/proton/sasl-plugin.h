@@ -128,6 +128,12 @@ PN_EXTERN void  pnx_sasl_set_selected_mechanism(pn_transport_t *transport, const
 PN_EXTERN void  pnx_sasl_succeed_authentication(pn_transport_t *transport, const char *username);
 PN_EXTERN void  pnx_sasl_fail_authentication(pn_transport_t *transport);
 
+// Process wide cache of successful server authentications, see pn_sasl_config_credential_cache()
+// If mechanism and response were cached, succeed authentication as the cached user and return true
+PN_EXTERN bool  pnx_sasl_cached_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response);
+// Remember a successful authentication by mechanism with initial response, for the current user
+PN_EXTERN void  pnx_sasl_cache_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response);
+
 PN_EXTERN void  pnx_sasl_set_implementation(pn_transport_t *transport, const pnx_sasl_implementation *impl, void *context);
 PN_EXTERN void  pnx_sasl_set_default_implementation(const pnx_sasl_implementation *impl);
 
@@ -170,6 +170,38 @@ PN_EXTERN void pn_sasl_set_allow_insecure_mechs(pn_sasl_t *sasl, bool insecure);
  */
 PN_EXTERN bool pn_sasl_get_allow_insecure_mechs(pn_sasl_t *sasl);
 
+/**
+ * Send the client's first SASL frame without waiting for the server's mechanisms
+ *
+ * By default a client waits for the server's list of mechanisms before it
+ * sends SASL-INIT, and only sends the AMQP header and frames once
+ * authentication has succeeded, costing a round trip for each.
+ *
+ * A pipelined client sends the SASL header, SASL-INIT, the AMQP header and
+ * any AMQP frames that are ready (such as OPEN, BEGIN and ATTACH) in its
+ * first flight, as the AMQP specification allows. This only happens if
+ * pn_sasl_allowed_mechs() restricts the client to exactly one of
+ * ANONYMOUS, PLAIN or EXTERNAL and that mechanism can be used, otherwise
+ * the client negotiates as usual. If the server does not offer the
+ * mechanism or authentication fails the transport fails as usual, but the
+ * AMQP frames will already have been sent.
+ *
+ * This has no effect on a server, which always accepts a pipelined client.
+ *
+ * @param[in] sasl the SASL layer
+ * @param[in] pipelined true to pipeline the client's first flight
+ */
+PN_EXTERN void pn_sasl_set_pipelined(pn_sasl_t *sasl, bool pipelined);
+
+/**
+ * Return the current value for pipelined
+ *
+ * This is reset to false once the client has found it cannot pipeline.
+ *
+ * @param[in] sasl the SASL layer
+ */
+PN_EXTERN bool pn_sasl_get_pipelined(pn_sasl_t *sasl);
+
 /**
  * Set the sasl configuration name
  *
@@ -201,6 +233,27 @@ PN_EXTERN void pn_sasl_config_name(pn_sasl_t *sasl, const char *name);
  */
 PN_EXTERN void pn_sasl_config_path(pn_sasl_t *sasl, const char *path);
 
+/**
+ * Configure the server's cache of successful authentications
+ *
+ * A server normally checks every client's credentials with its
+ * authentication backend. With the cache, a client that authenticates
+ * again with the same single step mechanism (PLAIN) and the same
+ * credentials within ttl milliseconds of a successful check is accepted
+ * without asking the backend. Only a digest of the credentials is kept.
+ *
+ * A changed or revoked password is still accepted until its cache entry
+ * expires, so keep ttl short. The cache is off by default.
+ *
+ * The cache is process wide and only used with extended SASL, see
+ * pn_sasl_extended(). Calling this clears it.
+ *
+ * @param[in] sasl the SASL layer
+ * @param[in] size the most authentications to remember, 0 to disable the cache
+ * @param[in] ttl how long a remembered authentication is accepted, in milliseconds
+ */
+PN_EXTERN void pn_sasl_config_credential_cache(pn_sasl_t *sasl, size_t size, pn_millis_t ttl);
+
 /**
  * @}
  */
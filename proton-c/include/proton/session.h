@@ -220,6 +220,31 @@ PN_EXTERN size_t pn_session_get_incoming_capacity(pn_session_t *session);
  */
 PN_EXTERN void pn_session_set_incoming_capacity(pn_session_t *session, size_t capacity);
 
+/**
+ * Get whether a session budgets its incoming capacity without a max frame.
+ *
+ * @param[in] session the session object
+ * @return true if the incoming capacity applies with no max frame size
+ */
+PN_EXTERN bool pn_session_get_incoming_budget(pn_session_t *session);
+
+/**
+ * Set whether a session budgets its incoming capacity without a max frame.
+ *
+ * The incoming window a session grants its peer is the incoming
+ * capacity not yet used by buffered message data, in frames of the
+ * transport's max frame size (see ::pn_transport_set_max_frame).  By
+ * default a transport sets no max frame size, and then the window is
+ * unlimited and the capacity ignored.  A budgeted session keeps to its
+ * capacity regardless, counting frames as big as the biggest it has yet
+ * received, or 16 KB before the first.  The window is granted again as
+ * the application reads data with ::pn_link_recv.
+ *
+ * @param[in] session the session object
+ * @param[in] budget true to budget the incoming capacity
+ */
+PN_EXTERN void pn_session_set_incoming_budget(pn_session_t *session, bool budget);
+
 /**
  * Get the outgoing window for a session object.
  *
@@ -286,6 +311,29 @@ PN_EXTERN pn_session_t *pn_session_head(pn_connection_t *connection, pn_state_t
  */
 PN_EXTERN pn_session_t *pn_session_next(pn_session_t *session, pn_state_t state);
 
+/**
+ * Retrieve the first sender of a session that matches the specified
+ * state mask, see ::pn_session_head for the match behavior.
+ *
+ * Only the session's own senders are visited, in the order they were
+ * created.
+ *
+ * @param[in] session the session to search
+ * @param[in] state mask to match
+ * @return the first matching sender, else NULL
+ */
+PN_EXTERN pn_link_t *pn_session_sender_head(pn_session_t *session, pn_state_t state);
+
+/**
+ * Retrieve the first receiver of a session that matches the specified
+ * state mask, see ::pn_session_sender_head.
+ *
+ * @param[in] session the session to search
+ * @param[in] state mask to match
+ * @return the first matching receiver, else NULL
+ */
+PN_EXTERN pn_link_t *pn_session_receiver_head(pn_session_t *session, pn_state_t state);
+
 /**
  * @}
  */
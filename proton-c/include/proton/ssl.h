@@ -238,6 +238,60 @@ PN_EXTERN int pn_ssl_domain_set_peer_authentication(pn_ssl_domain_t *domain,
  */
 PN_EXTERN int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain);
 
+/**
+ * Set the size of the buffers holding application data on its way into and out
+ * of SSL, for transports initialized with the domain after the call.
+ *
+ * Larger buffers let more data pass through the SSL layer per call, at the cost
+ * of memory per connection.  AMQP frames are normally encrypted without passing
+ * through the output buffer.
+ *
+ * @param[in] domain the domain to configure.
+ * @param[in] size the buffer size in bytes, must not be 0.
+ * @return 0 on success
+ */
+PN_EXTERN int pn_ssl_domain_set_buffer_size(pn_ssl_domain_t *domain, size_t size);
+
+/**
+ * Configure the TLS session cache used for session resumption.
+ *
+ * A client domain keeps the most recently used sessions, keyed by the session_id
+ * given to ::pn_ssl_init, and offers them to the server when a transport with the
+ * same id connects again.  TLS 1.3 session tickets are cached as they arrive.  The
+ * cache is shared by all transports of the domain and may be used from several
+ * threads at once.  For a server domain this sizes the library's own session cache.
+ *
+ * Changing the configuration discards any sessions already cached.
+ *
+ * @param[in] domain the domain to configure.
+ * @param[in] size the most sessions kept, 0 disables resumption.
+ * @param[in] ttl milliseconds a session may be resumed after it was established,
+ * 0 to only limit it by the lifetime the server gave the session.
+ * @return 0 on success
+ */
+PN_EXTERN int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl);
+
+/**
+ * Configure the cache of verified peer certificate chains.
+ *
+ * Peers that connect again with the same certificate chain, such as many
+ * clients reconnecting with certificates from a few intermediate CAs, skip
+ * checking the chain's signatures against the trusted CAs.  The validity
+ * dates of the certificates and the peer name (see
+ * ::PN_SSL_VERIFY_PEER_NAME) are still checked on every connection.  Only
+ * chains that verified are cached.  The cache is shared by all transports of
+ * the domain and may be used from several threads at once.
+ *
+ * Changing the trusted CAs or the peer authentication mode discards the cache.
+ *
+ * @param[in] domain the domain to configure.
+ * @param[in] size the most chains kept, 0 verifies every chain in full.
+ * @param[in] ttl milliseconds a chain is trusted after it was verified, 0 for
+ * no limit other than the certificates' own validity.
+ * @return 0 on success
+ */
+PN_EXTERN int pn_ssl_domain_set_verify_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl);
+
 /**
  * Create a new SSL session object associated with a transport.
  *
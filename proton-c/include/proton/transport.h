@@ -115,6 +115,24 @@ PN_EXTERN pn_transport_t *pn_transport(void);
  */
 PN_EXTERN void pn_transport_set_server(pn_transport_t *transport);
 
+/**
+ * Set whether a server transport detects the protocol layers from the
+ * headers sent by the client.
+ *
+ * With autodetection off the server expects exactly the layers it is
+ * configured with, in the same way a client does: TLS if pn_ssl_init()
+ * was called, SASL if pn_sasl() was called, then AMQP. Any other header
+ * from the client is a framing error. A listener accepting only one kind
+ * of client can turn it off for each transport it accepts.
+ *
+ * The default is on. The setting takes effect when the transport first
+ * reads or writes and has no effect on client transports.
+ *
+ * @param[in] transport a transport object
+ * @param[in] autodetect false to pin the configured protocol layers
+ */
+PN_EXTERN void pn_transport_set_autodetect(pn_transport_t *transport, bool autodetect);
+
 /**
  * Free a transport object.
  *
@@ -267,6 +285,97 @@ PN_EXTERN void pn_transport_set_tracer(pn_transport_t *transport, pn_tracer_t tr
  */
 PN_EXTERN pn_tracer_t pn_transport_get_tracer(pn_transport_t *transport);
 
+/**
+ * A binary summary of one frame read or written by a transport.
+ *
+ * See pn_transport_record_frames().
+ */
+typedef struct pn_frame_record_t {
+  uint64_t sequence;        /**< Number of frames recorded before this one */
+  pn_timestamp_t time;      /**< When the frame was read or written, in milliseconds since the epoch */
+  uint32_t size;            /**< Size of the whole frame including its header */
+  uint32_t payload;         /**< Bytes of message data after the performative */
+  uint16_t channel;
+  uint8_t type;             /**< Frame type: 0 for AMQP, 1 for SASL */
+  uint8_t performative;     /**< Descriptor code, e.g. 0x14 for transfer, 0 for an empty frame */
+  bool outgoing;            /**< True if written, false if read */
+} pn_frame_record_t;
+
+/**
+ * Record a binary summary of every frame the transport reads or writes.
+ *
+ * The most recent capacity frames are kept in a ring in memory, without
+ * formatting or logging, so unlike ::PN_TRACE_FRM the cost is small enough
+ * to leave on in production. Use pn_transport_frame_records() to dump them
+ * on demand, or call it regularly to stream records to a file from the
+ * application's own thread.
+ *
+ * Calling this discards any recorded frames, capacity 0 stops recording.
+ *
+ * @param[in] transport a transport object
+ * @param[in] capacity the number of frames to keep
+ * @return 0 on success, PN_OUT_OF_MEMORY if the ring can't be allocated
+ */
+PN_EXTERN int pn_transport_record_frames(pn_transport_t *transport, size_t capacity);
+
+/**
+ * Copy recorded frames, oldest first.
+ *
+ * Copies up to max of the frames still held whose sequence is at least
+ * from. To stream records pass one more than the last sequence seen: a
+ * gap in the sequence means the ring wrapped and frames were lost.
+ * Records are not removed, so a dump does not disturb a stream.
+ *
+ * @param[in] transport a transport object
+ * @param[in] from the lowest sequence wanted, 0 for everything held
+ * @param[out] records where to copy the records
+ * @param[in] max the most records to copy
+ * @return the number of records copied
+ */
+PN_EXTERN size_t pn_transport_frame_records(pn_transport_t *transport, uint64_t from,
+                                            pn_frame_record_t *records, size_t max);
+
+/**
+ * Called with the encoded bytes of each whole frame a transport reads or
+ * writes, AMQP and SASL, after any SSL decryption and before encryption.
+ *
+ * @p frame is only valid during the call. The capture is called once more
+ * with @p frame NULL when it is replaced or the transport is freed, so it
+ * can release @p context.
+ */
+typedef void (*pn_frame_capture_t)(pn_transport_t *transport, void *context, bool outgoing,
+                                   const char *frame, size_t size);
+
+/**
+ * Pass every frame the transport reads or writes to @p capture.
+ *
+ * A NULL capture stops capturing.
+ *
+ * @param[in] transport a transport object
+ * @param[in] capture called for each frame
+ * @param[in] context passed to capture
+ */
+PN_EXTERN void pn_transport_set_frame_capture(pn_transport_t *transport, pn_frame_capture_t capture,
+                                              void *context);
+
+/**
+ * Capture every frame the transport reads or writes into a file.
+ *
+ * The file starts with the 8 bytes "PNCAP01\n", then holds one record per
+ * frame: a flags byte (1 if the frame was written, 0 if read), the time
+ * in milliseconds since the epoch as 8 bytes, the frame size as 4 bytes,
+ * both in network byte order, then the frame itself. The file is closed
+ * when capturing stops or the transport is freed.
+ *
+ * Writes are buffered but synchronous, capturing a busy connection slows
+ * it down. The c-frame-replay tool replays the frames read.
+ *
+ * @param[in] transport a transport object
+ * @param[in] path the file to create
+ * @return 0 on success, PN_ERR if the file can't be created
+ */
+PN_EXTERN int pn_transport_capture_file(pn_transport_t *transport, const char *path);
+
 /**
  * @deprecated
  *
@@ -408,6 +517,122 @@ PN_EXTERN uint32_t pn_transport_get_max_frame(pn_transport_t *transport);
  */
 PN_EXTERN void pn_transport_set_max_frame(pn_transport_t *transport, uint32_t size);
 
+/**
+ * Get the output limit of a transport.
+ *
+ * @param[in] transport a transport object
+ * @return the output limit in bytes, 0 if there is no limit
+ */
+PN_EXTERN size_t pn_transport_get_output_limit(pn_transport_t *transport);
+
+/**
+ * Set the output limit of a transport.
+ *
+ * Once this many bytes of encoded frames are waiting to be written the
+ * transport stops framing message transfers, until
+ * ::pn_transport_pending() and ::pn_transport_pop() drain the output
+ * below the limit again.  Unsent deliveries stay queued on their links.
+ * Other frames are not held back.  A transfer already under way
+ * continues with at least one frame at a time, so the limit is a
+ * high-water mark rather than a hard bound.
+ *
+ * @param[in] transport a transport object
+ * @param[in] limit the output limit in bytes, 0 for no limit
+ */
+PN_EXTERN void pn_transport_set_output_limit(pn_transport_t *transport, size_t limit);
+
+/**
+ * Get the interleave mode of a transport.
+ *
+ * @param[in] transport a transport object
+ * @return true if transfers from different deliveries are interleaved
+ */
+PN_EXTERN bool pn_transport_get_interleave(pn_transport_t *transport);
+
+/**
+ * Set the interleave mode of a transport.
+ *
+ * Normally a delivery is framed in full before the next one is looked
+ * at, so one large message holds back every other link on the
+ * connection.  In interleave mode each pending delivery is given a turn
+ * of transfer frames (one, or the link weight, see
+ * ::pn_link_set_weight()) round robin, so small messages are not stuck
+ * behind bulk transfers.  Transfer frames are kept to at most 16 KB even
+ * if the peer allows bigger ones, and if no max frame size has been set
+ * (see ::pn_transport_set_max_frame()) the same size is advertised to
+ * the peer.  Set this before the connection is opened.
+ *
+ * @param[in] transport a transport object
+ * @param[in] interleave true to interleave transfers
+ */
+PN_EXTERN void pn_transport_set_interleave(pn_transport_t *transport, bool interleave);
+
+/**
+ * Get whether a transport validates the text in incoming frames.
+ *
+ * @param[in] transport a transport object
+ * @return true if strings and symbols in performatives are validated
+ */
+PN_EXTERN bool pn_transport_get_validate_text(pn_transport_t *transport);
+
+/**
+ * Set whether a transport validates the text in incoming frames.
+ *
+ * When set, every string in an incoming performative must be well formed
+ * UTF-8 and every symbol ASCII, as AMQP requires, or the transport fails
+ * with an amqp:decode-error.  Message content carried by transfers is
+ * not checked.  Off by default.
+ *
+ * @param[in] transport a transport object
+ * @param[in] validate true to validate
+ */
+PN_EXTERN void pn_transport_set_validate_text(pn_transport_t *transport, bool validate);
+
+/**
+ * Get the disposition delay of a transport.
+ *
+ * @param[in] transport a transport object
+ * @return the disposition delay in milliseconds, 0 if dispositions are not held
+ */
+PN_EXTERN pn_millis_t pn_transport_get_disposition_delay(pn_transport_t *transport);
+
+/**
+ * Set the disposition delay of a transport.
+ *
+ * Settlements of consecutive deliveries to the same outcome are sent as
+ * one ranged DISPOSITION frame.  Normally a range is sent at the end of
+ * each processing pass.  With a delay the range is held back across
+ * passes until it covers the disposition limit (see
+ * ::pn_transport_set_disposition_limit()) or the delay has passed.
+ * Held dispositions are always sent before a DETACH, END or CLOSE.
+ *
+ * The delay is measured by ::pn_transport_tick(), so the driver must
+ * call it after generating output and again by the deadline it returns.
+ *
+ * @param[in] transport a transport object
+ * @param[in] delay the disposition delay in milliseconds, 0 to send at once
+ */
+PN_EXTERN void pn_transport_set_disposition_delay(pn_transport_t *transport, pn_millis_t delay);
+
+/**
+ * Get the disposition limit of a transport.
+ *
+ * @param[in] transport a transport object
+ * @return the number of deliveries a held range may cover, 0 for no limit
+ */
+PN_EXTERN uint32_t pn_transport_get_disposition_limit(pn_transport_t *transport);
+
+/**
+ * Set the disposition limit of a transport.
+ *
+ * A held disposition range is sent as soon as it covers this many
+ * deliveries. Only used when a disposition delay is set.
+ *
+ * @param[in] transport a transport object
+ * @param[in] limit the number of deliveries, 0 to wait for the delay only
+ */
+PN_EXTERN void pn_transport_set_disposition_limit(pn_transport_t *transport, uint32_t limit);
+
 /**
  * Get the maximum frame size of a transport's remote peer.
  *
@@ -641,6 +866,19 @@ PN_EXTERN bool pn_transport_closed(pn_transport_t *transport);
  */
 PN_EXTERN pn_timestamp_t pn_transport_tick(pn_transport_t *transport, pn_timestamp_t now);
 
+/**
+ * **Experimental** - Release the memory an idle transport keeps for I/O.
+ *
+ * Input and output buffers with nothing in them are freed along with
+ * scratch space for encoding and decoding frames, and the TLS layer's
+ * buffers when they are empty. Each is allocated again when the
+ * transport next needs it, so this can be called at any time. It is
+ * meant for connections that have had no traffic for a while.
+ *
+ * @return the number of bytes released
+ */
+PN_EXTERN size_t pn_transport_hibernate(pn_transport_t *transport);
+
 /**
  * Get the number of frames output by a transport.
  *
@@ -657,6 +895,42 @@ PN_EXTERN uint64_t pn_transport_get_frames_output(const pn_transport_t *transpor
  */
 PN_EXTERN uint64_t pn_transport_get_frames_input(const pn_transport_t *transport);
 
+/**
+ * The number of AMQP performatives, open (0x10) to close (0x18).
+ */
+#define PN_PERFORMATIVES 9
+
+/**
+ * Performance counters for a transport, see pn_transport_stats().
+ *
+ * The per performative arrays are indexed by the performative's
+ * descriptor code less 0x10, so open is 0, transfer is 4 and close is 8.
+ * Empty frames and SASL frames are only counted in the totals.
+ */
+typedef struct pn_transport_stats_t {
+  uint64_t frames_input;
+  uint64_t frames_output;
+  uint64_t bytes_input;
+  uint64_t bytes_output;
+  uint64_t performative_frames_input[PN_PERFORMATIVES];
+  uint64_t performative_frames_output[PN_PERFORMATIVES];
+  uint64_t performative_bytes_input[PN_PERFORMATIVES];   /**< Whole frames, headers and payload included */
+  uint64_t performative_bytes_output[PN_PERFORMATIVES];
+  uint64_t deliveries_input;    /**< Deliveries begun by the peer */
+  uint64_t deliveries_output;   /**< Deliveries sent whole, or aborted */
+} pn_transport_stats_t;
+
+/**
+ * Get the performance counters of a transport.
+ *
+ * The counters are always kept and only ever increase: take the
+ * difference between two samples to get rates.
+ *
+ * @param[in] transport a transport object
+ * @param[out] stats filled in with the transport's counters
+ */
+PN_EXTERN void pn_transport_stats(const pn_transport_t *transport, pn_transport_stats_t *stats);
+
 /**
  * Access the AMQP Connection associated with the transport.
  *
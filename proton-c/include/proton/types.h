@@ -54,6 +54,10 @@
  * @brief A mutable holder of application content
  * @ingroup core
  *
+ * @defgroup message_selector Message selector
+ * @brief A compiled filter over encoded messages
+ * @ingroup core
+ *
  * @defgroup delivery Delivery
  * @brief A message transfer
  * @ingroup core
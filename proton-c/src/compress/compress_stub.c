@@ -0,0 +1,52 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/codec.h>
+#include <proton/error.h>
+#include <proton/message.h>
+
+#include <string.h>
+
+/*
+ * Stubs of message body compression, used if there is no zlib in the
+ * system's environment. Bodies are sent uncompressed but deflated
+ * ones cannot be read.
+ */
+
+bool pn_message_compress_present(void)
+{
+  return false;
+}
+
+int pn_message_compress(pn_message_t *msg, size_t min_size)
+{
+  return 0;
+}
+
+int pn_message_decompress(pn_message_t *msg, size_t max_size)
+{
+  const char *encoding = pn_message_get_content_encoding(msg);
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_rewind(body);
+  if (!encoding || strcmp(encoding, "deflate") || !pn_data_next(body) || pn_data_type(body) != PN_BINARY)
+    return 0;
+  return pn_error_format(pn_message_error(msg), PN_ERR, "no deflate support");
+}
@@ -0,0 +1,131 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/codec.h>
+#include <proton/error.h>
+#include <proton/message.h>
+
+#include <zlib.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Message body compression with zlib, see pn_message_compress().
+ */
+
+static const char DEFLATE[] = "deflate";
+
+bool pn_message_compress_present(void)
+{
+  return true;
+}
+
+/* The body of msg if it is a single binary */
+static bool pni_binary_body(pn_message_t *msg, pn_bytes_t *bytes)
+{
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_rewind(body);
+  if (!pn_data_next(body) || pn_data_type(body) != PN_BINARY) return false;
+  *bytes = pn_data_get_binary(body);
+  return !pn_data_next(body);
+}
+
+/* Replace the body of msg, bytes must not point into it */
+static int pni_set_body(pn_message_t *msg, const char *bytes, size_t size, const char *encoding)
+{
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_clear(body);
+  int err = pn_data_put_binary(body, pn_bytes(size, bytes));
+  return err ? err : pn_message_set_content_encoding(msg, encoding);
+}
+
+int pn_message_compress(pn_message_t *msg, size_t min_size)
+{
+  pn_bytes_t bytes;
+  if (pn_message_get_content_encoding(msg) || !pni_binary_body(msg, &bytes) || bytes.size < min_size)
+    return 0;
+  uLongf size = compressBound(bytes.size);
+  char *out = (char *) malloc(size);
+  if (!out) return PN_OUT_OF_MEMORY;
+  int err = 0;
+  int zerr = compress2((Bytef *) out, &size, (const Bytef *) bytes.start, bytes.size, Z_DEFAULT_COMPRESSION);
+  if (zerr != Z_OK) {
+    err = pn_error_format(pn_message_error(msg), PN_ERR, "deflate failed: %s", zError(zerr));
+  } else if (size < bytes.size) {   /* Incompressible bodies are left alone */
+    err = pni_set_body(msg, out, size, DEFLATE);
+  }
+  free(out);
+  return err;
+}
+
+int pn_message_decompress(pn_message_t *msg, size_t max_size)
+{
+  const char *encoding = pn_message_get_content_encoding(msg);
+  pn_bytes_t bytes;
+  if (!encoding || strcmp(encoding, DEFLATE) || !pni_binary_body(msg, &bytes))
+    return 0;
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit(&zs) != Z_OK) return PN_OUT_OF_MEMORY;
+  zs.next_in = (Bytef *) bytes.start;
+  zs.avail_in = (uInt) bytes.size;
+  /* The inflated size is not sent, so guess and grow, to one byte over
+     max_size at most so a body of exactly max_size is seen to end */
+  size_t limit = max_size < SIZE_MAX ? max_size + 1 : max_size;
+  size_t capacity = 4 * bytes.size + 64;
+  if (capacity > limit) capacity = limit;
+  char *out = (char *) malloc(capacity);
+  int zerr = out ? Z_OK : Z_MEM_ERROR;
+  while (zerr == Z_OK || (zerr == Z_BUF_ERROR && !zs.avail_out)) {
+    if (zs.total_out == capacity) {
+      if (capacity == limit)
+        break;                  /* Over max_size */
+      size_t size = capacity < limit / 2 ? 2 * capacity : limit;
+      char *grown = (char *) realloc(out, size);
+      if (!grown) {
+        zerr = Z_MEM_ERROR;
+        break;
+      }
+      out = grown;
+      capacity = size;
+    }
+    zs.next_out = (Bytef *) out + zs.total_out;
+    zs.avail_out = (uInt) (capacity - zs.total_out);
+    zerr = inflate(&zs, Z_NO_FLUSH);
+  }
+  int err;
+  if (zs.total_out > max_size) {
+    err = pn_error_format(pn_message_error(msg), PN_OVERFLOW, "inflated body is over %lu bytes",
+                          (unsigned long) max_size);
+  } else if (zerr == Z_STREAM_END) {
+    err = pni_set_body(msg, out, zs.total_out, NULL);
+  } else if (zerr == Z_MEM_ERROR) {
+    err = PN_OUT_OF_MEMORY;
+  } else {
+    err = pn_error_format(pn_message_error(msg), PN_ERR, "inflate failed: %s",
+                          zs.msg ? zs.msg : zError(zerr));
+  }
+  inflateEnd(&zs);
+  free(out);
+  return err;
+}
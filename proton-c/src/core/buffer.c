@@ -278,6 +278,19 @@ int pn_buffer_defrag(pn_buffer_t *buf)
   return 0;
 }
 
+/* Give back memory above capacity, never dropping content */
+int pn_buffer_shrink(pn_buffer_t *buf, size_t capacity)
+{
+  if (capacity < buf->size) capacity = buf->size;
+  if (capacity >= buf->capacity) return 0;
+  pn_buffer_defrag(buf);
+  char *new_bytes = (char *) realloc(buf->bytes, capacity ? capacity : 1);
+  if (!new_bytes) return PN_OUT_OF_MEMORY;
+  buf->bytes = new_bytes;
+  buf->capacity = capacity;
+  return 0;
+}
+
 pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf)
 {
   if (buf) {
@@ -300,6 +313,28 @@ pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf)
   }
 }
 
+/* Contiguous free space of at least size bytes after the content, for writing
+   in place; the written bytes are added to the content by pn_buffer_extend() */
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size)
+{
+  if (pn_buffer_ensure(buf, size) || pn_buffer_available(buf) < size) {
+    pn_rwbytes_t r = {0, NULL};
+    return r;
+  }
+  if (pni_buffer_tail_space(buf) < size) {
+    pn_buffer_defrag(buf);
+  }
+  pn_rwbytes_t r = {pni_buffer_tail_space(buf), buf->bytes + pni_buffer_tail(buf)};
+  return r;
+}
+
+int pn_buffer_extend(pn_buffer_t *buf, size_t size)
+{
+  if (size > pni_buffer_tail_space(buf)) return PN_OVERFLOW;
+  buf->size += size;
+  return 0;
+}
+
 int pn_buffer_print(pn_buffer_t *buf)
 {
   printf("pn_buffer(\"");
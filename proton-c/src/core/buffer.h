@@ -43,8 +43,11 @@ size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst);
 int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right);
 void pn_buffer_clear(pn_buffer_t *buf);
 int pn_buffer_defrag(pn_buffer_t *buf);
+int pn_buffer_shrink(pn_buffer_t *buf, size_t capacity);
 pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf);
 pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf);
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size);
+int pn_buffer_extend(pn_buffer_t *buf, size_t size);
 int pn_buffer_print(pn_buffer_t *buf);
 
 #ifdef __cplusplus
@@ -0,0 +1,136 @@
+#ifndef PROTON_BYTEORDER_H
+#define PROTON_BYTEORDER_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/type_compat.h>
+
+#include <string.h>
+
+/*
+ * Unaligned big-endian (network order) reads and writes shared by the
+ * framing, encoding and decoding code.
+ *
+ * Where the compiler provides byte swap intrinsics a whole word is moved
+ * with memcpy and swapped in a register, otherwise bytes are shifted one
+ * at a time.
+ */
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PNI_BSWAP16(x) __builtin_bswap16(x)
+#define PNI_BSWAP32(x) __builtin_bswap32(x)
+#define PNI_BSWAP64(x) __builtin_bswap64(x)
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PNI_BSWAP16(x) (x)
+#define PNI_BSWAP32(x) (x)
+#define PNI_BSWAP64(x) (x)
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define PNI_BSWAP16(x) _byteswap_ushort(x)
+#define PNI_BSWAP32(x) _byteswap_ulong(x)
+#define PNI_BSWAP64(x) _byteswap_uint64(x)
+#endif
+
+#ifdef PNI_BSWAP32
+
+static inline uint16_t pni_read16(const char *bytes)
+{
+  uint16_t v;
+  memcpy(&v, bytes, 2);
+  return PNI_BSWAP16(v);
+}
+
+static inline uint32_t pni_read32(const char *bytes)
+{
+  uint32_t v;
+  memcpy(&v, bytes, 4);
+  return PNI_BSWAP32(v);
+}
+
+static inline uint64_t pni_read64(const char *bytes)
+{
+  uint64_t v;
+  memcpy(&v, bytes, 8);
+  return PNI_BSWAP64(v);
+}
+
+static inline void pni_write16(char *bytes, uint16_t value)
+{
+  value = PNI_BSWAP16(value);
+  memcpy(bytes, &value, 2);
+}
+
+static inline void pni_write32(char *bytes, uint32_t value)
+{
+  value = PNI_BSWAP32(value);
+  memcpy(bytes, &value, 4);
+}
+
+static inline void pni_write64(char *bytes, uint64_t value)
+{
+  value = PNI_BSWAP64(value);
+  memcpy(bytes, &value, 8);
+}
+
+#else
+
+static inline uint16_t pni_read16(const char *bytes)
+{
+  return (uint16_t)((uint8_t) bytes[0] << 8 | (uint8_t) bytes[1]);
+}
+
+static inline uint32_t pni_read32(const char *bytes)
+{
+  return (uint32_t)(uint8_t) bytes[0] << 24
+    | (uint32_t)(uint8_t) bytes[1] << 16
+    | (uint32_t)(uint8_t) bytes[2] <<  8
+    | (uint32_t)(uint8_t) bytes[3];
+}
+
+static inline uint64_t pni_read64(const char *bytes)
+{
+  return (uint64_t) pni_read32(bytes) << 32 | pni_read32(bytes + 4);
+}
+
+static inline void pni_write16(char *bytes, uint16_t value)
+{
+  bytes[0] = 0xFF & (value >> 8);
+  bytes[1] = 0xFF & (value     );
+}
+
+static inline void pni_write32(char *bytes, uint32_t value)
+{
+  bytes[0] = 0xFF & (value >> 24);
+  bytes[1] = 0xFF & (value >> 16);
+  bytes[2] = 0xFF & (value >>  8);
+  bytes[3] = 0xFF & (value      );
+}
+
+static inline void pni_write64(char *bytes, uint64_t value)
+{
+  pni_write32(bytes, value >> 32);
+  pni_write32(bytes + 4, value);
+}
+
+#endif
+
+#endif /* byteorder.h */
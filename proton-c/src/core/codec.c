@@ -28,15 +28,21 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <math.h>
 #include "encodings.h"
 #define DEFINE_FIELDS
 #include "protocol.h"
 #include "platform/platform_fmt.h"
 #include "util.h"
+#include "byteorder.h"
+#include "config.h"
 #include "decoder.h"
 #include "encoder.h"
 #include "data.h"
+#define DEFINE_FORMATS
+#include "formats.h"
 #include "log_private.h"
+#include "max_align.h"
 
 const char *pn_type_name(pn_type_t type)
 {
@@ -81,15 +87,41 @@ static inline void pni_atom_init(pn_atom_t *atom, pn_type_t type)
 
 // data
 
+/* The initial nodes are allocated in the same block as the pn_data_t, after
+   padding it to maximal alignment, so a new pn_data_t is a single allocation */
+typedef union {
+  pn_data_t d;
+  pn_max_align_t a;
+} pni_aligned_data_t;
+
+static inline pni_node_t *pni_data_inline_nodes(pn_data_t *data)
+{
+  return (pni_node_t *) ((char *) data + sizeof(pni_aligned_data_t));
+}
+
+// Free a chunk and those filled before it
+static void pni_data_free_chunks(pni_data_chunk_t *chunk)
+{
+  while (chunk) {
+    pni_data_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
 static void pn_data_finalize(void *object)
 {
   pn_data_t *data = (pn_data_t *) object;
-  free(data->nodes);
-  pn_buffer_free(data->buf);
+  if (data->nodes != pni_data_inline_nodes(data)) free(data->nodes);
+  pni_data_free_chunks(data->chunks);
   pn_free(data->str);
   pn_error_free(data->error);
   pn_free(data->decoder);
   pn_free(data->encoder);
+  if (data->index) {
+    free(data->index->slots);
+    free(data->index);
+  }
 }
 
 static const pn_fields_t *pni_node_fields(pn_data_t *data, pni_node_t *node)
@@ -121,81 +153,93 @@ static int pni_node_index(pn_data_t *data, pni_node_t *node)
   return count - 1;
 }
 
-int pni_inspect_atom(pn_atom_t *atom, pn_string_t *str)
+// The text of a scalar other than binary, string or symbol into buf, as
+// snprintf returns it, -1 for the other types
+static int pni_atom_text(const pn_atom_t *atom, char *buf, size_t size)
 {
   switch (atom->type) {
   case PN_NULL:
-    return pn_string_addf(str, "null");
+    return snprintf(buf, size, "null");
   case PN_BOOL:
-    return pn_string_addf(str, atom->u.as_bool ? "true" : "false");
+    return snprintf(buf, size, atom->u.as_bool ? "true" : "false");
   case PN_UBYTE:
-    return pn_string_addf(str, "%" PRIu8, atom->u.as_ubyte);
+    return snprintf(buf, size, "%" PRIu8, atom->u.as_ubyte);
   case PN_BYTE:
-    return pn_string_addf(str, "%" PRIi8, atom->u.as_byte);
+    return snprintf(buf, size, "%" PRIi8, atom->u.as_byte);
   case PN_USHORT:
-    return pn_string_addf(str, "%" PRIu16, atom->u.as_ushort);
+    return snprintf(buf, size, "%" PRIu16, atom->u.as_ushort);
   case PN_SHORT:
-    return pn_string_addf(str, "%" PRIi16, atom->u.as_short);
+    return snprintf(buf, size, "%" PRIi16, atom->u.as_short);
   case PN_UINT:
-    return pn_string_addf(str, "%" PRIu32, atom->u.as_uint);
+    return snprintf(buf, size, "%" PRIu32, atom->u.as_uint);
   case PN_INT:
-    return pn_string_addf(str, "%" PRIi32, atom->u.as_int);
+    return snprintf(buf, size, "%" PRIi32, atom->u.as_int);
   case PN_CHAR:
-    return pn_string_addf(str, "%c",  atom->u.as_char);
+    return snprintf(buf, size, "%c",  atom->u.as_char);
   case PN_ULONG:
-    return pn_string_addf(str, "%" PRIu64, atom->u.as_ulong);
+    return snprintf(buf, size, "%" PRIu64, atom->u.as_ulong);
   case PN_LONG:
-    return pn_string_addf(str, "%" PRIi64, atom->u.as_long);
+    return snprintf(buf, size, "%" PRIi64, atom->u.as_long);
   case PN_TIMESTAMP:
-    return pn_string_addf(str, "%" PRIi64, atom->u.as_timestamp);
+    return snprintf(buf, size, "%" PRIi64, atom->u.as_timestamp);
   case PN_FLOAT:
-    return pn_string_addf(str, "%g", atom->u.as_float);
+    return snprintf(buf, size, "%g", atom->u.as_float);
   case PN_DOUBLE:
-    return pn_string_addf(str, "%g", atom->u.as_double);
+    return snprintf(buf, size, "%g", atom->u.as_double);
   case PN_DECIMAL32:
-    return pn_string_addf(str, "D32(%" PRIu32 ")", atom->u.as_decimal32);
+    return snprintf(buf, size, "D32(%" PRIu32 ")", atom->u.as_decimal32);
   case PN_DECIMAL64:
-    return pn_string_addf(str, "D64(%" PRIu64 ")", atom->u.as_decimal64);
+    return snprintf(buf, size, "D64(%" PRIu64 ")", atom->u.as_decimal64);
   case PN_DECIMAL128:
-    return pn_string_addf(str, "D128(%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx"
-                          "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx"
-                          "%02hhx%02hhx)",
-                          atom->u.as_decimal128.bytes[0],
-                          atom->u.as_decimal128.bytes[1],
-                          atom->u.as_decimal128.bytes[2],
-                          atom->u.as_decimal128.bytes[3],
-                          atom->u.as_decimal128.bytes[4],
-                          atom->u.as_decimal128.bytes[5],
-                          atom->u.as_decimal128.bytes[6],
-                          atom->u.as_decimal128.bytes[7],
-                          atom->u.as_decimal128.bytes[8],
-                          atom->u.as_decimal128.bytes[9],
-                          atom->u.as_decimal128.bytes[10],
-                          atom->u.as_decimal128.bytes[11],
-                          atom->u.as_decimal128.bytes[12],
-                          atom->u.as_decimal128.bytes[13],
-                          atom->u.as_decimal128.bytes[14],
-                          atom->u.as_decimal128.bytes[15]);
+    return snprintf(buf, size, "D128(%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx"
+                    "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx"
+                    "%02hhx%02hhx)",
+                    atom->u.as_decimal128.bytes[0],
+                    atom->u.as_decimal128.bytes[1],
+                    atom->u.as_decimal128.bytes[2],
+                    atom->u.as_decimal128.bytes[3],
+                    atom->u.as_decimal128.bytes[4],
+                    atom->u.as_decimal128.bytes[5],
+                    atom->u.as_decimal128.bytes[6],
+                    atom->u.as_decimal128.bytes[7],
+                    atom->u.as_decimal128.bytes[8],
+                    atom->u.as_decimal128.bytes[9],
+                    atom->u.as_decimal128.bytes[10],
+                    atom->u.as_decimal128.bytes[11],
+                    atom->u.as_decimal128.bytes[12],
+                    atom->u.as_decimal128.bytes[13],
+                    atom->u.as_decimal128.bytes[14],
+                    atom->u.as_decimal128.bytes[15]);
   case PN_UUID:
-    return pn_string_addf(str, "UUID(%02hhx%02hhx%02hhx%02hhx-"
-                          "%02hhx%02hhx-%02hhx%02hhx-%02hhx%02hhx-"
-                          "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx)",
-                          atom->u.as_uuid.bytes[0],
-                          atom->u.as_uuid.bytes[1],
-                          atom->u.as_uuid.bytes[2],
-                          atom->u.as_uuid.bytes[3],
-                          atom->u.as_uuid.bytes[4],
-                          atom->u.as_uuid.bytes[5],
-                          atom->u.as_uuid.bytes[6],
-                          atom->u.as_uuid.bytes[7],
-                          atom->u.as_uuid.bytes[8],
-                          atom->u.as_uuid.bytes[9],
-                          atom->u.as_uuid.bytes[10],
-                          atom->u.as_uuid.bytes[11],
-                          atom->u.as_uuid.bytes[12],
-                          atom->u.as_uuid.bytes[13],
-                          atom->u.as_uuid.bytes[14],
-                          atom->u.as_uuid.bytes[15]);
+    return snprintf(buf, size, "UUID(%02hhx%02hhx%02hhx%02hhx-"
+                    "%02hhx%02hhx-%02hhx%02hhx-%02hhx%02hhx-"
+                    "%02hhx%02hhx%02hhx%02hhx%02hhx%02hhx)",
+                    atom->u.as_uuid.bytes[0],
+                    atom->u.as_uuid.bytes[1],
+                    atom->u.as_uuid.bytes[2],
+                    atom->u.as_uuid.bytes[3],
+                    atom->u.as_uuid.bytes[4],
+                    atom->u.as_uuid.bytes[5],
+                    atom->u.as_uuid.bytes[6],
+                    atom->u.as_uuid.bytes[7],
+                    atom->u.as_uuid.bytes[8],
+                    atom->u.as_uuid.bytes[9],
+                    atom->u.as_uuid.bytes[10],
+                    atom->u.as_uuid.bytes[11],
+                    atom->u.as_uuid.bytes[12],
+                    atom->u.as_uuid.bytes[13],
+                    atom->u.as_uuid.bytes[14],
+                    atom->u.as_uuid.bytes[15]);
+  default:
+    return -1;
+  }
+}
+
+int pni_inspect_atom(pn_atom_t *atom, pn_string_t *str)
+{
+  char text[64];
+  if (pni_atom_text(atom, text, sizeof(text)) >= 0) return pn_string_addf(str, "%s", text);
+  switch (atom->type) {
   case PN_BINARY:
   case PN_STRING:
   case PN_SYMBOL:
@@ -353,10 +397,14 @@ int pni_inspect_exit(void *ctx, pn_data_t *data, pni_node_t *node)
   return 0;
 }
 
+static int pni_data_expand(pn_data_t *data, pni_nid_t id);
+static int pni_data_expand_all(pn_data_t *data);
+
 static int pn_data_inspect(void *obj, pn_string_t *dst)
 {
   pn_data_t *data = (pn_data_t *) obj;
-
+  int err = pni_data_expand_all(data);
+  if (err) return err;
   return pni_data_traverse(data, pni_inspect_enter, pni_inspect_exit, dst);
 }
 
@@ -367,19 +415,22 @@ static int pn_data_inspect(void *obj, pn_string_t *dst)
 pn_data_t *pn_data(size_t capacity)
 {
   static const pn_class_t clazz = PN_CLASS(pn_data);
-  pn_data_t *data = (pn_data_t *) pn_class_new(&clazz, sizeof(pn_data_t));
+  if (capacity > PNI_NID_MAX) capacity = PNI_NID_MAX;
+  pn_data_t *data = (pn_data_t *) pn_class_new(&clazz, sizeof(pni_aligned_data_t) + capacity * sizeof(pni_node_t));
   data->capacity = capacity;
   data->size = 0;
-  data->nodes = capacity ? (pni_node_t *) malloc(capacity * sizeof(pni_node_t)) : NULL;
-  data->buf = pn_buffer(64);
+  data->nodes = capacity ? pni_data_inline_nodes(data) : NULL;
+  data->chunks = NULL;
   data->parent = 0;
   data->current = 0;
   data->base_parent = 0;
   data->base_current = 0;
-  data->decoder = pn_decoder();
-  data->encoder = pn_encoder();
-  data->error = pn_error();
-  data->str = pn_string(NULL);
+  // The codecs, error and inspection string are created on first use
+  data->decoder = NULL;
+  data->encoder = NULL;
+  data->error = NULL;
+  data->str = NULL;
+  data->index = NULL;
   return data;
 }
 
@@ -390,11 +441,12 @@ void pn_data_free(pn_data_t *data)
 
 int pn_data_errno(pn_data_t *data)
 {
-  return pn_error_code(data->error);
+  return data->error ? pn_error_code(data->error) : 0;
 }
 
 pn_error_t *pn_data_error(pn_data_t *data)
 {
+  if (!data->error) data->error = pn_error();
   return data->error;
 }
 
@@ -411,32 +463,107 @@ void pn_data_clear(pn_data_t *data)
     data->current = 0;
     data->base_parent = 0;
     data->base_current = 0;
-    pn_buffer_clear(data->buf);
+    if (data->index) data->index->map = 0;
+    if (data->chunks) {
+      pni_data_free_chunks(data->chunks->next);
+      data->chunks->next = NULL;
+      data->chunks->used = 0;
+    }
   }
 }
 
+size_t pni_data_shrink(pn_data_t *data)
+{
+  pn_data_clear(data);
+  size_t size = 0;
+  if (data->nodes != pni_data_inline_nodes(data)) {
+    // The inline nodes are smaller, start again from none
+    size += data->capacity * sizeof(pni_node_t);
+    free(data->nodes);
+    data->nodes = NULL;
+    data->capacity = 0;
+  }
+  for (pni_data_chunk_t *chunk = data->chunks; chunk; chunk = chunk->next)
+    size += sizeof(pni_data_chunk_t) + chunk->size;
+  pni_data_free_chunks(data->chunks);
+  data->chunks = NULL;
+  // Created again on first use, the encoder stays for its settings
+  pn_free(data->decoder);
+  data->decoder = NULL;
+  if (data->index) {
+    free(data->index->slots);
+    free(data->index);
+    data->index = NULL;
+  }
+  return size;
+}
+
+static int pni_data_resize(pn_data_t *data, size_t capacity)
+{
+  pni_node_t *new_nodes;
+  if (data->nodes == pni_data_inline_nodes(data)) {
+    new_nodes = (pni_node_t *)malloc(capacity * sizeof(pni_node_t));
+    if (new_nodes) memcpy(new_nodes, data->nodes, data->capacity * sizeof(pni_node_t));
+  } else {
+    new_nodes = (pni_node_t *)realloc(data->nodes, capacity * sizeof(pni_node_t));
+  }
+  if (new_nodes == NULL) return PN_OUT_OF_MEMORY;
+  data->capacity = capacity;
+  data->nodes = new_nodes;
+  return 0;
+}
+
 static int pni_data_grow(pn_data_t *data)
 {
   size_t capacity = data->capacity ? data->capacity : 2;
   if (capacity >= PNI_NID_MAX) return PN_OUT_OF_MEMORY;
   else if (capacity < PNI_NID_MAX/2) capacity *= 2;
   else capacity = PNI_NID_MAX;
+  return pni_data_resize(data, capacity);
+}
 
-  pni_node_t *new_nodes = (pni_node_t *)realloc(data->nodes, capacity * sizeof(pni_node_t));
-  if (new_nodes == NULL) return PN_OUT_OF_MEMORY;
-  data->capacity = capacity;
-  data->nodes = new_nodes;
-  return 0;
+int pni_data_reserve(pn_data_t *data, size_t count)
+{
+  size_t needed = data->size + count;
+  if (needed <= data->capacity) return 0;
+  if (count > PNI_NID_MAX || needed > PNI_NID_MAX) return PN_OUT_OF_MEMORY;
+  size_t capacity = data->capacity ? data->capacity : 2;
+  while (capacity < needed) {
+    capacity = capacity < PNI_NID_MAX/2 ? capacity * 2 : PNI_NID_MAX;
+  }
+  return pni_data_resize(data, capacity);
 }
 
-static ssize_t pni_data_intern(pn_data_t *data, const char *start, size_t size)
+#define PNI_DATA_CHUNK_SIZE (64)
+
+// Take size bytes from the current chunk, or a new one, at least twice
+// the size of the last, when it is full
+static char *pni_data_alloc(pn_data_t *data, size_t size)
 {
-  size_t offset = pn_buffer_size(data->buf);
-  int err = pn_buffer_append(data->buf, start, size);
-  if (err) return err;
-  err = pn_buffer_append(data->buf, "\0", 1);
-  if (err) return err;
-  return offset;
+  pni_data_chunk_t *chunk = data->chunks;
+  if (!chunk || chunk->size - chunk->used < size) {
+    size_t chunk_size = chunk ? 2 * chunk->size : PNI_DATA_CHUNK_SIZE;
+    if (chunk_size < size) chunk_size = size;
+    pni_data_chunk_t *next = (pni_data_chunk_t *) malloc(sizeof(pni_data_chunk_t) + chunk_size);
+    if (!next) return NULL;
+    next->next = chunk;
+    next->size = chunk_size;
+    next->used = 0;
+    data->chunks = chunk = next;
+  }
+  char *bytes = (char *) (chunk + 1) + chunk->used;
+  chunk->used += size;
+  return bytes;
+}
+
+// Copy size bytes and a terminating nul into the chunks
+static char *pni_data_intern(pn_data_t *data, const char *start, size_t size)
+{
+  char *bytes = pni_data_alloc(data, size + 1);
+  if (!bytes) return NULL;
+  if (size) memcpy(bytes, start, size);
+  bytes[size] = '\0';
+  return bytes;
 }
 
 static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
@@ -450,46 +577,156 @@ static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
   }
 }
 
-static void pni_data_rebase(pn_data_t *data, char *base)
+// The bytes a node keeps in its data's chunks, NULL if none
+static pn_bytes_t *pni_node_interned(pni_node_t *node)
 {
-  for (unsigned i = 0; i < data->size; i++) {
-    pni_node_t *node = &data->nodes[i];
-    if (node->data) {
-      pn_bytes_t *bytes = pni_data_bytes(data, node);
-      bytes->start = base + node->data_offset;
-    }
-  }
+  return node->encoded ? &node->atom.u.as_bytes : pni_data_bytes(NULL, node);
 }
 
 static int pni_data_intern_node(pn_data_t *data, pni_node_t *node)
 {
   pn_bytes_t *bytes = pni_data_bytes(data, node);
   if (!bytes) return 0;
-  size_t oldcap = pn_buffer_capacity(data->buf);
-  ssize_t offset = pni_data_intern(data, bytes->start, bytes->size);
-  if (offset < 0) return offset;
-  node->data = true;
-  node->data_offset = offset;
-  node->data_size = bytes->size;
-  pn_rwbytes_t buf = pn_buffer_memory(data->buf);
-  bytes->start = buf.start + offset;
+  char *start = pni_data_intern(data, bytes->start, bytes->size);
+  if (!start) return PN_OUT_OF_MEMORY;
+  bytes->start = start;
+  return 0;
+}
 
-  if (pn_buffer_capacity(data->buf) != oldcap) {
-    pni_data_rebase(data, buf.start);
-  }
+// Compiling a fill format: described values, containers and '?' guards
+// still open, innermost last
+#define PNI_FORMAT_DEPTH (32)
+
+typedef struct {
+  uint8_t *ops;
+  size_t size;
+  size_t max;
+  int depth;
+  struct {
+    char kind;                  /* 'D', '[' or '?' */
+    uint8_t children;
+    size_t pos;                 /* Of the op count for '?' */
+  } open[PNI_FORMAT_DEPTH];
+} pni_fill_compiler_t;
 
+static int pni_fill_op(pni_fill_compiler_t *c, uint8_t op)
+{
+  if (c->size >= c->max) return PN_OVERFLOW;
+  c->ops[c->size++] = op;
   return 0;
 }
 
-int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
+static int pni_fill_open(pni_fill_compiler_t *c, char kind)
 {
-  int err = 0;
-  const char *begin = fmt;
-  while (*fmt) {
-    char code = *(fmt++);
-    if (!code) return 0;
+  if (c->depth == PNI_FORMAT_DEPTH) {
+    pn_log(PN_SUBSYSTEM_ENGINE, PN_LEVEL_ERROR, "fill format nested too deeply");
+    return PN_ARG_ERR;
+  }
+  c->open[c->depth].kind = kind;
+  c->open[c->depth].children = 0;
+  c->open[c->depth].pos = c->size;
+  c->depth++;
+  return 0;
+}
 
+// A value is complete: close the guards and described values it completes
+static int pni_fill_value(pni_fill_compiler_t *c)
+{
+  while (c->depth) {
+    if (c->open[c->depth-1].kind == '?') {
+      size_t pos = c->open[c->depth-1].pos;
+      size_t n = c->size - pos - 1;
+      if (n > 255) {
+        pn_log(PN_SUBSYSTEM_ENGINE, PN_LEVEL_ERROR, "fill format value after ? too long");
+        return PN_ARG_ERR;
+      }
+      c->ops[pos] = (uint8_t) n;
+    } else if (c->open[c->depth-1].kind == 'D' && ++c->open[c->depth-1].children == 2) {
+      int err = pni_fill_op(c, PNI_OP_EXIT_DESCRIBED);
+      if (err) return err;
+    } else {
+      return 0;
+    }
+    c->depth--;
+  }
+  return 0;
+}
+
+ssize_t pni_fill_compile(const char *fmt, uint8_t *ops, size_t max)
+{
+  pni_fill_compiler_t c;
+  c.ops = ops;
+  c.size = 0;
+  c.max = max;
+  c.depth = 0;
+  for (const char *f = fmt; *f; f++) {
+    char code = *f;
+    int err = 0;
     switch (code) {
+    case 'n': case 'o': case 'B': case 'b': case 'H': case 'h': case 'I': case 'i':
+    case 'L': case 'l': case 't': case 'f': case 'd': case 'z': case 'S': case 's': case 'C':
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_value(&c);
+      break;
+    case 'D':
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_open(&c, 'D');
+      break;
+    case '@':
+      if (*(f + 1) == 'D') {
+        f++;
+        code = PNI_OP_DESCRIBED_ARRAY;
+      }
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_open(&c, '[');
+      break;
+    case '[':
+      if (f > fmt && *(f - 1) == 'T') break; /* The array's own list */
+      // fallthrough
+    case '{':
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_open(&c, '[');
+      break;
+    case ']':
+    case '}':
+      err = pni_fill_op(&c, code);
+      if (!err && c.depth && c.open[c.depth-1].kind == '[') {
+        c.depth--;
+        err = pni_fill_value(&c);
+      }
+      break;
+    case 'T':
+      err = pni_fill_op(&c, code);
+      break;
+    case '?':
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_open(&c, '?');
+      if (!err) err = pni_fill_op(&c, 0);
+      break;
+    case '*':
+      if (*(f + 1) != 's') {
+        pn_log(PN_SUBSYSTEM_ENGINE, PN_LEVEL_ERROR, "unrecognized * code: 0x%.2X '%c'", *(f + 1), *(f + 1));
+        return PN_ARG_ERR;
+      }
+      f++;
+      err = pni_fill_op(&c, code);
+      if (!err) err = pni_fill_value(&c);
+      break;
+    default:
+      pn_log(PN_SUBSYSTEM_ENGINE, PN_LEVEL_ERROR, "unrecognized fill code: 0x%.2X '%c'", code, code);
+      return PN_ARG_ERR;
+    }
+    if (err) return err;
+  }
+  return c.size;
+}
+
+int pni_data_vfill_format(pn_data_t *data, const pni_format_t *format, va_list ap)
+{
+  const uint8_t *ops = format->ops;
+  for (size_t i = 0; i < format->size; i++) {
+    int err = 0;
+    switch (ops[i]) {
     case 'n':
       err = pn_data_put_null(data);
       break;
@@ -545,14 +782,9 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
     case 's':
       {
         char *start = va_arg(ap, char *);
-        size_t size;
         if (start) {
-          size = strlen(start);
-          if (code == 'S') {
-            err = pn_data_put_string(data, pn_bytes(size, start));
-          } else {
-            err = pn_data_put_symbol(data, pn_bytes(size, start));
-          }
+          pn_bytes_t bytes = pn_bytes(strlen(start), start);
+          err = ops[i] == 'S' ? pn_data_put_string(data, bytes) : pn_data_put_symbol(data, bytes);
         } else {
           err = pn_data_put_null(data);
         }
@@ -562,35 +794,28 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
       err = pn_data_put_described(data);
       pn_data_enter(data);
       break;
+    case PNI_OP_EXIT_DESCRIBED:
+      pn_data_exit(data);
+      break;
     case 'T':
       {
         pni_node_t *parent = pn_data_node(data, data->parent);
         if (parent->atom.type == PN_ARRAY) {
           parent->type = (pn_type_t) va_arg(ap, int);
         } else {
-          return pn_error_format(data->error, PN_ERR, "naked type");
+          return pn_error_format(pn_data_error(data), PN_ERR, "naked type");
         }
       }
       break;
     case '@':
-      {
-        bool described;
-        if (*(fmt + 1) == 'D') {
-          fmt++;
-          described = true;
-        } else {
-          described = false;
-        }
-        err = pn_data_put_array(data, described, (pn_type_t) 0);
-        pn_data_enter(data);
-      }
+    case PNI_OP_DESCRIBED_ARRAY:
+      err = pn_data_put_array(data, ops[i] == PNI_OP_DESCRIBED_ARRAY, (pn_type_t) 0);
+      pn_data_enter(data);
       break;
     case '[':
-      if (fmt < (begin + 2) || *(fmt - 2) != 'T') {
-        err = pn_data_put_list(data);
-        if (err) return err;
-        pn_data_enter(data);
-      }
+      err = pn_data_put_list(data);
+      if (err) return err;
+      pn_data_enter(data);
       break;
     case '{':
       err = pn_data_put_map(data);
@@ -600,38 +825,41 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
     case '}':
     case ']':
       if (!pn_data_exit(data))
-        return pn_error_format(data->error, PN_ERR, "exit failed");
+        return pn_error_format(pn_data_error(data), PN_ERR, "exit failed");
       break;
     case '?':
-      if (!va_arg(ap, int)) {
+      {
+        size_t end = i + 1 + ops[i + 1];
+        ++i;
+        if (va_arg(ap, int)) break;
         err = pn_data_put_null(data);
-        if (err) return err;
-        pn_data_enter(data);
+        // Skip the guarded value, taking its arguments
+        while (i < end) {
+          switch (ops[++i]) {
+          case 'o': case 'b': case 'h': case 'T': (void) va_arg(ap, int); break;
+          case 'B': case 'H': (void) va_arg(ap, unsigned int); break;
+          case 'I': case 'i': (void) va_arg(ap, uint32_t); break;
+          case 'L': (void) va_arg(ap, uint64_t); break;
+          case 'l': (void) va_arg(ap, int64_t); break;
+          case 't': (void) va_arg(ap, pn_timestamp_t); break;
+          case 'f': case 'd': (void) va_arg(ap, double); break;
+          case 'z': (void) va_arg(ap, size_t); (void) va_arg(ap, char *); break;
+          case 'S': case 's': (void) va_arg(ap, char *); break;
+          case 'C': (void) va_arg(ap, pn_data_t *); break;
+          case '*': (void) va_arg(ap, int); (void) va_arg(ap, void *); break;
+          case '?': (void) va_arg(ap, int); ++i; break;
+          default: break;
+          }
+        }
       }
       break;
     case '*':
       {
         int count = va_arg(ap, int);
-        void *ptr = va_arg(ap, void *);
-
-        char c = *(fmt++);
-
-        switch (c)
-        {
-        case 's':
-          {
-            char **sptr = (char **) ptr;
-            for (int i = 0; i < count; i++)
-            {
-              char *sym = *(sptr++);
-              err = pn_data_fill(data, "s", sym);
-              if (err) return err;
-            }
-          }
-          break;
-        default:
-          pn_logf("unrecognized * code: 0x%.2X '%c'", code, code);
-          return PN_ARG_ERR;
+        char **sptr = (char **) va_arg(ap, void *);
+        for (int n = 0; n < count && !err; n++) {
+          char *sym = *(sptr++);
+          err = sym ? pn_data_put_symbol(data, pn_bytes(strlen(sym), sym)) : pn_data_put_null(data);
         }
       }
       break;
@@ -640,40 +868,46 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
         pn_data_t *src = va_arg(ap, pn_data_t *);
         if (src && pn_data_size(src) > 0) {
           err = pn_data_appendn(data, src, 1);
-          if (err) return err;
         } else {
           err = pn_data_put_null(data);
-          if (err) return err;
         }
       }
       break;
     default:
-      pn_logf("unrecognized fill code: 0x%.2X '%c'", code, code);
-      return PN_ARG_ERR;
+      return pn_error_format(pn_data_error(data), PN_ARG_ERR, "bad fill op: 0x%.2X", ops[i]);
     }
-
     if (err) return err;
-
-    pni_node_t *parent = pn_data_node(data, data->parent);
-    while (parent) {
-      if (parent->atom.type == PN_DESCRIBED && parent->children == 2) {
-        pn_data_exit(data);
-        parent = pn_data_node(data, data->parent);
-      } else if (parent->atom.type == PN_NULL && parent->children == 1) {
-        pn_data_exit(data);
-        pni_node_t *current = pn_data_node(data, data->current);
-        current->down = 0;
-        current->children = 0;
-        parent = pn_data_node(data, data->parent);
-      } else {
-        break;
-      }
-    }
   }
-
   return 0;
 }
 
+int pni_data_fill_format(pn_data_t *data, const pni_format_t *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  int err = pni_data_vfill_format(data, format, ap);
+  va_end(ap);
+  return err;
+}
+
+// Ops for a format compiled on the fly, without allocating for most formats
+#define PNI_FORMAT_STACK (128)
+
+int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
+{
+  uint8_t buf[PNI_FORMAT_STACK];
+  size_t max = 2 * strlen(fmt);
+  uint8_t *ops = max <= sizeof(buf) ? buf : (uint8_t *) malloc(max);
+  if (!ops) return PN_OUT_OF_MEMORY;
+  ssize_t size = pni_fill_compile(fmt, ops, max);
+  int err = (int) size;
+  if (size >= 0) {
+    pni_format_t format = {fmt, ops, (size_t) size};
+    err = pni_data_vfill_format(data, &format, ap);
+  }
+  if (ops != buf) free(ops);
+  return err;
+}
 
 int pn_data_fill(pn_data_t *data, const char *fmt, ...)
 {
@@ -705,7 +939,33 @@ static bool pn_scan_next(pn_data_t *data, pn_type_t *type, bool suspend)
 
 static pni_node_t *pni_data_peek(pn_data_t *data);
 
-int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
+ssize_t pni_scan_compile(const char *fmt, uint8_t *ops, size_t max, pn_error_t *error)
+{
+  size_t size = 0;
+  uint8_t flag = 0;
+  for (const char *f = fmt; *f; f++) {
+    char code = *f;
+    switch (code) {
+    case '?':
+      if (!*(f + 1) || *(f + 1) == '?')
+        return error ? pn_error_format(error, PN_ARG_ERR, "codes must follow a ?") : PN_ARG_ERR;
+      flag = PNI_OP_SCANARG;
+      continue;
+    case 'n': case 'o': case 'B': case 'b': case 'H': case 'h': case 'I': case 'i': case 'c':
+    case 'L': case 'l': case 't': case 'f': case 'd': case 'z': case 'S': case 's':
+    case 'D': case '@': case '[': case '{': case ']': case '}': case '.': case 'C':
+      break;
+    default:
+      return error ? pn_error_format(error, PN_ARG_ERR, "unrecognized scan code: 0x%.2X '%c'", code, code) : PN_ARG_ERR;
+    }
+    if (size >= max) return PN_OVERFLOW;
+    ops[size++] = (uint8_t) code | flag;
+    flag = 0;
+  }
+  return size;
+}
+
+int pni_data_vscan_format(pn_data_t *data, const pni_format_t *format, va_list ap)
 {
   pn_data_rewind(data);
   bool *scanarg = NULL;
@@ -714,8 +974,9 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
   int count_level = -1;
   int resume_count = 0;
 
-  while (*fmt) {
-    char code = *(fmt++);
+  for (size_t i = 0; i < format->size; i++) {
+    char code = (char) (format->ops[i] & ~PNI_OP_SCANARG);
+    if (format->ops[i] & PNI_OP_SCANARG) scanarg = va_arg(ap, bool *);
 
     bool found = false;
     pn_type_t type;
@@ -1026,7 +1287,7 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
     case '}':
       level--;
       if (!suspend && !pn_data_exit(data))
-        return pn_error_format(data->error, PN_ERR, "exit failed");
+        return pn_error_format(pn_data_error(data), PN_ERR, "exit failed");
       if (resume_count && level == count_level) resume_count--;
       break;
     case '.':
@@ -1034,11 +1295,6 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
       scanned = found;
       if (resume_count && level == count_level) resume_count--;
       break;
-    case '?':
-      if (!*fmt || *fmt == '?')
-        return pn_error_format(data->error, PN_ARG_ERR, "codes must follow a ?");
-      scanarg = va_arg(ap, bool *);
-      break;
     case 'C':
       {
         pn_data_t *dst = va_arg(ap, pn_data_t *);
@@ -1062,10 +1318,10 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
       if (resume_count && level == count_level) resume_count--;
       break;
     default:
-      return pn_error_format(data->error, PN_ARG_ERR, "unrecognized scan code: 0x%.2X '%c'", code, code);
+      return pn_error_format(pn_data_error(data), PN_ARG_ERR, "bad scan op: 0x%.2X", format->ops[i]);
     }
 
-    if (scanarg && code != '?') {
+    if (scanarg) {
       *scanarg = scanned;
       scanarg = NULL;
     }
@@ -1074,6 +1330,33 @@ int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
   return 0;
 }
 
+int pni_data_scan_format(pn_data_t *data, const pni_format_t *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  int err = pni_data_vscan_format(data, format, ap);
+  va_end(ap);
+  return err;
+}
+
+int pn_data_vscan(pn_data_t *data, const char *fmt, va_list ap)
+{
+  uint8_t buf[PNI_FORMAT_STACK];
+  size_t max = strlen(fmt);
+  uint8_t *ops = max <= sizeof(buf) ? buf : (uint8_t *) malloc(max);
+  if (!ops) return PN_OUT_OF_MEMORY;
+  ssize_t size = pni_scan_compile(fmt, ops, max, NULL);
+  // Compile again for the message, the error is only created when needed
+  if (size < 0) size = pni_scan_compile(fmt, ops, max, pn_data_error(data));
+  int err = (int) size;
+  if (size >= 0) {
+    pni_format_t format = {fmt, ops, (size_t) size};
+    err = pni_data_vscan_format(data, &format, ap);
+  }
+  if (ops != buf) free(ops);
+  return err;
+}
+
 int pn_data_scan(pn_data_t *data, const char *fmt, ...)
 {
   va_list ap;
@@ -1083,9 +1366,15 @@ int pn_data_scan(pn_data_t *data, const char *fmt, ...)
   return err;
 }
 
+static pn_string_t *pni_data_str(pn_data_t *data)
+{
+  if (!data->str) data->str = pn_string(NULL);
+  return data->str;
+}
+
 static int pni_data_inspectify(pn_data_t *data)
 {
-  int err = pn_string_set(data->str, "");
+  int err = pn_string_set(pni_data_str(data), "");
   if (err) return err;
   return pn_data_inspect(data, data->str);
 }
@@ -1111,6 +1400,355 @@ int pn_data_format(pn_data_t *data, char *bytes, size_t *size)
   }
 }
 
+// Streaming text, see pn_encoded_format
+
+#define PNI_TEXT_DEPTH (64)
+
+typedef struct {
+  pn_type_t type;               /* PN_INVALID for the top level */
+  size_t index;                 /* Values started so far */
+  bool emitted;                 /* A value was written, so the next is separated */
+  bool described;               /* An array with a descriptor */
+  const pn_fields_t *fields;    /* A described value with a known descriptor */
+  const pn_fields_t *named;     /* The value of such a described value, its
+                                   elements are that descriptor's fields */
+} pni_text_frame_t;
+
+typedef struct {
+  char *pos;
+  char *end;                    /* Leaves room for the nul */
+  pn_text_style_t style;
+  bool quoting;                 /* JSON: a map key that isn't a string is
+                                   written as one, escaping what goes in */
+  size_t quote_depth;           /* Of the map whose key is quoted */
+  size_t depth;
+  pni_text_frame_t top;
+  pni_text_frame_t stack[PNI_TEXT_DEPTH];
+} pni_text_t;
+
+static inline pni_text_frame_t *pni_text_frame(pni_text_t *t)
+{
+  return t->depth ? &t->stack[t->depth - 1] : &t->top;
+}
+
+static int pni_text_put(pni_text_t *t, const char *s, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    if (t->quoting && (s[i] == '"' || s[i] == '\\')) {
+      if (t->pos == t->end) return PN_OVERFLOW;
+      *t->pos++ = '\\';
+    }
+    if (t->pos == t->end) return PN_OVERFLOW;
+    *t->pos++ = s[i];
+  }
+  return 0;
+}
+
+static inline int pni_text_puts(pni_text_t *t, const char *s)
+{
+  return pni_text_put(t, s, strlen(s));
+}
+
+static int pni_text_printf(pni_text_t *t, const char *fmt, ...)
+{
+  char buf[64];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return PN_ERR;
+  return pni_text_put(t, buf, pn_min((size_t) n, sizeof(buf) - 1));
+}
+
+// Printable bytes as they are and the rest as \xNN, like pn_quote
+static int pni_text_quote(pni_text_t *t, pn_bytes_t bytes)
+{
+  size_t run = 0;
+  for (size_t i = 0; i < bytes.size; i++) {
+    uint8_t c = bytes.start[i];
+    if (isprint(c)) continue;
+    int err = pni_text_put(t, bytes.start + run, i - run);
+    if (!err) err = pni_text_printf(t, "\\x%.2x", c);
+    if (err) return err;
+    run = i + 1;
+  }
+  return pni_text_put(t, bytes.start + run, bytes.size - run);
+}
+
+static int pni_text_json_string(pni_text_t *t, pn_bytes_t bytes)
+{
+  int err = pni_text_put(t, "\"", 1);
+  size_t run = 0;
+  for (size_t i = 0; i < bytes.size && !err; i++) {
+    uint8_t c = bytes.start[i];
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    err = pni_text_put(t, bytes.start + run, i - run);
+    char escape = 0;
+    switch (c) {
+    case '"': case '\\': escape = c; break;
+    case '\b': escape = 'b'; break;
+    case '\f': escape = 'f'; break;
+    case '\n': escape = 'n'; break;
+    case '\r': escape = 'r'; break;
+    case '\t': escape = 't'; break;
+    }
+    if (!err) err = escape ? pni_text_printf(t, "\\%c", escape) : pni_text_printf(t, "\\u%.4x", c);
+    run = i + 1;
+  }
+  if (!err) err = pni_text_put(t, bytes.start + run, bytes.size - run);
+  return err ? err : pni_text_put(t, "\"", 1);
+}
+
+static int pni_text_base64(pni_text_t *t, pn_bytes_t bytes)
+{
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  int err = pni_text_put(t, "\"", 1);
+  for (size_t i = 0; i < bytes.size && !err; i += 3) {
+    size_t n = pn_min(bytes.size - i, (size_t) 3);
+    uint32_t v = (uint32_t) (uint8_t) bytes.start[i] << 16;
+    if (n > 1) v |= (uint32_t) (uint8_t) bytes.start[i+1] << 8;
+    if (n > 2) v |= (uint8_t) bytes.start[i+2];
+    char quad[4] = { digits[v >> 18], digits[(v >> 12) & 63],
+                     n > 1 ? digits[(v >> 6) & 63] : '=', n > 2 ? digits[v & 63] : '=' };
+    err = pni_text_put(t, quad, 4);
+  }
+  return err ? err : pni_text_put(t, "\"", 1);
+}
+
+static int pni_text_inspect_atom(pni_text_t *t, const pn_atom_t *atom)
+{
+  char text[64];
+  int n = pni_atom_text(atom, text, sizeof(text));
+  if (n >= 0) return pni_text_put(t, text, pn_min((size_t) n, sizeof(text) - 1));
+  pn_bytes_t bytes = atom->u.as_bytes;
+  bool quote = true;
+  int err = 0;
+  if (atom->type == PN_BINARY) {
+    err = pni_text_put(t, "b", 1);
+  } else if (atom->type == PN_SYMBOL) {
+    err = pni_text_put(t, ":", 1);
+    quote = false;
+    for (size_t i = 0; i < bytes.size && !quote; i++) quote = !isalpha(bytes.start[i]);
+  }
+  if (!err && quote) err = pni_text_put(t, "\"", 1);
+  if (!err) err = pni_text_quote(t, bytes);
+  if (!err && quote) err = pni_text_put(t, "\"", 1);
+  return err;
+}
+
+static int pni_text_json_atom(pni_text_t *t, const pn_atom_t *atom)
+{
+  char text[64];
+  switch (atom->type) {
+  case PN_FLOAT:
+    return isfinite(atom->u.as_float) ? pni_text_printf(t, "%.9g", atom->u.as_float) : pni_text_puts(t, "null");
+  case PN_DOUBLE:
+    return isfinite(atom->u.as_double) ? pni_text_printf(t, "%.17g", atom->u.as_double) : pni_text_puts(t, "null");
+  case PN_CHAR: {
+    // As a string of its UTF-8 encoding
+    uint32_t c = atom->u.as_char;
+    size_t n;
+    if (c < 0x80) {
+      text[0] = (char) c;
+      n = 1;
+    } else if (c < 0x800) {
+      text[0] = (char) (0xC0 | (c >> 6));
+      text[1] = (char) (0x80 | (c & 0x3F));
+      n = 2;
+    } else if (c < 0x10000) {
+      text[0] = (char) (0xE0 | (c >> 12));
+      text[1] = (char) (0x80 | ((c >> 6) & 0x3F));
+      text[2] = (char) (0x80 | (c & 0x3F));
+      n = 3;
+    } else {
+      text[0] = (char) (0xF0 | ((c >> 18) & 0x07));
+      text[1] = (char) (0x80 | ((c >> 12) & 0x3F));
+      text[2] = (char) (0x80 | ((c >> 6) & 0x3F));
+      text[3] = (char) (0x80 | (c & 0x3F));
+      n = 4;
+    }
+    return pni_text_json_string(t, pn_bytes(n, text));
+  }
+  case PN_DECIMAL32:
+  case PN_DECIMAL64:
+  case PN_DECIMAL128: {
+    int n = pni_atom_text(atom, text, sizeof(text));
+    return pni_text_json_string(t, pn_bytes(pn_min((size_t) n, sizeof(text) - 1), text));
+  }
+  case PN_UUID: {
+    // Without the UUID( ) around it
+    int n = pni_atom_text(atom, text, sizeof(text));
+    return pni_text_json_string(t, pn_bytes(pn_min((size_t) n, sizeof(text) - 1) - 6, text + 5));
+  }
+  case PN_BINARY:
+    return pni_text_base64(t, atom->u.as_bytes);
+  case PN_STRING:
+  case PN_SYMBOL:
+    return pni_text_json_string(t, atom->u.as_bytes);
+  default: {
+    int n = pni_atom_text(atom, text, sizeof(text));
+    if (n < 0) return PN_ARG_ERR;
+    return pni_text_put(t, text, pn_min((size_t) n, sizeof(text) - 1));
+  }
+  }
+}
+
+// Write what comes before a value: a separator, a field name, or the quote
+// opening a JSON map key that isn't a string. A scalar is given, and the
+// null fields of a performative are left out as pn_inspect leaves them out.
+static int pni_text_before(pni_text_t *t, const pn_atom_t *scalar, bool *skip)
+{
+  pni_text_frame_t *f = pni_text_frame(t);
+  size_t i = f->index;
+  const char *sep;
+  int err;
+  *skip = false;
+  if (t->style == PN_TEXT_JSON) {
+    switch (f->type) {
+    case PN_MAP: sep = i % 2 ? ":" : (i ? "," : ""); break;
+    case PN_DESCRIBED: sep = i ? ",\"value\":" : ""; break;
+    case PN_ARRAY: sep = f->described && i == 1 ? ",\"value\":[" : (i ? "," : ""); break;
+    case PN_INVALID: sep = i ? "\n" : ""; break;
+    default: sep = i ? "," : ""; break;
+    }
+    if ((err = pni_text_puts(t, sep))) return err;
+    if (f->type == PN_MAP && !(i % 2) && !t->quoting &&
+        !(scalar && (scalar->type == PN_STRING || scalar->type == PN_SYMBOL))) {
+      if ((err = pni_text_put(t, "\"", 1))) return err;
+      t->quoting = true;
+      t->quote_depth = t->depth;
+    }
+    return 0;
+  }
+  if (f->named && scalar && scalar->type == PN_NULL) {
+    *skip = true;
+    return 0;
+  }
+  switch (f->type) {
+  case PN_MAP: sep = i % 2 ? "=" : (i ? ", " : ""); break;
+  case PN_DESCRIBED: sep = i ? " " : ""; break;
+  default: sep = f->emitted ? ", " : ""; break;
+  }
+  if ((err = pni_text_puts(t, sep))) return err;
+  if (f->named && i < f->named->field_count) {
+    err = pni_text_printf(t, "%s=", FIELD_STRINGPOOL.STRING0+FIELD_FIELDS[f->named->first_field_index+i]);
+  }
+  return err;
+}
+
+static int pni_text_after(pni_text_t *t)
+{
+  pni_text_frame_t *f = pni_text_frame(t);
+  f->index++;
+  f->emitted = true;
+  if (t->quoting && t->quote_depth == t->depth) {
+    t->quoting = false;
+    return pni_text_put(t, "\"", 1);
+  }
+  return 0;
+}
+
+static int pni_text_enter(void *context, pn_type_t type, size_t count, pn_type_t element_type, bool described)
+{
+  pni_text_t *t = (pni_text_t *) context;
+  bool skip;
+  int err = pni_text_before(t, NULL, &skip);
+  if (err) return err;
+  if (t->depth == PNI_TEXT_DEPTH) return PN_ARG_ERR;
+  pni_text_frame_t *parent = pni_text_frame(t);
+  pni_text_frame_t *f = &t->stack[t->depth++];
+  f->type = type;
+  f->index = 0;
+  f->emitted = false;
+  f->described = described;
+  f->fields = NULL;
+  f->named = parent->type == PN_DESCRIBED && parent->index == 1 ? parent->fields : NULL;
+  bool json = t->style == PN_TEXT_JSON;
+  switch (type) {
+  case PN_DESCRIBED: return pni_text_puts(t, json ? "{\"descriptor\":" : "@");
+  case PN_LIST: return pni_text_put(t, "[", 1);
+  case PN_MAP: return pni_text_put(t, "{", 1);
+  default:
+    if (json) return pni_text_puts(t, described ? "{\"descriptor\":" : "[");
+    // XXX: the descriptor of a described array is its first element, as pn_inspect has it
+    return pni_text_printf(t, "@%s[", pn_type_name(element_type));
+  }
+}
+
+static int pni_text_leave(void *context, pn_type_t type)
+{
+  pni_text_t *t = (pni_text_t *) context;
+  pni_text_frame_t *f = pni_text_frame(t);
+  bool json = t->style == PN_TEXT_JSON;
+  int err = 0;
+  switch (type) {
+  case PN_DESCRIBED: if (json) err = pni_text_put(t, "}", 1); break;
+  case PN_LIST: err = pni_text_put(t, "]", 1); break;
+  case PN_MAP: err = pni_text_put(t, "}", 1); break;
+  default:
+    if (json && f->described) err = pni_text_puts(t, f->index < 2 ? ",\"value\":[]}" : "]}");
+    else err = pni_text_put(t, "]", 1);
+    break;
+  }
+  if (err) return err;
+  t->depth--;
+  return pni_text_after(t);
+}
+
+static int pni_text_scalar(void *context, const pn_atom_t *atom)
+{
+  pni_text_t *t = (pni_text_t *) context;
+  bool skip;
+  int err = pni_text_before(t, atom, &skip);
+  if (err) return err;
+  pni_text_frame_t *f = pni_text_frame(t);
+  if (skip) {
+    f->index++;
+    return 0;
+  }
+  if (t->style == PN_TEXT_JSON) {
+    err = pni_text_json_atom(t, atom);
+  } else if (f->type == PN_DESCRIBED && f->index == 0 && atom->type == PN_ULONG &&
+             atom->u.as_ulong >= FIELD_MIN && atom->u.as_ulong <= FIELD_MAX &&
+             FIELDS[atom->u.as_ulong-FIELD_MIN].name_index) {
+    f->fields = &FIELDS[atom->u.as_ulong-FIELD_MIN];
+    err = pni_text_printf(t, "%s(", FIELD_STRINGPOOL.STRING0+FIELD_NAME[f->fields->name_index]);
+    if (!err) err = pni_text_inspect_atom(t, atom);
+    if (!err) err = pni_text_put(t, ")", 1);
+  } else {
+    err = pni_text_inspect_atom(t, atom);
+  }
+  return err ? err : pni_text_after(t);
+}
+
+int pn_encoded_format(const char *bytes, size_t size, pn_text_style_t style, char *text, size_t *text_size)
+{
+  static const pn_decoder_handler_t handler = { pni_text_enter, pni_text_leave, pni_text_scalar };
+  if (!*text_size) return PN_OVERFLOW;
+  pni_text_t t;
+  t.pos = text;
+  t.end = text + *text_size - 1;
+  t.style = style;
+  t.quoting = false;
+  t.quote_depth = 0;
+  t.depth = 0;
+  t.top.type = PN_INVALID;
+  t.top.index = 0;
+  t.top.emitted = false;
+  t.top.described = false;
+  t.top.fields = NULL;
+  t.top.named = NULL;
+  pn_decoder_stream_t *stream = pn_decoder_stream(&handler, &t);
+  if (!stream) return PN_OUT_OF_MEMORY;
+  int err = pn_decoder_stream_feed(stream, bytes, size);
+  if (!err && !pn_decoder_stream_complete(stream)) err = PN_UNDERFLOW;
+  pn_decoder_stream_free(stream);
+  *t.pos = '\0';
+  if (err) return err;
+  *text_size = t.pos - text;
+  return 0;
+}
+
 static size_t pni_data_id(pn_data_t *data, pni_node_t *node)
 {
   return node - data->nodes + 1;
@@ -1298,6 +1936,7 @@ size_t pn_data_siblings(pn_data_t *data)
 bool pn_data_enter(pn_data_t *data)
 {
   if (data->current) {
+    if (pni_data_current(data)->encoded && pni_data_expand(data, data->current)) return false;
     data->parent = data->current;
     data->current = 0;
     return true;
@@ -1318,25 +1957,78 @@ bool pn_data_exit(pn_data_t *data)
   }
 }
 
-bool pn_data_lookup(pn_data_t *data, const char *name)
+static inline bool pni_key_matches(pni_node_t *node, pn_type_t type, pn_bytes_t key)
 {
-  while (pn_data_next(data)) {
-    pn_type_t type = pn_data_type(data);
+  return (type == PN_INVALID ? node->atom.type == PN_STRING || node->atom.type == PN_SYMBOL
+          : node->atom.type == type) && pn_bytes_equal(node->atom.u.as_bytes, key);
+}
 
-    switch (type) {
-    case PN_STRING:
-    case PN_SYMBOL:
-      {
-        pn_bytes_t bytes = pn_data_get_bytes(data);
-        if (pn_bytes_equal(bytes, pn_bytes(strlen(name), name))) {
-          return pn_data_next(data);
-        }
+static inline size_t pni_key_hash(pn_bytes_t key)
+{
+  uint32_t hash = 2166136261u;  /* FNV-1a */
+  for (size_t i = 0; i < key.size; i++) {
+    hash = (hash ^ (uint8_t) key.start[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Index the keys of map, false if there is no memory for it
+static bool pni_data_index_map(pn_data_t *data, pni_nid_t map)
+{
+  pni_map_index_t *index = data->index;
+  if (!index) {
+    index = (pni_map_index_t *) calloc(1, sizeof(pni_map_index_t));
+    if (!index) return false;
+    data->index = index;
+  }
+  pni_node_t *node = pn_data_node(data, map);
+  size_t capacity = 2 * PN_DATA_MAP_INDEX_MIN;
+  while (capacity < node->children) capacity *= 2; /* At most half full */
+  if (capacity > index->capacity) {
+    pni_nid_t *slots = (pni_nid_t *) malloc(capacity * sizeof(pni_nid_t));
+    if (!slots) return false;
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+  }
+  memset(index->slots, 0, index->capacity * sizeof(pni_nid_t));
+  size_t mask = index->capacity - 1;
+  bool is_key = true;
+  for (pni_nid_t id = node->down; id; id = pn_data_node(data, id)->next, is_key = !is_key) {
+    pni_node_t *child = pn_data_node(data, id);
+    index->last = id;
+    if (!is_key || (child->atom.type != PN_STRING && child->atom.type != PN_SYMBOL)) continue;
+    size_t i = pni_key_hash(child->atom.u.as_bytes) & mask;
+    while (index->slots[i]) i = (i + 1) & mask;
+    index->slots[i] = id;
+  }
+  index->map = map;
+  return true;
+}
+
+bool pn_data_lookup_key(pn_data_t *data, pn_type_t type, pn_bytes_t key)
+{
+  // From the start of a large map use its index, built on the first lookup
+  pni_node_t *parent = pn_data_node(data, data->parent);
+  if (!data->current && parent && parent->atom.type == PN_MAP &&
+      parent->children >= 2 * PN_DATA_MAP_INDEX_MIN &&
+      ((data->index && data->index->map == data->parent) || pni_data_index_map(data, data->parent))) {
+    pni_map_index_t *index = data->index;
+    size_t mask = index->capacity - 1;
+    for (size_t i = pni_key_hash(key) & mask; index->slots[i]; i = (i + 1) & mask) {
+      if (pni_key_matches(pn_data_node(data, index->slots[i]), type, key)) {
+        data->current = index->slots[i];
+        return pn_data_next(data);
       }
-      break;
-    default:
-      break;
     }
+    data->current = index->last;
+    return false;
+  }
 
+  while (pn_data_next(data)) {
+    if (pni_key_matches(pni_data_current(data), type, key)) {
+      return pn_data_next(data);
+    }
     // skip the value
     pn_data_next(data);
   }
@@ -1344,13 +2036,18 @@ bool pn_data_lookup(pn_data_t *data, const char *name)
   return false;
 }
 
+bool pn_data_lookup(pn_data_t *data, const char *name)
+{
+  return pn_data_lookup_key(data, PN_INVALID, pn_bytes(strlen(name), name));
+}
+
 void pn_data_dump(pn_data_t *data)
 {
   printf("{current=%" PN_ZI ", parent=%" PN_ZI "}\n", (size_t) data->current, (size_t) data->parent);
   for (unsigned i = 0; i < data->size; i++)
   {
     pni_node_t *node = &data->nodes[i];
-    pn_string_set(data->str, "");
+    pn_string_set(pni_data_str(data), "");
     pni_inspect_atom((pn_atom_t *) &node->atom, data->str);
     printf("Node %i: prev=%" PN_ZI ", next=%" PN_ZI ", parent=%" PN_ZI ", down=%" PN_ZI 
            ", children=%" PN_ZI ", type=%s (%s)\n",
@@ -1365,6 +2062,7 @@ void pn_data_dump(pn_data_t *data)
 
 static pni_node_t *pni_data_add(pn_data_t *data)
 {
+  if (data->index) data->index->map = 0;
   pni_node_t *current = pni_data_current(data);
   pni_node_t *parent = pn_data_node(data, data->parent);
   pni_node_t *node;
@@ -1415,28 +2113,216 @@ static pni_node_t *pni_data_add(pn_data_t *data)
 
   node->down = 0;
   node->children = 0;
-  node->data = false;
-  node->data_offset = 0;
-  node->data_size = 0;
+  node->encoded = false;
   data->current = pni_data_id(data, node);
   return node;
 }
 
 ssize_t pn_data_encode(pn_data_t *data, char *bytes, size_t size)
 {
+  if (!data->encoder) data->encoder = pn_encoder();
   return pn_encoder_encode(data->encoder, data, bytes, size);
 }
 
 ssize_t pn_data_encoded_size(pn_data_t *data)
 {
+  if (!data->encoder) data->encoder = pn_encoder();
   return pn_encoder_size(data->encoder, data);
 }
 
+void pni_data_trim_nulls(pn_data_t *data)
+{
+  if (!data->encoder) data->encoder = pn_encoder();
+  pn_encoder_trim(data->encoder, true);
+}
+
+ssize_t pni_data_encode_grow(pn_data_t *data, pn_rwbytes_t *buf, size_t offset)
+{
+  if (!data->encoder) data->encoder = pn_encoder();
+  return pn_encoder_encode_grow(data->encoder, data, buf, offset);
+}
+
 ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size)
 {
+  if (!data->decoder) data->decoder = pn_decoder();
   return pn_decoder_decode(data->decoder, bytes, size, data);
 }
 
+// Encoded nodes
+
+static inline bool pni_data_keeps_encoded(pn_data_t *data, const char *bytes)
+{
+  switch ((uint8_t) bytes[0]) {
+  case PNE_DESCRIPTOR:
+  case PNE_LIST8:
+  case PNE_LIST32:
+  case PNE_MAP8:
+  case PNE_MAP32:
+    return pni_data_parent_type(data) != PN_ARRAY;
+  default:
+    return false;
+  }
+}
+
+// Put a value that pni_data_keeps_encoded, its bytes already interned
+static int pni_data_put_raw(pn_data_t *data, pn_bytes_t bytes)
+{
+  pni_node_t *node = pni_data_add(data);
+  if (node == NULL) return PN_OUT_OF_MEMORY;
+  switch ((uint8_t) bytes.start[0]) {
+  case PNE_DESCRIPTOR: node->atom.type = PN_DESCRIBED; break;
+  case PNE_LIST8:
+  case PNE_LIST32: node->atom.type = PN_LIST; break;
+  default: node->atom.type = PN_MAP; break;
+  }
+  node->atom.u.as_bytes = bytes;
+  node->encoded = true;
+  return 0;
+}
+
+// The first element of an encoded node and the number of elements, NULL if
+// the header does not fit
+static const char *pni_data_raw_elements(pni_node_t *node, size_t *count)
+{
+  pn_bytes_t bytes = node->atom.u.as_bytes;
+  switch ((uint8_t) bytes.start[0]) {
+  case PNE_DESCRIPTOR:
+    *count = 2;
+    return bytes.start + 1;
+  case PNE_LIST8:
+  case PNE_MAP8:
+    if (bytes.size < 3) return NULL;
+    *count = (uint8_t) bytes.start[2];
+    return bytes.start + 3;
+  default:
+    if (bytes.size < 9) return NULL;
+    *count = pni_read32(bytes.start + 5);
+    return bytes.start + 9;
+  }
+}
+
+// Decode the elements of an encoded node as its children. Children that
+// can stay encoded do, pointing into the node's bytes.
+static int pni_data_expand(pn_data_t *data, pni_nid_t id)
+{
+  pni_node_t *node = pn_data_node(data, id);
+  const char *end = node->atom.u.as_bytes.start + node->atom.u.as_bytes.size;
+  size_t count;
+  const char *pos = pni_data_raw_elements(node, &count);
+  if (!pos) return pn_error_format(pn_data_error(data), PN_ARG_ERR, "truncated encoded value");
+  node->encoded = false;
+  if (!data->decoder) data->decoder = pn_decoder();
+
+  pni_nid_t parent = data->parent, current = data->current;
+  data->parent = id;
+  data->current = 0;
+  int err = 0;
+  for (size_t i = 0; i < count && !err; i++) {
+    ssize_t size = pni_decoder_value_size(pos, end - pos);
+    if (size < 0) {
+      err = pn_error_format(pn_data_error(data), (int) size, "bad encoded value");
+    } else if (pni_data_keeps_encoded(data, pos)) {
+      err = pni_data_put_raw(data, pn_bytes(size, pos));
+    } else {
+      ssize_t used = pn_decoder_decode(data->decoder, pos, size, data);
+      if (used < 0) err = (int) used;
+    }
+    pos += size;
+  }
+  // The decoder leaves a described value once it has both children
+  data->parent = parent;
+  data->current = current;
+  return err;
+}
+
+ssize_t pn_data_decode_lazy(pn_data_t *data, const char *bytes, size_t size)
+{
+  ssize_t used = pni_decoder_value_size(bytes, size);
+  if (used < 0) {
+    return pn_error_format(pn_data_error(data), (int) used, used == PN_UNDERFLOW ?
+                           "not enough data to decode" : "bad encoded value");
+  }
+  if (!pni_data_keeps_encoded(data, bytes)) return pn_data_decode(data, bytes, used);
+  char *start = pni_data_intern(data, bytes, used);
+  if (!start) return PN_OUT_OF_MEMORY;
+  int err = pni_data_put_raw(data, pn_bytes(used, start));
+  return err ? err : used;
+}
+
+int pn_data_put_encoded(pn_data_t *data, pn_bytes_t bytes)
+{
+  ssize_t used = pni_decoder_value_size(bytes.start, bytes.size);
+  if (used < 0 || (size_t) used != bytes.size) {
+    return pn_error_format(pn_data_error(data), PN_ARG_ERR, "not a single encoded value");
+  }
+  used = pn_data_decode_lazy(data, bytes.start, bytes.size);
+  return used < 0 ? (int) used : 0;
+}
+
+static bool pni_data_skips(pni_node_t *node, const uint64_t *skip, size_t count)
+{
+  pn_bytes_t bytes = node->atom.u.as_bytes;
+  if (!count || (uint8_t) bytes.start[0] != PNE_DESCRIPTOR || bytes.size < 2) return false;
+  uint64_t code;
+  switch ((uint8_t) bytes.start[1]) {
+  case PNE_ULONG0: code = 0; break;
+  case PNE_SMALLULONG:
+    if (bytes.size < 3) return false;
+    code = (uint8_t) bytes.start[2];
+    break;
+  case PNE_ULONG:
+    if (bytes.size < 10) return false;
+    code = pni_read64(bytes.start + 2);
+    break;
+  default: return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (skip[i] == code) return true;
+  }
+  return false;
+}
+
+// Expand an encoded node and its children down to depth, except values
+// described by one of skip
+static int pni_data_expand_partial(pn_data_t *data, pni_nid_t id, int depth,
+                                   const uint64_t *skip, size_t count)
+{
+  pni_node_t *node = pn_data_node(data, id);
+  if (!node->encoded || depth == 0 || pni_data_skips(node, skip, count)) return 0;
+  int err = pni_data_expand(data, id);
+  for (pni_nid_t child = pn_data_node(data, id)->down; child && !err;
+       child = pn_data_node(data, child)->next) {
+    err = pni_data_expand_partial(data, child, depth - 1, skip, count);
+  }
+  return err;
+}
+
+ssize_t pn_data_decode_partial(pn_data_t *data, const char *bytes, size_t size,
+                               const uint64_t *skip, size_t count, int depth)
+{
+  ssize_t used = pn_data_decode_lazy(data, bytes, size);
+  if (used < 0) return used;
+  pni_nid_t id = data->current;
+  if (pn_data_node(data, id)->encoded) {
+    // The expanded nodes are added after id, so id stays current
+    int err = pni_data_expand_partial(data, id, depth, skip, count);
+    if (err) return err;
+  }
+  return used;
+}
+
+// Expand every encoded node, for inspection
+static int pni_data_expand_all(pn_data_t *data)
+{
+  for (pni_nid_t id = 1; id && id <= data->size; id++) {
+    if (pn_data_node(data, id)->encoded) {
+      int err = pni_data_expand(data, id);
+      if (err) return err;
+    }
+  }
+  return 0;
+}
+
 int pn_data_put_list(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
@@ -1463,6 +2349,85 @@ int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type)
   return 0;
 }
 
+static bool pni_type_fixed_width(pn_type_t type)
+{
+  switch (type) {
+  case PN_UBYTE: case PN_BYTE: case PN_USHORT: case PN_SHORT: case PN_UINT: case PN_INT:
+  case PN_CHAR: case PN_ULONG: case PN_LONG: case PN_TIMESTAMP: case PN_FLOAT: case PN_DOUBLE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Expands BODY(FIELD, CTYPE) with the atom field and C type of a fixed
+   width TYPE */
+#define PNI_FIXED_WIDTH_SWITCH(TYPE, BODY) \
+  switch (TYPE) { \
+  case PN_UBYTE: BODY(as_ubyte, uint8_t); break; \
+  case PN_BYTE: BODY(as_byte, int8_t); break; \
+  case PN_USHORT: BODY(as_ushort, uint16_t); break; \
+  case PN_SHORT: BODY(as_short, int16_t); break; \
+  case PN_UINT: BODY(as_uint, uint32_t); break; \
+  case PN_INT: BODY(as_int, int32_t); break; \
+  case PN_CHAR: BODY(as_char, pn_char_t); break; \
+  case PN_ULONG: BODY(as_ulong, uint64_t); break; \
+  case PN_LONG: BODY(as_long, int64_t); break; \
+  case PN_TIMESTAMP: BODY(as_timestamp, pn_timestamp_t); break; \
+  case PN_FLOAT: BODY(as_float, float); break; \
+  case PN_DOUBLE: BODY(as_double, double); break; \
+  default: break; \
+  }
+
+int pn_data_put_array_values(pn_data_t *data, pn_type_t type, const void *values, size_t count)
+{
+  if (!pni_type_fixed_width(type)) return PN_ARG_ERR;
+  /* Room for the array and all its elements, so nodes don't move below */
+  int err = pni_data_reserve(data, count + 1);
+  if (err) return err;
+  err = pn_data_put_array(data, false, type);
+  if (err) return err;
+
+  /* The elements are new nodes following the array, linked in order */
+  pni_nid_t array = data->current;
+  pni_nid_t first = data->size + 1;
+  pni_node_t *nodes = data->nodes + data->size;
+  for (size_t i = 0; i < count; i++) {
+    pni_node_t *node = &nodes[i];
+    node->next = i + 1 < count ? first + i + 1 : 0;
+    node->prev = i ? first + i - 1 : 0;
+    node->down = 0;
+    node->parent = array;
+    node->children = 0;
+    node->encoded = false;
+    node->atom.type = type;
+  }
+#define PNI_PUT_VALUES(FIELD, CTYPE) \
+  for (size_t i = 0; i < count; i++) nodes[i].atom.u.FIELD = ((const CTYPE *) values)[i]
+  PNI_FIXED_WIDTH_SWITCH(type, PNI_PUT_VALUES)
+#undef PNI_PUT_VALUES
+  data->size += count;
+  pni_node_t *node = pn_data_node(data, array);
+  node->down = count ? first : 0;
+  node->children = count;
+  return 0;
+}
+
+size_t pn_data_get_array_values(pn_data_t *data, pn_type_t type, void *values, size_t count)
+{
+  pni_node_t *array = pni_data_current(data);
+  if (!array || array->atom.type != PN_ARRAY || array->described || array->type != type) return 0;
+  size_t n = 0;
+#define PNI_GET_VALUES(FIELD, CTYPE) \
+  for (pni_node_t *node = pn_data_node(data, array->down); \
+       node && n < count && node->atom.type == type; \
+       node = pn_data_node(data, node->next)) \
+    ((CTYPE *) values)[n++] = node->atom.u.FIELD
+  PNI_FIXED_WIDTH_SWITCH(type, PNI_GET_VALUES)
+#undef PNI_GET_VALUES
+  return n;
+}
+
 void pni_data_set_array_type(pn_data_t *data, pn_type_t type)
 {
   pni_node_t *array = pni_data_current(data);
@@ -1677,6 +2642,8 @@ size_t pn_data_get_list(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node && node->atom.type == PN_LIST) {
+    size_t count;
+    if (node->encoded) return pni_data_raw_elements(node, &count) ? count : 0;
     return node->children;
   } else {
     return 0;
@@ -1687,6 +2654,8 @@ size_t pn_data_get_map(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node && node->atom.type == PN_MAP) {
+    size_t count;
+    if (node->encoded) return pni_data_raw_elements(node, &count) ? count : 0;
     return node->children;
   } else {
     return 0;
@@ -1968,10 +2937,102 @@ pn_atom_t pn_data_get_atom(pn_data_t *data)
   }
 }
 
+// Chunk sizes at least double, so this is more than the address space holds
+#define PNI_DATA_MAX_CHUNKS (64)
+
+// Append copies of node id of src, the siblings after it and everything
+// below them, node by node without the put API. Encoded nodes stay encoded.
+static int pni_data_copy_tree(pn_data_t *data, pn_data_t *src, pni_nid_t id)
+{
+  pni_nid_t top = pn_data_node(src, id)->parent;
+  while (id) {
+    pni_node_t *from = pn_data_node(src, id);
+    pni_node_t *node = pni_data_add(data);
+    if (!node) return PN_OUT_OF_MEMORY;
+    pni_nid_t next = node->next, prev = node->prev, parent = node->parent;
+    *node = *from;
+    node->next = next;
+    node->prev = prev;
+    node->parent = parent;
+    node->down = 0;
+    node->children = 0;
+    pn_bytes_t *bytes = pni_node_interned(node);
+    if (bytes) {
+      char *start = pni_data_intern(data, bytes->start, bytes->size);
+      if (!start) return PN_OUT_OF_MEMORY;
+      bytes->start = start;
+    }
+    if (!from->encoded && from->down) {
+      data->parent = data->current;
+      data->current = 0;
+      id = from->down;
+      continue;
+    }
+    // On to the next sibling, leaving the compounds this completes
+    while (!pn_data_node(src, id)->next) {
+      id = pn_data_node(src, id)->parent;
+      if (id == top) return 0;
+      pn_data_exit(data);
+    }
+    id = pn_data_node(src, id)->next;
+  }
+  return 0;
+}
+
+// Copy all of src into an empty data: the nodes as they are, the bytes of
+// all the chunks into one, and each node's bytes moved by its chunk's offset
+static int pni_data_copy_all(pn_data_t *data, pn_data_t *src)
+{
+  struct { const char *start; size_t used; char *to; } chunks[PNI_DATA_MAX_CHUNKS];
+  size_t count = 0, total = 0;
+  for (pni_data_chunk_t *chunk = src->chunks; chunk; chunk = chunk->next) {
+    if (count == PNI_DATA_MAX_CHUNKS) return pni_data_copy_tree(data, src, 1);
+    chunks[count].start = (const char *) (chunk + 1);
+    chunks[count].used = chunk->used;
+    total += chunk->used;
+    count++;
+  }
+  int err = pni_data_reserve(data, src->size);
+  if (err) return err;
+  char *to = total ? pni_data_alloc(data, total) : NULL;
+  if (total && !to) return PN_OUT_OF_MEMORY;
+  for (size_t i = 0; i < count; i++) {
+    if (chunks[i].used) memcpy(to, chunks[i].start, chunks[i].used);
+    chunks[i].to = to;
+    to += chunks[i].used;
+  }
+  if (src->size) memcpy(data->nodes, src->nodes, src->size * sizeof(pni_node_t));
+  data->size = src->size;
+  for (pni_nid_t id = 1; id <= data->size; id++) {
+    pn_bytes_t *bytes = pni_node_interned(pn_data_node(data, id));
+    if (!bytes) continue;
+    uintptr_t at = (uintptr_t) bytes->start;
+    size_t i = 0;
+    while (i < count && !(at >= (uintptr_t) chunks[i].start && at < (uintptr_t) chunks[i].start + chunks[i].used))
+      i++;
+    if (i < count) {
+      bytes->start = chunks[i].to + (at - (uintptr_t) chunks[i].start);
+    } else {
+      char *start = pni_data_intern(data, bytes->start, bytes->size);
+      if (!start) return PN_OUT_OF_MEMORY;
+      bytes->start = start;
+    }
+  }
+  return 0;
+}
+
 int pn_data_copy(pn_data_t *data, pn_data_t *src)
 {
   pn_data_clear(data);
-  int err = pn_data_append(data, src);
+  int err = 0;
+  if (!src->base_parent && !src->base_current) {
+    err = pni_data_copy_all(data, src);
+  } else {
+    // Narrowed, the values pn_data_next finds after a rewind
+    pni_nid_t first = src->base_current ? pn_data_node(src, src->base_current)->next
+      : pn_data_node(src, src->base_parent)->down;
+    if (first) err = pni_data_copy_tree(data, src, first);
+  }
   pn_data_rewind(data);
   return err;
 }
@@ -2009,6 +3070,15 @@ int pn_data_appendn(pn_data_t *data, pn_data_t *src, int limit)
     if (level == 0 && count == limit)
       break;
 
+    /* Still encoded, so copied as it is */
+    pni_node_t *node = pni_data_current(src);
+    if (node->encoded) {
+      err = pn_data_put_encoded(data, node->atom.u.as_bytes);
+      if (level == 0) count++;
+      if (err) { pn_data_restore(src, point); return err; }
+      continue;
+    }
+
     pn_type_t type = pn_data_type(src);
     switch (type) {
     case PN_NULL:
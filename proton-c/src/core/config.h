@@ -25,4 +25,124 @@
 # define PN_TRANSPORT_INITIAL_FRAME_SIZE (512) /* bytes */
 #endif
 
+#ifndef PN_TRANSPORT_OUTPUT_CHUNK_SIZE
+# define PN_TRANSPORT_OUTPUT_CHUNK_SIZE (16*1024) /* bytes */
+#endif
+
+#ifndef PN_TRANSPORT_OUTPUT_LIMIT
+# define PN_TRANSPORT_OUTPUT_LIMIT (1024*1024) /* bytes */
+#endif
+
+#ifndef PN_TRANSPORT_INTERLEAVE_FRAME_SIZE
+# define PN_TRANSPORT_INTERLEAVE_FRAME_SIZE (16*1024) /* bytes */
+#endif
+
+#ifndef PN_TRANSPORT_INPUT_SHRINK
+# define PN_TRANSPORT_INPUT_SHRINK 16 /* times the input buffer empties little used before it shrinks */
+#endif
+
+#ifndef PN_TRANSPORT_DISPOSITION_LIMIT
+# define PN_TRANSPORT_DISPOSITION_LIMIT 256 /* deliveries */
+#endif
+
+#ifndef PN_COLLECTOR_RING_SIZE
+# define PN_COLLECTOR_RING_SIZE 64 /* events preallocated per connection driver */
+#endif
+
+#ifndef PN_LINK_STREAM_FRAMES
+# define PN_LINK_STREAM_FRAMES 4 /* frames buffered per streamed delivery */
+#endif
+
+#ifndef PN_LINK_STREAM_FRAME_SIZE
+# define PN_LINK_STREAM_FRAME_SIZE (64*1024) /* bytes, when the peer sets no max frame */
+#endif
+
+#ifndef PN_DATA_MAP_INDEX_MIN
+# define PN_DATA_MAP_INDEX_MIN 16 /* entries, pn_data_lookup indexes larger maps */
+#endif
+
+#ifndef PN_ENCODER_BUFFER_SIZE
+# define PN_ENCODER_BUFFER_SIZE 256 /* bytes, first allocation of an encoding grown as it is written */
+#endif
+
+#ifndef PN_OBJECT_POOL_CHUNK_SIZE
+# define PN_OBJECT_POOL_CHUNK_SIZE (16*1024) /* bytes, allocated at a time by a connection's object pool */
+#endif
+
+#ifndef PN_OBJECT_POOL_MAX_SIZE
+# define PN_OBJECT_POOL_MAX_SIZE 1024 /* bytes, larger objects bypass the pool */
+#endif
+
+#ifndef PN_DELIVERY_BUFFER_SIZE
+# define PN_DELIVERY_BUFFER_SIZE 64 /* bytes, initial capacity of a delivery's data buffer */
+#endif
+
+#ifndef PN_DELIVERY_TAG_SIZE
+# define PN_DELIVERY_TAG_SIZE 32 /* bytes, longer tags are copied to the heap; 32 is the AMQP maximum */
+#endif
+
+#ifndef PN_SESSION_BUDGET_FRAME_SIZE
+# define PN_SESSION_BUDGET_FRAME_SIZE (16*1024) /* bytes per frame a budgeted session assumes until one arrives */
+#endif
+
+#ifndef PN_DELIVERY_POOL_MAX_BYTES
+# define PN_DELIVERY_POOL_MAX_BYTES (1024*1024) /* bytes of data buffer kept by a connection's recycled deliveries */
+#endif
+
+#ifndef PN_LINK_POOL_MAX
+# define PN_LINK_POOL_MAX 64 /* finalized links a connection keeps for reuse with their termini */
+#endif
+
+#ifndef PN_SSL_BUFFER_SIZE
+# define PN_SSL_BUFFER_SIZE (16*1024) /* bytes, application data buffered each way per SSL transport */
+#endif
+
+#ifndef PN_SSL_RECORD_START_SIZE
+# define PN_SSL_RECORD_START_SIZE 1400 /* bytes per TLS record at the start of a burst, one TCP segment */
+#endif
+
+#ifndef PN_SSL_RECORD_RAMP_BYTES
+# define PN_SSL_RECORD_RAMP_BYTES (64*1024) /* bytes of a burst before TLS records grow to the maximum */
+#endif
+
+#ifndef PN_SSL_SESSION_CACHE_SIZE
+# define PN_SSL_SESSION_CACHE_SIZE 256 /* client sessions kept per SSL domain for resumption */
+#endif
+
+#ifndef PN_SSL_SESSION_CACHE_TTL
+# define PN_SSL_SESSION_CACHE_TTL 0 /* milliseconds, 0 leaves it to the session's own lifetime */
+#endif
+
+#ifndef PN_SSL_VERIFY_CACHE_SIZE
+# define PN_SSL_VERIFY_CACHE_SIZE 256 /* verified peer certificate chains remembered per SSL domain */
+#endif
+
+#ifndef PN_SSL_VERIFY_CACHE_TTL
+# define PN_SSL_VERIFY_CACHE_TTL (10*60*1000) /* milliseconds a verified chain is trusted without checking signatures */
+#endif
+
+#ifndef PN_IOCP_WRITE_DEPTH
+# define PN_IOCP_WRITE_DEPTH 16 /* overlapped writes outstanding per Windows socket, except loopback */
+#endif
+
+#ifndef PN_IOCP_WRITE_POOL
+# define PN_IOCP_WRITE_POOL 64 /* 16K write buffers shared by the sockets of a completion port */
+#endif
+
+#ifndef PN_IOCP_RIO_RECV_SIZE
+# define PN_IOCP_RIO_RECV_SIZE (16*1024) /* registered receive buffer per socket with -Dproactor=rio */
+#endif
+
+#ifndef PN_IOCP_RIO_QUEUE_SIZE
+# define PN_IOCP_RIO_QUEUE_SIZE 1024 /* initial Registered I/O completion queue entries, grown as needed */
+#endif
+
+#ifndef PN_SASL_CREDENTIAL_CACHE_SIZE
+# define PN_SASL_CREDENTIAL_CACHE_SIZE 0 /* successful SASL server authentications remembered, 0 for none */
+#endif
+
+#ifndef PN_SASL_CREDENTIAL_CACHE_TTL
+# define PN_SASL_CREDENTIAL_CACHE_TTL (60*1000) /* milliseconds a remembered authentication is accepted */
+#endif
+
 #endif /*  _PROTON_SRC_CONFIG_H */
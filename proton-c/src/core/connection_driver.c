@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "config.h"
 #include "engine-internal.h"
 #include <proton/condition.h>
 #include <proton/connection.h>
@@ -56,6 +57,8 @@ int pn_connection_driver_init(pn_connection_driver_t* d, pn_connection_t *c, pn_
     pn_connection_driver_destroy(d);
     return PN_OUT_OF_MEMORY;
   }
+  // Driver events are only valid until the next one, so they can be recycled in place
+  pn_collector_set_ring(d->collector, PN_COLLECTOR_RING_SIZE);
   pn_connection_collect(d->connection, d->collector);
   return 0;
 }
@@ -94,6 +97,11 @@ void pn_connection_driver_read_done(pn_connection_driver_t *d, size_t n) {
   if (n > 0) pn_transport_process(d->transport, n);
 }
 
+size_t pn_connection_driver_read_external(pn_connection_driver_t *d, const char *bytes, size_t n) {
+  ssize_t taken = n ? pni_transport_push_external(d->transport, bytes, n) : 0;
+  return taken > 0 ? (size_t)taken : 0;
+}
+
 bool pn_connection_driver_read_closed(pn_connection_driver_t *d) {
   return pn_transport_tail_closed(d->transport);
 }
@@ -114,6 +122,14 @@ void pn_connection_driver_write_done(pn_connection_driver_t *d, size_t n) {
   pn_transport_pop(d->transport, n);
 }
 
+size_t pn_connection_driver_write_iovec(pn_connection_driver_t *d, pn_bytes_t *segments, size_t n) {
+  return pni_transport_output_segments(d->transport, segments, n);
+}
+
+void pn_connection_driver_write_iovec_done(pn_connection_driver_t *d, size_t n) {
+  if (n > 0) pni_transport_output_segments_done(d->transport, n);
+}
+
 bool pn_connection_driver_write_closed(pn_connection_driver_t *d) {
   return pn_transport_head_closed(d->transport);
 }
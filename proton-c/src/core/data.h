@@ -27,15 +27,16 @@
 #include "decoder.h"
 #include "encoder.h"
 
+#ifdef PNI_DATA_LARGE
+typedef uint32_t pni_nid_t;
+#else
 typedef uint16_t pni_nid_t;
+#endif
 #define PNI_NID_MAX ((pni_nid_t)-1)
 
+/* The tree links and flags that traversal touches come first, ahead of the
+   payload, so with 16 bit ids a node fits in 64 bytes */
 typedef struct {
-  char *start;
-  size_t data_offset;
-  size_t data_size;
-  pn_atom_t atom;
-  pn_type_t type;
   pni_nid_t next;
   pni_nid_t prev;
   pni_nid_t down;
@@ -43,17 +44,40 @@ typedef struct {
   pni_nid_t children;
   // for arrays
   bool described;
-  bool data;
   bool small;
+  bool encoded;                 /* A list, map or described value kept as
+                                   its encoding in atom until entered */
+  pn_type_t type;
+  pn_atom_t atom;
+  size_t start;                 /* Offset of a compound's size, for the encoder */
 } pni_node_t;
 
+/* Interned bytes are copied into chunks that never move, so nodes point
+   straight at them however much the data grows */
+typedef struct pni_data_chunk_t {
+  struct pni_data_chunk_t *next; /* The chunk filled before this one */
+  size_t size;
+  size_t used;
+} pni_data_chunk_t;             /* Followed by size bytes */
+
+/* Key index for one map, built by pn_data_lookup on a large map and dropped
+   by any put or clear.  Slots hold the map's string and symbol keys in map
+   order along each probe chain, so the first of duplicate keys is found. */
+typedef struct {
+  pni_nid_t map;                /* The map indexed, 0 if none */
+  pni_nid_t last;               /* Its last child, where a failed lookup stops */
+  size_t capacity;              /* Slots, a power of two */
+  pni_nid_t *slots;             /* Key node ids, 0 for an empty slot */
+} pni_map_index_t;
+
 struct pn_data_t {
   pni_node_t *nodes;
-  pn_buffer_t *buf;
+  pni_data_chunk_t *chunks;     /* The one being filled, NULL until needed */
   pn_decoder_t *decoder;
   pn_encoder_t *encoder;
   pn_error_t *error;
   pn_string_t *str;
+  pni_map_index_t *index;       /* NULL until a large map is looked up */
   pni_nid_t capacity;
   pni_nid_t size;
   pni_nid_t parent;
@@ -67,9 +91,23 @@ static inline pni_node_t * pn_data_node(pn_data_t *data, pni_nid_t nd)
   return nd ? (data->nodes + nd - 1) : NULL;
 }
 
+/* Make room for count more nodes so a run of puts does not regrow */
+int pni_data_reserve(pn_data_t *data, size_t count);
+
+/* Clear data and free what it has grown, return the bytes freed */
+size_t pni_data_shrink(pn_data_t *data);
+
 int pni_data_traverse(pn_data_t *data,
                       int (*enter)(void *ctx, pn_data_t *data, pni_node_t *node),
                       int (*exit)(void *ctx, pn_data_t *data, pni_node_t *node),
                       void *ctx);
 
+/* Encode data without the trailing nulls of described lists from now on,
+   see pn_encoder_trim */
+PN_EXTERN void pni_data_trim_nulls(pn_data_t *data);
+
+/* Encode at buf->start + offset, growing buf with realloc to fit, see
+   pn_encoder_encode_grow */
+PN_EXTERN ssize_t pni_data_encode_grow(pn_data_t *data, pn_rwbytes_t *buf, size_t offset);
+
 #endif /* data.h */
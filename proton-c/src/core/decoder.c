@@ -24,7 +24,11 @@
 #include <proton/codec.h>
 #include "encodings.h"
 #include "decoder.h"
+#include "buffer.h"
+#include "byteorder.h"
+#include "util.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 struct pn_decoder_t {
@@ -67,33 +71,23 @@ static inline uint8_t pn_decoder_readf8(pn_decoder_t *decoder)
 
 static inline uint16_t pn_decoder_readf16(pn_decoder_t *decoder)
 {
-  uint16_t a = (uint8_t) decoder->position[0];
-  uint16_t b = (uint8_t) decoder->position[1];
-  uint16_t r = a << 8
-    | b;
+  uint16_t r = pni_read16(decoder->position);
   decoder->position += 2;
   return r;
 }
 
 static inline uint32_t pn_decoder_readf32(pn_decoder_t *decoder)
 {
-  uint32_t a = (uint8_t) decoder->position[0];
-  uint32_t b = (uint8_t) decoder->position[1];
-  uint32_t c = (uint8_t) decoder->position[2];
-  uint32_t d = (uint8_t) decoder->position[3];
-  uint32_t r = a << 24
-    | b << 16
-    | c <<  8
-    | d;
+  uint32_t r = pni_read32(decoder->position);
   decoder->position += 4;
   return r;
 }
 
 static inline uint64_t pn_decoder_readf64(pn_decoder_t *decoder)
 {
-  uint64_t a = pn_decoder_readf32(decoder);
-  uint64_t b = pn_decoder_readf32(decoder);
-  return a << 32 | b;
+  uint64_t r = pni_read64(decoder->position);
+  decoder->position += 8;
+  return r;
 }
 
 static inline void pn_decoder_readf128(pn_decoder_t *decoder, void *dst)
@@ -192,6 +186,96 @@ static inline pn_type_t pn_code2type(uint8_t code)
 static int pni_decoder_decode_type(pn_decoder_t *decoder, pn_data_t *data, uint8_t *code);
 static int pni_decoder_single(pn_decoder_t *decoder, pn_data_t *data);
 void pni_data_set_array_type(pn_data_t *data, pn_type_t type);
+int pni_data_reserve(pn_data_t *data, size_t count);
+
+static size_t pni_fixed_width(uint8_t code)
+{
+  switch (code) {
+  case PNE_USHORT:
+  case PNE_SHORT:
+    return 2;
+  case PNE_UINT:
+  case PNE_INT:
+  case PNE_UTF32:
+  case PNE_FLOAT:
+  case PNE_DECIMAL32:
+    return 4;
+  case PNE_ULONG:
+  case PNE_LONG:
+  case PNE_MS64:
+  case PNE_DOUBLE:
+  case PNE_DECIMAL64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Arrays of multi-byte fixed width elements are checked for underflow once
+ * and decoded in a loop per element code, rather than going back through
+ * pni_decoder_decode_value for every element. Returns 1 if the element code
+ * has no bulk path and the caller must decode element by element.
+ */
+static int pni_decoder_fixed_array(pn_decoder_t *decoder, pn_data_t *data, uint8_t code, size_t count)
+{
+  size_t width = pni_fixed_width(code);
+  if (!width) return 1;
+  if (count > pn_decoder_remaining(decoder) / width) return PN_UNDERFLOW;
+  int err = pni_data_reserve(data, count);
+  if (err) return err;
+
+  const char *p = decoder->position;
+  size_t i;
+  conv_t conv;
+  switch (code) {
+  case PNE_USHORT:
+    for (i = 0; i < count && !err; i++, p += 2) err = pn_data_put_ushort(data, pni_read16(p));
+    break;
+  case PNE_SHORT:
+    for (i = 0; i < count && !err; i++, p += 2) err = pn_data_put_short(data, (int16_t) pni_read16(p));
+    break;
+  case PNE_UINT:
+    for (i = 0; i < count && !err; i++, p += 4) err = pn_data_put_uint(data, pni_read32(p));
+    break;
+  case PNE_INT:
+    for (i = 0; i < count && !err; i++, p += 4) err = pn_data_put_int(data, (int32_t) pni_read32(p));
+    break;
+  case PNE_UTF32:
+    for (i = 0; i < count && !err; i++, p += 4) err = pn_data_put_char(data, pni_read32(p));
+    break;
+  case PNE_FLOAT:
+    for (i = 0; i < count && !err; i++, p += 4) {
+      conv.i = pni_read32(p);
+      err = pn_data_put_float(data, conv.f);
+    }
+    break;
+  case PNE_DECIMAL32:
+    for (i = 0; i < count && !err; i++, p += 4) err = pn_data_put_decimal32(data, pni_read32(p));
+    break;
+  case PNE_ULONG:
+    for (i = 0; i < count && !err; i++, p += 8) err = pn_data_put_ulong(data, pni_read64(p));
+    break;
+  case PNE_LONG:
+    for (i = 0; i < count && !err; i++, p += 8) err = pn_data_put_long(data, (int64_t) pni_read64(p));
+    break;
+  case PNE_MS64:
+    for (i = 0; i < count && !err; i++, p += 8) err = pn_data_put_timestamp(data, (int64_t) pni_read64(p));
+    break;
+  case PNE_DOUBLE:
+    for (i = 0; i < count && !err; i++, p += 8) {
+      conv.l = pni_read64(p);
+      err = pn_data_put_double(data, conv.d);
+    }
+    break;
+  case PNE_DECIMAL64:
+    for (i = 0; i < count && !err; i++, p += 8) err = pn_data_put_decimal64(data, pni_read64(p));
+    break;
+  }
+  if (err) return err;
+  decoder->position = p;
+  return 0;
+}
 
 static int pni_decoder_decode_value(pn_decoder_t *decoder, pn_data_t *data, uint8_t code)
 {
@@ -397,10 +481,15 @@ static int pni_decoder_decode_value(pn_decoder_t *decoder, pn_data_t *data, uint
         if (e) return e;
         pn_type_t type = pn_code2type(acode);
         if ((int)type < 0) return (int)type;
-        for (size_t i = 0; i < count; i++)
-        {
-          e = pni_decoder_decode_value(decoder, data, acode);
-          if (e) return e;
+        e = pni_decoder_fixed_array(decoder, data, acode, count);
+        if (e > 0) {
+          for (size_t i = 0; i < count; i++)
+          {
+            e = pni_decoder_decode_value(decoder, data, acode);
+            if (e) return e;
+          }
+        } else if (e < 0) {
+          return e;
         }
         pn_data_exit(data);
 
@@ -496,3 +585,535 @@ ssize_t pn_decoder_decode(pn_decoder_t *decoder, const char *src, size_t size, p
 
   return decoder->position - decoder->input;
 }
+
+/* Width of the encoded value at src, found from the AMQP encoding
+   category alone so the value itself is never decoded */
+ssize_t pni_decoder_value_size(const char *src, size_t size)
+{
+  if (!size) return PN_UNDERFLOW;
+
+  uint8_t code = src[0];
+  if (code == PNE_DESCRIPTOR) {
+    ssize_t descriptor = pni_decoder_value_size(src + 1, size - 1);
+    if (descriptor < 0) return descriptor;
+    ssize_t value = pni_decoder_value_size(src + 1 + descriptor, size - 1 - descriptor);
+    if (value < 0) return value;
+    return 1 + descriptor + value;
+  }
+
+  size_t width;
+  switch (code & 0xF0) {
+  case 0x40: width = 0; break;
+  case 0x50: width = 1; break;
+  case 0x60: width = 2; break;
+  case 0x70: width = 4; break;
+  case 0x80: width = 8; break;
+  case 0x90: width = 16; break;
+  case 0xA0:
+  case 0xC0:
+  case 0xE0:
+    if (size < 2) return PN_UNDERFLOW;
+    width = 1 + (uint8_t) src[1];
+    break;
+  case 0xB0:
+  case 0xD0:
+  case 0xF0:
+    if (size < 5) return PN_UNDERFLOW;
+    width = 4 + (size_t) pni_read32(src + 1);
+    break;
+  default:
+    return PN_ARG_ERR;
+  }
+
+  if (width >= size) return PN_UNDERFLOW;
+  return 1 + width;
+}
+
+/* Find the extent of the section at bytes, the offset of its value and its
+   descriptor code, which is 0 unless the descriptor is a ulong */
+ssize_t pni_section_scan(const char *bytes, size_t size, uint64_t *code, size_t *value)
+{
+  ssize_t extent = pni_decoder_value_size(bytes, size);
+  *code = 0;
+  *value = 0;
+  if (extent < 0 || (uint8_t) bytes[0] != PNE_DESCRIPTOR) return extent;
+
+  *value = 1 + pni_decoder_value_size(bytes + 1, extent - 1);
+  switch ((uint8_t) bytes[1]) {
+  case PNE_SMALLULONG:
+    *code = (uint8_t) bytes[2];
+    break;
+  case PNE_ULONG:
+    for (int i = 0; i < 8; i++) {
+      *code = (*code << 8) | (uint8_t) bytes[2 + i];
+    }
+    break;
+  }
+  return extent;
+}
+
+// Eight bytes at a time are checked for ASCII, the common case, and only
+// multi-byte sequences are checked a byte at a time
+#define PNI_HIGH_BITS 0x8080808080808080ULL
+
+static inline bool pni_ascii_word(const char *s)
+{
+  uint64_t w;
+  memcpy(&w, s, sizeof(w));
+  return !(w & PNI_HIGH_BITS);
+}
+
+static bool pni_ascii_valid(const char *s, size_t size)
+{
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    if (!pni_ascii_word(s + i)) return false;
+  }
+  for (; i < size; i++) {
+    if (s[i] & 0x80) return false;
+  }
+  return true;
+}
+
+bool pni_utf8_valid(const char *s, size_t size)
+{
+  const uint8_t *p = (const uint8_t *) s;
+  size_t i = 0;
+  while (i < size) {
+    if (i + 8 <= size && pni_ascii_word(s + i)) {
+      i += 8;
+      continue;
+    }
+    uint8_t c = p[i];
+    if (c < 0x80) {
+      i++;
+      continue;
+    }
+    // The range of the second byte rules out overlong forms, surrogates
+    // and code points past U+10FFFF, see RFC 3629
+    size_t n;
+    uint8_t lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) n = 1;
+    else if (c >= 0xE0 && c <= 0xEF) {
+      n = 2;
+      if (c == 0xE0) lo = 0xA0;
+      else if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      n = 3;
+      if (c == 0xF0) lo = 0x90;
+      else if (c == 0xF4) hi = 0x8F;
+    } else {
+      return false;
+    }
+    if (size - i <= n) return false;
+    if (p[i + 1] < lo || p[i + 1] > hi) return false;
+    for (size_t k = 2; k <= n; k++) {
+      if ((p[i + k] & 0xC0) != 0x80) return false;
+    }
+    i += n + 1;
+  }
+  return true;
+}
+
+static bool pni_text_single(const char **pos, const char *end);
+
+static bool pni_text_size(const char **pos, const char *end, size_t width, size_t *value)
+{
+  if ((size_t)(end - *pos) < width) return false;
+  *value = width == 1 ? (uint8_t) **pos : pni_read32(*pos);
+  *pos += width;
+  return true;
+}
+
+// Check the value of type code whose constructor ends at *pos, leaving *pos
+// after it
+static bool pni_text_value(uint8_t code, const char **pos, const char *end)
+{
+  size_t width = (code & 0x10) ? 4 : 1, size, count;
+  switch (code & 0xF0) {
+  case 0x40: size = 0; break;
+  case 0x50: size = 1; break;
+  case 0x60: size = 2; break;
+  case 0x70: size = 4; break;
+  case 0x80: size = 8; break;
+  case 0x90: size = 16; break;
+  case 0xA0:
+  case 0xB0:
+    if (!pni_text_size(pos, end, width, &size) || (size_t)(end - *pos) < size) return false;
+    switch (code) {
+    case PNE_STR8_UTF8:
+    case PNE_STR32_UTF8:
+      if (!pni_utf8_valid(*pos, size)) return false;
+      break;
+    case PNE_SYM8:
+    case PNE_SYM32:
+      if (!pni_ascii_valid(*pos, size)) return false;
+      break;
+    }
+    *pos += size;
+    return true;
+  case 0xC0:
+  case 0xD0:
+  case 0xE0:
+  case 0xF0: {
+    if (!pni_text_size(pos, end, width, &size) || (size_t)(end - *pos) < size) return false;
+    const char *limit = *pos + size;
+    if (!pni_text_size(pos, limit, width, &count)) return false;
+    if (code < 0xE0) {
+      while (count--) {
+        if (!pni_text_single(pos, limit)) return false;
+      }
+    } else {
+      uint8_t acode;
+      if (*pos == limit) return false;
+      acode = (uint8_t) *(*pos)++;
+      if (acode == PNE_DESCRIPTOR) {
+        if (!pni_text_single(pos, limit) || *pos == limit) return false;
+        acode = (uint8_t) *(*pos)++;
+      }
+      // Elements with no strings or symbols are skipped whole
+      if ((acode & 0xF0) < 0xA0) count = 0;
+      while (count--) {
+        if (!pni_text_value(acode, pos, limit)) return false;
+      }
+    }
+    *pos = limit;
+    return true;
+  }
+  default:
+    return false;
+  }
+  if ((size_t)(end - *pos) < size) return false;
+  *pos += size;
+  return true;
+}
+
+static bool pni_text_single(const char **pos, const char *end)
+{
+  while (*pos < end) {
+    uint8_t code = (uint8_t) *(*pos)++;
+    if (code != PNE_DESCRIPTOR) return pni_text_value(code, pos, end);
+    if (!pni_text_single(pos, end)) return false;
+  }
+  return false;
+}
+
+bool pni_decoder_text_valid(const char *src, size_t size)
+{
+  return pni_text_single(&src, src + size);
+}
+
+// streaming decoder
+
+typedef struct {
+  pn_type_t type;
+  size_t remaining;     /* values still to come */
+  uint8_t code;         /* array element constructor, 0 until it is read */
+} pni_stream_frame_t;
+
+struct pn_decoder_stream_t {
+  pn_decoder_handler_t handler;
+  void *context;
+  pn_buffer_t *pending;       /* start of a value split across feeds */
+  pni_stream_frame_t *stack;
+  size_t depth;
+  size_t capacity;
+  int error;
+};
+
+pn_decoder_stream_t *pn_decoder_stream(const pn_decoder_handler_t *handler, void *context)
+{
+  pn_decoder_stream_t *stream = (pn_decoder_stream_t *) malloc(sizeof(pn_decoder_stream_t));
+  if (!stream) return NULL;
+  stream->handler = *handler;
+  stream->context = context;
+  stream->pending = pn_buffer(0);
+  stream->stack = NULL;
+  stream->depth = 0;
+  stream->capacity = 0;
+  stream->error = 0;
+  return stream;
+}
+
+void pn_decoder_stream_free(pn_decoder_stream_t *stream)
+{
+  if (stream) {
+    pn_buffer_free(stream->pending);
+    free(stream->stack);
+    free(stream);
+  }
+}
+
+bool pn_decoder_stream_complete(pn_decoder_stream_t *stream)
+{
+  return !stream->depth && !pn_buffer_size(stream->pending);
+}
+
+/* Decode the payload of a scalar, returns the payload size or PN_UNDERFLOW
+   with the payload size needed so far in *need */
+static ssize_t pni_stream_atom(uint8_t code, const char *b, size_t n, pn_atom_t *atom, size_t *need)
+{
+  size_t width;
+  switch (code & 0xF0) {
+  case 0x40: width = 0; break;
+  case 0x50: width = 1; break;
+  case 0x60: width = 2; break;
+  case 0x70: width = 4; break;
+  case 0x80: width = 8; break;
+  case 0x90: width = 16; break;
+  case 0xA0:
+    if (n < 1) { *need = 1; return PN_UNDERFLOW; }
+    width = 1 + (uint8_t) b[0];
+    break;
+  case 0xB0:
+    if (n < 4) { *need = 4; return PN_UNDERFLOW; }
+    width = 4 + (size_t) pni_read32(b);
+    break;
+  default:
+    return PN_ARG_ERR;
+  }
+  if (n < width) { *need = width; return PN_UNDERFLOW; }
+
+  conv_t conv;
+  atom->type = pn_code2type(code);
+  switch (code) {
+  case PNE_NULL: break;
+  case PNE_TRUE: atom->u.as_bool = true; break;
+  case PNE_FALSE: atom->u.as_bool = false; break;
+  case PNE_BOOLEAN: atom->u.as_bool = b[0] != 0; break;
+  case PNE_UBYTE: atom->u.as_ubyte = (uint8_t) b[0]; break;
+  case PNE_BYTE: atom->u.as_byte = (int8_t) b[0]; break;
+  case PNE_USHORT: atom->u.as_ushort = pni_read16(b); break;
+  case PNE_SHORT: atom->u.as_short = (int16_t) pni_read16(b); break;
+  case PNE_UINT0: atom->u.as_uint = 0; break;
+  case PNE_SMALLUINT: atom->u.as_uint = (uint8_t) b[0]; break;
+  case PNE_UINT: atom->u.as_uint = pni_read32(b); break;
+  case PNE_SMALLINT: atom->u.as_int = (int8_t) b[0]; break;
+  case PNE_INT: atom->u.as_int = (int32_t) pni_read32(b); break;
+  case PNE_UTF32: atom->u.as_char = pni_read32(b); break;
+  case PNE_FLOAT:
+    // XXX: this assumes the platform uses IEEE floats
+    conv.i = pni_read32(b);
+    atom->u.as_float = conv.f;
+    break;
+  case PNE_DECIMAL32: atom->u.as_decimal32 = pni_read32(b); break;
+  case PNE_ULONG0: atom->u.as_ulong = 0; break;
+  case PNE_SMALLULONG: atom->u.as_ulong = (uint8_t) b[0]; break;
+  case PNE_ULONG: atom->u.as_ulong = pni_read64(b); break;
+  case PNE_SMALLLONG: atom->u.as_long = (int8_t) b[0]; break;
+  case PNE_LONG: atom->u.as_long = (int64_t) pni_read64(b); break;
+  case PNE_MS64: atom->u.as_timestamp = (pn_timestamp_t) pni_read64(b); break;
+  case PNE_DOUBLE:
+    // XXX: this assumes the platform uses IEEE floats
+    conv.l = pni_read64(b);
+    atom->u.as_double = conv.d;
+    break;
+  case PNE_DECIMAL64: atom->u.as_decimal64 = pni_read64(b); break;
+  case PNE_DECIMAL128: memmove(&atom->u.as_decimal128, b, 16); break;
+  case PNE_UUID: memmove(&atom->u.as_uuid, b, 16); break;
+  case PNE_VBIN8:
+  case PNE_STR8_UTF8:
+  case PNE_SYM8:
+    atom->u.as_bytes = pn_bytes(width - 1, b + 1);
+    break;
+  case PNE_VBIN32:
+  case PNE_STR32_UTF8:
+  case PNE_SYM32:
+    atom->u.as_bytes = pn_bytes(width - 4, b + 4);
+    break;
+  default:
+    return PN_ARG_ERR;
+  }
+  return width;
+}
+
+static int pni_stream_push(pn_decoder_stream_t *stream, pn_type_t type, size_t count)
+{
+  if (stream->depth == stream->capacity) {
+    size_t capacity = stream->capacity ? 2 * stream->capacity : 8;
+    pni_stream_frame_t *stack = (pni_stream_frame_t *) realloc(stream->stack, capacity * sizeof(pni_stream_frame_t));
+    if (!stack) return PN_OUT_OF_MEMORY;
+    stream->stack = stack;
+    stream->capacity = capacity;
+  }
+  pni_stream_frame_t *frame = &stream->stack[stream->depth++];
+  frame->type = type;
+  frame->remaining = count;
+  frame->code = 0;
+  return 0;
+}
+
+/* Leave every compound completed by the value that has just ended */
+static int pni_stream_value_done(pn_decoder_stream_t *stream)
+{
+  while (stream->depth) {
+    pni_stream_frame_t *top = &stream->stack[stream->depth - 1];
+    if (--top->remaining) return 0;
+    stream->depth--;
+    if (stream->handler.leave) {
+      int err = stream->handler.leave(stream->context, top->type);
+      if (err) return err;
+    }
+  }
+  return 0;
+}
+
+/* A compound with no values ends as soon as it starts */
+static int pni_stream_empty_done(pn_decoder_stream_t *stream, pn_type_t type)
+{
+  stream->depth--;
+  if (stream->handler.leave) {
+    int err = stream->handler.leave(stream->context, type);
+    if (err) return err;
+  }
+  return pni_stream_value_done(stream);
+}
+
+/* The constructor of an array: an element code, optionally preceded by a
+   descriptor which must be a scalar */
+static int pni_stream_array_constructor(pn_decoder_stream_t *stream, pni_stream_frame_t *top,
+                                        const char *b, size_t n, size_t *used, size_t *need)
+{
+  if (n < 1) { *need = 1; return PN_UNDERFLOW; }
+  bool described = (uint8_t) b[0] == PNE_DESCRIPTOR;
+  pn_atom_t descriptor;
+  size_t pos = 0;
+  if (described) {
+    if (n < 2) { *need = 2; return PN_UNDERFLOW; }
+    ssize_t size = pni_stream_atom(b[1], b + 2, n - 2, &descriptor, need);
+    if (size == PN_UNDERFLOW) { *need += 3; return PN_UNDERFLOW; }
+    if (size < 0) return (int) size;
+    pos = 2 + size;
+  }
+  if (n < pos + 1) { *need = pos + 1; return PN_UNDERFLOW; }
+  uint8_t code = b[pos++];
+  pn_type_t type = pn_code2type(code);
+  if ((int) type < 0 || code == PNE_DESCRIPTOR) return PN_ARG_ERR;
+
+  top->code = code;
+  if (stream->handler.enter) {
+    int err = stream->handler.enter(stream->context, PN_ARRAY, top->remaining, type, described);
+    if (err) return err;
+  }
+  if (described && stream->handler.scalar) {
+    int err = stream->handler.scalar(stream->context, &descriptor);
+    if (err) return err;
+  }
+  *used = pos;
+  if (!top->remaining) return pni_stream_empty_done(stream, PN_ARRAY);
+  return 0;
+}
+
+/* Decode one constructor, compound header or scalar from b and set *used, or
+   return PN_UNDERFLOW with the lower bound of bytes needed in *need. Nothing is
+   reported to the handler until the whole item is available. */
+static int pni_stream_step(pn_decoder_stream_t *stream, const char *b, size_t n, size_t *used, size_t *need)
+{
+  pni_stream_frame_t *top = stream->depth ? &stream->stack[stream->depth - 1] : NULL;
+  size_t pos = 0;
+  uint8_t code;
+  int err;
+
+  if (top && top->type == PN_ARRAY) {
+    if (!top->code) return pni_stream_array_constructor(stream, top, b, n, used, need);
+    code = top->code;
+  } else {
+    if (n < 1) { *need = 1; return PN_UNDERFLOW; }
+    code = b[pos++];
+    if (code == PNE_DESCRIPTOR) {
+      err = pni_stream_push(stream, PN_DESCRIBED, 2);
+      if (err) return err;
+      if (stream->handler.enter) {
+        err = stream->handler.enter(stream->context, PN_DESCRIBED, 2, PN_NULL, false);
+        if (err) return err;
+      }
+      *used = pos;
+      return 0;
+    }
+  }
+
+  pn_type_t type = pn_code2type(code);
+  if ((int) type < 0) return PN_ARG_ERR;
+
+  if (type == PN_LIST || type == PN_MAP || type == PN_ARRAY) {
+    size_t count = 0;
+    switch (code) {
+    case PNE_LIST0:
+      break;
+    case PNE_LIST8:
+    case PNE_MAP8:
+    case PNE_ARRAY8:
+      if (n < pos + 2) { *need = pos + 2; return PN_UNDERFLOW; }
+      count = (uint8_t) b[pos + 1];
+      pos += 2;
+      break;
+    default:
+      if (n < pos + 8) { *need = pos + 8; return PN_UNDERFLOW; }
+      count = pni_read32(b + pos + 4);
+      pos += 8;
+      break;
+    }
+    err = pni_stream_push(stream, type, count);
+    if (err) return err;
+    *used = pos;
+    // Arrays are entered once their constructor is known
+    if (type == PN_ARRAY) return 0;
+    if (stream->handler.enter) {
+      err = stream->handler.enter(stream->context, type, count, PN_NULL, false);
+      if (err) return err;
+    }
+    if (!count) return pni_stream_empty_done(stream, type);
+    return 0;
+  }
+
+  pn_atom_t atom;
+  ssize_t size = pni_stream_atom(code, b + pos, n - pos, &atom, need);
+  if (size == PN_UNDERFLOW) { *need += pos; return PN_UNDERFLOW; }
+  if (size < 0) return (int) size;
+  *used = pos + size;
+  if (stream->handler.scalar) {
+    err = stream->handler.scalar(stream->context, &atom);
+    if (err) return err;
+  }
+  return pni_stream_value_done(stream);
+}
+
+int pn_decoder_stream_feed(pn_decoder_stream_t *stream, const char *bytes, size_t size)
+{
+  if (stream->error) return stream->error;
+
+  // First complete any value left over from the previous feed, taking only
+  // as much new input as it needs
+  while (pn_buffer_size(stream->pending)) {
+    pn_bytes_t pending = pn_buffer_bytes(stream->pending);
+    size_t used = 0, need = 0;
+    int err = pni_stream_step(stream, pending.start, pending.size, &used, &need);
+    if (err == PN_UNDERFLOW) {
+      if (!size) return 0;
+      size_t n = pn_min(size, need - pending.size);
+      err = pn_buffer_append(stream->pending, bytes, n);
+      if (err) return stream->error = err;
+      bytes += n;
+      size -= n;
+    } else if (err) {
+      return stream->error = err;
+    } else {
+      pn_buffer_trim(stream->pending, used, 0);
+    }
+  }
+
+  while (size) {
+    size_t used = 0, need = 0;
+    int err = pni_stream_step(stream, bytes, size, &used, &need);
+    if (err == PN_UNDERFLOW) {
+      err = pn_buffer_append(stream->pending, bytes, size);
+      if (err) return stream->error = err;
+      return 0;
+    } else if (err) {
+      return stream->error = err;
+    }
+    bytes += used;
+    size -= used;
+  }
+  return 0;
+}
@@ -22,9 +22,28 @@
  *
  */
 
+#include <proton/codec.h>
+
 typedef struct pn_decoder_t pn_decoder_t;
 
 pn_decoder_t *pn_decoder(void);
 ssize_t pn_decoder_decode(pn_decoder_t *decoder, const char *src, size_t size, pn_data_t *dst);
 
+/* Size of the single encoded value (including any descriptor) at the
+   start of src, PN_UNDERFLOW if it is truncated */
+ssize_t pni_decoder_value_size(const char *src, size_t size);
+
+/* Find the extent of the message section at bytes, the offset of its value
+   and its descriptor code, which is 0 unless the descriptor is a ulong */
+ssize_t pni_section_scan(const char *bytes, size_t size, uint64_t *code, size_t *value);
+
+/* True if the size bytes at s are well formed UTF-8: no overlong forms,
+   surrogates or code points past U+10FFFF */
+PN_EXTERN bool pni_utf8_valid(const char *s, size_t size);
+
+/* True if every string in the single encoded value at the start of src is
+   valid UTF-8 and every symbol is ASCII, as AMQP requires. False too if the
+   value is malformed or truncated. */
+PN_EXTERN bool pni_decoder_text_valid(const char *src, size_t size);
+
 #endif /* decoder.h */
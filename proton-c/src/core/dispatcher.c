@@ -22,10 +22,12 @@
 #include "dispatcher.h"
 
 #include "framing.h"
+#include "decoder.h"
 #include "protocol.h"
 #include "engine-internal.h"
 
 #include "dispatch_actions.h"
+#include "probes.h"
 
 int pni_bad_frame(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload) {
   pn_transport_logf(transport, "Error dispatching frame: type: %d: Unknown performative", frame_type);
@@ -74,15 +76,105 @@ static inline int pni_dispatch_action(pn_transport_t* transport, uint64_t lcode,
   return action(transport, frame_type, channel, args, payload);
 }
 
+// Decode a delivery state into transport->disp_data as pn_data_scan "D?LC" would
+static bool pni_decode_state(pn_transport_t *transport, pn_bytes_t state, bool present,
+                             bool *has_type, uint64_t *type)
+{
+  pn_data_clear(transport->disp_data);
+  *has_type = false;
+  if (!present) return true;
+  pni_reader_t r = pni_reader(state.start, state.size);
+  if (!pni_read_descriptor(&r, type)) return false;
+  *has_type = true;
+  size_t size = r.end - r.pos;
+  return pn_data_decode(transport->disp_data, (const char *) r.pos, size) == (ssize_t) size;
+}
+
+// Transfer, flow and disposition are nearly all the frames on a busy
+// connection: decode them straight from the frame bytes, without
+// transport->args.  Return false, having done nothing, if the frame needs
+// the general decoder: another performative, an unusual encoding or a
+// frame trace that prints args.
+static bool pni_dispatch_direct(pn_transport_t *transport, pn_frame_t frame, int *err)
+{
+  if (frame.type != AMQP_FRAME_TYPE || (transport->trace & PN_TRACE_FRM)) return false;
+  pni_reader_t r = pni_reader(frame.payload, frame.size), fields;
+  uint64_t lcode;
+  uint32_t count;
+  if (!pni_read_descriptor(&r, &lcode) || !pni_read_list(&r, &fields, &count)) return false;
+
+  union {
+    pni_transfer_t transfer;
+    pni_flow_t flow;
+    pni_disposition_t disposition;
+  } p;
+  bool has_type = false;
+  uint64_t type = 0;
+  switch (lcode) {
+  case TRANSFER:
+    if (!pni_decode_transfer(&fields, count, &p.transfer) || fields.pos != fields.end ||
+        !pni_decode_state(transport, p.transfer.state, PNI_PRESENT(&p.transfer, TRANSFER_STATE), &has_type, &type))
+      return false;
+    break;
+  case FLOW:
+    if (!pni_decode_flow(&fields, count, &p.flow) || fields.pos != fields.end) return false;
+    break;
+  case DISPOSITION:
+    if (!pni_decode_disposition(&fields, count, &p.disposition) || fields.pos != fields.end ||
+        !pni_decode_state(transport, p.disposition.state, PNI_PRESENT(&p.disposition, DISPOSITION_STATE), &has_type, &type))
+      return false;
+    break;
+  default:
+    return false;
+  }
+
+  size_t payload_size = r.end - r.pos;
+  pn_bytes_t payload = {payload_size, payload_size ? (const char *) r.pos : NULL};
+  size_t frame_size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
+  pni_count_performative(transport, IN, lcode, frame_size);
+  if (transport->frame_ring)
+    pni_record_frame(transport, IN, frame.type, frame.channel, (uint8_t) lcode, frame_size, payload_size);
+
+  PNI_PROBE4(frame_start, transport, frame.channel, lcode, frame_size);
+  switch (lcode) {
+  case TRANSFER:
+    *err = pni_do_transfer(transport, frame.channel, &p.transfer, has_type, type, &payload);
+    break;
+  case FLOW:
+    *err = pni_do_flow(transport, frame.channel, &p.flow);
+    break;
+  default:
+    *err = pni_do_disposition(transport, frame.channel, &p.disposition, has_type, type);
+    break;
+  }
+  PNI_PROBE2(frame_done, transport, *err);
+  return true;
+}
+
 static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_frame_t frame)
 {
   if (frame.size == 0) { // ignore null frames
+    if (transport->frame_ring)
+      pni_record_frame(transport, IN, frame.type, frame.channel, 0, AMQP_HEADER_SIZE + frame.ex_size, 0);
     if (transport->trace & PN_TRACE_FRM)
       pn_transport_logf(transport, "%u <- (EMPTY FRAME)", frame.channel);
     return 0;
   }
 
-  ssize_t dsize = pn_data_decode(args, frame.payload, frame.size);
+  if (transport->validate_text && !pni_decoder_text_valid(frame.payload, frame.size)) {
+    pn_do_error(transport, "amqp:decode-error", "invalid UTF-8 string or non-ASCII symbol in frame");
+    return PN_ERR;
+  }
+
+  int err;
+  if (pni_dispatch_direct(transport, frame, &err)) return err;
+
+  // The frame is interned into args once, and reset with it after the
+  // frame. Only the performative and its list of fields are expanded: any
+  // field that is itself a map, list or described value stays a slice of
+  // those bytes, so the handlers that copy one out (properties, termini,
+  // capabilities) copy its encoding rather than rebuilding it node by node.
+  ssize_t dsize = pn_data_decode_partial(args, frame.payload, frame.size, NULL, 0, 2);
   if (dsize < 0) {
     pn_string_format(transport->scratch,
                      "Error decoding frame: %s %s\n", pn_code(dsize),
@@ -111,9 +203,15 @@ static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_fr
   const char *payload_mem = payload_size ? frame.payload + dsize : NULL;
   pn_bytes_t payload = {payload_size, payload_mem};
 
+  size_t frame_size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
+  if (frame_type == AMQP_FRAME_TYPE) pni_count_performative(transport, IN, lcode, frame_size);
+  if (transport->frame_ring)
+    pni_record_frame(transport, IN, frame_type, channel, (uint8_t) lcode, frame_size, payload_size);
   pn_do_trace(transport, channel, IN, args, payload_mem, payload_size);
 
-  int err = pni_dispatch_action(transport, lcode, frame_type, channel, args, &payload);
+  PNI_PROBE4(frame_start, transport, channel, lcode, frame_size);
+  err = pni_dispatch_action(transport, lcode, frame_type, channel, args, &payload);
+  PNI_PROBE2(frame_done, transport, err);
 
   pn_data_clear(args);
 
@@ -132,6 +230,7 @@ ssize_t pn_dispatcher_input(pn_transport_t *transport, const char *bytes, size_t
       read += n;
       available -= n;
       transport->input_frames_ct += 1;
+      if (transport->frame_capture) pni_capture_frame(transport, IN, bytes + read - n, n);
       int e = pni_dispatch_frame(transport, transport->args, frame);
       if (e) return e;
     } else if (n < 0) {
@@ -147,11 +246,43 @@ ssize_t pn_dispatcher_input(pn_transport_t *transport, const char *bytes, size_t
   return read;
 }
 
+// The pending output of the first chunk, to be written without copying
+pn_bytes_t pn_dispatcher_peek(pn_transport_t *transport)
+{
+  pni_output_chunk_t *chunk = transport->output_head;
+  if (!chunk) return pn_bytes_null;
+  return pn_bytes(chunk->end - chunk->start, pni_output_chunk_bytes(chunk) + chunk->start);
+}
+
+// Mark size bytes of the first chunk, at most what pn_dispatcher_peek returned, as written
+void pn_dispatcher_consume(pn_transport_t *transport, size_t size)
+{
+  pni_output_chunk_t *chunk = transport->output_head;
+  chunk->start += size;
+  transport->available -= size;
+  if (chunk->start == chunk->end) {
+    transport->output_head = chunk->next;
+    if (!transport->output_head) transport->output_tail = NULL;
+    pni_output_chunk_release(transport, chunk);
+  }
+}
+
 ssize_t pn_dispatcher_output(pn_transport_t *transport, char *bytes, size_t size)
 {
-    int n = transport->available < size ? transport->available : size;
-    memmove(bytes, transport->output, n);
-    memmove(transport->output, transport->output + n, transport->available - n);
+    size_t n = 0;
+    while (n < size && transport->output_head) {
+      pni_output_chunk_t *chunk = transport->output_head;
+      size_t len = chunk->end - chunk->start;
+      if (len > size - n) len = size - n;
+      memcpy(bytes + n, pni_output_chunk_bytes(chunk) + chunk->start, len);
+      chunk->start += len;
+      n += len;
+      if (chunk->start == chunk->end) {
+        transport->output_head = chunk->next;
+        if (!transport->output_head) transport->output_tail = NULL;
+        pni_output_chunk_release(transport, chunk);
+      }
+    }
     transport->available -= n;
     // XXX: need to check for errors
     return n;
@@ -33,5 +33,7 @@ typedef int (pn_action_t)(pn_transport_t *transport, uint8_t frame_type, uint16_
 
 ssize_t pn_dispatcher_input(pn_transport_t* transport, const char* bytes, size_t available, bool batch, bool* halt);
 ssize_t pn_dispatcher_output(pn_transport_t *transport, char *bytes, size_t size);
+pn_bytes_t pn_dispatcher_peek(pn_transport_t *transport);
+void pn_dispatcher_consume(pn_transport_t *transport, size_t size);
 
 #endif /* dispatcher.h */
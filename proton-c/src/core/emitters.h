@@ -0,0 +1,202 @@
+#ifndef PROTON_EMITTERS_H
+#define PROTON_EMITTERS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/types.h>
+
+#include "byteorder.h"
+#include "encodings.h"
+
+#include <string.h>
+
+/*
+ * Direct AMQP encoding of fixed shape performatives, bypassing pn_data_t.
+ *
+ * Like pn_encoder_t the emitter keeps advancing past the end of the output
+ * without writing, so after emitting a whole performative the caller can
+ * check pni_emitter_overflow() and retry with a bigger buffer.
+ */
+
+typedef struct {
+  char *output_start;
+  size_t size;
+  size_t position;
+} pni_emitter_t;
+
+typedef struct {
+  size_t start;
+  uint32_t count;
+} pni_compound_context;
+
+static inline pni_emitter_t pni_emitter(pn_rwbytes_t output)
+{
+  pni_emitter_t e = {output.start, output.size, 0};
+  return e;
+}
+
+static inline bool pni_emitter_overflow(pni_emitter_t *emitter)
+{
+  return emitter->position > emitter->size;
+}
+
+static inline void pni_emitter_writef8(pni_emitter_t *emitter, uint8_t value)
+{
+  if (emitter->position + 1 <= emitter->size) {
+    emitter->output_start[emitter->position] = value;
+  }
+  emitter->position++;
+}
+
+static inline void pni_emitter_writef32(pni_emitter_t *emitter, uint32_t value)
+{
+  if (emitter->position + 4 <= emitter->size) {
+    pni_write32(emitter->output_start + emitter->position, value);
+  }
+  emitter->position += 4;
+}
+
+static inline void pni_emitter_writef64(pni_emitter_t *emitter, uint64_t value)
+{
+  pni_emitter_writef32(emitter, value >> 32);
+  pni_emitter_writef32(emitter, value);
+}
+
+static inline void pni_emitter_raw(pni_emitter_t *emitter, const char *bytes, size_t size)
+{
+  if (emitter->position + size <= emitter->size) {
+    memmove(emitter->output_start + emitter->position, bytes, size);
+  }
+  emitter->position += size;
+}
+
+static inline void pni_emitter_writev8(pni_emitter_t *emitter, const pn_bytes_t value)
+{
+  pni_emitter_writef8(emitter, value.size);
+  pni_emitter_raw(emitter, value.start, value.size);
+}
+
+static inline void pni_emitter_writev32(pni_emitter_t *emitter, const pn_bytes_t value)
+{
+  pni_emitter_writef32(emitter, value.size);
+  pni_emitter_raw(emitter, value.start, value.size);
+}
+
+static inline void emit_null(pni_emitter_t *emitter, pni_compound_context *compound)
+{
+  pni_emitter_writef8(emitter, PNE_NULL);
+  compound->count++;
+}
+
+static inline void emit_bool(pni_emitter_t *emitter, pni_compound_context *compound, bool b)
+{
+  pni_emitter_writef8(emitter, b ? PNE_TRUE : PNE_FALSE);
+  compound->count++;
+}
+
+static inline void emit_uint(pni_emitter_t *emitter, pni_compound_context *compound, uint32_t i)
+{
+  if (i == 0) {
+    pni_emitter_writef8(emitter, PNE_UINT0);
+  } else if (i < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLUINT);
+    pni_emitter_writef8(emitter, i);
+  } else {
+    pni_emitter_writef8(emitter, PNE_UINT);
+    pni_emitter_writef32(emitter, i);
+  }
+  compound->count++;
+}
+
+static inline void emit_ulong(pni_emitter_t *emitter, pni_compound_context *compound, uint64_t ul)
+{
+  if (ul == 0) {
+    pni_emitter_writef8(emitter, PNE_ULONG0);
+  } else if (ul < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLULONG);
+    pni_emitter_writef8(emitter, ul);
+  } else {
+    pni_emitter_writef8(emitter, PNE_ULONG);
+    pni_emitter_writef64(emitter, ul);
+  }
+  compound->count++;
+}
+
+static inline void emit_binary(pni_emitter_t *emitter, pni_compound_context *compound, pn_bytes_t bytes)
+{
+  if (bytes.size < 256) {
+    pni_emitter_writef8(emitter, PNE_VBIN8);
+    pni_emitter_writev8(emitter, bytes);
+  } else {
+    pni_emitter_writef8(emitter, PNE_VBIN32);
+    pni_emitter_writev32(emitter, bytes);
+  }
+  compound->count++;
+}
+
+/* Write the described type prefix; the caller emits the described value next */
+static inline void emit_descriptor(pni_emitter_t *emitter, pni_compound_context *compound, uint64_t code)
+{
+  pni_emitter_writef8(emitter, PNE_DESCRIPTOR);
+  pni_compound_context descriptor = {0, 0};
+  emit_ulong(emitter, &descriptor, code);
+  compound->count++;
+}
+
+/* Lists are written in 32 bit form, the size and count are backfilled and
+   the list moved down to 8 bit ones if they fit, as pn_encoder_t does. A
+   list that overflowed keeps the 32 bit form so overflow is still seen. */
+static inline pni_compound_context emit_list_begin(pni_emitter_t *emitter)
+{
+  pni_emitter_writef8(emitter, PNE_LIST32);
+  pni_compound_context list = {emitter->position, 0};
+  emitter->position += 8;
+  return list;
+}
+
+static inline void emit_list_end(pni_emitter_t *emitter, pni_compound_context *compound, pni_compound_context *list)
+{
+  size_t end = emitter->position;
+  size_t elements = end - list->start - 8;
+  if (end <= emitter->size && elements < 255 && list->count < 256) {
+    char *start = emitter->output_start + list->start;
+    start[-1] = (char) PNE_LIST8;
+    start[0] = (char) (elements + 1);
+    start[1] = (char) list->count;
+    memmove(start + 2, start + 8, elements);
+    emitter->position = end - 6;
+  } else {
+    emitter->position = list->start;
+    pni_emitter_writef32(emitter, end - list->start - 4);
+    pni_emitter_writef32(emitter, list->count);
+    emitter->position = end;
+  }
+  compound->count++;
+}
+
+static inline void emit_empty_list(pni_emitter_t *emitter, pni_compound_context *compound)
+{
+  pni_emitter_writef8(emitter, PNE_LIST0);
+  compound->count++;
+}
+
+#endif /* emitters.h */
@@ -24,15 +24,29 @@
 #include <proton/codec.h>
 #include "encodings.h"
 #include "encoder.h"
+#include "byteorder.h"
+#include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "data.h"
 
+/* Compounds are written with 32 bit sizes and counts, backfilled on exit,
+   and moved down to 8 bit ones there if they fit, so an encoding takes a
+   single traversal.  Writes that do not fit the output are dropped but
+   counted, unless the output is grown to fit them.  A fixed output spills
+   into scratch instead, since a compound near its end may only fit once
+   it is compacted. */
 struct pn_encoder_t {
   char *output;
   size_t size;
   char *position;
+  pn_rwbytes_t *grow;           /* Grown with realloc if not NULL */
+  pn_rwbytes_t scratch;         /* Where a fixed output spills */
+  bool spill;                   /* The output is fixed and can spill */
+  bool trim;                    /* Leave out the trailing nulls of described lists */
+  bool failed;                  /* Growing ran out of memory */
   pn_error_t *error;
 };
 
@@ -42,11 +56,17 @@ static void pn_encoder_initialize(void *obj)
   encoder->output = NULL;
   encoder->size = 0;
   encoder->position = NULL;
+  encoder->grow = NULL;
+  encoder->scratch = pn_rwbytes(0, NULL);
+  encoder->spill = false;
+  encoder->trim = false;
+  encoder->failed = false;
   encoder->error = pn_error();
 }
 
 static void pn_encoder_finalize(void *obj) {
   pn_encoder_t *encoder = (pn_encoder_t *) obj;
+  free(encoder->scratch.start);
   pn_error_free(encoder->error);
 }
 
@@ -60,6 +80,11 @@ pn_encoder_t *pn_encoder()
   return (pn_encoder_t *) pn_class_new(&clazz, sizeof(pn_encoder_t));
 }
 
+void pn_encoder_trim(pn_encoder_t *encoder, bool trim)
+{
+  encoder->trim = trim;
+}
+
 static uint8_t pn_type2code(pn_encoder_t *encoder, pn_type_t type)
 {
   switch (type)
@@ -110,13 +135,17 @@ static uint8_t pn_node2code(pn_encoder_t *encoder, pni_node_t *node)
       return PNE_INT;
     }
   case PN_ULONG:
-    if (node->atom.u.as_ulong < 256) {
+    if (node->atom.u.as_ulong == 0) {
+      return PNE_ULONG0;
+    } else if (node->atom.u.as_ulong < 256) {
       return PNE_SMALLULONG;
     } else {
       return PNE_ULONG;
     }
   case PN_UINT:
-    if (node->atom.u.as_uint < 256) {
+    if (node->atom.u.as_uint == 0) {
+      return PNE_UINT0;
+    } else if (node->atom.u.as_uint < 256) {
       return PNE_SMALLUINT;
     } else {
       return PNE_UINT;
@@ -158,9 +187,57 @@ static size_t pn_encoder_remaining(pn_encoder_t *encoder) {
     return 0;
 }
 
+static bool pn_encoder_grow(pn_encoder_t *encoder, size_t n)
+{
+  size_t used = encoder->position - encoder->output;
+  size_t size = encoder->size ? encoder->size : PN_ENCODER_BUFFER_SIZE;
+  while (size - used < n) size *= 2;
+  char *output = (char *) realloc(encoder->output, size);
+  if (!output) {
+    encoder->failed = true;
+    return false;
+  }
+  encoder->output = output;
+  encoder->size = size;
+  encoder->position = output + used;
+  *encoder->grow = pn_rwbytes(size, output);
+  return true;
+}
+
+/* Carry on in scratch from a fixed output that is full */
+static bool pn_encoder_spill(pn_encoder_t *encoder, size_t n)
+{
+  size_t used = encoder->position - encoder->output;
+  encoder->spill = false;
+  encoder->grow = &encoder->scratch;
+  if (encoder->scratch.size < used) {
+    char *start = (char *) realloc(encoder->scratch.start, used);
+    if (!start) {
+      encoder->failed = true;
+      return false;
+    }
+    encoder->scratch = pn_rwbytes(used, start);
+  }
+  memcpy(encoder->scratch.start, encoder->output, used);
+  encoder->output = encoder->scratch.start;
+  encoder->size = encoder->scratch.size;
+  encoder->position = encoder->output + used;
+  return pn_encoder_remaining(encoder) >= n || pn_encoder_grow(encoder, n);
+}
+
+/* True if n bytes can be written at the position */
+static inline bool pn_encoder_room(pn_encoder_t *encoder, size_t n)
+{
+  if (pn_encoder_remaining(encoder) >= n) return true;
+  if (encoder->failed) return false;
+  if (encoder->spill) return pn_encoder_spill(encoder, n);
+  if (encoder->grow) return pn_encoder_grow(encoder, n);
+  return false;
+}
+
 static inline void pn_encoder_writef8(pn_encoder_t *encoder, uint8_t value)
 {
-  if (pn_encoder_remaining(encoder)) {
+  if (pn_encoder_room(encoder, 1)) {
     encoder->position[0] = value;
   }
   encoder->position++;
@@ -168,40 +245,29 @@ static inline void pn_encoder_writef8(pn_encoder_t *encoder, uint8_t value)
 
 static inline void pn_encoder_writef16(pn_encoder_t *encoder, uint16_t value)
 {
-  if (pn_encoder_remaining(encoder) >= 2) {
-    encoder->position[0] = 0xFF & (value >> 8);
-    encoder->position[1] = 0xFF & (value     );
+  if (pn_encoder_room(encoder, 2)) {
+    pni_write16(encoder->position, value);
   }
   encoder->position += 2;
 }
 
 static inline void pn_encoder_writef32(pn_encoder_t *encoder, uint32_t value)
 {
-  if (pn_encoder_remaining(encoder) >= 4) {
-    encoder->position[0] = 0xFF & (value >> 24);
-    encoder->position[1] = 0xFF & (value >> 16);
-    encoder->position[2] = 0xFF & (value >>  8);
-    encoder->position[3] = 0xFF & (value      );
+  if (pn_encoder_room(encoder, 4)) {
+    pni_write32(encoder->position, value);
   }
   encoder->position += 4;
 }
 
 static inline void pn_encoder_writef64(pn_encoder_t *encoder, uint64_t value) {
-  if (pn_encoder_remaining(encoder) >= 8) {
-    encoder->position[0] = 0xFF & (value >> 56);
-    encoder->position[1] = 0xFF & (value >> 48);
-    encoder->position[2] = 0xFF & (value >> 40);
-    encoder->position[3] = 0xFF & (value >> 32);
-    encoder->position[4] = 0xFF & (value >> 24);
-    encoder->position[5] = 0xFF & (value >> 16);
-    encoder->position[6] = 0xFF & (value >>  8);
-    encoder->position[7] = 0xFF & (value      );
+  if (pn_encoder_room(encoder, 8)) {
+    pni_write64(encoder->position, value);
   }
   encoder->position += 8;
 }
 
 static inline void pn_encoder_writef128(pn_encoder_t *encoder, char *value) {
-  if (pn_encoder_remaining(encoder) >= 16) {
+  if (pn_encoder_room(encoder, 16)) {
     memmove(encoder->position, value, 16);
   }
   encoder->position += 16;
@@ -210,7 +276,7 @@ static inline void pn_encoder_writef128(pn_encoder_t *encoder, char *value) {
 static inline void pn_encoder_writev8(pn_encoder_t *encoder, const pn_bytes_t *value)
 {
   pn_encoder_writef8(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
+  if (pn_encoder_room(encoder, value->size))
     memmove(encoder->position, value->start, value->size);
   encoder->position += value->size;
 }
@@ -218,7 +284,14 @@ static inline void pn_encoder_writev8(pn_encoder_t *encoder, const pn_bytes_t *v
 static inline void pn_encoder_writev32(pn_encoder_t *encoder, const pn_bytes_t *value)
 {
   pn_encoder_writef32(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
+  if (pn_encoder_room(encoder, value->size))
+    memmove(encoder->position, value->start, value->size);
+  encoder->position += value->size;
+}
+
+static inline void pn_encoder_writeraw(pn_encoder_t *encoder, const pn_bytes_t *value)
+{
+  if (pn_encoder_room(encoder, value->size))
     memmove(encoder->position, value->start, value->size);
   encoder->position += value->size;
 }
@@ -237,6 +310,39 @@ static bool pn_is_first_in_array(pn_data_t *data, pni_node_t *parent, pni_node_t
   return parent->described && (!pn_data_node(data, node->prev)->prev);
 }
 
+/* True if the trailing nulls of list are left out, as a described list
+   reads the same without them */
+static bool pni_encoder_trims(pn_encoder_t *encoder, pn_data_t *data, pni_node_t *list)
+{
+  if (!encoder->trim || list->atom.type != PN_LIST || !list->prev) return false;
+  pni_node_t *parent = pn_data_node(data, list->parent);
+  return parent && parent->atom.type == PN_DESCRIBED;
+}
+
+/* The number of elements written for a list or map */
+static uint32_t pni_encoder_count(pn_encoder_t *encoder, pn_data_t *data, pni_node_t *node)
+{
+  if (!pni_encoder_trims(encoder, data, node)) return node->children;
+  uint32_t count = 0, i = 0;
+  for (pni_nid_t id = node->down; id; id = pn_data_node(data, id)->next) {
+    ++i;
+    if (pn_data_node(data, id)->atom.type != PN_NULL) count = i;
+  }
+  return count;
+}
+
+/* True if node is a null that is left out of its list */
+static bool pni_encoder_elides(pn_encoder_t *encoder, pn_data_t *data, pni_node_t *node)
+{
+  pni_node_t *parent = pn_data_node(data, node->parent);
+  if (!parent || !pni_encoder_trims(encoder, data, parent)) return false;
+  for (;;) {
+    if (node->atom.type != PN_NULL) return false;
+    if (!node->next) return true;
+    node = pn_data_node(data, node->next);
+  }
+}
+
 typedef union {
   uint32_t i;
   uint32_t a[2];
@@ -253,6 +359,14 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   uint8_t code;
   conv_t c;
 
+  /* Spliced back verbatim, never inside an array */
+  if (node->encoded) {
+    pn_encoder_writeraw(encoder, &atom->u.as_bytes);
+    return 0;
+  }
+
+  if (atom->type == PN_NULL && pni_encoder_elides(encoder, data, node)) return 0;
+
   /** In an array we don't write the code before each element, only the first. */
   if (pn_is_in_array(data, parent, node)) {
     code = pn_type2code(encoder, parent->type);
@@ -275,6 +389,7 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   case PNE_USHORT: pn_encoder_writef16(encoder, atom->u.as_ushort); return 0;
   case PNE_SHORT: pn_encoder_writef16(encoder, atom->u.as_short); return 0;
   case PNE_UINT0: return 0;
+  case PNE_ULONG0: return 0;
   case PNE_SMALLUINT: pn_encoder_writef8(encoder, atom->u.as_uint); return 0;
   case PNE_UINT: pn_encoder_writef32(encoder, atom->u.as_uint); return 0;
   case PNE_SMALLINT: pn_encoder_writef8(encoder, atom->u.as_int); return 0;
@@ -298,34 +413,67 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   case PNE_SYM8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
   case PNE_SYM32: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
   case PNE_ARRAY32:
-    node->start = encoder->position;
+    node->start = encoder->position - encoder->output;
     node->small = false;
     // we'll backfill the size on exit
-    encoder->position += 4;
+    pn_encoder_writef32(encoder, 0);
     pn_encoder_writef32(encoder, node->described ? node->children - 1 : node->children);
     if (node->described)
       pn_encoder_writef8(encoder, 0);
     return 0;
   case PNE_LIST32:
   case PNE_MAP32:
-    node->start = encoder->position;
+    node->start = encoder->position - encoder->output;
     node->small = false;
     // we'll backfill the size later
-    encoder->position += 4;
-    pn_encoder_writef32(encoder, node->children);
+    pn_encoder_writef32(encoder, 0);
+    pn_encoder_writef32(encoder, pni_encoder_count(encoder, data, node));
     return 0;
   default:
-    return pn_error_format(data->error, PN_ERR, "unrecognized encoding: %u", code);
+    return pn_error_format(pn_data_error(data), PN_ERR, "unrecognized encoding: %u", code);
   }
 }
 
-#include <stdio.h>
+/* Move a compound written from start down to an 8 bit size and count, or
+   to list0 if it is an empty list, where it fits */
+static void pni_encoder_compact(pn_encoder_t *encoder, pn_data_t *data, pni_node_t *node)
+{
+  pni_node_t *parent = pn_data_node(data, node->parent);
+  size_t elements = encoder->position - encoder->output - node->start - 8;
+  size_t count = node->atom.type != PN_ARRAY ? pni_encoder_count(encoder, data, node)
+    : (uint32_t) (node->described ? node->children - 1 : node->children);
+  /* The elements of an array share one constructor */
+  if (pn_is_in_array(data, parent, node) || elements >= 255 || count > 255) return;
+  bool list0 = node->atom.type == PN_LIST && !count;
+  bool written = encoder->position <= encoder->output + encoder->size;
+  char *start = encoder->output + node->start;
+  if (written) {
+    switch ((uint8_t) start[-1]) {
+    case PNE_LIST32: start[-1] = (char) (list0 ? PNE_LIST0 : PNE_LIST8); break;
+    case PNE_MAP32: start[-1] = (char) PNE_MAP8; break;
+    default: start[-1] = (char) PNE_ARRAY8; break;
+    }
+  }
+  if (list0) {
+    encoder->position = start;
+    return;
+  }
+  if (written) {
+    start[0] = (char) (elements + 1);
+    start[1] = (char) count;
+    memmove(start + 2, start + 8, elements);
+  }
+  node->small = true;
+  encoder->position -= 6;
+}
 
 static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_encoder_t *encoder = (pn_encoder_t *) ctx;
   char *pos;
 
+  if (node->encoded) return 0;
+
   switch (node->atom.type) {
   case PN_ARRAY:
     if ((node->described && node->children == 1) || (!node->described && node->children == 0)) {
@@ -335,49 +483,56 @@ static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
   case PN_LIST:
   case PN_MAP:
     pos = encoder->position;
-    encoder->position = node->start;
-    if (node->small) {
-      // backfill size
-      size_t size = pos - node->start - 1;
-      pn_encoder_writef8(encoder, size);
-    } else {
-      // backfill size
-      size_t size = pos - node->start - 4;
-      pn_encoder_writef32(encoder, size);
-    }
+    encoder->position = encoder->output + node->start;
+    // backfill size
+    pn_encoder_writef32(encoder, pos - encoder->position - 4);
     encoder->position = pos;
+    pni_encoder_compact(encoder, data, node);
     return 0;
   default:
     return 0;
   }
 }
 
-ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size)
+static ssize_t pni_encoder_run(pn_encoder_t *encoder, pn_data_t *src, char *output, size_t size, size_t offset)
 {
-  encoder->output = dst;
-  encoder->position = dst;
+  encoder->output = output;
+  encoder->position = output + offset;
   encoder->size = size;
+  encoder->failed = false;
 
   int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
+  encoder->grow = NULL;
+  encoder->spill = false;
+  if (encoder->failed) return PN_OUT_OF_MEMORY;
   if (err) return err;
-  size_t encoded = encoder->position - encoder->output;
-  if (encoded > size) {
+  return encoder->position - encoder->output - offset;
+}
+
+ssize_t pn_encoder_encode_grow(pn_encoder_t *encoder, pn_data_t *src, pn_rwbytes_t *dst, size_t offset)
+{
+  if (offset > dst->size) return PN_ARG_ERR;
+  encoder->grow = dst;
+  return pni_encoder_run(encoder, src, dst->start, dst->size, offset);
+}
+
+ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size)
+{
+  encoder->spill = true;
+  ssize_t encoded = pni_encoder_run(encoder, src, dst, size, 0);
+  if (encoded < 0) return encoded;
+  if ((size_t) encoded > size) {
       pn_error_format(pn_data_error(src), PN_OVERFLOW, "not enough space to encode");
       return PN_OVERFLOW;
   }
-  return (ssize_t)encoded;
+  if (encoder->output != dst) memcpy(dst, encoder->output, encoded);
+  return encoded;
 }
 
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src)
 {
-  encoder->output = 0;
-  encoder->position = 0;
-  encoder->size = 0;
-
   pn_handle_t save = pn_data_point(src);
-  int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
+  ssize_t size = pni_encoder_run(encoder, src, NULL, 0, 0);
   pn_data_restore(src, save);
-
-  if (err) return err;
-  return encoder->position - encoder->output;
+  return size;
 }
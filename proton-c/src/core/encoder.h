@@ -25,7 +25,13 @@
 typedef struct pn_encoder_t pn_encoder_t;
 
 pn_encoder_t *pn_encoder(void);
+/* Leave out the trailing nulls of described lists, which AMQP composite
+   types read as absent fields: for performatives and message sections */
+void pn_encoder_trim(pn_encoder_t *encoder, bool trim);
 ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size);
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src);
+/* Encode at dst->start + offset in one pass, growing dst with realloc to
+   fit. dst->start may be NULL, and belongs to the caller either way. */
+ssize_t pn_encoder_encode_grow(pn_encoder_t *encoder, pn_data_t *src, pn_rwbytes_t *dst, size_t offset);
 
 #endif /* encoder.h */
@@ -27,7 +27,10 @@
 #include <proton/types.h>
 
 #include "buffer.h"
+#include "config.h"
 #include "dispatcher.h"
+#include "format.h"
+#include "object_private.h"
 #include "util.h"
 
 typedef enum pn_endpoint_type_t {CONNECTION, SESSION, SENDER, RECEIVER} pn_endpoint_type_t;
@@ -40,20 +43,22 @@ struct pn_condition_t {
   pn_data_t *info;
 };
 
+// The conditions and error come last, they are rarely used once the
+// endpoint is open.
 struct pn_endpoint_t {
   pn_endpoint_type_t type;
   pn_state_t state;
-  pn_error_t *error;
-  pn_condition_t condition;
-  pn_condition_t remote_condition;
-  pn_endpoint_t *endpoint_next;
-  pn_endpoint_t *endpoint_prev;
-  pn_endpoint_t *transport_next;
-  pn_endpoint_t *transport_prev;
   int refcount; // when this hits zero we generate a final event
   bool modified;
   bool freed;
   bool referenced;
+  pn_endpoint_t *endpoint_next;
+  pn_endpoint_t *endpoint_prev;
+  pn_endpoint_t *transport_next;
+  pn_endpoint_t *transport_prev;
+  pn_error_t *error;
+  pn_condition_t condition;
+  pn_condition_t remote_condition;
 };
 
 typedef struct {
@@ -62,9 +67,27 @@ typedef struct {
   bool init;
 } pn_delivery_state_t;
 
+/* Where a delivery that was on the wire when its connection lost its
+   transport is in resuming its link on the next one, see
+   pn_transport_unbind() and pni_delivery_resume() */
+typedef enum {
+  PNI_RESUME_NONE,
+  PNI_RESUME_WAIT,    /* for the peer's unsettled map on the new attach */
+  PNI_RESUME_EXPECT,  /* receiver only, for the peer's resumed transfer */
+  PNI_RESUME_SEND,    /* sender only, sent again with the resume flag */
+  PNI_RESUME_SETTLE,  /* sender only, once settled a resumed transfer settles it at the peer */
+  PNI_RESUME_DONE     /* sender only, the peer has forgotten it, nothing more goes out */
+} pni_resume_t;
+
+/* Delivery ids are dense sequence numbers, so the map is a ring indexed by
+   id - lwm.  It covers ids [lwm, next) and lwm advances past settled ids. */
 typedef struct {
-  pn_sequence_t next;
-  pn_hash_t *deliveries;
+  pn_sequence_t next;           /* id of the next delivery pushed */
+  pn_sequence_t lwm;            /* lowest id that may still be mapped */
+  size_t first;                 /* ring slot of lwm */
+  size_t capacity;              /* ring size, a power of 2 */
+  size_t count;                 /* deliveries in the map */
+  struct pn_delivery_t **deliveries;
 } pn_delivery_map_t;
 
 typedef struct {
@@ -75,20 +98,26 @@ typedef struct {
   pn_sequence_t link_credit;
 } pn_link_state_t;
 
+/* Dense slots for small remote channel and handle numbers, so frame
+   dispatch needn't hash.  The pn_hash_t kept alongside still owns the
+   mapping and is the only index for numbers above PNI_ALIAS_INDEX_MAX */
+#define PNI_ALIAS_INDEX_MAX 65536
+
+typedef struct {
+  void **slots;
+  size_t size;
+} pni_alias_index_t;
+
 typedef struct {
   // XXX: stop using negative numbers
   uint16_t local_channel;
   uint16_t remote_channel;
   bool incoming_init;
-  pn_delivery_map_t incoming;
-  pn_delivery_map_t outgoing;
   pn_sequence_t incoming_transfer_count;
   pn_sequence_t incoming_window;
   pn_sequence_t remote_incoming_window;
   pn_sequence_t outgoing_transfer_count;
   pn_sequence_t outgoing_window;
-  pn_hash_t *local_handles;
-  pn_hash_t *remote_handles;
 
   uint64_t disp_code;
   bool disp_settled;
@@ -96,6 +125,15 @@ typedef struct {
   pn_sequence_t disp_first;
   pn_sequence_t disp_last;
   bool disp;
+
+  pn_delivery_map_t incoming;
+  pn_delivery_map_t outgoing;
+
+  // Only used to attach and detach links
+  pn_hash_t *local_handles;
+  pn_hash_t *remote_handles;
+  pni_alias_index_t remote_handle_index;
+  uint32_t local_handle_hint; /* lowest local handle that may be free */
 } pn_session_state_t;
 
 typedef struct pn_io_layer_t {
@@ -110,6 +148,7 @@ extern const pn_io_layer_t pni_passthru_layer;
 extern const pn_io_layer_t ssl_layer;
 extern const pn_io_layer_t sasl_header_layer;
 extern const pn_io_layer_t sasl_write_header_layer;
+extern const pn_io_layer_t sasl_server_header_layer;
 
 // Bit flag defines for the protocol layers
 typedef uint8_t pn_io_layer_flags_t;
@@ -122,6 +161,21 @@ typedef uint8_t pn_io_layer_flags_t;
 typedef struct pni_sasl_t pni_sasl_t;
 typedef struct pni_ssl_t pni_ssl_t;
 
+/* Pending output is a chain of chunks rather than one growing buffer, so a
+   burst of output is freed again as it drains.  Chunks hold size bytes after
+   the header, normally PN_TRANSPORT_OUTPUT_CHUNK_SIZE; a frame that does not
+   fit gets a chunk of its own size. */
+typedef struct pni_output_chunk_t {
+  struct pni_output_chunk_t *next;
+  size_t size;
+  size_t start;                 /* first byte not yet consumed */
+  size_t end;                   /* end of the pending bytes */
+} pni_output_chunk_t;
+
+static inline char *pni_output_chunk_bytes(pni_output_chunk_t *chunk) {
+  return (char *) (chunk + 1);
+}
+
 struct pn_transport_t {
   pn_tracer_t tracer;
   pni_sasl_t *sasl;
@@ -154,8 +208,15 @@ struct pn_transport_t {
   pn_timestamp_t keepalive_deadline;
   uint64_t last_bytes_output;
 
+  /* disposition coalescing, see pn_transport_set_disposition_delay */
+  pn_millis_t disp_delay;
+  uint32_t disp_limit;
+  pn_timestamp_t disp_deadline;
+
   pn_hash_t *local_channels;
   pn_hash_t *remote_channels;
+  pni_alias_index_t remote_channel_index;
+  uint32_t local_channel_hint; /* lowest local channel that may be free */
 
 
   /* scratch area */
@@ -163,25 +224,42 @@ struct pn_transport_t {
   pn_data_t *args;
   pn_data_t *output_args;
   pn_buffer_t *frame;  // frame under construction
-  // Temporary
-  size_t capacity;
+  // Encoded frames waiting for the io layers, see pni_output_chunk_t
+  pni_output_chunk_t *output_head;
+  pni_output_chunk_t *output_tail;
+  pni_output_chunk_t *output_spare; /* one emptied chunk kept for reuse */
   size_t available; /* number of raw bytes pending output */
-  char *output;
+  size_t output_limit; /* stop framing transfers above this, 0 for no limit */
+  bool interleave; /* one turn of transfer frames per delivery per pass, see pn_transport_set_interleave */
+  bool validate_text; /* check strings and symbols in incoming performatives, see pn_transport_set_validate_text */
+  struct pni_phase_stats_t *phase_stats; /* per phase timing, see pni_phase */
+  pn_frame_record_t *frame_ring; /* binary frame records, see pn_transport_record_frames */
+  size_t frame_ring_size;
+  uint64_t frame_seq; /* number of frames recorded */
+  pn_frame_capture_t frame_capture; /* see pn_transport_set_frame_capture */
+  void *frame_capture_context;
 
   /* statistics */
   uint64_t bytes_input;
   uint64_t bytes_output;
   uint64_t output_frames_ct;
   uint64_t input_frames_ct;
+  uint64_t performative_frames[2][PN_PERFORMATIVES]; /* indexed by pn_dir_t, see pn_transport_stats */
+  uint64_t performative_bytes[2][PN_PERFORMATIVES];
+  uint64_t deliveries_input;
+  uint64_t deliveries_output;
 
   /* output buffered for send */
   size_t output_size;
   size_t output_pending;
   char *output_buf;
 
-  /* input from peer */
+  /* input from peer, input_pending bytes at input_buf + input_head */
   size_t input_size;
+  size_t input_head;
   size_t input_pending;
+  size_t input_peak;            /* most input_pending since the buffer was last well used */
+  unsigned input_idle;          /* times emptied since then, see pni_input_emptied() */
   char *input_buf;
 
   pn_record_t *context;
@@ -214,7 +292,10 @@ struct pn_transport_t {
   bool head_closed;
   bool done_processing; // if true, don't call pn_process again
   bool posted_idle_timeout;
+  bool disp_expired;     // held dispositions are due, flush on the next pass
+  bool disp_hold;        // dispositions may be held back during this pass
   bool server;
+  bool autodetect;      // server sniffs the client's protocol headers
   bool halt;
   bool auth_required;
   bool authenticated;
@@ -223,12 +304,35 @@ struct pn_transport_t {
   bool referenced;
 };
 
+/* Endpoints needing transport work, kept apart by kind so each
+   processing phase only walks the endpoints it can act on */
+typedef enum {
+  PNI_MODIFIED_CONNECTION,
+  PNI_MODIFIED_SESSION,
+  PNI_MODIFIED_LINK,
+  PNI_MODIFIED_KINDS
+} pni_modified_kind_t;
+
+typedef struct {
+  pn_endpoint_t *transport_head;  // reference counted
+  pn_endpoint_t *transport_tail;
+} pni_modified_list_t;
+
+/* A session's senders or its receivers, in the order they were made */
+typedef struct {
+  pn_link_t *role_head;
+  pn_link_t *role_tail;
+} pni_link_list_t;
+
 struct pn_connection_t {
   pn_endpoint_t endpoint;
   pn_endpoint_t *endpoint_head;
   pn_endpoint_t *endpoint_tail;
-  pn_endpoint_t *transport_head;  // reference counted
-  pn_endpoint_t *transport_tail;
+  pn_session_t *session_head; /* the sessions and the links among the endpoints */
+  pn_session_t *session_tail;
+  pn_link_t *link_head;
+  pn_link_t *link_tail;
+  pni_modified_list_t modified[PNI_MODIFIED_KINDS];
   pn_list_t *sessions;
   pn_list_t *freed;
   pn_transport_t *transport;
@@ -246,21 +350,42 @@ struct pn_connection_t {
   pn_collector_t *collector;
   pn_record_t *context;
   pn_list_t *delivery_pool;
+  size_t delivery_pool_bytes;  // data buffer capacity held by delivery_pool
+  size_t delivery_pool_max;
+  uint64_t delivery_pool_hits;
+  uint64_t delivery_pool_misses;
+  pn_list_t *link_pool;    // finalized links kept with their termini, see pn_link_finalize()
+  size_t delivery_memory;  // data buffer capacity of all its deliveries, pooled or not
+  size_t memory_limit;     // stop reading input above this, 0 for no limit
+  size_t output_high_water;  // withhold sender credit above this, 0 for never
+  bool output_blocked;       // output went over output_high_water, not yet drained
+  pni_object_pool_t *object_pool;  // sessions, links and deliveries are allocated here
 };
 
+// Fields used for every transfer come first after the endpoint, see
+// PNI_HOT_FIELDS in engine.c, the link index and lists after the state.
 struct pn_session_t {
   pn_endpoint_t endpoint;
   pn_connection_t *connection;  // reference counted
-  pn_list_t *links;
-  pn_list_t *freed;
-  pn_record_t *context;
+  pni_link_list_t senders;
+  pni_link_list_t receivers;
+  size_t queued_senders; /* sender links with queued deliveries, see pni_sender_queue */
   size_t incoming_capacity;
   pn_sequence_t incoming_bytes;
   pn_sequence_t outgoing_bytes;
   pn_sequence_t incoming_deliveries;
   pn_sequence_t outgoing_deliveries;
   pn_sequence_t outgoing_window;
+  uint32_t incoming_frame_max; /* largest transfer payload received, for an incoming budget */
+  bool incoming_budget; /* see pn_session_set_incoming_budget */
   pn_session_state_t state;
+  pn_session_t *session_next;
+  pn_session_t *session_prev;
+  pn_list_t *links;
+  pn_link_t **link_index; /* hash chains of links by name, see pn_find_link */
+  size_t link_index_size;
+  pn_list_t *freed;
+  pn_record_t *context;
 };
 
 struct pn_terminus_t {
@@ -277,25 +402,26 @@ struct pn_terminus_t {
   bool dynamic;
 };
 
+// Fields used for every transfer, flow and settlement come first after
+// the endpoint, see PNI_HOT_FIELDS in engine.c, the names, termini and
+// statistics after them.
 struct pn_link_t {
   pn_endpoint_t endpoint;
-  pn_terminus_t source;
-  pn_terminus_t target;
-  pn_terminus_t remote_source;
-  pn_terminus_t remote_target;
-  pn_link_state_t state;
-  pn_string_t *name;
   pn_session_t *session;  // reference counted
-  pn_delivery_t *unsettled_head;
-  pn_delivery_t *unsettled_tail;
-  pn_delivery_t *current;
-  pn_record_t *context;
-  size_t unsettled_count;
-  uint64_t max_message_size;
-  uint64_t remote_max_message_size;
+  pn_link_state_t state;
   pn_sequence_t available;
   pn_sequence_t credit;
   pn_sequence_t queued;
+  uint32_t weight; /* transfer frames per interleave turn */
+  pn_delivery_t *current;
+  pn_delivery_t *partial; /* receiver only, the delivery whose transfer has more frames */
+  pn_delivery_t *unsettled_head;
+  pn_delivery_t *unsettled_tail;
+  size_t unsettled_count;
+  pn_delivery_t *tpwork_head; /* sender only, transport work parked until credit, see pni_park_tpwork */
+  pn_delivery_t *tpwork_tail;
+  pn_link_t *role_next; /* in the session's senders or receivers */
+  pn_link_t *role_prev;
   int drained; // number of drained credits
   uint8_t snd_settle_mode;
   uint8_t rcv_settle_mode;
@@ -304,13 +430,30 @@ struct pn_link_t {
   bool drain_flag_mode; // receiver only
   bool drain;
   bool detached;
+  pn_link_stats_t stats;
+  uint64_t tag_serial; // last tag made by pn_delivery_auto
+  pn_timestamp_t credit_blocked_since; // sender only, 0 if not blocked
+  pn_timestamp_t window_blocked_since;
+  size_t resuming; /* deliveries waiting on the peer to resume them, see pni_delivery_resume */
+  uint64_t max_message_size;
+  uint64_t remote_max_message_size;
+  pn_link_t *link_next; /* in the connection's links */
+  pn_link_t *link_prev;
+  pn_string_t *name;
+  pn_link_t *name_next; /* next link in the session's name chain */
+  uintptr_t name_hash;
+  pn_record_t *context;
+  pn_terminus_t source;
+  pn_terminus_t target;
+  pn_terminus_t remote_source;
+  pn_terminus_t remote_target;
 };
 
 struct pn_disposition_t {
   pn_condition_t condition;
   uint64_t type;
-  pn_data_t *data;
-  pn_data_t *annotations;
+  pn_data_t *data;        // created on first use, see pn_disposition_data()
+  pn_data_t *annotations; // created on first use, see pn_disposition_annotations()
   uint64_t section_offset;
   uint32_t section_number;
   bool failed;
@@ -318,26 +461,39 @@ struct pn_disposition_t {
   bool settled;
 };
 
+// Fields used for every transfer and settlement come first, see
+// PNI_HOT_FIELDS in engine.c, the dispositions and less used fields after
+// them.
 struct pn_delivery_t {
-  pn_disposition_t local;
-  pn_disposition_t remote;
   pn_link_t *link;  // reference counted
-  pn_buffer_t *tag;
+  pn_delivery_state_t state;
+  pn_buffer_t *bytes;
+  size_t sent;        // framed bytes at the front of bytes, kept to send again on a new transport
   pn_delivery_t *unsettled_next;
   pn_delivery_t *unsettled_prev;
   pn_delivery_t *work_next;
   pn_delivery_t *work_prev;
   pn_delivery_t *tpwork_next;
   pn_delivery_t *tpwork_prev;
-  pn_delivery_state_t state;
-  pn_buffer_t *bytes;
-  pn_record_t *context;
+  uint32_t message_format;
   bool updated;
   bool settled; // tracks whether we're in the unsettled list or not
   bool work;
   bool tpwork;
+  bool tpwork_parked; // tpwork is on the link's list rather than the connection's
   bool done;
+  bool kept;    // all of the payload is still here to send again
   bool referenced;
+  uint8_t resume; // pni_resume_t
+  char *tag;        // tag_inline unless the tag is longer than PN_DELIVERY_TAG_SIZE
+  size_t tag_size;
+  pn_disposition_t local;
+  pn_disposition_t remote;
+  pn_bytes_t shared;  // unsent bytes queued by reference, see pn_link_send_shared()
+  void *shared_owner; // reference counted, keeps shared valid
+  pn_record_t *context;
+  pn_timestamp_t created; // for the link's settle time
+  char tag_inline[PN_DELIVERY_TAG_SIZE];
 };
 
 #define PN_SET_LOCAL(OLD, NEW)                                          \
@@ -348,6 +504,38 @@ struct pn_delivery_t {
 
 void pn_link_dump(pn_link_t *link);
 
+/* Outgoing bytes not yet framed: a delivery holds either shared or
+   buffered bytes, never both */
+static inline pn_bytes_t pni_delivery_outgoing(pn_delivery_t *delivery)
+{
+  if (delivery->shared.size) return delivery->shared;
+  pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
+  return pn_bytes(bytes.size - delivery->sent, bytes.start + delivery->sent);
+}
+
+void pni_delivery_sent(pn_delivery_t *delivery, size_t size);
+
+/* Decide what happens to a delivery in PNI_RESUME_WAIT now the peer has
+   attached its link again. known is true if the tag is in the peer's unsettled
+   map, with outcome the peer's state for it, 0 if none */
+void pni_delivery_resume(pn_delivery_t *delivery, bool known, uint64_t outcome);
+
+/* Append to a delivery's data buffer, counting any growth in the
+   connection's memory usage */
+int pni_delivery_append(pn_delivery_t *delivery, const char *bytes, size_t size);
+
+/* Bytes held by the connection and its bound transport, and whether
+   that is over the connection's memory limit */
+size_t pni_connection_memory(pn_connection_t *connection);
+bool pni_connection_memory_full(pn_connection_t *connection);
+void pni_connection_output_drained(pn_connection_t *connection);
+size_t pni_transport_memory(pn_transport_t *transport);
+
+/* Return *data or *string, creating it first if it is NULL.  Fields that
+   most connections never use are left NULL until needed. */
+pn_data_t *pni_data_lazy(pn_data_t **data);
+pn_string_t *pni_string_lazy(pn_string_t **string);
+
 void pn_dump(pn_connection_t *conn);
 void pn_transport_sasl_init(pn_transport_t *transport);
 
@@ -356,6 +544,8 @@ void pn_condition_tini(pn_condition_t *condition);
 void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit);
 void pn_real_settle(pn_delivery_t *delivery);  // will free delivery if link is freed
 void pn_clear_tpwork(pn_delivery_t *delivery);
+void pni_park_tpwork(pn_delivery_t *delivery);
+void pni_link_unpark_tpwork(pn_link_t *link);
 void pn_work_update(pn_connection_t *connection, pn_delivery_t *delivery);
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint);
 void pn_connection_bound(pn_connection_t *conn);
@@ -364,13 +554,64 @@ int pn_do_error(pn_transport_t *transport, const char *condition, const char *fm
 void pn_set_error_layer(pn_transport_t *transport);
 void pn_session_unbound(pn_session_t* ssn);
 void pn_link_unbound(pn_link_t* link);
+pn_link_t *pni_link_named(pn_session_t *ssn, pn_bytes_t name, pn_link_t *prev);
+void pni_alias_index_put(pni_alias_index_t *index, uintptr_t alias, void *value);
+void pni_alias_index_del(pni_alias_index_t *index, uintptr_t alias);
+void pni_alias_index_free(pni_alias_index_t *index);
+void pni_release_alias(uint32_t *hint, uintptr_t alias);
 void pn_ep_incref(pn_endpoint_t *endpoint);
 void pn_ep_decref(pn_endpoint_t *endpoint);
 
 int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...);
+int pni_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const pni_format_t *format, ...);
+void pni_output_chunk_release(pn_transport_t *transport, pni_output_chunk_t *chunk);
+pn_bytes_t pni_transport_peek_output(pn_transport_t *transport, unsigned int layer);
+void pni_transport_consume_output(pn_transport_t *transport, size_t size);
+
+/* Process input straight from caller memory, copying only an incomplete
+   trailing frame into the transport's input buffer.  Return the bytes taken,
+   which may be fewer than size if the transport holds off input, or an
+   error. See pn_connection_driver_read_external() */
+ssize_t pni_transport_push_external(pn_transport_t *transport, const char *src, size_t size);
+
+/* Fill segments with up to n references to the pending output in order,
+   ending with the output chunks themselves where the io layers write plain
+   AMQP frames.  Return the number filled, 0 if there is nothing to write.
+   pni_transport_output_segments_done() consumes size bytes across them.
+   See pn_connection_driver_write_iovec() */
+size_t pni_transport_output_segments(pn_transport_t *transport, pn_bytes_t *segments, size_t n);
+void pni_transport_output_segments_done(pn_transport_t *transport, size_t size);
 
 typedef enum {IN, OUT} pn_dir_t;
 
+// Queue a delivery on a sender (delta 1) or take one off (delta -1), keeping
+// the session's count of senders with any queued. A freed link no longer
+// counts.
+static inline void pni_sender_queue(pn_link_t *link, int delta)
+{
+  pn_sequence_t was = link->queued;
+  link->queued += delta;
+  if (!link->endpoint.freed && !was != !link->queued) {
+    if (was) link->session->queued_senders--;
+    else link->session->queued_senders++;
+  }
+}
+
+// Count a frame carrying the performative with this descriptor code, see pn_transport_stats
+static inline void pni_count_performative(pn_transport_t *transport, pn_dir_t dir, uint64_t code, size_t size)
+{
+  if (code >= 0x10 && code < 0x10 + PN_PERFORMATIVES) {
+    transport->performative_frames[dir][code - 0x10]++;
+    transport->performative_bytes[dir][code - 0x10] += size;
+  }
+}
+
+static inline void pni_capture_frame(pn_transport_t *transport, pn_dir_t dir, const char *frame, size_t size) {
+  transport->frame_capture(transport, transport->frame_capture_context, dir == OUT, frame, size);
+}
+
+void pni_record_frame(pn_transport_t *transport, pn_dir_t dir, uint8_t type, uint16_t ch,
+                      uint8_t performative, size_t size, size_t payload);
 void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
                  pn_data_t *args, const char *payload, size_t size);
 
@@ -24,17 +24,35 @@
 #include <string.h>
 #include "protocol.h"
 
+#include <proton/message.h>
+
 #include <assert.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <stdio.h>
 
 #include "platform/platform.h"
 #include "platform/platform_fmt.h"
 #include "transport.h"
+#include "config.h"
+#include "probes.h"
 
 static void pni_session_bound(pn_session_t *ssn);
 static void pni_link_bound(pn_link_t *link);
 
+/* The fields used on every transfer, flow and settlement are kept together
+   at the front of the engine structs, this fails the build if they grow
+   past the cache lines they are meant to fit in. */
+#define PNI_CACHE_LINE 64
+#define PNI_HOT_FIELDS(TYPE, FIRST, COLD, LINES)                        \
+  typedef char pni_hot_##TYPE[offsetof(TYPE, COLD) - offsetof(TYPE, FIRST) <= (LINES) * PNI_CACHE_LINE ? 1 : -1]
+
+PNI_HOT_FIELDS(pn_endpoint_t, type, error, 1);
+PNI_HOT_FIELDS(pn_session_t, connection, state, 2);
+PNI_HOT_FIELDS(pn_session_state_t, local_channel, local_handles, 3);
+PNI_HOT_FIELDS(pn_link_t, session, stats, 2);
+PNI_HOT_FIELDS(pn_delivery_t, link, local, 2);
+
 
 // endpoints
 
@@ -165,8 +183,10 @@ void pn_connection_unbound(pn_connection_t *connection)
     // connection has been freed prior to unbinding, thus it
     // cannot be re-assigned to a new transport.  Clear the
     // transport work lists to allow the connection to be freed.
-    while (connection->transport_head) {
-        pn_clear_modified(connection, connection->transport_head);
+    for (int i = 0; i < PNI_MODIFIED_KINDS; ++i) {
+      while (connection->modified[i].transport_head) {
+        pn_clear_modified(connection, connection->modified[i].transport_head);
+      }
     }
     while (connection->tpwork_head) {
       pn_clear_tpwork(connection->tpwork_head);
@@ -200,11 +220,13 @@ pn_transport_t *pn_connection_transport(pn_connection_t *connection)
   return connection->transport;
 }
 
+// Every endpoint and transport has two conditions and few are ever set,
+// their parts are created on first use
 void pn_condition_init(pn_condition_t *condition)
 {
-  condition->name = pn_string(NULL);
-  condition->description = pn_string(NULL);
-  condition->info = pn_data(0);
+  condition->name = NULL;
+  condition->description = NULL;
+  condition->info = NULL;
 }
 
 pn_condition_t *pn_condition() {
@@ -231,6 +253,7 @@ void pn_condition_free(pn_condition_t *c) {
 static void pni_add_session(pn_connection_t *conn, pn_session_t *ssn)
 {
   pn_list_add(conn->sessions, ssn);
+  LL_ADD(conn, session, ssn);
   ssn->connection = conn;
   pn_incref(conn);  // keep around until finalized
   pn_ep_incref(&conn->endpoint);
@@ -241,6 +264,7 @@ static void pni_remove_session(pn_connection_t *conn, pn_session_t *ssn)
   if (pn_list_remove(conn->sessions, ssn)) {
     pn_ep_decref(&conn->endpoint);
     LL_REMOVE(conn, endpoint, &ssn->endpoint);
+    LL_REMOVE(conn, session, ssn);
   }
 }
 
@@ -298,9 +322,83 @@ void pn_session_set_context(pn_session_t *session, void *context)
 }
 
 
+static uintptr_t pni_link_name_hash(pn_bytes_t name)
+{
+  // FNV-1a
+  uintptr_t hash = 2166136261u;
+  for (size_t i = 0; i < name.size; ++i) {
+    hash = (hash ^ (uint8_t) name.start[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Append to the end of its chain, so links of the same name stay in creation order
+static void pni_link_index_insert(pn_session_t *ssn, pn_link_t *link)
+{
+  pn_link_t **next = &ssn->link_index[link->name_hash & (ssn->link_index_size - 1)];
+  while (*next) next = &(*next)->name_next;
+  link->name_next = NULL;
+  *next = link;
+}
+
+static void pni_link_index_add(pn_session_t *ssn, pn_link_t *link)
+{
+  link->name_hash = pni_link_name_hash(pn_string_bytes(link->name));
+  size_t nlinks = pn_list_size(ssn->links);
+  if (nlinks <= ssn->link_index_size) {
+    pni_link_index_insert(ssn, link);
+    return;
+  }
+  // Grow and rebuild from the links list, which already has the new link
+  size_t size = ssn->link_index_size ? 2 * ssn->link_index_size : 16;
+  while (size < nlinks) size *= 2;
+  free(ssn->link_index);
+  ssn->link_index = (pn_link_t **) calloc(size, sizeof(pn_link_t *));
+  ssn->link_index_size = size;
+  for (size_t i = 0; i < nlinks; ++i) {
+    pni_link_index_insert(ssn, (pn_link_t *) pn_list_get(ssn->links, i));
+  }
+}
+
+static void pni_link_index_remove(pn_session_t *ssn, pn_link_t *link)
+{
+  pn_link_t **next = &ssn->link_index[link->name_hash & (ssn->link_index_size - 1)];
+  while (*next && *next != link) next = &(*next)->name_next;
+  if (*next) *next = link->name_next;
+  link->name_next = NULL;
+}
+
+pn_link_t *pni_link_named(pn_session_t *ssn, pn_bytes_t name, pn_link_t *prev)
+{
+  pn_link_t *link;
+  uintptr_t hash;
+  if (prev) {
+    hash = prev->name_hash;
+    link = prev->name_next;
+  } else {
+    if (!ssn->link_index_size) return NULL;
+    hash = pni_link_name_hash(name);
+    link = ssn->link_index[hash & (ssn->link_index_size - 1)];
+  }
+  for (; link; link = link->name_next) {
+    if (link->name_hash == hash && pn_bytes_equal(name, pn_string_bytes(link->name))) {
+      return link;
+    }
+  }
+  return NULL;
+}
+
+static pni_link_list_t *pni_link_role_list(pn_session_t *ssn, pn_link_t *link)
+{
+  return link->endpoint.type == SENDER ? &ssn->senders : &ssn->receivers;
+}
+
 static void pni_add_link(pn_session_t *ssn, pn_link_t *link)
 {
   pn_list_add(ssn->links, link);
+  pni_link_index_add(ssn, link);
+  LL_ADD(ssn->connection, link, link);
+  LL_ADD(pni_link_role_list(ssn, link), role, link);
   link->session = ssn;
   pn_ep_incref(&ssn->endpoint);
 }
@@ -308,8 +406,12 @@ static void pni_add_link(pn_session_t *ssn, pn_link_t *link)
 static void pni_remove_link(pn_session_t *ssn, pn_link_t *link)
 {
   if (pn_list_remove(ssn->links, link)) {
+    if (link->endpoint.type == SENDER && link->queued && !link->endpoint.freed) ssn->queued_senders--;
+    pni_link_index_remove(ssn, link);
     pn_ep_decref(&ssn->endpoint);
     LL_REMOVE(ssn->connection, endpoint, &link->endpoint);
+    LL_REMOVE(ssn->connection, link, link);
+    LL_REMOVE(pni_link_role_list(ssn, link), role, link);
   }
 }
 
@@ -383,14 +485,12 @@ pn_record_t *pn_link_attachments(pn_link_t *link)
   return link->context;
 }
 
-void pn_endpoint_init(pn_endpoint_t *endpoint, int type, pn_connection_t *conn)
+// Set up an endpoint whose error and conditions are already there
+static void pni_endpoint_reset(pn_endpoint_t *endpoint, int type, pn_connection_t *conn)
 {
   endpoint->type = (pn_endpoint_type_t) type;
   endpoint->referenced = true;
   endpoint->state = PN_LOCAL_UNINIT | PN_REMOTE_UNINIT;
-  endpoint->error = pn_error();
-  pn_condition_init(&endpoint->condition);
-  pn_condition_init(&endpoint->remote_condition);
   endpoint->endpoint_next = NULL;
   endpoint->endpoint_prev = NULL;
   endpoint->transport_next = NULL;
@@ -403,6 +503,14 @@ void pn_endpoint_init(pn_endpoint_t *endpoint, int type, pn_connection_t *conn)
   LL_ADD(conn, endpoint, endpoint);
 }
 
+void pn_endpoint_init(pn_endpoint_t *endpoint, int type, pn_connection_t *conn)
+{
+  endpoint->error = pn_error();
+  pn_condition_init(&endpoint->condition);
+  pn_condition_init(&endpoint->remote_condition);
+  pni_endpoint_reset(endpoint, type, conn);
+}
+
 void pn_ep_incref(pn_endpoint_t *endpoint)
 {
   endpoint->refcount++;
@@ -501,6 +609,8 @@ static void pn_connection_finalize(void *object)
   pn_free(conn->properties);
   pni_endpoint_tini(endpoint);
   pn_free(conn->delivery_pool);
+  pn_free(conn->link_pool);
+  pni_object_pool_release(conn->object_pool);
 }
 
 #define pn_connection_initialize NULL
@@ -516,9 +626,15 @@ pn_connection_t *pn_connection()
 
   conn->endpoint_head = NULL;
   conn->endpoint_tail = NULL;
+  conn->session_head = NULL;
+  conn->session_tail = NULL;
+  conn->link_head = NULL;
+  conn->link_tail = NULL;
   pn_endpoint_init(&conn->endpoint, CONNECTION, conn);
-  conn->transport_head = NULL;
-  conn->transport_tail = NULL;
+  for (int i = 0; i < PNI_MODIFIED_KINDS; ++i) {
+    conn->modified[i].transport_head = NULL;
+    conn->modified[i].transport_tail = NULL;
+  }
   conn->sessions = pn_list(PN_WEAKREF, 0);
   conn->freed = pn_list(PN_WEAKREF, 0);
   conn->transport = NULL;
@@ -528,14 +644,25 @@ pn_connection_t *pn_connection()
   conn->tpwork_tail = NULL;
   conn->container = pn_string(NULL);
   conn->hostname = pn_string(NULL);
-  conn->auth_user = pn_string(NULL);
-  conn->auth_password = pn_string(NULL);
-  conn->offered_capabilities = pn_data(0);
-  conn->desired_capabilities = pn_data(0);
-  conn->properties = pn_data(0);
+  // Created on first use, most connections never set them
+  conn->auth_user = NULL;
+  conn->auth_password = NULL;
+  conn->offered_capabilities = NULL;
+  conn->desired_capabilities = NULL;
+  conn->properties = NULL;
   conn->collector = NULL;
   conn->context = pn_record();
-  conn->delivery_pool = pn_list(PN_OBJECT, 0);
+  conn->delivery_pool = NULL;
+  conn->delivery_pool_bytes = 0;
+  conn->delivery_pool_max = PN_DELIVERY_POOL_MAX_BYTES;
+  conn->delivery_pool_hits = 0;
+  conn->delivery_pool_misses = 0;
+  conn->link_pool = NULL;
+  conn->delivery_memory = 0;
+  conn->memory_limit = 0;
+  conn->output_high_water = 0;
+  conn->output_blocked = false;
+  conn->object_pool = pni_object_pool();
 
   return conn;
 }
@@ -562,6 +689,123 @@ pn_collector_t* pn_connection_collector(pn_connection_t *connection) {
   return connection->collector;
 }
 
+// Cut back pooled buffers until the pool holds at most bytes
+static void pni_delivery_pool_trim(pn_connection_t *connection, size_t bytes)
+{
+  pn_list_t *pool = connection->delivery_pool;
+  if (!pool) return;
+  for (size_t i = 0; i < pn_list_size(pool) && connection->delivery_pool_bytes > bytes; ++i) {
+    pn_delivery_t *delivery = (pn_delivery_t *) pn_list_get(pool, i);
+    size_t capacity = pn_buffer_capacity(delivery->bytes);
+    pn_buffer_shrink(delivery->bytes, PN_DELIVERY_BUFFER_SIZE);
+    connection->delivery_pool_bytes -= capacity - pn_buffer_capacity(delivery->bytes);
+    connection->delivery_memory -= capacity - pn_buffer_capacity(delivery->bytes);
+  }
+}
+
+void pn_connection_set_delivery_pool_max(pn_connection_t *connection, size_t bytes)
+{
+  assert(connection);
+  connection->delivery_pool_max = bytes;
+  pni_delivery_pool_trim(connection, bytes);
+}
+
+uint64_t pn_connection_get_delivery_pool_hits(const pn_connection_t *connection)
+{
+  return connection->delivery_pool_hits;
+}
+
+uint64_t pn_connection_get_delivery_pool_misses(const pn_connection_t *connection)
+{
+  return connection->delivery_pool_misses;
+}
+
+size_t pni_connection_memory(pn_connection_t *connection)
+{
+  size_t size = connection->delivery_memory + pni_object_pool_size(connection->object_pool);
+  if (connection->transport) size += pni_transport_memory(connection->transport);
+  return size;
+}
+
+bool pni_connection_memory_full(pn_connection_t *connection)
+{
+  if (!connection->memory_limit) return false;
+  if (pni_connection_memory(connection) < connection->memory_limit) return false;
+  // Buffers kept only for reuse go before input is held off
+  if (connection->delivery_pool)
+    pni_delivery_pool_trim(connection, pn_list_size(connection->delivery_pool) * PN_DELIVERY_BUFFER_SIZE);
+  return pni_connection_memory(connection) >= connection->memory_limit;
+}
+
+size_t pn_connection_memory_usage(pn_connection_t *connection)
+{
+  assert(connection);
+  return pni_connection_memory(connection);
+}
+
+void pn_connection_set_memory_limit(pn_connection_t *connection, size_t bytes)
+{
+  assert(connection);
+  connection->memory_limit = bytes;
+}
+
+size_t pn_connection_get_memory_limit(pn_connection_t *connection)
+{
+  assert(connection);
+  return connection->memory_limit;
+}
+
+size_t pn_connection_output_backlog(pn_connection_t *connection)
+{
+  assert(connection);
+  size_t size = 0;
+  for (pn_session_t *ssn = connection->session_head; ssn; ssn = ssn->session_next) {
+    if (ssn->outgoing_bytes > 0) size += ssn->outgoing_bytes;
+  }
+  pn_transport_t *transport = connection->transport;
+  if (transport) size += transport->available + transport->output_pending;
+  return size;
+}
+
+void pn_connection_set_output_high_water(pn_connection_t *connection, size_t bytes)
+{
+  assert(connection);
+  connection->output_high_water = bytes;
+  pni_connection_output_drained(connection);
+}
+
+size_t pn_connection_get_output_high_water(pn_connection_t *connection)
+{
+  assert(connection);
+  return connection->output_high_water;
+}
+
+bool pn_connection_output_blocked(pn_connection_t *connection)
+{
+  assert(connection);
+  if (!connection->output_blocked && connection->output_high_water &&
+      pn_connection_output_backlog(connection) >= connection->output_high_water) {
+    connection->output_blocked = true;
+  }
+  return connection->output_blocked;
+}
+
+// Called as output leaves the transport.  Once the backlog is down to half
+// the high-water mark, senders that have credit are told to send again.
+void pni_connection_output_drained(pn_connection_t *connection)
+{
+  if (!connection->output_blocked) return;
+  if (connection->output_high_water &&
+      pn_connection_output_backlog(connection) > connection->output_high_water / 2) return;
+  connection->output_blocked = false;
+  for (pn_link_t *link = connection->link_head; link; link = link->link_next) {
+    if (pn_link_is_sender(link) && pn_link_credit(link) > 0 &&
+        (link->endpoint.state & PN_LOCAL_ACTIVE)) {
+      pn_collector_put(connection->collector, PN_OBJECT, link, PN_LINK_FLOW);
+    }
+  }
+}
+
 pn_state_t pn_connection_state(pn_connection_t *connection)
 {
   return connection ? connection->endpoint.state : 0;
@@ -599,18 +843,26 @@ void pn_connection_set_hostname(pn_connection_t *connection, const char *hostnam
 const char *pn_connection_get_user(pn_connection_t *connection)
 {
     assert(connection);
-    return pn_string_get(connection->auth_user);
+    return connection->auth_user ? pn_string_get(connection->auth_user) : NULL;
 }
 
 void pn_connection_set_user(pn_connection_t *connection, const char *user)
 {
     assert(connection);
+    if (!connection->auth_user) {
+      if (!user) return;
+      connection->auth_user = pn_string(NULL);
+    }
     pn_string_set(connection->auth_user, user);
 }
 
 void pn_connection_set_password(pn_connection_t *connection, const char *password)
 {
     assert(connection);
+    if (!connection->auth_password) {
+      if (!password) return;
+      connection->auth_password = pn_string(NULL);
+    }
     // Make sure the previous password is erased, if there was one.
     size_t n = pn_string_size(connection->auth_password);
     const char* s = pn_string_get(connection->auth_password);
@@ -618,40 +870,52 @@ void pn_connection_set_password(pn_connection_t *connection, const char *passwor
     pn_string_set(connection->auth_password, password);
 }
 
+pn_data_t *pni_data_lazy(pn_data_t **data)
+{
+  if (!*data) *data = pn_data(0);
+  return *data;
+}
+
+pn_string_t *pni_string_lazy(pn_string_t **string)
+{
+  if (!*string) *string = pn_string(NULL);
+  return *string;
+}
+
 pn_data_t *pn_connection_offered_capabilities(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->offered_capabilities;
+  return pni_data_lazy(&connection->offered_capabilities);
 }
 
 pn_data_t *pn_connection_desired_capabilities(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->desired_capabilities;
+  return pni_data_lazy(&connection->desired_capabilities);
 }
 
 pn_data_t *pn_connection_properties(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->properties;
+  return pni_data_lazy(&connection->properties);
 }
 
 pn_data_t *pn_connection_remote_offered_capabilities(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->transport ? connection->transport->remote_offered_capabilities : NULL;
+  return connection->transport ? pni_data_lazy(&connection->transport->remote_offered_capabilities) : NULL;
 }
 
 pn_data_t *pn_connection_remote_desired_capabilities(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->transport ? connection->transport->remote_desired_capabilities : NULL;
+  return connection->transport ? pni_data_lazy(&connection->transport->remote_desired_capabilities) : NULL;
 }
 
 pn_data_t *pn_connection_remote_properties(pn_connection_t *connection)
 {
   assert(connection);
-  return connection->transport ? connection->transport->remote_properties : NULL;
+  return connection->transport ? pni_data_lazy(&connection->transport->remote_properties) : NULL;
 }
 
 const char *pn_connection_remote_container(pn_connection_t *connection)
@@ -738,7 +1002,12 @@ void pn_clear_tpwork(pn_delivery_t *delivery)
   pn_connection_t *connection = delivery->link->session->connection;
   if (delivery->tpwork)
   {
-    LL_REMOVE(connection, tpwork, delivery);
+    if (delivery->tpwork_parked) {
+      LL_REMOVE(delivery->link, tpwork, delivery);
+      delivery->tpwork_parked = false;
+    } else {
+      LL_REMOVE(connection, tpwork, delivery);
+    }
     delivery->tpwork = false;
     if (pn_refcount(delivery) > 0) {
       pn_incref(delivery);
@@ -747,23 +1016,68 @@ void pn_clear_tpwork(pn_delivery_t *delivery)
   }
 }
 
+// A sender delivery that can only wait for credit moves off the
+// connection's transport work onto its link's, so the transport stops
+// walking it on every pass.  It stays tpwork, adding work again is a no-op.
+void pni_park_tpwork(pn_delivery_t *delivery)
+{
+  assert(delivery->tpwork && !delivery->tpwork_parked);
+  pn_link_t *link = delivery->link;
+  LL_REMOVE(link->session->connection, tpwork, delivery);
+  LL_ADD(link, tpwork, delivery);
+  delivery->tpwork_parked = true;
+}
+
+// Parked deliveries go back in front of the connection's transport work,
+// ahead of any the link gained since, so the link still sends in order
+void pni_link_unpark_tpwork(pn_link_t *link)
+{
+  if (!link->tpwork_head) return;
+  pn_connection_t *connection = link->session->connection;
+  for (pn_delivery_t *d = link->tpwork_head; d; d = d->tpwork_next) {
+    d->tpwork_parked = false;
+  }
+  link->tpwork_tail->tpwork_next = connection->tpwork_head;
+  if (connection->tpwork_head) {
+    connection->tpwork_head->tpwork_prev = link->tpwork_tail;
+  } else {
+    connection->tpwork_tail = link->tpwork_tail;
+  }
+  connection->tpwork_head = link->tpwork_head;
+  link->tpwork_head = NULL;
+  link->tpwork_tail = NULL;
+  pn_modified(connection, &connection->endpoint, true);
+}
+
 void pn_dump(pn_connection_t *conn)
 {
-  pn_endpoint_t *endpoint = conn->transport_head;
-  while (endpoint)
-  {
-    printf("%p", (void *) endpoint);
-    endpoint = endpoint->transport_next;
-    if (endpoint)
-      printf(" -> ");
+  for (int i = 0; i < PNI_MODIFIED_KINDS; ++i) {
+    pn_endpoint_t *endpoint = conn->modified[i].transport_head;
+    while (endpoint)
+    {
+      printf("%p", (void *) endpoint);
+      endpoint = endpoint->transport_next;
+      if (endpoint)
+        printf(" -> ");
+    }
+    printf("\n");
+  }
+}
+
+static pni_modified_list_t *pni_modified_list(pn_connection_t *connection, pn_endpoint_t *endpoint)
+{
+  switch (endpoint->type) {
+  case CONNECTION: return &connection->modified[PNI_MODIFIED_CONNECTION];
+  case SESSION: return &connection->modified[PNI_MODIFIED_SESSION];
+  default: return &connection->modified[PNI_MODIFIED_LINK];
   }
-  printf("\n");
 }
 
 void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit)
 {
   if (!endpoint->modified) {
-    LL_ADD(connection, transport, endpoint);
+    pni_modified_list_t *list = pni_modified_list(connection, endpoint);
+    LL_ADD(list, transport, endpoint);
     endpoint->modified = true;
   }
 
@@ -776,17 +1090,16 @@ void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint)
 {
   if (endpoint->modified) {
-    LL_REMOVE(connection, transport, endpoint);
+    pni_modified_list_t *list = pni_modified_list(connection, endpoint);
+    LL_REMOVE(list, transport, endpoint);
     endpoint->transport_next = NULL;
     endpoint->transport_prev = NULL;
     endpoint->modified = false;
   }
 }
 
-static bool pni_matches(pn_endpoint_t *endpoint, pn_endpoint_type_t type, pn_state_t state)
+static bool pni_state_matches(pn_endpoint_t *endpoint, pn_state_t state)
 {
-  if (endpoint->type != type) return false;
-
   if (!state) return true;
 
   int st = endpoint->state;
@@ -796,6 +1109,11 @@ static bool pni_matches(pn_endpoint_t *endpoint, pn_endpoint_type_t type, pn_sta
     return st == state;
 }
 
+static bool pni_matches(pn_endpoint_t *endpoint, pn_endpoint_type_t type, pn_state_t state)
+{
+  return endpoint->type == type && pni_state_matches(endpoint, state);
+}
+
 pn_endpoint_t *pn_find(pn_endpoint_t *endpoint, pn_endpoint_type_t type, pn_state_t state)
 {
   while (endpoint)
@@ -807,52 +1125,57 @@ pn_endpoint_t *pn_find(pn_endpoint_t *endpoint, pn_endpoint_type_t type, pn_stat
   return NULL;
 }
 
+static pn_session_t *pni_find_session(pn_session_t *ssn, pn_state_t state)
+{
+  while (ssn && !pni_state_matches(&ssn->endpoint, state)) ssn = ssn->session_next;
+  return ssn;
+}
+
 pn_session_t *pn_session_head(pn_connection_t *conn, pn_state_t state)
 {
-  if (conn)
-    return (pn_session_t *) pn_find(conn->endpoint_head, SESSION, state);
-  else
-    return NULL;
+  return conn ? pni_find_session(conn->session_head, state) : NULL;
 }
 
 pn_session_t *pn_session_next(pn_session_t *ssn, pn_state_t state)
 {
-  if (ssn)
-    return (pn_session_t *) pn_find(ssn->endpoint.endpoint_next, SESSION, state);
-  else
-    return NULL;
+  return ssn ? pni_find_session(ssn->session_next, state) : NULL;
 }
 
 pn_link_t *pn_link_head(pn_connection_t *conn, pn_state_t state)
 {
   if (!conn) return NULL;
-
-  pn_endpoint_t *endpoint = conn->endpoint_head;
-
-  while (endpoint)
-  {
-    if (pni_matches(endpoint, SENDER, state) || pni_matches(endpoint, RECEIVER, state))
-      return (pn_link_t *) endpoint;
-    endpoint = endpoint->endpoint_next;
-  }
-
-  return NULL;
+  pn_link_t *link = conn->link_head;
+  while (link && !pni_state_matches(&link->endpoint, state)) link = link->link_next;
+  return link;
 }
 
 pn_link_t *pn_link_next(pn_link_t *link, pn_state_t state)
 {
   if (!link) return NULL;
+  link = link->link_next;
+  while (link && !pni_state_matches(&link->endpoint, state)) link = link->link_next;
+  return link;
+}
 
-  pn_endpoint_t *endpoint = link->endpoint.endpoint_next;
+static pn_link_t *pni_find_role(pn_link_t *link, pn_state_t state)
+{
+  while (link && !pni_state_matches(&link->endpoint, state)) link = link->role_next;
+  return link;
+}
 
-  while (endpoint)
-  {
-    if (pni_matches(endpoint, SENDER, state) || pni_matches(endpoint, RECEIVER, state))
-      return (pn_link_t *) endpoint;
-    endpoint = endpoint->endpoint_next;
-  }
+pn_link_t *pn_session_sender_head(pn_session_t *session, pn_state_t state)
+{
+  return session ? pni_find_role(session->senders.role_head, state) : NULL;
+}
 
-  return NULL;
+pn_link_t *pn_session_receiver_head(pn_session_t *session, pn_state_t state)
+{
+  return session ? pni_find_role(session->receivers.role_head, state) : NULL;
+}
+
+pn_link_t *pn_link_session_next(pn_link_t *link, pn_state_t state)
+{
+  return link ? pni_find_role(link->role_next, state) : NULL;
 }
 
 static void pn_session_incref(void *object)
@@ -929,7 +1252,7 @@ static bool pni_preserve_child(pn_endpoint_t *endpoint)
     pn_decref(parent);
     return true;
   } else {
-    LL_REMOVE(conn, transport, endpoint);
+    pn_clear_modified(conn, endpoint);
     return false;
   }
 }
@@ -945,18 +1268,22 @@ static void pn_session_finalize(void *object)
 
   pn_free(session->context);
   pni_free_children(session->links, session->freed);
+  free(session->link_index);
   pni_endpoint_tini(endpoint);
   pn_delivery_map_free(&session->state.incoming);
   pn_delivery_map_free(&session->state.outgoing);
   pn_free(session->state.local_handles);
   pn_free(session->state.remote_handles);
+  pni_alias_index_free(&session->state.remote_handle_index);
   pni_remove_session(session->connection, session);
   pn_list_remove(session->connection->freed, session);
 
   if (session->connection->transport) {
     pn_transport_t *transport = session->connection->transport;
     pn_hash_del(transport->local_channels, session->state.local_channel);
+    pni_release_alias(&transport->local_channel_hint, session->state.local_channel);
     pn_hash_del(transport->remote_channels, session->state.remote_channel);
+    pni_alias_index_del(&transport->remote_channel_index, session->state.remote_channel);
   }
 
   if (endpoint->referenced) {
@@ -994,19 +1321,30 @@ pn_session_t *pn_session(pn_connection_t *conn)
 #define pn_session_free pn_object_free
   static const pn_class_t clazz = PN_METACLASS(pn_session);
 #undef pn_session_free
+  pni_object_pool_t *prev_pool = pni_object_pool_use(conn->object_pool);
   pn_session_t *ssn = (pn_session_t *) pn_class_new(&clazz, sizeof(pn_session_t));
-  if (!ssn) return NULL;
+  if (!ssn) {
+    pni_object_pool_use(prev_pool);
+    return NULL;
+  }
   pn_endpoint_init(&ssn->endpoint, SESSION, conn);
   pni_add_session(conn, ssn);
   ssn->links = pn_list(PN_WEAKREF, 0);
+  ssn->senders.role_head = ssn->senders.role_tail = NULL;
+  ssn->receivers.role_head = ssn->receivers.role_tail = NULL;
+  ssn->link_index = NULL;
+  ssn->link_index_size = 0;
   ssn->freed = pn_list(PN_WEAKREF, 0);
   ssn->context = pn_record();
   ssn->incoming_capacity = 1024*1024;
   ssn->incoming_bytes = 0;
+  ssn->incoming_frame_max = 0;
+  ssn->incoming_budget = false;
   ssn->outgoing_bytes = 0;
   ssn->incoming_deliveries = 0;
   ssn->outgoing_deliveries = 0;
   ssn->outgoing_window = 2147483647;
+  ssn->queued_senders = 0;
 
   // begin transport state
   memset(&ssn->state, 0, sizeof(ssn->state));
@@ -1017,6 +1355,7 @@ pn_session_t *pn_session(pn_connection_t *conn)
   ssn->state.local_handles = pn_hash(PN_WEAKREF, 0, 0.75);
   ssn->state.remote_handles = pn_hash(PN_WEAKREF, 0, 0.75);
   // end transport state
+  pni_object_pool_use(prev_pool);
 
   pn_collector_put(conn->collector, PN_OBJECT, ssn, PN_SESSION_INIT);
   if (conn->transport) {
@@ -1059,6 +1398,18 @@ void pn_session_set_incoming_capacity(pn_session_t *ssn, size_t capacity)
   ssn->incoming_capacity = capacity;
 }
 
+bool pn_session_get_incoming_budget(pn_session_t *ssn)
+{
+  assert(ssn);
+  return ssn->incoming_budget;
+}
+
+void pn_session_set_incoming_budget(pn_session_t *ssn, bool budget)
+{
+  assert(ssn);
+  ssn->incoming_budget = budget;
+}
+
 size_t pn_session_get_outgoing_window(pn_session_t *ssn)
 {
   assert(ssn);
@@ -1093,19 +1444,30 @@ pn_error_t *pn_session_error(pn_session_t *session)
   return session->endpoint.error;
 }
 
-static void pni_terminus_init(pn_terminus_t *terminus, pn_terminus_type_t type)
+// Reset a terminus to its defaults, keeping its string and data
+static void pni_terminus_reset(pn_terminus_t *terminus, pn_terminus_type_t type)
 {
   terminus->type = type;
-  terminus->address = pn_string(NULL);
+  pn_string_set(terminus->address, NULL);
   terminus->durability = PN_NONDURABLE;
   terminus->expiry_policy = PN_EXPIRE_WITH_SESSION;
   terminus->timeout = 0;
   terminus->dynamic = false;
   terminus->distribution_mode = PN_DIST_MODE_UNSPECIFIED;
+  pn_data_clear(terminus->properties);
+  pn_data_clear(terminus->capabilities);
+  pn_data_clear(terminus->outcomes);
+  pn_data_clear(terminus->filter);
+}
+
+static void pni_terminus_init(pn_terminus_t *terminus, pn_terminus_type_t type)
+{
+  terminus->address = pn_string(NULL);
   terminus->properties = pn_data(0);
   terminus->capabilities = pn_data(0);
   terminus->outcomes = pn_data(0);
   terminus->filter = pn_data(0);
+  pni_terminus_reset(terminus, type);
 }
 
 static void pn_link_incref(void *object)
@@ -1119,11 +1481,29 @@ static void pn_link_incref(void *object)
   }
 }
 
+// Free what a link owns, it is not coming back
+static void pni_link_free_fields(pn_link_t *link)
+{
+  pn_free(link->context);
+  pni_terminus_free(&link->source);
+  pni_terminus_free(&link->target);
+  pni_terminus_free(&link->remote_source);
+  pni_terminus_free(&link->remote_target);
+  pn_free(link->name);
+  pni_endpoint_tini(&link->endpoint);
+}
+
 static void pn_link_finalize(void *object)
 {
   pn_link_t *link = (pn_link_t *) object;
   pn_endpoint_t *endpoint = &link->endpoint;
 
+  if (!link->session) {
+    // A pooled link, its connection is going away
+    pni_link_free_fields(link);
+    return;
+  }
+
   if (pni_preserve_child(endpoint)) {
     return;
   }
@@ -1133,19 +1513,36 @@ static void pn_link_finalize(void *object)
     pn_free(link->unsettled_head);
   }
 
-  pn_free(link->context);
-  pni_terminus_free(&link->source);
-  pni_terminus_free(&link->target);
-  pni_terminus_free(&link->remote_source);
-  pni_terminus_free(&link->remote_target);
-  pn_free(link->name);
-  pni_endpoint_tini(endpoint);
-  pni_remove_link(link->session, link);
-  pn_hash_del(link->session->state.local_handles, link->state.local_handle);
-  pn_hash_del(link->session->state.remote_handles, link->state.remote_handle);
-  pn_list_remove(link->session->freed, link);
-  if (endpoint->referenced) {
-    pn_decref(link->session);
+  pn_session_t *session = link->session;
+  pn_connection_t *conn = session->connection;
+  // Links come and go with requests on RPC connections, keep a few
+  // with their termini for pn_link_new() to reuse
+  bool pooled = pni_connection_live(conn) &&
+    (!conn->link_pool || pn_list_size(conn->link_pool) < PN_LINK_POOL_MAX);
+  if (pooled) {
+    pn_record_clear(link->context);
+    pn_error_clear(endpoint->error);
+    pn_condition_clear(&endpoint->condition);
+    pn_condition_clear(&endpoint->remote_condition);
+  } else {
+    pni_link_free_fields(link);
+  }
+  pni_remove_link(session, link);
+  pn_hash_del(session->state.local_handles, link->state.local_handle);
+  pni_release_alias(&session->state.local_handle_hint, link->state.local_handle);
+  pn_hash_del(session->state.remote_handles, link->state.remote_handle);
+  pni_alias_index_del(&session->state.remote_handle_index, link->state.remote_handle);
+  pn_list_remove(session->freed, link);
+  bool referenced = endpoint->referenced;
+  if (pooled) {
+    link->session = NULL;
+    endpoint->referenced = true; // So the pool's reference is a plain one
+    if (!conn->link_pool) conn->link_pool = pn_list(PN_OBJECT, 0);
+    pn_list_add(conn->link_pool, link);
+    assert(pn_refcount(link) == 1);
+  }
+  if (referenced) {
+    pn_decref(session);
   }
 }
 
@@ -1164,27 +1561,47 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   static const pn_class_t clazz = PN_METACLASS(pn_link);
 #undef pn_link_new
 #undef pn_link_free
-  pn_link_t *link = (pn_link_t *) pn_class_new(&clazz, sizeof(pn_link_t));
-
-  pn_endpoint_init(&link->endpoint, type, session->connection);
+  pn_connection_t *conn = session->connection;
+  pn_link_t *link = conn->link_pool ? (pn_link_t *) pn_list_pop(conn->link_pool) : NULL;
+  pni_object_pool_t *prev_pool = pni_object_pool_use(conn->object_pool);
+  if (link) {
+    // Its error, conditions and data were cleared by pn_link_finalize()
+    pni_endpoint_reset(&link->endpoint, type, conn);
+    pn_string_set(link->name, name);
+    pni_terminus_reset(&link->source, PN_SOURCE);
+    pni_terminus_reset(&link->target, PN_TARGET);
+    pni_terminus_reset(&link->remote_source, PN_UNSPECIFIED);
+    pni_terminus_reset(&link->remote_target, PN_UNSPECIFIED);
+  } else {
+    link = (pn_link_t *) pn_class_new(&clazz, sizeof(pn_link_t));
+    pn_endpoint_init(&link->endpoint, type, conn);
+    link->name = pn_string(name);
+    pni_terminus_init(&link->source, PN_SOURCE);
+    pni_terminus_init(&link->target, PN_TARGET);
+    pni_terminus_init(&link->remote_source, PN_UNSPECIFIED);
+    pni_terminus_init(&link->remote_target, PN_UNSPECIFIED);
+    link->context = pn_record();
+  }
   pni_add_link(session, link);
   pn_incref(session);  // keep session until link finalized
-  link->name = pn_string(name);
-  pni_terminus_init(&link->source, PN_SOURCE);
-  pni_terminus_init(&link->target, PN_TARGET);
-  pni_terminus_init(&link->remote_source, PN_UNSPECIFIED);
-  pni_terminus_init(&link->remote_target, PN_UNSPECIFIED);
   link->unsettled_head = link->unsettled_tail = link->current = NULL;
+  link->tpwork_head = link->tpwork_tail = NULL;
+  link->partial = NULL;
   link->unsettled_count = 0;
+  link->resuming = 0;
   link->max_message_size = 0;
   link->remote_max_message_size = 0;
+  link->weight = 1;
   link->available = 0;
   link->credit = 0;
   link->queued = 0;
+  link->tag_serial = 0;
+  memset(&link->stats, 0, sizeof(link->stats));
+  link->credit_blocked_since = 0;
+  link->window_blocked_since = 0;
   link->drain = false;
   link->drain_flag_mode = true;
   link->drained = 0;
-  link->context = pn_record();
   link->snd_settle_mode = PN_SND_MIXED;
   link->rcv_settle_mode = PN_RCV_FIRST;
   link->remote_snd_settle_mode = PN_SND_MIXED;
@@ -1197,6 +1614,7 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   link->state.delivery_count = 0;
   link->state.link_credit = 0;
   // end transport state
+  pni_object_pool_use(prev_pool);
 
   pn_collector_put(session->connection->collector, PN_OBJECT, link, PN_LINK_INIT);
   if (session->connection->transport) {
@@ -1217,6 +1635,7 @@ void pn_link_unbound(pn_link_t* link)
   link->state.remote_handle = -1;
   link->state.delivery_count = 0;
   link->state.link_credit = 0;
+  link->partial = NULL;
 }
 
 pn_terminus_t *pn_link_source(pn_link_t *link)
@@ -1434,6 +1853,109 @@ static bool pni_preserve_delivery(pn_delivery_t *delivery)
   return !delivery->local.settled || (conn->transport && (delivery->state.init || delivery->tpwork));
 }
 
+
+static void pni_delivery_release_shared(pn_delivery_t *delivery)
+{
+  void *owner = delivery->shared_owner;
+  delivery->shared = pn_bytes(0, NULL);
+  delivery->shared_owner = NULL;
+  pn_decref(owner);
+}
+
+static void pni_delivery_grown(pn_delivery_t *delivery, size_t old_capacity)
+{
+  pn_connection_t *conn = delivery->link->session->connection;
+  conn->delivery_memory += pn_buffer_capacity(delivery->bytes) - old_capacity;
+}
+
+int pni_delivery_append(pn_delivery_t *delivery, const char *bytes, size_t size)
+{
+  if (!size) return 0;
+  size_t capacity = pn_buffer_capacity(delivery->bytes);
+  int err = pn_buffer_append(delivery->bytes, bytes, size);
+  pni_delivery_grown(delivery, capacity);
+  return err;
+}
+
+// Copy unsent shared bytes into the delivery's own buffer
+static void pni_delivery_unshare(pn_delivery_t *delivery)
+{
+  if (delivery->shared_owner) {
+    pni_delivery_append(delivery, delivery->shared.start, delivery->shared.size);
+    pni_delivery_release_shared(delivery);
+  }
+}
+
+void pni_delivery_sent(pn_delivery_t *delivery, size_t size)
+{
+  if (delivery->shared.size) {
+    delivery->shared.start += size;
+    delivery->shared.size -= size;
+    if (!delivery->shared.size) pni_delivery_release_shared(delivery);
+    delivery->kept = false;
+  } else if (delivery->done && delivery->kept) {
+    // The buffer holds them anyway, keeping them costs nothing
+    delivery->sent += size;
+  } else {
+    // A delivery still being written could grow without bound
+    pn_buffer_trim(delivery->bytes, delivery->sent + size, 0);
+    delivery->sent = 0;
+    delivery->kept = false;
+  }
+}
+
+void pni_delivery_resume(pn_delivery_t *delivery, bool known, uint64_t outcome)
+{
+  pn_link_t *link = delivery->link;
+  pn_session_t *ssn = link->session;
+  assert(delivery->resume == PNI_RESUME_WAIT);
+  link->resuming--;
+  if (!pn_link_is_sender(link)) {
+    if (known) {
+      // The peer sends it again, see pni_do_transfer()
+      delivery->resume = PNI_RESUME_EXPECT;
+      link->resuming++;
+      return;
+    }
+    // The peer has settled it
+    delivery->resume = PNI_RESUME_NONE;
+    delivery->remote.settled = true;
+  } else if (delivery->local.settled) {
+    delivery->resume = known ? PNI_RESUME_SETTLE : PNI_RESUME_DONE;
+  } else if (known && outcome >= PN_ACCEPTED && outcome <= PN_MODIFIED) {
+    // The peer decided before the old transport went
+    delivery->remote.type = outcome;
+    delivery->resume = PNI_RESUME_SETTLE;
+  } else if (delivery->done && delivery->kept) {
+    // Frame all of it again
+    delivery->sent = 0;
+    ssn->outgoing_bytes += pn_buffer_size(delivery->bytes);
+    ssn->outgoing_deliveries++;
+    pni_sender_queue(link, 1);
+    delivery->resume = PNI_RESUME_SEND;
+    pni_add_tpwork(delivery);
+    return;
+  } else {
+    // Its bytes are gone, so the application has to send it again
+    delivery->remote.type = PN_RELEASED;
+    delivery->resume = known ? PNI_RESUME_SETTLE : PNI_RESUME_DONE;
+  }
+  if (!delivery->local.settled) {
+    delivery->updated = true;
+    pn_work_update(ssn->connection, delivery);
+    pn_collector_put(ssn->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
+  }
+  pni_add_tpwork(delivery);
+}
+
+static void pni_delivery_free_tag(pn_delivery_t *delivery)
+{
+  if (delivery->tag != delivery->tag_inline) free(delivery->tag);
+  delivery->tag = delivery->tag_inline;
+  delivery->tag_size = 0;
+}
+
+
 static void pn_delivery_finalize(void *object)
 {
   pn_delivery_t *delivery = (pn_delivery_t *) object;
@@ -1453,28 +1975,42 @@ static void pn_delivery_finalize(void *object)
 
     pn_clear_tpwork(delivery);
     LL_REMOVE(link, unsettled, delivery);
+    if (link->partial == delivery) link->partial = NULL;
+    if (delivery->resume == PNI_RESUME_WAIT || delivery->resume == PNI_RESUME_EXPECT) link->resuming--;
     pn_delivery_map_del(pn_link_is_sender(link)
                         ? &link->session->state.outgoing
                         : &link->session->state.incoming,
                         delivery);
-    pn_buffer_clear(delivery->tag);
+    pni_delivery_free_tag(delivery);
     pn_buffer_clear(delivery->bytes);
+    pni_delivery_release_shared(delivery);
     pn_record_clear(delivery->context);
     delivery->settled = true;
     pn_connection_t *conn = link->session->connection;
     assert(pn_refcount(delivery) == 0);
     if (pni_connection_live(conn)) {
-      pn_list_t *pool = link->session->connection->delivery_pool;
+      // Keep grown buffers for reuse up to the connection's budget
+      size_t capacity = pn_buffer_capacity(delivery->bytes);
+      if (capacity > PN_DELIVERY_BUFFER_SIZE &&
+          conn->delivery_pool_bytes + capacity > conn->delivery_pool_max) {
+        pn_buffer_shrink(delivery->bytes, PN_DELIVERY_BUFFER_SIZE);
+        conn->delivery_memory -= capacity - pn_buffer_capacity(delivery->bytes);
+        capacity = pn_buffer_capacity(delivery->bytes);
+      }
+      conn->delivery_pool_bytes += capacity;
       delivery->link = NULL;
-      pn_list_add(pool, delivery);
+      if (!conn->delivery_pool) conn->delivery_pool = pn_list(PN_OBJECT, 0);
+      pn_list_add(conn->delivery_pool, delivery);
       pooled = true;
       assert(pn_refcount(delivery) == 1);
     }
   }
 
   if (!pooled) {
+    if (link) link->session->connection->delivery_memory -= pn_buffer_capacity(delivery->bytes);
+    pni_delivery_release_shared(delivery);
     pn_free(delivery->context);
-    pn_buffer_free(delivery->tag);
+    pni_delivery_free_tag(delivery);
     pn_buffer_free(delivery->bytes);
     pn_disposition_finalize(&delivery->local);
     pn_disposition_finalize(&delivery->remote);
@@ -1487,8 +2023,8 @@ static void pn_delivery_finalize(void *object)
 
 static void pn_disposition_init(pn_disposition_t *ds)
 {
-  ds->data = pn_data(0);
-  ds->annotations = pn_data(0);
+  ds->data = NULL;
+  ds->annotations = NULL;
   pn_condition_init(&ds->condition);
 }
 
@@ -1515,6 +2051,45 @@ static void pn_disposition_clear(pn_disposition_t *ds)
 #define pn_delivery_compare NULL
 #define pn_delivery_inspect NULL
 
+// Allocate a delivery with its buffers, for pn_delivery() to set up
+static pn_delivery_t *pni_delivery_new(pn_connection_t *conn)
+{
+  static const pn_class_t clazz = PN_METACLASS(pn_delivery);
+  pni_object_pool_t *prev_pool = pni_object_pool_use(conn->object_pool);
+  pn_delivery_t *delivery = (pn_delivery_t *) pn_class_new(&clazz, sizeof(pn_delivery_t));
+  if (delivery) {
+    delivery->tag = delivery->tag_inline;
+    delivery->tag_size = 0;
+    delivery->bytes = pn_buffer(PN_DELIVERY_BUFFER_SIZE);
+    conn->delivery_memory += pn_buffer_capacity(delivery->bytes);
+    delivery->shared = pn_bytes(0, NULL);
+    delivery->shared_owner = NULL;
+    pn_disposition_init(&delivery->local);
+    pn_disposition_init(&delivery->remote);
+    delivery->context = pn_record();
+  }
+  pni_object_pool_use(prev_pool);
+  return delivery;
+}
+
+int pn_connection_reserve_deliveries(pn_connection_t *connection, size_t count)
+{
+  assert(connection);
+  if (!connection->delivery_pool) connection->delivery_pool = pn_list(PN_OBJECT, count);
+  while (pn_list_size(connection->delivery_pool) < count) {
+    pn_delivery_t *delivery = pni_delivery_new(connection);
+    if (!delivery) return PN_OUT_OF_MEMORY;
+    // As a settled delivery is kept, see pn_delivery_finalize()
+    delivery->link = NULL;
+    delivery->settled = true;
+    delivery->state.init = false;
+    connection->delivery_pool_bytes += pn_buffer_capacity(delivery->bytes);
+    pn_list_add(connection->delivery_pool, delivery);
+    pn_decref(delivery);
+  }
+  return 0;
+}
+
 pn_delivery_tag_t pn_dtag(const char *bytes, size_t size) {
   pn_delivery_tag_t dtag = {size, bytes};
   return dtag;
@@ -1523,26 +2098,34 @@ pn_delivery_tag_t pn_dtag(const char *bytes, size_t size) {
 pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
 {
   assert(link);
-  pn_list_t *pool = link->session->connection->delivery_pool;
-  pn_delivery_t *delivery = (pn_delivery_t *) pn_list_pop(pool);
+  // AMQP limits tags to 32 bytes, so only a misbehaving peer's tags need the heap
+  char *tag_copy = NULL;
+  if (tag.size > PN_DELIVERY_TAG_SIZE) {
+    tag_copy = (char *) malloc(tag.size);
+    if (!tag_copy) return NULL;
+  }
+  pn_connection_t *conn = link->session->connection;
+  pn_delivery_t *delivery = conn->delivery_pool ? (pn_delivery_t *) pn_list_pop(conn->delivery_pool) : NULL;
   if (!delivery) {
-    static const pn_class_t clazz = PN_METACLASS(pn_delivery);
-    delivery = (pn_delivery_t *) pn_class_new(&clazz, sizeof(pn_delivery_t));
-    if (!delivery) return NULL;
-    delivery->tag = pn_buffer(16);
-    delivery->bytes = pn_buffer(64);
-    pn_disposition_init(&delivery->local);
-    pn_disposition_init(&delivery->remote);
-    delivery->context = pn_record();
+    conn->delivery_pool_misses++;
+    delivery = pni_delivery_new(conn);
+    if (!delivery) {
+      free(tag_copy);
+      return NULL;
+    }
   } else {
     assert(!delivery->state.init);
+    conn->delivery_pool_hits++;
+    conn->delivery_pool_bytes -= pn_buffer_capacity(delivery->bytes);
   }
+  if (tag_copy) delivery->tag = tag_copy;
+  if (tag.size) memcpy(delivery->tag, tag.start, tag.size);
+  delivery->tag_size = tag.size;
   delivery->link = link;
   pn_incref(delivery->link);  // keep link until finalized
-  pn_buffer_clear(delivery->tag);
-  pn_buffer_append(delivery->tag, tag.start, tag.size);
   pn_disposition_clear(&delivery->local);
   pn_disposition_clear(&delivery->remote);
+  delivery->message_format = 0;
   delivery->updated = false;
   delivery->settled = false;
   LL_ADD(link, unsettled, delivery);
@@ -1553,8 +2136,12 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
   delivery->tpwork_next = NULL;
   delivery->tpwork_prev = NULL;
   delivery->tpwork = false;
+  delivery->tpwork_parked = false;
   pn_buffer_clear(delivery->bytes);
+  delivery->sent = 0;
   delivery->done = false;
+  delivery->kept = true;
+  delivery->resume = PNI_RESUME_NONE;
   pn_record_clear(delivery->context);
 
   // begin delivery state
@@ -1566,6 +2153,10 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
     link->current = delivery;
 
   link->unsettled_count++;
+  delivery->created = pn_i_now();
+  link->stats.deliveries++;
+  if (link->unsettled_count > link->stats.unsettled_max)
+    link->stats.unsettled_max = link->unsettled_count;
 
   pn_work_update(link->session->connection, delivery);
 
@@ -1575,6 +2166,19 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
   return delivery;
 }
 
+pn_delivery_t *pn_delivery_auto(pn_link_t *link)
+{
+  // The serial's significant bytes, least significant first, so each tag is unique and most are one byte
+  char tag[8];
+  size_t size = 0;
+  uint64_t serial = ++link->tag_serial;
+  do {
+    tag[size++] = (char) (serial & 0xff);
+    serial >>= 8;
+  } while (serial);
+  return pn_delivery(link, pn_dtag(tag, size));
+}
+
 bool pn_delivery_buffered(pn_delivery_t *delivery)
 {
   assert(delivery);
@@ -1584,7 +2188,7 @@ bool pn_delivery_buffered(pn_delivery_t *delivery)
     if (state->sent) {
       return false;
     } else {
-      return delivery->done || (pn_buffer_size(delivery->bytes) > 0);
+      return delivery->done || pni_delivery_outgoing(delivery).size > 0;
     }
   } else {
     return false;
@@ -1596,6 +2200,12 @@ int pn_link_unsettled(pn_link_t *link)
   return link->unsettled_count;
 }
 
+void pn_link_stats(pn_link_t *link, pn_link_stats_t *stats)
+{
+  assert(link);
+  *stats = link->stats;
+}
+
 pn_delivery_t *pn_unsettled_head(pn_link_t *link)
 {
   pn_delivery_t *d = link->unsettled_head;
@@ -1623,8 +2233,7 @@ bool pn_delivery_current(pn_delivery_t *delivery)
 void pn_delivery_dump(pn_delivery_t *d)
 {
   char tag[1024];
-  pn_bytes_t bytes = pn_buffer_bytes(d->tag);
-  pn_quote_data(tag, 1024, bytes.start, bytes.size);
+  pn_quote_data(tag, 1024, d->tag, d->tag_size);
   printf("{tag=%s, local.type=%" PRIu64 ", remote.type=%" PRIu64 ", local.settled=%u, "
          "remote.settled=%u, updated=%u, current=%u, writable=%u, readable=%u, "
          "work=%u}",
@@ -1660,6 +2269,7 @@ uint64_t pn_disposition_type(pn_disposition_t *disposition)
 pn_data_t *pn_disposition_data(pn_disposition_t *disposition)
 {
   assert(disposition);
+  if (!disposition->data) disposition->data = pn_data(0);
   return disposition->data;
 }
 
@@ -1714,6 +2324,7 @@ void pn_disposition_set_undeliverable(pn_disposition_t *disposition, bool undeli
 pn_data_t *pn_disposition_annotations(pn_disposition_t *disposition)
 {
   assert(disposition);
+  if (!disposition->annotations) disposition->annotations = pn_data(0);
   return disposition->annotations;
 }
 
@@ -1726,8 +2337,7 @@ pn_condition_t *pn_disposition_condition(pn_disposition_t *disposition)
 pn_delivery_tag_t pn_delivery_tag(pn_delivery_t *delivery)
 {
   if (delivery) {
-    pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
-    return pn_dtag(tag.start, tag.size);
+    return pn_dtag(delivery->tag, delivery->tag_size);
   } else {
     return pn_dtag(0, 0);
   }
@@ -1742,7 +2352,7 @@ pn_delivery_t *pn_link_current(pn_link_t *link)
 static void pni_advance_sender(pn_link_t *link)
 {
   link->current->done = true;
-  link->queued++;
+  pni_sender_queue(link, 1);
   link->credit--;
   link->session->outgoing_deliveries++;
   pni_add_tpwork(link->current);
@@ -1759,7 +2369,7 @@ static void pni_advance_receiver(pn_link_t *link)
   link->session->incoming_bytes -= pn_buffer_size(current->bytes);
   pn_buffer_clear(current->bytes);
 
-  if (!link->session->state.incoming_window) {
+  if (pni_session_window_low(link->session)) {
     pni_add_tpwork(current);
   }
 
@@ -1855,6 +2465,8 @@ void pn_delivery_settle(pn_delivery_t *delivery)
     }
 
     link->unsettled_count--;
+    link->stats.settled++;
+    link->stats.settle_time += pn_i_now() - delivery->created;
     delivery->local.settled = true;
     pni_add_tpwork(delivery);
     pn_work_update(delivery->link->session->connection, delivery);
@@ -1873,12 +2485,101 @@ ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n)
   pn_delivery_t *current = pn_link_current(sender);
   if (!current) return PN_EOS;
   if (!bytes || !n) return 0;
-  pn_buffer_append(current->bytes, bytes, n);
+  pni_delivery_unshare(current);
+  pni_delivery_append(current, bytes, n);
   sender->session->outgoing_bytes += n;
   pni_add_tpwork(current);
+  PNI_PROBE2(link_send, sender, n);
   return n;
 }
 
+ssize_t pn_link_send_shared(pn_link_t *sender, const char *bytes, size_t n, void *owner)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return PN_EOS;
+  if (!bytes || !n) return 0;
+  if (!owner || current->shared.size || pn_buffer_size(current->bytes)) {
+    // only a delivery with nothing else pending can refer to the bytes
+    return pn_link_send(sender, bytes, n);
+  }
+  current->shared = pn_bytes(n, bytes);
+  current->shared_owner = owner;
+  pn_incref(owner);
+  sender->session->outgoing_bytes += n;
+  pni_add_tpwork(current);
+  PNI_PROBE2(link_send, sender, n);
+  return n;
+}
+
+// Owner of a caller's buffer for pn_link_send_buffer()
+typedef struct {
+  void (*release)(void *context);
+  void *context;
+} pni_send_buffer_t;
+
+static void pni_send_buffer_finalize(void *object)
+{
+  pni_send_buffer_t *buf = (pni_send_buffer_t *) object;
+  buf->release(buf->context);
+}
+
+#define CID_pni_send_buffer CID_pn_object
+#define pni_send_buffer_initialize NULL
+#define pni_send_buffer_hashcode NULL
+#define pni_send_buffer_compare NULL
+#define pni_send_buffer_inspect NULL
+
+ssize_t pn_link_send_buffer(pn_link_t *sender, const char *bytes, size_t n,
+                            void (*release)(void *context), void *context)
+{
+  static const pn_class_t clazz = PN_CLASS(pni_send_buffer);
+  if (!release) return pn_link_send(sender, bytes, n);
+  pni_send_buffer_t *buf = (pni_send_buffer_t *) pn_class_new(&clazz, sizeof(pni_send_buffer_t));
+  if (!buf) {
+    release(context);
+    return PN_OUT_OF_MEMORY;
+  }
+  buf->release = release;
+  buf->context = context;
+  ssize_t sent = pn_link_send_shared(sender, bytes, n, buf);
+  pn_decref(buf);
+  return sent;
+}
+
+size_t pn_link_send_wanted(pn_link_t *sender)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return 0;
+  size_t frame = PN_LINK_STREAM_FRAME_SIZE;
+  pn_transport_t *transport = sender->session->connection->transport;
+  if (transport && transport->remote_max_frame && transport->remote_max_frame < frame)
+    frame = transport->remote_max_frame;
+  size_t bound = PN_LINK_STREAM_FRAMES * frame;
+  size_t pending = pni_delivery_outgoing(current).size;
+  return pending < bound ? bound - pending : 0;
+}
+
+ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return PN_EOS;
+  ssize_t n = pn_message_encoded_size(msg);
+  if (n < 0) return n;
+  pni_delivery_unshare(current);
+  size_t capacity = pn_buffer_capacity(current->bytes);
+  pn_rwbytes_t space = pn_buffer_reserve(current->bytes, n);
+  pni_delivery_grown(current, capacity);
+  if (!space.start) return PN_OUT_OF_MEMORY;
+  size_t size = space.size;
+  int err = pn_message_encode(msg, space.start, &size);
+  if (err) return err;
+  pn_buffer_extend(current->bytes, size);
+  sender->session->outgoing_bytes += size;
+  pni_add_tpwork(current);
+  PNI_PROBE2(link_send, sender, size);
+  return size;
+}
+
 int pn_link_drained(pn_link_t *link)
 {
   assert(link);
@@ -1905,11 +2606,13 @@ ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n)
 
   pn_delivery_t *delivery = receiver->current;
   if (delivery) {
-    size_t size = pn_buffer_get(delivery->bytes, 0, n, bytes);
+    size_t size = bytes ? pn_buffer_get(delivery->bytes, 0, n, bytes)
+      : pn_min(n, pn_buffer_size(delivery->bytes));
     pn_buffer_trim(delivery->bytes, size, 0);
+    PNI_PROBE3(link_recv, receiver, n, size);
     if (size) {
       receiver->session->incoming_bytes -= size;
-      if (!receiver->session->state.incoming_window) {
+      if (pni_session_window_low(receiver->session)) {
         pni_add_tpwork(delivery);
       }
       return size;
@@ -1958,6 +2661,16 @@ bool pn_link_draining(pn_link_t *receiver)
   return receiver->drain && (pn_link_credit(receiver) > pn_link_queued(receiver));
 }
 
+uint32_t pn_link_weight(pn_link_t *sender)
+{
+  return sender->weight;
+}
+
+void pn_link_set_weight(pn_link_t *sender, uint32_t weight)
+{
+  sender->weight = weight ? weight : 1;
+}
+
 uint64_t pn_link_max_message_size(pn_link_t *link)
 {
   return link->max_message_size;
@@ -2008,6 +2721,18 @@ bool pn_delivery_settled(pn_delivery_t *delivery)
   return delivery ? delivery->remote.settled : false;
 }
 
+uint32_t pn_delivery_message_format(pn_delivery_t *delivery)
+{
+  assert(delivery);
+  return delivery->message_format;
+}
+
+void pn_delivery_set_message_format(pn_delivery_t *delivery, uint32_t format)
+{
+  assert(delivery);
+  delivery->message_format = format;
+}
+
 bool pn_delivery_updated(pn_delivery_t *delivery)
 {
   return delivery ? delivery->updated : false;
@@ -2046,7 +2771,12 @@ bool pn_delivery_readable(pn_delivery_t *delivery)
 
 size_t pn_delivery_pending(pn_delivery_t *delivery)
 {
-  return pn_buffer_size(delivery->bytes);
+  return pni_delivery_outgoing(delivery).size;
+}
+
+pn_bytes_t pn_delivery_bytes(pn_delivery_t *delivery)
+{
+  return pni_delivery_outgoing(delivery);
 }
 
 bool pn_delivery_partial(pn_delivery_t *delivery)
@@ -2093,39 +2823,41 @@ pn_condition_t *pn_link_remote_condition(pn_link_t *link)
 
 bool pn_condition_is_set(pn_condition_t *condition)
 {
-  return condition && pn_string_get(condition->name);
+  return condition && condition->name && pn_string_get(condition->name);
 }
 
 void pn_condition_clear(pn_condition_t *condition)
 {
   assert(condition);
-  pn_string_clear(condition->name);
-  pn_string_clear(condition->description);
-  pn_data_clear(condition->info);
+  if (condition->name) pn_string_clear(condition->name);
+  if (condition->description) pn_string_clear(condition->description);
+  if (condition->info) pn_data_clear(condition->info);
 }
 
 const char *pn_condition_get_name(pn_condition_t *condition)
 {
   assert(condition);
-  return pn_string_get(condition->name);
+  return condition->name ? pn_string_get(condition->name) : NULL;
 }
 
 int pn_condition_set_name(pn_condition_t *condition, const char *name)
 {
   assert(condition);
-  return pn_string_set(condition->name, name);
+  if (!name && !condition->name) return 0;
+  return pn_string_set(pni_string_lazy(&condition->name), name);
 }
 
 const char *pn_condition_get_description(pn_condition_t *condition)
 {
   assert(condition);
-  return pn_string_get(condition->description);
+  return condition->description ? pn_string_get(condition->description) : NULL;
 }
 
 int pn_condition_set_description(pn_condition_t *condition, const char *description)
 {
   assert(condition);
-  return pn_string_set(condition->description, description);
+  if (!description && !condition->description) return 0;
+  return pn_string_set(pni_string_lazy(&condition->description), description);
 }
 
 int pn_condition_vformat(pn_condition_t *condition, const char *name, const char *fmt, va_list ap)
@@ -2156,7 +2888,7 @@ int pn_condition_format(pn_condition_t *condition, const char *name, const char
 pn_data_t *pn_condition_info(pn_condition_t *condition)
 {
   assert(condition);
-  return condition->info;
+  return pni_data_lazy(&condition->info);
 }
 
 bool pn_condition_is_redirect(pn_condition_t *condition)
@@ -2264,14 +2996,25 @@ pn_transport_t *pn_event_transport(pn_event_t *event)
   }
 }
 
+// Copy a condition part, creating dest only if there is something to copy
+static int pni_condition_string_copy(pn_string_t **dest, pn_string_t *src) {
+  if (!src || !pn_string_get(src)) return *dest ? pn_string_set(*dest, NULL) : 0;
+  return pn_string_copy(pni_string_lazy(dest), src);
+}
+
 int pn_condition_copy(pn_condition_t *dest, pn_condition_t *src) {
   assert(dest);
   assert(src);
   int err = 0;
   if (src != dest) {
-    int err = pn_string_copy(dest->name, src->name);
-    if (!err) err = pn_string_copy(dest->description, src->description);
-    if (!err) err = pn_data_copy(dest->info, src->info);
+    int err = pni_condition_string_copy(&dest->name, src->name);
+    if (!err) err = pni_condition_string_copy(&dest->description, src->description);
+    if (!err) {
+      if (src->info && pn_data_size(src->info))
+        err = pn_data_copy(pni_data_lazy(&dest->info), src->info);
+      else if (dest->info)
+        pn_data_clear(dest->info);
+    }
   }
   return err;
 }
@@ -23,12 +23,24 @@
 #include <proton/event.h>
 #include <proton/reactor.h>
 #include <assert.h>
+#include <stdlib.h>
+
+#include "probes.h"
 
 struct pn_collector_t {
   pn_list_t *pool;
+  pn_event_t **ring;        /* recycled events, NULL until first used, see pn_collector_set_ring() */
+  size_t ring_size;
+  size_t ring_first;        /* oldest ring event in use */
+  size_t ring_used;
   pn_event_t *head;
   pn_event_t *tail;
   pn_event_t *prev;         /* event returned by previous call to pn_collector_next() */
+  uint64_t unwanted;        /* bit per event type, see pn_collector_set_wanted() */
+  uint64_t unique;          /* bit per event type, see pn_collector_set_unique() */
+  pn_event_t **pending;     /* open-addressed set of queued unique events */
+  size_t pending_size;      /* power of two, or 0 */
+  size_t pending_count;
   bool freed;
 };
 
@@ -39,14 +51,25 @@ struct pn_event_t {
   pn_record_t *attachments;
   pn_event_t *next;
   pn_event_type_t type;
+  bool ringed;      // owned by the collector ring, recycled rather than freed
+  bool pending;     // in the collector's pending set until consumed
 };
 
 static void pn_collector_initialize(pn_collector_t *collector)
 {
   collector->pool = pn_list(PN_OBJECT, 0);
+  collector->ring = NULL;
+  collector->ring_size = 0;
+  collector->ring_first = 0;
+  collector->ring_used = 0;
   collector->head = NULL;
   collector->tail = NULL;
   collector->prev = NULL;
+  collector->unwanted = 0;
+  collector->unique = ((uint64_t)1 << PN_DELIVERY) | ((uint64_t)1 << PN_LINK_FLOW);
+  collector->pending = NULL;
+  collector->pending_size = 0;
+  collector->pending_count = 0;
   collector->freed = false;
 }
 
@@ -68,6 +91,11 @@ static void pn_collector_shrink(pn_collector_t *collector)
 static void pn_collector_finalize(pn_collector_t *collector)
 {
   pn_collector_drain(collector);
+  for (size_t i = 0; i < collector->ring_size; ++i) {
+    if (collector->ring[i]) pn_decref(collector->ring[i]);
+  }
+  free(collector->ring);
+  free(collector->pending);
   pn_decref(collector->pool);
 }
 
@@ -121,6 +149,185 @@ void pn_collector_release(pn_collector_t *collector)
 
 pn_event_t *pn_event(void);
 
+void pn_collector_set_ring(pn_collector_t *collector, size_t capacity)
+{
+  assert(collector);
+  assert(!collector->head && !collector->prev);
+  for (size_t i = 0; i < collector->ring_size; ++i) {
+    if (collector->ring[i]) pn_decref(collector->ring[i]);
+  }
+  free(collector->ring);
+  // Events are created as the ring first reaches them, a short-lived
+  // connection only pays for the events it queues at once
+  collector->ring = capacity ? (pn_event_t **) calloc(capacity, sizeof(pn_event_t *)) : NULL;
+  collector->ring_size = collector->ring ? capacity : 0;
+  collector->ring_first = 0;
+  collector->ring_used = 0;
+}
+
+int pn_collector_reserve(pn_collector_t *collector, size_t count)
+{
+  assert(collector);
+  for (size_t i = 0; i < collector->ring_size && count; ++i, --count) {
+    pn_event_t **slot = &collector->ring[(collector->ring_first + i) % collector->ring_size];
+    if (!*slot) {
+      if (!(*slot = pn_event())) return PN_OUT_OF_MEMORY;
+      (*slot)->ringed = true;
+    }
+  }
+  while (pn_list_size(collector->pool) < count) {
+    pn_event_t *event = pn_event();
+    if (!event) return PN_OUT_OF_MEMORY;
+    pn_list_add(collector->pool, event);
+    pn_decref(event);
+  }
+  return 0;
+}
+
+// Types beyond the mask are always wanted
+#define PNI_EVENT_MASK_BITS 64
+
+void pn_collector_set_wanted(pn_collector_t *collector, pn_event_type_t type, bool wanted)
+{
+  assert(collector);
+  if (type == PN_EVENT_NONE) {
+    collector->unwanted = wanted ? 0 : ~(uint64_t)0;
+  } else if ((unsigned) type < PNI_EVENT_MASK_BITS) {
+    uint64_t bit = (uint64_t)1 << type;
+    if (wanted) {
+      collector->unwanted &= ~bit;
+    } else {
+      collector->unwanted |= bit;
+    }
+  }
+}
+
+bool pn_collector_wanted(pn_collector_t *collector, pn_event_type_t type)
+{
+  assert(collector);
+  return (unsigned) type >= PNI_EVENT_MASK_BITS || !(collector->unwanted & ((uint64_t)1 << type));
+}
+
+void pn_collector_set_unique(pn_collector_t *collector, pn_event_type_t type, bool unique)
+{
+  assert(collector);
+  if (type == PN_EVENT_NONE) {
+    collector->unique = unique ? ~(uint64_t)0 : 0;
+  } else if ((unsigned) type < PNI_EVENT_MASK_BITS) {
+    uint64_t bit = (uint64_t)1 << type;
+    if (unique) {
+      collector->unique |= bit;
+    } else {
+      collector->unique &= ~bit;
+    }
+  }
+}
+
+bool pn_collector_unique(pn_collector_t *collector, pn_event_type_t type)
+{
+  assert(collector);
+  return (unsigned) type < PNI_EVENT_MASK_BITS && (collector->unique & ((uint64_t)1 << type));
+}
+
+// The pending set holds the queued events of unique types, keyed on
+// context and type, so a put can find an unconsumed duplicate anywhere
+// in the queue rather than only at the tail.  Linear probing, with
+// deletion by shifting back so no tombstones build up under churn.
+static inline size_t pni_pending_slot(pn_collector_t *collector, void *context, pn_event_type_t type)
+{
+  uintptr_t h = ((uintptr_t) context >> 3) ^ ((uintptr_t) type * 0x9E3779B1u);
+  h ^= h >> 16;
+  return h & (collector->pending_size - 1);
+}
+
+static bool pni_pending_find(pn_collector_t *collector, void *context, pn_event_type_t type)
+{
+  if (!collector->pending_count) return false;
+  size_t mask = collector->pending_size - 1;
+  for (size_t i = pni_pending_slot(collector, context, type);; i = (i + 1) & mask) {
+    pn_event_t *e = collector->pending[i];
+    if (!e) return false;
+    if (e->context == context && e->type == type) return true;
+  }
+}
+
+static void pni_pending_insert(pn_collector_t *collector, pn_event_t *event)
+{
+  size_t mask = collector->pending_size - 1;
+  size_t i = pni_pending_slot(collector, event->context, event->type);
+  while (collector->pending[i]) i = (i + 1) & mask;
+  collector->pending[i] = event;
+  collector->pending_count++;
+  event->pending = true;
+}
+
+// Keep the load at most one half, a failed resize leaves the event out
+// of the set and it is simply not de-duplicated against
+static void pni_pending_add(pn_collector_t *collector, pn_event_t *event)
+{
+  if (2 * (collector->pending_count + 1) > collector->pending_size) {
+    size_t size = collector->pending_size ? 2 * collector->pending_size : 16;
+    pn_event_t **old = collector->pending;
+    size_t old_size = collector->pending_size;
+    pn_event_t **table = (pn_event_t **) calloc(size, sizeof(pn_event_t *));
+    if (!table) return;
+    collector->pending = table;
+    collector->pending_size = size;
+    collector->pending_count = 0;
+    for (size_t i = 0; i < old_size; ++i) {
+      if (old[i]) pni_pending_insert(collector, old[i]);
+    }
+    free(old);
+  }
+  pni_pending_insert(collector, event);
+}
+
+static void pni_pending_remove(pn_collector_t *collector, pn_event_t *event)
+{
+  size_t mask = collector->pending_size - 1;
+  size_t i = pni_pending_slot(collector, event->context, event->type);
+  while (collector->pending[i] != event) i = (i + 1) & mask;
+  collector->pending[i] = NULL;
+  collector->pending_count--;
+  event->pending = false;
+  // Move back any later entry of the run that the hole would hide
+  for (size_t j = (i + 1) & mask; collector->pending[j]; j = (j + 1) & mask) {
+    pn_event_t *e = collector->pending[j];
+    size_t home = pni_pending_slot(collector, e->context, e->type);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      collector->pending[i] = e;
+      collector->pending[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+// Ring events are released in the order they were put, as they are consumed
+static void pni_ring_release(pn_collector_t *collector, pn_event_t *event)
+{
+  assert(event == collector->ring[collector->ring_first]);
+  const pn_class_t *clazz = event->clazz;
+  void *context = event->context;
+  event->type = PN_EVENT_NONE;
+  event->clazz = NULL;
+  event->context = NULL;
+  event->next = NULL;
+  if (event->attachments) pn_record_clear(event->attachments);
+  collector->ring_first = (collector->ring_first + 1) % collector->ring_size;
+  collector->ring_used--;
+  // last, the context finalizer may put new events
+  if (clazz && context) pn_class_decref(clazz, context);
+}
+
+static void pni_event_release(pn_collector_t *collector, pn_event_t *event)
+{
+  if (event->ringed) {
+    pni_ring_release(collector, event);
+  } else {
+    pn_decref(event);
+  }
+}
+
 pn_event_t *pn_collector_put(pn_collector_t *collector,
                              const pn_class_t *clazz, void *context,
                              pn_event_type_t type)
@@ -135,21 +342,40 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
     return NULL;
   }
 
+  if (collector->unwanted && !pn_collector_wanted(collector, type)) {
+    return NULL;
+  }
+
   pn_event_t *tail = collector->tail;
   if (tail && tail->type == type && tail->context == context) {
     return NULL;
   }
 
-  clazz = clazz->reify(context);
-
-  pn_event_t *event = (pn_event_t *) pn_list_pop(collector->pool);
-
-  if (!event) {
-    event = pn_event();
+  bool unique = collector->unique && pn_collector_unique(collector, type);
+  if (unique && pni_pending_find(collector, context, type)) {
+    return NULL;
   }
 
-  event->pool = collector->pool;
-  pn_incref(event->pool);
+  clazz = clazz->reify(context);
+  PNI_PROBE2(event_put, collector, type);
+
+  pn_event_t *event;
+  if (collector->ring_used < collector->ring_size) {
+    pn_event_t **slot = &collector->ring[(collector->ring_first + collector->ring_used) % collector->ring_size];
+    if (!*slot) {
+      *slot = pn_event();
+      (*slot)->ringed = true;
+    }
+    event = *slot;
+    collector->ring_used++;
+  } else {
+    event = (pn_event_t *) pn_list_pop(collector->pool);
+    if (!event) {
+      event = pn_event();
+    }
+    event->pool = collector->pool;
+    pn_incref(event->pool);
+  }
 
   if (tail) {
     tail->next = event;
@@ -163,6 +389,7 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
   event->context = context;
   event->type = type;
   pn_class_incref(clazz, event->context);
+  if (unique) pni_pending_add(collector, event);
 
   return event;
 }
@@ -180,6 +407,7 @@ static pn_event_t *pop_internal(pn_collector_t *collector) {
     if (!collector->head) {
       collector->tail = NULL;
     }
+    if (event->pending) pni_pending_remove(collector, event);
   }
   return event;
 }
@@ -187,14 +415,16 @@ static pn_event_t *pop_internal(pn_collector_t *collector) {
 bool pn_collector_pop(pn_collector_t *collector) {
   pn_event_t *event = pop_internal(collector);
   if (event) {
-    pn_decref(event);
+    pni_event_release(collector, event);
   }
   return event;
 }
 
 pn_event_t *pn_collector_next(pn_collector_t *collector) {
   if (collector->prev) {
-    pn_decref(collector->prev);
+    pn_event_t *prev = collector->prev;
+    collector->prev = NULL;
+    pni_event_release(collector, prev);
   }
   collector->prev = pop_internal(collector);
   return collector->prev;
@@ -217,7 +447,9 @@ static void pn_event_initialize(pn_event_t *event)
   event->clazz = NULL;
   event->context = NULL;
   event->next = NULL;
-  event->attachments = pn_record();
+  event->attachments = NULL;   // made on first use
+  event->ringed = false;
+  event->pending = false;
 }
 
 static void pn_event_finalize(pn_event_t *event) {
@@ -234,7 +466,7 @@ static void pn_event_finalize(pn_event_t *event) {
     event->clazz = NULL;
     event->context = NULL;
     event->next = NULL;
-    pn_record_clear(event->attachments);
+    if (event->attachments) pn_record_clear(event->attachments);
     pn_list_add(pool, event);
   } else {
     pn_decref(event->attachments);
@@ -295,6 +527,7 @@ void *pn_event_context(pn_event_t *event)
 pn_record_t *pn_event_attachments(pn_event_t *event)
 {
   assert(event);
+  if (!event->attachments) event->attachments = pn_record();
   return event->attachments;
 }
 
@@ -0,0 +1,67 @@
+#ifndef _PROTON_SRC_FORMAT_H
+#define _PROTON_SRC_FORMAT_H 1
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * pn_data_fill and pn_data_scan formats compiled to programs.
+ *
+ * pn_data_vfill and pn_data_vscan compile their format on every call. The
+ * engine's own formats are compiled when proton is built, see formats.h.py,
+ * and run with pni_data_fill_format and pni_data_scan_format.
+ *
+ * A fill program is the format with every lookahead resolved:
+ *  - '[' after 'T' is dropped, "@D" becomes PNI_OP_DESCRIBED_ARRAY and "*s" becomes '*'
+ *  - PNI_OP_EXIT_DESCRIBED follows the value of each described type
+ *  - '?' is followed by the number of ops in the value it guards, skipped
+ *    without touching the pn_data_t when the guard is false
+ * A scan program is the format with each '?' folded into the next code
+ * as PNI_OP_SCANARG.
+ */
+
+#include <proton/import_export.h>
+#include <proton/codec.h>
+
+#include <stdarg.h>
+
+enum {
+  PNI_OP_DESCRIBED_ARRAY = 'A',
+  PNI_OP_EXIT_DESCRIBED = 'X',
+  PNI_OP_SCANARG = 0x80
+};
+
+typedef struct pni_format_t {
+  const char *source;           /* The format compiled */
+  const uint8_t *ops;
+  size_t size;
+} pni_format_t;
+
+/* Compile fmt into at most max ops, return the number used or an error
+   code. max = 2*strlen(fmt) is always enough. */
+PN_EXTERN ssize_t pni_fill_compile(const char *fmt, uint8_t *ops, size_t max);
+/* max = strlen(fmt) is always enough. Errors are also set on error if not NULL. */
+PN_EXTERN ssize_t pni_scan_compile(const char *fmt, uint8_t *ops, size_t max, pn_error_t *error);
+
+PN_EXTERN int pni_data_vfill_format(pn_data_t *data, const pni_format_t *format, va_list ap);
+PN_EXTERN int pni_data_fill_format(pn_data_t *data, const pni_format_t *format, ...);
+PN_EXTERN int pni_data_vscan_format(pn_data_t *data, const pni_format_t *format, va_list ap);
+PN_EXTERN int pni_data_scan_format(pn_data_t *data, const pni_format_t *format, ...);
+
+#endif /* format.h */
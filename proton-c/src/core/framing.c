@@ -23,51 +23,12 @@
 #include <string.h>
 
 #include "framing.h"
-
-// TODO: These are near duplicates of code in codec.c - they should be
-// deduplicated.
-static inline void pn_i_write16(char *bytes, uint16_t value)
-{
-    bytes[0] = 0xFF & (value >> 8);
-    bytes[1] = 0xFF & (value     );
-}
-
-
-static inline void pn_i_write32(char *bytes, uint32_t value)
-{
-    bytes[0] = 0xFF & (value >> 24);
-    bytes[1] = 0xFF & (value >> 16);
-    bytes[2] = 0xFF & (value >>  8);
-    bytes[3] = 0xFF & (value      );
-}
-
-static inline uint16_t pn_i_read16(const char *bytes)
-{
-    uint16_t a = (uint8_t) bytes[0];
-    uint16_t b = (uint8_t) bytes[1];
-    uint16_t r = a << 8
-    | b;
-    return r;
-}
-
-static inline uint32_t pn_i_read32(const char *bytes)
-{
-    uint32_t a = (uint8_t) bytes[0];
-    uint32_t b = (uint8_t) bytes[1];
-    uint32_t c = (uint8_t) bytes[2];
-    uint32_t d = (uint8_t) bytes[3];
-    uint32_t r = a << 24
-    | b << 16
-    | c <<  8
-    | d;
-    return r;
-}
-
+#include "byteorder.h"
 
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max)
 {
   if (available < AMQP_HEADER_SIZE) return 0;
-  uint32_t size = pn_i_read32(&bytes[0]);
+  uint32_t size = pni_read32(&bytes[0]);
   if (max && size > max) return PN_ERR;
   if (available < size) return 0;
   unsigned int doff = 4 * (uint8_t)bytes[4];
@@ -76,7 +37,7 @@ ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, ui
   frame->size = size - doff;
   frame->ex_size = doff - AMQP_HEADER_SIZE;
   frame->type = bytes[5];
-  frame->channel = pn_i_read16(&bytes[6]);
+  frame->channel = pni_read16(&bytes[6]);
   frame->extended = bytes + AMQP_HEADER_SIZE;
   frame->payload = bytes + doff;
 
@@ -88,11 +49,11 @@ size_t pn_write_frame(char *bytes, size_t available, pn_frame_t frame)
   size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
   if (size <= available)
   {
-    pn_i_write32(&bytes[0], size);
+    pni_write32(&bytes[0], size);
     int doff = (frame.ex_size + AMQP_HEADER_SIZE - 1)/4 + 1;
     bytes[4] = doff;
     bytes[5] = frame.type;
-    pn_i_write16(&bytes[6], frame.channel);
+    pni_write16(&bytes[6], frame.channel);
 
     memmove(bytes + AMQP_HEADER_SIZE, frame.extended, frame.ex_size);
     memmove(bytes + 4*doff, frame.payload, frame.size);
@@ -101,3 +62,26 @@ size_t pn_write_frame(char *bytes, size_t available, pn_frame_t frame)
     return 0;
   }
 }
+
+size_t pni_write_frame_segments(char *bytes, size_t available, uint8_t type, uint16_t channel,
+                                const pn_bytes_t *segments, size_t count)
+{
+  size_t size = AMQP_HEADER_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    size += segments[i].size;
+  }
+  if (size > available) return 0;
+
+  pni_write32(&bytes[0], size);
+  bytes[4] = AMQP_HEADER_SIZE/4;
+  bytes[5] = type;
+  pni_write16(&bytes[6], channel);
+
+  char *pos = bytes + AMQP_HEADER_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    if (!segments[i].size) continue;
+    memmove(pos, segments[i].start, segments[i].size);
+    pos += segments[i].size;
+  }
+  return size;
+}
@@ -25,6 +25,7 @@
 #include <proton/import_export.h>
 #include <proton/type_compat.h>
 #include <proton/error.h>
+#include <proton/types.h>
 
 #define AMQP_HEADER_SIZE (8)
 #define AMQP_MIN_MAX_FRAME_SIZE ((uint32_t)512) // minimum allowable max-frame
@@ -41,4 +42,9 @@ typedef struct {
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max);
 size_t pn_write_frame(char *bytes, size_t size, pn_frame_t frame);
 
+// Write a frame with no extended header whose body is the concatenation of
+// count segments, so callers need not assemble the body in a scratch buffer.
+size_t pni_write_frame_segments(char *bytes, size_t size, uint8_t type, uint16_t channel,
+                                const pn_bytes_t *segments, size_t count);
+
 #endif /* framing.h */
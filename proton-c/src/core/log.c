@@ -20,9 +20,16 @@
 #include <proton/log.h>
 #include <proton/object.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "log_private.h"
 #include "util.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#define PNI_LOG_ASYNC
+#endif
+
 
 static void stderr_logger(const char *message) {
     fprintf(stderr, "%s\n", message);
@@ -32,6 +39,13 @@ static pn_logger_t logger = stderr_logger;
 static int enabled_env  = -1;   /* Set from environment variable. */
 static int enabled_call = -1;   /* set by pn_log_enable */
 
+/* Level of each subsystem, -1 until set by pn_log_set_level or PN_LOG_LEVEL */
+static int levels[PN_SUBSYSTEM_ALL] = { -1, -1, -1 };
+static bool env_read = false;
+
+static const char *subsystem_names[PN_SUBSYSTEM_ALL] = { "engine", "event", "messenger" };
+static const char *level_names[] = { "none", "error", "warning", "info", "debug", "trace" };
+
 void pn_log_enable(bool value) {
     enabled_call = value;
 }
@@ -48,9 +62,195 @@ void pn_log_logger(pn_logger_t new_logger) {
     if (!logger) pn_log_enable(false);
 }
 
+void pn_log_set_level(pn_log_subsystem_t subsystem, pn_log_level_t level) {
+    for (int i = 0; i < PN_SUBSYSTEM_ALL; ++i) {
+        if (subsystem == PN_SUBSYSTEM_ALL || subsystem == (pn_log_subsystem_t) i) levels[i] = level;
+    }
+}
+
+static int pni_log_level_named(const char *name, size_t len) {
+    for (size_t i = 0; i < sizeof(level_names)/sizeof(*level_names); ++i) {
+        if (strlen(level_names[i]) == len && !pn_strncasecmp(name, level_names[i], len)) return (int) i;
+    }
+    return -1;
+}
+
+/* PN_LOG_LEVEL is one level, or a comma separated list of subsystem=level */
+static void pni_log_read_env(void) {
+    env_read = true;
+    const char *v = getenv("PN_LOG_LEVEL");
+    while (v && *v) {
+        size_t len = strcspn(v, ",");
+        const char *eq = (const char *) memchr(v, '=', len);
+        if (!eq) {
+            int level = pni_log_level_named(v, len);
+            if (level >= 0) pn_log_set_level(PN_SUBSYSTEM_ALL, (pn_log_level_t) level);
+        } else {
+            int level = pni_log_level_named(eq + 1, len - (eq + 1 - v));
+            for (int i = 0; i < PN_SUBSYSTEM_ALL && level >= 0; ++i) {
+                if (strlen(subsystem_names[i]) == (size_t) (eq - v) && !pn_strncasecmp(v, subsystem_names[i], eq - v))
+                    levels[i] = level;
+            }
+        }
+        v += len;
+        if (*v) ++v;
+    }
+    if (pn_env_bool("PN_LOG_ASYNC")) pn_log_set_async(true);
+}
+
+int pni_log_level(pn_log_subsystem_t subsystem) {
+    if (!env_read) pni_log_read_env();
+    if (!logger) return PN_LEVEL_NONE;
+    int level = levels[subsystem];
+    if (level >= 0) return level;
+    return pn_log_enabled() ? PN_LEVEL_TRACE : PN_LEVEL_NONE;
+}
+
+bool pn_log_level_enabled(pn_log_subsystem_t subsystem, pn_log_level_t level) {
+    return (unsigned) subsystem < PN_SUBSYSTEM_ALL && pni_log_level(subsystem) >= (int) level;
+}
+
+/* A logger removed while logging is forced on still leaves messages somewhere */
+static void pni_log_emit(const char *message) {
+    pn_logger_t l = logger;
+    (l ? l : stderr_logger)(message);
+}
+
+#define PNI_LOG_LINE 512
+
+#ifdef PNI_LOG_ASYNC
+
+#define PNI_LOG_SLOTS 1024
+
+/* Formatted messages waiting for the writer thread */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t more;        /* signalled to the writer */
+    pthread_cond_t drained;     /* signalled by the writer when it has nothing left */
+    pthread_t thread;
+    char (*ring)[PNI_LOG_LINE];
+    size_t first;
+    size_t used;
+    size_t dropped;
+    bool running;
+    bool stopping;
+    bool writing;
+    bool at_exit;
+} async = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void *pni_log_writer(void *arg) {
+    char line[PNI_LOG_LINE];
+    pthread_mutex_lock(&async.lock);
+    for (;;) {
+        if (!async.used && !async.dropped) {
+            async.writing = false;
+            pthread_cond_broadcast(&async.drained);
+            if (async.stopping) break;
+            pthread_cond_wait(&async.more, &async.lock);
+            continue;
+        }
+        async.writing = true;
+        size_t dropped = async.dropped;
+        async.dropped = 0;
+        bool have = async.used > 0;
+        if (have) {
+            memcpy(line, async.ring[async.first], PNI_LOG_LINE);
+            async.first = (async.first + 1) % PNI_LOG_SLOTS;
+            async.used--;
+        }
+        pthread_mutex_unlock(&async.lock);
+        /* The logger runs unlocked, a slow one only fills the ring */
+        if (dropped) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "%lu log messages dropped", (unsigned long) dropped);
+            pni_log_emit(msg);
+        }
+        if (have) pni_log_emit(line);
+        pthread_mutex_lock(&async.lock);
+    }
+    pthread_mutex_unlock(&async.lock);
+    return NULL;
+}
+
+/* Queue a message for the writer, false if it is not running */
+static bool pni_log_queue(const char *line) {
+    pthread_mutex_lock(&async.lock);
+    bool running = async.running;
+    if (running) {
+        if (async.used == PNI_LOG_SLOTS) {
+            async.dropped++;
+        } else {
+            char *slot = async.ring[(async.first + async.used) % PNI_LOG_SLOTS];
+            strncpy(slot, line, PNI_LOG_LINE - 1);
+            slot[PNI_LOG_LINE - 1] = '\0';
+            async.used++;
+            pthread_cond_signal(&async.more);
+        }
+    }
+    pthread_mutex_unlock(&async.lock);
+    return running;
+}
+
+static void pni_log_stop(void) {
+    pn_log_set_async(false);
+}
+
+void pn_log_set_async(bool on) {
+    pthread_mutex_lock(&async.lock);
+    if (on && !async.running) {
+        if (!async.ring) async.ring = (char (*)[PNI_LOG_LINE]) malloc(PNI_LOG_SLOTS * PNI_LOG_LINE);
+        async.stopping = false;
+        if (async.ring && !pthread_create(&async.thread, NULL, pni_log_writer, NULL)) {
+            async.running = true;
+            if (!async.at_exit) async.at_exit = !atexit(pni_log_stop);
+        }
+    } else if (!on && async.running) {
+        /* Later messages are written at once, the writer finishes the queue */
+        async.running = false;
+        async.stopping = true;
+        pthread_cond_signal(&async.more);
+        pthread_mutex_unlock(&async.lock);
+        pthread_join(async.thread, NULL);
+        return;
+    }
+    pthread_mutex_unlock(&async.lock);
+}
+
+void pn_log_flush(void) {
+    pthread_mutex_lock(&async.lock);
+    while (async.running && (async.used || async.dropped || async.writing)) {
+        pthread_cond_wait(&async.drained, &async.lock);
+    }
+    pthread_mutex_unlock(&async.lock);
+}
+
+#else
+
+void pn_log_set_async(bool on) {}
+void pn_log_flush(void) {}
+
+#endif
+
 void pn_vlogf_impl(const char *fmt, va_list ap) {
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
+    if (!env_read) pni_log_read_env();
+    char line[PNI_LOG_LINE];
+    va_list copy;
+    va_copy(copy, ap);
+    int n = vsnprintf(line, sizeof(line), fmt, copy);
+    va_end(copy);
+#ifdef PNI_LOG_ASYNC
+    if (pni_log_queue(line)) return;
+#endif
+    if (n >= (int) sizeof(line)) {
+        char *full = (char *) malloc(n + 1);
+        if (full) {
+            vsnprintf(full, n + 1, fmt, ap);
+            pni_log_emit(full);
+            free(full);
+            return;
+        }
+    }
+    pni_log_emit(line);
 }
 
 /**@internal
@@ -67,4 +267,3 @@ void pn_logf_impl(const char *fmt, ...) {
   pn_vlogf_impl(fmt, ap);
   va_end(ap);
 }
-
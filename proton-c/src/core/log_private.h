@@ -41,9 +41,19 @@
             pn_vlogf_impl(fmt, ap);             \
     } while(0)
 
+/** Log a printf style message from a subsystem at a level */
+#define pn_log(subsystem, level, ...)                   \
+    do {                                                \
+        if (pni_log_level(subsystem) >= (level))        \
+            pn_logf_impl(__VA_ARGS__);                  \
+    } while(0)
+
 /** Return true if logging is enabled. */
 PN_EXTERN bool pn_log_enabled(void);
 
+/** The level a subsystem logs at, see pn_log_set_level */
+PN_EXTERN int pni_log_level(pn_log_subsystem_t subsystem);
+
 /**@internal*/
 PN_EXTERN void pn_logf_impl(const char* fmt, ...);
 /**@internal*/
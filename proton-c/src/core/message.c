@@ -21,6 +21,12 @@
 
 #include "platform/platform_fmt.h"
 
+#include "buffer.h"
+#include "config.h"
+#include "data.h"
+#include "decoder.h"
+#include "encodings.h"
+#include "formats.h"
 #include "max_align.h"
 #include "protocol.h"
 #include "util.h"
@@ -37,6 +43,14 @@
 
 // message
 
+/* A section kept in its received encoding, see pn_message_decode */
+typedef struct {
+  size_t start;     /* offset of the section in the raw buffer */
+  size_t size;      /* encoded size of the section, 0 if not pending */
+  size_t value;     /* offset of the section value after its descriptor */
+  uint64_t code;    /* section descriptor */
+} pni_section_t;
+
 struct pn_message_t {
   pn_timestamp_t expiry_time;
   pn_timestamp_t creation_time;
@@ -57,6 +71,12 @@ struct pn_message_t {
   pn_data_t *properties;
   pn_data_t *body;
 
+  pn_buffer_t *raw;
+  pni_section_t raw_instructions;
+  pni_section_t raw_annotations;
+  pni_section_t raw_properties;
+  pni_section_t raw_body;
+
   pn_error_t *error;
 
   pn_sequence_t group_sequence;
@@ -68,6 +88,7 @@ struct pn_message_t {
   bool durable;
   bool first_acquirer;
   bool inferred;
+  bool strings_set;   /* a property string may be non-null, see pn_message_clear */
 };
 
 void pn_message_finalize(void *obj)
@@ -88,12 +109,47 @@ void pn_message_finalize(void *obj)
   pn_data_free(msg->annotations);
   pn_data_free(msg->properties);
   pn_data_free(msg->body);
+  pn_buffer_free(msg->raw);
   pn_error_free(msg->error);
 }
 
+static const pni_section_t pni_no_section = {0, 0, 0, 0};
+
+/* Decode a pending section into data, after which data owns the content */
+static int pni_section_decode(pn_message_t *msg, pni_section_t *section, pn_data_t *data)
+{
+  if (!section->size) return 0;
+  pn_bytes_t raw = pn_buffer_bytes(msg->raw);
+  const char *value = raw.start + section->value;
+  size_t size = section->start + section->size - section->value;
+  *section = pni_no_section;
+  pn_data_clear(data);
+  ssize_t used = pn_data_decode(data, value, size);
+  pn_data_rewind(data);
+  if (used < 0) {
+    int err = pn_error_format(msg->error, used, "data error: %s",
+                              pn_error_text(pn_data_error(data)));
+    pn_data_clear(data);
+    return err;
+  }
+  return 0;
+}
+
+static int pni_message_expand(pn_message_t *msg)
+{
+  int err = pni_section_decode(msg, &msg->raw_instructions, msg->instructions);
+  if (err) return err;
+  err = pni_section_decode(msg, &msg->raw_annotations, msg->annotations);
+  if (err) return err;
+  err = pni_section_decode(msg, &msg->raw_properties, msg->properties);
+  if (err) return err;
+  return pni_section_decode(msg, &msg->raw_body, msg->body);
+}
+
 int pn_message_inspect(void *obj, pn_string_t *dst)
 {
   pn_message_t *msg = (pn_message_t *) obj;
+  pni_message_expand(msg);
   int err = pn_string_addf(dst, "Message{");
   if (err) return err;
 
@@ -329,11 +385,18 @@ static pn_message_t *pni_message_new(size_t size)
   msg->reply_to_group_id = pn_string(NULL);
 
   msg->inferred = false;
+  msg->strings_set = false;
   msg->data = pn_data(16);
+  pni_data_trim_nulls(msg->data);
   msg->instructions = pn_data(16);
   msg->annotations = pn_data(16);
   msg->properties = pn_data(16);
   msg->body = pn_data(16);
+  msg->raw = pn_buffer(0);
+  msg->raw_instructions = pni_no_section;
+  msg->raw_annotations = pni_no_section;
+  msg->raw_properties = pni_no_section;
+  msg->raw_body = pni_no_section;
 
   msg->error = pn_error();
   return msg;
@@ -370,24 +433,34 @@ void pn_message_clear(pn_message_t *msg)
   msg->first_acquirer = false;
   msg->delivery_count = 0;
   pn_data_clear(msg->id);
-  pn_string_clear(msg->user_id);
-  pn_string_clear(msg->address);
-  pn_string_clear(msg->subject);
-  pn_string_clear(msg->reply_to);
   pn_data_clear(msg->correlation_id);
-  pn_string_clear(msg->content_type);
-  pn_string_clear(msg->content_encoding);
+  /* Messages are cleared for reuse on every decode, most never set a
+     property string so skip the eight string resets when none was set */
+  if (msg->strings_set) {
+    pn_string_clear(msg->user_id);
+    pn_string_clear(msg->address);
+    pn_string_clear(msg->subject);
+    pn_string_clear(msg->reply_to);
+    pn_string_clear(msg->content_type);
+    pn_string_clear(msg->content_encoding);
+    pn_string_clear(msg->group_id);
+    pn_string_clear(msg->reply_to_group_id);
+    msg->strings_set = false;
+  }
   msg->expiry_time = 0;
   msg->creation_time = 0;
-  pn_string_clear(msg->group_id);
   msg->group_sequence = 0;
-  pn_string_clear(msg->reply_to_group_id);
   msg->inferred = false;
   pn_data_clear(msg->data);
   pn_data_clear(msg->instructions);
   pn_data_clear(msg->annotations);
   pn_data_clear(msg->properties);
   pn_data_clear(msg->body);
+  pn_buffer_clear(msg->raw);
+  msg->raw_instructions = pni_no_section;
+  msg->raw_annotations = pni_no_section;
+  msg->raw_properties = pni_no_section;
+  msg->raw_body = pni_no_section;
 }
 
 int pn_message_errno(pn_message_t *msg)
@@ -511,6 +584,7 @@ pn_bytes_t pn_message_get_user_id(pn_message_t *msg)
 int pn_message_set_user_id(pn_message_t *msg, pn_bytes_t user_id)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set_bytes(msg->user_id, user_id);
 }
 
@@ -522,6 +596,7 @@ const char *pn_message_get_address(pn_message_t *msg)
 int pn_message_set_address(pn_message_t *msg, const char *address)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->address, address);
 }
 
@@ -533,6 +608,7 @@ const char *pn_message_get_subject(pn_message_t *msg)
 int pn_message_set_subject(pn_message_t *msg, const char *subject)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->subject, subject);
 }
 
@@ -544,6 +620,7 @@ const char *pn_message_get_reply_to(pn_message_t *msg)
 int pn_message_set_reply_to(pn_message_t *msg, const char *reply_to)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->reply_to, reply_to);
 }
 
@@ -572,6 +649,7 @@ const char *pn_message_get_content_type(pn_message_t *msg)
 int pn_message_set_content_type(pn_message_t *msg, const char *type)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->content_type, type);
 }
 
@@ -583,6 +661,7 @@ const char *pn_message_get_content_encoding(pn_message_t *msg)
 int pn_message_set_content_encoding(pn_message_t *msg, const char *encoding)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->content_encoding, encoding);
 }
 
@@ -618,6 +697,7 @@ const char *pn_message_get_group_id(pn_message_t *msg)
 int pn_message_set_group_id(pn_message_t *msg, const char *group_id)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->group_id, group_id);
 }
 
@@ -641,18 +721,85 @@ const char *pn_message_get_reply_to_group_id(pn_message_t *msg)
 int pn_message_set_reply_to_group_id(pn_message_t *msg, const char *reply_to_group_id)
 {
   assert(msg);
+  msg->strings_set = true;
   return pn_string_set(msg->reply_to_group_id, reply_to_group_id);
 }
 
+/* Annotations, application properties and the body are only located here;
+   they are copied still encoded and decoded the first time they are
+   accessed, so a message that is just forwarded never decodes them. */
+static bool pni_section_skipped(uint64_t code, const uint64_t *skip, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (skip[i] == code) return true;
+  }
+  return false;
+}
+
 int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
+{
+  return pn_message_decode_partial(msg, bytes, size, NULL, 0);
+}
+
+int pn_message_decode_partial(pn_message_t *msg, const char *bytes, size_t size,
+                              const uint64_t *skip, size_t count)
 {
   assert(msg && bytes && size);
 
   pn_message_clear(msg);
 
   while (size) {
+    uint64_t code;
+    size_t value;
+    ssize_t extent = pni_section_scan(bytes, size, &code, &value);
+    if (extent < 0)
+      return pn_error_format(msg->error, extent, "data error: %s",
+                             extent == PN_UNDERFLOW ? "not enough data to decode" : "invalid encoding");
+
+    if (pni_section_skipped(code, skip, count)) {
+      size -= extent;
+      bytes += extent;
+      continue;
+    }
+
+    pni_section_t *section = NULL;
+    switch (code) {
+    case DELIVERY_ANNOTATIONS:
+      section = &msg->raw_instructions;
+      break;
+    case MESSAGE_ANNOTATIONS:
+      section = &msg->raw_annotations;
+      break;
+    case APPLICATION_PROPERTIES:
+      section = &msg->raw_properties;
+      break;
+    case DATA:
+    case AMQP_SEQUENCE:
+    case AMQP_VALUE:
+      section = &msg->raw_body;
+      break;
+    }
+
+    if (section) {
+      section->start = pn_buffer_size(msg->raw);
+      section->size = extent;
+      section->value = section->start + value;
+      section->code = code;
+      int err = pn_buffer_append(msg->raw, bytes, extent);
+      if (err) return pn_error_format(msg->error, err, "error saving section");
+      size -= extent;
+      bytes += extent;
+      continue;
+    }
+
+    if (code == FOOTER) {
+      size -= extent;
+      bytes += extent;
+      continue;
+    }
+
     pn_data_clear(msg->data);
-    ssize_t used = pn_data_decode(msg->data, bytes, size);
+    ssize_t used = pn_data_decode_partial(msg->data, bytes, extent, skip, count, -1);
     if (used < 0)
         return pn_error_format(msg->error, used, "data error: %s",
                                pn_error_text(pn_data_error(msg->data)));
@@ -660,7 +807,7 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
     bytes += used;
     bool scanned;
     uint64_t desc;
-    int err = pn_data_scan(msg->data, "D?L.", &scanned, &desc);
+    int err = pni_data_scan_format(msg->data, &PNI_SCAN_SECTION, &scanned, &desc);
     if (err) return pn_error_format(msg->error, err, "data error: %s",
                                     pn_error_text(pn_data_error(msg->data)));
     if (!scanned) {
@@ -674,7 +821,7 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
 
     switch (desc) {
     case HEADER:
-      err = pn_data_scan(msg->data, "D.[oBIoI]", &msg->durable, &msg->priority,
+      err = pni_data_scan_format(msg->data, &PNI_SCAN_HEADER, &msg->durable, &msg->priority,
                    &msg->ttl, &msg->first_acquirer, &msg->delivery_count);
       if (err) return pn_error_format(msg->error, err, "data error: %s",
                                       pn_error_text(pn_data_error(msg->data)));
@@ -685,13 +832,14 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
           group_id, reply_to_group_id;
         pn_data_clear(msg->id);
         pn_data_clear(msg->correlation_id);
-        err = pn_data_scan(msg->data, "D.[CzSSSCssttSIS]", msg->id,
+        err = pni_data_scan_format(msg->data, &PNI_SCAN_PROPERTIES, msg->id,
                            &user_id, &address, &subject, &reply_to,
                            msg->correlation_id, &ctype, &cencoding,
                            &msg->expiry_time, &msg->creation_time, &group_id,
                            &msg->group_sequence, &reply_to_group_id);
         if (err) return pn_error_format(msg->error, err, "data error: %s",
                                         pn_error_text(pn_data_error(msg->data)));
+        msg->strings_set = true;
         err = pn_string_set_bytes(msg->user_id, user_id);
         if (err) return pn_error_format(msg->error, err, "error setting user_id");
         err = pn_string_setn(msg->address, address.start, address.size);
@@ -712,31 +860,8 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
         if (err) return pn_error_format(msg->error, err, "error setting reply_to_group_id");
       }
       break;
-    case DELIVERY_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->instructions, msg->data);
-      if (err) return err;
-      break;
-    case MESSAGE_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->annotations, msg->data);
-      if (err) return err;
-      break;
-    case APPLICATION_PROPERTIES:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->properties, msg->data);
-      if (err) return err;
-      break;
-    case DATA:
-    case AMQP_SEQUENCE:
-    case AMQP_VALUE:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
-      break;
-    case FOOTER:
-      break;
     default:
+      msg->raw_body = pni_no_section;
       err = pn_data_copy(msg->body, msg->data);
       if (err) return err;
       break;
@@ -747,136 +872,342 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
   return 0;
 }
 
-int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+/* The sections of a message in encoding order */
+typedef enum {
+  PNI_HEADER_SECTION,
+  PNI_INSTRUCTIONS_SECTION,
+  PNI_ANNOTATIONS_SECTION,
+  PNI_PROPERTIES_SECTION,
+  PNI_APPLICATION_PROPERTIES_SECTION,
+  PNI_BODY_SECTION,
+  PNI_SECTION_COUNT
+} pni_section_id_t;
+
+static uint64_t pni_message_body_code(pn_message_t *msg, pn_type_t body_type)
 {
-  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
-  pn_data_clear(msg->data);
-  pn_message_data(msg, msg->data);
-  size_t remaining = *size;
-  ssize_t encoded = pn_data_encode(msg->data, bytes, remaining);
-  if (encoded < 0) {
-    if (encoded == PN_OVERFLOW) {
-      return encoded;
-    } else {
-      return pn_error_format(msg->error, encoded, "data error: %s",
-                             pn_error_text(pn_data_error(msg->data)));
-    }
+  if (!msg->inferred) return AMQP_VALUE;
+  switch (body_type) {
+  case PN_BINARY: return DATA;
+  case PN_LIST: return AMQP_SEQUENCE;
+  default: return AMQP_VALUE;
   }
-  bytes += encoded;
-  remaining -= encoded;
-  *size -= remaining;
-  pn_data_clear(msg->data);
-  return 0;
 }
 
-int pn_message_data(pn_message_t *msg, pn_data_t *data)
+/* A raw body can only be sent as is if it would be encoded the same way */
+static bool pni_message_body_verbatim(pn_message_t *msg)
 {
-  pn_data_clear(data);
-  int err = pn_data_fill(data, "DL[oB?IoI]", HEADER, msg->durable,
-                         msg->priority, msg->ttl, msg->ttl, msg->first_acquirer,
-                         msg->delivery_count);
+  pn_type_t body_type;
+  switch ((uint8_t) pn_buffer_bytes(msg->raw).start[msg->raw_body.value]) {
+  case PNE_VBIN8:
+  case PNE_VBIN32:
+    body_type = PN_BINARY;
+    break;
+  case PNE_LIST0:
+  case PNE_LIST8:
+  case PNE_LIST32:
+    body_type = PN_LIST;
+    break;
+  default:
+    body_type = PN_NULL;
+    break;
+  }
+  return msg->raw_body.code == pni_message_body_code(msg, body_type);
+}
+
+static pni_section_t *pni_message_raw_section(pn_message_t *msg, pni_section_id_t id)
+{
+  switch (id) {
+  case PNI_INSTRUCTIONS_SECTION: return &msg->raw_instructions;
+  case PNI_ANNOTATIONS_SECTION: return &msg->raw_annotations;
+  case PNI_APPLICATION_PROPERTIES_SECTION: return &msg->raw_properties;
+  case PNI_BODY_SECTION: return &msg->raw_body;
+  default: return NULL;
+  }
+}
+
+static int pni_message_data_map(pn_message_t *msg, pn_data_t *data, uint64_t code, pn_data_t *map)
+{
+  if (!pn_data_size(map)) return 0;
+  pn_data_put_described(data);
+  pn_data_enter(data);
+  pn_data_put_ulong(data, code);
+  pn_data_rewind(map);
+  int err = pn_data_append(data, map);
   if (err)
     return pn_error_format(msg->error, err, "data error: %s",
                            pn_error_text(pn_data_error(data)));
+  pn_data_exit(data);
+  return 0;
+}
 
-  if (pn_data_size(msg->instructions)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, DELIVERY_ANNOTATIONS);
-    pn_data_rewind(msg->instructions);
-    err = pn_data_append(data, msg->instructions);
+/* Append one section to data, decoding it first if it is still raw */
+static int pni_message_data_section(pn_message_t *msg, pn_data_t *data, pni_section_id_t id)
+{
+  int err;
+  switch (id) {
+  case PNI_HEADER_SECTION:
+    err = pni_data_fill_format(data, &PNI_FILL_HEADER, HEADER, msg->durable,
+                       msg->priority, msg->ttl, msg->ttl, msg->first_acquirer,
+                       msg->delivery_count);
     if (err)
       return pn_error_format(msg->error, err, "data error: %s",
                              pn_error_text(pn_data_error(data)));
-    pn_data_exit(data);
-  }
-
-  if (pn_data_size(msg->annotations)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, MESSAGE_ANNOTATIONS);
-    pn_data_rewind(msg->annotations);
-    err = pn_data_append(data, msg->annotations);
+    return 0;
+  case PNI_INSTRUCTIONS_SECTION:
+    err = pni_section_decode(msg, &msg->raw_instructions, msg->instructions);
+    if (err) return err;
+    return pni_message_data_map(msg, data, DELIVERY_ANNOTATIONS, msg->instructions);
+  case PNI_ANNOTATIONS_SECTION:
+    err = pni_section_decode(msg, &msg->raw_annotations, msg->annotations);
+    if (err) return err;
+    return pni_message_data_map(msg, data, MESSAGE_ANNOTATIONS, msg->annotations);
+  case PNI_PROPERTIES_SECTION:
+    err = pni_data_fill_format(data, &PNI_FILL_PROPERTIES, PROPERTIES,
+                       msg->id,
+                       pn_string_size(msg->user_id), pn_string_get(msg->user_id),
+                       pn_string_get(msg->address),
+                       pn_string_get(msg->subject),
+                       pn_string_get(msg->reply_to),
+                       msg->correlation_id,
+                       pn_string_get(msg->content_type),
+                       pn_string_get(msg->content_encoding),
+                       msg->expiry_time,
+                       msg->creation_time,
+                       pn_string_get(msg->group_id),
+                       msg->group_sequence,
+                       pn_string_get(msg->reply_to_group_id));
     if (err)
       return pn_error_format(msg->error, err, "data error: %s",
                              pn_error_text(pn_data_error(data)));
-    pn_data_exit(data);
-  }
-
-  err = pn_data_fill(data, "DL[CzSSSCssttSIS]", PROPERTIES,
-                     msg->id,
-                     pn_string_size(msg->user_id), pn_string_get(msg->user_id),
-                     pn_string_get(msg->address),
-                     pn_string_get(msg->subject),
-                     pn_string_get(msg->reply_to),
-                     msg->correlation_id,
-                     pn_string_get(msg->content_type),
-                     pn_string_get(msg->content_encoding),
-                     msg->expiry_time,
-                     msg->creation_time,
-                     pn_string_get(msg->group_id),
-                     msg->group_sequence,
-                     pn_string_get(msg->reply_to_group_id));
-  if (err)
-    return pn_error_format(msg->error, err, "data error: %s",
-                           pn_error_text(pn_data_error(data)));
+    return 0;
+  case PNI_APPLICATION_PROPERTIES_SECTION:
+    err = pni_section_decode(msg, &msg->raw_properties, msg->properties);
+    if (err) return err;
+    return pni_message_data_map(msg, data, APPLICATION_PROPERTIES, msg->properties);
+  case PNI_BODY_SECTION:
+    err = pni_section_decode(msg, &msg->raw_body, msg->body);
+    if (err) return err;
+    if (pn_data_size(msg->body)) {
+      pn_data_rewind(msg->body);
+      pn_data_next(msg->body);
+      pn_type_t body_type = pn_data_type(msg->body);
+      pn_data_rewind(msg->body);
+
+      pn_data_put_described(data);
+      pn_data_enter(data);
+      pn_data_put_ulong(data, pni_message_body_code(msg, body_type));
+      pn_data_append(data, msg->body);
+    }
+    return 0;
+  default:
+    return 0;
+  }
+}
 
-  if (pn_data_size(msg->properties)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, APPLICATION_PROPERTIES);
-    pn_data_rewind(msg->properties);
-    err = pn_data_append(data, msg->properties);
-    if (err)
-      return pn_error_format(msg->error, err, "data error: %s",
-                             pn_data_error(data));
-    pn_data_exit(data);
+/* What one section encodes to: raw bytes that are sent as is, or content
+   to be encoded behind the descriptor code if it is not zero. Sections held
+   in their own pn_data_t are encoded straight from it behind a hand written
+   descriptor rather than being appended to msg->data first. */
+static int pni_message_section(pn_message_t *msg, pni_section_id_t id, pn_bytes_t *raw,
+                               pn_data_t **content, uint64_t *code)
+{
+  pni_section_t *section = pni_message_raw_section(msg, id);
+  *raw = pn_bytes(0, NULL);
+  *content = NULL;
+  *code = 0;
+  if (section && section->size && (id != PNI_BODY_SECTION || pni_message_body_verbatim(msg))) {
+    *raw = pn_bytes(section->size, pn_buffer_bytes(msg->raw).start + section->start);
+    return 0;
   }
 
-  if (pn_data_size(msg->body)) {
-    pn_data_rewind(msg->body);
-    pn_data_next(msg->body);
-    pn_type_t body_type = pn_data_type(msg->body);
-    pn_data_rewind(msg->body);
-
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    if (msg->inferred) {
-      switch (body_type) {
-      case PN_BINARY:
-        pn_data_put_ulong(data, DATA);
-        break;
-      case PN_LIST:
-        pn_data_put_ulong(data, AMQP_SEQUENCE);
-        break;
-      default:
-        pn_data_put_ulong(data, AMQP_VALUE);
-        break;
-      }
-    } else {
-      pn_data_put_ulong(data, AMQP_VALUE);
+  int err = 0;
+  switch (id) {
+  case PNI_INSTRUCTIONS_SECTION:
+    err = pni_section_decode(msg, &msg->raw_instructions, msg->instructions);
+    *code = DELIVERY_ANNOTATIONS;
+    *content = msg->instructions;
+    break;
+  case PNI_ANNOTATIONS_SECTION:
+    err = pni_section_decode(msg, &msg->raw_annotations, msg->annotations);
+    *code = MESSAGE_ANNOTATIONS;
+    *content = msg->annotations;
+    break;
+  case PNI_APPLICATION_PROPERTIES_SECTION:
+    err = pni_section_decode(msg, &msg->raw_properties, msg->properties);
+    *code = APPLICATION_PROPERTIES;
+    *content = msg->properties;
+    break;
+  case PNI_BODY_SECTION:
+    err = pni_section_decode(msg, &msg->raw_body, msg->body);
+    if (!err && pn_data_size(msg->body)) {
+      pn_data_rewind(msg->body);
+      pn_data_next(msg->body);
+      *code = pni_message_body_code(msg, pn_data_type(msg->body));
+      pn_data_rewind(msg->body);
+    }
+    *content = msg->body;
+    break;
+  default:
+    pn_data_clear(msg->data);
+    err = pni_message_data_section(msg, msg->data, id);
+    *content = msg->data;
+    break;
+  }
+  /* Section descriptors all fit a smallulong */
+  assert(*code < 256);
+  return err;
+}
+
+static void pni_message_write_descriptor(char *bytes, uint64_t code)
+{
+  bytes[0] = PNE_DESCRIPTOR;
+  bytes[1] = PNE_SMALLULONG;
+  bytes[2] = code;
+}
+
+static ssize_t pni_message_content_error(pn_message_t *msg, pn_data_t *content, ssize_t encoded)
+{
+  if (encoded == PN_OVERFLOW) return encoded;
+  return pn_error_format(msg->error, encoded, "data error: %s",
+                         pn_error_text(pn_data_error(content)));
+}
+
+/* Encode one section into bytes, or only size it if bytes is NULL */
+static ssize_t pni_message_encode_section(pn_message_t *msg, pni_section_id_t id, char *bytes, size_t size)
+{
+  pn_bytes_t raw;
+  pn_data_t *content;
+  uint64_t code;
+  int err = pni_message_section(msg, id, &raw, &content, &code);
+  if (err) return err;
+  if (raw.size) {
+    if (bytes) {
+      if (raw.size > size) return PN_OVERFLOW;
+      memcpy(bytes, raw.start, raw.size);
     }
-    pn_data_append(data, msg->body);
+    return raw.size;
+  }
+  if (!pn_data_size(content)) return 0;
+
+  size_t prefix = code ? 3 : 0;
+  ssize_t encoded;
+  if (!bytes) {
+    encoded = pn_data_encoded_size(content);
+  } else if (size < prefix) {
+    return PN_OVERFLOW;
+  } else {
+    encoded = pn_data_encode(content, bytes + prefix, size - prefix);
+  }
+  if (encoded < 0) return pni_message_content_error(msg, content, encoded);
+  if (bytes && prefix) pni_message_write_descriptor(bytes, code);
+  return prefix + encoded;
+}
+
+/* Encode one section at buf->start + offset, growing buf to fit */
+static ssize_t pni_message_encode_section_grow(pn_message_t *msg, pni_section_id_t id,
+                                               pn_rwbytes_t *buf, size_t offset)
+{
+  pn_bytes_t raw;
+  pn_data_t *content;
+  uint64_t code;
+  int err = pni_message_section(msg, id, &raw, &content, &code);
+  if (err) return err;
+  if (!raw.size && !pn_data_size(content)) return 0;
+
+  /* The raw bytes or the descriptor, the encoder grows buf for the rest */
+  size_t prefix = raw.size ? raw.size : code ? 3 : 0;
+  if (buf->size - offset < prefix) {
+    size_t size = buf->size ? buf->size : PN_ENCODER_BUFFER_SIZE;
+    while (size - offset < prefix) size *= 2;
+    char *start = (char *) realloc(buf->start, size);
+    if (!start) return PN_OUT_OF_MEMORY;
+    *buf = pn_rwbytes(size, start);
+  }
+  if (raw.size) {
+    memcpy(buf->start + offset, raw.start, raw.size);
+    return raw.size;
+  }
+  if (prefix) pni_message_write_descriptor(buf->start + offset, code);
+  ssize_t encoded = pni_data_encode_grow(content, buf, offset + prefix);
+  if (encoded < 0) return pni_message_content_error(msg, content, encoded);
+  return prefix + encoded;
+}
+
+ssize_t pn_message_encoded_size(pn_message_t *msg)
+{
+  if (!msg) return PN_ARG_ERR;
+  size_t total = 0;
+  for (int id = 0; id < PNI_SECTION_COUNT; id++) {
+    ssize_t encoded = pni_message_encode_section(msg, (pni_section_id_t) id, NULL, 0);
+    if (encoded < 0) return encoded;
+    total += encoded;
+  }
+  pn_data_clear(msg->data);
+  return total;
+}
+
+ssize_t pn_message_encode2(pn_message_t *msg, pn_rwbytes_t *buf)
+{
+  if (!msg || !buf) return PN_ARG_ERR;
+  size_t total = 0;
+  for (int id = 0; id < PNI_SECTION_COUNT; id++) {
+    ssize_t encoded = pni_message_encode_section_grow(msg, (pni_section_id_t) id, buf, total);
+    if (encoded < 0) return encoded;
+    total += encoded;
+  }
+  pn_data_clear(msg->data);
+  return total;
+}
+
+int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+{
+  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
+  size_t remaining = *size;
+  for (int id = 0; id < PNI_SECTION_COUNT; id++) {
+    ssize_t encoded = pni_message_encode_section(msg, (pni_section_id_t) id, bytes, remaining);
+    if (encoded < 0) return encoded;
+    bytes += encoded;
+    remaining -= encoded;
+  }
+  *size -= remaining;
+  pn_data_clear(msg->data);
+  return 0;
+}
+
+int pn_message_data(pn_message_t *msg, pn_data_t *data)
+{
+  pn_data_clear(data);
+  for (int id = 0; id < PNI_SECTION_COUNT; id++) {
+    int err = pni_message_data_section(msg, data, (pni_section_id_t) id);
+    if (err) return err;
   }
   return 0;
 }
 
 pn_data_t *pn_message_instructions(pn_message_t *msg)
 {
-  return msg ? msg->instructions : NULL;
+  if (!msg) return NULL;
+  pni_section_decode(msg, &msg->raw_instructions, msg->instructions);
+  return msg->instructions;
 }
 
 pn_data_t *pn_message_annotations(pn_message_t *msg)
 {
-  return msg ? msg->annotations : NULL;
+  if (!msg) return NULL;
+  pni_section_decode(msg, &msg->raw_annotations, msg->annotations);
+  return msg->annotations;
 }
 
 pn_data_t *pn_message_properties(pn_message_t *msg)
 {
-  return msg ? msg->properties : NULL;
+  if (!msg) return NULL;
+  pni_section_decode(msg, &msg->raw_properties, msg->properties);
+  return msg->properties;
 }
 
 pn_data_t *pn_message_body(pn_message_t *msg)
 {
-  return msg ? msg->body : NULL;
+  if (!msg) return NULL;
+  pni_section_decode(msg, &msg->raw_body, msg->body);
+  return msg->body;
 }
@@ -0,0 +1,1184 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "byteorder.h"
+#include "decoder.h"
+#include "encodings.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <proton/message.h>
+#include <proton/message_selector.h>
+#include <proton/object.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The expression is compiled to code for a small stack machine. Nesting is
+   bounded so evaluation needs only a fixed stack and no allocation. */
+#define PNI_SELECTOR_MAX_DEPTH (64)
+
+typedef enum {
+  PNI_SV_NULL,
+  PNI_SV_BOOL,
+  PNI_SV_LONG,
+  PNI_SV_DOUBLE,
+  PNI_SV_STRING
+} pni_sv_type_t;
+
+/* A selector value: a constant, or a field or property read from a message.
+   A string refers to the selector's text or to the message bytes. */
+typedef struct {
+  pni_sv_type_t type;
+  union {
+    bool b;
+    int64_t l;
+    double d;
+    pn_bytes_t s;
+  } u;
+} pni_sv_t;
+
+typedef enum {
+  PNI_OP_CONST,                 /* push constant a */
+  PNI_OP_FIELD,                 /* push header or properties field a */
+  PNI_OP_PROPERTY,              /* push the application property named by constant a */
+  PNI_OP_NEG,
+  PNI_OP_ADD,
+  PNI_OP_SUB,
+  PNI_OP_MUL,
+  PNI_OP_DIV,
+  PNI_OP_EQ,
+  PNI_OP_NE,
+  PNI_OP_LT,
+  PNI_OP_GT,
+  PNI_OP_LE,
+  PNI_OP_GE,
+  PNI_OP_NOT,
+  PNI_OP_AND,
+  PNI_OP_OR,
+  PNI_OP_JFALSE,                /* jump to a if the top is FALSE, keeping it */
+  PNI_OP_JTRUE,                 /* jump to a if the top is TRUE, keeping it */
+  PNI_OP_BETWEEN,               /* value, low, high */
+  PNI_OP_IN,                    /* is the top one of the b constants from a */
+  PNI_OP_LIKE,                  /* does the top match pattern constant a with escape b */
+  PNI_OP_ISNULL
+} pni_op_t;
+
+typedef struct {
+  uint16_t op;
+  uint16_t a;
+  uint16_t b;
+} pni_insn_t;
+
+#define PNI_NO_ESCAPE (0x100)
+
+/* The message sections a selector can read */
+typedef enum {
+  PNI_SECTION_HEADER,
+  PNI_SECTION_PROPERTIES,
+  PNI_SECTION_APPLICATION_PROPERTIES,
+  PNI_SECTION_COUNT
+} pni_section_id_t;
+
+typedef enum {
+  PNI_FIELD_DELIVERY_MODE,
+  PNI_FIELD_PRIORITY,
+  PNI_FIELD_MESSAGE_ID,
+  PNI_FIELD_CORRELATION_ID,
+  PNI_FIELD_TYPE,
+  PNI_FIELD_TIMESTAMP,
+  PNI_FIELD_EXPIRATION,
+  PNI_FIELD_GROUP_ID,
+  PNI_FIELD_GROUP_SEQ
+} pni_field_id_t;
+
+static const struct {
+  const char *name;
+  pni_section_id_t section;
+  size_t index;
+} pni_fields[] = {
+  {"JMSDeliveryMode", PNI_SECTION_HEADER, HEADER_DURABLE},
+  {"JMSPriority", PNI_SECTION_HEADER, HEADER_PRIORITY},
+  {"JMSMessageID", PNI_SECTION_PROPERTIES, PROPERTIES_MESSAGE_ID},
+  {"JMSCorrelationID", PNI_SECTION_PROPERTIES, PROPERTIES_CORRELATION_ID},
+  {"JMSType", PNI_SECTION_PROPERTIES, PROPERTIES_SUBJECT},
+  {"JMSTimestamp", PNI_SECTION_PROPERTIES, PROPERTIES_CREATION_TIME},
+  {"JMSExpiration", PNI_SECTION_PROPERTIES, PROPERTIES_ABSOLUTE_EXPIRY_TIME},
+  {"JMSXGroupID", PNI_SECTION_PROPERTIES, PROPERTIES_GROUP_ID},
+  {"JMSXGroupSeq", PNI_SECTION_PROPERTIES, PROPERTIES_GROUP_SEQUENCE}
+};
+
+#define PNI_FIELD_COUNT (sizeof(pni_fields)/sizeof(pni_fields[0]))
+
+struct pn_message_selector_t {
+  pn_error_t *error;
+  char *text;                   /* A copy of the expression, string constants point into it */
+  pni_insn_t *code;
+  size_t code_size;
+  size_t code_capacity;
+  pni_sv_t *constants;
+  size_t constants_size;
+  size_t constants_capacity;
+};
+
+static void pn_message_selector_finalize(void *object)
+{
+  pn_message_selector_t *selector = (pn_message_selector_t *) object;
+  pn_error_free(selector->error);
+  free(selector->text);
+  free(selector->code);
+  free(selector->constants);
+}
+
+#define pn_message_selector_initialize NULL
+#define pn_message_selector_hashcode NULL
+#define pn_message_selector_compare NULL
+#define pn_message_selector_inspect NULL
+
+/* Compiling */
+
+typedef enum {
+  PNI_TOK_END,
+  PNI_TOK_ERROR,
+  PNI_TOK_IDENTIFIER,
+  PNI_TOK_STRING,
+  PNI_TOK_LONG,
+  PNI_TOK_DOUBLE,
+  PNI_TOK_LPAREN,
+  PNI_TOK_RPAREN,
+  PNI_TOK_COMMA,
+  PNI_TOK_EQ,
+  PNI_TOK_NE,
+  PNI_TOK_LT,
+  PNI_TOK_GT,
+  PNI_TOK_LE,
+  PNI_TOK_GE,
+  PNI_TOK_PLUS,
+  PNI_TOK_MINUS,
+  PNI_TOK_STAR,
+  PNI_TOK_SLASH,
+  PNI_TOK_AND,
+  PNI_TOK_OR,
+  PNI_TOK_NOT,
+  PNI_TOK_BETWEEN,
+  PNI_TOK_IN,
+  PNI_TOK_LIKE,
+  PNI_TOK_ESCAPE,
+  PNI_TOK_IS,
+  PNI_TOK_NULL,
+  PNI_TOK_TRUE,
+  PNI_TOK_FALSE
+} pni_token_type_t;
+
+static const struct {
+  const char *name;
+  pni_token_type_t type;
+} pni_keywords[] = {
+  {"AND", PNI_TOK_AND},
+  {"OR", PNI_TOK_OR},
+  {"NOT", PNI_TOK_NOT},
+  {"BETWEEN", PNI_TOK_BETWEEN},
+  {"IN", PNI_TOK_IN},
+  {"LIKE", PNI_TOK_LIKE},
+  {"ESCAPE", PNI_TOK_ESCAPE},
+  {"IS", PNI_TOK_IS},
+  {"NULL", PNI_TOK_NULL},
+  {"TRUE", PNI_TOK_TRUE},
+  {"FALSE", PNI_TOK_FALSE}
+};
+
+typedef struct {
+  pni_token_type_t type;
+  char *start;                  /* In the selector's text */
+  size_t size;
+  int64_t l;
+  double d;
+} pni_token_t;
+
+typedef struct {
+  pn_message_selector_t *selector;
+  char *input;
+  pni_token_t token;
+  int depth;                    /* Values on the evaluation stack */
+  int nesting;                  /* Parser recursion */
+  bool failed;
+} pni_compiler_t;
+
+static bool pni_fail(pni_compiler_t *c, const char *what)
+{
+  if (!c->failed) {
+    c->failed = true;
+    pn_error_format(c->selector->error, PN_ARG_ERR, "selector error at %d: %s",
+                    (int) (c->token.start - c->selector->text), what);
+  }
+  return false;
+}
+
+static bool pni_identifier_start(char ch)
+{
+  return isalpha((unsigned char) ch) || ch == '_' || ch == '$';
+}
+
+static bool pni_identifier_part(char ch)
+{
+  return isalnum((unsigned char) ch) || ch == '_' || ch == '$';
+}
+
+/* A string literal is unescaped where it lies: '' becomes ', so the value is
+   never longer than the literal and overwrites only text already read. */
+static void pni_lex_string(pni_compiler_t *c, char *p)
+{
+  char *out = p;
+  c->token.start = p;
+  for (++p;; ++p) {
+    if (!*p) {
+      c->token.type = PNI_TOK_ERROR;
+      pni_fail(c, "unterminated string");
+      return;
+    }
+    if (*p == '\'') {
+      if (p[1] != '\'') break;
+      ++p;
+    }
+    *out++ = *p;
+  }
+  c->token.type = PNI_TOK_STRING;
+  c->token.size = out - c->token.start;
+  c->input = p + 1;
+}
+
+static void pni_lex_number(pni_compiler_t *c, char *p)
+{
+  char *end;
+  bool fractional = false;
+  c->token.start = p;
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    errno = 0;
+    c->token.l = (int64_t) strtoull(p, &end, 16);
+  } else {
+    for (end = p; isdigit((unsigned char) *end); ++end);
+    fractional = *end == '.' || *end == 'e' || *end == 'E';
+    errno = 0;
+    if (fractional) {
+      c->token.d = strtod(p, &end);
+    } else {
+      c->token.l = strtoll(p, &end, 10);
+    }
+  }
+  if (errno == ERANGE) {
+    c->token.type = PNI_TOK_ERROR;
+    pni_fail(c, "number out of range");
+    return;
+  }
+  if (fractional || *end == 'f' || *end == 'F' || *end == 'd' || *end == 'D') {
+    if (!fractional) c->token.d = (double) c->token.l;
+    c->token.type = PNI_TOK_DOUBLE;
+    if (*end == 'f' || *end == 'F' || *end == 'd' || *end == 'D') ++end;
+  } else {
+    c->token.type = PNI_TOK_LONG;
+    if (*end == 'l' || *end == 'L') ++end;
+  }
+  if (pni_identifier_part(*end) || *end == '.') {
+    c->token.type = PNI_TOK_ERROR;
+    pni_fail(c, "malformed number");
+    return;
+  }
+  c->token.size = end - p;
+  c->input = end;
+}
+
+static void pni_lex(pni_compiler_t *c)
+{
+  char *p = c->input;
+  while (isspace((unsigned char) *p)) ++p;
+  c->token.start = p;
+  c->token.size = 1;
+  c->input = p + 1;
+  switch (*p) {
+  case '\0': c->token.type = PNI_TOK_END; c->token.size = 0; c->input = p; return;
+  case '(': c->token.type = PNI_TOK_LPAREN; return;
+  case ')': c->token.type = PNI_TOK_RPAREN; return;
+  case ',': c->token.type = PNI_TOK_COMMA; return;
+  case '+': c->token.type = PNI_TOK_PLUS; return;
+  case '-': c->token.type = PNI_TOK_MINUS; return;
+  case '*': c->token.type = PNI_TOK_STAR; return;
+  case '/': c->token.type = PNI_TOK_SLASH; return;
+  case '=': c->token.type = PNI_TOK_EQ; return;
+  case '<':
+    if (p[1] == '>') { c->token.type = PNI_TOK_NE; c->token.size = 2; c->input = p + 2; }
+    else if (p[1] == '=') { c->token.type = PNI_TOK_LE; c->token.size = 2; c->input = p + 2; }
+    else c->token.type = PNI_TOK_LT;
+    return;
+  case '>':
+    if (p[1] == '=') { c->token.type = PNI_TOK_GE; c->token.size = 2; c->input = p + 2; }
+    else c->token.type = PNI_TOK_GT;
+    return;
+  case '\'':
+    pni_lex_string(c, p);
+    return;
+  }
+
+  if (isdigit((unsigned char) *p) || (*p == '.' && isdigit((unsigned char) p[1]))) {
+    pni_lex_number(c, p);
+    return;
+  }
+
+  if (pni_identifier_start(*p)) {
+    char *end = p + 1;
+    while (pni_identifier_part(*end)) ++end;
+    c->token.type = PNI_TOK_IDENTIFIER;
+    c->token.size = end - p;
+    c->input = end;
+    for (size_t i = 0; i < sizeof(pni_keywords)/sizeof(pni_keywords[0]); i++) {
+      if (strlen(pni_keywords[i].name) == c->token.size &&
+          !pn_strncasecmp(pni_keywords[i].name, p, c->token.size)) {
+        c->token.type = pni_keywords[i].type;
+        break;
+      }
+    }
+    return;
+  }
+
+  c->token.type = PNI_TOK_ERROR;
+  pni_fail(c, "unexpected character");
+}
+
+static bool pni_accept(pni_compiler_t *c, pni_token_type_t type)
+{
+  if (c->token.type != type) return false;
+  pni_lex(c);
+  return true;
+}
+
+static bool pni_expect(pni_compiler_t *c, pni_token_type_t type, const char *what)
+{
+  return pni_accept(c, type) || pni_fail(c, what);
+}
+
+/* The stack effect of each operation, to size the evaluation stack */
+static int pni_op_effect(pni_op_t op)
+{
+  switch (op) {
+  case PNI_OP_CONST:
+  case PNI_OP_FIELD:
+  case PNI_OP_PROPERTY:
+    return 1;
+  case PNI_OP_ADD:
+  case PNI_OP_SUB:
+  case PNI_OP_MUL:
+  case PNI_OP_DIV:
+  case PNI_OP_EQ:
+  case PNI_OP_NE:
+  case PNI_OP_LT:
+  case PNI_OP_GT:
+  case PNI_OP_LE:
+  case PNI_OP_GE:
+  case PNI_OP_AND:
+  case PNI_OP_OR:
+    return -1;
+  case PNI_OP_BETWEEN:
+    return -2;
+  default:
+    return 0;
+  }
+}
+
+static size_t pni_emit(pni_compiler_t *c, pni_op_t op, size_t a, size_t b)
+{
+  pn_message_selector_t *selector = c->selector;
+  if (c->failed) return 0;
+  if (selector->code_size == selector->code_capacity) {
+    size_t capacity = selector->code_capacity ? 2 * selector->code_capacity : 16;
+    pni_insn_t *code = (pni_insn_t *) realloc(selector->code, capacity * sizeof(pni_insn_t));
+    if (!code) {
+      pni_fail(c, "out of memory");
+      return 0;
+    }
+    selector->code = code;
+    selector->code_capacity = capacity;
+  }
+  if (a > UINT16_MAX || selector->code_size > UINT16_MAX) {
+    pni_fail(c, "expression too long");
+    return 0;
+  }
+  c->depth += pni_op_effect(op);
+  if (c->depth > PNI_SELECTOR_MAX_DEPTH) {
+    pni_fail(c, "expression too complex");
+    return 0;
+  }
+  pni_insn_t insn = {(uint16_t) op, (uint16_t) a, (uint16_t) b};
+  selector->code[selector->code_size] = insn;
+  return selector->code_size++;
+}
+
+/* Point the jump at insn to the next instruction */
+static void pni_patch(pni_compiler_t *c, size_t insn)
+{
+  if (!c->failed) c->selector->code[insn].a = (uint16_t) c->selector->code_size;
+}
+
+static size_t pni_constant(pni_compiler_t *c, pni_sv_t value)
+{
+  pn_message_selector_t *selector = c->selector;
+  if (c->failed) return 0;
+  if (selector->constants_size == selector->constants_capacity) {
+    size_t capacity = selector->constants_capacity ? 2 * selector->constants_capacity : 8;
+    pni_sv_t *constants = (pni_sv_t *) realloc(selector->constants, capacity * sizeof(pni_sv_t));
+    if (!constants) {
+      pni_fail(c, "out of memory");
+      return 0;
+    }
+    selector->constants = constants;
+    selector->constants_capacity = capacity;
+  }
+  selector->constants[selector->constants_size] = value;
+  return selector->constants_size++;
+}
+
+static size_t pni_string_constant(pni_compiler_t *c)
+{
+  pni_sv_t v;
+  v.type = PNI_SV_STRING;
+  v.u.s = pn_bytes(c->token.size, c->token.start);
+  return pni_constant(c, v);
+}
+
+static bool pni_parse_or(pni_compiler_t *c);
+
+static bool pni_parse_primary(pni_compiler_t *c)
+{
+  pni_sv_t v;
+  switch (c->token.type) {
+  case PNI_TOK_LPAREN:
+    pni_lex(c);
+    return pni_parse_or(c) && pni_expect(c, PNI_TOK_RPAREN, "expected ')'");
+  case PNI_TOK_STRING:
+    pni_emit(c, PNI_OP_CONST, pni_string_constant(c), 0);
+    break;
+  case PNI_TOK_LONG:
+    v.type = PNI_SV_LONG;
+    v.u.l = c->token.l;
+    pni_emit(c, PNI_OP_CONST, pni_constant(c, v), 0);
+    break;
+  case PNI_TOK_DOUBLE:
+    v.type = PNI_SV_DOUBLE;
+    v.u.d = c->token.d;
+    pni_emit(c, PNI_OP_CONST, pni_constant(c, v), 0);
+    break;
+  case PNI_TOK_TRUE:
+  case PNI_TOK_FALSE:
+    v.type = PNI_SV_BOOL;
+    v.u.b = c->token.type == PNI_TOK_TRUE;
+    pni_emit(c, PNI_OP_CONST, pni_constant(c, v), 0);
+    break;
+  case PNI_TOK_IDENTIFIER: {
+    size_t i = 0;
+    for (; i < PNI_FIELD_COUNT; i++) {
+      if (strlen(pni_fields[i].name) == c->token.size &&
+          !memcmp(pni_fields[i].name, c->token.start, c->token.size))
+        break;
+    }
+    if (i < PNI_FIELD_COUNT) {
+      pni_emit(c, PNI_OP_FIELD, i, 0);
+    } else {
+      pni_emit(c, PNI_OP_PROPERTY, pni_string_constant(c), 0);
+    }
+    break;
+  }
+  default:
+    return pni_fail(c, "expected a value");
+  }
+  pni_lex(c);
+  return !c->failed;
+}
+
+static bool pni_parse_unary(pni_compiler_t *c)
+{
+  bool negate = pni_accept(c, PNI_TOK_MINUS);
+  if (negate || pni_accept(c, PNI_TOK_PLUS)) {
+    if (++c->nesting > PNI_SELECTOR_MAX_DEPTH) return pni_fail(c, "expression too complex");
+    bool ok = pni_parse_unary(c);
+    --c->nesting;
+    if (!ok) return false;
+    if (negate) pni_emit(c, PNI_OP_NEG, 0, 0);
+    return !c->failed;
+  }
+  return pni_parse_primary(c);
+}
+
+static bool pni_parse_product(pni_compiler_t *c)
+{
+  if (!pni_parse_unary(c)) return false;
+  for (;;) {
+    pni_op_t op;
+    if (pni_accept(c, PNI_TOK_STAR)) op = PNI_OP_MUL;
+    else if (pni_accept(c, PNI_TOK_SLASH)) op = PNI_OP_DIV;
+    else return !c->failed;
+    if (!pni_parse_unary(c)) return false;
+    pni_emit(c, op, 0, 0);
+  }
+}
+
+static bool pni_parse_sum(pni_compiler_t *c)
+{
+  if (!pni_parse_product(c)) return false;
+  for (;;) {
+    pni_op_t op;
+    if (pni_accept(c, PNI_TOK_PLUS)) op = PNI_OP_ADD;
+    else if (pni_accept(c, PNI_TOK_MINUS)) op = PNI_OP_SUB;
+    else return !c->failed;
+    if (!pni_parse_product(c)) return false;
+    pni_emit(c, op, 0, 0);
+  }
+}
+
+static bool pni_parse_in(pni_compiler_t *c)
+{
+  if (!pni_expect(c, PNI_TOK_LPAREN, "expected '(' after IN")) return false;
+  size_t first = 0, count = 0;
+  do {
+    if (c->token.type != PNI_TOK_STRING) return pni_fail(c, "expected a string in IN list");
+    size_t k = pni_string_constant(c);
+    if (!count) first = k;
+    ++count;
+    pni_lex(c);
+  } while (pni_accept(c, PNI_TOK_COMMA));
+  if (!pni_expect(c, PNI_TOK_RPAREN, "expected ')' after IN list")) return false;
+  if (count > UINT16_MAX) return pni_fail(c, "IN list too long");
+  pni_emit(c, PNI_OP_IN, first, count);
+  return !c->failed;
+}
+
+static bool pni_parse_like(pni_compiler_t *c)
+{
+  if (c->token.type != PNI_TOK_STRING) return pni_fail(c, "expected a string after LIKE");
+  pn_bytes_t pattern = pn_bytes(c->token.size, c->token.start);
+  size_t k = pni_string_constant(c);
+  pni_lex(c);
+  int escape = PNI_NO_ESCAPE;
+  if (pni_accept(c, PNI_TOK_ESCAPE)) {
+    if (c->token.type != PNI_TOK_STRING || c->token.size != 1)
+      return pni_fail(c, "expected a single character after ESCAPE");
+    escape = (unsigned char) c->token.start[0];
+    pni_lex(c);
+    /* The escape must be followed by a character */
+    for (size_t i = 0; i < pattern.size; i++) {
+      if ((unsigned char) pattern.start[i] == escape && ++i == pattern.size)
+        return pni_fail(c, "LIKE pattern ends with its escape");
+    }
+  }
+  pni_emit(c, PNI_OP_LIKE, k, escape);
+  return !c->failed;
+}
+
+static bool pni_parse_comparison(pni_compiler_t *c)
+{
+  if (!pni_parse_sum(c)) return false;
+
+  pni_op_t op;
+  switch (c->token.type) {
+  case PNI_TOK_EQ: op = PNI_OP_EQ; break;
+  case PNI_TOK_NE: op = PNI_OP_NE; break;
+  case PNI_TOK_LT: op = PNI_OP_LT; break;
+  case PNI_TOK_GT: op = PNI_OP_GT; break;
+  case PNI_TOK_LE: op = PNI_OP_LE; break;
+  case PNI_TOK_GE: op = PNI_OP_GE; break;
+  case PNI_TOK_IS: {
+    pni_lex(c);
+    bool negated = pni_accept(c, PNI_TOK_NOT);
+    if (!pni_expect(c, PNI_TOK_NULL, "expected NULL after IS")) return false;
+    pni_emit(c, PNI_OP_ISNULL, 0, 0);
+    if (negated) pni_emit(c, PNI_OP_NOT, 0, 0);
+    return !c->failed;
+  }
+  default: {
+    bool negated = pni_accept(c, PNI_TOK_NOT);
+    if (pni_accept(c, PNI_TOK_BETWEEN)) {
+      if (!pni_parse_sum(c)) return false;
+      if (!pni_expect(c, PNI_TOK_AND, "expected AND in BETWEEN")) return false;
+      if (!pni_parse_sum(c)) return false;
+      pni_emit(c, PNI_OP_BETWEEN, 0, 0);
+    } else if (pni_accept(c, PNI_TOK_IN)) {
+      if (!pni_parse_in(c)) return false;
+    } else if (pni_accept(c, PNI_TOK_LIKE)) {
+      if (!pni_parse_like(c)) return false;
+    } else if (negated) {
+      return pni_fail(c, "expected BETWEEN, IN or LIKE after NOT");
+    } else {
+      return !c->failed;
+    }
+    if (negated) pni_emit(c, PNI_OP_NOT, 0, 0);
+    return !c->failed;
+  }
+  }
+
+  pni_lex(c);
+  if (!pni_parse_sum(c)) return false;
+  pni_emit(c, op, 0, 0);
+  return !c->failed;
+}
+
+static bool pni_parse_not(pni_compiler_t *c)
+{
+  if (pni_accept(c, PNI_TOK_NOT)) {
+    if (++c->nesting > PNI_SELECTOR_MAX_DEPTH) return pni_fail(c, "expression too complex");
+    bool ok = pni_parse_not(c);
+    --c->nesting;
+    if (!ok) return false;
+    pni_emit(c, PNI_OP_NOT, 0, 0);
+    return !c->failed;
+  }
+  return pni_parse_comparison(c);
+}
+
+/* a AND b: if a is FALSE, so is the result and b is not evaluated */
+static bool pni_parse_and(pni_compiler_t *c)
+{
+  if (!pni_parse_not(c)) return false;
+  while (pni_accept(c, PNI_TOK_AND)) {
+    size_t jump = pni_emit(c, PNI_OP_JFALSE, 0, 0);
+    if (!pni_parse_not(c)) return false;
+    pni_emit(c, PNI_OP_AND, 0, 0);
+    pni_patch(c, jump);
+  }
+  return !c->failed;
+}
+
+static bool pni_parse_or(pni_compiler_t *c)
+{
+  if (++c->nesting > PNI_SELECTOR_MAX_DEPTH) return pni_fail(c, "expression too complex");
+  bool ok = pni_parse_and(c);
+  while (ok && pni_accept(c, PNI_TOK_OR)) {
+    size_t jump = pni_emit(c, PNI_OP_JTRUE, 0, 0);
+    ok = pni_parse_and(c);
+    pni_emit(c, PNI_OP_OR, 0, 0);
+    pni_patch(c, jump);
+  }
+  --c->nesting;
+  return ok && !c->failed;
+}
+
+static void pni_compile(pn_message_selector_t *selector)
+{
+  pni_compiler_t c;
+  memset(&c, 0, sizeof(c));
+  c.selector = selector;
+  c.input = selector->text;
+  pni_lex(&c);
+  if (c.token.type == PNI_TOK_END) {
+    pni_sv_t v;
+    v.type = PNI_SV_BOOL;
+    v.u.b = true;
+    pni_emit(&c, PNI_OP_CONST, pni_constant(&c, v), 0);
+    return;
+  }
+  if (pni_parse_or(&c) && c.token.type != PNI_TOK_END)
+    pni_fail(&c, "unexpected text after expression");
+}
+
+pn_message_selector_t *pn_message_selector(const char *expression)
+{
+  static const pn_class_t clazz = PN_CLASS(pn_message_selector);
+  pn_message_selector_t *selector = (pn_message_selector_t *) pn_class_new(&clazz, sizeof(pn_message_selector_t));
+  if (!selector) return NULL;
+  selector->error = pn_error();
+  selector->text = pn_strdup(expression ? expression : "");
+  selector->code = NULL;
+  selector->code_size = selector->code_capacity = 0;
+  selector->constants = NULL;
+  selector->constants_size = selector->constants_capacity = 0;
+  if (!selector->error || !selector->text) {
+    pn_free(selector);
+    return NULL;
+  }
+  pni_compile(selector);
+  return selector;
+}
+
+void pn_message_selector_free(pn_message_selector_t *selector)
+{
+  pn_free(selector);
+}
+
+pn_error_t *pn_message_selector_error(pn_message_selector_t *selector)
+{
+  assert(selector);
+  return selector->error;
+}
+
+/* Matching */
+
+typedef struct {
+  const char *bytes;
+  size_t size;
+  bool scanned;
+  int error;
+  pn_bytes_t sections[PNI_SECTION_COUNT]; /* The value of each section, empty if absent */
+} pni_match_t;
+
+/* Locate the sections before the body, the body itself is never read */
+static void pni_match_scan(pni_match_t *m)
+{
+  const char *bytes = m->bytes;
+  size_t size = m->size;
+  m->scanned = true;
+  while (size) {
+    /* Stop at a body with the usual small descriptor before even finding its extent */
+    if (size >= 3 && bytes[0] == PNE_DESCRIPTOR && (uint8_t) bytes[1] == PNE_SMALLULONG &&
+        (uint8_t) bytes[2] >= DATA)
+      return;
+    uint64_t code;
+    size_t value;
+    ssize_t extent = pni_section_scan(bytes, size, &code, &value);
+    if (extent < 0) {
+      m->error = (int) extent;
+      return;
+    }
+    pn_bytes_t *section = NULL;
+    switch (code) {
+    case HEADER: section = &m->sections[PNI_SECTION_HEADER]; break;
+    case PROPERTIES: section = &m->sections[PNI_SECTION_PROPERTIES]; break;
+    case APPLICATION_PROPERTIES: section = &m->sections[PNI_SECTION_APPLICATION_PROPERTIES]; break;
+    case DATA:
+    case AMQP_SEQUENCE:
+    case AMQP_VALUE:
+    case FOOTER:
+      return;
+    }
+    if (section) *section = pn_bytes(extent - value, bytes + value);
+    bytes += extent;
+    size -= extent;
+  }
+}
+
+/* The elements of the encoded list or map at the start of b, and their count */
+static bool pni_compound(pn_bytes_t b, uint8_t code8, uint8_t code32, pn_bytes_t *elements, size_t *count)
+{
+  ssize_t extent = pni_decoder_value_size(b.start, b.size);
+  if (extent < 0) return false;
+  uint8_t code = (uint8_t) b.start[0];
+  if (code == code8 && extent >= 3) {
+    *count = (uint8_t) b.start[2];
+    *elements = pn_bytes(extent - 3, b.start + 3);
+    return true;
+  }
+  if (code == code32 && extent >= 9) {
+    *count = pni_read32(b.start + 5);
+    *elements = pn_bytes(extent - 9, b.start + 9);
+    return true;
+  }
+  if (code == PNE_LIST0 && code8 == PNE_LIST8) {
+    *count = 0;
+    *elements = pn_bytes(0, NULL);
+    return true;
+  }
+  return false;
+}
+
+/* Step over the encoded value at the start of b, false if it is malformed */
+static bool pni_skip(pn_bytes_t *b)
+{
+  ssize_t extent = pni_decoder_value_size(b->start, b->size);
+  if (extent < 0) return false;
+  b->start += extent;
+  b->size -= extent;
+  return true;
+}
+
+/* Decode the scalar at the start of b. Values a selector cannot compare,
+   described and compound values among them, are NULL. */
+static void pni_sv_decode(pn_bytes_t b, pni_sv_t *v)
+{
+  v->type = PNI_SV_NULL;
+  ssize_t extent = pni_decoder_value_size(b.start, b.size);
+  if (extent < 0) return;
+  const char *p = b.start + 1;
+  switch ((uint8_t) b.start[0]) {
+  case PNE_TRUE: v->type = PNI_SV_BOOL; v->u.b = true; break;
+  case PNE_FALSE: v->type = PNI_SV_BOOL; v->u.b = false; break;
+  case PNE_BOOLEAN: v->type = PNI_SV_BOOL; v->u.b = *p != 0; break;
+  case PNE_UBYTE:
+  case PNE_SMALLUINT:
+  case PNE_SMALLULONG: v->type = PNI_SV_LONG; v->u.l = (uint8_t) *p; break;
+  case PNE_USHORT: v->type = PNI_SV_LONG; v->u.l = pni_read16(p); break;
+  case PNE_UINT: v->type = PNI_SV_LONG; v->u.l = pni_read32(p); break;
+  case PNE_UINT0:
+  case PNE_ULONG0: v->type = PNI_SV_LONG; v->u.l = 0; break;
+  case PNE_ULONG: {
+    uint64_t u = pni_read64(p);
+    if (u <= INT64_MAX) {
+      v->type = PNI_SV_LONG;
+      v->u.l = (int64_t) u;
+    }
+    break;
+  }
+  case PNE_BYTE:
+  case PNE_SMALLINT:
+  case PNE_SMALLLONG: v->type = PNI_SV_LONG; v->u.l = (int8_t) *p; break;
+  case PNE_SHORT: v->type = PNI_SV_LONG; v->u.l = (int16_t) pni_read16(p); break;
+  case PNE_INT: v->type = PNI_SV_LONG; v->u.l = (int32_t) pni_read32(p); break;
+  case PNE_LONG:
+  case PNE_MS64: v->type = PNI_SV_LONG; v->u.l = (int64_t) pni_read64(p); break;
+  case PNE_FLOAT: {
+    uint32_t u = pni_read32(p);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    v->type = PNI_SV_DOUBLE;
+    v->u.d = f;
+    break;
+  }
+  case PNE_DOUBLE: {
+    uint64_t u = pni_read64(p);
+    v->type = PNI_SV_DOUBLE;
+    memcpy(&v->u.d, &u, sizeof(v->u.d));
+    break;
+  }
+  case PNE_STR8_UTF8:
+  case PNE_SYM8:
+    v->type = PNI_SV_STRING;
+    v->u.s = pn_bytes(extent - 2, b.start + 2);
+    break;
+  case PNE_STR32_UTF8:
+  case PNE_SYM32:
+    v->type = PNI_SV_STRING;
+    v->u.s = pn_bytes(extent - 5, b.start + 5);
+    break;
+  }
+}
+
+static bool pni_string_value(pn_bytes_t b, pn_bytes_t *s)
+{
+  pni_sv_t v;
+  pni_sv_decode(b, &v);
+  if (v.type != PNI_SV_STRING) return false;
+  *s = v.u.s;
+  return true;
+}
+
+static const pn_bytes_t *pni_match_section(pni_match_t *m, pni_section_id_t id)
+{
+  if (!m->scanned) pni_match_scan(m);
+  return m->error || !m->sections[id].start ? NULL : &m->sections[id];
+}
+
+static void pni_match_field(pni_match_t *m, size_t field, pni_sv_t *v)
+{
+  v->type = PNI_SV_NULL;
+  const pn_bytes_t *section = pni_match_section(m, pni_fields[field].section);
+  pn_bytes_t elements;
+  size_t count;
+  if (section && pni_compound(*section, PNE_LIST8, PNE_LIST32, &elements, &count)) {
+    size_t i = 0;
+    for (; i < pni_fields[field].index && i < count && pni_skip(&elements); i++);
+    if (i == pni_fields[field].index && i < count) pni_sv_decode(elements, v);
+  }
+  switch ((pni_field_id_t) field) {
+  case PNI_FIELD_DELIVERY_MODE: {
+    bool durable = v->type == PNI_SV_BOOL && v->u.b;
+    v->type = PNI_SV_STRING;
+    v->u.s = durable ? pn_bytes(10, "PERSISTENT") : pn_bytes(14, "NON_PERSISTENT");
+    break;
+  }
+  case PNI_FIELD_PRIORITY:
+    if (v->type == PNI_SV_NULL) {
+      v->type = PNI_SV_LONG;
+      v->u.l = PN_DEFAULT_PRIORITY;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/* Application properties are searched in their encoded form, only the value
+   of the property named is decoded */
+static void pni_match_property(pni_match_t *m, pn_bytes_t name, pni_sv_t *v)
+{
+  v->type = PNI_SV_NULL;
+  const pn_bytes_t *section = pni_match_section(m, PNI_SECTION_APPLICATION_PROPERTIES);
+  pn_bytes_t elements;
+  size_t count;
+  if (!section || !pni_compound(*section, PNE_MAP8, PNE_MAP32, &elements, &count)) return;
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    pn_bytes_t key;
+    bool found = pni_string_value(elements, &key) && key.size == name.size &&
+      !memcmp(key.start, name.start, name.size);
+    if (!pni_skip(&elements)) return;
+    if (found) {
+      pni_sv_decode(elements, v);
+      return;
+    }
+    if (!pni_skip(&elements)) return;
+  }
+}
+
+static void pni_sv_bool(pni_sv_t *v, int truth)
+{
+  if (truth < 0) {
+    v->type = PNI_SV_NULL;
+  } else {
+    v->type = PNI_SV_BOOL;
+    v->u.b = truth;
+  }
+}
+
+/* TRUE, FALSE or unknown (-1) */
+static int pni_sv_truth(const pni_sv_t *v)
+{
+  return v->type == PNI_SV_BOOL ? v->u.b : -1;
+}
+
+static bool pni_sv_numeric(const pni_sv_t *v)
+{
+  return v->type == PNI_SV_LONG || v->type == PNI_SV_DOUBLE;
+}
+
+static double pni_sv_double(const pni_sv_t *v)
+{
+  return v->type == PNI_SV_DOUBLE ? v->u.d : (double) v->u.l;
+}
+
+#define PNI_UNORDERED (2)
+
+/* -1, 0 or 1 ordering two numbers, PNI_UNORDERED for anything else */
+static int pni_sv_order(const pni_sv_t *a, const pni_sv_t *b)
+{
+  if (!pni_sv_numeric(a) || !pni_sv_numeric(b)) return PNI_UNORDERED;
+  if (a->type == PNI_SV_LONG && b->type == PNI_SV_LONG)
+    return (a->u.l > b->u.l) - (a->u.l < b->u.l);
+  double x = pni_sv_double(a), y = pni_sv_double(b);
+  if (x < y) return -1;
+  if (x > y) return 1;
+  return x == y ? 0 : PNI_UNORDERED;
+}
+
+/* 1 if equal, 0 if not, -1 if the values cannot be compared */
+static int pni_sv_equal(const pni_sv_t *a, const pni_sv_t *b)
+{
+  if (a->type == PNI_SV_STRING && b->type == PNI_SV_STRING)
+    return a->u.s.size == b->u.s.size && !memcmp(a->u.s.start, b->u.s.start, a->u.s.size);
+  if (a->type == PNI_SV_BOOL && b->type == PNI_SV_BOOL)
+    return a->u.b == b->u.b;
+  int order = pni_sv_order(a, b);
+  return order == PNI_UNORDERED ? -1 : order == 0;
+}
+
+/* Comparisons with an operand that is not a number are unknown */
+static int pni_sv_compare(pni_op_t op, const pni_sv_t *a, const pni_sv_t *b)
+{
+  int order = pni_sv_order(a, b);
+  if (order == PNI_UNORDERED) return -1;
+  switch (op) {
+  case PNI_OP_LT: return order < 0;
+  case PNI_OP_GT: return order > 0;
+  case PNI_OP_LE: return order <= 0;
+  default: return order >= 0;
+  }
+}
+
+static void pni_sv_arithmetic(pni_op_t op, pni_sv_t *a, const pni_sv_t *b)
+{
+  if (!pni_sv_numeric(a) || !pni_sv_numeric(b)) {
+    a->type = PNI_SV_NULL;
+    return;
+  }
+  if (a->type == PNI_SV_LONG && b->type == PNI_SV_LONG) {
+    /* Unsigned arithmetic wraps on overflow instead of being undefined */
+    uint64_t x = (uint64_t) a->u.l, y = (uint64_t) b->u.l;
+    switch (op) {
+    case PNI_OP_ADD: a->u.l = (int64_t) (x + y); break;
+    case PNI_OP_SUB: a->u.l = (int64_t) (x - y); break;
+    case PNI_OP_MUL: a->u.l = (int64_t) (x * y); break;
+    default:
+      if (b->u.l == 0 || (b->u.l == -1 && a->u.l == INT64_MIN)) a->type = PNI_SV_NULL;
+      else a->u.l /= b->u.l;
+      break;
+    }
+    return;
+  }
+  double x = pni_sv_double(a), y = pni_sv_double(b);
+  a->type = PNI_SV_DOUBLE;
+  switch (op) {
+  case PNI_OP_ADD: a->u.d = x + y; break;
+  case PNI_OP_SUB: a->u.d = x - y; break;
+  case PNI_OP_MUL: a->u.d = x * y; break;
+  default: a->u.d = x / y; break;
+  }
+}
+
+/* The length of the UTF-8 sequence starting with byte c */
+static size_t pni_utf8_length(char c)
+{
+  unsigned char u = (unsigned char) c;
+  if (u < 0xC0) return 1;
+  if (u < 0xE0) return 2;
+  if (u < 0xF0) return 3;
+  return 4;
+}
+
+/* Match s against a LIKE pattern where % matches any characters and _ one
+   character. A % backtracks only to the most recent %, which is enough as
+   the text a % skips is never constrained by an earlier one. */
+static bool pni_like(pn_bytes_t s, pn_bytes_t p, int escape)
+{
+  size_t si = 0, pi = 0, star = SIZE_MAX, mark = 0;
+  while (si < s.size) {
+    if (pi < p.size) {
+      int ch = (unsigned char) p.start[pi];
+      size_t next = pi + 1;
+      bool literal = false;
+      if (ch == escape) {
+        ch = (unsigned char) p.start[next++];
+        literal = true;
+      }
+      if (!literal && ch == '%') {
+        star = pi = next;
+        mark = si;
+        continue;
+      }
+      if (!literal && ch == '_') {
+        si += pni_utf8_length(s.start[si]);
+        pi = next;
+        continue;
+      }
+      if (ch == (unsigned char) s.start[si]) {
+        si++;
+        pi = next;
+        continue;
+      }
+    }
+    if (star == SIZE_MAX) return false;
+    mark += pni_utf8_length(s.start[mark]);
+    si = mark;
+    pi = star;
+  }
+  while (pi < p.size && p.start[pi] == '%' && escape != '%') pi++;
+  return si == s.size && pi == p.size;
+}
+
+int pn_message_selector_match(pn_message_selector_t *selector, const char *bytes, size_t size)
+{
+  assert(selector);
+  if (pn_error_code(selector->error)) return pn_error_code(selector->error);
+
+  pni_match_t m;
+  memset(&m, 0, sizeof(m));
+  m.bytes = bytes;
+  m.size = size;
+
+  const pni_sv_t *constants = selector->constants;
+  pni_sv_t stack[PNI_SELECTOR_MAX_DEPTH];
+  pni_sv_t *top = stack - 1;
+  for (size_t pc = 0; pc < selector->code_size; pc++) {
+    const pni_insn_t *insn = &selector->code[pc];
+    switch ((pni_op_t) insn->op) {
+    case PNI_OP_CONST:
+      *++top = constants[insn->a];
+      break;
+    case PNI_OP_FIELD:
+      pni_match_field(&m, insn->a, ++top);
+      break;
+    case PNI_OP_PROPERTY:
+      pni_match_property(&m, constants[insn->a].u.s, ++top);
+      break;
+    case PNI_OP_NEG:
+      if (top->type == PNI_SV_LONG) top->u.l = (int64_t) (0 - (uint64_t) top->u.l);
+      else if (top->type == PNI_SV_DOUBLE) top->u.d = -top->u.d;
+      else top->type = PNI_SV_NULL;
+      break;
+    case PNI_OP_ADD:
+    case PNI_OP_SUB:
+    case PNI_OP_MUL:
+    case PNI_OP_DIV:
+      --top;
+      pni_sv_arithmetic((pni_op_t) insn->op, top, top + 1);
+      break;
+    case PNI_OP_EQ:
+    case PNI_OP_NE: {
+      --top;
+      int equal = pni_sv_equal(top, top + 1);
+      pni_sv_bool(top, equal < 0 ? -1 : (insn->op == PNI_OP_EQ) == equal);
+      break;
+    }
+    case PNI_OP_LT:
+    case PNI_OP_GT:
+    case PNI_OP_LE:
+    case PNI_OP_GE:
+      --top;
+      pni_sv_bool(top, pni_sv_compare((pni_op_t) insn->op, top, top + 1));
+      break;
+    case PNI_OP_NOT: {
+      int t = pni_sv_truth(top);
+      pni_sv_bool(top, t < 0 ? -1 : !t);
+      break;
+    }
+    case PNI_OP_AND: {
+      --top;
+      int a = pni_sv_truth(top), b = pni_sv_truth(top + 1);
+      pni_sv_bool(top, (a == 0 || b == 0) ? 0 : (a == 1 && b == 1) ? 1 : -1);
+      break;
+    }
+    case PNI_OP_OR: {
+      --top;
+      int a = pni_sv_truth(top), b = pni_sv_truth(top + 1);
+      pni_sv_bool(top, (a == 1 || b == 1) ? 1 : (a == 0 && b == 0) ? 0 : -1);
+      break;
+    }
+    case PNI_OP_JFALSE:
+      if (pni_sv_truth(top) == 0) pc = insn->a - 1;
+      break;
+    case PNI_OP_JTRUE:
+      if (pni_sv_truth(top) == 1) pc = insn->a - 1;
+      break;
+    case PNI_OP_BETWEEN: {
+      top -= 2;
+      int low = pni_sv_compare(PNI_OP_GE, top, top + 1);
+      int high = pni_sv_compare(PNI_OP_LE, top, top + 2);
+      pni_sv_bool(top, (low == 0 || high == 0) ? 0 : (low == 1 && high == 1) ? 1 : -1);
+      break;
+    }
+    case PNI_OP_IN: {
+      if (top->type != PNI_SV_STRING) {
+        top->type = PNI_SV_NULL;
+        break;
+      }
+      int found = 0;
+      for (size_t i = insn->a; i < (size_t) insn->a + insn->b && !found; i++)
+        found = pni_sv_equal(top, &constants[i]) == 1;
+      pni_sv_bool(top, found);
+      break;
+    }
+    case PNI_OP_LIKE:
+      if (top->type != PNI_SV_STRING) top->type = PNI_SV_NULL;
+      else pni_sv_bool(top, pni_like(top->u.s, constants[insn->a].u.s, insn->b));
+      break;
+    case PNI_OP_ISNULL:
+      pni_sv_bool(top, top->type == PNI_SV_NULL);
+      break;
+    }
+    if (m.error) return m.error;
+  }
+  assert(top == stack);
+  return pni_sv_truth(top) == 1;
+}
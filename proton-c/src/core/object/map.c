@@ -21,37 +21,60 @@
 
 #include <proton/object.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
-#define PNI_ENTRY_FREE (0)
-#define PNI_ENTRY_LINK (1)
-#define PNI_ENTRY_TAIL (2)
+/*
+ * Open addressing with robin hood linear probing.
+ *
+ * Each entry keeps its full hash and its distance from its home slot, so
+ * a probe stops as soon as it meets an entry closer to home than the key
+ * would be, and only calls equals on a matching hash. Probes never wrap:
+ * they run on into an overflow tail after the home slots, which is
+ * extended when an insert reaches its end. Deletion shifts the rest of
+ * the cluster back by one, so there are no tombstones.
+ *
+ * Iteration runs from the last slot down, which lets the current entry be
+ * deleted during iteration: the backward shift only moves entries that
+ * have already been visited.
+ */
 
 typedef struct {
   void *key;
   void *value;
-  size_t next;
-  uint8_t state;
+  uintptr_t hash;
+  size_t probe;     // distance from the home slot + 1, 0 means free
 } pni_entry_t;
 
 struct pn_map_t {
   const pn_class_t *key;
   const pn_class_t *value;
   pni_entry_t *entries;
-  size_t capacity;
-  size_t addressable;
+  size_t capacity;  // home slots, a power of two
+  size_t length;    // home slots plus the overflow tail
   size_t size;
+  unsigned shift;   // hash bits dropped when picking a home slot
   uintptr_t (*hashcode)(void *key);
   bool (*equals)(void *a, void *b);
   float load_factor;
+  bool identity;    // keys are compared by value, as for pn_hash_t
 };
 
+#define PNI_MAP_TAIL (4)
+#define PNI_MAP_MAX_LOAD (0.9f)
+
+#if UINTPTR_MAX > 0xffffffff
+#define PNI_MAP_GOLDEN ((uintptr_t) 0x9e3779b97f4a7c15ULL)
+#else
+#define PNI_MAP_GOLDEN ((uintptr_t) 0x9e3779b9UL)
+#endif
+
 static void pn_map_finalize(void *object)
 {
   pn_map_t *map = (pn_map_t *) object;
 
-  for (size_t i = 0; i < map->capacity; i++) {
-    if (map->entries[i].state != PNI_ENTRY_FREE) {
+  for (size_t i = 0; i < map->length; i++) {
+    if (map->entries[i].probe) {
       pn_class_decref(map->key, map->entries[i].key);
       pn_class_decref(map->value, map->entries[i].value);
     }
@@ -66,8 +89,8 @@ static uintptr_t pn_map_hashcode(void *object)
 
   uintptr_t hashcode = 0;
 
-  for (size_t i = 0; i < map->capacity; i++) {
-    if (map->entries[i].state != PNI_ENTRY_FREE) {
+  for (size_t i = 0; i < map->length; i++) {
+    if (map->entries[i].probe) {
       void *key = map->entries[i].key;
       void *value = map->entries[i].value;
       hashcode += pn_hashcode(key) ^ pn_hashcode(value);
@@ -77,17 +100,14 @@ static uintptr_t pn_map_hashcode(void *object)
   return hashcode;
 }
 
-static void pni_map_allocate(pn_map_t *map)
+static void pni_map_allocate(pn_map_t *map, size_t capacity)
 {
-  map->entries = (pni_entry_t *) malloc(map->capacity * sizeof (pni_entry_t));
-  if (map->entries != NULL) {
-    for (size_t i = 0; i < map->capacity; i++) {
-      map->entries[i].key = NULL;
-      map->entries[i].value = NULL;
-      map->entries[i].next = 0;
-      map->entries[i].state = PNI_ENTRY_FREE;
-    }
-  }
+  unsigned bits = 0;
+  while (((size_t) 1 << bits) < capacity) bits++;
+  map->capacity = (size_t) 1 << bits;
+  map->length = map->capacity + PNI_MAP_TAIL;
+  map->shift = sizeof(uintptr_t)*8 - bits;
+  map->entries = (pni_entry_t *) calloc(map->length, sizeof(pni_entry_t));
   map->size = 0;
 }
 
@@ -128,13 +148,11 @@ pn_map_t *pn_map(const pn_class_t *key, const pn_class_t *value,
   pn_map_t *map = (pn_map_t *) pn_class_new(&clazz, sizeof(pn_map_t));
   map->key = key;
   map->value = value;
-  map->capacity = capacity ? capacity : 16;
-  map->addressable = (size_t) (map->capacity * 0.86);
-  if (!map->addressable) map->addressable = map->capacity;
-  map->load_factor = load_factor;
+  map->load_factor = (load_factor > 0 && load_factor < PNI_MAP_MAX_LOAD) ? load_factor : PNI_MAP_MAX_LOAD;
   map->hashcode = pn_hashcode;
   map->equals = pn_equals;
-  pni_map_allocate(map);
+  map->identity = false;
+  pni_map_allocate(map, capacity > 2 ? capacity : 16);
   return map;
 }
 
@@ -144,113 +162,98 @@ size_t pn_map_size(pn_map_t *map)
   return map->size;
 }
 
-static float pni_map_load(pn_map_t *map)
+static inline uintptr_t pni_map_hash(pn_map_t *map, void *key)
 {
-  return ((float) map->size) / ((float) map->addressable);
+  return map->identity ? (uintptr_t) key : map->hashcode(key);
 }
 
-static bool pni_map_ensure(pn_map_t *map, size_t capacity)
+static inline size_t pni_map_home(pn_map_t *map, uintptr_t hash)
 {
-  float load = pni_map_load(map);
-  if (capacity <= map->capacity && load <= map->load_factor) {
-    return false;
-  }
-
-  size_t oldcap = map->capacity;
-
-  while (map->capacity < capacity || pni_map_load(map) > map->load_factor) {
-    map->capacity *= 2;
-    map->addressable = (size_t) (0.86 * map->capacity);
-  }
-
-  pni_entry_t *entries = map->entries;
-  pni_map_allocate(map);
-
-  for (size_t i = 0; i < oldcap; i++) {
-    if (entries[i].state != PNI_ENTRY_FREE) {
-      void *key = entries[i].key;
-      void *value = entries[i].value;
-      pn_map_put(map, key, value);
-    }
-  }
-
-  for (size_t i = 0; i < oldcap; i++) {
-    if (entries[i].state != PNI_ENTRY_FREE) {
-      void *key = entries[i].key;
-      void *value = entries[i].value;
-      pn_class_decref(map->key, key);
-      pn_class_decref(map->value, value);
-    }
-  }
-
-  free(entries);
-  return true;
+  return (size_t) ((hash * PNI_MAP_GOLDEN) >> map->shift);
 }
 
-static pni_entry_t *pni_map_entry(pn_map_t *map, void *key, pni_entry_t **pprev, bool create)
+static pni_entry_t *pni_map_find(pn_map_t *map, void *key, uintptr_t hash)
 {
-  uintptr_t hashcode = map->hashcode(key);
-
-  pni_entry_t *entry = &map->entries[hashcode % map->addressable];
-  pni_entry_t *prev = NULL;
-
-  if (entry->state == PNI_ENTRY_FREE) {
-    if (create) {
-      entry->state = PNI_ENTRY_TAIL;
-      entry->key = key;
-      pn_class_incref(map->key, key);
-      map->size++;
-      return entry;
-    } else {
+  size_t probe = 1;
+  for (size_t i = pni_map_home(map, hash); i < map->length; i++, probe++) {
+    pni_entry_t *entry = &map->entries[i];
+    if (entry->probe < probe) {
+      // free, or the key would have displaced this entry
       return NULL;
     }
-  }
-
-  while (true) {
-    if (map->equals(entry->key, key)) {
-      if (pprev) *pprev = prev;
+    if (entry->hash == hash && (map->identity || map->equals(entry->key, key))) {
       return entry;
     }
+  }
+  return NULL;
+}
 
-    if (entry->state == PNI_ENTRY_TAIL) {
+// Place an entry known not to be present, returns where it ended up
+static size_t pni_map_insert(pn_map_t *map, void *key, void *value, uintptr_t hash)
+{
+  pni_entry_t carried = {key, value, hash, 1};
+  size_t placed = map->length;
+  bool found = false;
+  for (size_t i = pni_map_home(map, hash);; i++, carried.probe++) {
+    if (i == map->length) {
+      size_t length = map->length + (map->length - map->capacity);
+      map->entries = (pni_entry_t *) realloc(map->entries, length * sizeof(pni_entry_t));
+      memset(map->entries + map->length, 0, (length - map->length) * sizeof(pni_entry_t));
+      map->length = length;
+    }
+    pni_entry_t *entry = &map->entries[i];
+    if (!entry->probe) {
+      *entry = carried;
+      if (!found) placed = i;
       break;
-    } else {
-      prev = entry;
-      entry = &map->entries[entry->next];
     }
+    if (entry->probe < carried.probe) {
+      pni_entry_t displaced = *entry;
+      *entry = carried;
+      carried = displaced;
+      if (!found) {
+        placed = i;
+        found = true;
+      }
+    }
+  }
+  map->size++;
+  return placed;
+}
+
+static void pni_map_ensure(pn_map_t *map, size_t size)
+{
+  if ((float) size <= map->load_factor * (float) map->capacity) {
+    return;
   }
 
-  if (create) {
-    if (pni_map_ensure(map, map->size + 1)) {
-      // if we had to grow the table we need to start over
-      return pni_map_entry(map, key, pprev, create);
-    }
+  size_t capacity = map->capacity;
+  while ((float) size > map->load_factor * (float) capacity) {
+    capacity *= 2;
+  }
 
-    size_t empty = 0;
-    for (size_t i = 0; i < map->capacity; i++) {
-      size_t idx = map->capacity - i - 1;
-      if (map->entries[idx].state == PNI_ENTRY_FREE) {
-        empty = idx;
-        break;
-      }
+  // Entries move across as they are, without touching refcounts
+  pni_entry_t *entries = map->entries;
+  size_t length = map->length;
+  pni_map_allocate(map, capacity);
+  for (size_t i = 0; i < length; i++) {
+    if (entries[i].probe) {
+      pni_map_insert(map, entries[i].key, entries[i].value, entries[i].hash);
     }
-    entry->next = empty;
-    entry->state = PNI_ENTRY_LINK;
-    map->entries[empty].state = PNI_ENTRY_TAIL;
-    map->entries[empty].key = key;
-    pn_class_incref(map->key, key);
-    if (pprev) *pprev = entry;
-    map->size++;
-    return &map->entries[empty];
-  } else {
-    return NULL;
   }
+  free(entries);
 }
 
 int pn_map_put(pn_map_t *map, void *key, void *value)
 {
   assert(map);
-  pni_entry_t *entry = pni_map_entry(map, key, NULL, true);
+  uintptr_t hash = pni_map_hash(map, key);
+  pni_entry_t *entry = pni_map_find(map, key, hash);
+  if (!entry) {
+    pni_map_ensure(map, map->size + 1);
+    entry = &map->entries[pni_map_insert(map, key, NULL, hash)];
+    pn_class_incref(map->key, key);
+  }
   void *dref_val = entry->value;
   entry->value = value;
   pn_class_incref(map->value, value);
@@ -261,78 +264,26 @@ int pn_map_put(pn_map_t *map, void *key, void *value)
 void *pn_map_get(pn_map_t *map, void *key)
 {
   assert(map);
-  pni_entry_t *entry = pni_map_entry(map, key, NULL, false);
+  pni_entry_t *entry = pni_map_find(map, key, pni_map_hash(map, key));
   return entry ? entry->value : NULL;
 }
 
-static void pni_map_rehash(pn_map_t *map, size_t index)
-{
-  //reinsert entries in chain starting at index
-  assert(map);
-  size_t i = index;
-  bool complete = false;
-  while (!complete) {
-    pni_entry_t *entry = &map->entries[i];
-    assert(entry);
-    assert(entry->state != PNI_ENTRY_FREE);
-    size_t current = i;
-    if (entry->state == PNI_ENTRY_TAIL) {
-      complete = true;
-    } else {
-      assert(entry->state == PNI_ENTRY_LINK);
-      i = entry->next;
-    }
-    uintptr_t hashcode = map->hashcode(entry->key);
-    pni_entry_t *reloc = &map->entries[hashcode % map->addressable];
-    if (reloc->state == PNI_ENTRY_FREE) {
-      //correct addressable slot is available, copy into that...
-      reloc->state = PNI_ENTRY_TAIL;
-      reloc->key = entry->key;
-      reloc->value = entry->value;
-      //...then free the current entry
-      entry->key = NULL;
-      entry->value = NULL;
-      entry->state = PNI_ENTRY_FREE;
-      entry->next = 0;
-    } else {
-      //iterate to end of chain...
-      while (reloc->state == PNI_ENTRY_LINK) {
-        reloc = &map->entries[reloc->next];
-      }
-      assert(reloc->state == PNI_ENTRY_TAIL);
-      //... and append current entry
-      reloc->state = PNI_ENTRY_LINK;
-      reloc->next = current;
-      entry->state = PNI_ENTRY_TAIL;
-      entry->next = 0;
-    }
-  }
-}
-
 void pn_map_del(pn_map_t *map, void *key)
 {
   assert(map);
-  pni_entry_t *prev = NULL;
-  pni_entry_t *entry = pni_map_entry(map, key, &prev, false);
+  pni_entry_t *entry = pni_map_find(map, key, pni_map_hash(map, key));
   if (entry) {
-    uint8_t orig_state = entry->state;
-    size_t orig_next = entry->next;
-
     void *dref_key = entry->key;
     void *dref_value = entry->value;
-    if (prev) {
-      prev->next = 0;
-      prev->state = PNI_ENTRY_TAIL;
-    }
-    entry->state = PNI_ENTRY_FREE;
-    entry->next = 0;
-    entry->key = NULL;
-    entry->value = NULL;
-    map->size--;
 
-    if (orig_state == PNI_ENTRY_LINK) {
-      pni_map_rehash(map, orig_next);
+    size_t i = entry - map->entries;
+    while (i + 1 < map->length && map->entries[i + 1].probe > 1) {
+      map->entries[i] = map->entries[i + 1];
+      map->entries[i].probe--;
+      i++;
     }
+    memset(&map->entries[i], 0, sizeof(pni_entry_t));
+    map->size--;
 
     // do this last as it may trigger further deletions
     pn_class_decref(map->key, dref_key);
@@ -340,28 +291,27 @@ void pn_map_del(pn_map_t *map, void *key)
   }
 }
 
-pn_handle_t pn_map_head(pn_map_t *map)
+static pn_handle_t pni_map_prev(pn_map_t *map, size_t end)
 {
-  assert(map);
-  for (size_t i = 0; i < map->capacity; i++)
-  {
-    if (map->entries[i].state != PNI_ENTRY_FREE) {
-      return (pn_handle_t)(i + 1);
+  for (size_t i = end; i > 0; i--) {
+    if (map->entries[i - 1].probe) {
+      return (pn_handle_t) i;
     }
   }
 
   return 0;
 }
 
-pn_handle_t pn_map_next(pn_map_t *map, pn_handle_t entry)
+pn_handle_t pn_map_head(pn_map_t *map)
 {
-  for (size_t i = (size_t)entry; i < map->capacity; i++) {
-    if (map->entries[i].state != PNI_ENTRY_FREE) {
-      return (pn_handle_t)(i + 1);
-    }
-  }
+  assert(map);
+  return pni_map_prev(map, map->length);
+}
 
-  return 0;
+pn_handle_t pn_map_next(pn_map_t *map, pn_handle_t entry)
+{
+  assert(map);
+  return pni_map_prev(map, (size_t) entry - 1);
 }
 
 void *pn_map_key(pn_map_t *map, pn_handle_t entry)
@@ -417,6 +367,7 @@ pn_hash_t *pn_hash(const pn_class_t *clazz, size_t capacity, float load_factor)
   pn_hash_t *hash = (pn_hash_t *) pn_map(PN_UINTPTR, clazz, capacity, load_factor);
   hash->map.hashcode = pni_identity_hashcode;
   hash->map.equals = pni_identity_equals;
+  hash->map.identity = true;
   return hash;
 }
 
@@ -19,8 +19,13 @@
  *
  */
 
+#include "core/config.h"
+#include "core/max_align.h"
+#include "core/object_private.h"
+
 #include <proton/object.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #define pn_object_initialize NULL
@@ -191,17 +196,156 @@ int pn_class_inspect(const pn_class_t *clazz, void *object, pn_string_t *dst)
 typedef struct {
   const pn_class_t *clazz;
   int refcount;
+  uint16_t bucket;  /* free list + 1 if the object came from a pool */
 } pni_head_t;
 
+/* The head is padded so objects keep malloc alignment */
+#define PNI_HEAD_SIZE \
+  ((sizeof(pni_head_t) + sizeof(pn_max_align_t) - 1)/sizeof(pn_max_align_t)*sizeof(pn_max_align_t))
+
 #define pni_head(PTR) \
-  (((pni_head_t *) (PTR)) - 1)
+  ((pni_head_t *) ((char *) (PTR) - PNI_HEAD_SIZE))
+
+/* Pooled objects are preceded by their pool, keeping the object aligned */
+typedef union {
+  pni_object_pool_t *pool;
+  pn_max_align_t align;
+} pni_pooled_t;
+
+#define pni_pooled(HEAD) \
+  (((pni_pooled_t *) (HEAD)) - 1)
+
+#define PNI_POOL_QUANTUM sizeof(pn_max_align_t)
+#define PNI_POOL_BUCKETS (PN_OBJECT_POOL_MAX_SIZE/PNI_POOL_QUANTUM)
+
+struct pni_object_pool_t {
+  void *free[PNI_POOL_BUCKETS];  /* recycled blocks, linked through their first word */
+  pni_pooled_t *chunks;          /* linked through the first slot of each chunk */
+  size_t chunk_used;             /* bytes handed out from the newest chunk */
+  size_t outstanding;            /* blocks currently holding an object */
+  size_t size;                   /* bytes of chunks allocated */
+  bool released;
+};
+
+#if defined(_MSC_VER)
+# define PNI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+# define PNI_THREAD_LOCAL __thread
+#endif
+
+#ifdef PNI_THREAD_LOCAL
+
+static PNI_THREAD_LOCAL pni_object_pool_t *pni_pool_current = NULL;
+
+pni_object_pool_t *pni_object_pool(void)
+{
+  pni_object_pool_t *pool = (pni_object_pool_t *) calloc(1, sizeof(pni_object_pool_t));
+  if (pool) {
+    pool->chunk_used = PN_OBJECT_POOL_CHUNK_SIZE;  /* no chunk yet */
+  }
+  return pool;
+}
+
+pni_object_pool_t *pni_object_pool_use(pni_object_pool_t *pool)
+{
+  pni_object_pool_t *prev = pni_pool_current;
+  pni_pool_current = pool;
+  return prev;
+}
+
+#else
+
+pni_object_pool_t *pni_object_pool(void) { return NULL; }
+pni_object_pool_t *pni_object_pool_use(pni_object_pool_t *pool) { return NULL; }
+
+#endif
+
+size_t pni_object_pool_size(pni_object_pool_t *pool)
+{
+  return pool ? pool->size : 0;
+}
+
+static void pni_pool_destroy(pni_object_pool_t *pool)
+{
+  pni_pooled_t *chunk = pool->chunks;
+  while (chunk) {
+    pni_pooled_t *next = (pni_pooled_t *) chunk->pool;
+    free(chunk);
+    chunk = next;
+  }
+  free(pool);
+}
+
+void pni_object_pool_release(pni_object_pool_t *pool)
+{
+  if (!pool) return;
+  assert(!pool->released);
+  pool->released = true;
+#ifdef PNI_THREAD_LOCAL
+  if (pni_pool_current == pool) {
+    pni_pool_current = NULL;
+  }
+#endif
+  if (pool->outstanding == 0) {
+    pni_pool_destroy(pool);
+  }
+}
+
+static void *pni_pool_alloc(pni_object_pool_t *pool, size_t bucket)
+{
+  void *block = pool->free[bucket];
+  if (block) {
+    memcpy(&pool->free[bucket], block, sizeof(void *));
+  } else {
+    size_t size = (bucket + 1) * PNI_POOL_QUANTUM;
+    if (pool->chunk_used + size > PN_OBJECT_POOL_CHUNK_SIZE) {
+      pni_pooled_t *chunk = (pni_pooled_t *) malloc(PN_OBJECT_POOL_CHUNK_SIZE);
+      if (!chunk) return NULL;
+      chunk->pool = (pni_object_pool_t *) pool->chunks;
+      pool->chunks = chunk;
+      pool->chunk_used = sizeof(pni_pooled_t);
+      pool->size += PN_OBJECT_POOL_CHUNK_SIZE;
+    }
+    block = (char *) pool->chunks + pool->chunk_used;
+    pool->chunk_used += size;
+  }
+  memset(block, 0, (bucket + 1) * PNI_POOL_QUANTUM);
+  pool->outstanding++;
+  return block;
+}
+
+static void pni_pool_free(pni_object_pool_t *pool, void *block, size_t bucket)
+{
+  memcpy(block, &pool->free[bucket], sizeof(void *));
+  pool->free[bucket] = block;
+  assert(pool->outstanding > 0);
+  if (--pool->outstanding == 0 && pool->released) {
+    pni_pool_destroy(pool);
+  }
+}
 
 void *pn_object_new(const pn_class_t *clazz, size_t size)
 {
   void *object = NULL;
-  pni_head_t *head = (pni_head_t *) calloc(1, sizeof(pni_head_t) + size);
+  pni_head_t *head = NULL;
+#ifdef PNI_THREAD_LOCAL
+  pni_object_pool_t *pool = pni_pool_current;
+  size_t total = sizeof(pni_pooled_t) + PNI_HEAD_SIZE + size;
+  if (pool && total <= PN_OBJECT_POOL_MAX_SIZE) {
+    size_t bucket = (total + PNI_POOL_QUANTUM - 1)/PNI_POOL_QUANTUM - 1;
+    pni_pooled_t *pooled = (pni_pooled_t *) pni_pool_alloc(pool, bucket);
+    if (pooled) {
+      pooled->pool = pool;
+      head = (pni_head_t *) (pooled + 1);
+      head->bucket = bucket + 1;
+    }
+  }
+#endif
+  if (!head) {
+    head = (pni_head_t *) calloc(1, PNI_HEAD_SIZE + size);
+  }
   if (head != NULL) {
-    object = head + 1;
+    object = (char *) head + PNI_HEAD_SIZE;
     head->clazz = clazz;
     head->refcount = 1;
   }
@@ -240,7 +384,12 @@ void pn_object_decref(void *object)
 void pn_object_free(void *object)
 {
   pni_head_t *head = pni_head(object);
-  free(head);
+  if (head->bucket) {
+    pni_pooled_t *pooled = pni_pooled(head);
+    pni_pool_free(pooled->pool, pooled, head->bucket - 1);
+  } else {
+    free(head);
+  }
 }
 
 void *pn_incref(void *object)
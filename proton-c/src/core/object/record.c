@@ -29,10 +29,17 @@ typedef struct {
   void *value;
 } pni_field_t;
 
+/* A fixed slot is defined once it has a class */
+typedef struct {
+  const pn_class_t *clazz;
+  void *value;
+} pni_slot_t;
+
 struct pn_record_t {
   size_t size;
   size_t capacity;
   pni_field_t *fields;
+  pni_slot_t slots[PN_RECORD_SLOTS];
 };
 
 static void pn_record_initialize(void *object)
@@ -41,11 +48,24 @@ static void pn_record_initialize(void *object)
   record->size = 0;
   record->capacity = 0;
   record->fields = NULL;
+  for (size_t i = 0; i < PN_RECORD_SLOTS; i++) {
+    record->slots[i].clazz = NULL;
+    record->slots[i].value = NULL;
+  }
+}
+
+static inline pni_slot_t *pni_record_slot(pn_record_t *record, pn_handle_t key) {
+  uintptr_t index = (uintptr_t) key;
+  return index < PN_RECORD_SLOTS ? &record->slots[index] : NULL;
 }
 
 static void pn_record_finalize(void *object)
 {
   pn_record_t *record = (pn_record_t *) object;
+  for (size_t i = 0; i < PN_RECORD_SLOTS; i++) {
+    pni_slot_t *slot = &record->slots[i];
+    if (slot->clazz) pn_class_decref(slot->clazz, slot->value);
+  }
   for (size_t i = 0; i < record->size; i++) {
     pni_field_t *v = &record->fields[i];
     pn_class_decref(v->clazz, v->value);
@@ -93,6 +113,13 @@ void pn_record_def(pn_record_t *record, pn_handle_t key, const pn_class_t *clazz
   assert(record);
   assert(clazz);
 
+  pni_slot_t *slot = pni_record_slot(record, key);
+  if (slot) {
+    assert(!slot->clazz || slot->clazz == clazz);
+    slot->clazz = clazz;
+    return;
+  }
+
   pni_field_t *field = pni_record_find(record, key);
   if (field) {
     assert(field->clazz == clazz);
@@ -106,6 +133,8 @@ void pn_record_def(pn_record_t *record, pn_handle_t key, const pn_class_t *clazz
 bool pn_record_has(pn_record_t *record, pn_handle_t key)
 {
   assert(record);
+  pni_slot_t *slot = pni_record_slot(record, key);
+  if (slot) return slot->clazz != NULL;
   pni_field_t *field = pni_record_find(record, key);
   if (field) {
     return true;
@@ -117,6 +146,8 @@ bool pn_record_has(pn_record_t *record, pn_handle_t key)
 void *pn_record_get(pn_record_t *record, pn_handle_t key)
 {
   assert(record);
+  pni_slot_t *slot = pni_record_slot(record, key);
+  if (slot) return slot->value;
   pni_field_t *field = pni_record_find(record, key);
   if (field) {
     return field->value;
@@ -129,6 +160,17 @@ void pn_record_set(pn_record_t *record, pn_handle_t key, void *value)
 {
   assert(record);
 
+  pni_slot_t *slot = pni_record_slot(record, key);
+  if (slot) {
+    if (slot->clazz) {
+      void *old = slot->value;
+      slot->value = value;
+      pn_class_incref(slot->clazz, value);
+      pn_class_decref(slot->clazz, old);
+    }
+    return;
+  }
+
   pni_field_t *field = pni_record_find(record, key);
   if (field) {
     void *old = field->value;
@@ -141,6 +183,12 @@ void pn_record_set(pn_record_t *record, pn_handle_t key, void *value)
 void pn_record_clear(pn_record_t *record)
 {
   assert(record);
+  for (size_t i = 0; i < PN_RECORD_SLOTS; i++) {
+    pni_slot_t *slot = &record->slots[i];
+    if (slot->clazz) pn_class_decref(slot->clazz, slot->value);
+    slot->clazz = NULL;
+    slot->value = NULL;
+  }
   for (size_t i = 0; i < record->size; i++) {
     pni_field_t *field = &record->fields[i];
     pn_class_decref(field->clazz, field->value);
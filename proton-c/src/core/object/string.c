@@ -31,16 +31,24 @@
 
 #define PNI_NULL_SIZE (-1)
 
+/* Strings up to this size, including the terminator, need no separate buffer */
+#define PNI_STRING_INLINE 24
+
 struct pn_string_t {
-  char *bytes;
+  char *bytes;        // inline until the string outgrows it
   ssize_t size;       // PNI_NULL_SIZE (-1) means null
   size_t capacity;
+  char inline_bytes[PNI_STRING_INLINE];
 };
 
+#define pni_string_inline(STRING) ((STRING)->bytes == (STRING)->inline_bytes)
+
 static void pn_string_finalize(void *object)
 {
   pn_string_t *string = (pn_string_t *) object;
-  free(string->bytes);
+  if (!pni_string_inline(string)) {
+    free(string->bytes);
+  }
 }
 
 static uintptr_t pn_string_hashcode(void *object)
@@ -108,8 +116,14 @@ pn_string_t *pn_stringn(const char *bytes, size_t n)
 {
   static const pn_class_t clazz = PN_CLASS(pn_string);
   pn_string_t *string = (pn_string_t *) pn_class_new(&clazz, sizeof(pn_string_t));
-  string->capacity = n ? n * sizeof(char) : 16;
-  string->bytes = (char *) malloc(string->capacity);
+  string->size = PNI_NULL_SIZE;
+  if (n < PNI_STRING_INLINE) {
+    string->capacity = PNI_STRING_INLINE;
+    string->bytes = string->inline_bytes;
+  } else {
+    string->capacity = (n + 1) * sizeof(char);
+    string->bytes = (char *) malloc(string->capacity);
+  }
   pn_string_setn(string, bytes, n);
   return string;
 }
@@ -147,7 +161,16 @@ int pn_string_grow(pn_string_t *string, size_t capacity)
     grow = true;
   }
 
-  if (grow) {
+  if (grow && pni_string_inline(string)) {
+    char *growed = (char *) malloc(string->capacity);
+    if (growed) {
+      memcpy(growed, string->inline_bytes, PNI_STRING_INLINE);
+      string->bytes = growed;
+    } else {
+      string->capacity = PNI_STRING_INLINE;
+      return PN_ERR;
+    }
+  } else if (grow) {
     char *growed = (char *) realloc(string->bytes, string->capacity);
     if (growed) {
       string->bytes = growed;
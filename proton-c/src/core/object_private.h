@@ -0,0 +1,54 @@
+#ifndef OBJECT_PRIVATE_H
+#define OBJECT_PRIVATE_H
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**@file
+ *
+ * Object pools: small objects created by pn_object_new() while a pool
+ * is in use on the current thread are carved from the pool's chunks
+ * and recycled through per size free lists instead of malloc/free.
+ *
+ * A pool is not locked, it must only be used by one thread at a time,
+ * like the connection that owns it. Pooled objects may outlive the
+ * owner's call to pni_object_pool_release(), the chunks are freed
+ * together once the last of them is gone.
+ */
+
+#include <stddef.h>
+
+typedef struct pni_object_pool_t pni_object_pool_t;
+
+/** Create an empty pool, or NULL if pooling is not available */
+pni_object_pool_t *pni_object_pool(void);
+
+/** Bytes of memory held by the pool's chunks */
+size_t pni_object_pool_size(pni_object_pool_t *pool);
+
+/** The owner is done with the pool, no new objects come from it */
+void pni_object_pool_release(pni_object_pool_t *pool);
+
+/**
+ * Allocate pn_object_new() objects from pool on this thread until the
+ * next call, NULL returns to plain malloc. Returns the pool previously
+ * in use so nested uses can restore it.
+ */
+pni_object_pool_t *pni_object_pool_use(pni_object_pool_t *pool);
+
+#endif // OBJECT_PRIVATE_H
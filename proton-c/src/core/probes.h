@@ -0,0 +1,66 @@
+#ifndef _PROTON_SRC_PROBES_H
+#define _PROTON_SRC_PROBES_H 1
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Static probes at engine hot spots, for perf, bpftrace or systemtap.
+ *
+ * Built with cmake -DENABLE_PROBES=ON, which defines PNI_PROBES and needs
+ * <sys/sdt.h>.  Otherwise the macros expand to nothing.  A disabled probe
+ * is a single nop in the instruction stream.  All probes belong to the
+ * "proton" provider:
+ *
+ *   frame_start(transport, channel, performative, size)   frame_done(transport, err)
+ *   phase_start(transport, name)                          phase_done(transport, name, endpoints)
+ *   event_put(collector, type)
+ *   link_send(link, size)                                 link_recv(link, size, result)
+ *   ssl_input_start(transport, available)                 ssl_input_done(transport, consumed)
+ *   ssl_output_start(transport, max)                      ssl_output_done(transport, written)
+ *
+ * link_send fires for pn_link_send(), pn_link_send_shared() and the calls
+ * built on them, and for pn_message_send(), with the bytes sent.
+ *
+ * For example, time spent per process phase:
+ *
+ *   bpftrace -e 'usdt:libqpid-proton.so:proton:phase_start { @s[tid] = nsecs; }
+ *                usdt:libqpid-proton.so:proton:phase_done /@s[tid]/
+ *                { @ns[str(arg1)] = hist(nsecs - @s[tid]); delete(@s[tid]); }'
+ */
+
+#ifdef PNI_PROBES
+
+#include <sys/sdt.h>
+
+#define PNI_PROBE1(name, a) DTRACE_PROBE1(proton, name, a)
+#define PNI_PROBE2(name, a, b) DTRACE_PROBE2(proton, name, a, b)
+#define PNI_PROBE3(name, a, b, c) DTRACE_PROBE3(proton, name, a, b, c)
+#define PNI_PROBE4(name, a, b, c, d) DTRACE_PROBE4(proton, name, a, b, c, d)
+
+#else
+
+#define PNI_PROBE1(name, a) ((void)0)
+#define PNI_PROBE2(name, a, b) ((void)0)
+#define PNI_PROBE3(name, a, b, c) ((void)0)
+#define PNI_PROBE4(name, a, b, c, d) ((void)0)
+
+#endif
+
+#endif /* probes.h */
@@ -0,0 +1,254 @@
+#ifndef _PROTON_SRC_READER_H
+#define _PROTON_SRC_READER_H 1
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Read AMQP encoded values straight from the bytes, for the generated
+ * performative decoders in performatives.h.
+ *
+ * Each pni_read_... function reads one value of the expected type and
+ * returns true, or returns false and leaves the reader unchanged if the
+ * next value has some other encoding or runs past the end.  Callers fall
+ * back to pn_data_t for anything these don't handle.
+ */
+
+#include <proton/types.h>
+#include "encodings.h"
+
+typedef struct pni_reader_t {
+  const uint8_t *pos;
+  const uint8_t *end;
+} pni_reader_t;
+
+static inline pni_reader_t pni_reader(const char *start, size_t size) {
+  pni_reader_t r;
+  r.pos = (const uint8_t *) start;
+  r.end = r.pos + size;
+  return r;
+}
+
+static inline uint32_t pni_reader_u32(const uint8_t *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline uint64_t pni_reader_u64(const uint8_t *p) {
+  return ((uint64_t) pni_reader_u32(p) << 32) | pni_reader_u32(p + 4);
+}
+
+static inline bool pni_reader_has(const pni_reader_t *r, size_t n) {
+  return (size_t)(r->end - r->pos) >= n;
+}
+
+static inline bool pni_read_null(pni_reader_t *r) {
+  if (r->pos < r->end && *r->pos == PNE_NULL) {
+    ++r->pos;
+    return true;
+  }
+  return false;
+}
+
+static inline bool pni_read_bool(pni_reader_t *r, bool *v) {
+  if (!pni_reader_has(r, 1)) return false;
+  switch (*r->pos) {
+   case PNE_TRUE: *v = true; r->pos += 1; return true;
+   case PNE_FALSE: *v = false; r->pos += 1; return true;
+   case PNE_BOOLEAN:
+    if (!pni_reader_has(r, 2)) return false;
+    *v = r->pos[1] != 0;
+    r->pos += 2;
+    return true;
+   default: return false;
+  }
+}
+
+static inline bool pni_read_ubyte(pni_reader_t *r, uint8_t *v) {
+  if (!pni_reader_has(r, 2) || *r->pos != PNE_UBYTE) return false;
+  *v = r->pos[1];
+  r->pos += 2;
+  return true;
+}
+
+static inline bool pni_read_ushort(pni_reader_t *r, uint16_t *v) {
+  if (!pni_reader_has(r, 3) || *r->pos != PNE_USHORT) return false;
+  *v = (uint16_t)((r->pos[1] << 8) | r->pos[2]);
+  r->pos += 3;
+  return true;
+}
+
+static inline bool pni_read_uint(pni_reader_t *r, uint32_t *v) {
+  if (!pni_reader_has(r, 1)) return false;
+  switch (*r->pos) {
+   case PNE_UINT0: *v = 0; r->pos += 1; return true;
+   case PNE_SMALLUINT:
+    if (!pni_reader_has(r, 2)) return false;
+    *v = r->pos[1];
+    r->pos += 2;
+    return true;
+   case PNE_UINT:
+    if (!pni_reader_has(r, 5)) return false;
+    *v = pni_reader_u32(r->pos + 1);
+    r->pos += 5;
+    return true;
+   default: return false;
+  }
+}
+
+static inline bool pni_read_ulong(pni_reader_t *r, uint64_t *v) {
+  if (!pni_reader_has(r, 1)) return false;
+  switch (*r->pos) {
+   case PNE_ULONG0: *v = 0; r->pos += 1; return true;
+   case PNE_SMALLULONG:
+    if (!pni_reader_has(r, 2)) return false;
+    *v = r->pos[1];
+    r->pos += 2;
+    return true;
+   case PNE_ULONG:
+    if (!pni_reader_has(r, 9)) return false;
+    *v = pni_reader_u64(r->pos + 1);
+    r->pos += 9;
+    return true;
+   default: return false;
+  }
+}
+
+/* Variable width values with a one or four byte size */
+static inline bool pni_read_variable(pni_reader_t *r, uint8_t code8, uint8_t code32, pn_bytes_t *v) {
+  size_t size, header;
+  if (!pni_reader_has(r, 2)) return false;
+  if (*r->pos == code8) {
+    header = 2;
+    size = r->pos[1];
+  } else if (*r->pos == code32 && pni_reader_has(r, 5)) {
+    header = 5;
+    size = pni_reader_u32(r->pos + 1);
+  } else {
+    return false;
+  }
+  if (!pni_reader_has(r, header) || (size_t)(r->end - r->pos) - header < size) return false;
+  *v = pn_bytes(size, (const char *) r->pos + header);
+  r->pos += header + size;
+  return true;
+}
+
+static inline bool pni_read_binary(pni_reader_t *r, pn_bytes_t *v) {
+  return pni_read_variable(r, PNE_VBIN8, PNE_VBIN32, v);
+}
+
+static inline bool pni_read_string(pni_reader_t *r, pn_bytes_t *v) {
+  return pni_read_variable(r, PNE_STR8_UTF8, PNE_STR32_UTF8, v);
+}
+
+static inline bool pni_read_symbol(pni_reader_t *r, pn_bytes_t *v) {
+  return pni_read_variable(r, PNE_SYM8, PNE_SYM32, v);
+}
+
+/* Skip n values of any type, checking only that their sizes fit */
+static inline bool pni_skip_values(pni_reader_t *r, size_t n) {
+  const uint8_t *pos = r->pos;
+  while (n) {
+    if (pos >= r->end) return false;
+    uint8_t code = *pos++;
+    size_t avail = r->end - pos, size, header = 0;
+    switch (code >> 4) {
+     case 0x0:
+      if (code != PNE_DESCRIPTOR) return false;
+      ++n;                      /* The descriptor then the value */
+      continue;
+     case 0x4: size = 0; break;
+     case 0x5: size = 1; break;
+     case 0x6: size = 2; break;
+     case 0x7: size = 4; break;
+     case 0x8: size = 8; break;
+     case 0x9: size = 16; break;
+     case 0xa: case 0xc: case 0xe:
+      if (avail < 1) return false;
+      header = 1;
+      size = pos[0];
+      break;
+     case 0xb: case 0xd: case 0xf:
+      if (avail < 4) return false;
+      header = 4;
+      size = pni_reader_u32(pos);
+      break;
+     default: return false;
+    }
+    if (avail - header < size) return false;
+    pos += header + size;
+    --n;
+  }
+  r->pos = pos;
+  return true;
+}
+
+/* The encoded bytes of the next value, whatever its type */
+static inline bool pni_read_raw(pni_reader_t *r, pn_bytes_t *v) {
+  const uint8_t *start = r->pos;
+  if (!pni_skip_values(r, 1)) return false;
+  *v = pn_bytes(r->pos - start, (const char *) start);
+  return true;
+}
+
+/* A value described by a numeric descriptor: read the code and leave the
+   reader at the value */
+static inline bool pni_read_descriptor(pni_reader_t *r, uint64_t *code) {
+  pni_reader_t d = *r;
+  if (!pni_reader_has(&d, 1) || *d.pos != PNE_DESCRIPTOR) return false;
+  ++d.pos;
+  if (!pni_read_ulong(&d, code)) return false;
+  *r = d;
+  return true;
+}
+
+/* Enter a list: *fields reads its elements, r moves past it */
+static inline bool pni_read_list(pni_reader_t *r, pni_reader_t *fields, uint32_t *count) {
+  /* The size follows the header and covers the count and the elements */
+  size_t header, first, size;
+  if (!pni_reader_has(r, 1)) return false;
+  switch (*r->pos) {
+   case PNE_LIST0:
+    header = first = 1;
+    size = 0;
+    *count = 0;
+    break;
+   case PNE_LIST8:
+    if (!pni_reader_has(r, 3)) return false;
+    header = 2;
+    first = 3;
+    size = r->pos[1];
+    *count = r->pos[2];
+    break;
+   case PNE_LIST32:
+    if (!pni_reader_has(r, 9)) return false;
+    header = 5;
+    first = 9;
+    size = pni_reader_u32(r->pos + 1);
+    *count = pni_reader_u32(r->pos + 5);
+    break;
+   default: return false;
+  }
+  if (size < first - header || (size_t)(r->end - r->pos) - header < size) return false;
+  fields->pos = r->pos + first;
+  fields->end = r->pos + header + size;
+  r->pos = fields->end;
+  return true;
+}
+
+#endif /* reader.h */
@@ -27,10 +27,15 @@
 #include "ssl/ssl-internal.h"
 
 #include "autodetect.h"
+#include "byteorder.h"
 #include "protocol.h"
 #include "dispatch_actions.h"
 #include "config.h"
+#include "data.h"
 #include "log_private.h"
+#include "emitters.h"
+#include "formats.h"
+#include "probes.h"
 
 #include "proton/event.h"
 
@@ -39,8 +44,10 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <time.h>
 
 static ssize_t transport_consume(pn_transport_t *transport);
+static void pni_input_emptied(pn_transport_t *transport);
 
 // delivery buffers
 
@@ -71,26 +78,62 @@ static void pni_calculate_channel_max(pn_transport_t *transport) {
   }
 }
 
+#define PNI_DELIVERY_MAP_INITIAL_CAPACITY 16
+
 void pn_delivery_map_init(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  db->deliveries = pn_hash(PN_WEAKREF, 0, 0.75);
   db->next = next;
+  db->lwm = next;
+  db->first = 0;
+  db->capacity = 0;
+  db->count = 0;
+  db->deliveries = NULL;
 }
 
 void pn_delivery_map_free(pn_delivery_map_t *db)
 {
-  pn_free(db->deliveries);
+  free(db->deliveries);
 }
 
-static inline uintptr_t pni_sequence_make_hash ( pn_sequence_t i )
+static inline pn_delivery_t **pni_delivery_map_slot(pn_delivery_map_t *db, pn_sequence_t id)
 {
-  return i & 0x00000000FFFFFFFFUL;
+  return &db->deliveries[(db->first + (pn_sequence_t)(id - db->lwm)) & (db->capacity - 1)];
 }
 
-
 static pn_delivery_t *pni_delivery_map_get(pn_delivery_map_t *db, pn_sequence_t id)
 {
-  return (pn_delivery_t *) pn_hash_get(db->deliveries, pni_sequence_make_hash(id) );
+  // Unsigned arithmetic, ids below lwm wrap to large offsets
+  if ((pn_sequence_t)(id - db->lwm) >= (pn_sequence_t)(db->next - db->lwm)) return NULL;
+  return *pni_delivery_map_slot(db, id);
+}
+
+// Narrow [*first, *last] to the ids the map holds, false if none remain
+static bool pni_delivery_map_clamp(pn_delivery_map_t *db, pn_sequence_t *first, pn_sequence_t *last)
+{
+  if (db->lwm == db->next) return false;
+  if ((int32_t)(*first - db->lwm) < 0) *first = db->lwm;
+  if ((int32_t)(*last - (db->next - 1)) > 0) *last = db->next - 1;
+  return (int32_t)(*last - *first) >= 0;
+}
+
+// Make room for ids up to and including db->next
+static bool pni_delivery_map_reserve(pn_delivery_map_t *db)
+{
+  size_t span = (pn_sequence_t)(db->next - db->lwm) + 1;
+  if (span <= db->capacity) return true;
+
+  size_t capacity = db->capacity ? db->capacity : PNI_DELIVERY_MAP_INITIAL_CAPACITY;
+  while (capacity < span) capacity *= 2;
+  pn_delivery_t **deliveries = (pn_delivery_t **) calloc(capacity, sizeof(pn_delivery_t *));
+  if (!deliveries) return false;
+  for (size_t i = 0; i + 1 < span; ++i) {
+    deliveries[i] = db->deliveries[(db->first + i) & (db->capacity - 1)];
+  }
+  free(db->deliveries);
+  db->deliveries = deliveries;
+  db->capacity = capacity;
+  db->first = 0;
+  return true;
 }
 
 static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *delivery, pn_sequence_t id)
@@ -102,9 +145,17 @@ static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *deliv
 
 static pn_delivery_state_t *pni_delivery_map_push(pn_delivery_map_t *db, pn_delivery_t *delivery)
 {
+  if (!db->count) {
+    // Empty, restart the window at next, which the session may have moved
+    db->lwm = db->next;
+    db->first = 0;
+  }
   pn_delivery_state_t *ds = &delivery->state;
+  if (pni_delivery_map_reserve(db)) {
+    *pni_delivery_map_slot(db, db->next) = delivery;
+    db->count++;
+  }
   pn_delivery_state_init(ds, delivery, db->next++);
-  pn_hash_put(db->deliveries, pni_sequence_make_hash(ds->id), delivery);
   return ds;
 }
 
@@ -113,26 +164,84 @@ void pn_delivery_map_del(pn_delivery_map_t *db, pn_delivery_t *delivery)
   if (delivery->state.init) {
     delivery->state.init = false;
     delivery->state.sent = false;
-    pn_hash_del(db->deliveries, pni_sequence_make_hash(delivery->state.id) );
+    pn_sequence_t id = delivery->state.id;
+    if (pni_delivery_map_get(db, id) == delivery) {
+      *pni_delivery_map_slot(db, id) = NULL;
+      db->count--;
+      // Move the window past settled ids, each id is passed over once
+      while (db->lwm != db->next && !db->deliveries[db->first]) {
+        db->first = (db->first + 1) & (db->capacity - 1);
+        db->lwm++;
+      }
+    }
   }
 }
 
 static void pni_delivery_map_clear(pn_delivery_map_t *dm)
 {
-  pn_hash_t *hash = dm->deliveries;
-  for (pn_handle_t entry = pn_hash_head(hash);
-       entry;
-       entry = pn_hash_next(hash, entry))
-  {
-    pn_delivery_t *dlv = (pn_delivery_t *) pn_hash_value(hash, entry);
-    pn_delivery_map_del(dm, dlv);
+  // The window always starts at a mapped delivery
+  while (dm->count) {
+    pn_delivery_map_del(dm, dm->deliveries[dm->first]);
   }
   dm->next = 0;
+  dm->lwm = 0;
+  dm->first = 0;
 }
 
+// Keep the deliveries on the wire for the links to resume on the next
+// transport, see pni_delivery_resume()
+static void pni_link_suspend(pn_link_t *link)
+{
+  for (pn_delivery_t *d = link->unsettled_head; d; d = d->unsettled_next) {
+    if (d->state.init || (d->resume != PNI_RESUME_NONE && d->resume != PNI_RESUME_DONE)) {
+      if (d->resume != PNI_RESUME_WAIT && d->resume != PNI_RESUME_EXPECT) link->resuming++;
+      d->resume = PNI_RESUME_WAIT;
+    }
+  }
+}
+
+static pn_delivery_t *pni_link_resuming(pn_link_t *link, pn_bytes_t tag, pni_resume_t resume)
+{
+  for (pn_delivery_t *d = link->unsettled_head; d; d = d->unsettled_next) {
+    if (d->resume == resume && d->tag_size == tag.size && (!tag.size || !memcmp(d->tag, tag.start, tag.size)))
+      return d;
+  }
+  return NULL;
+}
+
+// Resume the deliveries from the old transport with the peer's unsettled
+// map. A tag the peer does not have is one it never got or has settled.
+static void pni_link_resume(pn_link_t *link, pn_data_t *unsettled)
+{
+  pn_data_rewind(unsettled);
+  if (pn_data_next(unsettled) && pn_data_type(unsettled) == PN_MAP) {
+    pn_data_enter(unsettled);
+    while (pn_data_next(unsettled)) {
+      pn_bytes_t tag = pn_data_type(unsettled) == PN_BINARY ? pn_data_get_binary(unsettled) : pn_bytes(0, NULL);
+      if (!pn_data_next(unsettled)) break;
+      uint64_t outcome = 0;
+      if (pn_data_is_described(unsettled)) {
+        pn_data_enter(unsettled);
+        if (pn_data_next(unsettled) && pn_data_type(unsettled) == PN_ULONG)
+          outcome = pn_data_get_ulong(unsettled);
+        pn_data_exit(unsettled);
+      }
+      pn_delivery_t *delivery = pni_link_resuming(link, tag, PNI_RESUME_WAIT);
+      if (delivery) pni_delivery_resume(delivery, true, outcome);
+    }
+    pn_data_exit(unsettled);
+  }
+  pn_delivery_t *next;
+  for (pn_delivery_t *d = link->unsettled_head; d; d = next) {
+    next = d->unsettled_next;
+    if (d->resume == PNI_RESUME_WAIT) pni_delivery_resume(d, false, 0);
+  }
+}
+
+// Through the logger, so traces are queued when it writes asynchronously
 static void pni_default_tracer(pn_transport_t *transport, const char *message)
 {
-  fprintf(stderr, "[%p]:%s\n", (void *) transport, message);
+  pn_logf_impl("[%p]:%s", (void *) transport, message);
 }
 
 static ssize_t pn_io_layer_input_passthru(pn_transport_t *, unsigned int, const char *, size_t );
@@ -152,6 +261,7 @@ static void pn_error_amqp(pn_transport_t *transport, unsigned int layer);
 static pn_timestamp_t pn_tick_amqp(pn_transport_t *transport, unsigned int layer, pn_timestamp_t now);
 
 static ssize_t pn_io_layer_input_autodetect(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available);
+static ssize_t pn_io_layer_input_pinned_amqp(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available);
 static ssize_t pn_io_layer_output_null(pn_transport_t *transport, unsigned int layer, char *bytes, size_t available);
 
 const pn_io_layer_t amqp_header_layer = {
@@ -202,6 +312,15 @@ const pn_io_layer_t pni_autodetect_layer = {
     NULL
 };
 
+// Server AMQP header layer of a pinned stack: answer once the header is read
+const pn_io_layer_t pni_pinned_amqp_layer = {
+    pn_io_layer_input_pinned_amqp,
+    pn_io_layer_output_null,
+    NULL,
+    NULL,
+    NULL
+};
+
 const pn_io_layer_t pni_passthru_layer = {
     pn_io_layer_input_passthru,
     pn_io_layer_output_passthru,
@@ -231,10 +350,25 @@ static void pn_io_layer_setup(pn_transport_t *transport, unsigned int layer)
 {
   assert(layer == 0);
   // Figure out if we are server or not
-  if (transport->server) {
+  if (transport->server && transport->autodetect) {
       transport->io_layers[layer++] = &pni_autodetect_layer;
       return;
   }
+  if (transport->server) {
+    // Pinned stack: expect exactly the configured layers, the server
+    // writes each header after reading the client's
+    transport->allowed_layers = LAYER_NONE;
+    if (transport->ssl) {
+      transport->present_layers |= LAYER_SSL;
+      transport->io_layers[layer++] = &ssl_layer;
+    }
+    if (transport->sasl) {
+      transport->present_layers |= LAYER_AMQPSASL;
+      transport->io_layers[layer++] = &sasl_server_header_layer;
+    }
+    transport->io_layers[layer++] = &pni_pinned_amqp_layer;
+    return;
+  }
   if (transport->ssl) {
     transport->io_layers[layer++] = &ssl_layer;
   }
@@ -265,11 +399,30 @@ void pn_set_error_layer(pn_transport_t *transport)
   }
 }
 
+// Refuse a server connection reaching AMQP without the required security
+static bool pni_check_security_policy(pn_transport_t *transport)
+{
+  if (transport->auth_required && !pn_transport_is_authenticated(transport)) {
+    pn_do_error(transport, "amqp:connection:policy-error",
+                "Client skipped authentication - forbidden");
+    pn_set_error_layer(transport);
+    return false;
+  }
+  if (transport->encryption_required && !pn_transport_is_encrypted(transport)) {
+    pn_do_error(transport, "amqp:connection:policy-error",
+                "Client connection unencryted - forbidden");
+    pn_set_error_layer(transport);
+    return false;
+  }
+  return true;
+}
+
 // Autodetect the layer by reading the protocol header
 ssize_t pn_io_layer_input_autodetect(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available)
 {
   const char* error;
-  bool eos = pn_transport_capacity(transport)==PN_EOS;
+  // Not pn_transport_capacity(), that may grow the input buffer under bytes
+  bool eos = transport->tail_closed;
   if (eos && available==0) {
     pn_do_error(transport, "amqp:connection:framing-error", "No valid protocol header found");
     pn_set_error_layer(transport);
@@ -328,18 +481,7 @@ ssize_t pn_io_layer_input_autodetect(pn_transport_t *transport, unsigned int lay
     }
     transport->present_layers |= LAYER_AMQP1;
     transport->allowed_layers = LAYER_NONE;
-    if (transport->auth_required && !pn_transport_is_authenticated(transport)) {
-      pn_do_error(transport, "amqp:connection:policy-error",
-                  "Client skipped authentication - forbidden");
-      pn_set_error_layer(transport);
-      return 8;
-    }
-    if (transport->encryption_required && !pn_transport_is_encrypted(transport)) {
-      pn_do_error(transport, "amqp:connection:policy-error",
-                  "Client connection unencryted - forbidden");
-      pn_set_error_layer(transport);
-      return 8;
-    }
+    if (!pni_check_security_policy(transport)) return 8;
     transport->io_layers[layer] = &amqp_write_header_layer;
     if (transport->trace & PN_TRACE_FRM)
         pn_transport_logf(transport, "  <- %s", "AMQP");
@@ -365,6 +507,16 @@ ssize_t pn_io_layer_input_autodetect(pn_transport_t *transport, unsigned int lay
   return 0;
 }
 
+// Read the AMQP header of a pinned server stack, no other protocol is accepted
+ssize_t pn_io_layer_input_pinned_amqp(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available)
+{
+  ssize_t n = pn_input_read_amqp_header(transport, layer, bytes, available);
+  if (n <= 0) return n;
+  transport->present_layers |= LAYER_AMQP1;
+  pni_check_security_policy(transport);
+  return n;
+}
+
 // We don't know what the output should be - do nothing
 ssize_t pn_io_layer_output_null(pn_transport_t *transport, unsigned int layer, char *bytes, size_t available)
 {
@@ -399,14 +551,17 @@ ssize_t pn_io_layer_output_error(pn_transport_t *transport, unsigned int layer,
     return PN_EOS;
 }
 
+#define PN_TRANSPORT_IO_BUF_SIZE (PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024)
+
 static void pn_transport_initialize(void *object)
 {
   pn_transport_t *transport = (pn_transport_t *)object;
   transport->freed = false;
+  // The I/O buffers are allocated on first use, see pn_transport_capacity()
   transport->output_buf = NULL;
-  transport->output_size = PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024;
+  transport->output_size = 0;
   transport->input_buf = NULL;
-  transport->input_size =  PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024;
+  transport->input_size = 0;
   transport->tracer = pni_default_tracer;
   transport->sasl = NULL;
   transport->ssl = NULL;
@@ -414,9 +569,27 @@ static void pn_transport_initialize(void *object)
   transport->scratch = pn_string(NULL);
   transport->args = pn_data(16);
   transport->output_args = pn_data(16);
+  pni_data_trim_nulls(transport->output_args);
   transport->frame = pn_buffer(PN_TRANSPORT_INITIAL_FRAME_SIZE);
+  transport->output_head = NULL;
+  transport->output_tail = NULL;
+  transport->output_spare = NULL;
+  transport->available = 0;
+  transport->output_limit = PN_TRANSPORT_OUTPUT_LIMIT;
+  transport->interleave = false;
+  transport->validate_text = false;
+  transport->phase_stats = NULL;
+  transport->frame_ring = NULL;
+  transport->frame_ring_size = 0;
+  transport->frame_seq = 0;
+  transport->frame_capture = NULL;
+  transport->frame_capture_context = NULL;
   transport->input_frames_ct = 0;
   transport->output_frames_ct = 0;
+  transport->deliveries_input = 0;
+  transport->deliveries_output = 0;
+  memset(transport->performative_frames, 0, sizeof(transport->performative_frames));
+  memset(transport->performative_bytes, 0, sizeof(transport->performative_bytes));
 
   transport->connection = NULL;
   transport->context = pn_record();
@@ -463,10 +636,14 @@ static void pn_transport_initialize(void *object)
   transport->last_bytes_input = 0;
   transport->remote_idle_timeout = 0;
   transport->keepalive_deadline = 0;
+  transport->disp_delay = 0;
+  transport->disp_limit = PN_TRANSPORT_DISPOSITION_LIMIT;
+  transport->disp_deadline = 0;
   transport->last_bytes_output = 0;
-  transport->remote_offered_capabilities = pn_data(0);
-  transport->remote_desired_capabilities = pn_data(0);
-  transport->remote_properties = pn_data(0);
+  // Created when the peer's open arrives or the application asks
+  transport->remote_offered_capabilities = NULL;
+  transport->remote_desired_capabilities = NULL;
+  transport->remote_properties = NULL;
   transport->disp_data = pn_data(0);
   pn_condition_init(&transport->remote_condition);
   pn_condition_init(&transport->condition);
@@ -474,18 +651,27 @@ static void pn_transport_initialize(void *object)
 
   transport->local_channels = pn_hash(PN_WEAKREF, 0, 0.75);
   transport->remote_channels = pn_hash(PN_WEAKREF, 0, 0.75);
+  transport->local_channel_hint = 0;
+  transport->remote_channel_index.slots = NULL;
+  transport->remote_channel_index.size = 0;
 
   transport->bytes_input = 0;
   transport->bytes_output = 0;
 
+  transport->input_head = 0;
   transport->input_pending = 0;
+  transport->input_peak = 0;
+  transport->input_idle = 0;
   transport->output_pending = 0;
 
   transport->done_processing = false;
 
   transport->posted_idle_timeout = false;
+  transport->disp_expired = false;
+  transport->disp_hold = false;
 
   transport->server = false;
+  transport->autodetect = true;
   transport->halt = false;
   transport->auth_required = false;
   transport->authenticated = false;
@@ -501,15 +687,61 @@ static void pn_transport_initialize(void *object)
 }
 
 
+void pni_alias_index_put(pni_alias_index_t *index, uintptr_t alias, void *value)
+{
+  if (alias >= PNI_ALIAS_INDEX_MAX) return;
+  if (alias >= index->size) {
+    size_t size = index->size ? index->size : 16;
+    while (size <= alias) size *= 2;
+    void **slots = (void **) realloc(index->slots, size * sizeof(void *));
+    if (!slots) return;         // the hash still has it
+    memset(slots + index->size, 0, (size - index->size) * sizeof(void *));
+    index->slots = slots;
+    index->size = size;
+  }
+  index->slots[alias] = value;
+}
+
+void pni_alias_index_del(pni_alias_index_t *index, uintptr_t alias)
+{
+  if (alias < index->size) index->slots[alias] = NULL;
+}
+
+static void pni_alias_index_clear(pni_alias_index_t *index)
+{
+  if (index->size) memset(index->slots, 0, index->size * sizeof(void *));
+}
+
+void pni_alias_index_free(pni_alias_index_t *index)
+{
+  free(index->slots);
+  index->slots = NULL;
+  index->size = 0;
+}
+
+void pni_release_alias(uint32_t *hint, uintptr_t alias)
+{
+  if (alias < *hint) *hint = alias;
+}
+
+static inline void *pni_alias_index_get(pni_alias_index_t *index, pn_hash_t *hash, uintptr_t alias)
+{
+  if (alias < PNI_ALIAS_INDEX_MAX) {
+    return alias < index->size ? index->slots[alias] : NULL;
+  }
+  return pn_hash_get(hash, alias);
+}
+
 static pn_session_t *pni_channel_state(pn_transport_t *transport, uint16_t channel)
 {
-  return (pn_session_t *) pn_hash_get(transport->remote_channels, channel);
+  return (pn_session_t *) pni_alias_index_get(&transport->remote_channel_index, transport->remote_channels, channel);
 }
 
 static void pni_map_remote_channel(pn_session_t *session, uint16_t channel)
 {
   pn_transport_t *transport = session->connection->transport;
   pn_hash_put(transport->remote_channels, channel, session);
+  pni_alias_index_put(&transport->remote_channel_index, channel, session);
   session->state.remote_channel = channel;
   pn_ep_incref(&session->endpoint);
 }
@@ -521,9 +753,11 @@ static void pni_unmap_remote_channel(pn_session_t *ssn)
   // XXX: should really update link state also
   pni_delivery_map_clear(&ssn->state.incoming);
   pni_transport_unbind_handles(ssn->state.remote_handles, false);
+  pni_alias_index_clear(&ssn->state.remote_handle_index);
   pn_transport_t *transport = ssn->connection->transport;
   uint16_t channel = ssn->state.remote_channel;
   ssn->state.remote_channel = -2;
+  pni_alias_index_del(&transport->remote_channel_index, channel);
   if (pn_hash_get(transport->remote_channels, channel)) {
     pn_ep_decref(&ssn->endpoint);
   }
@@ -547,6 +781,7 @@ static void pn_transport_incref(void *object)
 }
 
 static void pn_transport_finalize(void *object);
+static void pni_phase_stats_log(pn_transport_t *transport);
 #define pn_transport_new pn_object_new
 #define pn_transport_refcount pn_object_refcount
 #define pn_transport_decref pn_object_decref
@@ -562,28 +797,6 @@ pn_transport_t *pn_transport(void)
 #undef pn_transport_free
   pn_transport_t *transport =
     (pn_transport_t *) pn_class_new(&clazz, sizeof(pn_transport_t));
-  if (!transport) return NULL;
-
-  transport->output_buf = (char *) malloc(transport->output_size);
-  if (!transport->output_buf) {
-    pn_transport_free(transport);
-    return NULL;
-  }
-
-  transport->input_buf = (char *) malloc(transport->input_size);
-  if (!transport->input_buf) {
-    pn_transport_free(transport);
-    return NULL;
-  }
-
-  transport->capacity = 4*1024;
-  transport->available = 0;
-  transport->output = (char *) malloc(transport->capacity);
-  if (!transport->output) {
-    pn_transport_free(transport);
-    return NULL;
-  }
-
   return transport;
 }
 
@@ -593,6 +806,12 @@ void pn_transport_set_server(pn_transport_t *transport)
   transport->server = true;
 }
 
+void pn_transport_set_autodetect(pn_transport_t *transport, bool autodetect)
+{
+  assert(transport);
+  transport->autodetect = autodetect;
+}
+
 const char *pn_transport_get_user(pn_transport_t *transport)
 {
   assert(transport);
@@ -660,6 +879,7 @@ static void pn_transport_finalize(void *object)
   // we may have posted events, so stay alive until they are processed
   if (pn_refcount(transport) > 0) return;
 
+  if (transport->phase_stats) pni_phase_stats_log(transport);
   pn_ssl_free(transport);
   pn_sasl_free(transport);
   free(transport->remote_container);
@@ -673,6 +893,7 @@ static void pn_transport_finalize(void *object)
   pn_error_free(transport->error);
   pn_free(transport->local_channels);
   pn_free(transport->remote_channels);
+  pni_alias_index_free(&transport->remote_channel_index);
   if (transport->input_buf) free(transport->input_buf);
   if (transport->output_buf) free(transport->output_buf);
   pn_free(transport->scratch);
@@ -680,7 +901,15 @@ static void pn_transport_finalize(void *object)
   pn_data_free(transport->output_args);
   pn_buffer_free(transport->frame);
   pn_free(transport->context);
-  free(transport->output);
+  while (transport->output_head) {
+    pni_output_chunk_t *chunk = transport->output_head;
+    transport->output_head = chunk->next;
+    free(chunk);
+  }
+  free(transport->output_spare);
+  free(transport->phase_stats);
+  free(transport->frame_ring);
+  pn_transport_set_frame_capture(transport, NULL, NULL);
 }
 
 static void pni_post_remote_open_events(pn_transport_t *transport, pn_connection_t *connection) {
@@ -706,7 +935,7 @@ int pn_transport_bind(pn_transport_t *transport, pn_connection_t *connection)
   pn_connection_bound(connection);
 
   // set the hostname/user/password
-  if (pn_string_size(connection->auth_user)) {
+  if (connection->auth_user && pn_string_size(connection->auth_user)) {
     pn_sasl(transport);
     pni_sasl_set_user_password(transport, pn_string_get(connection->auth_user), pn_string_get(connection->auth_password));
   }
@@ -759,6 +988,8 @@ void pni_transport_unbind_channels(pn_hash_t *channels)
     pni_delivery_map_clear(&ssn->state.outgoing);
     pni_transport_unbind_handles(ssn->state.local_handles, true);
     pni_transport_unbind_handles(ssn->state.remote_handles, true);
+    pni_alias_index_clear(&ssn->state.remote_handle_index);
+    ssn->state.local_handle_hint = 0;
     pn_session_unbound(ssn);
     pn_ep_decref(&ssn->endpoint);
     pn_hash_del(channels, key);
@@ -777,6 +1008,11 @@ int pn_transport_unbind(pn_transport_t *transport)
 
   pn_collector_put(conn->collector, PN_OBJECT, conn, PN_CONNECTION_UNBOUND);
 
+  for (pn_link_t *link = conn->link_head; link; link = link->link_next) {
+    pni_link_unpark_tpwork(link);
+    pni_link_suspend(link);
+  }
+
   // XXX: what happens if the endpoints are freed before we get here?
   pn_session_t *ssn = pn_session_head(conn, 0);
   while (ssn) {
@@ -793,7 +1029,9 @@ int pn_transport_unbind(pn_transport_t *transport)
   }
 
   pni_transport_unbind_channels(transport->local_channels);
+  transport->local_channel_hint = 0;
   pni_transport_unbind_channels(transport->remote_channels);
+  pni_alias_index_clear(&transport->remote_channel_index);
 
   pn_connection_unbound(conn);
   if (was_referenced) {
@@ -825,6 +1063,7 @@ static void pni_map_remote_handle(pn_link_t *link, uint32_t handle)
 {
   link->state.remote_handle = handle;
   pn_hash_put(link->session->state.remote_handles, handle, link);
+  pni_alias_index_put(&link->session->state.remote_handle_index, handle, link);
   pn_ep_incref(&link->endpoint);
 }
 
@@ -832,6 +1071,7 @@ static void pni_unmap_remote_handle(pn_link_t *link)
 {
   uintptr_t handle = link->state.remote_handle;
   link->state.remote_handle = -2;
+  pni_alias_index_del(&link->session->state.remote_handle_index, handle);
   if (pn_hash_get(link->session->state.remote_handles, handle)) {
     pn_ep_decref(&link->endpoint);
   }
@@ -841,7 +1081,7 @@ static void pni_unmap_remote_handle(pn_link_t *link)
 
 static pn_link_t *pni_handle_state(pn_session_t *ssn, uint32_t handle)
 {
-  return (pn_link_t *) pn_hash_get(ssn->state.remote_handles, handle);
+  return (pn_link_t *) pni_alias_index_get(&ssn->state.remote_handle_index, ssn->state.remote_handles, handle);
 }
 
 bool pni_disposition_batchable(pn_disposition_t *disposition)
@@ -856,6 +1096,13 @@ bool pni_disposition_batchable(pn_disposition_t *disposition)
   }
 }
 
+// Dispositions without data leave it unallocated, see pn_disposition_data()
+static int pni_disposition_set_data(pn_disposition_t *disposition, pn_data_t *src)
+{
+  if (!disposition->data && !pn_data_size(src)) return 0;
+  return pn_data_copy(pn_disposition_data(disposition), src);
+}
+
 static int pni_disposition_encode(pn_disposition_t *disposition, pn_data_t *data)
 {
   pn_condition_t *cond = &disposition->condition;
@@ -871,17 +1118,17 @@ static int pni_disposition_encode(pn_disposition_t *disposition, pn_data_t *data
   case PN_RELEASED:
     return 0;
   case PN_REJECTED:
-    return pn_data_fill(data, "[?DL[sSC]]", pn_condition_is_set(cond), ERROR,
+    return pni_data_fill_format(data, &PNI_FILL_REJECTED, pn_condition_is_set(cond), ERROR,
                  pn_condition_get_name(cond),
                  pn_condition_get_description(cond),
                  pn_condition_info(cond));
   case PN_MODIFIED:
-    return pn_data_fill(data, "[ooC]",
+    return pni_data_fill_format(data, &PNI_FILL_MODIFIED,
                  disposition->failed,
                  disposition->undeliverable,
                  disposition->annotations);
   default:
-    return pn_data_copy(data, disposition->data);
+    return disposition->data ? pn_data_copy(data, disposition->data) : 0;
   }
 }
 
@@ -908,14 +1155,184 @@ void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
   }
 }
 
-int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...)
+void pni_record_frame(pn_transport_t *transport, pn_dir_t dir, uint8_t type, uint16_t ch,
+                      uint8_t performative, size_t size, size_t payload)
+{
+  pn_frame_record_t *r = &transport->frame_ring[transport->frame_seq % transport->frame_ring_size];
+  r->sequence = transport->frame_seq++;
+  r->time = pn_i_now();
+  r->size = size;
+  r->payload = payload;
+  r->channel = ch;
+  r->type = type;
+  r->performative = performative;
+  r->outgoing = dir == OUT;
+}
+
+int pn_transport_record_frames(pn_transport_t *transport, size_t capacity)
+{
+  assert(transport);
+  pn_frame_record_t *ring = NULL;
+  if (capacity) {
+    ring = (pn_frame_record_t *) malloc(capacity * sizeof(pn_frame_record_t));
+    if (!ring) return PN_OUT_OF_MEMORY;
+  }
+  free(transport->frame_ring);
+  transport->frame_ring = ring;
+  transport->frame_ring_size = capacity;
+  transport->frame_seq = 0;
+  return 0;
+}
+
+size_t pn_transport_frame_records(pn_transport_t *transport, uint64_t from,
+                                  pn_frame_record_t *records, size_t max)
+{
+  assert(transport);
+  uint64_t end = transport->frame_seq;
+  uint64_t oldest = end > transport->frame_ring_size ? end - transport->frame_ring_size : 0;
+  uint64_t seq = from > oldest ? from : oldest;
+  size_t n = 0;
+  for (; seq < end && n < max; ++seq, ++n) {
+    records[n] = transport->frame_ring[seq % transport->frame_ring_size];
+  }
+  return n;
+}
+
+void pn_transport_set_frame_capture(pn_transport_t *transport, pn_frame_capture_t capture, void *context)
+{
+  assert(transport);
+  if (transport->frame_capture) {
+    pni_capture_frame(transport, IN, NULL, 0);
+  }
+  transport->frame_capture = capture;
+  transport->frame_capture_context = context;
+}
+
+static const char PNI_CAPTURE_MAGIC[8] = {'P', 'N', 'C', 'A', 'P', '0', '1', '\n'};
+
+static void pni_capture_to_file(pn_transport_t *transport, void *context, bool outgoing,
+                                const char *frame, size_t size)
+{
+  FILE *file = (FILE *) context;
+  if (!frame) {
+    fclose(file);
+    return;
+  }
+  char header[13];
+  header[0] = outgoing ? 1 : 0;
+  pni_write64(header + 1, (uint64_t) pn_i_now());
+  pni_write32(header + 9, (uint32_t) size);
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(frame, size, 1, file);
+}
+
+int pn_transport_capture_file(pn_transport_t *transport, const char *path)
+{
+  assert(transport);
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    pn_transport_logf(transport, "cannot create frame capture file %s", path);
+    return PN_ERR;
+  }
+  fwrite(PNI_CAPTURE_MAGIC, sizeof(PNI_CAPTURE_MAGIC), 1, file);
+  pn_transport_set_frame_capture(transport, pni_capture_to_file, file);
+  return 0;
+}
+
+// The descriptor code of an encoded performative, 0 if it has none
+static uint8_t pni_performative_code(const pn_bytes_t *body)
+{
+  const uint8_t *p = (const uint8_t *) body->start;
+  if (body->size >= 3 && p[0] == 0 && p[1] == PNE_SMALLULONG) return p[2];
+  if (body->size >= 10 && p[0] == 0 && p[1] == PNE_ULONG) return p[9];
+  return 0;
+}
+
+// Keep one standard sized chunk for reuse, free the rest
+void pni_output_chunk_release(pn_transport_t *transport, pni_output_chunk_t *chunk)
+{
+  if (!transport->output_spare && chunk->size == PN_TRANSPORT_OUTPUT_CHUNK_SIZE) {
+    transport->output_spare = chunk;
+  } else {
+    free(chunk);
+  }
+}
+
+// Return room for size contiguous bytes at the end of the pending output,
+// adding a chunk if the last one is too full
+static char *pni_reserve_output(pn_transport_t *transport, size_t size)
+{
+  pni_output_chunk_t *tail = transport->output_tail;
+  if (tail && tail->size - tail->end >= size) {
+    return pni_output_chunk_bytes(tail) + tail->end;
+  }
+
+  pni_output_chunk_t *chunk = NULL;
+  if (size <= PN_TRANSPORT_OUTPUT_CHUNK_SIZE && transport->output_spare) {
+    chunk = transport->output_spare;
+    transport->output_spare = NULL;
+  } else {
+    size_t chunk_size = pn_max(size, PN_TRANSPORT_OUTPUT_CHUNK_SIZE);
+    chunk = (pni_output_chunk_t *) malloc(sizeof(pni_output_chunk_t) + chunk_size);
+    if (!chunk) return NULL;
+    chunk->size = chunk_size;
+  }
+  chunk->next = NULL;
+  chunk->start = chunk->end = 0;
+  if (tail) {
+    tail->next = chunk;
+  } else {
+    transport->output_head = chunk;
+  }
+  transport->output_tail = chunk;
+  return pni_output_chunk_bytes(chunk);
+}
+
+// True when enough output is pending that no more transfers should be framed
+static inline bool pni_output_full(pn_transport_t *transport)
+{
+  return transport->output_limit && transport->available >= transport->output_limit;
+}
+
+// Frame the body segments directly into the pending output, so the
+// payload is only copied once on its way out
+static int pni_write_output_frame(pn_transport_t *transport, uint8_t type, uint16_t ch,
+                                  const pn_bytes_t *segments, size_t count)
+{
+  size_t size = AMQP_HEADER_SIZE;
+  for (size_t i = 0; i < count; ++i) {
+    size += segments[i].size;
+  }
+  char *output = pni_reserve_output(transport, size);
+  if (!output) {
+    pn_transport_logf(transport, "error posting frame: %s", pn_code(PN_OUT_OF_MEMORY));
+    return PN_ERR;
+  }
+
+  size_t n = pni_write_frame_segments(output, size, type, ch, segments, count);
+  assert(n == size);
+  transport->output_frames_ct += 1;
+  uint8_t code = count ? pni_performative_code(&segments[0]) : 0;
+  if (type == AMQP_FRAME_TYPE) pni_count_performative(transport, OUT, code, n);
+  if (transport->frame_ring) {
+    pni_record_frame(transport, OUT, type, ch, code, n, count ? n - AMQP_HEADER_SIZE - segments[0].size : 0);
+  }
+  if (transport->frame_capture) pni_capture_frame(transport, OUT, output, n);
+  if (transport->trace & PN_TRACE_RAW) {
+    pn_string_set(transport->scratch, "RAW: \"");
+    pn_quote(transport->scratch, output, n);
+    pn_string_addf(transport->scratch, "\"");
+    pn_transport_log(transport, pn_string_get(transport->scratch));
+  }
+  transport->output_tail->end += n;
+  transport->available += n;
+  return 0;
+}
+
+// Encode and write the performative filled into transport->output_args
+static int pni_post_output_args(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, int err)
 {
   pn_buffer_t *frame_buf = transport->frame;
-  va_list ap;
-  va_start(ap, fmt);
-  pn_data_clear(transport->output_args);
-  int err = pn_data_vfill(transport->output_args, fmt, ap);
-  va_end(ap);
   if (err) {
     pn_transport_logf(transport,
                       "error posting frame: %s, %s: %s", fmt, pn_code(err),
@@ -941,27 +1358,62 @@ int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const ch
     return PN_ERR;
   }
 
-  pn_frame_t frame = {0,};
-  frame.type = type;
-  frame.channel = ch;
-  frame.payload = buf.start;
-  frame.size = wr;
-  size_t n;
-  while (!(n = pn_write_frame(transport->output + transport->available,
-                              transport->capacity - transport->available, frame))) {
-    transport->capacity *= 2;
-    transport->output = (char *) realloc(transport->output, transport->capacity);
-  }
-  transport->output_frames_ct += 1;
-  if (transport->trace & PN_TRACE_RAW) {
-    pn_string_set(transport->scratch, "RAW: \"");
-    pn_quote(transport->scratch, transport->output + transport->available, n);
-    pn_string_addf(transport->scratch, "\"");
-    pn_transport_log(transport, pn_string_get(transport->scratch));
-  }
-  transport->available += n;
+  pn_bytes_t body = {wr, buf.start};
+  return pni_write_output_frame(transport, type, ch, &body, 1);
+}
 
-  return 0;
+int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  pn_data_clear(transport->output_args);
+  int err = pn_data_vfill(transport->output_args, fmt, ap);
+  va_end(ap);
+  return pni_post_output_args(transport, type, ch, fmt, err);
+}
+
+int pni_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const pni_format_t *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  pn_data_clear(transport->output_args);
+  int err = pni_data_vfill_format(transport->output_args, format, ap);
+  va_end(ap);
+  return pni_post_output_args(transport, type, ch, format->source, err);
+}
+
+// The delivery tag is the only variable length field of a transfer without
+// delivery state, so the performative is encoded directly rather than
+// through pn_data_t. Returns the encoded size and the offset of the 'more'
+// flag so it can be patched in place, or PN_OVERFLOW if buf is too small.
+static ssize_t pni_encode_transfer(pn_rwbytes_t buf, uint32_t handle, pn_sequence_t id,
+                                   const pn_bytes_t *tag, uint32_t message_format,
+                                   bool settled, bool more, size_t *more_flag_pos)
+{
+  pni_emitter_t emitter = pni_emitter(buf);
+  pni_compound_context performative = {0, 0};
+  emit_descriptor(&emitter, &performative, TRANSFER);
+  pni_compound_context list = emit_list_begin(&emitter);
+  emit_uint(&emitter, &list, handle);
+  emit_uint(&emitter, &list, id);
+  emit_binary(&emitter, &list, *tag);
+  emit_uint(&emitter, &list, message_format);
+  emit_bool(&emitter, &list, settled);
+  emit_bool(&emitter, &list, more);
+  emit_list_end(&emitter, &performative, &list);
+  if (pni_emitter_overflow(&emitter)) return PN_OVERFLOW;
+  // The last byte, wherever compacting the list left it
+  *more_flag_pos = emitter.position - 1;
+  return emitter.position;
+}
+
+// The largest transfer frame to send, 0 for no limit
+static uint32_t pni_transfer_max_frame(pn_transport_t *transport)
+{
+  uint32_t max_frame = transport->remote_max_frame;
+  if (transport->interleave && (!max_frame || max_frame > PN_TRANSPORT_INTERLEAVE_FRAME_SIZE))
+    max_frame = PN_TRANSPORT_INTERLEAVE_FRAME_SIZE;
+  return max_frame;
 }
 
 static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
@@ -974,95 +1426,87 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
                                         bool more,
                                         pn_sequence_t frame_limit,
                                         uint64_t code,
-                                        pn_data_t* state)
+                                        pn_data_t* state,
+                                        bool resume)
 {
   bool more_flag = more;
   int framecount = 0;
   pn_buffer_t *frame = transport->frame;
+  // Only transfers carrying a delivery state or resuming one need the general encoder
+  const bool direct = !code && !resume;
+  const bool traced = transport->trace & PN_TRACE_FRM;
+  size_t more_flag_pos = 0;
+  uint32_t max_frame = pni_transfer_max_frame(transport);
 
   // create preformatives, assuming 'more' flag need not change
 
  compute_performatives:
-  pn_data_clear(transport->output_args);
-  int err = pn_data_fill(transport->output_args, "DL[IIzIoon?DLC]", TRANSFER,
-                         handle, id, tag->size, tag->start,
-                         message_format,
-                         settled, more_flag, (bool)code, code, state);
-  if (err) {
-    pn_transport_logf(transport,
-                      "error posting transfer frame: %s: %s", pn_code(err),
-                      pn_error_text(pn_data_error(transport->output_args)));
-    return PN_ERR;
+  if (!direct || traced) {
+    pn_data_clear(transport->output_args);
+    int err = pni_data_fill_format(transport->output_args, &PNI_FILL_TRANSFER, TRANSFER,
+                           handle, id, tag->size, tag->start,
+                           message_format,
+                           settled, more_flag, (bool)code, code, state, resume, resume);
+    if (err) {
+      pn_transport_logf(transport,
+                        "error posting transfer frame: %s: %s", pn_code(err),
+                        pn_error_text(pn_data_error(transport->output_args)));
+      return PN_ERR;
+    }
   }
 
-  do { // send as many frames as possible without changing the 'more' flag...
-
-  encode_performatives:
-    pn_buffer_clear( frame );
-    pn_rwbytes_t buf = pn_buffer_memory( frame );
-    buf.size = pn_buffer_available( frame );
+ encode_performatives:
+  pn_buffer_clear( frame );
+  pn_rwbytes_t buf = pn_buffer_memory( frame );
+  buf.size = pn_buffer_available( frame );
 
-    ssize_t wr = pn_data_encode(transport->output_args, buf.start, buf.size);
-    if (wr < 0) {
-      if (wr == PN_OVERFLOW) {
-        pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
-        goto encode_performatives;
-      }
-      pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
-      return PN_ERR;
+  ssize_t wr = direct
+    ? pni_encode_transfer(buf, handle, id, tag, message_format, settled, more_flag, &more_flag_pos)
+    : pn_data_encode(transport->output_args, buf.start, buf.size);
+  if (wr < 0) {
+    if (wr == PN_OVERFLOW) {
+      pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
+      goto encode_performatives;
     }
-    buf.size = wr;
+    pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
+    return PN_ERR;
+  }
+  buf.size = wr;
+
+  do { // send as many frames as possible without changing the 'more' flag...
 
     // check if we need to break up the outbound frame
     size_t available = payload->size;
-    if (transport->remote_max_frame) {
-      if ((available + buf.size) > transport->remote_max_frame - 8) {
-        available = transport->remote_max_frame - 8 - buf.size;
-        if (more_flag == false) {
-          more_flag = true;
-          goto compute_performatives;  // deal with flag change
-        }
+    if (max_frame) {
+      bool flag = more_flag;
+      if ((available + buf.size) > max_frame - 8) {
+        available = max_frame - 8 - buf.size;
+        flag = true;
       } else if (more_flag == true && more == false) {
         // caller has no more, and this is the last frame
-        more_flag = false;
-        goto compute_performatives;
+        flag = false;
+      }
+      if (flag != more_flag) {
+        more_flag = flag;
+        if (direct && !traced) {
+          // both values encode as a single byte so patch in place
+          buf.start[more_flag_pos] = more_flag ? PNE_TRUE : PNE_FALSE;
+        } else {
+          goto compute_performatives;  // deal with flag change
+        }
       }
-    }
-
-    if (pn_buffer_available( frame ) < (available + buf.size)) {
-      // not enough room for payload - try again...
-      pn_buffer_ensure( frame, available + buf.size );
-      goto encode_performatives;
     }
 
     pn_do_trace(transport, ch, OUT, transport->output_args, payload->start, available);
 
-    memmove( buf.start + buf.size, payload->start, available);
+    // the performative and the payload slice go out as separate segments
+    pn_bytes_t body[2] = {{buf.size, buf.start}, {available, payload->start}};
+    int err = pni_write_output_frame(transport, AMQP_FRAME_TYPE, ch, body, 2);
+    if (err) return err;
     payload->start += available;
     payload->size -= available;
-    buf.size += available;
-
-    pn_frame_t frame = {AMQP_FRAME_TYPE};
-    frame.channel = ch;
-    frame.payload = buf.start;
-    frame.size = buf.size;
-
-    size_t n;
-    while (!(n = pn_write_frame(transport->output + transport->available,
-                                transport->capacity - transport->available, frame))) {
-      transport->capacity *= 2;
-      transport->output = (char *) realloc(transport->output, transport->capacity);
-    }
-    transport->output_frames_ct += 1;
     framecount++;
-    if (transport->trace & PN_TRACE_RAW) {
-      pn_string_set(transport->scratch, "RAW: \"");
-      pn_quote(transport->scratch, transport->output + transport->available, n);
-      pn_string_addf(transport->scratch, "\"");
-      pn_transport_log(transport, pn_string_get(transport->scratch));
-    }
-    transport->available += n;
-  } while (payload->size > 0 && framecount < frame_limit);
+  } while (payload->size > 0 && framecount < frame_limit && !pni_output_full(transport));
 
   return framecount;
 }
@@ -1081,7 +1525,7 @@ static int pni_post_close(pn_transport_t *transport, pn_condition_t *cond)
     info = pn_condition_info(cond);
   }
 
-  return pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "DL[?DL[sSC]]", CLOSE,
+  return pni_post_frame(transport, AMQP_FRAME_TYPE, 0, &PNI_FILL_CLOSE, CLOSE,
                        (bool) condition, ERROR, condition, description, info);
 }
 
@@ -1167,10 +1611,10 @@ int pn_do_open(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
   uint16_t remote_channel_max;
   uint32_t remote_max_frame;
   pn_bytes_t remote_container, remote_hostname;
-  pn_data_clear(transport->remote_offered_capabilities);
-  pn_data_clear(transport->remote_desired_capabilities);
-  pn_data_clear(transport->remote_properties);
-  int err = pn_data_scan(args, "D.[?S?S?I?HI..CCC]",
+  pn_data_clear(pni_data_lazy(&transport->remote_offered_capabilities));
+  pn_data_clear(pni_data_lazy(&transport->remote_desired_capabilities));
+  pn_data_clear(pni_data_lazy(&transport->remote_properties));
+  int err = pni_data_scan_format(args, &PNI_SCAN_OPEN,
                          &container_q, &remote_container,
                          &hostname_q, &remote_hostname,
                          &remote_max_frame_q, &remote_max_frame,
@@ -1228,7 +1672,7 @@ int pn_do_begin(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
   bool reply;
   uint16_t remote_channel;
   pn_sequence_t next;
-  int err = pn_data_scan(args, "D.[?HI]", &reply, &remote_channel, &next);
+  int err = pni_data_scan_format(args, &PNI_SCAN_BEGIN, &reply, &remote_channel, &next);
   if (err) return err;
 
   // AMQP 1.0 section 2.7.1 - if the peer doesn't honor our channel_max --
@@ -1268,16 +1712,14 @@ pn_link_t *pn_find_link(pn_session_t *ssn, pn_bytes_t name, bool is_sender)
 {
   pn_endpoint_type_t type = is_sender ? SENDER : RECEIVER;
 
-  for (size_t i = 0; i < pn_list_size(ssn->links); i++)
+  for (pn_link_t *link = pni_link_named(ssn, name, NULL); link; link = pni_link_named(ssn, name, link))
   {
-    pn_link_t *link = (pn_link_t *) pn_list_get(ssn->links, i);
     if (link->endpoint.type == type &&
         // This function is used to locate the link object for an
         // incoming attach. If a link object of the same name is found
         // which is closed both locally and remotely, assume that is
         // no longer in use.
-        !((link->endpoint.state & PN_LOCAL_CLOSED) && (link->endpoint.state & PN_REMOTE_CLOSED)) &&
-        pn_bytes_equal(name, pn_string_bytes(link->name)))
+        !((link->endpoint.state & PN_LOCAL_CLOSED) && (link->endpoint.state & PN_REMOTE_CLOSED)))
     {
       return link;
     }
@@ -1349,7 +1791,7 @@ int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
   bool snd_settle, rcv_settle;
   uint8_t snd_settle_mode, rcv_settle_mode;
   uint64_t max_msgsz;
-  int err = pn_data_scan(args, "D.[SIo?B?BD.[SIsIo.s]D.[SIsIo]..IL]", &name, &handle,
+  int err = pni_data_scan_format(args, &PNI_SCAN_ATTACH, &name, &handle,
                          &is_sender,
                          &snd_settle, &snd_settle_mode,
                          &rcv_settle, &rcv_settle_mode,
@@ -1407,7 +1849,7 @@ int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
   } else {
     uint64_t code = 0;
     pn_data_clear(link->remote_target.capabilities);
-    err = pn_data_scan(args, "D.[.....D..DL[C]...]", &code,
+    err = pni_data_scan_format(args, &PNI_SCAN_ATTACH_TERMINUS_TYPE, &code,
                        link->remote_target.capabilities);
     if (err) return err;
     if (code == COORDINATOR) {
@@ -1431,7 +1873,7 @@ int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
   pn_data_clear(link->remote_target.properties);
   pn_data_clear(link->remote_target.capabilities);
 
-  err = pn_data_scan(args, "D.[.....D.[.....C.C.CC]D.[.....CC]",
+  err = pni_data_scan_format(args, &PNI_SCAN_ATTACH_TERMINI,
                      link->remote_source.properties,
                      link->remote_source.filter,
                      link->remote_source.outcomes,
@@ -1455,6 +1897,13 @@ int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
     link->remote_max_message_size = max_msgsz;
   }
 
+  if (link->resuming) {
+    pn_data_clear(transport->disp_data);
+    err = pni_data_scan_format(args, &PNI_SCAN_ATTACH_UNSETTLED, transport->disp_data);
+    if (err) return err;
+    pni_link_resume(link, transport->disp_data);
+  }
+
   pn_collector_put(transport->connection->collector, PN_OBJECT, link, PN_LINK_REMOTE_OPEN);
   return 0;
 }
@@ -1473,19 +1922,31 @@ static void pn_full_settle(pn_delivery_map_t *db, pn_delivery_t *delivery)
 
 int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  // XXX: multi transfer
-  uint32_t handle;
-  pn_bytes_t tag;
+  pni_transfer_t transfer;
   bool id_present;
-  pn_sequence_t id;
-  bool settled;
-  bool more;
   bool has_type;
   uint64_t type;
+  memset(&transfer, 0, sizeof(transfer));
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[I?Iz.oo.D?LC]", &handle, &id_present, &id, &tag,
-                         &settled, &more, &has_type, &type, transport->disp_data);
+  int err = pni_data_scan_format(args, &PNI_SCAN_TRANSFER, &transfer.handle, &id_present, &transfer.delivery_id,
+                         &transfer.delivery_tag, &transfer.message_format, &transfer.settled, &transfer.more, &has_type, &type,
+                         transport->disp_data, &transfer.resume);
   if (err) return err;
+  if (id_present) transfer.present |= 1u << TRANSFER_DELIVERY_ID;
+  return pni_do_transfer(transport, channel, &transfer, has_type, type, payload);
+}
+
+// The delivery state, if any, is in transport->disp_data
+int pni_do_transfer(pn_transport_t *transport, uint16_t channel, const pni_transfer_t *transfer,
+                    bool has_type, uint64_t type, const pn_bytes_t *payload)
+{
+  // XXX: multi transfer
+  uint32_t handle = transfer->handle;
+  pn_bytes_t tag = transfer->delivery_tag;
+  bool id_present = PNI_PRESENT(transfer, TRANSFER_DELIVERY_ID);
+  pn_sequence_t id = transfer->delivery_id;
+  bool settled = transfer->settled;
+  bool more = transfer->more;
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
     return pn_do_error(transport, "amqp:not-allowed", "no such channel: %u", channel);
@@ -1499,10 +1960,8 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
   if (!link) {
     return pn_do_error(transport, "amqp:invalid-field", "no such handle: %u", handle);
   }
-  pn_delivery_t *delivery;
-  if (link->unsettled_tail && !link->unsettled_tail->done) {
-    delivery = link->unsettled_tail;
-  } else {
+  pn_delivery_t *delivery = link->partial;
+  if (!delivery) {
     pn_delivery_map_t *incoming = &ssn->state.incoming;
 
     if (!ssn->state.incoming_init) {
@@ -1511,7 +1970,19 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
       ssn->incoming_deliveries++;
     }
 
-    delivery = pn_delivery(link, pn_dtag(tag.start, tag.size));
+    // One from the old transport coming again, see pni_delivery_resume()
+    delivery = transfer->resume && link->resuming ? pni_link_resuming(link, tag, PNI_RESUME_EXPECT) : NULL;
+    if (delivery) {
+      delivery->resume = PNI_RESUME_NONE;
+      link->resuming--;
+      // It all comes again: start over on a part, drop the repeat of the whole
+      if (!delivery->done) pn_buffer_clear(delivery->bytes);
+    } else {
+      delivery = pn_delivery(link, pn_dtag(tag.start, tag.size));
+      delivery->message_format = transfer->message_format;
+      link->queued++;
+      transport->deliveries_input++;
+    }
     pn_delivery_state_t *state = pni_delivery_map_push(incoming, delivery);
     if (id_present && id != state->id) {
       return pn_do_error(transport, "amqp:session:invalid-field",
@@ -1520,12 +1991,11 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     }
     if (has_type) {
       delivery->remote.type = type;
-      pn_data_copy(delivery->remote.data, transport->disp_data);
+      pni_disposition_set_data(&delivery->remote, transport->disp_data);
     }
 
     link->state.delivery_count++;
     link->state.link_credit--;
-    link->queued++;
 
     // XXX: need to fill in remote state: delivery->remote.state = ...;
     delivery->remote.settled = settled;
@@ -1535,9 +2005,13 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     }
   }
 
-  pn_buffer_append(delivery->bytes, payload->start, payload->size);
-  ssn->incoming_bytes += payload->size;
-  delivery->done = !more;
+  if (!delivery->done) {
+    pni_delivery_append(delivery, payload->start, payload->size);
+    ssn->incoming_bytes += payload->size;
+    delivery->done = !more;
+  }
+  if (payload->size > ssn->incoming_frame_max) ssn->incoming_frame_max = payload->size;
+  link->partial = more ? delivery : NULL;
 
   ssn->state.incoming_transfer_count++;
   ssn->state.incoming_window--;
@@ -1553,14 +2027,29 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
 int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  pn_sequence_t onext, inext, delivery_count;
-  uint32_t iwin, owin, link_credit;
-  uint32_t handle;
-  bool inext_init, handle_init, dcount_init, drain;
-  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &inext_init, &inext, &iwin,
-                         &onext, &owin, &handle_init, &handle, &dcount_init,
-                         &delivery_count, &link_credit, &drain);
+  pni_flow_t flow;
+  bool inext_init, handle_init, dcount_init;
+  memset(&flow, 0, sizeof(flow));
+  int err = pni_data_scan_format(args, &PNI_SCAN_FLOW, &inext_init, &flow.next_incoming_id,
+                         &flow.incoming_window, &flow.next_outgoing_id, &flow.outgoing_window,
+                         &handle_init, &flow.handle, &dcount_init, &flow.delivery_count,
+                         &flow.link_credit, &flow.drain);
   if (err) return err;
+  if (inext_init) flow.present |= 1u << FLOW_NEXT_INCOMING_ID;
+  if (handle_init) flow.present |= 1u << FLOW_HANDLE;
+  if (dcount_init) flow.present |= 1u << FLOW_DELIVERY_COUNT;
+  return pni_do_flow(transport, channel, &flow);
+}
+
+int pni_do_flow(pn_transport_t *transport, uint16_t channel, const pni_flow_t *flow)
+{
+  pn_sequence_t inext = flow->next_incoming_id, delivery_count = flow->delivery_count;
+  uint32_t iwin = flow->incoming_window, link_credit = flow->link_credit;
+  uint32_t handle = flow->handle;
+  bool inext_init = PNI_PRESENT(flow, FLOW_NEXT_INCOMING_ID);
+  bool handle_init = PNI_PRESENT(flow, FLOW_HANDLE);
+  bool dcount_init = PNI_PRESENT(flow, FLOW_DELIVERY_COUNT);
+  bool drain = flow->drain;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1590,6 +2079,7 @@ int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
       link->state.link_credit = receiver_count + link_credit - link->state.delivery_count;
       link->credit += link->state.link_credit - old;
       link->drain = drain;
+      if (link->state.link_credit > 0) pni_link_unpark_tpwork(link);
       pn_delivery_t *delivery = pn_link_current(link);
       if (delivery) pn_work_update(transport->connection, delivery);
     } else {
@@ -1608,19 +2098,19 @@ int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
   return 0;
 }
 
-#define SCAN_ERROR_DEFAULT ("D.[D.[sSC]")
-#define SCAN_ERROR_DETACH ("D.[..D.[sSC]")
-#define SCAN_ERROR_DISP ("[D.[sSC]")
+#define SCAN_ERROR_DEFAULT (&PNI_SCAN_ERROR_DEFAULT)
+#define SCAN_ERROR_DETACH (&PNI_SCAN_ERROR_DETACH)
+#define SCAN_ERROR_DISP (&PNI_SCAN_ERROR_DISP)
 
-static int pn_scan_error(pn_data_t *data, pn_condition_t *condition, const char *fmt)
+static int pn_scan_error(pn_data_t *data, pn_condition_t *condition, const pni_format_t *format)
 {
   pn_bytes_t cond;
   pn_bytes_t desc;
   pn_condition_clear(condition);
-  int err = pn_data_scan(data, fmt, &cond, &desc, condition->info);
+  int err = pni_data_scan_format(data, format, &cond, &desc, pni_data_lazy(&condition->info));
   if (err) return err;
-  pn_string_setn(condition->name, cond.start, cond.size);
-  pn_string_setn(condition->description, desc.start, desc.size);
+  if (cond.start) pn_string_setn(pni_string_lazy(&condition->name), cond.start, cond.size);
+  if (desc.start) pn_string_setn(pni_string_lazy(&condition->description), desc.start, desc.size);
   pn_data_rewind(condition->info);
   return 0;
 }
@@ -1636,16 +2126,28 @@ static inline int sequence_cmp(pn_sequence_t a, pn_sequence_t b) {
 
 int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  bool role;
-  pn_sequence_t first, last;
+  pni_disposition_t disposition;
   uint64_t type = 0;
-  bool last_init, settled, type_init;
+  bool last_init, type_init;
+  memset(&disposition, 0, sizeof(disposition));
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &role, &first, &last_init,
-                         &last, &settled, &type_init, &type,
+  int err = pni_data_scan_format(args, &PNI_SCAN_DISPOSITION, &disposition.role, &disposition.first, &last_init,
+                         &disposition.last, &disposition.settled, &type_init, &type,
                          transport->disp_data);
   if (err) return err;
-  if (!last_init) last = first;
+  if (last_init) disposition.present |= 1u << DISPOSITION_LAST;
+  return pni_do_disposition(transport, channel, &disposition, type_init, type);
+}
+
+// The delivery state, if any, is in transport->disp_data
+int pni_do_disposition(pn_transport_t *transport, uint16_t channel, const pni_disposition_t *disposition,
+                       bool type_init, uint64_t type)
+{
+  int err = 0;
+  bool role = disposition->role;
+  pn_sequence_t first = disposition->first;
+  pn_sequence_t last = PNI_PRESENT(disposition, DISPOSITION_LAST) ? (pn_sequence_t) disposition->last : first;
+  bool settled = disposition->settled;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1663,54 +2165,83 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
   bool remote_data = (pn_data_next(transport->disp_data) &&
                       pn_data_get_list(transport->disp_data) > 0);
 
+  // Decode the fixed state fields once for the whole range
+  uint32_t section_number = 0;
+  uint64_t section_offset = 0;
+  bool section_number_init = false, section_offset_init = false;
+  bool failed = false, undeliverable = false;
+  bool failed_init = false, undeliverable_init = false;
+  if (remote_data && (type == PN_RECEIVED || type == PN_MODIFIED)) {
+    pn_data_rewind(transport->disp_data);
+    pn_data_next(transport->disp_data);
+    pn_data_enter(transport->disp_data);
+    if (type == PN_RECEIVED) {
+      if ((section_number_init = pn_data_next(transport->disp_data)))
+        section_number = pn_data_get_uint(transport->disp_data);
+      if ((section_offset_init = pn_data_next(transport->disp_data)))
+        section_offset = pn_data_get_ulong(transport->disp_data);
+    } else {
+      if ((failed_init = pn_data_next(transport->disp_data)))
+        failed = pn_data_get_bool(transport->disp_data);
+      if ((undeliverable_init = pn_data_next(transport->disp_data)))
+        undeliverable = pn_data_get_bool(transport->disp_data);
+    }
+    pn_data_exit(transport->disp_data);
+  }
+
+  // Only ids inside the map window can name a delivery, so a wide range
+  // costs no more than the deliveries it actually settles
+  if (!pni_delivery_map_clamp(deliveries, &first, &last)) return 0;
+
+  pn_condition_t *condition = NULL;
   for (pn_sequence_t id = first; sequence_cmp(id, last) <= 0; ++id) {
-    pn_delivery_t *delivery = pni_delivery_map_get(deliveries, id);
+    pn_delivery_t *delivery = *pni_delivery_map_slot(deliveries, id);
+    if (!delivery) continue;
     pn_disposition_t *remote = &delivery->remote;
-    if (delivery) {
-      if (type_init) remote->type = type;
-      if (remote_data) {
-        switch (type) {
-        case PN_RECEIVED:
-          pn_data_rewind(transport->disp_data);
-          pn_data_next(transport->disp_data);
-          pn_data_enter(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->section_number = pn_data_get_uint(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->section_offset = pn_data_get_ulong(transport->disp_data);
-          break;
-        case PN_ACCEPTED:
-          break;
-        case PN_REJECTED:
+    if (type_init) remote->type = type;
+    if (remote_data) {
+      switch (type) {
+      case PN_RECEIVED:
+        if (section_number_init) remote->section_number = section_number;
+        if (section_offset_init) remote->section_offset = section_offset;
+        break;
+      case PN_ACCEPTED:
+        break;
+      case PN_REJECTED:
+        if (condition) {
+          err = pn_condition_copy(&remote->condition, condition);
+        } else {
           err = pn_scan_error(transport->disp_data, &remote->condition, SCAN_ERROR_DISP);
-          if (err) return err;
-          break;
-        case PN_RELEASED:
-          break;
-        case PN_MODIFIED:
-          pn_data_rewind(transport->disp_data);
-          pn_data_next(transport->disp_data);
-          pn_data_enter(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->failed = pn_data_get_bool(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->undeliverable = pn_data_get_bool(transport->disp_data);
-          pn_data_narrow(transport->disp_data);
-          pn_data_clear(remote->data);
-          pn_data_appendn(remote->annotations, transport->disp_data, 1);
-          pn_data_widen(transport->disp_data);
-          break;
-        default:
-          pn_data_copy(remote->data, transport->disp_data);
-          break;
+          condition = &remote->condition;
         }
+        if (err) return err;
+        break;
+      case PN_RELEASED:
+        break;
+      case PN_MODIFIED:
+        if (failed_init) remote->failed = failed;
+        if (undeliverable_init) remote->undeliverable = undeliverable;
+        pn_data_rewind(transport->disp_data);
+        pn_data_next(transport->disp_data);
+        pn_data_enter(transport->disp_data);
+        pn_data_next(transport->disp_data);
+        pn_data_next(transport->disp_data);
+        pn_data_narrow(transport->disp_data);
+        pn_data_clear(remote->data);
+        pn_data_clear(pn_disposition_annotations(remote));
+        pn_data_appendn(remote->annotations, transport->disp_data, 1);
+        pn_data_widen(transport->disp_data);
+        break;
+      default:
+        pni_disposition_set_data(remote, transport->disp_data);
+        break;
       }
-      remote->settled = settled;
-      delivery->updated = true;
-      pn_work_update(transport->connection, delivery);
-
-      pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
     }
+    remote->settled = settled;
+    delivery->updated = true;
+    pn_work_update(transport->connection, delivery);
+
+    pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
   }
 
   return 0;
@@ -1720,7 +2251,7 @@ int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
 {
   uint32_t handle;
   bool closed;
-  int err = pn_data_scan(args, "D.[Io]", &handle, &closed);
+  int err = pni_data_scan_format(args, &PNI_SCAN_DETACH, &handle, &closed);
   if (err) return err;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
@@ -1814,15 +2345,18 @@ static ssize_t transport_consume(pn_transport_t *transport)
   }
 
   size_t consumed = 0;
+  if (transport->input_pending > transport->input_peak)
+    transport->input_peak = transport->input_pending;
 
   while (transport->input_pending || transport->tail_closed) {
     ssize_t n;
     n = transport->io_layers[0]->
       process_input( transport, 0,
-                     transport->input_buf + consumed,
+                     transport->input_buf + transport->input_head,
                      transport->input_pending );
     if (n > 0) {
       consumed += n;
+      transport->input_head += n;
       transport->input_pending -= n;
     } else if (n == 0) {
       break;
@@ -1831,13 +2365,14 @@ static ssize_t transport_consume(pn_transport_t *transport)
       if (transport->trace & (PN_TRACE_RAW | PN_TRACE_FRM))
         pn_transport_log(transport, "  <- EOS");
       transport->input_pending = 0;  // XXX ???
+      transport->input_head = 0;
       return n;
     }
   }
 
-  if (transport->input_pending && consumed) {
-    memmove( transport->input_buf,  &transport->input_buf[consumed], transport->input_pending );
-  }
+  // Unconsumed input stays where it is, see pn_transport_capacity()
+  if (consumed && !transport->input_pending)
+    pni_input_emptied(transport);
 
   return consumed;
 }
@@ -1856,7 +2391,7 @@ static int pni_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endp
       pn_connection_t *connection = (pn_connection_t *) endpoint;
       const char *cid = pn_string_get(connection->container);
       pni_calculate_channel_max(transport);
-      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "DL[SS?I?H?InnCCC]", OPEN,
+      int err = pni_post_frame(transport, AMQP_FRAME_TYPE, 0, &PNI_FILL_OPEN, OPEN,
                               cid ? cid : "",
                               pn_string_get(connection->hostname),
                               // if not zero, advertise our max frame size and idle timeout
@@ -1874,11 +2409,15 @@ static int pni_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endp
   return 0;
 }
 
-static uint16_t allocate_alias(pn_hash_t *aliases, uint32_t max_index, int * valid)
+// Aliases below *hint are normally all in use, so the search starts there.
+// It wraps round in case one was released without lowering the hint.
+static uint16_t allocate_alias(pn_hash_t *aliases, uint32_t max_index, uint32_t *hint, int * valid)
 {
-  for (uint32_t i = 0; i <= max_index; i++) {
+  for (uint32_t n = 0; n <= max_index; n++) {
+    uint32_t i = (*hint + n) % (max_index + 1);
     if (!pn_hash_get(aliases, i)) {
       * valid = 1;
+      *hint = i + 1;
       return i;
     }
   }
@@ -1892,22 +2431,41 @@ static size_t pni_session_outgoing_window(pn_session_t *ssn)
   return ssn->outgoing_window;
 }
 
+// The transfers that fit in what is left of the incoming capacity. Frames are
+// at most the max frame size, or with none, for a budgeted session, as big as
+// the biggest yet. Nothing buffered always leaves room for one frame.
 static size_t pni_session_incoming_window(pn_session_t *ssn)
 {
   uint32_t size = ssn->connection->transport->local_max_frame;
+  if (!size && ssn->incoming_budget) {
+    size = ssn->incoming_frame_max ? ssn->incoming_frame_max : PN_SESSION_BUDGET_FRAME_SIZE;
+  }
   if (!size) {
     return 2147483647; // biggest legal value
+  } else if ((size_t) ssn->incoming_bytes >= ssn->incoming_capacity) {
+    return 0;
   } else {
-    return (ssn->incoming_capacity - ssn->incoming_bytes)/size;
+    size_t window = (ssn->incoming_capacity - ssn->incoming_bytes)/size;
+    if (window > 2147483647) window = 2147483647;
+    return window || ssn->incoming_bytes ? window : 1;
   }
 }
 
+// True when the peer should be sent a fresh incoming window: it is used up, or
+// the application has read enough that it could be more than doubled
+bool pni_session_window_low(pn_session_t *ssn)
+{
+  if (!ssn->state.incoming_window) return true;
+  if (!ssn->connection->transport) return false;
+  return (size_t) ssn->state.incoming_window < pni_session_incoming_window(ssn) / 2;
+}
+
 static int pni_map_local_channel(pn_session_t *ssn)
 {
   pn_transport_t *transport = ssn->connection->transport;
   pn_session_state_t *state = &ssn->state;
   int valid;
-  uint16_t channel = allocate_alias(transport->local_channels, transport->channel_max, & valid);
+  uint16_t channel = allocate_alias(transport->local_channels, transport->channel_max, &transport->local_channel_hint, & valid);
   if (!valid) {
     return 0;
   }
@@ -1931,7 +2489,7 @@ static int pni_process_ssn_setup(pn_transport_t *transport, pn_endpoint_t *endpo
       }
       state->incoming_window = pni_session_incoming_window(ssn);
       state->outgoing_window = pni_session_outgoing_window(ssn);
-      pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[?HIII]", BEGIN,
+      pni_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, &PNI_FILL_BEGIN, BEGIN,
                     ((int16_t) state->remote_channel >= 0), state->remote_channel,
                     state->outgoing_transfer_count,
                     state->incoming_window,
@@ -1963,7 +2521,7 @@ static int pni_map_local_handle(pn_link_t *link) {
   pn_session_state_t *ssn_state = &link->session->state;
   int valid;
   // XXX TODO MICK: once changes are made to handle_max, change this hardcoded value to something reasonable.
-  state->local_handle = allocate_alias(ssn_state->local_handles, 65536, & valid);
+  state->local_handle = allocate_alias(ssn_state->local_handles, 65536, &ssn_state->local_handle_hint, & valid);
   if ( ! valid )
     return 0;
   pn_hash_put(ssn_state->local_handles, state->local_handle, link);
@@ -1971,6 +2529,38 @@ static int pni_map_local_handle(pn_link_t *link) {
   return 1;
 }
 
+// The unsettled map of a link attaching again, NULL if it has no deliveries
+// from an old transport
+static int pni_link_unsettled_map(pn_transport_t *transport, pn_link_t *link, pn_data_t **map)
+{
+  pn_data_t *data = transport->disp_data;
+  pn_data_clear(data);
+  *map = NULL;
+  for (pn_delivery_t *d = link->unsettled_head; d; d = d->unsettled_next) {
+    if (d->resume == PNI_RESUME_NONE || d->resume == PNI_RESUME_DONE) continue;
+    if (!*map) {
+      PN_RETURN_IF_ERROR(pn_data_put_map(data));
+      pn_data_enter(data);
+      *map = data;
+    }
+    PN_RETURN_IF_ERROR(pn_data_put_binary(data, pn_bytes(d->tag_size, d->tag)));
+    if (!d->local.type) {
+      PN_RETURN_IF_ERROR(pn_data_put_null(data));
+      continue;
+    }
+    PN_RETURN_IF_ERROR(pn_data_put_described(data));
+    pn_data_enter(data);
+    PN_RETURN_IF_ERROR(pn_data_put_ulong(data, d->local.type));
+    size_t size = pn_data_size(data);
+    if (d->local.type >= PN_RECEIVED && d->local.type <= PN_MODIFIED)
+      PN_RETURN_IF_ERROR(pni_disposition_encode(&d->local, data));
+    if (pn_data_size(data) == size) PN_RETURN_IF_ERROR(pn_data_put_list(data));
+    pn_data_exit(data);
+  }
+  if (*map) pn_data_exit(data);
+  return 0;
+}
+
 static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endpoint)
 {
   if (transport->open_sent && (endpoint->type == SENDER ||
@@ -1984,9 +2574,12 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
     {
       pni_map_local_handle(link);
       const pn_distribution_mode_t dist_mode = link->source.distribution_mode;
+      pn_data_t *unsettled;
+      int err = pni_link_unsettled_map(transport, link, &unsettled);
+      if (err) return err;
       if (link->target.type == PN_COORDINATOR) {
-        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                                "DL[SIoBB?DL[SIsIoC?sCnCC]DL[C]nnI]", ATTACH,
+        err = pni_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
+                                &PNI_FILL_ATTACH_SENDER, ATTACH,
                                 pn_string_get(link->name),
                                 state->local_handle,
                                 endpoint->type == RECEIVER,
@@ -2004,11 +2597,11 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
                                 link->source.outcomes,
                                 link->source.capabilities,
                                 COORDINATOR, link->target.capabilities,
-                                0);
+                                unsettled, 0);
         if (err) return err;
       } else {
-        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                                "DL[SIoBB?DL[SIsIoC?sCnCC]?DL[SIsIoCC]nnIL]", ATTACH,
+        err = pni_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
+                                &PNI_FILL_ATTACH_RECEIVER, ATTACH,
                                 pn_string_get(link->name),
                                 state->local_handle,
                                 endpoint->type == RECEIVER,
@@ -2033,7 +2626,7 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
                                 link->target.dynamic,
                                 link->target.properties,
                                 link->target.capabilities,
-                                0, link->max_message_size);
+                                unsettled, 0, link->max_message_size);
         if (err) return err;
       }
     }
@@ -2048,7 +2641,35 @@ static int pni_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t
   ssn->state.outgoing_window = pni_session_outgoing_window(ssn);
   bool linkq = (bool) link;
   pn_link_state_t *state = &link->state;
-  return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[?IIII?I?I?In?o]", FLOW,
+  if (!(transport->trace & PN_TRACE_FRM)) {
+    // A flow has a small fixed upper size so needs no scratch buffer
+    char bytes[64];
+    pn_rwbytes_t buf = {sizeof(bytes), bytes};
+    pni_emitter_t emitter = pni_emitter(buf);
+    pni_compound_context performative = {0, 0};
+    emit_descriptor(&emitter, &performative, FLOW);
+    pni_compound_context list = emit_list_begin(&emitter);
+    if ((int16_t) ssn->state.remote_channel >= 0) {
+      emit_uint(&emitter, &list, ssn->state.incoming_transfer_count);
+    } else {
+      emit_null(&emitter, &list);
+    }
+    emit_uint(&emitter, &list, ssn->state.incoming_window);
+    emit_uint(&emitter, &list, ssn->state.outgoing_transfer_count);
+    emit_uint(&emitter, &list, ssn->state.outgoing_window);
+    if (linkq) {
+      emit_uint(&emitter, &list, state->local_handle);
+      emit_uint(&emitter, &list, state->delivery_count);
+      emit_uint(&emitter, &list, state->link_credit);
+      emit_null(&emitter, &list);
+      emit_bool(&emitter, &list, link->drain);
+    }
+    emit_list_end(&emitter, &performative, &list);
+    assert(!pni_emitter_overflow(&emitter));
+    pn_bytes_t body = {emitter.position, bytes};
+    return pni_write_output_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, &body, 1);
+  }
+  return pni_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, &PNI_FILL_FLOW, FLOW,
                        (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
                        ssn->state.incoming_window,
                        ssn->state.outgoing_transfer_count,
@@ -2082,9 +2703,33 @@ static int pni_flush_disp(pn_transport_t *transport, pn_session_t *ssn)
   uint64_t code = ssn->state.disp_code;
   bool settled = ssn->state.disp_settled;
   if (ssn->state.disp) {
-    int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[oIIo?DL[]]", DISPOSITION,
-                            ssn->state.disp_type, ssn->state.disp_first, ssn->state.disp_last,
-                            settled, (bool)code, code);
+    int err;
+    if (!(transport->trace & PN_TRACE_FRM)) {
+      char bytes[64];
+      pn_rwbytes_t buf = {sizeof(bytes), bytes};
+      pni_emitter_t emitter = pni_emitter(buf);
+      pni_compound_context performative = {0, 0};
+      emit_descriptor(&emitter, &performative, DISPOSITION);
+      pni_compound_context list = emit_list_begin(&emitter);
+      emit_bool(&emitter, &list, ssn->state.disp_type);
+      emit_uint(&emitter, &list, ssn->state.disp_first);
+      emit_uint(&emitter, &list, ssn->state.disp_last);
+      emit_bool(&emitter, &list, settled);
+      // A null state is a trailing null, so it is left out
+      if (code) {
+        emit_descriptor(&emitter, &list, code);
+        pni_compound_context state = {0, 0};
+        emit_empty_list(&emitter, &state);
+      }
+      emit_list_end(&emitter, &performative, &list);
+      assert(!pni_emitter_overflow(&emitter));
+      pn_bytes_t body = {emitter.position, bytes};
+      err = pni_write_output_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, &body, 1);
+    } else {
+      err = pni_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, &PNI_FILL_DISPOSITION, DISPOSITION,
+                          ssn->state.disp_type, ssn->state.disp_first, ssn->state.disp_last,
+                          settled, (bool)code, code);
+    }
     if (err) return err;
     ssn->state.disp_type = 0;
     ssn->state.disp_code = 0;
@@ -2114,8 +2759,8 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
   if (!pni_disposition_batchable(&delivery->local)) {
     pn_data_clear(transport->disp_data);
     PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
-    return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel,
-      "DL[oIIo?DLC]", DISPOSITION,
+    return pni_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel,
+      &PNI_FILL_DISPOSITION_STATE, DISPOSITION,
       role, state->id, state->id, delivery->local.settled,
       (bool)code, code, transport->disp_data);
   }
@@ -2147,6 +2792,81 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
   return 0;
 }
 
+// Account the time a sender had a delivery ready but could not send it, see pn_link_stats
+static void pni_link_unblocked(pn_link_t *link)
+{
+  if (link->credit_blocked_since || link->window_blocked_since) {
+    pn_timestamp_t now = pn_i_now();
+    if (link->credit_blocked_since) link->stats.credit_blocked += now - link->credit_blocked_since;
+    if (link->window_blocked_since) link->stats.window_blocked += now - link->window_blocked_since;
+    link->credit_blocked_since = 0;
+    link->window_blocked_since = 0;
+  }
+}
+
+// Use up the next delivery id for a transfer with no delivery, see pn_link_send_settled
+static bool pni_delivery_map_skip(pn_delivery_map_t *db, pn_sequence_t *id)
+{
+  if (!db->count) {
+    *id = db->next++;
+    db->lwm = db->next;
+    db->first = 0;
+    return true;
+  }
+  // A NULL slot the window moves past once the deliveries before it go
+  if (!pni_delivery_map_reserve(db)) return false;
+  *id = db->next++;
+  return true;
+}
+
+// The most a transfer performative with a four byte tag may encode to
+#define PNI_SETTLED_TRANSFER_OVERHEAD 64
+
+ssize_t pn_link_send_settled(pn_link_t *link, const char *bytes, size_t n)
+{
+  if (!link || !pn_link_is_sender(link)) return PN_ARG_ERR;
+  pn_transport_t *transport = link->session->connection->transport;
+  pn_session_state_t *ssn_state = &link->session->state;
+  pn_link_state_t *link_state = &link->state;
+  uint32_t max_frame = transport ? pni_transfer_max_frame(transport) : 0;
+  pn_sequence_t id;
+  if (transport && !transport->close_sent && !link->current && !link->queued &&
+      (link->endpoint.state & PN_LOCAL_ACTIVE) &&
+      (int16_t) ssn_state->local_channel >= 0 && (int32_t) link_state->local_handle >= 0 &&
+      link_state->link_credit > 0 && ssn_state->remote_incoming_window > 0 &&
+      !pni_output_full(transport) &&
+      (!max_frame || n + AMQP_HEADER_SIZE + PNI_SETTLED_TRANSFER_OVERHEAD <= max_frame) &&
+      pni_delivery_map_skip(&ssn_state->outgoing, &id))
+  {
+    uint8_t tag_bytes[4] = {(uint8_t)(id >> 24), (uint8_t)(id >> 16), (uint8_t)(id >> 8), (uint8_t)id};
+    pn_bytes_t tag = pn_bytes(sizeof(tag_bytes), (const char *) tag_bytes);
+    pn_bytes_t payload = pn_bytes(n, bytes);
+    int count = pni_post_amqp_transfer_frame(transport, ssn_state->local_channel,
+                                             link_state->local_handle, id, &payload, &tag,
+                                             0, true, false, 1, 0, NULL, false);
+    if (count < 0) return count;
+    assert(count == 1 && !payload.size);
+    ssn_state->outgoing_transfer_count++;
+    ssn_state->remote_incoming_window--;
+    link_state->delivery_count++;
+    link_state->link_credit--;
+    link->credit--;
+    link->stats.deliveries++;
+    link->stats.settled++;
+    transport->deliveries_output++;
+    PNI_PROBE2(link_send, link, n);
+    return n;
+  }
+
+  pn_delivery_t *delivery = pn_delivery_auto(link);
+  if (!delivery) return PN_OUT_OF_MEMORY;
+  ssize_t sent = pn_link_send(link, bytes, n);
+  if (sent < 0) return sent;
+  pn_link_advance(link);
+  pn_delivery_settle(delivery);
+  return n;
+}
+
 static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *delivery, bool *settle)
 {
   *settle = false;
@@ -2154,41 +2874,74 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
   pn_session_state_t *ssn_state = &link->session->state;
   pn_link_state_t *link_state = &link->state;
   bool xfr_posted = false;
+  switch (delivery->resume) {
+  case PNI_RESUME_WAIT:
+    return 0;
+  case PNI_RESUME_SETTLE:
+    if (!delivery->local.settled) return 0;
+    break;
+  case PNI_RESUME_DONE:
+    *settle = delivery->local.settled;
+    return 0;
+  default:
+    break;
+  }
+  // Resuming a delivery the peer already has an outcome for only settles it
+  const bool settling = delivery->resume == PNI_RESUME_SETTLE;
   if ((int16_t) ssn_state->local_channel >= 0 && (int32_t) link_state->local_handle >= 0) {
     pn_delivery_state_t *state = &delivery->state;
-    if (!state->sent && (delivery->done || pn_buffer_size(delivery->bytes) > 0) &&
-        ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
+    bool ready = !state->sent && (delivery->done || settling || pni_delivery_outgoing(delivery).size > 0);
+    if (ready && link_state->link_credit <= 0) {
+      if (!link->credit_blocked_since) link->credit_blocked_since = pn_i_now();
+      // Nothing to do until the peer gives credit, see pni_do_flow
+      pni_park_tpwork(delivery);
+    } else if (ready && ssn_state->remote_incoming_window <= 0) {
+      if (!link->window_blocked_since) link->window_blocked_since = pn_i_now();
+    } else if (ready && !pni_output_full(transport)) {
+      pni_link_unblocked(link);
       if (!state->init) {
         state = pni_delivery_map_push(&ssn_state->outgoing, delivery);
       }
 
-      pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
+      pn_bytes_t bytes = settling ? pn_bytes(0, NULL) : pni_delivery_outgoing(delivery);
       size_t full_size = bytes.size;
-      pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
+      pn_bytes_t tag = pn_bytes(delivery->tag_size, delivery->tag);
+      pn_sequence_t frame_limit = ssn_state->remote_incoming_window;
+      if (transport->interleave && link->weight < (uint32_t) frame_limit) frame_limit = link->weight;
       pn_data_clear(transport->disp_data);
       PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
       int count = pni_post_amqp_transfer_frame(transport,
                                               ssn_state->local_channel,
                                               link_state->local_handle,
                                               state->id, &bytes, &tag,
-                                              0, // message-format
+                                              delivery->message_format,
                                               delivery->local.settled,
-                                              !delivery->done,
-                                              ssn_state->remote_incoming_window,
-                                              delivery->local.type, transport->disp_data);
+                                              !delivery->done && !settling,
+                                              frame_limit,
+                                              delivery->local.type, transport->disp_data,
+                                              delivery->resume != PNI_RESUME_NONE);
       if (count < 0) return count;
       xfr_posted = true;
+      delivery->resume = PNI_RESUME_NONE;
       ssn_state->outgoing_transfer_count += count;
       ssn_state->remote_incoming_window -= count;
 
       int sent = full_size - bytes.size;
-      pn_buffer_trim(delivery->bytes, sent, 0);
-      link->session->outgoing_bytes -= sent;
-      if (!pn_buffer_size(delivery->bytes) && delivery->done) {
+      if (settling) {
+        state->sent = true;
+        link_state->delivery_count++;
+        link_state->link_credit--;
+        transport->deliveries_output++;
+      } else {
+        pni_delivery_sent(delivery, sent);
+        link->session->outgoing_bytes -= sent;
+      }
+      if (!settling && !pni_delivery_outgoing(delivery).size && delivery->done) {
         state->sent = true;
         link_state->delivery_count++;
         link_state->link_credit--;
-        link->queued--;
+        transport->deliveries_output++;
+        pni_sender_queue(link, -1);
         link->session->outgoing_deliveries--;
       }
 
@@ -2218,8 +2971,7 @@ static int pni_process_tpwork_receiver(pn_transport_t *transport, pn_delivery_t
     if (err) return err;
   }
 
-  // XXX: need to centralize this policy and improve it
-  if (!ssn->state.incoming_window) {
+  if (pni_session_window_low(ssn)) {
     int err = pni_post_flow(transport, ssn, link);
     if (err) return err;
   }
@@ -2233,43 +2985,69 @@ static int pni_process_tpwork(pn_transport_t *transport, pn_endpoint_t *endpoint
   if (endpoint->type == CONNECTION && !transport->close_sent)
   {
     pn_connection_t *conn = (pn_connection_t *) endpoint;
-    pn_delivery_t *delivery = conn->tpwork_head;
-    while (delivery)
-    {
-      pn_delivery_t *tp_next = delivery->tpwork_next;
-      bool settle = false;
-
-      pn_link_t *link = delivery->link;
-      pn_delivery_map_t *dm = NULL;
-      if (pn_link_is_sender(link)) {
-        dm = &link->session->state.outgoing;
-        int err = pni_process_tpwork_sender(transport, delivery, &settle);
-        if (err) return err;
-      } else {
-        dm = &link->session->state.incoming;
-        int err = pni_process_tpwork_receiver(transport, delivery, &settle);
-        if (err) return err;
-      }
+    bool rotated;
+    do {
+      // In interleave mode a delivery that got its turn (see pn_link_set_weight)
+      // and still has more to send moves behind the others, so each pass
+      // stops at the old tail
+      pn_delivery_t *last = conn->tpwork_tail;
+      pn_delivery_t *delivery = conn->tpwork_head;
+      rotated = false;
+      while (delivery)
+      {
+        pn_delivery_t *tp_next = delivery->tpwork_next;
+        bool end = delivery == last;
+        bool settle = false;
+
+        pn_link_t *link = delivery->link;
+        pn_delivery_map_t *dm = NULL;
+        pn_sequence_t transfers = link->session->state.outgoing_transfer_count;
+        if (pn_link_is_sender(link)) {
+          dm = &link->session->state.outgoing;
+          int err = pni_process_tpwork_sender(transport, delivery, &settle);
+          if (err) return err;
+        } else {
+          dm = &link->session->state.incoming;
+          int err = pni_process_tpwork_receiver(transport, delivery, &settle);
+          if (err) return err;
+        }
 
-      if (settle) {
-        pn_full_settle(dm, delivery);
-      } else if (!pn_delivery_buffered(delivery)) {
-        pn_clear_tpwork(delivery);
-      }
+        if (settle) {
+          pn_full_settle(dm, delivery);
+        } else if (!pn_delivery_buffered(delivery)) {
+          pn_clear_tpwork(delivery);
+        } else if (transport->interleave && transfers != link->session->state.outgoing_transfer_count) {
+          LL_REMOVE(conn, tpwork, delivery);
+          LL_ADD(conn, tpwork, delivery);
+          rotated = true;
+        }
 
-      delivery = tp_next;
-    }
+        if (end) break;
+        delivery = tp_next;
+      }
+    } while (rotated && !pni_output_full(transport));
   }
 
   return 0;
 }
 
+// Keep an open disposition range back for a later pass, see pn_transport_set_disposition_delay
+static bool pni_disp_held(pn_transport_t *transport, pn_session_t *session)
+{
+  pn_session_state_t *state = &session->state;
+  return transport->disp_hold && !transport->disp_expired &&
+    (session->endpoint.state & PN_LOCAL_ACTIVE) &&
+    (!transport->disp_limit ||
+     (uint32_t)(state->disp_last - state->disp_first) + 1 < transport->disp_limit);
+}
+
 static int pni_process_flush_disp(pn_transport_t *transport, pn_endpoint_t *endpoint)
 {
   if (endpoint->type == SESSION) {
     pn_session_t *session = (pn_session_t *) endpoint;
     pn_session_state_t *state = &session->state;
-    if ((int16_t) state->local_channel >= 0 && !transport->close_sent)
+    if ((int16_t) state->local_channel >= 0 && !transport->close_sent &&
+        !(state->disp && pni_disp_held(transport, session)))
     {
       int err = pni_flush_disp(transport, session);
       if (err) return err;
@@ -2306,6 +3084,7 @@ static void pni_unmap_local_handle(pn_link_t *link) {
   pn_link_state_t *state = &link->state;
   uintptr_t handle = state->local_handle;
   state->local_handle = -2;
+  pni_release_alias(&link->session->state.local_handle_hint, handle);
   if (pn_hash_get(link->session->state.local_handles, handle)) {
     pn_ep_decref(&link->endpoint);
   }
@@ -2339,8 +3118,8 @@ static int pni_process_link_teardown(pn_transport_t *transport, pn_endpoint_t *e
       }
 
       int err =
-          pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                        "DL[Io?DL[sSC]]", DETACH, state->local_handle, !link->detached,
+          pni_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
+                        &PNI_FILL_DETACH, DETACH, state->local_handle, !link->detached,
                         (bool)name, ERROR, name, description, info);
       if (err) return err;
       pni_unmap_local_handle(link);
@@ -2357,19 +3136,18 @@ static bool pni_pointful_buffering(pn_transport_t *transport, pn_session_t *sess
   if (transport->close_rcvd) return false;
   if (!transport->open_rcvd) return true;
 
-  pn_connection_t *conn = transport->connection;
-  pn_link_t *link = pn_link_head(conn, 0);
-  while (link) {
-    if (pn_link_is_sender(link) && pn_link_queued(link) > 0) {
-      pn_session_t *ssn = link->session;
-      if (session && session == ssn) {
-        if ((int32_t) link->state.remote_handle != -2 &&
-            (int16_t) session->state.remote_channel != -2) {
-          return true;
-        }
-      }
+  // Only a session's own senders hold up its end, and only if any has
+  // deliveries queued
+  if (!session || !session->queued_senders) return false;
+  if ((int16_t) session->state.remote_channel == -2) return false;
+
+  size_t nlinks = pn_list_size(session->links);
+  for (size_t i = 0; i < nlinks; i++) {
+    pn_link_t *link = (pn_link_t *) pn_list_get(session->links, i);
+    if (pn_link_is_sender(link) && pn_link_queued(link) > 0 &&
+        (int32_t) link->state.remote_handle != -2) {
+      return true;
     }
-    link = pn_link_next(link, 0);
   }
 
   return false;
@@ -2379,10 +3157,12 @@ static void pni_unmap_local_channel(pn_session_t *ssn) {
   // XXX: should really update link state also
   pni_delivery_map_clear(&ssn->state.outgoing);
   pni_transport_unbind_handles(ssn->state.local_handles, false);
+  ssn->state.local_handle_hint = 0;
   pn_transport_t *transport = ssn->connection->transport;
   pn_session_state_t *state = &ssn->state;
   uintptr_t channel = state->local_channel;
   state->local_channel = -2;
+  pni_release_alias(&transport->local_channel_hint, channel);
   if (pn_hash_get(transport->local_channels, channel)) {
     pn_ep_decref(&ssn->endpoint);
   }
@@ -2413,7 +3193,7 @@ static int pni_process_ssn_teardown(pn_transport_t *transport, pn_endpoint_t *en
         info = pn_condition_info(&endpoint->condition);
       }
 
-      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[?DL[sSC]]", END,
+      int err = pni_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, &PNI_FILL_END, END,
                               (bool) name, ERROR, name, description, info);
       if (err) return err;
       pni_unmap_local_channel(session);
@@ -2440,40 +3220,159 @@ static int pni_process_conn_teardown(pn_transport_t *transport, pn_endpoint_t *e
   return 0;
 }
 
-static int pni_phase(pn_transport_t *transport, int (*phase)(pn_transport_t *, pn_endpoint_t *))
+typedef enum {
+  PNI_PHASE_CONN_SETUP,
+  PNI_PHASE_SSN_SETUP,
+  PNI_PHASE_LINK_SETUP,
+  PNI_PHASE_FLOW_RECEIVER,
+  PNI_PHASE_TPWORK,
+  PNI_PHASE_FLUSH_DISP,
+  PNI_PHASE_FLOW_SENDER,
+  PNI_PHASE_LINK_TEARDOWN,
+  PNI_PHASE_SSN_TEARDOWN,
+  PNI_PHASE_CONN_TEARDOWN,
+  PNI_PHASES
+} pni_phase_id_t;
+
+typedef struct {
+  const char *name;
+  pni_modified_kind_t kind;     /* the only endpoints the phase acts on */
+  int (*process)(pn_transport_t *, pn_endpoint_t *);
+} pni_phase_t;
+
+static const pni_phase_t pni_phases[PNI_PHASES] = {
+  {"conn_setup", PNI_MODIFIED_CONNECTION, pni_process_conn_setup},
+  {"ssn_setup", PNI_MODIFIED_SESSION, pni_process_ssn_setup},
+  {"link_setup", PNI_MODIFIED_LINK, pni_process_link_setup},
+  {"flow_receiver", PNI_MODIFIED_LINK, pni_process_flow_receiver},
+  {"tpwork", PNI_MODIFIED_CONNECTION, pni_process_tpwork},
+  {"flush_disp", PNI_MODIFIED_SESSION, pni_process_flush_disp},
+  {"flow_sender", PNI_MODIFIED_LINK, pni_process_flow_sender},
+  {"link_teardown", PNI_MODIFIED_LINK, pni_process_link_teardown},
+  {"ssn_teardown", PNI_MODIFIED_SESSION, pni_process_ssn_teardown},
+  {"conn_teardown", PNI_MODIFIED_CONNECTION, pni_process_conn_teardown}
+};
+
+// Phase CPU time, collected while PN_TRACE_DRV is set and logged when the transport is freed
+struct pni_phase_stats_t {
+  uint64_t runs;
+  uint64_t endpoints;
+  clock_t cpu;
+};
+
+static int pni_phase(pn_transport_t *transport, pni_phase_id_t id)
 {
-  pn_connection_t *conn = transport->connection;
-  pn_endpoint_t *endpoint = conn->transport_head;
-  while (endpoint)
+  const pni_phase_t *phase = &pni_phases[id];
+  pn_endpoint_t *endpoint = transport->connection->modified[phase->kind].transport_head;
+  if (!endpoint) return 0;
+
+  struct pni_phase_stats_t *stats = NULL;
+  clock_t start = 0;
+  if (transport->trace & PN_TRACE_DRV) {
+    if (!transport->phase_stats)
+      transport->phase_stats = (struct pni_phase_stats_t *) calloc(PNI_PHASES, sizeof(struct pni_phase_stats_t));
+    if (transport->phase_stats) {
+      stats = &transport->phase_stats[id];
+      start = clock();
+    }
+  }
+
+  PNI_PROBE2(phase_start, transport, phase->name);
+  int err = 0;
+  uint64_t count = 0;
+  while (endpoint && !err)
   {
     pn_endpoint_t *next = endpoint->transport_next;
-    int err = phase(transport, endpoint);
-    if (err) return err;
+    err = phase->process(transport, endpoint);
     endpoint = next;
+    ++count;
   }
-  return 0;
+  PNI_PROBE3(phase_done, transport, phase->name, count);
+
+  if (stats) {
+    stats->runs++;
+    stats->endpoints += count;
+    stats->cpu += clock() - start;
+  }
+  return err;
+}
+
+static void pni_phase_stats_log(pn_transport_t *transport)
+{
+  for (int i = 0; i < PNI_PHASES; ++i) {
+    struct pni_phase_stats_t *stats = &transport->phase_stats[i];
+    if (stats->runs) {
+      pn_transport_logf(transport, "phase %s: %" PRIu64 " runs, %" PRIu64 " endpoints, %.3f ms",
+                        pni_phases[i].name, stats->runs, stats->endpoints,
+                        stats->cpu * 1000.0 / CLOCKS_PER_SEC);
+    }
+  }
+}
+
+static bool pni_disp_pending(pn_transport_t *transport)
+{
+  if (!transport->connection) return false;
+  pn_list_t *sessions = transport->connection->sessions;
+  for (size_t i = 0; i < pn_list_size(sessions); ++i) {
+    if (((pn_session_t *) pn_list_get(sessions, i))->state.disp) return true;
+  }
+  return false;
+}
+
+// Release every held disposition range on the next pass
+static void pni_disp_expire(pn_transport_t *transport)
+{
+  transport->disp_expired = true;
+  if (!transport->connection) return;
+  pn_list_t *sessions = transport->connection->sessions;
+  for (size_t i = 0; i < pn_list_size(sessions); ++i) {
+    pn_session_t *ssn = (pn_session_t *) pn_list_get(sessions, i);
+    if (ssn->state.disp)
+      pn_modified(transport->connection, &ssn->endpoint, false);
+  }
+}
+
+// Dispositions are only held while nothing is being closed, so they are never
+// overtaken by a DETACH, END or CLOSE
+static bool pni_disp_can_hold(pn_transport_t *transport)
+{
+  pn_connection_t *conn = transport->connection;
+  if (!transport->disp_delay || !(conn->endpoint.state & PN_LOCAL_ACTIVE)) return false;
+  for (int i = 0; i < PNI_MODIFIED_KINDS; ++i) {
+    pn_endpoint_t *endpoint = conn->modified[i].transport_head;
+    for (; endpoint; endpoint = endpoint->transport_next) {
+      if (endpoint->state & PN_LOCAL_CLOSED) return false;
+    }
+  }
+  return true;
 }
 
 static int pni_process(pn_transport_t *transport)
 {
   int err;
-  if ((err = pni_phase(transport, pni_process_conn_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_ssn_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_link_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_flow_receiver))) return err;
+  transport->disp_hold = pni_disp_can_hold(transport);
+  if (transport->disp_delay && !transport->disp_hold) pni_disp_expire(transport);
+  if ((err = pni_phase(transport, PNI_PHASE_CONN_SETUP))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_SSN_SETUP))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_LINK_SETUP))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_FLOW_RECEIVER))) return err;
 
   // XXX: this has to happen two times because we might settle stuff
   // on the first pass and create space for more work to be done on the
   // second pass
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_TPWORK))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_TPWORK))) return err;
 
-  if ((err = pni_phase(transport, pni_process_flush_disp))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_FLUSH_DISP))) return err;
+  if (transport->disp_expired) {
+    transport->disp_expired = false;
+    transport->disp_deadline = 0;
+  }
 
-  if ((err = pni_phase(transport, pni_process_flow_sender))) return err;
-  if ((err = pni_phase(transport, pni_process_link_teardown))) return err;
-  if ((err = pni_phase(transport, pni_process_ssn_teardown))) return err;
-  if ((err = pni_phase(transport, pni_process_conn_teardown))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_FLOW_SENDER))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_LINK_TEARDOWN))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_SSN_TEARDOWN))) return err;
+  if ((err = pni_phase(transport, PNI_PHASE_CONN_TEARDOWN))) return err;
 
   if (transport->connection->tpwork_head) {
     pn_modified(transport->connection, &transport->connection->endpoint, false);
@@ -2500,7 +3399,7 @@ static void pn_error_amqp(pn_transport_t* transport, unsigned int layer)
 
 static ssize_t pn_input_read_amqp_header(pn_transport_t* transport, unsigned int layer, const char* bytes, size_t available)
 {
-  bool eos = pn_transport_capacity(transport)==PN_EOS;
+  bool eos = transport->tail_closed;
   pni_protocol_type_t protocol = pni_sniff_header(bytes, available);
   switch (protocol) {
   case PNI_PROTOCOL_AMQP1:
@@ -2590,6 +3489,20 @@ static pn_timestamp_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer
     timeout = pn_timestamp_min( timeout, transport->keepalive_deadline );
   }
 
+  // Held dispositions are due one delay after the first tick that sees them
+  if (transport->disp_delay) {
+    if (!pni_disp_pending(transport)) {
+      transport->disp_deadline = 0;
+    } else if (!transport->disp_deadline) {
+      transport->disp_deadline = now + transport->disp_delay;
+    } else if (transport->disp_deadline <= now) {
+      // Keep a deadline until a pass has sent them
+      pni_disp_expire(transport);
+      transport->disp_deadline = now + 1;
+    }
+    timeout = pn_timestamp_min(timeout, transport->disp_deadline);
+  }
+
   return timeout;
 }
 
@@ -2633,6 +3546,31 @@ static ssize_t pn_output_write_amqp(pn_transport_t* transport, unsigned int laye
   return pn_dispatcher_output(transport, bytes, available);
 }
 
+// Let the layer above 'layer' write AMQP frames straight from the output
+// chunks instead of copying them out with process_output. Returns the next
+// pending bytes, empty if the layers below do not simply write AMQP frames or
+// have nothing to send right now; process_output must then be used as usual.
+pn_bytes_t pni_transport_peek_output(pn_transport_t *transport, unsigned int layer)
+{
+  while (layer < PN_IO_LAYER_CT && transport->io_layers[layer] == &pni_passthru_layer) ++layer;
+  if (layer >= PN_IO_LAYER_CT) return pn_bytes_null;
+  const pn_io_layer_t *l = transport->io_layers[layer];
+  if (l != &amqp_layer && l != &amqp_read_header_layer) return pn_bytes_null;
+  if (!transport->output_head && transport->connection && !transport->done_processing) {
+    int err = pni_process(transport);
+    if (err) {
+      pn_transport_logf(transport, "process error %i", err);
+      transport->done_processing = true;
+    }
+  }
+  return pn_dispatcher_peek(transport);
+}
+
+void pni_transport_consume_output(pn_transport_t *transport, size_t size)
+{
+  pn_dispatcher_consume(transport, size);
+}
+
 // Mark transport output as closed and send event
 static void pni_close_head(pn_transport_t *transport)
 {
@@ -2649,6 +3587,10 @@ static ssize_t transport_produce(pn_transport_t *transport)
 {
   if (transport->head_closed) return PN_EOS;
 
+  if (!transport->output_buf) {  // after pn_transport_hibernate()
+    if (!(transport->output_buf = (char *) malloc(PN_TRANSPORT_IO_BUF_SIZE))) return 0;
+    transport->output_size = PN_TRANSPORT_IO_BUF_SIZE;
+  }
   ssize_t space = transport->output_size - transport->output_pending;
 
   if (space <= 0) {     // can we expand the buffer?
@@ -2816,6 +3758,59 @@ void pn_transport_set_max_frame(pn_transport_t *transport, uint32_t size)
   transport->local_max_frame = size;
 }
 
+size_t pn_transport_get_output_limit(pn_transport_t *transport)
+{
+  return transport->output_limit;
+}
+
+void pn_transport_set_output_limit(pn_transport_t *transport, size_t limit)
+{
+  transport->output_limit = limit;
+}
+
+bool pn_transport_get_interleave(pn_transport_t *transport)
+{
+  return transport->interleave;
+}
+
+void pn_transport_set_interleave(pn_transport_t *transport, bool interleave)
+{
+  transport->interleave = interleave;
+  if (interleave && !transport->local_max_frame)
+    transport->local_max_frame = PN_TRANSPORT_INTERLEAVE_FRAME_SIZE;
+}
+
+bool pn_transport_get_validate_text(pn_transport_t *transport)
+{
+  return transport->validate_text;
+}
+
+void pn_transport_set_validate_text(pn_transport_t *transport, bool validate)
+{
+  transport->validate_text = validate;
+}
+
+pn_millis_t pn_transport_get_disposition_delay(pn_transport_t *transport)
+{
+  return transport->disp_delay;
+}
+
+void pn_transport_set_disposition_delay(pn_transport_t *transport, pn_millis_t delay)
+{
+  transport->disp_delay = delay;
+  if (!delay) pni_disp_expire(transport);
+}
+
+uint32_t pn_transport_get_disposition_limit(pn_transport_t *transport)
+{
+  return transport->disp_limit;
+}
+
+void pn_transport_set_disposition_limit(pn_transport_t *transport, uint32_t limit)
+{
+  transport->disp_limit = limit;
+}
+
 uint32_t pn_transport_get_remote_max_frame(pn_transport_t *transport)
 {
   return transport->remote_max_frame;
@@ -2860,13 +3855,126 @@ uint64_t pn_transport_get_frames_input(const pn_transport_t *transport)
   return 0;
 }
 
+void pn_transport_stats(const pn_transport_t *transport, pn_transport_stats_t *stats)
+{
+  assert(stats);
+  memset(stats, 0, sizeof(*stats));
+  if (!transport) return;
+  stats->frames_input = transport->input_frames_ct;
+  stats->frames_output = transport->output_frames_ct;
+  stats->bytes_input = transport->bytes_input;
+  stats->bytes_output = transport->bytes_output;
+  memcpy(stats->performative_frames_input, transport->performative_frames[IN], sizeof(stats->performative_frames_input));
+  memcpy(stats->performative_frames_output, transport->performative_frames[OUT], sizeof(stats->performative_frames_output));
+  memcpy(stats->performative_bytes_input, transport->performative_bytes[IN], sizeof(stats->performative_bytes_input));
+  memcpy(stats->performative_bytes_output, transport->performative_bytes[OUT], sizeof(stats->performative_bytes_output));
+  stats->deliveries_input = transport->deliveries_input;
+  stats->deliveries_output = transport->deliveries_output;
+}
+
 // input
+size_t pni_transport_memory(pn_transport_t *transport)
+{
+  size_t size = transport->input_size + transport->output_size + pn_buffer_capacity(transport->frame);
+  for (pni_output_chunk_t *chunk = transport->output_head; chunk; chunk = chunk->next)
+    size += sizeof(pni_output_chunk_t) + chunk->size;
+  if (transport->output_spare)
+    size += sizeof(pni_output_chunk_t) + transport->output_spare->size;
+  return size;
+}
+
+static size_t pni_input_frame_needed(pn_transport_t *transport);
+
+/*
+ * Input is consumed from input_head without moving what is left, so a
+ * partial frame is only copied to the start of the buffer when there is too
+ * little room after it to read the rest of the frame.  The buffer grows
+ * toward local_max_frame for frames that do not fit, and shrinks again once
+ * it has emptied PN_TRANSPORT_INPUT_SHRINK times with no more than a quarter
+ * of it used.
+ */
+
+// The input buffer is empty, start again from the front and maybe shrink it.
+static void pni_input_emptied(pn_transport_t *transport)
+{
+  transport->input_head = 0;
+  if (transport->input_size <= PN_TRANSPORT_IO_BUF_SIZE) return;
+  if (transport->input_peak > transport->input_size / 4) {
+    transport->input_peak = 0;
+    transport->input_idle = 0;
+    return;
+  }
+  if (++transport->input_idle < PN_TRANSPORT_INPUT_SHRINK) return;
+  size_t size = transport->input_size;
+  while (size / 2 >= PN_TRANSPORT_IO_BUF_SIZE && size / 2 >= 2 * transport->input_peak)
+    size /= 2;
+  // Nothing to keep, so there is no need for realloc to copy
+  char *newbuf = (char *) malloc(size);
+  if (newbuf) {
+    free(transport->input_buf);
+    transport->input_buf = newbuf;
+    transport->input_size = size;
+  }
+  transport->input_peak = 0;
+  transport->input_idle = 0;
+}
+
+size_t pn_transport_hibernate(pn_transport_t *transport)
+{
+  assert(transport);
+  size_t size = 0;
+  if (transport->input_buf && !transport->input_pending) {
+    size += transport->input_size;
+    free(transport->input_buf);
+    transport->input_buf = NULL;
+    transport->input_size = 0;
+    transport->input_head = 0;
+    transport->input_peak = 0;
+    transport->input_idle = 0;
+  }
+  if (transport->output_buf && !transport->output_pending) {
+    size += transport->output_size;
+    free(transport->output_buf);
+    transport->output_buf = NULL;
+    transport->output_size = 0;
+  }
+  if (transport->output_spare) {
+    size += sizeof(pni_output_chunk_t) + transport->output_spare->size;
+    free(transport->output_spare);
+    transport->output_spare = NULL;
+  }
+  if (!pn_buffer_size(transport->frame)) {
+    size_t capacity = pn_buffer_capacity(transport->frame);
+    pn_buffer_shrink(transport->frame, PN_TRANSPORT_INITIAL_FRAME_SIZE);
+    size += capacity - pn_buffer_capacity(transport->frame);
+  }
+  size += pni_data_shrink(transport->args);
+  size += pni_data_shrink(transport->output_args);
+  size += pni_data_shrink(transport->disp_data);
+  size += pni_ssl_hibernate(transport);
+  return size;
+}
+
 ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 {
   if (transport->tail_closed) return PN_EOS;
   //if (pn_error_code(transport->error)) return pn_error_code(transport->error);
 
-  ssize_t capacity = transport->input_size - transport->input_pending;
+  // Hold off the peer until the application frees memory
+  if (transport->connection && pni_connection_memory_full(transport->connection)) return 0;
+
+  if (!transport->input_buf) {  // after pn_transport_hibernate()
+    if (!(transport->input_buf = (char *) malloc(PN_TRANSPORT_IO_BUF_SIZE))) return 0;
+    transport->input_size = PN_TRANSPORT_IO_BUF_SIZE;
+  }
+  if (transport->input_head) {
+    size_t room = transport->input_size - transport->input_head - transport->input_pending;
+    if (room < transport->input_size / 4 || room < pni_input_frame_needed(transport)) {
+      memmove(transport->input_buf, transport->input_buf + transport->input_head, transport->input_pending);
+      transport->input_head = 0;
+    }
+  }
+  ssize_t capacity = transport->input_size - transport->input_head - transport->input_pending;
   if ( capacity<=0 ) {
     // can we expand the size of the input buffer?
     int more = 0;
@@ -2890,8 +3998,8 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 
 char *pn_transport_tail(pn_transport_t *transport)
 {
-  if (transport && transport->input_pending < transport->input_size) {
-    return &transport->input_buf[transport->input_pending];
+  if (transport && transport->input_head + transport->input_pending < transport->input_size) {
+    return &transport->input_buf[transport->input_head + transport->input_pending];
   }
   return NULL;
 }
@@ -2919,10 +4027,69 @@ ssize_t pn_transport_push(pn_transport_t *transport, const char *src, size_t siz
   }
 }
 
+// Bytes still needed to complete an AMQP frame that starts the input
+// buffer, 0 if the active layer is not AMQP framing or the frame is complete
+static size_t pni_input_frame_needed(pn_transport_t *transport)
+{
+  unsigned int layer = 0;
+  while (layer < PN_IO_LAYER_CT - 1 && transport->io_layers[layer] == &pni_passthru_layer)
+    ++layer;
+  if (transport->io_layers[layer] != &amqp_layer) return 0;
+  if (transport->input_pending < AMQP_HEADER_SIZE)
+    return AMQP_HEADER_SIZE - transport->input_pending;
+  size_t size = pni_read32(transport->input_buf + transport->input_head);
+  return size > transport->input_pending ? size - transport->input_pending : 0;
+}
+
+ssize_t pni_transport_push_external(pn_transport_t *transport, const char *src, size_t size)
+{
+  assert(transport);
+  size_t taken = 0;
+  while (taken < size) {
+    ssize_t capacity = pn_transport_capacity(transport);
+    if (capacity < 0) {
+      return taken ? (ssize_t)taken : capacity;
+    } else if (capacity == 0) {
+      break;
+    }
+    size_t available = size - taken;
+    if (transport->input_pending) {
+      // Complete the partial frame kept from earlier input, copying no
+      // further than its end when the frame size is known
+      size_t needed = pni_input_frame_needed(transport);
+      size_t count = pn_min(needed ? needed : available, pn_min(available, (size_t)capacity));
+      memmove(pn_transport_tail(transport), src + taken, count);
+      taken += count;
+      int err = pn_transport_process(transport, count);
+      if (err < 0) return err;
+      continue;
+    }
+    ssize_t n = transport->io_layers[0]->process_input(transport, 0, src + taken, available);
+    if (n > 0) {
+      transport->bytes_input += n;
+      taken += n;
+    } else if (n == 0) {
+      // Keep the incomplete trailing frame, the caller's memory is not ours to hold
+      size_t count = pn_min(available, (size_t)capacity);
+      memmove(pn_transport_tail(transport), src + taken, count);
+      transport->input_pending += count;
+      transport->bytes_input += count;
+      taken += count;
+    } else {
+      assert(n == PN_EOS);
+      if (transport->trace & (PN_TRACE_RAW | PN_TRACE_FRM))
+        pn_transport_log(transport, "  <- EOS");
+      pni_close_tail(transport);
+      return size;
+    }
+  }
+  return taken;
+}
+
 int pn_transport_process(pn_transport_t *transport, size_t size)
 {
   assert(transport);
-  size = pn_min( size, (transport->input_size - transport->input_pending) );
+  size = pn_min( size, (transport->input_size - transport->input_head - transport->input_pending) );
   transport->input_pending += size;
   transport->bytes_input += size;
 
@@ -2979,16 +4146,30 @@ ssize_t pn_transport_peek(pn_transport_t *transport, char *dst, size_t size)
   return size;
 }
 
+// Drop size bytes from the front of the layer output buffer
+static void pni_output_buf_pop(pn_transport_t *transport, size_t size)
+{
+  assert( transport->output_pending >= size );
+  transport->output_pending -= size;
+  if (transport->output_pending) {
+    memmove( transport->output_buf,  &transport->output_buf[size],
+             transport->output_pending );
+  } else if (transport->output_size > PN_TRANSPORT_IO_BUF_SIZE) {
+    // Drained, give back the room grown for a burst
+    char *newbuf = (char *)realloc( transport->output_buf, PN_TRANSPORT_IO_BUF_SIZE );
+    if (newbuf) {
+      transport->output_buf = newbuf;
+      transport->output_size = PN_TRANSPORT_IO_BUF_SIZE;
+    }
+  }
+}
+
 void pn_transport_pop(pn_transport_t *transport, size_t size)
 {
   if (transport) {
-    assert( transport->output_pending >= size );
-    transport->output_pending -= size;
+    pni_output_buf_pop(transport, size);
     transport->bytes_output += size;
-    if (transport->output_pending) {
-      memmove( transport->output_buf,  &transport->output_buf[size],
-               transport->output_pending );
-    }
+    if (transport->connection) pni_connection_output_drained(transport->connection);
 
     if (transport->output_pending==0 && pn_transport_pending(transport) < 0) {
       // TODO: It looks to me that this is a NOP as iff we ever get here
@@ -2998,6 +4179,48 @@ void pn_transport_pop(pn_transport_t *transport, size_t size)
   }
 }
 
+size_t pni_transport_output_segments(pn_transport_t *transport, pn_bytes_t *segments, size_t n)
+{
+  if (!n || transport->head_closed) return 0;
+  size_t count = 0;
+  // Output the io layers already produced goes first.  If they write plain
+  // AMQP frames the output chunks follow as they are, else everything must
+  // go through process_output.
+  bool direct = pni_transport_peek_output(transport, 0).size > 0;
+  if (transport->output_pending || (!direct && transport_produce(transport) > 0)) {
+    segments[count++] = pn_bytes(transport->output_pending, transport->output_buf);
+    direct = pni_transport_peek_output(transport, 0).size > 0;
+  }
+  if (direct) {
+    for (pni_output_chunk_t *chunk = transport->output_head; chunk && count < n; chunk = chunk->next) {
+      if (chunk->end > chunk->start) {
+        segments[count++] = pn_bytes(chunk->end - chunk->start, pni_output_chunk_bytes(chunk) + chunk->start);
+      }
+    }
+  }
+  return count;
+}
+
+void pni_transport_output_segments_done(pn_transport_t *transport, size_t size)
+{
+  transport->bytes_output += size;
+  size_t head = pn_min(size, transport->output_pending);
+  if (head) pni_output_buf_pop(transport, head);
+  // pn_transport_pop would refill output_buf here, copying the very chunks
+  // the caller is about to be handed by reference
+  for (size -= head; size > 0;) {
+    pn_bytes_t chunk = pn_dispatcher_peek(transport);
+    assert(chunk.size);
+    size_t n = pn_min(size, chunk.size);
+    pni_transport_consume_output(transport, n);
+    size -= n;
+  }
+  if (transport->connection) pni_connection_output_drained(transport->connection);
+  if (!transport->output_pending && !transport->output_head && pn_transport_pending(transport) < 0) {
+    pni_close_head(transport);
+  }
+}
+
 int pn_transport_close_head(pn_transport_t *transport)
 {
   ssize_t pending = pn_transport_pending(transport);
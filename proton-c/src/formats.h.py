@@ -0,0 +1,180 @@
+#!/usr/bin/python
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# The engine's pn_data_fill and pn_data_scan formats, compiled as
+# pni_fill_compile and pni_scan_compile in core/codec.c would, see
+# core/format.h. c-data-tests checks that the two agree.
+
+from __future__ import print_function
+
+FILLS = [
+  ("OPEN", "DL[SS?I?H?InnCCC]"),
+  ("BEGIN", "DL[?HIII]"),
+  ("ATTACH_SENDER", "DL[SIoBB?DL[SIsIoC?sCnCC]DL[C]CnI]"),
+  ("ATTACH_RECEIVER", "DL[SIoBB?DL[SIsIoC?sCnCC]?DL[SIsIoCC]CnIL]"),
+  ("FLOW", "DL[?IIII?I?I?In?o]"),
+  ("TRANSFER", "DL[IIzIoon?DLC?o]"),
+  ("DISPOSITION", "DL[oIIo?DL[]]"),
+  ("DISPOSITION_STATE", "DL[oIIo?DLC]"),
+  ("REJECTED", "[?DL[sSC]]"),
+  ("MODIFIED", "[ooC]"),
+  ("DETACH", "DL[Io?DL[sSC]]"),
+  ("END", "DL[?DL[sSC]]"),
+  ("CLOSE", "DL[?DL[sSC]]"),
+  ("HEADER", "DL[oB?IoI]"),
+  ("PROPERTIES", "DL[CzSSSCssttSIS]"),
+  ]
+
+SCANS = [
+  ("OPEN", "D.[?S?S?I?HI..CCC]"),
+  ("BEGIN", "D.[?HI]"),
+  ("ATTACH", "D.[SIo?B?BD.[SIsIo.s]D.[SIsIo]..IL]"),
+  ("ATTACH_TERMINUS_TYPE", "D.[.....D..DL[C]...]"),
+  ("ATTACH_TERMINI", "D.[.....D.[.....C.C.CC]D.[.....CC]"),
+  ("ATTACH_UNSETTLED", "D.[.......C]"),
+  ("TRANSFER", "D.[I?IzIoo.D?LCo]"),
+  ("FLOW", "D.[?IIII?I?II.o]"),
+  ("DISPOSITION", "D.[oI?IoD?LC]"),
+  ("DETACH", "D.[Io]"),
+  ("ERROR_DEFAULT", "D.[D.[sSC]"),
+  ("ERROR_DETACH", "D.[..D.[sSC]"),
+  ("ERROR_DISP", "[D.[sSC]"),
+  ("SECTION", "D?L."),
+  ("HEADER", "D.[oBIoI]"),
+  ("PROPERTIES", "D.[CzSSSCssttSIS]"),
+  ]
+
+LEAVES = "noBbHhIiLltfdzSsC"
+DESCRIBED_ARRAY = "A"
+EXIT_DESCRIBED = "X"
+SCANARG = 0x80
+
+def fill_compile(fmt):
+  ops, open = [], []            # open: [kind, children, pos]
+  def value():
+    while open:
+      kind = open[-1][0]
+      if kind == "?":
+        pos = open[-1][2]
+        n = len(ops) - pos - 1
+        assert n <= 255, fmt
+        ops[pos] = n
+      elif kind == "D":
+        open[-1][1] += 1
+        if open[-1][1] != 2: return
+        ops.append(EXIT_DESCRIBED)
+      else:
+        return
+      open.pop()
+  i = 0
+  while i < len(fmt):
+    code = fmt[i]
+    if code in LEAVES:
+      ops.append(code)
+      value()
+    elif code == "D":
+      ops.append(code)
+      open.append(["D", 0, 0])
+    elif code == "@":
+      if fmt[i+1:i+2] == "D":
+        i += 1
+        code = DESCRIBED_ARRAY
+      ops.append(code)
+      open.append(["[", 0, 0])
+    elif code in "[{":
+      if not (code == "[" and i > 0 and fmt[i-1] == "T"):
+        ops.append(code)
+        open.append(["[", 0, 0])
+    elif code in "]}":
+      ops.append(code)
+      if open and open[-1][0] == "[":
+        open.pop()
+        value()
+    elif code == "T":
+      ops.append(code)
+    elif code == "?":
+      ops.append(code)
+      open.append(["?", 0, len(ops)])
+      ops.append(0)
+    elif code == "*":
+      assert fmt[i+1:i+2] == "s", fmt
+      i += 1
+      ops.append(code)
+      value()
+    else:
+      raise Exception("unrecognized fill code %r in %r" % (code, fmt))
+    i += 1
+  return ops
+
+def scan_compile(fmt):
+  ops, flag = [], 0
+  for i, code in enumerate(fmt):
+    if code == "?":
+      assert fmt[i+1:i+2] not in ("", "?"), fmt
+      flag = SCANARG
+      continue
+    assert code in "noBbHhIicLltfdzSsD@[{]}.C", fmt
+    ops.append(ord(code) | flag)
+    flag = 0
+  return ops
+
+def c_op(op):
+  if isinstance(op, int):
+    if op & SCANARG: return "'%s' | PNI_OP_SCANARG" % chr(op & ~SCANARG)
+    if op >= 32 and chr(op) in LEAVES + "D@[]{}T?*." + DESCRIBED_ARRAY + EXIT_DESCRIBED:
+      return "'%s'" % chr(op)
+    return "%d" % op
+  return "'%s'" % op
+
+FORMATS = [("FILL", name, fmt, fill_compile(fmt)) for name, fmt in FILLS] + \
+          [("SCAN", name, fmt, scan_compile(fmt)) for name, fmt in SCANS]
+
+print("/* generated */")
+print("#ifndef _PROTON_FORMATS_H")
+print("#define _PROTON_FORMATS_H 1")
+print()
+print("#include \"core/format.h\"")
+print()
+for kind, name, fmt, ops in FORMATS:
+  print("PN_EXTERN extern const pni_format_t PNI_%s_%s; /* %s */" % (kind, name, fmt))
+print()
+print("/* NULL terminated, for tests */")
+print("PN_EXTERN extern const pni_format_t *const PNI_FILL_FORMATS[];")
+print("PN_EXTERN extern const pni_format_t *const PNI_SCAN_FORMATS[];")
+print()
+print("#ifdef DEFINE_FORMATS")
+for kind, name, fmt, ops in FORMATS:
+  print()
+  print("static const uint8_t PNI_%s_%s_OPS[] = {" % (kind, name))
+  print("  %s" % ", ".join(c_op(op) for op in ops))
+  print("};")
+  print("const pni_format_t PNI_%s_%s = {\"%s\", PNI_%s_%s_OPS, sizeof(PNI_%s_%s_OPS)};" %
+        (kind, name, fmt, kind, name, kind, name))
+for kind in ("FILL", "SCAN"):
+  print()
+  print("const pni_format_t *const PNI_%s_FORMATS[] = {" % kind)
+  for k, name, fmt, ops in FORMATS:
+    if k == kind: print("  &PNI_%s_%s," % (kind, name))
+  print("  NULL")
+  print("};")
+print()
+print("#endif /* DEFINE_FORMATS */")
+print()
+print("#endif /* formats.h */")
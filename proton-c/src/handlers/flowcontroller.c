@@ -20,21 +20,119 @@
  */
 
 #include <proton/link.h>
+#include <proton/delivery.h>
+#include <proton/event.h>
 #include <proton/handlers.h>
+#include <proton/object.h>
+#include <proton/reactor.h>
+#include "platform/platform.h"
 #include <assert.h>
+#include <limits.h>
+#include <string.h>
 
 typedef struct {
   int window;
+  int low_water;                /* -1 for window - 1 */
   int drained;
+  size_t max_bytes;             /* 0 unless the window is adaptive */
 } pni_flowcontroller_t;
 
 pni_flowcontroller_t *pni_flowcontroller(pn_handler_t *handler) {
   return (pni_flowcontroller_t *) pn_handler_mem(handler);
 }
 
-static void pni_topup(pn_link_t *link, int window) {
-  int delta = window - pn_link_credit(link);
-  pn_link_flow(link, delta);
+/* What an adaptive flow controller has measured of one link, kept in its
+   attachments */
+typedef struct {
+  double rate;                  /* deliveries per millisecond */
+  double rtt;                   /* milliseconds from credit granted from none to its first delivery */
+  double size;                  /* average bytes per delivery */
+  pn_timestamp_t sample_start;
+  int sample_count;             /* deliveries since sample_start */
+  pn_timestamp_t flow_at;       /* when credit was granted from none, 0 once a delivery arrives */
+  int credit;                   /* left by the last topup */
+  int window;
+} pni_link_credit_t;
+
+#define CID_pni_link_credit CID_pn_object
+#define pni_link_credit_inspect NULL
+#define pni_link_credit_hashcode NULL
+#define pni_link_credit_compare NULL
+#define pni_link_credit_finalize NULL
+
+static void pni_link_credit_initialize(void *object) {
+  pni_link_credit_t *lc = (pni_link_credit_t *) object;
+  memset(lc, 0, sizeof(*lc));
+}
+
+PN_HANDLE(PNI_LINK_CREDIT)
+
+static pni_link_credit_t *pni_link_credit(pn_link_t *link, int window) {
+  static const pn_class_t clazz = PN_CLASS(pni_link_credit);
+  pn_record_t *record = pn_link_attachments(link);
+  pni_link_credit_t *lc = (pni_link_credit_t *) pn_record_get(record, PNI_LINK_CREDIT);
+  if (!lc) {
+    lc = (pni_link_credit_t *) pn_class_new(&clazz, sizeof(pni_link_credit_t));
+    lc->window = window;
+    pn_record_def(record, PNI_LINK_CREDIT, PN_OBJECT);
+    pn_record_set(record, PNI_LINK_CREDIT, lc);
+    pn_decref(lc);
+  }
+  return lc;
+}
+
+static inline double pni_ewma(double average, double sample) {
+  return average ? average + (sample - average) / 4 : sample;
+}
+
+/* Size the window to twice the deliveries expected in a round trip, so the
+   pipeline stays full while credit is on its way. While credit is what
+   limits the rate the window doubles each sample, once the consumer is
+   what limits it the window follows its rate, and it is never allowed to
+   buffer more than max_bytes of deliveries of the average size. */
+static int pni_adapt_window(pni_link_credit_t *lc, pn_link_t *link, pn_delivery_t *delivery,
+                            pn_timestamp_t now, size_t max_bytes) {
+  if (delivery && pn_delivery_readable(delivery) && !pn_delivery_partial(delivery))
+    lc->size = pni_ewma(lc->size, (double) pn_delivery_pending(delivery));
+
+  int arrived = lc->credit - pn_link_credit(link);
+  if (arrived > 0) {
+    lc->credit -= arrived;
+    lc->sample_count += arrived;
+    if (lc->flow_at) {
+      double rtt = now > lc->flow_at ? (double) (now - lc->flow_at) : 1;
+      lc->rtt = pni_ewma(lc->rtt, rtt);
+      lc->flow_at = 0;
+    }
+  }
+
+  pn_timestamp_t period = lc->rtt > 10 ? (pn_timestamp_t) lc->rtt : 10;
+  if (!lc->sample_start) {
+    lc->sample_start = now;
+    lc->sample_count = 0;
+  } else if (now - lc->sample_start >= period) {
+    if (lc->sample_count)
+      lc->rate = pni_ewma(lc->rate, (double) lc->sample_count / (double) (now - lc->sample_start));
+    lc->sample_start = now;
+    lc->sample_count = 0;
+  }
+
+  if (lc->rate && lc->rtt) {
+    double window = 2 * lc->rate * lc->rtt + 1;
+    double cap = lc->size >= 1 ? (double) max_bytes / lc->size : (double) INT_MAX;
+    if (window > cap) window = cap;
+    if (window > INT_MAX / 2) window = INT_MAX / 2;
+    lc->window = window < 2 ? 2 : (int) window;
+  }
+  return lc->window;
+}
+
+// Restore the window in one flow once credit falls to the low-water mark
+static void pni_topup(pn_link_t *link, int window, int low_water) {
+  int credit = pn_link_credit(link);
+  if (low_water < 0 || low_water >= window) low_water = window - 1;
+  if (credit <= low_water || credit > window)
+    pn_link_flow(link, window - credit);
 }
 
 static void pn_flowcontroller_dispatch(pn_handler_t *handler, pn_event_t *event, pn_event_type_t type) {
@@ -50,7 +148,18 @@ static void pn_flowcontroller_dispatch(pn_handler_t *handler, pn_event_t *event,
     if (pn_link_is_receiver(link)) {
       fc->drained += pn_link_drained(link);
       if (!fc->drained) {
-        pni_topup(link, window);
+        if (fc->max_bytes) {
+          pn_reactor_t *reactor = pn_event_reactor(event);
+          pn_timestamp_t now = reactor ? pn_reactor_now(reactor) : pn_i_now();
+          pni_link_credit_t *lc = pni_link_credit(link, window);
+          window = pni_adapt_window(lc, link, pn_event_delivery(event), now, fc->max_bytes);
+          bool starved = !pn_link_credit(link);
+          pni_topup(link, window, fc->low_water);
+          lc->credit = pn_link_credit(link);
+          if (starved && lc->credit) lc->flow_at = now;
+        } else {
+          pni_topup(link, window, fc->low_water);
+        }
       }
     }
     break;
@@ -66,6 +175,18 @@ pn_flowcontroller_t *pn_flowcontroller(int window) {
   pn_flowcontroller_t *handler = pn_handler_new(pn_flowcontroller_dispatch, sizeof(pni_flowcontroller_t), NULL);
   pni_flowcontroller_t *fc = pni_flowcontroller(handler);
   fc->window = window;
+  fc->low_water = -1;
   fc->drained = 0;
+  fc->max_bytes = 0;
+  return handler;
+}
+
+pn_flowcontroller_t *pn_flowcontroller_adaptive(int window, size_t max_bytes) {
+  pn_flowcontroller_t *handler = pn_flowcontroller(window);
+  pni_flowcontroller(handler)->max_bytes = max_bytes;
   return handler;
 }
+
+void pn_flowcontroller_set_low_water(pn_flowcontroller_t *handler, int low_water) {
+  pni_flowcontroller(handler)->low_water = low_water < 0 ? -1 : low_water;
+}
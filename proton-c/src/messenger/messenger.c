@@ -30,6 +30,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -99,6 +100,8 @@ struct pn_messenger_t {
   pn_string_t *original;
   pn_string_t *rewritten;
   pn_string_t *domain;
+  pn_map_t *targets;            // Sender links by unrouted address
+  pn_string_t *target_key;
   int timeout;
   int send_threshold;
   pn_link_credit_mode_t credit_mode;
@@ -210,7 +213,7 @@ static void pni_connection_update(pn_selectable_t *sel) {
 
 static void pn_error_report(const char *pfx, const char *error)
 {
-  pn_logf("%s ERROR %s", pfx, error);
+  pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_ERROR, "%s ERROR %s", pfx, error);
 }
 
 void pni_modified(pn_ctx_t *ctx)
@@ -666,6 +669,8 @@ pn_messenger_t *pn_messenger(const char *name)
     m->original = pn_string(NULL);
     m->rewritten = pn_string(NULL);
     m->domain = pn_string(NULL);
+    m->targets = pn_map(PN_OBJECT, PN_WEAKREF, 0, 0.75);
+    m->target_key = pn_string(NULL);
     m->connection_error = 0;
     m->flags = PN_FLAGS_ALLOW_INSECURE_MECHS; // TODO: Change this back to 0 for the Proton 0.11 release
     m->snd_settle_mode = -1;    /* Default depends on sender/receiver */
@@ -812,6 +817,8 @@ void pn_messenger_free(pn_messenger_t *messenger)
 {
   if (messenger) {
     pn_free(messenger->domain);
+    pn_free(messenger->targets);
+    pn_free(messenger->target_key);
     pn_free(messenger->rewritten);
     pn_free(messenger->original);
     pn_free(messenger->address.text);
@@ -896,10 +903,10 @@ bool pn_messenger_flow(pn_messenger_t *messenger)
   } else {
     // not enough credit for all links
     if (!messenger->draining) {
-      pn_logf("%s: let's drain", messenger->name);
+      pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "%s: let's drain", messenger->name);
       if (messenger->next_drain == 0) {
         messenger->next_drain = pn_i_now() + 250;
-        pn_logf("%s: initializing next_drain", messenger->name);
+        pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "%s: initializing next_drain", messenger->name);
       } else if (messenger->next_drain <= pn_i_now()) {
         // initiate drain, free up at most enough to satisfy blocked
         messenger->next_drain = 0;
@@ -918,7 +925,7 @@ bool pn_messenger_flow(pn_messenger_t *messenger)
           }
         }
       } else {
-        pn_logf("%s: delaying", messenger->name);
+        pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "%s: delaying", messenger->name);
       }
     }
   }
@@ -976,7 +983,7 @@ static int pn_transport_config(pn_messenger_t *messenger,
 static void pn_condition_report(const char *pfx, pn_condition_t *condition)
 {
   if (pn_condition_is_redirect(condition)) {
-    pn_logf("%s NOTICE (%s) redirecting to %s:%i",
+    pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_INFO, "%s NOTICE (%s) redirecting to %s:%i",
             pfx,
             pn_condition_get_name(condition),
             pn_condition_redirect_host(condition),
@@ -1059,8 +1066,21 @@ int pni_pump_in(pn_messenger_t *messenger, const char *address, pn_link_t *recei
   return 0;
 }
 
+// The sender links cached by pn_messenger_target are only weak references
+static void pni_forget_targets(pn_messenger_t *messenger)
+{
+  if (pn_map_size(messenger->targets)) {
+    pn_free(messenger->targets);
+    messenger->targets = pn_map(PN_OBJECT, PN_WEAKREF, 0, 0.75);
+  }
+}
+
 void pni_messenger_reclaim_link(pn_messenger_t *messenger, pn_link_t *link)
 {
+  if (pn_link_is_sender(link)) {
+    pni_forget_targets(messenger);
+  }
+
   if (pn_link_is_receiver(link) && pn_link_credit(link) > 0) {
     int credit = pn_link_credit(link);
     messenger->credit += credit;
@@ -1248,7 +1268,7 @@ void pn_messenger_process_delivery(pn_messenger_t *messenger, pn_event_t *event)
   if (pn_delivery_readable(d)) {
     int err = pni_pump_in(messenger, pn_terminus_get_address(pn_link_source(link)), link);
     if (err) {
-      pn_logf("%s", pn_error_text(messenger->error));
+      pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_ERROR, "%s", pn_error_text(messenger->error));
     }
   }
 }
@@ -1270,13 +1290,13 @@ int pn_messenger_process_events(pn_messenger_t *messenger)
     processed++;
     switch (pn_event_type(event)) {
     case PN_CONNECTION_INIT:
-      pn_logf("connection created: %p", (void *) pn_event_connection(event));
+      pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "connection created: %p", (void *) pn_event_connection(event));
       break;
     case PN_SESSION_INIT:
-      pn_logf("session created: %p", (void *) pn_event_session(event));
+      pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "session created: %p", (void *) pn_event_session(event));
       break;
     case PN_LINK_INIT:
-      pn_logf("link created: %p", (void *) pn_event_link(event));
+      pn_log(PN_SUBSYSTEM_MESSENGER, PN_LEVEL_DEBUG, "link created: %p", (void *) pn_event_link(event));
       break;
     case PN_CONNECTION_REMOTE_OPEN:
     case PN_CONNECTION_REMOTE_CLOSE:
@@ -1800,7 +1820,22 @@ pn_link_t *pn_messenger_source(pn_messenger_t *messenger, const char *source,
 pn_link_t *pn_messenger_target(pn_messenger_t *messenger, const char *target,
                                pn_seconds_t timeout)
 {
-  return pn_messenger_link(messenger, target, true, timeout);
+  // Skip routing and resolving the address when we already have its link
+  if (target) {
+    pn_string_set(messenger->target_key, target);
+    pn_link_t *link = (pn_link_t *) pn_map_get(messenger->targets, messenger->target_key);
+    if (link && (pn_link_state(link) & PN_LOCAL_ACTIVE)) {
+      return link;
+    }
+  }
+
+  pn_link_t *link = pn_messenger_link(messenger, target, true, timeout);
+  if (link && target) {
+    pn_string_t *key = pn_string(target);
+    pn_map_put(messenger->targets, key, link);
+    pn_decref(key);
+  }
+  return link;
 }
 
 pn_subscription_t *pn_messenger_subscribe(pn_messenger_t *messenger, const char *source)
@@ -1846,6 +1881,17 @@ int pn_messenger_set_outgoing_window(pn_messenger_t *messenger, int window)
   return 0;
 }
 
+size_t pn_messenger_get_outgoing_spill(pn_messenger_t *messenger)
+{
+  return pni_store_get_spill(messenger->outgoing);
+}
+
+int pn_messenger_set_outgoing_spill(pn_messenger_t *messenger, size_t threshold)
+{
+  pni_store_set_spill(messenger->outgoing, threshold);
+  return 0;
+}
+
 int pn_messenger_get_incoming_window(pn_messenger_t *messenger)
 {
   return pni_store_get_window(messenger->incoming);
@@ -1903,6 +1949,10 @@ int pni_pump_out(pn_messenger_t *messenger, const char *address, pn_link_t *send
   }
 
   pn_buffer_t *buf = pni_entry_bytes(entry);
+  if (!buf) {
+    pni_entry_free(entry);
+    return pn_error_format(messenger->error, PN_ERR, "store error: cannot read spilled message");
+  }
   pn_bytes_t bytes = pn_buffer_bytes(buf);
   const char *encoded = bytes.start;
   size_t size = bytes.size;
@@ -1968,14 +2018,15 @@ static void pni_restore(pn_messenger_t *messenger, pn_message_t *msg)
   pn_message_set_address(msg, pn_string_get(messenger->original));
 }
 
-int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
+// Encode msg onto the outgoing queue, setting address to the queue it went on
+static int pni_messenger_store(pn_messenger_t *messenger, pn_message_t *msg,
+                               const char **address)
 {
-  if (!messenger) return PN_ARG_ERR;
   if (!msg) return pn_error_set(messenger->error, PN_ARG_ERR, "null message");
   outward_munge(messenger, msg);
-  const char *address = pn_message_get_address(msg);
+  *address = pn_message_get_address(msg);
 
-  pni_entry_t *entry = pni_store_put(messenger->outgoing, address);
+  pni_entry_t *entry = pni_store_put(messenger->outgoing, *address);
   if (!entry)
     return pn_error_format(messenger->error, PN_ERR, "store error");
 
@@ -1983,6 +2034,15 @@ int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
   pn_buffer_t *buf = pni_entry_bytes(entry);
 
   pni_rewrite(messenger, msg);
+  ssize_t needed = pn_message_encoded_size(msg);
+  if (needed > 0 && (size_t) needed > pn_buffer_capacity(buf)) {
+    int err = pn_buffer_ensure(buf, needed);
+    if (err) {
+      pni_entry_free(entry);
+      pni_restore(messenger, msg);
+      return pn_error_format(messenger->error, err, "put: error growing buffer");
+    }
+  }
   while (true) {
     char *encoded = pn_buffer_memory(buf).start;
     size_t size = pn_buffer_capacity(buf);
@@ -2001,23 +2061,72 @@ int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
     } else {
       pni_restore(messenger, msg);
       pn_buffer_append(buf, encoded, size); // XXX
-      pn_link_t *sender = pn_messenger_target(messenger, address, 0);
-      if (!sender) {
-        int err = pn_error_code(messenger->error);
-        if (err) {
-          return err;
-        } else if (messenger->connection_error) {
-          return pni_bump_out(messenger, address);
-        } else {
-          return 0;
-        }
+      pni_entry_stored(entry);
+      return 0;
+    }
+  }
+
+  return PN_ERR;
+}
+
+// Offer up to count queued messages for address to its link
+static int pni_messenger_offer(pn_messenger_t *messenger, const char *address, size_t count)
+{
+  pn_link_t *sender = pn_messenger_target(messenger, address, 0);
+  for (size_t i = 0; i < count; i++) {
+    int err = 0;
+    if (!sender) {
+      err = pn_error_code(messenger->error);
+      if (err) {
+        return err;
+      } else if (messenger->connection_error) {
+        err = pni_bump_out(messenger, address);
       } else {
-        return pni_pump_out(messenger, address, sender);
+        return 0;
       }
+    } else {
+      err = pni_pump_out(messenger, address, sender);
     }
+    if (err) return err;
   }
+  return 0;
+}
 
-  return PN_ERR;
+int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
+{
+  if (!messenger) return PN_ARG_ERR;
+  const char *address;
+  int err = pni_messenger_store(messenger, msg, &address);
+  if (err) return err;
+  return pni_messenger_offer(messenger, address, 1);
+}
+
+int pn_messenger_put_batch(pn_messenger_t *messenger, pn_message_t **msgs, size_t count)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msgs && count) return pn_error_set(messenger->error, PN_ARG_ERR, "null messages");
+
+  // Runs of messages to the same address share one link lookup
+  pn_string_t *run = pn_string(NULL);
+  size_t queued = 0;
+  int err = 0;
+  for (size_t i = 0; i < count && !err; i++) {
+    const char *address;
+    err = pni_messenger_store(messenger, msgs[i], &address);
+    if (err) break;
+    if (queued && strcmp(pn_string_get(run), address)) {
+      err = pni_messenger_offer(messenger, pn_string_get(run), queued);
+      queued = 0;
+    }
+    if (!queued) pn_string_set(run, address);
+    queued++;
+  }
+  if (queued) {
+    int offered = pni_messenger_offer(messenger, pn_string_get(run), queued);
+    if (!err) err = offered;
+  }
+  pn_free(run);
+  return err;
 }
 
 pn_tracker_t pn_messenger_outgoing_tracker(pn_messenger_t *messenger)
@@ -2261,6 +2370,21 @@ int pn_messenger_get(pn_messenger_t *messenger, pn_message_t *msg)
   }
 }
 
+int pn_messenger_get_batch(pn_messenger_t *messenger, pn_message_t **msgs, size_t count)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msgs && count) return pn_error_set(messenger->error, PN_ARG_ERR, "null messages");
+
+  int got = 0;
+  while ((size_t) got < count && got < INT_MAX) {
+    int err = pn_messenger_get(messenger, msgs[got]);
+    if (err == PN_EOS) break;
+    if (err) return err;
+    got++;
+  }
+  return got || !count ? got : PN_EOS;
+}
+
 pn_tracker_t pn_messenger_incoming_tracker(pn_messenger_t *messenger)
 {
   assert(messenger);
@@ -2347,6 +2471,7 @@ int pn_messenger_incoming(pn_messenger_t *messenger)
 int pn_messenger_route(pn_messenger_t *messenger, const char *pattern, const char *address)
 {
   pn_transform_rule(messenger->routes, pattern, address);
+  pni_forget_targets(messenger);
   return 0;
 }
 
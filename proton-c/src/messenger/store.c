@@ -26,6 +26,7 @@
 #ifndef __cplusplus
 #include <stdbool.h>
 #endif
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "core/util.h"
@@ -35,10 +36,20 @@ typedef struct pni_stream_t pni_stream_t;
 
 struct pni_store_t {
   pni_stream_t *streams;
+  pni_stream_t *streams_tail;
+  pni_stream_t **buckets;       // Streams hashed by address
+  size_t bucket_count;          // Power of 2, or 0 before the first stream
+  size_t stream_count;
   pni_entry_t *store_head;
   pni_entry_t *store_tail;
-  pn_hash_t *tracked;
+  pni_entry_t **tracked;        // Ring of the tracked window, indexed by id
+  size_t tracked_capacity;      // Power of 2, or 0 before the first entry
   size_t size;
+  FILE *spill;                  // Log of the entries stored past the threshold
+  size_t spill_threshold;       // Encoded bytes kept in memory, 0 for no limit
+  size_t spill_end;             // Where the next spilled entry goes
+  size_t spilled;               // Entries in the log
+  size_t memory;                // Encoded bytes of the entries in memory
   int window;
   pn_sequence_t lwm;
   pn_sequence_t hwm;
@@ -50,6 +61,8 @@ struct pni_stream_t {
   pni_entry_t *stream_head;
   pni_entry_t *stream_tail;
   pni_stream_t *next;
+  pni_stream_t *bucket_next;
+  uintptr_t hash;
 };
 
 struct pni_entry_t {
@@ -58,11 +71,15 @@ struct pni_entry_t {
   pni_entry_t *stream_prev;
   pni_entry_t *store_next;
   pni_entry_t *store_prev;
-  pn_buffer_t *bytes;
+  pn_buffer_t *bytes;           // NULL while spilled
   pn_delivery_t *delivery;
   void *context;
+  size_t memory;                // Bytes counted in store->memory
+  size_t spill_offset;
+  size_t spill_size;
   pn_status_t status;
   pn_sequence_t id;
+  bool spilled;
   bool free;
 };
 
@@ -84,12 +101,22 @@ pni_store_t *pni_store()
 
   store->size = 0;
   store->streams = NULL;
+  store->streams_tail = NULL;
+  store->buckets = NULL;
+  store->bucket_count = 0;
+  store->stream_count = 0;
   store->store_head = NULL;
   store->store_tail = NULL;
   store->window = 0;
   store->lwm = 0;
   store->hwm = 0;
-  store->tracked = pn_hash(PN_OBJECT, 0, 0.75);
+  store->tracked = NULL;
+  store->tracked_capacity = 0;
+  store->spill = NULL;
+  store->spill_threshold = 0;
+  store->spill_end = 0;
+  store->spilled = 0;
+  store->memory = 0;
 
   return store;
 }
@@ -100,36 +127,70 @@ size_t pni_store_size(pni_store_t *store)
   return store->size;
 }
 
+static uintptr_t pni_address_hash(const char *address)
+{
+  uintptr_t hash = 5381;
+  for (const char *c = address; *c; c++) {
+    hash = hash * 33 + (unsigned char) *c;
+  }
+  return hash;
+}
+
+// Keep at most one stream per bucket on average
+static bool pni_stream_rehash(pni_store_t *store)
+{
+  if (store->stream_count < store->bucket_count) return true;
+  size_t count = store->bucket_count ? 2 * store->bucket_count : 16;
+  pni_stream_t **buckets = (pni_stream_t **) calloc(count, sizeof(pni_stream_t *));
+  if (!buckets) return false;
+  for (pni_stream_t *stream = store->streams; stream; stream = stream->next) {
+    pni_stream_t **bucket = &buckets[stream->hash & (count - 1)];
+    stream->bucket_next = *bucket;
+    *bucket = stream;
+  }
+  free(store->buckets);
+  store->buckets = buckets;
+  store->bucket_count = count;
+  return true;
+}
+
 pni_stream_t *pni_stream(pni_store_t *store, const char *address, bool create)
 {
   assert(store);
   assert(address);
 
-  pni_stream_t *prev = NULL;
-  pni_stream_t *stream = store->streams;
-  while (stream) {
-    if (!strcmp(pn_string_get(stream->address), address)) {
-      return stream;
+  uintptr_t hash = pni_address_hash(address);
+  if (store->bucket_count) {
+    pni_stream_t *stream = store->buckets[hash & (store->bucket_count - 1)];
+    for (; stream; stream = stream->bucket_next) {
+      if (stream->hash == hash && !strcmp(pn_string_get(stream->address), address)) {
+        return stream;
+      }
     }
-    prev = stream;
-    stream = stream->next;
   }
 
-  if (create) {
-    stream = (pni_stream_t *) malloc(sizeof(pni_stream_t));
-    if (stream != NULL) {
-      stream->store = store;
-      stream->address = pn_string(address);
-      stream->stream_head = NULL;
-      stream->stream_tail = NULL;
-      stream->next = NULL;
-
-      if (prev) {
-        prev->next = stream;
-      } else {
-        store->streams = stream;
-      }
+  if (!create || !pni_stream_rehash(store)) return NULL;
+
+  pni_stream_t *stream = (pni_stream_t *) malloc(sizeof(pni_stream_t));
+  if (stream != NULL) {
+    stream->store = store;
+    stream->address = pn_string(address);
+    stream->stream_head = NULL;
+    stream->stream_tail = NULL;
+    stream->next = NULL;
+    stream->hash = hash;
+
+    if (store->streams_tail) {
+      store->streams_tail->next = stream;
+    } else {
+      store->streams = stream;
     }
+    store->streams_tail = stream;
+
+    pni_stream_t **bucket = &store->buckets[hash & (store->bucket_count - 1)];
+    stream->bucket_next = *bucket;
+    *bucket = stream;
+    store->stream_count++;
   }
 
   return stream;
@@ -156,6 +217,11 @@ void pni_entry_free(pni_entry_t *entry)
   LL_REMOVE(store, store, entry);
   entry->free = true;
 
+  if (entry->spilled) {
+    // The log is append only, start it again once it is empty
+    if (--store->spilled == 0) store->spill_end = 0;
+  }
+  store->memory -= entry->memory;
   pn_buffer_free(entry->bytes);
   entry->bytes = NULL;
   pn_decref(entry);
@@ -174,16 +240,23 @@ void pni_stream_free(pni_stream_t *stream)
   free(stream);
 }
 
+static void pni_store_untrack(pni_store_t *store, pn_sequence_t id);
+
 void pni_store_free(pni_store_t *store)
 {
   if (!store) return;
-  pn_free(store->tracked);
+  for (pn_sequence_t id = store->lwm; store->hwm - id > 0; id++) {
+    pni_store_untrack(store, id);
+  }
+  free(store->tracked);
   pni_stream_t *stream = store->streams;
   while (stream) {
     pni_stream_t *next = stream->next;
     pni_stream_free(stream);
     stream = next;
   }
+  free(store->buckets);
+  if (store->spill) fclose(store->spill);
   free(store);
 }
 
@@ -222,6 +295,10 @@ pni_entry_t *pni_store_put(pni_store_t *store, const char *address)
   entry->store_next = NULL;
   entry->store_prev = NULL;
   entry->delivery = NULL;
+  entry->memory = 0;
+  entry->spill_offset = 0;
+  entry->spill_size = 0;
+  entry->spilled = false;
   entry->bytes = pn_buffer(64);
   entry->status = PN_STATUS_UNKNOWN;
   LL_ADD(stream, stream, entry);
@@ -242,12 +319,73 @@ pni_entry_t *pni_store_get(pni_store_t *store, const char *address)
   }
 }
 
+// Read a spilled entry back from the log, NULL on error
+static pn_buffer_t *pni_entry_unspill(pni_entry_t *entry)
+{
+  pni_store_t *store = entry->stream->store;
+  pn_buffer_t *buf = pn_buffer(entry->spill_size);
+  if (!buf) return NULL;
+  pn_rwbytes_t space = pn_buffer_reserve(buf, entry->spill_size);
+  if (!space.start ||
+      fseek(store->spill, (long) entry->spill_offset, SEEK_SET) ||
+      fread(space.start, 1, entry->spill_size, store->spill) != entry->spill_size) {
+    pn_buffer_free(buf);
+    return NULL;
+  }
+  pn_buffer_extend(buf, entry->spill_size);
+  return buf;
+}
+
+// Spilled entries are read back when first asked for, NULL if that fails
 pn_buffer_t *pni_entry_bytes(pni_entry_t *entry)
 {
   assert(entry);
+  if (!entry->bytes && entry->spilled) {
+    entry->bytes = pni_entry_unspill(entry);
+  }
   return entry->bytes;
 }
 
+// Write the encoded entry to the log, false if it must stay in memory
+static bool pni_entry_spill(pni_entry_t *entry)
+{
+  pni_store_t *store = entry->stream->store;
+  if (!store->spill) {
+    store->spill = tmpfile();
+    if (!store->spill) return false;
+  }
+  pn_bytes_t bytes = pn_buffer_bytes(entry->bytes);
+  if (fseek(store->spill, (long) store->spill_end, SEEK_SET) ||
+      fwrite(bytes.start, 1, bytes.size, store->spill) != bytes.size ||
+      fflush(store->spill)) {
+    return false;
+  }
+  entry->spilled = true;
+  entry->spill_offset = store->spill_end;
+  entry->spill_size = bytes.size;
+  store->spill_end += bytes.size;
+  store->spilled++;
+  pn_buffer_free(entry->bytes);
+  entry->bytes = NULL;
+  return true;
+}
+
+// Called once the entry's bytes are complete.  Entries that would take the
+// store past its threshold go to the log, an entry the log cannot take
+// stays in memory.
+void pni_entry_stored(pni_entry_t *entry)
+{
+  assert(entry);
+  pni_store_t *store = entry->stream->store;
+  size_t size = pn_buffer_size(entry->bytes);
+  if (store->spill_threshold && store->memory + size > store->spill_threshold &&
+      pni_entry_spill(entry)) {
+    return;
+  }
+  entry->memory = size;
+  store->memory += size;
+}
+
 pn_status_t pni_entry_get_status(pni_entry_t *entry)
 {
   assert(entry);
@@ -340,15 +478,49 @@ pn_sequence_t pni_entry_id(pni_entry_t *entry)
   return entry->id;
 }
 
+bool pni_store_tracking(pni_store_t *store, pn_sequence_t id)
+{
+  return (id - store->lwm >= 0) && (store->hwm - id > 0);
+}
+
+static pni_entry_t **pni_store_slot(pni_store_t *store, pn_sequence_t id)
+{
+  return &store->tracked[(size_t) id & (store->tracked_capacity - 1)];
+}
+
 pni_entry_t *pni_store_entry(pni_store_t *store, pn_sequence_t id)
 {
   assert(store);
-  return (pni_entry_t *) pn_hash_get(store->tracked, id);
+  if (!pni_store_tracking(store, id)) return NULL;
+  return *pni_store_slot(store, id);
 }
 
-bool pni_store_tracking(pni_store_t *store, pn_sequence_t id)
+// The ring holds a reference to each tracked entry
+static void pni_store_untrack(pni_store_t *store, pn_sequence_t id)
 {
-  return (id - store->lwm >= 0) && (store->hwm - id > 0);
+  pni_entry_t **slot = pni_store_slot(store, id);
+  pni_entry_t *e = *slot;
+  if (e) {
+    *slot = NULL;
+    pn_decref(e);
+  }
+}
+
+// Make room in the ring for one more id past hwm
+static bool pni_store_reserve(pni_store_t *store)
+{
+  size_t tracked = (size_t) (store->hwm - store->lwm);
+  if (tracked < store->tracked_capacity) return true;
+  size_t capacity = store->tracked_capacity ? 2 * store->tracked_capacity : 16;
+  pni_entry_t **ring = (pni_entry_t **) calloc(capacity, sizeof(pni_entry_t *));
+  if (!ring) return false;
+  for (pn_sequence_t id = store->lwm; store->hwm - id > 0; id++) {
+    ring[(size_t) id & (capacity - 1)] = *pni_store_slot(store, id);
+  }
+  free(store->tracked);
+  store->tracked = ring;
+  store->tracked_capacity = capacity;
+  return true;
 }
 
 pn_sequence_t pni_entry_track(pni_entry_t *entry)
@@ -356,15 +528,23 @@ pn_sequence_t pni_entry_track(pni_entry_t *entry)
   assert(entry);
 
   pni_store_t *store = entry->stream->store;
-  entry->id = store->hwm++;
-  pn_hash_put(store->tracked, entry->id, entry);
+  entry->id = store->hwm;
+  if (!pni_store_reserve(store)) {
+    // Out of memory: drop the oldest entry to make room, as a full window would
+    if (!store->tracked_capacity) {
+      store->lwm = ++store->hwm;
+      return entry->id;
+    }
+    pni_store_untrack(store, store->lwm);
+    store->lwm++;
+  }
+  store->hwm++;
+  pn_incref(entry);
+  *pni_store_slot(store, entry->id) = entry;
 
   if (store->window >= 0) {
     while (store->hwm - store->lwm > store->window) {
-      pni_entry_t *e = pni_store_entry(store, store->lwm);
-      if (e) {
-        pn_hash_del(store->tracked, store->lwm);
-      }
+      pni_store_untrack(store, store->lwm);
       store->lwm++;
     }
   }
@@ -416,13 +596,13 @@ int pni_store_update(pni_store_t *store, pn_sequence_t id, pn_status_t status,
         if (d) {
           pn_delivery_settle(d);
         }
-        pn_hash_del(store->tracked, e->id);
+        pni_store_untrack(store, e->id);
       }
     }
   }
 
   while (store->hwm - store->lwm > 0 &&
-         !pn_hash_get(store->tracked, store->lwm)) {
+         !*pni_store_slot(store, store->lwm)) {
     store->lwm++;
   }
 
@@ -440,3 +620,15 @@ void pni_store_set_window(pni_store_t *store, int window)
   assert(store);
   store->window = window;
 }
+
+size_t pni_store_get_spill(pni_store_t *store)
+{
+  assert(store);
+  return store->spill_threshold;
+}
+
+void pni_store_set_spill(pni_store_t *store, size_t threshold)
+{
+  assert(store);
+  store->spill_threshold = threshold;
+}
@@ -41,6 +41,7 @@ void pni_entry_set_delivery(pni_entry_t *entry, pn_delivery_t *delivery);
 void pni_entry_set_context(pni_entry_t *entry, void *context);
 void *pni_entry_get_context(pni_entry_t *entry);
 void pni_entry_updated(pni_entry_t *entry);
+void pni_entry_stored(pni_entry_t *entry);
 void pni_entry_free(pni_entry_t *entry);
 
 pn_sequence_t pni_entry_track(pni_entry_t *entry);
@@ -49,6 +50,8 @@ int pni_store_update(pni_store_t *store, pn_sequence_t id, pn_status_t status,
                      int flags, bool settle, bool match);
 int pni_store_get_window(pni_store_t *store);
 void pni_store_set_window(pni_store_t *store, int window);
+size_t pni_store_get_spill(pni_store_t *store);
+void pni_store_set_spill(pni_store_t *store, size_t threshold);
 
 
 #endif /* store.h */
@@ -0,0 +1,80 @@
+#!/usr/bin/python
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# Structs and decoders for the performatives the dispatcher reads straight
+# from the frame bytes, see core/reader.h
+
+from __future__ import print_function
+from protocol import *
+
+DIRECT = ["transfer", "flow", "disposition"]
+
+# AMQP type: C type, reader. Anything else is kept as its encoded bytes.
+READERS = {
+  "boolean": ("bool", "pni_read_bool"),
+  "ubyte": ("uint8_t", "pni_read_ubyte"),
+  "ushort": ("uint16_t", "pni_read_ushort"),
+  "uint": ("uint32_t", "pni_read_uint"),
+  "ulong": ("uint64_t", "pni_read_ulong"),
+  "binary": ("pn_bytes_t", "pni_read_binary"),
+  "string": ("pn_bytes_t", "pni_read_string"),
+  "symbol": ("pn_bytes_t", "pni_read_symbol"),
+  }
+RAW = ("pn_bytes_t", "pni_read_raw")
+
+print("/* generated */")
+print("#ifndef _PROTON_PERFORMATIVES_H")
+print("#define _PROTON_PERFORMATIVES_H 1")
+print()
+print("#include \"protocol.h\"")
+print("#include \"core/reader.h\"")
+print()
+print("#include <string.h>")
+print()
+print("/* True if the field was given and not null */")
+print("#define PNI_PRESENT(p, field) (((p)->present >> (field)) & 1)")
+
+for type in TYPES:
+  if type["@name"] not in DIRECT: continue
+  fields = list(type.query["field"])
+  kw = field_kw(type)
+  print()
+  print("typedef struct pni_%s_t {" % tname(type))
+  print("  uint32_t present;")
+  for f in fields:
+    print("  %s %s;" % (READERS.get(ftype(f), RAW)[0], fname(f)))
+  print("} pni_%s_t;" % tname(type))
+  print()
+  print("/* Decode the count fields of a %s, false if any needs the general decoder */" % type["@name"])
+  print("static inline bool pni_decode_%s(pni_reader_t *r, uint32_t count, pni_%s_t *p)" % (tname(type), tname(type)))
+  print("{")
+  print("  memset(p, 0, sizeof(*p));")
+  for f in fields:
+    field = "%s_%s" % (kw, field_kw(f))
+    print("  if (count <= %s) return true;" % field)
+    print("  if (!pni_read_null(r)) {")
+    print("    if (!%s(r, &p->%s)) return false;" % (READERS.get(ftype(f), RAW)[1], fname(f)))
+    print("    p->present |= 1u << %s;" % field)
+    print("  }")
+  print("  return pni_skip_values(r, count - %d);" % len(fields))
+  print("}")
+
+print()
+print("#endif /* performatives.h */")
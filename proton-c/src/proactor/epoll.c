@@ -46,10 +46,12 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <asm/socket.h>         /* Linux socket options hidden without _GNU_SOURCE */
 #include <netdb.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
@@ -57,7 +59,6 @@
 #include <limits.h>
 #include <time.h>
 
-// TODO: replace timerfd per connection with global lightweight timer mechanism.
 // logging in general
 // SIGPIPE?
 // Can some of the mutexes be spinlocks (any benefit over adaptive pthread mutex)?
@@ -65,8 +66,7 @@
 // See other "TODO" in code.
 //
 // Consider case of large number of wakes: proactor_do_epoll() could start by
-// looking for pending wakes before a kernel call to epoll_wait(), or there
-// could be several eventfds with random assignment of wakeables.
+// looking for pending wakes before a kernel call to epoll_wait().
 
 
 typedef char strerrorbuf[1024];      /* used for pstrerror message buffer */
@@ -115,17 +115,20 @@ static inline void unlock(pmutex *m) { pthread_mutex_unlock(m); }
 typedef enum {
   WAKE,   /* see if any work to do in proactor/psocket context */
   PCONNECTION_IO,
-  PCONNECTION_TIMER,
+  PCONNECTION_TIMER,  /* the shared connection timer wheel */
   LISTENER_IO,
-  PROACTOR_TIMER } epoll_type_t;
+  PROACTOR_TIMER,
+  POLLER } epoll_type_t;  /* a per-thread epoll set with ready events */
 
 // Data to use with epoll.
 typedef struct epoll_extended_t {
   struct psocket_t *psocket;  // pconnection, listener, or NULL -> proactor
   int fd;
+  int epollfd;         // epoll set the fd is polled in
   epoll_type_t type;   // io/timer/wakeup
   uint32_t wanted;     // events to poll for
   bool polling;
+  bool edge;           // EPOLLET instead of EPOLLONESHOT, never rearmed
 } epoll_extended_t;
 
 /*
@@ -156,14 +159,13 @@ typedef struct ptimer_t {
   bool shutting_down;
 } ptimer_t;
 
-static bool ptimer_init(ptimer_t *pt, struct psocket_t *ps) {
+static bool ptimer_init(ptimer_t *pt, epoll_type_t type) {
   pt->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
   pmutex_init(&pt->mutex);
   pt->timer_active = false;
   pt->in_doubt = false;
   pt->shutting_down = false;
-  epoll_type_t type = ps ? PCONNECTION_TIMER : PROACTOR_TIMER;
-  pt->epoll_io.psocket = ps;
+  pt->epoll_io.psocket = NULL;
   pt->epoll_io.fd = pt->timerfd;
   pt->epoll_io.type = type;
   pt->epoll_io.wanted = EPOLLIN;
@@ -224,32 +226,15 @@ static bool ptimer_callback(ptimer_t *pt) {
   return u_exp_count > 0;
 }
 
-// Return true if timerfd has and will have no pollable expiries in the current armed state
-static bool ptimer_shutdown(ptimer_t *pt, bool currently_armed) {
-  lock(&pt->mutex);
-  if (currently_armed) {
-    ptimer_set_lh(pt, 0);
-    pt->shutting_down = true;
-    if (pt->in_doubt)
-      // Force at least one callback.  If two, second cannot proceed with unarmed timerfd.
-      ptimer_set_lh(pt, 1);
-  }
-  else
-    pt->shutting_down = true;
-  bool rv = !pt->in_doubt;
-  unlock(&pt->mutex);
-  return rv;
-}
-
 static void ptimer_finalize(ptimer_t *pt) {
   if (pt->timerfd >= 0) close(pt->timerfd);
   pmutex_finalize(&pt->mutex);
 }
 
-pn_timestamp_t pn_i_now2(void)
+static pn_timestamp_t clock_now(clockid_t clock)
 {
   struct timespec now;
-  clock_gettime(CLOCK_REALTIME, &now);
+  clock_gettime(clock, &now);
   return ((pn_timestamp_t)now.tv_sec) * 1000 + (now.tv_nsec / 1000000);
 }
 
@@ -260,14 +245,87 @@ pn_timestamp_t pn_i_now2(void)
 const char *AMQP_PORT = "5672";
 const char *AMQP_PORT_NAME = "amqp";
 
-PN_HANDLE(PN_PROACTOR)
+static const pn_handle_t PN_PROACTOR = PN_RECORD_SLOT(1);
 
 // The number of times a connection event batch may be replenished for
 // a thread between calls to wait().  Some testing shows that
 // increasing this value above 1 actually slows performance slightly
-// and increases latency.
+// and increases latency.  PN_PROACTOR_HOG_MAX overrides it.
 #define HOG_MAX 1
 
+// Ring size of "shm:" connections, PN_PROACTOR_SHM_SIZE overrides it.
+#define SHM_SIZE (256 * 1024)
+
+// The most read() or send() calls a working thread makes on a socket before
+// going back to deliver events, as long as each call fills or empties the
+// whole transport buffer.
+#define IO_LOOP_MAX 4
+
+// How often listeners left idle by running out of file descriptors try to
+// accept again, in milliseconds.  PN_PROACTOR_OVERFLOW_RETRY overrides it.
+// PN_PROACTOR_FD_RESERVE=0 stops the proactor holding a spare fd to refuse
+// connections with, see listener_shed_lh().
+#define OVERFLOW_RETRY_MS 100
+
+/*
+ * Options set with pn_proactor_set_option() or the environment variable of
+ * the same name follow.  Fairness options, 0 means no limit:
+ *  - PN_PROACTOR_BATCH_EVENTS: most events in one connection batch.  The batch
+ *    ends early and the connection goes back in line behind other ready work.
+ *  - PN_PROACTOR_TURN_BYTES: most bytes read, and most bytes written, for a
+ *    connection in one turn.  A connection with more to do yields its thread.
+ *  - PN_PROACTOR_HANDSHAKE_MAX: most threads doing I/O at once for connections
+ *    the peer has not opened yet, where TLS and SASL handshakes do their
+ *    crypto.  Others wait in line, so a burst of reconnects leaves the rest of
+ *    the threads to established connections.
+ * Small values favour latency, large ones throughput.
+ *
+ * PN_PROACTOR_HIBERNATE: milliseconds a connection may go without delivering
+ * events before it hibernates, 0 (the default) never.  A hibernating
+ * connection frees its transport's empty I/O buffers and scratch space, see
+ * pn_transport_hibernate(), and allocates them again when it next reads or
+ * writes.  Heartbeats do not count as activity, so a mostly idle connection
+ * with an idle timeout hibernates again after each one.
+ *
+ * PN_PROACTOR_LOCAL_WAKE: when > 0, work posted to a connection by a thread
+ * that is handling a batch, e.g. pn_connection_wake() from a handler, skips
+ * the wake eventfd.  The thread keeps the connection and runs it from its
+ * next pn_proactor_wait() or pn_proactor_get() without an epoll round trip,
+ * see local_wake_defer().  A thread keeps one such connection at a time, and
+ * puts it on the wake list if it exits first.  Only useful when the threads
+ * handling batches come straight back for more.
+ *
+ * PN_PROACTOR_WRITE_MORE: when > 0, output flushed in the middle of a batch
+ * that is about to read more input, see PN_PROACTOR_HOG_MAX, is sent with
+ * MSG_MORE since the events from that input usually add to it.  The kernel
+ * holds back partial segments until the flush at the end of the batch, which
+ * sends without MSG_MORE or uncorks the socket, see write_flush().  Fewer,
+ * fuller segments under a load of many small messages, at the cost of latency
+ * for output that waits on the rest of its batch.  A batch with no more input
+ * waiting flushes as usual.
+ *
+ * PN_PROACTOR_SPIN: microseconds a thread in pn_proactor_wait() polls for work
+ * without blocking before it sleeps in epoll_wait(), 0 (the default) never.
+ * While any thread spins, wakes skip the eventfd write and leave a flag the
+ * spinners check instead, see wake_notify() and proactor_spin().  Trades CPU
+ * for latency, best with no more threads than idle cores.
+ * PN_PROACTOR_BUSY_POLL: when > 0, set as SO_BUSY_POLL on each connection
+ * socket: microseconds a read of an empty socket polls the device queue for
+ * more before giving up.  Values above net.core.busy_read need CAP_NET_ADMIN.
+ *
+ * PN_PROACTOR_SHM_SIZE: bytes in each direction of the shared memory rings
+ * a "shm:" connection creates, rounded up to a power of 2, 256KiB by default.
+ * See shm.c, the accepting end uses the size the connecting end chose.
+ *
+ * PN_PROACTOR_EDGE: when > 0, connection sockets are polled edge-triggered
+ * once connected and the wake eventfds always are, so a turn ends without the
+ * epoll_ctl() that rearms a one-shot descriptor, see edge_table_t.
+ *
+ * PN_PROACTOR_PREWARM_DELIVERIES, PN_PROACTOR_PREWARM_EVENTS: deliveries and
+ * events each new connection allocates up front, see pni_proactor_prewarm(),
+ * so its first messages are handled without allocating.
+ */
+
 /* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
    Class definitions are for identification as pn_event_t context only.
 */
@@ -278,12 +336,14 @@ static bool start_polling(epoll_extended_t *ee, int epollfd) {
   if (ee->polling)
     return false;
   ee->polling = true;
+  ee->epollfd = epollfd;
   struct epoll_event ev;
   ev.data.ptr = ee;
-  ev.events = ee->wanted | EPOLLONESHOT;
+  ev.events = ee->wanted | (ee->edge ? EPOLLET : EPOLLONESHOT);
   return (epoll_ctl(epollfd, EPOLL_CTL_ADD, ee->fd, &ev) == 0);
 }
 
+// epollfd is the proactor epollfd, -1 once the proactor is being freed
 static void stop_polling(epoll_extended_t *ee, int epollfd) {
   // TODO: check for error, return bool or just log?
   if (ee->fd == -1 || !ee->polling || epollfd == -1)
@@ -291,7 +351,7 @@ static void stop_polling(epoll_extended_t *ee, int epollfd) {
   struct epoll_event ev;
   ev.data.ptr = ee;
   ev.events = 0;
-  if (epoll_ctl(epollfd, EPOLL_CTL_DEL, ee->fd, &ev) == -1)
+  if (epoll_ctl(ee->epollfd, EPOLL_CTL_DEL, ee->fd, &ev) == -1)
     EPOLL_FATAL("EPOLL_CTL_DEL", errno);
   ee->fd = -1;
   ee->polling = false;
@@ -306,6 +366,8 @@ static void stop_polling(epoll_extended_t *ee, int epollfd) {
  * (i.e. socket IO is ready and wakeup at same time). Mutexes are used
  * to manage contention.  Some vars are only ever touched by one
  * "working" thread and are accessed without holding the mutex.
+ * Connections are scheduled with an atomic state word instead (see
+ * PCS_WORKING) so an uncontended connection turn takes no mutex at all.
  *
  * Currently internal wakeups (via wake()/wake_notify()) are used to
  * force a context to check if it has work to do.  To minimize trips
@@ -332,9 +394,10 @@ typedef struct pcontext_t {
   pn_proactor_t *proactor;  /* Immutable */
   void *owner;              /* Instance governed by the context */
   pcontext_type_t type;
-  bool working;
+  bool working;             /* Not used by PCONNECTION, see pconnection_t.sched */
   int wake_ops;             // unprocessed eventfd wake callback (convert to bool?)
-  struct pcontext_t *wake_next; // wake list, guarded by proactor eventfd_mutex
+  struct pcontext_t *wake_next; // wake list, guarded by the wake_shard_t mutex
+  uint64_t wake_time;       // when added to the wake list, only with proactor stats
   bool closing;
   // Next 4 are protected by the proactor mutex
   struct pcontext_t* next;  /* Protected by proactor.mutex */
@@ -355,6 +418,126 @@ static void pcontext_finalize(pcontext_t* ctx) {
   pmutex_finalize(&ctx->mutex);
 }
 
+/*
+ * Wakes are spread over several independent shards, each with its own eventfd,
+ * mutex and wake list, so threads waking unrelated contexts do not contend.
+ * A context always uses the same shard, chosen from its address.
+ */
+#define WAKE_SHARDS 8
+
+typedef struct wake_shard_t {
+  int eventfd;
+  pmutex mutex;
+  bool wakes_in_progress;
+  bool spin_notified;  // atomic, notified without the eventfd, see wake_notify()
+  pcontext_t *wake_list_first;
+  pcontext_t *wake_list_last;
+  epoll_extended_t epoll_wake;
+} wake_shard_t;
+
+/*
+ * Connection timers share a single timerfd owned by the proactor.  Deadlines
+ * are kept in a hashed timer wheel: each slot covers TWHEEL_TICK_MS and holds
+ * the entries due in that tick of any round, so scheduling and cancelling are
+ * O(1) and an expiry only visits the slots that have come due.  The timerfd is
+ * armed for the earliest deadline in the first non-empty slot.
+ *
+ * Deadlines and transport ticks use the wheel's monotonic clock so that
+ * setting the system time neither fires nor postpones idle timeouts.  The
+ * coarse clock is used when its resolution is within TWHEEL_TICK_MS, it is
+ * read without touching the hardware counter.  Connections read the clock at
+ * most once per turn, see pconnection_now().
+ *
+ * Lock ordering: twheel_t mutex before any connection mutex.
+ */
+#define TWHEEL_SLOTS 1024
+#define TWHEEL_TICK_MS 8
+
+typedef struct twheel_entry_t {
+  struct twheel_entry_t *next;
+  struct twheel_entry_t *prev;
+  uint64_t deadline;            /* 0 if not scheduled */
+} twheel_entry_t;
+
+typedef struct twheel_t {
+  pmutex mutex;
+  ptimer_t timer;
+  uint64_t tick;                /* last tick processed */
+  uint64_t armed;               /* deadline the timerfd is set for, 0 if none */
+  clockid_t clock;              /* source of deadlines, see twheel_now() */
+  twheel_entry_t *slots[TWHEEL_SLOTS];
+} twheel_t;
+
+/*
+ * Optional per-thread polling, enabled by setting PN_PROACTOR_POLLERS to the
+ * number of epoll sets to use.  Each thread calling pn_proactor_wait/get has a
+ * home poller; connections are polled in the home poller of the thread that
+ * started them, which for accepted connections is the thread handling the
+ * PN_LISTENER_ACCEPT event.  A thread always looks at its home poller first
+ * and only takes work from another poller when it would otherwise block.
+ * Listeners, wakes and timers stay in the proactor epollfd, which also polls
+ * every poller's epollfd so an idle thread can see work anywhere.
+ *
+ * PN_PROACTOR_NUMA > 0 spreads the pollers over the host's NUMA nodes, one
+ * poller per node if PN_PROACTOR_POLLERS is not set.  A thread's home is a
+ * poller of the node it first calls the proactor on, and the thread is bound
+ * to that node's CPUs.  Connections it starts or accepts are polled there, and
+ * their I/O buffers, allocated on first use, come from memory local to it.
+ */
+#define MAX_POLLERS 64
+
+typedef struct poller_t {
+  int epollfd;
+  epoll_extended_t epoll_io;    /* this poller's epollfd in the proactor epollfd */
+} poller_t;
+
+/*
+ * pn_proactor_connect() resolves addresses on a small pool of resolver threads
+ * so a slow DNS server does not stall a proactor thread.  Results, including
+ * failures, are cached by host:port for every connection of the proactor, and
+ * connections asking for a lookup already in progress wait for its result.
+ * A connection waiting for a lookup has no socket; the resolver hands over its
+ * own copy of the addresses and posts PCS_RESOLVED, the working thread then
+ * starts connecting from pconnection_process().  Numeric and empty hosts need
+ * no lookup, those connections start connecting at once as before.
+ * Tuning from the environment:
+ *  - PN_PROACTOR_RESOLVERS: resolver threads, 0 resolves on the calling thread
+ *  - PN_PROACTOR_DNS_TTL: milliseconds to cache a resolved address
+ *  - PN_PROACTOR_DNS_NEGATIVE_TTL: milliseconds to cache a resolver error
+ */
+#define RESOLVERS 2
+#define RESOLVER_MAX 16
+#define DNS_TTL 10000
+#define DNS_NEGATIVE_TTL 1000
+#define DNS_CACHE_MAX 64
+
+struct pconnection_t;
+
+typedef struct dns_entry_t {
+  struct dns_entry_t *next;         /* cache list, most recently added first */
+  struct dns_entry_t *queue_next;   /* resolver work queue */
+  char *host, *port;
+  uint64_t expires;                 /* pn_proactor_now() */
+  int gai_error;
+  struct addrinfo *addrinfo;        /* NULL on error */
+  bool resolving;                   /* queued or in progress, not evicted */
+  struct pconnection_t *waiters;    /* connections waiting for the result */
+} dns_entry_t;
+
+/* All fields protected by the mutex */
+typedef struct resolver_t {
+  pmutex mutex;
+  pthread_cond_t cond;
+  dns_entry_t *cache;
+  size_t cache_len;
+  dns_entry_t *queue_first, *queue_last;
+  pthread_t threads[RESOLVER_MAX];
+  int nthreads;                     /* threads started */
+  int max_threads;
+  int ttl, negative_ttl;
+  bool shutting_down;
+} resolver_t;
+
 /* common to connection and listener */
 typedef struct psocket_t {
   pn_proactor_t *proactor;
@@ -366,16 +549,119 @@ typedef struct psocket_t {
   const char *host, *port;
 } psocket_t;
 
+/*
+ * Edge-triggered connections, see PN_PROACTOR_EDGE.  A connected socket is
+ * polled with EPOLLET instead of EPOLLONESHOT, so the working thread never
+ * rearms it.  Events that arrive while another thread is working are or'ed
+ * into new_events and posted as PCS_IO, and the working thread takes them
+ * before it stops.  A socket counts as drained once a read or write returns
+ * short or EAGAIN, the kernel reports a new edge for anything after that.
+ *
+ * Without the rearm there is no point at which a closing connection knows no
+ * other thread holds an event for it.  So epoll carries an index into this
+ * table, whose slots live as long as the proactor, instead of a pointer to
+ * the connection.  A thread holds the slot while it posts the event, cleanup
+ * detaches the connection and waits for the holders to leave.  The slot's
+ * generation, also in the event, keeps an old event from reaching a later
+ * connection that reuses the slot.
+ *
+ * A connection polls one-shot until its first event after connecting, then
+ * switches, so connect retries and "shm:" sockets are unaffected.
+ */
+#define EDGE_TAG 1              /* Low bit of the epoll data, never set in a pointer */
+#define EDGE_CHUNK 1024
+#define EDGE_CHUNKS 4096        /* Connections past the last slot stay one-shot */
+
+typedef struct edge_slot_t {
+  struct pconnection_t *pc;     /* atomic, NULL while free or being released */
+  uint32_t gen;                 /* atomic, changed each time the slot is taken */
+  uint32_t holders;             /* atomic, threads posting an event to pc */
+  uint32_t next_free;           /* index + 1 of the next free slot, table mutex */
+} edge_slot_t;
+
+typedef struct edge_table_t {
+  pmutex mutex;
+  edge_slot_t *chunks[EDGE_CHUNKS]; /* atomic, allocated once, freed with the proactor */
+  uint32_t size;                /* slots allocated */
+  uint32_t free;                /* index + 1 of the first free slot, 0 if none */
+} edge_table_t;
+
+static inline edge_slot_t *edge_slot(edge_table_t *t, uint64_t data) {
+  uint32_t i = (uint32_t) data >> 1;
+  return &__atomic_load_n(&t->chunks[i / EDGE_CHUNK], __ATOMIC_ACQUIRE)[i % EDGE_CHUNK];
+}
+
+// Take a slot for pc, return the epoll data for it or 0 if the table is full
+static uint64_t edge_slot_take(edge_table_t *t, struct pconnection_t *pc) {
+  uint32_t i;
+  lock(&t->mutex);
+  if (t->free) {
+    i = t->free - 1;
+    t->free = edge_slot(t, (uint64_t) i << 1)->next_free;
+  } else {
+    uint32_t c = t->size / EDGE_CHUNK;
+    if (t->size % EDGE_CHUNK == 0) {
+      edge_slot_t *chunk = c < EDGE_CHUNKS ? (edge_slot_t *) calloc(EDGE_CHUNK, sizeof(edge_slot_t)) : NULL;
+      if (!chunk) {
+        unlock(&t->mutex);
+        return 0;
+      }
+      __atomic_store_n(&t->chunks[c], chunk, __ATOMIC_RELEASE);
+    }
+    i = t->size++;
+  }
+  uint64_t data = ((uint64_t) i << 1) | EDGE_TAG;
+  edge_slot_t *s = edge_slot(t, data);
+  uint32_t gen = s->gen + 1;
+  __atomic_store_n(&s->gen, gen, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->pc, pc, __ATOMIC_SEQ_CST);  /* Publishes gen */
+  unlock(&t->mutex);
+  return data | (uint64_t) gen << 32;
+}
+
+// Detach the slot from its connection, the socket is no longer polled
+static void edge_slot_release(edge_table_t *t, uint64_t data) {
+  edge_slot_t *s = edge_slot(t, data);
+  __atomic_store_n(&s->pc, NULL, __ATOMIC_SEQ_CST);
+  // Holders are between epoll_wait() and posting PCS_IO, see edge_process()
+  while (__atomic_load_n(&s->holders, __ATOMIC_SEQ_CST))
+    sched_yield();
+  lock(&t->mutex);
+  s->next_free = t->free;
+  t->free = ((uint32_t) data >> 1) + 1;
+  unlock(&t->mutex);
+}
+
+static void edge_table_finalize(edge_table_t *t) {
+  for (int i = 0; i < EDGE_CHUNKS && t->chunks[i]; ++i)
+    free(t->chunks[i]);
+  pmutex_finalize(&t->mutex);
+}
+
+// Contexts a pn_proactor_disconnect_async() call found, closed DISCONNECT_CHUNK
+// at a time by the threads that take the proactor's wakes.  A thread taking a
+// chunk wakes the proactor again first, so idle threads join in one by one.
+typedef struct disconnect_job_t {
+  pcontext_t *contexts;         /* not yet taken, linked by next */
+  pn_condition_t *condition;    /* copied to each context, NULL for none */
+  int working;                  /* chunks taken and not yet closed */
+  struct disconnect_job_t *next;
+} disconnect_job_t;
+
+#define DISCONNECT_CHUNK 64
+
 struct pn_proactor_t {
   pcontext_t context;
   int epollfd;
   ptimer_t timer;
+  twheel_t timers;              /* connection timers */
   pn_collector_t *collector;
   pcontext_t *contexts;         /* in-use contexts for PN_PROACTOR_INACTIVE and cleanup */
-  epoll_extended_t epoll_wake;
   epoll_extended_t epoll_interrupt;
   pn_event_batch_t batch;
   size_t disconnects_pending;   /* unfinished proactor disconnects*/
+  struct disconnect_job_t *disconnect_jobs; /* pn_proactor_disconnect_async() not yet taken */
+  struct disconnect_job_t *disconnect_jobs_last;
   // need_xxx flags indicate we should generate PN_PROACTOR_XXX on the next update_batch()
   bool need_interrupt;
   bool need_inactive;
@@ -384,88 +670,163 @@ struct pn_proactor_t {
   bool timer_armed; /* timer is armed in epoll */
   bool shutting_down;
   // wake subsystem
-  int eventfd;
-  pmutex eventfd_mutex;
-  bool wakes_in_progress;
-  pcontext_t *wake_list_first;
-  pcontext_t *wake_list_last;
+  wake_shard_t wake_shards[WAKE_SHARDS];
   // Interrupts have a dedicated eventfd because they must be async-signal safe.
   int interruptfd;
   // If the process runs out of file descriptors, disarm listeners temporarily and save them here.
+  // A lock free stack: pushed one at a time, popped all at once.
   pn_listener_t *overflow;
-  pmutex overflow_mutex;
+  twheel_entry_t overflow_timer; /* Retries overflow listeners, see OVERFLOW_RETRY_MS */
+  uint64_t overflow_next;       /* No retry on fd close before this wheel time, atomic */
+  int overflow_retry;           /* Milliseconds */
+  int reserve_fd;               /* Spare fd to refuse connections with when out of fds, atomic */
+  // Options, see pn_proactor_set_option().  Socket options, 0 leaves the system default
+  int so_rcvbuf;
+  int so_sndbuf;
+  int notsent_lowat;
+  // Fairness
+  int hog_max;
+  int handshake_max;
+  // Handshake slots, protected by handshake_mutex
+  pmutex handshake_mutex;
+  int handshaking;              /* slots in use */
+  struct pconnection_t *handshake_first, *handshake_last; /* waiting for a slot */
+  int batch_events;
+  size_t turn_bytes;
+  // Transport settings, applied to each transport
+  int disp_delay;
+  int disp_limit;               /* -1 leaves the transport default */
+  bool interleave;              /* see pn_transport_set_interleave */
+  int hibernate;                /* Milliseconds, 0 never, see PN_PROACTOR_HIBERNATE */
+  bool local_wake;              /* see PN_PROACTOR_LOCAL_WAKE */
+  bool write_more;              /* see PN_PROACTOR_WRITE_MORE */
+  uint64_t spin;                /* Nanoseconds, see PN_PROACTOR_SPIN */
+  int spinners;                 /* threads in proactor_spin(), atomic */
+  int busy_poll;                /* see PN_PROACTOR_BUSY_POLL */
+  size_t shm_size;              /* see PN_PROACTOR_SHM_SIZE */
+  bool edge;                    /* see PN_PROACTOR_EDGE */
+  edge_table_t edges;
+  // Per-thread polling, npollers is 0 if all threads share epollfd
+  int npollers;
+  int next_poller;              /* round robin home assignment, atomic */
+  int nnodes;                   /* NUMA nodes the pollers are spread over, 0 if not */
+  int next_node_poller[MAX_POLLERS]; /* round robin within each node, atomic */
+  poller_t pollers[MAX_POLLERS];
+  resolver_t resolver;
+  pn_proactor_stats_t *stats;   /* NULL unless PN_PROACTOR_STATS is set */
 };
 
 static void rearm(pn_proactor_t *p, epoll_extended_t *ee);
 
 /*
- * Wake strategy with eventfd.
+ * Wake strategy with eventfd, applied to each wake_shard_t separately.
  *  - wakees can be in the list only once
  *  - wakers only write() if wakes_in_progress is false
  *  - wakees only read() if about to set wakes_in_progress to false
  * When multiple wakes are pending, the kernel cost is a single rearm().
  * Otherwise it is the trio of write/read/rearm.
  * Only the writes and reads need to be carefully ordered.
- *
- * Multiple eventfds could be used and shared amongst the pcontext_t's.
  */
 
+// ctx->proactor must be set
+static inline wake_shard_t *wake_shard(pcontext_t *ctx) {
+  uintptr_t h = (uintptr_t) ctx;
+  h ^= h >> 12;
+  return &ctx->proactor->wake_shards[(h >> 4) % WAKE_SHARDS];
+}
+
+// Append ctx to its wake list, return true if notify required by caller
+static bool wake_list_push(pcontext_t *ctx) {
+  bool notify = false;
+  wake_shard_t *ws = wake_shard(ctx);
+  lock(&ws->mutex);
+  if (!ws->wake_list_first) {
+    ws->wake_list_first = ws->wake_list_last = ctx;
+  } else {
+    ws->wake_list_last->wake_next = ctx;
+    ws->wake_list_last = ctx;
+  }
+  if (ctx->proactor->stats)
+    ctx->wake_time = pni_proactor_stats_now();
+  if (!ws->wakes_in_progress) {
+    // force a wakeup via the eventfd
+    ws->wakes_in_progress = true;
+    notify = true;
+  }
+  unlock(&ws->mutex);
+  return notify;
+}
+
 // part1: call with ctx->owner lock held, return true if notify required by caller
+// Connections use pconnection_post() instead.
 static bool wake(pcontext_t *ctx) {
   bool notify = false;
   if (!ctx->wake_ops) {
     if (!ctx->working) {
       ctx->wake_ops++;
-      pn_proactor_t *p = ctx->proactor;
-      lock(&p->eventfd_mutex);
-      if (!p->wake_list_first) {
-        p->wake_list_first = p->wake_list_last = ctx;
-      } else {
-        p->wake_list_last->wake_next = ctx;
-        p->wake_list_last = ctx;
-      }
-      if (!p->wakes_in_progress) {
-        // force a wakeup via the eventfd
-        p->wakes_in_progress = true;
-        notify = true;
-      }
-      unlock(&p->eventfd_mutex);
+      notify = wake_list_push(ctx);
     }
   }
   return notify;
 }
 
-// part2: make OS call without lock held
-static inline void wake_notify(pcontext_t *ctx) {
-  if (ctx->proactor->eventfd == -1)
+static inline void wake_shard_notify(pn_proactor_t *p, wake_shard_t *ws) {
+  if (p->spin) {
+    // A spinning thread checks the flag after it stops counting itself, so
+    // either it sees the flag or we see no spinners and write the eventfd.
+    __atomic_store_n(&ws->spin_notified, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p->spinners, __ATOMIC_SEQ_CST) > 0)
+      return;
+  }
+  int fd = ws->eventfd;
+  if (fd == -1)
     return;
   uint64_t increment = 1;
-  if (write(ctx->proactor->eventfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+  if (write(fd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
     EPOLL_FATAL("setting eventfd", errno);
 }
 
-// call with no locks
-static pcontext_t *wake_pop_front(pn_proactor_t *p) {
+// part2: make OS call without lock held
+static inline void wake_notify(pcontext_t *ctx) {
+  wake_shard_notify(ctx->proactor, wake_shard(ctx));
+}
+
+// call with no locks, *wake_time is set to when ctx was pushed.  Rearm the
+// eventfd if epoll reported it.  A spinning thread may have emptied the list
+// before an eventfd event for it is handled, see proactor_spin().
+static pcontext_t *wake_pop_front(pn_proactor_t *p, wake_shard_t *ws, uint64_t *wake_time, bool polled) {
   pcontext_t *ctx = NULL;
-  lock(&p->eventfd_mutex);
-  assert(p->wakes_in_progress);
-  if (p->wake_list_first) {
-    ctx = p->wake_list_first;
-    p->wake_list_first = ctx->wake_next;
-    if (!p->wake_list_first) p->wake_list_last = NULL;
+  lock(&ws->mutex);
+  if (!ws->wakes_in_progress) {
+    (void)read_uint64(ws->eventfd);  /* Nothing is pushed, any count is stale */
+  } else if (ws->wake_list_first) {
+    ctx = ws->wake_list_first;
+    *wake_time = ctx->wake_time;
+    ws->wake_list_first = ctx->wake_next;
+    if (!ws->wake_list_first) ws->wake_list_last = NULL;
     ctx->wake_next = NULL;
 
-    if (!p->wake_list_first) {
+    if (!ws->wake_list_first) {
       /* Reset the eventfd until a future write.
        * Can the read system call be made without holding the lock?
        * Note that if the reads/writes happen out of order, the wake
        * mechanism will hang. */
-      (void)read_uint64(p->eventfd);
-      p->wakes_in_progress = false;
+      (void)read_uint64(ws->eventfd);
+      ws->wakes_in_progress = false;
+    }
+  }
+  bool more = ws->wakes_in_progress;
+  unlock(&ws->mutex);
+  if (polled) {
+    if (!ws->epoll_wake.edge)
+      rearm(p, &ws->epoll_wake);
+    else if (more) {
+      /* No rearm to report the eventfd again, a write makes a new edge */
+      uint64_t increment = 1;
+      if (write(ws->eventfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+        EPOLL_FATAL("setting eventfd", errno);
     }
   }
-  unlock(&p->eventfd_mutex);
-  rearm(p, &p->epoll_wake);
   return ctx;
 }
 
@@ -483,6 +844,7 @@ static void psocket_init(psocket_t* ps, pn_proactor_t* p, pn_listener_t *listene
   ps->epoll_io.type = listener ? LISTENER_IO : PCONNECTION_IO;
   ps->epoll_io.wanted = 0;
   ps->epoll_io.polling = false;
+  ps->epoll_io.edge = false;
   ps->proactor = p;
   ps->listener = listener;
   ps->sockfd = -1;
@@ -496,28 +858,216 @@ struct pn_netaddr_t {
 typedef struct pconnection_t {
   psocket_t psocket;
   pcontext_t context;
-  uint32_t new_events;
-  int wake_count;
+  uint32_t sched;             /* PCS_* flags, atomic */
+  uint32_t new_events;        /* epoll events, valid while PCS_IO is set */
   bool server;                /* accept, not connect */
-  bool tick_pending;
-  bool timer_armed;
-  bool queued_disconnect;     /* deferred from pn_proactor_disconnect() */
+  bool queued_disconnect;     /* deferred from pn_proactor_disconnect(), protected by context.mutex */
   pn_condition_t *disconnect_condition;
-  ptimer_t timer;  // TODO: review one timerfd per connectoin
+  twheel_entry_t timer;       /* Protected by the proactor timers mutex */
   // Following values only changed by (sole) working context:
   uint32_t current_arm;  // active epoll io events
+  uint64_t edge;         // epoll data of the edge_slot_t, 0 if polled one-shot
   bool connected;
   bool read_blocked;
   bool write_blocked;
+  bool corked;  // sent with MSG_MORE since the last plain send
+  pni_shm_t *shm;  // "shm:" connection, data goes through shared rings, see shm.c
   bool disconnected;
   int hog_count; // thread hogging limiter
+  int batch_count; // events delivered in the current batch
   pn_event_batch_t batch;
   pn_connection_driver_t driver;
   struct pn_netaddr_t local, remote; /* Actual addresses */
   struct addrinfo *addrinfo;         /* Resolved address list */
   struct addrinfo *ai;               /* Current connect address */
+  // Asynchronous address lookup, protected by the resolver mutex
+  dns_entry_t *resolve_entry;        /* lookup this connection waits for */
+  struct pconnection_t *resolve_next; /* next waiter of resolve_entry */
+  bool resolve_done;                  /* result below not yet taken, PCS_RESOLVED */
+  struct addrinfo *resolved;
+  int resolve_error;
+  // Handshake admission, see PN_PROACTOR_HANDSHAKE_MAX
+  bool handshake_done;                /* working thread: the peer has opened */
+  bool handshake_slot;                /* working thread: holds a slot */
+  bool handshake_queued;              /* working thread: in line or granted below */
+  bool handshake_granted;             /* handshake mutex: slot handed over, PCS_ADMIT */
+  struct pconnection_t *handshake_next; /* handshake mutex: next in line */
+  // Latency statistics, NULL unless the proactor keeps them
+  pn_proactor_stats_t *stats;
+  uint64_t batch_start;               /* working thread: batch returned */
+  uint64_t flush_start;               /* working thread: output waiting to be sent */
+  uint64_t now;                       /* working thread: clock this turn, 0 if not read */
+  // Hibernation, see PN_PROACTOR_HIBERNATE
+  uint64_t active_at;                 /* working thread: last batch done */
+  uint64_t sleep_at;                  /* working thread: deadline on the timer, 0 if none */
+  uint64_t tick_at;                   /* working thread: transport deadline on the timer */
+  struct pconnection_t *heartbeat_next; /* timer thread: next expired idle connection */
 } pconnection_t;
 
+// Record a duration for a connection and its proactor, call only if pc->stats
+#define PCONNECTION_STAT(PC, FIELD, NS) do {                            \
+    uint64_t ns_ = (NS);                                                \
+    pni_histogram_record(&(PC)->stats->FIELD, ns_);                     \
+    pni_histogram_record(&(PC)->psocket.proactor->stats->FIELD, ns_);   \
+  } while (0)
+
+/*
+ * Connections keep their scheduling state in one atomic word instead of the
+ * pcontext_t working/wake_ops/closing fields, so an uncontended connection
+ * turn takes no mutex.  Other threads post pending work with an atomic update
+ * and either become the working thread or leave the work to the current one,
+ * which re-checks before it stops working.
+ *
+ *  PCS_WORKING: a thread owns the connection, like pcontext_t.working
+ *  PCS_QUEUED: on the wake list, like pcontext_t.wake_ops
+ *  PCS_CLOSING: pcontext_t.closing is set, pn_connection_wake() is a no-op
+ * Pending work, cleared by the working thread:
+ *  PCS_IO: an epoll event is saved in new_events
+ *  PCS_WAKE: pn_connection_wake()
+ *  PCS_TICK: the connection timer expired
+ *  PCS_DISCONNECT: pn_proactor_disconnect(), details under context.mutex
+ *  PCS_RESOLVED: an address lookup finished, details under the resolver mutex
+ *  PCS_ADMIT: a handshake slot was handed over, details under the handshake mutex
+ */
+#define PCS_WORKING    0x01
+#define PCS_QUEUED     0x02
+#define PCS_CLOSING    0x04
+#define PCS_IO         0x08
+#define PCS_WAKE       0x10
+#define PCS_TICK       0x20
+#define PCS_DISCONNECT 0x40
+#define PCS_RESOLVED   0x80
+#define PCS_ADMIT      0x100
+#define PCS_PENDING (PCS_IO | PCS_WAKE | PCS_TICK | PCS_DISCONNECT | PCS_RESOLVED | PCS_ADMIT)
+
+static inline uint32_t pcs_load(pconnection_t *pc) {
+  return __atomic_load_n(&pc->sched, __ATOMIC_ACQUIRE);
+}
+
+static inline bool pcs_cas(pconnection_t *pc, uint32_t *old, uint32_t next) {
+  return __atomic_compare_exchange_n(&pc->sched, old, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* The home poller of the calling thread */
+static __thread struct {
+  pn_proactor_t *proactor;
+  poller_t *poller;
+  pn_proactor_t *batching;      /* proactor whose batch the thread is handling */
+} thread_home;
+
+/*
+ * Local wakes, see PN_PROACTOR_LOCAL_WAKE.  A connection queued by a thread
+ * handling a batch is held in the thread's local_wake_key slot instead of
+ * the wake list.  It is marked PCS_QUEUED like any queued connection, so no
+ * other thread will run it, and the slot's destructor queues it normally if
+ * the thread exits without running it.
+ */
+static pthread_key_t local_wake_key;
+static pthread_once_t local_wake_once = PTHREAD_ONCE_INIT;
+
+static void local_wake_exit(void *v) {
+  pconnection_t *pc = (pconnection_t *) v;
+  pn_proactor_t *p = pc->psocket.proactor;
+  wake_shard_t *ws = wake_shard(&pc->context);
+  if (wake_list_push(&pc->context)) wake_shard_notify(p, ws);
+}
+
+static void local_wake_init(void) {
+  pthread_key_create(&local_wake_key, local_wake_exit);
+}
+
+// Keep pc, marked PCS_QUEUED by the caller, for this thread if it can.
+// Return true if the caller must put it on the wake list instead.
+static bool local_wake_defer(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  if (!p->local_wake || thread_home.batching != p || pthread_getspecific(local_wake_key))
+    return true;
+  pthread_setspecific(local_wake_key, pc);
+  return false;
+}
+
+// Take the connection this thread kept for p, if any
+static pconnection_t *local_wake_take(pn_proactor_t *p) {
+  if (!p->local_wake) return NULL;
+  pconnection_t *pc = (pconnection_t *) pthread_getspecific(local_wake_key);
+  if (!pc || pc->psocket.proactor != p) return NULL;
+  pthread_setspecific(local_wake_key, NULL);
+  return pc;
+}
+
+
+// Post pending work from any thread.  If no thread is working, put the
+// connection on the wake list.  Return true if the caller must wake_notify().
+static bool pconnection_post(pconnection_t *pc, uint32_t bits) {
+  uint32_t old = pcs_load(pc);
+  uint32_t next;
+  bool push;
+  do {
+    if ((bits & PCS_WAKE) && (old & PCS_CLOSING))
+      return false;             // No wakes after close
+    push = !(old & (PCS_WORKING | PCS_QUEUED));
+    next = old | bits | (push ? PCS_QUEUED : 0);
+  } while (!pcs_cas(pc, &old, next));
+  return push && local_wake_defer(pc) && wake_list_push(&pc->context);
+}
+
+// Set and clear bits, and become the working thread if there is none.
+// Return true if the caller is now the working thread.
+static bool pconnection_acquire(pconnection_t *pc, uint32_t set, uint32_t clear) {
+  uint32_t old = pcs_load(pc);
+  while (!pcs_cas(pc, &old, ((old | set) & ~clear) | PCS_WORKING))
+    ;
+  return !(old & PCS_WORKING);
+}
+
+// Take the pending work bits in mask, for the working thread.
+static inline uint32_t pconnection_take(pconnection_t *pc, uint32_t mask) {
+  return __atomic_fetch_and(&pc->sched, ~mask, __ATOMIC_ACQ_REL) & mask;
+}
+
+// Stop working unless work is pending.  Return false if work is pending.
+static bool pconnection_try_release(pconnection_t *pc) {
+  uint32_t old = pcs_load(pc);
+  do {
+    if (old & PCS_PENDING)
+      return false;
+  } while (!pcs_cas(pc, &old, old & ~PCS_WORKING));
+  return true;
+}
+
+// Stop working.  Go on the wake list if requeue is true or work is pending.
+// Return true if the caller must wake_notify().
+static bool pconnection_release(pconnection_t *pc, bool requeue) {
+  uint32_t old = pcs_load(pc);
+  bool push;
+  do {
+    push = (requeue || (old & PCS_PENDING)) && !(old & PCS_QUEUED);
+  } while (!pcs_cas(pc, &old, (old & ~PCS_WORKING) | (push ? PCS_QUEUED : 0)));
+  // A requeue for fairness goes back in line, work posted during the batch may stay local
+  return push && (requeue || local_wake_defer(pc)) && wake_list_push(&pc->context);
+}
+
+// Release and wake a thread if needed.  Once released another thread may take
+// pc and free it, so finish with pc (rearm included) first and don't touch it
+// afterwards: the wake shard is found before the release.
+static void pconnection_release_notify(pconnection_t *pc, bool requeue) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  wake_shard_t *ws = wake_shard(&pc->context);
+  if (pconnection_release(pc, requeue))
+    wake_shard_notify(p, ws);
+}
+
+// Post without holding a lock that keeps pc alive, same reasoning as above
+static void pconnection_post_notify(pconnection_t *pc, uint32_t bits) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  wake_shard_t *ws = wake_shard(&pc->context);
+  if (pconnection_post(pc, bits))
+    wake_shard_notify(p, ws);
+}
+
+/* Maximum connections taken from a listening socket per wakeup */
+#define LISTENER_ACCEPT_BATCH 16
+
 struct pn_listener_t {
   psocket_t *psockets;          /* Array of listening sockets */
   size_t psockets_size;
@@ -528,17 +1078,32 @@ struct pn_listener_t {
   pn_record_t *attachments;
   void *listener_context;
   size_t backlog;
-  int accepted_fd;              /* fd accepted but not yet handled by pn_listener_accept() */
-  psocket_t *accepted;          /* psocket from which we accpeted accepted_fd */
+  int accepted_fds[LISTENER_ACCEPT_BATCH]; /* fds accepted but not yet handled by pn_listener_accept() */
+  size_t accepted_next;         /* next of accepted_fds for pn_listener_accept() */
+  size_t accepted_announced;    /* accepted_fds with a PN_LISTENER_ACCEPT event */
+  size_t accepted_size;
+  psocket_t *accepted;          /* psocket from which we accepted accepted_fds */
   bool close_dispatched;
   bool armed;
+  bool reuseport;               /* Share the port with other listeners, SO_REUSEPORT */
   pn_listener_t *overflow;       /* Next overflowed listener */
+  uint64_t overflows;           /* Counters for pn_listener_overflow() */
+  uint64_t shed;
+  const char *inproc;           /* Name of an "inproc:" listener, else NULL */
+  pn_listener_t *inproc_next;   /* Next in inproc_listeners */
+  int *inproc_fds;              /* Connected socketpair ends waiting to be accepted */
+  size_t inproc_size, inproc_capacity;
 };
 
+/* "inproc:" listeners by name, see inproc_connect() */
+static pmutex inproc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pn_listener_t *inproc_listeners = NULL;
 
-static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events, bool timeout, bool topup);
-static void write_flush(pconnection_t *pc);
+
+static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events, bool topup);
+static bool write_flush(pconnection_t *pc, bool more);
 static void listener_begin_close(pn_listener_t* l);
+static int inproc_connect(const char *name, int *fd);
 static void proactor_add(pcontext_t *ctx);
 static bool proactor_remove(pcontext_t *ctx);
 
@@ -583,8 +1148,9 @@ static inline bool pconnection_has_event(pconnection_t *pc) {
   return pn_connection_driver_has_event(&pc->driver);
 }
 
+/* The collector coalesces repeated events, so accepted fds are announced one at a time */
 static inline bool listener_has_event(pn_listener_t *l) {
-  return pn_collector_peek(l->collector);
+  return pn_collector_peek(l->collector) || l->accepted_announced < l->accepted_size;
 }
 
 static inline bool proactor_has_event(pn_proactor_t *p) {
@@ -593,7 +1159,7 @@ static inline bool proactor_has_event(pn_proactor_t *p) {
 
 static pn_event_t *log_event(void* p, pn_event_t *e) {
   if (e) {
-    pn_logf("[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+    pn_log(PN_SUBSYSTEM_EVENT, PN_LEVEL_TRACE, "[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
   }
   return e;
 }
@@ -625,48 +1191,109 @@ static void rearm(pn_proactor_t *p, epoll_extended_t *ee) {
   struct epoll_event ev;
   ev.data.ptr = ee;
   ev.events = ee->wanted | EPOLLONESHOT;
-  if (epoll_ctl(p->epollfd, EPOLL_CTL_MOD, ee->fd, &ev) == -1)
+  if (epoll_ctl(ee->epollfd, EPOLL_CTL_MOD, ee->fd, &ev) == -1)
     EPOLL_FATAL("arming polled file descriptor", errno);
 }
 
+static const int dummy__ = 0;
+static pn_listener_t * const NO_OVERFLOW = (pn_listener_t*)&dummy__; /* Bogus pointer */
+
+static void twheel_schedule(twheel_t *w, twheel_entry_t *e, uint64_t deadline, uint64_t now);
+static inline uint64_t twheel_now(twheel_t *w);
+static inline bool listener_can_free(pn_listener_t *l);
+
+/*
+ * Running out of file descriptors on accept.
+ *
+ * The proactor holds a reserve fd.  A listener that gets EMFILE or ENFILE
+ * closes it to accept the connections waiting on the socket and reset them
+ * (SO_LINGER 0 sends RST at once) so clients fail fast instead of waiting in
+ * the backlog.  The listener is then disarmed and pushed on p->overflow.
+ *
+ * Overflow listeners are rearmed every overflow_retry ms by the timer wheel,
+ * and sooner when the proactor closes an fd, but at most once per interval so
+ * that a process at its limit does not spin between accept and close.  A
+ * freed fd goes to the reserve first.  None of this takes a proactor lock.
+ */
+
+// Take the reserve fd back if it was used, true if it is held.
+static bool proactor_reserve(pn_proactor_t *p) {
+  if (__atomic_load_n(&p->reserve_fd, __ATOMIC_ACQUIRE) >= 0) return true;
+  int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  int none = -1;
+  if (!__atomic_compare_exchange_n(&p->reserve_fd, &none, fd, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    close(fd);                  /* Another thread got there first */
+  return true;
+}
+
+// Refuse the connections waiting on ps with the reserve fd. Called with listener context lock held.
+static void listener_shed_lh(pn_listener_t *l, psocket_t *ps) {
+  pn_proactor_t *p = ps->proactor;
+  int reserve = __atomic_exchange_n(&p->reserve_fd, -1, __ATOMIC_ACQ_REL);
+  if (reserve < 0) return;
+  close(reserve);
+  for (int i = 0; i < LISTENER_ACCEPT_BATCH; ++i) {
+    int fd = accept(ps->sockfd, NULL, 0);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    struct linger reset = { 1, 0 };
+    (void)setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    close(fd);
+    l->shed++;
+  }
+  proactor_reserve(p);
+}
+
 // Add an overflowing listener to the overflow list. Called with listener context lock held.
 static void listener_set_overflow(pn_listener_t *l) {
   pn_proactor_t *p = l->psockets[0].proactor;
-  lock(&p->overflow_mutex);
-  l->overflow = p->overflow;
-  p->overflow = l;
-  unlock(&p->overflow_mutex);
+  l->overflows++;
+  l->overflow = __atomic_load_n(&p->overflow, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&p->overflow, &l->overflow, l, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    ;
+  uint64_t now = twheel_now(&p->timers);
+  twheel_schedule(&p->timers, &p->overflow_timer, now + p->overflow_retry, now);
 }
 
-static const int dummy__ = 0;
-static pn_listener_t * const NO_OVERFLOW = (pn_listener_t*)&dummy__; /* Bogus pointer */
-
-/* TODO aconway 2017-06-08: we should also call proactor_rearm_overflow after a fixed delay,
-   even if the proactor has not freed any file descriptors, since other parts of the process
-   might have*/
-
 // Activate overflowing listeners, called when there may be available file descriptors.
 static void proactor_rearm_overflow(pn_proactor_t *p) {
-  lock(&p->overflow_mutex);
-  pn_listener_t *l = p->overflow;
-  p->overflow = NULL;
-  unlock(&p->overflow_mutex);
+  pn_listener_t *l = __atomic_exchange_n(&p->overflow, NULL, __ATOMIC_ACQ_REL);
   while (l) {
     lock(&l->context.mutex);
-    rearm(l->accepted->proactor, &l->accepted->epoll_io);
-    l->armed = true;
-    l->accepted = NULL;
     pn_listener_t *next = l->overflow;
     l->overflow = NO_OVERFLOW;
+    if (!l->context.closing) {
+      rearm(l->accepted->proactor, &l->accepted->epoll_io);
+      l->armed = true;
+      l->accepted = NULL;
+    }
+    /* A listener closed while waiting here is freed by the last to let go of it */
+    bool can_free = !l->context.working && l->close_dispatched && listener_can_free(l);
     unlock(&l->context.mutex);
+    if (can_free) pn_listener_free(l);
     l = next;
   }
 }
 
+// An fd was closed, retry overflow listeners unless they were retried recently.
+static void proactor_fd_closed(pn_proactor_t *p) {
+  if (!__atomic_load_n(&p->overflow, __ATOMIC_ACQUIRE)) return;
+  uint64_t now = twheel_now(&p->timers);
+  uint64_t next = __atomic_load_n(&p->overflow_next, __ATOMIC_ACQUIRE);
+  if (now < next ||
+      !__atomic_compare_exchange_n(&p->overflow_next, &next, now + p->overflow_retry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return;
+  if (proactor_reserve(p))
+    proactor_rearm_overflow(p);
+}
+
 // Close an FD and rearm overflow listeners
 static int pclosefd(pn_proactor_t *p, int fd) {
   int err = close(fd);
-  if (!err) proactor_rearm_overflow(p);
+  if (!err) proactor_fd_closed(p);
   return err;
 }
 
@@ -684,12 +1311,18 @@ static int pclosefd(pn_proactor_t *p, int fd) {
 
 static void pconnection_finalize(void *vp_pconnection) {
   pconnection_t *pc = (pconnection_t*)vp_pconnection;
+  free(pc->stats);
   pcontext_finalize(&pc->context);
 }
 
 static const pn_class_t pconnection_class = PN_CLASS(pconnection);
 
 static void pconnection_tick(pconnection_t *pc);
+static void pconnection_sleep(pconnection_t *pc);
+static uint64_t pconnection_now(pconnection_t *pc);
+static void pconnection_resolve_cancel(pconnection_t *pc);
+static void pconnection_handshake_leave(pconnection_t *pc);
+static void addrinfo_free(struct addrinfo *ai);
 
 static pconnection_t *new_pconnection_t(pn_proactor_t *p, pn_connection_t *c, bool server, const char *addr)
 {
@@ -699,49 +1332,76 @@ static pconnection_t *new_pconnection_t(pn_proactor_t *p, pn_connection_t *c, bo
     free(pc);
     return NULL;
   }
+  pni_proactor_capture(pc->driver.transport);
+  pni_proactor_prewarm(pc->driver.connection, pc->driver.collector);
   pcontext_init(&pc->context, PCONNECTION, p, pc);
   psocket_init(&pc->psocket, p, NULL, addr);
+  pc->sched = PCS_WORKING;      /* Owned by the creating thread until started */
   pc->new_events = 0;
-  pc->wake_count = 0;
-  pc->tick_pending = false;
-  pc->timer_armed = false;
   pc->queued_disconnect = false;
   pc->disconnect_condition = NULL;
 
   pc->current_arm = 0;
+  pc->edge = 0;
+  pc->server = server;
   pc->connected = false;
   pc->read_blocked = true;
   pc->write_blocked = true;
+  pc->corked = false;
+  pc->shm = NULL;
   pc->disconnected = false;
   pc->hog_count = 0;
+  pc->batch_count = 0;
   pc->batch.next_event = pconnection_batch_next;
+  pc->addrinfo = NULL;
+  pc->ai = NULL;
+  pc->resolve_entry = NULL;
+  pc->resolve_next = NULL;
+  pc->resolve_done = false;
+  pc->handshake_done = false;
+  pc->handshake_slot = false;
+  pc->handshake_queued = false;
+  pc->handshake_granted = false;
+  pc->handshake_next = NULL;
+  pc->resolved = NULL;
+  pc->resolve_error = 0;
+  /* Statistics are skipped for this connection if the allocation fails */
+  pc->stats = p->stats ? (pn_proactor_stats_t*)calloc(1, sizeof(*pc->stats)) : NULL;
+  pc->batch_start = 0;
+  pc->flush_start = 0;
+  pc->now = 0;
+  pc->active_at = p->hibernate ? twheel_now(&p->timers) : 0;
+  pc->sleep_at = 0;
+  pc->tick_at = 0;
+  pc->heartbeat_next = NULL;
 
   if (server) {
     pn_transport_set_server(pc->driver.transport);
   }
+  if (p->disp_delay > 0)
+    pn_transport_set_disposition_delay(pc->driver.transport, p->disp_delay);
+  if (p->disp_limit >= 0)
+    pn_transport_set_disposition_limit(pc->driver.transport, p->disp_limit);
+  if (p->interleave)
+    pn_transport_set_interleave(pc->driver.transport, true);
   pn_record_t *r = pn_connection_attachments(pc->driver.connection);
   pn_record_def(r, PN_PROACTOR, &pconnection_class);
   pn_record_set(r, PN_PROACTOR, pc);
 
-  if (!ptimer_init(&pc->timer, &pc->psocket)) {
-    psocket_error(&pc->psocket, errno, "timer setup");
-    pc->disconnected = true;    /* Already failed */
-  }
-
   pn_decref(pc);                /* Will be deleted when the connection is */
   return pc;
 }
 
-// Call with lock held and closing == true (i.e. pn_connection_driver_finished() == true), timer cancelled.
+// Call from the working thread with closing == true (i.e. pn_connection_driver_finished() == true).
 // Return true when all possible outstanding epoll events associated with this pconnection have been processed.
 static inline bool pconnection_is_final(pconnection_t *pc) {
-  return !pc->current_arm && !pc->timer_armed && !pc->context.wake_ops;
+  return !pc->current_arm && !(pcs_load(pc) & PCS_QUEUED);
 }
 
 static void pconnection_final_free(pconnection_t *pc) {
-  if (pc->addrinfo) {
-    freeaddrinfo(pc->addrinfo);
-  }
+  addrinfo_free(pc->addrinfo);
+  pni_shm_free(pc->shm);
+  pc->shm = NULL;
   pn_condition_free(pc->disconnect_condition);
   pn_incref(pc);                /* Make sure we don't do a circular free */
   pn_connection_driver_destroy(&pc->driver);
@@ -749,13 +1409,20 @@ static void pconnection_final_free(pconnection_t *pc) {
   /* Now pc is freed iff the connection is, otherwise remains till the pn_connection_t is freed. */
 }
 
+static void twheel_cancel(twheel_t *w, twheel_entry_t *e);
+
 // call without lock, but only if pconnection_is_final() is true
 static void pconnection_cleanup(pconnection_t *pc) {
+  // Still the working context so expiry cannot wake us again, it can only be
+  // in progress.  Cancelling waits for it under the timers mutex.
+  twheel_cancel(&pc->psocket.proactor->timers, &pc->timer);
   stop_polling(&pc->psocket.epoll_io, pc->psocket.proactor->epollfd);
+  if (pc->edge) {
+    edge_slot_release(&pc->psocket.proactor->edges, pc->edge);
+    pc->edge = 0;
+  }
   if (pc->psocket.sockfd != -1)
     pclosefd(pc->psocket.proactor, pc->psocket.sockfd);
-  stop_polling(&pc->timer.epoll_io, pc->psocket.proactor->epollfd);
-  ptimer_finalize(&pc->timer);
   lock(&pc->context.mutex);
   bool can_free = proactor_remove(&pc->context);
   unlock(&pc->context.mutex);
@@ -764,23 +1431,20 @@ static void pconnection_cleanup(pconnection_t *pc) {
   // else proactor_disconnect logic owns psocket and its final free
 }
 
-// Call with lock held or from forced_shutdown
+// Call from the working thread, with lock held or from forced_shutdown
 static void pconnection_begin_close(pconnection_t *pc) {
   if (!pc->context.closing) {
     pc->context.closing = true;
-    if (pc->current_arm != 0 && !pc->new_events) {
+    __atomic_fetch_or(&pc->sched, PCS_CLOSING, __ATOMIC_ACQ_REL);
+    if (!pc->server)
+      pconnection_resolve_cancel(pc);  // No PCS_RESOLVED posts after this
+    pconnection_handshake_leave(pc);   // No PCS_ADMIT posts after this
+    if (pc->current_arm != 0 && !(pcs_load(pc) & PCS_IO)) {
       // Force io callback via an EPOLLHUP
       shutdown(pc->psocket.sockfd, SHUT_RDWR);
     }
 
     pn_connection_driver_close(&pc->driver);
-    if (ptimer_shutdown(&pc->timer, pc->timer_armed))
-      pc->timer_armed = false;  // disarmed in the sense that the timer will never fire again
-    else if (!pc->timer_armed) {
-      // In doubt.  One last callback to collect
-      rearm(pc->psocket.proactor, &pc->timer.epoll_io);
-      pc->timer_armed = true;
-    }
   }
 }
 
@@ -788,10 +1452,9 @@ static void pconnection_forced_shutdown(pconnection_t *pc) {
   // Called by proactor_free, no competing threads, no epoll activity.
   pc->current_arm = 0;
   pc->new_events = 0;
-  pconnection_begin_close(pc);
   // pconnection_process will never be called again.  Zero everything.
-  pc->timer_armed = false;
-  pc->context.wake_ops = 0;
+  pc->sched = PCS_WORKING;
+  pconnection_begin_close(pc);
   pn_connection_t *c = pc->driver.connection;
   pn_collector_release(pn_connection_collector(c));
   assert(pconnection_is_final(pc));
@@ -800,16 +1463,27 @@ static void pconnection_forced_shutdown(pconnection_t *pc) {
 
 static pn_event_t *pconnection_batch_next(pn_event_batch_t *batch) {
   pconnection_t *pc = batch_pconnection(batch);
+  pn_proactor_t *p = pc->psocket.proactor;
+  // Stop only if an event is waiting: the next pn_connection_driver_next_event()
+  // finishes handling the last one, which can generate more.
+  if (p->batch_events && pc->batch_count >= p->batch_events && pconnection_has_event(pc))
+    return NULL;  // pconnection_done() puts us back in line for the rest
   pn_event_t *e = pn_connection_driver_next_event(&pc->driver);
   if (!e) {
-    write_flush(pc);  // May generate transport event
+    // Handshake output waits for a slot in the next turn
+    if (pc->handshake_done || !p->handshake_max) {
+      // The topup below reads again, its events will likely add more output
+      bool more = p->write_more && pc->hog_count < p->hog_max && !pc->read_blocked;
+      write_flush(pc, more);  // May generate transport event
+    }
     e = pn_connection_driver_next_event(&pc->driver);
-    if (!e && pc->hog_count < HOG_MAX) {
-      if (pconnection_process(pc, 0, false, true)) {
+    if (!e && pc->hog_count < p->hog_max) {
+      if (pconnection_process(pc, 0, true)) {
         e = pn_connection_driver_next_event(&pc->driver);
       }
     }
   }
+  if (e) pc->batch_count++;
   return e;
 }
 
@@ -832,9 +1506,15 @@ static inline bool pconnection_wclosed(pconnection_t  *pc) {
    close/shutdown.  Let read()/write() return 0 or -1 to trigger cleanup logic.
 */
 static bool pconnection_rearm_check(pconnection_t *pc) {
+  if (pc->edge) {
+    return false;               /* Edge-triggered, never rearmed */
+  }
   if (pconnection_rclosed(pc) && pconnection_wclosed(pc)) {
     return false;
   }
+  if (pc->psocket.sockfd == -1) {
+    return false;               /* No socket while the address is resolved */
+  }
   uint32_t wanted_now = (pc->read_blocked && !pconnection_rclosed(pc)) ? EPOLLIN : 0;
   if (!pconnection_wclosed(pc)) {
     if (pc->write_blocked)
@@ -845,21 +1525,26 @@ static bool pconnection_rearm_check(pconnection_t *pc) {
         wanted_now |= EPOLLOUT;
     }
   }
+  // A "shm:" socket carries doorbells for both directions, see shm.c
+  if (pc->shm && pc->connected && wanted_now)
+    wanted_now = EPOLLIN;
   if (!wanted_now || pc->current_arm == wanted_now) return false;
+  // An armed event may have fired and not been taken yet; re-arming would
+  // allow a second one.  Keeping a wider arm only costs a spurious wakeup.
+  if ((pc->current_arm & wanted_now) == wanted_now) return false;
 
   pc->psocket.epoll_io.wanted = wanted_now;
   pc->current_arm = wanted_now;
   return true;
 }
 
-/* Call without lock */
+/* Call as the working thread without lock, before releasing pc */
 static inline void pconnection_rearm(pconnection_t *pc) {
   rearm(pc->psocket.proactor, &pc->psocket.epoll_io);
 }
 
+/* IO the working thread can do now, work posted by other threads is in pc->sched */
 static inline bool pconnection_work_pending(pconnection_t *pc) {
-  if (pc->new_events || pc->wake_count || pc->tick_pending || pc->queued_disconnect)
-    return true;
   if (!pc->read_blocked && !pconnection_rclosed(pc))
     return true;
   pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
@@ -867,25 +1552,28 @@ static inline bool pconnection_work_pending(pconnection_t *pc) {
 }
 
 static void pconnection_done(pconnection_t *pc) {
-  bool notify = false;
-  lock(&pc->context.mutex);
-  pc->context.working = false;  // So we can wake() ourself if necessary.  We remain the defacto
-                                // working context while the lock is held.
   pc->hog_count = 0;
-  if (pconnection_has_event(pc) || pconnection_work_pending(pc)) {
-    notify = wake(&pc->context);
-  } else if (pn_connection_driver_finished(&pc->driver)) {
+  pc->batch_count = 0;
+  pc->now = 0;                  /* The application may have spent a while on the batch */
+  if (pc->psocket.proactor->hibernate) pc->active_at = pconnection_now(pc);
+  bool requeue = pconnection_has_event(pc) || pconnection_work_pending(pc);
+  if (!requeue && pn_transport_get_disposition_delay(pc->driver.transport))
+    pconnection_tick(pc);         /* Dispositions may be held back, see pconnection_process */
+  if (!requeue)
+    pconnection_sleep(pc);
+  if (!requeue && pn_connection_driver_finished(&pc->driver)) {
     pconnection_begin_close(pc);
     if (pconnection_is_final(pc)) {
-      unlock(&pc->context.mutex);
       pconnection_cleanup(pc);
       return;
     }
   }
-  bool rearm = pconnection_rearm_check(pc);
-  unlock(&pc->context.mutex);
-  if (rearm) pconnection_rearm(pc);
-  if (notify) wake_notify(&pc->context);
+  // Rearm while still working: an event from now on finds us working and
+  // posts PCS_IO, which the release sees
+  if (pconnection_rearm_check(pc))
+    pconnection_rearm(pc);
+  // Stop working, go on the wake list if there is more to do
+  pconnection_release_notify(pc, requeue);
 }
 
 static pconnection_t *get_pconnection(pn_connection_t* c) {
@@ -895,9 +1583,12 @@ static pconnection_t *get_pconnection(pn_connection_t* c) {
 }
 
 // Return true unless error
-static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf) {
-  ssize_t n = send(pc->psocket.sockfd, wbuf.start, wbuf.size, MSG_NOSIGNAL);
+static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf, bool more) {
+  ssize_t n = pc->shm ?
+    pni_shm_write(pc->shm, pc->psocket.sockfd, wbuf.start, wbuf.size) :
+    send(pc->psocket.sockfd, wbuf.start, wbuf.size, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
   if (n > 0) {
+    pc->corked = more && !pc->shm;
     pn_connection_driver_write_done(&pc->driver, n);
     if ((size_t) n < wbuf.size) pc->write_blocked = true;
   } else if (errno == EWOULDBLOCK) {
@@ -908,140 +1599,243 @@ static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf) {
   return true;
 }
 
-static void write_flush(pconnection_t *pc) {
-  if (!pc->write_blocked && !pconnection_wclosed(pc)) {
+// Return true if the turn byte limit stopped us with more to send.
+// With more, the batch goes on and will flush again: sends may be held back
+// by the kernel for a fuller segment, see PN_PROACTOR_WRITE_MORE.
+static bool write_flush(pconnection_t *pc, bool more) {
+  size_t limit = pc->psocket.proactor->turn_bytes;
+  size_t sent = 0;
+  bool yield = false;
+  // Keep sending while the socket takes everything, the transport may have more
+  for (int i = 0; i < IO_LOOP_MAX && !pc->write_blocked && !pconnection_wclosed(pc); ++i) {
     pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
     if (wbuf.size > 0) {
-      if (!pconnection_write(pc, wbuf)) {
+      if (pc->stats && !pc->flush_start)
+        pc->flush_start = pni_proactor_stats_now();
+      if (limit && sent >= limit) {
+        yield = true;
+        break;
+      }
+      if (!pconnection_write(pc, wbuf, more)) {
         psocket_error(&pc->psocket, errno, pc->disconnected ? "disconnected" : "on write to");
+        break;
       }
+      sent += wbuf.size;
     }
     else {
+      if (pc->flush_start) {
+        PCONNECTION_STAT(pc, flush, pni_proactor_stats_now() - pc->flush_start);
+        pc->flush_start = 0;
+      }
       if (pn_connection_driver_write_closed(&pc->driver)) {
-        shutdown(pc->psocket.sockfd, SHUT_WR);
+        if (pc->shm)
+          pni_shm_close_write(pc->shm, pc->psocket.sockfd); /* The socket still rings */
+        else
+          shutdown(pc->psocket.sockfd, SHUT_WR);
         pc->write_blocked = true;
       }
+      break;
+    }
+  }
+  if (pc->corked && !more) {
+    // Nothing left to send without MSG_MORE, push out what the kernel holds
+    int cork = 0;
+    setsockopt(pc->psocket.sockfd, IPPROTO_TCP, TCP_CORK, (void*) &cork, sizeof(cork));
+    pc->corked = false;
+  }
+  return yield;
+}
+
+// Call from the working thread before I/O.  Return true if the connection
+// may do I/O now: it needs no handshake slot, holds one, or got one.
+// Otherwise it waits in line and pconnection_handshake_leave() of the
+// connection ahead hands it a slot with PCS_ADMIT.
+static bool pconnection_handshake_admit(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  if (!p->handshake_max || pc->handshake_slot || pc->handshake_done)
+    return true;
+  if (pc->context.closing || pconnection_rclosed(pc) || pconnection_wclosed(pc) ||
+      (pn_connection_state(pc->driver.connection) & (PN_REMOTE_ACTIVE | PN_REMOTE_CLOSED | PN_LOCAL_CLOSED))) {
+    pc->handshake_done = true;
+    pconnection_handshake_leave(pc);
+    return true;
+  }
+  bool admit = false;
+  lock(&p->handshake_mutex);
+  if (pc->handshake_queued) {
+    if (pc->handshake_granted) {
+      pc->handshake_granted = false;
+      pc->handshake_queued = false;
+      admit = true;
+    }
+  } else if (p->handshaking < p->handshake_max) {
+    ++p->handshaking;
+    admit = true;
+  } else {
+    pc->handshake_queued = true;
+    pc->handshake_next = NULL;
+    if (p->handshake_last) p->handshake_last->handshake_next = pc;
+    else p->handshake_first = pc;
+    p->handshake_last = pc;
+  }
+  unlock(&p->handshake_mutex);
+  pc->handshake_slot = admit;
+  return admit;
+}
+
+// Call from the working thread: give up any slot, or place in line, and hand
+// a freed slot to the next connection waiting.
+static void pconnection_handshake_leave(pconnection_t *pc) {
+  if (!pc->handshake_slot && !pc->handshake_queued)
+    return;
+  pn_proactor_t *p = pc->psocket.proactor;
+  lock(&p->handshake_mutex);
+  bool freed = pc->handshake_slot;
+  pc->handshake_slot = false;
+  if (pc->handshake_queued) {
+    if (pc->handshake_granted) {
+      freed = true;
+    } else {
+      pconnection_t **wp = &p->handshake_first;
+      pconnection_t *prev = NULL;
+      while (*wp != pc) { prev = *wp; wp = &(*wp)->handshake_next; }
+      *wp = pc->handshake_next;
+      if (p->handshake_last == pc) p->handshake_last = prev;
+    }
+    pc->handshake_queued = false;
+    pc->handshake_granted = false;
+    pc->handshake_next = NULL;
+  }
+  if (freed) {
+    pconnection_t *next = p->handshake_first;
+    if (next) {
+      p->handshake_first = next->handshake_next;
+      if (!p->handshake_first) p->handshake_last = NULL;
+      next->handshake_next = NULL;
+      next->handshake_granted = true;  // The slot stays counted for next
+      // Notify before unlocking: next leaves under the lock, so it cannot be freed yet.
+      if (pconnection_post(next, PCS_ADMIT)) wake_notify(&next->context);
+    } else {
+      --p->handshaking;
     }
   }
+  unlock(&p->handshake_mutex);
 }
 
 static void pconnection_connected_lh(pconnection_t *pc);
 static void pconnection_maybe_connect_lh(pconnection_t *pc);
+static void pconnection_resolved(pconnection_t *pc);
+static pn_event_batch_t *pconnection_turn(pconnection_t *pc, bool topup);
 
 /*
  * May be called concurrently from multiple threads:
  *   pn_event_batch_t loop (topup is true)
- *   timer (timeout is true)
  *   socket io (events != 0)
- *   one or more wake()
+ *   one or more pconnection_post(), including timer expiry (PCS_TICK)
  * Only one thread becomes (or always was) the working thread.
  */
-static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events, bool timeout, bool topup) {
-  bool inbound_wake = !(events | timeout | topup);
-  bool timer_unarmed = false;
-  bool timer_fired = false;
-  bool waking = false;
-  bool tick_required = false;
-
+static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events, bool topup) {
   // Don't touch data exclusive to working thread (yet).
 
-  if (timeout) {
-    timer_unarmed = true;
-    timer_fired = ptimer_callback(&pc->timer) != 0;
-  }
-  lock(&pc->context.mutex);
-
-  if (events) {
-    pc->new_events = events;
-    events = 0;
-  }
-  else if (timer_fired) {
-    pc->tick_pending = true;
-    timer_fired = false;
-  }
-  else if (inbound_wake) {
-    wake_done(&pc->context);
-    inbound_wake = false;
-  }
-
-  if (timer_unarmed)
-    pc->timer_armed = false;
-
   if (topup) {
     // Only called by the batch owner.  Does not loop, just "tops up"
     // once.  May be back depending on hog_count.
-    assert(pc->context.working);
+    assert(pcs_load(pc) & PCS_WORKING);
   }
   else {
-    if (pc->context.working) {
-      // Another thread is the working context.
-      unlock(&pc->context.mutex);
-      return NULL;
+    bool acquired;
+    if (events) {
+      // A rearm before the working thread's release may fire while the
+      // previous events are not yet taken, keep both
+      __atomic_fetch_or(&pc->new_events, events, __ATOMIC_RELEASE);
+      acquired = pconnection_acquire(pc, PCS_IO, 0);
+    } else {
+      acquired = pconnection_acquire(pc, 0, PCS_QUEUED);  // Inbound wake
     }
-    pc->context.working = true;
+    if (!acquired)
+      return NULL;              // Another thread is the working context.
   }
+  return pconnection_turn(pc, topup);
+}
+
+// Confirmed as working thread, do the work posted to the connection.
+static pn_event_batch_t *pconnection_turn(pconnection_t *pc, bool topup) {
+  bool waking = false;
+  bool tick_required = false;
+  size_t turn_limit = pc->psocket.proactor->turn_bytes;
+  bool yield = false;           /* turn byte limit reached with work remaining */
 
-  // Confirmed as working thread.  Review state and unlock ASAP.
+  if (!topup) pc->now = 0;
 
  retry:
 
-  if (pc->queued_disconnect) {  // From pn_proactor_disconnect()
+  if (pconnection_take(pc, PCS_DISCONNECT)) {  // From pn_proactor_disconnect()
+    lock(&pc->context.mutex);
+    bool disconnect = pc->queued_disconnect;
     pc->queued_disconnect = false;
-    if (!pc->context.closing) {
+    if (disconnect && !pc->context.closing) {
       if (pc->disconnect_condition) {
         pn_condition_copy(pn_transport_condition(pc->driver.transport), pc->disconnect_condition);
       }
       pn_connection_driver_close(&pc->driver);
     }
+    unlock(&pc->context.mutex);
+  }
+
+  if (pconnection_take(pc, PCS_RESOLVED)) {  // From a resolver thread
+    pconnection_resolved(pc);
   }
 
   if (pconnection_has_event(pc)) {
-    unlock(&pc->context.mutex);
     return &pc->batch;
   }
   bool closed = pconnection_rclosed(pc) && pconnection_wclosed(pc);
-  if (pc->wake_count) {
+  uint32_t work = pconnection_take(pc, PCS_IO | PCS_WAKE | PCS_TICK | PCS_ADMIT);
+  if (work & PCS_WAKE)
     waking = !closed;
-    pc->wake_count = 0;
-  }
-  if (pc->tick_pending) {
-    pc->tick_pending = false;
+  if (work & PCS_TICK)
     tick_required = !closed;
-  }
 
-  if (pc->new_events) {
+  if (work & PCS_IO) {
+    // Edge-triggered events may have been or'ed in by several threads
+    uint32_t events = __atomic_exchange_n(&pc->new_events, 0, __ATOMIC_ACQUIRE);
     if (!pc->context.closing) {
-      if ((pc->new_events & (EPOLLHUP | EPOLLERR)) && !pconnection_rclosed(pc) && !pconnection_wclosed(pc))
+      if ((events & (EPOLLHUP | EPOLLERR)) && !pconnection_rclosed(pc) && !pconnection_wclosed(pc))
         pconnection_maybe_connect_lh(pc);
       else
         pconnection_connected_lh(pc); /* Non error event means we are connected */
-      if (pc->new_events & EPOLLOUT)
+      if (events & EPOLLOUT)
         pc->write_blocked = false;
-      if (pc->new_events & EPOLLIN)
+      if (events & EPOLLIN)
         pc->read_blocked = false;
+      if (pc->shm && pc->connected && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        // A doorbell for either direction
+        int err = pni_shm_poll(pc->shm, pc->psocket.sockfd);
+        if (err) psocket_error(&pc->psocket, err, "on read from");
+        pc->read_blocked = pc->write_blocked = false;
+      }
     }
     pc->current_arm = 0;
-    pc->new_events = 0;
   }
 
   if (pc->context.closing && pconnection_is_final(pc)) {
-    unlock(&pc->context.mutex);
+    // A topup caller still holds the batch, pconnection_done() cleans up,
+    // for example after pn_proactor_release_connection() from a handler
+    if (topup) return NULL;
     pconnection_cleanup(pc);
     return NULL;
   }
 
-  if (!pc->timer_armed && !pc->timer.shutting_down && pc->timer.timerfd >= 0) {
-    pc->timer_armed = true;  // about to rearm outside the lock
-    timer_unarmed = true;    // so we remember
+  if (!pconnection_handshake_admit(pc)) {
+    // Wait in line for a handshake slot, PCS_ADMIT brings us back
+    if (topup) return NULL;
+    pc->hog_count = 0;
+    pconnection_release_notify(pc, false);
+    return NULL;
   }
 
-  unlock(&pc->context.mutex);
   pc->hog_count++; // working context doing work
 
-  if (timer_unarmed) {
-    rearm(pc->psocket.proactor, &pc->timer.epoll_io);
-    timer_unarmed = false;
-  }
   if (waking) {
     pn_connection_t *c = pc->driver.connection;
     pn_collector_put(pn_connection_collector(c), PN_OBJECT, c, PN_CONNECTION_WAKE);
@@ -1051,26 +1845,37 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
   // read... tick... write
   // perhaps should be: write_if_recent_EPOLLOUT... read... tick... write
 
-  if (!pconnection_rclosed(pc)) {
+  // Keep reading while each read fills the transport buffer, the socket may have more
+  size_t received = 0;
+  for (int i = 0; i < IO_LOOP_MAX && !pc->read_blocked && !pconnection_rclosed(pc); ++i) {
     pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
-    if (rbuf.size > 0 && !pc->read_blocked) {
-      ssize_t n = read(pc->psocket.sockfd, rbuf.start, rbuf.size);
-
-      if (n > 0) {
-        pn_connection_driver_read_done(&pc->driver, n);
-        pconnection_tick(pc);         /* check for tick changes. */
-        tick_required = false;
-        if (!pn_connection_driver_read_closed(&pc->driver) && (size_t)n < rbuf.size)
-          pc->read_blocked = true;
-      }
-      else if (n == 0) {
-        pn_connection_driver_read_close(&pc->driver);
-      }
-      else if (errno == EWOULDBLOCK)
+    if (rbuf.size == 0)
+      break;
+    if (turn_limit && received >= turn_limit) {
+      yield = true;
+      break;
+    }
+    ssize_t n = pc->shm ?
+      pni_shm_read(pc->shm, pc->psocket.sockfd, rbuf.start, rbuf.size) :
+      read(pc->psocket.sockfd, rbuf.start, rbuf.size);
+
+    if (n > 0) {
+      pn_connection_driver_read_done(&pc->driver, n);
+      received += n;
+      tick_required = true;           /* check for tick changes. */
+      if (!pn_connection_driver_read_closed(&pc->driver) && (size_t)n < rbuf.size)
         pc->read_blocked = true;
-      else if (!(errno == EAGAIN || errno == EINTR)) {
+    }
+    else if (n == 0) {
+      pn_connection_driver_read_close(&pc->driver);
+      break;
+    }
+    else if (errno == EWOULDBLOCK)
+      pc->read_blocked = true;
+    else {
+      if (errno != EAGAIN && errno != EINTR)
         psocket_error(&pc->psocket, errno, pc->disconnected ? "disconnected" : "on read from");
-      }
+      break;
     }
   }
 
@@ -1081,67 +1886,119 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
 
   if (topup) {
     // If there was anything new to topup, we have it by now.
+    pconnection_handshake_leave(pc);
     return NULL;  // caller already owns the batch
   }
 
   if (pconnection_has_event(pc)) {
+    pconnection_handshake_leave(pc);
     return &pc->batch;
   }
 
-  write_flush(pc);
+  if (write_flush(pc, false))
+    yield = true;
+  pconnection_handshake_leave(pc);  // Back in line for the next turn
+  // Dispositions held back by the write need their deadline on the timer
+  if (pn_transport_get_disposition_delay(pc->driver.transport))
+    pconnection_tick(pc);
 
-  lock(&pc->context.mutex);
   if (pc->context.closing && pconnection_is_final(pc)) {
-    unlock(&pc->context.mutex);
     pconnection_cleanup(pc);
     return NULL;
   }
 
-  // Never stop working while work remains.  hog_count exception to this rule is elsewhere.
-  if (pconnection_work_pending(pc))
-    goto retry;  // TODO: get rid of goto without adding more locking
+  // Never stop working while work remains.  hog_count and the turn byte limit
+  // are the exceptions to this rule.
+  if (pconnection_work_pending(pc)) {
+    if (!yield)
+      goto retry;  // TODO: get rid of goto
+    // Go to the back of the line so other ready work gets this thread.
+    pc->hog_count = 0;
+    if (pconnection_rearm_check(pc))
+      pconnection_rearm(pc);
+    pconnection_release_notify(pc, true);
+    return NULL;
+  }
 
-  pc->context.working = false;
   pc->hog_count = 0;
   if (pn_connection_driver_finished(&pc->driver)) {
     pconnection_begin_close(pc);
     if (pconnection_is_final(pc)) {
-      unlock(&pc->context.mutex);
       pconnection_cleanup(pc);
       return NULL;
     }
   }
 
-  bool rearm = pconnection_rearm_check(pc);
-  unlock(&pc->context.mutex);
-  if (rearm) pconnection_rearm(pc);
+  pconnection_sleep(pc);
+  if (pconnection_rearm_check(pc))
+    pconnection_rearm(pc);
+  if (!pconnection_try_release(pc))
+    goto retry;                 // Work was posted during the turn, keep working
   return NULL;
 }
 
-static void configure_socket(int sock) {
+// Apply the socket buffer options; listening sockets pass them on to accepted sockets
+static void configure_buffers(pn_proactor_t *p, int sock) {
+  if (p->so_rcvbuf)
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &p->so_rcvbuf, sizeof(p->so_rcvbuf));
+  if (p->so_sndbuf)
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &p->so_sndbuf, sizeof(p->so_sndbuf));
+#ifdef TCP_NOTSENT_LOWAT
+  if (p->notsent_lowat)
+    setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &p->notsent_lowat, sizeof(p->notsent_lowat));
+#endif
+}
+
+static void configure_socket(pn_proactor_t *p, int sock) {
   int flags = fcntl(sock, F_GETFL);
   flags |= O_NONBLOCK;
   fcntl(sock, F_SETFL, flags);
+  configure_buffers(p, sock);
 
   int tcp_nodelay = 1;
   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void*) &tcp_nodelay, sizeof(tcp_nodelay));
+#ifdef SO_BUSY_POLL
+  if (p->busy_poll > 0)
+    setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (void*) &p->busy_poll, sizeof(p->busy_poll));
+#endif
+}
+
+/* Switch a connected socket to edge-triggered polling, see edge_table_t.  Called
+   by the working thread with the one-shot event taken, so no other thread holds
+   one.  The kernel reports at once whatever is already ready. */
+static void pconnection_edge_start(pconnection_t *pc) {
+  epoll_extended_t *ee = &pc->psocket.epoll_io;
+  uint64_t data = edge_slot_take(&pc->psocket.proactor->edges, pc);
+  if (!data)
+    return;                     /* Table full, stay one-shot */
+  struct epoll_event ev;
+  ev.data.u64 = data;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  if (epoll_ctl(ee->epollfd, EPOLL_CTL_MOD, ee->fd, &ev) == -1)
+    EPOLL_FATAL("arming polled file descriptor", errno);
+  pc->edge = data;
 }
 
-/* Called with context.lock held */
+/* Called by the working thread */
 void pconnection_connected_lh(pconnection_t *pc) {
   if (!pc->connected) {
     pc->connected = true;
-    if (pc->addrinfo) {
-      freeaddrinfo(pc->addrinfo);
-      pc->addrinfo = NULL;
-    }
+    addrinfo_free(pc->addrinfo);
+    pc->addrinfo = NULL;
     pc->ai = NULL;
+    if (pc->shm && !pc->server) {
+      int err = pni_shm_offer(pc->shm, pc->psocket.sockfd, pc->psocket.proactor->shm_size);
+      if (err) psocket_error(&pc->psocket, err, "on connect to");
+    }
+    if (pc->psocket.proactor->edge && !pc->shm)
+      pconnection_edge_start(pc);
   }
 }
 
+static int thread_epollfd(pn_proactor_t *p);
+
 static void pconnection_start(pconnection_t *pc) {
-  int efd = pc->psocket.proactor->epollfd;
-  start_polling(&pc->timer.epoll_io, efd);  // TODO: check for error
+  int efd = thread_epollfd(pc->psocket.proactor);
 
   int fd = pc->psocket.sockfd;
   socklen_t len = sizeof(pc->local.ss);
@@ -1149,15 +2006,16 @@ static void pconnection_start(pconnection_t *pc) {
   len = sizeof(pc->remote.ss);
   getpeername(fd, (struct sockaddr*)&pc->remote.ss, &len);
 
-  start_polling(&pc->timer.epoll_io, efd);  // TODO: check for error
   epoll_extended_t *ee = &pc->psocket.epoll_io;
   ee->fd = pc->psocket.sockfd;
   ee->wanted = EPOLLIN | EPOLLOUT;
   ee->polling = false;
+  // Armed until the first event is taken, so cleanup waits for it
+  pc->current_arm = ee->wanted;
   start_polling(ee, efd);  // TODO: check for error
 }
 
-/* Called on initial connect, and if connection fails to try another address */
+/* Called by the working thread on initial connect, and if connection fails to try another address */
 static void pconnection_maybe_connect_lh(pconnection_t *pc) {
   errno = 0;
   if (!pc->connected) {         /* Not yet connected */
@@ -1166,7 +2024,7 @@ static void pconnection_maybe_connect_lh(pconnection_t *pc) {
       pc->ai = pc->ai->ai_next; /* Move to next address in case this fails */
       int fd = socket(ai->ai_family, SOCK_STREAM, 0);
       if (fd >= 0) {
-        configure_socket(fd);
+        configure_socket(pc->psocket.proactor, fd);
         if (!connect(fd, ai->ai_addr, ai->ai_addrlen) || errno == EINPROGRESS) {
           pc->psocket.sockfd = fd;
           pconnection_start(pc);
@@ -1175,7 +2033,7 @@ static void pconnection_maybe_connect_lh(pconnection_t *pc) {
       }
       /* connect failed immediately, go round the loop to try the next addr */
     }
-    freeaddrinfo(pc->addrinfo);
+    addrinfo_free(pc->addrinfo);
     pc->addrinfo = NULL;
     /* If there was a previous attempted connection, let the poller discover the
        errno from its socket, otherwise set the current error. */
@@ -1195,8 +2053,298 @@ static int pgetaddrinfo(const char *host, const char *port, int flags, struct ad
   return getaddrinfo(host, port, &hints, res);
 }
 
-static inline bool is_inactive(pn_proactor_t *p) {
-  return (!p->contexts && !p->disconnects_pending && !p->timeout_set && !p->shutting_down);
+static void addrinfo_free(struct addrinfo *ai) {
+  while (ai) {
+    struct addrinfo *next = ai->ai_next;
+    free(ai);
+    ai = next;
+  }
+}
+
+// Copy an addrinfo list, one allocation per address.  Free with addrinfo_free().
+static struct addrinfo *addrinfo_copy(const struct addrinfo *ai) {
+  struct addrinfo *first = NULL;
+  struct addrinfo **last = &first;
+  for (; ai; ai = ai->ai_next) {
+    struct addrinfo *c = (struct addrinfo*)malloc(sizeof(struct addrinfo) + ai->ai_addrlen);
+    if (!c) {
+      addrinfo_free(first);
+      return NULL;
+    }
+    *c = *ai;
+    c->ai_canonname = NULL;
+    c->ai_addr = (struct sockaddr*)(c + 1);
+    memcpy(c->ai_addr, ai->ai_addr, ai->ai_addrlen);
+    c->ai_next = NULL;
+    *last = c;
+    last = &c->ai_next;
+  }
+  return first;
+}
+
+// A one-address list for a unix: socket path in the addrinfo_copy() format.
+// Return NULL and set *gai_error on failure.
+static struct addrinfo *unix_addrinfo(const char *path, int *gai_error) {
+  struct sockaddr_storage ss;
+  size_t len;
+  if (pni_unix_sockaddr(path, &ss, &len)) {
+    *gai_error = EAI_NONAME;    /* Path too long */
+    return NULL;
+  }
+  struct addrinfo *ai = (struct addrinfo*)calloc(1, sizeof(struct addrinfo) + len);
+  if (!ai) {
+    *gai_error = EAI_MEMORY;
+    return NULL;
+  }
+  ai->ai_family = AF_UNIX;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_addrlen = len;
+  ai->ai_addr = (struct sockaddr*)(ai + 1);
+  memcpy(ai->ai_addr, &ss, len);
+  *gai_error = 0;
+  return ai;
+}
+
+/* The socket path of a "unix:" or "shm:" address, NULL for others */
+static const char *local_path(const char *host, const char *port) {
+  const char *path = pni_unix_path(host, port);
+  return path ? path : pni_shm_path(host, port);
+}
+
+static inline bool str_equal(const char *a, const char *b) {
+  return a == b || (a && b && !strcmp(a, b));
+}
+
+static char *str_dup(const char *s) {
+  return s ? strdup(s) : NULL;
+}
+
+static void dns_entry_free(dns_entry_t *e) {
+  if (e->addrinfo) freeaddrinfo(e->addrinfo);
+  free(e->host);
+  free(e->port);
+  free(e);
+}
+
+// Call with resolver lock.  Find the entry for host:port, dropping other
+// expired entries on the way.
+static dns_entry_t *dns_cache_find_lh(resolver_t *r, const char *host, const char *port, uint64_t now) {
+  dns_entry_t *found = NULL;
+  dns_entry_t **ep = &r->cache;
+  while (*ep) {
+    dns_entry_t *e = *ep;
+    if (!found && str_equal(e->host, host) && str_equal(e->port, port)) {
+      found = e;
+      ep = &e->next;
+    } else if (!e->resolving && e->expires <= now) {
+      *ep = e->next;
+      --r->cache_len;
+      dns_entry_free(e);
+    } else {
+      ep = &e->next;
+    }
+  }
+  return found;
+}
+
+// Call with resolver lock.  Add an entry for host:port, evicting the oldest
+// idle entry if the cache is full.
+static dns_entry_t *dns_cache_add_lh(resolver_t *r, const char *host, const char *port) {
+  if (r->cache_len >= DNS_CACHE_MAX) {
+    dns_entry_t **oldest = NULL;
+    for (dns_entry_t **ep = &r->cache; *ep; ep = &(*ep)->next) {
+      if (!(*ep)->resolving) oldest = ep;
+    }
+    if (oldest) {
+      dns_entry_t *e = *oldest;
+      *oldest = e->next;
+      --r->cache_len;
+      dns_entry_free(e);
+    }
+  }
+  dns_entry_t *e = (dns_entry_t*)calloc(1, sizeof(dns_entry_t));
+  if (!e) return NULL;
+  e->host = str_dup(host);
+  e->port = str_dup(port);
+  if ((host && !e->host) || (port && !e->port)) {
+    dns_entry_free(e);
+    return NULL;
+  }
+  e->next = r->cache;
+  r->cache = e;
+  ++r->cache_len;
+  return e;
+}
+
+// Call with resolver lock.  A private copy of the result for one connection.
+static int dns_entry_result_lh(dns_entry_t *e, struct addrinfo **ai) {
+  *ai = NULL;
+  if (e->gai_error)
+    return e->gai_error;
+  *ai = addrinfo_copy(e->addrinfo);
+  return *ai ? 0 : EAI_MEMORY;
+}
+
+// Call with resolver lock.  Cache a lookup result and hand it to the waiting connections.
+static void dns_entry_resolved_lh(resolver_t *r, dns_entry_t *e, int gai_error, struct addrinfo *res) {
+  if (e->addrinfo) freeaddrinfo(e->addrinfo);
+  e->addrinfo = gai_error ? NULL : res;
+  e->gai_error = gai_error;
+  e->expires = pn_proactor_now() + (gai_error ? r->negative_ttl : r->ttl);
+  e->resolving = false;
+  while (e->waiters) {
+    pconnection_t *pc = e->waiters;
+    e->waiters = pc->resolve_next;
+    pc->resolve_entry = NULL;
+    pc->resolve_next = NULL;
+    pc->resolve_error = dns_entry_result_lh(e, &pc->resolved);
+    pc->resolve_done = true;
+    // Notify before unlocking: pconnection_resolve_cancel() waits for the
+    // lock, so pc cannot be freed yet.
+    if (pconnection_post(pc, PCS_RESOLVED)) wake_notify(&pc->context);
+  }
+}
+
+static void *resolver_thread(void *arg) {
+  resolver_t *r = (resolver_t*)arg;
+  lock(&r->mutex);
+  while (!r->shutting_down) {
+    dns_entry_t *e = r->queue_first;
+    if (!e) {
+      pthread_cond_wait(&r->cond, &r->mutex);
+      continue;
+    }
+    r->queue_first = e->queue_next;
+    if (!r->queue_first) r->queue_last = NULL;
+    e->queue_next = NULL;
+    unlock(&r->mutex);
+    // e is not evicted while resolving
+    struct addrinfo *res = NULL;
+    int gai_error = pgetaddrinfo(e->host, e->port, 0, &res);
+    lock(&r->mutex);
+    dns_entry_resolved_lh(r, e, gai_error, res);
+  }
+  unlock(&r->mutex);
+  return NULL;
+}
+
+// Call with resolver lock.  Start the resolver threads on first use, return
+// false if there are none.
+static bool resolver_start_lh(resolver_t *r) {
+  while (r->nthreads < r->max_threads && !r->shutting_down) {
+    if (pthread_create(&r->threads[r->nthreads], NULL, resolver_thread, r) != 0)
+      break;
+    r->nthreads++;
+  }
+  return r->nthreads > 0;
+}
+
+/* Find addresses for a new outgoing connection.  Return true if the result is
+   available now in *ai and *gai_error, false if the connection must wait for
+   PCS_RESOLVED.  Called by the thread that owns pc in pn_proactor_connect(). */
+static bool resolver_lookup(pn_proactor_t *p, pconnection_t *pc, struct addrinfo **ai, int *gai_error) {
+  resolver_t *r = &p->resolver;
+  const char *host = pc->psocket.host;
+  const char *port = pc->psocket.port;
+  const char *path = local_path(host, port);
+  if (path) {
+    *ai = unix_addrinfo(path, gai_error);
+    return true;
+  }
+  struct addrinfo *res = NULL;
+  if (!pgetaddrinfo(host, port, AI_NUMERICHOST, &res)) {
+    /* Numeric or empty host, no lookup needed */
+    *ai = addrinfo_copy(res);
+    *gai_error = *ai ? 0 : EAI_MEMORY;
+    freeaddrinfo(res);
+    return true;
+  }
+  uint64_t now = pn_proactor_now();
+  lock(&r->mutex);
+  dns_entry_t *e = dns_cache_find_lh(r, host, port, now);
+  if (e && !e->resolving && e->expires > now) {
+    *gai_error = dns_entry_result_lh(e, ai);  /* Cached */
+    unlock(&r->mutex);
+    return true;
+  }
+  if (!e)
+    e = dns_cache_add_lh(r, host, port);
+  if (e && !e->resolving && resolver_start_lh(r)) {
+    e->resolving = true;
+    if (r->queue_last) r->queue_last->queue_next = e;
+    else r->queue_first = e;
+    r->queue_last = e;
+    pthread_cond_signal(&r->cond);
+  }
+  if (e && e->resolving) {
+    pc->resolve_entry = e;
+    pc->resolve_next = e->waiters;
+    e->waiters = pc;
+    unlock(&r->mutex);
+    return false;
+  }
+  // No resolver threads, look up on this thread.  Connections asking for the
+  // same address meanwhile wait for this result.
+  if (e) e->resolving = true;
+  unlock(&r->mutex);
+  res = NULL;
+  int err = pgetaddrinfo(host, port, 0, &res);
+  lock(&r->mutex);
+  if (e) {
+    dns_entry_resolved_lh(r, e, err, res);
+    *gai_error = dns_entry_result_lh(e, ai);
+  } else {
+    *ai = err ? NULL : addrinfo_copy(res);
+    *gai_error = err ? err : (*ai ? 0 : EAI_MEMORY);
+    if (res) freeaddrinfo(res);
+  }
+  unlock(&r->mutex);
+  return true;
+}
+
+/* Call from the working thread when closing.  Stop waiting for a lookup and
+   drop a result not yet taken, there are no PCS_RESOLVED posts after this. */
+static void pconnection_resolve_cancel(pconnection_t *pc) {
+  resolver_t *r = &pc->psocket.proactor->resolver;
+  lock(&r->mutex);
+  dns_entry_t *e = pc->resolve_entry;
+  if (e) {
+    pconnection_t **wp = &e->waiters;
+    while (*wp != pc) wp = &(*wp)->resolve_next;
+    *wp = pc->resolve_next;
+    pc->resolve_entry = NULL;
+    pc->resolve_next = NULL;
+  }
+  if (pc->resolve_done) {
+    addrinfo_free(pc->resolved);
+    pc->resolved = NULL;
+    pc->resolve_done = false;
+  }
+  unlock(&r->mutex);
+}
+
+/* Call from the working thread on PCS_RESOLVED to start connecting */
+static void pconnection_resolved(pconnection_t *pc) {
+  resolver_t *r = &pc->psocket.proactor->resolver;
+  lock(&r->mutex);
+  bool done = pc->resolve_done;
+  struct addrinfo *ai = pc->resolved;
+  int gai_error = pc->resolve_error;
+  pc->resolve_done = false;
+  pc->resolved = NULL;
+  unlock(&r->mutex);
+  if (!done)
+    return;                     /* Cancelled */
+  if (gai_error) {
+    psocket_gai_error(&pc->psocket, gai_error, "connect to ");
+  } else {
+    pc->addrinfo = pc->ai = ai;
+    pconnection_maybe_connect_lh(pc); /* Start connection attempts */
+  }
+}
+
+static inline bool is_inactive(pn_proactor_t *p) {
+  return (!p->contexts && !p->disconnects_pending && !p->timeout_set && !p->shutting_down);
 }
 
 /* If inactive set need_inactive and return true if the proactor needs a wakeup */
@@ -1211,72 +2359,265 @@ static bool wake_if_inactive(pn_proactor_t *p) {
 void pn_proactor_connect(pn_proactor_t *p, pn_connection_t *c, const char *addr) {
   pconnection_t *pc = new_pconnection_t(p, c, false, addr);
   assert(pc); // TODO: memory safety
+  if (pni_shm_path(pc->psocket.host, pc->psocket.port)) {
+    pc->shm = pni_shm();
+    assert(pc->shm);  // TODO: memory safety
+  }
   // TODO: check case of proactor shutting down
   lock(&pc->context.mutex);
   proactor_add(&pc->context);
   pn_connection_open(pc->driver.connection); /* Auto-open */
 
-  bool notify = false;
+  bool requeue = false;
   bool notify_proactor = false;
 
+  const char *name = pni_inproc_name(pc->psocket.host, pc->psocket.port);
   if (pc->disconnected) {
-    notify = wake(&pc->context);    /* Error during initialization */
+    requeue = true;             /* Error during initialization */
+  } else if (name) {
+    int err = inproc_connect(name, &pc->psocket.sockfd);
+    if (!err) {
+      configure_socket(p, pc->psocket.sockfd);
+      pconnection_start(pc);
+    } else {
+      psocket_error(&pc->psocket, err, "connect to ");
+      requeue = true;
+      notify_proactor = wake_if_inactive(p);
+    }
   } else {
-    int gai_error = pgetaddrinfo(pc->psocket.host, pc->psocket.port, 0, &pc->addrinfo);
-    if (!gai_error) {
+    int gai_error = 0;
+    if (!resolver_lookup(p, pc, &pc->addrinfo, &gai_error)) {
+      /* Resolving, pconnection_resolved() starts the connection attempts */
+    } else if (!gai_error) {
       pn_connection_open(pc->driver.connection); /* Auto-open */
       pc->ai = pc->addrinfo;
       pconnection_maybe_connect_lh(pc); /* Start connection attempts */
-      notify = pc->disconnected;
+      requeue = pc->disconnected;
     } else {
       psocket_gai_error(&pc->psocket, gai_error, "connect to ");
-      notify = wake(&pc->context);
+      requeue = true;
       notify_proactor = wake_if_inactive(p);
     }
   }
   /* We need to issue INACTIVE on immediate failure */
   unlock(&pc->context.mutex);
-  if (notify) wake_notify(&pc->context);
+  // Hand the new connection over to the proactor threads
+  pconnection_release_notify(pc, requeue);
   if (notify_proactor) wake_notify(&p->context);
 }
 
+// Call with wheel lock held.  Set the timerfd for deadline if it is earlier than the current setting.
+static void twheel_arm_lh(twheel_t *w, uint64_t deadline, uint64_t now) {
+  if (w->armed && w->armed <= deadline)
+    return;
+  w->armed = deadline;
+  ptimer_set(&w->timer, deadline > now ? deadline - now : 1);
+}
+
+static void twheel_unlink_lh(twheel_t *w, twheel_entry_t *e) {
+  if (e->prev) e->prev->next = e->next;
+  else w->slots[(e->deadline / TWHEEL_TICK_MS) % TWHEEL_SLOTS] = e->next;
+  if (e->next) e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+  e->deadline = 0;
+}
+
+// Replace any deadline for e with a new one, 0 just cancels.
+static void twheel_schedule(twheel_t *w, twheel_entry_t *e, uint64_t deadline, uint64_t now) {
+  lock(&w->mutex);
+  if (e->deadline)
+    twheel_unlink_lh(w, e);
+  if (deadline) {
+    // Deadlines in an already processed tick go in the next slot to be visited
+    if (deadline / TWHEEL_TICK_MS < w->tick)
+      deadline = w->tick * TWHEEL_TICK_MS;
+    twheel_entry_t **slot = &w->slots[(deadline / TWHEEL_TICK_MS) % TWHEEL_SLOTS];
+    e->deadline = deadline;
+    e->prev = NULL;
+    e->next = *slot;
+    if (e->next) e->next->prev = e;
+    *slot = e;
+    twheel_arm_lh(w, deadline, now);
+  }
+  unlock(&w->mutex);
+}
+
+static void twheel_cancel(twheel_t *w, twheel_entry_t *e) {
+  twheel_schedule(w, e, 0, 0);
+}
+
+static inline uint64_t twheel_now(twheel_t *w) {
+  return clock_now(w->clock);
+}
+
+static void twheel_init(twheel_t *w) {
+  pmutex_init(&w->mutex);
+  ptimer_init(&w->timer, PCONNECTION_TIMER);
+  w->clock = CLOCK_MONOTONIC;
+#ifdef CLOCK_MONOTONIC_COARSE
+  struct timespec res;
+  if (clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0 && res.tv_sec == 0 &&
+      res.tv_nsec <= TWHEEL_TICK_MS * 1000000L)
+    w->clock = CLOCK_MONOTONIC_COARSE;
+#endif
+  w->tick = twheel_now(w) / TWHEEL_TICK_MS;
+  w->armed = 0;
+}
+
+static void twheel_finalize(twheel_t *w) {
+  ptimer_finalize(&w->timer);
+  pmutex_finalize(&w->mutex);
+}
+
+// Called with the wheel lock held for each connection whose deadline has passed.
+// A connection with no thread and nothing else to do is taken by the timer
+// thread and pushed on idle for pconnection_heartbeat(), others get a turn.
+static pconnection_t *pconnection_expired_lh(pconnection_t *pc, pconnection_t *idle) {
+  uint32_t old = pcs_load(pc);
+  if (!(old & (PCS_WORKING | PCS_QUEUED | PCS_CLOSING | PCS_PENDING)) &&
+      pcs_cas(pc, &old, old | PCS_WORKING)) {
+    pc->heartbeat_next = idle;
+    return pc;
+  }
+  pconnection_post_notify(pc, PCS_TICK);
+  return idle;
+}
+
+// The timer thread is the working thread of an idle connection whose timer
+// expired.  Tick the transport and send any keepalive frame without making a
+// batch, the dead remote check is done by the same tick.  Only if that leaves
+// events or more work does the connection go in line for a normal turn.
+static void pconnection_heartbeat(pconnection_t *pc, uint64_t now) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  if (pc->context.closing || pc->psocket.sockfd == -1 || (p->handshake_max && !pc->handshake_done)) {
+    __atomic_fetch_or(&pc->sched, PCS_TICK, __ATOMIC_ACQ_REL);
+    pconnection_release_notify(pc, false);
+    return;
+  }
+  pc->now = now;
+  pconnection_tick(pc);
+  bool yield = !pconnection_has_event(pc) && write_flush(pc, false);
+  if (yield || pconnection_has_event(pc) || pconnection_work_pending(pc) ||
+      pn_connection_driver_finished(&pc->driver)) {
+    pconnection_release_notify(pc, true);
+  } else {
+    pconnection_sleep(pc);
+    if (pconnection_rearm_check(pc))
+      pconnection_rearm(pc);
+    pconnection_release_notify(pc, false);
+  }
+}
+
+// Timer wheel epoll event: expire every connection timer that is due.
+static void twheel_process(pn_proactor_t *p) {
+  twheel_t *w = &p->timers;
+  lock(&w->mutex);
+  (void)ptimer_callback(&w->timer);
+  uint64_t now = twheel_now(w);
+  uint64_t now_tick = now / TWHEEL_TICK_MS;
+  uint64_t first = w->tick;
+  bool overflow = false;
+  pconnection_t *idle = NULL;
+  if (now_tick >= first && now_tick - first >= TWHEEL_SLOTS)
+    first = now_tick - TWHEEL_SLOTS + 1;
+  for (uint64_t t = first; t <= now_tick; t++) {
+    twheel_entry_t *e = w->slots[t % TWHEEL_SLOTS];
+    while (e) {
+      twheel_entry_t *next = e->next;
+      if (e->deadline <= now) {
+        twheel_unlink_lh(w, e);
+        if (e == &p->overflow_timer)
+          overflow = true;
+        else
+          idle = pconnection_expired_lh((pconnection_t *) ((char *) e - offsetof(pconnection_t, timer)), idle);
+      }
+      e = next;
+    }
+  }
+  if (now_tick > w->tick)
+    w->tick = now_tick;
+
+  // Entries in the first non-empty slot that are due this round bound all later slots.
+  w->armed = 0;
+  for (uint64_t t = w->tick; t < w->tick + TWHEEL_SLOTS; t++) {
+    twheel_entry_t *e = w->slots[t % TWHEEL_SLOTS];
+    if (e) {
+      uint64_t next = (t + 1) * TWHEEL_TICK_MS;
+      for (; e; e = e->next)
+        if (e->deadline < next) next = e->deadline;
+      twheel_arm_lh(w, next, now);
+      break;
+    }
+  }
+  unlock(&w->mutex);
+  rearm(p, &w->timer.epoll_io);
+  while (idle) {
+    pconnection_t *pc = idle;
+    idle = pc->heartbeat_next;
+    pconnection_heartbeat(pc, now);
+  }
+  if (overflow) {
+    /* Listeners that overflow again schedule the next retry */
+    __atomic_store_n(&p->overflow_next, now + p->overflow_retry, __ATOMIC_RELEASE);
+    proactor_reserve(p);
+    proactor_rearm_overflow(p);
+  }
+}
+
+// The wheel clock, read by the working thread once per turn.
+static uint64_t pconnection_now(pconnection_t *pc) {
+  if (!pc->now) pc->now = twheel_now(&pc->psocket.proactor->timers);
+  return pc->now;
+}
+
 static void pconnection_tick(pconnection_t *pc) {
   pn_transport_t *t = pc->driver.transport;
-  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t)) {
-    ptimer_set(&pc->timer, 0);
-    uint64_t now = pn_i_now2();
-    uint64_t next = pn_transport_tick(t, now);
-    if (next) {
-      ptimer_set(&pc->timer, next - now);
-    }
+  bool ticking = pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+    pn_transport_get_disposition_delay(t);
+  if (ticking || pc->sleep_at) {
+    uint64_t now = pconnection_now(pc);
+    uint64_t next = pc->tick_at = ticking ? pn_transport_tick(t, now) : 0;
+    // A passed hibernation deadline is handled as the turn ends, see pconnection_sleep
+    if (pc->sleep_at > now && (!next || pc->sleep_at < next))
+      next = pc->sleep_at;
+    twheel_schedule(&pc->psocket.proactor->timers, &pc->timer, next, now);
+  }
+}
+
+// Called by the working thread as it stops with nothing left to do.
+// Hibernate if no batch has been done for p->hibernate, else make sure the
+// timer brings the connection back when it is time to.
+static void pconnection_sleep(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  if (!p->hibernate || pc->context.closing || !pc->read_blocked)
+    return;
+  uint64_t now = pconnection_now(pc);
+  uint64_t deadline = pc->active_at + p->hibernate;
+  if (now >= deadline) {
+    pc->sleep_at = 0;
+    pn_transport_hibernate(pc->driver.transport);
+  } else if (pc->sleep_at != deadline) {
+    pc->sleep_at = deadline;
+    uint64_t next = (pc->tick_at && pc->tick_at < deadline) ? pc->tick_at : deadline;
+    twheel_schedule(&p->timers, &pc->timer, next, now);
   }
 }
 
 void pn_connection_wake(pn_connection_t* c) {
-  bool notify = false;
   pconnection_t *pc = get_pconnection(c);
-  if (pc) {
-    lock(&pc->context.mutex);
-    if (!pc->context.closing) {
-      pc->wake_count++;
-      notify = wake(&pc->context);
-    }
-    unlock(&pc->context.mutex);
-  }
-  if (notify) wake_notify(&pc->context);
+  if (pc)
+    pconnection_post_notify(pc, PCS_WAKE);  // No locks, ignored after close
 }
 
 void pn_proactor_release_connection(pn_connection_t *c) {
-  bool notify = false;
   pconnection_t *pc = get_pconnection(c);
   if (pc) {
     lock(&pc->context.mutex);
     pn_connection_driver_release_connection(&pc->driver);
     pconnection_begin_close(pc);
-    notify = wake(&pc->context);
     unlock(&pc->context.mutex);
+    pconnection_post_notify(pc, 0);
   }
-  if (notify) wake_notify(&pc->context);
 }
 
 // ========================================================================
@@ -1290,7 +2631,7 @@ pn_listener_t *pn_event_listener(pn_event_t *e) {
 pn_listener_t *pn_listener() {
   pn_listener_t *l = (pn_listener_t*)calloc(1, sizeof(pn_listener_t));
   if (l) {
-    l->accepted_fd = -1;
+    l->accepted_next = l->accepted_announced = l->accepted_size = 0;
     l->accepted = NULL;
     l->batch.next_event = listener_batch_next;
     l->collector = pn_collector();
@@ -1306,6 +2647,81 @@ pn_listener_t *pn_listener() {
   return l;
 }
 
+/* Listen on "inproc:<name>" with an eventfd in place of a socket, readable
+   while inproc_connect() has left connections to accept.  Sets errno on
+   failure.  Called without the listener lock, inproc_lock is taken first. */
+static void inproc_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, const char *name) {
+  lock(&inproc_lock);
+  bool taken = false;
+  for (pn_listener_t *x = inproc_listeners; x && !taken; x = x->inproc_next) {
+    if (str_equal(x->inproc, name)) {
+      lock(&x->context.mutex);
+      taken = !x->context.closing;
+      unlock(&x->context.mutex);
+    }
+  }
+  int fd = taken ? -1 : eventfd(0, EFD_NONBLOCK);
+  if (fd >= 0) {
+    l->psockets = (psocket_t*)calloc(1, sizeof(psocket_t));
+    assert(l->psockets);      /* TODO aconway 2017-05-05: memory safety */
+    psocket_t *ps = &l->psockets[l->psockets_size++];
+    psocket_init(ps, p, l, addr);
+    ps->sockfd = fd;
+    ps->epoll_io.fd = fd;
+    ps->epoll_io.wanted = EPOLLIN;
+    ps->epoll_io.polling = false;
+    start_polling(&ps->epoll_io, ps->proactor->epollfd);  // TODO: check for error
+    l->inproc = ps->port;
+    l->inproc_next = inproc_listeners;
+    inproc_listeners = l;
+  } else if (taken) {
+    errno = EADDRINUSE;
+  }
+  unlock(&inproc_lock);
+}
+
+/* Connect to the "inproc:<name>" listener with a socketpair.  The listener
+   accepts the other end as if it came from a listening socket.  There is no
+   backlog limit, connections wait until the listener closes. */
+static int inproc_connect(const char *name, int *fd) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv)) return errno;
+  int err = ECONNREFUSED;
+  lock(&inproc_lock);
+  for (pn_listener_t *l = inproc_listeners; l && err; l = l->inproc_next) {
+    if (!str_equal(l->inproc, name)) continue;
+    lock(&l->context.mutex);
+    if (!l->context.closing) {
+      if (l->inproc_size == l->inproc_capacity) {
+        size_t cap = l->inproc_capacity ? 2 * l->inproc_capacity : LISTENER_ACCEPT_BATCH;
+        int *fds = (int*)realloc(l->inproc_fds, cap * sizeof(int));
+        if (fds) {
+          l->inproc_fds = fds;
+          l->inproc_capacity = cap;
+        }
+      }
+      if (l->inproc_size < l->inproc_capacity) {
+        l->inproc_fds[l->inproc_size++] = sv[1];
+        uint64_t one = 1;
+        if (write(l->psockets[0].sockfd, &one, sizeof(one)) < 0)
+          EPOLL_FATAL("inproc eventfd write", errno);
+        err = 0;
+      } else {
+        err = ENOMEM;
+      }
+    }
+    unlock(&l->context.mutex);
+  }
+  unlock(&inproc_lock);
+  if (err) {
+    close(sv[0]);
+    close(sv[1]);
+  } else {
+    *fd = sv[0];
+  }
+  return err;
+}
+
 void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, int backlog)
 {
   // TODO: check listener not already listening for this or another proactor
@@ -1319,8 +2735,19 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
   pni_parse_addr(addr, addr_buf, PN_MAX_ADDR, &host, &port);
 
   struct addrinfo *addrinfo = NULL;
-  int gai_err = pgetaddrinfo(host, port, AI_PASSIVE | AI_ALL, &addrinfo);
-  if (!gai_err) {
+  const char *path = local_path(host, port);
+  const char *name = pni_inproc_name(host, port);
+  int gai_err = 0;
+  if (name) {
+    unlock(&l->context.mutex);  // Not published until inproc_listen() adds it
+    inproc_listen(p, l, addr, name);
+    lock(&l->context.mutex);
+  } else if (path) {
+    addrinfo = unix_addrinfo(path, &gai_err);
+  } else {
+    gai_err = pgetaddrinfo(host, port, AI_PASSIVE | AI_ALL, &addrinfo);
+  }
+  if (!gai_err && !name) {
     /* Count addresses, allocate enough space for sockets */
     size_t len = 0;
     for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
@@ -1332,10 +2759,13 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
     l->psockets_size = 0;
     /* Find working listen addresses */
     for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
-      int fd = socket(ai->ai_family, SOCK_STREAM, ai->ai_protocol);
+      int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK, ai->ai_protocol);
       static int on = 1;
+      if (fd >= 0) configure_buffers(p, fd);
       if ((fd >= 0) &&
           !setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) &&
+          (!l->reuseport ||
+           !setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) &&
           /* We listen to v4/v6 on separate sockets, don't let v6 listen for v4 */
           (ai->ai_family != AF_INET6 ||
            !setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on))) &&
@@ -1352,7 +2782,9 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
       }
     }
   }
-  if (addrinfo) {
+  if (path) {
+    addrinfo_free(addrinfo);
+  } else if (addrinfo) {
     freeaddrinfo(addrinfo);
   }
   /* Always put an OPEN event for symmetry, even if we immediately close with err */
@@ -1360,7 +2792,8 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
   bool notify = wake(&l->context);
 
   if (l->psockets_size == 0) { /* All failed, create dummy socket with an error */
-    l->psockets = (psocket_t*)calloc(sizeof(psocket_t), 1);
+    if (!l->psockets)           /* Reuse the array if sockets were tried */
+      l->psockets = (psocket_t*)calloc(sizeof(psocket_t), 1);
     psocket_init(l->psockets, p, l, addr);
     if (gai_err) {
       psocket_gai_error(l->psockets, gai_err, "listen on");
@@ -1376,10 +2809,25 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
 
 // call with lock held
 static inline bool listener_can_free(pn_listener_t *l) {
-  return l->context.closing && l->close_dispatched && !l->context.wake_ops;
+  return l->context.closing && l->close_dispatched && !l->context.wake_ops && l->overflow == NO_OVERFLOW;
+}
+
+static inline bool listener_accepted_empty(pn_listener_t *l) {
+  return l->accepted_next == l->accepted_size;
 }
 
 static inline void listener_final_free(pn_listener_t *l) {
+  /* Connections the application never accepted */
+  while (!listener_accepted_empty(l))
+    close(l->accepted_fds[l->accepted_next++]);
+  if (l->inproc) {
+    lock(&inproc_lock);
+    pn_listener_t **pl = &inproc_listeners;
+    while (*pl != l) pl = &(*pl)->inproc_next;
+    *pl = l->inproc_next;
+    unlock(&inproc_lock);
+    free(l->inproc_fds);
+  }
   pcontext_finalize(&l->context);
   free(l->psockets);
   free(l);
@@ -1413,9 +2861,14 @@ static void listener_begin_close(pn_listener_t* l) {
       psocket_t *ps = &l->psockets[i];
       if (ps->sockfd >= 0) {
         stop_polling(&ps->epoll_io, ps->proactor->epollfd);
-        pclosefd(l->psockets[0].proactor, ps->sockfd);
+        close(ps->sockfd);      /* Not pclosefd(), retrying overflow listeners could take our lock */
+        const char *path = local_path(ps->host, ps->port);
+        if (path && *path != '@') unlink(path); /* Remove the socket file we bound */
       }
     }
+    /* Refuse inproc connections that were never accepted */
+    while (l->inproc_size)
+      close(l->inproc_fds[--l->inproc_size]);
     pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_CLOSE);
   }
 }
@@ -1437,25 +2890,58 @@ static void listener_forced_shutdown(pn_listener_t *l) {
   // pconnection_process will never be called again.  Zero everything.
   l->context.wake_ops = 0;
   l->close_dispatched = true;
+  l->overflow = NO_OVERFLOW;
   assert(listener_can_free(l));
   pn_listener_free(l);
 }
 
-/* Accept a connection as part of listener_process(). Called with listener context lock held. */
+/* Accept connections as part of listener_process(). Called with listener context lock held.
+   Drains up to LISTENER_ACCEPT_BATCH connections, each gets a PN_LISTENER_ACCEPT event in turn. */
 static void listener_accept_lh(psocket_t *ps) {
   pn_listener_t *l = psocket_listener(ps);
-  assert(l->accepted_fd < 0); /* Shouldn't already have an accepted_fd */
-  l->accepted_fd = accept(ps->sockfd, NULL, 0);
+  assert(listener_accepted_empty(l)); /* Shouldn't already have accepted fds */
+  l->accepted_next = l->accepted_announced = l->accepted_size = 0;
   l->accepted = ps;
-  if (l->accepted_fd >= 0) {
-    pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_ACCEPT);
-  } else {
+  if (l->inproc) {
+    size_t n = l->inproc_size < LISTENER_ACCEPT_BATCH ? l->inproc_size : LISTENER_ACCEPT_BATCH;
+    if (n == l->inproc_size)
+      read_uint64(ps->sockfd); /* Taking them all, leave the eventfd readable otherwise */
+    memcpy(l->accepted_fds, l->inproc_fds, n * sizeof(int));
+    memmove(l->inproc_fds, l->inproc_fds + n, (l->inproc_size - n) * sizeof(int));
+    l->inproc_size -= n;
+    l->accepted_size = n;
+    if (n == 0) {
+      rearm(ps->proactor, &ps->epoll_io);
+      l->armed = true;
+      l->accepted = NULL;
+    }
+    return;
+  }
+  while (l->accepted_size < LISTENER_ACCEPT_BATCH) {
+    int fd = accept(ps->sockfd, NULL, 0);
+    if (fd >= 0) {
+      l->accepted_fds[l->accepted_size++] = fd;
+      continue;
+    }
     int err = errno;
-    if (err == ENFILE || err == EMFILE) {
-      listener_set_overflow(l);
-    } else {
+    if (err == EINTR || err == ECONNABORTED) {
+      continue;
+    } else if (err == EAGAIN || err == EWOULDBLOCK) {
+      if (l->accepted_size == 0) {
+        /* Nothing left to accept, no pn_listener_accept() will trigger the rearm */
+        rearm(ps->proactor, &ps->epoll_io);
+        l->armed = true;
+        l->accepted = NULL;
+      }
+    } else if (err == ENFILE || err == EMFILE) {
+      if (l->accepted_size == 0) {
+        listener_shed_lh(l, ps);
+        listener_set_overflow(l);
+      }
+    } else if (l->accepted_size == 0) {
       psocket_error(ps, err, "accept");
     }
+    break;
   }
 }
 
@@ -1490,6 +2976,10 @@ static pn_event_batch_t *listener_process(psocket_t *ps, uint32_t events) {
 static pn_event_t *listener_batch_next(pn_event_batch_t *batch) {
   pn_listener_t *l = batch_listener(batch);
   lock(&l->context.mutex);
+  if (!pn_collector_peek(l->collector) && l->accepted_announced < l->accepted_size) {
+    l->accepted_announced++;
+    pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_ACCEPT);
+  }
   pn_event_t *e = pn_collector_next(l->collector);
   if (e && pn_event_type(e) == PN_LISTENER_CLOSE)
     l->close_dispatched = true;
@@ -1511,7 +3001,7 @@ static void listener_done(pn_listener_t *l) {
   } else if (listener_has_event(l)) {
     notify = wake(&l->context);
   } else if (l->overflow == NO_OVERFLOW &&
-             !l->context.closing && !l->armed && l->accepted_fd < 0 && l->accepted)
+             !l->context.closing && !l->armed && listener_accepted_empty(l) && l->accepted)
   {
     /* Don't rearm until the current socket is accepted */
     rearm(l->accepted->proactor, &l->accepted->epoll_io);
@@ -1526,6 +3016,30 @@ pn_proactor_t *pn_listener_proactor(pn_listener_t* l) {
   return l ? l->psockets[0].proactor : NULL;
 }
 
+size_t pn_listener_backlog(pn_listener_t *l) {
+  lock(&l->context.mutex);
+  size_t n = l->accepted_size - l->accepted_next;
+  unlock(&l->context.mutex);
+  return n;
+}
+
+/* Each listener binds its own socket and the kernel hashes incoming
+   connections over the sockets sharing the port.  EPOLLEXCLUSIVE is not
+   needed: it only helps several epoll sets polling one shared socket, and
+   cannot be combined with the EPOLLONESHOT rearming used here. */
+int pn_listener_set_reuseport(pn_listener_t *l, bool reuseport) {
+  l->reuseport = reuseport;
+  return 0;
+}
+
+int pn_listener_overflow(pn_listener_t *l, pn_listener_overflow_t *overflow) {
+  lock(&l->context.mutex);
+  overflow->overflows = l->overflows;
+  overflow->shed = l->shed;
+  unlock(&l->context.mutex);
+  return 0;
+}
+
 pn_condition_t* pn_listener_condition(pn_listener_t* l) {
   return l->condition;
 }
@@ -1546,19 +3060,24 @@ void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
   // TODO: fuller sanity check on input args
   pconnection_t *pc = new_pconnection_t(l->psockets[0].proactor, c, true, "");
   assert(pc);  // TODO: memory safety
+  if (pni_shm_path(l->psockets[0].host, l->psockets[0].port)) {
+    pc->shm = pni_shm();
+    assert(pc->shm);  // TODO: memory safety
+  }
 
   lock(&l->context.mutex);
-  int fd = l->accepted_fd;
-  l->accepted_fd = -1;
+  int fd = listener_accepted_empty(l) ? -1 : l->accepted_fds[l->accepted_next++];
   proactor_add(&pc->context);
 
   lock(&pc->context.mutex);
-  configure_socket(fd);
+  configure_socket(pc->psocket.proactor, fd);
   pc->psocket.sockfd = fd;
   pconnection_start(pc);
   unlock(&pc->context.mutex);
 
   unlock(&l->context.mutex);
+  // Hand the new connection over to the proactor threads
+  pconnection_release_notify(pc, false);
 }
 
 
@@ -1567,43 +3086,244 @@ void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
 // ========================================================================
 
 /* Set up an epoll_extended_t to be used for wakeup or interrupts */
-static void epoll_wake_init(epoll_extended_t *ee, int eventfd, int epollfd) {
+static void epoll_wake_init(epoll_extended_t *ee, int eventfd, int epollfd, bool edge) {
   ee->psocket = NULL;
   ee->fd = eventfd;
   ee->type = WAKE;
   ee->wanted = EPOLLIN;
   ee->polling = false;
+  ee->edge = edge;
   start_polling(ee, epollfd);  // TODO: check for error
 }
 
+
+static poller_t *thread_poller(pn_proactor_t *p) {
+  if (thread_home.proactor != p) {
+    thread_home.proactor = p;
+    if (p->nnodes) {
+      // Poller k belongs to node k % nnodes, stay on the node we started on
+      int node = pni_numa_node();
+      (void)pni_numa_bind(node);
+      int k = node % p->nnodes;
+      int count = (p->npollers - k + p->nnodes - 1) / p->nnodes;
+      int i = __sync_fetch_and_add(&p->next_node_poller[k], 1);
+      thread_home.poller = &p->pollers[k + p->nnodes * ((unsigned) i % count)];
+    } else {
+      int i = __sync_fetch_and_add(&p->next_poller, 1);
+      thread_home.poller = &p->pollers[(unsigned) i % p->npollers];
+    }
+  }
+  return thread_home.poller;
+}
+
+/* The epoll set for a connection started by the calling thread */
+static int thread_epollfd(pn_proactor_t *p) {
+  return p->npollers ? thread_poller(p)->epollfd : p->epollfd;
+}
+
+static int env_int(const char *name) {
+  const char *env = getenv(name);
+  return env ? atoi(env) : 0;
+}
+
+static bool pollers_init(pn_proactor_t *p) {
+  int n = env_int("PN_PROACTOR_POLLERS");
+  int nodes = env_int("PN_PROACTOR_NUMA") > 0 ? pni_numa_nodes() : 0;
+  if (nodes && n <= 0) n = nodes;
+  if (n > MAX_POLLERS) n = MAX_POLLERS;
+  p->nnodes = (nodes > 1 && n > 1) ? (nodes < n ? nodes : n) : 0;
+  for (int i = 0; i < MAX_POLLERS; i++)
+    p->pollers[i].epollfd = -1;
+  for (p->npollers = 0; p->npollers < n; p->npollers++) {
+    poller_t *pl = &p->pollers[p->npollers];
+    if ((pl->epollfd = epoll_create(1)) < 0)
+      return false;
+    pl->epoll_io.psocket = NULL;
+    pl->epoll_io.fd = pl->epollfd;
+    pl->epoll_io.type = POLLER;
+    pl->epoll_io.wanted = EPOLLIN;
+    pl->epoll_io.polling = false;
+    start_polling(&pl->epoll_io, p->epollfd);  // TODO: check for error
+  }
+  return true;
+}
+
+static void resolver_init(resolver_t *r) {
+  memset(r, 0, sizeof(*r));
+  pmutex_init(&r->mutex);
+  pthread_cond_init(&r->cond, NULL);
+  r->max_threads = RESOLVERS;
+  r->ttl = DNS_TTL;
+  r->negative_ttl = DNS_NEGATIVE_TTL;
+}
+
+// Wait for lookups in progress, connections still waiting are left unresolved.
+static void resolver_stop(resolver_t *r) {
+  lock(&r->mutex);
+  r->shutting_down = true;
+  pthread_cond_broadcast(&r->cond);
+  unlock(&r->mutex);
+  for (int i = 0; i < r->nthreads; i++)
+    pthread_join(r->threads[i], NULL);
+  r->nthreads = 0;
+}
+
+// Call after resolver_stop() once no connection is waiting
+static void resolver_finalize(resolver_t *r) {
+  while (r->cache) {
+    dns_entry_t *e = r->cache;
+    r->cache = e->next;
+    dns_entry_free(e);
+  }
+  pthread_cond_destroy(&r->cond);
+  pmutex_finalize(&r->mutex);
+}
+
+static void pollers_close(pn_proactor_t *p) {
+  for (int i = 0; i < MAX_POLLERS; i++) {
+    if (p->pollers[i].epollfd >= 0) close(p->pollers[i].epollfd);
+    p->pollers[i].epollfd = -1;
+  }
+}
+
+static bool wake_shards_init(pn_proactor_t *p) {
+  for (int i = 0; i < WAKE_SHARDS; i++) {
+    if ((p->wake_shards[i].eventfd = eventfd(0, EFD_NONBLOCK)) < 0)
+      return false;
+  }
+  return true;
+}
+
+static void wake_shards_close(pn_proactor_t *p) {
+  for (int i = 0; i < WAKE_SHARDS; i++) {
+    if (p->wake_shards[i].eventfd >= 0) close(p->wake_shards[i].eventfd);
+    p->wake_shards[i].eventfd = -1;
+  }
+}
+
+// The environment variable of each option, in pn_proactor_option_t order
+static const char *const option_env[] = {
+  "PN_PROACTOR_HOG_MAX", "PN_PROACTOR_BATCH_EVENTS", "PN_PROACTOR_TURN_BYTES",
+  "PN_PROACTOR_HANDSHAKE_MAX", "PN_PROACTOR_SO_RCVBUF", "PN_PROACTOR_SO_SNDBUF",
+  "PN_PROACTOR_TCP_NOTSENT_LOWAT", "PN_PROACTOR_BUSY_POLL", "PN_PROACTOR_EDGE",
+  "PN_PROACTOR_WRITE_MORE", "PN_PROACTOR_DISPOSITION_DELAY", "PN_PROACTOR_DISPOSITION_LIMIT",
+  "PN_PROACTOR_INTERLEAVE", "PN_PROACTOR_HIBERNATE", "PN_PROACTOR_LOCAL_WAKE",
+  "PN_PROACTOR_SPIN", "PN_PROACTOR_RESOLVERS", "PN_PROACTOR_DNS_TTL",
+  "PN_PROACTOR_DNS_NEGATIVE_TTL", "PN_PROACTOR_SHM_SIZE", "PN_PROACTOR_OVERFLOW_RETRY"
+};
+#define OPTIONS (int)(sizeof(option_env) / sizeof(option_env[0]))
+
+static int proactor_option(pn_proactor_t *p, pn_proactor_option_t option, int value) {
+  if (value < (option == PN_PROACTOR_DISPOSITION_LIMIT ? -1 : 0))
+    return PN_ARG_ERR;
+  switch (option) {
+   case PN_PROACTOR_HOG_MAX: p->hog_max = value; break;
+   case PN_PROACTOR_BATCH_EVENTS: p->batch_events = value; break;
+   case PN_PROACTOR_TURN_BYTES: p->turn_bytes = value; break;
+   case PN_PROACTOR_HANDSHAKE_MAX: p->handshake_max = value; break;
+   case PN_PROACTOR_SO_RCVBUF: p->so_rcvbuf = value; break;
+   case PN_PROACTOR_SO_SNDBUF: p->so_sndbuf = value; break;
+   case PN_PROACTOR_TCP_NOTSENT_LOWAT: p->notsent_lowat = value; break;
+   case PN_PROACTOR_BUSY_POLL: p->busy_poll = value; break;
+   case PN_PROACTOR_EDGE: p->edge = value > 0; break;
+   case PN_PROACTOR_WRITE_MORE: p->write_more = value > 0; break;
+   case PN_PROACTOR_DISPOSITION_DELAY: p->disp_delay = value; break;
+   case PN_PROACTOR_DISPOSITION_LIMIT: p->disp_limit = value; break;
+   case PN_PROACTOR_INTERLEAVE: p->interleave = value > 0; break;
+   case PN_PROACTOR_HIBERNATE: p->hibernate = value; break;
+   case PN_PROACTOR_LOCAL_WAKE:
+    p->local_wake = value > 0;
+    if (p->local_wake) pthread_once(&local_wake_once, local_wake_init);
+    break;
+   case PN_PROACTOR_SPIN: p->spin = (uint64_t) value * 1000; break;
+   case PN_PROACTOR_RESOLVERS: p->resolver.max_threads = value < RESOLVER_MAX ? value : RESOLVER_MAX; break;
+   case PN_PROACTOR_DNS_TTL: p->resolver.ttl = value; break;
+   case PN_PROACTOR_DNS_NEGATIVE_TTL: p->resolver.negative_ttl = value; break;
+   case PN_PROACTOR_SHM_SIZE:
+    if (!value) return PN_ARG_ERR;
+    p->shm_size = value;
+    break;
+   case PN_PROACTOR_OVERFLOW_RETRY:
+    if (!value) return PN_ARG_ERR;
+    p->overflow_retry = value;
+    break;
+   default:
+    return PN_ARG_ERR;
+  }
+  return 0;
+}
+
+int pn_proactor_set_option(pn_proactor_t *p, pn_proactor_option_t option, int value) {
+  if ((int) option < 0 || (int) option >= OPTIONS)
+    return PN_ARG_ERR;
+  if (getenv(option_env[option]))
+    return 0;                   // The environment overrides the application
+  return proactor_option(p, option, value);
+}
+
 pn_proactor_t *pn_proactor() {
   pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(*p));
   if (!p) return NULL;
-  p->epollfd = p->eventfd = p->timer.timerfd = -1;
+  if (pni_proactor_stats_enabled() && !(p->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*p->stats)))) {
+    free(p);
+    return NULL;
+  }
+  p->epollfd = p->interruptfd = p->timer.timerfd = -1;
+  for (int i = 0; i < WAKE_SHARDS; i++) {
+    p->wake_shards[i].eventfd = -1;
+    pmutex_init(&p->wake_shards[i].mutex);
+  }
   pcontext_init(&p->context, PROACTOR, p, p);
-  pmutex_init(&p->eventfd_mutex);
-  ptimer_init(&p->timer, 0);
-
-  if ((p->epollfd = epoll_create(1)) >= 0) {
-    if ((p->eventfd = eventfd(0, EFD_NONBLOCK)) >= 0) {
+  pmutex_init(&p->handshake_mutex);
+  pmutex_init(&p->edges.mutex);
+  resolver_init(&p->resolver);
+  p->hog_max = HOG_MAX;
+  p->disp_limit = -1;
+  p->shm_size = SHM_SIZE;
+  p->overflow_retry = OVERFLOW_RETRY_MS;
+  for (int i = 0; i < OPTIONS; i++) {
+    if (getenv(option_env[i]))  // Out of range values leave the default
+      proactor_option(p, (pn_proactor_option_t) i, env_int(option_env[i]));
+  }
+  p->reserve_fd = -1;
+  if (!getenv("PN_PROACTOR_FD_RESERVE") || env_int("PN_PROACTOR_FD_RESERVE") > 0)
+    proactor_reserve(p);
+  ptimer_init(&p->timer, PROACTOR_TIMER);
+  twheel_init(&p->timers);
+
+  if ((p->epollfd = epoll_create(1)) >= 0 && pollers_init(p)) {
+    if (wake_shards_init(p)) {
       if ((p->interruptfd = eventfd(0, EFD_NONBLOCK)) >= 0) {
-        if (p->timer.timerfd >= 0)
+        if (p->timer.timerfd >= 0 && p->timers.timer.timerfd >= 0)
           if ((p->collector = pn_collector()) != NULL) {
             p->batch.next_event = &proactor_batch_next;
             start_polling(&p->timer.epoll_io, p->epollfd);  // TODO: check for error
             p->timer_armed = true;
-            epoll_wake_init(&p->epoll_wake, p->eventfd, p->epollfd);
-            epoll_wake_init(&p->epoll_interrupt, p->interruptfd, p->epollfd);
+            start_polling(&p->timers.timer.epoll_io, p->epollfd);  // TODO: check for error
+            for (int i = 0; i < WAKE_SHARDS; i++)
+              epoll_wake_init(&p->wake_shards[i].epoll_wake, p->wake_shards[i].eventfd, p->epollfd, p->edge);
+            epoll_wake_init(&p->epoll_interrupt, p->interruptfd, p->epollfd, false);
             return p;
           }
       }
     }
   }
   if (p->epollfd >= 0) close(p->epollfd);
-  if (p->eventfd >= 0) close(p->eventfd);
-  if (p->interruptfd >= 0) close(p->eventfd);
+  pollers_close(p);
+  wake_shards_close(p);
+  if (p->interruptfd >= 0) close(p->interruptfd);
+  if (p->reserve_fd >= 0) close(p->reserve_fd);
   ptimer_finalize(&p->timer);
+  twheel_finalize(&p->timers);
   if (p->collector) pn_free(p->collector);
+  resolver_stop(&p->resolver);
+  resolver_finalize(&p->resolver);
+  for (int i = 0; i < WAKE_SHARDS; i++)
+    pmutex_finalize(&p->wake_shards[i].mutex);
+  pmutex_finalize(&p->handshake_mutex);
+  edge_table_finalize(&p->edges);
+  pcontext_finalize(&p->context);
+  free(p->stats);
   free (p);
   return NULL;
 }
@@ -1611,13 +3331,33 @@ pn_proactor_t *pn_proactor() {
 void pn_proactor_free(pn_proactor_t *p) {
   //  No competing threads, not even a pending timer
   p->shutting_down = true;
+  (void)local_wake_take(p);
+  resolver_stop(&p->resolver);
   close(p->epollfd);
   p->epollfd = -1;
-  close(p->eventfd);
-  p->eventfd = -1;
+  pollers_close(p);
+  wake_shards_close(p);
   close(p->interruptfd);
   p->interruptfd = -1;
+  if (p->reserve_fd >= 0) close(p->reserve_fd);
   ptimer_finalize(&p->timer);
+  // Contexts no thread took for pn_proactor_disconnect_async() are shut down with the rest
+  while (p->disconnect_jobs) {
+    disconnect_job_t *job = p->disconnect_jobs;
+    p->disconnect_jobs = job->next;
+    while (job->contexts) {
+      pcontext_t *ctx = job->contexts;
+      job->contexts = ctx->next;
+      ctx->disconnecting = false;
+      --p->disconnects_pending;
+      ctx->prev = NULL;
+      ctx->next = p->contexts;
+      if (p->contexts) p->contexts->prev = ctx;
+      p->contexts = ctx;
+    }
+    pn_condition_free(job->condition);
+    free(job);
+  }
   while (p->contexts) {
     pcontext_t *ctx = p->contexts;
     p->contexts = ctx->next;
@@ -1633,9 +3373,15 @@ void pn_proactor_free(pn_proactor_t *p) {
     }
   }
 
+  twheel_finalize(&p->timers);
+  resolver_finalize(&p->resolver);
   pn_collector_free(p->collector);
-  pmutex_finalize(&p->eventfd_mutex);
+  for (int i = 0; i < WAKE_SHARDS; i++)
+    pmutex_finalize(&p->wake_shards[i].mutex);
+  pmutex_finalize(&p->handshake_mutex);
+  edge_table_finalize(&p->edges);
   pcontext_finalize(&p->context);
+  free(p->stats);
   free(p);
 }
 
@@ -1761,19 +3507,35 @@ static bool proactor_remove(pcontext_t *ctx) {
   return can_free;
 }
 
+static pn_event_batch_t *process_wake(pn_proactor_t *p, pcontext_t *ctx, uint64_t wake_time);
+static void disconnect_share(pn_proactor_t *p);
+
 static pn_event_batch_t *process_inbound_wake(pn_proactor_t *p, epoll_extended_t *ee) {
   if  (ee->fd == p->interruptfd) {        /* Interrupts have their own dedicated eventfd */
     (void)read_uint64(p->interruptfd);
     rearm(p, &p->epoll_interrupt);
     return proactor_process(p, PN_PROACTOR_INTERRUPT);
   }
-  pcontext_t *ctx = wake_pop_front(p);
+  wake_shard_t *ws = (wake_shard_t *) ((char *) ee - offsetof(wake_shard_t, epoll_wake));
+  uint64_t wake_time = 0;
+  pcontext_t *ctx = wake_pop_front(p, ws, &wake_time, true);
+  return process_wake(p, ctx, wake_time);
+}
+
+static pn_event_batch_t *process_wake(pn_proactor_t *p, pcontext_t *ctx, uint64_t wake_time) {
   if (ctx) {
     switch (ctx->type) {
-     case PROACTOR:
-      return proactor_process(p, PN_EVENT_NONE);
-     case PCONNECTION:
-      return pconnection_process((pconnection_t *) ctx->owner, 0, false, false);
+     case PROACTOR: {
+       pn_event_batch_t *batch = proactor_process(p, PN_EVENT_NONE);
+       disconnect_share(p);
+       return batch;
+     }
+     case PCONNECTION: {
+       pconnection_t *pc = (pconnection_t *) ctx->owner;
+       if (pc->stats && wake_time)
+         PCONNECTION_STAT(pc, wake, pni_proactor_stats_now() - wake_time);
+       return pconnection_process(pc, 0, false);
+     }
      case LISTENER:
       return listener_process(&((pn_listener_t *) ctx->owner)->psockets[0], 0);
      default:
@@ -1783,12 +3545,59 @@ static pn_event_batch_t *process_inbound_wake(pn_proactor_t *p, epoll_extended_t
   return NULL;
 }
 
+// Note the start of a connection batch for pn_proactor_stats(), ready is
+// when epoll reported the socket event that produced it or 0.
+static void stats_batch_start(pn_event_batch_t *batch, uint64_t ready) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc && pc->stats) {
+    pc->batch_start = pni_proactor_stats_now();
+    if (ready)
+      PCONNECTION_STAT(pc, dispatch, pc->batch_start - ready);
+  }
+}
+
+// Post an edge-triggered event to its connection, see edge_table_t
+static pn_event_batch_t *edge_process(pn_proactor_t *p, uint64_t data, uint32_t events) {
+  edge_slot_t *s = edge_slot(&p->edges, data);
+  __atomic_fetch_add(&s->holders, 1, __ATOMIC_SEQ_CST);
+  pconnection_t *pc = __atomic_load_n(&s->pc, __ATOMIC_SEQ_CST);
+  bool acquired = false;
+  if (pc && __atomic_load_n(&s->gen, __ATOMIC_RELAXED) == (uint32_t) (data >> 32)) {
+    __atomic_fetch_or(&pc->new_events, events, __ATOMIC_RELEASE);
+    acquired = pconnection_acquire(pc, PCS_IO, 0);
+  }
+  // Cleanup needs the working thread, so pc stays valid while we are working
+  __atomic_fetch_sub(&s->holders, 1, __ATOMIC_SEQ_CST);
+  return acquired ? pconnection_turn(pc, false) : NULL;
+}
+
 static pn_event_batch_t *proactor_do_epoll(struct pn_proactor_t* p, bool can_block) {
   int timeout = can_block ? -1 : 0;
+  for (pconnection_t *pc = local_wake_take(p); pc; pc = local_wake_take(p)) {
+    pn_event_batch_t *batch = pconnection_process(pc, 0, false);
+    if (batch) {
+      if (p->stats)
+        stats_batch_start(batch, 0);
+      thread_home.batching = p;
+      return batch;
+    }
+  }
   while(true) {
     pn_event_batch_t *batch = NULL;
     struct epoll_event ev;
-    int n = epoll_wait(p->epollfd, &ev, 1, timeout);
+    int n;
+    if (p->npollers && epoll_wait(thread_poller(p)->epollfd, &ev, 1, 0) == 1) {
+      n = 1;                    /* Work pinned to this thread comes first */
+    } else {
+      n = epoll_wait(p->epollfd, &ev, 1, timeout);
+      if (n == 1 && !(ev.data.u64 & EDGE_TAG) && ((epoll_extended_t *) ev.data.ptr)->type == POLLER) {
+        /* Take one event from a poller with work, then let others see the rest */
+        poller_t *pl = (poller_t *) ((char *) ev.data.ptr - offsetof(poller_t, epoll_io));
+        n = epoll_wait(pl->epollfd, &ev, 1, 0);
+        rearm(p, &pl->epoll_io);
+        if (n != 1) continue;
+      }
+    }
 
     if (n < 0) {
       if (errno != EINTR)
@@ -1806,21 +3615,26 @@ static pn_event_batch_t *proactor_do_epoll(struct pn_proactor_t* p, bool can_blo
       }
     }
     assert(n == 1);
-    epoll_extended_t *ee = (epoll_extended_t *) ev.data.ptr;
-
-    if (ee->type == WAKE) {
+    epoll_extended_t *ee = (ev.data.u64 & EDGE_TAG) ? NULL : (epoll_extended_t *) ev.data.ptr;
+    uint64_t ready = 0;
+
+    if (!ee) {
+      if (p->stats)
+        ready = pni_proactor_stats_now();
+      batch = edge_process(p, ev.data.u64, ev.events);
+    } else if (ee->type == WAKE) {
       batch = process_inbound_wake(p, ee);
     } else if (ee->type == PROACTOR_TIMER) {
       batch = proactor_process(p, PN_PROACTOR_TIMEOUT);
+    } else if (ee->type == PCONNECTION_TIMER) {
+      twheel_process(p);
     } else {
       pconnection_t *pc = psocket_pconnection(ee->psocket);
       if (pc) {
-        if (ee->type == PCONNECTION_IO) {
-          batch = pconnection_process(pc, ev.events, false, false);
-        } else {
-          assert(ee->type == PCONNECTION_TIMER);
-          batch = pconnection_process(pc, 0, true, false);
-        }
+        assert(ee->type == PCONNECTION_IO);
+        if (p->stats)
+          ready = pni_proactor_stats_now();
+        batch = pconnection_process(pc, ev.events, false);
       }
       else {
         // TODO: can any of the listener processing be parallelized like IOCP?
@@ -1828,12 +3642,66 @@ static pn_event_batch_t *proactor_do_epoll(struct pn_proactor_t* p, bool can_blo
       }
     }
 
-    if (batch) return batch;
+    if (batch) {
+      if (p->stats)
+        stats_batch_start(batch, ready);
+      thread_home.batching = p;
+      return batch;
+    }
     // No Proton event generated.  epoll_wait() again.
   }
 }
 
+// Take one wake from each shard notified to spinning threads, see wake_notify()
+static pn_event_batch_t *spin_wakes(pn_proactor_t *p) {
+  for (int i = 0; i < WAKE_SHARDS; ++i) {
+    wake_shard_t *ws = &p->wake_shards[i];
+    if (__atomic_load_n(&ws->spin_notified, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&ws->spin_notified, false, __ATOMIC_SEQ_CST)) {
+      uint64_t wake_time = 0;
+      pcontext_t *ctx = wake_pop_front(p, ws, &wake_time, false);
+      lock(&ws->mutex);
+      bool more = ws->wakes_in_progress;
+      unlock(&ws->mutex);
+      if (more) wake_shard_notify(p, ws);  // The rest of the list needs its own
+      pn_event_batch_t *batch = process_wake(p, ctx, wake_time);
+      if (batch) {
+        if (p->stats)
+          stats_batch_start(batch, 0);
+        return batch;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Poll for work without blocking for up to p->spin, see PN_PROACTOR_SPIN
+static pn_event_batch_t *proactor_spin(pn_proactor_t *p) {
+  pn_event_batch_t *batch = NULL;
+  uint64_t deadline = pni_proactor_stats_now() + p->spin;
+  __atomic_fetch_add(&p->spinners, 1, __ATOMIC_SEQ_CST);
+  do {
+    batch = spin_wakes(p);
+    if (!batch) batch = proactor_do_epoll(p, false);
+  } while (!batch && pni_proactor_stats_now() < deadline);
+  __atomic_fetch_sub(&p->spinners, 1, __ATOMIC_SEQ_CST);
+
+  // Wakers that saw us spinning left a flag instead of writing the eventfd
+  if (!batch) batch = spin_wakes(p);
+  for (int i = 0; i < WAKE_SHARDS; ++i) {
+    wake_shard_t *ws = &p->wake_shards[i];
+    if (__atomic_exchange_n(&ws->spin_notified, false, __ATOMIC_SEQ_CST))
+      wake_shard_notify(p, ws);  // Other spinners, or the eventfd
+  }
+  if (batch) thread_home.batching = p;
+  return batch;
+}
+
 pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  if (p->spin) {
+    pn_event_batch_t *batch = proactor_spin(p);
+    if (batch) return batch;
+  }
   return proactor_do_epoll(p, true);
 }
 
@@ -1844,9 +3712,15 @@ pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
 void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
   pconnection_t *pc = batch_pconnection(batch);
   if (pc) {
+    if (pc->batch_start) {
+      PCONNECTION_STAT(pc, batch, pni_proactor_stats_now() - pc->batch_start);
+      pc->batch_start = 0;
+    }
     pconnection_done(pc);
+    thread_home.batching = NULL;
     return;
   }
+  thread_home.batching = NULL;
   pn_listener_t *l = batch_listener(batch);
   if (l) {
     listener_done(l);
@@ -1860,7 +3734,7 @@ void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
     p->timer_armed = true;
     p->context.working = false;
     proactor_update_batch(p);
-    if (proactor_has_event(p))
+    if (proactor_has_event(p) || p->disconnect_jobs)
       notify = wake(&p->context);
     unlock(&p->context.mutex);
     if (notify)
@@ -1909,26 +3783,38 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->psocket.proactor : NULL;
 }
 
-void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
-  lock(&p->context.mutex);
-  // Move the whole contexts list into a disconnecting state
+int pn_proactor_stats(pn_proactor_t *p, pn_proactor_stats_t *stats) {
+  if (!p->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, p->stats);
+  return 0;
+}
+
+int pn_connection_proactor_stats(pn_connection_t *c, pn_proactor_stats_t *stats) {
+  pconnection_t *pc = get_pconnection(c);
+  if (!pc || !pc->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, pc->stats);
+  return 0;
+}
+
+// Take the whole contexts list into a disconnecting state.  Call with the proactor lock held.
+static pcontext_t *disconnect_snapshot_lh(pn_proactor_t *p) {
   pcontext_t *disconnecting_pcontexts = p->contexts;
   p->contexts = NULL;
-  // First pass: mark each pcontext as disconnecting and update global pending count.
-  pcontext_t *ctx = disconnecting_pcontexts;
-  while (ctx) {
+  // Mark each pcontext as disconnecting and update global pending count.
+  for (pcontext_t *ctx = disconnecting_pcontexts; ctx; ctx = ctx->next) {
     ctx->disconnecting = true;
-    ctx->disconnect_ops = 2;   // Second pass below and proactor_remove(), in any order.
+    ctx->disconnect_ops = 2;   // disconnect_contexts() and proactor_remove(), in any order.
     p->disconnects_pending++;
-    ctx = ctx->next;
   }
-  unlock(&p->context.mutex);
-  if (!disconnecting_pcontexts)
-    return;
+  return disconnecting_pcontexts;
+}
 
-  // Second pass: different locking, close the pcontexts, free them if !disconnect_ops
+// Close a list of contexts from disconnect_snapshot_lh(), free them if !disconnect_ops
+static void disconnect_contexts(pn_proactor_t *p, pcontext_t *list, pn_condition_t *cond) {
   bool notify = false;
-  for (ctx = disconnecting_pcontexts; ctx; ctx = ctx ? ctx->next : NULL) {
+  pcontext_t *next;
+  for (pcontext_t *ctx = list; ctx; ctx = next) {
+    next = ctx->next;
     bool do_free = false;
     bool ctx_notify = true;
     pmutex *ctx_mutex = NULL;
@@ -1936,22 +3822,13 @@ void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
     if (pc) {
       ctx_mutex = &pc->context.mutex;
       lock(ctx_mutex);
-      if (!ctx->closing) {
-        if (ctx->working) {
-          // Must defer
-          pc->queued_disconnect = true;
-          if (cond) {
-            if (!pc->disconnect_condition)
-              pc->disconnect_condition = pn_condition();
-            pn_condition_copy(pc->disconnect_condition, cond);
-          }
-        }
-        else {
-          // No conflicting working context.
-          if (cond) {
-            pn_condition_copy(pn_transport_condition(pc->driver.transport), cond);
-          }
-          pn_connection_driver_close(&pc->driver);
+      if (!(pcs_load(pc) & PCS_CLOSING)) {
+        // Always deferred to the working thread, see PCS_DISCONNECT
+        pc->queued_disconnect = true;
+        if (cond) {
+          if (!pc->disconnect_condition)
+            pc->disconnect_condition = pn_condition();
+          pn_condition_copy(pc->disconnect_condition, cond);
         }
       }
     } else {
@@ -1971,11 +3848,11 @@ void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
     if (--ctx->disconnect_ops == 0) {
       do_free = true;
       ctx_notify = false;
-      notify = wake_if_inactive(p);
+      notify = wake_if_inactive(p) || notify;
     } else {
       // If initiating the close, wake the pcontext to do the free.
       if (ctx_notify)
-        ctx_notify = wake(ctx);
+        ctx_notify = pc ? pconnection_post(pc, PCS_DISCONNECT) : wake(ctx);
     }
     unlock(&p->context.mutex);
     unlock(ctx_mutex);
@@ -1992,6 +3869,76 @@ void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
     wake_notify(&p->context);
 }
 
+void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
+  lock(&p->context.mutex);
+  pcontext_t *list = disconnect_snapshot_lh(p);
+  unlock(&p->context.mutex);
+  disconnect_contexts(p, list, cond);
+}
+
+void pn_proactor_disconnect_async(pn_proactor_t *p, pn_condition_t *cond) {
+  disconnect_job_t *job = (disconnect_job_t *) calloc(1, sizeof(*job));
+  if (job && cond) {
+    job->condition = pn_condition();
+    pn_condition_copy(job->condition, cond);
+  }
+  lock(&p->context.mutex);
+  pcontext_t *list = disconnect_snapshot_lh(p);
+  bool notify = false;
+  if (list && job) {
+    job->contexts = list;
+    if (p->disconnect_jobs_last)
+      p->disconnect_jobs_last->next = job;
+    else
+      p->disconnect_jobs = job;
+    p->disconnect_jobs_last = job;
+    notify = wake(&p->context);
+    job = NULL;
+  }
+  unlock(&p->context.mutex);
+  if (notify)
+    wake_notify(&p->context);
+  if (job) {
+    if (list) disconnect_contexts(p, list, cond); // No memory for the job, do it here
+    pn_condition_free(job->condition);
+    free(job);
+  }
+}
+
+// Close a chunk of the oldest pn_proactor_disconnect_async() call, if any
+static void disconnect_share(pn_proactor_t *p) {
+  lock(&p->context.mutex);
+  disconnect_job_t *job = p->disconnect_jobs;
+  if (!job) {
+    unlock(&p->context.mutex);
+    return;
+  }
+  pcontext_t *chunk = job->contexts, *last = chunk;
+  for (int i = 1; i < DISCONNECT_CHUNK && last->next; ++i)
+    last = last->next;
+  job->contexts = last->next;
+  last->next = NULL;
+  ++job->working;
+  if (!job->contexts) {         // All taken, the last chunk to finish frees it
+    p->disconnect_jobs = job->next;
+    if (!p->disconnect_jobs) p->disconnect_jobs_last = NULL;
+  }
+  bool notify = p->disconnect_jobs && wake(&p->context);
+  unlock(&p->context.mutex);
+  if (notify)
+    wake_notify(&p->context);
+
+  disconnect_contexts(p, chunk, job->condition);
+
+  lock(&p->context.mutex);
+  bool done = (--job->working == 0 && !job->contexts);
+  unlock(&p->context.mutex);
+  if (done) {
+    pn_condition_free(job->condition);
+    free(job);
+  }
+}
+
 const struct sockaddr *pn_netaddr_sockaddr(const pn_netaddr_t *na) {
   return (struct sockaddr*)na;
 }
@@ -2019,6 +3966,8 @@ const pn_netaddr_t *pn_netaddr_remote(pn_transport_t *t) {
 #endif
 
 int pn_netaddr_str(const pn_netaddr_t* na, char *buf, size_t len) {
+  int n = pni_unix_addr_str(&na->ss, buf, len);
+  if (n >= 0) return n;
   char host[NI_MAXHOST];
   char port[NI_MAXSERV];
   int err = getnameinfo((struct sockaddr *)&na->ss, sizeof(na->ss),
@@ -0,0 +1,1877 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* Enable POSIX features beyond c99 for modern pthread and standard strerror_r() */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+/* There are no libc wrappers for the io_uring system calls, we need syscall() */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+/* Avoid GNU extensions, in particular the incompatible alternative strerror_r() */
+#undef _GNU_SOURCE
+
+#include "../core/log_private.h"
+#include "./proactor-internal.h"
+
+#include <proton/condition.h>
+#include <proton/connection_driver.h>
+#include <proton/engine.h>
+#include <proton/listener.h>
+#include <proton/netaddr.h>
+#include <proton/object.h>
+#include <proton/proactor.h>
+#include <proton/transport.h>
+
+/* All asserts are cheap and should remain in a release build for debugability */
+#undef NDEBUG
+#include <assert.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+  io_uring proactor, using the same "leader-worker-follower" model as the libuv proactor:
+
+  - At most one thread at a time is the "leader". Only the leader touches the ring: it
+  queues requests, reaps completions and blocks in io_uring_enter() when there is
+  nothing else to do, then becomes a "worker".
+
+  - Concurrent "worker" threads process events for separate connections or listeners.
+  When they run out of work they become "followers".
+
+  - A "follower" is idle, waiting for work. When the leader becomes a worker, one follower
+  takes over as the new leader.
+
+  Sockets are never polled for readiness. Each connection has a multishot recv that
+  picks buffers from a ring of receive buffers registered with the kernel, so a single
+  request delivers data for the life of the connection. Listening sockets use multishot
+  accept. Connects, sends and timers are one-shot requests.
+
+  Received buffers are queued on the connection and copied into the transport by the
+  leader, so the recv stays armed while a worker owns the connection. Sends go straight
+  from the transport's output buffer, so like the libuv proactor a connection with a
+  send in flight stays with the leader until the send completes.
+
+  Needs Linux 6.0 or later for multishot recv.
+
+  Function naming:
+  - on_*() - completion handlers, called in the leader thread.
+  - leader_* - only called in the leader thread
+  - *_lh - called with the relevant lock held
+*/
+
+#define RING_ENTRIES 256          /* Submission queue size, the completion queue is 4 times bigger */
+#define RECV_BUFFERS 256          /* Registered receive buffers, must be a power of 2 */
+#define RECV_BUFFER_SIZE 8192
+#define RECV_GROUP 0              /* Buffer group ID of the receive buffers */
+#define RECV_QUEUE_MAX 16         /* Buffers a connection can hold before its recv is paused */
+
+static const pn_handle_t PN_PROACTOR = PN_RECORD_SLOT(1);
+
+/* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
+   CLASSDEF is for identification when used as a pn_event_t context.
+*/
+PN_STRUCT_CLASSDEF(pn_proactor, CID_pn_proactor)
+PN_STRUCT_CLASSDEF(pn_listener, CID_pn_listener)
+
+typedef char strerrorbuf[1024];      /* used for pstrerror message buffer */
+
+/* Like strerror_r but provide a default message if strerror_r fails */
+static void pstrerror(int err, strerrorbuf msg) {
+  int e = strerror_r(err, msg, sizeof(strerrorbuf));
+  if (e) snprintf(msg, sizeof(strerrorbuf), "unknown error %d", err);
+}
+
+/* ================ Queues ================ */
+static int unqueued;            /* Provide invalid address for _unqueued pointers */
+
+#define QUEUE_DECL(T)                                                   \
+  typedef struct T##_queue_t { T##_t *front, *back; } T##_queue_t;      \
+                                                                        \
+  static T##_t *T##_unqueued = (T##_t*)&unqueued;                       \
+                                                                        \
+  static void T##_push(T##_queue_t *q, T##_t *x) {                      \
+    assert(x->next == T##_unqueued);                                    \
+    x->next = NULL;                                                     \
+    if (!q->front) {                                                    \
+      q->front = q->back = x;                                           \
+    } else {                                                            \
+      q->back->next = x;                                                \
+      q->back =  x;                                                     \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static T##_t* T##_pop(T##_queue_t *q) {                               \
+    T##_t *x = q->front;                                                \
+    if (x) {                                                            \
+      q->front = x->next;                                               \
+      x->next = T##_unqueued;                                           \
+    }                                                                   \
+    return x;                                                           \
+  }
+
+typedef enum { T_CONNECTION, T_LISTENER } struct_type;
+
+/* A stream of serialized work for the proactor */
+typedef struct work_t {
+  /* Immutable */
+  struct_type type;
+  pn_proactor_t *proactor;
+
+  /* Protected by proactor.lock */
+  struct work_t *next;
+  struct work_t *all_prev, *all_next; /* Every started work item, for disconnect and free */
+  bool working;                      /* Owned by a worker thread */
+  bool disconnect;                   /* pn_proactor_disconnect() not yet applied */
+} work_t;
+
+QUEUE_DECL(work)
+
+static void work_init(work_t* w, pn_proactor_t* p, struct_type type) {
+  w->proactor = p;
+  w->next = work_unqueued;
+  w->all_prev = w->all_next = NULL;
+  w->type = type;
+  w->working = true;
+  w->disconnect = false;
+}
+
+/* ================ IO ================ */
+
+typedef enum {
+  OP_NOTIFY, OP_INTERRUPT, OP_TIMEOUT,  /* Proactor */
+  OP_CONNECT, OP_RECV, OP_SEND, OP_TICK, /* Connection */
+  OP_ACCEPT                             /* Listening socket */
+} op_type;
+
+/* The user_data of a request is the address of its op_t, 0 for requests without a handler */
+typedef struct op_t {
+  op_type type;
+  void *owner;
+} op_t;
+
+/* A timeout request, moved earlier or re-armed as the deadline changes */
+typedef struct utimer_t {
+  op_t op;
+  uint64_t armed;               /* Deadline of the request in flight, 0 if none */
+  struct __kernel_timespec ts;
+} utimer_t;
+
+typedef enum { W_NONE, W_PENDING, W_CLOSED } wake_state;
+
+struct pn_netaddr_t {
+  struct sockaddr_storage ss;
+};
+
+/* An incoming or outgoing connection. */
+typedef struct pconnection_t {
+  work_t work;                  /* Must be first to allow casting */
+
+  /* Only used by owner thread */
+  pn_connection_driver_t driver;
+  bool released;                /* pn_proactor_release_connection() was called */
+
+  /* Only used by leader, or before the connection is started */
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  struct addrinfo *addrinfo;    /* Outgoing connection addresses */
+  struct addrinfo *ai;          /* Next address to try */
+  int connected;      /* 0: not connected, 1: connected or no more addresses to try */
+  int connect_err;    /* First connect error, reported if all addresses fail */
+  int fd;
+  op_t connect_op, recv_op, send_op;
+  utimer_t timer;
+  int inflight;                 /* Requests with completions still to come */
+  bool receiving;               /* Multishot recv in flight */
+  bool recv_cancelled;          /* Recv cancelled because too many buffers are queued */
+  bool recv_closed;             /* Recv reported end of stream */
+  int recv_err;
+  bool starved;                 /* Recv stopped for lack of buffers */
+  struct pconnection_t *starved_next;
+  int queue_head, queue_tail;   /* Received buffers not yet given to the transport */
+  size_t queue_len, queue_offset;
+  size_t writing;               /* Size of the send in flight, 0 if none */
+  bool shutdown;                /* Socket shut down for writing */
+  bool closing;                 /* Requests are being cancelled before the final free */
+
+  struct pn_netaddr_t local, remote; /* Actual addresses */
+
+  /* Locked for thread-safe access */
+  pthread_mutex_t lock;
+  wake_state wake;
+
+  /* Latency statistics, NULL unless the proactor keeps them */
+  pn_proactor_stats_t *stats;
+  uint64_t ready_time;          /* Leader: data received, not yet dispatched */
+  uint64_t queue_time;          /* proactor.lock: pushed on worker_q */
+  uint64_t batch_start;         /* Owner thread: batch returned */
+  uint64_t flush_start;         /* Leader: first send of pending output started */
+} pconnection_t;
+
+/* Record a duration for a connection and its proactor, call only if pc->stats */
+#define PCONNECTION_STAT(PC, FIELD, NS) do {                            \
+    uint64_t ns_ = (NS);                                                \
+    pni_histogram_record(&(PC)->stats->FIELD, ns_);                     \
+    pni_histogram_record(&(PC)->work.proactor->stats->FIELD, ns_);      \
+  } while (0)
+
+/* A single listening socket, a listener can have more than one */
+typedef struct lsocket_t {
+  op_t accept_op;
+  pn_listener_t *parent;
+  int fd;
+  bool accepting;               /* Multishot accept in flight */
+  int err;                      /* Accept error, applied by the leader */
+} lsocket_t;
+
+typedef enum {
+  L_LISTENING,                  /**<< Listening */
+  L_CLOSE,                      /**<< Close requested  */
+  L_CLOSING,                    /**<< Accepts are being cancelled */
+  L_CLOSED                      /**<< PN_LISTENER_CLOSE sent, free once it is processed */
+} listener_state;
+
+/* A listener */
+struct pn_listener_t {
+  work_t work;                  /* Must be first to allow casting */
+
+  /* Only used by owner thread */
+  pn_event_batch_t batch;
+  pn_record_t *attachments;
+  void *context;
+
+  /* Used by the owner thread, or the leader while no thread owns the listener */
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  lsocket_t *lsockets;
+  size_t lsockets_size;
+  pn_condition_t *condition;
+  pn_collector_t *collector;
+  bool reuseport;               /* Share the port with other listeners, SO_REUSEPORT */
+
+  /* Locked for thread-safe access */
+  pthread_mutex_t lock;
+  int *accepted;                /* Accepted fds waiting for pn_listener_accept() */
+  size_t accepted_next;         /* Next of accepted for pn_listener_accept() */
+  size_t accepted_announced;    /* Accepted fds with a PN_LISTENER_ACCEPT event */
+  size_t accepted_size, accepted_capacity;
+  listener_state state;
+};
+
+typedef enum { TM_NONE, TM_REQUEST, TM_PENDING, TM_FIRED } timeout_state_t;
+
+struct pn_proactor_t {
+  /* Only used by leader */
+  int ring_fd;
+  void *ring;                   /* Submission and completion rings, one mapping */
+  size_t ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+  unsigned sq_entries;
+  unsigned sq_next;             /* Tail including requests not yet submitted */
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  size_t inflight;              /* Requests with completions still to come */
+
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  char *buffers;
+  uint16_t buf_tail;
+  uint32_t buf_len[RECV_BUFFERS];  /* Bytes received in each buffer */
+  int buf_next[RECV_BUFFERS];      /* Connection receive queue links */
+  pconnection_t *starved;          /* Connections waiting for receive buffers */
+
+  int notify_fd, interrupt_fd;
+  op_t notify_op, interrupt_op;
+  uint64_t notify_count, interrupt_count;
+  utimer_t timer;
+  bool freeing;
+
+  /* Owner thread: proactor collector and batch can belong to leader or a worker */
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+
+  /* Protected by lock */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  work_queue_t worker_q; /* ready for work, to be returned via pn_proactor_wait()  */
+  work_queue_t leader_q; /* waiting for attention by the leader thread */
+  work_t *all;           /* every started connection and listener */
+  timeout_state_t timeout_state;
+  uint64_t timeout_deadline;
+  size_t active;         /* connection/listener count for INACTIVE events */
+  size_t interrupts;     /* PN_PROACTOR_INTERRUPT events to deliver */
+  pn_condition_t *disconnect_cond; /* disconnect condition */
+
+  bool has_leader;             /* A thread is working as leader */
+  bool leader_waiting;         /* The leader is, or is about to be, blocked in the ring */
+  bool batch_working;          /* batch is being processed in a worker thread */
+  bool need_inactive;          /* need INACTIVE event */
+
+  pn_proactor_stats_t *stats;  /* NULL unless PN_PROACTOR_STATS is set */
+};
+
+/* ================ Ring ================ */
+
+static inline int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int ring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Return a receive buffer to the kernel */
+static void leader_recycle(pn_proactor_t *p, int bid);
+
+static bool ring_init(pn_proactor_t *p) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = 4 * RING_ENTRIES;
+  p->ring_fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+  if (p->ring_fd < 0) return false;
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+    return false;
+
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  p->ring_size = sq_size > cq_size ? sq_size : cq_size;
+  p->ring = mmap(NULL, p->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, p->ring_fd, IORING_OFF_SQ_RING);
+  if (p->ring == MAP_FAILED) {
+    p->ring = NULL;
+    return false;
+  }
+  p->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  p->sqes = (struct io_uring_sqe*)mmap(NULL, p->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                       p->ring_fd, IORING_OFF_SQES);
+  if (p->sqes == MAP_FAILED) {
+    p->sqes = NULL;
+    return false;
+  }
+  char *r = (char*)p->ring;
+  p->sq_head = (unsigned*)(r + params.sq_off.head);
+  p->sq_tail = (unsigned*)(r + params.sq_off.tail);
+  p->sq_mask = (unsigned*)(r + params.sq_off.ring_mask);
+  p->sq_flags = (unsigned*)(r + params.sq_off.flags);
+  p->sq_array = (unsigned*)(r + params.sq_off.array);
+  p->sq_entries = params.sq_entries;
+  p->sq_next = *p->sq_tail;
+  p->cq_head = (unsigned*)(r + params.cq_off.head);
+  p->cq_tail = (unsigned*)(r + params.cq_off.tail);
+  p->cq_mask = (unsigned*)(r + params.cq_off.ring_mask);
+  p->cqes = (struct io_uring_cqe*)(r + params.cq_off.cqes);
+
+  /* The buffer ring must be page aligned */
+  p->buf_ring_size = RECV_BUFFERS * sizeof(struct io_uring_buf);
+  p->buf_ring = (struct io_uring_buf_ring*)mmap(NULL, p->buf_ring_size, PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p->buf_ring == MAP_FAILED) {
+    p->buf_ring = NULL;
+    return false;
+  }
+  p->buffers = (char*)malloc(RECV_BUFFERS * RECV_BUFFER_SIZE);
+  if (!p->buffers) return false;
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uintptr_t)p->buf_ring;
+  reg.ring_entries = RECV_BUFFERS;
+  reg.bgid = RECV_GROUP;
+  if (ring_register(p->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+  for (int bid = 0; bid < RECV_BUFFERS; ++bid) {
+    leader_recycle(p, bid);
+  }
+  return true;
+}
+
+static void ring_finalize(pn_proactor_t *p) {
+  if (p->ring_fd >= 0) close(p->ring_fd);
+  if (p->ring) munmap(p->ring, p->ring_size);
+  if (p->sqes) munmap(p->sqes, p->sqes_size);
+  if (p->buf_ring) munmap(p->buf_ring, p->buf_ring_size);
+  free(p->buffers);
+}
+
+/* Submit queued requests. If wait, block till there is at least one completion. */
+static void ring_submit(pn_proactor_t *p, bool wait) {
+  unsigned n = p->sq_next - *p->sq_tail;
+  if (n) __atomic_store_n(p->sq_tail, p->sq_next, __ATOMIC_RELEASE);
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  if (__atomic_load_n(p->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+    flags |= IORING_ENTER_GETEVENTS; /* Flush completions that did not fit in the ring */
+  }
+  if (n || flags) {
+    while (ring_enter(p->ring_fd, n, wait ? 1 : 0, flags) < 0 && errno == EINTR)
+      ;
+  }
+}
+
+/* Get a zeroed submission queue entry. */
+static struct io_uring_sqe *ring_sqe(pn_proactor_t *p, op_t *op) {
+  while (p->sq_next - __atomic_load_n(p->sq_head, __ATOMIC_ACQUIRE) >= p->sq_entries) {
+    ring_submit(p, false);      /* Full, make room */
+  }
+  unsigned i = p->sq_next & *p->sq_mask;
+  struct io_uring_sqe *sqe = &p->sqes[i];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = (uintptr_t)op;
+  p->sq_array[i] = i;
+  ++p->sq_next;
+  if (op) ++p->inflight;
+  return sqe;
+}
+
+static inline bool ring_pending(pn_proactor_t *p) {
+  return p->sq_next != *p->sq_tail;
+}
+
+/* Cancel requests matching user_data op, or every request on fd if op is NULL */
+static void ring_cancel(pn_proactor_t *p, op_t *op, int fd) {
+  struct io_uring_sqe *sqe = ring_sqe(p, NULL);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  if (op) {
+    sqe->addr = (uintptr_t)op;
+  } else {
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  }
+}
+
+/* Arm a one-shot read of an eventfd counter */
+static void ring_read_eventfd(pn_proactor_t *p, op_t *op, int fd, uint64_t *count) {
+  struct io_uring_sqe *sqe = ring_sqe(p, op);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t)count;
+  sqe->len = sizeof(*count);
+}
+
+/* ================ Timers ================ */
+
+static void utimer_init(utimer_t *t, op_type type, void *owner) {
+  t->op.type = type;
+  t->op.owner = owner;
+  t->armed = 0;
+}
+
+/* Make sure the timer fires no later than deadline, an earlier fire is re-checked by the owner */
+static void utimer_arm(pn_proactor_t *p, utimer_t *t, uint64_t deadline) {
+  if (t->armed && t->armed <= deadline) return;
+  t->ts.tv_sec = deadline / 1000;
+  t->ts.tv_nsec = (deadline % 1000) * 1000000;
+  struct io_uring_sqe *sqe;
+  if (!t->armed) {
+    sqe = ring_sqe(p, &t->op);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uintptr_t)&t->ts;
+    sqe->len = 1;
+  } else {
+    sqe = ring_sqe(p, NULL);
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->addr = (uintptr_t)&t->op;
+    sqe->addr2 = (uintptr_t)&t->ts;
+    sqe->timeout_flags = IORING_TIMEOUT_UPDATE;
+  }
+  sqe->timeout_flags |= IORING_TIMEOUT_ABS;
+  t->armed = deadline;
+}
+
+static void utimer_cancel(pn_proactor_t *p, utimer_t *t) {
+  if (t->armed) {
+    struct io_uring_sqe *sqe = ring_sqe(p, NULL);
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->addr = (uintptr_t)&t->op;
+  }
+}
+
+/* ================ Work ================ */
+
+/* Wake the leader if it is blocked in the ring */
+static void notify_lh(pn_proactor_t *p) {
+  if (p->leader_waiting) {
+    p->leader_waiting = false;
+    uint64_t one = 1;
+    (void)!write(p->notify_fd, &one, sizeof(one));
+  }
+}
+
+/* Notify that this work item needs attention from the leader at the next opportunity */
+static void work_notify(work_t *w) {
+  pthread_mutex_lock(&w->proactor->lock);
+  /* If the item is in use by a worker or is already queued then leave it where it is.
+     It will be processed in pn_proactor_done() or when the queue it is on is processed.
+  */
+  if (!w->working && w->next == work_unqueued) {
+    work_push(&w->proactor->leader_q, w);
+    notify_lh(w->proactor);
+  }
+  pthread_mutex_unlock(&w->proactor->lock);
+}
+
+/* Hand a newly-created work item to the leader */
+static void work_start(work_t *w) {
+  pn_proactor_t *p = w->proactor;
+  pthread_mutex_lock(&p->lock);
+  w->all_next = p->all;
+  if (p->all) p->all->all_prev = w;
+  p->all = w;
+  w->working = false;
+  work_push(&p->leader_q, w);
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void work_remove_lh(work_t *w) {
+  pn_proactor_t *p = w->proactor;
+  if (w->all_prev) w->all_prev->all_next = w->all_next;
+  else p->all = w->all_next;
+  if (w->all_next) w->all_next->all_prev = w->all_prev;
+  w->all_prev = w->all_next = NULL;
+}
+
+/* Total count of listener and connections for PN_PROACTOR_INACTIVE */
+static void add_active(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  ++p->active;
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void remove_active_lh(pn_proactor_t *p) {
+  assert(p->active > 0);
+  if (--p->active == 0) {
+    p->need_inactive = true;
+  }
+}
+
+/* Final removal of a work item from the proactor */
+static void work_finish(work_t *w) {
+  pthread_mutex_lock(&w->proactor->lock);
+  work_remove_lh(w);
+  remove_active_lh(w->proactor);
+  pthread_mutex_unlock(&w->proactor->lock);
+}
+
+static int pgetaddrinfo(const char *host, const char *port, int flags, struct addrinfo **res)
+{
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_V4MAPPED | AI_ADDRCONFIG | flags;
+  return getaddrinfo(host, port, &hints, res);
+}
+
+/* getaddrinfo() never returns AF_UNIX, so those are from unix_addrinfo() */
+static void addrinfo_free(struct addrinfo *ai) {
+  if (ai && ai->ai_family == AF_UNIX) free(ai);
+  else if (ai) freeaddrinfo(ai);
+}
+
+/* A one-address list for a "unix:" path in a single allocation, as
+   pgetaddrinfo() otherwise.  Free with addrinfo_free(). */
+static int paddrinfo(const char *host, const char *port, int flags, struct addrinfo **res) {
+  const char *path = pni_unix_path(host, port);
+  if (!path) return pgetaddrinfo(host, port, flags, res);
+  struct sockaddr_storage ss;
+  size_t len;
+  if (pni_unix_sockaddr(path, &ss, &len)) return EAI_NONAME; /* Path too long */
+  struct addrinfo *ai = (struct addrinfo*)calloc(1, sizeof(struct addrinfo) + len);
+  if (!ai) return EAI_MEMORY;
+  ai->ai_family = AF_UNIX;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_addrlen = len;
+  ai->ai_addr = (struct sockaddr*)(ai + 1);
+  memcpy(ai->ai_addr, &ss, len);
+  *res = ai;
+  return 0;
+}
+
+static void configure_socket(int sock) {
+  int tcp_nodelay = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void*) &tcp_nodelay, sizeof(tcp_nodelay));
+}
+
+/* ================ Connections ================ */
+
+/* Make a pn_class for pconnection_t since it is attached to a pn_connection_t record */
+#define CID_pconnection CID_pn_object
+#define pconnection_inspect NULL
+#define pconnection_initialize NULL
+#define pconnection_hashcode NULL
+#define pconnection_compare NULL
+
+static void pconnection_finalize(void *vp_pconnection) {
+  pconnection_t *pc = (pconnection_t*)vp_pconnection;
+  pthread_mutex_destroy(&pc->lock);   /* Only the lock and stats are left to clean up */
+  free(pc->stats);
+}
+
+static const pn_class_t pconnection_class = PN_CLASS(pconnection);
+
+static pconnection_t *pconnection(pn_proactor_t *p, pn_connection_t *c, bool server) {
+  /* pconnection_t is a pn_class instance so we can attach it to the pn_connection_t and
+     it will be finalized when the pn_connection_t is freed.
+  */
+  pconnection_t *pc =
+    (pconnection_t *) pn_class_new(&pconnection_class, sizeof(pconnection_t));
+  if (!pc) return NULL;
+  memset(pc, 0, sizeof(*pc));
+  if (pn_connection_driver_init(&pc->driver, c, NULL) != 0) {
+    free(pc);
+    return NULL;
+  }
+  pni_proactor_capture(pc->driver.transport);
+  pni_proactor_prewarm(pc->driver.connection, pc->driver.collector);
+  work_init(&pc->work, p, T_CONNECTION);
+  pc->fd = -1;
+  pc->connect_op.type = OP_CONNECT;
+  pc->recv_op.type = OP_RECV;
+  pc->send_op.type = OP_SEND;
+  pc->connect_op.owner = pc->recv_op.owner = pc->send_op.owner = pc;
+  utimer_init(&pc->timer, OP_TICK, pc);
+  pc->queue_head = pc->queue_tail = -1;
+  pthread_mutex_init(&pc->lock, NULL);
+  pc->wake = W_NONE;
+  if (p->stats) {
+    pc->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*pc->stats));
+  }
+  if (server) {
+    pn_transport_set_server(pc->driver.transport);
+  }
+  pn_record_t *r = pn_connection_attachments(pc->driver.connection);
+  pn_record_def(r, PN_PROACTOR, &pconnection_class);
+  pn_record_set(r, PN_PROACTOR, pc);
+  pn_decref(pc);                /* Will be deleted when the connection is */
+  return pc;
+}
+
+static void pconnection_free(pconnection_t *pc) {
+  if (pc->addrinfo) {
+    addrinfo_free(pc->addrinfo);
+  }
+  bool released = pc->released;
+  pn_incref(pc);                /* Make sure we don't do a circular free */
+  pn_connection_driver_destroy(&pc->driver);
+  pn_decref(pc);
+  /* Now pc is freed iff the connection is, otherwise remains till the pn_connection_t is freed. */
+  if (released) {
+    pn_decref(pc);              /* The reference taken by pn_proactor_release_connection() */
+  }
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch);
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch);
+
+static inline pn_proactor_t *batch_proactor(pn_event_batch_t *batch) {
+  return (batch->next_event == proactor_batch_next) ?
+    (pn_proactor_t*)((char*)batch - offsetof(pn_proactor_t, batch)) : NULL;
+}
+
+static inline pn_listener_t *batch_listener(pn_event_batch_t *batch) {
+  return (batch->next_event == listener_batch_next) ?
+    (pn_listener_t*)((char*)batch - offsetof(pn_listener_t, batch)) : NULL;
+}
+
+static inline pconnection_t *batch_pconnection(pn_event_batch_t *batch) {
+  pn_connection_driver_t *d = pn_event_batch_connection_driver(batch);
+  return d ? (pconnection_t*)((char*)d - offsetof(pconnection_t, driver)) : NULL;
+}
+
+static inline work_t *batch_work(pn_event_batch_t *batch) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc) return &pc->work;
+  pn_listener_t *l = batch_listener(batch);
+  if (l) return &l->work;
+  return NULL;
+}
+
+static pconnection_t *get_pconnection(pn_connection_t* c) {
+  if (!c) {
+    return NULL;
+  }
+  pn_record_t *r = pn_connection_attachments(c);
+  return (pconnection_t*) pn_record_get(r, PN_PROACTOR);
+}
+
+/* Set the error condition, but don't close the driver. */
+static void pconnection_set_error(pconnection_t *pc, const char *msg, const char* what) {
+  pn_connection_driver_t *driver = &pc->driver;
+  pn_connection_driver_bind(driver); /* Make sure we are bound so errors will be reported */
+  pni_proactor_set_cond(pn_transport_condition(driver->transport), what, pc->host, pc->port, msg);
+}
+
+/* Set the error condition and close the driver. */
+static void pconnection_error(pconnection_t *pc, int err, const char* what) {
+  assert(err);
+  strerrorbuf msg;
+  pstrerror(err, msg);
+  pconnection_set_error(pc, msg, what);
+  pn_connection_driver_close(&pc->driver);
+}
+
+static void pconnection_addresses(pconnection_t *pc) {
+  socklen_t len = sizeof(pc->local.ss);
+  getsockname(pc->fd, (struct sockaddr*)&pc->local.ss, &len);
+  len = sizeof(pc->remote.ss);
+  getpeername(pc->fd, (struct sockaddr*)&pc->remote.ss, &len);
+}
+
+/* Remember the first error code from a bad connect attempt.
+ * This is not yet a full-blown error as we might succeed connecting
+ * to a different address if there are several.
+ */
+static inline void pconnection_bad_connect(pconnection_t *pc, int err) {
+  if (!pc->connect_err) {
+    pc->connect_err = err;
+  }
+}
+
+/* Start connecting to the next address. Return false if there are no more to try. */
+static bool leader_connect(pconnection_t *pc) {
+  pn_proactor_t *p = pc->work.proactor;
+  while (pc->ai && !pn_connection_driver_write_closed(&pc->driver)) {
+    struct addrinfo *ai = pc->ai;
+    pc->ai = ai->ai_next;       /* Move to next address in case this fails */
+    int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+      configure_socket(fd);
+      pc->fd = fd;
+      struct io_uring_sqe *sqe = ring_sqe(p, &pc->connect_op);
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->fd = fd;
+      sqe->addr = (uintptr_t)ai->ai_addr;
+      sqe->off = ai->ai_addrlen;
+      ++pc->inflight;
+      return true;
+    }
+    pconnection_bad_connect(pc, errno);
+  }
+  pc->connected = 1;            /* Give up */
+  if (pc->addrinfo) {
+    addrinfo_free(pc->addrinfo);
+    pc->addrinfo = pc->ai = NULL;
+  }
+  if (pc->connect_err) {
+    pconnection_error(pc, pc->connect_err, "connecting to");
+  }
+  return false;
+}
+
+static void on_connect(pconnection_t *pc, int res) {
+  --pc->inflight;
+  if (!res) {
+    pc->connected = 1;
+    pconnection_addresses(pc);
+    addrinfo_free(pc->addrinfo); /* Done with address info */
+    pc->addrinfo = pc->ai = NULL;
+  } else {
+    pconnection_bad_connect(pc, -res);
+    close(pc->fd);              /* Try the next address if there is one */
+    pc->fd = -1;
+  }
+  work_notify(&pc->work);
+}
+
+static void queue_push(pconnection_t *pc, int bid) {
+  pn_proactor_t *p = pc->work.proactor;
+  p->buf_next[bid] = -1;
+  if (pc->queue_len) {
+    p->buf_next[pc->queue_tail] = bid;
+  } else {
+    pc->queue_head = bid;
+  }
+  pc->queue_tail = bid;
+  ++pc->queue_len;
+}
+
+static int queue_pop(pconnection_t *pc) {
+  int bid = pc->queue_head;
+  pc->queue_head = pc->work.proactor->buf_next[bid];
+  pc->queue_offset = 0;
+  if (--pc->queue_len == 0) {
+    pc->queue_head = pc->queue_tail = -1;
+  }
+  return bid;
+}
+
+static void leader_recycle(pn_proactor_t *p, int bid) {
+  struct io_uring_buf *b = &p->buf_ring->bufs[p->buf_tail & (RECV_BUFFERS - 1)];
+  b->addr = (uintptr_t)(p->buffers + (size_t)bid * RECV_BUFFER_SIZE);
+  b->len = RECV_BUFFER_SIZE;
+  b->bid = bid;
+  ++p->buf_tail;
+  __atomic_store_n(&p->buf_ring->tail, p->buf_tail, __ATOMIC_RELEASE);
+  /* Connections that ran out of buffers can receive again */
+  while (p->starved) {
+    pconnection_t *pc = p->starved;
+    p->starved = pc->starved_next;
+    pc->starved_next = NULL;
+    pc->starved = false;
+    work_notify(&pc->work);
+  }
+}
+
+static void on_recv(pconnection_t *pc, struct io_uring_cqe *cqe) {
+  pn_proactor_t *p = pc->work.proactor;
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    pc->receiving = false;
+    pc->recv_cancelled = false;
+    --pc->inflight;
+  }
+  if (cqe->res > 0) {
+    assert(cqe->flags & IORING_CQE_F_BUFFER);
+    int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    p->buf_len[bid] = cqe->res;
+    queue_push(pc, bid);
+    if (pc->stats && !pc->ready_time) {
+      pc->ready_time = pni_proactor_stats_now();
+    }
+    if (pc->queue_len >= RECV_QUEUE_MAX && pc->receiving && !pc->recv_cancelled) {
+      /* The transport is not keeping up, stop taking buffers other connections need */
+      pc->recv_cancelled = true;
+      ring_cancel(p, &pc->recv_op, -1);
+    }
+  } else if (cqe->res == 0) {
+    pc->recv_closed = true;
+  } else if (cqe->res == -ENOBUFS) {
+    if (!pc->starved) {
+      pc->starved = true;
+      pc->starved_next = p->starved;
+      p->starved = pc;
+    }
+  } else if (cqe->res != -ECANCELED) {
+    pc->recv_err = -cqe->res;
+  }
+  work_notify(&pc->work);
+}
+
+static void on_send(pconnection_t *pc, int res) {
+  --pc->inflight;
+  pc->writing = 0;
+  if (res < 0) {
+    strerrorbuf msg;
+    pstrerror(-res, msg);
+    pconnection_set_error(pc, msg, "on write to");
+    pn_connection_driver_write_close(&pc->driver);
+  } else if (!pn_connection_driver_write_closed(&pc->driver)) {
+    pn_connection_driver_write_done(&pc->driver, res);
+  }
+  if (pc->flush_start && pn_connection_driver_write_buffer(&pc->driver).size == 0) {
+    PCONNECTION_STAT(pc, flush, pni_proactor_stats_now() - pc->flush_start);
+    pc->flush_start = 0;
+  }
+  work_notify(&pc->work);
+}
+
+static void on_tick(pconnection_t *pc) {
+  --pc->inflight;
+  pc->timer.armed = 0;
+  work_notify(&pc->work);
+}
+
+/* Give queued receive buffers to the transport */
+static void leader_deliver(pconnection_t *pc) {
+  pn_proactor_t *p = pc->work.proactor;
+  while (pc->queue_len) {
+    int bid = pc->queue_head;
+    if (pn_connection_driver_read_closed(&pc->driver)) {
+      leader_recycle(p, queue_pop(pc)); /* Nobody wants it */
+      continue;
+    }
+    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
+    if (rbuf.size == 0) break;
+    size_t n = p->buf_len[bid] - pc->queue_offset;
+    if (n > rbuf.size) n = rbuf.size;
+    memcpy(rbuf.start, p->buffers + (size_t)bid * RECV_BUFFER_SIZE + pc->queue_offset, n);
+    pn_connection_driver_read_done(&pc->driver, n);
+    pc->queue_offset += n;
+    if (pc->queue_offset == p->buf_len[bid]) {
+      leader_recycle(p, queue_pop(pc));
+    }
+  }
+  if (!pc->queue_len) {
+    if (pc->recv_err) {
+      pconnection_error(pc, pc->recv_err, "on read from");
+      pc->recv_err = 0;
+      pc->recv_closed = true;
+    } else if (pc->recv_closed) {
+      pn_connection_driver_read_close(&pc->driver);
+    }
+  }
+}
+
+/* Check wake state and generate WAKE event if needed */
+static void check_wake(pconnection_t *pc) {
+  pthread_mutex_lock(&pc->lock);
+  if (pc->wake == W_PENDING) {
+    pn_connection_t *c = pc->driver.connection;
+    pn_collector_put(pn_connection_collector(c), PN_OBJECT, c, PN_CONNECTION_WAKE);
+    pc->wake = W_NONE;
+  }
+  pthread_mutex_unlock(&pc->lock);
+}
+
+/* The driver is finished: cancel outstanding requests, free when they have all completed */
+static void leader_close(pconnection_t *pc) {
+  pn_proactor_t *p = pc->work.proactor;
+  if (!pc->closing) {
+    pc->closing = true;
+    pthread_mutex_lock(&pc->lock);
+    pc->wake = W_CLOSED;        /* wake() is a no-op from now on */
+    pthread_mutex_unlock(&pc->lock);
+    if (pc->fd >= 0 && (pc->receiving || !pc->connected)) {
+      ring_cancel(p, NULL, pc->fd);
+    }
+    utimer_cancel(p, &pc->timer);
+  }
+  if (pc->inflight) return;     /* The last completion queues us again */
+
+  if (pc->fd >= 0) close(pc->fd);
+  while (pc->queue_len) {
+    leader_recycle(p, queue_pop(pc));
+  }
+  for (pconnection_t **pp = &p->starved; *pp; pp = &(*pp)->starved_next) {
+    if (*pp == pc) {
+      *pp = pc->starved_next;
+      break;
+    }
+  }
+  work_finish(&pc->work);
+  pconnection_free(pc);
+}
+
+/* Process a pconnection, return true if it has events for a worker thread */
+static bool leader_process_pconnection(pconnection_t *pc, bool disconnect) {
+  pn_proactor_t *p = pc->work.proactor;
+  if (disconnect) {
+    pthread_mutex_lock(&p->lock);
+    if (pn_condition_is_set(p->disconnect_cond)) {
+      pn_condition_copy(pn_transport_condition(pc->driver.transport), p->disconnect_cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    pn_connection_driver_close(&pc->driver);
+  }
+  if (pc->writing) {
+    /* We can't touch the driver while a send from its buffer is pending */
+    return false;
+  }
+  if (!pc->connected) {
+    if (pc->fd >= 0 || leader_connect(pc)) {
+      return false;             /* Connect in progress */
+    }
+  }
+  /* Must process INIT and BOUND events before we do any IO-related stuff  */
+  if (pn_connection_driver_has_event(&pc->driver)) {
+    return true;
+  }
+  if (pn_connection_driver_finished(&pc->driver)) {
+    leader_close(pc);
+    return false;
+  }
+  if (pc->fd < 0) {             /* Never connected, nothing more to do */
+    pn_connection_driver_close(&pc->driver);
+    return pn_connection_driver_has_event(&pc->driver);
+  }
+  /* Check for events that can be generated without blocking for IO */
+  check_wake(pc);
+  leader_deliver(pc);
+  uint64_t next_tick = pn_transport_tick(pc->driver.transport, pn_proactor_now());
+  if (next_tick) {
+    utimer_arm(p, &pc->timer, next_tick);
+  }
+  /* The recv uses our buffers, so it can stay armed while a worker has the connection */
+  if (!pc->receiving && !pc->recv_closed && !pc->starved && pc->queue_len < RECV_QUEUE_MAX &&
+      !pn_connection_driver_read_closed(&pc->driver))
+  {
+    struct io_uring_sqe *sqe = ring_sqe(p, &pc->recv_op);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pc->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_GROUP;
+    pc->receiving = true;
+    ++pc->inflight;
+  }
+  /* If we still have no events, send */
+  if (!pn_connection_driver_has_event(&pc->driver)) {
+    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
+    if (pn_transport_get_disposition_delay(pc->driver.transport)) {
+      /* Deadline for dispositions held back by the write */
+      next_tick = pn_transport_tick(pc->driver.transport, pn_proactor_now());
+      if (next_tick) utimer_arm(p, &pc->timer, next_tick);
+    }
+    if (wbuf.size > 0) {
+      struct io_uring_sqe *sqe = ring_sqe(p, &pc->send_op);
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = pc->fd;
+      sqe->addr = (uintptr_t)wbuf.start;
+      sqe->len = wbuf.size;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      pc->writing = wbuf.size;
+      ++pc->inflight;
+      if (pc->stats && !pc->flush_start) {
+        pc->flush_start = pni_proactor_stats_now();
+      }
+    } else if (pn_connection_driver_write_closed(&pc->driver) && !pc->shutdown) {
+      shutdown(pc->fd, SHUT_WR);
+      pc->shutdown = true;
+    }
+  }
+  return pn_connection_driver_has_event(&pc->driver);
+}
+
+/* ================ Listeners ================ */
+
+static void listener_close_lh(pn_listener_t* l) {
+  if (l->state < L_CLOSE) {
+    l->state = L_CLOSE;
+  }
+}
+
+static void listener_error(pn_listener_t *l, const char *msg, const char* what) {
+  pni_proactor_set_cond(l->condition, what, l->host, l->port, msg);
+  pthread_mutex_lock(&l->lock);
+  listener_close_lh(l);
+  pthread_mutex_unlock(&l->lock);
+}
+
+/* Close accepted fds that were never handed to pn_listener_accept() */
+static void listener_drop_accepted_lh(pn_listener_t *l) {
+  for (size_t i = l->accepted_next; i < l->accepted_size; ++i) {
+    close(l->accepted[i]);
+  }
+  l->accepted_next = l->accepted_announced = l->accepted_size = 0;
+}
+
+void pn_listener_free(pn_listener_t *l) {
+  if (l) {
+    if (l->collector) pn_collector_free(l->collector);
+    if (l->condition) pn_condition_free(l->condition);
+    if (l->attachments) pn_free(l->attachments);
+    for (size_t i = 0; i < l->lsockets_size; ++i) {
+      if (l->lsockets[i].fd >= 0) close(l->lsockets[i].fd);
+    }
+    free(l->lsockets);
+    listener_drop_accepted_lh(l);
+    free(l->accepted);
+    pthread_mutex_destroy(&l->lock);
+    free(l);
+  }
+}
+
+static void on_accept(lsocket_t *ls, struct io_uring_cqe *cqe) {
+  pn_listener_t *l = ls->parent;
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    ls->accepting = false;
+  }
+  if (cqe->res >= 0) {
+    int fd = cqe->res;
+    configure_socket(fd);
+    pthread_mutex_lock(&l->lock);
+    if (l->accepted_size == l->accepted_capacity) {
+      size_t capacity = l->accepted_capacity ? 2 * l->accepted_capacity : 16;
+      int *accepted = (int*)realloc(l->accepted, capacity * sizeof(int));
+      if (accepted) {
+        l->accepted = accepted;
+        l->accepted_capacity = capacity;
+      }
+    }
+    if (l->accepted_size < l->accepted_capacity) {
+      l->accepted[l->accepted_size++] = fd;
+    } else {
+      close(fd);
+    }
+    pthread_mutex_unlock(&l->lock);
+  } else if (cqe->res != -ECANCELED) {
+    ls->err = -cqe->res;
+  }
+  work_notify(&l->work);
+}
+
+/* The collector coalesces repeated events, so accepted fds are announced one at a time */
+static inline bool listener_has_event_lh(pn_listener_t *l) {
+  return pn_collector_peek(l->collector) || l->accepted_announced < l->accepted_size;
+}
+
+/* Process a listener, return true if it has events for a worker thread */
+static bool leader_process_listener(pn_listener_t *l, bool disconnect) {
+  pn_proactor_t *p = l->work.proactor;
+  if (disconnect) {
+    pthread_mutex_lock(&p->lock);
+    if (pn_condition_is_set(p->disconnect_cond)) {
+      pn_condition_copy(l->condition, p->disconnect_cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    pn_listener_close(l);
+  }
+  for (size_t i = 0; i < l->lsockets_size; ++i) {
+    lsocket_t *ls = &l->lsockets[i];
+    if (ls->err) {
+      strerrorbuf msg;
+      pstrerror(ls->err, msg);
+      listener_error(l, msg, "accepting from");
+      ls->err = 0;
+    }
+  }
+
+  bool closed = false;
+  pthread_mutex_lock(&l->lock);
+  switch (l->state) {
+
+   case L_LISTENING:
+    for (size_t i = 0; i < l->lsockets_size; ++i) {
+      lsocket_t *ls = &l->lsockets[i];
+      if (!ls->accepting) {
+        struct io_uring_sqe *sqe = ring_sqe(p, &ls->accept_op);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = ls->fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        ls->accepting = true;
+      }
+    }
+    break;
+
+   case L_CLOSE:                /* Close requested, cancel the accepts */
+    l->state = L_CLOSING;
+    listener_drop_accepted_lh(l);
+    for (size_t i = 0; i < l->lsockets_size; ++i) {
+      if (l->lsockets[i].accepting) {
+        ring_cancel(p, &l->lsockets[i].accept_op, -1);
+      }
+    }
+    /* NOTE: Fall through in case we have 0 sockets - e.g. resolver error */
+
+   case L_CLOSING: {            /* Closing - can we send PN_LISTENER_CLOSE? */
+     bool accepting = false;
+     for (size_t i = 0; i < l->lsockets_size; ++i) {
+       accepting = accepting || l->lsockets[i].accepting;
+     }
+     listener_drop_accepted_lh(l);
+     if (!accepting) {
+       for (size_t i = 0; i < l->lsockets_size; ++i) {
+         close(l->lsockets[i].fd);
+         l->lsockets[i].fd = -1;
+       }
+       const char *path = pni_unix_path(l->host, l->port);
+       if (path && *path != '@' && l->lsockets_size) unlink(path); /* Remove the socket file we bound */
+       l->state = L_CLOSED;
+       pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_CLOSE);
+     }
+     break;
+   }
+
+   case L_CLOSED:              /* Closed, has LISTENER_CLOSE has been processed? */
+    if (!pn_collector_peek(l->collector)) {
+      closed = true;
+    }
+  }
+  bool has_work = !closed && listener_has_event_lh(l);
+  pthread_mutex_unlock(&l->lock);
+
+  if (closed) {
+    work_finish(&l->work);
+    pn_listener_free(l);
+  }
+  return has_work;
+}
+
+/* ================ Proactor ================ */
+
+static void on_timeout(pn_proactor_t *p) {
+  p->timer.armed = 0;
+  pthread_mutex_lock(&p->lock);
+  if (p->timeout_state == TM_PENDING) { /* Only fire if still pending */
+    if (pn_proactor_now() >= p->timeout_deadline) {
+      p->timeout_state = TM_FIRED;
+    } else if (!p->freeing) {
+      utimer_arm(p, &p->timer, p->timeout_deadline); /* Moved later */
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void on_interrupt(pn_proactor_t *p, int res) {
+  if (res == sizeof(p->interrupt_count)) {
+    pthread_mutex_lock(&p->lock);
+    p->interrupts += p->interrupt_count;
+    pthread_mutex_unlock(&p->lock);
+  }
+  if (!p->freeing) {
+    ring_read_eventfd(p, &p->interrupt_op, p->interrupt_fd, &p->interrupt_count);
+  }
+}
+
+static void on_completion(pn_proactor_t *p, struct io_uring_cqe *cqe) {
+  op_t *op = (op_t*)(uintptr_t)cqe->user_data;
+  if (!op) return;              /* Cancel and timer update requests */
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    --p->inflight;
+  }
+  switch (op->type) {
+   case OP_NOTIFY:
+    if (!p->freeing) {
+      ring_read_eventfd(p, &p->notify_op, p->notify_fd, &p->notify_count);
+    }
+    break;
+   case OP_INTERRUPT: on_interrupt(p, cqe->res); break;
+   case OP_TIMEOUT: on_timeout(p); break;
+   case OP_CONNECT: on_connect((pconnection_t*)op->owner, cqe->res); break;
+   case OP_RECV: on_recv((pconnection_t*)op->owner, cqe); break;
+   case OP_SEND: on_send((pconnection_t*)op->owner, cqe->res); break;
+   case OP_TICK: on_tick((pconnection_t*)op->owner); break;
+   case OP_ACCEPT: on_accept((lsocket_t*)op->owner, cqe); break;
+  }
+}
+
+/* Handle all available completions, without blocking */
+static void leader_reap(pn_proactor_t *p) {
+  unsigned head = *p->cq_head;
+  unsigned tail;
+  while (head != (tail = __atomic_load_n(p->cq_tail, __ATOMIC_ACQUIRE))) {
+    for (; head != tail; ++head) {
+      struct io_uring_cqe cqe = p->cqes[head & *p->cq_mask];
+      __atomic_store_n(p->cq_head, head + 1, __ATOMIC_RELEASE);
+      on_completion(p, &cqe);
+    }
+  }
+}
+
+/* Set the event in the proactor's batch  */
+static pn_event_batch_t *proactor_batch_lh(pn_proactor_t *p, pn_event_type_t t) {
+  pn_collector_put(p->collector, pn_proactor__class(), p, t);
+  p->batch_working = true;
+  return &p->batch;
+}
+
+static pn_event_t *log_event(void* p, pn_event_t *e) {
+  if (e) {
+    pn_log(PN_SUBSYSTEM_EVENT, PN_LEVEL_TRACE, "[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+  }
+  return e;
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch) {
+  pn_listener_t *l = batch_listener(batch);
+  pthread_mutex_lock(&l->lock);
+  if (!pn_collector_peek(l->collector) && l->accepted_announced < l->accepted_size) {
+    l->accepted_announced++;
+    pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_ACCEPT);
+  }
+  pn_event_t *e = pn_collector_next(l->collector);
+  pthread_mutex_unlock(&l->lock);
+  return log_event(l, e);
+}
+
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch) {
+  pn_proactor_t *p = batch_proactor(batch);
+  assert(p->batch_working);
+  return log_event(p, pn_collector_next(p->collector));
+}
+
+/* Return the next event batch or NULL if no events are available */
+static pn_event_batch_t *get_batch_lh(pn_proactor_t *p) {
+  if (!p->batch_working) {       /* Can generate proactor events */
+    if (p->need_inactive) {
+      p->need_inactive = false;
+      return proactor_batch_lh(p, PN_PROACTOR_INACTIVE);
+    }
+    if (p->interrupts) {
+      --p->interrupts;
+      return proactor_batch_lh(p, PN_PROACTOR_INTERRUPT);
+    }
+    if (p->timeout_state == TM_FIRED) {
+      p->timeout_state = TM_NONE;
+      remove_active_lh(p);
+      return proactor_batch_lh(p, PN_PROACTOR_TIMEOUT);
+    }
+  }
+  for (work_t *w = work_pop(&p->worker_q); w; w = work_pop(&p->worker_q)) {
+    assert(w->working);
+    switch (w->type) {
+     case T_CONNECTION: {
+       pconnection_t *pc = (pconnection_t*)w;
+       if (pc->stats) {
+         pc->batch_start = pni_proactor_stats_now();
+         PCONNECTION_STAT(pc, wake, pc->batch_start - pc->queue_time);
+         if (pc->ready_time) {
+           PCONNECTION_STAT(pc, dispatch, pc->batch_start - pc->ready_time);
+           pc->ready_time = 0;
+         }
+       }
+       return &pc->driver.batch;
+     }
+     case T_LISTENER:
+      return &((pn_listener_t*)w)->batch;
+     default:
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* Process the leader_q, in the leader thread */
+static void leader_work_lh(pn_proactor_t *p) {
+  for (work_t *w = work_pop(&p->leader_q); w; w = work_pop(&p->leader_q)) {
+    assert(!w->working);
+    bool disconnect = w->disconnect;
+    w->disconnect = false;
+
+    pthread_mutex_unlock(&p->lock);  /* Unlock to process each item, may add more items to leader_q */
+    bool has_work = false;
+    switch (w->type) {
+     case T_CONNECTION:
+      has_work = leader_process_pconnection((pconnection_t*)w, disconnect);
+      break;
+     case T_LISTENER:
+      has_work = leader_process_listener((pn_listener_t*)w, disconnect);
+      break;
+     default:
+      break;
+    }
+    pthread_mutex_lock(&p->lock);
+
+    if (has_work && !w->working && w->next == work_unqueued) {
+      w->working = true;
+      if (w->type == T_CONNECTION && ((pconnection_t*)w)->stats) {
+        ((pconnection_t*)w)->queue_time = pni_proactor_stats_now();
+      }
+      work_push(&p->worker_q, w);
+    }
+  }
+}
+
+/* Process the leader_q and the ring, in the leader thread */
+static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, bool wait) {
+  /* Set timeout timer if there was a request, let it count down while we process work */
+  if (p->timeout_state == TM_REQUEST) {
+    p->timeout_state = TM_PENDING;
+    utimer_arm(p, &p->timer, p->timeout_deadline);
+  }
+  leader_work_lh(p);
+  /* Submit what the work asked for and handle completions, without blocking */
+  pthread_mutex_unlock(&p->lock);
+  ring_submit(p, false);
+  leader_reap(p);
+  pthread_mutex_lock(&p->lock);
+  leader_work_lh(p);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  if (!batch && wait && !p->leader_q.front) {
+    p->leader_waiting = true;   /* notify_lh() will write the notify eventfd */
+    pthread_mutex_unlock(&p->lock);
+    ring_submit(p, true);
+    leader_reap(p);
+    pthread_mutex_lock(&p->lock);
+    p->leader_waiting = false;
+    leader_work_lh(p);
+    batch = get_batch_lh(p);
+  }
+  if (ring_pending(p)) {        /* Don't leave requests waiting for the next leader */
+    pthread_mutex_unlock(&p->lock);
+    ring_submit(p, false);
+    pthread_mutex_lock(&p->lock);
+  }
+  return batch;
+}
+
+/**** public API ****/
+
+pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
+  pthread_mutex_lock(&p->lock);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  if (batch == NULL && !p->has_leader) {
+    /* Try a non-blocking lead to generate some work */
+    p->has_leader = true;
+    batch = leader_lead_lh(p, false);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond);   /* Signal followers for possible work */
+  }
+  pthread_mutex_unlock(&p->lock);
+  return batch;
+}
+
+pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  pthread_mutex_lock(&p->lock);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  while (!batch && p->has_leader) {
+    pthread_cond_wait(&p->cond, &p->lock); /* Follow the leader */
+    batch = get_batch_lh(p);
+  }
+  if (!batch) {                 /* Become leader */
+    p->has_leader = true;
+    do {
+      batch = leader_lead_lh(p, true);
+    } while (!batch);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond); /* Signal a followers. One takes over, many can work. */
+  }
+  pthread_mutex_unlock(&p->lock);
+  return batch;
+}
+
+void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
+  if (!batch) return;
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc && pc->stats && pc->batch_start) {
+    PCONNECTION_STAT(pc, batch, pni_proactor_stats_now() - pc->batch_start);
+    pc->batch_start = 0;
+  }
+  pthread_mutex_lock(&p->lock);
+  work_t *w = batch_work(batch);
+  if (w) {
+    assert(w->working);
+    assert(w->next == work_unqueued);
+    w->working = false;
+    work_push(&p->leader_q, w);
+  }
+  pn_proactor_t *bp = batch_proactor(batch); /* Proactor events */
+  if (bp == p) {
+    p->batch_working = false;
+  }
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+pn_listener_t *pn_event_listener(pn_event_t *e) {
+  return (pn_event_class(e) == pn_listener__class()) ? (pn_listener_t*)pn_event_context(e) : NULL;
+}
+
+pn_proactor_t *pn_event_proactor(pn_event_t *e) {
+  if (pn_event_class(e) == pn_proactor__class()) {
+    return (pn_proactor_t*)pn_event_context(e);
+  }
+  pn_listener_t *l = pn_event_listener(e);
+  if (l) {
+    return l->work.proactor;
+  }
+  pn_connection_t *c = pn_event_connection(e);
+  if (c) {
+    return pn_connection_proactor(pn_event_connection(e));
+  }
+  return NULL;
+}
+
+void pn_proactor_interrupt(pn_proactor_t *p) {
+  /* NOTE: pn_proactor_interrupt must be async-signal-safe so we cannot use
+     locks to update shared proactor state here. Instead we use a dedicated
+     eventfd, on_interrupt() will count the interrupt in the leader thread.
+   */
+  uint64_t one = 1;
+  (void)!write(p->interrupt_fd, &one, sizeof(one));
+}
+
+void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
+  pthread_mutex_lock(&p->lock);
+  if (cond) {
+    pn_condition_copy(p->disconnect_cond, cond);
+  } else {
+    pn_condition_clear(p->disconnect_cond);
+  }
+  for (work_t *w = p->all; w; w = w->all_next) {
+    w->disconnect = true;
+    if (!w->working && w->next == work_unqueued) {
+      work_push(&p->leader_q, w);
+    }
+  }
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_disconnect_async(pn_proactor_t *p, pn_condition_t *cond) {
+  pn_proactor_disconnect(p, cond);
+}
+
+void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
+  pthread_mutex_lock(&p->lock);
+  p->timeout_deadline = pn_proactor_now() + t;
+  // This timeout *replaces* any existing timeout
+  if (p->timeout_state == TM_NONE) ++p->active;
+  p->timeout_state = TM_REQUEST;
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_cancel_timeout(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  if (p->timeout_state != TM_NONE) {
+    p->timeout_state = TM_NONE;
+    remove_active_lh(p);
+    notify_lh(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_connect(pn_proactor_t *p, pn_connection_t *c, const char *addr) {
+  pconnection_t *pc = pconnection(p, c, false);
+  assert(pc);                                  /* TODO aconway 2017-03-31: memory safety */
+  pn_connection_open(pc->driver.connection);   /* Auto-open */
+  if (pni_parse_addr(addr, pc->addr_buf, sizeof(pc->addr_buf), &pc->host, &pc->port)) {
+    pconnection_error(pc, EINVAL, "connect to");
+  } else {
+    int gai_error = paddrinfo(pc->host, pc->port, 0, &pc->addrinfo);
+    if (gai_error) {
+      pconnection_set_error(pc, gai_strerror(gai_error), "connect to");
+      pn_connection_driver_close(&pc->driver);
+    }
+    pc->ai = pc->addrinfo;
+  }
+  add_active(p);
+  work_start(&pc->work);
+}
+
+void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, int backlog) {
+  work_init(&l->work, p, T_LISTENER);
+  int err = 0;
+  const char *msg = NULL;
+  strerrorbuf errbuf;
+  struct addrinfo *addrinfo = NULL;
+  if (pni_parse_addr(addr, l->addr_buf, sizeof(l->addr_buf), &l->host, &l->port)) {
+    err = EINVAL;
+  } else {
+    int gai_error = paddrinfo(l->host, l->port, AI_PASSIVE | AI_ALL, &addrinfo);
+    if (gai_error) msg = gai_strerror(gai_error);
+  }
+  if (addrinfo) {
+    size_t len = 0;
+    for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
+      ++len;
+    }
+    l->lsockets = (lsocket_t*)calloc(len, sizeof(lsocket_t));
+    assert(l->lsockets);      /* TODO aconway 2017-05-05: memory safety */
+    /* Find working listen addresses */
+    for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
+      int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+      static int on = 1;
+      if ((fd >= 0) &&
+          !setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) &&
+          (!l->reuseport ||
+           !setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) &&
+          /* We listen to v4/v6 on separate sockets, don't let v6 listen for v4 */
+          (ai->ai_family != AF_INET6 ||
+           !setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on))) &&
+          !bind(fd, ai->ai_addr, ai->ai_addrlen) &&
+          !listen(fd, backlog))
+      {
+        lsocket_t *ls = &l->lsockets[l->lsockets_size++];
+        ls->accept_op.type = OP_ACCEPT;
+        ls->accept_op.owner = ls;
+        ls->parent = l;
+        ls->fd = fd;
+      } else {
+        err = errno;
+        if (fd >= 0) close(fd);
+      }
+    }
+    addrinfo_free(addrinfo);
+  }
+  if (l->lsockets_size) {
+    l->state = L_LISTENING;
+  } else {
+    if (!msg) {
+      pstrerror(err ? err : EINVAL, errbuf);
+      msg = errbuf;
+    }
+    listener_error(l, msg, "listen on");
+  }
+  /* Always put an OPEN event for symmetry, even if we have an error. */
+  pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_OPEN);
+  add_active(p);
+  work_start(&l->work);
+}
+
+static void work_free(work_t *w) {
+  switch (w->type) {
+   case T_CONNECTION: {
+     pconnection_t *pc = (pconnection_t*)w;
+     if (pc->fd >= 0) close(pc->fd);
+     pconnection_free(pc);
+     break;
+   }
+   case T_LISTENER: pn_listener_free((pn_listener_t*)w); break;
+   default: break;
+  }
+}
+
+pn_proactor_t *pn_proactor() {
+  pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(pn_proactor_t));
+  if (!p) return NULL;
+  p->ring_fd = p->notify_fd = p->interrupt_fd = -1;
+  if (pni_proactor_stats_enabled()) {
+    p->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*p->stats));
+  }
+  p->batch.next_event = &proactor_batch_next;
+  p->collector = pn_collector();
+  p->disconnect_cond = pn_condition();
+  p->notify_fd = eventfd(0, EFD_CLOEXEC);
+  p->interrupt_fd = eventfd(0, EFD_CLOEXEC);
+  if (!p->collector || !p->disconnect_cond || p->notify_fd < 0 || p->interrupt_fd < 0 ||
+      !ring_init(p))
+  {
+    ring_finalize(p);
+    if (p->notify_fd >= 0) close(p->notify_fd);
+    if (p->interrupt_fd >= 0) close(p->interrupt_fd);
+    pn_collector_free(p->collector);
+    pn_condition_free(p->disconnect_cond);
+    free(p->stats);
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  p->notify_op.type = OP_NOTIFY;
+  p->interrupt_op.type = OP_INTERRUPT;
+  p->notify_op.owner = p->interrupt_op.owner = p;
+  utimer_init(&p->timer, OP_TIMEOUT, p);
+  ring_read_eventfd(p, &p->notify_op, p->notify_fd, &p->notify_count);
+  ring_read_eventfd(p, &p->interrupt_op, p->interrupt_fd, &p->interrupt_count);
+  ring_submit(p, false);
+  return p;
+}
+
+void pn_proactor_free(pn_proactor_t *p) {
+  /* Cancel everything and wait till the kernel is done with our buffers */
+  p->freeing = true;
+  struct io_uring_sqe *sqe = ring_sqe(p, NULL);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+  while (p->inflight) {
+    ring_submit(p, true);
+    leader_reap(p);
+  }
+  /* Free all work items */
+  while (p->all) {
+    work_t *w = p->all;
+    work_remove_lh(w);
+    work_free(w);
+  }
+  ring_finalize(p);
+  close(p->notify_fd);
+  close(p->interrupt_fd);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
+  pn_collector_free(p->collector);
+  pn_condition_free(p->disconnect_cond);
+  free(p->stats);
+  free(p);
+}
+
+pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
+  pconnection_t *pc = get_pconnection(c);
+  return pc ? pc->work.proactor : NULL;
+}
+
+int pn_proactor_stats(pn_proactor_t *p, pn_proactor_stats_t *stats) {
+  if (!p->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, p->stats);
+  return 0;
+}
+
+int pn_connection_proactor_stats(pn_connection_t *c, pn_proactor_stats_t *stats) {
+  pconnection_t *pc = get_pconnection(c);
+  if (!pc || !pc->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, pc->stats);
+  return 0;
+}
+
+void pn_connection_wake(pn_connection_t* c) {
+  /* May be called from any thread */
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    bool notify = false;
+    pthread_mutex_lock(&pc->lock);
+    if (pc->wake == W_NONE) {
+      pc->wake = W_PENDING;
+      notify = true;
+    }
+    pthread_mutex_unlock(&pc->lock);
+    if (notify) {
+      work_notify(&pc->work);
+    }
+  }
+}
+
+void pn_proactor_release_connection(pn_connection_t *c) {
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    /* Keep pc alive for the proactor, it is no longer attached to c */
+    pn_incref(pc);
+    pn_record_set(pn_connection_attachments(c), PN_PROACTOR, NULL);
+    pc->released = true;
+    pn_connection_driver_release_connection(&pc->driver);
+    work_notify(&pc->work);
+  }
+}
+
+pn_listener_t *pn_listener(void) {
+  pn_listener_t *l = (pn_listener_t*)calloc(1, sizeof(pn_listener_t));
+  if (l) {
+    l->batch.next_event = listener_batch_next;
+    l->collector = pn_collector();
+    l->condition = pn_condition();
+    l->attachments = pn_record();
+    pthread_mutex_init(&l->lock, NULL);
+    if (!l->condition || !l->collector || !l->attachments) {
+      pn_listener_free(l);
+      return NULL;
+    }
+  }
+  return l;
+}
+
+void pn_listener_close(pn_listener_t* l) {
+  /* May be called from any thread */
+  pthread_mutex_lock(&l->lock);
+  listener_close_lh(l);
+  pthread_mutex_unlock(&l->lock);
+  work_notify(&l->work);
+}
+
+pn_proactor_t *pn_listener_proactor(pn_listener_t* l) {
+  return l ? l->work.proactor : NULL;
+}
+
+pn_condition_t* pn_listener_condition(pn_listener_t* l) {
+  return l->condition;
+}
+
+void *pn_listener_get_context(pn_listener_t *l) {
+  return l->context;
+}
+
+void pn_listener_set_context(pn_listener_t *l, void *context) {
+  l->context = context;
+}
+
+pn_record_t *pn_listener_attachments(pn_listener_t *l) {
+  return l->attachments;
+}
+
+size_t pn_listener_backlog(pn_listener_t *l) {
+  pthread_mutex_lock(&l->lock);
+  size_t n = l->accepted_size - l->accepted_next;
+  pthread_mutex_unlock(&l->lock);
+  return n;
+}
+
+int pn_proactor_set_option(pn_proactor_t *p, pn_proactor_option_t option, int value) {
+  return PN_STATE_ERR;          /* No tuning options */
+}
+
+int pn_listener_set_reuseport(pn_listener_t *l, bool reuseport) {
+  l->reuseport = reuseport;
+  return 0;
+}
+
+int pn_listener_overflow(pn_listener_t *l, pn_listener_overflow_t *overflow) {
+  return PN_STATE_ERR;          /* Not counted */
+}
+
+void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
+  pn_proactor_t *p = l->work.proactor;
+  pthread_mutex_lock(&l->lock);
+  int fd = -1;
+  if (l->accepted_next < l->accepted_announced) {
+    fd = l->accepted[l->accepted_next++];
+    if (l->accepted_next == l->accepted_size) {
+      l->accepted_next = l->accepted_announced = l->accepted_size = 0;
+    }
+  }
+  pthread_mutex_unlock(&l->lock);
+
+  pconnection_t *pc = pconnection(p, c, true);
+  assert(pc);
+  pc->connected = 1;            /* Don't need to connect() */
+  pc->fd = fd;
+  if (fd >= 0) {
+    pconnection_addresses(pc);
+  } else {
+    pconnection_error(pc, EAGAIN, "accepting from");
+  }
+  add_active(p);
+  work_start(&pc->work);
+}
+
+const struct sockaddr *pn_netaddr_sockaddr(const pn_netaddr_t *na) {
+  return (struct sockaddr*)na;
+}
+
+size_t pn_netaddr_socklen(const pn_netaddr_t *na) {
+  return sizeof(struct sockaddr_storage);
+}
+
+const pn_netaddr_t *pn_netaddr_local(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc? &pc->local : NULL;
+}
+
+const pn_netaddr_t *pn_netaddr_remote(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc ? &pc->remote : NULL;
+}
+
+#ifndef NI_MAXHOST
+# define NI_MAXHOST 1025
+#endif
+
+#ifndef NI_MAXSERV
+# define NI_MAXSERV 32
+#endif
+
+int pn_netaddr_str(const pn_netaddr_t* na, char *buf, size_t len) {
+  int n = pni_unix_addr_str(&na->ss, buf, len);
+  if (n >= 0) return n;
+  char host[NI_MAXHOST];
+  char port[NI_MAXSERV];
+  int err = getnameinfo((struct sockaddr *)&na->ss, sizeof(na->ss),
+                        host, sizeof(host), port, sizeof(port),
+                        NI_NUMERICHOST | NI_NUMERICSERV);
+  if (!err) {
+    return snprintf(buf, len, "%s:%s", host, port);
+  } else {
+    if (buf) *buf = '\0';
+    return 0;
+  }
+}
+
+pn_millis_t pn_proactor_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000 + t.tv_nsec/1000000;
+}
@@ -48,6 +48,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 /*
   libuv functions are thread unsafe, we use a"leader-worker-follower" model as follows:
 
@@ -64,6 +71,13 @@
   roles as required at run-time. Monitored sockets (connections or listeners) are passed
   between threads on thread-safe queues.
 
+  Setting PN_PROACTOR_LOOPS=N runs N UV loops, each with its own leader, so IO for
+  different loops runs in parallel. Connections are spread round-robin over the loops,
+  accepted sockets are handed over to their connection's loop. The first "main" loop
+  also has the listeners and the proactor timer and interrupt, and it polls the other
+  loops (see uv_backend_fd()) so a loop without a leader still gets IO turns from the
+  main loop leader. With the default of one loop there is a single leader as above.
+
   Function naming:
   - on_*() - libuv callbacks, called in leader thread via  uv_run().
   - leader_* - only called in leader thread from
@@ -73,7 +87,7 @@
 const char *AMQP_PORT = "5672";
 const char *AMQP_PORT_NAME = "amqp";
 
-PN_HANDLE(PN_PROACTOR)
+static const pn_handle_t PN_PROACTOR = PN_RECORD_SLOT(1);
 
 /* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
    CLASSDEF is for identification when used as a pn_event_t context.
@@ -114,11 +128,14 @@ static int unqueued;            /* Provide invalid address for _unqueued pointer
 /* All work structs and UV callback data structs start with a struct_type member  */
 typedef enum { T_CONNECTION, T_LISTENER, T_LSOCKET } struct_type;
 
+struct loop_t;
+
 /* A stream of serialized work for the proactor */
 typedef struct work_t {
   /* Immutable */
   struct_type type;
   pn_proactor_t *proactor;
+  struct loop_t *loop;               /* UV loop that does IO for this work */
 
   /* Protected by proactor.lock */
   struct work_t* next;
@@ -127,8 +144,83 @@ typedef struct work_t {
 
 QUEUE_DECL(work)
 
+/*
+  Connections read and write through pool buffers of their loop, so IO goes on while a
+  worker has the driver. Input is read into buffers queued on the connection and given
+  to the transport when the leader next has it. Output is copied out of the transport
+  and several buffers go in one uv_write() request, the transport does not wait for the
+  write to complete. A connection holds at most IOBUF_MAX buffers of unread input and of
+  unwritten output: past that reading stops and output waits in the transport.
+  PN_PROACTOR_PREWARM_IOBUFS=N allocates N buffers for each loop's pool up front.
+*/
+#define IOBUF_SIZE (16 * 1024)
+#define IOBUF_MAX 8
+#define IOBUF_POOL 64           /* Free buffers kept by each loop */
+
+typedef struct iobuf_t {
+  struct iobuf_t *next;
+  uv_write_t write;             /* First buffer of a write request only */
+  size_t len;                   /* Bytes of data */
+  size_t pos;                   /* Bytes given to the transport, input only */
+  char data[IOBUF_SIZE];
+} iobuf_t;
+
+/* A UV loop with its own leader thread, see PN_PROACTOR_LOOPS */
+typedef struct loop_t {
+  uv_loop_t loop;
+  uv_async_t notify;            /* Notify the leader of this loop */
+
+  /* Other loops only, handles in the main loop to poll this loop when it has no leader */
+  uv_poll_t embed;
+  uv_timer_t embed_timer;
+
+  /* Only used by the leader */
+  iobuf_t *iobufs;              /* Free buffers */
+  size_t iobufs_len;
+
+  /* Protected by proactor.lock */
+  work_queue_t leader_q;        /* waiting for attention by the leader thread */
+  bool has_leader;              /* A thread is working as leader */
+  bool disconnect;              /* disconnect requested */
+  bool ready;                   /* Needs a turn from the main loop leader */
+} loop_t;
+
+static loop_t *proactor_main_loop(pn_proactor_t *p);
+
+static iobuf_t *iobuf_get(loop_t *lp) {
+  iobuf_t *b = lp->iobufs;
+  if (b) {
+    lp->iobufs = b->next;
+    --lp->iobufs_len;
+  } else if (!(b = (iobuf_t*)malloc(sizeof(iobuf_t)))) {
+    return NULL;
+  }
+  b->next = NULL;
+  b->len = b->pos = 0;
+  return b;
+}
+
+static void iobuf_put(loop_t *lp, iobuf_t *b) {
+  if (lp->iobufs_len < IOBUF_POOL) {
+    b->next = lp->iobufs;
+    lp->iobufs = b;
+    ++lp->iobufs_len;
+  } else {
+    free(b);
+  }
+}
+
+static void iobufs_free(iobuf_t *b) {
+  while (b) {
+    iobuf_t *next = b->next;
+    free(b);
+    b = next;
+  }
+}
+
 static void work_init(work_t* w, pn_proactor_t* p, struct_type type) {
   w->proactor = p;
+  w->loop = proactor_main_loop(p);
   w->next = work_unqueued;
   w->type = type;
   w->working = true;
@@ -144,11 +236,17 @@ typedef struct addr_t {
   struct addrinfo* addrinfo;    /* The current addrinfo being tried */
 } addr_t;
 
+/* A TCP socket, or a pipe for a unix: address */
+typedef union sock_t {
+  uv_tcp_t tcp;
+  uv_pipe_t pipe;
+} sock_t;
+
 /* A single listening socket, a listener can have more than one */
 typedef struct lsocket_t {
   struct_type type;             /* Always T_LSOCKET */
   pn_listener_t *parent;
-  uv_tcp_t tcp;
+  sock_t sock;
   struct lsocket_t *next;
 } lsocket_t;
 
@@ -168,9 +266,11 @@ typedef struct pconnection_t {
   /* Only used by owner thread */
   pn_connection_driver_t driver;
 
-  /* Only used by leader */
-  uv_tcp_t tcp;
+  /* Only used by leader of work.loop */
+  sock_t sock;
+  bool unix_socket;             /* sock is a pipe */
   addr_t addr;
+  int accepted_fd;              /* Accepted socket from another loop, not yet opened */
 
   uv_connect_t connect;         /* Outgoing connection only */
   int connected;      /* 0: not connected, <0: connecting after error, 1 = connected ok */
@@ -179,15 +279,33 @@ typedef struct pconnection_t {
 
   struct pn_netaddr_t local, remote; /* Actual addresses */
   uv_timer_t timer;
-  uv_write_t write;
-  size_t writing;               /* size of pending write request, 0 if none pending */
   uv_shutdown_t shutdown;
+  iobuf_t *input, *input_last;  /* Read, not yet given to the transport */
+  size_t input_len;             /* Buffers in input */
+  int read_err;                 /* Read error or UV_EOF, given to the transport after input */
+  bool reading;                 /* uv_read_start() is in effect */
+  size_t writing;               /* Buffers in write requests not yet completed */
+  int write_err;                /* First write error, not yet given to the transport */
 
   /* Locked for thread-safe access */
   uv_mutex_t lock;
   wake_state wake;
+
+  /* Latency statistics, NULL unless the proactor keeps them */
+  pn_proactor_stats_t *stats;
+  uint64_t ready_time;          /* Leader: read completed, not yet dispatched */
+  uint64_t queue_time;          /* proactor.lock: pushed on worker_q */
+  uint64_t batch_start;         /* Owner thread: batch returned */
+  uint64_t flush_start;         /* Leader: first write request of pending output started */
 } pconnection_t;
 
+/* Record a duration for a connection and its proactor, call only if pc->stats */
+#define PCONNECTION_STAT(PC, FIELD, NS) do {                            \
+    uint64_t ns_ = (NS);                                                \
+    pni_histogram_record(&(PC)->stats->FIELD, ns_);                     \
+    pni_histogram_record(&(PC)->work.proactor->stats->FIELD, ns_);      \
+  } while (0)
+
 QUEUE_DECL(pconnection)
 
 typedef enum {
@@ -207,6 +325,7 @@ struct pn_listener_t {
   pn_record_t *attachments;
   void *context;
   size_t backlog;
+  bool reuseport;               /* Share the port with other listeners */
 
   /* Only used by leader */
   addr_t addr;
@@ -219,6 +338,7 @@ struct pn_listener_t {
   pn_condition_t *condition;
   pn_collector_t *collector;
   pconnection_queue_t accept;   /* pconnection_t list for accepting */
+  size_t pending;               /* PN_LISTENER_ACCEPT events not yet accepted */
   listener_state state;
 };
 
@@ -226,13 +346,13 @@ typedef enum { TM_NONE, TM_REQUEST, TM_PENDING, TM_FIRED } timeout_state_t;
 
 struct pn_proactor_t {
   /* Notification */
-  uv_async_t notify;
   uv_async_t interrupt;
 
-  /* Leader thread  */
+  /* Leader threads, the main loop is loops[0] */
   uv_cond_t cond;
-  uv_loop_t loop;
-  uv_timer_t timer;
+  loop_t *loops;
+  size_t loops_len;
+  uv_timer_t timer;             /* In the main loop */
 
   /* Owner thread: proactor collector and batch can belong to leader or a worker */
   pn_collector_t *collector;
@@ -241,23 +361,28 @@ struct pn_proactor_t {
   /* Protected by lock */
   uv_mutex_t lock;
   work_queue_t worker_q; /* ready for work, to be returned via pn_proactor_wait()  */
-  work_queue_t leader_q; /* waiting for attention by the leader thread */
   timeout_state_t timeout_state;
   pn_millis_t timeout;
   size_t active;         /* connection/listener count for INACTIVE events */
   pn_condition_t *disconnect_cond; /* disconnect condition */
+  size_t disconnect_pending;   /* loops that have not yet handled the disconnect */
+  size_t next_loop;            /* round-robin loop for new connections */
 
-  bool has_leader;             /* A thread is working as leader */
-  bool disconnect;             /* disconnect requested */
   bool batch_working;          /* batch is being processed in a worker thread */
   bool need_interrupt;         /* Need a PN_PROACTOR_INTERRUPT event */
   bool need_inactive;          /* need INACTIVE event */
+
+  pn_proactor_stats_t *stats;  /* NULL unless PN_PROACTOR_STATS is set */
 };
 
 
-/* Notify the leader thread that there is something to do outside of uv_run() */
-static inline void notify(pn_proactor_t* p) {
-  uv_async_send(&p->notify);
+static loop_t *proactor_main_loop(pn_proactor_t *p) {
+  return &p->loops[0];
+}
+
+/* Notify the leader thread of a loop that there is something to do outside of uv_run() */
+static inline void notify(loop_t* lp) {
+  uv_async_send(&lp->notify);
 }
 
 /* Set the interrupt flag in the leader thread to avoid race conditions. */
@@ -275,8 +400,8 @@ static void work_notify(work_t *w) {
      It will be processed in pn_proactor_done() or when the queue it is on is processed.
   */
   if (!w->working && w->next == work_unqueued) {
-    work_push(&w->proactor->leader_q, w);
-    notify(w->proactor);
+    work_push(&w->loop->leader_q, w);
+    notify(w->loop);
   }
   uv_mutex_unlock(&w->proactor->lock);
 }
@@ -286,10 +411,10 @@ static void work_start(work_t *w) {
   uv_mutex_lock(&w->proactor->lock);
   if (w->next == work_unqueued) {  /* No-op if already queued */
     w->working = false;
-    work_push(&w->proactor->leader_q, w);
-    notify(w->proactor);
-    uv_mutex_unlock(&w->proactor->lock);
+    work_push(&w->loop->leader_q, w);
+    notify(w->loop);
   }
+  uv_mutex_unlock(&w->proactor->lock);
 }
 
 static void parse_addr(addr_t *addr, const char *str) {
@@ -305,7 +430,8 @@ static void parse_addr(addr_t *addr, const char *str) {
 
 static void pconnection_finalize(void *vp_pconnection) {
   pconnection_t *pc = (pconnection_t*)vp_pconnection;
-  uv_mutex_destroy(&pc->lock);   /* Only the lock is left to clean up */
+  uv_mutex_destroy(&pc->lock);   /* Only the lock and stats are left to clean up */
+  free(pc->stats);
 }
 
 
@@ -321,9 +447,17 @@ static pconnection_t *pconnection(pn_proactor_t *p, pn_connection_t *c, bool ser
   if (!pc || pn_connection_driver_init(&pc->driver, c, NULL) != 0) {
     return NULL;
   }
+  pni_proactor_capture(pc->driver.transport);
+  pni_proactor_prewarm(pc->driver.connection, pc->driver.collector);
+  if (p->stats) {
+    pc->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*pc->stats));
+  }
   work_init(&pc->work, p,  T_CONNECTION);
+  uv_mutex_lock(&p->lock);
+  pc->work.loop = &p->loops[p->next_loop++ % p->loops_len];
+  uv_mutex_unlock(&p->lock);
+  pc->accepted_fd = -1;
   pc->next = pconnection_unqueued;
-  pc->write.data = &pc->work;
   if (server) {
     pn_transport_set_server(pc->driver.transport);
   }
@@ -384,6 +518,13 @@ static void pconnection_free(pconnection_t *pc) {
   if (pc->addr.getaddrinfo.addrinfo) {
     uv_freeaddrinfo(pc->addr.getaddrinfo.addrinfo); /* Interrupted after resolve */
   }
+#ifndef _WIN32
+  if (pc->accepted_fd >= 0) {
+    close(pc->accepted_fd);     /* Interrupted before being opened */
+  }
+#endif
+  iobufs_free(pc->input);       /* Write requests were cancelled before the close */
+  pc->input = pc->input_last = NULL;
   pn_incref(pc);                /* Make sure we don't do a circular free */
   pn_connection_driver_destroy(&pc->driver);
   pn_decref(pc);
@@ -485,17 +626,68 @@ static void listener_error(pn_listener_t *l, int err, const char* what) {
   uv_mutex_unlock(&l->lock);
 }
 
+/* The socket path of a unix: address, NULL for TCP */
+static inline const char *addr_path(const addr_t *addr) {
+#ifndef _WIN32
+  return pni_unix_path(addr->host, addr->port);
+#else
+  return NULL;                  /* UV pipes are named pipes on Windows */
+#endif
+}
+
+static int sock_init(uv_loop_t *loop, sock_t *sock, bool is_pipe) {
+  return is_pipe ? uv_pipe_init(loop, &sock->pipe, 0) : uv_tcp_init(loop, &sock->tcp);
+}
+
+#ifndef _WIN32
+/* Abstract names ("@name") need the explicit length pipe functions */
+#define ABSTRACT_PIPES (UV_VERSION_HEX >= 0x012e00)
+
+#if ABSTRACT_PIPES
+static size_t abstract_name(const char *path, char *name, size_t size) {
+  size_t len = strlen(path);
+  if (len > size) len = size;
+  name[0] = '\0';
+  memcpy(name + 1, path + 1, len - 1);
+  return len;
+}
+#endif
+
+static int pipe_bind(uv_pipe_t *pipe, const char *path) {
+  if (*path != '@') return uv_pipe_bind(pipe, path);
+#if ABSTRACT_PIPES
+  char name[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  return uv_pipe_bind2(pipe, name, abstract_name(path, name, sizeof(name)), 0);
+#else
+  return UV_EAFNOSUPPORT;
+#endif
+}
+
+static int pipe_connect(uv_connect_t *connect, uv_pipe_t *pipe, const char *path, uv_connect_cb cb) {
+  if (*path != '@') {
+    uv_pipe_connect(connect, pipe, path, cb); /* Errors are reported to cb */
+    return 0;
+  }
+#if ABSTRACT_PIPES
+  char name[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  return uv_pipe_connect2(connect, pipe, name, abstract_name(path, name, sizeof(name)), 0, cb);
+#else
+  return UV_EAFNOSUPPORT;
+#endif
+}
+#endif
+
 static int pconnection_init(pconnection_t *pc) {
   int err = 0;
-  err = uv_tcp_init(&pc->work.proactor->loop, &pc->tcp);
+  err = sock_init(&pc->work.loop->loop, &pc->sock, pc->unix_socket);
   if (!err) {
-    pc->tcp.data = pc;
+    pc->sock.tcp.data = pc;
     pc->connect.data = pc;
-    err = uv_timer_init(&pc->work.proactor->loop, &pc->timer);
+    err = uv_timer_init(&pc->work.loop->loop, &pc->timer);
     if (!err) {
       pc->timer.data = pc;
     } else {
-      uv_close((uv_handle_t*)&pc->tcp, NULL);
+      uv_close((uv_handle_t*)&pc->sock, NULL);
     }
   }
   if (!err) {
@@ -511,7 +703,7 @@ static void try_connect(pconnection_t *pc);
 static void on_connect_fail(uv_handle_t *handle) {
   pconnection_t *pc = (pconnection_t*)handle->data;
   /* Create a new TCP socket, the current one is closed */
-  int err = uv_tcp_init(&pc->work.proactor->loop, &pc->tcp);
+  int err = sock_init(&pc->work.loop->loop, &pc->sock, pc->unix_socket);
   if (err) {
     pc->connected = err;
     pc->addr.addrinfo = NULL; /* No point in trying anymore, we can't create a socket */
@@ -521,11 +713,23 @@ static void on_connect_fail(uv_handle_t *handle) {
 }
 
 static void pconnection_addresses(pconnection_t *pc) {
+#ifndef _WIN32
+  if (pc->unix_socket) {
+    uv_os_fd_t fd;
+    if (!uv_fileno((uv_handle_t*)&pc->sock, &fd)) {
+      socklen_t len = sizeof(pc->local.ss);
+      getsockname(fd, (struct sockaddr*)&pc->local.ss, &len);
+      len = sizeof(pc->remote.ss);
+      getpeername(fd, (struct sockaddr*)&pc->remote.ss, &len);
+    }
+    return;
+  }
+#endif
   int len;
   len = sizeof(pc->local.ss);
-  uv_tcp_getsockname(&pc->tcp, (struct sockaddr*)&pc->local.ss, &len);
+  uv_tcp_getsockname(&pc->sock.tcp, (struct sockaddr*)&pc->local.ss, &len);
   len = sizeof(pc->remote.ss);
-  uv_tcp_getpeername(&pc->tcp, (struct sockaddr*)&pc->remote.ss, &len);
+  uv_tcp_getpeername(&pc->sock.tcp, (struct sockaddr*)&pc->remote.ss, &len);
 }
 
 /* Outgoing connection */
@@ -539,7 +743,7 @@ static void on_connect(uv_connect_t *connect, int err) {
     pc->addr.getaddrinfo.addrinfo = NULL;
   } else {
     pconnection_bad_connect(pc, err);
-    uv_safe_close((uv_handle_t*)&pc->tcp, on_connect_fail); /* Try the next addr if there is one */
+    uv_safe_close((uv_handle_t*)&pc->sock, on_connect_fail); /* Try the next addr if there is one */
   }
 }
 
@@ -560,13 +764,14 @@ static void on_connection(uv_stream_t* server, int err) {
   } else {
     uv_mutex_lock(&l->lock);
     pn_collector_put(l->collector, lsocket__class(), ls, PN_LISTENER_ACCEPT);
+    ++l->pending;
     uv_mutex_unlock(&l->lock);
   }
   work_notify(&l->work);
 }
 
 /* Common address resolution for leader_listen and leader_connect */
-static int leader_resolve(pn_proactor_t *p, addr_t *addr, bool listen) {
+static int leader_resolve(loop_t *lp, addr_t *addr, bool listen) {
   struct addrinfo hints = { 0 };
   hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
@@ -577,13 +782,26 @@ static int leader_resolve(pn_proactor_t *p, addr_t *addr, bool listen) {
   if (listen) {
     hints.ai_flags |= AI_PASSIVE | AI_ALL;
   }
-  int err = uv_getaddrinfo(&p->loop, &addr->getaddrinfo, NULL, addr->host, addr->port, &hints);
+  int err = uv_getaddrinfo(&lp->loop, &addr->getaddrinfo, NULL, addr->host, addr->port, &hints);
   addr->addrinfo = addr->getaddrinfo.addrinfo; /* Start with the first addrinfo */
   return err;
 }
 
 /* Try to connect to the current addrinfo. Called by leader and via callbacks for retry.*/
 static void try_connect(pconnection_t *pc) {
+#ifndef _WIN32
+  if (pc->unix_socket) {        /* A single address, no retries */
+    int err = pc->connected;
+    if (!err) {
+      err = pipe_connect(&pc->connect, &pc->sock.pipe, addr_path(&pc->addr), on_connect);
+      if (!err) return;
+      pconnection_bad_connect(pc, err);
+    }
+    pconnection_error(pc, err, "connecting to");
+    work_notify(&pc->work);
+    return;
+  }
+#endif
   struct addrinfo *ai = pc->addr.addrinfo;
   if (!ai) {                    /* End of list, connect fails */
     uv_freeaddrinfo(pc->addr.getaddrinfo.addrinfo);
@@ -593,17 +811,21 @@ static void try_connect(pconnection_t *pc) {
     work_notify(&pc->work);
   } else {
     pc->addr.addrinfo = ai->ai_next; /* Advance for next attempt */
-    int err = uv_tcp_connect(&pc->connect, &pc->tcp, ai->ai_addr, on_connect);
+    int err = uv_tcp_connect(&pc->connect, &pc->sock.tcp, ai->ai_addr, on_connect);
     if (err) {
       pconnection_bad_connect(pc, err);
-      uv_close((uv_handle_t*)&pc->tcp, on_connect_fail); /* Queue up next attempt */
+      uv_close((uv_handle_t*)&pc->sock, on_connect_fail); /* Queue up next attempt */
     }
   }
 }
 
 static bool leader_connect(pconnection_t *pc) {
+  pc->unix_socket = addr_path(&pc->addr) != NULL;
+  if (pc->unix_socket) {        /* Nothing to resolve */
+    pc->addr.getaddrinfo.addrinfo = pc->addr.addrinfo = NULL;
+  }
   int err = pconnection_init(pc);
-  if (!err) err = leader_resolve(pc->work.proactor, &pc->addr, false);
+  if (!err && !pc->unix_socket) err = leader_resolve(pc->work.loop, &pc->addr, false);
   if (err) {
     pconnection_error(pc, err, "on connect resolving");
     return true;
@@ -613,26 +835,40 @@ static bool leader_connect(pconnection_t *pc) {
   }
 }
 
-static int lsocket(pn_listener_t *l, struct addrinfo *ai) {
+/* Load-balanced SO_REUSEPORT binding arrived in libuv 1.49 */
+#define REUSEPORT (UV_VERSION_HEX >= 0x013100)
+
+/* Listen on ai, or on path for a unix: address */
+static int lsocket(pn_listener_t *l, struct addrinfo *ai, const char *path) {
   lsocket_t *ls = (lsocket_t*)calloc(1, sizeof(lsocket_t));
   ls->type = T_LSOCKET;
-  ls->tcp.data = ls;
+  ls->sock.tcp.data = ls;
   ls->parent = NULL;
   ls->next = NULL;
-  int err = uv_tcp_init(&l->work.proactor->loop, &ls->tcp);
+  int err = sock_init(&l->work.loop->loop, &ls->sock, path != NULL);
   if (err) {
     free(ls);                   /* Will never be closed */
   } else {
-    int flags = (ai->ai_family == AF_INET6) ? UV_TCP_IPV6ONLY : 0;
-    err = uv_tcp_bind(&ls->tcp, ai->ai_addr, flags);
-    if (!err) err = uv_listen((uv_stream_t*)&ls->tcp, l->backlog, on_connection);
+#ifndef _WIN32
+    if (path) {
+      err = pipe_bind(&ls->sock.pipe, path);
+    } else
+#endif
+    {
+      int flags = (ai->ai_family == AF_INET6) ? UV_TCP_IPV6ONLY : 0;
+#if REUSEPORT
+      if (l->reuseport) flags |= UV_TCP_REUSEPORT;
+#endif
+      err = uv_tcp_bind(&ls->sock.tcp, ai->ai_addr, flags);
+    }
+    if (!err) err = uv_listen((uv_stream_t*)&ls->sock, l->backlog, on_connection);
     if (!err) {
       /* Add to l->lsockets list */
       ls->parent = l;
       ls->next = l->lsockets;
       l->lsockets = ls;
     } else {
-      uv_close((uv_handle_t*)&ls->tcp, on_close_lsocket); /* Freed by on_close_lsocket */
+      uv_close((uv_handle_t*)&ls->sock, on_close_lsocket); /* Freed by on_close_lsocket */
     }
   }
   return err;
@@ -643,11 +879,12 @@ static int lsocket(pn_listener_t *l, struct addrinfo *ai) {
 /* Listen on all available addresses */
 static void leader_listen_lh(pn_listener_t *l) {
   add_active(l->work.proactor);
-  int err = leader_resolve(l->work.proactor, &l->addr, true);
-  if (!err) {
+  const char *path = addr_path(&l->addr);
+  int err = path ? lsocket(l, NULL, path) : leader_resolve(l->work.loop, &l->addr, true);
+  if (!err && !path) {
     /* Find the working addresses */
     for (struct addrinfo *ai = l->addr.getaddrinfo.addrinfo; ai; ai = ai->ai_next) {
-      int err2 = lsocket(l, ai);
+      int err2 = lsocket(l, ai, NULL);
       if (err2) {
         err = err2;
       }
@@ -678,11 +915,59 @@ void pn_listener_free(pn_listener_t *l) {
       l->lsockets = ls->next;
       free(ls);
     }
-    assert(!l->accept.front);
+    /* Accepted but never processed, e.g. the proactor was freed */
+    for (pconnection_t *pc = pconnection_pop(&l->accept); pc; pc = pconnection_pop(&l->accept)) {
+      pconnection_free(pc);
+    }
     free(l);
   }
 }
 
+#ifndef _WIN32
+static void on_close_free(uv_handle_t *h) {
+  free(h);
+}
+
+/* UV handles can't move between loops: accept with a temporary handle in the listener's
+   loop and keep a duplicate of the socket for the connection's loop to open.
+*/
+static int leader_accept_fd(pn_listener_t *l, pconnection_t *pc) {
+  sock_t *sock = (sock_t*)malloc(sizeof(sock_t));
+  int err = sock ? sock_init(&l->work.loop->loop, sock, pc->unix_socket) : UV_ENOMEM;
+  if (err) {
+    free(sock);
+    return err;
+  }
+  err = uv_accept((uv_stream_t*)&pc->lsocket->sock, (uv_stream_t*)sock);
+  if (!err) {
+    uv_os_fd_t fd;
+    err = uv_fileno((uv_handle_t*)sock, &fd);
+    if (!err) {
+      pc->accepted_fd = dup(fd);
+      if (pc->accepted_fd < 0) err = uv_translate_sys_error(errno);
+    }
+  }
+  uv_close((uv_handle_t*)sock, on_close_free);
+  return err;
+}
+
+/* Open a socket accepted by leader_accept_fd() in the connection's loop */
+static void leader_open_accepted(pconnection_t *pc) {
+  int fd = pc->accepted_fd;
+  pc->accepted_fd = -1;
+  int err = pconnection_init(pc);
+  if (!err) {
+    err = pc->unix_socket ? uv_pipe_open(&pc->sock.pipe, fd) : uv_tcp_open(&pc->sock.tcp, fd);
+    if (!err) {
+      pconnection_addresses(pc);
+      return;
+    }
+    pconnection_error(pc, err, "accepting from");
+  }
+  close(fd);
+}
+#endif
+
 /* Process a listener, return true if it has events for a worker thread */
 static bool leader_process_listener(pn_listener_t *l) {
   /* NOTE: l may be concurrently accessed by on_connection() */
@@ -691,12 +976,20 @@ static bool leader_process_listener(pn_listener_t *l) {
 
   /* Process accepted connections */
   for (pconnection_t *pc = pconnection_pop(&l->accept); pc; pc = pconnection_pop(&l->accept)) {
-    int err = pconnection_init(pc);
-    if (!err) err = uv_accept((uv_stream_t*)&pc->lsocket->tcp, (uv_stream_t*)&pc->tcp);
-    if (!err) {
-      pconnection_addresses(pc);
-    } else {
-      listener_error(l, err, "accepting from");
+    int err = 0;
+    pc->unix_socket = addr_path(&l->addr) != NULL;
+#ifndef _WIN32
+    if (pc->work.loop != l->work.loop) {
+      err = leader_accept_fd(l, pc);
+    } else
+#endif
+    {
+      err = pconnection_init(pc);
+      if (!err) err = uv_accept((uv_stream_t*)&pc->lsocket->sock, (uv_stream_t*)&pc->sock);
+      if (!err) pconnection_addresses(pc);
+    }
+    if (err) {
+      listener_error_lh(l, err, "accepting from");
       pconnection_error(pc, err, "accepting from");
     }
     work_start(&pc->work);      /* Process events for the accepted/failed connection */
@@ -715,7 +1008,11 @@ static bool leader_process_listener(pn_listener_t *l) {
    case L_CLOSE:                /* Close requested, start closing lsockets */
     l->state = L_CLOSING;
     for (lsocket_t *ls = l->lsockets; ls; ls = ls->next) {
-      uv_safe_close((uv_handle_t*)&ls->tcp, on_close_lsocket);
+      uv_safe_close((uv_handle_t*)&ls->sock, on_close_lsocket);
+    }
+    {
+      const char *path = addr_path(&l->addr);
+      if (path && *path != '@' && l->lsockets) unlink(path); /* Remove the socket file we bound */
     }
     /* NOTE: Fall through in case we have 0 sockets - e.g. resolver error */
 
@@ -754,28 +1051,42 @@ static void on_tick(uv_timer_t *timer) {
   work_notify(&pc->work);
 }
 
+/* Input goes to the connection's buffers, a worker may have the driver */
 static void on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
   pconnection_t *pc = (pconnection_t*)stream->data;
   if (nread > 0) {
-    pn_connection_driver_read_done(&pc->driver, nread);
-  } else if (nread < 0) {
-    if (nread != UV_EOF) { /* hangup */
-      pconnection_set_error(pc, nread, "on read from");
+    pc->input_last->len += nread;
+    if (pc->stats && !pc->ready_time) {
+      pc->ready_time = pni_proactor_stats_now();
     }
-    pn_connection_driver_close(&pc->driver);
+    if (pc->input_len >= IOBUF_MAX && pc->input_last->len == IOBUF_SIZE) {
+      uv_read_stop(stream);     /* Restarted by the leader as the transport takes input */
+      pc->reading = false;
+    }
+  } else if (nread < 0) {
+    pc->read_err = nread;       /* Hangup or error, after the input before it */
+    uv_read_stop(stream);
+    pc->reading = false;
   }
   work_notify(&pc->work);
 }
 
 static void on_write(uv_write_t* write, int err) {
   pconnection_t *pc = (pconnection_t*)write->data;
-  size_t size = pc->writing;
-  pc->writing = 0;
-  if (err) {
-    pconnection_set_error(pc, err, "on write to");
-    pn_connection_driver_write_close(&pc->driver);
-  } else if (!pn_connection_driver_write_closed(&pc->driver)) {
-    pn_connection_driver_write_done(&pc->driver, size);
+  loop_t *lp = pc->work.loop;
+  iobuf_t *b = (iobuf_t*)((char*)write - offsetof(iobuf_t, write));
+  while (b) {
+    iobuf_t *next = b->next;
+    iobuf_put(lp, b);
+    --pc->writing;
+    b = next;
+  }
+  if (err && !pc->write_err) {
+    pc->write_err = err;
+  }
+  if (pc->flush_start && !pc->writing) {
+    PCONNECTION_STAT(pc, flush, pni_proactor_stats_now() - pc->flush_start);
+    pc->flush_start = 0;
   }
   work_notify(&pc->work);
 }
@@ -786,15 +1097,112 @@ static void on_timeout(uv_timer_t *timer) {
   if (p->timeout_state == TM_PENDING) { /* Only fire if still pending */
     p->timeout_state = TM_FIRED;
   }
-  uv_stop(&p->loop);            /* UV does not always stop after on_timeout without this */
+  uv_stop(timer->loop);         /* UV does not always stop after on_timeout without this */
   uv_mutex_unlock(&p->lock);
 }
 
-/* Read buffer allocation function for uv, just returns the transports read buffer. */
+/* Read buffer allocation function for uv, the free space of the last input buffer */
 static void alloc_read_buffer(uv_handle_t* stream, size_t size, uv_buf_t* buf) {
   pconnection_t *pc = (pconnection_t*)stream->data;
-  pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
-  *buf = uv_buf_init(rbuf.start, rbuf.size);
+  iobuf_t *b = pc->input_last;
+  if (!b || b->len == IOBUF_SIZE) {
+    if (!(b = iobuf_get(pc->work.loop))) {
+      *buf = uv_buf_init(NULL, 0); /* on_read() gets UV_ENOBUFS */
+      return;
+    }
+    if (pc->input_last) {
+      pc->input_last->next = b;
+    } else {
+      pc->input = b;
+    }
+    pc->input_last = b;
+    ++pc->input_len;
+  }
+  *buf = uv_buf_init(b->data + b->len, IOBUF_SIZE - b->len);
+}
+
+/* Give the transport the input read so far, and any read or write error after it */
+static void leader_input(pconnection_t *pc) {
+  loop_t *lp = pc->work.loop;
+  bool rclosed = pn_connection_driver_read_closed(&pc->driver);
+  while (pc->input) {
+    iobuf_t *b = pc->input;
+    while (b->pos < b->len && !rclosed) {
+      pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
+      if (rbuf.size == 0) {
+        return;                 /* Transport is full */
+      }
+      size_t n = b->len - b->pos < rbuf.size ? b->len - b->pos : rbuf.size;
+      memcpy(rbuf.start, b->data + b->pos, n);
+      pn_connection_driver_read_done(&pc->driver, n);
+      b->pos += n;
+      rclosed = pn_connection_driver_read_closed(&pc->driver);
+    }
+    if (b == pc->input_last && pc->reading) {
+      b->len = b->pos = 0;      /* Reading may go on into it */
+      break;
+    }
+    pc->input = b->next;
+    if (!pc->input) {
+      pc->input_last = NULL;
+    }
+    --pc->input_len;
+    iobuf_put(lp, b);
+  }
+  if (pc->read_err && !pc->input) {
+    if (pc->read_err != UV_EOF) {
+      pconnection_set_error(pc, pc->read_err, "on read from");
+    }
+    pn_connection_driver_close(&pc->driver);
+    pc->read_err = 0;
+  }
+  if (pc->write_err) {
+    pconnection_set_error(pc, pc->write_err, "on write to");
+    pn_connection_driver_write_close(&pc->driver);
+    pc->write_err = 0;
+  }
+}
+
+/* Copy the transport's output to buffers and write them in one request */
+static int leader_write(pconnection_t *pc) {
+  loop_t *lp = pc->work.loop;
+  uv_buf_t bufs[IOBUF_MAX];
+  iobuf_t *first = NULL, *last = NULL;
+  size_t n = 0;
+  while (pc->writing + n < IOBUF_MAX) {
+    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
+    if (wbuf.size == 0) {
+      break;
+    }
+    iobuf_t *b = iobuf_get(lp);
+    if (!b) {
+      break;                    /* Output waits in the transport */
+    }
+    b->len = wbuf.size < IOBUF_SIZE ? wbuf.size : IOBUF_SIZE;
+    memcpy(b->data, wbuf.start, b->len);
+    pn_connection_driver_write_done(&pc->driver, b->len);
+    bufs[n++] = uv_buf_init(b->data, b->len);
+    if (last) {
+      last->next = b;
+    } else {
+      first = b;
+    }
+    last = b;
+  }
+  if (!n) {
+    return 0;
+  }
+  first->write.data = pc;
+  int err = uv_write(&first->write, (uv_stream_t*)&pc->sock, bufs, n, on_write);
+  if (err) {
+    iobufs_free(first);
+    return err;
+  }
+  pc->writing += n;
+  if (pc->stats && !pc->flush_start) {
+    pc->flush_start = pni_proactor_stats_now();
+  }
+  return 0;
 }
 
 /* Set the event in the proactor's batch  */
@@ -806,7 +1214,7 @@ static pn_event_batch_t *proactor_batch_lh(pn_proactor_t *p, pn_event_type_t t)
 
 static pn_event_t *log_event(void* p, pn_event_t *e) {
   if (e) {
-    pn_logf("[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+    pn_log(PN_SUBSYSTEM_EVENT, PN_LEVEL_TRACE, "[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
   }
   return e;
 }
@@ -845,8 +1253,18 @@ static pn_event_batch_t *get_batch_lh(pn_proactor_t *p) {
   for (work_t *w = work_pop(&p->worker_q); w; w = work_pop(&p->worker_q)) {
     assert(w->working);
     switch (w->type) {
-     case T_CONNECTION:
-      return &((pconnection_t*)w)->driver.batch;
+     case T_CONNECTION: {
+       pconnection_t *pc = (pconnection_t*)w;
+       if (pc->stats) {
+         pc->batch_start = pni_proactor_stats_now();
+         PCONNECTION_STAT(pc, wake, pc->batch_start - pc->queue_time);
+         if (pc->ready_time) {
+           PCONNECTION_STAT(pc, dispatch, pc->batch_start - pc->ready_time);
+           pc->ready_time = 0;
+         }
+       }
+       return &pc->driver.batch;
+     }
      case T_LISTENER:
       return &((pn_listener_t*)w)->batch;
      default:
@@ -870,28 +1288,34 @@ static void check_wake(pconnection_t *pc) {
 /* Process a pconnection, return true if it has events for a worker thread */
 static bool leader_process_pconnection(pconnection_t *pc) {
   /* Important to do the following steps in order */
+#ifndef _WIN32
+  if (pc->accepted_fd >= 0) {
+    leader_open_accepted(pc);
+  }
+#endif
   if (!pc->connected) {
     return leader_connect(pc);
   }
-  if (pc->writing) {
-    /* We can't do anything while a write request is pending */
-    return false;
-  }
   /* Must process INIT and BOUND events before we do any IO-related stuff  */
   if (pn_connection_driver_has_event(&pc->driver)) {
     return true;
   }
+  leader_input(pc);
   if (pn_connection_driver_finished(&pc->driver)) {
+    if (pc->writing) {
+      return false;             /* Let the last output go before closing */
+    }
     uv_mutex_lock(&pc->lock);
     pc->wake = W_CLOSED;        /* wake() is a no-op from now on */
     uv_mutex_unlock(&pc->lock);
-    uv_safe_close((uv_handle_t*)&pc->tcp, on_close_pconnection);
+    uv_safe_close((uv_handle_t*)&pc->sock, on_close_pconnection);
   } else {
     /* Check for events that can be generated without blocking for IO */
     check_wake(pc);
     pn_millis_t next_tick = leader_tick(pc);
-    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
-    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
+    if (pn_transport_get_disposition_delay(pc->driver.transport)) {
+      next_tick = leader_tick(pc); /* Deadline for dispositions held back by the write */
+    }
     /* If we still have no events, make async UV requests */
     if (!pn_connection_driver_has_event(&pc->driver)) {
       int err = 0;
@@ -902,19 +1326,17 @@ static bool leader_process_pconnection(pconnection_t *pc) {
       }
       if (!err) {
         what = "write";
-        if (wbuf.size > 0) {
-          uv_buf_t buf = uv_buf_init((char*)wbuf.start, wbuf.size);
-          err = uv_write(&pc->write, (uv_stream_t*)&pc->tcp, &buf, 1, on_write);
-          if (!err) {
-            pc->writing = wbuf.size;
-          }
-        } else if (pn_connection_driver_write_closed(&pc->driver)) {
-          uv_shutdown(&pc->shutdown, (uv_stream_t*)&pc->tcp, NULL);
+        err = leader_write(pc);
+        if (!err && !pc->writing && pn_connection_driver_write_closed(&pc->driver)) {
+          uv_shutdown(&pc->shutdown, (uv_stream_t*)&pc->sock, NULL);
         }
       }
-      if (!err && rbuf.size > 0) {
+      if (!err && !pc->reading && !pc->read_err && pc->input_len < IOBUF_MAX &&
+          !pn_connection_driver_read_closed(&pc->driver)) {
         what = "read";
-        err = uv_read_start((uv_stream_t*)&pc->tcp, alloc_read_buffer, on_read);
+        err = uv_read_start((uv_stream_t*)&pc->sock, alloc_read_buffer, on_read);
+        if (err == UV_EALREADY) err = 0; /* Still reading, newer libuv reports it */
+        pc->reading = !err;
       }
       if (err) {
         /* Some IO requests failed, generate the error events */
@@ -925,10 +1347,10 @@ static bool leader_process_pconnection(pconnection_t *pc) {
   return pn_connection_driver_has_event(&pc->driver);
 }
 
-/* Detach a connection from the UV loop so it can be used safely by a worker */
+/* Detach a connection from the UV loop so it can be used safely by a worker.
+   Reads and writes go on in the connection's buffers, only the timer uses the driver. */
 void pconnection_detach(pconnection_t *pc) {
-  if (pc->connected && !pc->writing) {           /* Can't detach while a write is pending */
-    uv_read_stop((uv_stream_t*)&pc->tcp);
+  if (pc->connected) {
     uv_timer_stop(&pc->timer);
   }
 }
@@ -963,23 +1385,23 @@ static void on_proactor_disconnect(uv_handle_t* h, void* v) {
   }
 }
 
-/* Process the leader_q and the UV loop, in the leader thread */
-static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, uv_run_mode mode) {
+/* Process the leader_q of a loop, in the loop's leader thread */
+static void leader_process_lh(pn_proactor_t *p, loop_t *lp) {
   /* Set timeout timer if there was a request, let it count down while we process work */
-  if (p->timeout_state == TM_REQUEST) {
+  if (lp == proactor_main_loop(p) && p->timeout_state == TM_REQUEST) {
     p->timeout_state = TM_PENDING;
     uv_timer_stop(&p->timer);
     uv_timer_start(&p->timer, on_timeout, p->timeout, 0);
   }
   /* If disconnect was requested, walk the socket list */
-  if (p->disconnect) {
-    p->disconnect = false;
+  if (lp->disconnect) {
+    lp->disconnect = false;
     uv_mutex_unlock(&p->lock);
-    uv_walk(&p->loop, on_proactor_disconnect, NULL);
+    uv_walk(&lp->loop, on_proactor_disconnect, NULL);
     uv_mutex_lock(&p->lock);
+    --p->disconnect_pending;
   }
-  pn_event_batch_t *batch = NULL;
-  for (work_t *w = work_pop(&p->leader_q); w; w = work_pop(&p->leader_q)) {
+  for (work_t *w = work_pop(&lp->leader_q); w; w = work_pop(&lp->leader_q)) {
     assert(!w->working);
 
     uv_mutex_unlock(&p->lock);  /* Unlock to process each item, may add more items to leader_q */
@@ -998,33 +1420,104 @@ static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, uv_run_mode mode) {
 
     if (has_work && !w->working && w->next == work_unqueued) {
       if (w->type == T_CONNECTION) {
-        pconnection_detach((pconnection_t*)w);
+        pconnection_t *pc = (pconnection_t*)w;
+        pconnection_detach(pc);
+        if (pc->stats) {
+          pc->queue_time = pni_proactor_stats_now();
+        }
       }
       w->working = true;
       work_push(&p->worker_q, w);
     }
   }
-  batch = get_batch_lh(p);      /* Check for work */
+}
+
+/* A loop without a leader has IO or a timer due, called in the main loop leader thread */
+static void on_embed(uv_poll_t *poll, int status, int events) {
+  loop_t *lp = (loop_t*)poll->data;
+  uv_poll_stop(&lp->embed);     /* Restarted by leader_embed_lh() */
+  uv_timer_stop(&lp->embed_timer);
+  pn_proactor_t *p = (pn_proactor_t*)lp->notify.data;
+  uv_mutex_lock(&p->lock);
+  lp->ready = true;
+  uv_mutex_unlock(&p->lock);
+}
+
+static void on_embed_timer(uv_timer_t *timer) {
+  on_embed(&((loop_t*)timer->data)->embed, 0, 0);
+}
+
+/* Give each ready loop without a leader a non-blocking turn, in the main loop leader thread.
+   Ready loops with a leader are left till the leader leaves, see leader_release_lh()
+*/
+static void leader_embed_lh(pn_proactor_t *p) {
+  for (size_t i = 1; i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    if (lp->ready && !lp->has_leader) {
+      lp->ready = false;
+      lp->has_leader = true;
+      leader_process_lh(p, lp);
+      uv_mutex_unlock(&p->lock);
+      uv_run(&lp->loop, UV_RUN_NOWAIT);
+      /* Poll again, the poll is level triggered so unfinished work is not lost */
+      uv_poll_start(&lp->embed, UV_READABLE, on_embed);
+      int timeout = uv_backend_timeout(&lp->loop);
+      if (timeout >= 0) uv_timer_start(&lp->embed_timer, on_embed_timer, timeout, 0);
+      uv_mutex_lock(&p->lock);
+      lp->has_leader = false;
+    }
+  }
+}
+
+/* Process the leader_q and the UV loop, in the leader thread */
+static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, loop_t *lp, uv_run_mode mode) {
+  leader_process_lh(p, lp);
+  if (lp == proactor_main_loop(p)) {
+    leader_embed_lh(p);
+  }
+  pn_event_batch_t *batch = get_batch_lh(p);      /* Check for work */
   if (!batch) {                 /* No work, run the UV loop */
     uv_mutex_unlock(&p->lock);  /* Unlock to run UV loop */
-    uv_run(&p->loop, mode);
+    uv_run(&lp->loop, mode);
     uv_mutex_lock(&p->lock);
     batch = get_batch_lh(p);
   }
   return batch;
 }
 
+/* Return a loop with no leader, preferring the main loop, or NULL */
+static loop_t *leader_loop_lh(pn_proactor_t *p) {
+  for (size_t i = 0; i < p->loops_len; ++i) {
+    if (!p->loops[i].has_leader) {
+      return &p->loops[i];
+    }
+  }
+  return NULL;
+}
+
+/* Stop leading lp. Other loops go back to being polled by the main loop. */
+static void leader_release_lh(pn_proactor_t *p, loop_t *lp) {
+  lp->has_leader = false;
+  if (lp != proactor_main_loop(p)) {
+    lp->ready = true;
+    notify(proactor_main_loop(p));
+  }
+  uv_cond_broadcast(&p->cond);   /* Signal followers for possible work */
+}
+
 /**** public API ****/
 
 pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
   uv_mutex_lock(&p->lock);
   pn_event_batch_t *batch = get_batch_lh(p);
-  if (batch == NULL && !p->has_leader) {
-    /* Try a non-blocking lead to generate some work */
-    p->has_leader = true;
-    batch = leader_lead_lh(p, UV_RUN_NOWAIT);
-    p->has_leader = false;
-    uv_cond_broadcast(&p->cond);   /* Signal followers for possible work */
+  for (size_t i = 0; batch == NULL && i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    if (!lp->has_leader) {
+      /* Try a non-blocking lead to generate some work */
+      lp->has_leader = true;
+      batch = leader_lead_lh(p, lp, UV_RUN_NOWAIT);
+      leader_release_lh(p, lp);
+    }
   }
   uv_mutex_unlock(&p->lock);
   return batch;
@@ -1033,17 +1526,18 @@ pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
 pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
   uv_mutex_lock(&p->lock);
   pn_event_batch_t *batch = get_batch_lh(p);
-  while (!batch && p->has_leader) {
-    uv_cond_wait(&p->cond, &p->lock); /* Follow the leader */
-    batch = get_batch_lh(p);
-  }
-  if (!batch) {                 /* Become leader */
-    p->has_leader = true;
-    do {
-      batch = leader_lead_lh(p, UV_RUN_ONCE);
-    } while (!batch);
-    p->has_leader = false;
-    uv_cond_broadcast(&p->cond); /* Signal a followers. One takes over, many can work. */
+  while (!batch) {
+    loop_t *lp = leader_loop_lh(p);
+    if (lp) {                   /* Become leader */
+      lp->has_leader = true;
+      do {
+        batch = leader_lead_lh(p, lp, UV_RUN_ONCE);
+      } while (!batch);
+      leader_release_lh(p, lp); /* Signal followers. One takes over, many can work. */
+    } else {
+      uv_cond_wait(&p->cond, &p->lock); /* Follow the leader */
+      batch = get_batch_lh(p);
+    }
   }
   uv_mutex_unlock(&p->lock);
   return batch;
@@ -1052,19 +1546,26 @@ pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
 void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
   if (!batch) return;
   uv_mutex_lock(&p->lock);
+  loop_t *lp = proactor_main_loop(p);
   work_t *w = batch_work(batch);
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc && pc->stats && pc->batch_start) {
+    PCONNECTION_STAT(pc, batch, pni_proactor_stats_now() - pc->batch_start);
+    pc->batch_start = 0;
+  }
   if (w) {
     assert(w->working);
     assert(w->next == work_unqueued);
     w->working = false;
-    work_push(&p->leader_q, w);
+    work_push(&w->loop->leader_q, w);
+    lp = w->loop;
   }
   pn_proactor_t *bp = batch_proactor(batch); /* Proactor events */
   if (bp == p) {
     p->batch_working = false;
   }
   uv_mutex_unlock(&p->lock);
-  notify(p);
+  notify(lp);
 }
 
 pn_listener_t *pn_event_listener(pn_event_t *e) {
@@ -1103,18 +1604,25 @@ void pn_proactor_interrupt(pn_proactor_t *p) {
 
 void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
   uv_mutex_lock(&p->lock);
-  if (!p->disconnect) {
-    p->disconnect = true;
+  if (!p->disconnect_pending) {
+    p->disconnect_pending = p->loops_len;
     if (cond) {
       pn_condition_copy(p->disconnect_cond, cond);
     } else {
       pn_condition_clear(p->disconnect_cond);
     }
-    notify(p);
+    for (size_t i = 0; i < p->loops_len; ++i) {
+      p->loops[i].disconnect = true;
+      notify(&p->loops[i]);
+    }
   }
   uv_mutex_unlock(&p->lock);
 }
 
+void pn_proactor_disconnect_async(pn_proactor_t *p, pn_condition_t *cond) {
+  pn_proactor_disconnect(p, cond);
+}
+
 void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
   uv_mutex_lock(&p->lock);
   p->timeout = t;
@@ -1122,7 +1630,7 @@ void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
   if (p->timeout_state == TM_NONE) ++p->active;
   p->timeout_state = TM_REQUEST;
   uv_mutex_unlock(&p->lock);
-  notify(p);
+  notify(proactor_main_loop(p));
 }
 
 void pn_proactor_cancel_timeout(pn_proactor_t *p) {
@@ -1130,7 +1638,7 @@ void pn_proactor_cancel_timeout(pn_proactor_t *p) {
   if (p->timeout_state != TM_NONE) {
     p->timeout_state = TM_NONE;
     remove_active_lh(p);
-    notify(p);
+    notify(proactor_main_loop(p));
   }
   uv_mutex_unlock(&p->lock);
 }
@@ -1162,7 +1670,7 @@ static void on_proactor_free(uv_handle_t* h, void* v) {
      default: break;
     }
     if (w && w->next == work_unqueued) {
-      work_push(&w->proactor->leader_q, w); /* Save to be freed after all closed */
+      work_push(&w->loop->leader_q, w); /* Save to be freed after all closed */
     }
   }
 }
@@ -1175,41 +1683,89 @@ static void work_free(work_t *w) {
   }
 }
 
+static size_t loops_len(void) {
+#ifdef _WIN32
+  return 1;                     /* No uv_backend_fd() to poll other loops */
+#else
+  const char *env = getenv("PN_PROACTOR_LOOPS");
+  int n = env ? atoi(env) : 0;
+  return n > 1 ? n : 1;
+#endif
+}
+
 pn_proactor_t *pn_proactor() {
   pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(pn_proactor_t));
+  if (pni_proactor_stats_enabled()) {
+    p->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*p->stats));
+  }
   p->collector = pn_collector();
   p->batch.next_event = &proactor_batch_next;
   if (!p->collector) return NULL;
-  uv_loop_init(&p->loop);
+  p->loops_len = loops_len();
+  p->loops = (loop_t*)calloc(p->loops_len, sizeof(loop_t));
+  if (!p->loops) return NULL;
   uv_mutex_init(&p->lock);
   uv_cond_init(&p->cond);
-  uv_async_init(&p->loop, &p->notify, NULL);
-  uv_async_init(&p->loop, &p->interrupt, on_interrupt);
+  const char *prewarm = getenv("PN_PROACTOR_PREWARM_IOBUFS");
+  size_t iobufs = prewarm && atoi(prewarm) > 0 ? (size_t)atoi(prewarm) : 0;
+  for (size_t i = 0; i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    uv_loop_init(&lp->loop);
+    uv_async_init(&lp->loop, &lp->notify, NULL);
+    lp->notify.data = p;
+    /* Buffers for the first connections, no more than the pool keeps */
+    while (lp->iobufs_len < iobufs && lp->iobufs_len < IOBUF_POOL) {
+      iobuf_t *b = (iobuf_t*)malloc(sizeof(iobuf_t));
+      if (!b) break;
+      iobuf_put(lp, b);
+    }
+  }
+  uv_loop_t *main_loop = &proactor_main_loop(p)->loop;
+  for (size_t i = 1; i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    uv_poll_init(main_loop, &lp->embed, uv_backend_fd(&lp->loop));
+    lp->embed.data = lp;
+    uv_poll_start(&lp->embed, UV_READABLE, on_embed);
+    uv_timer_init(main_loop, &lp->embed_timer);
+    lp->embed_timer.data = lp;
+  }
+  uv_async_init(main_loop, &p->interrupt, on_interrupt);
   p->interrupt.data = p;
-  uv_timer_init(&p->loop, &p->timer);
+  uv_timer_init(main_loop, &p->timer);
   p->timer.data = p;
   p->disconnect_cond = pn_condition();
   return p;
 }
 
 void pn_proactor_free(pn_proactor_t *p) {
-  /* Close all open handles */
-  uv_walk(&p->loop, on_proactor_free, NULL);
-  while (uv_loop_alive(&p->loop)) {
-    uv_run(&p->loop, UV_RUN_DEFAULT); /* Finish closing the proactor handles */
+  /* Close all open handles, the main loop first as it polls the others */
+  for (size_t i = 0; i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    uv_walk(&lp->loop, on_proactor_free, NULL);
+    while (uv_loop_alive(&lp->loop)) {
+      uv_run(&lp->loop, UV_RUN_DEFAULT); /* Finish closing the proactor handles */
+    }
   }
   /* Free all work items */
-  for (work_t *w = work_pop(&p->leader_q); w; w = work_pop(&p->leader_q)) {
-    work_free(w);
+  for (size_t i = 0; i < p->loops_len; ++i) {
+    loop_t *lp = &p->loops[i];
+    for (work_t *w = work_pop(&lp->leader_q); w; w = work_pop(&lp->leader_q)) {
+      work_free(w);
+    }
   }
   for (work_t *w = work_pop(&p->worker_q); w; w = work_pop(&p->worker_q)) {
     work_free(w);
   }
-  uv_loop_close(&p->loop);
+  for (size_t i = 0; i < p->loops_len; ++i) {
+    uv_loop_close(&p->loops[i].loop);
+    iobufs_free(p->loops[i].iobufs);
+  }
+  free(p->loops);
   uv_mutex_destroy(&p->lock);
   uv_cond_destroy(&p->cond);
   pn_collector_free(p->collector);
   pn_condition_free(p->disconnect_cond);
+  free(p->stats);
   free(p);
 }
 
@@ -1218,6 +1774,19 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->work.proactor : NULL;
 }
 
+int pn_proactor_stats(pn_proactor_t *p, pn_proactor_stats_t *stats) {
+  if (!p->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, p->stats);
+  return 0;
+}
+
+int pn_connection_proactor_stats(pn_connection_t *c, pn_proactor_stats_t *stats) {
+  pconnection_t *pc = get_pconnection(c);
+  if (!pc || !pc->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, pc->stats);
+  return 0;
+}
+
 void pn_connection_wake(pn_connection_t* c) {
   /* May be called from any thread */
   pconnection_t *pc = get_pconnection(c);
@@ -1284,6 +1853,30 @@ pn_record_t *pn_listener_attachments(pn_listener_t *l) {
   return l->attachments;
 }
 
+size_t pn_listener_backlog(pn_listener_t *l) {
+  uv_mutex_lock(&l->lock);
+  size_t n = l->pending;
+  uv_mutex_unlock(&l->lock);
+  return n;
+}
+
+int pn_proactor_set_option(pn_proactor_t *p, pn_proactor_option_t option, int value) {
+  return PN_STATE_ERR;          /* No tuning options */
+}
+
+int pn_listener_set_reuseport(pn_listener_t *l, bool reuseport) {
+#if REUSEPORT
+  l->reuseport = reuseport;
+  return 0;
+#else
+  return reuseport ? PN_STATE_ERR : 0;
+#endif
+}
+
+int pn_listener_overflow(pn_listener_t *l, pn_listener_overflow_t *overflow) {
+  return PN_STATE_ERR;          /* Not counted */
+}
+
 void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
   uv_mutex_lock(&l->lock);
   pconnection_t *pc = pconnection(l->work.proactor, c, true);
@@ -1294,6 +1887,7 @@ void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
   assert(pn_event_listener(e) == l);
   pc->lsocket = (lsocket_t*)pn_event_context(e);
   pc->connected = 1;            /* Don't need to connect() */
+  if (l->pending) --l->pending;
   pconnection_push(&l->accept, pc);
   uv_mutex_unlock(&l->lock);
   work_notify(&l->work);
@@ -1318,6 +1912,10 @@ const pn_netaddr_t *pn_netaddr_remote(pn_transport_t *t) {
 }
 
 int pn_netaddr_str(const pn_netaddr_t* na, char *buf, size_t len) {
+#ifndef _WIN32
+  int n = pni_unix_addr_str(&na->ss, buf, len);
+  if (n >= 0) return n;
+#endif
   char host[NI_MAXHOST];
   char port[NI_MAXSERV];
   int err = getnameinfo((struct sockaddr *)&na->ss, sizeof(na->ss),
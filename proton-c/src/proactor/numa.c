@@ -0,0 +1,76 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* Linux NUMA topology from sysfs, without a libnuma dependency */
+
+/* CPU affinity and getcpu are GNU extensions, kept out of epoll.c */
+#define _GNU_SOURCE
+
+#include "proactor-internal.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NODE_PATH "/sys/devices/system/node/node%d"
+
+int pni_numa_nodes(void) {
+  char path[64];
+  int n = 0;
+  for (;; ++n) {
+    snprintf(path, sizeof(path), NODE_PATH, n);
+    if (access(path, F_OK) != 0) break;
+  }
+  return n ? n : 1;
+}
+
+int pni_numa_node(void) {
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return 0;
+  return (int)node;
+}
+
+bool pni_numa_bind(int node) {
+  char path[80];
+  snprintf(path, sizeof(path), NODE_PATH "/cpulist", node);
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  /* A list of ranges, e.g. "0-7,16-23" */
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  int first, last, any = 0;
+  char sep;
+  while (fscanf(f, "%d", &first) == 1) {
+    last = first;
+    sep = (char)fgetc(f);
+    if (sep == '-') {
+      if (fscanf(f, "%d", &last) != 1) break;
+      sep = (char)fgetc(f);
+    }
+    for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+      CPU_SET(cpu, &cpus);
+      any = 1;
+    }
+    if (sep != ',') break;
+  }
+  fclose(f);
+  return any && sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
@@ -20,19 +20,39 @@
 
 /* Common platform-independent implementation for proactor libraries */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L /* clock_gettime */
+#endif
+
 #include "proactor-internal.h"
+#include <proton/connection.h>
 #include <proton/error.h>
+#include <proton/event.h>
 #include <proton/proactor.h>
+#include <proton/transport.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 
 static const char *AMQP_PORT = "5672";
 static const char *AMQP_PORT_NAME = "amqp";
 static const char *AMQPS_PORT = "5671";
 static const char *AMQPS_PORT_NAME = "amqps";
+static const char *UNIX_PREFIX = "unix:";
+static const char *INPROC_PREFIX = "inproc:";
+static const char *SHM_PREFIX = "shm:";
 
 const char *PNI_IO_CONDITION = "proton:io";
 
@@ -46,6 +66,17 @@ int pn_proactor_addr(char *buf, size_t len, const char *host, const char *port)
 }
 #endif
 
+size_t pn_proactor_wait_batches(pn_proactor_t *p, pn_event_batch_t **batches, size_t n) {
+  size_t count = 0;
+  if (n > 0) {
+    batches[count++] = pn_proactor_wait(p);
+    while (count < n && (batches[count] = pn_proactor_get(p)) != NULL) {
+      ++count;
+    }
+  }
+  return count;
+}
+
 int pni_parse_addr(const char *addr, char *buf, size_t len, const char **host, const char **port)
 {
   size_t hplen = strlen(addr);
@@ -53,6 +84,29 @@ int pni_parse_addr(const char *addr, char *buf, size_t len, const char **host, c
     return PN_OVERFLOW;
   }
   memcpy(buf, addr, hplen+1);
+  size_t ulen = strlen(UNIX_PREFIX);
+  if (!strncmp(buf, UNIX_PREFIX, ulen) && strchr("/.@", buf[ulen]) && buf[ulen]) {
+    /* The whole remainder is the path, it may contain ':' */
+    buf[ulen - 1] = '\0';
+    *host = buf;
+    *port = buf + ulen;
+    return 0;
+  }
+  size_t slen = strlen(SHM_PREFIX);
+  if (!strncmp(buf, SHM_PREFIX, slen) && strchr("/.@", buf[slen]) && buf[slen]) {
+    buf[slen - 1] = '\0';
+    *host = buf;
+    *port = buf + slen;
+    return 0;
+  }
+  size_t ilen = strlen(INPROC_PREFIX);
+  if (!strncmp(buf, INPROC_PREFIX, ilen) && buf[ilen]) {
+    /* As for unix: the name is the whole remainder */
+    buf[ilen - 1] = '\0';
+    *host = buf;
+    *port = buf + ilen;
+    return 0;
+  }
   char *p = strrchr(buf, ':');
   if (p) {
     *port = p + 1;
@@ -73,6 +127,71 @@ int pni_parse_addr(const char *addr, char *buf, size_t len, const char **host, c
   return 0;
 }
 
+const char *pni_unix_path(const char *host, const char *port) {
+  size_t ulen = strlen(UNIX_PREFIX);
+  if (host && port && *port && strchr("/.@", *port) &&
+      strlen(host) == ulen - 1 && !strncmp(host, UNIX_PREFIX, ulen - 1)) {
+    return port;
+  }
+  return NULL;
+}
+
+const char *pni_shm_path(const char *host, const char *port) {
+  size_t slen = strlen(SHM_PREFIX);
+  if (host && port && *port && strchr("/.@", *port) &&
+      strlen(host) == slen - 1 && !strncmp(host, SHM_PREFIX, slen - 1)) {
+    return port;
+  }
+  return NULL;
+}
+
+const char *pni_inproc_name(const char *host, const char *port) {
+  size_t ilen = strlen(INPROC_PREFIX);
+  if (host && port && *port &&
+      strlen(host) == ilen - 1 && !strncmp(host, INPROC_PREFIX, ilen - 1)) {
+    return port;
+  }
+  return NULL;
+}
+
+#ifndef _WIN32
+int pni_unix_sockaddr(const char *path, struct sockaddr_storage *ss, size_t *len) {
+  struct sockaddr_un *sa = (struct sockaddr_un*)ss;
+  size_t plen = strlen(path);
+  if (plen >= sizeof(sa->sun_path)) {
+    return PN_OVERFLOW;
+  }
+  memset(ss, 0, sizeof(*ss));
+  sa->sun_family = AF_UNIX;
+  memcpy(sa->sun_path, path, plen);
+  if (*path == '@') {
+    sa->sun_path[0] = '\0';    /* Abstract, the name is not NUL terminated */
+    *len = offsetof(struct sockaddr_un, sun_path) + plen;
+  } else {
+    *len = offsetof(struct sockaddr_un, sun_path) + plen + 1;
+  }
+  return 0;
+}
+
+static int bounded_len(const char *s, size_t max) {
+  const char *end = (const char*)memchr(s, '\0', max);
+  return (int)(end ? (size_t)(end - s) : max);
+}
+
+int pni_unix_addr_str(const struct sockaddr_storage *ss, char *buf, size_t len) {
+  const struct sockaddr_un *sa = (const struct sockaddr_un*)ss;
+  if (sa->sun_family != AF_UNIX) {
+    return -1;
+  }
+  size_t max = sizeof(sa->sun_path);
+  if (sa->sun_path[0] == '\0' && sa->sun_path[1] != '\0') {
+    /* Abstract, assume the name stops at the first NUL */
+    return snprintf(buf, len, "%s@%.*s", UNIX_PREFIX, bounded_len(sa->sun_path + 1, max - 1), sa->sun_path + 1);
+  }
+  return snprintf(buf, len, "%s%.*s", UNIX_PREFIX, bounded_len(sa->sun_path, max), sa->sun_path);
+}
+#endif
+
 static inline const char *nonull(const char *str) { return str ? str : ""; }
 
 void pni_proactor_set_cond(
@@ -83,3 +202,118 @@ void pni_proactor_set_cond(
                         msg, what, nonull(host), nonull(port));
   }
 }
+
+bool pni_proactor_stats_enabled(void) {
+  const char *env = getenv("PN_PROACTOR_STATS");
+  return env && atoi(env) > 0;
+}
+
+uint64_t pni_proactor_stats_now(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+  return (uint64_t)(c.QuadPart / f.QuadPart) * 1000000000 +
+    (uint64_t)(c.QuadPart % f.QuadPart) * 1000000000 / (uint64_t)f.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+#endif
+}
+
+/* Relaxed atomics, the counters are independent of each other */
+#if defined(_MSC_VER)
+static inline void stats_add(uint64_t *p, uint64_t n) {
+  InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)n);
+}
+static inline uint64_t stats_load(const uint64_t *p) {
+  return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0);
+}
+static inline void stats_max(uint64_t *p, uint64_t n) {
+  LONG64 m = (LONG64)stats_load(p);
+  while ((uint64_t)m < n) {
+    LONG64 prev = InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)n, m);
+    if (prev == m) break;
+    m = prev;
+  }
+}
+#else
+static inline void stats_add(uint64_t *p, uint64_t n) {
+  __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+}
+static inline uint64_t stats_load(const uint64_t *p) {
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static inline void stats_max(uint64_t *p, uint64_t n) {
+  uint64_t m = stats_load(p);
+  while (m < n && !__atomic_compare_exchange_n(p, &m, n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+#endif
+
+/* Smallest i with ns <= 2^i, limited to the last bucket */
+static size_t histogram_bucket(uint64_t ns) {
+  size_t i = 0;
+  while (i < PN_PROACTOR_HISTOGRAM_BUCKETS - 1 && ((uint64_t)1 << i) < ns)
+    ++i;
+  return i;
+}
+
+void pni_histogram_record(pn_proactor_histogram_t *h, uint64_t ns) {
+  stats_add(&h->count, 1);
+  stats_add(&h->total, ns);
+  stats_add(&h->buckets[histogram_bucket(ns)], 1);
+  stats_max(&h->max, ns);
+}
+
+void pni_proactor_stats_copy(pn_proactor_stats_t *dst, const pn_proactor_stats_t *src) {
+  /* All fields are uint64_t */
+  const uint64_t *s = (const uint64_t*)src;
+  uint64_t *d = (uint64_t*)dst;
+  for (size_t i = 0; i < sizeof(*src) / sizeof(uint64_t); ++i)
+    d[i] = stats_load(&s[i]);
+}
+
+uint64_t pn_proactor_histogram_percentile(const pn_proactor_histogram_t *h, double percent) {
+  if (!h->count) return 0;
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+  uint64_t want = (uint64_t)(percent / 100.0 * (double)h->count + 0.5);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < PN_PROACTOR_HISTOGRAM_BUCKETS - 1; ++i) {
+    seen += h->buckets[i];
+    if (seen && seen >= want) {
+      uint64_t bound = (uint64_t)1 << i;
+      return bound < h->max ? bound : h->max;
+    }
+  }
+  return h->max;
+}
+
+void pni_proactor_capture(pn_transport_t *t) {
+  const char *prefix = getenv("PN_PROACTOR_CAPTURE");
+  if (!prefix || !*prefix) return;
+  static uint64_t captures = 0;
+#if defined(_MSC_VER)
+  uint64_t n = (uint64_t)InterlockedIncrement64((volatile LONG64*)&captures);
+  unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+  uint64_t n = __atomic_add_fetch(&captures, 1, __ATOMIC_RELAXED);
+  unsigned long pid = (unsigned long)getpid();
+#endif
+  char *path = (char*)malloc(strlen(prefix) + 48);
+  if (!path) return;
+  sprintf(path, "%s.%lu.%llu", prefix, pid, (unsigned long long)n);
+  pn_transport_capture_file(t, path);
+  free(path);
+}
+
+void pni_proactor_prewarm(pn_connection_t *c, pn_collector_t *collector) {
+  const char *deliveries = getenv("PN_PROACTOR_PREWARM_DELIVERIES");
+  const char *events = getenv("PN_PROACTOR_PREWARM_EVENTS");
+  if (deliveries && atoi(deliveries) > 0)
+    (void)pn_connection_reserve_deliveries(c, (size_t)atoi(deliveries));
+  if (events && atoi(events) > 0)
+    (void)pn_collector_reserve(collector, (size_t)atoi(events));
+}
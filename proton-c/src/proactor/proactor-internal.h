@@ -23,6 +23,7 @@
 #include <proton/type_compat.h>
 #include <proton/import_export.h>
 #include <proton/condition.h>
+#include <proton/proactor.h>
 
 /* NOTE PNP_EXTERN is for use by proton-internal tests  */
 
@@ -37,6 +38,77 @@
  */
 PNP_EXTERN int pni_parse_addr(const char *addr, char *buf, size_t len, const char **host, const char **port);
 
+/**
+ * Return the socket path if host and port were parsed from a local address
+ * "unix:<path>", otherwise NULL.  The path starts with '/' or '.', or with '@'
+ * for a name in the Linux abstract namespace.
+ */
+PNP_EXTERN const char *pni_unix_path(const char *host, const char *port);
+
+/**
+ * Return the listener name if host and port were parsed from an in-process
+ * address "inproc:<name>", otherwise NULL.
+ */
+PNP_EXTERN const char *pni_inproc_name(const char *host, const char *port);
+
+/**
+ * Return the socket path if host and port were parsed from a shared memory
+ * address "shm:<path>", otherwise NULL.  The path is as for pni_unix_path().
+ */
+PNP_EXTERN const char *pni_shm_path(const char *host, const char *port);
+
+#ifndef _WIN32
+struct sockaddr_storage;
+
+/**
+ * Fill ss with the AF_UNIX address for a pni_unix_path() path, set *len to its size.
+ *
+ * @return 0 on success, PN_OVERFLOW if the path is too long.
+ */
+PNP_EXTERN int pni_unix_sockaddr(const char *path, struct sockaddr_storage *ss, size_t *len);
+
+/**
+ * Format an AF_UNIX address as "unix:<path>" for pn_netaddr_str().
+ *
+ * @return as for snprintf(), or -1 if ss is not an AF_UNIX address.
+ */
+PNP_EXTERN int pni_unix_addr_str(const struct sockaddr_storage *ss, char *buf, size_t len);
+#endif
+
+/**
+ * True if the PN_PROACTOR_STATS environment variable enables pn_proactor_stats().
+ */
+bool pni_proactor_stats_enabled(void);
+
+/**
+ * Monotonic clock in nanoseconds for pn_proactor_stats() durations.
+ */
+uint64_t pni_proactor_stats_now(void);
+
+/**
+ * Record a duration in h.  Thread safe, concurrent records use atomic updates.
+ */
+void pni_histogram_record(pn_proactor_histogram_t *h, uint64_t ns);
+
+/**
+ * Copy stats that may be recording concurrently.
+ */
+void pni_proactor_stats_copy(pn_proactor_stats_t *dst, const pn_proactor_stats_t *src);
+
+/**
+ * If the PN_PROACTOR_CAPTURE environment variable is set, capture the frames
+ * of a new connection's transport to "<PN_PROACTOR_CAPTURE>.<pid>.<n>", see
+ * pn_transport_capture_file().
+ */
+void pni_proactor_capture(pn_transport_t *t);
+
+/**
+ * Allocate ahead of use for a new connection, as the PN_PROACTOR_PREWARM_DELIVERIES
+ * and PN_PROACTOR_PREWARM_EVENTS environment variables ask, see
+ * pn_connection_reserve_deliveries() and pn_collector_reserve().
+ */
+void pni_proactor_prewarm(pn_connection_t *c, pn_collector_t *collector);
+
 /**
  * Condition name for error conditions related to proton-IO.
  */
@@ -48,4 +120,48 @@ extern const char *PNI_IO_CONDITION;
 void pni_proactor_set_cond(
   pn_condition_t *cond, const char *what, const char *msg, const char *host, const char *port);
 
+#ifdef __linux__
+/*
+ * NUMA placement for the epoll proactor, see numa.c.  Without NUMA
+ * information the host looks like a single node.
+ */
+
+/** Number of NUMA nodes, 1 if not known. */
+int pni_numa_nodes(void);
+
+/** NUMA node of the CPU the calling thread is running on, 0 if not known. */
+int pni_numa_node(void);
+
+/** Run the calling thread only on the CPUs of node. Return false on failure. */
+bool pni_numa_bind(int node);
+
+#include <sys/types.h>
+
+/*
+ * Shared memory rings for "shm:" connections of the epoll proactor, see
+ * shm.c.  Reads and writes behave like read() and send() on the socket
+ * connecting the two ends, which only carries notifications.
+ */
+typedef struct pni_shm_t pni_shm_t;
+
+/** Rings for a new connection, not usable until offered or received. */
+pni_shm_t *pni_shm(void);
+void pni_shm_free(pni_shm_t *shm);
+
+/** True once the rings are shared with the peer. */
+bool pni_shm_ready(pni_shm_t *shm);
+
+/** Connecting end: create rings of at least size bytes and pass them to the peer. Return 0 or errno. */
+int pni_shm_offer(pni_shm_t *shm, int sock, size_t size);
+
+/** The socket is readable: take the peer's rings if not yet done, consume notifications. Return 0 or errno. */
+int pni_shm_poll(pni_shm_t *shm, int sock);
+
+ssize_t pni_shm_read(pni_shm_t *shm, int sock, char *buf, size_t size);
+ssize_t pni_shm_write(pni_shm_t *shm, int sock, const char *buf, size_t size);
+
+/** No more writes, the peer reads end of stream once the ring is empty. */
+void pni_shm_close_write(pni_shm_t *shm, int sock);
+#endif
+
 #endif // PROACTOR_NETADDR_INTERNAL_H
@@ -0,0 +1,321 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Shared memory rings for "shm:" connections of the epoll proactor.
+ *
+ * The two ends connect over a local socket as for "unix:".  The connecting
+ * end creates a memory-mapped file holding one single-producer,
+ * single-consumer ring for each direction and passes its descriptor over the
+ * socket with SCM_RIGHTS.  From then on AMQP bytes go through the rings and
+ * the socket only carries one byte "doorbells" that make the peer's socket
+ * readable for epoll:
+ *
+ *  - A reader that finds its ring empty sets reader_waiting and looks again
+ *    before it sleeps, a writer that publishes data rings if it was set.
+ *  - A writer that finds its ring full does the same with writer_waiting,
+ *    and a reader that frees space rings if it was set.
+ *
+ * So an end only rings while the peer sleeps, a busy pair exchanges data
+ * without system calls.  The socket also reports the peer going away.
+ */
+
+/* CMSG_SPACE and friends are not in plain POSIX */
+#define _DEFAULT_SOURCE
+
+#include "proactor-internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x70736d31    /* "psm1" */
+#define CACHE_LINE 64
+
+/* One direction, written by one end and read by the other */
+typedef struct ring_t {
+  uint64_t head;                /* Bytes written, by the writer */
+  uint32_t closed;              /* Writer is done, set after the last head */
+  uint32_t writer_waiting;      /* Writer sleeps until the reader frees space */
+  char pad1_[CACHE_LINE - 16];
+  uint64_t tail;                /* Bytes read, by the reader */
+  uint32_t reader_waiting;      /* Reader sleeps until the writer adds data */
+  char pad2_[CACHE_LINE - 12];
+} ring_t;
+
+/* The start of the shared file, followed by the data of both rings */
+typedef struct segment_t {
+  uint32_t magic;
+  uint32_t size;                /* Data bytes in each ring, a power of 2 */
+  char pad_[CACHE_LINE - 8];
+  ring_t rings[2];              /* [0] from the connecting end, [1] from the accepting end */
+} segment_t;
+
+struct pni_shm_t {
+  segment_t *seg;               /* NULL until created or received */
+  size_t map_size;
+  ring_t *in, *out;
+  char *in_data, *out_data;
+  uint64_t mask;
+  bool hup;                     /* The socket reported the peer gone */
+};
+
+pni_shm_t *pni_shm(void) {
+  return (pni_shm_t*)calloc(1, sizeof(pni_shm_t));
+}
+
+void pni_shm_free(pni_shm_t *shm) {
+  if (shm) {
+    if (shm->seg) munmap(shm->seg, shm->map_size);
+    free(shm);
+  }
+}
+
+bool pni_shm_ready(pni_shm_t *shm) {
+  return shm->seg != NULL;
+}
+
+static void shm_map(pni_shm_t *shm, segment_t *seg, size_t map_size, size_t ring, bool accepting) {
+  shm->seg = seg;
+  shm->map_size = map_size;
+  char *data = (char*)(seg + 1);
+  int out = accepting ? 1 : 0;
+  shm->out = &seg->rings[out];
+  shm->in = &seg->rings[!out];
+  shm->out_data = data + out * ring;
+  shm->in_data = data + !out * ring;
+  shm->mask = ring - 1;
+}
+
+static void shm_ring(pni_shm_t *shm, int sock) {
+  static const char bell = 0;
+  /* A full socket already holds a doorbell, and a dead peer needs none */
+  (void)send(sock, &bell, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+int pni_shm_offer(pni_shm_t *shm, int sock, size_t size) {
+  size_t ring = 4096;
+  while (ring < size && ring < (1u << 30)) ring <<= 1;
+  size_t map_size = sizeof(segment_t) + 2 * ring;
+
+  char shm_path[] = "/dev/shm/qpid-proton-XXXXXX";
+  char tmp_path[] = "/tmp/qpid-proton-XXXXXX";
+  char *path = shm_path;
+  int fd = mkstemp(path);
+  if (fd < 0) fd = mkstemp(path = tmp_path);
+  if (fd < 0) return errno;
+  unlink(path);                 /* Only the descriptor passed to the peer keeps it */
+  void *p = MAP_FAILED;
+  if (!ftruncate(fd, (off_t)map_size))
+    p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    return err;
+  }
+  segment_t *seg = (segment_t*)p;
+  seg->magic = SHM_MAGIC;
+  seg->size = (uint32_t)ring;
+  /* Neither end is reading yet, the first data rings the doorbell */
+  seg->rings[0].reader_waiting = seg->rings[1].reader_waiting = 1;
+
+  /* The descriptor rides on the first byte over the socket */
+  char byte = 0;
+  struct iovec iov = { &byte, 1 };
+  union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  int err = (n == 1) ? 0 : (n < 0 ? errno : EIO);
+  close(fd);
+  if (err) {
+    munmap(p, map_size);
+    return err;
+  }
+  shm_map(shm, seg, map_size, ring, false);
+  return 0;
+}
+
+/* Receive the peer's file on the first byte.  Return 0, EAGAIN or an error */
+static int shm_accept(pni_shm_t *shm, int sock) {
+  char byte;
+  struct iovec iov = { &byte, 1 };
+  union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  ssize_t n = recvmsg(sock, &msg, MSG_DONTWAIT);
+  if (n < 0) return errno == EWOULDBLOCK ? EAGAIN : errno;
+  if (n == 0) return ECONNRESET;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+    return EPROTO;
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  struct stat st;
+  segment_t head;
+  int err = 0;
+  if (fstat(fd, &st) || pread(fd, &head, sizeof(head), 0) != (ssize_t)sizeof(head)) {
+    err = EPROTO;
+  } else if (head.magic != SHM_MAGIC || head.size < 4096 || (head.size & (head.size - 1)) ||
+             (uint64_t)st.st_size != sizeof(segment_t) + 2 * (uint64_t)head.size) {
+    err = EPROTO;
+  } else {
+    size_t map_size = (size_t)st.st_size;
+    void *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      err = errno;
+    } else {
+      /* Use the size we checked, whatever the peer writes later */
+      shm_map(shm, (segment_t*)p, map_size, head.size, true);
+    }
+  }
+  close(fd);
+  return err;
+}
+
+int pni_shm_poll(pni_shm_t *shm, int sock) {
+  if (!shm->seg) {
+    int err = shm_accept(shm, sock);
+    if (err) return err == EAGAIN ? 0 : err;
+  }
+  char bells[64];
+  for (;;) {
+    ssize_t n = recv(sock, bells, sizeof(bells), MSG_DONTWAIT);
+    if (n > 0) continue;
+    if (n == 0) shm->hup = true;
+    else if (errno == EINTR) continue;
+    else if (errno != EWOULDBLOCK && errno != EAGAIN) shm->hup = true;
+    return 0;
+  }
+}
+
+ssize_t pni_shm_read(pni_shm_t *shm, int sock, char *buf, size_t size) {
+  if (!shm->seg) {
+    errno = EWOULDBLOCK;
+    return -1;
+  }
+  ring_t *r = shm->in;
+  uint64_t tail = r->tail;
+  uint64_t ring_size = shm->mask + 1;
+  size_t got = 0;
+  bool waiting = false;
+ again:
+  while (got < size) {
+    uint64_t avail = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) - tail;
+    if (avail > ring_size) {    /* Only a broken peer gets here */
+      errno = EPROTO;
+      return -1;
+    }
+    if (avail == 0) {
+      if (waiting) break;
+      /* Look again after asking for a doorbell, the writer may have just missed it */
+      __atomic_store_n(&r->reader_waiting, 1, __ATOMIC_SEQ_CST);
+      waiting = true;
+      continue;
+    }
+    size_t n = (size_t)(avail < size - got ? avail : size - got);
+    size_t at = (size_t)(tail & shm->mask);
+    size_t first = n < ring_size - at ? n : (size_t)(ring_size - at);
+    memcpy(buf + got, shm->in_data + at, first);
+    memcpy(buf + got + first, shm->in_data, n - first);
+    got += n;
+    tail += n;
+    __atomic_store_n(&r->tail, tail, __ATOMIC_SEQ_CST);
+  }
+  if (got && __atomic_exchange_n(&r->writer_waiting, 0, __ATOMIC_SEQ_CST))
+    shm_ring(shm, sock);
+  if (got) return (ssize_t)got;
+  if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE) || shm->hup) {
+    /* closed is set after the last head, so an empty ring is empty for good */
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail) return 0;
+    goto again;
+  }
+  errno = EWOULDBLOCK;
+  return -1;
+}
+
+ssize_t pni_shm_write(pni_shm_t *shm, int sock, const char *buf, size_t size) {
+  if (!shm->seg) {
+    errno = EWOULDBLOCK;
+    return -1;
+  }
+  if (shm->hup) {
+    errno = EPIPE;
+    return -1;
+  }
+  ring_t *r = shm->out;
+  uint64_t head = r->head;
+  uint64_t ring_size = shm->mask + 1;
+  size_t put = 0;
+  bool waiting = false;
+  while (put < size) {
+    uint64_t used = head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+    if (used > ring_size) {
+      errno = EPROTO;
+      return -1;
+    }
+    uint64_t space = ring_size - used;
+    if (space == 0) {
+      if (waiting) break;
+      __atomic_store_n(&r->writer_waiting, 1, __ATOMIC_SEQ_CST);
+      waiting = true;
+      continue;
+    }
+    size_t n = (size_t)(space < size - put ? space : size - put);
+    size_t at = (size_t)(head & shm->mask);
+    size_t first = n < ring_size - at ? n : (size_t)(ring_size - at);
+    memcpy(shm->out_data + at, buf + put, first);
+    memcpy(shm->out_data, buf + put + first, n - first);
+    put += n;
+    head += n;
+    __atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+  }
+  if (put && __atomic_exchange_n(&r->reader_waiting, 0, __ATOMIC_SEQ_CST))
+    shm_ring(shm, sock);
+  if (put) return (ssize_t)put;
+  errno = EWOULDBLOCK;
+  return -1;
+}
+
+void pni_shm_close_write(pni_shm_t *shm, int sock) {
+  if (shm->seg) {
+    __atomic_store_n(&shm->out->closed, 1, __ATOMIC_RELEASE);
+    shm_ring(shm, sock);        /* Once per connection, not worth saving */
+  }
+}
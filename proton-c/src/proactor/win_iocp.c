@@ -45,6 +45,8 @@
 #include <iostream>
 #include <sstream>
 
+#include "../core/config.h"
+
 /*
  * Proactor for Windows using IO completion ports.
  *
@@ -58,6 +60,13 @@
  * proactor will hurt the completion port scheduler and cause fewer threads to
  * run.
  *
+ * PN_PROACTOR_THREADS=N limits the completion port to N concurrently running
+ * threads (default one per processor).  PN_PROACTOR_AFFINITY=core pins each
+ * thread to a processor, round-robin across processor groups, the first time
+ * it calls pn_proactor_wait; PN_PROACTOR_AFFINITY=numa pins it to a NUMA node
+ * instead.  The completion port wakes the most recently waiting thread first,
+ * so a pinned thread tends to keep finding the connections it just ran.
+ *
  * Each proactor connection maintains its own queue of pending completions and
  * its work is serialized on that.  The proactor listener runs parallel where
  * possible, but its event batch is serialized.
@@ -67,7 +76,6 @@
 //       make the global write lock window much smaller
 //       2 exclusive write buffers per connection
 //       make the zombie processing thread safe
-//       configurable completion port concurrency
 //       proton objects and ref counting: just say no.
 
 
@@ -106,6 +114,15 @@ struct iocp_t {
   size_t writer_count;
   int loopback_bufsize;
   bool iocp_trace;
+#ifdef PN_IOCP_RIO
+  bool rio_enabled;             // false if Registered I/O is not available
+  CRITICAL_SECTION rio_lock;    // for the completion queue and request queues
+  RIO_CQ rio_cq;
+  ULONG rio_cq_size;
+  ULONG rio_cq_used;            // entries reserved by request queues
+  OVERLAPPED rio_overlapped;    // completion queue notifications
+  RIO_BUFFERID rio_pool_id;     // the shared write pool
+#endif
 };
 
 // One for each socket.
@@ -131,6 +148,15 @@ struct iocpdesc_t {
   bool write_blocked;
   int events;
   pn_timestamp_t reap_time;
+#ifdef PN_IOCP_RIO
+  RIO_RQ rio_rq;                // RIO_INVALID_RQ if not using Registered I/O
+  bool rio_unavailable;
+  char *rio_rbuf;               // registered receive buffer
+  RIO_BUFFERID rio_rbuf_id;
+  size_t rio_rstart;            // received bytes not yet consumed
+  size_t rio_rend;
+  bool rio_eof;
+#endif
 };
 
 
@@ -165,6 +191,10 @@ struct write_result_t {
   size_t requested;
   bool in_use;
   pn_bytes_t buffer;
+#ifdef PN_IOCP_RIO
+  RIO_BUFFERID rio_id;          // buffer registration, RIO_INVALID_BUFFERID until used
+  ULONG rio_offset;
+#endif
 };
 
 typedef struct {
@@ -188,6 +218,7 @@ void start_reading(iocpdesc_t *iocpd);
 void begin_accept(pni_acceptor_t *acceptor, accept_result_t *result);
 void reset_accept_result(accept_result_t *result);
 iocpdesc_t *create_same_type_socket(iocpdesc_t *iocpd);
+SOCKET pni_iocp_socket(iocp_t *iocp, int family, int protocol);
 void pni_iocp_reap_check(iocpdesc_t *iocpd);
 connect_result_t *connect_result(iocpdesc_t *iocpd, struct addrinfo *addr);
 iocpdesc_t *pni_iocpdesc_create(iocp_t *, pn_socket_t s);
@@ -228,7 +259,7 @@ pn_timestamp_t pn_i_now2(void);
 namespace pn_experimental {
 
 // Max overlapped writes per socket
-#define IOCP_MAX_OWRITES 16
+#define IOCP_MAX_OWRITES PN_IOCP_WRITE_DEPTH
 // Write buffer size
 #define IOCP_WBUFSIZE 16384
 
@@ -244,11 +275,11 @@ static void pipeline_log(const char *fmt, ...)
 void pni_shared_pool_create(iocp_t *iocp)
 {
   // TODO: more pools (or larger one) when using multiple non-loopback interfaces
-  iocp->shared_pool_size = 16;
+  iocp->shared_pool_size = PN_IOCP_WRITE_POOL;
   char *env = getenv("PNI_WRITE_BUFFERS"); // Internal: for debugging
   if (env) {
     int sz = atoi(env);
-    if (sz >= 0 && sz < 256) {
+    if (sz >= 0 && sz < 4096) {
       iocp->shared_pool_size = sz;
     }
   }
@@ -315,6 +346,210 @@ static write_result_t *shared_pool_pop(iocp_t *iocp)
   return iocp->shared_available_count ? iocp->available_results[--iocp->shared_available_count] : NULL;
 }
 
+#ifdef PN_IOCP_RIO
+// ======================================================================
+// Registered I/O (Windows 8 and later).
+//
+// Connection reads and writes use buffers registered once with the kernel,
+// and their completions are collected from a single completion queue per
+// iocp_t that signals the completion port when it becomes non-empty.  The
+// proactor has no threads of its own, so rather than a queue per thread
+// the results are posted back to the port for whichever application thread
+// is waiting.  Accept and connect stay ordinary overlapped operations, and
+// without RIO support everything falls back to them at runtime.
+// ======================================================================
+
+static RIO_EXTENSION_FUNCTION_TABLE pni_rio;  // Process wide, same for every socket
+
+static void rio_notify_stub() {}
+static ULONG_PTR rio_notify_key = (ULONG_PTR) &rio_notify_stub;
+
+static void rio_complete_stub() {}
+static ULONG_PTR rio_complete_key = (ULONG_PTR) &rio_complete_stub;
+
+// Completion queue entries needed by one request queue
+#define RIO_CQ_ENTRIES (1 + IOCP_MAX_OWRITES)
+
+static void rio_initialize(iocp_t *iocp)
+{
+  iocp->rio_cq = RIO_INVALID_CQ;
+  iocp->rio_pool_id = RIO_INVALID_BUFFERID;
+  InitializeCriticalSectionAndSpinCount(&iocp->rio_lock, 4000);
+  if (getenv("PNI_NO_RIO")) return;  // Internal: for debugging
+
+  SOCKET s = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0,
+                       WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+  if (s == INVALID_SOCKET) return;
+  GUID guid = WSAID_MULTIPLE_RIO;
+  DWORD bytes = 0;
+  pni_rio.cbSize = sizeof(pni_rio);
+  int rc = WSAIoctl(s, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid),
+                    &pni_rio, sizeof(pni_rio), &bytes, NULL, NULL);
+  closesocket(s);
+  if (rc) return;
+
+  RIO_NOTIFICATION_COMPLETION nc;
+  nc.Type = RIO_IOCP_COMPLETION;
+  nc.Iocp.IocpHandle = iocp->completion_port;
+  nc.Iocp.CompletionKey = (PVOID) rio_notify_key;
+  nc.Iocp.Overlapped = &iocp->rio_overlapped;
+  iocp->rio_cq_size = PN_IOCP_RIO_QUEUE_SIZE;
+  iocp->rio_cq = pni_rio.RIOCreateCompletionQueue(iocp->rio_cq_size, &nc);
+  if (iocp->rio_cq == RIO_INVALID_CQ) return;
+
+  // One registration covers the whole shared write pool
+  if (iocp->shared_pool_memory) {
+    iocp->rio_pool_id = pni_rio.RIORegisterBuffer(iocp->shared_pool_memory,
+                                                  IOCP_WBUFSIZE * iocp->shared_pool_size);
+    if (iocp->rio_pool_id != RIO_INVALID_BUFFERID) {
+      for (int i = 0; i < iocp->shared_pool_size; i++) {
+        write_result_t *result = iocp->shared_results[i];
+        result->rio_id = iocp->rio_pool_id;
+        result->rio_offset = (ULONG) (result->buffer.start - iocp->shared_pool_memory);
+      }
+    }
+  }
+  iocp->rio_enabled = true;
+  pni_rio.RIONotify(iocp->rio_cq);
+}
+
+static void rio_finalize(iocp_t *iocp)
+{
+  if (iocp->rio_cq != RIO_INVALID_CQ)
+    pni_rio.RIOCloseCompletionQueue(iocp->rio_cq);
+  if (iocp->rio_pool_id != RIO_INVALID_BUFFERID)
+    pni_rio.RIODeregisterBuffer(iocp->rio_pool_id);
+  iocp->rio_cq = RIO_INVALID_CQ;
+  iocp->rio_pool_id = RIO_INVALID_BUFFERID;
+  iocp->rio_enabled = false;
+  DeleteCriticalSection(&iocp->rio_lock);
+}
+
+// Set up Registered I/O on a connected socket before its first read.  Any
+// failure leaves the socket on plain overlapped I/O for good.
+static bool rio_start(iocpdesc_t *iocpd)
+{
+  if (iocpd->rio_rq != RIO_INVALID_RQ) return true;
+  iocp_t *iocp = iocpd->iocp;
+  if (!iocp->rio_enabled || iocpd->rio_unavailable || iocpd->closing) return false;
+  iocpd->rio_unavailable = true;  // Until the request queue exists
+
+  char *rbuf = (char *) malloc(PN_IOCP_RIO_RECV_SIZE);
+  if (!rbuf) return false;
+  RIO_BUFFERID rbuf_id = pni_rio.RIORegisterBuffer(rbuf, PN_IOCP_RIO_RECV_SIZE);
+  if (rbuf_id == RIO_INVALID_BUFFERID) {
+    free(rbuf);
+    return false;
+  }
+
+  RIO_RQ rq = RIO_INVALID_RQ;
+  EnterCriticalSection(&iocp->rio_lock);
+  bool room = true;
+  if (iocp->rio_cq_used + RIO_CQ_ENTRIES > iocp->rio_cq_size) {
+    ULONG size = iocp->rio_cq_size * 2;
+    while (size < iocp->rio_cq_used + RIO_CQ_ENTRIES) size *= 2;
+    room = pni_rio.RIOResizeCompletionQueue(iocp->rio_cq, size);
+    if (room) iocp->rio_cq_size = size;
+  }
+  if (room)
+    rq = pni_rio.RIOCreateRequestQueue(iocpd->socket, 1, 1, IOCP_MAX_OWRITES, 1,
+                                       iocp->rio_cq, iocp->rio_cq, iocpd);
+  if (rq != RIO_INVALID_RQ)
+    iocp->rio_cq_used += RIO_CQ_ENTRIES;
+  LeaveCriticalSection(&iocp->rio_lock);
+
+  if (rq == RIO_INVALID_RQ) {
+    if (iocp->iocp_trace)
+      pipeline_log("Registered I/O unavailable for socket: %d\n", WSAGetLastError());
+    pni_rio.RIODeregisterBuffer(rbuf_id);
+    free(rbuf);
+    return false;
+  }
+  iocpd->rio_rq = rq;
+  iocpd->rio_rbuf = rbuf;
+  iocpd->rio_rbuf_id = rbuf_id;
+  iocpd->rio_unavailable = false;
+  return true;
+}
+
+// The socket is about to be closed, which also frees its request queue.
+static void rio_stop(iocpdesc_t *iocpd)
+{
+  if (iocpd->rio_rq == RIO_INVALID_RQ) return;
+  iocp_t *iocp = iocpd->iocp;
+  EnterCriticalSection(&iocp->rio_lock);
+  iocp->rio_cq_used -= RIO_CQ_ENTRIES;
+  LeaveCriticalSection(&iocp->rio_lock);
+  iocpd->rio_rq = RIO_INVALID_RQ;
+}
+
+// Move results from the completion queue to the completion port, then ask
+// to be notified again.
+static void rio_dequeue(iocp_t *iocp)
+{
+  RIORESULT results[64];
+  EnterCriticalSection(&iocp->rio_lock);
+  while (true) {
+    ULONG n = pni_rio.RIODequeueCompletion(iocp->rio_cq, results, 64);
+    if (n == 0 || n == RIO_CORRUPT_CQ) {
+      if (n == RIO_CORRUPT_CQ)
+        pipeline_log("Proton Registered I/O completion queue corrupt\n");
+      break;
+    }
+    for (ULONG i = 0; i < n; i++) {
+      iocp_result_t *result = (iocp_result_t *) results[i].RequestContext;
+      result->status = results[i].Status;
+      result->num_transferred = results[i].BytesTransferred;
+      PostQueuedCompletionStatus(iocp->completion_port, 0, rio_complete_key, (LPOVERLAPPED) result);
+    }
+  }
+  pni_rio.RIONotify(iocp->rio_cq);
+  LeaveCriticalSection(&iocp->rio_lock);
+}
+
+static int rio_send(write_result_t *result, const void *buf, size_t len)
+{
+  iocpdesc_t *iocpd = result->base.iocpd;
+  if (result->rio_id == RIO_INVALID_BUFFERID) {
+    // Not from the shared pool: register on first use, kept until the pipeline goes
+    result->rio_id = pni_rio.RIORegisterBuffer((PCHAR) result->buffer.start, (DWORD) result->buffer.size);
+    if (result->rio_id == RIO_INVALID_BUFFERID)
+      return SOCKET_ERROR;
+    result->rio_offset = 0;
+  }
+  RIO_BUF rb;
+  rb.BufferId = result->rio_id;
+  rb.Offset = result->rio_offset + (ULONG) ((const char *) buf - result->buffer.start);
+  rb.Length = (ULONG) len;
+  EnterCriticalSection(&iocpd->iocp->rio_lock);
+  BOOL ok = pni_rio.RIOSend(iocpd->rio_rq, &rb, 1, 0, result);
+  LeaveCriticalSection(&iocpd->iocp->rio_lock);
+  return ok ? 0 : SOCKET_ERROR;
+}
+
+static int rio_receive(iocpdesc_t *iocpd)
+{
+  RIO_BUF rb;
+  rb.BufferId = iocpd->rio_rbuf_id;
+  rb.Offset = 0;
+  rb.Length = PN_IOCP_RIO_RECV_SIZE;
+  EnterCriticalSection(&iocpd->iocp->rio_lock);
+  BOOL ok = pni_rio.RIOReceive(iocpd->rio_rq, &rb, 1, 0, iocpd->read_result);
+  LeaveCriticalSection(&iocpd->iocp->rio_lock);
+  return ok ? 0 : SOCKET_ERROR;
+}
+#endif
+
+SOCKET pni_iocp_socket(iocp_t *iocp, int family, int protocol)
+{
+#ifdef PN_IOCP_RIO
+  if (iocp->rio_enabled)
+    return WSASocket(family, SOCK_STREAM, protocol, NULL, 0,
+                     WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+#endif
+  return socket(family, SOCK_STREAM, protocol);
+}
+
 struct write_pipeline_t {
   iocpdesc_t *iocpd;
   size_t pending_count;
@@ -342,6 +577,10 @@ static void write_pipeline_initialize(void *object)
 static void write_pipeline_finalize(void *object)
 {
   write_pipeline_t *pl = (write_pipeline_t *) object;
+#ifdef PN_IOCP_RIO
+  if (pl->primary->rio_id != RIO_INVALID_BUFFERID)
+    pni_rio.RIODeregisterBuffer(pl->primary->rio_id);
+#endif
   free((void *)pl->primary->buffer.start);
   free(pl->primary);
 }
@@ -642,7 +881,7 @@ iocpdesc_t *create_same_type_socket(iocpdesc_t *iocpd)
   socklen_t salen = sizeof(sa);
   if (getsockname(iocpd->socket, (sockaddr*)&sa, &salen) == -1)
     return NULL;
-  SOCKET s = socket(sa.ss_family, SOCK_STREAM, 0); // Currently only work with SOCK_STREAM
+  SOCKET s = pni_iocp_socket(iocpd->iocp, sa.ss_family, 0); // Currently only work with SOCK_STREAM
   if (s == INVALID_SOCKET)
     return NULL;
   return pni_iocpdesc_create(iocpd->iocp, s);
@@ -900,12 +1139,19 @@ write_result_t *pni_write_result(iocpdesc_t *iocpd, const char *buf, size_t bufl
     result->base.iocpd = iocpd;
     result->buffer.start = buf;
     result->buffer.size = buflen;
+#ifdef PN_IOCP_RIO
+    result->rio_id = RIO_INVALID_BUFFERID;
+#endif
   }
   return result;
 }
 
 static int submit_write(write_result_t *result, const void *buf, size_t len)
 {
+#ifdef PN_IOCP_RIO
+  if (result->base.iocpd->rio_rq != RIO_INVALID_RQ)
+    return rio_send(result, buf, len);
+#endif
   WSABUF wsabuf;
   wsabuf.buf = (char *) buf;
   wsabuf.len = len;
@@ -1037,6 +1283,22 @@ static void begin_zero_byte_read(iocpdesc_t *iocpd)
     pni_events_update(iocpd, iocpd->events | PN_READABLE);
     return;
   }
+#ifdef PN_IOCP_RIO
+  if (rio_start(iocpd)) {
+    // A real read into the registered buffer, not a zero byte probe
+    if (iocpd->rio_rstart < iocpd->rio_rend || iocpd->rio_eof) {
+      pni_events_update(iocpd, iocpd->events | PN_READABLE);
+      return;
+    }
+    if (rio_receive(iocpd)) {
+      iocpdesc_fail(iocpd, WSAGetLastError(), "RIO receive error");
+      return;
+    }
+    iocpd->ops_in_progress++;
+    iocpd->read_in_progress = true;
+    return;
+  }
+#endif
 
   read_result_t *result = iocpd->read_result;
   memset(&result->base.overlapped, 0, sizeof (OVERLAPPED));
@@ -1083,10 +1345,51 @@ static void drain_until_closed(iocpdesc_t *iocpd) {
 }
 
 
+#ifdef PN_IOCP_RIO
+static void rio_complete_read(iocpdesc_t *iocpd, DWORD xfer_count, HRESULT status)
+{
+  if (status == 0) {
+    iocpd->rio_rstart = 0;
+    iocpd->rio_rend = xfer_count;
+    if (xfer_count == 0)
+      iocpd->rio_eof = true;
+  }
+  if (iocpd->closing) {
+    // As drain_until_closed, discard data until the peer closes
+    read_result_t *result = iocpd->read_result;
+    if (status || iocpd->rio_eof) {
+      iocpd->read_closed = true;
+    } else {
+      result->drain_count += xfer_count;
+      iocpd->rio_rend = 0;
+      if (result->drain_count < 16 * 1024) {
+        start_reading(iocpd);
+      } else {
+        if (iocpd->iocp->iocp_trace)
+          iocp_log("graceful close on reader abandoned (too many chars)\n");
+        iocpd->read_closed = true;
+      }
+    }
+    reap_check(iocpd);
+    return;
+  }
+  if (status == 0)
+    pni_events_update(iocpd, iocpd->events | PN_READABLE);
+  else
+    iocpdesc_fail(iocpd, status, "RIO receive complete error");
+}
+#endif
+
 void complete_read(read_result_t *result, DWORD xfer_count, HRESULT status)
 {
   iocpdesc_t *iocpd = result->base.iocpd;
   iocpd->read_in_progress = false;
+#ifdef PN_IOCP_RIO
+  if (iocpd->rio_rq != RIO_INVALID_RQ) {
+    rio_complete_read(iocpd, xfer_count, status);
+    return;
+  }
+#endif
 
   if (iocpd->closing) {
     // Application no longer reading, but we are looking for a zero length read
@@ -1124,18 +1427,46 @@ ssize_t pni_iocp_recv(iocpdesc_t *iocpd, void *buf, size_t size, bool *would_blo
       set_iocp_error_status(error, PN_ERR, WSAENOTCONN);
     return SOCKET_ERROR;
   }
+#ifdef PN_IOCP_RIO
+  if (iocpd->rio_rq != RIO_INVALID_RQ) {
+    size_t available = iocpd->rio_rend - iocpd->rio_rstart;
+    if (available) {
+      size_t count = size < available ? size : available;
+      memcpy(buf, iocpd->rio_rbuf + iocpd->rio_rstart, count);
+      iocpd->rio_rstart += count;
+      if (iocpd->rio_rstart == iocpd->rio_rend) {
+        // Drained, the caller initiates the next receive
+        iocpd->rio_rstart = iocpd->rio_rend = 0;
+        pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
+      }
+      return (ssize_t) count;
+    }
+    if (iocpd->rio_eof) {
+      iocpd->read_closed = true;
+      return 0;
+    }
+    pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
+    *would_block = true;
+    return SOCKET_ERROR;
+  }
+#endif
 
   int count = recv(iocpd->socket, (char *) buf, size, 0);
   if (count > 0) {
-    pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
+    // A full buffer suggests more is waiting: stay readable and let the
+    // caller recv again rather than wait a completion for each buffer.
+    if ((size_t) count < size)
+      pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
     // caller must initiate     begin_zero_byte_read(iocpd);
     return (ssize_t) count;
   } else if (count == 0) {
     iocpd->read_closed = true;
     return 0;
   }
-  if (WSAGetLastError() == WSAEWOULDBLOCK)
+  if (WSAGetLastError() == WSAEWOULDBLOCK) {
+    pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
     *would_block = true;
+  }
   else {
     set_iocp_error_status(error, PN_ERR, WSAGetLastError());
     iocpd->read_closed = true;
@@ -1172,6 +1503,12 @@ static void pni_iocpdesc_finalize(void *object)
     iocp_log("iocp descriptor read leak\n");
   else
     free(iocpd->read_result);
+#ifdef PN_IOCP_RIO
+  if (iocpd->rio_rbuf) {
+    pni_rio.RIODeregisterBuffer(iocpd->rio_rbuf_id);
+    free(iocpd->rio_rbuf);
+  }
+#endif
 }
 
 static uintptr_t pni_iocpdesc_hashcode(void *object)
@@ -1220,6 +1557,14 @@ iocpdesc_t *pni_iocpdesc_create(iocp_t *iocp, pn_socket_t s) {
 }
 
 
+static void skip_set_event(SOCKET s)
+{
+#ifdef FILE_SKIP_SET_EVENT_ON_HANDLE
+  // Completions only ever come through the port, nobody waits on the handle
+  SetFileCompletionNotificationModes((HANDLE) s, FILE_SKIP_SET_EVENT_ON_HANDLE);
+#endif
+}
+
 static void bind_to_completion_port(iocpdesc_t *iocpd)
 {
   if (iocpd->bound) return;
@@ -1228,8 +1573,10 @@ static void bind_to_completion_port(iocpdesc_t *iocpd)
     return;
   }
 
-  if (CreateIoCompletionPort ((HANDLE) iocpd->socket, iocpd->iocp->completion_port, 0, 0))
+  if (CreateIoCompletionPort ((HANDLE) iocpd->socket, iocpd->iocp->completion_port, 0, 0)) {
     iocpd->bound = true;
+    skip_set_event(iocpd->socket);
+  }
   else {
     iocpdesc_fail(iocpd, GetLastError(), "IOCP socket setup.");
   }
@@ -1257,9 +1604,8 @@ void pni_iocpdesc_start(iocpdesc_t *iocpd)
   }
 }
 
-static void complete(iocp_result_t *result, bool success, DWORD num_transferred) {
+static void complete_status(iocp_result_t *result, DWORD status, DWORD num_transferred) {
   result->iocpd->ops_in_progress--;
-  DWORD status = success ? 0 : GetLastError();
 
   switch (result->type) {
   case IOCP_ACCEPT:
@@ -1279,6 +1625,10 @@ static void complete(iocp_result_t *result, bool success, DWORD num_transferred)
   }
 }
 
+static void complete(iocp_result_t *result, bool success, DWORD num_transferred) {
+  complete_status(result, success ? 0 : GetLastError(), num_transferred);
+}
+
 void pni_iocp_drain_completions(iocp_t *iocp)
 {
   while (true) {
@@ -1294,6 +1644,12 @@ void pni_iocp_drain_completions(iocp_t *iocp)
     iocp_result_t *result = (iocp_result_t *) overlapped;
     if (!completion_key)
       complete(result, good_op, num_transferred);
+#ifdef PN_IOCP_RIO
+    else if (completion_key == rio_notify_key)
+      rio_dequeue(iocp);
+    else if (completion_key == rio_complete_key)
+      complete_status(result, result->status, result->num_transferred);
+#endif
   }
 }
 
@@ -1316,6 +1672,17 @@ int pni_iocp_wait_one(iocp_t *iocp, int timeout, pn_error_t *error) {
       return -1;
     }
 
+#ifdef PN_IOCP_RIO
+  if (completion_key == rio_notify_key) {
+    rio_dequeue(iocp);
+    return pni_iocp_wait_one(iocp, timeout, error);
+  }
+  if (completion_key == rio_complete_key) {
+    iocp_result_t *result = (iocp_result_t *) overlapped;
+    complete_status(result, result->status, result->num_transferred);
+    return 1;
+  }
+#endif
   if (completion_key)
     return pni_iocp_wait_one(iocp, timeout, error);
   iocp_result_t *result = (iocp_result_t *) overlapped;
@@ -1334,6 +1701,9 @@ static void zombie_list_add(iocpdesc_t *iocpd)
   if (!iocpd->ops_in_progress) {
     // No need to make a zombie.
     if (iocpd->socket != INVALID_SOCKET) {
+#ifdef PN_IOCP_RIO
+      rio_stop(iocpd);
+#endif
       closesocket(iocpd->socket);
       iocpd->socket = INVALID_SOCKET;
       iocpd->read_closed = true;
@@ -1349,6 +1719,9 @@ static void reap_check(iocpdesc_t *iocpd)
 {
   if (iocpd->closing && !iocpd->ops_in_progress) {
     if (iocpd->socket != INVALID_SOCKET) {
+#ifdef PN_IOCP_RIO
+      rio_stop(iocpd);
+#endif
       closesocket(iocpd->socket);
       iocpd->socket = INVALID_SOCKET;
     }
@@ -1439,6 +1812,9 @@ static void zombie_list_hard_close_all(iocp_t *iocp)
   for (size_t i = 0; i < zs; i++) {
     iocpdesc_t *iocpd = (iocpdesc_t *) pn_list_get(iocp->zombie_list, i);
     if (iocpd->socket != INVALID_SOCKET) {
+#ifdef PN_IOCP_RIO
+      rio_stop(iocpd);
+#endif
       closesocket(iocpd->socket);
       iocpd->socket = INVALID_SOCKET;
       iocpd->read_closed = true;
@@ -1508,8 +1884,15 @@ void pni_iocp_initialize(void *obj)
   iocp_t *iocp = (iocp_t *) obj;
   memset(iocp, 0, sizeof(iocp_t));
   pni_shared_pool_create(iocp);
-  iocp->completion_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+  DWORD threads = 0;  // One per processor
+  const char *env = getenv("PN_PROACTOR_THREADS");
+  if (env && atoi(env) > 0)
+    threads = atoi(env);
+  iocp->completion_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, threads);
   assert(iocp->completion_port != NULL);
+#ifdef PN_IOCP_RIO
+  rio_initialize(iocp);
+#endif
   iocp->zombie_list = pn_list(PN_OBJECT, 0);
   iocp->iocp_trace = true;
 }
@@ -1520,6 +1903,9 @@ void pni_iocp_finalize(void *obj)
   // Move sockets to closed state
   drain_zombie_completions(iocp);    // Last chance for graceful close
   zombie_list_hard_close_all(iocp);
+#ifdef PN_IOCP_RIO
+  rio_finalize(iocp);
+#endif
   CloseHandle(iocp->completion_port);  // This cancels all our async ops
   iocp->completion_port = NULL;
   // Now safe to free everything that might be touched by a former async operation.
@@ -1598,7 +1984,7 @@ static int pgetaddrinfo(const char *host, const char *port, int flags, struct ad
 }
 
 const char *COND_NAME = "proactor";
-PN_HANDLE(PN_PROACTOR)
+static const pn_handle_t PN_PROACTOR = PN_RECORD_SLOT(1);
 
 // The number of times a connection event batch may be replenished for
 // a thread between calls to wait().
@@ -1630,6 +2016,7 @@ typedef struct pcontext_t {
   bool wake_pending;
   int completion_ops;  // uncompleted ops that are not socket IO related
   struct pcontext_t *wake_next; // wake list, guarded by proactor eventfd_mutex
+  uint64_t wake_time;       // wakeup() posted, only with proactor stats
   bool closing;
   // Next 4 are protected by the proactor mutex
   struct pcontext_t* next;  /* Protected by proactor.mutex */
@@ -1681,6 +2068,9 @@ struct pn_proactor_t {
   bool timeout_request;
   bool timeout_elapsed;
   bool shutting_down;
+  int affinity;                 /* PN_PROACTOR_AFFINITY */
+  LONG affinity_next;           /* threads pinned so far */
+  pn_proactor_stats_t *stats;   /* NULL unless PN_PROACTOR_STATS is set */
 };
 
 struct pn_netaddr_t {
@@ -1704,8 +2094,18 @@ typedef struct pconnection_t {
   struct pn_netaddr_t local, remote; /* Actual addresses */
   struct addrinfo *addrinfo;         /* Resolved address list */
   struct addrinfo *ai;               /* Current connect address */
+  // Latency statistics, NULL unless the proactor keeps them
+  pn_proactor_stats_t *stats;
+  uint64_t batch_start;              /* working thread: batch returned */
 } pconnection_t;
 
+// Record a duration for a connection and its proactor, call only if pc->stats
+#define PCONNECTION_STAT(PC, FIELD, NS) do {                            \
+    uint64_t ns_ = (NS);                                                \
+    pni_histogram_record(&(PC)->stats->FIELD, ns_);                     \
+    pni_histogram_record(&(PC)->context.proactor->stats->FIELD, ns_);   \
+  } while (0)
+
 struct pn_listener_t {
   psocket_t *psockets;          /* Array of listening sockets */
   size_t psockets_size;
@@ -1858,6 +2258,8 @@ static void wakeup(psocket_t *ps) {
   if (!ctx->working && !ctx->wake_pending) {
     ctx->wake_pending = true;
     ctx->completion_ops++;
+    if (ctx->proactor->stats)
+      ctx->wake_time = pni_proactor_stats_now();
     post_completion(ctx->proactor->iocp, psocket_wakeup_key, ps);
   }
 }
@@ -2003,7 +2405,7 @@ static inline bool proactor_has_event(pn_proactor_t *p) {
 
 static pn_event_t *log_event(void* p, pn_event_t *e) {
   if (e) {
-    pn_logf("[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+    pn_log(PN_SUBSYSTEM_EVENT, PN_LEVEL_TRACE, "[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
   }
   return e;
 }
@@ -2040,6 +2442,7 @@ static void psocket_error(psocket_t *ps, int err, const char* what) {
 
 static void pconnection_finalize(void *vp_pconnection) {
   pconnection_t *pc = (pconnection_t*)vp_pconnection;
+  free(pc->stats);
   pcontext_finalize(&pc->context);
 }
 
@@ -2052,9 +2455,14 @@ static pconnection_t *new_pconnection_t(pn_proactor_t *p, pn_connection_t *c, bo
     free(pc);
     return NULL;
   }
+  pni_proactor_capture(pc->driver.transport);
+  pni_proactor_prewarm(pc->driver.connection, pc->driver.collector);
   pc->completion_queue = new std::queue<iocp_result_t *>();
   pc->work_queue = new std::queue<iocp_result_t *>();
   pcontext_init(&pc->context, PCONNECTION, p, pc);
+  /* Statistics are skipped for this connection if the allocation fails */
+  pc->stats = p->stats ? (pn_proactor_stats_t*)calloc(1, sizeof(*pc->stats)) : NULL;
+  pc->batch_start = 0;
 
   psocket_init(&pc->psocket, NULL, false, addr);
   pc->batch.next_event = pconnection_batch_next;
@@ -2158,6 +2566,10 @@ static bool pconnection_cleanup(pconnection_t *pc) {
 static inline bool pconnection_work_pending(pconnection_t *pc) {
   if (pc->completion_queue->size() || pc->wake_count || pc->tick_pending)
     return true;
+  iocpdesc_t *iocpd = pc->psocket.iocpd;
+  if (iocpd && (iocpd->events & PN_READABLE) && !iocpd->read_in_progress &&
+      pn_connection_driver_read_buffer(&pc->driver).size > 0)
+    return true;  // Left readable by a recv that filled the buffer
   pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
   return (wbuf.size > 0 && (pc->psocket.iocpd->events & PN_WRITABLE));
 }
@@ -2302,7 +2714,9 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, iocp_result_t *r
         else if (!wouldblock)
           psocket_error(&pc->psocket, WSAGetLastError(), "on read from");
       }
-      if (!pc->psocket.iocpd->read_in_progress)
+      // Still readable after a full buffer: loop round and recv again
+      if (!pc->psocket.iocpd->read_in_progress &&
+          (rbuf.size == 0 || !(pc->psocket.iocpd->events & PN_READABLE)))
         start_reading(pc->psocket.iocpd);
 
 
@@ -2355,6 +2769,10 @@ static void pconnection_done(pconnection_t *pc) {
 void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
   pconnection_t *pc = batch_pconnection(batch);
   if (pc) {
+    if (pc->batch_start) {
+      PCONNECTION_STAT(pc, batch, pni_proactor_stats_now() - pc->batch_start);
+      pc->batch_start = 0;
+    }
     pconnection_done(pc);
     return;
   }
@@ -2404,7 +2822,58 @@ static pn_event_batch_t *psocket_process(psocket_t *ps, iocp_result_t *result, r
   return NULL;
 }
 
+enum { AFFINITY_NONE, AFFINITY_CORE, AFFINITY_NUMA };
+
+#ifdef _MSC_VER
+static __declspec(thread) bool thread_pinned = false;
+#else
+static __thread bool thread_pinned = false;
+#endif
+
+// Pin the calling thread to the next processor or NUMA node in turn
+static void pin_thread(pn_proactor_t *p) {
+  thread_pinned = true;
+  ULONG n = (ULONG) InterlockedIncrement(&p->affinity_next) - 1;
+  GROUP_AFFINITY ga;
+  memset(&ga, 0, sizeof(ga));
+  if (p->affinity == AFFINITY_NUMA) {
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest) ||
+        !GetNumaNodeProcessorMaskEx((USHORT) (n % (highest + 1)), &ga))
+      return;
+  } else {
+    DWORD total = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    if (!total) return;
+    DWORD cpu = n % total;
+    WORD groups = GetActiveProcessorGroupCount();
+    for (WORD g = 0; g < groups; g++) {
+      DWORD count = GetActiveProcessorCount(g);
+      if (cpu < count) {
+        ga.Group = g;
+        ga.Mask = (KAFFINITY) 1 << cpu;
+        break;
+      }
+      cpu -= count;
+    }
+  }
+  if (ga.Mask)                  // A node may have no processors
+    SetThreadGroupAffinity(GetCurrentThread(), &ga, NULL);
+}
+
+// Note the start of a connection batch for pn_proactor_stats(), ready is
+// when the IO completion that produced it was dequeued or 0.
+static void stats_batch_start(pn_event_batch_t *batch, uint64_t ready) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc && pc->stats) {
+    pc->batch_start = pni_proactor_stats_now();
+    if (ready)
+      PCONNECTION_STAT(pc, dispatch, pc->batch_start - ready);
+  }
+}
+
 pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  if (p->affinity != AFFINITY_NONE && !thread_pinned)
+    pin_thread(p);
   // Proact! Process inbound completions of async activity until one
   // of them provides a batch of events.
   while(true) {
@@ -2417,6 +2886,7 @@ pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
 
     bool good_op = GetQueuedCompletionStatus (p->iocp->completion_port, &num_xfer,
                                               &completion_key, &overlapped, win_timeout);
+    uint64_t ready = p->stats ? pni_proactor_stats_now() : 0;
     if (!good_op && !overlapped) {
       // Should never happen.  shutdown?
       // We aren't expecting a timeout, closed completion port, or other error here.
@@ -2433,18 +2903,38 @@ pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
       psocket_t *ps = (psocket_t *) result->iocpd->active_completer;
       batch = psocket_process(ps, result, p->reaper);
     }
+#ifdef PN_IOCP_RIO
+    else if (completion_key == rio_complete_key) {
+      // Registered I/O result, status and count already set by rio_dequeue
+      iocp_result_t *result = (iocp_result_t *) overlapped;
+      psocket_t *ps = (psocket_t *) result->iocpd->active_completer;
+      batch = psocket_process(ps, result, p->reaper);
+    }
+    else if (completion_key == rio_notify_key) {
+      rio_dequeue(p->iocp);
+    }
+#endif
     else {
       // completion_key on our completion port is always null unless set by us
       // in PostQueuedCompletionStatus.  In which case, we hijack the overlapped
       // data structure for our own use.
-      if (completion_key == psocket_wakeup_key)
+      if (completion_key == psocket_wakeup_key) {
+        pconnection_t *pc = as_pconnection_t((psocket_t *) overlapped);
+        if (pc && pc->stats && pc->context.wake_time)
+          PCONNECTION_STAT(pc, wake, ready - pc->context.wake_time);
+        ready = 0;              // Not socket readiness
         batch = psocket_process((psocket_t *) overlapped, NULL, p->reaper);
+      }
       else if (completion_key == proactor_wakeup_key)
         batch = proactor_process((pn_proactor_t *) overlapped);
       else if (completion_key == recycle_accept_key)
         recycle_result((accept_result_t *) overlapped);
     }
-    if (batch) return batch;
+    if (batch) {
+      if (p->stats)
+        stats_batch_start(batch, ready);
+      return batch;
+    }
     // No event generated.  Try again with next completion.
   }
 }
@@ -2477,7 +2967,7 @@ static bool connect_step(pconnection_t *pc) {
   while (pc->ai) {            /* Have an address */
     struct addrinfo *ai = pc->ai;
     pc->ai = pc->ai->ai_next; /* Move to next address in case this fails */
-    unique_socket fd(::socket(ai->ai_family, SOCK_STREAM, ai->ai_protocol));
+    unique_socket fd(pni_iocp_socket(p->iocp, ai->ai_family, ai->ai_protocol));
     if (fd != INVALID_SOCKET) {
       pni_configure_sock_2(fd);
       if (!pc->psocket.iocpd) {
@@ -2491,6 +2981,7 @@ static bool connect_step(pconnection_t *pc) {
       fd.release();
       iocpdesc_t *iocpd = pc->psocket.iocpd;
       if (CreateIoCompletionPort ((HANDLE) iocpd->socket, iocpd->iocp->completion_port, 0, 0)) {
+        skip_set_event(iocpd->socket);
         LPFN_CONNECTEX fn_connect_ex = lookup_connect_ex2(iocpd->socket);
         // addrinfo is owned by the pconnection so pass NULL to the connect result
         connect_result_t *result = connect_result(iocpd, NULL);
@@ -2727,6 +3218,19 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->context.proactor : NULL;
 }
 
+int pn_proactor_stats(pn_proactor_t *p, pn_proactor_stats_t *stats) {
+  if (!p->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, p->stats);
+  return 0;
+}
+
+int pn_connection_proactor_stats(pn_connection_t *c, pn_proactor_stats_t *stats) {
+  pconnection_t *pc = get_pconnection(c);
+  if (!pc || !pc->stats) return PN_STATE_ERR;
+  pni_proactor_stats_copy(stats, pc->stats);
+  return 0;
+}
+
 void pn_connection_wake(pn_connection_t* c) {
   pconnection_t *pc = get_pconnection(c);
   csguard g(&pc->context.cslock);
@@ -2761,6 +3265,13 @@ pn_proactor_t *pn_proactor() {
             p->batch.next_event = &proactor_batch_next;
             p->collector = c;
             p->timer_queue = tq;
+            const char *env = getenv("PN_PROACTOR_AFFINITY");
+            if (env && !strcmp(env, "core"))
+              p->affinity = AFFINITY_CORE;
+            else if (env && !strcmp(env, "numa"))
+              p->affinity = AFFINITY_NUMA;
+            if (pni_proactor_stats_enabled())
+              p->stats = (pn_proactor_stats_t*)calloc(1, sizeof(*p->stats));
             InitializeCriticalSectionAndSpinCount(&p->context.cslock, 4000);
             InitializeCriticalSectionAndSpinCount(&p->write_lock, 4000);
             return p;
@@ -2784,6 +3295,7 @@ void pn_proactor_free(pn_proactor_t *p) {
   delete p->reaper;
   WSACleanup();
   pn_collector_free(p->collector);
+  free(p->stats);
   free(p);
 }
 
@@ -2941,6 +3453,25 @@ static void recycle_result(accept_result_t *accept_result) {
   }
 }
 
+size_t pn_listener_backlog(pn_listener_t *l) {
+  csguard g(&l->context.cslock);
+  return l->accept_results->size();
+}
+
+int pn_proactor_set_option(pn_proactor_t *p, pn_proactor_option_t option, int value) {
+  return PN_STATE_ERR;          /* No tuning options */
+}
+
+int pn_listener_set_reuseport(pn_listener_t *l, bool reuseport) {
+  /* SO_REUSEADDR on Windows lets a second socket steal the port rather
+     than share the load, so there is no equivalent */
+  return reuseport ? PN_STATE_ERR : 0;
+}
+
+int pn_listener_overflow(pn_listener_t *l, pn_listener_overflow_t *overflow) {
+  return PN_STATE_ERR;          /* Not counted */
+}
+
 void pn_listener_accept(pn_listener_t *l, pn_connection_t *c) {
   accept_result_t *accept_result = NULL;
   DWORD err = 0;
@@ -3183,6 +3714,10 @@ void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
 #endif
 }
 
+void pn_proactor_disconnect_async(pn_proactor_t *p, pn_condition_t *cond) {
+  pn_proactor_disconnect(p, cond);
+}
+
 
 //TODO!!
 void pn_proactor_release_connection(pn_connection_t *c) {
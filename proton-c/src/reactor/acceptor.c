@@ -28,6 +28,7 @@
 #include "selectable.h"
 #include "selector.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 pn_selectable_t *pn_reactor_selectable_transport(pn_reactor_t *reactor, pn_socket_t sock, pn_transport_t *transport);
@@ -36,14 +37,9 @@ PN_HANDLE(PNI_ACCEPTOR_HANDLER)
 PN_HANDLE(PNI_ACCEPTOR_SSL_DOMAIN)
 PN_HANDLE(PNI_ACCEPTOR_CONNECTION)
 
-void pni_acceptor_readable(pn_selectable_t *sel) {
-  pn_reactor_t *reactor = (pn_reactor_t *) pni_selectable_get_context(sel);
-  char name[1024];
-  pn_socket_t sock = pn_accept(pni_reactor_io(reactor), pn_selectable_get_fd(sel), name, 1024);
-  pn_handler_t *handler = (pn_handler_t *) pn_record_get(pn_selectable_attachments(sel), PNI_ACCEPTOR_HANDLER);
-  if (!handler) { handler = pn_reactor_get_handler(reactor); }
-  pn_record_t *record = pn_selectable_attachments(sel);
-  pn_ssl_domain_t *ssl_domain = (pn_ssl_domain_t *) pn_record_get(record, PNI_ACCEPTOR_SSL_DOMAIN);
+// Set up a connection for an accepted socket, dispatching its events to handler
+static pn_connection_t *pni_accepted(pn_reactor_t *reactor, pn_socket_t sock, char *name,
+                                     pn_handler_t *handler, pn_ssl_domain_t *ssl_domain) {
   pn_connection_t *conn = pn_reactor_connection(reactor, handler);
   if (name[0]) { // store the peer address of connection in <host>:<port> format
     char *port = strrchr(name, ':');   // last : separates the port #
@@ -59,6 +55,26 @@ void pni_acceptor_readable(pn_selectable_t *sel) {
   pn_transport_bind(trans, conn);
   pn_decref(trans);
   pn_reactor_selectable_transport(reactor, sock, trans);
+  return conn;
+}
+
+void pni_acceptor_readable(pn_selectable_t *sel) {
+  pn_reactor_t *reactor = (pn_reactor_t *) pni_selectable_get_context(sel);
+  char name[1024];
+  pn_socket_t sock = pn_accept(pni_reactor_io(reactor), pn_selectable_get_fd(sel), name, 1024);
+  pn_handler_t *handler = (pn_handler_t *) pn_record_get(pn_selectable_attachments(sel), PNI_ACCEPTOR_HANDLER);
+  if (!handler) { handler = pn_reactor_get_handler(reactor); }
+  pn_record_t *record = pn_selectable_attachments(sel);
+  pn_ssl_domain_t *ssl_domain = (pn_ssl_domain_t *) pn_record_get(record, PNI_ACCEPTOR_SSL_DOMAIN);
+  if (sock != PN_INVALID_SOCKET && strlen(name) < sizeof(((pni_handoff_t *) 0)->name)) {
+    pni_handoff_t handoff;
+    memset(&handoff, 0, sizeof(handoff));
+    handoff.sock = sock;
+    handoff.ssl = ssl_domain != NULL;
+    strcpy(handoff.name, name);
+    if (pni_reactor_handoff(reactor, &handoff)) return;
+  }
+  pn_connection_t *conn = pni_accepted(reactor, sock, name, handler, ssl_domain);
   record = pn_connection_attachments(conn);
   pn_record_def(record, PNI_ACCEPTOR_CONNECTION, PN_OBJECT);
   pn_record_set(record, PNI_ACCEPTOR_CONNECTION, sel);
@@ -110,6 +126,61 @@ void pn_acceptor_set_ssl_domain(pn_acceptor_t *acceptor, pn_ssl_domain_t *domain
   pn_record_set(record, PNI_ACCEPTOR_SSL_DOMAIN, domain);
 }
 
+// Worker side of pn_reactor_add_worker: sockets arrive as pni_handoff_t records on a pipe
+
+PN_HANDLE(PNI_HANDOFF_SSL_DOMAIN)
+PN_HANDLE(PNI_HANDOFF_BUFFER)
+
+typedef struct {
+  pni_handoff_t handoff;
+  size_t size;                  // Bytes of handoff read so far
+} pni_handoff_buffer_t;
+
+static void pni_handoff_readable(pn_selectable_t *sel) {
+  pn_reactor_t *reactor = (pn_reactor_t *) pni_selectable_get_context(sel);
+  pn_record_t *record = pn_selectable_attachments(sel);
+  pni_handoff_buffer_t *buf = (pni_handoff_buffer_t *) pn_record_get(record, PNI_HANDOFF_BUFFER);
+  ssize_t n = pn_read(pni_reactor_io(reactor), pn_selectable_get_fd(sel),
+                      (char *) &buf->handoff + buf->size, sizeof(buf->handoff) - buf->size);
+  if (n <= 0) {
+    // The accepting reactor has gone, stop waiting for it
+    if (buf->size >= sizeof(buf->handoff.sock)) pn_close(pni_reactor_io(reactor), buf->handoff.sock);
+    pn_selectable_terminate(sel);
+    pn_reactor_update(reactor, sel);
+    return;
+  }
+  buf->size += n;
+  if (buf->size == sizeof(buf->handoff)) {
+    buf->size = 0;
+    pn_ssl_domain_t *ssl_domain = buf->handoff.ssl ?
+      (pn_ssl_domain_t *) pn_record_get(record, PNI_HANDOFF_SSL_DOMAIN) : NULL;
+    pni_accepted(reactor, buf->handoff.sock, buf->handoff.name, NULL, ssl_domain);
+  }
+}
+
+static void pni_handoff_finalize(pn_selectable_t *sel) {
+  pn_reactor_t *reactor = (pn_reactor_t *) pni_selectable_get_context(sel);
+  pn_close(pni_reactor_io(reactor), pn_selectable_get_fd(sel));
+  free(pn_record_get(pn_selectable_attachments(sel), PNI_HANDOFF_BUFFER));
+}
+
+pn_selectable_t *pni_handoff_selectable(pn_reactor_t *worker, pn_socket_t sock, pn_ssl_domain_t *ssl_domain) {
+  pn_selectable_t *sel = pn_reactor_selectable(worker);
+  pn_selectable_set_fd(sel, sock);
+  pn_selectable_on_readable(sel, pni_handoff_readable);
+  pn_selectable_on_error(sel, pni_handoff_readable); // Hang up, read to the end
+  pn_selectable_on_finalize(sel, pni_handoff_finalize);
+  pni_record_init_reactor(pn_selectable_attachments(sel), worker);
+  pn_record_t *record = pn_selectable_attachments(sel);
+  pn_record_def(record, PNI_HANDOFF_SSL_DOMAIN, PN_VOID);
+  pn_record_set(record, PNI_HANDOFF_SSL_DOMAIN, ssl_domain);
+  pn_record_def(record, PNI_HANDOFF_BUFFER, PN_VOID);
+  pn_record_set(record, PNI_HANDOFF_BUFFER, calloc(1, sizeof(pni_handoff_buffer_t)));
+  pn_selectable_set_reading(sel, true);
+  pn_reactor_update(worker, sel);
+  return sel;
+}
+
 pn_acceptor_t *pn_connection_acceptor(pn_connection_t *conn) {
   // Return the acceptor that created the connection or NULL if an outbound connection
   pn_record_t *record = pn_connection_attachments(conn);
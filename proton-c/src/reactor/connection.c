@@ -138,9 +138,11 @@ void pni_handle_bound(pn_reactor_t *reactor, pn_event_t *event) {
   // link the new transport to its reactor:
   pni_record_init_reactor(pn_transport_attachments(transport), reactor);
 
-  if (pn_connection_acceptor(conn) != NULL) {
-      // this connection was created by the acceptor.  There is already a
-      // socket assigned to this connection.  Nothing needs to be done.
+  if (pn_connection_acceptor(conn) != NULL ||
+      pn_record_get(pn_transport_attachments(transport), PN_TRANCTX)) {
+      // this connection was created by an acceptor, possibly one handing its
+      // sockets off to this reactor.  There is already a socket assigned to
+      // this connection.  Nothing needs to be done.
       return;
   }
 
@@ -0,0 +1,456 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+// Selector using epoll (Linux) or kqueue (BSD, macOS) in place of poll().
+//
+// File descriptors stay registered with the kernel between calls, so
+// pn_selector_select() costs the number of ready selectables, not the
+// number of registered ones.  Deadlines are kept in a binary min-heap.
+//
+// The kernel registration is keyed by fd.  If two selectables use the same
+// fd only the most recently registered one gets its events.
+
+#include "core/util.h"
+#include "platform/platform.h" // pn_i_now, pn_i_error_from_errno
+#include "reactor/io.h"
+#include "reactor/selector.h"
+#include "reactor/selectable.h"
+
+#include <proton/error.h>
+
+#if defined(__linux__)
+#  define USE_EPOLL 1
+#  include <sys/epoll.h>
+#else
+#  include <sys/types.h>
+#  include <sys/event.h>
+#  include <sys/time.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 256
+
+typedef struct {
+  pn_selectable_t *selectable;
+  int fd;                       // fd registered with the kernel, -1 if none
+  int interest;                 // PN_READABLE | PN_WRITABLE registered for fd
+  int revents;                  // events found by the last select
+  pn_timestamp_t deadline;
+  int heap;                     // position in selector->heap, -1 if no deadline
+  bool ready;                   // in selector->ready
+} pni_slot_t;
+
+struct pn_selector_t {
+  int kfd;                      // epoll or kqueue descriptor
+  pni_slot_t *slots;            // indexed by the selectable's index
+  size_t size;
+  size_t capacity;
+  int *heap;                    // slot indexes ordered on deadline
+  size_t heap_size;
+  int *owners;                  // slot index + 1 of the slot registered for each fd, 0 if none
+  size_t owners_size;
+  pn_selectable_t **ready;      // selectables with events from the last select, NULL once removed
+  size_t ready_size;
+  size_t current;
+  pn_timestamp_t awoken;
+  pn_error_t *error;
+};
+
+// Deadline heap
+
+static inline bool heap_less(pn_selector_t *s, size_t a, size_t b) {
+  return s->slots[s->heap[a]].deadline < s->slots[s->heap[b]].deadline;
+}
+
+static inline void heap_swap(pn_selector_t *s, size_t a, size_t b) {
+  int t = s->heap[a];
+  s->heap[a] = s->heap[b];
+  s->heap[b] = t;
+  s->slots[s->heap[a]].heap = a;
+  s->slots[s->heap[b]].heap = b;
+}
+
+static void heap_fix(pn_selector_t *s, size_t i) {
+  while (i > 0 && heap_less(s, i, (i - 1) / 2)) {
+    heap_swap(s, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  for (;;) {
+    size_t l = 2*i + 1, r = l + 1, m = i;
+    if (l < s->heap_size && heap_less(s, l, m)) m = l;
+    if (r < s->heap_size && heap_less(s, r, m)) m = r;
+    if (m == i) break;
+    heap_swap(s, i, m);
+    i = m;
+  }
+}
+
+static void heap_remove(pn_selector_t *s, int idx) {
+  size_t i = s->slots[idx].heap;
+  s->slots[idx].heap = -1;
+  if (i != --s->heap_size) {
+    s->heap[i] = s->heap[s->heap_size];
+    s->slots[s->heap[i]].heap = i;
+    heap_fix(s, i);
+  }
+}
+
+static void heap_set(pn_selector_t *s, int idx, pn_timestamp_t deadline) {
+  pni_slot_t *slot = &s->slots[idx];
+  if (deadline == slot->deadline && (deadline == 0) == (slot->heap < 0)) return;
+  slot->deadline = deadline;
+  if (!deadline) {
+    heap_remove(s, idx);
+    return;
+  }
+  if (slot->heap < 0) {
+    slot->heap = s->heap_size++;
+    s->heap[slot->heap] = idx;
+  }
+  heap_fix(s, slot->heap);
+}
+
+static void slot_found(pn_selector_t *s, int idx, int events) {
+  pni_slot_t *slot = &s->slots[idx];
+  slot->revents |= events;
+  if (!slot->ready) {
+    slot->ready = true;
+    s->ready[s->ready_size++] = slot->selectable;
+  }
+}
+
+// Mark every expired slot, walking only the part of the heap that has expired
+static void heap_expire(pn_selector_t *s, size_t i, pn_timestamp_t now) {
+  if (i >= s->heap_size || s->slots[s->heap[i]].deadline > now) return;
+  slot_found(s, s->heap[i], PN_EXPIRED);
+  heap_expire(s, 2*i + 1, now);
+  heap_expire(s, 2*i + 2, now);
+}
+
+// Kernel registration
+
+#ifdef USE_EPOLL
+
+static int kernel_open(void) { return epoll_create1(EPOLL_CLOEXEC); }
+
+static int kernel_set(pn_selector_t *s, int fd, int old, int interest) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = fd;
+  if (interest & PN_READABLE) ev.events |= EPOLLIN;
+  if (interest & PN_WRITABLE) ev.events |= EPOLLOUT;
+  int op = old < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  int r = epoll_ctl(s->kfd, op, fd, &ev);
+  if (r < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+    r = epoll_ctl(s->kfd, EPOLL_CTL_MOD, fd, &ev);
+  } else if (r < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+    r = epoll_ctl(s->kfd, EPOLL_CTL_ADD, fd, &ev); // fd was closed and reused
+  }
+  return r;
+}
+
+static void kernel_del(pn_selector_t *s, int fd, int interest) {
+  struct epoll_event ev;
+  (void) interest;
+  epoll_ctl(s->kfd, EPOLL_CTL_DEL, fd, &ev); // Fails harmlessly if fd is already closed
+}
+
+static int kernel_wait(pn_selector_t *s, int timeout, void (*found)(pn_selector_t*, int fd, int events)) {
+  struct epoll_event evs[MAX_EVENTS];
+  int n = epoll_wait(s->kfd, evs, MAX_EVENTS, timeout);
+  for (int i = 0; i < n; ++i) {
+    int events = 0;
+    if (evs[i].events & EPOLLIN) events |= PN_READABLE;
+    if (evs[i].events & EPOLLOUT) events |= PN_WRITABLE;
+    if (evs[i].events & (EPOLLERR | EPOLLHUP)) events |= PN_ERROR;
+    found(s, evs[i].data.fd, events);
+  }
+  return n;
+}
+
+#else
+
+static int kernel_open(void) { return kqueue(); }
+
+static int kernel_set(pn_selector_t *s, int fd, int old, int interest) {
+  struct kevent ch[2];
+  int n = 0;
+  if (old < 0) old = 0;
+  if ((interest ^ old) & PN_READABLE) {
+    EV_SET(&ch[n++], fd, EVFILT_READ, (interest & PN_READABLE) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+  }
+  if ((interest ^ old) & PN_WRITABLE) {
+    EV_SET(&ch[n++], fd, EVFILT_WRITE, (interest & PN_WRITABLE) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+  }
+  // Deleting a filter of a closed and reused fd fails, there is nothing to delete
+  return (n && kevent(s->kfd, ch, n, NULL, 0, NULL) < 0 && errno != ENOENT) ? -1 : 0;
+}
+
+static void kernel_del(pn_selector_t *s, int fd, int interest) {
+  kernel_set(s, fd, interest, 0);
+}
+
+static int kernel_wait(pn_selector_t *s, int timeout, void (*found)(pn_selector_t*, int fd, int events)) {
+  struct kevent evs[MAX_EVENTS];
+  struct timespec ts, *tsp = NULL;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    tsp = &ts;
+  }
+  int n = kevent(s->kfd, NULL, 0, evs, MAX_EVENTS, tsp);
+  for (int i = 0; i < n; ++i) {
+    int events = 0;
+    if (evs[i].filter == EVFILT_READ) events |= PN_READABLE;
+    if (evs[i].filter == EVFILT_WRITE) events |= PN_WRITABLE;
+    if (evs[i].flags & (EV_ERROR | EV_EOF)) events |= PN_ERROR;
+    found(s, (int) evs[i].ident, events);
+  }
+  return n;
+}
+
+#endif
+
+static void selector_found(pn_selector_t *s, int fd, int events) {
+  if (fd < 0 || (size_t) fd >= s->owners_size || !s->owners[fd]) return;
+  slot_found(s, s->owners[fd] - 1, events);
+}
+
+// Register the slot's fd and interest, taking the fd over from any slot whose fd was closed
+static void slot_register(pn_selector_t *s, int idx, int fd, int interest) {
+  pni_slot_t *slot = &s->slots[idx];
+  if (slot->fd >= 0 && slot->fd != fd) {
+    if (s->owners[slot->fd] == idx + 1) {
+      kernel_del(s, slot->fd, slot->interest);
+      s->owners[slot->fd] = 0;
+    }
+    slot->fd = -1;
+  }
+  if (fd < 0) return;
+  if ((size_t) fd >= s->owners_size) {
+    size_t size = s->owners_size ? s->owners_size : 64;
+    while (size <= (size_t) fd) size *= 2;
+    s->owners = (int *) realloc(s->owners, size * sizeof(int));
+    memset(s->owners + s->owners_size, 0, (size - s->owners_size) * sizeof(int));
+    s->owners_size = size;
+  }
+  int owner = s->owners[fd];
+  int old = -1;                 // Not registered by this slot, add it
+  if (owner == idx + 1) {
+    old = slot->interest;
+  } else if (owner) {
+    s->slots[owner - 1].fd = -1;
+  }
+  if (old != interest || owner != idx + 1) {
+    if (kernel_set(s, fd, old, interest) < 0) {
+      pn_i_error_from_errno(s->error, "selector register");
+    }
+  }
+  s->owners[fd] = idx + 1;
+  slot->fd = fd;
+  slot->interest = interest;
+}
+
+void pn_selector_initialize(void *obj)
+{
+  pn_selector_t *selector = (pn_selector_t *) obj;
+  selector->kfd = kernel_open();
+  selector->slots = NULL;
+  selector->size = 0;
+  selector->capacity = 0;
+  selector->heap = NULL;
+  selector->heap_size = 0;
+  selector->owners = NULL;
+  selector->owners_size = 0;
+  selector->ready = NULL;
+  selector->ready_size = 0;
+  selector->current = 0;
+  selector->awoken = 0;
+  selector->error = pn_error();
+}
+
+void pn_selector_finalize(void *obj)
+{
+  pn_selector_t *selector = (pn_selector_t *) obj;
+  if (selector->kfd >= 0) close(selector->kfd);
+  free(selector->slots);
+  free(selector->heap);
+  free(selector->owners);
+  free(selector->ready);
+  pn_error_free(selector->error);
+}
+
+#define pn_selector_hashcode NULL
+#define pn_selector_compare NULL
+#define pn_selector_inspect NULL
+
+pn_selector_t *pni_selector(void)
+{
+  static const pn_class_t clazz = PN_CLASS(pn_selector);
+  pn_selector_t *selector = (pn_selector_t *) pn_class_new(&clazz, sizeof(pn_selector_t));
+  return selector;
+}
+
+void pn_selector_add(pn_selector_t *selector, pn_selectable_t *selectable)
+{
+  assert(selector);
+  assert(selectable);
+  assert(pni_selectable_get_index(selectable) < 0);
+
+  if (pni_selectable_get_index(selectable) < 0) {
+    if (selector->capacity == selector->size) {
+      size_t capacity = selector->capacity ? 2*selector->capacity : 16;
+      selector->slots = (pni_slot_t *) realloc(selector->slots, capacity*sizeof(pni_slot_t));
+      selector->heap = (int *) realloc(selector->heap, capacity*sizeof(int));
+      selector->ready = (pn_selectable_t **) realloc(selector->ready, capacity*sizeof(pn_selectable_t*));
+      selector->capacity = capacity;
+    }
+    int idx = selector->size++;
+    pni_slot_t *slot = &selector->slots[idx];
+    slot->selectable = selectable;
+    slot->fd = -1;
+    slot->interest = 0;
+    slot->revents = 0;
+    slot->deadline = 0;
+    slot->heap = -1;
+    slot->ready = false;
+    pni_selectable_set_index(selectable, idx);
+  }
+
+  pn_selector_update(selector, selectable);
+}
+
+void pn_selector_update(pn_selector_t *selector, pn_selectable_t *selectable)
+{
+  int idx = pni_selectable_get_index(selectable);
+  assert(idx >= 0);
+  int interest = 0;
+  if (pn_selectable_is_reading(selectable)) {
+    interest |= PN_READABLE;
+  }
+  if (pn_selectable_is_writing(selectable)) {
+    interest |= PN_WRITABLE;
+  }
+  slot_register(selector, idx, pn_selectable_get_fd(selectable), interest);
+  selector->slots[idx].revents = 0;
+  heap_set(selector, idx, pn_selectable_get_deadline(selectable));
+}
+
+void pn_selector_remove(pn_selector_t *selector, pn_selectable_t *selectable)
+{
+  assert(selector);
+  assert(selectable);
+
+  int idx = pni_selectable_get_index(selectable);
+  assert(idx >= 0);
+  pni_slot_t *slot = &selector->slots[idx];
+  slot_register(selector, idx, -1, 0);
+  heap_set(selector, idx, 0);
+  if (slot->ready) {
+    for (size_t i = 0; i < selector->ready_size; ++i) {
+      if (selector->ready[i] == selectable) selector->ready[i] = NULL;
+    }
+  }
+
+  // Move the last slot into the hole
+  int last = --selector->size;
+  if (idx != last) {
+    *slot = selector->slots[last];
+    pni_selectable_set_index(slot->selectable, idx);
+    if (slot->heap >= 0) selector->heap[slot->heap] = idx;
+    if (slot->fd >= 0 && selector->owners[slot->fd] == last + 1) selector->owners[slot->fd] = idx + 1;
+  }
+
+  pni_selectable_set_index(selectable, -1);
+}
+
+size_t pn_selector_size(pn_selector_t *selector) {
+  assert(selector);
+  return selector->size;
+}
+
+int pn_selector_select(pn_selector_t *selector, int timeout)
+{
+  assert(selector);
+
+  if (timeout && selector->heap_size) {
+    pn_timestamp_t deadline = selector->slots[selector->heap[0]].deadline;
+    pn_timestamp_t now = pn_i_now();
+    int64_t delta = deadline - now;
+    if (delta < 0) {
+      timeout = 0;
+    } else if (delta < timeout) {
+      timeout = delta;
+    }
+  }
+
+  // Forget the events of the last select
+  for (size_t i = 0; i < selector->ready_size; ++i) {
+    pn_selectable_t *sel = selector->ready[i];
+    if (sel) {
+      pni_slot_t *slot = &selector->slots[pni_selectable_get_index(sel)];
+      slot->revents = 0;
+      slot->ready = false;
+    }
+  }
+  selector->ready_size = 0;
+  selector->current = 0;
+
+  int error = 0;
+  int result = kernel_wait(selector, timeout, selector_found);
+  if (result == -1) {
+    error = pn_i_error_from_errno(selector->error, "select");
+  } else {
+    selector->awoken = pn_i_now();
+    heap_expire(selector, 0, selector->awoken);
+  }
+
+  return error;
+}
+
+pn_selectable_t *pn_selector_next(pn_selector_t *selector, int *events)
+{
+  while (selector->current < selector->ready_size) {
+    pn_selectable_t *sel = selector->ready[selector->current++];
+    if (!sel) continue;
+    pni_slot_t *slot = &selector->slots[pni_selectable_get_index(sel)];
+    int ev = slot->revents & ~PN_EXPIRED;
+    if (slot->deadline && selector->awoken >= slot->deadline) {
+      ev |= PN_EXPIRED;
+    }
+    if (ev) {
+      *events = ev;
+      return sel;
+    }
+  }
+  return NULL;
+}
+
+void pn_selector_free(pn_selector_t *selector)
+{
+  assert(selector);
+  pn_free(selector);
+}
@@ -124,6 +124,7 @@ void pn_selector_remove(pn_selector_t *selector, pn_selectable_t *selectable)
     pn_selectable_t *sel = (pn_selectable_t *) pn_list_get(selector->selectables, i);
     pni_selectable_set_index(sel, i);
     selector->fds[i] = selector->fds[i + 1];
+    selector->deadlines[i] = selector->deadlines[i + 1];
   }
 
   pni_selectable_set_index(selectable, -1);
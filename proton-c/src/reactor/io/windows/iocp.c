@@ -694,15 +694,22 @@ ssize_t pni_iocp_recv(iocpdesc_t *iocpd, void *buf, size_t size, bool *would_blo
 
   int count = recv(iocpd->socket, (char *) buf, size, 0);
   if (count > 0) {
-    pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
-    begin_zero_byte_read(iocpd);
+    // A full buffer suggests more is waiting: stay readable so the next
+    // recv need not wait a completion for each buffer.
+    if ((size_t) count < size) {
+      pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
+      begin_zero_byte_read(iocpd);
+    }
     return (ssize_t) count;
   } else if (count == 0) {
     iocpd->read_closed = true;
     return 0;
   }
-  if (WSAGetLastError() == WSAEWOULDBLOCK)
+  if (WSAGetLastError() == WSAEWOULDBLOCK) {
+    pni_events_update(iocpd, iocpd->events & ~PN_READABLE);
+    begin_zero_byte_read(iocpd);
     *would_block = true;
+  }
   else {
     set_iocp_error_status(error, PN_ERR, WSAGetLastError());
     iocpd->read_closed = true;
@@ -815,6 +822,14 @@ void pni_iocpdesc_map_del(iocp_t *iocp, pn_socket_t s) {
   pn_hash_del(iocp->iocpdesc_map, (uintptr_t) s);
 }
 
+static void skip_set_event(SOCKET s)
+{
+#ifdef FILE_SKIP_SET_EVENT_ON_HANDLE
+  // Completions only ever come through the port, nobody waits on the handle
+  SetFileCompletionNotificationModes((HANDLE) s, FILE_SKIP_SET_EVENT_ON_HANDLE);
+#endif
+}
+
 static void bind_to_completion_port(iocpdesc_t *iocpd)
 {
   if (iocpd->bound) return;
@@ -823,8 +838,10 @@ static void bind_to_completion_port(iocpdesc_t *iocpd)
     return;
   }
 
-  if (CreateIoCompletionPort ((HANDLE) iocpd->socket, iocpd->iocp->completion_port, 0, 0))
+  if (CreateIoCompletionPort ((HANDLE) iocpd->socket, iocpd->iocp->completion_port, 0, 0)) {
     iocpd->bound = true;
+    skip_set_event(iocpd->socket);
+  }
   else {
     iocpdesc_fail(iocpd, GetLastError(), "IOCP socket setup.");
   }
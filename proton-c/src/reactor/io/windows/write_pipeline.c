@@ -41,6 +41,7 @@
 #include "reactor/selectable.h"
 
 #include "iocp.h"
+#include "core/config.h"
 #include "core/util.h"
 
 #include <proton/error.h>
@@ -49,7 +50,7 @@
 #include <assert.h>
 
 // Max overlapped writes per socket
-#define IOCP_MAX_OWRITES 16
+#define IOCP_MAX_OWRITES PN_IOCP_WRITE_DEPTH
 // Write buffer size
 #define IOCP_WBUFSIZE 16384
 
@@ -65,11 +66,11 @@ static void pipeline_log(const char *fmt, ...)
 void pni_shared_pool_create(iocp_t *iocp)
 {
   // TODO: more pools (or larger one) when using multiple non-loopback interfaces
-  iocp->shared_pool_size = 16;
+  iocp->shared_pool_size = PN_IOCP_WRITE_POOL;
   char *env = getenv("PNI_WRITE_BUFFERS"); // Internal: for debugging
   if (env) {
     int sz = atoi(env);
-    if (sz >= 0 && sz < 256) {
+    if (sz >= 0 && sz < 4096) {
       iocp->shared_pool_size = sz;
     }
   }
@@ -37,6 +37,11 @@
 #include <stdlib.h>
 #include <assert.h>
 
+typedef struct {
+  pn_socket_t sock;             // Write end of the worker's handoff pipe
+  bool ssl;                     // Worker has an SSL domain for SSL acceptors
+} pni_worker_t;
+
 struct pn_reactor_t {
   pn_record_t *attachments;
   pn_io_t *io;
@@ -53,6 +58,9 @@ struct pn_reactor_t {
   int timeout;
   bool yield;
   bool stop;
+  pni_worker_t *workers;
+  size_t worker_count;
+  size_t next_worker;
 };
 
 pn_timestamp_t pn_reactor_mark(pn_reactor_t *reactor) {
@@ -82,6 +90,9 @@ static void pn_reactor_initialize(pn_reactor_t *reactor) {
   reactor->timeout = 0;
   reactor->yield = false;
   reactor->stop = false;
+  reactor->workers = NULL;
+  reactor->worker_count = 0;
+  reactor->next_worker = 0;
   pn_reactor_mark(reactor);
 }
 
@@ -91,6 +102,12 @@ static void pn_reactor_finalize(pn_reactor_t *reactor) {
       pn_close(reactor->io, reactor->wakeup[i]);
     }
   }
+  // Workers see the end of their handoff pipe and finish once their connections close
+  for (size_t i = 0; i < reactor->worker_count; ++i) {
+    if (reactor->workers[i].sock != PN_INVALID_SOCKET)
+      pn_close(reactor->io, reactor->workers[i].sock);
+  }
+  free(reactor->workers);
   pn_decref(reactor->attachments);
   pn_decref(reactor->collector);
   pn_decref(reactor->global);
@@ -170,6 +187,48 @@ pn_io_t *pni_reactor_io(pn_reactor_t *reactor) {
   return reactor->io;
 }
 
+int pn_reactor_add_worker(pn_reactor_t *reactor, pn_reactor_t *worker, pn_ssl_domain_t *ssl_domain) {
+  assert(reactor);
+  assert(worker && worker != reactor);
+  pn_socket_t fds[2];
+  int err = pn_pipe(reactor->io, fds);
+  if (err) return err;
+  pni_worker_t *workers = (pni_worker_t *) realloc(reactor->workers, (reactor->worker_count + 1) * sizeof(pni_worker_t));
+  if (!workers) {
+    pn_close(reactor->io, fds[0]);
+    pn_close(reactor->io, fds[1]);
+    return PN_OUT_OF_MEMORY;
+  }
+  reactor->workers = workers;
+  reactor->workers[reactor->worker_count].sock = fds[1];
+  reactor->workers[reactor->worker_count].ssl = ssl_domain != NULL;
+  reactor->worker_count++;
+  pni_handoff_selectable(worker, fds[0], ssl_domain);
+  return 0;
+}
+
+bool pni_reactor_handoff(pn_reactor_t *reactor, const pni_handoff_t *handoff) {
+  // Round robin over the workers that can take the connection
+  for (size_t n = 0; n < reactor->worker_count; ++n) {
+    size_t i = reactor->next_worker++ % reactor->worker_count;
+    pn_socket_t sock = reactor->workers[i].sock;
+    if (sock == PN_INVALID_SOCKET || (handoff->ssl && !reactor->workers[i].ssl)) continue;
+    const char *bytes = (const char *) handoff;
+    size_t size = sizeof(*handoff);
+    while (size) {
+      ssize_t w = pn_write(reactor->io, sock, bytes, size);
+      if (w <= 0) break;
+      bytes += w;
+      size -= w;
+    }
+    if (!size) return true;
+    // The worker is gone or its pipe is broken, it drops any partial record at the end of the pipe
+    pn_close(reactor->io, sock);
+    reactor->workers[i].sock = PN_INVALID_SOCKET;
+  }
+  return false;
+}
+
 pn_error_t *pn_reactor_error(pn_reactor_t *reactor) {
   assert(reactor);
   return pn_io_error(reactor->io);
@@ -31,4 +31,14 @@ void pni_reactor_set_connection_peer_address(pn_connection_t *connection,
                                              const char *port);
 pn_io_t *pni_reactor_io(pn_reactor_t *reactor);
 
+// An accepted socket passed from the accepting reactor to a worker reactor
+typedef struct {
+  pn_socket_t sock;
+  bool ssl;                     // From an acceptor with an SSL domain
+  char name[128];               // Peer address as <host>:<port>, or empty
+} pni_handoff_t;
+
+bool pni_reactor_handoff(pn_reactor_t *reactor, const pni_handoff_t *handoff);
+pn_selectable_t *pni_handoff_selectable(pn_reactor_t *worker, pn_socket_t sock, pn_ssl_domain_t *ssl_domain);
+
 #endif /* src/reactor.h */
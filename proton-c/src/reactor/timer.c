@@ -22,10 +22,18 @@
 #include <proton/object.h>
 #include <proton/reactor.h>
 #include <assert.h>
+#include <stdlib.h>
+
+// Tasks are kept in a binary min-heap ordered on deadline, then on the
+// order they were scheduled.  Each task knows its place in the heap so a
+// cancelled task is taken out straight away rather than left to expire.
 
 struct pn_task_t {
   pn_list_t *pool;
   pn_record_t *attachments;
+  pn_timer_t *timer;            // Timer whose heap holds the task, NULL if none
+  size_t index;                 // Position in the timer's heap
+  uint64_t sequence;
   pn_timestamp_t deadline;
   bool cancelled;
 };
@@ -33,6 +41,9 @@ struct pn_task_t {
 void pn_task_initialize(pn_task_t *task) {
   task->pool = NULL;
   task->attachments = pn_record();
+  task->timer = NULL;
+  task->index = 0;
+  task->sequence = 0;
   task->deadline = 0;
   task->cancelled = false;
 }
@@ -70,9 +81,14 @@ pn_record_t *pn_task_attachments(pn_task_t *task) {
   return task->attachments;
 }
 
+static void pni_timer_remove(pn_timer_t *timer, pn_task_t *task);
+
 void pn_task_cancel(pn_task_t *task) {
     assert(task);
     task->cancelled = true;
+    if (task->timer) {
+      pni_timer_remove(task->timer, task);
+    }
 }
 
 //
@@ -81,18 +97,28 @@ void pn_task_cancel(pn_task_t *task) {
 
 struct pn_timer_t {
   pn_list_t *pool;
-  pn_list_t *tasks;
+  pn_task_t **tasks;            // Heap of tasks, each holding a reference
+  size_t size;
+  size_t capacity;
+  uint64_t sequence;
   pn_collector_t *collector;
 };
 
 static void pn_timer_initialize(pn_timer_t *timer) {
   timer->pool = pn_list(PN_OBJECT, 0);
-  timer->tasks = pn_list(PN_OBJECT, 0);
+  timer->tasks = NULL;
+  timer->size = 0;
+  timer->capacity = 0;
+  timer->sequence = 0;
 }
 
 static void pn_timer_finalize(pn_timer_t *timer) {
   pn_decref(timer->pool);
-  pn_free(timer->tasks);
+  for (size_t i = 0; i < timer->size; ++i) {
+    timer->tasks[i]->timer = NULL;
+    pn_decref(timer->tasks[i]);
+  }
+  free(timer->tasks);
 }
 
 #define pn_timer_inspect NULL
@@ -107,7 +133,53 @@ pn_timer_t *pn_timer(pn_collector_t *collector) {
   return timer;
 }
 
+static inline bool pni_task_before(pn_task_t *a, pn_task_t *b) {
+  return a->deadline < b->deadline || (a->deadline == b->deadline && a->sequence < b->sequence);
+}
+
+static inline void pni_timer_place(pn_timer_t *timer, size_t i, pn_task_t *task) {
+  timer->tasks[i] = task;
+  task->index = i;
+}
+
+// Move the task at i up or down until the heap is ordered again
+static void pni_timer_fix(pn_timer_t *timer, size_t i) {
+  pn_task_t *task = timer->tasks[i];
+  while (i > 0 && pni_task_before(task, timer->tasks[(i - 1) / 2])) {
+    pni_timer_place(timer, i, timer->tasks[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  for (;;) {
+    size_t child = 2*i + 1;
+    if (child >= timer->size) break;
+    if (child + 1 < timer->size && pni_task_before(timer->tasks[child + 1], timer->tasks[child])) child++;
+    if (!pni_task_before(timer->tasks[child], task)) break;
+    pni_timer_place(timer, i, timer->tasks[child]);
+    i = child;
+  }
+  pni_timer_place(timer, i, task);
+}
+
+// Take the task out of the heap and drop the heap's reference to it
+static void pni_timer_remove(pn_timer_t *timer, pn_task_t *task) {
+  assert(task->timer == timer && timer->tasks[task->index] == task);
+  size_t i = task->index;
+  task->timer = NULL;
+  if (i != --timer->size) {
+    pni_timer_place(timer, i, timer->tasks[timer->size]);
+    pni_timer_fix(timer, i);
+  }
+  pn_decref(task);
+}
+
 pn_task_t *pn_timer_schedule(pn_timer_t *timer,  pn_timestamp_t deadline) {
+  if (timer->size == timer->capacity) {
+    size_t capacity = timer->capacity ? 2*timer->capacity : 16;
+    pn_task_t **tasks = (pn_task_t **) realloc(timer->tasks, capacity * sizeof(pn_task_t *));
+    if (!tasks) return NULL;
+    timer->tasks = tasks;
+    timer->capacity = capacity;
+  }
   pn_task_t *task = (pn_task_t *) pn_list_pop(timer->pool);
   if (!task) {
     task = pn_task();
@@ -115,54 +187,29 @@ pn_task_t *pn_timer_schedule(pn_timer_t *timer,  pn_timestamp_t deadline) {
   task->pool = timer->pool;
   pn_incref(task->pool);
   task->deadline = deadline;
+  task->sequence = timer->sequence++;
   task->cancelled = false;
-  pn_list_minpush(timer->tasks, task);
-  pn_decref(task);
+  task->timer = timer;
+  pni_timer_place(timer, timer->size++, task); // The heap takes the pool's or pn_task()'s reference
+  pni_timer_fix(timer, task->index);
   return task;
 }
 
-void pni_timer_flush_cancelled(pn_timer_t *timer) {
-    while (pn_list_size(timer->tasks)) {
-        pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
-        if (task->cancelled) {
-            pn_task_t *min = (pn_task_t *) pn_list_minpop(timer->tasks);
-            assert(min == task);
-            pn_decref(min);
-        } else {
-            break;
-        }
-    }
-}
-
 pn_timestamp_t pn_timer_deadline(pn_timer_t *timer) {
   assert(timer);
-  pni_timer_flush_cancelled(timer);
-  if (pn_list_size(timer->tasks)) {
-    pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
-    return task->deadline;
-  } else {
-    return 0;
-  }
+  return timer->size ? timer->tasks[0]->deadline : 0;
 }
 
 void pn_timer_tick(pn_timer_t *timer, pn_timestamp_t now) {
   assert(timer);
-  while (pn_list_size(timer->tasks)) {
-    pn_task_t *task = (pn_task_t *) pn_list_get(timer->tasks, 0);
-    if (now >= task->deadline) {
-      pn_task_t *min = (pn_task_t *) pn_list_minpop(timer->tasks);
-      assert(min == task);
-      if (!min->cancelled)
-          pn_collector_put(timer->collector, PN_OBJECT, min, PN_TIMER_TASK);
-      pn_decref(min);
-    } else {
-      break;
-    }
+  while (timer->size && now >= timer->tasks[0]->deadline) {
+    pn_task_t *task = timer->tasks[0];
+    pn_collector_put(timer->collector, PN_OBJECT, task, PN_TIMER_TASK);
+    pni_timer_remove(timer, task);
   }
 }
 
 int pn_timer_tasks(pn_timer_t *timer) {
   assert(timer);
-  pni_timer_flush_cancelled(timer);
-  return pn_list_size(timer->tasks);
+  return timer->size;
 }
@@ -479,8 +479,20 @@ static void pni_process_server_result(pn_transport_t *transport, int result)
     }
 }
 
+// Only a single step mechanism has the whole credential in its initial response
+static bool pni_cacheable_mech(const char *mechanism)
+{
+    return strcmp(mechanism, "PLAIN")==0;
+}
+
 void cyrus_sasl_process_init(pn_transport_t *transport, const char *mechanism, const pn_bytes_t *recv)
 {
+    bool cacheable = pni_cacheable_mech(mechanism) &&
+        pnx_sasl_is_included_mech(transport, pn_bytes(strlen(mechanism), mechanism));
+    if (cacheable && pnx_sasl_cached_authentication(transport, mechanism, *recv)) {
+        pnx_sasl_set_desired_state(transport, SASL_POSTED_OUTCOME);
+        return;
+    }
     int result = pni_wrap_server_start(transport, mechanism, recv);
     if (result==SASL_OK) {
         // We need to filter out a supplied mech in in the inclusion list
@@ -493,6 +505,9 @@ void cyrus_sasl_process_init(pn_transport_t *transport, const char *mechanism, c
         }
     }
     pni_process_server_result(transport, result);
+    if (result==SASL_OK && cacheable) {
+        pnx_sasl_cache_authentication(transport, mechanism, *recv);
+    }
 }
 
 static int pni_wrap_server_step(pn_transport_t *transport, const pn_bytes_t *in)
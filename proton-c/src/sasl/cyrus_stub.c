@@ -38,3 +38,15 @@ void pn_sasl_config_path(pn_sasl_t *sasl0, const char *dir)
 {
 }
 
+void pn_sasl_config_credential_cache(pn_sasl_t *sasl0, size_t size, pn_millis_t ttl)
+{
+}
+
+bool pnx_sasl_cached_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response)
+{
+  return false;
+}
+
+void pnx_sasl_cache_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response)
+{
+}
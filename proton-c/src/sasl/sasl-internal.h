@@ -44,6 +44,7 @@ struct pni_sasl_t {
   char *selected_mechanism;
   char *included_mechanisms;
   const char *username;
+  char *cached_username;        // Owns username after a credential cache hit
   char *password;
   const char *remote_fqdn;
   char *external_auth;
@@ -57,6 +58,7 @@ struct pni_sasl_t {
   enum pnx_sasl_state last_state;
   bool allow_insecure_mechs;
   bool client;
+  bool pipelined;
 };
 
 #endif /* sasl-internal.h */
@@ -245,6 +245,7 @@ static ssize_t pn_input_read_sasl_header(pn_transport_t* transport, unsigned int
 static ssize_t pn_input_read_sasl(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available);
 static ssize_t pn_input_read_sasl_encrypt(pn_transport_t *transport, unsigned int layer, const char *bytes, size_t available);
 static ssize_t pn_output_write_sasl_header(pn_transport_t* transport, unsigned int layer, char* bytes, size_t size);
+static ssize_t pn_output_await_sasl_header(pn_transport_t* transport, unsigned int layer, char* bytes, size_t size);
 static ssize_t pn_output_write_sasl(pn_transport_t *transport, unsigned int layer, char *bytes, size_t available);
 static ssize_t pn_output_write_sasl_encrypt(pn_transport_t *transport, unsigned int layer, char *bytes, size_t available);
 static void pn_error_sasl(pn_transport_t* transport, unsigned int layer);
@@ -265,6 +266,15 @@ const pn_io_layer_t sasl_write_header_layer = {
     NULL
 };
 
+// Server of a pinned layer stack: read the client's header before writing ours
+const pn_io_layer_t sasl_server_header_layer = {
+    pn_input_read_sasl_header,
+    pn_output_await_sasl_header,
+    pn_error_sasl,
+    NULL,
+    NULL
+};
+
 const pn_io_layer_t sasl_read_header_layer = {
     pn_input_read_sasl_header,
     pn_output_write_sasl,
@@ -325,6 +335,7 @@ static bool pni_sasl_is_final_output_state(pni_sasl_t *sasl)
   enum pnx_sasl_state last_state = sasl->last_state;
   enum pnx_sasl_state desired_state = sasl->desired_state;
   return (desired_state==SASL_RECVED_OUTCOME_SUCCEED && last_state>=SASL_POSTED_INIT)
+      || (sasl->pipelined && last_state>=SASL_POSTED_INIT)
       || last_state==SASL_RECVED_OUTCOME_SUCCEED
       || last_state==SASL_RECVED_OUTCOME_FAIL
       || last_state==SASL_ERROR
@@ -515,7 +526,7 @@ static void pn_error_sasl(pn_transport_t* transport, unsigned int layer)
 
 static ssize_t pn_input_read_sasl_header(pn_transport_t* transport, unsigned int layer, const char* bytes, size_t available)
 {
-  bool eos = pn_transport_capacity(transport)==PN_EOS;
+  bool eos = transport->tail_closed;
   pni_protocol_type_t protocol = pni_sniff_header(bytes, available);
   switch (protocol) {
   case PNI_PROTOCOL_AMQP_SASL:
@@ -551,11 +562,31 @@ static void pni_sasl_start_server_if_needed(pn_transport_t *transport)
   }
 }
 
+// A pipelined client picks its mechanism without waiting for the server's
+// list, so it must have been restricted to exactly one that needs no
+// challenge: then SASL-INIT, the AMQP header and whatever AMQP frames are
+// ready all go out in the first flight.  Otherwise fall back to waiting.
+static void pni_sasl_start_client_if_pipelined(pn_transport_t *transport)
+{
+  pni_sasl_t *sasl = transport->sasl;
+  if (!sasl->client || !sasl->pipelined || sasl->desired_state!=SASL_NONE) return;
+
+  const char *mech = sasl->included_mechanisms;
+  if (!mech || strchr(mech, ' ') ||
+      (pn_strcasecmp(mech, "ANONYMOUS")!=0 && pn_strcasecmp(mech, "PLAIN")!=0 && pn_strcasecmp(mech, "EXTERNAL")!=0) ||
+      !(pni_sasl_impl_init_client(transport) && pni_sasl_impl_process_mechanisms(transport, mech))) {
+    sasl->pipelined = false;
+    return;
+  }
+  if (transport->trace & PN_TRACE_DRV)
+    pn_transport_logf(transport, "SASL pipelined: %s", sasl->selected_mechanism);
+}
+
 static ssize_t pn_input_read_sasl(pn_transport_t* transport, unsigned int layer, const char* bytes, size_t available)
 {
   pni_sasl_t *sasl = transport->sasl;
 
-  bool eos = pn_transport_capacity(transport)==PN_EOS;
+  bool eos = transport->tail_closed;
   if (eos) {
     pn_do_error(transport, "amqp:connection:framing-error", "connection aborted");
     pn_set_error_layer(transport);
@@ -624,6 +655,11 @@ static ssize_t pn_output_write_sasl_header(pn_transport_t *transport, unsigned i
   return SASL_HEADER_LEN;
 }
 
+static ssize_t pn_output_await_sasl_header(pn_transport_t *transport, unsigned int layer, char *bytes, size_t size)
+{
+  return 0;
+}
+
 static ssize_t pn_output_write_sasl(pn_transport_t* transport, unsigned int layer, char* bytes, size_t available)
 {
   pni_sasl_t *sasl = transport->sasl;
@@ -632,6 +668,7 @@ static ssize_t pn_output_write_sasl(pn_transport_t* transport, unsigned int laye
   if (transport->close_sent) return PN_EOS;
 
   pni_sasl_start_server_if_needed(transport);
+  pni_sasl_start_client_if_pipelined(transport);
 
   pni_sasl_impl_prepare_write(transport);
 
@@ -697,6 +734,7 @@ pn_sasl_t *pn_sasl(pn_transport_t *transport)
     sasl->selected_mechanism = NULL;
     sasl->included_mechanisms = NULL;
     sasl->username = NULL;
+    sasl->cached_username = NULL;
     sasl->password = NULL;
     sasl->remote_fqdn = NULL;
     sasl->external_auth = NULL;
@@ -709,6 +747,7 @@ pn_sasl_t *pn_sasl(pn_transport_t *transport)
     sasl->desired_state = SASL_NONE;
     sasl->last_state = SASL_NONE;
     sasl->allow_insecure_mechs = false;
+    sasl->pipelined = false;
 
     transport->sasl = sasl;
   }
@@ -724,6 +763,7 @@ void pn_sasl_free(pn_transport_t *transport)
     if (sasl) {
       free(sasl->selected_mechanism);
       free(sasl->included_mechanisms);
+      free(sasl->cached_username);
       free(sasl->password);
       free(sasl->external_auth);
 
@@ -790,6 +830,18 @@ bool pn_sasl_get_allow_insecure_mechs(pn_sasl_t *sasl0)
     return sasl->allow_insecure_mechs;
 }
 
+void pn_sasl_set_pipelined(pn_sasl_t *sasl0, bool pipelined)
+{
+    pni_sasl_t *sasl = get_sasl_internal(sasl0);
+    sasl->pipelined = pipelined;
+}
+
+bool pn_sasl_get_pipelined(pn_sasl_t *sasl0)
+{
+    pni_sasl_t *sasl = get_sasl_internal(sasl0);
+    return sasl->pipelined;
+}
+
 void pn_sasl_done(pn_sasl_t *sasl0, pn_sasl_outcome_t outcome)
 {
   pni_sasl_t *sasl = get_sasl_internal(sasl0);
@@ -855,7 +907,9 @@ int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t cha
     pn_string_setn(mechs, symbol.start, symbol.size);
   }
 
-  if (!(pni_sasl_impl_init_client(transport) &&
+  // A pipelined client already sent INIT, the server's outcome will say if it took the mechanism
+  bool posted = sasl->pipelined && sasl->desired_state>=SASL_POSTED_INIT;
+  if (!posted && !(pni_sasl_impl_init_client(transport) &&
         pn_string_size(mechs) &&
         pni_sasl_impl_process_mechanisms(transport, pn_string_get(mechs)))) {
     sasl->outcome = PN_SASL_PERM;
@@ -0,0 +1,243 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+// Process wide cache of successful server authentications, so a client that
+// reconnects with the same credentials is not checked against the backend
+// every time.  Only built with Cyrus SASL, whose backends (sasldb, LDAP, ...)
+// are what is slow, and which already needs pthreads.
+//
+// Entries are keyed by a SHA-256 digest of the mechanism and the client's
+// initial response, so no credential is kept in memory.  The cache is
+// direct mapped on the digest: a new entry replaces whatever was in its slot.
+
+#include "sasl-internal.h"
+
+#include "core/config.h"
+#include "core/util.h"
+#include "platform/platform.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIGEST_LEN 32
+
+// SHA-256, FIPS 180-4
+
+typedef struct {
+  uint32_t h[8];
+  uint64_t len;
+  unsigned char block[64];
+  size_t used;
+} pni_sha256_t;
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(pni_sha256_t *s)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; ++i) {
+    const unsigned char *p = s->block + 4*i;
+    w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+  }
+  for (int i = 16; i < 64; ++i) {
+    uint32_t s0 = ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3);
+    uint32_t s1 = ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+  uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3];
+  uint32_t e = s->h[4], f = s->h[5], g = s->h[6], h = s->h[7];
+  for (int i = 0; i < 64; ++i) {
+    uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+    uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+  s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+static void sha256_init(pni_sha256_t *s)
+{
+  static const uint32_t h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(s->h, h0, sizeof(h0));
+  s->len = 0;
+  s->used = 0;
+}
+
+static void sha256_update(pni_sha256_t *s, const char *data, size_t size)
+{
+  s->len += size;
+  while (size) {
+    size_t n = pn_min(size, sizeof(s->block) - s->used);
+    memcpy(s->block + s->used, data, n);
+    s->used += n;
+    data += n;
+    size -= n;
+    if (s->used == sizeof(s->block)) {
+      sha256_block(s);
+      s->used = 0;
+    }
+  }
+}
+
+static void sha256_final(pni_sha256_t *s, unsigned char digest[DIGEST_LEN])
+{
+  uint64_t bits = s->len * 8;
+  char pad[72] = { (char)0x80 };
+  size_t n = (s->used < 56 ? 56 : 120) - s->used;
+  for (int i = 0; i < 8; ++i)
+    pad[n + i] = (char)(bits >> (56 - 8*i));
+  sha256_update(s, pad, n + 8);
+  for (int i = 0; i < 8; ++i) {
+    digest[4*i] = (unsigned char)(s->h[i] >> 24);
+    digest[4*i+1] = (unsigned char)(s->h[i] >> 16);
+    digest[4*i+2] = (unsigned char)(s->h[i] >> 8);
+    digest[4*i+3] = (unsigned char)s->h[i];
+  }
+}
+
+// The cache
+
+typedef struct {
+  unsigned char digest[DIGEST_LEN];
+  char *username;               // NULL if the slot is empty
+  pn_timestamp_t expires;
+} pni_cred_t;
+
+static pthread_mutex_t pni_cred_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pni_cred_t *pni_cred_slots = NULL;
+static size_t pni_cred_size = PN_SASL_CREDENTIAL_CACHE_SIZE;
+static pn_millis_t pni_cred_ttl = PN_SASL_CREDENTIAL_CACHE_TTL;
+
+static void cred_digest(const char *mechanism, pn_bytes_t response, unsigned char digest[DIGEST_LEN])
+{
+  pni_sha256_t s;
+  sha256_init(&s);
+  sha256_update(&s, mechanism, strlen(mechanism) + 1); // Include the NUL to separate the response
+  sha256_update(&s, response.start, response.size);
+  sha256_final(&s, digest);
+}
+
+// Called with the lock held
+static pni_cred_t *cred_slot(const unsigned char digest[DIGEST_LEN])
+{
+  if (!pni_cred_slots) {
+    if (!pni_cred_size || !pni_cred_ttl) return NULL;
+    size_t slots = 1;
+    while (slots < pni_cred_size) slots <<= 1;
+    pni_cred_size = slots;
+    pni_cred_slots = (pni_cred_t *) calloc(pni_cred_size, sizeof(pni_cred_t));
+    if (!pni_cred_slots) return NULL;
+  }
+  size_t h = (size_t)digest[0] << 24 | (size_t)digest[1] << 16 | (size_t)digest[2] << 8 | digest[3];
+  return &pni_cred_slots[h & (pni_cred_size - 1)];
+}
+
+static void cred_slots_free(void)
+{
+  if (!pni_cred_slots) return;
+  for (size_t i = 0; i < pni_cred_size; ++i)
+    free(pni_cred_slots[i].username);
+  free(pni_cred_slots);
+  pni_cred_slots = NULL;
+}
+
+__attribute__((destructor))
+static void pni_cred_finish(void) {
+  pthread_mutex_lock(&pni_cred_mutex);
+  cred_slots_free();
+  pthread_mutex_unlock(&pni_cred_mutex);
+}
+
+void pn_sasl_config_credential_cache(pn_sasl_t *sasl0, size_t size, pn_millis_t ttl)
+{
+  pthread_mutex_lock(&pni_cred_mutex);
+  cred_slots_free();
+  pni_cred_size = size;
+  pni_cred_ttl = ttl;
+  pthread_mutex_unlock(&pni_cred_mutex);
+}
+
+bool pnx_sasl_cached_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response)
+{
+  pni_sasl_t *sasl = transport->sasl;
+  if (!sasl || !mechanism) return false;
+
+  unsigned char digest[DIGEST_LEN];
+  cred_digest(mechanism, response, digest);
+  char *username = NULL;
+  pthread_mutex_lock(&pni_cred_mutex);
+  pni_cred_t *slot = pni_cred_slots ? cred_slot(digest) : NULL;
+  if (slot && slot->username && memcmp(slot->digest, digest, DIGEST_LEN) == 0) {
+    if (slot->expires > pn_i_now()) {
+      username = pn_strdup(slot->username);
+    } else {
+      free(slot->username);
+      slot->username = NULL;
+    }
+  }
+  pthread_mutex_unlock(&pni_cred_mutex);
+  if (!username) return false;
+
+  // The transport keeps its own copy, the entry may be replaced at any time
+  free(sasl->cached_username);
+  sasl->cached_username = username;
+  pnx_sasl_succeed_authentication(transport, username);
+  pnx_sasl_logf(transport, "Authenticated user: %s with mechanism %s (cached)", username, mechanism);
+  return true;
+}
+
+void pnx_sasl_cache_authentication(pn_transport_t *transport, const char *mechanism, pn_bytes_t response)
+{
+  pni_sasl_t *sasl = transport->sasl;
+  if (!sasl || !mechanism || sasl->outcome != PN_SASL_OK || !sasl->username) return;
+
+  unsigned char digest[DIGEST_LEN];
+  cred_digest(mechanism, response, digest);
+  char *username = pn_strdup(sasl->username);
+  if (!username) return;
+  pthread_mutex_lock(&pni_cred_mutex);
+  pni_cred_t *slot = cred_slot(digest);
+  if (slot) {
+    free(slot->username);
+    memcpy(slot->digest, digest, DIGEST_LEN);
+    slot->username = username;
+    slot->expires = pn_i_now() + pni_cred_ttl;
+    username = NULL;
+  }
+  pthread_mutex_unlock(&pni_cred_mutex);
+  free(username);
+}
@@ -20,8 +20,10 @@
  */
 
 #include "platform/platform.h"
+#include "core/config.h"
 #include "core/util.h"
 #include "core/engine-internal.h"
+#include "core/probes.h"
 
 #include <proton/ssl.h>
 #include <proton/engine.h>
@@ -45,11 +47,13 @@
 #include <openssl/ssl.h>
 #include <openssl/dh.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/x509v3.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <time.h>
 
 /** @file
  * SSL/TLS support API.
@@ -62,6 +66,48 @@ static int ssl_ex_data_index;
 
 typedef struct pn_ssl_session_t pn_ssl_session_t;
 
+// A cached client session, on an LRU list and a hash bucket chain
+typedef struct pni_ssn_t pni_ssn_t;
+struct pni_ssn_t {
+  char *id;
+  size_t hash;
+  SSL_SESSION *session;
+  time_t saved;
+  pni_ssn_t *bucket_next;
+  pni_ssn_t *prev, *next;       // Most recently used first
+};
+
+// Client sessions by session_id, shared by the threads using a domain.
+typedef struct {
+  pni_ssn_t **buckets;
+  size_t bucket_mask;           // Bucket count - 1, a power of 2
+  pni_ssn_t *first, *last;
+  size_t count;
+  size_t size;
+  pn_millis_t ttl;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  CRYPTO_RWLOCK *lock;
+#endif
+} pni_ssn_cache_t;
+
+// A verified peer certificate chain, by a digest of the certificates presented
+typedef struct {
+  unsigned char digest[32];     // SHA-256
+  time_t verified;              // 0 for an empty slot
+} pni_vfy_t;
+
+// Recently verified chains, shared by the threads using a domain.  One slot
+// per digest, a chain replaces any other with the same slot.
+typedef struct {
+  pni_vfy_t *slots;
+  size_t slot_mask;             // Slot count - 1, a power of 2
+  size_t size;
+  pn_millis_t ttl;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  CRYPTO_RWLOCK *lock;
+#endif
+} pni_vfy_cache_t;
+
 struct pn_ssl_domain_t {
 
   SSL_CTX       *ctx;
@@ -81,6 +127,10 @@ struct pn_ssl_domain_t {
   bool has_ca_db;       // true when CA database configured
   bool has_certificate; // true when certificate configured
   bool allow_unsecured;
+
+  size_t buffer_size;   // application buffers of new transports
+  pni_ssn_cache_t ssn_cache;
+  pni_vfy_cache_t vfy_cache;
 };
 
 
@@ -91,10 +141,18 @@ struct pni_ssl_t {
   SSL *ssl;
 
   BIO *bio_ssl;         // i/o from/to SSL socket layer
-  BIO *bio_ssl_io;      // SSL "half" of network-facing BIO
-  BIO *bio_net_io;      // socket-side "half" of network-facing BIO
-  // buffers for holding I/O from "applications" above SSL
-#define APP_BUF_SIZE    (4*1024)
+  BIO *bio_net;         // network-facing BIO below SSL, see net_bio_method
+  // network bytes offered by the transport while it processes input or output
+  const char *net_in;
+  size_t net_in_len;
+  char *net_out;
+  size_t net_out_len;
+  // records SSL wrote with no room in net_out, sent before any others
+  char *net_pending;
+  size_t net_pending_len;
+  size_t net_pending_size;
+  bool net_in_closed;   // the transport's input has closed
+  // buffers for holding I/O from "applications" above SSL, allocated with the socket
   char *outbuf;
   char *inbuf;
 
@@ -106,6 +164,9 @@ struct pni_ssl_t {
   size_t in_size;
   size_t in_count;
 
+  size_t record_size;   // most application bytes per SSL record
+  size_t streamed;      // bytes written since the application last ran out of output
+
   bool ssl_shutdown;    // BIO_ssl_shutdown() called on socket.
   bool ssl_closed;      // shutdown complete, or SSL error
   bool read_blocked;    // SSL blocked until more network data is read
@@ -140,6 +201,8 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
 static ssize_t process_input_done(pn_transport_t *transport, unsigned int layer, const char *input_data, size_t len);
 static ssize_t process_output_done(pn_transport_t *transport, unsigned int layer, char *input_data, size_t len);
 static int init_ssl_socket(pn_transport_t *, pni_ssl_t *);
+static BIO_METHOD *net_bio_method(void);
+static int ssl_alloc_buffers(pn_transport_t *, pni_ssl_t *);
 static void release_ssl_socket( pni_ssl_t * );
 static size_t buffered_output( pn_transport_t *transport );
 static X509 *get_peer_certificate(pni_ssl_t *ssl);
@@ -271,30 +334,29 @@ static bool match_dns_pattern( const char *hostname,
   return plen == slen;
 }
 
-// Certificate chain verification callback: return 1 if verified,
-// 0 if remote cannot be verified (fail handshake).
-//
-static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
+// The transport whose peer certificate chain is being verified, NULL if unknown
+static pn_transport_t *verify_transport(X509_STORE_CTX *ctx)
 {
-  if (!preverify_ok || X509_STORE_CTX_get_error_depth(ctx) != 0)
-    // already failed, or not at peer cert in chain
-    return preverify_ok;
-
-  X509 *cert = X509_STORE_CTX_get_current_cert(ctx);
   SSL *ssn = (SSL *) X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
   if (!ssn) {
     pn_transport_logf(NULL, "Error: unexpected error - SSL session info not available for peer verify!");
-    return 0;  // fail connection
+    return NULL;
   }
 
   pn_transport_t *transport = (pn_transport_t *)SSL_get_ex_data(ssn, ssl_ex_data_index);
   if (!transport) {
     pn_transport_logf(NULL, "Error: unexpected error - SSL context info not available for peer verify!");
-    return 0;  // fail connection
   }
+  return transport;
+}
 
+// Check the peer certificate names against the peer hostname if the domain
+// verifies names: return 1 if matched or not checked, 0 to fail the handshake.
+//
+static int verify_peer_name(pn_transport_t *transport, X509 *cert, X509_STORE_CTX *ctx)
+{
   pni_ssl_t *ssl = transport->ssl;
-  if (ssl->domain->verify_mode != PN_SSL_VERIFY_PEER_NAME) return preverify_ok;
+  if (ssl->domain->verify_mode != PN_SSL_VERIFY_PEER_NAME) return 1;
   if (!ssl->peer_hostname) {
     pn_transport_logf(transport, "Error: configuration error: PN_SSL_VERIFY_PEER_NAME configured, but no peer hostname set!");
     return 0;  // fail connection
@@ -347,18 +409,35 @@ static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
   if (!matched) {
     ssl_log(transport, "Error: no name matching %s found in peer cert - rejecting handshake.",
           ssl->peer_hostname);
-    preverify_ok = 0;
 #ifdef X509_V_ERR_APPLICATION_VERIFICATION
     X509_STORE_CTX_set_error( ctx, X509_V_ERR_APPLICATION_VERIFICATION );
 #endif
-  } else {
-    ssl_log(transport, "Name from peer cert matched - peer is valid.");
+    return 0;
   }
-  return preverify_ok;
+  ssl_log(transport, "Name from peer cert matched - peer is valid.");
+  return 1;
 }
 
-// This was introduced in v1.1
+// Certificate chain verification callback: return 1 if verified,
+// 0 if remote cannot be verified (fail handshake).
+//
+static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
+{
+  if (!preverify_ok || X509_STORE_CTX_get_error_depth(ctx) != 0)
+    // already failed, or not at peer cert in chain
+    return preverify_ok;
+
+  pn_transport_t *transport = verify_transport(ctx);
+  if (!transport) return 0;  // fail connection
+  return verify_peer_name(transport, X509_STORE_CTX_get_current_cert(ctx), ctx);
+}
+
+// These were introduced in v1.1
 #if OPENSSL_VERSION_NUMBER < 0x10100000
+#define BIO_get_data(b) ((b)->ptr)
+#define BIO_set_data(b, p) ((b)->ptr = (p))
+#define BIO_set_init(b, i) ((b)->init = (i))
+
 int DH_set0_pqg(DH *dh, BIGNUM *p, BIGNUM *q, BIGNUM *g)
 {
   dh->p = p;
@@ -416,58 +495,270 @@ static DH *get_dh2048(void)
   return dh;
 }
 
-typedef struct {
-  char *id;
-  SSL_SESSION *session;
-} ssl_cache_data;
+// Before OpenSSL 1.1 the application must set up the library's own locking for
+// threads, so the cache is only locked by OpenSSL versions that can be shared.
+static void ssn_lock(pni_ssn_cache_t *cache) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  if (cache->lock) CRYPTO_THREAD_write_lock(cache->lock);
+#endif
+}
+
+static void ssn_unlock(pni_ssn_cache_t *cache) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  if (cache->lock) CRYPTO_THREAD_unlock(cache->lock);
+#endif
+}
+
+static size_t ssn_hash(const char *id) {
+  size_t h = 2166136261u;       // FNV-1a
+  for (; *id; ++id) h = (h ^ (unsigned char)*id) * 16777619u;
+  return h;
+}
+
+static void ssn_unlink(pni_ssn_cache_t *cache, pni_ssn_t *e) {
+  pni_ssn_t **p = &cache->buckets[e->hash & cache->bucket_mask];
+  while (*p != e) p = &(*p)->bucket_next;
+  *p = e->bucket_next;
+  if (e->prev) e->prev->next = e->next; else cache->first = e->next;
+  if (e->next) e->next->prev = e->prev; else cache->last = e->prev;
+  --cache->count;
+  free(e->id);
+  SSL_SESSION_free(e->session);
+  free(e);
+}
+
+static void ssn_push_front(pni_ssn_cache_t *cache, pni_ssn_t *e) {
+  e->prev = NULL;
+  e->next = cache->first;
+  if (cache->first) cache->first->prev = e; else cache->last = e;
+  cache->first = e;
+}
+
+static pni_ssn_t *ssn_find(pni_ssn_cache_t *cache, const char *id, size_t hash) {
+  if (!cache->buckets) return NULL;
+  pni_ssn_t *e = cache->buckets[hash & cache->bucket_mask];
+  while (e && (e->hash != hash || strcmp(e->id, id) != 0)) e = e->bucket_next;
+  return e;
+}
+
+// Session lifetimes are in seconds of time(), as OpenSSL keeps them
+static bool ssn_expired(pni_ssn_cache_t *cache, pni_ssn_t *e, time_t now) {
+  if (cache->ttl && (pn_millis_t)(now - e->saved) * 1000 >= cache->ttl) return true;
+  if ((long)now >= SSL_SESSION_get_time(e->session) + SSL_SESSION_get_timeout(e->session))
+    return true;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+  if (!SSL_SESSION_is_resumable(e->session)) return true;
+#endif
+  return false;
+}
 
-#define SSL_CACHE_SIZE 4
-static int ssl_cache_ptr = 0;
-static ssl_cache_data ssl_cache[SSL_CACHE_SIZE];
+static void ssn_cache_clear(pni_ssn_cache_t *cache) {
+  while (cache->first) ssn_unlink(cache, cache->first);
+  free(cache->buckets);
+  cache->buckets = NULL;
+  cache->bucket_mask = 0;
+}
 
-static void ssn_init(void) {
-  ssl_cache_data s = {NULL, NULL};
-  for (int i=0; i<SSL_CACHE_SIZE; i++) {
-    ssl_cache[i] = s;
+static int ssn_cache_init(pni_ssn_cache_t *cache, size_t size, pn_millis_t ttl) {
+  ssn_cache_clear(cache);
+  cache->size = size;
+  cache->ttl = ttl;
+  if (!size) return 0;
+  size_t n = 1;
+  while (n < size) n <<= 1;
+  cache->buckets = (pni_ssn_t **) calloc(n, sizeof(pni_ssn_t *));
+  if (!cache->buckets) {
+    cache->size = 0;
+    return PN_OUT_OF_MEMORY;
   }
+  cache->bucket_mask = n - 1;
+  return 0;
 }
 
 static void ssn_restore(pn_transport_t *transport, pni_ssl_t *ssl) {
   if (!ssl->session_id) return;
-  for (int i = ssl_cache_ptr;;) {
-    i = (i==0) ? SSL_CACHE_SIZE-1 : i-1;
-    if (ssl_cache[i].id == NULL) return;
-    if (strcmp(ssl_cache[i].id, ssl->session_id) == 0) {
-      ssl_log( transport, "Restoring previous session id=%s", ssl->session_id );
-      int rc = SSL_set_session( ssl->ssl, ssl_cache[i].session );
-      if (rc != 1) {
-        ssl_log( transport, "Session restore failed, id=%s", ssl->session_id );
-      }
-      return;
+  pni_ssn_cache_t *cache = &ssl->domain->ssn_cache;
+  size_t hash = ssn_hash(ssl->session_id);
+  ssn_lock(cache);
+  pni_ssn_t *e = ssn_find(cache, ssl->session_id, hash);
+  if (e && ssn_expired(cache, e, time(NULL))) {
+    ssl_log( transport, "Discarding expired session id=%s", ssl->session_id );
+    ssn_unlink(cache, e);
+    e = NULL;
+  }
+  if (e) {
+    ssl_log( transport, "Restoring previous session id=%s", ssl->session_id );
+    if (e != cache->first) {
+      e->prev->next = e->next;
+      if (e->next) e->next->prev = e->prev; else cache->last = e->prev;
+      ssn_push_front(cache, e);
+    }
+    int rc = SSL_set_session( ssl->ssl, e->session ); // Takes its own reference
+    if (rc != 1) {
+      ssl_log( transport, "Session restore failed, id=%s", ssl->session_id );
     }
-    if (i == ssl_cache_ptr) return;
   }
+  ssn_unlock(cache);
 }
 
-static void ssn_save(pn_transport_t *transport, pni_ssl_t *ssl) {
-  if (ssl->session_id) {
-    // Attach the session id to the session before we close the connection
-    // So that if we find it in the cache later we can figure out the session id
-    SSL_SESSION *session = SSL_get1_session( ssl->ssl );
-    if (session) {
+// OpenSSL new session callback: called once a client handshake completes, and
+// for every TLS 1.3 session ticket the server sends after it.
+static int ssn_save(SSL *ssn, SSL_SESSION *session) {
+  pn_transport_t *transport = (pn_transport_t *)SSL_get_ex_data(ssn, ssl_ex_data_index);
+  if (!transport || !transport->ssl) return 0;
+  pni_ssl_t *ssl = transport->ssl;
+  pni_ssn_cache_t *cache = &ssl->domain->ssn_cache;
+  if (!ssl->session_id) return 0;
+
+  size_t hash = ssn_hash(ssl->session_id);
+  int taken = 0;
+  ssn_lock(cache);
+  if (cache->size) {
+    pni_ssn_t *e = ssn_find(cache, ssl->session_id, hash);
+    if (e) {
+      ssn_unlink(cache, e);     // Replaced by the newer session or ticket
+    } else if (cache->count >= cache->size) {
+      ssn_unlink(cache, cache->last);
+    }
+    char *id = pn_strdup(ssl->session_id);
+    e = (pni_ssn_t *) malloc(sizeof(pni_ssn_t));
+    if (id && e) {
       ssl_log(transport, "Saving SSL session as %s", ssl->session_id );
-      // If we're overwriting a value, need to free it
-      free(ssl_cache[ssl_cache_ptr].id);
-      if (ssl_cache[ssl_cache_ptr].session) SSL_SESSION_free(ssl_cache[ssl_cache_ptr].session);
-
-      char *id = pn_strdup( ssl->session_id );
-      ssl_cache_data s = {id, session};
-      ssl_cache[ssl_cache_ptr++] = s;
-      if (ssl_cache_ptr==SSL_CACHE_SIZE) ssl_cache_ptr = 0;
+      e->id = id;
+      e->hash = hash;
+      e->session = session;     // The callback's reference is ours when we return 1
+      e->saved = time(NULL);
+      pni_ssn_t **bucket = &cache->buckets[hash & cache->bucket_mask];
+      e->bucket_next = *bucket;
+      *bucket = e;
+      ssn_push_front(cache, e);
+      ++cache->count;
+      taken = 1;
+    } else {
+      free(id);
+      free(e);
     }
   }
+  ssn_unlock(cache);
+  return taken;
+}
+
+static void vfy_cache_clear(pni_vfy_cache_t *cache) {
+  free(cache->slots);
+  cache->slots = NULL;
+  cache->slot_mask = 0;
+}
+
+static int vfy_cache_init(pni_vfy_cache_t *cache, size_t size, pn_millis_t ttl) {
+  vfy_cache_clear(cache);
+  cache->size = size;
+  cache->ttl = ttl;
+  if (!size) return 0;
+  size_t n = 1;
+  while (n < size) n <<= 1;
+  cache->slots = (pni_vfy_t *) calloc(n, sizeof(pni_vfy_t));
+  if (!cache->slots) {
+    cache->size = 0;
+    return PN_OUT_OF_MEMORY;
+  }
+  cache->slot_mask = n - 1;
+  return 0;
+}
+
+// Forget every verified chain, for a change of the domain's trust settings
+static void vfy_cache_reset(pni_vfy_cache_t *cache) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  if (cache->lock) CRYPTO_THREAD_write_lock(cache->lock);
+#endif
+  if (cache->slots) memset(cache->slots, 0, (cache->slot_mask + 1) * sizeof(pni_vfy_t));
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  if (cache->lock) CRYPTO_THREAD_unlock(cache->lock);
+#endif
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+
+static pni_vfy_t *vfy_slot(pni_vfy_cache_t *cache, const unsigned char *digest) {
+  size_t h;
+  memcpy(&h, digest, sizeof(h));
+  return &cache->slots[h & cache->slot_mask];
+}
+
+// Digest of the peer certificate and the chain it was presented with
+static bool vfy_digest(X509_STORE_CTX *ctx, unsigned char *digest) {
+  STACK_OF(X509) *chain = X509_STORE_CTX_get0_untrusted(ctx);
+  EVP_MD_CTX *md = EVP_MD_CTX_new();
+  unsigned char fp[EVP_MAX_MD_SIZE];
+  unsigned int len;
+  bool ok = md && EVP_DigestInit_ex(md, EVP_sha256(), NULL) &&
+    X509_digest(X509_STORE_CTX_get0_cert(ctx), EVP_sha256(), fp, &len) &&
+    EVP_DigestUpdate(md, fp, len);
+  for (int i = 0; ok && chain && i < sk_X509_num(chain); ++i) {
+    ok = X509_digest(sk_X509_value(chain, i), EVP_sha256(), fp, &len) &&
+      EVP_DigestUpdate(md, fp, len);
+  }
+  ok = ok && EVP_DigestFinal_ex(md, digest, NULL);
+  EVP_MD_CTX_free(md);
+  return ok;
+}
+
+static bool vfy_current(X509 *cert, time_t *now) {
+  return X509_cmp_time(X509_get0_notBefore(cert), now) <= 0 &&
+    X509_cmp_time(X509_get0_notAfter(cert), now) > 0;
+}
+
+// True if the chain was verified within the cache ttl and every certificate
+// is still within its validity period.
+static bool vfy_find(pni_vfy_cache_t *cache, const unsigned char *digest, X509_STORE_CTX *ctx) {
+  time_t now = time(NULL);
+  bool found = false;
+  if (cache->lock) CRYPTO_THREAD_read_lock(cache->lock);
+  if (cache->slots) {
+    pni_vfy_t *v = vfy_slot(cache, digest);
+    found = v->verified && !memcmp(v->digest, digest, sizeof(v->digest)) &&
+      !(cache->ttl && (pn_millis_t)(now - v->verified) * 1000 >= cache->ttl);
+  }
+  if (cache->lock) CRYPTO_THREAD_unlock(cache->lock);
+  if (!found || !vfy_current(X509_STORE_CTX_get0_cert(ctx), &now)) return false;
+  STACK_OF(X509) *chain = X509_STORE_CTX_get0_untrusted(ctx);
+  for (int i = 0; chain && i < sk_X509_num(chain); ++i) {
+    if (!vfy_current(sk_X509_value(chain, i), &now)) return false;
+  }
+  return true;
+}
+
+static void vfy_save(pni_vfy_cache_t *cache, const unsigned char *digest) {
+  if (cache->lock) CRYPTO_THREAD_write_lock(cache->lock);
+  if (cache->slots) {
+    pni_vfy_t *v = vfy_slot(cache, digest);
+    memcpy(v->digest, digest, sizeof(v->digest));
+    v->verified = time(NULL);
+  }
+  if (cache->lock) CRYPTO_THREAD_unlock(cache->lock);
+}
+
+// Certificate chain verification for the domain's SSL_CTX.  A chain verified
+// recently is trusted again without checking its signatures, but still has
+// its peer name checked since verify_callback() only runs for a full
+// verification.  Only chains that verified are kept.
+static int cert_verify(X509_STORE_CTX *ctx, void *arg) {
+  pni_vfy_cache_t *cache = &((pn_ssl_domain_t *) arg)->vfy_cache;
+  unsigned char digest[sizeof(((pni_vfy_t *) 0)->digest)];
+  bool keyed = cache->size && vfy_digest(ctx, digest);
+  if (keyed && vfy_find(cache, digest, ctx)) {
+    pn_transport_t *transport = verify_transport(ctx);
+    if (!transport) return 0;
+    ssl_log(transport, "Peer certificate chain verified recently, not checking signatures");
+    X509_STORE_CTX_set_error(ctx, X509_V_OK);
+    return verify_peer_name(transport, X509_STORE_CTX_get0_cert(ctx), ctx);
+  }
+  int ok = X509_verify_cert(ctx);
+  if (ok > 0 && keyed) vfy_save(cache, digest);
+  return ok;
 }
 
+#endif
+
 /** Public API - visible to application code */
 
 bool pn_ssl_present(void)
@@ -484,7 +775,6 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
     OpenSSL_add_all_algorithms();
     ssl_ex_data_index = SSL_get_ex_new_index( 0, (void *) "org.apache.qpid.proton.ssl",
                                               NULL, NULL, NULL);
-    ssn_init();
   }
 
   pn_ssl_domain_t *domain = (pn_ssl_domain_t *) calloc(1, sizeof(pn_ssl_domain_t));
@@ -492,6 +782,7 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
 
   domain->ref_count = 1;
   domain->mode = mode;
+  domain->buffer_size = PN_SSL_BUFFER_SIZE;
 
   // enable all supported protocol versions, then explicitly disable the
   // known vulnerable ones.  This should allow us to use the latest version
@@ -499,12 +790,14 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
   switch(mode) {
   case PN_SSL_MODE_CLIENT:
     domain->ctx = SSL_CTX_new(SSLv23_client_method()); // and TLSv1+
-    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_CLIENT);
     if (!domain->ctx) {
       ssl_log_error("Unable to initialize OpenSSL context.");
       free(domain);
       return NULL;
     }
+    // Sessions are kept in the domain's cache by session_id, not by OpenSSL
+    SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(domain->ctx, ssn_save);
     break;
 
   case PN_SSL_MODE_SERVER:
@@ -514,6 +807,9 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
       free(domain);
       return NULL;
     }
+    // Needed to resume sessions once peer certificates are verified
+    SSL_CTX_set_session_id_context(domain->ctx, (const unsigned char *)"org.apache.qpid.proton",
+                                   sizeof("org.apache.qpid.proton") - 1);
     break;
 
   default:
@@ -531,6 +827,23 @@ pn_ssl_domain_t *pn_ssl_domain( pn_ssl_mode_t mode )
     domain->default_seclevel = SSL_CTX_get_security_level(domain->ctx);
 #endif
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  domain->ssn_cache.lock = CRYPTO_THREAD_lock_new();
+  domain->vfy_cache.lock = CRYPTO_THREAD_lock_new();
+  SSL_CTX_set_cert_verify_callback(domain->ctx, cert_verify, domain);
+#endif
+  if (mode == PN_SSL_MODE_CLIENT &&
+      ssn_cache_init(&domain->ssn_cache, PN_SSL_SESSION_CACHE_SIZE, PN_SSL_SESSION_CACHE_TTL)) {
+    pn_ssl_domain_free(domain);
+    return NULL;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  if (vfy_cache_init(&domain->vfy_cache, PN_SSL_VERIFY_CACHE_SIZE, PN_SSL_VERIFY_CACHE_TTL)) {
+    pn_ssl_domain_free(domain);
+    return NULL;
+  }
+#endif
+
   // by default, allow anonymous ciphers so certificates are not required 'out of the box'
   if (!SSL_CTX_set_cipher_list( domain->ctx, CIPHERS_ANONYMOUS )) {
     ssl_log_error("Failed to set cipher list to %s", CIPHERS_ANONYMOUS);
@@ -559,6 +872,12 @@ void pn_ssl_domain_free( pn_ssl_domain_t *domain )
   if (--domain->ref_count == 0) {
 
     if (domain->ctx) SSL_CTX_free(domain->ctx);
+    ssn_cache_clear(&domain->ssn_cache);
+    vfy_cache_clear(&domain->vfy_cache);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+    if (domain->ssn_cache.lock) CRYPTO_THREAD_lock_free(domain->ssn_cache.lock);
+    if (domain->vfy_cache.lock) CRYPTO_THREAD_lock_free(domain->vfy_cache.lock);
+#endif
     if (domain->keyfile_pw) free(domain->keyfile_pw);
     if (domain->trusted_CAs) free(domain->trusted_CAs);
     free(domain);
@@ -566,6 +885,50 @@ void pn_ssl_domain_free( pn_ssl_domain_t *domain )
 }
 
 
+int pn_ssl_domain_set_buffer_size(pn_ssl_domain_t *domain, size_t size)
+{
+  if (!domain || !size) return -1;
+  domain->buffer_size = size;
+  return 0;
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  if (!domain || !domain->ctx) return -1;
+  if (domain->mode == PN_SSL_MODE_SERVER) {
+    if (size) {
+      SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size(domain->ctx, size);
+      SSL_CTX_clear_options(domain->ctx, SSL_OP_NO_TICKET);
+    } else {                    // OpenSSL takes a cache size of 0 as unlimited
+      SSL_CTX_set_session_cache_mode(domain->ctx, SSL_SESS_CACHE_OFF);
+      SSL_CTX_set_options(domain->ctx, SSL_OP_NO_TICKET);
+    }
+    if (ttl) SSL_CTX_set_timeout(domain->ctx, (ttl + 999) / 1000);
+    return 0;
+  }
+  pni_ssn_cache_t *cache = &domain->ssn_cache;
+  ssn_lock(cache);
+  int err = ssn_cache_init(cache, size, ttl);
+  ssn_unlock(cache);
+  return err;
+}
+
+int pn_ssl_domain_set_verify_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  if (!domain) return -1;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  pni_vfy_cache_t *cache = &domain->vfy_cache;
+  if (cache->lock) CRYPTO_THREAD_write_lock(cache->lock);
+  int err = vfy_cache_init(cache, size, ttl);
+  if (cache->lock) CRYPTO_THREAD_unlock(cache->lock);
+  return err;
+#else
+  return size ? -1 : 0;        // Needs the X509_STORE_CTX accessors of OpenSSL 1.1
+#endif
+}
+
+
 int pn_ssl_domain_set_credentials( pn_ssl_domain_t *domain,
                                const char *certificate_file,
                                const char *private_key_file,
@@ -638,6 +1001,7 @@ int pn_ssl_domain_set_trusted_ca_db(pn_ssl_domain_t *domain,
   }
 
   domain->has_ca_db = true;
+  vfy_cache_reset(&domain->vfy_cache);
 
   return 0;
 }
@@ -708,6 +1072,7 @@ int pn_ssl_domain_set_peer_authentication(pn_ssl_domain_t *domain,
   }
 
   domain->verify_mode = mode;
+  vfy_cache_reset(&domain->vfy_cache);
   return 0;
 }
 
@@ -840,20 +1205,6 @@ pn_ssl_t *pn_ssl(pn_transport_t *transport)
 
   pni_ssl_t *ssl = (pni_ssl_t *) calloc(1, sizeof(pni_ssl_t));
   if (!ssl) return NULL;
-  ssl->out_size = APP_BUF_SIZE;
-  uint32_t max_frame = pn_transport_get_max_frame(transport);
-  ssl->in_size =  max_frame ? max_frame : APP_BUF_SIZE;
-  ssl->outbuf = (char *)malloc(ssl->out_size);
-  if (!ssl->outbuf) {
-    free(ssl);
-    return NULL;
-  }
-  ssl->inbuf =  (char *)malloc(ssl->in_size);
-  if (!ssl->inbuf) {
-    free(ssl->outbuf);
-    free(ssl);
-    return NULL;
-  }
 
   transport->ssl = ssl;
 
@@ -883,7 +1234,6 @@ static int start_ssl_shutdown(pn_transport_t *transport)
   pni_ssl_t *ssl = transport->ssl;
   if (!ssl->ssl_shutdown) {
     ssl_log(transport, "Shutting down SSL connection...");
-    ssn_save(transport, ssl);
     ssl->ssl_shutdown = true;
     BIO_ssl_shutdown( ssl->bio_ssl );
   }
@@ -894,42 +1244,173 @@ static int start_ssl_shutdown(pn_transport_t *transport)
 //////// SSL Connections
 
 
+// The BIO below SSL reads records straight from the input the transport
+// offers and writes them straight into its output buffer, in place of a BIO
+// pair that copied every byte through a ring buffer of its own.  Records SSL
+// writes when the transport has offered no room, during input processing or
+// a handshake, are kept in net_pending and go out ahead of any others.
+
+static int net_bio_write(BIO *b, const char *data, int len)
+{
+  pni_ssl_t *ssl = (pni_ssl_t *) BIO_get_data(b);
+  BIO_clear_retry_flags(b);
+  if (len <= 0) return 0;
+  size_t n = 0;
+  if (ssl->net_pending_len == 0) {
+    n = (size_t)len < ssl->net_out_len ? (size_t)len : ssl->net_out_len;
+    if (n) {
+      memcpy(ssl->net_out, data, n);
+      ssl->net_out += n;
+      ssl->net_out_len -= n;
+    }
+  }
+  size_t rest = len - n;
+  if (rest) {
+    if (ssl->net_pending_len + rest > ssl->net_pending_size) {
+      size_t size = ssl->net_pending_size ? ssl->net_pending_size : 1024;
+      while (size < ssl->net_pending_len + rest) size *= 2;
+      char *pending = (char *) realloc(ssl->net_pending, size);
+      if (!pending) return -1;
+      ssl->net_pending = pending;
+      ssl->net_pending_size = size;
+    }
+    memcpy(ssl->net_pending + ssl->net_pending_len, data + n, rest);
+    ssl->net_pending_len += rest;
+  }
+  return len;
+}
+
+static int net_bio_read(BIO *b, char *data, int len)
+{
+  pni_ssl_t *ssl = (pni_ssl_t *) BIO_get_data(b);
+  BIO_clear_retry_flags(b);
+  if (len <= 0) return 0;
+  if (ssl->net_in_len == 0) {
+    if (ssl->net_in_closed) return 0;
+    BIO_set_retry_read(b);
+    return -1;
+  }
+  size_t n = (size_t)len < ssl->net_in_len ? (size_t)len : ssl->net_in_len;
+  memcpy(data, ssl->net_in, n);
+  ssl->net_in += n;
+  ssl->net_in_len -= n;
+  return (int) n;
+}
+
+static int net_bio_puts(BIO *b, const char *str)
+{
+  return net_bio_write(b, str, (int) strlen(str));
+}
+
+static long net_bio_ctrl(BIO *b, int cmd, long num, void *ptr)
+{
+  pni_ssl_t *ssl = (pni_ssl_t *) BIO_get_data(b);
+  switch (cmd) {
+  case BIO_CTRL_FLUSH:
+    return 1;
+  case BIO_CTRL_PENDING:
+    return ssl ? (long) ssl->net_in_len : 0;
+  case BIO_CTRL_WPENDING:
+    return ssl ? (long) ssl->net_pending_len : 0;
+  case BIO_CTRL_EOF:
+    return ssl ? ssl->net_in_closed && ssl->net_in_len == 0 : 1;
+  default:
+    return 0;
+  }
+}
+
+static int net_bio_create(BIO *b)
+{
+  BIO_set_init(b, 1);
+  return 1;
+}
+
+static int net_bio_destroy(BIO *b)
+{
+  BIO_set_data(b, NULL);
+  return 1;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+
+static BIO_METHOD *net_bio_method(void)
+{
+  static BIO_METHOD *method;
+  if (!method) {
+    BIO_METHOD *m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "proton transport");
+    if (!m) return NULL;
+    BIO_meth_set_write(m, net_bio_write);
+    BIO_meth_set_read(m, net_bio_read);
+    BIO_meth_set_puts(m, net_bio_puts);
+    BIO_meth_set_ctrl(m, net_bio_ctrl);
+    BIO_meth_set_create(m, net_bio_create);
+    BIO_meth_set_destroy(m, net_bio_destroy);
+    method = m;
+  }
+  return method;
+}
+
+#else
+
+static BIO_METHOD net_bio = {
+  BIO_TYPE_SOURCE_SINK, "proton transport",
+  net_bio_write, net_bio_read, net_bio_puts, NULL,
+  net_bio_ctrl, net_bio_create, net_bio_destroy, NULL
+};
+
+static BIO_METHOD *net_bio_method(void)
+{
+  return &net_bio;
+}
+
+#endif
+
+static void net_out_close(pni_ssl_t *ssl)
+{
+  ssl->net_out = NULL;
+  ssl->net_out_len = 0;
+}
+
+// Move records that had no room when SSL wrote them into the output buffer
+static size_t net_pending_drain(pni_ssl_t *ssl, char *buffer, size_t max_len)
+{
+  size_t n = ssl->net_pending_len < max_len ? ssl->net_pending_len : max_len;
+  if (n) {
+    memcpy(buffer, ssl->net_pending, n);
+    ssl->net_pending_len -= n;
+    if (ssl->net_pending_len)
+      memmove(ssl->net_pending, ssl->net_pending + n, ssl->net_pending_len);
+  }
+  return n;
+}
+
+
 // take data from the network, and pass it into SSL.  Attempt to read decrypted data from
 // SSL socket and pass it to the application.
-static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer, const char *input_data, size_t available)
+static ssize_t ssl_process_input( pn_transport_t *transport, unsigned int layer, const char *input_data, size_t available)
 {
   pni_ssl_t *ssl = transport->ssl;
   if (ssl->ssl == NULL && init_ssl_socket(transport, ssl)) return PN_EOS;
+  if (ssl_alloc_buffers(transport, ssl)) return PN_EOS;
 
   ssl_log( transport, "process_input_ssl( data size=%d )",available );
 
-  ssize_t consumed = 0;
+  // SSL reads the network bytes in place, as many as it takes
+  ssl->net_in = input_data;
+  ssl->net_in_len = available;
+  if (available > 0) {
+    ssl->read_blocked = false;
+  } else if (!ssl->net_in_closed) {
+    // lower layer (caller) has closed.  SSL reads EOF from the network BIO from now on.
+    ssl_log( transport, "Lower layer closed - network BIO at EOF");
+    ssl->net_in_closed = true;
+  }
+
   bool work_pending;
-  bool shutdown_input = (available == 0);  // caller is closed
 
   do {
     work_pending = false;
 
-    // Write to network bio as much as possible, consuming bytes/available
-
-    if (available > 0) {
-      int written = BIO_write( ssl->bio_net_io, input_data, available );
-      if (written > 0) {
-        input_data += written;
-        available -= written;
-        consumed += written;
-        ssl->read_blocked = false;
-        work_pending = (available > 0);
-        ssl_log( transport, "Wrote %d bytes to BIO Layer, %d left over", written, available );
-      }
-    } else if (shutdown_input) {
-      // lower layer (caller) has closed.  Close the WRITE side of the BIO.  This will cause
-      // an EOF to be passed to SSL once all pending inbound data has been consumed.
-      ssl_log( transport, "Lower layer closed - shutting down BIO write side");
-      (void)BIO_shutdown_wr( ssl->bio_net_io );
-      shutdown_input = false;
-    }
-
     // Read all available data from the SSL socket
 
     if (!ssl->ssl_closed && ssl->in_count < ssl->in_size) {
@@ -951,6 +1432,8 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
             break;
           default:
             // unexpected error
+            ssl->net_in = NULL;
+            ssl->net_in_len = 0;
             return (ssize_t)ssl_failed(transport);
           }
         } else {
@@ -1017,6 +1500,11 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
 
   } while (work_pending);
 
+  ssize_t consumed = available - ssl->net_in_len;
+  ssl->net_in = NULL;
+  ssl->net_in_len = 0;
+  ssl_log( transport, "SSL read %d network bytes, %d left over", (int) consumed, (int) (available - consumed) );
+
   //_log(ssl, "ssl_closed=%d in_count=%d app_input_closed=%d app_output_closed=%d",
   //     ssl->ssl_closed, ssl->in_count, ssl->app_input_closed, ssl->app_output_closed );
 
@@ -1042,25 +1530,99 @@ static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer,
   return consumed;
 }
 
+static ssize_t process_input_ssl( pn_transport_t *transport, unsigned int layer, const char *input_data, size_t available)
+{
+  PNI_PROBE2(ssl_input_start, transport, available);
+  ssize_t consumed = ssl_process_input(transport, layer, input_data, available);
+  PNI_PROBE2(ssl_input_done, transport, consumed);
+  return consumed;
+}
+
 static void handle_error_ssl(pn_transport_t *transport, unsigned int layer)
 {
   transport->io_layers[layer] = &ssl_closed_layer;
 }
 
-static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer, char *buffer, size_t max_len)
+// Write application bytes to the SSL socket, one record at most. Records start
+// small so the first bytes of a burst reach the peer in a single TCP segment,
+// and grow to the TLS maximum once the application keeps streaming. Returns
+// the bytes written, 0 if SSL cannot take more now, < 0 if SSL failed.
+static ssize_t ssl_write_app(pn_transport_t *transport, pni_ssl_t *ssl, const char *data, size_t len)
+{
+  if (len > ssl->record_size) len = ssl->record_size;
+  int wrote = BIO_write( ssl->bio_ssl, data, len );
+  if (wrote > 0) {
+    ssl_log( transport, "Wrote %d bytes from app to socket", wrote );
+    ssl->streamed += wrote;
+    if (ssl->streamed >= PN_SSL_RECORD_RAMP_BYTES) ssl->record_size = SSL3_RT_MAX_PLAIN_LENGTH;
+    return wrote;
+  }
+  if (!BIO_should_retry(ssl->bio_ssl)) {
+    int reason = SSL_get_error( ssl->ssl, wrote );
+    switch (reason) {
+    case SSL_ERROR_ZERO_RETURN:
+      // SSL closed cleanly
+      ssl_log(transport, "SSL connection has closed");
+      start_ssl_shutdown(transport); // KAG: not sure - this may not be necessary
+      ssl->out_count = 0;      // can no longer write to socket, so erase app output data
+      ssl->ssl_closed = true;
+      return 0;
+    default:
+      // unexpected error
+      return (ssize_t)ssl_failed(transport);
+    }
+  }
+  if (BIO_should_read( ssl->bio_ssl )) {
+    ssl->read_blocked = true;
+    ssl_log(transport, "Detected read-blocked");
+  }
+  if (BIO_should_write( ssl->bio_ssl )) {
+    ssl->write_blocked = true;
+    ssl_log(transport, "Detected write-blocked");
+  }
+  return 0;
+}
+
+static ssize_t ssl_process_output( pn_transport_t *transport, unsigned int layer, char *buffer, size_t max_len)
 {
   pni_ssl_t *ssl = transport->ssl;
   if (!ssl) return PN_EOS;
   if (ssl->ssl == NULL && init_ssl_socket(transport, ssl)) return PN_EOS;
-
-  ssize_t written = 0;
+  if (ssl_alloc_buffers(transport, ssl)) return PN_EOS;
+
+  // Records that had no room before go first.  SSL writes into the buffer
+  // in place once they are all out, and only while there is room for them.
+  ssize_t written = net_pending_drain(ssl, buffer, max_len);
+  if (ssl->net_pending_len == 0) {
+    ssl->net_out = buffer + written;
+    ssl->net_out_len = max_len - written;
+  }
   bool work_pending;
 
   do {
     work_pending = false;
     // first, get any pending application output, if possible
 
-    if (!ssl->app_output_closed && ssl->out_count < ssl->out_size) {
+    // AMQP frames are encrypted where the transport holds them, other
+    // application output is gathered into outbuf first
+    bool direct = false;
+    if (!ssl->ssl_closed && !ssl->app_output_closed && ssl->out_count == 0 && ssl->net_out_len) {
+      pn_bytes_t frames = pni_transport_peek_output(transport, layer+1);
+      if (frames.size) {
+        direct = true;
+        ssize_t wrote = ssl_write_app(transport, ssl, frames.start, frames.size);
+        if (wrote < 0) {
+          net_out_close(ssl);
+          return wrote;
+        }
+        if (wrote > 0) {
+          pni_transport_consume_output(transport, wrote);
+          work_pending = true;
+        }
+      }
+    }
+
+    if (!direct && !ssl->app_output_closed && ssl->out_count < ssl->out_size) {
       ssize_t app_bytes = transport->io_layers[layer+1]->process_output(transport, layer+1, &ssl->outbuf[ssl->out_count], ssl->out_size - ssl->out_count);
       if (app_bytes > 0) {
         ssl->out_count += app_bytes;
@@ -1071,6 +1633,10 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
           ssl_log(transport, "Application layer closed its output, error=%d (%d bytes pending send)",
                (int) app_bytes, (int) ssl->out_count);
           ssl->app_output_closed = app_bytes;
+        } else if (ssl->out_count == 0) {
+          // Nothing more to send: go back to small records for the next burst
+          ssl->record_size = PN_SSL_RECORD_START_SIZE;
+          ssl->streamed = 0;
         }
       }
     }
@@ -1079,38 +1645,16 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
 
     if (!ssl->ssl_closed) {
       char *data = ssl->outbuf;
-      if (ssl->out_count > 0) {
-        int wrote = BIO_write( ssl->bio_ssl, data, ssl->out_count );
+      if (ssl->out_count > 0 && ssl->net_out_len) {
+        ssize_t wrote = ssl_write_app(transport, ssl, data, ssl->out_count);
+        if (wrote < 0) {
+          net_out_close(ssl);
+          return wrote;
+        }
         if (wrote > 0) {
           data += wrote;
           ssl->out_count -= wrote;
           work_pending = true;
-          ssl_log( transport, "Wrote %d bytes from app to socket", wrote );
-        } else {
-          if (!BIO_should_retry(ssl->bio_ssl)) {
-            int reason = SSL_get_error( ssl->ssl, wrote );
-            switch (reason) {
-            case SSL_ERROR_ZERO_RETURN:
-              // SSL closed cleanly
-              ssl_log(transport, "SSL connection has closed");
-              start_ssl_shutdown(transport); // KAG: not sure - this may not be necessary
-              ssl->out_count = 0;      // can no longer write to socket, so erase app output data
-              ssl->ssl_closed = true;
-              break;
-            default:
-              // unexpected error
-              return (ssize_t)ssl_failed(transport);
-            }
-          } else {
-            if (BIO_should_read( ssl->bio_ssl )) {
-              ssl->read_blocked = true;
-              ssl_log(transport, "Detected read-blocked");
-            }
-            if (BIO_should_write( ssl->bio_ssl )) {
-              ssl->write_blocked = true;
-              ssl_log(transport, "Detected write-blocked");
-            }
-          }
         }
       }
 
@@ -1125,33 +1669,29 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
       }
     }
 
-    // read from the network bio as much as possible, filling the buffer
-    if (max_len) {
-      int available = BIO_read( ssl->bio_net_io, buffer, max_len );
-      if (available > 0) {
-        max_len -= available;
-        buffer += available;
-        written += available;
-        ssl->write_blocked = false;
-        work_pending = work_pending || max_len > 0;
-        ssl_log(transport, "Read %d bytes from BIO Layer", available );
-      }
-    }
-
   } while (work_pending);
 
+  if (ssl->net_out) {
+    written = ssl->net_out - buffer;
+    net_out_close(ssl);
+  }
+  if (written > 0) {
+    ssl->write_blocked = false;
+    ssl_log(transport, "SSL wrote %d network bytes", (int) written );
+  }
+
   //_log(ssl, "written=%d ssl_closed=%d in_count=%d app_input_closed=%d app_output_closed=%d bio_pend=%d",
-  //     written, ssl->ssl_closed, ssl->in_count, ssl->app_input_closed, ssl->app_output_closed, BIO_pending(ssl->bio_net_io) );
+  //     written, ssl->ssl_closed, ssl->in_count, ssl->app_input_closed, ssl->app_output_closed, ssl->net_pending_len );
 
   // PROTON-82: close the output side as soon as we've sent the SSL close_notify.
   // We're not requiring the response, as some implementations never reply.
   // ----
   // Once no more data is available "below" the SSL socket, tell the transport we are
   // done.
-  //if (written == 0 && ssl->ssl_closed && BIO_pending(ssl->bio_net_io) == 0) {
+  //if (written == 0 && ssl->ssl_closed && ssl->net_pending_len == 0) {
   //  written = ssl->app_output_closed ? ssl->app_output_closed : PN_EOS;
   //}
-  if (written == 0 && (SSL_get_shutdown(ssl->ssl) & SSL_SENT_SHUTDOWN) && BIO_pending(ssl->bio_net_io) == 0) {
+  if (written == 0 && (SSL_get_shutdown(ssl->ssl) & SSL_SENT_SHUTDOWN) && ssl->net_pending_len == 0) {
     written = ssl->app_output_closed ? ssl->app_output_closed : PN_EOS;
     if (transport->io_layers[layer]==&ssl_input_closed_layer) {
       transport->io_layers[layer] = &ssl_closed_layer;
@@ -1163,16 +1703,64 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
   return written;
 }
 
+static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer, char *buffer, size_t max_len)
+{
+  PNI_PROBE2(ssl_output_start, transport, max_len);
+  ssize_t written = ssl_process_output(transport, layer, buffer, max_len);
+  PNI_PROBE2(ssl_output_done, transport, written);
+  return written;
+}
+
+// Allocate the application buffers, at setup and again after pni_ssl_hibernate()
+static int ssl_alloc_buffers(pn_transport_t* transport, pni_ssl_t *ssl)
+{
+  if (ssl->outbuf) return 0;
+  ssl->out_size = ssl->domain->buffer_size;
+  uint32_t max_frame = pn_transport_get_max_frame(transport);
+  ssl->in_size = max_frame ? max_frame : ssl->domain->buffer_size;
+  ssl->outbuf = (char *)malloc(ssl->out_size);
+  ssl->inbuf = (char *)malloc(ssl->in_size);
+  if (!ssl->outbuf || !ssl->inbuf) {
+    pn_transport_logf(transport, "SSL buffer allocation failure." );
+    return -1;
+  }
+  return 0;
+}
+
+size_t pni_ssl_hibernate(pn_transport_t *transport)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  if (!ssl || !ssl->outbuf || ssl->in_count || ssl->out_count || ssl->net_pending_len) return 0;
+  size_t size = ssl->in_size + ssl->out_size + ssl->net_pending_size;
+  free(ssl->inbuf);
+  free(ssl->outbuf);
+  free(ssl->net_pending);
+  ssl->inbuf = ssl->outbuf = ssl->net_pending = NULL;
+  ssl->net_pending_size = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000
+  // OpenSSL's record buffers, allocated again on the next read or write
+  if (ssl->ssl) (void)SSL_free_buffers(ssl->ssl);
+#endif
+  return size;
+}
+
 static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
 {
   if (ssl->ssl) return 0;
   if (!ssl->domain) return -1;
 
+  if (ssl_alloc_buffers(transport, ssl)) return -1;
+  ssl->record_size = PN_SSL_RECORD_START_SIZE;
+  ssl->streamed = 0;
+
   ssl->ssl = SSL_new(ssl->domain->ctx);
   if (!ssl->ssl) {
     pn_transport_logf(transport, "SSL socket setup failure." );
     return -1;
   }
+  // Writes return after each record, and may resume from frames still
+  // waiting in the transport rather than the buffer first offered.
+  SSL_set_mode(ssl->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
   // store backpointer to pn_transport_t in SSL object:
   SSL_set_ex_data(ssl->ssl, ssl_ex_data_index, transport);
@@ -1194,12 +1782,15 @@ static int init_ssl_socket(pn_transport_t* transport, pni_ssl_t *ssl)
   }
   (void)BIO_set_ssl(ssl->bio_ssl, ssl->ssl, BIO_NOCLOSE);
 
-  // create the "lower" BIO "pipe", and attach it below the SSL layer
-  if (!BIO_new_bio_pair(&ssl->bio_ssl_io, 0, &ssl->bio_net_io, 0)) {
+  // attach the network BIO below the SSL layer
+  BIO_METHOD *method = net_bio_method();
+  ssl->bio_net = method ? BIO_new(method) : NULL;
+  if (!ssl->bio_net) {
     pn_transport_log(transport, "BIO setup failure." );
     return -1;
   }
-  SSL_set_bio(ssl->ssl, ssl->bio_ssl_io, ssl->bio_ssl_io);
+  BIO_set_data(ssl->bio_net, ssl);
+  SSL_set_bio(ssl->ssl, ssl->bio_net, ssl->bio_net);
 
   if (ssl->domain->mode == PN_SSL_MODE_SERVER) {
     SSL_set_accept_state(ssl->ssl);
@@ -1219,14 +1810,15 @@ static void release_ssl_socket(pni_ssl_t *ssl)
 {
   if (ssl->bio_ssl) BIO_free(ssl->bio_ssl);
   if (ssl->ssl) {
-      SSL_free(ssl->ssl);       // will free bio_ssl_io
+      SSL_free(ssl->ssl);       // will free bio_net
   } else {
-    if (ssl->bio_ssl_io) BIO_free(ssl->bio_ssl_io);
+    if (ssl->bio_net) BIO_free(ssl->bio_net);
   }
-  if (ssl->bio_net_io) BIO_free(ssl->bio_net_io);
+  free(ssl->net_pending);
   ssl->bio_ssl = NULL;
-  ssl->bio_ssl_io = NULL;
-  ssl->bio_net_io = NULL;
+  ssl->bio_net = NULL;
+  ssl->net_pending = NULL;
+  ssl->net_pending_len = ssl->net_pending_size = 0;
   ssl->ssl = NULL;
 }
 
@@ -1452,9 +2044,7 @@ static size_t buffered_output(pn_transport_t *transport)
   pni_ssl_t *ssl = transport->ssl;
   if (ssl) {
     count += ssl->out_count;
-    if (ssl->bio_net_io) { // pick up any bytes waiting for network io
-      count += BIO_ctrl_pending(ssl->bio_net_io);
-    }
+    count += ssl->net_pending_len;  // records waiting for network io
   }
   return count;
 }
@@ -649,6 +649,23 @@ int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain)
   return 0;
 }
 
+int pn_ssl_domain_set_buffer_size(pn_ssl_domain_t *domain, size_t size)
+{
+  return -1;
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  // SChannel keeps its own credential cache, session resumption is not yet supported.
+  return -1;
+}
+
+int pn_ssl_domain_set_verify_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  // Chain verification is left to the Windows certificate chain engine and its cache.
+  return -1;
+}
+
 
 // TODO: This is just an untested guess
 int pn_ssl_get_ssf(pn_ssl_t *ssl0)
@@ -736,6 +753,11 @@ void pn_ssl_free( pn_transport_t *transport)
   free(ssl);
 }
 
+size_t pni_ssl_hibernate(pn_transport_t *transport)
+{
+  return 0;                     // Not implemented, the buffers are kept
+}
+
 pn_ssl_t *pn_ssl(pn_transport_t *transport)
 {
   if (!transport) return NULL;
@@ -870,7 +892,10 @@ const char *tls_version_check(pni_ssl_t *ssl)
     "peer does not support TLS 1.0 security" : NULL;
 }
 
-static void ssl_encrypt(pn_transport_t *transport, char *app_data, size_t count)
+// Encrypt count bytes at app_data into one Record, in place: the header goes
+// in the cbHeader bytes before app_data, the trailer right after the data.
+// Returns the Record size.
+static size_t ssl_encrypt(pn_transport_t *transport, char *app_data, size_t count)
 {
   pni_ssl_t *ssl = transport->ssl;
 
@@ -878,7 +903,7 @@ static void ssl_encrypt(pn_transport_t *transport, char *app_data, size_t count)
   SecBuffer buffs[4];
   buffs[0].cbBuffer = ssl->sc_sizes.cbHeader;
   buffs[0].BufferType = SECBUFFER_STREAM_HEADER;
-  buffs[0].pvBuffer = ssl->sc_outbuf;
+  buffs[0].pvBuffer = app_data - ssl->sc_sizes.cbHeader;
   buffs[1].cbBuffer = count;
   buffs[1].BufferType = SECBUFFER_DATA;
   buffs[1].pvBuffer = app_data;
@@ -898,14 +923,14 @@ static void ssl_encrypt(pn_transport_t *transport, char *app_data, size_t count)
   // EncryptMessage encrypts the data in place. The header and trailer
   // areas were reserved previously and must now be included in the updated
   // count of bytes to write to the peer.
-  ssl->sc_out_count = buffs[0].cbBuffer + buffs[1].cbBuffer + buffs[2].cbBuffer;
-  ssl->network_outp = ssl->sc_outbuf;
-  ssl->network_out_pending = ssl->sc_out_count;
-  ssl_log(transport, "ssl_encrypt %d network bytes\n", ssl->network_out_pending);
+  size_t size = buffs[0].cbBuffer + buffs[1].cbBuffer + buffs[2].cbBuffer;
+  ssl_log(transport, "ssl_encrypt %d network bytes\n", (int) size);
+  return size;
 }
 
+// Decrypt count bytes at data in place, normally sc_inbuf.
 // Returns true if decryption succeeded (even for empty content)
-static bool ssl_decrypt(pn_transport_t *transport)
+static bool ssl_decrypt(pn_transport_t *transport, char *data, size_t count)
 {
   pni_ssl_t *ssl = transport->ssl;
   // Get SChannel to decrypt input.  May have an incomplete Record,
@@ -913,9 +938,9 @@ static bool ssl_decrypt(pn_transport_t *transport)
   // session renegotiation.
 
   SecBuffer recv_buffs[4];
-  recv_buffs[0].cbBuffer = ssl->sc_in_count;
+  recv_buffs[0].cbBuffer = count;
   recv_buffs[0].BufferType = SECBUFFER_DATA;
-  recv_buffs[0].pvBuffer = ssl->sc_inbuf;
+  recv_buffs[0].pvBuffer = data;
   recv_buffs[1].BufferType = SECBUFFER_EMPTY;
   recv_buffs[2].BufferType = SECBUFFER_EMPTY;
   recv_buffs[3].BufferType = SECBUFFER_EMPTY;
@@ -1512,6 +1537,16 @@ static void read_closed(pn_transport_t *transport, unsigned int layer, ssize_t e
 }
 
 
+// Size of the TLS Record at the start of data if all of it is there and fits
+// in max bytes, else 0.
+static size_t whole_record(const char *data, size_t available, size_t max)
+{
+  if (available < 5)
+    return 0;
+  size_t rec_len = (unsigned char) data[3] * 256 + (unsigned char) data[4] + 5;
+  return (rec_len <= available && rec_len <= max) ? rec_len : 0;
+}
+
 // Read up to "available" bytes from the network, decrypt it and pass plaintext to application.
 
 static ssize_t process_input_ssl(pn_transport_t *transport, unsigned int layer, const char *input_data, size_t available)
@@ -1539,9 +1574,33 @@ static ssize_t process_input_ssl(pn_transport_t *transport, unsigned int layer,
     // i.e. no straggling decrypted bytes pending.
     assert(ssl->in_data_count == 0 && ssl->decrypting);
     new_app_input = false;
-    size_t count;
-
-    if (ssl->state != RUNNING) {
+    size_t count = 0;
+    size_t whole = 0;
+    if (ssl->state == RUNNING && ssl->sc_in_count == 0 && !ssl->double_buffered)
+      whole = whole_record(input_data, available, ssl->sc_in_size);
+
+    if (whole) {
+      // The network input holds a whole Record: decrypt it there, in the
+      // transport's own input buffer, rather than copy it to sc_inbuf.  The
+      // plaintext is handed to the application below, and what it leaves is
+      // double buffered, before the input buffer is reused.
+      char *record = (char *) input_data;
+      input_data += whole;
+      available -= whole;
+      consumed += whole;
+      if (ssl_decrypt(transport, record, whole)) {
+        if (ssl->in_data_size > 0) {
+          new_app_input = true;
+          app_inbytes_add(transport);
+        } else {
+          rewind_sc_inbuf(ssl);
+        }
+      } else if (ssl->sc_in_incomplete) {
+        // SChannel disagrees with the Record length, let it see more input
+        memmove(ssl->sc_inbuf, record, whole);
+        ssl->sc_in_count = whole;
+      }
+    } else if (ssl->state != RUNNING) {
       count = _pni_min(ssl->sc_in_size - ssl->sc_in_count, available);
     } else {
       // look for TLS record boundaries
@@ -1580,11 +1639,11 @@ static ssize_t process_input_ssl(pn_transport_t *transport, unsigned int layer,
 
     // Try to decrypt another TLS Record.
 
-    if (ssl->sc_in_count > 0 && ssl->state <= SHUTTING_DOWN) {
+    if (!whole && ssl->sc_in_count > 0 && ssl->state <= SHUTTING_DOWN) {
       if (ssl->state == NEGOTIATING) {
         ssl_handshake(transport);
       } else {
-        if (ssl_decrypt(transport)) {
+        if (ssl_decrypt(transport, ssl->sc_inbuf, ssl->sc_in_count)) {
           // Ignore TLS Record with 0 length data (does not mean EOS)
           if (ssl->in_data_size > 0) {
             new_app_input = true;
@@ -1687,9 +1746,11 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
     }
 
     if (ssl->network_out_pending == 0 && ssl->state == RUNNING  && !ssl->app_output_closed) {
-      // refill the buffer with app data and encrypt it
-
-      char *app_data = ssl->sc_outbuf + ssl->sc_sizes.cbHeader;
+      // refill the buffer with app data and encrypt it.  If a whole Record
+      // fits in the network buffer, gather and encrypt right there instead
+      // of in sc_outbuf, saving a copy of every Record.
+      bool direct = max_len >= ssl->sc_sizes.cbHeader + ssl->max_data_size + ssl->sc_sizes.cbTrailer;
+      char *app_data = (direct ? buffer : ssl->sc_outbuf) + ssl->sc_sizes.cbHeader;
       char *app_outp = app_data;
       size_t remaining = ssl->max_data_size;
       ssize_t app_bytes;
@@ -1715,8 +1776,17 @@ static ssize_t process_output_ssl( pn_transport_t *transport, unsigned int layer
         }
       } while (app_bytes > 0);
       if (app_outp > app_data) {
+        size_t size = ssl_encrypt(transport, app_data, app_outp - app_data);
+        if (direct) {
+          buffer += size;
+          max_len -= size;
+          written += size;
+        } else {
+          ssl->sc_out_count = size;
+          ssl->network_outp = ssl->sc_outbuf;
+          ssl->network_out_pending = size;
+        }
         work_pending = (max_len > 0);
-        ssl_encrypt(transport, app_data, app_outp - app_data);
       }
     }
 
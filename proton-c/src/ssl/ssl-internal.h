@@ -33,4 +33,7 @@
 // release the SSL context
 void pn_ssl_free(pn_transport_t *transport);
 
+// free empty I/O buffers until next needed, return the bytes freed
+size_t pni_ssl_hibernate(pn_transport_t *transport);
+
 #endif /* ssl-internal.h */
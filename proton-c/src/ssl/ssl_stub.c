@@ -52,6 +52,11 @@ void pn_ssl_free( pn_ssl_t *ssl)
 {
 }
 
+size_t pni_ssl_hibernate(pn_transport_t *transport)
+{
+  return 0;
+}
+
 void pn_ssl_trace(pn_ssl_t *ssl, pn_trace_t trace)
 {
 }
@@ -120,6 +125,21 @@ int pn_ssl_domain_allow_unsecured_client(pn_ssl_domain_t *domain)
   return -1;
 }
 
+int pn_ssl_domain_set_buffer_size(pn_ssl_domain_t *domain, size_t size)
+{
+  return -1;
+}
+
+int pn_ssl_domain_set_session_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  return -1;
+}
+
+int pn_ssl_domain_set_verify_cache(pn_ssl_domain_t *domain, size_t size, pn_millis_t ttl)
+{
+  return -1;
+}
+
 bool pn_ssl_allow_unsecured(pn_ssl_t *ssl)
 {
   return true;
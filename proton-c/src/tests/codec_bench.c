@@ -0,0 +1,311 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Codec microbenchmarks: time pn_data_t fill, encode and decode and
+ * pn_message_t encode and decode for a few message shapes.
+ *
+ * Usage: c-codec-bench [-t <ms per measurement>] [<shape>...]
+ *
+ * Prints ns/op and, with glibc, allocations/op (malloc, calloc and
+ * realloc calls made by the benchmark and the proton library).
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#undef NDEBUG                   /* Make sure that assert() is enabled even in a release build. */
+
+#include <proton/codec.h>
+#include <proton/message.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Count allocations by interposing the glibc allocator */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void*, size_t);
+extern void __libc_free(void*);
+
+static size_t allocs = 0;
+
+/* Visible to the library despite -fvisibility=hidden */
+#define EXPORT __attribute__((visibility("default")))
+
+EXPORT void *malloc(size_t size) { ++allocs; return __libc_malloc(size); }
+EXPORT void *calloc(size_t n, size_t size) { ++allocs; return __libc_calloc(n, size); }
+EXPORT void *realloc(void *p, size_t size) { ++allocs; return __libc_realloc(p, size); }
+EXPORT void free(void *p) { __libc_free(p); }
+#else
+static size_t allocs = 0;      /* Not counted */
+#endif
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart * 1e9 / (double)f.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+#endif
+}
+
+/* Shapes */
+
+#define PROPERTIES 32
+#define BINARY_SIZE (64*1024)
+#define NESTED_DEPTH 4
+#define NESTED_FANOUT 4
+#define ARRAY_SIZE 1000
+
+static char keys[PROPERTIES][16];
+static char blob[BINARY_SIZE];
+
+static void fill_tiny(pn_data_t *data) {
+  pn_data_clear(data);
+  pn_data_fill(data, "S", "hello");
+}
+
+static void fill_properties(pn_data_t *data) {
+  pn_data_clear(data);
+  pn_data_put_map(data);
+  pn_data_enter(data);
+  for (int i = 0; i < PROPERTIES; ++i) {
+    pn_data_put_string(data, pn_bytes(strlen(keys[i]), keys[i]));
+    switch (i % 4) {
+     case 0: pn_data_put_string(data, pn_bytes(5, "value")); break;
+     case 1: pn_data_put_int(data, i); break;
+     case 2: pn_data_put_long(data, (int64_t)i << 40); break;
+     case 3: pn_data_put_bool(data, true); break;
+    }
+  }
+  pn_data_exit(data);
+}
+
+static void fill_binary(pn_data_t *data) {
+  pn_data_clear(data);
+  pn_data_put_binary(data, pn_bytes(sizeof(blob), blob));
+}
+
+static void put_nested(pn_data_t *data, int depth) {
+  if (depth == 0) {
+    pn_data_put_int(data, 42);
+    return;
+  }
+  pn_data_put_map(data);
+  pn_data_enter(data);
+  for (int i = 0; i < NESTED_FANOUT; ++i) {
+    pn_data_put_symbol(data, pn_bytes(strlen(keys[i]), keys[i]));
+    put_nested(data, depth - 1);
+  }
+  pn_data_exit(data);
+}
+
+static void fill_nested(pn_data_t *data) {
+  pn_data_clear(data);
+  put_nested(data, NESTED_DEPTH);
+}
+
+static void fill_array(pn_data_t *data) {
+  pn_data_clear(data);
+  pn_data_put_array(data, false, PN_INT);
+  pn_data_enter(data);
+  for (int i = 0; i < ARRAY_SIZE; ++i) {
+    pn_data_put_int(data, i);
+  }
+  pn_data_exit(data);
+}
+
+typedef struct shape_t {
+  const char *name;
+  void (*fill)(pn_data_t *data);
+  bool properties;              /* Application properties rather than the message body */
+} shape_t;
+
+static const shape_t shapes[] = {
+  { "tiny", fill_tiny, false },
+  { "properties", fill_properties, true },
+  { "binary", fill_binary, false },
+  { "nested", fill_nested, false },
+  { "array", fill_array, false },
+};
+
+/* Operations */
+
+#define BUFFER_SIZE (1024*1024)
+
+typedef struct bench_t {
+  const shape_t *shape;
+  pn_data_t *src, *dst;
+  pn_message_t *msg, *msg2;
+  char *buf, *mbuf;
+  size_t size, msize;           /* Encoded sizes */
+} bench_t;
+
+static void op_fill(bench_t *b) {
+  b->shape->fill(b->dst);
+}
+
+static void op_encode(bench_t *b) {
+  ssize_t n = pn_data_encode(b->src, b->buf, BUFFER_SIZE);
+  assert(n > 0);
+}
+
+static void op_decode(bench_t *b) {
+  pn_data_clear(b->dst);
+  ssize_t n = pn_data_decode(b->dst, b->buf, b->size);
+  assert(n == (ssize_t)b->size);
+}
+
+static void op_message_encode(bench_t *b) {
+  size_t size = BUFFER_SIZE;
+  int err = pn_message_encode(b->msg, b->mbuf, &size);
+  assert(!err);
+}
+
+static void op_message_decode(bench_t *b) {
+  int err = pn_message_decode(b->msg2, b->mbuf, b->msize);
+  assert(!err);
+}
+
+typedef struct op_t {
+  const char *name;
+  void (*run)(bench_t *b);
+} op_t;
+
+static const op_t ops[] = {
+  { "pn_data_fill", op_fill },
+  { "pn_data_encode", op_encode },
+  { "pn_data_decode", op_decode },
+  { "pn_message_encode", op_message_encode },
+  { "pn_message_decode", op_message_decode },
+};
+
+#define ARRAYLEN(A) (sizeof(A)/sizeof((A)[0]))
+
+static void bench_init(bench_t *b, const shape_t *shape) {
+  b->shape = shape;
+  b->src = pn_data(0);
+  b->dst = pn_data(0);
+  b->msg = pn_message();
+  b->msg2 = pn_message();
+  b->buf = (char*)malloc(BUFFER_SIZE);
+  b->mbuf = (char*)malloc(BUFFER_SIZE);
+  assert(b->buf && b->mbuf);
+
+  shape->fill(b->src);
+  ssize_t n = pn_data_encode(b->src, b->buf, BUFFER_SIZE);
+  assert(n > 0);
+  b->size = (size_t)n;
+
+  pn_message_set_address(b->msg, "examples");
+  pn_data_t *part = shape->properties ? pn_message_properties(b->msg) : pn_message_body(b->msg);
+  pn_data_copy(part, b->src);
+  if (shape->properties) {
+    pn_data_put_string(pn_message_body(b->msg), pn_bytes(5, "hello"));
+  }
+  b->msize = BUFFER_SIZE;
+  int err = pn_message_encode(b->msg, b->mbuf, &b->msize);
+  assert(!err);
+}
+
+static void bench_free(bench_t *b) {
+  pn_data_free(b->src);
+  pn_data_free(b->dst);
+  pn_message_free(b->msg);
+  pn_message_free(b->msg2);
+  free(b->buf);
+  free(b->mbuf);
+}
+
+/* Double the iterations until a run takes at least target_ns */
+static void measure(bench_t *b, const op_t *op, double target_ns) {
+  op->run(b);                   /* Warm up, and let buffers grow to size */
+  size_t n = 1;
+  double elapsed;
+  size_t allocated;
+  for (;;) {
+    size_t a = allocs;
+    double start = now_ns();
+    for (size_t i = 0; i < n; ++i) {
+      op->run(b);
+    }
+    elapsed = now_ns() - start;
+    allocated = allocs - a;
+    if (elapsed >= target_ns || n >= ((size_t)1 << 30)) break;
+    n *= 2;
+  }
+#ifdef COUNT_ALLOCS
+  printf("%-12s %-18s %12.1f ns/op %8.2f allocs/op %10zu iterations\n",
+         b->shape->name, op->name, elapsed / n, (double)allocated / n, n);
+#else
+  (void)allocated;
+  printf("%-12s %-18s %12.1f ns/op %10zu iterations\n",
+         b->shape->name, op->name, elapsed / n, n);
+#endif
+}
+
+int main(int argc, char **argv) {
+  double target_ms = 200;
+  int first = 1;
+  if (argc > 2 && !strcmp(argv[1], "-t")) {
+    target_ms = atof(argv[2]);
+    first = 3;
+  }
+  for (int i = 0; i < PROPERTIES; ++i) {
+    snprintf(keys[i], sizeof(keys[i]), "property-%02d", i);
+  }
+  for (size_t i = 0; i < sizeof(blob); ++i) {
+    blob[i] = (char)i;
+  }
+
+  for (size_t s = 0; s < ARRAYLEN(shapes); ++s) {
+    bool selected = first >= argc;
+    for (int i = first; i < argc; ++i) {
+      selected = selected || !strcmp(argv[i], shapes[s].name);
+    }
+    if (!selected) continue;
+    bench_t b;
+    bench_init(&b, &shapes[s]);
+    printf("%-12s %zu bytes encoded, %zu bytes as a message\n", shapes[s].name, b.size, b.msize);
+    for (size_t o = 0; o < ARRAYLEN(ops); ++o) {
+      measure(&b, &ops[o], target_ms * 1e6);
+    }
+    bench_free(&b);
+  }
+  return 0;
+}
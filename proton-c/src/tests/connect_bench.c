@@ -0,0 +1,145 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Connection churn benchmark: create two pn_connection_driver_t connected
+ * in memory, open and close the connection between them and free them,
+ * measuring the cost of short-lived connections without sockets.
+ *
+ * Usage: c-connect-bench [-n cycles]
+ *
+ * Prints ns/cycle and, with glibc, allocations/cycle (malloc, calloc and
+ * realloc calls made by the benchmark and the proton library) for the
+ * whole cycle and for creating the drivers alone.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "test_handler.h"
+#include <proton/connection.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Count allocations by interposing the glibc allocator */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void*, size_t);
+extern void __libc_free(void*);
+
+static size_t allocs = 0;
+
+/* Visible to the library despite -fvisibility=hidden */
+#define EXPORT __attribute__((visibility("default")))
+
+EXPORT void *malloc(size_t size) { ++allocs; return __libc_malloc(size); }
+EXPORT void *calloc(size_t n, size_t size) { ++allocs; return __libc_calloc(n, size); }
+EXPORT void *realloc(void *p, size_t size) { ++allocs; return __libc_realloc(p, size); }
+EXPORT void free(void *p) { __libc_free(p); }
+#else
+static size_t allocs = 0;      /* Not counted */
+#endif
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart * 1e9 / (double)f.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+#endif
+}
+
+/* Answer the peer's open and close, stop when the transport closes */
+static pn_event_type_t handler(test_handler_t *th, pn_event_t *e) {
+  test_handler_keep(th, 0);
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(pn_event_connection(e));
+    break;
+   case PN_CONNECTION_REMOTE_CLOSE:
+    pn_connection_close(pn_event_connection(e));
+    break;
+   default:
+    break;
+  }
+  return PN_EVENT_NONE;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n cycles]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  size_t count = 100000;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc || argv[i][0] != '-') usage(argv[0]);
+    switch (argv[i][1]) {
+     case 'n': count = strtoul(argv[i+1], NULL, 0); break;
+     default: usage(argv[0]);
+    }
+  }
+  if (!count) usage(argv[0]);
+
+  test_t t = { "connect_bench", 0 };
+  size_t setup_allocs = 0, cycle_allocs = 0;
+  double start = now_ns();
+  for (size_t i = 0; i < count; ++i) {
+    size_t a = allocs;
+    test_connection_driver_t client, server;
+    test_connection_driver_init(&client, &t, handler, NULL, NULL);
+    test_connection_driver_init(&server, &t, handler, NULL, NULL);
+    pn_transport_set_server(server.driver.transport);
+    setup_allocs += allocs - a;
+
+    pn_connection_open(client.driver.connection);
+    test_connection_drivers_run(&client, &server);
+    TEST_ASSERT(pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE);
+    pn_connection_close(client.driver.connection);
+    test_connection_drivers_run(&client, &server);
+    TEST_ASSERT(pn_connection_state(client.driver.connection) & PN_REMOTE_CLOSED);
+
+    test_connection_driver_destroy(&client);
+    test_connection_driver_destroy(&server);
+    cycle_allocs += allocs - a;
+  }
+  double elapsed = now_ns() - start;
+
+#ifdef COUNT_ALLOCS
+  printf("%zu cycles: %.1f ns/cycle %.1f allocs/cycle (%.1f allocs creating the drivers)\n",
+         count, elapsed / count, (double)cycle_allocs / count, (double)setup_allocs / count);
+#else
+  printf("%zu cycles: %.1f ns/cycle\n", count, elapsed / count);
+#endif
+  return t.errors;
+}
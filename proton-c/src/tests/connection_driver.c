@@ -18,14 +18,19 @@
  */
 
 
+#include "test_config.h"
 #include "test_handler.h"
 #include <proton/codec.h>
 #include <proton/connection_driver.h>
 #include <proton/connection.h>
 #include <proton/delivery.h>
 #include <proton/message.h>
+#include <proton/sasl.h>
 #include <proton/session.h>
 #include <proton/link.h>
+#include <proton/ssl.h>
+
+#include <time.h>
 
 struct context {
   pn_link_t *link;
@@ -138,6 +143,265 @@ static void test_message_transfer(test_t *t) {
   test_connection_driver_destroy(&server);
 }
 
+/* Transfer client output to the server with pn_connection_driver_read_external(),
+   in small chunks that split frames, from a scratch buffer that is clobbered
+   after every call.
+*/
+static size_t xfer_external(test_connection_driver_t *dst, test_connection_driver_t *src) {
+  char scratch[7];
+  size_t total = 0;
+  pn_bytes_t wb = pn_connection_driver_write_buffer(&src->driver);
+  while (total < wb.size) {
+    size_t n = wb.size - total < sizeof(scratch) ? wb.size - total : sizeof(scratch);
+    memcpy(scratch, wb.start + total, n);
+    size_t taken = pn_connection_driver_read_external(&dst->driver, scratch, n);
+    memset(scratch, 0xff, sizeof(scratch));
+    if (!taken) break;
+    total += taken;
+  }
+  if (total) pn_connection_driver_write_done(&src->driver, total);
+  return total;
+}
+
+static void drivers_run_external(test_connection_driver_t *client, test_connection_driver_t *server) {
+  size_t data = 0;
+  do {
+    test_connection_driver_handle(client);
+    test_connection_driver_handle(server);
+    data = xfer_external(server, client) + test_connection_drivers_xfer(client, server);
+  } while (data || pn_connection_driver_has_event(&client->driver) ||
+           pn_connection_driver_has_event(&server->driver));
+}
+
+/* Message transfer with the receiver reading directly from caller memory */
+static void test_read_external(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  drivers_run_external(&client, &server);
+  TEST_CHECK(t, pn_connection_state(server.driver.connection) & PN_REMOTE_ACTIVE);
+  TEST_ASSERT(server_ctx.link);
+  pn_link_flow(server_ctx.link, 1);
+  drivers_run_external(&client, &server);
+
+  /* Larger than the chunk size so the transfer frame is split many times */
+  char body[1000];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)('a' + i % 26);
+  pn_message_t *m = pn_message();
+  pn_data_put_binary(pn_message_body(m), pn_bytes(sizeof(body), body));
+  pn_rwbytes_t buf = { 0 };
+  ssize_t size = message_encode(m, &buf);
+  pn_message_free(m);
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, size == pn_link_send(snd, buf.start, size));
+  TEST_CHECK(t, pn_link_advance(snd));
+  drivers_run_external(&client, &server);
+
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  TEST_CHECK(t, !pn_delivery_partial(dlv));
+  pn_message_t *m2 = pn_message();
+  pn_rwbytes_t buf2 = { 0 };
+  message_decode(m2, dlv, &buf2);
+  pn_data_t *data = pn_message_body(m2);
+  pn_data_rewind(data);
+  TEST_CHECK(t, pn_data_next(data));
+  pn_bytes_t got = pn_data_get_binary(data);
+  TEST_CHECK(t, got.size == sizeof(body) && !memcmp(got.start, body, sizeof(body)));
+  pn_message_free(m2);
+
+  /* Nothing is taken once the read side is closed */
+  pn_connection_driver_read_close(&server.driver);
+  TEST_CHECK(t, 0 == pn_connection_driver_read_external(&server.driver, "xxxx", 4));
+
+  free(buf.start);
+  free(buf2.start);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Transfer client output to the server from pn_connection_driver_write_iovec()
+   segments, consuming an odd amount each time so writes end part way
+   through segments.  Count the most segments seen at once in max_segments.
+*/
+static size_t xfer_iovec(test_connection_driver_t *dst, test_connection_driver_t *src, size_t *max_segments) {
+  pn_bytes_t segments[4];
+  size_t total = 0;
+  size_t count;
+  while ((count = pn_connection_driver_write_iovec(&src->driver, segments, 4))) {
+    if (count > *max_segments) *max_segments = count;
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i) {
+      pn_rwbytes_t rb = pn_connection_driver_read_buffer(&dst->driver);
+      size_t n = rb.size < segments[i].size ? rb.size : segments[i].size;
+      if (i == count - 1 && n > 1000) n -= 999; /* Leave some behind */
+      memcpy(rb.start, segments[i].start, n);
+      pn_connection_driver_read_done(&dst->driver, n);
+      written += n;
+      if (n < segments[i].size) break;
+    }
+    pn_connection_driver_write_iovec_done(&src->driver, written);
+    total += written;
+    if (!written) break;
+  }
+  return total;
+}
+
+/* Message transfer with the sender using gather writes */
+static void test_write_iovec(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, 4096); /* Several frames per chunk */
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(server_ctx.link);
+  pn_link_flow(server_ctx.link, 1);
+  test_connection_drivers_run(&client, &server);
+
+  /* Spans several 16KB output chunks */
+  size_t size = 48 * 1024;
+  char *body = (char*)malloc(size);
+  for (size_t i = 0; i < size; ++i) body[i] = (char)('a' + i % 26);
+  pn_message_t *m = pn_message();
+  pn_data_put_binary(pn_message_body(m), pn_bytes(size, body));
+  pn_rwbytes_t buf = { 0 };
+  ssize_t esize = message_encode(m, &buf);
+  pn_message_free(m);
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, esize == pn_link_send(snd, buf.start, esize));
+  TEST_CHECK(t, pn_link_advance(snd));
+
+  size_t max_segments = 0, data;
+  do {
+    test_connection_driver_handle(&client);
+    test_connection_driver_handle(&server);
+    data = xfer_iovec(&server, &client, &max_segments) + test_connection_drivers_xfer(&client, &server);
+  } while (data);
+  TEST_CHECKF(t, max_segments > 1, "max_segments=%zu", max_segments);
+
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  TEST_CHECK(t, !pn_delivery_partial(dlv));
+  pn_message_t *m2 = pn_message();
+  pn_rwbytes_t buf2 = { 0 };
+  message_decode(m2, dlv, &buf2);
+  pn_data_t *data_body = pn_message_body(m2);
+  pn_data_rewind(data_body);
+  TEST_CHECK(t, pn_data_next(data_body));
+  pn_bytes_t got = pn_data_get_binary(data_body);
+  TEST_CHECK(t, got.size == size && !memcmp(got.start, body, size));
+  pn_message_free(m2);
+
+  /* Nothing to write once the write side is closed */
+  pn_connection_driver_write_close(&client.driver);
+  pn_bytes_t seg;
+  TEST_CHECK(t, 0 == pn_connection_driver_write_iovec(&client.driver, &seg, 1));
+
+  free(body);
+  free(buf.start);
+  free(buf2.start);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+struct stream_context {
+  pn_link_t *link;
+  pn_rwbytes_t data;
+  size_t offset;
+  size_t max_pending;
+};
+
+/* Send from data whenever the sender wants more, advance at the end */
+static pn_event_type_t stream_send_handler(test_handler_t *th, pn_event_t *e) {
+  struct stream_context *ctx = (struct stream_context*) th->context;
+  test_handler_keep(th, 0);
+  if (pn_event_type(e) == PN_LINK_FLOW && pn_event_link(e) == ctx->link && ctx->offset < ctx->data.size) {
+    size_t n = pn_link_send_wanted(ctx->link);
+    if (n > ctx->data.size - ctx->offset) n = ctx->data.size - ctx->offset;
+    pn_link_send(ctx->link, ctx->data.start + ctx->offset, n);
+    ctx->offset += n;
+    size_t pending = pn_delivery_pending(pn_link_current(ctx->link));
+    if (pending > ctx->max_pending) ctx->max_pending = pending;
+    if (ctx->offset == ctx->data.size) pn_link_advance(ctx->link);
+  }
+  return PN_EVENT_NONE;
+}
+
+/* Receive into data as it arrives */
+static pn_event_type_t stream_recv_handler(test_handler_t *th, pn_event_t *e) {
+  struct stream_context *ctx = (struct stream_context*) th->context;
+  test_handler_keep(th, 0);
+  if (pn_event_type(e) == PN_DELIVERY) {
+    pn_delivery_t *d = pn_event_delivery(e);
+    size_t n = pn_delivery_pending(d);
+    if (n > ctx->max_pending) ctx->max_pending = n;
+    rwbytes_ensure(&ctx->data, ctx->offset + n);
+    ctx->offset += pn_link_recv(pn_delivery_link(d), ctx->data.start + ctx->offset, n);
+    return PN_EVENT_NONE;
+  }
+  if (pn_event_type(e) == PN_LINK_REMOTE_OPEN) ctx->link = pn_event_link(e);
+  return open_handler(th, e);
+}
+
+/* Stream a large delivery with the sender pulling data as framing needs it */
+static void test_message_stream_wanted(test_t *t) {
+  const size_t size = 1024*1024, frame = 4096;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, stream_send_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, stream_recv_handler, NULL, NULL);
+  struct stream_context send_ctx = { 0 }, recv_ctx = { 0 };
+  client.handler.context = &send_ctx;
+  server.handler.context = &recv_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, frame);
+
+  rwbytes_ensure(&send_ctx.data, size);
+  send_ctx.data.size = size;
+  for (size_t i = 0; i < size; ++i) send_ctx.data.start[i] = (char)(i * 31 + i / 4096);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  send_ctx.link = pn_sender(ssn, "x");
+  pn_link_open(send_ctx.link);
+  TEST_CHECK(t, 0 == pn_link_send_wanted(send_ctx.link)); /* No current delivery */
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(recv_ctx.link);
+  pn_delivery(send_ctx.link, pn_dtag("x", 1));
+  TEST_CHECK(t, pn_link_send_wanted(send_ctx.link) > 0);
+  pn_link_flow(recv_ctx.link, 1);
+  while (test_connection_drivers_run(&client, &server))
+    ;
+
+  TEST_CHECK(t, size == send_ctx.offset);
+  TEST_CHECK(t, size == recv_ctx.offset);
+  TEST_CHECK(t, !memcmp(send_ctx.data.start, recv_ctx.data.start, size));
+  TEST_CHECKF(t, send_ctx.max_pending <= 4 * frame, "max pending %zu", send_ctx.max_pending);
+
+  free(send_ctx.data.start);
+  free(recv_ctx.data.start);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
 /* Send a message in pieces, ensure each can be received before the next is sent */
 static void test_message_stream(test_t *t) {
   /* Set up the link, give credit, start the delivery */
@@ -200,9 +464,1940 @@ static void test_message_stream(test_t *t) {
   test_connection_driver_destroy(&server);
 }
 
+/* Send a message larger than the peer's max-frame, it must arrive split over several frames */
+static void test_message_multiframe(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, 512);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_CHECK(t, rcv);
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+
+  char body[4096];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)i;
+  uint64_t frames = pn_transport_get_frames_output(client.driver.transport);
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send(snd, body, sizeof(body)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_transport_get_frames_output(client.driver.transport) - frames >= sizeof(body)/512);
+
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  TEST_CHECK(t, !pn_delivery_partial(dlv));
+  char received[sizeof(body)];
+  TEST_CHECK(t, sizeof(body) == pn_delivery_pending(dlv));
+  pn_bytes_t view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, sizeof(body) == view.size && !memcmp(body, view.start, view.size));
+  TEST_CHECK(t, 1024 == pn_link_recv(rcv, NULL, 1024));
+  TEST_CHECK(t, sizeof(body) - 1024 == pn_delivery_pending(dlv));
+  TEST_CHECK(t, sizeof(body) - 1024 == pn_link_recv(rcv, received, sizeof(received)));
+  TEST_CHECK(t, !memcmp(body + 1024, received, sizeof(body) - 1024));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Frame records summarise each frame and keep only the most recent */
+static void test_frame_records(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, 0 == pn_transport_record_frames(client.driver.transport, 4));
+  TEST_CHECK(t, 0 == pn_transport_record_frames(server.driver.transport, 64));
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+
+  /* The server read open, begin, attach then wrote them back and a flow */
+  pn_frame_record_t r[64];
+  size_t n = pn_transport_frame_records(server.driver.transport, 0, r, 64);
+  TEST_CHECK(t, n >= 7);
+  const uint8_t in[] = {0x10, 0x11, 0x12};
+  for (size_t i = 0; i < 3 && i < n; ++i) {
+    TEST_CHECKF(t, r[i].sequence == i && !r[i].outgoing && r[i].performative == in[i] && r[i].type == 0,
+                "record %zu: seq %d out %d perf 0x%x", i, (int)r[i].sequence, r[i].outgoing, r[i].performative);
+  }
+  TEST_CHECK(t, r[n-1].outgoing && r[n-1].performative == 0x13);
+  TEST_CHECK(t, r[0].channel == 0 && r[0].time > 0);
+  TEST_CHECK(t, 1 == pn_transport_frame_records(server.driver.transport, n-1, r, 64));
+
+  /* A transfer records its payload, the client's small ring has wrapped */
+  char body[100] = {0};
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send(snd, body, sizeof(body)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  n = pn_transport_frame_records(client.driver.transport, 0, r, 64);
+  TEST_CHECK(t, n == 4);
+  TEST_CHECK(t, r[0].sequence > 0 && r[3].sequence == r[0].sequence + 3);
+  size_t i = 0;
+  while (i < n && !(r[i].outgoing && r[i].performative == 0x14)) ++i;
+  TEST_ASSERT(i < n);
+  TEST_CHECK(t, r[i].payload == sizeof(body) && r[i].size > sizeof(body));
+  TEST_CHECK(t, 2 == pn_transport_frame_records(client.driver.transport, 0, r, 2));
+
+  TEST_CHECK(t, 0 == pn_transport_record_frames(client.driver.transport, 0));
+  TEST_CHECK(t, 0 == pn_transport_frame_records(client.driver.transport, 0, r, 64));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+struct capture {
+  size_t in, out, bytes;
+  bool sizes_ok, released;
+};
+
+static void count_frames(pn_transport_t *transport, void *context, bool outgoing,
+                         const char *frame, size_t size) {
+  struct capture *c = (struct capture*)context;
+  if (!frame) {
+    c->released = true;
+    return;
+  }
+  uint32_t header = ((uint32_t)(uint8_t)frame[0] << 24) | ((uint32_t)(uint8_t)frame[1] << 16) |
+    ((uint32_t)(uint8_t)frame[2] << 8) | (uint8_t)frame[3];
+  if (header != size) c->sizes_ok = false;
+  if (outgoing) ++c->out; else ++c->in;
+  c->bytes += size;
+}
+
+/* Every whole frame is passed to the capture */
+static void test_frame_capture(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  struct capture c = { 0, 0, 0, true, false };
+  pn_transport_set_frame_capture(server.driver.transport, count_frames, &c);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(server_ctx.link);
+  pn_link_flow(server_ctx.link, 1);
+  test_connection_drivers_run(&client, &server);
+  char body[100] = {0};
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send(snd, body, sizeof(body)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+
+  /* open, begin, attach, transfer read; open, begin, attach, flow written */
+  TEST_CHECKF(t, c.in == 4, "in=%zu", c.in);
+  TEST_CHECKF(t, c.out == 4, "out=%zu", c.out);
+  TEST_CHECK(t, c.sizes_ok);
+  /* Everything but the two 8 byte protocol headers is a captured frame */
+  pn_transport_stats_t stats;
+  pn_transport_stats(server.driver.transport, &stats);
+  TEST_CHECKF(t, c.bytes + 16 == stats.bytes_input + stats.bytes_output, "captured %zu of %d",
+              c.bytes, (int)(stats.bytes_input + stats.bytes_output));
+  TEST_CHECK(t, !c.released);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  TEST_CHECK(t, c.released);
+}
+
+/* Transport and link counters */
+static void test_stats(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+
+  /* Two deliveries queued before there is any credit */
+  char body[100] = {0};
+  for (int i = 0; i < 2; ++i) {
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    TEST_CHECK(t, sizeof(body) == pn_link_send(snd, body, sizeof(body)));
+    TEST_CHECK(t, pn_link_advance(snd));
+  }
+  test_connection_drivers_run(&client, &server);
+  pn_link_flow(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+
+  pn_transport_stats_t cs, ss;
+  pn_transport_stats(client.driver.transport, &cs);
+  pn_transport_stats(server.driver.transport, &ss);
+  TEST_CHECK(t, cs.frames_output == pn_transport_get_frames_output(client.driver.transport));
+  TEST_CHECK(t, cs.bytes_output == ss.bytes_input);
+  for (int i = 0; i < 3; ++i) { /* open, begin, attach */
+    TEST_CHECKF(t, cs.performative_frames_output[i] == 1, "0x%x out %d", 0x10 + i, (int)cs.performative_frames_output[i]);
+    TEST_CHECKF(t, ss.performative_frames_input[i] == 1, "0x%x in %d", 0x10 + i, (int)ss.performative_frames_input[i]);
+  }
+  TEST_CHECK(t, cs.performative_frames_output[4] == 2 && ss.performative_frames_input[4] == 2);
+  TEST_CHECK(t, cs.performative_bytes_output[4] > 2 * sizeof(body));
+  TEST_CHECK(t, cs.performative_bytes_output[4] == ss.performative_bytes_input[4]);
+  TEST_CHECK(t, ss.performative_frames_output[3] >= 1 && cs.performative_frames_input[3] >= 1);
+  TEST_CHECK(t, cs.deliveries_output == 2 && ss.deliveries_input == 2);
+  TEST_CHECK(t, cs.deliveries_input == 0 && ss.deliveries_output == 0);
+  uint64_t sum = 0;
+  for (int i = 0; i < PN_PERFORMATIVES; ++i) sum += cs.performative_bytes_output[i];
+  TEST_CHECK(t, sum <= cs.bytes_output);
+
+  pn_link_stats_t ls;
+  pn_link_stats(snd, &ls);
+  TEST_CHECK(t, ls.deliveries == 2 && ls.settled == 0 && ls.unsettled_max == 2);
+  pn_delivery_settle(pn_unsettled_head(snd));
+  pn_link_stats(snd, &ls);
+  TEST_CHECK(t, ls.settled == 1);
+  pn_link_stats(rcv, &ls);
+  TEST_CHECK(t, ls.deliveries == 2 && ls.credit_blocked == 0 && ls.window_blocked == 0);
+
+  pn_transport_stats(NULL, &cs);
+  TEST_CHECK(t, cs.frames_output == 0 && cs.performative_frames_output[4] == 0);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Shared bytes are framed in place and the owner released once they are sent */
+static void test_send_shared(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, 512);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+
+  char body[2048];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)i;
+  pn_string_t *owner = pn_string(NULL);
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send_shared(snd, body, sizeof(body), owner));
+  TEST_CHECK(t, 2 == pn_refcount(owner));
+  TEST_CHECK(t, sizeof(body) == pn_delivery_pending(pn_link_current(snd)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 1 == pn_refcount(owner));
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  pn_bytes_t view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, sizeof(body) == view.size && !memcmp(body, view.start, view.size));
+  pn_delivery_settle(dlv);
+
+  /* Appending to shared bytes copies them, the owner is released at once */
+  pn_delivery(snd, pn_dtag("y", 1));
+  TEST_CHECK(t, 4 == pn_link_send_shared(snd, "abcd", 4, owner));
+  TEST_CHECK(t, 2 == pn_refcount(owner));
+  TEST_CHECK(t, 2 == pn_link_send(snd, "ef", 2));
+  TEST_CHECK(t, 1 == pn_refcount(owner));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  dlv = server_ctx.delivery;
+  view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, 6 == view.size && !memcmp("abcdef", view.start, view.size));
+
+  pn_free(owner);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+static void count_release(void *context) { ++*(int*)context; }
+
+/* A caller's buffer is framed in place and released exactly once */
+static void test_send_buffer(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+
+  int released = 0;
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, 5 == pn_link_send_buffer(snd, "hello", 5, count_release, &released));
+  TEST_CHECK(t, 0 == released);
+  TEST_CHECK(t, 5 == pn_delivery_pending(pn_link_current(snd)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 1 == released);
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  pn_bytes_t view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, 5 == view.size && !memcmp("hello", view.start, view.size));
+  pn_delivery_settle(dlv);
+
+  /* Appending to a pending buffer copies both */
+  pn_delivery(snd, pn_dtag("y", 1));
+  TEST_CHECK(t, 2 == pn_link_send_buffer(snd, "ab", 2, count_release, &released));
+  TEST_CHECK(t, 1 == pn_link_send_buffer(snd, "c", 1, count_release, &released));
+  TEST_CHECK(t, 3 == released);
+  TEST_CHECK(t, pn_link_advance(snd));
+  test_connection_drivers_run(&client, &server);
+  view = pn_delivery_bytes(server_ctx.delivery);
+  TEST_CHECK(t, 3 == view.size && !memcmp("abc", view.start, view.size));
+
+  /* No current delivery, released straight away */
+  TEST_CHECK(t, PN_EOS == pn_link_send_buffer(snd, "x", 1, count_release, &released));
+  TEST_CHECK(t, 4 == released);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Pre-settled sends with credit are framed without a delivery */
+static void test_send_settled(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_set_snd_settle_mode(snd, PN_SND_SETTLED);
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+
+  TEST_CHECK(t, 5 == pn_link_send_settled(snd, "hello", 5));
+  TEST_CHECK(t, !pn_link_current(snd) && 0 == pn_link_unsettled(snd) && 0 == pn_link_queued(snd));
+  TEST_CHECK(t, 1 == pn_link_credit(snd));
+  test_connection_drivers_run(&client, &server);
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  pn_bytes_t view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, 5 == view.size && !memcmp("hello", view.start, view.size));
+  TEST_CHECK(t, pn_delivery_settled(dlv) && !pn_delivery_partial(dlv));
+
+  /* Without credit the message is queued as a settled delivery */
+  TEST_CHECK(t, 1 == pn_link_send_settled(snd, "a", 1));
+  TEST_CHECK(t, 1 == pn_link_send_settled(snd, "b", 1));
+  TEST_CHECK(t, 1 == pn_link_queued(snd));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 1 == pn_delivery_bytes(server_ctx.delivery).size && 'a' == *pn_delivery_bytes(server_ctx.delivery).start);
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 'b' == *pn_delivery_bytes(server_ctx.delivery).start);
+  TEST_CHECK(t, 0 == pn_link_queued(snd) && 0 == pn_link_unsettled(snd));
+  pn_link_stats_t stats;
+  pn_link_stats(snd, &stats);
+  TEST_CHECK(t, 3 == stats.deliveries && 3 == stats.settled);
+
+  /* Between unsettled deliveries the window passes over the settled id */
+  snd = pn_sender(ssn, "y");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  rcv = server_ctx.link;
+  pn_link_flow(rcv, 3);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery_t *d1 = pn_delivery(snd, pn_dtag("1", 1));
+  pn_link_send(snd, "1", 1);
+  pn_link_advance(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery_t *r1 = server_ctx.delivery;
+  TEST_CHECK(t, 1 == pn_link_send_settled(snd, "2", 1));
+  pn_delivery_t *d3 = pn_delivery(snd, pn_dtag("3", 1));
+  pn_link_send(snd, "3", 1);
+  pn_link_advance(snd);
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  pn_delivery_t *r3 = server_ctx.delivery;
+  TEST_CHECK(t, r3 != r1 && '3' == *pn_delivery_bytes(r3).start);
+  pn_delivery_update(r3, PN_ACCEPTED);
+  pn_delivery_settle(r3);
+  pn_delivery_update(r1, PN_ACCEPTED);
+  pn_delivery_settle(r1);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, PN_ACCEPTED == pn_delivery_remote_state(d1) && PN_ACCEPTED == pn_delivery_remote_state(d3));
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+static void quiet_tracer(pn_transport_t *transport, const char *message) {}
+
+/* The message format goes out on the first transfer and is kept by the
+   receiving delivery, whether the transfer is decoded directly or traced */
+/* Read what a receiver has, in order, checking it continues from *next */
+static int recv_in_order(test_t *t, pn_link_t *rcv, int *next) {
+  int n = 0;
+  pn_delivery_t *d;
+  while ((d = pn_link_current(rcv)) && !pn_delivery_partial(d)) {
+    char buf[16] = { 0 };
+    pn_link_recv(rcv, buf, sizeof(buf) - 1);
+    TEST_CHECKF(t, atoi(buf) == *next, "got %s, want %d", buf, *next);
+    ++*next;
+    ++n;
+    pn_link_advance(rcv);
+    pn_delivery_settle(d);
+  }
+  return n;
+}
+
+/* Deliveries waiting for credit do not hold up other links, and go in order once it comes */
+static void test_credit_wait(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *x = pn_sender(ssn, "x");
+  pn_link_open(x);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rx = server_ctx.link;
+  pn_link_t *y = pn_sender(ssn, "y");
+  pn_link_open(y);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *ry = server_ctx.link;
+  TEST_ASSERT(rx && ry && rx != ry);
+
+  enum { N = 200 };
+  for (int i = 0; i < N; ++i) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", i);
+    pn_delivery(x, pn_dtag(buf, len));
+    pn_link_send(x, buf, len);
+    pn_link_advance(x);
+  }
+  test_connection_drivers_run(&client, &server);
+  int next = 0;
+  TEST_CHECK(t, 0 == recv_in_order(t, rx, &next));
+
+  pn_link_flow(ry, 1);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery(y, pn_dtag("y", 1));
+  pn_link_send(y, "0", 1);
+  pn_link_advance(y);
+  test_connection_drivers_run(&client, &server);
+  int ynext = 0;
+  TEST_CHECK(t, 1 == recv_in_order(t, ry, &ynext));
+
+  /* More work for the waiting link before its credit arrives */
+  for (int i = N; i < N + 10; ++i) {
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", i);
+    pn_delivery(x, pn_dtag(buf, len));
+    pn_link_send(x, buf, len);
+    pn_link_advance(x);
+  }
+  pn_link_flow(rx, 50);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 50 == recv_in_order(t, rx, &next));
+  pn_link_flow(rx, N + 10 - 50);
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  TEST_CHECK(t, N + 10 - 50 == recv_in_order(t, rx, &next));
+  TEST_CHECK(t, 0 == pn_link_queued(x));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+static void test_message_format(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 3);
+  test_connection_drivers_run(&client, &server);
+
+  for (int i = 0; i < 3; ++i) {
+    if (i == 2) {
+      pn_transport_set_tracer(server.driver.transport, quiet_tracer);
+      pn_transport_trace(server.driver.transport, PN_TRACE_FRM);
+    }
+    pn_delivery_t *d = pn_delivery(snd, pn_dtag("x", 1));
+    TEST_CHECK(t, 0 == pn_delivery_message_format(d));
+    if (i) pn_delivery_set_message_format(d, 0x00abcd01);
+    pn_link_send(snd, "a", 1);
+    pn_link_advance(snd);
+    while (test_connection_drivers_run(&client, &server))
+      ;
+    pn_delivery_t *r = server_ctx.delivery;
+    TEST_ASSERT(r);
+    TEST_CHECK(t, (i ? 0x00abcd01u : 0) == pn_delivery_message_format(r));
+    TEST_CHECK(t, 1 == pn_delivery_pending(r));
+    pn_delivery_settle(r);
+    server_ctx.delivery = NULL;
+  }
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Tags from pn_delivery_auto are short and unique, tags over the AMQP limit still arrive whole */
+static void test_delivery_tag(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 3);
+  test_connection_drivers_run(&client, &server);
+
+  char long_tag[40];
+  memset(long_tag, 'l', sizeof(long_tag));
+  pn_delivery_tag_t tags[] = { pn_dtag("\x01", 1), pn_dtag(long_tag, sizeof(long_tag)), pn_dtag("\x02", 1) };
+  for (int i = 0; i < 3; ++i) {
+    pn_delivery_t *d = (i == 1) ? pn_delivery(snd, tags[i]) : pn_delivery_auto(snd);
+    pn_link_send(snd, "a", 1);
+    pn_link_advance(snd);
+    while (test_connection_drivers_run(&client, &server))
+      ;
+    pn_delivery_t *r = server_ctx.delivery;
+    TEST_ASSERT(r);
+    pn_delivery_tag_t tag = pn_delivery_tag(r);
+    TEST_CHECK(t, tag.size == tags[i].size && !memcmp(tag.start, tags[i].start, tag.size));
+    tag = pn_delivery_tag(d);
+    TEST_CHECK(t, tag.size == tags[i].size && !memcmp(tag.start, tags[i].start, tag.size));
+    pn_delivery_settle(r);
+    pn_delivery_settle(d);
+    server_ctx.delivery = NULL;
+  }
+  /* The serial carries into a second byte */
+  for (int i = 3; i < 256; ++i)
+    pn_delivery_settle(pn_delivery_auto(snd));
+  pn_delivery_t *d = pn_delivery_auto(snd);
+  pn_delivery_tag_t tag = pn_delivery_tag(d);
+  TEST_CHECK(t, tag.size == 2 && tag.start[0] == 0 && tag.start[1] == 1);
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Pass src's frames to dst, with attach in place of any ATTACH */
+static size_t xfer_attach(test_connection_driver_t *dst, test_connection_driver_t *src, pn_bytes_t attach) {
+  pn_bytes_t wb = pn_connection_driver_write_buffer(&src->driver);
+  size_t done = 0;
+  while (done + 8 <= wb.size) {
+    const unsigned char *p = (const unsigned char*)wb.start + done;
+    size_t size = memcmp(p, "AMQP", 4) ? (size_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3] : 8;
+    pn_bytes_t frame = pn_bytes(size, (const char*)p);
+    if (size > 8 && p[5] == 0) {
+      pn_data_t *data = pn_data(0);
+      pn_data_decode(data, frame.start + 4 * p[4], size - 4 * p[4]);
+      pn_data_rewind(data);
+      if (pn_data_next(data) && pn_data_enter(data) && pn_data_next(data) &&
+          pn_data_get_ulong(data) == 0x12)
+        frame = attach;
+      pn_data_free(data);
+    }
+    pn_rwbytes_t rb = pn_connection_driver_read_buffer(&dst->driver);
+    if (rb.size < frame.size) break;
+    memcpy(rb.start, frame.start, frame.size);
+    pn_connection_driver_read_done(&dst->driver, frame.size);
+    done += size;
+  }
+  if (done) pn_connection_driver_write_done(&src->driver, done);
+  return done;
+}
+
+struct resume_context {
+  struct context c;
+  char tags[8];
+  char bytes[8];
+  int n;
+};
+
+/* Record the first tag byte and payload byte, '-' for none, of each delivery */
+static pn_event_type_t resume_handler(test_handler_t *th, pn_event_t *e) {
+  struct resume_context *ctx = (struct resume_context*) th->context;
+  switch (pn_event_type(e)) {
+   case PN_LINK_REMOTE_OPEN:
+    open_handler(th, e);
+    pn_link_flow(ctx->c.link, 10);
+    break;
+   case PN_DELIVERY: {
+    pn_delivery_t *d = pn_event_delivery(e);
+    if (!pn_delivery_readable(d) || pn_delivery_partial(d) || ctx->n >= 8) break;
+    char b = '-';
+    pn_link_recv(pn_delivery_link(d), &b, 1);
+    ctx->tags[ctx->n] = pn_delivery_tag(d).start[0];
+    ctx->bytes[ctx->n++] = b;
+    pn_link_advance(pn_delivery_link(d));
+    pn_delivery_settle(d);
+    break;
+   }
+   default:
+    return open_handler(th, e);
+  }
+  return PN_EVENT_NONE;
+}
+
+/* A sender attaching again on a new transport resends only what the peer's
+   unsettled map does not settle. */
+static void test_link_resume(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(server_ctx.link);
+  pn_link_flow(server_ctx.link, 10);
+  test_connection_drivers_run(&client, &server);
+
+  pn_delivery_t *d[4];
+  for (int i = 0; i < 4; ++i) {
+    d[i] = pn_delivery_auto(snd);
+    pn_link_send(snd, "abcd" + i, 1);
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 4 == pn_link_unsettled(snd));
+  pn_delivery_settle(d[3]);
+
+  /* Lose the transport, and the peer with it */
+  pn_connection_t *c = pn_connection_driver_release_connection(&client.driver);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  test_connection_driver_init(&client, t, open_handler, c, NULL);
+  test_connection_driver_init(&server, t, resume_handler, NULL, NULL);
+  struct resume_context resume_ctx = { { 0 } };
+  server.handler.context = &resume_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  /* The peer has accepted the first and has the second with no outcome */
+  pn_data_t *data = pn_data(0);
+  pn_data_fill(data, "DL[SIonnnn{zDL[]zn}]", (uint64_t)0x12, "x", 0, true,
+               (size_t)1, "\x01", (uint64_t)PN_ACCEPTED, (size_t)1, "\x02");
+  char attach[256];
+  ssize_t n = pn_data_encode(data, attach + 8, sizeof(attach) - 8);
+  pn_data_free(data);
+  TEST_ASSERT(n > 0);
+  size_t size = 8 + n;
+  attach[0] = size >> 24; attach[1] = size >> 16; attach[2] = size >> 8; attach[3] = size;
+  attach[4] = 2; attach[5] = 0; attach[6] = 0; attach[7] = 0;
+
+  size_t moved;
+  do {
+    test_connection_driver_handle(&client);
+    test_connection_driver_handle(&server);
+    moved = xfer_attach(&client, &server, pn_bytes(size, attach)) +
+      test_connection_drivers_xfer(&server, &client);
+  } while (moved);
+  TEST_CHECK(t, PN_ACCEPTED == pn_delivery_remote_state(d[0]));
+  TEST_CHECK(t, pn_delivery_updated(d[0]));
+  TEST_CHECKF(t, 2 == resume_ctx.n, "got %d", resume_ctx.n);
+  pn_delivery_settle(d[0]);
+  test_connection_drivers_run(&client, &server);
+
+  /* Sent again in full, then the settlement of the accepted one */
+  TEST_CHECKF(t, 3 == resume_ctx.n, "got %d", resume_ctx.n);
+  TEST_CHECK(t, !memcmp("\x02\x03\x01", resume_ctx.tags, 3));
+  TEST_CHECK(t, !memcmp("bc-", resume_ctx.bytes, 3));
+  int unsettled = 0;
+  for (pn_delivery_t *u = pn_unsettled_head(snd); u; u = pn_unsettled_next(u)) ++unsettled;
+  TEST_CHECKF(t, 2 == unsettled, "got %d", unsettled);
+  TEST_COND_EMPTY(t, pn_transport_condition(client.driver.transport));
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Input stops while the receiving connection is over its memory limit */
+static void test_memory_limit(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, 4096);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 10);
+  test_connection_drivers_run(&client, &server);
+
+  pn_connection_t *c = server.driver.connection;
+  size_t base = pn_connection_memory_usage(c);
+  TEST_CHECK(t, base > 0);
+  pn_connection_set_memory_limit(c, base + 32*1024);
+  TEST_CHECK(t, base + 32*1024 == pn_connection_get_memory_limit(c));
+
+  static char body[16*1024];
+  for (int i = 0; i < 10; ++i) {
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, body, sizeof(body));
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  int queued = pn_link_queued(rcv);
+  TEST_CHECKF(t, queued < 10, "%d queued", queued);
+  TEST_CHECK(t, pn_connection_memory_usage(c) < base + 64*1024);
+
+  /* Reading and settling lets more in */
+  int received = 0;
+  for (int pass = 0; pass < 20 && received < 10; ++pass) {
+    pn_delivery_t *d;
+    while ((d = pn_link_current(rcv)) && !pn_delivery_partial(d)) {
+      TEST_CHECK(t, sizeof(body) == pn_link_recv(rcv, NULL, sizeof(body)));
+      pn_link_advance(rcv);
+      pn_delivery_settle(d);
+      ++received;
+    }
+    test_connection_drivers_run(&client, &server);
+  }
+  TEST_CHECKF(t, 10 == received, "%d received", received);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* The input buffer grows for a large frame and shrinks again after it */
+static void test_input_shrink(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 100);
+  test_connection_drivers_run(&client, &server);
+  pn_connection_t *c = server.driver.connection;
+  pn_connection_set_delivery_pool_max(c, 0); /* Count only the transport's buffers */
+  size_t base = pn_connection_memory_usage(c);
+
+  /* Unlimited max frame, the message arrives as a single frame */
+  static char body[256*1024];
+  for (int i = 0; i < 33; ++i) {
+    size_t size = i ? 100 : sizeof(body);
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, body, size);
+    pn_link_advance(snd);
+    test_connection_drivers_run(&client, &server);
+    pn_delivery_t *d = pn_link_current(rcv);
+    TEST_ASSERT(d && !pn_delivery_partial(d));
+    TEST_CHECK(t, (ssize_t)size == pn_link_recv(rcv, NULL, size));
+    pn_link_advance(rcv);
+    pn_delivery_settle(d);
+    if (!i) {
+      size_t big = pn_connection_memory_usage(c);
+      TEST_CHECKF(t, big > base + sizeof(body), "%d grown", (int)(big - base));
+    }
+  }
+  size_t after = pn_connection_memory_usage(c);
+  TEST_CHECKF(t, after < base + 32*1024, "%d over", (int)(after - base));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* An idle transport frees its buffers and gets them back when traffic resumes */
+static void test_hibernate(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 10);
+  test_connection_drivers_run(&client, &server);
+
+  pn_connection_t *c = server.driver.connection;
+  size_t before = pn_connection_memory_usage(c);
+  size_t freed = pn_transport_hibernate(server.driver.transport);
+  TEST_CHECKF(t, freed >= 2*16*1024, "%d freed", (int)freed);
+  TEST_CHECKF(t, pn_connection_memory_usage(c) < before, "%d before", (int)before);
+  TEST_CHECK(t, pn_transport_hibernate(client.driver.transport) > 0);
+  TEST_CHECK(t, 0 == pn_transport_hibernate(client.driver.transport));
+
+  for (int i = 0; i < 3; ++i) {
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    TEST_CHECK(t, 5 == pn_link_send(snd, "hello", 5));
+    pn_link_advance(snd);
+    test_connection_drivers_run(&client, &server);
+    pn_delivery_t *d = pn_link_current(rcv);
+    TEST_ASSERT(d && !pn_delivery_partial(d));
+    char buf[5];
+    TEST_CHECK(t, 5 == pn_link_recv(rcv, buf, sizeof(buf)));
+    TEST_CHECK(t, 0 == memcmp(buf, "hello", 5));
+    pn_link_advance(rcv);
+    pn_delivery_settle(d);
+    test_connection_drivers_run(&client, &server);
+    TEST_CHECK(t, pn_transport_hibernate(server.driver.transport) > 0);
+  }
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* A server with autodetection off speaks only the configured layer stack */
+static void test_pinned_layers(test_t *t) {
+  /* Plain AMQP */
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_autodetect(server.driver.transport, false);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE);
+  TEST_STR_EQUAL(t, "anonymous", pn_transport_get_user(server.driver.transport));
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+
+  /* SASL then AMQP */
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_autodetect(server.driver.transport, false);
+  pn_sasl_allowed_mechs(pn_sasl(client.driver.transport), "ANONYMOUS");
+  pn_sasl_allowed_mechs(pn_sasl(server.driver.transport), "ANONYMOUS");
+  pn_transport_require_auth(server.driver.transport, false);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE);
+  TEST_CHECK(t, PN_SASL_OK == pn_sasl_outcome(pn_sasl(client.driver.transport)));
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+
+  /* A client starting with SASL is refused by a plain AMQP server */
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_autodetect(server.driver.transport, false);
+  pn_sasl(client.driver.transport);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, !(pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE));
+  TEST_STR_EQUAL(t, "amqp:connection:framing-error",
+                 pn_condition_get_name(pn_transport_condition(server.driver.transport)));
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Transfers are framed only as fast as the output drains below the output limit */
+static void test_output_limit(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_max_frame(server.driver.transport, 512);
+  pn_transport_set_output_limit(client.driver.transport, 2048);
+  TEST_CHECK(t, 2048 == pn_transport_get_output_limit(client.driver.transport));
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_CHECK(t, rcv);
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+
+  static char body[64*1024];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)i;
+  uint64_t frames = pn_transport_get_frames_output(client.driver.transport);
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send(snd, body, sizeof(body)));
+  TEST_CHECK(t, pn_link_advance(snd));
+  /* Fill the write buffer without writing anything, framing stops early */
+  TEST_CHECK(t, pn_connection_driver_write_buffer(&client.driver).size < sizeof(body));
+  TEST_CHECK(t, pn_transport_get_frames_output(client.driver.transport) - frames < sizeof(body)/512/2);
+
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv);
+  TEST_CHECK(t, !pn_delivery_partial(dlv));
+  pn_bytes_t view = pn_delivery_bytes(dlv);
+  TEST_CHECK(t, sizeof(body) == view.size && !memcmp(body, view.start, view.size));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Like open_handler but stops at PN_LINK_FLOW */
+static pn_event_type_t flow_handler(test_handler_t *th, pn_event_t *e) {
+  if (pn_event_type(e) == PN_LINK_FLOW) return PN_LINK_FLOW;
+  return open_handler(th, e);
+}
+
+/* Past the output high-water mark senders are blocked despite credit, until the output drains */
+static void test_output_high_water(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, flow_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx;
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  pn_connection_set_output_high_water(client.driver.connection, 4096);
+  TEST_CHECK(t, 4096 == pn_connection_get_output_high_water(client.driver.connection));
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_CHECK(t, rcv);
+  pn_link_flow(rcv, 100);
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  TEST_CHECK(t, 100 == pn_link_credit(snd));
+
+  static char body[1024];
+  int sent = 0;
+  while (!pn_connection_output_blocked(client.driver.connection)) {
+    pn_delivery(snd, pn_dtag((char*)&sent, sizeof(sent)));
+    pn_link_send(snd, body, sizeof(body));
+    pn_link_advance(snd);
+    ++sent;
+  }
+  TEST_CHECKF(t, 4 == sent, "sent %d", sent);
+  TEST_CHECK(t, pn_connection_output_backlog(client.driver.connection) >= 4096);
+  TEST_CHECK(t, 96 == pn_link_credit(snd));
+
+  /* The client hears PN_LINK_FLOW once the backlog is written */
+  test_connection_driver_t *d;
+  while ((d = test_connection_drivers_run(&client, &server)) && d != &client)
+    ;
+  TEST_CHECK(t, d == &client);
+  TEST_CHECK(t, !pn_connection_output_blocked(client.driver.connection));
+  TEST_CHECK(t, pn_connection_output_backlog(client.driver.connection) <= 2048);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Like open_handler but keeps no event log, for tests with very many events */
+static pn_event_type_t nolog_handler(test_handler_t *th, pn_event_t *e) {
+  test_handler_keep(th, 0);
+  return open_handler(th, e);
+}
+
+/* Settle a large window of unsettled deliveries, report the disposition processing rate */
+static void test_disposition_many(test_t *t) {
+  const int n = 100000;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, n);
+  test_connection_drivers_run(&client, &server);
+
+  for (int i = 0; i < n; ++i) {
+    pn_delivery(snd, pn_dtag((const char*)&i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, n == pn_link_unsettled(snd));
+  TEST_CHECK(t, n == pn_link_unsettled(rcv));
+
+  pn_delivery_t *d = pn_unsettled_head(rcv);
+  while (d) {
+    pn_delivery_t *next = pn_unsettled_next(d);
+    pn_delivery_update(d, PN_ACCEPTED);
+    pn_delivery_settle(d);
+    d = next;
+  }
+  /* Like test_connection_drivers_run(), timing only the sender side */
+  clock_t sender_clock = 0;
+  size_t data;
+  do {
+    test_connection_driver_handle(&server);
+    pn_bytes_t wb = pn_connection_driver_write_buffer(&server.driver);
+    pn_rwbytes_t rb = pn_connection_driver_read_buffer(&client.driver);
+    data = rb.size < wb.size ? rb.size : wb.size;
+    if (data) memcpy(rb.start, wb.start, data);
+    pn_connection_driver_write_done(&server.driver, data);
+    clock_t start = clock();
+    pn_connection_driver_read_done(&client.driver, data);
+    test_connection_driver_handle(&client);
+    sender_clock += clock() - start;
+    data += test_connection_drivers_xfer(&server, &client);
+  } while (data || pn_connection_driver_has_event(&server.driver));
+  double elapsed = (double)sender_clock / CLOCKS_PER_SEC;
+
+  int accepted = 0;
+  for (d = pn_unsettled_head(snd); d; d = pn_unsettled_next(d)) {
+    if (pn_delivery_remote_state(d) == PN_ACCEPTED && pn_delivery_settled(d)) ++accepted;
+  }
+  TEST_CHECK(t, n == accepted);
+  TEST_LOGF(t, "%d dispositions in %.0f ms (%.0f/sec)", accepted, elapsed * 1000,
+            accepted / (elapsed > 0 ? elapsed : 1e-6));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Dispositions with and without data, the data is created when first used */
+static void test_disposition_data(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+
+  pn_delivery_t *sd[2];
+  for (int i = 0; i < 2; ++i) {
+    sd[i] = pn_delivery(snd, pn_dtag((const char*)&i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(2 == pn_link_unsettled(rcv));
+
+  pn_delivery_t *d = pn_unsettled_head(rcv);
+  pn_delivery_update(d, PN_ACCEPTED);
+  d = pn_unsettled_next(d);
+  pn_disposition_t *local = pn_delivery_local(d);
+  pn_disposition_set_failed(local, true);
+  pn_data_fill(pn_disposition_annotations(local), "{sS}", "key", "value");
+  pn_delivery_update(d, PN_MODIFIED);
+  test_connection_drivers_run(&client, &server);
+
+  pn_disposition_t *remote = pn_delivery_remote(sd[0]);
+  TEST_CHECK(t, PN_ACCEPTED == pn_disposition_type(remote));
+  TEST_CHECK(t, 0 == pn_data_size(pn_disposition_data(remote)));
+  TEST_CHECK(t, 0 == pn_data_size(pn_disposition_annotations(remote)));
+
+  remote = pn_delivery_remote(sd[1]);
+  TEST_CHECK(t, PN_MODIFIED == pn_disposition_type(remote));
+  TEST_CHECK(t, pn_disposition_is_failed(remote));
+  pn_data_t *annotations = pn_disposition_annotations(remote);
+  pn_data_rewind(annotations);
+  TEST_CHECK(t, pn_data_next(annotations) && PN_MAP == pn_data_type(annotations));
+  pn_data_enter(annotations);
+  TEST_CHECK(t, pn_data_next(annotations));
+  pn_bytes_t key = pn_data_get_symbol(annotations);
+  TEST_CHECK(t, key.size == 3 && !memcmp(key.start, "key", 3));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Encode a DISPOSITION frame rejecting and settling the outgoing ids [first, last] */
+static size_t disposition_frame(char *buf, size_t size, uint32_t first, uint32_t last) {
+  pn_data_t *data = pn_data(0);
+  pn_data_fill(data, "DL[oIIoDL[DL[sS]]]", (uint64_t)0x15, true, first, last, true,
+               (uint64_t)0x25, (uint64_t)0x1d, "x:range", "range rejected");
+  ssize_t n = pn_data_encode(data, buf + 8, size - 8);
+  pn_data_free(data);
+  size_t frame = 8 + n;
+  buf[0] = frame >> 24; buf[1] = frame >> 16; buf[2] = frame >> 8; buf[3] = frame;
+  buf[4] = 2; buf[5] = 0; buf[6] = 0; buf[7] = 0; /* doff, AMQP frame, channel 0 */
+  return frame;
+}
+
+/* A DISPOSITION whose range is far wider than the unsettled window */
+static void test_disposition_range(test_t *t) {
+  const int n = 10;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(server_ctx.link);
+  pn_link_flow(server_ctx.link, n);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < n; ++i) {
+    pn_delivery(snd, pn_dtag((const char*)&i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, n == pn_link_unsettled(snd));
+
+  /* Without clamping to the window this walks two billion ids */
+  char frame[256];
+  size_t size = disposition_frame(frame, sizeof(frame), 0, 0x7ffffff0);
+  pn_rwbytes_t rb = pn_connection_driver_read_buffer(&client.driver);
+  TEST_ASSERT(rb.size >= size);
+  memcpy(rb.start, frame, size);
+  pn_connection_driver_read_done(&client.driver, size);
+  test_connection_driver_handle(&client);
+
+  int rejected = 0;
+  for (pn_delivery_t *d = pn_unsettled_head(snd); d; d = pn_unsettled_next(d)) {
+    pn_condition_t *cond = pn_disposition_condition(pn_delivery_remote(d));
+    if (pn_delivery_remote_state(d) == PN_REJECTED && pn_delivery_settled(d) &&
+        !strcmp("x:range", pn_condition_get_name(cond)) &&
+        !strcmp("range rejected", pn_condition_get_description(cond)))
+      ++rejected;
+  }
+  TEST_CHECK(t, n == rejected);
+  TEST_CHECK(t, !pn_condition_is_set(pn_transport_condition(client.driver.transport)));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+static int settle_next(pn_link_t *rcv, int n) {
+  int i = 0;
+  for (pn_delivery_t *d = pn_unsettled_head(rcv); d && i < n; d = pn_unsettled_head(rcv), ++i) {
+    pn_delivery_update(d, PN_ACCEPTED);
+    pn_delivery_settle(d);
+  }
+  return i;
+}
+
+static int remote_settled(pn_link_t *snd) {
+  int n = 0;
+  for (pn_delivery_t *d = pn_unsettled_head(snd); d; d = pn_unsettled_next(d))
+    if (pn_delivery_remote_state(d) == PN_ACCEPTED && pn_delivery_settled(d)) ++n;
+  return n;
+}
+
+/* Settlements held back by the disposition delay and limit */
+static void test_disposition_delay(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_t *st = server.driver.transport;
+  pn_transport_set_server(st);
+  pn_transport_set_disposition_delay(st, 10);
+  pn_transport_set_disposition_limit(st, 4);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 20);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < 20; ++i) {
+    pn_delivery(snd, pn_dtag((const char*)&i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 20 == pn_link_unsettled(rcv));
+
+  /* Below the limit, held until the delay passes */
+  settle_next(rcv, 3);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 0 == remote_settled(snd));
+  TEST_CHECK(t, 1010 == pn_transport_tick(st, 1000));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 0 == remote_settled(snd));
+  pn_transport_tick(st, 1010);
+  uint64_t frames = pn_transport_get_frames_output(st);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 3 == remote_settled(snd));
+  TEST_CHECK(t, frames + 1 == pn_transport_get_frames_output(st));
+  TEST_CHECK(t, 0 == pn_transport_tick(st, 1020));
+
+  /* Reaching the limit sends the range at once, as one frame */
+  settle_next(rcv, 2);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 3 == remote_settled(snd));
+  settle_next(rcv, 2);
+  frames = pn_transport_get_frames_output(st);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 7 == remote_settled(snd));
+  TEST_CHECK(t, frames + 1 == pn_transport_get_frames_output(st));
+
+  /* Closing the link sends what is held before the DETACH */
+  settle_next(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 7 == remote_settled(snd));
+  pn_link_close(rcv);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 8 == remote_settled(snd));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* In interleave mode a small message goes out between the frames of a large one */
+static void test_interleave(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  pn_transport_t *ct = client.driver.transport;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_interleave(ct, true);
+  TEST_CHECK(t, pn_transport_get_interleave(ct));
+  TEST_CHECK(t, 16*1024 == pn_transport_get_max_frame(ct));
+  pn_transport_set_output_limit(ct, 32*1024);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *bulk = pn_sender(ssn, "bulk");
+  pn_link_t *small = pn_sender(ssn, "small");
+  pn_link_open(bulk);
+  pn_link_open(small);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, 16*1024 == pn_transport_get_remote_max_frame(server.driver.transport));
+  for (pn_link_t *l = pn_link_head(server.driver.connection, 0); l; l = pn_link_next(l, 0))
+    pn_link_flow(l, 1);
+  test_connection_drivers_run(&client, &server);
+
+  static char body[256*1024];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)i;
+  uint64_t frames = pn_transport_get_frames_output(ct);
+  pn_delivery(bulk, pn_dtag("b", 1));
+  TEST_CHECK(t, sizeof(body) == pn_link_send(bulk, body, sizeof(body)));
+  TEST_CHECK(t, pn_link_advance(bulk));
+  pn_delivery(small, pn_dtag("s", 1));
+  TEST_CHECK(t, 1 == pn_link_send(small, "x", 1));
+  TEST_CHECK(t, pn_link_advance(small));
+  /* The output limit stops framing long before the large message is done */
+  pn_connection_driver_write_buffer(&client.driver);
+  TEST_CHECK(t, 1 == pn_link_queued(bulk));
+  TEST_CHECK(t, 0 == pn_link_queued(small));
+
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  TEST_CHECK(t, pn_transport_get_frames_output(ct) - frames > sizeof(body)/(16*1024));
+  int received = 0;
+  for (pn_link_t *l = pn_link_head(server.driver.connection, 0); l; l = pn_link_next(l, 0)) {
+    pn_delivery_t *dlv = pn_link_current(l);
+    TEST_ASSERT(dlv);
+    TEST_CHECK(t, !pn_delivery_partial(dlv));
+    pn_bytes_t view = pn_delivery_bytes(dlv);
+    if (!strcmp("bulk", pn_link_name(l))) {
+      TEST_CHECK(t, sizeof(body) == view.size && !memcmp(body, view.start, view.size));
+    } else {
+      TEST_CHECK(t, 1 == view.size && 'x' == view.start[0]);
+    }
+    ++received;
+  }
+  TEST_CHECK(t, 2 == received);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Interleaved links share the output by their weights */
+static void test_link_weight(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  pn_transport_t *ct = client.driver.transport;
+  pn_transport_set_server(server.driver.transport);
+  pn_transport_set_interleave(ct, true);
+  pn_transport_set_output_limit(ct, 64*1024);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *fast = pn_sender(ssn, "fast");
+  pn_link_t *slow = pn_sender(ssn, "slow");
+  TEST_CHECK(t, 1 == pn_link_weight(slow));
+  pn_link_set_weight(slow, 0);
+  TEST_CHECK(t, 1 == pn_link_weight(slow));
+  pn_link_set_weight(fast, 3);
+  TEST_CHECK(t, 3 == pn_link_weight(fast));
+  pn_link_open(fast);
+  pn_link_open(slow);
+  test_connection_drivers_run(&client, &server);
+  for (pn_link_t *l = pn_link_head(server.driver.connection, 0); l; l = pn_link_next(l, 0))
+    pn_link_flow(l, 1);
+  test_connection_drivers_run(&client, &server);
+
+  static char body[256*1024];
+  pn_delivery_t *df = pn_delivery(fast, pn_dtag("f", 1));
+  pn_link_send(fast, body, sizeof(body));
+  pn_link_advance(fast);
+  pn_delivery_t *ds = pn_delivery(slow, pn_dtag("s", 1));
+  pn_link_send(slow, body, sizeof(body));
+  pn_link_advance(slow);
+  pn_connection_driver_write_buffer(&client.driver);
+  size_t sent_fast = sizeof(body) - pn_delivery_pending(df);
+  size_t sent_slow = sizeof(body) - pn_delivery_pending(ds);
+  /* To within the transfer headers, which are a byte shorter for handle and
+     delivery id 0, so the fast link's frames each carry two bytes more */
+  TEST_CHECKF(t, sent_slow && sent_fast == 3 * sent_slow + 3 * 2, "fast %zu, slow %zu", sent_fast, sent_slow);
+
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  TEST_CHECK(t, 0 == pn_link_queued(fast) && 0 == pn_link_queued(slow));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+static bool bytes_equal(const char *want, pn_bytes_t got) {
+  return got.size == strlen(want) && !memcmp(want, got.start, got.size);
+}
+
+/* Handler that budgets 64 KB per session before opening it */
+static pn_event_type_t budget_handler(test_handler_t *th, pn_event_t *e) {
+  if (pn_event_type(e) == PN_SESSION_REMOTE_OPEN) {
+    pn_session_set_incoming_capacity(pn_event_session(e), 64*1024);
+    pn_session_set_incoming_budget(pn_event_session(e), true);
+  }
+  return open_handler(th, e);
+}
+
+/* A budgeted session keeps to its capacity with no max frame size */
+static void test_session_budget(test_t *t) {
+  const size_t count = 20, size = 10*1024;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, budget_handler, NULL, NULL);
+  struct context ctx = { 0 };
+  server.handler.context = &ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_ASSERT(ctx.link);
+  pn_session_t *rssn = pn_link_session(ctx.link);
+  TEST_CHECK(t, pn_session_get_incoming_budget(rssn));
+  pn_link_flow(ctx.link, count);
+  test_connection_drivers_run(&client, &server);
+
+  static char body[10*1024];
+  for (size_t i = 0; i < count; i++) {
+    pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+    pn_link_send(snd, body, size);
+    pn_link_advance(snd);
+  }
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  size_t buffered = pn_session_incoming_bytes(rssn);
+  TEST_CHECKF(t, buffered > 0 && buffered <= 64*1024, "%zu bytes buffered", buffered);
+
+  /* Reading lets the rest in */
+  size_t received = 0;
+  for (int spin = 0; received < count && spin < 1000; spin++) {
+    pn_delivery_t *d;
+    while ((d = pn_link_current(ctx.link)) && !pn_delivery_partial(d)) {
+      TEST_CHECK(t, (ssize_t) size == pn_link_recv(ctx.link, NULL, size));
+      pn_link_advance(ctx.link);
+      pn_delivery_settle(d);
+      ++received;
+    }
+    test_connection_drivers_run(&client, &server);
+  }
+  TEST_CHECKF(t, received == count, "received %zu", received);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Remote properties and termini are copied out of the frame still encoded */
+static void test_remote_encoded(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+
+  pn_data_t *props = pn_connection_properties(client.driver.connection);
+  pn_data_put_map(props);
+  pn_data_enter(props);
+  for (int i = 0; i < 8; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%d", i);
+    pn_data_put_symbol(props, pn_bytes(strlen(key), key));
+    pn_data_put_int(props, i);
+  }
+  pn_data_exit(props);
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_terminus_set_address(pn_link_target(snd), "queue");
+  pn_data_put_map(pn_terminus_properties(pn_link_source(snd)));
+  pn_data_enter(pn_terminus_properties(pn_link_source(snd)));
+  pn_data_put_symbol(pn_terminus_properties(pn_link_source(snd)), pn_bytes(1, "k"));
+  pn_data_put_string(pn_terminus_properties(pn_link_source(snd)), pn_bytes(1, "v"));
+  pn_data_exit(pn_terminus_properties(pn_link_source(snd)));
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+
+  pn_data_t *remote = pn_connection_remote_properties(server.driver.connection);
+  TEST_CHECKF(t, 1 == pn_data_size(remote), "%zu nodes", pn_data_size(remote));
+  pn_data_rewind(remote);
+  TEST_CHECK(t, pn_data_next(remote) && 16 == pn_data_get_map(remote));
+  pn_data_enter(remote);
+  for (int i = 0; i < 8; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_CHECK(t, pn_data_next(remote) && bytes_equal(key, pn_data_get_symbol(remote)));
+    TEST_CHECK(t, pn_data_next(remote) && i == pn_data_get_int(remote));
+  }
+  TEST_CHECK(t, !pn_data_next(remote));
+
+  pn_link_t *rcv = pn_link_head(server.driver.connection, 0);
+  TEST_ASSERT(rcv);
+  TEST_STR_EQUAL(t, "queue", pn_terminus_get_address(pn_link_remote_target(rcv)));
+  pn_data_t *tprops = pn_terminus_properties(pn_link_remote_source(rcv));
+  TEST_CHECK(t, 1 == pn_data_size(tprops));
+  pn_data_rewind(tprops);
+  TEST_CHECK(t, pn_data_next(tprops) && 2 == pn_data_get_map(tprops));
+  pn_data_enter(tprops);
+  TEST_CHECK(t, pn_data_next(tprops) && bytes_equal("k", pn_data_get_symbol(tprops)));
+  TEST_CHECK(t, pn_data_next(tprops) && bytes_equal("v", pn_data_get_string(tprops)));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* The protocol header arrives with enough frames behind it to fill the input buffer */
+static void test_header_large_read(test_t *t) {
+  const int n = 1000;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+
+  /* The server's first write carries all the attaches */
+  pn_connection_open(server.driver.connection);
+  pn_session_t *ssn = pn_session(server.driver.connection);
+  pn_session_open(ssn);
+  for (int i = 0; i < n; ++i) {
+    char name[16];
+    snprintf(name, sizeof(name), "x%d", i);
+    pn_link_open(pn_sender(ssn, name));
+  }
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_COND_EMPTY(t, pn_transport_condition(client.driver.transport));
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+  int active = 0;
+  for (pn_link_t *l = pn_link_head(server.driver.connection, 0); l; l = pn_link_next(l, 0)) {
+    if (pn_link_state(l) & PN_REMOTE_ACTIVE) ++active;
+  }
+  TEST_CHECKF(t, n == active, "%d of %d links active", active, n);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* A transport validating text fails on a frame with a bad string */
+static void test_validate_text(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, open_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, !pn_transport_get_validate_text(server.driver.transport));
+  pn_transport_set_validate_text(server.driver.transport, true);
+  TEST_CHECK(t, pn_transport_get_validate_text(server.driver.transport));
+
+  pn_connection_set_container(client.driver.connection, "caf\xc3\xa9");
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_COND_EMPTY(t, pn_transport_condition(server.driver.transport));
+  TEST_STR_EQUAL(t, "caf\xc3\xa9", pn_connection_remote_container(server.driver.connection));
+
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_terminus_set_address(pn_link_target(snd), "bad\xff");
+  pn_link_open(snd);
+  while (test_connection_drivers_run(&client, &server))
+    ;
+  TEST_COND_NAME(t, "amqp:decode-error", pn_transport_condition(server.driver.transport));
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+/* Many links on one session, attach and lookup by name and handle */
+static void test_link_many(test_t *t) {
+  const int n = 10000;
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, nolog_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, nolog_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  char name[16];
+  pn_link_t *snd = NULL;
+  clock_t start = clock();
+  for (int i = 0; i < n; ++i) {
+    snprintf(name, sizeof(name), "l%d", i);
+    snd = pn_sender(ssn, name);
+    pn_link_open(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  TEST_LOGF(t, "%d links attached in %.0f ms", n, elapsed * 1000);
+  int attached = 0;
+  for (pn_link_t *l = pn_link_head(client.driver.connection, 0); l; l = pn_link_next(l, 0))
+    if (pn_link_state(l) & PN_REMOTE_ACTIVE) ++attached;
+  TEST_CHECKF(t, n == attached, "%d attached", attached);
+
+  /* A transfer on the last link finds it by handle */
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  TEST_STR_EQUAL(t, name, pn_link_name(rcv));
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery(snd, pn_dtag("x", 1));
+  pn_link_send(snd, "x", 1);
+  pn_link_advance(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_link_current(rcv) && 1 == pn_delivery_pending(pn_link_current(rcv)));
+
+  /* Once detached both ways a name is attached to a new link */
+  pn_link_close(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_close(rcv);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_link_state(rcv) == (PN_LOCAL_CLOSED | PN_REMOTE_CLOSED));
+  snd = pn_sender(ssn, name);
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, server_ctx.link && server_ctx.link != rcv);
+  TEST_STR_EQUAL(t, name, pn_link_name(server_ctx.link));
+
+  /* End waits for the one sender with a queued delivery */
+  pn_delivery(snd, pn_dtag("y", 1));
+  pn_link_send(snd, "y", 1);
+  pn_link_advance(snd);
+  pn_session_close(ssn);
+  test_connection_drivers_run(&client, &server);
+  pn_session_t *sssn = pn_link_session(server_ctx.link);
+  TEST_CHECK(t, !(pn_session_state(sssn) & PN_REMOTE_CLOSED));
+  pn_link_flow(server_ctx.link, 1);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_link_current(server_ctx.link));
+  TEST_CHECK(t, pn_session_state(sssn) & PN_REMOTE_CLOSED);
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
+#define CERTFILE(NAME) CMAKE_CURRENT_SOURCE_DIR "/ssl_certs/" NAME ".pem"
+
+/* Handler that also replies to REMOTE_CLOSE, so SSL shuts down cleanly */
+static pn_event_type_t close_handler(test_handler_t *th, pn_event_t *e) {
+  if (pn_event_type(e) == PN_CONNECTION_REMOTE_CLOSE) {
+    pn_connection_close(pn_event_connection(e));
+    return PN_EVENT_NONE;
+  }
+  return open_handler(th, e);
+}
+
+/* Open and close an SSL connection, return how the client session was resumed */
+static pn_ssl_resume_status_t ssl_connect(test_t *t, pn_ssl_domain_t *cd, pn_ssl_domain_t *sd, const char *id) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, close_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, close_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(client.driver.transport), cd, id));
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(server.driver.transport), sd, NULL));
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE);
+  pn_ssl_resume_status_t status = pn_ssl_resume_status(pn_ssl(client.driver.transport));
+  pn_connection_close(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  return status;
+}
+
+/* Open an SSL connection with the client verifying the server as host, return true if it opened */
+static bool ssl_verified(test_t *t, pn_ssl_domain_t *cd, pn_ssl_domain_t *sd, const char *host) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, close_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, close_handler, NULL, NULL);
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(client.driver.transport), cd, NULL));
+  TEST_CHECK(t, 0 == pn_ssl_set_peer_hostname(pn_ssl(client.driver.transport), host));
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(server.driver.transport), sd, NULL));
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  bool opened = pn_connection_state(client.driver.connection) & PN_REMOTE_ACTIVE;
+  if (opened) {
+    pn_connection_close(client.driver.connection);
+    test_connection_drivers_run(&client, &server);
+  }
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  return opened;
+}
+
+/* A chain found in the verified chain cache still has the peer name checked */
+static void test_ssl_verify_cache(test_t *t) {
+  if (!pn_ssl_present()) {
+    TEST_LOGF(t, "Skip SSL test, no support");
+    return;
+  }
+  pn_ssl_domain_t *sd = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_credentials(
+               sd, CERTFILE("tserver-certificate"), CERTFILE("tserver-private-key"), "tserverpw"));
+  pn_ssl_domain_t *cd = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_trusted_ca_db(cd, CERTFILE("tserver-certificate")));
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_peer_authentication(cd, PN_SSL_VERIFY_PEER_NAME, NULL));
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_verify_cache(cd, 16, 0));
+
+  /* The test certificate may have expired, a repeat connection must agree with the first */
+  bool verified = ssl_verified(t, cd, sd, "test_server");
+  TEST_CHECK(t, verified == ssl_verified(t, cd, sd, "test_server"));
+  TEST_CHECK(t, !ssl_verified(t, cd, sd, "not_test_server"));
+  TEST_CHECK(t, verified == ssl_verified(t, cd, sd, "test_server"));
+
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_verify_cache(cd, 0, 0));
+  TEST_CHECK(t, verified == ssl_verified(t, cd, sd, "test_server"));
+  TEST_CHECK(t, !ssl_verified(t, cd, sd, "not_test_server"));
+
+  pn_ssl_domain_free(cd);
+  pn_ssl_domain_free(sd);
+}
+
+/* Client sessions are resumed by id from the domain's LRU cache */
+static void test_ssl_session_cache(test_t *t) {
+  if (!pn_ssl_present()) {
+    TEST_LOGF(t, "Skip SSL test, no support");
+    return;
+  }
+  pn_ssl_domain_t *sd = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_credentials(
+               sd, CERTFILE("tserver-certificate"), CERTFILE("tserver-private-key"), "tserverpw"));
+  pn_ssl_domain_t *cd = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "a"));
+  TEST_CHECK(t, PN_SSL_RESUME_REUSED == ssl_connect(t, cd, sd, "a"));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "b"));
+  TEST_CHECK(t, PN_SSL_RESUME_REUSED == ssl_connect(t, cd, sd, "a"));
+
+  /* The least recently used session is dropped when the cache is full */
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_session_cache(cd, 2, 0));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "a"));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "b"));
+  TEST_CHECK(t, PN_SSL_RESUME_REUSED == ssl_connect(t, cd, sd, "a"));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "c"));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "b"));
+  TEST_CHECK(t, PN_SSL_RESUME_REUSED == ssl_connect(t, cd, sd, "c"));
+
+  /* An empty cache never resumes */
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_session_cache(cd, 0, 0));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "a"));
+  TEST_CHECK(t, PN_SSL_RESUME_NEW == ssl_connect(t, cd, sd, "a"));
+
+  pn_ssl_domain_free(cd);
+  pn_ssl_domain_free(sd);
+}
+
+/* A large delivery over SSL is encrypted from the transport's frames and arrives intact */
+static void test_ssl_transfer(test_t *t) {
+  if (!pn_ssl_present()) {
+    TEST_LOGF(t, "Skip SSL test, no support");
+    return;
+  }
+  pn_ssl_domain_t *sd = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_credentials(
+               sd, CERTFILE("tserver-certificate"), CERTFILE("tserver-private-key"), "tserverpw"));
+  pn_ssl_domain_t *cd = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+  TEST_CHECK(t, 0 != pn_ssl_domain_set_buffer_size(cd, 0));
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_buffer_size(cd, 512));
+
+  size_t size = 1024*1024;
+  char *bytes = (char*)malloc(size);
+  for (size_t i = 0; i < size; ++i) bytes[i] = (char)(i * 31);
+
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(client.driver.transport), cd, NULL));
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(server.driver.transport), sd, NULL));
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, (ssize_t)size == pn_link_send(snd, bytes, size));
+  TEST_CHECK(t, pn_link_advance(snd));
+  while (test_connection_drivers_run(&client, &server) &&
+         !(server_ctx.delivery && !pn_delivery_partial(server_ctx.delivery)))
+    ;
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv && !pn_delivery_partial(dlv));
+  TEST_CHECK(t, size == pn_delivery_pending(dlv));
+  char *received = (char*)malloc(size);
+  TEST_CHECK(t, (ssize_t)size == pn_link_recv(rcv, received, size));
+  TEST_CHECK(t, !memcmp(bytes, received, size));
+
+  free(received);
+  free(bytes);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  pn_ssl_domain_free(cd);
+  pn_ssl_domain_free(sd);
+}
+
+/* SSL records split across reads of a few bytes are put together from the
+   transport's input, and records written while it was reading are sent first */
+static void test_ssl_split_records(test_t *t) {
+  if (!pn_ssl_present()) {
+    TEST_LOGF(t, "Skip SSL test, no support");
+    return;
+  }
+  pn_ssl_domain_t *sd = pn_ssl_domain(PN_SSL_MODE_SERVER);
+  TEST_CHECK(t, 0 == pn_ssl_domain_set_credentials(
+               sd, CERTFILE("tserver-certificate"), CERTFILE("tserver-private-key"), "tserverpw"));
+  pn_ssl_domain_t *cd = pn_ssl_domain(PN_SSL_MODE_CLIENT);
+
+  size_t size = 64*1024;
+  char *bytes = (char*)malloc(size);
+  for (size_t i = 0; i < size; ++i) bytes[i] = (char)(i * 17);
+
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, open_handler, NULL, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL, NULL);
+  struct context server_ctx = { 0 };
+  server.handler.context = &server_ctx;
+  pn_transport_set_server(server.driver.transport);
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(client.driver.transport), cd, NULL));
+  TEST_CHECK(t, 0 == pn_ssl_init(pn_ssl(server.driver.transport), sd, NULL));
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "x");
+  pn_link_open(snd);
+  drivers_run_external(&client, &server);
+  pn_link_t *rcv = server_ctx.link;
+  TEST_ASSERT(rcv);
+  pn_link_flow(rcv, 1);
+  drivers_run_external(&client, &server);
+
+  pn_delivery(snd, pn_dtag("x", 1));
+  TEST_CHECK(t, (ssize_t)size == pn_link_send(snd, bytes, size));
+  TEST_CHECK(t, pn_link_advance(snd));
+  drivers_run_external(&client, &server);
+  pn_delivery_t *dlv = server_ctx.delivery;
+  TEST_ASSERT(dlv && !pn_delivery_partial(dlv));
+  char *received = (char*)malloc(size);
+  TEST_CHECK(t, (ssize_t)size == pn_link_recv(rcv, received, size));
+  TEST_CHECK(t, !memcmp(bytes, received, size));
+
+  pn_connection_close(client.driver.connection);
+  pn_connection_close(server.driver.connection);
+  drivers_run_external(&client, &server);
+  TEST_CHECK(t, pn_connection_state(client.driver.connection) & PN_REMOTE_CLOSED);
+  TEST_CHECK(t, pn_connection_state(server.driver.connection) & PN_REMOTE_CLOSED);
+
+  free(received);
+  free(bytes);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  pn_ssl_domain_free(cd);
+  pn_ssl_domain_free(sd);
+}
+
 int main(int argc, char **argv) {
   int failed = 0;
   RUN_ARGV_TEST(failed, t, test_message_transfer(&t));
+  RUN_ARGV_TEST(failed, t, test_read_external(&t));
+  RUN_ARGV_TEST(failed, t, test_write_iovec(&t));
   RUN_ARGV_TEST(failed, t, test_message_stream(&t));
+  RUN_ARGV_TEST(failed, t, test_message_stream_wanted(&t));
+  RUN_ARGV_TEST(failed, t, test_message_multiframe(&t));
+  RUN_ARGV_TEST(failed, t, test_frame_records(&t));
+  RUN_ARGV_TEST(failed, t, test_frame_capture(&t));
+  RUN_ARGV_TEST(failed, t, test_stats(&t));
+  RUN_ARGV_TEST(failed, t, test_send_shared(&t));
+  RUN_ARGV_TEST(failed, t, test_send_buffer(&t));
+  RUN_ARGV_TEST(failed, t, test_send_settled(&t));
+  RUN_ARGV_TEST(failed, t, test_credit_wait(&t));
+  RUN_ARGV_TEST(failed, t, test_message_format(&t));
+  RUN_ARGV_TEST(failed, t, test_delivery_tag(&t));
+  RUN_ARGV_TEST(failed, t, test_link_resume(&t));
+  RUN_ARGV_TEST(failed, t, test_memory_limit(&t));
+  RUN_ARGV_TEST(failed, t, test_input_shrink(&t));
+  RUN_ARGV_TEST(failed, t, test_hibernate(&t));
+  RUN_ARGV_TEST(failed, t, test_pinned_layers(&t));
+  RUN_ARGV_TEST(failed, t, test_output_limit(&t));
+  RUN_ARGV_TEST(failed, t, test_output_high_water(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_many(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_data(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_range(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_delay(&t));
+  RUN_ARGV_TEST(failed, t, test_interleave(&t));
+  RUN_ARGV_TEST(failed, t, test_link_weight(&t));
+  RUN_ARGV_TEST(failed, t, test_session_budget(&t));
+  RUN_ARGV_TEST(failed, t, test_remote_encoded(&t));
+  RUN_ARGV_TEST(failed, t, test_header_large_read(&t));
+  RUN_ARGV_TEST(failed, t, test_validate_text(&t));
+  RUN_ARGV_TEST(failed, t, test_link_many(&t));
+  RUN_ARGV_TEST(failed, t, test_ssl_session_cache(&t));
+  RUN_ARGV_TEST(failed, t, test_ssl_verify_cache(&t));
+  RUN_ARGV_TEST(failed, t, test_ssl_transfer(&t));
+  RUN_ARGV_TEST(failed, t, test_ssl_split_records(&t));
   return failed;
 }
@@ -22,10 +22,31 @@
 #undef NDEBUG                   /* Make sure that assert() is enabled even in a release build. */
 
 #include <proton/codec.h>
+#include "core/config.h"
 #include "core/data.h"
+#include "core/decoder.h"
+#include "performatives.h"
+#include "formats.h"
 #include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#ifdef PNI_DATA_LARGE
+// With 32 bit node ids make sure we can grow well past the 16 bit limit.
+static void test_grow(void)
+{
+  pn_data_t* data = pn_data(0);
+  while (pn_data_size(data) < 100000) {
+    int code = pn_data_put_int(data, 1);
+    if (code) fprintf(stderr, "%d: %s", code, pn_error_text(pn_data_error(data)));
+    assert(code == 0);
+  }
+  assert(pn_data_size(data) == 100000);
+  pn_data_free(data);
+}
+#else
 // Make sure we can grow the capacity of a pn_data_t all the way to the max and we stop there.
 static void test_grow(void)
 {
@@ -43,7 +64,820 @@ static void test_grow(void)
   assert(pn_data_size(data) == PNI_NID_MAX);
   pn_data_free(data);
 }
+#endif
+
+// Nodes start in the block allocated with the pn_data_t and move to the heap as it grows.
+static void test_grow_inline(void)
+{
+  pn_data_t* data = pn_data(4);
+  pn_data_put_list(data);
+  pn_data_enter(data);
+  for (int i = 0; i < 100; ++i) {
+    assert(pn_data_put_int(data, i) == 0);
+  }
+  pn_data_exit(data);
+  char buf[1024];
+  ssize_t size = pn_data_encode(data, buf, sizeof(buf));
+  assert(size > 0);
+
+  pn_data_t* copy = pn_data(2);
+  assert(pn_data_decode(copy, buf, size) == size);
+  pn_data_rewind(copy);
+  assert(pn_data_next(copy) && pn_data_get_list(copy) == 100);
+  pn_data_enter(copy);
+  for (int i = 0; i < 100; ++i) {
+    assert(pn_data_next(copy) && pn_data_get_int(copy) == i);
+  }
+  pn_data_free(copy);
+  pn_data_free(data);
+}
+
+// Rebuild a pn_data_t from streaming decoder callbacks
+static int rebuild_enter(void *context, pn_type_t type, size_t count, pn_type_t element_type, bool described)
+{
+  pn_data_t *data = (pn_data_t *) context;
+  switch (type) {
+  case PN_LIST: pn_data_put_list(data); break;
+  case PN_MAP: pn_data_put_map(data); break;
+  case PN_ARRAY: pn_data_put_array(data, described, element_type); break;
+  case PN_DESCRIBED: pn_data_put_described(data); break;
+  default: return PN_ARG_ERR;
+  }
+  pn_data_enter(data);
+  return 0;
+}
+
+static int rebuild_leave(void *context, pn_type_t type)
+{
+  pn_data_exit((pn_data_t *) context);
+  return 0;
+}
+
+static int rebuild_scalar(void *context, const pn_atom_t *atom)
+{
+  return pn_data_put_atom((pn_data_t *) context, *atom);
+}
+
+static void check_stream(pn_data_t *data, const char *bytes, size_t size, size_t piece)
+{
+  static const pn_decoder_handler_t handler = {rebuild_enter, rebuild_leave, rebuild_scalar};
+  pn_data_t *rebuilt = pn_data(0);
+  pn_decoder_stream_t *stream = pn_decoder_stream(&handler, rebuilt);
+  for (size_t i = 0; i < size; i += piece) {
+    size_t n = size - i < piece ? size - i : piece;
+    assert(pn_decoder_stream_feed(stream, bytes + i, n) == 0);
+  }
+  assert(pn_decoder_stream_complete(stream));
+  char expected[1024], actual[1024];
+  size_t esize = sizeof(expected), asize = sizeof(actual);
+  assert(pn_data_format(data, expected, &esize) == 0);
+  assert(pn_data_format(rebuilt, actual, &asize) == 0);
+  if (strcmp(expected, actual)) fprintf(stderr, "expected %s\ngot %s\n", expected, actual);
+  assert(!strcmp(expected, actual));
+  pn_decoder_stream_free(stream);
+  pn_data_free(rebuilt);
+}
+
+static void test_decoder_stream(void)
+{
+  pn_data_t *data = pn_data(0);
+  char blob[300];
+  memset(blob, 'x', sizeof(blob));
+  int err = pn_data_fill(data, "DL[S{sIsz}@T[iii]zI]", (uint64_t)0x77,"hello", "a", 1, "b", (size_t)sizeof(blob), blob,
+               PN_INT, 1, 2, 3, (size_t)3, "abc", 42);
+  assert(err == 0);
+  pn_data_put_described(data);
+  pn_data_enter(data);
+  pn_data_put_symbol(data, pn_bytes(3, "sym"));
+  pn_data_put_array(data, true, PN_LONG);
+  pn_data_enter(data);
+  pn_data_put_symbol(data, pn_bytes(4, "desc"));
+  pn_data_put_long(data, 7);
+  pn_data_put_long(data, 8);
+  pn_data_exit(data);
+  pn_data_exit(data);
+  pn_data_put_list(data);
+
+  char buf[1024];
+  ssize_t size = pn_data_encode(data, buf, sizeof(buf));
+  assert(size > 0);
+  check_stream(data, buf, size, size);
+  check_stream(data, buf, size, 1);
+  check_stream(data, buf, size, 7);
+
+  // A value cut short is held until the rest arrives
+  static const pn_decoder_handler_t none = {NULL, NULL, NULL};
+  pn_decoder_stream_t *stream = pn_decoder_stream(&none, NULL);
+  assert(pn_decoder_stream_feed(stream, buf, 40) == 0);
+  assert(!pn_decoder_stream_complete(stream));
+  assert(pn_decoder_stream_feed(stream, buf + 40, size - 40) == 0);
+  assert(pn_decoder_stream_complete(stream));
+  pn_decoder_stream_free(stream);
+
+  // Malformed input is an error that sticks
+  stream = pn_decoder_stream(&none, NULL);
+  char bad = (char)0x01;
+  assert(pn_decoder_stream_feed(stream, &bad, 1) == PN_ARG_ERR);
+  assert(pn_decoder_stream_feed(stream, buf, size) == PN_ARG_ERR);
+  pn_decoder_stream_free(stream);
+  pn_data_free(data);
+}
+
+// Arrays of fixed width elements round trip and truncated input underflows.
+static void test_fixed_array(void)
+{
+  pn_data_t* data = pn_data(0);
+  pn_data_put_array(data, false, PN_LONG);
+  pn_data_enter(data);
+  for (int64_t i = 0; i < 1000; ++i) {
+    assert(pn_data_put_long(data, i * 0x01020304050607LL) == 0);
+  }
+  pn_data_exit(data);
+  pn_data_put_array(data, false, PN_DOUBLE);
+  pn_data_enter(data);
+  for (int i = 0; i < 10; ++i) {
+    assert(pn_data_put_double(data, i / 4.0) == 0);
+  }
+  pn_data_exit(data);
+  char buf[16384];
+  ssize_t size = pn_data_encode(data, buf, sizeof(buf));
+  assert(size > 0);
+
+  pn_data_t* copy = pn_data(0);
+  ssize_t used = pn_data_decode(copy, buf, size);
+  assert(used > 0 && used < size);
+  assert(pn_data_decode(copy, buf + used, size - used) == size - used);
+  pn_data_rewind(copy);
+  assert(pn_data_next(copy) && pn_data_get_array(copy) == 1000);
+  assert(pn_data_get_array_type(copy) == PN_LONG);
+  pn_data_enter(copy);
+  for (int64_t i = 0; i < 1000; ++i) {
+    assert(pn_data_next(copy) && pn_data_get_long(copy) == i * 0x01020304050607LL);
+  }
+  pn_data_exit(copy);
+  assert(pn_data_next(copy) && pn_data_get_array(copy) == 10);
+  pn_data_enter(copy);
+  for (int i = 0; i < 10; ++i) {
+    assert(pn_data_next(copy) && pn_data_get_double(copy) == i / 4.0);
+  }
+  pn_data_exit(copy);
+
+  pn_data_clear(copy);
+  assert(pn_data_decode(copy, buf, 1000) == PN_UNDERFLOW);
+  pn_data_free(copy);
+  pn_data_free(data);
+}
+
+// Arrays put and got in one call match arrays built element by element.
+static void test_array_values(void)
+{
+  int64_t longs[1000];
+  for (int i = 0; i < 1000; ++i) longs[i] = i * 0x01020304050607LL;
+  float floats[3] = {0.5f, -1.0f, 2.25f};
+
+  pn_data_t* slow = pn_data(0);
+  pn_data_put_list(slow);
+  pn_data_enter(slow);
+  pn_data_put_array(slow, false, PN_LONG);
+  pn_data_enter(slow);
+  for (int i = 0; i < 1000; ++i) pn_data_put_long(slow, longs[i]);
+  pn_data_exit(slow);
+  pn_data_put_array(slow, false, PN_FLOAT);
+  pn_data_enter(slow);
+  for (int i = 0; i < 3; ++i) pn_data_put_float(slow, floats[i]);
+  pn_data_exit(slow);
+  pn_data_put_array(slow, false, PN_INT);
+  pn_data_exit(slow);
+
+  pn_data_t* fast = pn_data(0);
+  pn_data_put_list(fast);
+  pn_data_enter(fast);
+  assert(pn_data_put_array_values(fast, PN_LONG, longs, 1000) == 0);
+  assert(pn_data_put_array_values(fast, PN_FLOAT, floats, 3) == 0);
+  assert(pn_data_put_array_values(fast, PN_INT, NULL, 0) == 0);
+  assert(pn_data_put_array_values(fast, PN_STRING, NULL, 0) == PN_ARG_ERR);
+  pn_data_exit(fast);
+
+  char buf[16384], buf2[16384];
+  ssize_t size = pn_data_encode(slow, buf, sizeof(buf));
+  assert(size > 0);
+  assert(pn_data_encode(fast, buf2, sizeof(buf2)) == size);
+  assert(memcmp(buf, buf2, size) == 0);
+
+  pn_data_t* copy = pn_data(0);
+  assert(pn_data_decode(copy, buf, size) == size);
+  pn_data_rewind(copy);
+  assert(pn_data_next(copy) && pn_data_enter(copy) && pn_data_next(copy));
+  int64_t got[1000];
+  assert(pn_data_get_array_values(copy, PN_INT, got, 1000) == 0);
+  assert(pn_data_get_array_values(copy, PN_LONG, got, 10) == 10);
+  assert(pn_data_get_array_values(copy, PN_LONG, got, 1000) == 1000);
+  assert(memcmp(got, longs, sizeof(longs)) == 0);
+  float gotf[3];
+  assert(pn_data_next(copy) && pn_data_get_array_values(copy, PN_FLOAT, gotf, 3) == 3);
+  assert(memcmp(gotf, floats, sizeof(floats)) == 0);
+  assert(pn_data_next(copy) && pn_data_get_array_values(copy, PN_INT, got, 1) == 0);
+  assert(!pn_data_next(copy));
+
+  pn_data_free(copy);
+  pn_data_free(fast);
+  pn_data_free(slow);
+}
+
+// Encode a performative with pn_data_fill and enter its field list
+static pni_reader_t encode_performative(char *buf, size_t max, uint64_t *code, uint32_t *count,
+                                        const char *fmt, ...)
+{
+  pn_data_t *data = pn_data(0);
+  va_list ap;
+  va_start(ap, fmt);
+  assert(pn_data_vfill(data, fmt, ap) == 0);
+  va_end(ap);
+  ssize_t size = pn_data_encode(data, buf, max);
+  assert(size > 0);
+  pn_data_free(data);
+  pni_reader_t r = pni_reader(buf, size), fields;
+  assert(pni_read_descriptor(&r, code));
+  assert(pni_read_list(&r, &fields, count));
+  assert(r.pos == r.end);
+  return fields;
+}
+
+// The generated decoders agree with pn_data_t and refuse what they can't read
+static void test_performatives(void)
+{
+  char buf[1024];
+  uint64_t code;
+  uint32_t count;
+
+  pni_reader_t r = encode_performative(buf, sizeof(buf), &code, &count, "DL[IIIIIIIIoo{}S]", FLOW,
+                                       1, 2, 300000, 4, 5, 0, 7, 8, true, false, "extra");
+  pni_flow_t flow;
+  assert(code == FLOW && count == 12);
+  assert(pni_decode_flow(&r, count, &flow) && r.pos == r.end);
+  assert(flow.next_incoming_id == 1 && flow.incoming_window == 2 && flow.next_outgoing_id == 300000);
+  assert(flow.handle == 5 && flow.delivery_count == 0 && flow.link_credit == 7 && flow.drain && !flow.echo);
+  assert(PNI_PRESENT(&flow, FLOW_DELIVERY_COUNT) && PNI_PRESENT(&flow, FLOW_PROPERTIES));
+  assert(flow.properties.size == 3 && (uint8_t) flow.properties.start[0] == PNE_MAP8);
+
+  r = encode_performative(buf, sizeof(buf), &code, &count, "DL[InzIonnDL[]]", TRANSFER,
+                          3, (size_t) 3, "tag", 0, true, ACCEPTED);
+  pni_transfer_t transfer;
+  assert(code == TRANSFER && count == 8);
+  assert(pni_decode_transfer(&r, count, &transfer) && r.pos == r.end);
+  assert(transfer.handle == 3 && !PNI_PRESENT(&transfer, TRANSFER_DELIVERY_ID));
+  assert(transfer.delivery_tag.size == 3 && !memcmp(transfer.delivery_tag.start, "tag", 3));
+  assert(transfer.settled && !transfer.more && !PNI_PRESENT(&transfer, TRANSFER_MORE));
+  assert(PNI_PRESENT(&transfer, TRANSFER_STATE) && !PNI_PRESENT(&transfer, TRANSFER_RESUME));
+  pni_reader_t state = pni_reader(transfer.state.start, transfer.state.size), list;
+  assert(pni_read_descriptor(&state, &code) && code == ACCEPTED);
+  assert(pni_read_list(&state, &list, &count) && count == 0 && state.pos == state.end);
+
+  r = encode_performative(buf, sizeof(buf), &code, &count, "DL[oI]", DISPOSITION, true, 42);
+  pni_disposition_t disposition;
+  assert(pni_decode_disposition(&r, count, &disposition) && r.pos == r.end);
+  assert(disposition.role && disposition.first == 42 && !PNI_PRESENT(&disposition, DISPOSITION_LAST));
+
+  /* A handle that isn't a uint is left to the general decoder */
+  r = encode_performative(buf, sizeof(buf), &code, &count, "DL[L]", TRANSFER, (uint64_t) 1);
+  assert(!pni_decode_transfer(&r, count, &transfer));
+
+  /* Truncated lists and values are refused */
+  ssize_t size = 0;
+  {
+    pn_data_t *data = pn_data(0);
+    assert(pn_data_fill(data, "DL[IIzI]", TRANSFER, 1, 2, (size_t) 5, "12345", 0) == 0);
+    size = pn_data_encode(data, buf, sizeof(buf));
+    pn_data_free(data);
+  }
+  for (ssize_t n = 0; n < size; ++n) {
+    pni_reader_t t = pni_reader(buf, n), fields;
+    uint32_t c;
+    assert(!pni_read_descriptor(&t, &code) || !pni_read_list(&t, &fields, &c));
+  }
+  pni_reader_t t = pni_reader(buf, size), fields;
+  assert(pni_read_descriptor(&t, &code) && pni_read_list(&t, &fields, &count));
+  fields.end -= 2;            /* The tag runs past the end of the list */
+  assert(!pni_decode_transfer(&fields, count, &transfer));
+}
+
+static void check_compiled(const pni_format_t *const *formats, bool fill)
+{
+  for (; *formats; ++formats) {
+    const pni_format_t *f = *formats;
+    uint8_t ops[256];
+    ssize_t size = fill ? pni_fill_compile(f->source, ops, sizeof(ops))
+      : pni_scan_compile(f->source, ops, sizeof(ops), NULL);
+    if (size != (ssize_t) f->size || memcmp(ops, f->ops, f->size))
+      fprintf(stderr, "formats.h disagrees with codec.c on %s\n", f->source);
+    assert(size == (ssize_t) f->size && !memcmp(ops, f->ops, f->size));
+  }
+}
+
+// The programs generated at build time are the ones codec.c compiles, and
+// false guards skip their value's arguments
+static void test_formats(void)
+{
+  check_compiled(PNI_FILL_FORMATS, true);
+  check_compiled(PNI_SCAN_FORMATS, false);
+
+  uint8_t ops[64];
+  assert(pni_fill_compile("[Q]", ops, sizeof(ops)) == PN_ARG_ERR);
+  assert(pni_fill_compile("*i", ops, sizeof(ops)) == PN_ARG_ERR);
+  assert(pni_fill_compile("DL[II]", ops, 3) == PN_OVERFLOW);
+  assert(pni_scan_compile("D.[??I]", ops, sizeof(ops), NULL) == PN_ARG_ERR);
+
+  pn_data_t *data = pn_data(0);
+  uint32_t i = 0, j = 0;
+  uint64_t l = 0;
+  bool inner, guard;
+  pn_bytes_t bin, sym;
+  assert(pn_data_fill(data, "[?[IzLs?S]I]", false, 1, (size_t) 3, "bin", (uint64_t) 2, "sym", true, "str", 7) == 0);
+  assert(pn_data_scan(data, "[?[IzLs]I]", &guard, &i, &bin, &l, &sym, &j) == 0);
+  assert(!guard && j == 7);
+
+  pn_data_clear(data);
+  assert(pn_data_fill(data, "[?[IzLs?S]I]", true, 1, (size_t) 3, "bin", (uint64_t) 2, "sym", false, "str", 7) == 0);
+  assert(pn_data_scan(data, "[[IzLs?n]I]", &i, &bin, &l, &sym, &inner, &j) == 0);
+  assert(i == 1 && l == 2 && bin.size == 3 && !memcmp(bin.start, "bin", 3) && sym.size == 3 && inner && j == 7);
+
+  /* The message header fill and scan programs round trip */
+  pn_data_clear(data);
+  assert(pni_data_fill_format(data, &PNI_FILL_HEADER, HEADER, true, 4, false, 0, false, 9) == 0);
+  bool durable, first;
+  uint8_t priority;
+  uint32_t ttl = 1, count;
+  assert(pni_data_scan_format(data, &PNI_SCAN_HEADER, &durable, &priority, &ttl, &first, &count) == 0);
+  assert(durable && priority == 4 && ttl == 0 && !first && count == 9);
+  pn_data_free(data);
+}
+
+// Lookups on a large map use its key index and agree with a scan
+static void test_map_lookup(void)
+{
+  pn_data_t *data = pn_data(0);
+  char key[16];
+  const int n = 2 * PN_DATA_MAP_INDEX_MIN;
+  pn_data_put_map(data);
+  pn_data_enter(data);
+  for (int i = 0; i < n; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    if (i % 2) pn_data_put_symbol(data, pn_bytes(strlen(key), key));
+    else pn_data_put_string(data, pn_bytes(strlen(key), key));
+    pn_data_put_int(data, i);
+  }
+  pn_data_put_string(data, pn_bytes(4, "key0")); /* A duplicate, never found */
+  pn_data_put_int(data, -1);
+  pn_data_exit(data);
+
+  for (int i = n - 1; i >= 0; i--) {
+    snprintf(key, sizeof(key), "key%d", i);
+    pn_data_rewind(data);
+    pn_data_next(data);
+    pn_data_enter(data);
+    assert(pn_data_lookup(data, key) && pn_data_get_int(data) == i);
+  }
+  assert(data->index && data->index->map == 1);
+
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  assert(!pn_data_lookup_key(data, PN_SYMBOL, pn_bytes(4, "key0")));
+  assert(pn_data_type(data) == PN_INT && pn_data_get_int(data) == -1); /* At the end, as a scan */
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  assert(pn_data_lookup_key(data, PN_SYMBOL, pn_bytes(4, "key1")) && pn_data_get_int(data) == 1);
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  assert(!pn_data_lookup(data, "missing"));
+
+  /* A put drops the index, the next lookup sees the new key */
+  pn_data_put_string(data, pn_bytes(3, "new"));
+  pn_data_put_int(data, 100);
+  assert(data->index->map == 0);
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  assert(pn_data_lookup(data, "new") && pn_data_get_int(data) == 100);
+  pn_data_free(data);
+}
+
+// Interned bytes stay where they were put however much the data grows
+static void test_intern(void)
+{
+  pn_data_t *data = pn_data(0);
+  char value[32];
+  const char *first = NULL;
+  for (int round = 0; round < 2; round++) {
+    pn_data_put_map(data);
+    pn_data_enter(data);
+    for (int i = 0; i < 10000; i++) {
+      snprintf(value, sizeof(value), "value%d", i);
+      pn_data_put_string(data, pn_bytes(strlen(value), value));
+      pn_data_put_binary(data, pn_bytes(0, NULL));
+      if (i == 0) {
+        pn_data_prev(data);
+        first = pn_data_get_string(data).start;
+        pn_data_next(data);
+      }
+    }
+    pn_data_exit(data);
+
+    pn_data_rewind(data);
+    pn_data_next(data);
+    pn_data_enter(data);
+    for (int i = 0; i < 10000; i++) {
+      snprintf(value, sizeof(value), "value%d", i);
+      assert(pn_data_next(data));
+      pn_bytes_t bytes = pn_data_get_string(data);
+      assert(bytes.size == strlen(value) && !memcmp(bytes.start, value, bytes.size));
+      assert(bytes.start[bytes.size] == '\0');
+      if (i == 0) assert(bytes.start == first);
+      assert(pn_data_next(data) && pn_data_get_binary(data).size == 0);
+    }
+    pn_data_clear(data);
+  }
+  pn_data_free(data);
+}
+
+static pn_bytes_t encode_into(pn_data_t *data, char *buf, size_t size)
+{
+  ssize_t n = pn_data_encode(data, buf, size);
+  assert(n > 0);
+  return pn_bytes(n, buf);
+}
+
+// Encoded values are spliced in, read when entered and encoded verbatim
+static void test_encoded(void)
+{
+  char ann[256], whole[512], spliced[512], again[512];
+  pn_data_t *src = pn_data(0);
+  assert(pn_data_fill(src, "{sIsS}", "x-count", 42, "x-name", "hello") == 0);
+  pn_bytes_t annotations = encode_into(src, ann, sizeof(ann));
+
+  pn_data_clear(src);
+  assert(pn_data_fill(src, "[I{sIsS}DL[SI]I]", 1, "x-count", 42, "x-name", "hello",
+                      (uint64_t) 7, "body", 2, 3) == 0);
+  pn_bytes_t expect = encode_into(src, whole, sizeof(whole));
+
+  char body[64];
+  pn_data_clear(src);
+  assert(pn_data_fill(src, "DL[SI]", (uint64_t) 7, "body", 2) == 0);
+  pn_bytes_t described = encode_into(src, body, sizeof(body));
+
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_put_list(data) == 0);
+  pn_data_enter(data);
+  assert(pn_data_put_uint(data, 1) == 0);
+  assert(pn_data_put_encoded(data, annotations) == 0);
+  assert(data->nodes[data->current - 1].encoded);
+  assert(pn_data_type(data) == PN_MAP && pn_data_get_map(data) == 4);
+  assert(pn_data_put_encoded(data, described) == 0);
+  assert(pn_data_type(data) == PN_DESCRIBED);
+  assert(pn_data_put_uint(data, 3) == 0);
+  pn_data_exit(data);
+  pn_bytes_t out = encode_into(data, spliced, sizeof(spliced));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+  assert(pn_data_size(data) == 5);
+
+  /* Lazily decoded, the same as decoded */
+  pn_data_clear(data);
+  assert(pn_data_decode_lazy(data, expect.start, expect.size) == (ssize_t) expect.size);
+  assert(pn_data_size(data) == 1);
+  pn_data_rewind(data);
+  assert(pn_data_next(data) && pn_data_get_list(data) == 4);
+  assert(pn_data_enter(data) && pn_data_next(data) && pn_data_get_uint(data) == 1);
+  assert(pn_data_next(data) && pn_data_enter(data));
+  assert(pn_data_lookup(data, "x-name") && !strcmp(pn_data_get_string(data).start, "hello"));
+  pn_data_exit(data);
+  out = encode_into(data, again, sizeof(again));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+
+  pn_data_t *copy = pn_data(0);
+  assert(pn_data_copy(copy, data) == 0);
+  out = encode_into(copy, again, sizeof(again));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+  pn_data_clear(copy);
+  assert(pn_data_decode(copy, expect.start, expect.size) > 0);
+  pn_string_t *s1 = pn_string(NULL), *s2 = pn_string(NULL);
+  pn_inspect(data, s1);
+  pn_inspect(copy, s2);
+  assert(!strcmp(pn_string_get(s1), pn_string_get(s2)));
+  pn_free(s1);
+  pn_free(s2);
+
+  /* Not a single value, or malformed inside */
+  assert(pn_data_put_encoded(data, pn_bytes(annotations.size - 1, annotations.start)) == PN_ARG_ERR);
+  assert(pn_data_put_encoded(data, pn_bytes(expect.size + 1, expect.start)) == PN_ARG_ERR);
+  pn_data_clear(data);
+  const char bad[] = {(char) PNE_LIST8, 2, 1, (char) 0xff};
+  assert(pn_data_put_encoded(data, pn_bytes(sizeof(bad), bad)) == 0);
+  assert(!pn_data_enter(data));
+
+  pn_data_free(copy);
+  pn_data_free(data);
+  pn_data_free(src);
+}
+
+// Copies hold their own bytes, whole or narrowed to a subtree
+static void test_copy(void)
+{
+  char value[32], ann[64], buf[65536], again[65536];
+  pn_data_t *fields = pn_data(0);
+  assert(pn_data_fill(fields, "{sI}", "x-count", 42) == 0);
+  pn_bytes_t annotations = encode_into(fields, ann, sizeof(ann));
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_fill(data, "DL[S@T[ss]]", (uint64_t) 7, "first", PN_SYMBOL, "a", "b") == 0);
+  assert(pn_data_put_map(data) == 0);
+  pn_data_enter(data);
+  for (int i = 0; i < 1000; i++) {
+    snprintf(value, sizeof(value), "key%d", i);
+    pn_data_put_symbol(data, pn_bytes(strlen(value), value));
+    pn_data_put_binary(data, pn_bytes(strlen(value), value));
+  }
+  pn_data_exit(data);
+  assert(pn_data_put_encoded(data, annotations) == 0);
+  pn_bytes_t expect = encode_into(data, buf, sizeof(buf));
+
+  pn_data_t *copy = pn_data(0);
+  for (int round = 0; round < 2; round++) { /* The second reuses the copy's chunks */
+    assert(pn_data_copy(copy, data) == 0);
+    pn_bytes_t out = encode_into(copy, again, sizeof(again));
+    assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+  }
+
+  /* Narrowed to the described list's fields, each with its own bytes */
+  pn_data_rewind(data);
+  assert(pn_data_next(data) && pn_data_enter(data) && pn_data_next(data) && pn_data_next(data));
+  assert(pn_data_enter(data));
+  pn_data_narrow(data);
+  assert(pn_data_copy(copy, data) == 0);
+  pn_data_widen(data);
+  pn_data_clear(fields);
+  assert(pn_data_fill(fields, "S@T[ss]", "first", PN_SYMBOL, "a", "b") == 0);
+  pn_bytes_t out = encode_into(copy, again, sizeof(again));
+  expect = encode_into(fields, buf, sizeof(buf));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+
+  /* Narrowed after a value, the siblings that follow it */
+  pn_data_rewind(data);
+  assert(pn_data_next(data));
+  pn_data_narrow(data);
+  assert(pn_data_copy(copy, data) == 0);
+  pn_data_widen(data);
+  assert(pn_data_size(copy) == 2001 + 1);
+  pn_data_rewind(copy);
+  assert(pn_data_next(copy) && pn_data_get_map(copy) == 2000);
+  assert(pn_data_enter(copy) && pn_data_lookup(copy, "key999"));
+  assert(pn_data_get_binary(copy).size == 6 && !memcmp(pn_data_get_binary(copy).start, "key999", 6));
+  pn_data_exit(copy);
+  assert(pn_data_next(copy) && pn_data_type(copy) == PN_MAP && copy->nodes[copy->current - 1].encoded);
+
+  pn_data_free(data);
+  assert(pn_data_enter(copy) && pn_data_lookup(copy, "x-count") && pn_data_get_uint(copy) == 42);
+  pn_data_rewind(copy);
+  assert(pn_data_next(copy) && pn_data_enter(copy) && pn_data_lookup(copy, "key0"));
+  assert(!strcmp(pn_data_get_binary(copy).start, "key0"));
+  pn_data_free(fields);
+  pn_data_free(copy);
+}
+
+/* Skipped and too deep values stay encoded, the rest is decoded */
+static void test_decode_partial(void)
+{
+  char whole[512], again[512];
+  pn_data_t *src = pn_data(0);
+  assert(pn_data_fill(src, "[I{sIsS}DL[SI]I]", 1, "x-count", 42, "x-name", "hello",
+                      (uint64_t) 7, "body", 2, 3) == 0);
+  pn_bytes_t expect = encode_into(src, whole, sizeof(whole));
+
+  const uint64_t skip[] = {3, 7};
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_decode_partial(data, expect.start, expect.size, skip, 2, -1) == (ssize_t) expect.size);
+  assert(pn_data_size(data) == 9);
+  assert(!data->nodes[data->current - 1].encoded);
+  pn_bytes_t out = encode_into(data, again, sizeof(again));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+
+  pn_data_clear(data);
+  assert(pn_data_decode_partial(data, expect.start, expect.size, NULL, 0, 1) == (ssize_t) expect.size);
+  assert(pn_data_size(data) == 5);
+  pn_data_clear(data);
+  assert(pn_data_decode_partial(data, expect.start, expect.size, NULL, 0, 0) == (ssize_t) expect.size);
+  assert(pn_data_size(data) == 1);
+
+  /* A skipped value can still be entered */
+  pn_data_clear(data);
+  assert(pn_data_decode_partial(data, expect.start, expect.size, skip + 1, 1, -1) > 0);
+  pn_data_rewind(data);
+  assert(pn_data_next(data) && pn_data_enter(data));
+  assert(pn_data_next(data) && pn_data_next(data) && pn_data_next(data));
+  assert(pn_data_type(data) == PN_DESCRIBED && data->nodes[data->current - 1].encoded);
+  assert(pn_data_enter(data) && pn_data_next(data) && pn_data_get_ulong(data) == 7);
+  assert(pn_data_next(data) && pn_data_get_list(data) == 2);
+  assert(pn_data_size(data) == 11);
+  pn_data_exit(data);
+  pn_data_exit(data);
+  out = encode_into(data, again, sizeof(again));
+  assert(out.size == expect.size && !memcmp(out.start, expect.start, out.size));
+
+  pn_data_free(data);
+  pn_data_free(src);
+}
+
+/* Compounds take the smallest encoding that fits, in a single pass */
+static void test_encode_compact(void)
+{
+  const char small[] = {(char) PNE_LIST8, 12, 3, (char) PNE_SMALLUINT, 1,
+                        (char) PNE_MAP8, 6, 2, (char) PNE_SYM8, 1, 'k', (char) PNE_SMALLUINT, 2,
+                        (char) PNE_LIST0};
+  char buf[512];
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_fill(data, "[I{sI}[]]", 1, "k", 2) == 0);
+  assert(pn_data_encoded_size(data) == sizeof(small));
+  assert(pn_data_encode(data, buf, sizeof(small) - 1) == PN_OVERFLOW);
+  /* Exactly the final size, though the 32 bit headers are written first */
+  pn_bytes_t out = encode_into(data, buf, sizeof(small));
+  assert(out.size == sizeof(small) && !memcmp(out.start, small, sizeof(small)));
+
+  pn_rwbytes_t grown = pn_rwbytes(0, NULL);
+  assert(pni_data_encode_grow(data, &grown, 0) == sizeof(small));
+  assert(!memcmp(grown.start, small, sizeof(small)));
+  memcpy(grown.start, "ab", 2);
+  assert(pni_data_encode_grow(data, &grown, 2) == sizeof(small));
+  assert(!memcmp(grown.start, "ab", 2) && !memcmp(grown.start + 2, small, sizeof(small)));
+
+  /* Too big for 8 bits, and array elements, which share one constructor */
+  char text[300];
+  memset(text, 'x', sizeof(text));
+  pn_data_clear(data);
+  assert(pn_data_fill(data, "[z]@T[[][]]", sizeof(text), text, PN_LIST) == 0);
+  ssize_t size = pni_data_encode_grow(data, &grown, 0);
+  assert(size == pn_data_encoded_size(data));
+  assert((uint8_t) grown.start[0] == PNE_LIST32);
+  const char *array = grown.start + 1 + 8 + 5 + sizeof(text);
+  assert((uint8_t) array[0] == PNE_ARRAY8 && (uint8_t) array[3] == PNE_LIST32);
+  assert(array + 4 + 2*8 == grown.start + size);
+
+  pn_data_t *copy = pn_data(0);
+  assert(pn_data_decode(copy, grown.start, size) > 0);
+  assert(pn_data_decode(copy, array, grown.start + size - array) > 0);
+  pn_string_t *s1 = pn_string(NULL), *s2 = pn_string(NULL);
+  pn_inspect(data, s1);
+  pn_inspect(copy, s2);
+  assert(!strcmp(pn_string_get(s1), pn_string_get(s2)));
+  pn_free(s1);
+  pn_free(s2);
+
+  free(grown.start);
+  pn_data_free(copy);
+  pn_data_free(data);
+}
+
+/* Trailing nulls of described lists are left out when trimming */
+static void test_trim_nulls(void)
+{
+  const char trimmed[] = {(char) PNE_DESCRIPTOR, (char) PNE_SMALLULONG, 0x10,
+                          (char) PNE_LIST8, 3, 2, (char) PNE_NULL, (char) PNE_UINT0,
+                          (char) PNE_LIST8, 4, 3, (char) PNE_ULONG0, (char) PNE_NULL, (char) PNE_NULL};
+  char buf[64];
+  pn_data_t *data = pn_data(0);
+  pni_data_trim_nulls(data);
+  assert(pn_data_fill(data, "DL[nInn][Lnn]", (uint64_t) 0x10, 0, (uint64_t) 0) == 0);
+  assert(pn_data_encoded_size(data) == sizeof(trimmed));
+  pn_bytes_t out = encode_into(data, buf, sizeof(buf));
+  assert(out.size == sizeof(trimmed) && !memcmp(out.start, trimmed, sizeof(trimmed)));
+
+  /* All null, and read back with the fields absent */
+  pn_data_clear(data);
+  assert(pn_data_fill(data, "DL[nn]", (uint64_t) 0x10) == 0);
+  out = encode_into(data, buf, sizeof(buf));
+  assert(out.size == 4 && (uint8_t) out.start[3] == PNE_LIST0);
+  pn_data_clear(data);
+  assert(pn_data_decode(data, trimmed, sizeof(trimmed)) > 0);
+  bool found = true;
+  uint32_t i = 1;
+  assert(pn_data_scan(data, "D.[?I?I?I]", &found, &i, &found, &i, &found, &i) == 0);
+  assert(!found && i == 0);
+
+  pn_data_free(data);
+}
+
+/* Strings must be UTF-8 and symbols ASCII, wherever they are nested */
+static void test_text_valid(void)
+{
+#define UTF8(S) pni_utf8_valid(S, sizeof(S) - 1)
+  assert(UTF8("") && UTF8("plain ascii, longer than one word"));
+  assert(UTF8("caf\xc3\xa9") && UTF8("\xe2\x82\xac 10") && UTF8("\xf0\x9f\x98\x80 and more text"));
+  assert(UTF8("\xed\x9f\xbf") && UTF8("\xf4\x8f\xbf\xbf"));
+  assert(!UTF8("\xff") && !UTF8("abcdefgh\x80"));
+  assert(!UTF8("\xc0\xaf") && !UTF8("\xe0\x80\xaf") && !UTF8("\xf0\x80\x80\xaf")); /* overlong */
+  assert(!UTF8("\xed\xa0\x80"));                  /* surrogate */
+  assert(!UTF8("\xf4\x90\x80\x80"));              /* past U+10FFFF */
+  assert(!UTF8("caf\xc3") && !UTF8("\xe2\x82") && !UTF8("\xe2\x28\xa1"));
+#undef UTF8
+
+  char buf[256];
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_fill(data, "DL[S{sS}@T[ss]]", (uint64_t) 0x10, "caf\xc3\xa9", "key", "value",
+                      PN_SYMBOL, "a", "b") == 0);
+  pn_bytes_t out = encode_into(data, buf, sizeof(buf));
+  assert(pni_decoder_text_valid(out.start, out.size));
+  assert(!pni_decoder_text_valid(out.start, out.size - 1));
+
+  const char *bad = "\xe2\x28\xa1";
+  for (int i = 0; i < 4; i++) {
+    pn_data_clear(data);
+    switch (i) {
+    case 0: assert(pn_data_fill(data, "DL[S]", (uint64_t) 0x10, bad) == 0); break;
+    case 1: assert(pn_data_fill(data, "DL[{sS}]", (uint64_t) 0x10, "k", bad) == 0); break;
+    case 2: assert(pn_data_fill(data, "DL[@T[SS]]", (uint64_t) 0x10, PN_STRING, "v", bad) == 0); break;
+    case 3: assert(pn_data_fill(data, "[s]", "caf\xc3\xa9") == 0); break; /* symbols are ASCII */
+    }
+    out = encode_into(data, buf, sizeof(buf));
+    assert(!pni_decoder_text_valid(out.start, out.size));
+  }
+
+  pn_data_free(data);
+}
+
+static void check_inspect(const char *fmt, ...)
+{
+  char buf[1024], expect[1024], text[1024];
+  pn_data_t *data = pn_data(0);
+  va_list ap;
+  va_start(ap, fmt);
+  assert(pn_data_vfill(data, fmt, ap) == 0);
+  va_end(ap);
+  pn_bytes_t encoded = encode_into(data, buf, sizeof(buf));
+  size_t expect_size = sizeof(expect), size = sizeof(text);
+  assert(pn_data_format(data, expect, &expect_size) == 0);
+  assert(pn_encoded_format(encoded.start, encoded.size, PN_TEXT_INSPECT, text, &size) == 0);
+  if (strcmp(text, expect)) fprintf(stderr, "%s: %s != %s\n", fmt, text, expect);
+  assert(size == expect_size && !strcmp(text, expect));
+  pn_data_free(data);
+}
+
+static void check_json(const char *expect, const char *fmt, ...)
+{
+  char buf[1024], text[1024];
+  pn_data_t *data = pn_data(0);
+  va_list ap;
+  va_start(ap, fmt);
+  assert(pn_data_vfill(data, fmt, ap) == 0);
+  va_end(ap);
+  pn_bytes_t encoded = encode_into(data, buf, sizeof(buf));
+  size_t size = sizeof(text);
+  assert(pn_encoded_format(encoded.start, encoded.size, PN_TEXT_JSON, text, &size) == 0);
+  if (strcmp(text, expect)) fprintf(stderr, "%s: %s != %s\n", fmt, text, expect);
+  assert(size == strlen(expect) && !strcmp(text, expect));
+  pn_data_free(data);
+}
+
+// Encoded values format as pn_data_format formats them decoded, or as JSON
+static void test_encoded_format(void)
+{
+  check_inspect("DL[InzIonnDL[]]", (uint64_t) TRANSFER, 3, (size_t) 3, "tag", 0, true, (uint64_t) ACCEPTED);
+  check_inspect("DL[IIIIIIIIoo{}S]", (uint64_t) FLOW, 1, 2, 300000, 4, 5, 0, 7, 8, true, false, "extra");
+  check_inspect("[I{sIsS}DL[SI]I]", 1, "x-count", 42, "x-name", "hello", (uint64_t) 7, "body", 2, 3);
+  check_inspect("{Sz}@T[ss]I", "a\x01", (size_t) 2, "\x00\xff", PN_SYMBOL, "a", "b-c", 5);
+  check_inspect("[]{}DL[]n");
+
+  check_json("{\"a\":1,\"b\":[2,true],\"3\":\"AP8=\"}", "{sIS[Io]Iz}", "a", 1, "b", 2, true, 3, (size_t) 2, "\x00\xff");
+  check_json("{\"descriptor\":20,\"value\":[\"x\\\"\\n\",null]}\n7", "DL[Sn]I", (uint64_t) TRANSFER, "x\"\n", 7);
+  check_json("{\"[\\\"q\\\\\\\"\\\"]\":null}", "{[S]n}", "q\"");
+  check_json("[\"a\",\"b\"]", "@T[ss]", PN_SYMBOL, "a", "b");
+
+  /* Too little room, or too little input */
+  char buf[64], text[8];
+  pn_data_t *data = pn_data(0);
+  assert(pn_data_fill(data, "[SSS]", "one", "two", "three") == 0);
+  pn_bytes_t encoded = encode_into(data, buf, sizeof(buf));
+  size_t size = sizeof(text);
+  assert(pn_encoded_format(encoded.start, encoded.size, PN_TEXT_JSON, text, &size) == PN_OVERFLOW);
+  assert(strlen(text) < sizeof(text));
+  size = sizeof(text);
+  assert(pn_encoded_format(encoded.start, encoded.size - 1, PN_TEXT_JSON, text, &size) != 0);
+  pn_data_free(data);
+}
 
 int main(int argc, char **argv) {
   test_grow();
+  test_grow_inline();
+  test_decoder_stream();
+  test_fixed_array();
+  test_array_values();
+  test_performatives();
+  test_formats();
+  test_map_lookup();
+  test_intern();
+  test_encoded();
+  test_copy();
+  test_decode_partial();
+  test_encode_compact();
+  test_trim_nulls();
+  test_text_valid();
+  test_encoded_format();
 }
@@ -0,0 +1,279 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * In-process transfer benchmark: pump messages between two
+ * pn_connection_driver_t connected in memory, measuring engine and
+ * framing cost without sockets or a proactor.
+ *
+ * Usage: c-driver-bench [-n messages] [-s bytes] [-c credit] [-f max-frame]
+ *                       [-m presettled|unsettled] [-l links] [-w capture-file]
+ *
+ * -l spreads the messages over that many links on one session, each with
+ * the given credit, to measure the engine with many active links.
+ * -w captures the receiver's frames for c-frame-replay.
+ *
+ * Latency is from pn_link_send() on the sender to the complete delivery
+ * on the receiver.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "test_handler.h"
+#include <proton/codec.h>
+#include <proton/connection.h>
+#include <proton/session.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart * 1e9 / (double)f.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+#endif
+}
+
+typedef struct bench_t {
+  /* Settings */
+  size_t count;
+  size_t credit;
+  size_t links;
+  bool presettled;
+  pn_rwbytes_t payload;         /* Encoded message */
+
+  /* Sender */
+  pn_link_t **senders;
+  size_t sent, settled;
+  double *sent_at;              /* Send time per message, indexed by tag */
+
+  /* Receiver */
+  size_t received;
+  pn_rwbytes_t buf;
+  double *latency;
+} bench_t;
+
+static void send_available(bench_t *b, pn_link_t *sender) {
+  while (b->sent < b->count && pn_link_credit(sender) > 0) {
+    uint64_t tag = b->sent;
+    pn_delivery_t *d = pn_delivery(sender, pn_dtag((const char*)&tag, sizeof(tag)));
+    b->sent_at[b->sent++] = now_ns();
+    pn_link_send(sender, b->payload.start, b->payload.size);
+    pn_link_advance(sender);
+    if (b->presettled) {
+      pn_delivery_settle(d);
+      ++b->settled;
+    }
+  }
+}
+
+static pn_event_type_t send_handler(test_handler_t *th, pn_event_t *e) {
+  bench_t *b = (bench_t*)th->context;
+  test_handler_keep(th, 0);
+  switch (pn_event_type(e)) {
+   case PN_LINK_FLOW:
+    send_available(b, pn_event_link(e));
+    break;
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (pn_delivery_settled(d)) {
+       pn_delivery_settle(d);
+       ++b->settled;
+     }
+     break;
+   }
+   default:
+    break;
+  }
+  return PN_EVENT_NONE;
+}
+
+static void receive(bench_t *b, pn_delivery_t *d) {
+  pn_link_t *l = pn_delivery_link(d);
+  size_t size = pn_delivery_pending(d);
+  rwbytes_ensure(&b->buf, size);
+  TEST_ASSERT(pn_link_recv(l, b->buf.start, size) == (ssize_t)size);
+  pn_delivery_tag_t tag = pn_delivery_tag(d);
+  uint64_t seq;
+  TEST_ASSERT(tag.size == sizeof(seq));
+  memcpy(&seq, tag.start, sizeof(seq));
+  TEST_ASSERT(seq < b->count);
+  b->latency[b->received++] = now_ns() - b->sent_at[seq];
+  if (!b->presettled) pn_delivery_update(d, PN_ACCEPTED);
+  pn_delivery_settle(d);
+  if (pn_link_credit(l) <= (int)(b->credit / 2)) {
+    pn_link_flow(l, (int)b->credit - pn_link_credit(l));
+  }
+}
+
+static pn_event_type_t recv_handler(test_handler_t *th, pn_event_t *e) {
+  bench_t *b = (bench_t*)th->context;
+  test_handler_keep(th, 0);
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(pn_event_connection(e));
+    break;
+   case PN_SESSION_REMOTE_OPEN:
+    pn_session_open(pn_event_session(e));
+    break;
+   case PN_LINK_REMOTE_OPEN:
+    pn_link_open(pn_event_link(e));
+    pn_link_flow(pn_event_link(e), (int)b->credit);
+    break;
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (pn_delivery_readable(d) && !pn_delivery_partial(d)) receive(b, d);
+     break;
+   }
+   default:
+    break;
+  }
+  return PN_EVENT_NONE;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+  size_t i = (size_t)(p * (n - 1) / 100.0 + 0.5);
+  return sorted[i];
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n messages] [-s bytes] [-c credit] [-f max-frame] [-m presettled|unsettled] [-l links] [-w capture-file]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  size_t count = 100000, size = 1024, credit = 1000, frame = 0, links = 1;
+  bool presettled = false;
+  const char *capture = NULL;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc || argv[i][0] != '-') usage(argv[0]);
+    const char *v = argv[i+1];
+    switch (argv[i][1]) {
+     case 'n': count = strtoul(v, NULL, 0); break;
+     case 's': size = strtoul(v, NULL, 0); break;
+     case 'c': credit = strtoul(v, NULL, 0); break;
+     case 'f': frame = strtoul(v, NULL, 0); break;
+     case 'l': links = strtoul(v, NULL, 0); break;
+     case 'm':
+      if (!strcmp(v, "presettled")) presettled = true;
+      else if (!strcmp(v, "unsettled")) presettled = false;
+      else usage(argv[0]);
+      break;
+     case 'w': capture = v; break;
+     default: usage(argv[0]);
+    }
+  }
+  if (!count || !credit || !links) usage(argv[0]);
+
+  test_t t = { "driver_bench", 0 };
+  bench_t b;
+  memset(&b, 0, sizeof(b));
+  b.count = count;
+  b.credit = credit;
+  b.links = links;
+  b.presettled = presettled;
+  b.senders = (pn_link_t**)calloc(links, sizeof(pn_link_t*));
+  b.sent_at = (double*)calloc(count, sizeof(double));
+  b.latency = (double*)calloc(count, sizeof(double));
+  TEST_ASSERT(b.senders && b.sent_at && b.latency);
+
+  /* A message with a binary body of the requested size */
+  pn_message_t *m = pn_message();
+  char *body = (char*)calloc(size ? size : 1, 1);
+  pn_data_put_binary(pn_message_body(m), pn_bytes(size, body));
+  size_t encoded = message_encode(m, &b.payload);
+  b.payload.size = encoded;
+  pn_message_free(m);
+  free(body);
+
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, &t, send_handler, NULL, NULL);
+  test_connection_driver_init(&server, &t, recv_handler, NULL, NULL);
+  client.handler.context = &b;
+  server.handler.context = &b;
+  pn_transport_set_server(server.driver.transport);
+  if (capture && pn_transport_capture_file(server.driver.transport, capture)) {
+    perror(capture);
+    return 1;
+  }
+  if (frame) {
+    pn_transport_set_max_frame(client.driver.transport, (uint32_t)frame);
+    pn_transport_set_max_frame(server.driver.transport, (uint32_t)frame);
+  }
+
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_open(ssn);
+  for (size_t i = 0; i < links; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "bench-%zu", i);
+    b.senders[i] = pn_sender(ssn, name);
+    if (presettled) pn_link_set_snd_settle_mode(b.senders[i], PN_SND_SETTLED);
+    pn_link_open(b.senders[i]);
+  }
+
+  double start = now_ns();
+  test_connection_drivers_run(&client, &server);
+  double elapsed = now_ns() - start;
+
+  TEST_CHECKF(&t, b.received == count, "received %zu of %zu", b.received, count);
+  TEST_CHECKF(&t, b.settled == count, "settled %zu of %zu", b.settled, count);
+
+  if (b.received) {
+    qsort(b.latency, b.received, sizeof(double), compare_double);
+    double secs = elapsed / 1e9;
+    printf("%zu messages of %zu bytes (%zu encoded), %zu links, credit %zu, max-frame %zu, %s\n",
+           count, size, encoded, links, credit, (size_t)pn_transport_get_remote_max_frame(client.driver.transport),
+           presettled ? "presettled" : "unsettled");
+    printf("%12.0f msgs/s %10.1f MB/s\n", b.received / secs, b.received * (double)encoded / secs / 1e6);
+    printf("latency us: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+           percentile(b.latency, b.received, 50) / 1e3,
+           percentile(b.latency, b.received, 90) / 1e3,
+           percentile(b.latency, b.received, 99) / 1e3,
+           percentile(b.latency, b.received, 99.9) / 1e3,
+           b.latency[b.received - 1] / 1e3);
+  }
+
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+  free(b.payload.start);
+  free(b.buf.start);
+  free(b.senders);
+  free(b.sent_at);
+  free(b.latency);
+  return t.errors;
+}
@@ -349,12 +349,224 @@ static int test_link_name_prefix(int argc, char **argv)
     return 0;
 }
 
+// links and deliveries come from their connection's object pool, which
+// must stay usable while the application still holds references to them
+static int test_pooled_outlive_connection(int argc, char **argv)
+{
+    fprintf(stdout, "test_pooled_outlive_connection\n");
+    pn_connection_t *c = pn_connection();
+    pn_session_t *s = pn_session(c);
+    pn_link_t *l = NULL;
+    for (int i = 0; i < 100; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "link-%d", i);
+        pn_link_t *snd = pn_sender(s, name);
+        if (i % 2) {
+            pn_link_free(snd);
+        } else {
+            l = snd;
+        }
+    }
+    pn_delivery_t *d = pn_delivery(l, pn_dtag("tag", 3));
+    pn_incref(l);
+    pn_incref(d);
+    pn_connection_free(c);
+
+    assert(!strcmp(pn_link_name(l), "link-98"));
+    assert(pn_delivery_tag(d).size == 3);
+    assert(pn_delivery_link(d) == l);
+    pn_decref(d);
+    pn_decref(l);
+    return 0;
+}
+
+// settled deliveries are reused, keeping grown buffers within the limit
+static int test_delivery_pool(int argc, char **argv)
+{
+    fprintf(stdout, "test_delivery_pool\n");
+    static char data[4096];
+    pn_connection_t *c = pn_connection();
+    pn_session_t *s = pn_session(c);
+    pn_link_t *l = pn_sender(s, "x");
+    pn_connection_set_delivery_pool_max(c, 2*sizeof(data));
+    pn_delivery_t *d[4];
+    for (int i = 0; i < 4; ++i) {
+        d[i] = pn_delivery(l, pn_dtag("tag", 3));
+        pn_link_send(l, data, sizeof(data));
+        pn_link_advance(l);
+    }
+    assert(pn_connection_get_delivery_pool_misses(c) == 4);
+    assert(pn_connection_get_delivery_pool_hits(c) == 0);
+    for (int i = 0; i < 4; ++i)
+        pn_delivery_settle(d[i]);
+
+    for (int i = 0; i < 4; ++i) {
+        pn_delivery_t *r = pn_delivery(l, pn_dtag("tag", 3));
+        assert(pn_delivery_pending(r) == 0);
+        pn_link_send(l, "x", 1);
+        pn_link_advance(l);
+        pn_delivery_settle(r);
+    }
+    assert(pn_connection_get_delivery_pool_hits(c) == 4);
+    assert(pn_connection_get_delivery_pool_misses(c) == 4);
+
+    pn_connection_set_delivery_pool_max(c, 0);
+    pn_connection_free(c);
+    return 0;
+}
+
+// reserved deliveries are used before any are allocated
+static int test_delivery_reserve(int argc, char **argv)
+{
+    fprintf(stdout, "test_delivery_reserve\n");
+    pn_connection_t *c = pn_connection();
+    pn_session_t *s = pn_session(c);
+    pn_link_t *l = pn_sender(s, "x");
+    size_t memory = pn_connection_memory_usage(c);
+    assert(pn_connection_reserve_deliveries(c, 3) == 0);
+    assert(pn_connection_memory_usage(c) > memory);
+    for (int i = 0; i < 4; ++i) {
+        pn_delivery(l, pn_dtag("tag", 3));
+        pn_link_advance(l);
+    }
+    assert(pn_connection_get_delivery_pool_hits(c) == 3);
+    assert(pn_connection_get_delivery_pool_misses(c) == 1);
+
+    // Reserving again tops the pool up, unused deliveries are freed with the connection
+    assert(pn_connection_reserve_deliveries(c, 2) == 0);
+    assert(pn_connection_reserve_deliveries(c, 2) == 0);
+    pn_delivery(l, pn_dtag("tag", 3));
+    assert(pn_connection_get_delivery_pool_hits(c) == 4);
+    pn_connection_free(c);
+    return 0;
+}
+
+// a session's senders and receivers are visited apart from the other endpoints
+static int test_session_links(int argc, char **argv)
+{
+    fprintf(stdout, "test_session_links\n");
+    pn_connection_t *c = pn_connection();
+    pn_session_t *s1 = pn_session(c);
+    pn_link_t *a = pn_sender(s1, "a");
+    pn_session_t *s2 = pn_session(c);
+    pn_link_t *b = pn_receiver(s1, "b");
+    pn_link_t *x = pn_sender(s2, "x");
+    pn_link_t *c1 = pn_sender(s1, "c");
+    pn_link_open(c1);
+
+    assert(pn_session_head(c, 0) == s1);
+    assert(pn_session_next(s1, 0) == s2);
+    assert(pn_session_next(s2, 0) == NULL);
+
+    assert(pn_link_head(c, 0) == a);
+    assert(pn_link_next(a, 0) == b);
+    assert(pn_link_next(b, 0) == x);
+    assert(pn_link_next(x, 0) == c1);
+    assert(pn_link_next(c1, 0) == NULL);
+    assert(pn_link_head(c, PN_LOCAL_ACTIVE) == c1);
+
+    assert(pn_session_sender_head(s1, 0) == a);
+    assert(pn_link_session_next(a, 0) == c1);
+    assert(pn_link_session_next(c1, 0) == NULL);
+    assert(pn_session_sender_head(s1, PN_LOCAL_ACTIVE) == c1);
+    assert(pn_session_receiver_head(s1, 0) == b);
+    assert(pn_link_session_next(b, 0) == NULL);
+    assert(pn_session_sender_head(s2, 0) == x);
+    assert(pn_session_receiver_head(s2, 0) == NULL);
+
+    pn_link_free(a);
+    assert(pn_session_sender_head(s1, 0) == c1);
+    assert(pn_link_head(c, 0) == b);
+    pn_session_free(s1);
+    assert(pn_session_head(c, 0) == s2);
+    assert(pn_link_head(c, 0) == x);
+
+    pn_connection_free(c);
+    return 0;
+}
+
+// links freed on a live connection are reused with their termini, reset
+static int test_link_pool(int argc, char **argv)
+{
+    fprintf(stdout, "test_link_pool\n");
+    pn_connection_t *c1 = pn_connection();
+    pn_transport_t  *t1 = pn_transport();
+    pn_transport_bind(t1, c1);
+    pn_collector_t *events = pn_collector();
+    pn_connection_collect(c1, events); // Releases links once they are unbound
+
+    pn_connection_t *c2 = pn_connection();
+    pn_transport_t  *t2 = pn_transport();
+    pn_transport_set_server(t2);
+    pn_transport_bind(t2, c2);
+
+    test_setup(c1, t1,
+               c2, t2);
+    pn_session_t *s1 = pn_session_head(c1, 0);
+
+    // An RPC client's reply receivers, one per request
+    pn_link_t *prev = NULL;
+    for (int i = 0; i < 5; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "reply-%d", i);
+        pn_link_t *rx = pn_receiver(s1, name);
+        if (prev) assert(rx == prev);
+        assert(!strcmp(pn_link_name(rx), name));
+        assert(pn_link_state(rx) == (PN_LOCAL_UNINIT | PN_REMOTE_UNINIT));
+        pn_terminus_t *src = pn_link_source(rx);
+        assert(pn_terminus_get_type(src) == PN_SOURCE);
+        assert(pn_terminus_get_address(src) == NULL);
+        assert(!pn_terminus_is_dynamic(src));
+        assert(pn_data_size(pn_terminus_filter(src)) == 0);
+        assert(pn_terminus_get_type(pn_link_remote_source(rx)) == PN_UNSPECIFIED);
+        assert(!pn_condition_is_set(pn_link_condition(rx)));
+        assert(pn_record_get(pn_link_attachments(rx), PN_LEGCTX) == NULL);
+
+        pn_terminus_set_dynamic(src, true);
+        pn_data_put_symbol(pn_terminus_filter(src), pn_bytes(6, "filter"));
+        pn_condition_set_name(pn_link_condition(rx), "amqp:link:detach-forced");
+        pn_record_def(pn_link_attachments(rx), PN_LEGCTX, PN_VOID);
+        pn_record_set(pn_link_attachments(rx), PN_LEGCTX, rx);
+        pn_link_open(rx);
+        pn_link_flow(rx, 1);
+        while (pump(t1, t2)) {
+            process_endpoints(c1);
+            process_endpoints(c2);
+        }
+        assert(pn_link_state(rx) == (PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE));
+
+        pn_link_close(rx);
+        pn_link_free(rx);
+        while (pump(t1, t2)) {
+            process_endpoints(c1);
+            process_endpoints(c2);
+        }
+        pn_collector_drain(events);
+        prev = rx;
+    }
+
+    pn_transport_unbind(t1);
+    pn_transport_free(t1);
+    pn_connection_free(c1);
+    pn_collector_free(events);
+
+    pn_transport_unbind(t2);
+    pn_transport_free(t2);
+    pn_connection_free(c2);
+    return 0;
+}
+
 typedef int (*test_ptr_t)(int argc, char **argv);
 
 test_ptr_t tests[] = {test_free_connection,
                       test_free_session,
                       test_free_link,
                       test_link_name_prefix,
+                      test_pooled_outlive_connection,
+                      test_delivery_pool,
+                      test_delivery_reserve,
+                      test_session_links,
+                      test_link_pool,
                       NULL};
 
 int main(int argc, char **argv)
@@ -96,6 +96,111 @@ static void test_event_incref(bool eventfirst) {
   }
 }
 
+static void test_collector_ring(void) {
+  pn_collector_t *collector = pn_collector();
+  pn_collector_set_ring(collector, 2);
+  void *obj = pn_class_new(PN_OBJECT, 0);
+  pn_event_t *e1 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_INIT);
+  pn_event_t *e2 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_BOUND);
+  pn_event_t *e3 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_LOCAL_OPEN);
+  assert(e1 && e2 && e3);
+  assert(pn_refcount(obj) == 4);
+  pn_record_t *r = pn_event_attachments(e1);
+  assert(r);
+  assert(pn_event_attachments(e1) == r);
+  /* The ring slots come back in order, the overflow event came from the pool */
+  assert(pn_collector_next(collector) == e1);
+  assert(pn_collector_next(collector) == e2);
+  assert(pn_refcount(obj) == 3);
+  pn_event_t *e4 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_REMOTE_OPEN);
+  assert(e4 == e1);
+  assert(pn_event_type(e4) == PN_CONNECTION_REMOTE_OPEN);
+  assert(pn_collector_next(collector) == e3);
+  assert(pn_collector_next(collector) == e4);
+  assert(!pn_collector_next(collector));
+  assert(pn_refcount(obj) == 1);
+  pn_decref(obj);
+  pn_free(collector);
+}
+
+static void test_collector_reserve(void) {
+  pn_collector_t *collector = pn_collector();
+  pn_collector_set_ring(collector, 2);
+  assert(pn_collector_reserve(collector, 3) == 0);
+  void *obj = pn_class_new(PN_OBJECT, 0);
+  /* Two ring events, then the one reserved in the pool */
+  pn_event_t *e1 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_INIT);
+  pn_event_t *e2 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_BOUND);
+  pn_event_t *e3 = pn_collector_put(collector, PN_OBJECT, obj, PN_CONNECTION_LOCAL_OPEN);
+  assert(e1 && e2 && e3);
+  assert(pn_collector_next(collector) == e1);
+  assert(pn_collector_next(collector) == e2);
+  assert(pn_collector_next(collector) == e3);
+  assert(!pn_collector_next(collector));
+  pn_decref(obj);
+  pn_free(collector);
+}
+
+static void test_collector_wanted(void) {
+  pn_collector_t *collector = pn_collector();
+  void *obj = pn_class_new(PN_OBJECT, 0);
+  assert(pn_collector_wanted(collector, PN_DELIVERY));
+  pn_collector_set_wanted(collector, PN_DELIVERY, false);
+  assert(!pn_collector_wanted(collector, PN_DELIVERY));
+  assert(!pn_collector_put(collector, PN_OBJECT, obj, PN_DELIVERY));
+  assert(!pn_collector_peek(collector));
+  assert(pn_refcount(obj) == 1);
+  assert(pn_collector_put(collector, PN_OBJECT, obj, PN_LINK_FLOW));
+  /* Turn everything off, then back on one type at a time */
+  pn_collector_set_wanted(collector, PN_EVENT_NONE, false);
+  assert(!pn_collector_put(collector, PN_OBJECT, obj, PN_TRANSPORT));
+  pn_collector_set_wanted(collector, PN_TRANSPORT, true);
+  assert(pn_collector_put(collector, PN_OBJECT, obj, PN_TRANSPORT));
+  assert(!pn_collector_wanted(collector, PN_DELIVERY));
+  pn_collector_set_wanted(collector, PN_EVENT_NONE, true);
+  assert(pn_collector_wanted(collector, PN_DELIVERY));
+  assert(pn_event_type(pn_collector_next(collector)) == PN_LINK_FLOW);
+  assert(pn_event_type(pn_collector_next(collector)) == PN_TRANSPORT);
+  assert(!pn_collector_next(collector));
+  pn_decref(obj);
+  pn_free(collector);
+}
+
+static void test_collector_unique(void) {
+  pn_collector_t *collector = pn_collector();
+  enum { N = 40 };
+  void *objs[N];
+  for (int i = 0; i < N; ++i) objs[i] = pn_class_new(PN_OBJECT, 0);
+  assert(pn_collector_unique(collector, PN_DELIVERY));
+  assert(!pn_collector_unique(collector, PN_TRANSPORT));
+  /* A pending duplicate is dropped even when it is not the tail */
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < N; ++i) {
+      pn_event_t *e = pn_collector_put(collector, PN_OBJECT, objs[i], PN_DELIVERY);
+      assert(round ? !e : !!e);
+      assert(pn_collector_put(collector, PN_OBJECT, objs[i], PN_TRANSPORT));
+    }
+  }
+  assert(pn_refcount(objs[0]) == 1 + 3 + 1);
+  /* Consumed events no longer count, other objects stay pending */
+  assert(pn_event_type(pn_collector_next(collector)) == PN_DELIVERY);
+  assert(pn_collector_put(collector, PN_OBJECT, objs[0], PN_DELIVERY));
+  assert(!pn_collector_put(collector, PN_OBJECT, objs[1], PN_DELIVERY));
+  pn_collector_set_unique(collector, PN_DELIVERY, false);
+  assert(pn_collector_put(collector, PN_OBJECT, objs[1], PN_DELIVERY));
+  int deliveries = 0;
+  pn_event_t *e;
+  while ((e = pn_collector_next(collector))) {
+    if (pn_event_type(e) == PN_DELIVERY) ++deliveries;
+  }
+  assert(deliveries == N + 1);  /* the first one was consumed above */
+  for (int i = 0; i < N; ++i) {
+    assert(pn_refcount(objs[i]) == 1);
+    pn_decref(objs[i]);
+  }
+  pn_free(collector);
+}
+
 int main(int argc, char **argv)
 {
   test_collector();
@@ -105,5 +210,9 @@ int main(int argc, char **argv)
   test_collector_pool();
   test_event_incref(true);
   test_event_incref(false);
+  test_collector_ring();
+  test_collector_reserve();
+  test_collector_wanted();
+  test_collector_unique();
   return 0;
 }
@@ -0,0 +1,275 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Replay the AMQP frames read by a captured connection through a fresh
+ * pn_connection_driver_t as fast as it will take them, measuring parse and
+ * dispatch cost.
+ *
+ * Usage: c-frame-replay [-n repeat] [-c chunk-bytes] capture-file
+ *
+ * Capture files are written by pn_transport_capture_file(), or by setting
+ * PN_PROACTOR_CAPTURE for a proactor application. SASL frames are skipped,
+ * the replaying connection opens whatever the peer opened, gives receivers
+ * plenty of credit and reads and settles every message. Its own output is
+ * thrown away. Sessions and links the captured connection opened are
+ * replayed as opened by the peer.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "test_handler.h"
+#include <proton/connection.h>
+#include <proton/session.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, c;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart * 1e9 / (double)f.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+#endif
+}
+
+static const char CAPTURE_MAGIC[8] = {'P', 'N', 'C', 'A', 'P', '0', '1', '\n'};
+static const char AMQP_HEADER[8] = {'A', 'M', 'Q', 'P', 0, 1, 0, 0};
+enum { RECORD_HEADER = 13, FRAME_TYPE_OFFSET = 5, SASL_FRAME_TYPE = 1, BEGIN = 0x11 };
+
+static uint32_t read32(const unsigned char *b) {
+  return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+typedef struct replay_t {
+  pn_rwbytes_t input;           /* AMQP header then the frames read */
+  size_t *begins;               /* Offsets just past each begin frame */
+  size_t nbegins;
+  size_t frames, skipped;
+  size_t deliveries;            /* Counted in the current run */
+  pn_rwbytes_t buf;
+} replay_t;
+
+static void write32(unsigned char *b, uint32_t v) {
+  b[0] = (unsigned char)(v >> 24); b[1] = (unsigned char)(v >> 16);
+  b[2] = (unsigned char)(v >> 8); b[3] = (unsigned char)v;
+}
+
+/* True if the frame is a begin performative */
+static bool is_begin(const unsigned char *frame, size_t size) {
+  size_t body = (size_t)frame[4] * 4;
+  return body + 3 <= size && frame[body] == 0 && frame[body+1] == 0x53 && frame[body+2] == BEGIN;
+}
+
+/* The peer's answer to a begin sent by the captured connection names the
+   channel of that session as remote-channel, which the replaying
+   connection never began.  Make it null, so the replay takes it for a
+   begin from the peer and answers it; links attached in answer likewise
+   become links attached by the peer.  Return the new frame size. */
+static size_t unanswer_begin(unsigned char *frame, size_t size) {
+  unsigned char *list = frame + (size_t)frame[4] * 4 + 3;
+  size_t header;                /* List constructor, size and count */
+  switch (list[0]) {
+   case 0xc0: header = 3; break;
+   case 0xd0: header = 9; break;
+   default: return size;        /* Empty list */
+  }
+  unsigned char *first = list + header;
+  if (first >= frame + size || *first != 0x60) return size; /* Not a ushort */
+  *first = 0x40;
+  memmove(first + 1, first + 3, frame + size - (first + 3));
+  if (list[0] == 0xc0) list[1] -= 2;
+  else write32(list + 1, read32(list + 1) - 2);
+  write32(frame, (uint32_t)size - 2);
+  return size - 2;
+}
+
+/* Collect the frames read into r->input, return false if the file is bad */
+static bool load(replay_t *r, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  bool ok = false;
+  char magic[sizeof(CAPTURE_MAGIC)];
+  size_t size = sizeof(AMQP_HEADER);
+  rwbytes_ensure(&r->input, size);
+  memcpy(r->input.start, AMQP_HEADER, size);
+  if (fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, CAPTURE_MAGIC, sizeof(magic))) {
+    fprintf(stderr, "%s: not a frame capture file\n", path);
+    goto done;
+  }
+  for (;;) {
+    unsigned char h[RECORD_HEADER];
+    size_t got = fread(h, 1, sizeof(h), f);
+    if (got == 0) break;
+    if (got != sizeof(h)) goto truncated;
+    uint32_t n = read32(h + 9);
+    rwbytes_ensure(&r->input, size + n);
+    if (fread(r->input.start + size, 1, n, f) != n) goto truncated;
+    if (h[0]) continue;         /* Written by the captured connection */
+    if (n > FRAME_TYPE_OFFSET && r->input.start[size + FRAME_TYPE_OFFSET] == SASL_FRAME_TYPE) {
+      ++r->skipped;
+      continue;
+    }
+    if (is_begin((unsigned char*)r->input.start + size, n)) {
+      n = unanswer_begin((unsigned char*)r->input.start + size, n);
+      r->begins = (size_t*)realloc(r->begins, (r->nbegins + 1) * sizeof(size_t));
+      TEST_ASSERT(r->begins);
+      r->begins[r->nbegins++] = size + n;
+    }
+    size += n;
+    ++r->frames;
+  }
+  r->input.size = size;
+  ok = true;
+  goto done;
+ truncated:
+  fprintf(stderr, "%s: truncated frame record\n", path);
+ done:
+  fclose(f);
+  return ok;
+}
+
+static pn_event_type_t replay_handler(test_handler_t *th, pn_event_t *e) {
+  replay_t *r = (replay_t*)th->context;
+  test_handler_keep(th, 0);
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_open(pn_event_connection(e));
+    break;
+   case PN_SESSION_REMOTE_OPEN:
+    pn_session_open(pn_event_session(e));
+    break;
+   case PN_LINK_REMOTE_OPEN: {
+     pn_link_t *l = pn_event_link(e);
+     pn_link_open(l);
+     if (pn_link_is_receiver(l)) pn_link_flow(l, 1 << 30);
+     break;
+   }
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     pn_link_t *l = pn_delivery_link(d);
+     if (pn_link_is_receiver(l) && pn_delivery_readable(d) && !pn_delivery_partial(d)) {
+       size_t size = pn_delivery_pending(d);
+       rwbytes_ensure(&r->buf, size);
+       pn_link_recv(l, r->buf.start, size);
+       pn_link_advance(l);
+       pn_delivery_update(d, PN_ACCEPTED);
+       pn_delivery_settle(d);
+       ++r->deliveries;
+     } else if (pn_delivery_updated(d)) {
+       pn_delivery_settle(d);
+     }
+     break;
+   }
+   default:
+    break;
+  }
+  return PN_EVENT_NONE;
+}
+
+/* Time one replay of all the frames, return the elapsed ns */
+static double run(replay_t *r, test_t *t, size_t chunk) {
+  test_connection_driver_t d;
+  test_connection_driver_init(&d, t, replay_handler, NULL, NULL);
+  d.handler.context = r;
+  /* The peer paced its transfers by the captured connection's session
+     window, which the replay can't reproduce: no frame size limit also
+     means no session window limit */
+  pn_transport_set_max_frame(d.driver.transport, 0);
+  r->deliveries = 0;
+  double start = now_ns();
+  size_t offset = 0, begin = 0;
+  while (offset < r->input.size) {
+    /* Stop after each begin so the handler opens the session, and with it
+       the session window, before any transfers on it arrive */
+    while (begin < r->nbegins && r->begins[begin] <= offset) ++begin;
+    size_t end = begin < r->nbegins ? r->begins[begin] : r->input.size;
+    size_t n = end - offset < chunk ? end - offset : chunk;
+    size_t taken = pn_connection_driver_read_external(&d.driver, r->input.start + offset, n);
+    offset += taken;
+    test_connection_driver_handle(&d);
+    pn_bytes_t out = pn_connection_driver_write_buffer(&d.driver);
+    if (out.size) pn_connection_driver_write_done(&d.driver, out.size);
+    if (!taken && !out.size && !pn_connection_driver_has_event(&d.driver)) break;
+  }
+  double elapsed = now_ns() - start;
+  TEST_CHECKF(t, offset == r->input.size, "replay stopped after %zu of %zu bytes: %s",
+              offset, r->input.size,
+              pn_condition_get_description(pn_transport_condition(d.driver.transport)));
+  test_connection_driver_destroy(&d);
+  return elapsed;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n repeat] [-c chunk-bytes] capture-file\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  size_t repeat = 10, chunk = 64 * 1024;
+  int i = 1;
+  for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+    const char *v = argv[i+1];
+    switch (argv[i][1]) {
+     case 'n': repeat = strtoul(v, NULL, 0); break;
+     case 'c': chunk = strtoul(v, NULL, 0); break;
+     default: usage(argv[0]);
+    }
+  }
+  if (i + 1 != argc || !repeat || !chunk) usage(argv[0]);
+
+  test_t t = { "frame_replay", 0 };
+  replay_t r;
+  memset(&r, 0, sizeof(r));
+  if (!load(&r, argv[i])) return 1;
+
+  double best = 0, total = 0;
+  for (size_t n = 0; n < repeat && !t.errors; ++n) {
+    double ns = run(&r, &t, chunk);
+    if (!n || ns < best) best = ns;
+    total += ns;
+  }
+  if (!t.errors) {
+    size_t bytes = r.input.size - sizeof(AMQP_HEADER);
+    printf("%zu frames (%zu SASL skipped), %zu bytes, %zu deliveries, %zu runs\n",
+           r.frames, r.skipped, bytes, r.deliveries, repeat);
+    printf("best %.3f ms mean %.3f ms\n", best / 1e6, total / repeat / 1e6);
+    printf("%12.0f frames/s %10.1f MB/s %8.1f ns/frame\n",
+           r.frames / (best / 1e9), bytes / (best / 1e9) / 1e6, r.frames ? best / r.frames : 0.0);
+  }
+  free(r.input.start);
+  free(r.begins);
+  free(r.buf.start);
+  return t.errors;
+}
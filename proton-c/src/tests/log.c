@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <proton/log.h>
+#include <proton/transport.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int fail = 0;
+
+#define TEST_ASSERT(B)                                  \
+    if(!(B)) {                                          \
+        ++fail;                                         \
+        printf("%s:%d %s\n", __FILE__, __LINE__ , #B); \
+    }
+
+static int logged = 0;
+static size_t last_len = 0;
+static char last[128];
+
+static void counting_logger(const char *message) {
+    ++logged;
+    last_len = strlen(message);
+    strncpy(last, message, sizeof(last) - 1);
+}
+
+static void test_levels(void) {
+    pn_log_set_level(PN_SUBSYSTEM_ALL, PN_LEVEL_NONE);
+    TEST_ASSERT(!pn_log_level_enabled(PN_SUBSYSTEM_EVENT, PN_LEVEL_ERROR));
+    pn_log_set_level(PN_SUBSYSTEM_EVENT, PN_LEVEL_DEBUG);
+    TEST_ASSERT(pn_log_level_enabled(PN_SUBSYSTEM_EVENT, PN_LEVEL_ERROR));
+    TEST_ASSERT(pn_log_level_enabled(PN_SUBSYSTEM_EVENT, PN_LEVEL_DEBUG));
+    TEST_ASSERT(!pn_log_level_enabled(PN_SUBSYSTEM_EVENT, PN_LEVEL_TRACE));
+    TEST_ASSERT(!pn_log_level_enabled(PN_SUBSYSTEM_ENGINE, PN_LEVEL_ERROR));
+    TEST_ASSERT(!pn_log_level_enabled(PN_SUBSYSTEM_ALL, PN_LEVEL_ERROR));
+}
+
+/* The default tracer writes through the logger, at once or from the writer thread */
+static void test_tracer(bool async) {
+    pn_transport_t *t = pn_transport();
+    logged = 0;
+    pn_log_set_async(async);
+    for (int i = 0; i < 100; ++i) {
+        pn_transport_logf(t, "message %d", i);
+    }
+    pn_log_flush();
+    TEST_ASSERT(logged == 100);
+    TEST_ASSERT(strstr(last, "]:message 99"));
+    pn_log_set_async(false);
+    pn_transport_free(t);
+}
+
+/* Long messages are whole when written at once, cut when queued */
+static void test_long(void) {
+    pn_transport_t *t = pn_transport();
+    char big[1000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    pn_transport_logf(t, "%s", big);
+    TEST_ASSERT(last_len > sizeof(big) - 1);
+    pn_log_set_async(true);
+    pn_transport_logf(t, "%s", big);
+    pn_log_flush();
+    TEST_ASSERT(last_len == 511);
+    pn_log_set_async(false);
+    pn_transport_free(t);
+}
+
+int main(int argc, char **argv) {
+    pn_log_logger(counting_logger);
+    test_levels();
+    test_tracer(false);
+    test_tracer(true);
+    test_long();
+    return fail;
+}
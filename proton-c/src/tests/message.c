@@ -23,8 +23,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <proton/codec.h>
 #include <proton/error.h>
 #include <proton/message.h>
+#include <proton/message_selector.h>
 
 #define assert(E) ((E) ? 0 : (abort(), 0))
 
@@ -40,8 +42,352 @@ static void test_overflow_error(void)
   pn_message_free(message);
 }
 
+static void test_decode_reencode(void)
+{
+  pn_message_t *message = pn_message();
+  pn_message_set_address(message, "queue");
+  pn_data_t *props = pn_message_properties(message);
+  pn_data_put_map(props);
+  pn_data_enter(props);
+  pn_data_put_string(props, pn_bytes(3, "key"));
+  pn_data_put_int(props, 42);
+  pn_data_exit(props);
+  pn_data_put_string(pn_message_body(message), pn_bytes(5, "hello"));
+
+  char buf[256];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+  assert(pn_message_encoded_size(message) == (ssize_t) size);
+
+  /* Untouched sections are re-encoded exactly as received */
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode(copy, buf, size) == 0);
+  char buf2[256];
+  size_t size2 = sizeof(buf2);
+  assert(pn_message_encode(copy, buf2, &size2) == 0);
+  assert(size2 == size && memcmp(buf, buf2, size) == 0);
+
+  /* Sections are decoded when accessed */
+  assert(strcmp(pn_message_get_address(copy), "queue") == 0);
+  props = pn_message_properties(copy);
+  assert(pn_data_next(props) && pn_data_type(props) == PN_MAP);
+  assert(pn_data_get_map(props) == 2);
+  pn_data_enter(props);
+  assert(pn_data_next(props) && pn_data_next(props) && pn_data_get_int(props) == 42);
+  pn_data_t *body = pn_message_body(copy);
+  assert(pn_data_next(body) && pn_data_type(body) == PN_STRING);
+  assert(pn_data_get_string(body).size == 5);
+
+  /* Modified sections are encoded from the new content */
+  pn_data_clear(body);
+  pn_data_put_string(body, pn_bytes(7, "goodbye"));
+  size2 = sizeof(buf2);
+  assert(pn_message_encode(copy, buf2, &size2) == 0);
+  assert(size2 == size + 2);
+  assert(pn_message_encoded_size(copy) == (ssize_t) size2);
+
+  /* A truncated message is an error, not an overrun */
+  assert(pn_message_decode(copy, buf, size - 1) == PN_UNDERFLOW);
+
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* A malformed section is found when it is accessed, not by pn_message_decode */
+static void test_decode_deferred_error(void)
+{
+  pn_message_t *message = pn_message();
+  pn_data_t *props = pn_message_properties(message);
+  pn_data_put_map(props);
+  pn_data_enter(props);
+  pn_data_put_string(props, pn_bytes(3, "key"));
+  pn_data_put_int(props, 42);
+  pn_data_exit(props);
+  pn_data_put_string(pn_message_body(message), pn_bytes(5, "hello"));
+
+  char buf[256];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+  /* Corrupt the type of the first key: described 0x74, map8 size count, key */
+  char *section = NULL;
+  for (size_t i = 0; i + 6 < size && !section; i++) {
+    if (buf[i] == 0x00 && buf[i+1] == 0x53 && buf[i+2] == 0x74) section = buf + i;
+  }
+  assert(section && (uint8_t) section[3] == 0xc1);
+  section[6] = (char) 0xff;
+
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode(copy, buf, size) == 0);
+  assert(pn_message_errno(copy) == 0);
+  assert(pn_data_size(pn_message_properties(copy)) == 0);
+  assert(pn_message_errno(copy) != 0);
+  assert(pn_error_text(pn_message_error(copy)));
+  /* The other sections are unaffected */
+  pn_data_t *body = pn_message_body(copy);
+  assert(pn_data_next(body) && pn_data_get_string(body).size == 5);
+
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* Clearing resets the property strings whether set directly or decoded */
+static void test_clear(void)
+{
+  pn_message_t *message = pn_message();
+  pn_message_set_subject(message, "subject");
+  pn_message_set_user_id(message, pn_bytes(4, "user"));
+  pn_message_clear(message);
+  assert(pn_message_get_subject(message) == NULL);
+  assert(pn_message_get_user_id(message).size == 0);
+
+  pn_message_set_reply_to(message, "reply");
+  char buf[256];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode(copy, buf, size) == 0);
+  assert(strcmp(pn_message_get_reply_to(copy), "reply") == 0);
+  pn_message_clear(copy);
+  assert(pn_message_get_reply_to(copy) == NULL);
+  assert(pn_message_get_address(copy) == NULL);
+
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* Skipped sections are left out, the others decode as usual */
+static void test_decode_partial(void)
+{
+  pn_message_t *message = pn_message();
+  pn_message_set_address(message, "queue");
+  pn_message_set_priority(message, 7);
+  pn_data_t *annotations = pn_message_annotations(message);
+  pn_data_put_map(annotations);
+  pn_data_enter(annotations);
+  pn_data_put_symbol(annotations, pn_bytes(5, "x-key"));
+  pn_data_put_int(annotations, 1);
+  pn_data_exit(annotations);
+  pn_data_put_string(pn_message_body(message), pn_bytes(5, "hello"));
+
+  char buf[256];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+
+  const uint64_t body[] = {0x75, 0x76, 0x77};
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode_partial(copy, buf, size, body, 3) == 0);
+  assert(strcmp(pn_message_get_address(copy), "queue") == 0);
+  assert(pn_message_get_priority(copy) == 7);
+  annotations = pn_message_annotations(copy);
+  assert(pn_data_next(annotations) && pn_data_get_map(annotations) == 2);
+  assert(!pn_data_next(pn_message_body(copy)));
+
+  /* Re-encoded without the body */
+  char buf2[256];
+  size_t size2 = sizeof(buf2);
+  assert(pn_message_encode(copy, buf2, &size2) == 0);
+  assert(size2 < size && memcmp(buf, buf2, size2) == 0);
+
+  /* Nothing skipped is the same as pn_message_decode */
+  assert(pn_message_decode_partial(copy, buf, size, NULL, 0) == 0);
+  size2 = sizeof(buf2);
+  assert(pn_message_encode(copy, buf2, &size2) == 0);
+  assert(size2 == size && memcmp(buf, buf2, size) == 0);
+
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* Encoding into a grown buffer gives the same bytes */
+static void test_encode2(void)
+{
+  pn_message_t *message = pn_message();
+  pn_message_set_address(message, "queue");
+  char text[1000];
+  memset(text, 'x', sizeof(text));
+  pn_data_put_string(pn_message_body(message), pn_bytes(sizeof(text), text));
+
+  char buf[2048];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+  pn_rwbytes_t grown = pn_rwbytes(0, NULL);
+  assert(pn_message_encode2(message, &grown) == (ssize_t) size);
+  assert(grown.size >= size && memcmp(buf, grown.start, size) == 0);
+
+  /* Received sections are copied as is */
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode(copy, buf, size) == 0);
+  assert(pn_message_encode2(copy, &grown) == (ssize_t) size);
+  assert(memcmp(buf, grown.start, size) == 0);
+
+  free(grown.start);
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* A compressed JSON body survives encoding and inflates to the original */
+static void test_compress(void)
+{
+  char json[4096];
+  size_t n = 0;
+  while (n + 40 < sizeof(json))
+    n += sprintf(json + n, "{\"id\": %6d, \"name\": \"sensor\"},", (int) n);
+
+  pn_message_t *message = pn_message();
+  pn_data_put_binary(pn_message_body(message), pn_bytes(n, json));
+  assert(pn_message_compress(message, n + 1) == 0); /* Too small */
+  assert(pn_message_get_content_encoding(message) == NULL);
+  if (!pn_message_compress_present()) {
+    assert(pn_message_compress(message, 0) == 0);
+    assert(pn_message_get_content_encoding(message) == NULL);
+    pn_message_free(message);
+    return;
+  }
+  assert(pn_message_compress(message, 0) == 0);
+  assert(strcmp(pn_message_get_content_encoding(message), "deflate") == 0);
+  pn_data_t *body = pn_message_body(message);
+  pn_data_rewind(body);
+  assert(pn_data_next(body) && pn_data_get_binary(body).size < n / 4);
+
+  /* Already encoded bodies are left alone */
+  pn_bytes_t deflated = pn_data_get_binary(body);
+  assert(pn_message_compress(message, 0) == 0);
+  pn_data_rewind(body);
+  assert(pn_data_next(body) && pn_data_get_binary(body).size == deflated.size);
+
+  char buf[8192];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+  pn_message_t *copy = pn_message();
+  assert(pn_message_decode(copy, buf, size) == 0);
+  /* A body that inflates past the limit is left compressed */
+  assert(pn_message_decompress(copy, n - 1) == PN_OVERFLOW);
+  assert(pn_message_errno(copy) == PN_OVERFLOW);
+  assert(strcmp(pn_message_get_content_encoding(copy), "deflate") == 0);
+  assert(pn_message_decompress(copy, n) == 0);
+  assert(pn_message_get_content_encoding(copy) == NULL);
+  body = pn_message_body(copy);
+  pn_data_rewind(body);
+  assert(pn_data_next(body));
+  pn_bytes_t inflated = pn_data_get_binary(body);
+  assert(inflated.size == n && memcmp(inflated.start, json, n) == 0);
+  assert(pn_message_decompress(copy, n) == 0); /* Nothing to do */
+
+  /* A corrupt body is an error */
+  pn_message_set_content_encoding(copy, "deflate");
+  assert(pn_message_decompress(copy, PN_DEFAULT_DECOMPRESS_MAX) == PN_ERR);
+  assert(pn_message_errno(copy) == PN_ERR);
+
+  pn_message_free(copy);
+  pn_message_free(message);
+}
+
+/* 1 if expression selects the message encoded in buf, 0 if not, or the error */
+static int selects(const char *expression, const char *buf, size_t size)
+{
+  pn_message_selector_t *selector = pn_message_selector(expression);
+  int result = pn_message_selector_match(selector, buf, size);
+  pn_message_selector_free(selector);
+  return result;
+}
+
+static void test_selector(void)
+{
+  pn_message_t *message = pn_message();
+  pn_message_set_durable(message, true);
+  pn_message_set_priority(message, 7);
+  pn_message_set_subject(message, "order");
+  pn_message_set_creation_time(message, 1000);
+  pn_data_t *props = pn_message_properties(message);
+  pn_data_put_map(props);
+  pn_data_enter(props);
+  pn_data_put_string(props, pn_bytes(6, "colour"));
+  pn_data_put_string(props, pn_bytes(3, "red"));
+  pn_data_put_string(props, pn_bytes(6, "weight"));
+  pn_data_put_int(props, 42);
+  pn_data_put_string(props, pn_bytes(5, "price"));
+  pn_data_put_double(props, 2.5);
+  pn_data_put_string(props, pn_bytes(4, "fast"));
+  pn_data_put_bool(props, true);
+  pn_data_put_string(props, pn_bytes(4, "path"));
+  pn_data_put_string(props, pn_bytes(6, "a_b%cd"));
+  pn_data_exit(props);
+  pn_data_put_string(pn_message_body(message), pn_bytes(5, "hello"));
+
+  char buf[512];
+  size_t size = sizeof(buf);
+  assert(pn_message_encode(message, buf, &size) == 0);
+
+  assert(selects("", buf, size) == 1);
+  assert(selects(NULL, buf, size) == 1);
+  assert(selects("colour = 'red'", buf, size) == 1);
+  assert(selects("colour <> 'red'", buf, size) == 0);
+  assert(selects("weight > 40 AND weight < 50", buf, size) == 1);
+  assert(selects("weight * 2 + 1 = 85 and price / 2 = 1.25", buf, size) == 1);
+  assert(selects("-weight = -42.0", buf, size) == 1);
+  assert(selects("weight BETWEEN 42 AND 0x2a", buf, size) == 1);
+  assert(selects("weight NOT BETWEEN 1 AND 100", buf, size) == 0);
+  assert(selects("fast AND NOT (colour IN ('green', 'blue'))", buf, size) == 1);
+  assert(selects("colour IN ('green', 'red')", buf, size) == 1);
+  assert(selects("colour LIKE 'r%'", buf, size) == 1);
+  assert(selects("colour LIKE '_e_'", buf, size) == 1);
+  assert(selects("colour LIKE '%x%'", buf, size) == 0);
+  assert(selects("path LIKE 'a!_b!%%' ESCAPE '!'", buf, size) == 1);
+  assert(selects("path LIKE 'a!_b!%' ESCAPE '!'", buf, size) == 0);
+  assert(selects("'it''s' = 'it''s'", buf, size) == 1);
+
+  /* Header and properties fields */
+  assert(selects("JMSDeliveryMode = 'PERSISTENT' AND JMSPriority = 7", buf, size) == 1);
+  assert(selects("JMSType = 'order' AND JMSTimestamp >= 1000", buf, size) == 1);
+  assert(selects("JMSCorrelationID IS NULL AND JMSMessageID IS NULL", buf, size) == 1);
+
+  /* Absent properties and mismatched types are unknown, neither true nor false */
+  assert(selects("size > 1", buf, size) == 0);
+  assert(selects("NOT (size > 1)", buf, size) == 0);
+  assert(selects("size IS NULL", buf, size) == 1);
+  assert(selects("colour IS NOT NULL", buf, size) == 1);
+  assert(selects("colour > 1", buf, size) == 0);
+  assert(selects("NOT (colour > 1)", buf, size) == 0);
+  assert(selects("size > 1 OR colour = 'red'", buf, size) == 1);
+  assert(selects("size > 1 AND colour = 'blue'", buf, size) == 0);
+  assert(selects("weight / 0 IS NULL", buf, size) == 1);
+
+  /* Errors are found when compiling */
+  const char *bad[] = {"colour =", "colour = 'red", "(a = 1", "a = 1 b", "a NOT 1",
+                       "a IN (1)", "a LIKE 'x!' ESCAPE '!'", "12abc = 1", "#"};
+  for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+    pn_message_selector_t *selector = pn_message_selector(bad[i]);
+    assert(pn_error_code(pn_message_selector_error(selector)) == PN_ARG_ERR);
+    assert(pn_message_selector_match(selector, buf, size) == PN_ARG_ERR);
+    pn_message_selector_free(selector);
+  }
+  char deep[512];
+  memset(deep, '(', 200);
+  strcpy(deep + 200, "1 = 1");
+  assert(selects(deep, buf, size) == PN_ARG_ERR);
+
+  /* A message with no properties selects on defaults, a malformed one is an error */
+  pn_message_t *empty = pn_message();
+  char buf2[64];
+  size_t size2 = sizeof(buf2);
+  assert(pn_message_encode(empty, buf2, &size2) == 0);
+  assert(selects("JMSPriority = 4 AND JMSDeliveryMode = 'NON_PERSISTENT'", buf2, size2) == 1);
+  assert(selects("colour = 'red'", buf, size - 4) == 1); /* The truncated body is never read */
+  assert(selects("colour = 'red'", buf, 5) < 0);
+  pn_message_free(empty);
+
+  pn_message_free(message);
+}
+
 int main(int argc, char **argv)
 {
   test_overflow_error();
+  test_decode_reencode();
+  test_decode_deferred_error();
+  test_clear();
+  test_decode_partial();
+  test_encode2();
+  test_compress();
+  test_selector();
   return 0;
 }
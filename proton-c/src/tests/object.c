@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <proton/object.h>
 
 #define assert(E) ((E) ? 0 : (abort(), 0))
@@ -689,6 +690,28 @@ static void test_string_addf(void)
   pn_free(str);
 }
 
+static void test_string_grow_inline(void)
+{
+  // short strings live inside the object, longer ones move out and back
+  const char *shortstr = "queue/a";
+  const char *longstr = "a rather longer address that does not fit inline";
+  pn_string_t *str = pn_string(shortstr);
+  assert(!strcmp(pn_string_get(str), shortstr));
+  char *inline_buffer = pn_string_buffer(str);
+  assert(pn_string_addf(str, " %s", longstr) == 0);
+  assert(pn_string_buffer(str) != inline_buffer);
+  assert(pn_string_size(str) == strlen(shortstr) + 1 + strlen(longstr));
+  assert(!strncmp(pn_string_get(str), shortstr, strlen(shortstr)));
+  assert(pn_string_set(str, shortstr) == 0);
+  assert(!strcmp(pn_string_get(str), shortstr));
+  pn_free(str);
+
+  str = pn_string(longstr);
+  assert(!strcmp(pn_string_get(str), longstr));
+  assert(pn_string_capacity(str) >= strlen(longstr));
+  pn_free(str);
+}
+
 static void test_map_iteration(int n)
 {
   pn_list_t *pairs = pn_list(PN_OBJECT, 2*n);
@@ -781,7 +804,7 @@ void test_map_inspect(void)
                 pn_string("k1"), pn_string("v1"),
                 pn_string("k2"), pn_string("v2"),
                 END);
-  test_inspect(m, "{\"k1\": \"v1\", \"k2\": \"v2\"}");
+  test_inspect(m, "{\"k2\": \"v2\", \"k1\": \"v1\"}");
   pn_free(m);
 
   m = build_map(0.75, 0,
@@ -789,7 +812,7 @@ void test_map_inspect(void)
                 pn_string("k2"), pn_string("v2"),
                 pn_string("k3"), pn_string("v3"),
                 END);
-  test_inspect(m, "{\"k3\": \"v3\", \"k1\": \"v1\", \"k2\": \"v2\"}");
+  test_inspect(m, "{\"k2\": \"v2\", \"k3\": \"v3\", \"k1\": \"v1\"}");
   pn_free(m);
 }
 
@@ -929,6 +952,93 @@ void test_map_coalesced_chain2(void)
   pn_free(map);
 }
 
+void test_hash_churn(void)
+{
+  pn_hash_t *map = pn_hash(PN_OBJECT, 0, 0.75);
+  void *value = pn_class_new(PN_OBJECT, 0);
+  const uintptr_t n = 4096;
+  for (uintptr_t i = 0; i < n; i++) {
+    pn_hash_put(map, i*7, value);
+  }
+  assert(pn_hash_size(map) == n);
+  assert(pn_refcount(value) == (int) n + 1);
+  for (uintptr_t i = 0; i < n; i += 2) {
+    pn_hash_del(map, i*7);
+  }
+  for (uintptr_t i = 0; i < n; i++) {
+    assert(pn_hash_get(map, i*7) == (i % 2 ? value : NULL));
+  }
+
+  //deleting the current entry must not disturb the iteration:
+  size_t visited = 0;
+  for (pn_handle_t h = pn_hash_head(map); h; h = pn_hash_next(map, h)) {
+    assert(pn_hash_key(map, h) % 2);
+    pn_hash_del(map, pn_hash_key(map, h));
+    visited++;
+  }
+  assert(visited == n/2);
+  assert(pn_hash_size(map) == 0);
+  assert(pn_refcount(value) == 1);
+
+  pn_free(value);
+  pn_free(map);
+}
+
+static double bench_seconds(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Not part of the test run: "c-object-tests bench" times map lookups */
+static void bench_map(void)
+{
+  const size_t keys = 1024, rounds = 4096;
+  pn_hash_t *hash = pn_hash(PN_OBJECT, 0, 0.75);
+  pn_map_t *map = pn_map(PN_OBJECT, PN_OBJECT, 0, 0.75);
+  pn_list_t *names = pn_list(PN_OBJECT, keys);
+  void *value = pn_class_new(PN_OBJECT, 0);
+  for (size_t i = 0; i < keys; i++) {
+    pn_string_t *name = pn_string(NULL);
+    pn_string_format(name, "queue/address-%zu", i);
+    pn_list_add(names, name);
+    pn_map_put(map, name, value);
+    pn_hash_put(hash, i, value);
+    pn_decref(name);
+  }
+
+  size_t found = 0;
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < keys; i++) {
+      found += pn_hash_get(hash, i) != NULL;
+    }
+  }
+  printf("pn_hash_get: %.1f ns\n", 1e9 * bench_seconds(start) / (keys * rounds));
+
+  start = clock();
+  for (size_t r = 0; r < rounds/16; r++) {
+    for (size_t i = 0; i < keys; i++) {
+      found += pn_map_get(map, pn_list_get(names, i)) != NULL;
+    }
+  }
+  printf("pn_map_get (string keys): %.1f ns\n", 1e9 * bench_seconds(start) / (keys * rounds/16));
+  assert(found == keys * rounds + keys * rounds/16);
+
+  start = clock();
+  for (size_t r = 0; r < rounds/16; r++) {
+    for (size_t i = 0; i < keys; i++) {
+      pn_hash_del(hash, i);
+      pn_hash_put(hash, i, value);
+    }
+  }
+  printf("pn_hash_del + pn_hash_put: %.1f ns\n", 1e9 * bench_seconds(start) / (keys * rounds/16));
+
+  pn_free(hash);
+  pn_free(map);
+  pn_free(names);
+  pn_free(value);
+}
+
 void test_list_compare(void)
 {
   pn_list_t *a = pn_list(PN_OBJECT, 0);
@@ -1041,6 +1151,46 @@ void test_heap(int seed, int size)
   pn_free(list);
 }
 
+PN_HANDLE(TEST_RECORD_KEY)
+
+void test_record_slots(void)
+{
+  pn_record_t *record = pn_record();
+  void *a = pn_class_new(PN_OBJECT, 0);
+  void *b = pn_class_new(PN_OBJECT, 0);
+  pn_handle_t slot = PN_RECORD_SLOT(PN_RECORD_SLOTS - 1);
+
+  assert(pn_record_has(record, PN_LEGCTX));
+  assert(!pn_record_has(record, slot));
+  pn_record_set(record, slot, a);      /* ignored until defined */
+  assert(!pn_record_get(record, slot));
+  assert(pn_refcount(a) == 1);
+
+  pn_record_def(record, slot, PN_OBJECT);
+  pn_record_def(record, TEST_RECORD_KEY, PN_OBJECT);
+  assert(pn_record_has(record, slot));
+  pn_record_set(record, slot, a);
+  pn_record_set(record, TEST_RECORD_KEY, b);
+  assert(pn_record_get(record, slot) == a);
+  assert(pn_record_get(record, TEST_RECORD_KEY) == b);
+  assert(pn_refcount(a) == 2);
+  pn_record_set(record, slot, b);
+  assert(pn_refcount(a) == 1);
+  assert(pn_refcount(b) == 3);
+
+  pn_record_clear(record);
+  assert(!pn_record_has(record, slot));
+  assert(pn_record_has(record, PN_LEGCTX));
+  assert(pn_refcount(b) == 1);
+
+  pn_record_def(record, slot, PN_OBJECT);
+  pn_record_set(record, slot, a);
+  pn_free(record);
+  assert(pn_refcount(a) == 1);
+  pn_free(a);
+  pn_free(b);
+}
+
 int main(int argc, char **argv)
 {
   for (size_t i = 0; i < 128; i++) {
@@ -1088,6 +1238,7 @@ int main(int argc, char **argv)
 
   test_string_format();
   test_string_addf();
+  test_string_grow_inline();
 
   test_build_list();
   test_build_map();
@@ -1110,6 +1261,12 @@ int main(int argc, char **argv)
 
   test_map_coalesced_chain();
   test_map_coalesced_chain2();
+  test_record_slots();
+  test_hash_churn();
+
+  if (argc > 1 && !strcmp(argv[1], "bench")) {
+    bench_map();
+  }
 
   return 0;
 }
@@ -258,6 +258,38 @@ static void test_interrupt_timeout(test_t *t) {
   pn_proactor_free(p);
 }
 
+/* Test that pn_proactor_wait_batches returns separate ready batches */
+static void test_wait_batches(test_t *t) {
+  pn_proactor_t *p = pn_proactor();
+  pn_event_batch_t *batches[4];
+  pn_proactor_interrupt(p);
+  TEST_CHECK(t, pn_proactor_wait_batches(p, batches, 4) == 1);
+  TEST_ETYPE_EQUAL(t, PN_PROACTOR_INTERRUPT, pn_event_type(pn_event_batch_next(batches[0])));
+  pn_proactor_done(p, batches[0]);
+
+  /* Two refused connections, run till both are closed */
+  test_port_t port = test_port(localhost);          /* Hold a port */
+  pn_proactor_connect(p, pn_connection(), port.host_port);
+  pn_proactor_connect(p, pn_connection(), port.host_port);
+  int closed = 0;
+  while (closed < 2 && !t->errors) {
+    size_t n = pn_proactor_wait_batches(p, batches, 4);
+    TEST_CHECK(t, n >= 1 && n <= 4);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        TEST_CHECK(t, batches[i] != batches[j]);
+      }
+      pn_event_t *e;
+      while ((e = pn_event_batch_next(batches[i]))) {
+        if (pn_event_type(e) == PN_TRANSPORT_CLOSED) ++closed;
+      }
+      pn_proactor_done(p, batches[i]);
+    }
+  }
+  sock_close(port.sock);
+  pn_proactor_free(p);
+}
+
 /* Save the last connection accepted by the common_handler */
 pn_connection_t *last_accepted = NULL;
 
@@ -359,6 +391,26 @@ static void test_client_server(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+#ifndef _WIN32
+/* Per-thread pollers spread over NUMA nodes, or one poller per node */
+static void test_client_server_numa(test_t *t) {
+  setenv("PN_PROACTOR_NUMA", "1", 1);
+  for (int pollers = 0; pollers <= 3; pollers += 3) {
+    char n[8];
+    snprintf(n, sizeof(n), "%d", pollers);
+    setenv("PN_PROACTOR_POLLERS", n, 1);
+    test_proactor_t tps[] ={ test_proactor(t, open_close_handler), test_proactor(t, common_handler) };
+    test_listener_t l = test_listen(&tps[1], localhost);
+    pn_proactor_connect(tps[0].proactor, pn_connection(), l.port.host_port);
+    TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+    TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+    TEST_PROACTORS_DESTROY(tps);
+  }
+  unsetenv("PN_PROACTOR_POLLERS");
+  unsetenv("PN_PROACTOR_NUMA");
+}
+#endif
+
 /* Return on connection open, close and return on wake */
 static pn_event_type_t open_wake_handler(test_handler_t *th, pn_event_t *e) {
   switch (pn_event_type(e)) {
@@ -372,6 +424,138 @@ static pn_event_type_t open_wake_handler(test_handler_t *th, pn_event_t *e) {
   }
 }
 
+static pn_event_type_t wake_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+   case PN_CONNECTION_WAKE:
+    return pn_event_type(e);
+   default:
+    return common_handler(th, e);
+  }
+}
+
+/* Wake the connection from its own batch until it has been woken turns times */
+static pn_event_type_t self_wake_handler(test_handler_t *th, pn_event_t *e) {
+  int *wakes = (int*)th->context;
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_wake(pn_event_connection(e));
+    return PN_EVENT_NONE;
+   case PN_CONNECTION_WAKE:
+    if (--*wakes > 0) {
+      pn_connection_wake(pn_event_connection(e));
+      return PN_EVENT_NONE;
+    }
+    return pn_event_type(e);
+   default:
+    return common_handler(th, e);
+  }
+}
+
+/* Time uncontended connection turns: each wake is one turn from the wake list
+   to the application and back via pn_proactor_done() */
+static void test_wake_turns(test_t *t) {
+  const int turns = 10000;
+  test_proactor_t tps[] =  { test_proactor(t, wake_handler), test_proactor(t, listen_handler) };
+  pn_proactor_t *client = tps[0].proactor;
+  test_listener_t l = test_listen(&tps[1], localhost);
+
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect(client, c, l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  pn_millis_t start = pn_proactor_now();
+  int i;
+  for (i = 0; i < turns; ++i) {
+    pn_connection_wake(c);
+    if (!TEST_ETYPE_EQUAL(t, PN_CONNECTION_WAKE, test_proactors_run(&tps[0], 1)))
+      break;
+    test_handler_keep(&tps[0].handler, 0);
+  }
+  pn_millis_t elapsed = pn_proactor_now() - start;
+  TEST_CHECK(t, i == turns);
+  TEST_LOGF(t, "%d wake turns in %u ms (%lu turns/sec)", i, (unsigned)elapsed,
+            (unsigned long)i * 1000 / (elapsed ? elapsed : 1));
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+#ifndef _WIN32
+/* Latency statistics are kept with PN_PROACTOR_STATS set */
+static void test_stats(test_t *t) {
+  const int turns = 100;
+  pn_proactor_stats_t stats;
+  unsetenv("PN_PROACTOR_STATS");
+  pn_proactor_t *plain = pn_proactor();
+  TEST_CHECK(t, PN_STATE_ERR == pn_proactor_stats(plain, &stats));
+  pn_proactor_free(plain);
+
+  setenv("PN_PROACTOR_STATS", "1", 1);
+  test_proactor_t tps[] =  { test_proactor(t, wake_handler), test_proactor(t, listen_handler) };
+  unsetenv("PN_PROACTOR_STATS");
+  pn_proactor_t *client = tps[0].proactor;
+  test_listener_t l = test_listen(&tps[1], localhost);
+
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect(client, c, l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  for (int i = 0; i < turns; ++i) {
+    pn_connection_wake(c);
+    if (!TEST_ETYPE_EQUAL(t, PN_CONNECTION_WAKE, test_proactors_run(&tps[0], 1)))
+      break;
+    test_handler_keep(&tps[0].handler, 0);
+  }
+
+  TEST_CHECK(t, 0 == pn_connection_proactor_stats(c, &stats));
+  TEST_CHECKF(t, stats.wake.count >= (uint64_t)turns, "%lu wakes", (unsigned long)stats.wake.count);
+  TEST_CHECK(t, stats.batch.count >= stats.wake.count); /* Each wake runs in a batch */
+  TEST_CHECK(t, stats.dispatch.count > 0);
+  TEST_CHECK(t, stats.flush.count > 0);
+  TEST_CHECK(t, stats.batch.max > 0 && stats.batch.total >= stats.batch.max);
+  uint64_t counted = 0;
+  for (int i = 0; i < PN_PROACTOR_HISTOGRAM_BUCKETS; ++i)
+    counted += stats.batch.buckets[i];
+  TEST_CHECK(t, counted == stats.batch.count);
+
+  pn_proactor_stats_t all;
+  TEST_CHECK(t, 0 == pn_proactor_stats(client, &all));
+  TEST_CHECK(t, all.batch.count >= stats.batch.count);
+  TEST_CHECK(t, 0 == pn_proactor_stats(tps[1].proactor, &all));
+  TEST_CHECK(t, all.batch.count > 0);
+  TEST_PROACTORS_DESTROY(tps);
+
+  /* Wakes posted during a batch are run by the same thread without the wake list */
+  setenv("PN_PROACTOR_STATS", "1", 1);
+  int wakes = turns;
+  test_proactor_t ltps[] =  { test_proactor(t, self_wake_handler), test_proactor(t, listen_handler) };
+  unsetenv("PN_PROACTOR_STATS");
+  bool local_wake = (0 == pn_proactor_set_option(ltps[0].proactor, PN_PROACTOR_LOCAL_WAKE, 1));
+  ltps[0].handler.context = &wakes;
+  l = test_listen(&ltps[1], localhost);
+  c = pn_connection();
+  pn_proactor_connect(ltps[0].proactor, c, l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_WAKE, TEST_PROACTORS_RUN(ltps));
+  TEST_CHECK(t, 0 == wakes);
+  TEST_CHECK(t, 0 == pn_connection_proactor_stats(c, &stats));
+  if (local_wake)
+    TEST_CHECKF(t, stats.wake.count < (uint64_t)turns, "%lu wakes", (unsigned long)stats.wake.count);
+  else
+    TEST_LOGF(t, "Skip local wake check, not supported by this proactor");
+  TEST_PROACTORS_DESTROY(ltps);
+
+  /* Percentiles are bucket upper bounds, limited by the max */
+  pn_proactor_histogram_t h;
+  memset(&h, 0, sizeof(h));
+  TEST_CHECK(t, 0 == pn_proactor_histogram_percentile(&h, 50));
+  h.count = 4;
+  h.buckets[3] = 3;             /* 5..8ns */
+  h.buckets[10] = 1;            /* 513..1024ns */
+  h.max = 1000;
+  TEST_CHECK(t, 8 == pn_proactor_histogram_percentile(&h, 50));
+  TEST_CHECK(t, 8 == pn_proactor_histogram_percentile(&h, 75));
+  TEST_CHECK(t, 1000 == pn_proactor_histogram_percentile(&h, 99));
+  TEST_CHECK(t, 1000 == pn_proactor_histogram_percentile(&h, 100));
+}
+#endif
+
 /* Test waking up a connection that is idle */
 static void test_connection_wake(test_t *t) {
   test_proactor_t tps[] =  { test_proactor(t, open_wake_handler), test_proactor(t,  listen_handler) };
@@ -409,6 +593,67 @@ static void test_connection_wake(test_t *t) {
   pn_decref(c);
 }
 
+/* Set a short local idle timeout on the connection transport */
+static pn_event_type_t idle_timeout_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_BOUND:
+    pn_transport_set_idle_timeout(pn_event_transport(e), 100);
+    return PN_EVENT_NONE;
+   default:
+    return common_handler(th, e);
+  }
+}
+
+/* Return on connection remote open */
+static pn_event_type_t open_idle_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    return pn_event_type(e);
+   default:
+    return idle_timeout_handler(th, e);
+  }
+}
+
+/* Test that connection timers fire: once open the server proactor is not run so the client idles out */
+static void test_idle_timeout(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, open_idle_handler), test_proactor(t, listen_handler) };
+  test_listener_t l = test_listen(&tps[1], localhost);
+  pn_proactor_connect(tps[0].proactor, pn_connection(), l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, test_proactors_run(&tps[0], 1));
+  TEST_COND_NAME(t, "amqp:resource-limit-exceeded", last_condition);
+  TEST_COND_DESC(t, "local-idle-timeout expired", last_condition);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+/* Listen with a 2s local idle timeout on the accepted connection, so the
+   remote sends a keepalive every 500ms and may be late by seconds */
+static pn_event_type_t listen_idle_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_BOUND:
+    pn_transport_set_idle_timeout(pn_event_transport(e), 2000);
+    return PN_EVENT_NONE;
+   default:
+    return listen_handler(th, e);
+  }
+}
+
+/* Test that keepalive frames from the connection timer hold off the remote idle timeout */
+static void test_idle_heartbeat(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, open_wake_handler), test_proactor(t, listen_idle_handler) };
+  test_listener_t l = test_listen(&tps[1], localhost);
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect(tps[0].proactor, c, l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  uint64_t frames = pn_transport_get_frames_output(pn_connection_transport(c));
+  /* Four keepalives are due in the window, a loaded host still sends two */
+  pn_proactor_set_timeout(tps[0].proactor, 2000);
+  TEST_ETYPE_EQUAL(t, PN_PROACTOR_TIMEOUT, TEST_PROACTORS_RUN(tps));
+  uint64_t sent = pn_transport_get_frames_output(pn_connection_transport(c)) - frames;
+  TEST_CHECKF(t, sent >= 2, "%d keepalive frames", (int)sent);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 /* Close the transport to abort a connection, i.e. close the socket without an AMQP close */
 static pn_event_type_t listen_abort_handler(test_handler_t *th, pn_event_t *e) {
   switch (pn_event_type(e)) {
@@ -711,6 +956,109 @@ static void test_release_free(test_t *t) {
   pn_connection_free(pn_connection());
 }
 
+static size_t backlog_max = 0;
+
+/* Accept every connection, note the largest backlog seen and return on each accept */
+static pn_event_type_t backlog_handler(test_handler_t *th, pn_event_t *e) {
+  if (pn_event_type(e) == PN_LISTENER_ACCEPT) {
+    size_t backlog = pn_listener_backlog(pn_event_listener(e));
+    if (backlog > backlog_max) backlog_max = backlog;
+    last_accepted = pn_connection();
+    pn_listener_accept(pn_event_listener(e), last_accepted);
+    return PN_LISTENER_ACCEPT;
+  }
+  return listen_handler(th, e);
+}
+
+/* Connections that arrive together are all accepted and counted in the backlog */
+static void test_accept_backlog(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, common_handler), test_proactor(t, backlog_handler) };
+  test_listener_t l = test_listen(&tps[1], localhost);
+  const int n = 4;
+  for (int i = 0; i < n; ++i)
+    pn_proactor_connect(tps[0].proactor, pn_connection(), l.port.host_port);
+  while (test_proactors_get(&tps[0], 1))
+    ;
+  backlog_max = 0;
+  for (int i = 0; i < n; ++i)
+    TEST_ETYPE_EQUAL(t, PN_LISTENER_ACCEPT, test_proactors_run(&tps[1], 1));
+  TEST_CHECK(t, backlog_max >= 1);
+  TEST_CHECK(t, backlog_max <= (size_t)n);
+  TEST_CHECK(t, pn_listener_backlog(l.listener) == 0);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+static pn_event_type_t count_accept_handler(test_handler_t *th, pn_event_t *e) {
+  if (pn_event_type(e) == PN_LISTENER_ACCEPT) {
+    ++*(int*)th->context;
+    pn_listener_accept(pn_event_listener(e), pn_connection());
+    return PN_LISTENER_ACCEPT;
+  }
+  return listen_handler(th, e);
+}
+
+/* Listeners on two proactors share a port and both get connections */
+static void test_reuseport(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, common_handler),
+                            test_proactor(t, count_accept_handler),
+                            test_proactor(t, count_accept_handler) };
+  int accepted[2] = { 0, 0 };
+  tps[1].handler.context = &accepted[0];
+  tps[2].handler.context = &accepted[1];
+  test_port_t port = test_port(localhost);
+  pn_listener_t *l[2];
+  for (int i = 0; i < 2; ++i) {
+    l[i] = pn_listener();
+    if (pn_listener_set_reuseport(l[i], true)) {
+      TEST_LOGF(t, "Skip reuseport test, not supported by this proactor");
+      pn_listener_free(l[i]);
+      if (i) pn_listener_close(l[0]);
+      sock_close(port.sock);
+      TEST_PROACTORS_DESTROY(tps);
+      return;
+    }
+    pn_proactor_listen(tps[i+1].proactor, l[i], port.host_port, 16);
+    TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[i+1], 1));
+    if (!i) sock_close(port.sock);
+  }
+
+  /* A listener that does not ask to share the port is refused */
+  pn_listener_t *other = pn_listener();
+  pn_proactor_listen(tps[1].proactor, other, port.host_port, 16);
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_CLOSE, test_proactors_run(&tps[1], 1));
+  TEST_COND_DESC(t, "in use", last_condition);
+
+  const int n = 32;
+  for (int i = 0; i < n; ++i)
+    pn_proactor_connect(tps[0].proactor, pn_connection(), port.host_port);
+  while (accepted[0] + accepted[1] < n)
+    TEST_PROACTORS_GET(tps);
+  TEST_CHECKF(t, accepted[0] > 0 && accepted[1] > 0, "accepted %d and %d", accepted[0], accepted[1]);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+/* Connections to the same host name share a lookup, later ones use the cache */
+static void test_resolve(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, open_close_handler), test_proactor(t, listen_handler) };
+  test_listener_t l = test_listen(&tps[1], localhost);
+  const char *addr = test_port_use_host(&l.port, "localhost");
+  const int n = 10;
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < n; ++i)
+      pn_proactor_connect(tps[0].proactor, pn_connection(), addr);
+    int closed = 0;
+    while (closed < 2 * n) {    /* Both ends of each connection */
+      pn_event_type_t e = TEST_PROACTORS_RUN(tps);
+      if (e == PN_PROACTOR_INACTIVE) continue; /* Client done first */
+      if (!TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, e)) break;
+      TEST_COND_EMPTY(t, last_condition);
+      ++closed;
+    }
+  }
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 /* TODO aconway 2017-03-27: need windows version with .p12 certs */
 #define CERTFILE(NAME) CMAKE_CURRENT_SOURCE_DIR "/ssl_certs/" NAME ".pem"
 
@@ -768,6 +1116,199 @@ static void test_ssl(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+
+/* Threads serving one proactor, counting client connections opened */
+typedef struct handshake_server_t {
+  pn_proactor_t *proactor;
+  test_t *t;
+  int opened;                   /* atomic */
+} handshake_server_t;
+
+static void *handshake_serve(void *arg) {
+  handshake_server_t *hs = (handshake_server_t*)arg;
+  for (;;) {
+    pn_event_batch_t *eb = pn_proactor_wait(hs->proactor);
+    bool stop = false;
+    for (pn_event_t *e = pn_event_batch_next(eb); e; e = pn_event_batch_next(eb)) {
+      pn_connection_t *c = pn_event_connection(e);
+      switch (pn_event_type(e)) {
+       case PN_LISTENER_ACCEPT:
+        pn_listener_accept(pn_event_listener(e), pn_connection());
+        break;
+       case PN_CONNECTION_BOUND: {
+         bool incoming = (pn_connection_state(c) & PN_LOCAL_UNINIT);
+         pn_ssl_domain_t *ssld = pn_ssl_domain(incoming ? PN_SSL_MODE_SERVER : PN_SSL_MODE_CLIENT);
+         if (incoming)
+           pn_ssl_domain_set_credentials(ssld, CERTFILE("tserver-certificate"), CERTFILE("tserver-private-key"), "tserverpw");
+         pn_ssl_init(pn_ssl(pn_event_transport(e)), ssld, NULL);
+         pn_ssl_domain_free(ssld);
+         if (!incoming) pn_connection_open(c);
+         break;
+       }
+       case PN_CONNECTION_REMOTE_OPEN:
+        if (pn_connection_state(c) & PN_LOCAL_ACTIVE) {
+          __atomic_add_fetch(&hs->opened, 1, __ATOMIC_SEQ_CST);
+          pn_connection_close(c);
+        } else {
+          pn_connection_open(c);
+        }
+        break;
+       case PN_CONNECTION_REMOTE_CLOSE:
+        pn_connection_close(c);
+        break;
+       case PN_PROACTOR_INTERRUPT:
+        pn_proactor_interrupt(hs->proactor); /* Interrupts coalesce, pass it on */
+        stop = true;
+        break;
+       default:
+        break;
+      }
+    }
+    pn_proactor_done(hs->proactor, eb);
+    if (stop) return NULL;
+  }
+}
+
+/* Many SSL connections opened at once over several threads all complete with
+   one handshake slot per proactor */
+static void test_ssl_handshake_max(test_t *t) {
+  if (!pn_ssl_present()) {
+    TEST_LOGF(t, "Skip SSL test, no support");
+    return;
+  }
+  enum { THREADS = 4, CONNECTIONS = 32 };
+  pn_ssl_domain_free(pn_ssl_domain(PN_SSL_MODE_CLIENT)); /* SSL library init is not thread safe */
+  handshake_server_t server = { pn_proactor(), t, 0 }, client = { pn_proactor(), t, 0 };
+  pn_proactor_set_option(server.proactor, PN_PROACTOR_HANDSHAKE_MAX, 1);
+  pn_proactor_set_option(client.proactor, PN_PROACTOR_HANDSHAKE_MAX, 1);
+  test_port_t port = test_port(localhost);
+  pn_proactor_listen(server.proactor, pn_listener(), port.host_port, CONNECTIONS);
+  sock_close(port.sock);
+  pthread_t threads[2 * THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, handshake_serve, &server);
+    pthread_create(&threads[THREADS + i], NULL, handshake_serve, &client);
+  }
+  for (int i = 0; i < CONNECTIONS; ++i)
+    pn_proactor_connect(client.proactor, pn_connection(), port.host_port);
+  for (int ms = 0; ms < 20000 && __atomic_load_n(&client.opened, __ATOMIC_SEQ_CST) < CONNECTIONS; ms += 10)
+    usleep(10 * 1000);
+  TEST_CHECKF(t, CONNECTIONS == client.opened, "%d opened", client.opened);
+  pn_proactor_interrupt(server.proactor);
+  pn_proactor_interrupt(client.proactor);
+  for (int i = 0; i < 2 * THREADS; ++i)
+    pthread_join(threads[i], NULL);
+  pn_proactor_free(client.proactor);
+  pn_proactor_free(server.proactor);
+}
+
+/* Wait for batches on a proactor till one has a connection wake */
+static void *wait_wake(void *arg) {
+  pn_proactor_t *p = (pn_proactor_t*)arg;
+  bool woken = false;
+  while (!woken) {
+    pn_event_batch_t *eb = pn_proactor_wait(p);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(eb)))
+      if (pn_event_type(e) == PN_CONNECTION_WAKE) woken = true;
+    pn_proactor_done(p, eb);
+  }
+  return NULL;
+}
+
+/* Options are checked unless the environment overrides them */
+static void test_proactor_options(test_t *t) {
+  pn_proactor_t *p = pn_proactor();
+  if (pn_proactor_set_option(p, PN_PROACTOR_TURN_BYTES, 65536) == PN_STATE_ERR) {
+    TEST_LOGF(t, "Skip options test, not supported by this proactor");
+    pn_proactor_free(p);
+    return;
+  }
+  TEST_CHECK(t, PN_ARG_ERR == pn_proactor_set_option(p, PN_PROACTOR_TURN_BYTES, -1));
+  TEST_CHECK(t, 0 == pn_proactor_set_option(p, PN_PROACTOR_DISPOSITION_LIMIT, -1));
+  TEST_CHECK(t, PN_ARG_ERR == pn_proactor_set_option(p, PN_PROACTOR_SHM_SIZE, 0));
+  TEST_CHECK(t, PN_ARG_ERR == pn_proactor_set_option(p, (pn_proactor_option_t) 1000, 1));
+  setenv("PN_PROACTOR_TURN_BYTES", "1024", 1);
+  TEST_CHECK(t, 0 == pn_proactor_set_option(p, PN_PROACTOR_TURN_BYTES, -1));
+  unsetenv("PN_PROACTOR_TURN_BYTES");
+  pn_proactor_free(p);
+}
+
+/* Wake a connection while a thread spins in pn_proactor_wait(), and after
+   it has given up spinning and blocked */
+static void test_spin_wake(test_t *t) {
+  test_proactor_t tps[] =  { test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
+  pn_proactor_set_option(tps[0].proactor, PN_PROACTOR_SPIN, 50000);
+  pn_proactor_set_option(tps[1].proactor, PN_PROACTOR_SPIN, 50000);
+  pn_proactor_t *client = tps[0].proactor;
+  test_listener_t l = test_listen(&tps[1], localhost);
+
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect(client, c, l.port.host_port);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  TEST_CHECK(t, pn_proactor_get(client) == NULL); /* Should be idle */
+  for (int i = 0; i < 2; ++i) {
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, wait_wake, client);
+    usleep(i ? 200000 : 1000);
+    pn_connection_wake(c);
+    pthread_join(waiter, NULL);
+  }
+  pn_connection_wake(c);        /* Closes the connection */
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_WAKE, TEST_PROACTORS_RUN(tps));
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+#include <sys/resource.h>
+
+/* Out of file descriptors, a listener resets the connections waiting for it
+   and accepts again once there are descriptors to spare */
+static void test_accept_overflow(test_t *t) {
+  test_proactor_t tps[] = { test_proactor(t, common_handler), test_proactor(t, backlog_handler) };
+  test_listener_t l = test_listen(&tps[1], localhost);
+  pn_listener_overflow_t ov;
+  if (pn_listener_overflow(l.listener, &ov)) {
+    TEST_LOGF(t, "Skip overflow test, not counted by this proactor");
+    TEST_PROACTORS_DESTROY(tps);
+    return;
+  }
+  const int n = 2;
+  for (int i = 0; i < n; ++i)
+    pn_proactor_connect(tps[0].proactor, pn_connection(), l.port.host_port);
+  while (test_proactors_get(&tps[0], 1))
+    ;
+
+  /* Use up every descriptor under a lowered limit */
+  struct rlimit saved, low;
+  getrlimit(RLIMIT_NOFILE, &saved);
+  low = saved;
+  if (low.rlim_cur > 256) low.rlim_cur = 256;
+  setrlimit(RLIMIT_NOFILE, &low);
+  int fds[256], nfds = 0;
+  while (nfds < 256 && (fds[nfds] = dup(0)) >= 0)
+    ++nfds;
+  for (int i = 0; i < n; ++i)
+    TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+  pn_listener_overflow(l.listener, &ov);
+  TEST_CHECKF(t, ov.overflows >= 1, "%d overflows", (int)ov.overflows);
+  TEST_CHECKF(t, ov.shed == (uint64_t)n, "%d shed", (int)ov.shed);
+
+  while (nfds)
+    close(fds[--nfds]);
+  setrlimit(RLIMIT_NOFILE, &saved);
+  pn_proactor_connect(tps[0].proactor, pn_connection(), l.port.host_port);
+  TEST_PROACTORS_RUN_UNTIL(tps, PN_LISTENER_ACCEPT);
+  pn_listener_overflow_t after;
+  pn_listener_overflow(l.listener, &after);
+  TEST_CHECK(t, after.shed == ov.shed);
+  TEST_PROACTORS_DESTROY(tps);
+}
+#endif
+
 static void test_proactor_addr(test_t *t) {
   /* Test the address formatter */
   char addr[PN_MAX_ADDR];
@@ -826,6 +1367,22 @@ static void test_parse_addr(test_t *t) {
   TEST_CHECK(t, 0 == pni_parse_addr("", buf, sizeof(buf), &host, &port));
   TEST_CHECKF(t, NULL == host, "expected null, got: %s", host);
   TEST_STR_EQUAL(t, "5672", port);
+
+  TEST_CHECK(t, 0 == pni_parse_addr("unix:/tmp/a:b", buf, sizeof(buf), &host, &port));
+  TEST_STR_EQUAL(t, "/tmp/a:b", pni_unix_path(host, port));
+  TEST_CHECK(t, 0 == pni_parse_addr("unix:@name", buf, sizeof(buf), &host, &port));
+  TEST_STR_EQUAL(t, "@name", pni_unix_path(host, port));
+  TEST_CHECK(t, 0 == pni_parse_addr("unix:5672", buf, sizeof(buf), &host, &port));
+  TEST_STR_EQUAL(t, "unix", host); /* A host called unix */
+  TEST_STR_EQUAL(t, "5672", port);
+  TEST_CHECK(t, NULL == pni_unix_path(host, port));
+
+  TEST_CHECK(t, 0 == pni_parse_addr("inproc:a:b", buf, sizeof(buf), &host, &port));
+  TEST_STR_EQUAL(t, "a:b", pni_inproc_name(host, port));
+  TEST_CHECK(t, 0 == pni_parse_addr("inproc:amqp", buf, sizeof(buf), &host, &port));
+  TEST_STR_EQUAL(t, "amqp", pni_inproc_name(host, port));
+  TEST_CHECK(t, 0 == pni_parse_addr("foo:bar", buf, sizeof(buf), &host, &port));
+  TEST_CHECK(t, NULL == pni_inproc_name(host, port));
 }
 
 /* Test pn_proactor_addr funtions */
@@ -890,6 +1447,87 @@ static void test_netaddr(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+/* Test unix: addresses, a socket file and on Linux an abstract name */
+static void test_unix(test_t *t) {
+#if !defined(_WIN32)
+  char path[64];
+  char addrs[2][80];
+  snprintf(path, sizeof(path), "/tmp/proton-test-%d.sock", (int)getpid());
+  snprintf(addrs[0], sizeof(addrs[0]), "unix:%s", path);
+  snprintf(addrs[1], sizeof(addrs[1]), "unix:@proton-test-%d", (int)getpid());
+#ifdef __linux__
+  size_t n = 2;
+#else
+  size_t n = 1;
+#endif
+  for (size_t i = 0; i < n; ++i) {
+    test_proactor_t tps[] ={ test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
+    pn_listener_t *l = pn_listener();
+    pn_proactor_listen(tps[1].proactor, l, addrs[i], 4);
+    TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+    pn_connection_t *c = pn_connection();
+    pn_proactor_connect(tps[0].proactor, c, addrs[i]);
+    if (TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps))) {
+      char cr[1024], sl[1024];
+      const pn_netaddr_t *na = pn_netaddr_remote(pn_connection_transport(c));
+      pn_netaddr_str(na, cr, sizeof(cr));
+      TEST_STR_EQUAL(t, addrs[i], cr);
+      TEST_CHECK(t, AF_UNIX == pn_netaddr_sockaddr(na)->sa_family);
+      pn_netaddr_str(pn_netaddr_local(pn_connection_transport(last_accepted)), sl, sizeof(sl));
+      TEST_STR_EQUAL(t, addrs[i], sl);
+    } else {
+      TEST_COND_EMPTY(t, last_condition); /* Show the last condition */
+    }
+    pn_listener_close(l);
+    TEST_PROACTORS_DRAIN(tps);
+    TEST_PROACTORS_DESTROY(tps);
+  }
+  TEST_CHECK(t, access(path, F_OK) != 0); /* Removed by pn_listener_close */
+#endif
+}
+
+/* Connections within the process to an "inproc:" listener */
+static void test_inproc(test_t *t) {
+  test_proactor_t tps[] ={ test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
+  const char *addr = "inproc:proton-test";
+  pn_listener_t *l = pn_listener();
+  pn_proactor_listen(tps[1].proactor, l, addr, 4);
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+  if (TEST_PROACTORS_GET(tps) == PN_LISTENER_CLOSE) {
+    TEST_LOGF(t, "Skip inproc test, not supported by this proactor");
+    TEST_PROACTORS_DESTROY(tps);
+    return;
+  }
+
+  /* The name is taken */
+  pn_proactor_listen(tps[1].proactor, pn_listener(), addr, 4);
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_CLOSE, test_proactors_run(&tps[1], 1));
+  TEST_COND_DESC(t, "in use", last_condition);
+
+  /* More connections than the listener accepts in one go */
+  pn_connection_t *c[20];
+  for (size_t i = 0; i < ARRAYLEN(c); ++i) {
+    c[i] = pn_connection();
+    pn_proactor_connect(tps[0].proactor, c[i], addr);
+  }
+  for (size_t i = 0; i < ARRAYLEN(c); ++i)
+    TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  const pn_netaddr_t *na = pn_netaddr_remote(pn_connection_transport(c[0]));
+  TEST_CHECK(t, AF_UNIX == pn_netaddr_sockaddr(na)->sa_family);
+
+  pn_proactor_connect(tps[0].proactor, pn_connection(), "inproc:nosuch");
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+  TEST_COND_DESC(t, "refused", last_condition);
+
+  pn_listener_close(l);
+  TEST_PROACTORS_RUN_UNTIL(tps, PN_LISTENER_CLOSE);
+  pn_proactor_connect(tps[0].proactor, pn_connection(), addr);
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, TEST_PROACTORS_RUN(tps));
+  TEST_COND_DESC(t, "refused", last_condition);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 /* Test pn_proactor_disconnect */
 static void test_disconnect(test_t *t) {
   test_proactor_t tps[] ={ test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
@@ -944,6 +1582,44 @@ static void test_disconnect(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+/* Test pn_proactor_disconnect_async with more connections than one thread's share */
+static void test_disconnect_async(test_t *t) {
+  test_proactor_t tps[] ={ test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
+  pn_proactor_t *client = tps[0].proactor;
+  test_listener_t l = test_listen(&tps[1], localhost);
+
+  enum { CONNECTIONS = 150 };
+  for (int i = 0; i < CONNECTIONS; ++i) {
+    pn_proactor_connect(client, pn_connection(), l.port.host_port);
+    TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  }
+  TEST_PROACTORS_DRAIN(tps);
+
+  pn_condition_t *cond = pn_condition();
+  pn_condition_set_name(cond, "test-name");
+  pn_proactor_disconnect_async(client, cond);
+  pn_condition_free(cond);    /* Copied by the call */
+  int closed = 0;
+  pn_event_type_t et;
+  while ((et = test_proactors_run(&tps[0], 1)) == PN_TRANSPORT_CLOSED) {
+    TEST_COND_NAME(t, "test-name", last_condition);
+    ++closed;
+  }
+  TEST_ETYPE_EQUAL(t, PN_PROACTOR_INACTIVE, et);
+  TEST_CHECKF(t, CONNECTIONS == closed, "%d closed", closed);
+
+  /* Still functional, and a disconnect with nothing to do is harmless */
+  pn_proactor_disconnect_async(client, NULL);
+  pn_proactor_connect(client, pn_connection(), l.port.host_port);
+  while ((et = TEST_PROACTORS_RUN(tps)) == PN_TRANSPORT_CLOSED) /* Server ends of the disconnects */
+    ;
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, et);
+
+  /* Connections no thread took before the proactor is freed are freed with it */
+  pn_proactor_disconnect_async(client, NULL);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 struct message_stream_context {
   pn_link_t *sender;
   pn_delivery_t *dlv;
@@ -1056,24 +1732,166 @@ static void test_message_stream(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+#ifdef __linux__
+/* Send the whole message at once, return PN_DELIVERY when it has all arrived */
+static pn_event_type_t bulk_handler(test_handler_t *th, pn_event_t *e) {
+  struct message_stream_context *ctx = (struct message_stream_context*)th->context;
+  pn_link_t *link = pn_event_link(e);
+  switch (pn_event_type(e)) {
+   case PN_LINK_REMOTE_OPEN:
+    common_handler(th, e);
+    if (pn_link_is_receiver(link)) pn_link_flow(link, 1);
+    return PN_EVENT_NONE;
+
+   case PN_LINK_FLOW:
+    if (pn_link_is_sender(link) && !ctx->dlv && pn_link_credit(link) > 0) {
+      ctx->dlv = pn_delivery(link, pn_dtag("x", 1));
+      TEST_CHECK(th->t, ctx->size == pn_link_send(link, ctx->send_buf.start, ctx->size));
+      ctx->sent = ctx->size;
+      pn_link_advance(link);
+    }
+    return PN_EVENT_NONE;
+
+   case PN_DELIVERY: {
+     pn_delivery_t *dlv = pn_event_delivery(e);
+     ssize_t n = pn_delivery_pending(dlv);
+     rwbytes_ensure(&ctx->recv_buf, ctx->received + n);
+     TEST_ASSERT(n == pn_link_recv(link, ctx->recv_buf.start + ctx->received, n));
+     ctx->received += n;
+     ctx->complete = !pn_delivery_partial(dlv);
+     return ctx->complete ? PN_DELIVERY : PN_EVENT_NONE;
+   }
+
+   case PN_CONNECTION_WAKE:
+    pn_connection_close(pn_event_connection(e));
+    return PN_EVENT_NONE;
+
+   default:
+    return common_handler(th, e);
+  }
+}
+
+/* Connections between the rings of a "shm:" address, much smaller than the message */
+static void test_shm(test_t *t) {
+  test_proactor_t tps[] ={ test_proactor(t, bulk_handler), test_proactor(t, bulk_handler) };
+  pn_proactor_set_option(tps[0].proactor, PN_PROACTOR_SHM_SIZE, 4096);
+  struct message_stream_context ctx = { 0 };
+  tps[0].handler.context = &ctx;
+  tps[1].handler.context = &ctx;
+  char path[64], addr[80];
+  snprintf(path, sizeof(path), "/tmp/proton-test-shm-%d.sock", (int)getpid());
+  snprintf(addr, sizeof(addr), "shm:%s", path);
+  pn_listener_t *l = pn_listener();
+  pn_proactor_listen(tps[1].proactor, l, addr, 4);
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+  if (pn_condition_is_set(pn_listener_condition(l))) {
+    TEST_LOGF(t, "Skip shm test, not supported by this proactor");
+    TEST_PROACTORS_DESTROY(tps);
+    return;
+  }
+
+  ctx.size = 256 * 1024;
+  rwbytes_ensure(&ctx.send_buf, ctx.size);
+  for (ssize_t i = 0; i < ctx.size; ++i)
+    ctx.send_buf.start[i] = (char)(i * 7);
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect(tps[0].proactor, c, addr);
+  pn_session_t *ssn = pn_session(c);
+  pn_session_open(ssn);
+  pn_link_open(pn_sender(ssn, "x"));
+  if (TEST_ETYPE_EQUAL(t, PN_DELIVERY, TEST_PROACTORS_RUN(tps))) {
+    TEST_CHECK(t, ctx.received == ctx.size);
+    TEST_CHECK(t, !memcmp(ctx.send_buf.start, ctx.recv_buf.start, ctx.size));
+    const pn_netaddr_t *na = pn_netaddr_remote(pn_connection_transport(c));
+    TEST_CHECK(t, AF_UNIX == pn_netaddr_sockaddr(na)->sa_family);
+    /* Both ends see a clean close through the rings */
+    pn_connection_wake(c);
+    TEST_PROACTORS_RUN_UNTIL(tps, PN_TRANSPORT_CLOSED);
+    TEST_COND_EMPTY(t, last_condition);
+    TEST_PROACTORS_RUN_UNTIL(tps, PN_TRANSPORT_CLOSED);
+    TEST_COND_EMPTY(t, last_condition);
+  } else {
+    TEST_COND_EMPTY(t, last_condition); /* Show the last condition */
+  }
+
+  TEST_PROACTORS_DRAIN(tps);
+  TEST_CHECK(t, access(path, F_OK) != 0); /* common_handler closed the listener */
+  free(ctx.send_buf.start);
+  free(ctx.recv_buf.start);
+  TEST_PROACTORS_DESTROY(tps);
+}
+#endif
+
+#ifndef _WIN32
+/* The message stream with output flushed mid-batch sent with MSG_MORE */
+static void test_message_stream_write_more(test_t *t) {
+  setenv("PN_PROACTOR_WRITE_MORE", "1", 1);
+  setenv("PN_PROACTOR_HOG_MAX", "4", 1);
+  test_message_stream(t);
+  unsetenv("PN_PROACTOR_HOG_MAX");
+  unsetenv("PN_PROACTOR_WRITE_MORE");
+}
+
+/* Edge-triggered connections and wakes, including over several threads */
+static void test_edge(test_t *t) {
+  setenv("PN_PROACTOR_EDGE", "1", 1);
+  test_client_server(t);
+  test_connection_wake(t);
+  test_message_stream(t);
+  test_ssl_handshake_max(t);
+  unsetenv("PN_PROACTOR_EDGE");
+}
+#endif
+
 int main(int argc, char **argv) {
   int failed = 0;
   last_condition = pn_condition();
   RUN_ARGV_TEST(failed, t, test_inactive(&t));
   RUN_ARGV_TEST(failed, t, test_interrupt_timeout(&t));
+  RUN_ARGV_TEST(failed, t, test_wait_batches(&t));
   RUN_ARGV_TEST(failed, t, test_errors(&t));
   RUN_ARGV_TEST(failed, t, test_client_server(&t));
+#ifndef _WIN32
+  RUN_ARGV_TEST(failed, t, test_client_server_numa(&t));
+#endif
   RUN_ARGV_TEST(failed, t, test_connection_wake(&t));
+  RUN_ARGV_TEST(failed, t, test_wake_turns(&t));
+#ifndef _WIN32
+  RUN_ARGV_TEST(failed, t, test_stats(&t));
+#endif
+  RUN_ARGV_TEST(failed, t, test_idle_timeout(&t));
+  RUN_ARGV_TEST(failed, t, test_idle_heartbeat(&t));
   RUN_ARGV_TEST(failed, t, test_ipv4_ipv6(&t));
   RUN_ARGV_TEST(failed, t, test_release_free(&t));
+  RUN_ARGV_TEST(failed, t, test_accept_backlog(&t));
+  RUN_ARGV_TEST(failed, t, test_reuseport(&t));
+#ifndef _WIN32
+  RUN_ARGV_TEST(failed, t, test_accept_overflow(&t));
+#endif
+  RUN_ARGV_TEST(failed, t, test_resolve(&t));
   RUN_ARGV_TEST(failed, t, test_ssl(&t));
+#ifndef _WIN32
+  RUN_ARGV_TEST(failed, t, test_ssl_handshake_max(&t));
+  RUN_ARGV_TEST(failed, t, test_proactor_options(&t));
+  RUN_ARGV_TEST(failed, t, test_spin_wake(&t));
+#endif
   RUN_ARGV_TEST(failed, t, test_proactor_addr(&t));
   RUN_ARGV_TEST(failed, t, test_parse_addr(&t));
   RUN_ARGV_TEST(failed, t, test_netaddr(&t));
+  RUN_ARGV_TEST(failed, t, test_unix(&t));
+  RUN_ARGV_TEST(failed, t, test_inproc(&t));
+#ifdef __linux__
+  RUN_ARGV_TEST(failed, t, test_shm(&t));
+#endif
   RUN_ARGV_TEST(failed, t, test_disconnect(&t));
+  RUN_ARGV_TEST(failed, t, test_disconnect_async(&t));
   RUN_ARGV_TEST(failed, t, test_abort(&t));
   RUN_ARGV_TEST(failed, t, test_refuse(&t));
   RUN_ARGV_TEST(failed, t, test_message_stream(&t));
+#ifndef _WIN32
+  RUN_ARGV_TEST(failed, t, test_message_stream_write_more(&t));
+  RUN_ARGV_TEST(failed, t, test_edge(&t));
+#endif
   pn_condition_free(last_condition);
   return failed;
 }
@@ -0,0 +1,434 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Multi-connection proactor scaling benchmark.
+ *
+ * One proactor is served by a pool of threads, like the broker example.
+ * It listens on a loopback port and also makes the client connections:
+ * each client opens a sender and sends its messages as fast as credit
+ * allows, the server side accepts them.  The run ends when every client
+ * has had all its messages accepted and has closed.
+ *
+ * Usage: c-proactor-bench [-c connections] [-t threads] [-n messages per connection]
+ *                         [-s bytes] [-w credit window] [-a address]
+ *
+ * Prints aggregate throughput, latency percentiles and CPU time per
+ * thread.  Latency is from pn_link_send() to the sender seeing the
+ * delivery accepted and settled.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <proton/codec.h>
+#include <proton/condition.h>
+#include <proton/connection.h>
+#include <proton/delivery.h>
+#include <proton/event.h>
+#include <proton/link.h>
+#include <proton/listener.h>
+#include <proton/message.h>
+#include <proton/proactor.h>
+#include <proton/session.h>
+#include <proton/transport.h>
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(clockid_t clock) {
+  struct timespec t;
+  clock_gettime(clock, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* Log-linear histogram of nanosecond values, 16 buckets per power of 2 */
+
+#define HIST_SUB 16
+#define HIST_SIZE (64 * HIST_SUB)
+
+typedef struct histogram_t {
+  uint64_t count[HIST_SIZE];
+  uint64_t total, max;
+} histogram_t;
+
+static size_t hist_index(uint64_t v) {
+  if (v < HIST_SUB) return (size_t)v;
+  int e = 63;
+  while (!(v >> e)) --e;        /* e >= 4 */
+  return (size_t)(e - 3) * HIST_SUB + (size_t)((v >> (e - 4)) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_value(size_t i) {
+  if (i < HIST_SUB) return i;
+  int e = (int)(i / HIST_SUB) + 3;
+  return (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - 4);
+}
+
+static void hist_add(histogram_t *h, uint64_t v) {
+  ++h->count[hist_index(v)];
+  ++h->total;
+  if (v > h->max) h->max = v;
+}
+
+static void hist_merge(histogram_t *h, const histogram_t *from) {
+  for (size_t i = 0; i < HIST_SIZE; ++i) h->count[i] += from->count[i];
+  h->total += from->total;
+  if (from->max > h->max) h->max = from->max;
+}
+
+static uint64_t hist_percentile(const histogram_t *h, double p) {
+  uint64_t want = (uint64_t)(p / 100.0 * h->total + 0.5), seen = 0;
+  for (size_t i = 0; i < HIST_SIZE; ++i) {
+    seen += h->count[i];
+    if (seen >= want && seen) return hist_value(i);
+  }
+  return h->max;
+}
+
+/* Benchmark state */
+
+typedef struct client_t {
+  size_t sent, acked;
+} client_t;
+
+typedef struct bench_t bench_t;
+
+typedef struct worker_t {
+  bench_t *b;
+  pthread_t thread;
+  uint64_t events;
+  uint64_t cpu;                 /* Thread CPU ns */
+  histogram_t latency;
+} worker_t;
+
+struct bench_t {
+  /* Settings */
+  size_t connections, threads, count, window;
+  char addr[PN_MAX_ADDR];
+  pn_rwbytes_t payload;         /* Encoded message */
+
+  pn_proactor_t *proactor;
+  pn_listener_t *listener;
+  client_t *clients;
+  worker_t *workers;
+
+  pthread_mutex_t lock;         /* Protects the fields below */
+  size_t closed;
+  int errors;
+  uint64_t start, end;
+
+  bool finished;
+};
+
+static void check_condition(bench_t *b, pn_event_t *e, pn_condition_t *cond) {
+  if (pn_condition_is_set(cond)) {
+    fprintf(stderr, "%s: %s: %s\n", pn_event_type_name(pn_event_type(e)),
+            pn_condition_get_name(cond), pn_condition_get_description(cond));
+    pthread_mutex_lock(&b->lock);
+    ++b->errors;
+    pthread_mutex_unlock(&b->lock);
+  }
+}
+
+static void send_available(bench_t *b, client_t *c, pn_link_t *l) {
+  while (c->sent < b->count && pn_link_credit(l) > 0) {
+    uint64_t tag = now_ns(CLOCK_MONOTONIC);
+    pn_delivery(l, pn_dtag((const char*)&tag, sizeof(tag)));
+    pn_link_send(l, b->payload.start, b->payload.size);
+    pn_link_advance(l);
+    ++c->sent;
+  }
+}
+
+static void receive(bench_t *b, pn_delivery_t *d) {
+  char buf[64*1024];
+  pn_link_t *l = pn_delivery_link(d);
+  while (pn_link_recv(l, buf, sizeof(buf)) > 0)
+    ;
+  pn_link_advance(l);
+  pn_delivery_update(d, PN_ACCEPTED);
+  pn_delivery_settle(d);
+  if (pn_link_credit(l) <= (int)(b->window / 2)) {
+    pn_link_flow(l, (int)b->window - pn_link_credit(l));
+  }
+}
+
+static void handle(worker_t *w, pn_event_t *e) {
+  bench_t *b = w->b;
+  pn_connection_t *c = pn_event_connection(e);
+  client_t *client = c ? (client_t*)pn_connection_get_context(c) : NULL;
+
+  switch (pn_event_type(e)) {
+
+   case PN_LISTENER_OPEN:
+    pthread_mutex_lock(&b->lock);
+    b->start = now_ns(CLOCK_MONOTONIC);
+    pthread_mutex_unlock(&b->lock);
+    for (size_t i = 0; i < b->connections; ++i) {
+      pn_connection_t *cc = pn_connection();
+      pn_connection_set_context(cc, &b->clients[i]);
+      pn_proactor_connect(b->proactor, cc, b->addr);
+    }
+    break;
+
+   case PN_LISTENER_ACCEPT:
+    pn_listener_accept(pn_event_listener(e), pn_connection());
+    break;
+
+   case PN_LISTENER_CLOSE:
+    check_condition(b, e, pn_listener_condition(pn_event_listener(e)));
+    break;
+
+   case PN_CONNECTION_INIT:
+    if (client) {
+      pn_connection_open(c);
+      pn_session_t *s = pn_session(c);
+      pn_session_open(s);
+      pn_link_open(pn_sender(s, "bench"));
+    }
+    break;
+
+   case PN_CONNECTION_REMOTE_OPEN:
+    if (pn_connection_state(c) & PN_LOCAL_UNINIT) pn_connection_open(c);
+    break;
+
+   case PN_SESSION_REMOTE_OPEN: {
+     pn_session_t *s = pn_event_session(e);
+     if (pn_session_state(s) & PN_LOCAL_UNINIT) pn_session_open(s);
+     break;
+   }
+
+   case PN_LINK_REMOTE_OPEN: {
+     pn_link_t *l = pn_event_link(e);
+     if (pn_link_state(l) & PN_LOCAL_UNINIT) {
+       pn_link_open(l);
+       if (pn_link_is_receiver(l)) pn_link_flow(l, (int)b->window);
+     }
+     break;
+   }
+
+   case PN_LINK_FLOW: {
+     pn_link_t *l = pn_event_link(e);
+     if (client && pn_link_is_sender(l)) send_available(b, client, l);
+     break;
+   }
+
+   case PN_DELIVERY: {
+     pn_delivery_t *d = pn_event_delivery(e);
+     if (client) {
+       if (pn_delivery_settled(d)) {
+         pn_delivery_tag_t tag = pn_delivery_tag(d);
+         uint64_t sent_at;
+         memcpy(&sent_at, tag.start, sizeof(sent_at));
+         hist_add(&w->latency, now_ns(CLOCK_MONOTONIC) - sent_at);
+         if (pn_delivery_remote_state(d) != PN_ACCEPTED) {
+           pthread_mutex_lock(&b->lock);
+           ++b->errors;
+           pthread_mutex_unlock(&b->lock);
+         }
+         pn_delivery_settle(d);
+         if (++client->acked == b->count) pn_connection_close(c);
+       }
+     } else if (pn_delivery_readable(d) && !pn_delivery_partial(d)) {
+       receive(b, d);
+     }
+     break;
+   }
+
+   case PN_CONNECTION_REMOTE_CLOSE:
+    if (!client) pn_connection_close(c);
+    break;
+
+   case PN_TRANSPORT_CLOSED:
+    if (client) {
+      check_condition(b, e, pn_transport_condition(pn_event_transport(e)));
+      pthread_mutex_lock(&b->lock);
+      if (++b->closed == b->connections) {
+        b->end = now_ns(CLOCK_MONOTONIC);
+        pn_listener_close(b->listener);
+      }
+      pthread_mutex_unlock(&b->lock);
+    }
+    break;
+
+   case PN_PROACTOR_INACTIVE:  /* Listener and all connections closed */
+    pn_proactor_interrupt(b->proactor);
+    break;
+
+   case PN_PROACTOR_INTERRUPT:
+    b->finished = true;
+    pn_proactor_interrupt(b->proactor); /* Pass along the interrupt to the other threads */
+    break;
+
+   default:
+    break;
+  }
+}
+
+static void *worker_run(void *arg) {
+  worker_t *w = (worker_t*)arg;
+  bench_t *b = w->b;
+  do {
+    pn_event_batch_t *events = pn_proactor_wait(b->proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(events))) {
+      ++w->events;
+      handle(w, e);
+    }
+    pn_proactor_done(b->proactor, events);
+  } while (!b->finished);
+  w->cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+  return NULL;
+}
+
+/* Find a free loopback port */
+static int free_port(void) {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  int port = -1;
+  if (!bind(sock, (struct sockaddr*)&addr, sizeof(addr)) &&
+      !getsockname(sock, (struct sockaddr*)&addr, &len))
+    port = ntohs(addr.sin_port);
+  close(sock);
+  return port;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-c connections] [-t threads] [-n messages per connection]"
+          " [-s bytes] [-w credit window] [-a address]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  bench_t b;
+  memset(&b, 0, sizeof(b));
+  b.connections = 100;
+  b.threads = 4;
+  b.count = 1000;
+  b.window = 100;
+  size_t size = 100;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc || argv[i][0] != '-') usage(argv[0]);
+    const char *v = argv[i+1];
+    switch (argv[i][1]) {
+     case 'c': b.connections = strtoul(v, NULL, 0); break;
+     case 't': b.threads = strtoul(v, NULL, 0); break;
+     case 'n': b.count = strtoul(v, NULL, 0); break;
+     case 's': size = strtoul(v, NULL, 0); break;
+     case 'w': b.window = strtoul(v, NULL, 0); break;
+     case 'a': snprintf(b.addr, sizeof(b.addr), "%s", v); break;
+     default: usage(argv[0]);
+    }
+  }
+  if (!b.connections || !b.threads || !b.count || !b.window) usage(argv[0]);
+  if (!b.addr[0]) {
+    char port[16];
+    int p = free_port();
+    if (p < 0) {
+      perror("free port");
+      return 1;
+    }
+    snprintf(port, sizeof(port), "%d", p);
+    pn_proactor_addr(b.addr, sizeof(b.addr), "127.0.0.1", port);
+  }
+
+  /* Each connection uses two file descriptors */
+  struct rlimit nofile;
+  if (!getrlimit(RLIMIT_NOFILE, &nofile) && nofile.rlim_cur < nofile.rlim_max) {
+    nofile.rlim_cur = nofile.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &nofile);
+  }
+
+  /* A message with a binary body of the requested size */
+  pn_message_t *m = pn_message();
+  char *body = (char*)calloc(size ? size : 1, 1);
+  pn_data_put_binary(pn_message_body(m), pn_bytes(size, body));
+  b.payload.size = (size_t)pn_message_encoded_size(m);
+  b.payload.start = (char*)malloc(b.payload.size);
+  if (pn_message_encode(m, b.payload.start, &b.payload.size)) {
+    fprintf(stderr, "encode: %s\n", pn_error_text(pn_message_error(m)));
+    return 1;
+  }
+  pn_message_free(m);
+  free(body);
+
+  pthread_mutex_init(&b.lock, NULL);
+  b.clients = (client_t*)calloc(b.connections, sizeof(client_t));
+  b.workers = (worker_t*)calloc(b.threads, sizeof(worker_t));
+  b.proactor = pn_proactor();
+  b.listener = pn_listener();
+  pn_proactor_listen(b.proactor, b.listener, b.addr, (int)b.connections);
+
+  for (size_t i = 0; i < b.threads; ++i) {
+    b.workers[i].b = &b;
+    pthread_create(&b.workers[i].thread, NULL, worker_run, &b.workers[i]);
+  }
+  for (size_t i = 0; i < b.threads; ++i) {
+    pthread_join(b.workers[i].thread, NULL);
+  }
+
+  histogram_t latency;
+  memset(&latency, 0, sizeof(latency));
+  uint64_t cpu = 0;
+  for (size_t i = 0; i < b.threads; ++i) {
+    hist_merge(&latency, &b.workers[i].latency);
+    cpu += b.workers[i].cpu;
+  }
+  double secs = (b.end > b.start ? b.end - b.start : 0) / 1e9;
+  uint64_t total = latency.total;
+
+  printf("connections %zu threads %zu messages %zu size %zu window %zu\n",
+         b.connections, b.threads, b.connections * b.count, size, b.window);
+  printf("%.3f s %.0f msgs/s\n", secs, secs > 0 ? total / secs : 0.0);
+  printf("latency us: p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+         hist_percentile(&latency, 50) / 1e3, hist_percentile(&latency, 99) / 1e3,
+         hist_percentile(&latency, 99.9) / 1e3, latency.max / 1e3);
+  for (size_t i = 0; i < b.threads; ++i) {
+    printf("thread %zu: %llu events, cpu %.3f s\n", i,
+           (unsigned long long)b.workers[i].events, b.workers[i].cpu / 1e9);
+  }
+  printf("cpu %.3f s %.2f us/msg\n", cpu / 1e9, total ? cpu / 1e3 / total : 0.0);
+
+  if (total != b.connections * b.count) {
+    fprintf(stderr, "accepted %llu of %zu messages\n", (unsigned long long)total, b.connections * b.count);
+    ++b.errors;
+  }
+
+  pn_proactor_free(b.proactor);
+  pthread_mutex_destroy(&b.lock);
+  free(b.clients);
+  free(b.workers);
+  free(b.payload.start);
+  return b.errors ? 1 : 0;
+}
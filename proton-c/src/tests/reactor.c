@@ -29,6 +29,7 @@
 #include <proton/url.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define assert(E) ((E) ? 0 : (abort(), 0))
 
@@ -461,7 +462,7 @@ void source_dispatch(pn_handler_t *handler, pn_event_t *event, pn_event_type_t t
   }
 }
 
-static void test_reactor_transfer(int count, int window) {
+static void test_reactor_transfer(int count, int window, size_t max_bytes) {
   pn_reactor_t *reactor = pn_reactor();
 
   pn_handler_t *sh = pn_handler_new(server_dispatch, sizeof(server_t), NULL);
@@ -473,7 +474,7 @@ static void test_reactor_transfer(int count, int window) {
   pn_handler_add(sh, pn_handshaker());
   // XXX: a window of 1 doesn't work unless the flowcontroller is
   // added after the thing that settles the delivery
-  pn_handler_add(sh, pn_flowcontroller(window));
+  pn_handler_add(sh, max_bytes ? pn_flowcontroller_adaptive(window, max_bytes) : pn_flowcontroller(window));
   pn_handler_t *snk = pn_handler_new(sink_dispatch, sizeof(sink_t), NULL);
   sink(snk)->received = 0;
   pn_handler_add(sh, snk);
@@ -549,6 +550,201 @@ static void test_reactor_schedule_cancel(void) {
   pn_free(events);
 }
 
+#ifndef _WIN32
+#include <pthread.h>
+
+/* Connections accepted by one reactor are served by worker reactors on their own threads */
+#define WORKERS 2
+#define WORKER_CONNECTIONS 3
+
+typedef struct {
+  pn_reactor_t *reactor;
+  int opened;
+} worker_t;
+
+static void worker_dispatch(pn_handler_t *handler, pn_event_t *event, pn_event_type_t type) {
+  worker_t *w = (worker_t *) pn_handler_mem(handler);
+  assert(pn_event_reactor(event) == w->reactor);
+  pn_connection_t *conn = pn_event_connection(event);
+  switch (type) {
+  case PN_CONNECTION_REMOTE_OPEN:
+    assert(!pn_connection_acceptor(conn));
+    w->opened++;
+    pn_connection_open(conn);
+    break;
+  case PN_CONNECTION_REMOTE_CLOSE:
+    pn_connection_close(conn);
+    pn_connection_release(conn);
+    break;
+  default:
+    break;
+  }
+}
+
+static void *worker_run(void *arg) {
+  pn_reactor_run((pn_reactor_t *) arg);
+  return NULL;
+}
+
+typedef struct {
+  pn_acceptor_t *acceptor;
+  int closed;
+} accepting_t;
+
+static void accepting_dispatch(pn_handler_t *handler, pn_event_t *event, pn_event_type_t type) {
+  accepting_t *a = (accepting_t *) pn_handler_mem(handler);
+  pn_connection_t *conn = pn_event_connection(event);
+  switch (type) {
+  case PN_CONNECTION_INIT:
+    pn_connection_open(conn);
+    break;
+  case PN_CONNECTION_REMOTE_OPEN:
+    pn_connection_close(conn);
+    break;
+  case PN_CONNECTION_REMOTE_CLOSE:
+    pn_connection_release(conn);
+    if (++a->closed == WORKERS * WORKER_CONNECTIONS) pn_acceptor_close(a->acceptor);
+    break;
+  default:
+    break;
+  }
+}
+
+static void test_reactor_workers(void) {
+  pn_reactor_t *reactor = pn_reactor();
+  pn_reactor_t *workers[WORKERS];
+  pn_handler_t *handlers[WORKERS];
+  for (int i = 0; i < WORKERS; ++i) {
+    workers[i] = pn_reactor();
+    handlers[i] = pn_handler_new(worker_dispatch, sizeof(worker_t), NULL);
+    worker_t *w = (worker_t *) pn_handler_mem(handlers[i]);
+    w->reactor = workers[i];
+    w->opened = 0;
+    pn_handler_add(pn_reactor_get_handler(workers[i]), handlers[i]);
+    assert(pn_reactor_add_worker(reactor, workers[i], NULL) == 0);
+  }
+  pthread_t threads[WORKERS];
+  for (int i = 0; i < WORKERS; ++i) {
+    pthread_create(&threads[i], NULL, worker_run, workers[i]);
+  }
+
+  pn_handler_t *h = pn_handler_new(accepting_dispatch, sizeof(accepting_t), NULL);
+  accepting_t *a = (accepting_t *) pn_handler_mem(h);
+  a->acceptor = pn_reactor_acceptor(reactor, "127.0.0.1", "5679", NULL);
+  assert(a->acceptor);
+  a->closed = 0;
+  for (int i = 0; i < WORKERS * WORKER_CONNECTIONS; ++i) {
+    assert(pn_reactor_connection_to_host(reactor, "127.0.0.1", "5679", h));
+  }
+  pn_reactor_run(reactor);
+  assert(a->closed == WORKERS * WORKER_CONNECTIONS);
+  pn_reactor_free(reactor);     /* Lets the workers finish */
+  pn_decref(h);
+
+  for (int i = 0; i < WORKERS; ++i) {
+    pthread_join(threads[i], NULL);
+    assert(((worker_t *) pn_handler_mem(handlers[i]))->opened == WORKER_CONNECTIONS);
+    pn_reactor_free(workers[i]);
+  }
+}
+#endif
+
+/* Tasks fire in deadline order, then schedule order, and cancelled tasks leave the timer at once */
+static void test_timer(void) {
+  pn_collector_t *collector = pn_collector();
+  pn_timer_t *timer = pn_timer(collector);
+  pn_task_t *tasks[1000];
+  for (intptr_t i = 0; i < 1000; ++i) {
+    tasks[i] = pn_timer_schedule(timer, 100 + (i * 7) % 10);
+    pn_record_t *r = pn_task_attachments(tasks[i]);
+    pn_record_def(r, PN_LEGCTX, PN_VOID);
+    pn_record_set(r, PN_LEGCTX, (void *) i);
+  }
+  assert(pn_timer_tasks(timer) == 1000);
+  assert(pn_timer_deadline(timer) == 100);
+  for (int i = 1; i < 1000; i += 2) pn_task_cancel(tasks[i]);
+  assert(pn_timer_tasks(timer) == 500);
+  for (int i = 0; i < 1000; i += 10) pn_task_cancel(tasks[i]); /* Every deadline 100 task */
+  assert(pn_timer_tasks(timer) == 400);
+  assert(pn_timer_deadline(timer) == 102);
+
+  pn_timer_tick(timer, 105);
+  pn_timestamp_t last = 0;
+  intptr_t last_i = -1;
+  int fired = 0;
+  pn_event_t *e;
+  while ((e = pn_collector_peek(collector))) {
+    assert(pn_event_type(e) == PN_TIMER_TASK);
+    intptr_t i = (intptr_t) pn_record_get(pn_task_attachments((pn_task_t *) pn_event_context(e)), PN_LEGCTX);
+    pn_timestamp_t d = 100 + (i * 7) % 10;
+    assert(i % 2 == 0 && d <= 105);
+    assert(d > last || (d == last && i > last_i));
+    last = d;
+    last_i = i;
+    ++fired;
+    pn_collector_pop(collector);
+  }
+  assert(fired == 200);
+  assert(pn_timer_tasks(timer) == 200 && pn_timer_deadline(timer) == 106);
+  pn_free(timer);
+  pn_collector_free(collector);
+}
+
+/* Many selectables, some made readable and the rest expiring at various deadlines */
+#define SELECTABLES 300
+
+static pn_reactor_t *sel_reactor;
+static int sel_readable_ct, sel_expired_ct;
+
+static void sel_readable(pn_selectable_t *sel) {
+  char buf[8];
+  assert(read(pn_selectable_get_fd(sel), buf, sizeof(buf)) == 1);
+  sel_readable_ct++;
+  pn_selectable_terminate(sel);
+  pn_reactor_update(sel_reactor, sel);
+}
+
+static void sel_expired(pn_selectable_t *sel) {
+  assert(pn_reactor_now(sel_reactor) >= pn_selectable_get_deadline(sel));
+  assert(!pn_selectable_is_terminal(sel));
+  sel_expired_ct++;
+  pn_selectable_terminate(sel);
+  pn_reactor_update(sel_reactor, sel);
+}
+
+static void sel_finalize(pn_selectable_t *sel) {
+  close(pn_selectable_get_fd(sel));
+}
+
+static void test_reactor_selectables(void) {
+  sel_reactor = pn_reactor();
+  sel_readable_ct = sel_expired_ct = 0;
+  int wfds[SELECTABLES];
+  pn_timestamp_t now = pn_reactor_mark(sel_reactor);
+  for (int i = 0; i < SELECTABLES; ++i) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    wfds[i] = fds[1];
+    pn_selectable_t *sel = pn_reactor_selectable(sel_reactor);
+    pn_selectable_set_fd(sel, fds[0]);
+    pn_selectable_set_reading(sel, true);
+    pn_selectable_on_readable(sel, sel_readable);
+    pn_selectable_on_expired(sel, sel_expired);
+    pn_selectable_on_finalize(sel, sel_finalize);
+    if (i % 10 == 0) {
+      assert(write(fds[1], "x", 1) == 1);
+    } else {
+      pn_selectable_set_deadline(sel, now + 1 + (i*7) % 20);
+    }
+    pn_reactor_update(sel_reactor, sel);
+  }
+  pn_reactor_run(sel_reactor);
+  assert(sel_readable_ct == SELECTABLES / 10);
+  assert(sel_expired_ct == SELECTABLES - SELECTABLES / 10);
+  for (int i = 0; i < SELECTABLES; ++i) close(wfds[i]);
+  pn_reactor_free(sel_reactor);
+}
+
 int main(int argc, char **argv)
 {
   test_reactor_event_root();
@@ -567,12 +763,18 @@ int main(int argc, char **argv)
   test_reactor_acceptor_run();
   test_reactor_connect();
   for (int i = 0; i < 64; i++) {
-    test_reactor_transfer(i, 2);
+    test_reactor_transfer(i, 2, 0);
   }
-  test_reactor_transfer(1024, 64);
-  test_reactor_transfer(4*1024, 1024);
+  test_reactor_transfer(1024, 64, 0);
+  test_reactor_transfer(4*1024, 1024, 0);
+  test_reactor_transfer(4*1024, 2, 64*1024);
   test_reactor_schedule();
   test_reactor_schedule_handler();
   test_reactor_schedule_cancel();
+  test_timer();
+#ifndef _WIN32
+  test_reactor_workers();
+#endif
+  test_reactor_selectables();
   return 0;
 }
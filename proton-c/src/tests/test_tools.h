@@ -204,7 +204,8 @@ static const size_t BUF_MIN = 1024;
  */
 size_t message_encode(pn_message_t* m, pn_rwbytes_t *buf) {
   int err = 0;
-  rwbytes_ensure(buf, BUF_MIN);
+  ssize_t needed = pn_message_encoded_size(m);
+  rwbytes_ensure(buf, needed > (ssize_t)BUF_MIN ? (size_t)needed : BUF_MIN);
   size_t size = buf->size;
   while ((err = pn_message_encode(m, buf->start, &size)) != 0) {
     if (err == PN_OVERFLOW) {
@@ -0,0 +1,68 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License
+#
+
+# For use with CMake (target "proactor_scale_c") to show how the proactor
+# scales with connection and thread count.  Runs c-proactor-bench for each
+# combination and prints a table.
+#
+# Usage: python proactor_scale.py <c-proactor-bench> [connections [threads [messages]]]
+#   connections, threads: comma separated lists, default 1,10,100,1000 and 1,2,4,8
+#   messages: total messages per run, default 200000
+#
+# Extra arguments for c-proactor-bench (e.g. "-s 1024 -w 500") may be given
+# in the PN_PSCALE_ARGS environment variable.
+
+from __future__ import print_function
+import os, re, sys
+from subprocess import Popen, PIPE
+
+def ints(arg, default):
+    return [int(x) for x in (arg or default).split(",")]
+
+try:
+    bench = sys.argv[1]
+    connections = ints(len(sys.argv) > 2 and sys.argv[2], "1,10,100,1000")
+    threads = ints(len(sys.argv) > 3 and sys.argv[3], "1,2,4,8")
+    messages = int(len(sys.argv) > 4 and sys.argv[4] or 200000)
+except:
+    print("Usage: python proactor_scale.py <c-proactor-bench> [connections [threads [messages]]]")
+    raise
+
+extra = os.environ.get('PN_PSCALE_ARGS', "").split()
+
+def run(c, t):
+    args = [bench, "-c", str(c), "-t", str(t), "-n", str(max(1, messages // c))] + extra
+    p = Popen(args, stdout=PIPE, stderr=PIPE, universal_newlines=True)
+    out, err = p.communicate()
+    if p.returncode:
+        raise Exception("%s failed (%s): %s" % (" ".join(args), p.returncode, err))
+    rate = float(re.search(r"([0-9.]+) msgs/s", out).group(1))
+    lat = re.search(r"p50 ([0-9.]+) p99 ([0-9.]+) p99.9 ([0-9.]+)", out).groups()
+    cpu = re.search(r"cpu [0-9.]+ s ([0-9.]+) us/msg", out).group(1)
+    thread_cpu = re.findall(r"thread [0-9]+: [0-9]+ events, cpu ([0-9.]+) s", out)
+    return rate, [float(x) for x in lat], float(cpu), [float(x) for x in thread_cpu]
+
+print("%6s %7s %10s %10s %10s %10s %8s  %s" %
+      ("conns", "threads", "msgs/s", "p50 us", "p99 us", "p999 us", "cpu us/m", "cpu s per thread"))
+for c in connections:
+    for t in threads:
+        rate, lat, cpu, thread_cpu = run(c, t)
+        print("%6d %7d %10.0f %10.1f %10.1f %10.1f %8.2f  %s" %
+              (c, t, rate, lat[0], lat[1], lat[2], cpu, " ".join("%.2f" % x for x in thread_cpu)))
+        sys.stdout.flush()
@@ -876,6 +876,23 @@ class TransferTest(Test):
     binary = self.rcv.recv(1024)
     assert binary is None
 
+  def test_recv_into(self):
+    self.rcv.flow(1)
+    self.snd.delivery("tag")
+    msg = str2bin("this is a test")
+    assert self.snd.send(memoryview(msg)) == len(msg)
+    assert self.snd.advance()
+
+    self.pump()
+
+    buf = bytearray(8)
+    view = memoryview(buf)
+    assert self.rcv.recv_into(view) == 8
+    assert bytes(buf) == msg[:8]
+    assert self.rcv.recv_into(view[2:]) == len(msg) - 8
+    assert bytes(buf[2:2 + len(msg) - 8]) == msg[8:]
+    assert self.rcv.recv_into(buf) is None
+
   def test_disposition(self):
     self.rcv.flow(1)
 
@@ -229,6 +229,29 @@ class MessengerTest(Test):
       t = trackers[i]
       assert self.client.status(t) is ACCEPTED
 
+  def testOutgoingSpill(self):
+    self.start()
+    assert self.client.outgoing_spill == 0
+    self.client.outgoing_spill = 1024
+    assert self.client.outgoing_spill == 1024
+    msg = Message()
+    msg.address="amqp://127.0.0.1:%d" % self.port
+    msg.reply_to = "~"
+
+    count = 50
+    for i in range(count):
+      msg.body = "%d %s" % (i, "x"*100)
+      self.client.put(msg)
+    assert self.client.outgoing == count, self.client.outgoing
+    self.client.send()
+
+    reply = Message()
+    for i in range(count):
+      if not self.client.incoming:
+        self.client.recv(count - i)
+      self.client.get(reply)
+      assert reply.body == "%d %s" % (i, "x"*100), reply.body
+
   def testReject(self, process_incoming=None):
     if process_incoming:
       self.process_incoming = process_incoming
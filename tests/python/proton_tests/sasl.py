@@ -208,6 +208,57 @@ class SaslTest(Test):
     out1 = self.t1.peek(1024)
     assert len(out1) > 0
 
+  def testPipelinedOptIn(self):
+    """The first flight of a pipelined client carries SASL-INIT, the AMQP header and OPEN"""
+    self.s1.allowed_mechs('ANONYMOUS')
+    self.s1.pipelined = True
+    c1 = Connection()
+    c1.open()
+    self.t1.bind(c1)
+
+    out1 = self.t1.peek(1024)
+    assert str2bin('AMQP\x03\x01\x00\x00') in out1
+    assert str2bin('ANONYMOUS') in out1
+    assert str2bin('AMQP\x00\x01\x00\x00') in out1
+
+    self.s2.allowed_mechs('ANONYMOUS')
+    c2 = Connection()
+    c2.open()
+    self.t2.bind(c2)
+    self.pump()
+
+    assert self.s1.outcome == SASL.OK
+    assert self.s2.outcome == SASL.OK
+    assert c1.state & Endpoint.REMOTE_ACTIVE
+    assert c2.state & Endpoint.REMOTE_ACTIVE
+
+  def testPipelinedNeedsOneMech(self):
+    """Without a single allowed mechanism a pipelined client waits for the server"""
+    self.s1.pipelined = True
+    c1 = Connection()
+    c1.open()
+    self.t1.bind(c1)
+
+    out1 = self.t1.peek(1024)
+    assert out1 == str2bin('AMQP\x03\x01\x00\x00')
+    assert not self.s1.pipelined
+
+    self.pump()
+    assert self.s1.outcome == SASL.OK
+
+  def testPipelinedMechRefused(self):
+    """A pipelined client fails if the server does not offer its mechanism"""
+    self.s1.allowed_mechs('ANONYMOUS')
+    self.s1.pipelined = True
+    c1 = Connection()
+    c1.open()
+    self.t1.bind(c1)
+    self.s2.allowed_mechs('EXTERNAL')
+    self.pump()
+
+    assert self.s1.outcome != SASL.OK
+    assert self.t1.condition
+
   def testFracturedSASL(self):
     """ PROTON-235
     """
@@ -352,6 +403,22 @@ class SASLMechTest(Test):
     self.t2.bind(self.c2)
     _testSaslMech(self, 'PLAIN')
 
+  def testPLAINCached(self):
+    common.ensureCanTestExtendedSASL()
+
+    self.s2.config_credential_cache(16, 60)
+    try:
+      for password in ['password', 'password', 'wrong']:
+        self.setUp()
+        self.c1.password = password
+        self.s1.allow_insecure_mechs = True
+        self.s2.allow_insecure_mechs = True
+        self.t1.bind(self.c1)
+        self.t2.bind(self.c2)
+        _testSaslMech(self, 'PLAIN', authenticated=(password == 'password'))
+    finally:
+      self.s2.config_credential_cache(0, 0)
+
 # SCRAM not supported before Cyrus SASL 2.1.26
 # so not universal and hance need a test for support
 # to keep it in tests.